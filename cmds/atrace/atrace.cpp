@@ -16,6 +16,7 @@
 
 #define LOG_TAG "atrace"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -26,12 +27,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/utsname.h>
 #include <time.h>
 #include <unistd.h>
 #include <zlib.h>
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <binder/IBinder.h>
 #include <binder/IServiceManager.h>
@@ -41,6 +49,7 @@
 #include <hidl/ServiceManagement.h>
 
 #include <pdx/default_transport/service_utility.h>
+#include <tracering/TraceRing.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
 #include <utils/Tokenizer.h>
@@ -49,6 +58,7 @@
 #include <android-base/macros.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 
 using namespace android;
 using pdx::default_transport::ServiceUtility;
@@ -225,6 +235,7 @@ static int g_traceDurationSeconds = 5;
 static bool g_traceOverwrite = false;
 static int g_traceBufferSizeKB = 2048;
 static bool g_compress = false;
+static bool g_rawTrace = false;
 static bool g_nohup = false;
 static int g_initialSleepSecs = 0;
 static const char* g_categoriesFile = NULL;
@@ -287,6 +298,15 @@ static const char* k_traceStreamPath =
 static const char* k_traceMarkerPath =
     "trace_marker";
 
+static const char* k_eventsPath =
+    "events/";
+
+static const char* k_printkFormatsPath =
+    "printk_formats";
+
+static const char* k_savedCmdlinesPath =
+    "saved_cmdlines";
+
 // Check whether a file exists.
 static bool fileExists(const char* filename) {
     return access((g_traceFolder + filename).c_str(), F_OK) != -1;
@@ -915,21 +935,170 @@ static void stopTrace()
     setTracingEnabled(false);
 }
 
-// Read data from the tracing pipe and forward to stdout
-static void streamTrace()
+// Deflates trace data on a separate thread, so that reading the trace and
+// compressing it overlap. The output is a single zlib stream, the same as
+// compressing the whole trace at once.
+class TraceCompressor {
+public:
+    explicit TraceCompressor(int outFd) : mOutFd(outFd) {}
+
+    ~TraceCompressor() {
+        finish();
+    }
+
+    // Starts the compression thread; returns false on failure.
+    bool start() {
+        memset(&mStream, 0, sizeof(mStream));
+        int result = deflateInit(&mStream, Z_DEFAULT_COMPRESSION);
+        if (result != Z_OK) {
+            fprintf(stderr, "error initializing zlib: %d\n", result);
+            return false;
+        }
+
+        // The thread must not take the signals that abort the trace, since
+        // they are meant to interrupt the reads of the main thread.
+        sigset_t signals, oldSignals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGHUP);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGQUIT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+        mThread = std::thread(&TraceCompressor::run, this);
+        pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+        return true;
+    }
+
+    // Queues data to be compressed, waiting while too much is already queued.
+    // Returns false once compressing or writing failed.
+    bool write(std::vector<uint8_t>&& data) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCond.wait(lock, [this] { return mQueue.size() < kMaxQueued || mFailed; });
+        if (mFailed) {
+            return false;
+        }
+        mQueue.push_back(std::move(data));
+        mCond.notify_all();
+        return true;
+    }
+
+    // Compresses the remaining data and ends the stream.
+    void finish() {
+        if (!mThread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mFinishing = true;
+        }
+        mCond.notify_all();
+        mThread.join();
+
+        int result = deflateEnd(&mStream);
+        if (result != Z_OK && result != Z_DATA_ERROR) {
+            fprintf(stderr, "error cleaning up zlib: %d\n", result);
+        }
+    }
+
+    static constexpr size_t kBufSize = 64*1024;
+
+private:
+    static constexpr size_t kMaxQueued = 16;
+
+    void run() {
+        std::unique_ptr<uint8_t[]> out(new uint8_t[kBufSize]);
+        for (;;) {
+            std::vector<uint8_t> in;
+            bool last;
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mCond.wait(lock, [this] { return !mQueue.empty() || mFinishing; });
+                if (!mQueue.empty()) {
+                    in = std::move(mQueue.front());
+                    mQueue.pop_front();
+                }
+                last = mQueue.empty() && mFinishing;
+            }
+            mCond.notify_all();
+
+            int flush = last ? Z_FINISH : Z_NO_FLUSH;
+            mStream.next_in = in.data();
+            mStream.avail_in = in.size();
+            do {
+                mStream.next_out = reinterpret_cast<Bytef*>(out.get());
+                mStream.avail_out = kBufSize;
+                int result = deflate(&mStream, flush);
+                if (result == Z_STREAM_ERROR) {
+                    fprintf(stderr, "error deflating trace: %s\n", mStream.msg);
+                    fail();
+                    return;
+                }
+                size_t bytes = kBufSize - mStream.avail_out;
+                if (!android::base::WriteFully(mOutFd, out.get(), bytes)) {
+                    fprintf(stderr, "error writing deflated trace: %s (%d)\n",
+                            strerror(errno), errno);
+                    fail();
+                    return;
+                }
+            } while (mStream.avail_out == 0);
+
+            if (last) {
+                return;
+            }
+        }
+    }
+
+    void fail() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFailed = true;
+        mQueue.clear();
+        mCond.notify_all();
+    }
+
+    int mOutFd;
+    z_stream mStream;
+    std::thread mThread;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::deque<std::vector<uint8_t>> mQueue;
+    bool mFinishing = false;
+    bool mFailed = false;
+};
+
+// Read data from the tracing pipe and forward it to the output, compressing it
+// with -z. Since reading consumes the data, the trace can run for as long as
+// needed, even with a small buffer.
+static void streamTrace(int outFd)
 {
-    char trace_data[4096];
     int traceFD = open((g_traceFolder + k_traceStreamPath).c_str(), O_RDWR);
     if (traceFD == -1) {
         fprintf(stderr, "error opening %s: %s (%d)\n", k_traceStreamPath,
                 strerror(errno), errno);
         return;
     }
+
+    TraceCompressor compressor(outFd);
+    if (g_compress) {
+        if (!compressor.start()) {
+            close(traceFD);
+            return;
+        }
+        dprintf(outFd, "TRACE:\n");
+    }
+
     while (!g_traceAborted) {
-        ssize_t bytes_read = read(traceFD, trace_data, 4096);
+        std::vector<uint8_t> trace_data(g_compress ? TraceCompressor::kBufSize : 4096);
+        ssize_t bytes_read = read(traceFD, trace_data.data(), trace_data.size());
         if (bytes_read > 0) {
-            write(STDOUT_FILENO, trace_data, bytes_read);
-            fflush(stdout);
+            if (g_compress) {
+                trace_data.resize(bytes_read);
+                if (!compressor.write(std::move(trace_data))) {
+                    break;
+                }
+            } else {
+                write(outFd, trace_data.data(), bytes_read);
+                fflush(stdout);
+            }
         } else {
             if (!g_traceAborted) {
                 fprintf(stderr, "read returned %zd bytes err %d (%s)\n",
@@ -938,6 +1107,9 @@ static void streamTrace()
             break;
         }
     }
+
+    compressor.finish();
+    close(traceFD);
 }
 
 // Read the current kernel trace and write it to stdout.
@@ -952,81 +1124,29 @@ static void dumpTrace(int outFd)
     }
 
     if (g_compress) {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
-
-        int result = deflateInit(&zs, Z_DEFAULT_COMPRESSION);
-        if (result != Z_OK) {
-            fprintf(stderr, "error initializing zlib: %d\n", result);
-            close(traceFD);
-            return;
-        }
-
-        constexpr size_t bufSize = 64*1024;
-        std::unique_ptr<uint8_t> in(new uint8_t[bufSize]);
-        std::unique_ptr<uint8_t> out(new uint8_t[bufSize]);
-        if (!in || !out) {
-            fprintf(stderr, "couldn't allocate buffers\n");
+        TraceCompressor compressor(outFd);
+        if (!compressor.start()) {
             close(traceFD);
             return;
         }
 
-        int flush = Z_NO_FLUSH;
-
-        zs.next_out = reinterpret_cast<Bytef*>(out.get());
-        zs.avail_out = bufSize;
-
-        do {
-
-            if (zs.avail_in == 0) {
-                // More input is needed.
-                result = read(traceFD, in.get(), bufSize);
-                if (result < 0) {
-                    fprintf(stderr, "error reading trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END;
-                    break;
-                } else if (result == 0) {
-                    flush = Z_FINISH;
-                } else {
-                    zs.next_in = reinterpret_cast<Bytef*>(in.get());
-                    zs.avail_in = result;
-                }
-            }
-
-            if (zs.avail_out == 0) {
-                // Need to write the output.
-                result = write(outFd, out.get(), bufSize);
-                if ((size_t)result < bufSize) {
-                    fprintf(stderr, "error writing deflated trace: %s (%d)\n",
-                            strerror(errno), errno);
-                    result = Z_STREAM_END; // skip deflate error message
-                    zs.avail_out = bufSize; // skip the final write
-                    break;
-                }
-                zs.next_out = reinterpret_cast<Bytef*>(out.get());
-                zs.avail_out = bufSize;
-            }
-
-        } while ((result = deflate(&zs, flush)) == Z_OK);
-
-        if (result != Z_STREAM_END) {
-            fprintf(stderr, "error deflating trace: %s\n", zs.msg);
-        }
-
-        if (zs.avail_out < bufSize) {
-            size_t bytes = bufSize - zs.avail_out;
-            result = write(outFd, out.get(), bytes);
-            if ((size_t)result < bytes) {
-                fprintf(stderr, "error writing deflated trace: %s (%d)\n",
+        for (;;) {
+            std::vector<uint8_t> in(TraceCompressor::kBufSize);
+            ssize_t rc = TEMP_FAILURE_RETRY(read(traceFD, in.data(), in.size()));
+            if (rc < 0) {
+                fprintf(stderr, "error reading trace: %s (%d)\n",
                         strerror(errno), errno);
+                break;
+            } else if (rc == 0) {
+                break;
+            }
+            in.resize(rc);
+            if (!compressor.write(std::move(in))) {
+                break;
             }
         }
 
-        result = deflateEnd(&zs);
-        if (result != Z_OK) {
-            fprintf(stderr, "error cleaning up zlib: %d\n", result);
-        }
+        compressor.finish();
     } else {
         char buf[4096];
         ssize_t rc;
@@ -1044,6 +1164,192 @@ static void dumpTrace(int outFd)
     close(traceFD);
 }
 
+// Appends a little-endian integer of the given size in bytes.
+static void appendInt(std::string* out, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        out->push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+// Appends the format of every event of a system, or of only the enabled ones,
+// as size and contents pairs. Returns the number of formats appended.
+static uint32_t appendEventFormats(std::string* out, const std::string& system,
+        bool onlyEnabled)
+{
+    std::string systemPath = g_traceFolder + k_eventsPath + system + "/";
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(systemPath.c_str()), closedir);
+    if (!dir) {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    while (struct dirent* entry = readdir(dir.get())) {
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string eventPath = systemPath + entry->d_name + "/";
+        std::string enable;
+        if (onlyEnabled && (!android::base::ReadFileToString(eventPath + "enable", &enable) ||
+                enable.empty() || enable[0] != '1')) {
+            continue;
+        }
+        std::string format;
+        if (!android::base::ReadFileToString(eventPath + "format", &format)) {
+            continue;
+        }
+        appendInt(out, format.size(), 8);
+        out->append(format);
+        count++;
+    }
+    return count;
+}
+
+// Read the per-CPU binary trace buffers and write them in the trace-cmd
+// trace.dat (version 6) format, together with the formats of the enabled
+// events, so that host tools like trace-cmd can convert it to text.
+static void dumpRawTrace(int outFd)
+{
+    ALOGI("Dumping raw trace");
+    const size_t pageSize = getpagesize();
+    std::string eventsPath = g_traceFolder + k_eventsPath;
+
+    std::string header("\027\010\104tracing6", 11);
+    header.push_back('\0');
+    header.push_back(0);  // little endian
+    struct utsname uts;
+    bool kernel64 = uname(&uts) == 0 && strstr(uts.machine, "64") != NULL;
+    header.push_back(kernel64 ? 8 : 4);
+    appendInt(&header, pageSize, 4);
+
+    for (const char* name : {"header_page", "header_event"}) {
+        std::string contents;
+        android::base::ReadFileToString(eventsPath + name, &contents);
+        header.append(name, strlen(name) + 1);
+        appendInt(&header, contents.size(), 8);
+        header.append(contents);
+    }
+
+    // The ftrace system has the print event used by userspace tracing, so
+    // all of its formats are always included.
+    std::string events;
+    appendInt(&header, appendEventFormats(&events, "ftrace", false), 4);
+    header.append(events);
+
+    events.clear();
+    uint32_t systems = 0;
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(eventsPath.c_str()), closedir);
+    while (dir) {
+        struct dirent* entry = readdir(dir.get());
+        if (entry == NULL) {
+            break;
+        }
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.' ||
+                !strcmp(entry->d_name, "ftrace")) {
+            continue;
+        }
+        std::string formats;
+        uint32_t count = appendEventFormats(&formats, entry->d_name, true);
+        if (count > 0) {
+            events.append(entry->d_name, strlen(entry->d_name) + 1);
+            appendInt(&events, count, 4);
+            events.append(formats);
+            systems++;
+        }
+    }
+    appendInt(&header, systems, 4);
+    header.append(events);
+
+    appendInt(&header, 0, 4);  // no kallsyms
+    std::string contents;
+    android::base::ReadFileToString(g_traceFolder + k_printkFormatsPath, &contents);
+    appendInt(&header, contents.size(), 4);
+    header.append(contents);
+    contents.clear();
+    android::base::ReadFileToString(g_traceFolder + k_savedCmdlinesPath, &contents);
+    appendInt(&header, contents.size(), 8);
+    header.append(contents);
+
+    // Reading the buffers consumes them, so read every CPU before writing
+    // anything, since the header has the offset and size of each of them.
+    std::vector<std::string> cpuData;
+    for (int cpu = 0; ; cpu++) {
+        std::string path = g_traceFolder + android::base::StringPrintf(
+                "per_cpu/cpu%d/trace_pipe_raw", cpu);
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        if (fd == -1) {
+            if (cpu == 0) {
+                fprintf(stderr, "error opening %s: %s (%d)\n", path.c_str(),
+                        strerror(errno), errno);
+                return;
+            }
+            break;
+        }
+        std::string data;
+        std::unique_ptr<char[]> page(new char[pageSize]);
+        ssize_t rc;
+        while ((rc = TEMP_FAILURE_RETRY(read(fd, page.get(), pageSize))) > 0) {
+            data.append(page.get(), rc);
+            // Keep each page at a page boundary, as readers expect.
+            data.resize((data.size() + pageSize - 1) / pageSize * pageSize);
+        }
+        if (rc == -1 && errno != EAGAIN) {
+            fprintf(stderr, "error reading %s: %s (%d)\n", path.c_str(),
+                    strerror(errno), errno);
+        }
+        close(fd);
+        cpuData.push_back(std::move(data));
+    }
+
+    appendInt(&header, cpuData.size(), 4);
+    header.append("flyrecord", 10);
+    uint64_t offset = header.size() + cpuData.size() * 16;
+    offset = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t dataStart = offset;
+    for (const std::string& data : cpuData) {
+        appendInt(&header, offset, 8);
+        appendInt(&header, data.size(), 8);
+        offset += data.size();
+    }
+    header.resize(dataStart);
+
+    bool ok = android::base::WriteFully(outFd, header.data(), header.size());
+    for (size_t i = 0; ok && i < cpuData.size(); i++) {
+        ok = android::base::WriteFully(outFd, cpuData[i].data(), cpuData[i].size());
+    }
+    if (!ok) {
+        fprintf(stderr, "error writing trace: %s\n", strerror(errno));
+    }
+}
+
+// Write the events recorded in the last |seconds| by processes tracing into
+// in-process rings, in the same text format as the kernel trace.
+static void dumpTraceRings(int outFd, int seconds)
+{
+    nsecs_t since = systemTime(SYSTEM_TIME_BOOTTIME) - seconds_to_nanoseconds(seconds);
+    std::map<pid_t, std::string> threadNames;
+    for (const TraceRing::Event& event : TraceRing::collect(since)) {
+        auto it = threadNames.find(event.tid);
+        if (it == threadNames.end()) {
+            std::string name;
+            if (!android::base::ReadFileToString(android::base::StringPrintf(
+                    "/proc/%d/task/%d/comm", event.pid, event.tid), &name)) {
+                name = "<...>";
+            }
+            name = android::base::Trim(name);
+            it = threadNames.emplace(event.tid, name).first;
+        }
+
+        std::string marker = event.type == 'B'
+                ? android::base::StringPrintf("B|%d|%s", event.pid, event.name.c_str())
+                : android::base::StringPrintf("E|%d", event.pid);
+        dprintf(outFd, "%16.16s-%-5d (%5d) [000] ...1 %5" PRId64 ".%06" PRId64
+                ": tracing_mark_write: %s\n", it->second.c_str(), event.tid, event.pid,
+                event.timestamp / 1000000000, (event.timestamp / 1000) % 1000000,
+                marker.c_str());
+    }
+}
+
 static void handleSignal(int /*signo*/)
 {
     if (!g_nohup) {
@@ -1093,10 +1399,16 @@ static void showHelp(const char *cmd)
                     "  --async_dump    dump the current contents of circular trace buffer\n"
                     "  --async_stop    stop tracing and dump the current contents of circular\n"
                     "                    trace buffer\n"
+                    "  --raw           dump the binary per-CPU trace buffers in the trace-cmd\n"
+                    "                    trace.dat format instead of the text trace\n"
                     "  --stream        stream trace to stdout as it enters the trace buffer\n"
                     "                    Note: this can take significant CPU time, and is best\n"
                     "                    used for measuring things that are not affected by\n"
                     "                    CPU performance, like pagecache usage.\n"
+                    "                    With -z and -o, the trace is compressed to the file\n"
+                    "                    while it is captured, for traces of any length.\n"
+                    "  --ring_dump N   dump the last N seconds of the in-process trace rings\n"
+                    "                    of always-on userspace tracing, and exit\n"
                     "  --list_categories\n"
                     "                  list the available tracing categories\n"
                     " -o filename      write the trace to the specified file instead\n"
@@ -1135,6 +1447,7 @@ int main(int argc, char **argv)
     bool traceDump = true;
     bool traceStream = false;
     bool onlyUserspace = false;
+    int ringDumpSeconds = 0;
 
     if (argc == 2 && 0 == strcmp(argv[1], "--help")) {
         showHelp(argv[0]);
@@ -1156,6 +1469,8 @@ int main(int argc, char **argv)
             {"only_userspace",    no_argument, 0,  0 },
             {"list_categories",   no_argument, 0,  0 },
             {"stream",            no_argument, 0,  0 },
+            {"raw",               no_argument, 0,  0 },
+            {"ring_dump",   required_argument, 0,  0 },
             {           0,                  0, 0,  0 }
         };
 
@@ -1231,6 +1546,14 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "stream")) {
                     traceStream = true;
                     traceDump = false;
+                } else if (!strcmp(long_options[option_index].name, "raw")) {
+                    g_rawTrace = true;
+                } else if (!strcmp(long_options[option_index].name, "ring_dump")) {
+                    ringDumpSeconds = atoi(optarg);
+                    if (ringDumpSeconds <= 0) {
+                        fprintf(stderr, "invalid --ring_dump duration: '%s'\n", optarg);
+                        exit(1);
+                    }
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
@@ -1253,6 +1576,28 @@ int main(int argc, char **argv)
         }
     }
 
+    if (ringDumpSeconds > 0) {
+        int outFd = STDOUT_FILENO;
+        if (g_outputFile) {
+            outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (outFd == -1) {
+            printf("Failed to open '%s', err=%d", g_outputFile, errno);
+            exit(1);
+        }
+        dprintf(outFd, "TRACE:\n");
+        dumpTraceRings(outFd, ringDumpSeconds);
+        if (g_outputFile) {
+            close(outFd);
+        }
+        exit(0);
+    }
+
+    if (g_rawTrace && (traceStream || g_compress)) {
+        fprintf(stderr, "--raw can't be used with --stream or -z\n");
+        exit(1);
+    }
+
     registerSigHandler();
 
     if (g_initialSleepSecs > 0) {
@@ -1301,7 +1646,18 @@ int main(int argc, char **argv)
         }
 
         if (traceStream) {
-            streamTrace();
+            int outFd = STDOUT_FILENO;
+            if (g_outputFile) {
+                outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+            if (outFd == -1) {
+                printf("Failed to open '%s', err=%d", g_outputFile, errno);
+            } else {
+                streamTrace(outFd);
+                if (g_outputFile) {
+                    close(outFd);
+                }
+            }
         }
     }
 
@@ -1320,8 +1676,12 @@ int main(int argc, char **argv)
             if (outFd == -1) {
                 printf("Failed to open '%s', err=%d", g_outputFile, errno);
             } else {
-                dprintf(outFd, "TRACE:\n");
-                dumpTrace(outFd);
+                if (g_rawTrace) {
+                    dumpRawTrace(outFd);
+                } else {
+                    dprintf(outFd, "TRACE:\n");
+                    dumpTrace(outFd);
+                }
                 if (g_outputFile) {
                     close(outFd);
                 }
@@ -20,17 +20,21 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/strings.h>
 
 #include "bugreportz.h"
 
 static constexpr char BEGIN_PREFIX[] = "BEGIN:";
 static constexpr char PROGRESS_PREFIX[] = "PROGRESS:";
+static constexpr char DATA_PREFIX[] = "DATA:";
+static constexpr char OK_PREFIX[] = "OK:";
 
-static void write_line(const std::string& line, bool show_progress) {
+static void write_line(const std::string& line, bool show_progress, int fd = STDOUT_FILENO) {
     if (line.empty()) return;
 
     // When not invoked with the -p option, it must skip BEGIN and PROGRESS lines otherwise it
@@ -39,7 +43,13 @@ static void write_line(const std::string& line, bool show_progress) {
                            android::base::StartsWith(line, BEGIN_PREFIX)))
         return;
 
-    android::base::WriteStringToFd(line, STDOUT_FILENO);
+    android::base::WriteStringToFd(line, fd);
+}
+
+static void close_socket(int s) {
+    if (close(s) == -1) {
+        fprintf(stderr, "WARNING: error closing socket: %s\n", strerror(errno));
+    }
 }
 
 int bugreportz(int s, bool show_progress) {
@@ -71,8 +81,74 @@ int bugreportz(int s, bool show_progress) {
     // Process final line, in case it didn't finish with newline
     write_line(line, show_progress);
 
-    if (close(s) == -1) {
-        fprintf(stderr, "WARNING: error closing socket: %s\n", strerror(errno));
-    }
+    close_socket(s);
     return EXIT_SUCCESS;
 }
+
+int bugreportz_stream(int s, bool show_progress) {
+    std::string line;
+    // Bytes of the current DATA chunk not received yet.
+    size_t data_left = 0;
+    bool ok = false;
+    bool failed = false;
+    while (!failed) {
+        char buffer[65536];
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(s, buffer, sizeof(buffer)));
+        if (bytes_read == 0) {
+            break;
+        } else if (bytes_read == -1) {
+            // EAGAIN really means time out, so change the errno.
+            if (errno == EAGAIN) {
+                errno = ETIMEDOUT;
+            }
+            fprintf(stderr, "FAIL:Bugreport read terminated abnormally (%s)\n", strerror(errno));
+            failed = true;
+            break;
+        }
+
+        for (ssize_t i = 0; i < bytes_read && !failed;) {
+            // Zip data goes straight to stdout...
+            if (data_left > 0) {
+                size_t size = std::min(data_left, static_cast<size_t>(bytes_read - i));
+                if (!android::base::WriteFully(STDOUT_FILENO, buffer + i, size)) {
+                    fprintf(stderr, "FAIL:Could not write bugreport (%s)\n", strerror(errno));
+                    failed = true;
+                    break;
+                }
+                data_left -= size;
+                i += size;
+                continue;
+            }
+
+            // ...and everything else is line by line.
+            char c = buffer[i++];
+            line.append(1, c);
+            if (c != '\n') {
+                continue;
+            }
+            if (android::base::StartsWith(line, DATA_PREFIX)) {
+                std::string size = line.substr(strlen(DATA_PREFIX), line.length() -
+                                               strlen(DATA_PREFIX) - 1);
+                if (!android::base::ParseUint(size, &data_left)) {
+                    fprintf(stderr, "FAIL:Invalid bugreport chunk header: %s", line.c_str());
+                    failed = true;
+                }
+            } else {
+                ok = ok || android::base::StartsWith(line, OK_PREFIX);
+                write_line(line, show_progress, STDERR_FILENO);
+            }
+            line.clear();
+        }
+    }
+    if (!failed) {
+        // Process final line, in case it didn't finish with newline
+        write_line(line, show_progress, STDERR_FILENO);
+        if (data_left > 0) {
+            fprintf(stderr, "FAIL:Bugreport ended %zu bytes short\n", data_left);
+            ok = false;
+        }
+    }
+
+    close_socket(s);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -18,4 +18,8 @@
 // Calls dumpstate using the given socket and output its result to stdout.
 int bugreportz(int s, bool show_progress);
 
+// Calls dumpstate using the given socket, writes the zip it streams to stdout and its other
+// output to stderr. Returns EXIT_FAILURE unless the whole zip was received.
+int bugreportz_stream(int s, bool show_progress);
+
 #endif  // BUGREPORTZ_H
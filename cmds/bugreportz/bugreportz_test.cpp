@@ -26,7 +26,9 @@
 #include "bugreportz.h"
 
 using ::testing::StrEq;
+using ::testing::internal::CaptureStderr;
 using ::testing::internal::CaptureStdout;
+using ::testing::internal::GetCapturedStderr;
 using ::testing::internal::GetCapturedStdout;
 
 class BugreportzTest : public ::testing::Test {
@@ -84,10 +86,31 @@ class BugreportzTest : public ::testing::Test {
         ASSERT_EQ(0, status) << "bugrepotz() call failed (stdout: " << stdout_ << ")";
     }
 
+    void AssertStderrEquals(const std::string& expected) {
+        ASSERT_THAT(stderr_, StrEq(expected)) << "wrong stderr output";
+    }
+
+    // Calls bugreportz_stream() using the internal pipe, like Bugreportz() does, and returns its
+    // status.
+    int BugreportzStream(bool show_progress) {
+        close(write_fd_);
+        write_fd_ = -1;
+
+        CaptureStdout();
+        CaptureStderr();
+        int status = bugreportz_stream(read_fd_, show_progress);
+
+        read_fd_ = -1;  // Closed by bugreportz_stream().
+        stderr_ = GetCapturedStderr();
+        stdout_ = GetCapturedStdout();
+        return status;
+    }
+
   private:
     int read_fd_;
     int write_fd_;
     std::string stdout_;
+    std::string stderr_;
 };
 
 // Tests 'bugreportz', without any argument - it will ignore progress lines.
@@ -126,3 +149,45 @@ TEST_F(BugreportzTest, WithProgress) {
         "PROGRESS:IS NOT AUTOMATIC\n"
         "Newline is optional");
 }
+
+// Tests 'bugreportz -s' - zip data goes to stdout, everything else but progress to stderr.
+TEST_F(BugreportzTest, Stream) {
+    WriteToSocket("BEGIN:I AM YOUR PATH\n");  // Should be ommited.
+    WriteToSocket("DATA:5\nPK\n\x03");
+    WriteToSocket("\x04");
+    WriteToSocket("PROGRESS:IS INEVITABLE\n");  // Should be ommited.
+    WriteToSocket("DA");
+    WriteToSocket("TA:3\nEND");
+    WriteToSocket("OK:I AM YOUR PATH\n");
+
+    ASSERT_EQ(EXIT_SUCCESS, BugreportzStream(false));
+
+    AssertStdoutEquals("PK\n\x03\x04" "END");
+    AssertStderrEquals("OK:I AM YOUR PATH\n");
+}
+
+// Tests 'bugreportz -s -p' - progress goes to stderr along with the result.
+TEST_F(BugreportzTest, StreamWithProgress) {
+    WriteToSocket("BEGIN:I AM YOUR PATH\n");
+    WriteToSocket("PROGRESS:IS INEVITABLE\n");
+    WriteToSocket("DATA:2\nPK");
+    WriteToSocket("OK:I AM YOUR PATH\n");
+
+    ASSERT_EQ(EXIT_SUCCESS, BugreportzStream(true));
+
+    AssertStdoutEquals("PK");
+    AssertStderrEquals(
+        "BEGIN:I AM YOUR PATH\n"
+        "PROGRESS:IS INEVITABLE\n"
+        "OK:I AM YOUR PATH\n");
+}
+
+// Tests 'bugreportz -s' when dumpstate stops in the middle of the zip.
+TEST_F(BugreportzTest, StreamTruncated) {
+    WriteToSocket("DATA:10\nPK");
+
+    ASSERT_EQ(EXIT_FAILURE, BugreportzStream(false));
+
+    AssertStdoutEquals("PK");
+    AssertStderrEquals("FAIL:Bugreport ended 8 bytes short\n");
+}
@@ -26,13 +26,14 @@
 
 #include "bugreportz.h"
 
-static constexpr char VERSION[] = "1.1";
+static constexpr char VERSION[] = "1.2";
 
 static void show_usage() {
     fprintf(stderr,
             "usage: bugreportz [-h | -v]\n"
             "  -h: to display this help message\n"
             "  -p: display progress\n"
+            "  -s: stream the zipped bugreport to stdout instead of writing it to a file\n"
             "  -v: to display the version\n"
             "  or no arguments to generate a zipped bugreport\n");
 }
@@ -43,10 +44,11 @@ static void show_version() {
 
 int main(int argc, char* argv[]) {
     bool show_progress = false;
+    bool stream = false;
     if (argc > 1) {
         /* parse arguments */
         int c;
-        while ((c = getopt(argc, argv, "hpv")) != -1) {
+        while ((c = getopt(argc, argv, "hpsv")) != -1) {
             switch (c) {
                 case 'h':
                     show_usage();
@@ -54,6 +56,9 @@ int main(int argc, char* argv[]) {
                 case 'p':
                     show_progress = true;
                     break;
+                case 's':
+                    stream = true;
+                    break;
                 case 'v':
                     show_version();
                     return EXIT_SUCCESS;
@@ -69,7 +74,7 @@ int main(int argc, char* argv[]) {
     // should be reused instead.
 
     // Start the dumpstatez service.
-    property_set("ctl.start", "dumpstatez");
+    property_set("ctl.start", stream ? "dumpstatez_stream" : "dumpstatez");
 
     // Socket will not be available until service starts.
     int s;
@@ -81,8 +86,9 @@ int main(int argc, char* argv[]) {
     }
 
     if (s == -1) {
-        printf("FAIL:Failed to connect to dumpstatez service: %s\n", strerror(errno));
-        return EXIT_SUCCESS;
+        fprintf(stream ? stderr : stdout, "FAIL:Failed to connect to dumpstatez service: %s\n",
+                strerror(errno));
+        return stream ? EXIT_FAILURE : EXIT_SUCCESS;
     }
 
     // Set a timeout so that if nothing is read in 10 minutes, we'll stop
@@ -95,5 +101,8 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "WARNING: Cannot set socket timeout: %s\n", strerror(errno));
     }
 
+    if (stream) {
+        return bugreportz_stream(s, show_progress);
+    }
     bugreportz(s, show_progress);
 }
@@ -18,22 +18,84 @@
 
 #include "DumpstateSectionReporter.h"
 
+#include <sys/resource.h>
+
+#include <android-base/stringprintf.h>
+
 namespace android {
 namespace os {
 namespace dumpstate {
 
+static std::chrono::microseconds ToMicroseconds(const struct timeval& tv) {
+    return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
+}
+
+/* CPU time used so far by the calling thread and by the children reaped by the process. */
+static std::chrono::microseconds CpuTime() {
+    std::chrono::microseconds total(0);
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        total += ToMicroseconds(usage.ru_utime) + ToMicroseconds(usage.ru_stime);
+    }
+    if (getrusage(RUSAGE_CHILDREN, &usage) == 0) {
+        total += ToMicroseconds(usage.ru_utime) + ToMicroseconds(usage.ru_stime);
+    }
+    return total;
+}
+
+void SectionStatsLog::Add(const SectionStats& stats) {
+    std::lock_guard<std::mutex> lock(lock_);
+    sections_.push_back(stats);
+}
+
+std::string SectionStatsLog::ToCsv() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    std::string csv = "section,status,size,wall_ms,cpu_ms,timed_out\n";
+    for (const SectionStats& stats : sections_) {
+        // Titles are quoted, since they are free form.
+        std::string title;
+        for (char c : stats.title) {
+            if (c == '"') title += '"';
+            title += c;
+        }
+        csv += android::base::StringPrintf("\"%s\",%d,%lld,%lld,%lld,%d\n", title.c_str(),
+                                           stats.status, (long long)stats.size,
+                                           (long long)stats.wall_ms, (long long)stats.cpu_ms,
+                                           stats.timed_out ? 1 : 0);
+    }
+    return csv;
+}
+
 DumpstateSectionReporter::DumpstateSectionReporter(const std::string& title,
                                                    sp<android::os::IDumpstateListener> listener,
-                                                   bool sendReport)
-    : title_(title), listener_(listener), sendReport_(sendReport), status_(OK), size_(-1) {
+                                                   bool sendReport, SectionStatsLog* stats)
+    : title_(title),
+      listener_(listener),
+      sendReport_(sendReport),
+      stats_(stats),
+      status_(OK),
+      size_(-1),
+      timed_out_(false),
+      elapsed_(-1) {
     started_ = std::chrono::steady_clock::now();
+    if (stats_ != nullptr) {
+        started_cpu_ = CpuTime();
+    }
 }
 
 DumpstateSectionReporter::~DumpstateSectionReporter() {
-    if ((listener_ != nullptr) && (sendReport_)) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    auto elapsed = elapsed_;
+    if (elapsed.count() < 0) {
+        elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::steady_clock::now() - started_);
-        listener_->onSectionComplete(title_, status_, size_, (int32_t)elapsed.count());
+    }
+    if ((listener_ != nullptr) && (sendReport_)) {
+        listener_->onSectionComplete(title_, status_, (int32_t)size_, (int32_t)elapsed.count());
+    }
+    if (stats_ != nullptr) {
+        auto cpu = std::chrono::duration_cast<std::chrono::milliseconds>(CpuTime() - started_cpu_);
+        stats_->Add({title_, status_, size_, elapsed.count(), cpu.count(),
+                     timed_out_ || status_ == TIMED_OUT});
     }
 }
 
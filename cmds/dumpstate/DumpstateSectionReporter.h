@@ -17,6 +17,11 @@
 #ifndef ANDROID_OS_DUMPSTATESECTIONREPORTER_H_
 #define ANDROID_OS_DUMPSTATESECTIONREPORTER_H_
 
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <android/os/IDumpstateListener.h>
 #include <utils/StrongPointer.h>
 
@@ -24,20 +29,50 @@ namespace android {
 namespace os {
 namespace dumpstate {
 
+/*
+ * Cost of a single bugreport section.
+ */
+struct SectionStats {
+    std::string title;
+    status_t status;
+    // Bytes produced by the section, or -1 when unknown.
+    int64_t size;
+    int64_t wall_ms;
+    // CPU used by the calling thread and by the child processes it reaped. It is approximate
+    // when sections run concurrently, since reaped children are accounted process-wide.
+    int64_t cpu_ms;
+    bool timed_out;
+};
+
+/*
+ * Thread-safe collection of the SectionStats of a bugreport, in the order sections finished.
+ */
+class SectionStatsLog {
+  public:
+    void Add(const SectionStats& stats);
+
+    /* Returns the sections as CSV, with a header line. */
+    std::string ToCsv() const;
+
+  private:
+    mutable std::mutex lock_;
+    std::vector<SectionStats> sections_;
+};
 
 /*
- * Helper class used to report per section details to a listener.
+ * Helper class used to report per section details to a listener, and to record them in an
+ * optional SectionStatsLog.
  *
  * Typical usage:
  *
- *    DumpstateSectionReporter sectionReporter(title, listener, sendReport);
+ *    DumpstateSectionReporter sectionReporter(title, listener, sendReport, &stats);
  *    sectionReporter.setSize(5000);
  *
  */
 class DumpstateSectionReporter {
   public:
     DumpstateSectionReporter(const std::string& title, sp<android::os::IDumpstateListener> listener,
-                             bool sendReport);
+                             bool sendReport, SectionStatsLog* stats = nullptr);
 
     ~DumpstateSectionReporter();
 
@@ -45,17 +80,31 @@ class DumpstateSectionReporter {
         status_ = status;
     }
 
-    void setSize(int size) {
+    void setSize(int64_t size) {
         size_ = size;
     }
 
+    /* Overrides the wall time of the section, for sections that ran before being reported. */
+    void setElapsed(std::chrono::milliseconds elapsed) {
+        elapsed_ = elapsed;
+    }
+
+    /* Marks the section as timed out; implied by a TIMED_OUT status. */
+    void setTimedOut() {
+        timed_out_ = true;
+    }
+
   private:
     std::string title_;
     android::sp<android::os::IDumpstateListener> listener_;
     bool sendReport_;
+    SectionStatsLog* stats_;
     status_t status_;
-    int size_;
+    int64_t size_;
+    bool timed_out_;
     std::chrono::time_point<std::chrono::steady_clock> started_;
+    std::chrono::milliseconds elapsed_;
+    std::chrono::microseconds started_cpu_;
 };
 
 }  // namespace dumpstate
@@ -729,6 +729,129 @@ static const std::set<std::string> PROBLEMATIC_FILE_EXTENSIONS = {
       ".shb", ".sys", ".vb",  ".vbe", ".vbs", ".vxd", ".wsc", ".wsf", ".wsh"
 };
 
+/*
+ * Reads a zip entry's source fd on its own thread, one chunk ahead of the caller, so that
+ * waiting on the process writing to the fd and compressing what it already wrote overlap.
+ */
+class ZipEntryReader {
+  public:
+    ZipEntryReader(const std::string& entry_name, int fd, std::chrono::milliseconds timeout)
+        : entry_name_(entry_name),
+          fd_(fd),
+          timeout_(timeout),
+          end_(std::chrono::steady_clock::now() + timeout),
+          thread_(&ZipEntryReader::Run, this) {
+    }
+
+    ~ZipEntryReader() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    /*
+     * Returns the size of the next chunk, which stays valid in |*data| until the next call, 0
+     * at the end of the fd, or a negative status_t on failure.
+     */
+    ssize_t Next(const uint8_t** data) {
+        std::unique_lock<std::mutex> lock(lock_);
+        if (holding_) {
+            // The previous chunk was consumed, so the reader may refill it.
+            free_++;
+            cond_.notify_all();
+        }
+        cond_.wait(lock, [this] { return filled_ > 0; });
+        filled_--;
+        holding_ = true;
+        int index = next_read_;
+        next_read_ ^= 1;
+        *data = buffers_[index].data();
+        return results_[index];
+    }
+
+  private:
+    static const int kPollSliceMs = 100;
+
+    void Run() {
+        for (int index = 0;; index ^= 1) {
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                cond_.wait(lock, [this] { return free_ > 0 || stop_; });
+                if (stop_) return;
+                free_--;
+            }
+
+            ssize_t result = ReadChunk(&buffers_[index]);
+
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                results_[index] = result;
+                filled_++;
+            }
+            cond_.notify_all();
+            if (result <= 0) return;
+        }
+    }
+
+    ssize_t ReadChunk(std::vector<uint8_t>* buffer) {
+        if (timeout_.count() > 0) {
+            struct pollfd pfd = {fd_, POLLIN};
+            while (1) {
+                // Poll in slices, so that we notice when the caller gives up on the entry.
+                auto time_left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    end_ - std::chrono::steady_clock::now()).count();
+                int rc = TEMP_FAILURE_RETRY(poll(
+                    &pfd, 1, std::max(std::min(time_left_ms, (long long)kPollSliceMs), 0LL)));
+                if (rc < 0) {
+                    MYLOGE("Error in poll while adding from fd to zip entry %s:%s",
+                           entry_name_.c_str(), strerror(errno));
+                    return -errno;
+                } else if (rc > 0) {
+                    break;
+                } else if (time_left_ms <= 0) {
+                    MYLOGE("Timed out adding from fd to zip entry %s:%s Timeout:%lldms",
+                           entry_name_.c_str(), strerror(errno), timeout_.count());
+                    return TIMED_OUT;
+                }
+                std::lock_guard<std::mutex> lock(lock_);
+                if (stop_) return TIMED_OUT;
+            }
+        }
+
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd_, buffer->data(), buffer->size()));
+        if (bytes_read == -1) {
+            MYLOGE("read(%s): %s\n", entry_name_.c_str(), strerror(errno));
+            return -errno;
+        }
+        return bytes_read;
+    }
+
+    const std::string& entry_name_;
+    const int fd_;
+    const std::chrono::milliseconds timeout_;
+    const std::chrono::steady_clock::time_point end_;
+
+    std::vector<uint8_t> buffers_[2] = {std::vector<uint8_t>(65536), std::vector<uint8_t>(65536)};
+    ssize_t results_[2] = {0, 0};
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    // Buffers the reader may fill, and buffers filled but not yet handed to the caller.
+    int free_ = 2;
+    int filled_ = 0;
+    // Index of the next buffer handed to the caller.
+    int next_read_ = 0;
+    // Whether the caller is holding the buffer returned by the last call to Next().
+    bool holding_ = false;
+    bool stop_ = false;
+
+    // Must be last, since it starts running with the members above.
+    std::thread thread_;
+};
+
 status_t Dumpstate::AddZipEntryFromFd(const std::string& entry_name, int fd,
                                       std::chrono::milliseconds timeout = 0ms) {
     if (!IsZipping()) {
@@ -758,40 +881,16 @@ status_t Dumpstate::AddZipEntryFromFd(const std::string& entry_name, int fd,
                ZipWriter::ErrorCodeString(err));
         return UNKNOWN_ERROR;
     }
-    auto start = std::chrono::steady_clock::now();
-    auto end = start + timeout;
-    struct pollfd pfd = {fd, POLLIN};
-
-    std::vector<uint8_t> buffer(65536);
+    ZipEntryReader reader(entry_name, fd, timeout);
     while (1) {
-        if (timeout.count() > 0) {
-            // lambda to recalculate the timeout.
-            auto time_left_ms = [end]() {
-                auto now = std::chrono::steady_clock::now();
-                auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - now);
-                return std::max(diff.count(), 0LL);
-            };
-
-            int rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, time_left_ms()));
-            if (rc < 0) {
-                MYLOGE("Error in poll while adding from fd to zip entry %s:%s", entry_name.c_str(),
-                       strerror(errno));
-                return -errno;
-            } else if (rc == 0) {
-                MYLOGE("Timed out adding from fd to zip entry %s:%s Timeout:%lldms",
-                       entry_name.c_str(), strerror(errno), timeout.count());
-                return TIMED_OUT;
-            }
-        }
-
-        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
+        const uint8_t* data;
+        ssize_t bytes_read = reader.Next(&data);
         if (bytes_read == 0) {
             break;
-        } else if (bytes_read == -1) {
-            MYLOGE("read(%s): %s\n", entry_name.c_str(), strerror(errno));
-            return -errno;
+        } else if (bytes_read < 0) {
+            return bytes_read;
         }
-        err = zip_writer_->WriteBytes(buffer.data(), bytes_read);
+        err = zip_writer_->WriteBytes(data, bytes_read);
         if (err) {
             MYLOGE("zip_writer_->WriteBytes(): %s\n", ZipWriter::ErrorCodeString(err));
             return UNKNOWN_ERROR;
@@ -884,35 +983,44 @@ static void DoKernelLogcat() {
         CommandOptions::WithTimeoutInMs(timeout_ms).Build());
 }
 
+// Each buffer is read by its own logcat, so they're all read at once and then dumped in order.
 static void DoLogcat() {
     unsigned long timeout_ms;
     // DumpFile("EVENT LOG TAGS", "/etc/event-log-tags");
     // calculate timeout
     timeout_ms = logcat_timeout({"main", "system", "crash"});
-    RunCommand("SYSTEM LOG",
-               {"logcat", "-v", "threadtime", "-v", "printable", "-v", "uid", "-d", "*:v"},
-               CommandOptions::WithTimeoutInMs(timeout_ms).Build());
+    ds.RunCommandInBackground(
+        "SYSTEM LOG",
+        {"logcat", "-v", "threadtime", "-v", "printable", "-v", "uid", "-d", "*:v"},
+        CommandOptions::WithTimeoutInMs(timeout_ms).Build());
     timeout_ms = logcat_timeout({"events"});
-    RunCommand(
+    ds.RunCommandInBackground(
         "EVENT LOG",
         {"logcat", "-b", "events", "-v", "threadtime", "-v", "printable", "-v", "uid", "-d", "*:v"},
         CommandOptions::WithTimeoutInMs(timeout_ms).Build());
     timeout_ms = logcat_timeout({"stats"});
-    RunCommand(
+    ds.RunCommandInBackground(
         "STATS LOG",
         {"logcat", "-b", "stats", "-v", "threadtime", "-v", "printable", "-v", "uid", "-d", "*:v"},
         CommandOptions::WithTimeoutInMs(timeout_ms).Build());
     timeout_ms = logcat_timeout({"radio"});
-    RunCommand(
+    ds.RunCommandInBackground(
         "RADIO LOG",
         {"logcat", "-b", "radio", "-v", "threadtime", "-v", "printable", "-v", "uid", "-d", "*:v"},
         CommandOptions::WithTimeoutInMs(timeout_ms).Build());
 
-    RunCommand("LOG STATISTICS", {"logcat", "-b", "all", "-S"});
+    ds.RunCommandInBackground("LOG STATISTICS", {"logcat", "-b", "all", "-S"});
 
     /* kernels must set CONFIG_PSTORE_PMSG, slice up pstore with device tree */
-    RunCommand("LAST LOGCAT", {"logcat", "-L", "-b", "all", "-v", "threadtime", "-v", "printable",
-                               "-v", "uid", "-d", "*:v"});
+    ds.RunCommandInBackground("LAST LOGCAT", {"logcat", "-L", "-b", "all", "-v", "threadtime",
+                              "-v", "printable", "-v", "uid", "-d", "*:v"});
+
+    ds.WaitForBackgroundCommand("SYSTEM LOG");
+    ds.WaitForBackgroundCommand("EVENT LOG");
+    ds.WaitForBackgroundCommand("STATS LOG");
+    ds.WaitForBackgroundCommand("RADIO LOG");
+    ds.WaitForBackgroundCommand("LOG STATISTICS");
+    ds.WaitForBackgroundCommand("LAST LOGCAT");
 }
 
 static void DumpIpTablesAsRoot() {
@@ -1105,40 +1213,35 @@ static void DumpIpAddrAndRules() {
     RunCommand("IP RULES v6", {"ip", "-6", "rule", "show"});
 }
 
+// Maximum number of services dumped at the same time by RunDumpsysTextByPriority().
+static const size_t kDumpsysMaxJobs = 4;
+
 static void RunDumpsysTextByPriority(const std::string& title, int priority,
                                      std::chrono::milliseconds timeout,
                                      std::chrono::milliseconds service_timeout) {
-    auto start = std::chrono::steady_clock::now();
     sp<android::IServiceManager> sm = defaultServiceManager();
     Dumpsys dumpsys(sm.get());
     Vector<String16> args;
     Dumpsys::setServiceArgs(args, /* asProto = */ false, priority);
     Vector<String16> services = dumpsys.listServices(priority, /* supports_proto = */ false);
-    for (const String16& service : services) {
-        std::string path(title);
-        path.append(" - ").append(String8(service).c_str());
-        DumpstateSectionReporter section_reporter(path, ds.listener_, ds.report_section_);
-        size_t bytes_written = 0;
-        status_t status = dumpsys.startDumpThread(service, args);
-        if (status == OK) {
-            dumpsys.writeDumpHeader(STDOUT_FILENO, service, priority);
-            std::chrono::duration<double> elapsed_seconds;
-            status = dumpsys.writeDump(STDOUT_FILENO, service, service_timeout,
-                                       /* as_proto = */ false, elapsed_seconds, bytes_written);
+    // Services are dumped concurrently, but their sections are still written in order, and all
+    // of them must complete within |timeout|.
+    status_t status = dumpsys.writeDumpsInParallel(
+        STDOUT_FILENO, services, args, priority, /* asProto = */ false, /* addSeparator = */ true,
+        service_timeout, timeout, kDumpsysMaxJobs,
+        [&title](const String16& service, status_t status, size_t bytes_written,
+                 const std::chrono::duration<double>& elapsed_seconds) {
+            std::string path(title);
+            path.append(" - ").append(String8(service).c_str());
+            DumpstateSectionReporter section_reporter(path, ds.listener_, ds.report_section_,
+                                                      &ds.section_stats_);
             section_reporter.setSize(bytes_written);
-            dumpsys.writeDumpFooter(STDOUT_FILENO, service, elapsed_seconds);
-            bool dump_complete = (status == OK);
-            dumpsys.stopDumpThread(dump_complete);
-        }
-        section_reporter.setStatus(status);
-
-        auto elapsed_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start);
-        if (elapsed_duration > timeout) {
-            MYLOGE("*** command '%s' timed out after %llums\n", title.c_str(),
-                   elapsed_duration.count());
-            break;
-        }
+            section_reporter.setStatus(status);
+            section_reporter.setElapsed(
+                std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_seconds));
+        });
+    if (status == TIMED_OUT) {
+        MYLOGE("*** command '%s' timed out after %llums\n", title.c_str(), timeout.count());
     }
 }
 
@@ -1188,7 +1291,8 @@ static void RunDumpsysProto(const std::string& title, int priority,
             path.append("_HIGH");
         }
         path.append(kProtoExt);
-        DumpstateSectionReporter section_reporter(path, ds.listener_, ds.report_section_);
+        DumpstateSectionReporter section_reporter(path, ds.listener_, ds.report_section_,
+                                                  &ds.section_stats_);
         status_t status = dumpsys.startDumpThread(service, args);
         if (status == OK) {
             status = ds.AddZipEntryFromFd(path, dumpsys.getDumpFd(), service_timeout);
@@ -1296,6 +1400,9 @@ static void dumpstate() {
     DumpFile("MEMORY INFO", "/proc/meminfo");
     RunCommand("CPU INFO", {"top", "-b", "-n", "1", "-H", "-s", "6", "-o",
                             "pid,tid,user,pr,ni,%cpu,s,virt,res,pcy,cmd,name"});
+    // These are slow but independent, so let them run while the sections before them are dumped.
+    ds.RunCommandInBackground("LIBRANK", {"librank"}, CommandOptions::AS_ROOT);
+    ds.RunCommandInBackground("LIST OF OPEN FILES", {"lsof"}, CommandOptions::AS_ROOT);
     RunCommand("PROCRANK", {"procrank"}, AS_ROOT_20);
     DumpFile("VIRTUAL MEMORY STATS", "/proc/vmstat");
     DumpFile("VMALLOC INFO", "/proc/vmallocinfo");
@@ -1311,7 +1418,7 @@ static void dumpstate() {
 
     RunCommand("PROCESSES AND THREADS",
                {"ps", "-A", "-T", "-Z", "-O", "pri,nice,rtprio,sched,pcy,time"});
-    RunCommand("LIBRANK", {"librank"}, CommandOptions::AS_ROOT);
+    ds.WaitForBackgroundCommand("LIBRANK");
 
     if (ds.IsZipping()) {
         RunCommand("HARDWARE HALS", {"lshal"}, CommandOptions::WithTimeout(2).AsRootIfAvailable().Build());
@@ -1336,7 +1443,7 @@ static void dumpstate() {
         do_dmesg();
     }
 
-    RunCommand("LIST OF OPEN FILES", {"lsof"}, CommandOptions::AS_ROOT);
+    ds.WaitForBackgroundCommand("LIST OF OPEN FILES");
     for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
     for_each_tid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
     for_each_pid(show_showtime, "PROCESS TIMES (pid cmd user system iowait+percentage)");
@@ -1411,6 +1518,14 @@ static void dumpstate() {
         RunCommand("DUMP VENDOR RIL LOGS", {"vril-dump"}, options.Build());
     }
 
+    // Checkins don't depend on the full dumpsys output, so collect them while it's running.
+    ds.RunDumpsysInBackground("CHECKIN BATTERYSTATS", {"batterystats", "-c"});
+    ds.RunDumpsysInBackground("CHECKIN MEMINFO", {"meminfo", "--checkin"});
+    ds.RunDumpsysInBackground("CHECKIN NETSTATS", {"netstats", "--checkin"});
+    ds.RunDumpsysInBackground("CHECKIN PROCSTATS", {"procstats", "-c"});
+    ds.RunDumpsysInBackground("CHECKIN USAGESTATS", {"usagestats", "-c"});
+    ds.RunDumpsysInBackground("CHECKIN PACKAGE", {"package", "--checkin"});
+
     printf("========================================================\n");
     printf("== Android Framework Services\n");
     printf("========================================================\n");
@@ -1421,12 +1536,12 @@ static void dumpstate() {
     printf("== Checkins\n");
     printf("========================================================\n");
 
-    RunDumpsys("CHECKIN BATTERYSTATS", {"batterystats", "-c"});
-    RunDumpsys("CHECKIN MEMINFO", {"meminfo", "--checkin"});
-    RunDumpsys("CHECKIN NETSTATS", {"netstats", "--checkin"});
-    RunDumpsys("CHECKIN PROCSTATS", {"procstats", "-c"});
-    RunDumpsys("CHECKIN USAGESTATS", {"usagestats", "-c"});
-    RunDumpsys("CHECKIN PACKAGE", {"package", "--checkin"});
+    ds.WaitForBackgroundCommand("CHECKIN BATTERYSTATS");
+    ds.WaitForBackgroundCommand("CHECKIN MEMINFO");
+    ds.WaitForBackgroundCommand("CHECKIN NETSTATS");
+    ds.WaitForBackgroundCommand("CHECKIN PROCSTATS");
+    ds.WaitForBackgroundCommand("CHECKIN USAGESTATS");
+    ds.WaitForBackgroundCommand("CHECKIN PACKAGE");
 
     printf("========================================================\n");
     printf("== Running Application Activities\n");
@@ -1562,6 +1677,8 @@ static void DumpstateWifiOnly() {
 }
 
 void Dumpstate::DumpstateBoard() {
+    DumpstateSectionReporter section_reporter("dumpstate_board()", listener_,
+                                              /* sendReport = */ false, &section_stats_);
     DurationReporter duration_reporter("dumpstate_board()");
     printf("========================================================\n");
     printf("== Board\n");
@@ -1636,6 +1753,7 @@ void Dumpstate::DumpstateBoard() {
     constexpr size_t timeout_sec = 30;
     if (result.wait_for(std::chrono::seconds(timeout_sec)) != std::future_status::ready) {
         MYLOGE("dumpstateBoard timed out after %zus, killing dumpstate vendor HAL\n", timeout_sec);
+        section_reporter.setTimedOut();
         if (!android::base::SetProperty("ctl.interface_restart",
                                         android::base::StringPrintf("%s/default",
                                                                     IDumpstateDevice::descriptor))) {
@@ -1661,10 +1779,12 @@ void Dumpstate::DumpstateBoard() {
         file_sizes[i] = s.st_size;
     }
 
+    int64_t total_size = 0;
     for (size_t i = 0; i < paths.size(); i++) {
         if (file_sizes[i] == -1) {
             continue;
         }
+        total_size += file_sizes[i];
         if (file_sizes[i] == 0) {
             MYLOGE("Ignoring empty %s\n", kDumpstateBoardFiles[i].c_str());
             continue;
@@ -1672,13 +1792,15 @@ void Dumpstate::DumpstateBoard() {
         AddZipEntry(kDumpstateBoardFiles[i], paths[i]);
     }
 
+    section_reporter.setSize(total_size);
+
     printf("*** See dumpstate-board.txt entry ***\n");
 }
 
 static void ShowUsageAndExit(int exitCode = 1) {
     fprintf(stderr,
             "usage: dumpstate [-h] [-b soundfile] [-e soundfile] [-o file] [-d] [-p] "
-            "[-z]] [-s] [-S] [-q] [-B] [-P] [-R] [-V version]\n"
+            "[-z]] [-s] [-S] [-Z] [-q] [-B] [-P] [-R] [-V version]\n"
             "  -h: display this help message\n"
             "  -b: play sound file instead of vibrate, at beginning of job\n"
             "  -e: play sound file instead of vibrate, at end of job\n"
@@ -1688,6 +1810,8 @@ static void ShowUsageAndExit(int exitCode = 1) {
             "  -z: generate zipped file (requires -o)\n"
             "  -s: write output to control socket (for init)\n"
             "  -S: write file location to control socket (for init; requires -o and -z)\n"
+            "  -Z: stream zipped file to control socket instead of writing it (requires -S, "
+            "shouldn't be used with -B)\n"
             "  -q: disable vibrate\n"
             "  -B: send broadcast when finished (requires -o)\n"
             "  -P: send broadcast when started and update system properties on "
@@ -1707,6 +1831,20 @@ static void register_sig_handler() {
     signal(SIGPIPE, SIG_IGN);
 }
 
+/* Buffer of the zip file streamed to the control socket, i.e. the size of most DATA chunks */
+static const int ZIP_STREAM_BUFFER_SIZE = 64 * 1024;
+
+/* funopen() writer sending a piece of the zip file to bugreportz -s as a DATA chunk */
+static int WriteZipToControlSocket(void* cookie, const char* data, int size) {
+    int fd = *static_cast<int*>(cookie);
+    std::string header = android::base::StringPrintf("DATA:%d\n", size);
+    if (!android::base::WriteStringToFd(header, fd) ||
+        !android::base::WriteFully(fd, data, size)) {
+        return -1;
+    }
+    return size;
+}
+
 bool Dumpstate::FinishZipFile() {
     std::string entry_name = base_name_ + "-" + name_ + ".txt";
     MYLOGD("Adding main entry (%s) from %s to .zip bugreport\n", entry_name.c_str(),
@@ -1727,6 +1865,10 @@ bool Dumpstate::FinishZipFile() {
         return false;
     }
 
+    if (!AddTextZipEntry("dumpstate_sections.csv", section_stats_.ToCsv())) {
+        MYLOGE("Failed to add dumpstate_sections.csv to .zip file\n");
+    }
+
     // Add log file (which contains stderr output) to zip...
     fprintf(stderr, "dumpstate_log.txt entry on zip file logged up to here\n");
     if (!ds.AddZipEntry("dumpstate_log.txt", ds.log_path_.c_str())) {
@@ -1742,6 +1884,10 @@ bool Dumpstate::FinishZipFile() {
         MYLOGE("zip_writer_->Finish(): %s\n", ZipWriter::ErrorCodeString(err));
         return false;
     }
+    if (fflush(zip_file.get()) != 0) {
+        MYLOGE("Failed to flush zip file: %s\n", strerror(errno));
+        return false;
+    }
 
     // TODO: remove once FinishZipFile() is automatically handled by Dumpstate's destructor.
     ds.zip_file.reset(nullptr);
@@ -1824,6 +1970,7 @@ int run_main(int argc, char* argv[]) {
     char* use_outfile = 0;
     int use_socket = 0;
     int use_control_socket = 0;
+    int stream_zip_file = 0;
     int do_fb = 0;
     int do_broadcast = 0;
     int is_remote_mode = 0;
@@ -1852,7 +1999,7 @@ int run_main(int argc, char* argv[]) {
 
     /* parse arguments */
     int c;
-    while ((c = getopt(argc, argv, "dho:svqzpPBRSV:")) != -1) {
+    while ((c = getopt(argc, argv, "dho:svqzpPBRSZV:")) != -1) {
         switch (c) {
             // clang-format off
             case 'd': do_add_date = 1;            break;
@@ -1860,6 +2007,7 @@ int run_main(int argc, char* argv[]) {
             case 'o': use_outfile = optarg;       break;
             case 's': use_socket = 1;             break;
             case 'S': use_control_socket = 1;     break;
+            case 'Z': stream_zip_file = 1;        break;
             case 'v': show_header_only = true;    break;
             case 'q': do_vibrate = 0;             break;
             case 'p': do_fb = 1;                  break;
@@ -1936,6 +2084,10 @@ int run_main(int argc, char* argv[]) {
         ExitOnInvalidArgs();
     }
 
+    if (stream_zip_file && (!use_control_socket || do_broadcast)) {
+        ExitOnInvalidArgs();
+    }
+
     if (ds.update_progress_ && !do_broadcast) {
         ExitOnInvalidArgs();
     }
@@ -2047,11 +2199,25 @@ int run_main(int argc, char* argv[]) {
 
         if (do_zip_file) {
             ds.path_ = ds.GetPath(".zip");
-            MYLOGD("Creating initial .zip file (%s)\n", ds.path_.c_str());
-            create_parent_dirs(ds.path_.c_str());
-            ds.zip_file.reset(fopen(ds.path_.c_str(), "wb"));
+            if (stream_zip_file) {
+                // Nothing is written to ds.path_, which only names the zip for bugreportz.
+                MYLOGD("Streaming .zip file (%s) to control socket\n", ds.path_.c_str());
+                ds.zip_file.reset(funopen(&ds.control_socket_fd_, nullptr,
+                                          WriteZipToControlSocket, nullptr, nullptr));
+                if (ds.zip_file == nullptr) {
+                    MYLOGE("funopen(): %s\n", strerror(errno));
+                } else {
+                    setvbuf(ds.zip_file.get(), nullptr, _IOFBF, ZIP_STREAM_BUFFER_SIZE);
+                }
+            } else {
+                MYLOGD("Creating initial .zip file (%s)\n", ds.path_.c_str());
+                create_parent_dirs(ds.path_.c_str());
+                ds.zip_file.reset(fopen(ds.path_.c_str(), "wb"));
+                if (ds.zip_file == nullptr) {
+                    MYLOGE("fopen(%s, 'wb'): %s\n", ds.path_.c_str(), strerror(errno));
+                }
+            }
             if (ds.zip_file == nullptr) {
-                MYLOGE("fopen(%s, 'wb'): %s\n", ds.path_.c_str(), strerror(errno));
                 do_zip_file = 0;
             } else {
                 ds.zip_writer_.reset(new ZipWriter(ds.zip_file.get()));
@@ -2100,7 +2266,7 @@ int run_main(int argc, char* argv[]) {
         }
     }
 
-    if (do_zip_file) {
+    if (do_zip_file && !stream_zip_file) {
         if (chown(ds.path_.c_str(), AID_SHELL, AID_SHELL)) {
             MYLOGE("Unable to change ownership of zip file %s: %s\n", ds.path_.c_str(),
                    strerror(errno));
@@ -2233,7 +2399,9 @@ int run_main(int argc, char* argv[]) {
                 do_text_file = false;
                 // Since zip file is already created, it needs to be renamed.
                 std::string new_path = ds.GetPath(".zip");
-                if (ds.path_ != new_path) {
+                if (stream_zip_file) {
+                    ds.path_ = new_path;
+                } else if (ds.path_ != new_path) {
                     MYLOGD("Renaming zip file from %s to %s\n", ds.path_.c_str(), new_path.c_str());
                     if (rename(ds.path_.c_str(), new_path.c_str())) {
                         MYLOGE("rename(%s, %s): %s\n", ds.path_.c_str(), new_path.c_str(),
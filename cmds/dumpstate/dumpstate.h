@@ -22,7 +22,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/macros.h>
@@ -31,6 +36,7 @@
 #include <utils/StrongPointer.h>
 #include <ziparchive/zip_writer.h>
 
+#include "DumpstateSectionReporter.h"
 #include "DumpstateUtil.h"
 
 // Workaround for const char *args[MAX_ARGS_ARRAY_SIZE] variables until they're converted to
@@ -219,6 +225,35 @@ class Dumpstate {
                     const android::os::dumpstate::CommandOptions& options = DEFAULT_DUMPSYS,
                     long dumpsys_timeout_ms = 0);
 
+    /*
+     * Starts running a command on a background thread, buffering its section in a temporary
+     * file, so slow independent sections can run concurrently. The section is only written to
+     * `stdout` by the matching WaitForBackgroundCommand(), so it keeps its place in the report.
+     *
+     * Arguments are the same as RunCommand(); |title| identifies the command and must be unique
+     * among the commands still running.
+     */
+    void RunCommandInBackground(const std::string& title,
+                                const std::vector<std::string>& full_command,
+                                const android::os::dumpstate::CommandOptions& options =
+                                    android::os::dumpstate::CommandOptions::DEFAULT);
+
+    /*
+     * Runs `dumpsys` in the background like RunCommandInBackground(), with arguments as in
+     * RunDumpsys().
+     */
+    void RunDumpsysInBackground(const std::string& title,
+                                const std::vector<std::string>& dumpsys_args,
+                                const android::os::dumpstate::CommandOptions& options =
+                                    DEFAULT_DUMPSYS,
+                                long dumpsys_timeout_ms = 0);
+
+    /*
+     * Waits for the background command |title| to finish, writes its section to `stdout`, and
+     * returns its status. When its output couldn't be buffered the command runs here instead.
+     */
+    int WaitForBackgroundCommand(const std::string& title);
+
     /*
      * Prints the contents of a file.
      *
@@ -361,6 +396,9 @@ class Dumpstate {
     std::string listener_name_;
     bool report_section_;
 
+    // Cost of every section run so far, added to the zip file as dumpstate_sections.csv.
+    android::os::dumpstate::SectionStatsLog section_stats_;
+
     // Notification title and description
     std::string notification_title;
     std::string notification_description;
@@ -372,6 +410,30 @@ class Dumpstate {
     std::vector<DumpData> anr_data_;
 
   private:
+    // Command started by RunCommandInBackground() and not yet waited for.
+    struct BackgroundCommand {
+        BackgroundCommand(const std::vector<std::string>& full_command,
+                          const android::os::dumpstate::CommandOptions& options)
+            : full_command(full_command), options(options) {
+        }
+
+        std::vector<std::string> full_command;
+        android::os::dumpstate::CommandOptions options;
+
+        // Temporary file buffering the section; invalid when it couldn't be created.
+        android::base::unique_fd fd;
+        std::thread thread;
+        int status = 0;
+    };
+
+    // Background commands by title.
+    std::map<std::string, std::unique_ptr<BackgroundCommand>> background_commands_;
+
+    // Bounds how many background commands run at once.
+    std::mutex background_lock_;
+    std::condition_variable background_cond_;
+    int background_running_ = 0;
+
     // Used by GetInstance() only.
     Dumpstate(const std::string& version = VERSION_CURRENT);
 
@@ -247,6 +247,41 @@ TEST_F(DumpstateTest, RunCommandWithMultipleArgs) {
     EXPECT_THAT(out, StrEq("one is the loniest number\n"));
 }
 
+TEST_F(DumpstateTest, RunCommandInBackground) {
+    ds.bugreport_dir_ = kTestDataPath;
+    ds.RunCommandInBackground("ONE", {kEchoCommand, "one"});
+    ds.RunCommandInBackground("TWO", {kEchoCommand, "two"});
+
+    // Sections are written in the order they're waited for, not the order they finish in.
+    CaptureStdout();
+    CaptureStderr();
+    EXPECT_EQ(0, ds.WaitForBackgroundCommand("TWO"));
+    EXPECT_EQ(0, ds.WaitForBackgroundCommand("ONE"));
+    out = GetCapturedStdout();
+    err = GetCapturedStderr();
+    ds.bugreport_dir_ = "";
+
+    EXPECT_THAT(err, IsEmpty());
+    EXPECT_THAT(out, StartsWith("------ TWO (" + kEchoCommand + " two) ------\ntwo\n------"));
+    EXPECT_THAT(out, HasSubstr("s was the duration of 'TWO' ------\n------ ONE (" +
+                               kEchoCommand + " one) ------\none\n------"));
+    EXPECT_THAT(out, EndsWith("s was the duration of 'ONE' ------\n"));
+}
+
+TEST_F(DumpstateTest, RunCommandInBackgroundWithoutDirectory) {
+    ds.bugreport_dir_ = "";
+    ds.RunCommandInBackground("", {kEchoCommand, "one"});
+
+    CaptureStdout();
+    CaptureStderr();
+    EXPECT_EQ(0, ds.WaitForBackgroundCommand(""));
+    out = GetCapturedStdout();
+    err = GetCapturedStderr();
+
+    EXPECT_THAT(err, IsEmpty());
+    EXPECT_THAT(out, StrEq("one\n"));
+}
+
 TEST_F(DumpstateTest, RunCommandDryRun) {
     SetDryRun(true);
     EXPECT_EQ(0, RunCommand("I AM GROOT", {kSimpleCommand}));
@@ -303,6 +338,19 @@ TEST_F(DumpstateTest, RunCommandTimesout) {
                                 " --sleep 2' timed out after 1"));
 }
 
+TEST_F(DumpstateTest, RunCommandRecordsSectionStats) {
+    EXPECT_EQ(0, RunCommand("SECTION STATS", {kEchoCommand, "one"}));
+    EXPECT_EQ(-1, RunCommand("SECTION STATS TIMEOUT", {kSimpleCommand, "--sleep", "2"},
+                             CommandOptions::WithTimeout(1).Build()));
+
+    std::string header = "------ SECTION STATS (" + kEchoCommand + " one) ------\n";
+    std::string csv = ds.section_stats_.ToCsv();
+    EXPECT_THAT(csv, StartsWith("section,status,size,wall_ms,cpu_ms,timed_out\n"));
+    EXPECT_THAT(csv, HasSubstr("\"SECTION STATS\",0," + std::to_string(header.size() + 4) + ","));
+    EXPECT_THAT(csv, EndsWith(",1\n"));
+    EXPECT_THAT(csv, HasSubstr("\"SECTION STATS TIMEOUT\",-1,"));
+}
+
 TEST_F(DumpstateTest, RunCommandIsKilled) {
     CaptureStdout();
     CaptureStderr();
@@ -32,15 +32,19 @@
 #include <sys/inotify.h>
 #include <sys/klog.h>
 #include <sys/prctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -60,6 +64,7 @@
 // TODO: remove once moved to namespace
 using android::os::dumpstate::CommandOptions;
 using android::os::dumpstate::DumpFileToFd;
+using android::os::dumpstate::DumpstateSectionReporter;
 using android::os::dumpstate::PropertiesHelper;
 
 // Keep in sync with
@@ -69,6 +74,9 @@ static const int TRACE_DUMP_TIMEOUT_MS = 10000; // 10 seconds
 /* Most simple commands have 10 as timeout, so 5 is a good estimate */
 static const int32_t WEIGHT_FILE = 5;
 
+/* Commands mostly wait on the processes they dump, so a few can overlap without contention */
+static const int MAX_BACKGROUND_COMMANDS = 4;
+
 // TODO: temporary variables and functions used during C++ refactoring
 static Dumpstate& ds = Dumpstate::GetInstance();
 static int RunCommand(const std::string& title, const std::vector<std::string>& full_command,
@@ -556,10 +564,28 @@ void do_showmap(int pid, const char *name) {
     RunCommand(title, {"showmap", "-q", arg}, CommandOptions::AS_ROOT);
 }
 
+/* Current offset of |fd|, used to tell how many bytes a section wrote; -1 when not seekable. */
+static off_t GetOutputOffset(int fd) {
+    return lseek(fd, 0, SEEK_CUR);
+}
+
+/* Records the bytes written to |fd| since |started|, when it could be told. */
+static void SetOutputSize(DumpstateSectionReporter* section_reporter, int fd, off_t started) {
+    off_t offset = GetOutputOffset(fd);
+    if (started != -1 && offset != -1) {
+        section_reporter->setSize(offset - started);
+    }
+}
+
 int Dumpstate::DumpFile(const std::string& title, const std::string& path) {
+    DumpstateSectionReporter section_reporter(title, listener_, /* sendReport = */ false,
+                                              title.empty() ? nullptr : &section_stats_);
     DurationReporter duration_reporter(title);
+    off_t started = GetOutputOffset(STDOUT_FILENO);
 
     int status = DumpFileToFd(STDOUT_FILENO, title, path);
+    SetOutputSize(&section_reporter, STDOUT_FILENO, started);
+    section_reporter.setStatus(status);
 
     UpdateProgress(WEIGHT_FILE);
 
@@ -675,11 +701,28 @@ int dump_file_from_fd(const char *title, const char *path, int fd) {
     return DumpFileFromFdToFd(title, path, fd, STDOUT_FILENO, PropertiesHelper::IsDryRun());
 }
 
+/*
+ * RunCommandToFd() returns -1 both when the command timed out and when it could not be waited
+ * for, so the former is told apart by how long it ran.
+ */
+static bool IsTimedOut(int status, uint64_t elapsed_ns, const CommandOptions& options) {
+    return status == -1 && elapsed_ns >= (uint64_t)options.TimeoutInMs() * (NANOS_PER_SEC / 1000);
+}
+
 int Dumpstate::RunCommand(const std::string& title, const std::vector<std::string>& full_command,
                           const CommandOptions& options) {
+    DumpstateSectionReporter section_reporter(title, listener_, /* sendReport = */ false,
+                                              title.empty() ? nullptr : &section_stats_);
     DurationReporter duration_reporter(title);
+    off_t started = GetOutputOffset(STDOUT_FILENO);
+    uint64_t started_ns = Nanotime();
 
     int status = RunCommandToFd(STDOUT_FILENO, title, full_command, options);
+    SetOutputSize(&section_reporter, STDOUT_FILENO, started);
+    section_reporter.setStatus(status);
+    if (IsTimedOut(status, Nanotime() - started_ns, options)) {
+        section_reporter.setTimedOut();
+    }
 
     /* TODO: for now we're simplifying the progress calculation by using the
      * timeout as the weight. It's a good approximation for most cases, except when calling dumpsys,
@@ -698,6 +741,110 @@ void Dumpstate::RunDumpsys(const std::string& title, const std::vector<std::stri
     RunCommand(title, dumpsys, options);
 }
 
+void Dumpstate::RunCommandInBackground(const std::string& title,
+                                       const std::vector<std::string>& full_command,
+                                       const CommandOptions& options) {
+    if (background_commands_.count(title) != 0) {
+        MYLOGE("Background command '%s' is already running\n", title.c_str());
+        return;
+    }
+    auto command = std::make_unique<BackgroundCommand>(full_command, options);
+
+    // Without a directory to buffer the output in, the command runs when waited for.
+    if (!bugreport_dir_.empty()) {
+        std::string path = bugreport_dir_ + "/.section-XXXXXX";
+        command->fd.reset(TEMP_FAILURE_RETRY(mkostemp(&path[0], O_CLOEXEC)));
+        if (command->fd == -1) {
+            MYLOGE("Could not create temporary file for '%s': %s\n", title.c_str(),
+                   strerror(errno));
+        } else {
+            unlink(path.c_str());
+        }
+    }
+
+    if (command->fd != -1) {
+        BackgroundCommand* c = command.get();
+        c->thread = std::thread([this, c, title] {
+            {
+                std::unique_lock<std::mutex> lock(background_lock_);
+                background_cond_.wait(
+                    lock, [this] { return background_running_ < MAX_BACKGROUND_COMMANDS; });
+                background_running_++;
+            }
+
+            {
+                DumpstateSectionReporter section_reporter(
+                    title, listener_, /* sendReport = */ false,
+                    title.empty() ? nullptr : &section_stats_);
+                uint64_t started = Nanotime();
+                c->status = RunCommandToFd(c->fd.get(), title, c->full_command, c->options);
+                uint64_t elapsed = Nanotime() - started;
+                if (!title.empty()) {
+                    // Same as what DurationReporter prints for commands run in the foreground.
+                    dprintf(c->fd.get(), "------ %.3fs was the duration of '%s' ------\n",
+                            (float)elapsed / NANOS_PER_SEC, title.c_str());
+                }
+                SetOutputSize(&section_reporter, c->fd.get(), 0);
+                section_reporter.setStatus(c->status);
+                if (IsTimedOut(c->status, elapsed, c->options)) {
+                    section_reporter.setTimedOut();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(background_lock_);
+                background_running_--;
+            }
+            background_cond_.notify_one();
+        });
+    }
+    background_commands_[title] = std::move(command);
+}
+
+void Dumpstate::RunDumpsysInBackground(const std::string& title,
+                                       const std::vector<std::string>& dumpsys_args,
+                                       const CommandOptions& options, long dumpsysTimeoutMs) {
+    long timeout_ms = dumpsysTimeoutMs > 0 ? dumpsysTimeoutMs : options.TimeoutInMs();
+    std::vector<std::string> dumpsys = {"/system/bin/dumpsys", "-T", std::to_string(timeout_ms)};
+    dumpsys.insert(dumpsys.end(), dumpsys_args.begin(), dumpsys_args.end());
+    RunCommandInBackground(title, dumpsys, options);
+}
+
+int Dumpstate::WaitForBackgroundCommand(const std::string& title) {
+    auto it = background_commands_.find(title);
+    if (it == background_commands_.end()) {
+        MYLOGE("No background command '%s'\n", title.c_str());
+        return -1;
+    }
+    std::unique_ptr<BackgroundCommand> command = std::move(it->second);
+    background_commands_.erase(it);
+
+    if (!command->thread.joinable()) {
+        return RunCommand(title, command->full_command, command->options);
+    }
+    command->thread.join();
+
+    struct stat st = {};
+    if (fstat(command->fd.get(), &st) == -1) {
+        MYLOGE("Failed to stat output of '%s': %s\n", title.c_str(), strerror(errno));
+    }
+    off_t size = st.st_size;
+    off_t offset = 0;
+    fflush(stdout);
+    while (offset < size) {
+        ssize_t bytes = TEMP_FAILURE_RETRY(
+            sendfile(STDOUT_FILENO, command->fd.get(), &offset, size - offset));
+        if (bytes <= 0) {
+            MYLOGE("Failed to copy output of '%s': %s\n", title.c_str(), strerror(errno));
+            break;
+        }
+    }
+    fsync(STDOUT_FILENO);
+
+    UpdateProgress(command->options.Timeout());
+    return command->status;
+}
+
 int open_socket(const char *service) {
     int s = android_get_control_socket(service);
     if (s < 0) {
@@ -799,6 +946,108 @@ const char *dump_traces() {
     return nullptr;
 }
 
+// A process whose stack is to be dumped, and the outcome of dumping it.
+struct TraceDump {
+    enum State { PENDING, DUMPED, FAILED, SKIPPED_FAILURES, SKIPPED_DEADLINE };
+
+    TraceDump(int pid, bool is_java_process) : pid(pid), is_java_process(is_java_process) {
+    }
+
+    int pid;
+    bool is_java_process;
+    State state = PENDING;
+    uint64_t elapsed = 0;
+    // Unlinked temporary file holding the backtrace.
+    android::base::unique_fd fd;
+};
+
+/* tombstoned serves this many trace dumps at the same time */
+static const size_t MAX_BACKTRACE_JOBS = 4;
+
+/* All processes must have been dumped within this many seconds */
+static const int BACKTRACE_DEADLINE_S = 30;
+
+// Dumps the stacks of |dumps| on up to MAX_BACKTRACE_JOBS threads, each process into its own
+// temporary file in |dir|. Processes not started by BACKTRACE_DEADLINE_S, or after debuggerd
+// seems dead, are skipped.
+static void DumpBacktraces(const std::string& dir, std::vector<TraceDump>* dumps) {
+    const uint64_t deadline = Nanotime() + BACKTRACE_DEADLINE_S * NANOS_PER_SEC;
+    std::atomic<size_t> next(0);
+    // Number of dumps in a row that have timed out. If we encounter too many failures, we'll
+    // give up.
+    std::atomic<int> timeout_failures(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < dumps->size()) {
+            TraceDump& dump = (*dumps)[i];
+
+            // If 3 backtrace dumps fail in a row, consider debuggerd dead.
+            if (timeout_failures >= 3) {
+                dump.state = TraceDump::SKIPPED_FAILURES;
+                continue;
+            }
+
+            const uint64_t start = Nanotime();
+            if (start >= deadline) {
+                dump.state = TraceDump::SKIPPED_DEADLINE;
+                continue;
+            }
+
+            std::string path = dir + "/.dumptrace-XXXXXX";
+            dump.fd.reset(TEMP_FAILURE_RETRY(mkostemp(&path[0], O_CLOEXEC)));
+            if (dump.fd == -1) {
+                MYLOGE("mkostemp on pattern %s: %s\n", path.c_str(), strerror(errno));
+                dump.state = TraceDump::FAILED;
+                continue;
+            }
+            unlink(path.c_str());
+
+            // A dump may not run past the deadline either.
+            int timeout = dump.is_java_process ? 5 : 20;
+            int remaining = (deadline - start + NANOS_PER_SEC - 1) / NANOS_PER_SEC;
+            const int ret = dump_backtrace_to_file_timeout(
+                dump.pid,
+                dump.is_java_process ? kDebuggerdJavaBacktrace : kDebuggerdNativeBacktrace,
+                std::min(timeout, remaining), dump.fd.get());
+            dump.elapsed = Nanotime() - start;
+
+            if (ret == -1) {
+                dump.state = TraceDump::FAILED;
+                timeout_failures++;
+            } else {
+                dump.state = TraceDump::DUMPED;
+                timeout_failures = 0;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(MAX_BACKTRACE_JOBS, dumps->size()); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Appends whatever backtrace |dump| got to |out_fd|.
+static void CopyTraceDump(const TraceDump& dump, int out_fd) {
+    if (dump.fd == -1 || lseek(dump.fd, 0, SEEK_SET) == -1) {
+        return;
+    }
+    // Not sendfile(), which doesn't support an O_APPEND destination.
+    char buffer[65536];
+    ssize_t bytes;
+    while ((bytes = TEMP_FAILURE_RETRY(read(dump.fd, buffer, sizeof(buffer)))) > 0) {
+        if (!android::base::WriteFully(out_fd, buffer, bytes)) {
+            MYLOGE("Failed to copy stack of pid %d: %s\n", dump.pid, strerror(errno));
+            return;
+        }
+    }
+}
+
 const char* DumpTracesTombstoned(const std::string& traces_dir) {
     const std::string temp_file_pattern = traces_dir + "/dumptrace_XXXXXX";
 
@@ -833,13 +1082,11 @@ const char* DumpTracesTombstoned(const std::string& traces_dir) {
         return nullptr;
     }
 
-    // Number of times process dumping has timed out. If we encounter too many
-    // failures, we'll give up.
-    int timeout_failures = 0;
     bool dalvik_found = false;
 
     const std::set<int> hal_pids = get_interesting_hal_pids();
 
+    std::vector<TraceDump> dumps;
     struct dirent* d;
     while ((d = readdir(proc.get()))) {
         int pid = atoi(d->d_name);
@@ -869,30 +1116,37 @@ const char* DumpTracesTombstoned(const std::string& traces_dir) {
             continue;
         }
 
-        // If 3 backtrace dumps fail in a row, consider debuggerd dead.
-        if (timeout_failures == 3) {
-            dprintf(fd, "ERROR: Too many stack dump failures, exiting.\n");
-            break;
-        }
+        dumps.emplace_back(pid, is_java_process);
+    }
+    std::sort(dumps.begin(), dumps.end(),
+              [](const TraceDump& a, const TraceDump& b) { return a.pid < b.pid; });
 
-        const uint64_t start = Nanotime();
-        const int ret = dump_backtrace_to_file_timeout(
-            pid, is_java_process ? kDebuggerdJavaBacktrace : kDebuggerdNativeBacktrace,
-            is_java_process ? 5 : 20, fd);
+    DumpBacktraces(traces_dir, &dumps);
 
-        if (ret == -1) {
-            dprintf(fd, "dumping failed, likely due to a timeout\n");
-            timeout_failures++;
+    // Dumps still running when the others were given up on can come after skipped processes in
+    // pid order, so the reason is written for the first skipped process only.
+    bool skip_reported = false;
+    for (const TraceDump& dump : dumps) {
+        if (dump.state == TraceDump::SKIPPED_FAILURES ||
+            dump.state == TraceDump::SKIPPED_DEADLINE) {
+            if (!skip_reported) {
+                dprintf(fd, dump.state == TraceDump::SKIPPED_FAILURES
+                                ? "ERROR: Too many stack dump failures, exiting.\n"
+                                : "ERROR: Stack dump deadline expired, exiting.\n");
+                skip_reported = true;
+            }
             continue;
         }
 
-        // We've successfully dumped stack traces, reset the failure count
-        // and write a summary of the elapsed time to the file and continue with the
-        // next process.
-        timeout_failures = 0;
+        CopyTraceDump(dump, fd);
+        if (dump.state == TraceDump::FAILED) {
+            dprintf(fd, "dumping failed, likely due to a timeout\n");
+            continue;
+        }
 
-        dprintf(fd, "[dump %s stack %d: %.3fs elapsed]\n", is_java_process ? "dalvik" : "native",
-                pid, (float)(Nanotime() - start) / NANOS_PER_SEC);
+        dprintf(fd, "[dump %s stack %d: %.3fs elapsed]\n",
+                dump.is_java_process ? "dalvik" : "native", dump.pid,
+                (float)dump.elapsed / NANOS_PER_SEC);
     }
 
     if (!dalvik_found) {
@@ -18,6 +18,7 @@
 #include <chrono>
 #include <iomanip>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
@@ -70,6 +71,10 @@ static void usage() {
             "         --priority LEVEL: filter services based on specified priority\n"
             "               LEVEL must be one of CRITICAL | HIGH | NORMAL\n"
             "         --skip SERVICES: dumps all services but SERVICES (comma-separated list)\n"
+            "         --parallel JOBS: dumps up to JOBS services at the same time\n"
+            "         --deadline TIMEOUT_MS: TIMEOUT to dump all services in milliseconds\n"
+            "         --binder-stats SERVICE [enable | disable | reset]: controls or dumps the\n"
+            "               binder transaction latency stats of the process hosting SERVICE\n"
             "         SERVICE [ARGS]: dumps only service SERVICE, optionally passing ARGS to it\n");
 }
 
@@ -120,12 +125,18 @@ int Dumpsys::main(int argc, char* const argv[]) {
     bool showListOnly = false;
     bool skipServices = false;
     bool asProto = false;
+    bool binderStats = false;
     int timeoutArgMs = 10000;
+    int maxJobs = 1;
+    int deadlineArgMs = 0;
     int priorityFlags = IServiceManager::DUMP_FLAG_PRIORITY_ALL;
     static struct option longOptions[] = {{"priority", required_argument, 0, 0},
                                           {"proto", no_argument, 0, 0},
                                           {"skip", no_argument, 0, 0},
                                           {"help", no_argument, 0, 0},
+                                          {"binder-stats", no_argument, 0, 0},
+                                          {"parallel", required_argument, 0, 0},
+                                          {"deadline", required_argument, 0, 0},
                                           {0, 0, 0, 0}};
 
     // Must reset optind, otherwise subsequent calls will fail (wouldn't happen on main.cpp, but
@@ -147,9 +158,26 @@ int Dumpsys::main(int argc, char* const argv[]) {
                 skipServices = true;
             } else if (!strcmp(longOptions[optionIndex].name, "proto")) {
                 asProto = true;
+            } else if (!strcmp(longOptions[optionIndex].name, "binder-stats")) {
+                binderStats = true;
             } else if (!strcmp(longOptions[optionIndex].name, "help")) {
                 usage();
                 return 0;
+            } else if (!strcmp(longOptions[optionIndex].name, "parallel")) {
+                char* endptr;
+                maxJobs = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || maxJobs <= 0) {
+                    fprintf(stderr, "Error: invalid number of jobs: '%s'\n", optarg);
+                    return -1;
+                }
+            } else if (!strcmp(longOptions[optionIndex].name, "deadline")) {
+                char* endptr;
+                deadlineArgMs = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || deadlineArgMs <= 0) {
+                    fprintf(stderr, "Error: invalid deadline(milliseconds) number: '%s'\n",
+                            optarg);
+                    return -1;
+                }
             } else if (!strcmp(longOptions[optionIndex].name, "priority")) {
                 priorityType = String16(String8(optarg));
                 if (!ConvertPriorityTypeToBitmask(priorityType, priorityFlags)) {
@@ -212,6 +240,14 @@ int Dumpsys::main(int argc, char* const argv[]) {
         return -1;
     }
 
+    if (binderStats) {
+        if (services.size() != 1 || skipServices || showListOnly) {
+            usage();
+            return -1;
+        }
+        return binderStatsCommand(STDOUT_FILENO, services[0], args) == OK ? 0 : -1;
+    }
+
     if (services.empty() || showListOnly) {
         services = listServices(priorityFlags, asProto);
         setServiceArgs(args, asProto, priorityFlags);
@@ -236,6 +272,23 @@ int Dumpsys::main(int argc, char* const argv[]) {
         return 0;
     }
 
+    if (maxJobs > 1 || deadlineArgMs > 0) {
+        Vector<String16> dumpedServices;
+        for (const auto& serviceName : services) {
+            if (!IsSkipped(skippedServices, serviceName)) {
+                dumpedServices.add(serviceName);
+            }
+        }
+        status_t status = writeDumpsInParallel(
+            STDOUT_FILENO, dumpedServices, args, priorityFlags, asProto, /* addSeparator = */ N > 1,
+            std::chrono::milliseconds(timeoutArgMs), std::chrono::milliseconds(deadlineArgMs),
+            maxJobs);
+        if (status == TIMED_OUT) {
+            aerr << "*** DUMPSYS DEADLINE (" << deadlineArgMs << "ms) EXPIRED ***" << endl;
+        }
+        return 0;
+    }
+
     for (size_t i = 0; i < N; i++) {
         const String16& serviceName = services[i];
         if (IsSkipped(skippedServices, serviceName)) continue;
@@ -269,6 +322,28 @@ int Dumpsys::main(int argc, char* const argv[]) {
     return 0;
 }
 
+status_t Dumpsys::binderStatsCommand(int fd, const String16& serviceName,
+                                     const Vector<String16>& args) const {
+    sp<IBinder> service = sm_->checkService(serviceName);
+    if (service == nullptr) {
+        aerr << "Can't find service: " << serviceName << endl;
+        return NAME_NOT_FOUND;
+    }
+
+    Parcel data, reply;
+    data.writeFileDescriptor(fd);
+    data.writeInt32(args.size());
+    for (const auto& arg : args) {
+        data.writeString16(arg);
+    }
+    status_t err = service->transact(IBinder::TRANSACTION_STATS_TRANSACTION, data, &reply);
+    if (err != OK) {
+        aerr << "Error getting binder stats of " << serviceName << ": (" << strerror(-err)
+             << ")" << endl;
+    }
+    return err;
+}
+
 Vector<String16> Dumpsys::listServices(int priorityFilterFlags, bool filterByProto) const {
     Vector<String16> services = sm_->listServices(priorityFilterFlags);
     services.sort(sort_func);
@@ -308,6 +383,11 @@ void Dumpsys::setServiceArgs(Vector<String16>& args, bool asProto, int priorityF
 }
 
 status_t Dumpsys::startDumpThread(const String16& serviceName, const Vector<String16>& args) {
+    return startDumpThread(serviceName, args, &redirectFd_, &activeThread_);
+}
+
+status_t Dumpsys::startDumpThread(const String16& serviceName, const Vector<String16>& args,
+                                  unique_fd* redirectFd, std::thread* thread) const {
     sp<IBinder> service = sm_->checkService(serviceName);
     if (service == nullptr) {
         aerr << "Can't find service: " << serviceName << endl;
@@ -321,12 +401,12 @@ status_t Dumpsys::startDumpThread(const String16& serviceName, const Vector<Stri
         return -errno;
     }
 
-    redirectFd_ = unique_fd(sfd[0]);
+    redirectFd->reset(sfd[0]);
     unique_fd remote_end(sfd[1]);
     sfd[0] = sfd[1] = -1;
 
     // dump blocks until completion, so spawn a thread..
-    activeThread_ = std::thread([=, remote_end{std::move(remote_end)}]() mutable {
+    *thread = std::thread([=, remote_end{std::move(remote_end)}]() mutable {
         int err = service->dump(remote_end.get(), args);
 
         // It'd be nice to be able to close the remote end of the socketpair before the dump
@@ -369,6 +449,11 @@ void Dumpsys::writeDumpHeader(int fd, const String16& serviceName, int priorityF
     WriteStringToFd(msg, fd);
 }
 
+static std::string TimeoutMessage(const String16& serviceName, std::chrono::milliseconds timeout) {
+    return StringPrintf("\n*** SERVICE '%s' DUMP TIMEOUT (%llums) EXPIRED ***\n\n",
+                        String8(serviceName).string(), timeout.count());
+}
+
 status_t Dumpsys::writeDump(int fd, const String16& serviceName, std::chrono::milliseconds timeout,
                             bool asProto, std::chrono::duration<double>& elapsedDuration,
                             size_t& bytesWritten) const {
@@ -425,9 +510,7 @@ status_t Dumpsys::writeDump(int fd, const String16& serviceName, std::chrono::mi
     }
 
     if ((status == TIMED_OUT) && (!asProto)) {
-        std::string msg = StringPrintf("\n*** SERVICE '%s' DUMP TIMEOUT (%llums) EXPIRED ***\n\n",
-                                       String8(serviceName).string(), timeout.count());
-        WriteStringToFd(msg, fd);
+        WriteStringToFd(TimeoutMessage(serviceName, timeout), fd);
     }
 
     elapsedDuration = std::chrono::steady_clock::now() - start;
@@ -448,3 +531,192 @@ void Dumpsys::writeDumpFooter(int fd, const String16& serviceName,
                      elapsedDuration.count(), String8(serviceName).string(), oss.str().c_str());
     WriteStringToFd(msg, fd);
 }
+
+namespace {
+
+// A service dumped by writeDumpsInParallel().
+struct ParallelDump {
+    String16 serviceName;
+    // Read end of the pipe the service dumps to; reset once the dump finished.
+    unique_fd fd;
+    std::thread thread;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    std::chrono::duration<double> elapsedDuration;
+    // Output read while the services before this one were still being written.
+    std::string output;
+    size_t bytesWritten = 0;
+    status_t status = OK;
+    bool started = false;
+    bool finished = false;
+    // Whether this service's section is being written; output is then written straight to the
+    // fd instead of being buffered.
+    bool writing = false;
+};
+
+}  // namespace
+
+status_t Dumpsys::writeDumpsInParallel(int fd, const Vector<String16>& services,
+                                       const Vector<String16>& args, int priorityFlags,
+                                       bool asProto, bool addSeparator,
+                                       std::chrono::milliseconds timeout,
+                                       std::chrono::milliseconds deadline, size_t maxJobs,
+                                       const DumpCompleteCallback& onDumpComplete) {
+    using std::chrono::steady_clock;
+
+    status_t result = OK;
+    auto deadlineEnd = steady_clock::time_point::max();
+    if (deadline.count() > 0) {
+        deadlineEnd = steady_clock::now() + deadline;
+    }
+
+    std::vector<ParallelDump> dumps(services.size());
+    for (size_t i = 0; i < services.size(); i++) {
+        dumps[i].serviceName = services[i];
+    }
+
+    auto finish = [](ParallelDump& dump, status_t status) {
+        dump.status = status;
+        dump.finished = true;
+        dump.elapsedDuration = steady_clock::now() - dump.start;
+        // Same as stopDumpThread(): a dump that did not complete may still be blocked.
+        if (status == OK) {
+            dump.thread.join();
+        } else {
+            dump.thread.detach();
+        }
+        dump.fd.reset();
+    };
+
+    size_t next = 0;     // next service to start dumping
+    size_t current = 0;  // service whose section is written next
+    size_t running = 0;
+    while (current < dumps.size()) {
+        auto now = steady_clock::now();
+        while (next < dumps.size() && running < maxJobs && now < deadlineEnd) {
+            ParallelDump& dump = dumps[next++];
+            dump.start = now;
+            dump.end = std::min(now + timeout, deadlineEnd);
+            if (startDumpThread(dump.serviceName, args, &dump.fd, &dump.thread) == OK) {
+                dump.started = true;
+                running++;
+            } else {
+                dump.finished = true;
+            }
+        }
+        if (next < dumps.size() && now >= deadlineEnd) {
+            // The remaining services are not dumped at all.
+            result = TIMED_OUT;
+            for (; next < dumps.size(); next++) {
+                dumps[next].finished = true;
+            }
+        }
+
+        // Write out the sections that are complete, and start writing the next one.
+        while (current < dumps.size()) {
+            ParallelDump& dump = dumps[current];
+            if (!dump.started) {
+                if (!dump.finished) break;
+                current++;
+                continue;
+            }
+            if (!dump.writing) {
+                dump.writing = true;
+                if (addSeparator) {
+                    writeDumpHeader(fd, dump.serviceName, priorityFlags);
+                }
+                if (!WriteStringToFd(dump.output, fd) && !dump.finished) {
+                    aerr << "Failed to write while dumping service " << dump.serviceName << ": "
+                         << strerror(errno) << endl;
+                    finish(dump, -errno);
+                    running--;
+                }
+                std::string().swap(dump.output);
+            }
+            if (!dump.finished) break;
+            if ((dump.status == TIMED_OUT) && (!asProto)) {
+                WriteStringToFd(TimeoutMessage(dump.serviceName, timeout), fd);
+            }
+            if (addSeparator) {
+                writeDumpFooter(fd, dump.serviceName, dump.elapsedDuration);
+            }
+            if (onDumpComplete) {
+                onDumpComplete(dump.serviceName, dump.status, dump.bytesWritten,
+                               dump.elapsedDuration);
+            }
+            current++;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        // Wait for output from any of the running dumps, until the earliest of them expires.
+        std::vector<struct pollfd> pfds;
+        std::vector<ParallelDump*> polled;
+        auto end = steady_clock::time_point::max();
+        for (size_t i = current; i < next; i++) {
+            ParallelDump& dump = dumps[i];
+            if (dump.started && !dump.finished) {
+                pfds.push_back({.fd = dump.fd.get(), .events = POLLIN});
+                polled.push_back(&dump);
+                end = std::min(end, dump.end);
+            }
+        }
+        auto time_left_ms = [end]() {
+            auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+                end - steady_clock::now());
+            return std::max(diff.count(), 0ll);
+        };
+        int rc = TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), time_left_ms()));
+        if (rc < 0) {
+            aerr << "Error in poll while dumping services: " << strerror(errno) << endl;
+            for (ParallelDump* dump : polled) {
+                finish(*dump, -errno);
+            }
+            running = 0;
+            continue;
+        }
+
+        for (size_t i = 0; i < pfds.size(); i++) {
+            ParallelDump& dump = *polled[i];
+            if (steady_clock::now() >= dump.end) {
+                if (dump.end == deadlineEnd) {
+                    result = TIMED_OUT;
+                }
+                finish(dump, TIMED_OUT);
+                running--;
+                continue;
+            }
+            if (pfds[i].revents == 0) {
+                continue;
+            }
+
+            char buf[4096];
+            ssize_t bytesRead = TEMP_FAILURE_RETRY(read(dump.fd.get(), buf, sizeof(buf)));
+            if (bytesRead < 0) {
+                aerr << "Failed to read while dumping service " << dump.serviceName << ": "
+                     << strerror(errno) << endl;
+                finish(dump, -errno);
+                running--;
+                continue;
+            } else if (bytesRead == 0) {
+                // EOF.
+                finish(dump, OK);
+                running--;
+                continue;
+            }
+
+            if (!dump.writing) {
+                dump.output.append(buf, bytesRead);
+            } else if (!WriteFully(fd, buf, bytesRead)) {
+                aerr << "Failed to write while dumping service " << dump.serviceName << ": "
+                     << strerror(errno) << endl;
+                finish(dump, -errno);
+                running--;
+                continue;
+            }
+            dump.bytesWritten += bytesRead;
+        }
+    }
+    return result;
+}
@@ -17,6 +17,8 @@
 #ifndef FRAMEWORK_NATIVE_CMD_DUMPSYS_H_
 #define FRAMEWORK_NATIVE_CMD_DUMPSYS_H_
 
+#include <chrono>
+#include <functional>
 #include <thread>
 
 #include <android-base/unique_fd.h>
@@ -51,6 +53,18 @@ class Dumpsys {
      */
     static void setServiceArgs(Vector<String16>& args, bool asProto, int priorityFlags);
 
+    /**
+     * Sends a binder transaction stats command to the process hosting a service.
+     * @param fd file descriptor the stats are dumped to
+     * @param serviceName
+     * @param args "enable", "disable" or "reset", or nothing to dump the stats
+     * @return {@code OK} if successful
+     *         {@code NAME_NOT_FOUND} service could not be found.
+     *         {@code != OK} error
+     */
+    status_t binderStatsCommand(int fd, const String16& serviceName,
+                                const Vector<String16>& args) const;
+
     /**
      * Starts a thread to connect to a service and get its dump output. The thread redirects
      * the output to a pipe. Thread must be stopped by a subsequent callto {@code
@@ -91,6 +105,38 @@ class Dumpsys {
                        bool asProto, std::chrono::duration<double>& elapsedDuration,
                        size_t& bytesWritten) const;
 
+    /**
+     * Called by {@code writeDumpsInParallel} once the whole section of a service was written.
+     */
+    using DumpCompleteCallback =
+        std::function<void(const String16& serviceName, status_t status, size_t bytesWritten,
+                           const std::chrono::duration<double>& elapsedDuration)>;
+
+    /**
+     * Dumps services concurrently, up to {@code maxJobs} at a time. The output of a service is
+     * buffered until the services before it were written, so sections are written to the fd in
+     * the same order and format as when dumping the services one at a time.
+     * @param fd file descriptor to write data
+     * @param services services to dump, in the order their sections are written
+     * @param args list of arguments to pass to service dump method.
+     * @param priorityFlags dump priority specified
+     * @param asProto used to supresses additional output to the fd such as timeout
+     * error messages
+     * @param addSeparator whether each dump is enclosed in a section header and footer
+     * @param timeout timeout to terminate a single dump if not completed
+     * @param deadline time all dumps must complete in, or 0 for none; pending dumps are not
+     * started once it expires, and running dumps are terminated as if they timed out
+     * @param maxJobs maximum number of services dumped at the same time
+     * @param onDumpComplete optional callback called for each service that was dumped
+     * @return {@code OK} if all services were dumped before the deadline
+     *         {@code TIMED_OUT} the deadline expired
+     */
+    status_t writeDumpsInParallel(int fd, const Vector<String16>& services,
+                                  const Vector<String16>& args, int priorityFlags, bool asProto,
+                                  bool addSeparator, std::chrono::milliseconds timeout,
+                                  std::chrono::milliseconds deadline, size_t maxJobs,
+                                  const DumpCompleteCallback& onDumpComplete = nullptr);
+
     /**
      * Writes a section footer to a file descriptor with duration info.
      * @param fd file descriptor to write data
@@ -116,6 +162,9 @@ class Dumpsys {
     }
 
   private:
+    status_t startDumpThread(const String16& serviceName, const Vector<String16>& args,
+                             android::base::unique_fd* redirectFd, std::thread* thread) const;
+
     android::IServiceManager* sm_;
     std::thread activeThread_;
     mutable android::base::unique_fd redirectFd_;
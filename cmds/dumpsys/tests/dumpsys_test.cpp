@@ -425,6 +425,45 @@ TEST_F(DumpsysTest, DumpMultipleServices) {
     AssertDumped("running3", "dump3");
 }
 
+// Tests 'dumpsys --parallel 2', which should still write the dumps in order
+TEST_F(DumpsysTest, DumpMultipleServicesInParallel) {
+    ExpectListServices({"running1", "stopped2", "running3", "running4"});
+    sp<BinderMock> binder_mock = ExpectDumpAndHang("running1", 1, "dump1");
+    ExpectCheckService("stopped2", false);
+    ExpectDump("running3", "dump3");
+    ExpectDump("running4", "dump4");
+
+    CallMain({"--parallel", "2"});
+
+    AssertRunningServices({"running1", "running3", "running4"});
+    AssertDumped("running1", "dump1");
+    AssertStopped("stopped2");
+    AssertDumped("running3", "dump3");
+    AssertDumped("running4", "dump4");
+    AssertOutputContains("DUMP OF SERVICE running1:\ndump1--------- ");
+    AssertOutputContains("DUMP OF SERVICE running3:\ndump3--------- ");
+}
+
+// Tests 'dumpsys --parallel 2 --deadline 500' on services that take longer than that to dump
+TEST_F(DumpsysTest, DumpMultipleServicesInParallelWithDeadline) {
+    ExpectListServices({"running1", "running2", "running3"});
+    sp<BinderMock> binder_mock1 = ExpectDumpAndHang("running1", 2, "dump1");
+    sp<BinderMock> binder_mock2 = ExpectDumpAndHang("running2", 2, "dump2");
+    ExpectDump("running3", "dump3");
+
+    CallMain({"--parallel", "2", "--deadline", "500"});
+
+    AssertOutputContains("SERVICE 'running1' DUMP TIMEOUT (10000ms) EXPIRED");
+    AssertOutputContains("SERVICE 'running2' DUMP TIMEOUT (10000ms) EXPIRED");
+    AssertNotDumped("dump1");
+    AssertNotDumped("dump2");
+    AssertNotDumped("DUMP OF SERVICE running3");
+
+    // TODO(b/65056227): BinderMock is not destructed because thread is detached on dumpsys.cpp
+    Mock::AllowLeak(binder_mock1.get());
+    Mock::AllowLeak(binder_mock2.get());
+}
+
 // Tests 'dumpsys --skip skipped3 skipped5', which should skip these services
 TEST_F(DumpsysTest, DumpWithSkip) {
     ExpectListServices({"running1", "stopped2", "skipped3", "running4", "skipped5"});
@@ -6,6 +6,7 @@ LOCAL_SRC_FILES:=   \
     Composers.cpp   \
     GLHelper.cpp    \
     Renderers.cpp   \
+    Scenarios.cpp   \
     Main.cpp        \
 
 LOCAL_CFLAGS := -Wall -Werror
@@ -21,8 +22,11 @@ LOCAL_MODULE_STEM_64 := flatland64
 LOCAL_SHARED_LIBRARIES := \
     libEGL      \
     libGLESv2   \
+    libbinder   \
     libcutils   \
     libgui      \
+    libprotobuf-cpp-lite \
+    libtimestats_proto \
     libui       \
     libutils    \
 
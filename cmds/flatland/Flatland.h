@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
@@ -68,4 +69,9 @@ public:
 
 Renderer* staticGradient();
 
+// Runs the SurfaceFlinger scenarios, posting the given number of frames in
+// each, and prints the results.  Each result is also written as a line of
+// JSON to resultsFile if it is not NULL.
+bool runScenarios(uint32_t frames, FILE* resultsFile);
+
 } // namespace android
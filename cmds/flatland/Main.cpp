@@ -26,6 +26,7 @@
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
 
+#include <errno.h>
 #include <math.h>
 #include <getopt.h>
 
@@ -37,6 +38,9 @@ using namespace ::android;
 static uint32_t g_SleepBetweenSamplesMs = 0;
 static bool     g_PresentToWindow       = false;
 static size_t   g_BenchmarkNameLen      = 0;
+static bool     g_RunScenarios          = false;
+static uint32_t g_ScenarioFrames        = 300;
+static FILE*    g_ResultsFile           = NULL;
 
 struct BenchmarkDesc {
     // The name of the test.
@@ -589,6 +593,7 @@ static int cmpDouble(const double* lhs, const double* rhs) {
 // Run a single benchmark and print the result.
 static bool runTest(const BenchmarkDesc b, size_t run) {
     bool success = true;
+    const char* status = "ok";
     double prevResult = 0.0, result = 0.0;
     Vector<double> samples;
 
@@ -628,10 +633,12 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
     if (totalFrames - warmUpFrames > 16) {
         // The test runs too fast to get a stable result.  Skip it.
         printf("  fast");
+        status = "fast";
         goto done;
     } else if (totalFrames == 5 && runTime > 200e6) {
         // The test runs too slow to be very useful.  Skip it.
         printf("  slow");
+        status = "slow";
         goto done;
     }
 
@@ -643,6 +650,7 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
 
         if (newSamples > 512) {
             printf("varies");
+            status = "varies";
             goto done;
         }
 
@@ -655,6 +663,7 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
 
             if (sample < 0.0) {
                 success = false;
+                status = "error";
                 goto done;
             }
 
@@ -668,7 +677,8 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
         result = (samples[elem-1] + samples[elem]) * 0.5;
     } while (fabs(result - prevResult) > threshold * result);
 
-    printf("%6.3f", result / double(totalFrames - warmUpFrames) / 1e6);
+    result = result / double(totalFrames - warmUpFrames) / 1e6;
+    printf("%6.3f", result);
 
 done:
 
@@ -676,6 +686,17 @@ done:
     fflush(stdout);
     r.tearDown();
 
+    if (g_ResultsFile != NULL) {
+        fprintf(g_ResultsFile, "{\"suite\":\"gpu\",\"scenario\":\"%s\","
+                "\"width\":%u,\"height\":%u,\"status\":\"%s\"", b.name,
+                runWidth, runHeight, status);
+        if (strcmp(status, "ok") == 0) {
+            fprintf(g_ResultsFile, ",\"frame_ms\":%.3f", result);
+        }
+        fprintf(g_ResultsFile, "}\n");
+        fflush(g_ResultsFile);
+    }
+
     return success;
 }
 
@@ -723,6 +744,10 @@ static void showHelp(const char *cmd) {
     fprintf(stderr, "options include:\n"
                     "  -s N            sleep for N ms between samples\n"
                     "  -d              display the test frame to a window\n"
+                    "  -f              run the SurfaceFlinger scenarios\n"
+                    "  -n N            post N frames per SurfaceFlinger scenario\n"
+                    "  -o FILE         also write the results to FILE, one\n"
+                    "                  JSON object per line\n"
                     "  --help          print this helpful message and exit\n"
             );
 }
@@ -741,7 +766,7 @@ int main(int argc, char** argv) {
             {     0,               0, 0,  0 }
         };
 
-        ret = getopt_long(argc, argv, "ds:",
+        ret = getopt_long(argc, argv, "ds:fn:o:",
                           long_options, &option_index);
 
         if (ret < 0) {
@@ -757,6 +782,23 @@ int main(int argc, char** argv) {
                 g_SleepBetweenSamplesMs = atoi(optarg);
             break;
 
+            case 'f':
+                g_RunScenarios = true;
+            break;
+
+            case 'n':
+                g_ScenarioFrames = atoi(optarg);
+            break;
+
+            case 'o':
+                g_ResultsFile = fopen(optarg, "w");
+                if (g_ResultsFile == NULL) {
+                    fprintf(stderr, "failed to open %s: %s\n", optarg,
+                            strerror(errno));
+                    exit(1);
+                }
+            break;
+
             case 0:
                 if (strcmp(long_options[option_index].name, "help")) {
                     showHelp(argv[0]);
@@ -778,7 +820,14 @@ int main(int argc, char** argv) {
     }
     printf("\n");
 
-    if (!runTests()) {
+    bool success = g_RunScenarios ?
+            runScenarios(g_ScenarioFrames, g_ResultsFile) : runTests();
+
+    if (g_ResultsFile != NULL) {
+        fclose(g_ResultsFile);
+    }
+
+    if (!success) {
         fprintf(stderr, "exiting due to error.\n");
         return 1;
     }
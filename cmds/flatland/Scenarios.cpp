@@ -0,0 +1,646 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_ALWAYS
+
+#include <binder/IServiceManager.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+#include <system/window.h>
+#include <timestatsproto/TimeStatsProtoHeader.h>
+#include <ui/DisplayInfo.h>
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Trace.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Flatland.h"
+
+namespace android {
+
+using surfaceflinger::SFTimeStatsGlobalProto;
+
+// Layer positions and sizes are given in thousandths of the display size.
+enum { SCENARIO_SPACE = 1000 };
+
+// The frames posted before the measurement starts, to fill the buffer queues.
+enum { SCENARIO_WARM_UP_FRAMES = 30 };
+
+enum {
+    // A color layer instead of a buffer layer. Its color changes every frame.
+    SCENARIO_COLOR = 1 << 0,
+    // Translucent, so that it blends with the layers below.
+    SCENARIO_BLEND = 1 << 1,
+    // Rotated by 45 degrees, which HWC cannot do, so that SurfaceFlinger
+    // composes it with the GPU.
+    SCENARIO_CLIENT = 1 << 2,
+    // RGBA_1010102 buffers in the BT2020 PQ dataspace.
+    SCENARIO_HDR = 1 << 3,
+};
+
+struct ScenarioLayerDesc {
+    uint32_t flags;
+
+    // The index of the parent layer, or -1 for a layer at the top of the
+    // layer stack. Child layers are positioned relative to their parent.
+    int32_t parent;
+
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct ScenarioDesc {
+    // The name of the scenario.
+    const char* name;
+
+    // The list of layers, terminated by a layer of zero width.
+    ScenarioLayerDesc layers[MAX_NUM_LAYERS];
+
+    // The number of rows and columns of small translucent buffer layers that
+    // are tiled over the display above the listed layers.
+    uint32_t gridSize;
+};
+
+static const ScenarioDesc scenarios[] = {
+    { "Static Window (HWC)",
+        {
+            { 0,                -1,   0,  30, 1000,  910 },  // Window
+            { 0,                -1,   0,   0, 1000,   30 },  // Status bar
+            { 0,                -1,   0, 940, 1000,   60 },  // Navigation bar
+        },
+        0,
+    },
+
+    { "Mixed HWC/Client Composition",
+        {
+            { 0,                -1,   0,   0, 1000, 1000 },  // Wallpaper
+            { SCENARIO_BLEND,   -1,   0,  30, 1000,  910 },  // Launcher
+            { SCENARIO_BLEND | SCENARIO_CLIENT,
+                                -1, 250, 150,  500,  500 },  // Rotated window
+            { 0,                -1,   0,   0, 1000,   30 },  // Status bar
+            { 0,                -1,   0, 940, 1000,   60 },  // Navigation bar
+        },
+        0,
+    },
+
+    { "HDR Video",
+        {
+            { 0,                -1,   0,  30, 1000,  910 },  // Window
+            { SCENARIO_HDR,      0,   0, 200, 1000,  562 },  // Video
+            { 0,                -1,   0,   0, 1000,   30 },  // Status bar
+            { 0,                -1,   0, 940, 1000,   60 },  // Navigation bar
+        },
+        0,
+    },
+
+    { "Color Layers",
+        {
+            { SCENARIO_COLOR,   -1,   0,   0, 1000, 1000 },  // Background
+            { 0,                -1,  50,  80,  900,  840 },  // Window
+            { SCENARIO_COLOR | SCENARIO_BLEND,
+                                -1,   0,   0, 1000, 1000 },  // Dim
+            { 0,                -1, 100, 300,  800,  400 },  // Dialog
+        },
+        0,
+    },
+
+    { "Child Layers",
+        {
+            { 0,                -1,   0,  30, 1000,  910 },  // Window
+            { 0,                 0, 100, 100,  800,  450 },  // SurfaceView
+            { SCENARIO_BLEND,    1,   0, 350,  800,  100 },  // Controls
+            { SCENARIO_COLOR | SCENARIO_BLEND,
+                                 0,   0, 700, 1000,  210 },  // Scrim
+            { 0,                -1,   0,   0, 1000,   30 },  // Status bar
+            { 0,                -1,   0, 940, 1000,   60 },  // Navigation bar
+        },
+        0,
+    },
+
+    { "Many Small Layers",
+        {
+            { 0,                -1,   0,   0, 1000, 1000 },  // Wallpaper
+        },
+        8,
+    },
+};
+
+struct ScenarioStage {
+    std::string name;
+    int32_t count;
+    double averageMs;
+    double maxMs;
+};
+
+struct ScenarioResult {
+    double framesPerSecond;
+    int32_t totalFrames;
+    int32_t missedFrames;
+    int32_t clientCompositionFrames;
+    std::vector<ScenarioStage> stages;
+    // Average of each TimeStats delta over the layers of the scenario.
+    std::map<std::string, double> layerDeltasMs;
+};
+
+// Runs a dumpsys command of SurfaceFlinger and returns its output.
+static bool dumpSurfaceFlinger(const Vector<String16>& args,
+        std::string* output) {
+    sp<IBinder> sf = defaultServiceManager()->checkService(
+            String16("SurfaceFlinger"));
+    if (sf == NULL) {
+        fprintf(stderr, "SurfaceFlinger service not found.\n");
+        return false;
+    }
+
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        fprintf(stderr, "tmpfile error: %s\n", strerror(errno));
+        return false;
+    }
+
+    status_t err = sf->dump(fileno(file), args);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceFlinger dump error: %d\n", err);
+        fclose(file);
+        return false;
+    }
+
+    output->clear();
+    rewind(file);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        output->append(buf, n);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool timeStatsCommand(const char* command) {
+    Vector<String16> args;
+    args.add(String16("--timestats"));
+    args.add(String16(command));
+    std::string output;
+    return dumpSurfaceFlinger(args, &output);
+}
+
+class ScenarioRunner {
+
+public:
+
+    explicit ScenarioRunner(const ScenarioDesc& desc) :
+        mDesc(desc),
+        mDisplayWidth(0),
+        mDisplayHeight(0),
+        mFrame(0) {
+    }
+
+    bool setUp() {
+        ATRACE_CALL();
+
+        mComposerClient = new SurfaceComposerClient;
+        status_t err = mComposerClient->initCheck();
+        if (err != NO_ERROR) {
+            fprintf(stderr, "SurfaceComposerClient::initCheck error: %#x\n",
+                    err);
+            return false;
+        }
+
+        sp<IBinder> dpy = SurfaceComposerClient::getBuiltInDisplay(
+                ISurfaceComposer::eDisplayIdMain);
+        DisplayInfo info;
+        err = SurfaceComposerClient::getDisplayInfo(dpy, &info);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "getDisplayInfo error: %#x\n", err);
+            return false;
+        }
+        mDisplayWidth = info.w;
+        mDisplayHeight = info.h;
+
+        for (size_t i = 0; i < MAX_NUM_LAYERS; i++) {
+            if (mDesc.layers[i].width == 0) {
+                break;
+            }
+            mLayers.push_back(ScenarioLayer(mDesc.layers[i]));
+        }
+        const uint32_t grid = mDesc.gridSize;
+        for (uint32_t i = 0; i < grid * grid; i++) {
+            const int32_t cell = SCENARIO_SPACE / grid;
+            ScenarioLayerDesc ld = {
+                SCENARIO_BLEND, -1,
+                int32_t(i % grid) * cell + cell / 8,
+                int32_t(i / grid) * cell + cell / 8,
+                uint32_t(cell * 3 / 4), uint32_t(cell * 3 / 4),
+            };
+            mLayers.push_back(ScenarioLayer(ld));
+        }
+
+        for (size_t i = 0; i < mLayers.size(); i++) {
+            if (!setUpLayer(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void tearDown() {
+        ATRACE_CALL();
+
+        // Destroy the children before their parents.
+        for (size_t i = mLayers.size(); i > 0; i--) {
+            ScenarioLayer& layer = mLayers[i - 1];
+            if (layer.surface != NULL) {
+                native_window_api_disconnect(layer.surface.get(),
+                        NATIVE_WINDOW_API_CPU);
+                layer.surface.clear();
+            }
+            layer.control.clear();
+        }
+        mLayers.clear();
+        mComposerClient.clear();
+    }
+
+    bool run(uint32_t frames, ScenarioResult* result) {
+        ATRACE_CALL();
+
+        for (uint32_t i = 0; i < SCENARIO_WARM_UP_FRAMES; i++) {
+            if (!doFrame()) {
+                return false;
+            }
+        }
+
+        if (!timeStatsCommand("-clear") || !timeStatsCommand("-enable")) {
+            return false;
+        }
+
+        nsecs_t start = systemTime();
+        for (uint32_t i = 0; i < frames; i++) {
+            if (!doFrame()) {
+                timeStatsCommand("-disable");
+                return false;
+            }
+        }
+        nsecs_t elapsed = systemTime() - start;
+
+        Vector<String16> args;
+        args.add(String16("--proto"));
+        args.add(String16("--timestats"));
+        args.add(String16("-dump"));
+        std::string dump;
+        bool dumped = dumpSurfaceFlinger(args, &dump);
+        timeStatsCommand("-disable");
+        if (!dumped) {
+            return false;
+        }
+
+        SFTimeStatsGlobalProto timeStats;
+        if (!timeStats.ParseFromString(dump)) {
+            fprintf(stderr, "Failed to parse the TimeStats dump.\n");
+            return false;
+        }
+        collectResult(timeStats, frames, elapsed, result);
+        return true;
+    }
+
+    uint32_t getDisplayWidth() const { return mDisplayWidth; }
+    uint32_t getDisplayHeight() const { return mDisplayHeight; }
+
+private:
+
+    struct ScenarioLayer {
+        explicit ScenarioLayer(const ScenarioLayerDesc& d) : desc(d) {}
+
+        ScenarioLayerDesc desc;
+        sp<SurfaceControl> control;
+        sp<Surface> surface;
+
+        // The buffers that were filled already. Later frames queue them
+        // again unchanged, so that the cost of producing them stays out of
+        // the measurement.
+        std::set<uint64_t> filledBuffers;
+    };
+
+    bool setUpLayer(size_t index) {
+        ScenarioLayer& layer = mLayers[index];
+        const ScenarioLayerDesc& ld = layer.desc;
+
+        uint32_t w = std::max(1u, ld.width * mDisplayWidth / SCENARIO_SPACE);
+        uint32_t h = std::max(1u, ld.height * mDisplayHeight / SCENARIO_SPACE);
+        PixelFormat format = (ld.flags & SCENARIO_HDR) ?
+                PIXEL_FORMAT_RGBA_1010102 : PIXEL_FORMAT_RGBA_8888;
+        uint32_t flags = 0;
+        if (ld.flags & SCENARIO_COLOR) {
+            flags |= ISurfaceComposerClient::eFXSurfaceColor;
+        }
+        if (!(ld.flags & SCENARIO_BLEND)) {
+            flags |= ISurfaceComposerClient::eOpaque;
+        }
+        SurfaceControl* parent = ld.parent >= 0 ?
+                mLayers[ld.parent].control.get() : NULL;
+
+        // TimeStats only tracks layers named after an app package.
+        String8 name = String8::format("com.android.flatland/layer%zu", index);
+        sp<SurfaceControl> sc = mComposerClient->createSurface(name, w, h,
+                format, flags, parent);
+        if (sc == NULL || !sc->isValid()) {
+            fprintf(stderr, "Failed to create SurfaceControl.\n");
+            return false;
+        }
+
+        SurfaceComposerClient::Transaction t;
+        t.setPosition(sc, float(ld.x * int32_t(mDisplayWidth) / SCENARIO_SPACE),
+                float(ld.y * int32_t(mDisplayHeight) / SCENARIO_SPACE));
+        // Top level layers go above the rest of the system UI.
+        t.setLayer(sc, parent != NULL ? int32_t(index) :
+                0x7FFFF000 + int32_t(index));
+        if (ld.flags & SCENARIO_BLEND) {
+            t.setAlpha(sc, 0.75f);
+        }
+        if (ld.flags & SCENARIO_CLIENT) {
+            const float c = float(M_SQRT1_2);
+            t.setMatrix(sc, c, -c, c, c);
+        }
+        if (ld.flags & SCENARIO_COLOR) {
+            t.setColor(sc, layerColor(index, 0));
+        }
+        t.show(sc);
+        t.apply(true);
+        layer.control = sc;
+
+        if (ld.flags & SCENARIO_COLOR) {
+            return true;
+        }
+
+        layer.surface = sc->getSurface();
+        ANativeWindow* window = layer.surface.get();
+        int err = native_window_api_connect(window, NATIVE_WINDOW_API_CPU);
+        if (err == NO_ERROR) {
+            err = native_window_set_usage(window,
+                    GraphicBuffer::USAGE_SW_WRITE_RARELY);
+        }
+        if (err == NO_ERROR && (ld.flags & SCENARIO_HDR)) {
+            err = native_window_set_buffers_data_space(window,
+                    HAL_DATASPACE_BT2020_PQ);
+        }
+        if (err != NO_ERROR) {
+            fprintf(stderr, "Failed to configure the layer surface: %d\n", err);
+            return false;
+        }
+        return true;
+    }
+
+    static half3 layerColor(size_t index, uint32_t frame) {
+        float hue = float((index * 37 + frame) % 360) / 60.0f;
+        float x = 1.0f - fabsf(fmodf(hue, 2.0f) - 1.0f);
+        switch (int(hue)) {
+            case 0: return half3(1.0f, x, 0.0f);
+            case 1: return half3(x, 1.0f, 0.0f);
+            case 2: return half3(0.0f, 1.0f, x);
+            case 3: return half3(0.0f, x, 1.0f);
+            case 4: return half3(x, 0.0f, 1.0f);
+            default: return half3(1.0f, 0.0f, x);
+        }
+    }
+
+    bool fillBuffer(size_t index, const sp<GraphicBuffer>& buffer) {
+        void* data = NULL;
+        status_t err = buffer->lock(GraphicBuffer::USAGE_SW_WRITE_RARELY,
+                &data);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "GraphicBuffer::lock error: %d\n", err);
+            return false;
+        }
+
+        half3 color = layerColor(index, 0);
+        uint32_t pixel;
+        if (mLayers[index].desc.flags & SCENARIO_HDR) {
+            pixel = uint32_t(float(color.r) * 1023.0f) |
+                    uint32_t(float(color.g) * 1023.0f) << 10 |
+                    uint32_t(float(color.b) * 1023.0f) << 20 | 3u << 30;
+        } else {
+            pixel = uint32_t(float(color.r) * 255.0f) |
+                    uint32_t(float(color.g) * 255.0f) << 8 |
+                    uint32_t(float(color.b) * 255.0f) << 16 | 0xffu << 24;
+        }
+
+        uint32_t* pixels = static_cast<uint32_t*>(data);
+        for (uint32_t y = 0; y < buffer->getHeight(); y++) {
+            for (uint32_t x = 0; x < buffer->getWidth(); x++) {
+                pixels[y * buffer->getStride() + x] = pixel;
+            }
+        }
+
+        buffer->unlock();
+        return true;
+    }
+
+    bool postBuffer(size_t index) {
+        ScenarioLayer& layer = mLayers[index];
+        ANativeWindow* window = layer.surface.get();
+
+        ANativeWindowBuffer* anb;
+        int fenceFd = -1;
+        int err = window->dequeueBuffer(window, &anb, &fenceFd);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "dequeueBuffer error: %d\n", err);
+            return false;
+        }
+        sp<Fence> fence(new Fence(fenceFd));
+        fence->waitForever("flatland");
+
+        sp<GraphicBuffer> buffer(GraphicBuffer::from(anb));
+        if (layer.filledBuffers.insert(buffer->getId()).second &&
+                !fillBuffer(index, buffer)) {
+            window->cancelBuffer(window, anb, -1);
+            return false;
+        }
+
+        err = window->queueBuffer(window, anb, -1);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "queueBuffer error: %d\n", err);
+            return false;
+        }
+        return true;
+    }
+
+    // Posts a buffer to every buffer layer and changes the color of every
+    // color layer. The buffer queues block the dequeues once SurfaceFlinger
+    // falls behind, so frames are posted at the rate it composes them.
+    bool doFrame() {
+        ATRACE_CALL();
+
+        mFrame++;
+        SurfaceComposerClient::Transaction t;
+        for (size_t i = 0; i < mLayers.size(); i++) {
+            ScenarioLayer& layer = mLayers[i];
+            if (layer.desc.flags & SCENARIO_COLOR) {
+                t.setColor(layer.control, layerColor(i, mFrame));
+            } else if (!postBuffer(i)) {
+                return false;
+            }
+        }
+        t.apply();
+        return true;
+    }
+
+    void collectResult(const SFTimeStatsGlobalProto& timeStats,
+            uint32_t frames, nsecs_t elapsed, ScenarioResult* result) {
+        result->framesPerSecond = double(frames) * 1e9 / double(elapsed);
+        result->totalFrames = timeStats.total_frames();
+        result->missedFrames = timeStats.missed_frames();
+        result->clientCompositionFrames =
+                timeStats.client_composition_frames();
+
+        result->stages.clear();
+        for (const auto& stage : timeStats.composition_stages()) {
+            if (stage.count() == 0) {
+                continue;
+            }
+            result->stages.push_back({stage.stage_name(), stage.count(),
+                    double(stage.total_micros()) / stage.count() / 1000.0,
+                    stage.max_micros() / 1000.0});
+        }
+
+        // The histograms only have the lower bound of each bucket, which is
+        // good enough for the millisecond buckets of the deltas.
+        std::map<std::string, std::pair<int64_t, int64_t>> deltas;
+        for (const auto& layer : timeStats.stats()) {
+            if (layer.package_name() != "com.android.flatland") {
+                continue;
+            }
+            for (const auto& delta : layer.deltas()) {
+                auto& sum = deltas[delta.delta_name()];
+                for (const auto& bucket : delta.histograms()) {
+                    sum.first += int64_t(bucket.render_millis()) *
+                            bucket.frame_count();
+                    sum.second += bucket.frame_count();
+                }
+            }
+        }
+        result->layerDeltasMs.clear();
+        for (const auto& delta : deltas) {
+            if (delta.second.second > 0) {
+                result->layerDeltasMs[delta.first] =
+                        double(delta.second.first) / delta.second.second;
+            }
+        }
+    }
+
+    const ScenarioDesc& mDesc;
+
+    sp<SurfaceComposerClient> mComposerClient;
+    uint32_t mDisplayWidth;
+    uint32_t mDisplayHeight;
+    uint32_t mFrame;
+
+    std::vector<ScenarioLayer> mLayers;
+};
+
+static double stageAverageMs(const ScenarioResult& result, const char* name) {
+    for (const auto& stage : result.stages) {
+        if (stage.name == name) {
+            return stage.averageMs;
+        }
+    }
+    return 0.0;
+}
+
+// Scenario names are constants without characters that need escaping.
+static void writeScenarioResult(FILE* file, const ScenarioDesc& s,
+        uint32_t width, uint32_t height, const ScenarioResult& result) {
+    fprintf(file, "{\"suite\":\"surfaceflinger\",\"scenario\":\"%s\","
+            "\"width\":%u,\"height\":%u,\"fps\":%.3f,\"total_frames\":%d,"
+            "\"missed_frames\":%d,\"client_composition_frames\":%d,"
+            "\"stages\":{", s.name, width, height, result.framesPerSecond,
+            result.totalFrames, result.missedFrames,
+            result.clientCompositionFrames);
+    for (size_t i = 0; i < result.stages.size(); i++) {
+        const ScenarioStage& stage = result.stages[i];
+        fprintf(file, "%s\"%s\":{\"count\":%d,\"avg_ms\":%.3f,"
+                "\"max_ms\":%.3f}", i ? "," : "", stage.name.c_str(),
+                stage.count, stage.averageMs, stage.maxMs);
+    }
+    fprintf(file, "},\"layer_deltas_ms\":{");
+    bool first = true;
+    for (const auto& delta : result.layerDeltasMs) {
+        fprintf(file, "%s\"%s\":%.3f", first ? "" : ",", delta.first.c_str(),
+                delta.second);
+        first = false;
+    }
+    fprintf(file, "}}\n");
+    fflush(file);
+}
+
+static size_t maxScenarioNameLen() {
+    size_t maxLen = strlen("Scenario");
+    for (size_t i = 0; i < NELEMS(scenarios); i++) {
+        maxLen = std::max(maxLen, strlen(scenarios[i].name));
+    }
+    return maxLen;
+}
+
+bool runScenarios(uint32_t frames, FILE* resultsFile) {
+    const int nameLen = static_cast<int>(maxScenarioNameLen());
+    printf(" %-*s | Resolution  |   FPS  | Missed | Client | "
+            "Compose (ms) | Present (ms)\n", nameLen, "Scenario");
+
+    for (size_t i = 0; i < NELEMS(scenarios); i++) {
+        const ScenarioDesc& s = scenarios[i];
+        ScenarioRunner r(s);
+        if (!r.setUp()) {
+            fprintf(stderr, "error initializing scenario runner.\n");
+            r.tearDown();
+            return false;
+        }
+
+        ScenarioResult result;
+        bool success = r.run(frames, &result);
+        r.tearDown();
+        if (!success) {
+            return false;
+        }
+
+        const uint32_t w = r.getDisplayWidth();
+        const uint32_t h = r.getDisplayHeight();
+        printf(" %-*s | %4u x %4u | %6.2f | %6d | %6d | %12.3f | %12.3f\n",
+                nameLen, s.name, w, h, result.framesPerSecond,
+                result.missedFrames, result.clientCompositionFrames,
+                stageAverageMs(result, "composeSurfaces"),
+                stageAverageMs(result, "hwcPresent"));
+        fflush(stdout);
+
+        if (resultsFile != NULL) {
+            writeScenarioResult(resultsFile, s, w, h, result);
+        }
+    }
+    return true;
+}
+
+} // namespace android
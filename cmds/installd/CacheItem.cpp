@@ -35,6 +35,7 @@ CacheItem::CacheItem(FTSENT* p) {
     directory = S_ISDIR(p->fts_statp->st_mode);
     size = p->fts_statp->st_blocks * 512;
     modified = p->fts_statp->st_mtime;
+    selfModified = modified;
 
     mParent = static_cast<CacheItem*>(p->fts_parent->fts_pointer);
     if (mParent) {
@@ -66,6 +67,15 @@ std::string CacheItem::buildPath() {
     return res;
 }
 
+bool CacheItem::isCurrent() {
+    struct stat st;
+    auto path = buildPath();
+    if (lstat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    return S_ISDIR(st.st_mode) == directory && st.st_mtime == selfModified;
+}
+
 int CacheItem::purge() {
     int res = 0;
     auto path = buildPath();
@@ -129,6 +139,14 @@ int CacheItem::purge() {
             }
         }
     }
+
+    // Our parent directory was just changed by us, so keep it current
+    if (mParent) {
+        struct stat st;
+        if (lstat(mParent->buildPath().c_str(), &st) == 0) {
+            mParent->selfModified = st.st_mtime;
+        }
+    }
     return res;
 }
 
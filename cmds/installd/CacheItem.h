@@ -42,6 +42,7 @@ public:
     std::string toString();
     std::string buildPath();
 
+    bool isCurrent();
     int purge();
 
     short level;
@@ -50,6 +51,8 @@ public:
     bool tombstone;
     int64_t size;
     time_t modified;
+    /* Modified time of this node alone, before bubbling up from children */
+    time_t selfModified;
 
 private:
     CacheItem* mParent;
@@ -18,6 +18,8 @@
 
 #include "CacheTracker.h"
 
+#include <algorithm>
+
 #include <fts.h>
 #include <sys/quota.h>
 #include <sys/xattr.h>
@@ -33,9 +35,26 @@ using android::base::StringPrintf;
 namespace android {
 namespace installd {
 
+/* How long loaded items may be reused by later passes before walking again */
+static constexpr std::chrono::minutes kItemsMaxAge(10);
+
+/* Orders items from newest to oldest, so the oldest item is on top of the heap */
+static bool compareItems(const std::shared_ptr<CacheItem>& left,
+        const std::shared_ptr<CacheItem>& right) {
+    // TODO: sort dotfiles last
+    // TODO: sort code_cache last
+    if (left->modified != right->modified) {
+        return (left->modified > right->modified);
+    }
+    if (left->level != right->level) {
+        return (left->level < right->level);
+    }
+    return left->directory && !right->directory;
+}
+
 CacheTracker::CacheTracker(userid_t userId, appid_t appId, const std::string& quotaDevice) :
         cacheUsed(0), cacheQuota(0), mUserId(userId), mAppId(appId), mQuotaDevice(quotaDevice),
-        mItemsLoaded(false) {
+        mItemsLoaded(false), mItemsAdopted(false) {
 }
 
 CacheTracker::~CacheTracker() {
@@ -119,7 +138,7 @@ void CacheTracker::loadItemsFrom(const std::string& path) {
         case FTS_SLNONE: {
             auto item = std::shared_ptr<CacheItem>(new CacheItem(p));
             p->fts_pointer = static_cast<void*>(item.get());
-            items.push_back(item);
+            mLoadedItems.push_back(item);
         }
         }
 
@@ -167,7 +186,8 @@ void CacheTracker::loadItemsFrom(const std::string& path) {
 }
 
 void CacheTracker::loadItems() {
-    items.clear();
+    mItems.clear();
+    mLoadedItems.clear();
 
     ATRACE_BEGIN("loadItems");
     for (const auto& path : mDataPaths) {
@@ -176,20 +196,15 @@ void CacheTracker::loadItems() {
     }
     ATRACE_END();
 
+    // Heapify instead of sorting, since callers usually only purge the
+    // oldest fraction of items before they're satisfied
     ATRACE_BEGIN("sortItems");
-    auto cmp = [](std::shared_ptr<CacheItem> left, std::shared_ptr<CacheItem> right) {
-        // TODO: sort dotfiles last
-        // TODO: sort code_cache last
-        if (left->modified != right->modified) {
-            return (left->modified > right->modified);
-        }
-        if (left->level != right->level) {
-            return (left->level < right->level);
-        }
-        return left->directory;
-    };
-    std::stable_sort(items.begin(), items.end(), cmp);
+    mItems = mLoadedItems;
+    std::make_heap(mItems.begin(), mItems.end(), compareItems);
     ATRACE_END();
+
+    mItemsAdopted = false;
+    mItemsLoadedTime = std::chrono::steady_clock::now();
 }
 
 void CacheTracker::ensureItems() {
@@ -201,6 +216,53 @@ void CacheTracker::ensureItems() {
     }
 }
 
+/**
+ * Adopt the items loaded by an earlier tracker for the same UID, letting
+ * purging start without walking the cache again. Adopted items are checked
+ * as they're popped, and any sign of staleness triggers a fresh load.
+ */
+bool CacheTracker::adoptItems(CacheTracker& other) {
+    if (other.isExpired(std::chrono::steady_clock::now()) || other.mDataPaths != mDataPaths) {
+        return false;
+    }
+    mItems = std::move(other.mItems);
+    mLoadedItems = std::move(other.mLoadedItems);
+    mItemsLoadedTime = other.mItemsLoadedTime;
+    mItemsLoaded = true;
+    mItemsAdopted = true;
+    other.mItemsLoaded = false;
+    return true;
+}
+
+std::shared_ptr<CacheItem> CacheTracker::popOldestItem() {
+    while (true) {
+        if (mItems.empty()) {
+            if (!mItemsAdopted) {
+                return nullptr;
+            }
+            // Adopted items ran out; look for anything created since
+            LOG(DEBUG) << "Reloading exhausted items for " << toString();
+            loadItems();
+            continue;
+        }
+
+        std::pop_heap(mItems.begin(), mItems.end(), compareItems);
+        auto item = mItems.back();
+        mItems.pop_back();
+        if (mItemsAdopted && !item->isCurrent()) {
+            LOG(DEBUG) << "Reloading stale items for " << toString() << " at "
+                    << item->toString();
+            loadItems();
+            continue;
+        }
+        return item;
+    }
+}
+
+bool CacheTracker::isExpired(std::chrono::steady_clock::time_point now) {
+    return !mItemsLoaded || (now - mItemsLoadedTime) > kItemsMaxAge;
+}
+
 int CacheTracker::getCacheRatio() {
     if (cacheQuota == 0) {
         return 0;
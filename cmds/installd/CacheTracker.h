@@ -17,6 +17,7 @@
 #ifndef ANDROID_INSTALLD_CACHE_TRACKER_H
 #define ANDROID_INSTALLD_CACHE_TRACKER_H
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <queue>
@@ -36,6 +37,10 @@ namespace installd {
  * Cache tracker for a single UID. Each tracker is used in two modes: first
  * for loading lightweight "stats", and then by loading detailed "items"
  * which can then be purged to free up space.
+ *
+ * Loaded items are kept as a heap with the oldest item on top, and can be
+ * adopted by the tracker created for the same UID on a later pass, so that
+ * purging can start without walking and sorting the whole cache again.
  */
 class CacheTracker {
 public:
@@ -50,21 +55,31 @@ public:
     void loadItems();
 
     void ensureItems();
+    bool adoptItems(CacheTracker& other);
+
+    std::shared_ptr<CacheItem> popOldestItem();
+
+    bool isExpired(std::chrono::steady_clock::time_point now);
 
     int getCacheRatio();
 
     int64_t cacheUsed;
     int64_t cacheQuota;
 
-    std::vector<std::shared_ptr<CacheItem>> items;
-
 private:
     userid_t mUserId;
     appid_t mAppId;
     std::string mQuotaDevice;
     bool mItemsLoaded;
+    /* True when items were adopted from an earlier pass and may be stale */
+    bool mItemsAdopted;
+    std::chrono::steady_clock::time_point mItemsLoadedTime;
 
     std::vector<std::string> mDataPaths;
+    /* Heap of items not yet purged, with the oldest on top */
+    std::vector<std::shared_ptr<CacheItem>> mItems;
+    /* Owns every loaded item, since items reference their parents */
+    std::vector<std::shared_ptr<CacheItem>> mLoadedItems;
 
     bool loadQuotaStats();
     void loadItemsFrom(const std::string& path);
@@ -19,6 +19,7 @@
 #define ATRACE_TAG ATRACE_TAG_PACKAGE_MANAGER
 
 #include <algorithm>
+#include <atomic>
 #include <errno.h>
 #include <fstream>
 #include <fts.h>
@@ -50,12 +51,12 @@
 #include <cutils/properties.h>
 #include <cutils/sched_policy.h>
 #include <log/log.h>               // TODO: Move everything to base/logging.
-#include <logwrap/logwrap.h>
 #include <private/android_filesystem_config.h>
 #include <selinux/android.h>
 #include <system/thread_defs.h>
 #include <utils/Trace.h>
 
+#include "apk_verity.h"
 #include "dexopt.h"
 #include "globals.h"
 #include "installd_deps.h"
@@ -75,8 +76,10 @@ using std::endl;
 namespace android {
 namespace installd {
 
-static constexpr const char* kCpPath = "/system/bin/cp";
 static constexpr const char* kXattrDefault = "user.default";
+// Records the last complete restorecon of an app data directory. Apps cannot set security.*
+// attributes, so they cannot use it to keep their files from being relabeled.
+static constexpr const char* kXattrRestoreconKey = "security.installd_restorecon";
 static constexpr const char* kPropHasReserved = "vold.has_reserved";
 
 static constexpr const int MIN_RESTRICTED_HOME_SDK_VERSION = 24; // > M
@@ -230,12 +233,30 @@ binder::Status checkArgumentPath(const std::unique_ptr<std::string>& path) {
     }                                                       \
 }
 
+// Holds mLock with no dexopt job running, so operations keep excluding dexopt
+#define LOCK_EXCLUSIVE()                                    \
+    std::unique_lock<std::recursive_mutex> lock(mLock);     \
+    waitForDexoptJobsLocked(lock);
+
 #define ASSERT_PAGE_SIZE_4K() {                             \
     if (getpagesize() != kVerityPageSize) {                 \
         return error("FSVerity only supports 4K pages");     \
     }                                                       \
 }
 
+/**
+ * Returns how many dexopt jobs may run at once, which defaults to one and is
+ * never more than the number of online cores, or one on low-ram devices.
+ */
+static int get_dexopt_max_jobs() {
+    if (property_get_bool("ro.config.low_ram", false)) {
+        return 1;
+    }
+    int jobs = property_get_int32("dalvik.vm.dexopt-max-jobs", 1);
+    int cpus = static_cast<int>(std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L));
+    return std::max(1, std::min(jobs, cpus));
+}
+
 }  // namespace
 
 status_t InstalldNativeService::start() {
@@ -282,12 +303,32 @@ status_t InstalldNativeService::dump(int fd, const Vector<String16> & /* args */
         }
     }
 
+    out << endl << "Dexopt jobs (max " << get_dexopt_max_jobs() << "):" << endl;
+    for (const auto& n : mDexoptJobs) {
+        out << "    " << n.first << " = " << n.second << endl;
+    }
+
     out << endl;
     out.flush();
 
     return NO_ERROR;
 }
 
+/**
+ * Wait with mLock held until no dexopt job is running. New jobs aren't
+ * admitted while we wait, so a steady stream of them can't starve us.
+ */
+void InstalldNativeService::waitForDexoptJobsLocked(
+        std::unique_lock<std::recursive_mutex>& lock) {
+    if (mDexoptJobs.empty()) {
+        return;
+    }
+    mExclusiveWaiting++;
+    mDexoptCondition.wait(lock, [&] { return mDexoptJobs.empty(); });
+    mExclusiveWaiting--;
+    mDexoptCondition.notify_all();
+}
+
 /**
  * Perform restorecon of the given path, but only perform recursive restorecon
  * if the label of that top-level file actually changed.  This can save us
@@ -344,6 +385,63 @@ static int restorecon_app_data_lazy(const std::string& parent, const char* name,
             existing);
 }
 
+/**
+ * Returns the key of a recursive restorecon of the given app data directory. The labels in the
+ * tree are fully determined by the policy, which only changes with the build, the seinfo and uid
+ * of the app, and the label of the directory itself, so this is what the key records.
+ */
+static bool get_restorecon_key(const std::string& path, const std::string& seInfo, uid_t uid,
+        std::string* key) {
+    char* context = nullptr;
+    if (lgetfilecon(path.c_str(), &context) < 0) {
+        PLOG(ERROR) << "Failed getfilecon for " << path;
+        return false;
+    }
+    std::string fingerprint = android::base::GetProperty("ro.build.fingerprint", "");
+    *key = StringPrintf("%s %u %s %s", fingerprint.c_str(), uid, seInfo.c_str(), context);
+    free(context);
+    return true;
+}
+
+/**
+ * Perform recursive restorecon of the given path, unless the last one was done with the same
+ * restorecon key, in which case the tree is already labeled as it would be now.
+ */
+static int restorecon_app_data_cached(const std::string& path, const std::string& seInfo,
+        uid_t uid, bool force) {
+    // Note that SELINUX_ANDROID_RESTORECON_DATADATA flag is set by
+    // libselinux. Not needed here.
+
+    // The top-level restorecon is cheap, and gives the directory its label for the key.
+    if (selinux_android_restorecon_pkgdir(path.c_str(), seInfo.c_str(), uid, 0) < 0) {
+        PLOG(ERROR) << "Failed top-level restorecon for " << path;
+        return -1;
+    }
+    std::string key;
+    if (!get_restorecon_key(path, seInfo, uid, &key)) {
+        return -1;
+    }
+    if (!force) {
+        std::string last(key.size(), '\0');
+        if (getxattr(path.c_str(), kXattrRestoreconKey, &last[0], last.size())
+                == static_cast<ssize_t>(last.size()) && last == key) {
+            LOG(DEBUG) << "Skipping restorecon of unchanged " << path;
+            return 0;
+        }
+    }
+
+    if (selinux_android_restorecon_pkgdir(path.c_str(), seInfo.c_str(), uid,
+            SELINUX_ANDROID_RESTORECON_RECURSE) < 0) {
+        PLOG(ERROR) << "Failed recursive restorecon for " << path;
+        return -1;
+    }
+    if (setxattr(path.c_str(), kXattrRestoreconKey, key.data(), key.size(), 0) != 0) {
+        // Only means the next restorecon walks the tree again.
+        PLOG(WARNING) << "Failed to record restorecon of " << path;
+    }
+    return 0;
+}
+
 static int prepare_app_dir(const std::string& path, mode_t target_mode, uid_t uid) {
     if (fs_prepare_dir_strict(path.c_str(), target_mode, uid, uid) != 0) {
         PLOG(ERROR) << "Failed to prepare " << path;
@@ -450,7 +548,7 @@ binder::Status InstalldNativeService::createAppData(const std::unique_ptr<std::s
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgname = packageName.c_str();
@@ -531,7 +629,7 @@ binder::Status InstalldNativeService::migrateAppData(const std::unique_ptr<std::
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgname = packageName.c_str();
@@ -575,7 +673,7 @@ binder::Status InstalldNativeService::clearAppProfiles(const std::string& packag
         const std::string& profileName) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     binder::Status res = ok();
     if (!clear_primary_reference_profile(packageName, profileName)) {
@@ -592,7 +690,7 @@ binder::Status InstalldNativeService::clearAppData(const std::unique_ptr<std::st
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgname = packageName.c_str();
@@ -650,7 +748,7 @@ static int destroy_app_current_profiles(const std::string& pkgname, userid_t use
 binder::Status InstalldNativeService::destroyAppProfiles(const std::string& packageName) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     binder::Status res = ok();
     std::vector<userid_t> users = get_known_users(/*volume_uuid*/ nullptr);
@@ -670,7 +768,7 @@ binder::Status InstalldNativeService::destroyAppData(const std::unique_ptr<std::
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgname = packageName.c_str();
@@ -701,105 +799,143 @@ static gid_t get_cache_gid(uid_t uid) {
     return (gid != -1) ? gid : uid;
 }
 
-binder::Status InstalldNativeService::fixupAppData(const std::unique_ptr<std::string>& uuid,
-        int32_t flags) {
-    ENFORCE_UID(AID_SYSTEM);
-    CHECK_ARGUMENT_UUID(uuid);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
-
-    const char* uuid_ = uuid ? uuid->c_str() : nullptr;
-    for (auto user : get_known_users(uuid_)) {
-        ATRACE_BEGIN("fixup user");
-        FTS* fts;
-        FTSENT* p;
-        auto ce_path = create_data_user_ce_path(uuid_, user);
-        auto de_path = create_data_user_de_path(uuid_, user);
-        char *argv[] = { (char*) ce_path.c_str(), (char*) de_path.c_str(), nullptr };
-        if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL))) {
-            return error("Failed to fts_open");
-        }
-        while ((p = fts_read(fts)) != nullptr) {
-            if (p->fts_info == FTS_D && p->fts_level == 1) {
-                // Track down inodes of cache directories
-                uint64_t raw = 0;
-                ino_t inode_cache = 0;
-                ino_t inode_code_cache = 0;
-                if (getxattr(p->fts_path, kXattrInodeCache, &raw, sizeof(raw)) == sizeof(raw)) {
-                    inode_cache = raw;
-                }
-                if (getxattr(p->fts_path, kXattrInodeCodeCache, &raw, sizeof(raw)) == sizeof(raw)) {
-                    inode_code_cache = raw;
-                }
+// Fixes up the GIDs in the data directory of one package, see fixupAppData().
+static bool fixup_app_data_tree(const std::string& path, int32_t flags) {
+    FTS* fts;
+    FTSENT* p;
+    char *argv[] = { (char*) path.c_str(), nullptr };
+    if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL))) {
+        PLOG(ERROR) << "Failed to fts_open " << path;
+        return false;
+    }
+    while ((p = fts_read(fts)) != nullptr) {
+        if (p->fts_info == FTS_D && p->fts_level == 0) {
+            // Track down inodes of cache directories
+            uint64_t raw = 0;
+            ino_t inode_cache = 0;
+            ino_t inode_code_cache = 0;
+            if (getxattr(p->fts_path, kXattrInodeCache, &raw, sizeof(raw)) == sizeof(raw)) {
+                inode_cache = raw;
+            }
+            if (getxattr(p->fts_path, kXattrInodeCodeCache, &raw, sizeof(raw)) == sizeof(raw)) {
+                inode_code_cache = raw;
+            }
 
-                // Figure out expected GID of each child
-                FTSENT* child = fts_children(fts, 0);
-                while (child != nullptr) {
-                    if ((child->fts_statp->st_ino == inode_cache)
-                            || (child->fts_statp->st_ino == inode_code_cache)
-                            || !strcmp(child->fts_name, "cache")
-                            || !strcmp(child->fts_name, "code_cache")) {
-                        child->fts_number = get_cache_gid(p->fts_statp->st_uid);
-                    } else {
-                        child->fts_number = p->fts_statp->st_uid;
-                    }
-                    child = child->fts_link;
-                }
-            } else if (p->fts_level >= 2) {
-                if (p->fts_level > 2) {
-                    // Inherit GID from parent once we're deeper into tree
-                    p->fts_number = p->fts_parent->fts_number;
+            // Figure out expected GID of each child
+            FTSENT* child = fts_children(fts, 0);
+            while (child != nullptr) {
+                if ((child->fts_statp->st_ino == inode_cache)
+                        || (child->fts_statp->st_ino == inode_code_cache)
+                        || !strcmp(child->fts_name, "cache")
+                        || !strcmp(child->fts_name, "code_cache")) {
+                    child->fts_number = get_cache_gid(p->fts_statp->st_uid);
+                } else {
+                    child->fts_number = p->fts_statp->st_uid;
                 }
+                child = child->fts_link;
+            }
+        } else if (p->fts_level >= 1) {
+            if (p->fts_level > 1) {
+                // Inherit GID from parent once we're deeper into tree
+                p->fts_number = p->fts_parent->fts_number;
+            }
 
-                uid_t uid = p->fts_parent->fts_statp->st_uid;
-                gid_t cache_gid = get_cache_gid(uid);
-                gid_t expected = p->fts_number;
-                gid_t actual = p->fts_statp->st_gid;
-                if (actual == expected) {
+            uid_t uid = p->fts_parent->fts_statp->st_uid;
+            gid_t cache_gid = get_cache_gid(uid);
+            gid_t expected = p->fts_number;
+            gid_t actual = p->fts_statp->st_gid;
+            if (actual == expected) {
 #if FIXUP_DEBUG
-                    LOG(DEBUG) << "Ignoring " << p->fts_path << " with expected GID " << expected;
+                LOG(DEBUG) << "Ignoring " << p->fts_path << " with expected GID " << expected;
 #endif
-                    if (!(flags & FLAG_FORCE)) {
-                        fts_set(fts, p, FTS_SKIP);
-                    }
-                } else if ((actual == uid) || (actual == cache_gid)) {
-                    // Only consider fixing up when current GID belongs to app
-                    if (p->fts_info != FTS_D) {
-                        LOG(INFO) << "Fixing " << p->fts_path << " with unexpected GID " << actual
-                                << " instead of " << expected;
-                    }
-                    switch (p->fts_info) {
-                    case FTS_DP:
-                        // If we're moving towards cache GID, we need to set S_ISGID
-                        if (expected == cache_gid) {
-                            if (chmod(p->fts_path, 02771) != 0) {
-                                PLOG(WARNING) << "Failed to chmod " << p->fts_path;
-                            }
-                        }
-                        // Intentional fall through to also set GID
-                    case FTS_F:
-                        if (chown(p->fts_path, -1, expected) != 0) {
-                            PLOG(WARNING) << "Failed to chown " << p->fts_path;
-                        }
-                        break;
-                    case FTS_SL:
-                    case FTS_SLNONE:
-                        if (lchown(p->fts_path, -1, expected) != 0) {
-                            PLOG(WARNING) << "Failed to chown " << p->fts_path;
+                if (!(flags & FLAG_FORCE)) {
+                    fts_set(fts, p, FTS_SKIP);
+                }
+            } else if ((actual == uid) || (actual == cache_gid)) {
+                // Only consider fixing up when current GID belongs to app
+                if (p->fts_info != FTS_D) {
+                    LOG(INFO) << "Fixing " << p->fts_path << " with unexpected GID " << actual
+                            << " instead of " << expected;
+                }
+                switch (p->fts_info) {
+                case FTS_DP:
+                    // If we're moving towards cache GID, we need to set S_ISGID
+                    if (expected == cache_gid) {
+                        if (chmod(p->fts_path, 02771) != 0) {
+                            PLOG(WARNING) << "Failed to chmod " << p->fts_path;
                         }
-                        break;
                     }
-                } else {
-                    // Ignore all other GID transitions, since they're kinda shady
-                    LOG(WARNING) << "Ignoring " << p->fts_path << " with unexpected GID " << actual
-                            << " instead of " << expected;
-                    if (!(flags & FLAG_FORCE)) {
-                        fts_set(fts, p, FTS_SKIP);
+                    // Intentional fall through to also set GID
+                case FTS_F:
+                    if (chown(p->fts_path, -1, expected) != 0) {
+                        PLOG(WARNING) << "Failed to chown " << p->fts_path;
                     }
+                    break;
+                case FTS_SL:
+                case FTS_SLNONE:
+                    if (lchown(p->fts_path, -1, expected) != 0) {
+                        PLOG(WARNING) << "Failed to chown " << p->fts_path;
+                    }
+                    break;
+                }
+            } else {
+                // Ignore all other GID transitions, since they're kinda shady
+                LOG(WARNING) << "Ignoring " << p->fts_path << " with unexpected GID " << actual
+                        << " instead of " << expected;
+                if (!(flags & FLAG_FORCE)) {
+                    fts_set(fts, p, FTS_SKIP);
                 }
             }
         }
-        fts_close(fts);
+    }
+    fts_close(fts);
+    return true;
+}
+
+// Appends the package directories found in the user data directory 'path' to 'out'.
+static void add_app_data_trees(const std::string& path, std::vector<std::string>* out) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        PLOG(WARNING) << "Failed to opendir " << path;
+        return;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+        if (ent->d_type != DT_DIR || !strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+            continue;
+        }
+        out->push_back(path + "/" + ent->d_name);
+    }
+    closedir(dir);
+}
+
+// Fixing up one package mostly waits on metadata reads, so a few packages are fixed up at once.
+static constexpr size_t kFixupAppDataThreads = 4;
+
+binder::Status InstalldNativeService::fixupAppData(const std::unique_ptr<std::string>& uuid,
+        int32_t flags) {
+    ENFORCE_UID(AID_SYSTEM);
+    CHECK_ARGUMENT_UUID(uuid);
+    LOCK_EXCLUSIVE();
+
+    const char* uuid_ = uuid ? uuid->c_str() : nullptr;
+    for (auto user : get_known_users(uuid_)) {
+        ATRACE_BEGIN("fixup user");
+        std::vector<std::string> trees;
+        add_app_data_trees(create_data_user_ce_path(uuid_, user), &trees);
+        add_app_data_trees(create_data_user_de_path(uuid_, user), &trees);
+
+        // The packages' trees are independent, so they are queued and fixed up in parallel.
+        std::atomic<bool> failed(false);
+        for_each_in_parallel(trees.size(), kFixupAppDataThreads, [&](size_t i) {
+            if (!fixup_app_data_tree(trees[i], flags)) {
+                failed = true;
+            }
+        });
         ATRACE_END();
+        if (failed) {
+            return error("Failed to fts_open");
+        }
     }
     return ok();
 }
@@ -812,7 +948,7 @@ binder::Status InstalldNativeService::moveCompleteApp(const std::unique_ptr<std:
     CHECK_ARGUMENT_UUID(fromUuid);
     CHECK_ARGUMENT_UUID(toUuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* from_uuid = fromUuid ? fromUuid->c_str() : nullptr;
     const char* to_uuid = toUuid ? toUuid->c_str() : nullptr;
@@ -826,23 +962,10 @@ binder::Status InstalldNativeService::moveCompleteApp(const std::unique_ptr<std:
     {
         auto from = create_data_app_package_path(from_uuid, data_app_name);
         auto to = create_data_app_package_path(to_uuid, data_app_name);
-        auto to_parent = create_data_app_path(to_uuid);
-
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            (char*) from.c_str(),
-            (char*) to_parent.c_str()
-        };
 
         LOG(DEBUG) << "Copying " << from << " to " << to;
-        int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-        if (rc != 0) {
-            res = error(rc, "Failed copying " + from + " to " + to);
+        if (copy_directory_recursive(from, to) != 0) {
+            res = error("Failed copying " + from + " to " + to);
             goto fail;
         }
 
@@ -868,40 +991,23 @@ binder::Status InstalldNativeService::moveCompleteApp(const std::unique_ptr<std:
             goto fail;
         }
 
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            nullptr,
-            nullptr
-        };
-
         {
             auto from = create_data_user_de_package_path(from_uuid, user, package_name);
-            auto to = create_data_user_de_path(to_uuid, user);
-            argv[6] = (char*) from.c_str();
-            argv[7] = (char*) to.c_str();
+            auto to = create_data_user_de_package_path(to_uuid, user, package_name);
 
             LOG(DEBUG) << "Copying " << from << " to " << to;
-            int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-            if (rc != 0) {
-                res = error(rc, "Failed copying " + from + " to " + to);
+            if (copy_directory_recursive(from, to) != 0) {
+                res = error("Failed copying " + from + " to " + to);
                 goto fail;
             }
         }
         {
             auto from = create_data_user_ce_package_path(from_uuid, user, package_name);
-            auto to = create_data_user_ce_path(to_uuid, user);
-            argv[6] = (char*) from.c_str();
-            argv[7] = (char*) to.c_str();
+            auto to = create_data_user_ce_package_path(to_uuid, user, package_name);
 
             LOG(DEBUG) << "Copying " << from << " to " << to;
-            int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-            if (rc != 0) {
-                res = error(rc, "Failed copying " + from + " to " + to);
+            if (copy_directory_recursive(from, to) != 0) {
+                res = error("Failed copying " + from + " to " + to);
                 goto fail;
             }
         }
@@ -913,6 +1019,17 @@ binder::Status InstalldNativeService::moveCompleteApp(const std::unique_ptr<std:
         }
     }
 
+    // Make sure the copy is durable before the framework persists the new
+    // location; one syncfs() is far cheaper than an fsync() per file
+    {
+        auto to = create_data_path(to_uuid);
+        android::base::unique_fd fd(
+                TEMP_FAILURE_RETRY(open(to.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+        if (fd == -1 || syncfs(fd.get()) != 0) {
+            PLOG(WARNING) << "Failed to sync " << to;
+        }
+    }
+
     // We let the framework scan the new location and persist that before
     // deleting the data in the old location; this ordering ensures that
     // we can recover from things like battery pulls.
@@ -947,7 +1064,7 @@ binder::Status InstalldNativeService::createUserData(const std::unique_ptr<std::
         int32_t userId, int32_t userSerial ATTRIBUTE_UNUSED, int32_t flags) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     if (flags & FLAG_STORAGE_DE) {
@@ -972,7 +1089,7 @@ binder::Status InstalldNativeService::destroyUserData(const std::unique_ptr<std:
         int32_t userId, int32_t flags) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     binder::Status res = ok();
@@ -1009,7 +1126,7 @@ binder::Status InstalldNativeService::freeCache(const std::unique_ptr<std::strin
         int64_t targetFreeBytes, int64_t cacheReservedBytes, int32_t flags) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     auto data_path = create_data_path(uuid_);
@@ -1079,6 +1196,15 @@ binder::Status InstalldNativeService::freeCache(const std::unique_ptr<std::strin
             }
             fts_close(fts);
         }
+
+        // Reuse items loaded by earlier passes, which are still in order
+        for (const auto& it : trackers) {
+            auto search = mCacheTrackers.find(it.first);
+            if (search != mCacheTrackers.end()) {
+                it.second->adoptItems(*search->second);
+            }
+        }
+        mCacheTrackers.clear();
         ATRACE_END();
 
         // 2. Populate tracker stats and insert into priority queue
@@ -1131,13 +1257,11 @@ binder::Status InstalldNativeService::freeCache(const std::unique_ptr<std::strin
             }
 
             // If no items remain, go find another tracker
-            if (active->items.empty()) {
+            auto item = active->popOldestItem();
+            if (!item) {
                 active = nullptr;
                 continue;
             } else {
-                auto item = active->items.back();
-                active->items.pop_back();
-
                 LOG(DEBUG) << "Purging " << item->toString() << " from " << active->toString();
                 if (!noop) {
                     item->purge();
@@ -1161,6 +1285,17 @@ binder::Status InstalldNativeService::freeCache(const std::unique_ptr<std::strin
         }
         ATRACE_END();
 
+        // 4. Remember loaded items so the next pass can start purging
+        // without walking those caches again
+        if (!noop) {
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& it : trackers) {
+                if (!it.second->isExpired(now)) {
+                    mCacheTrackers[it.first] = it.second;
+                }
+            }
+        }
+
     } else {
         return error("Legacy cache logic no longer supported");
     }
@@ -1178,7 +1313,7 @@ binder::Status InstalldNativeService::rmdex(const std::string& codePath,
         const std::string& instructionSet) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(codePath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     char dex_path[PKG_PATH_MAX];
 
@@ -1310,7 +1445,16 @@ static void collectQuotaStats(const std::string& device, int32_t userId,
     }
 }
 
-static void collectManualStats(const std::string& path, struct stats* stats) {
+// Children directories found by listManualStats(), measured by collectTreeStats() once they
+// are all known so that several of them can be walked at once.
+struct TreeStatsJob {
+    std::string path;
+    struct stats* stats;
+    bool isCache;
+};
+
+static void listManualStats(const std::string& path, struct stats* stats,
+        std::vector<TreeStatsJob>* jobs) {
     DIR *d;
     int dfd;
     struct dirent *de;
@@ -1339,13 +1483,10 @@ static void collectManualStats(const std::string& path, struct stats* stats) {
                 // Don't recurse or count node size
                 continue;
             } else {
-                // Measure all children nodes
-                size = 0;
-                calculate_tree_size(StringPrintf("%s/%s", path.c_str(), name), &size);
-            }
-
-            if (!strcmp(name, "cache") || !strcmp(name, "code_cache")) {
-                stats->cacheSize += size;
+                // Measure all children nodes; everything found inside is considered data
+                const bool isCache = !strcmp(name, "cache") || !strcmp(name, "code_cache");
+                jobs->push_back({StringPrintf("%s/%s", path.c_str(), name), stats, isCache});
+                continue;
             }
         }
 
@@ -1360,6 +1501,22 @@ static void collectManualStats(const std::string& path, struct stats* stats) {
     closedir(d);
 }
 
+static void collectTreeStats(const std::vector<TreeStatsJob>& jobs) {
+    std::vector<std::string> paths;
+    paths.reserve(jobs.size());
+    for (const auto& job : jobs) {
+        paths.push_back(job.path);
+    }
+    std::vector<int64_t> sizes;
+    calculate_tree_sizes(paths, &sizes);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].isCache) {
+            jobs[i].stats->cacheSize += sizes[i];
+        }
+        jobs[i].stats->dataSize += sizes[i];
+    }
+}
+
 static void collectManualStatsForUser(const std::string& path, struct stats* stats,
         bool exclude_apps = false) {
     DIR *d;
@@ -1374,6 +1531,7 @@ static void collectManualStatsForUser(const std::string& path, struct stats* sta
         }
         return;
     }
+    std::vector<TreeStatsJob> jobs;
     dfd = dirfd(d);
     while ((de = readdir(d))) {
         if (de->d_type == DT_DIR) {
@@ -1387,11 +1545,13 @@ static void collectManualStatsForUser(const std::string& path, struct stats* sta
             } else if (exclude_apps && (user_uid >= AID_APP_START && user_uid <= AID_APP_END)) {
                 continue;
             } else {
-                collectManualStats(StringPrintf("%s/%s", path.c_str(), name), stats);
+                listManualStats(StringPrintf("%s/%s", path.c_str(), name), stats, &jobs);
             }
         }
     }
     closedir(d);
+    // The trees of all the apps of the user are walked together.
+    collectTreeStats(jobs);
 }
 
 static void collectManualExternalStatsForUser(const std::string& path, struct stats* stats) {
@@ -1500,14 +1660,17 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
         }
         ATRACE_END();
 
+        // The data directories of all the packages are listed first, and their trees are walked
+        // together once they are all known.
+        std::vector<TreeStatsJob> jobs;
         for (size_t i = 0; i < packageNames.size(); i++) {
             const char* pkgname = packageNames[i].c_str();
 
             ATRACE_BEGIN("data");
             auto cePath = create_data_user_ce_package_path(uuid_, userId, pkgname, ceDataInodes[i]);
-            collectManualStats(cePath, &stats);
+            listManualStats(cePath, &stats, &jobs);
             auto dePath = create_data_user_de_package_path(uuid_, userId, pkgname);
-            collectManualStats(dePath, &stats);
+            listManualStats(dePath, &stats, &jobs);
             ATRACE_END();
 
             if (!uuid) {
@@ -1523,12 +1686,16 @@ binder::Status InstalldNativeService::getAppSize(const std::unique_ptr<std::stri
 
             ATRACE_BEGIN("external");
             auto extPath = create_data_media_package_path(uuid_, userId, "data", pkgname);
-            collectManualStats(extPath, &extStats);
+            listManualStats(extPath, &extStats, &jobs);
             auto mediaPath = create_data_media_package_path(uuid_, userId, "media", pkgname);
-            calculate_tree_size(mediaPath, &extStats.dataSize);
+            jobs.push_back({mediaPath, &extStats, false});
             ATRACE_END();
         }
 
+        ATRACE_BEGIN("trees");
+        collectTreeStats(jobs);
+        ATRACE_END();
+
         if (!uuid) {
             ATRACE_BEGIN("dalvik");
             int32_t sharedGid = multiuser_get_shared_gid(0, appId);
@@ -1886,7 +2053,7 @@ binder::Status InstalldNativeService::dumpProfiles(int32_t uid, const std::strin
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
     CHECK_ARGUMENT_PATH(codePath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     *_aidl_return = dump_profiles(uid, packageName, profileName, codePath);
     return ok();
@@ -1898,7 +2065,7 @@ binder::Status InstalldNativeService::copySystemProfile(const std::string& syste
         bool* _aidl_return) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
     *_aidl_return = copy_system_profile(systemProfile, packageUid, packageName, profileName);
     return ok();
 }
@@ -1908,7 +2075,7 @@ binder::Status InstalldNativeService::mergeProfiles(int32_t uid, const std::stri
         const std::string& profileName, bool* _aidl_return) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     *_aidl_return = analyze_primary_profiles(uid, packageName, profileName);
     return ok();
@@ -1919,7 +2086,7 @@ binder::Status InstalldNativeService::createProfileSnapshot(int32_t appId,
         const std::string& classpath, bool* _aidl_return) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     *_aidl_return = create_profile_snapshot(appId, packageName, profileName, classpath);
     return ok();
@@ -1929,7 +2096,7 @@ binder::Status InstalldNativeService::destroyProfileSnapshot(const std::string&
         const std::string& profileName) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     std::string snapshot = create_snapshot_profile_path(packageName, profileName);
     if ((unlink(snapshot.c_str()) != 0) && (errno != ENOENT)) {
@@ -1959,7 +2126,18 @@ binder::Status InstalldNativeService::dexopt(const std::string& apkPath, int32_t
     }
     CHECK_ARGUMENT_PATH(outputPath);
     CHECK_ARGUMENT_PATH(dexMetadataPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+
+    // Admit up to the configured number of concurrent jobs, letting any
+    // operation that's waiting for running jobs to finish go first
+    pid_t tid = gettid();
+    {
+        std::unique_lock<std::recursive_mutex> lock(mLock);
+        int maxJobs = get_dexopt_max_jobs();
+        mDexoptCondition.wait(lock, [&] {
+            return mExclusiveWaiting == 0 && static_cast<int>(mDexoptJobs.size()) < maxJobs;
+        });
+        mDexoptJobs[tid] = apkPath + " " + instructionSet;
+    }
 
     const char* apk_path = apkPath.c_str();
     const char* pkgname = getCStr(packageName, "*");
@@ -1976,12 +2154,18 @@ binder::Status InstalldNativeService::dexopt(const std::string& apkPath, int32_t
     int res = android::installd::dexopt(apk_path, uid, pkgname, instruction_set, dexoptNeeded,
             oat_dir, dexFlags, compiler_filter, volume_uuid, class_loader_context, se_info,
             downgrade, targetSdkVersion, profile_name, dm_path, compilation_reason, &error_msg);
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(mLock);
+        mDexoptJobs.erase(tid);
+    }
+    mDexoptCondition.notify_all();
     return res ? error(res, error_msg) : ok();
 }
 
 binder::Status InstalldNativeService::markBootComplete(const std::string& instructionSet) {
     ENFORCE_UID(AID_SYSTEM);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* instruction_set = instructionSet.c_str();
 
@@ -2006,7 +2190,7 @@ binder::Status InstalldNativeService::linkNativeLibraryDirectory(
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
     CHECK_ARGUMENT_PATH(nativeLibPath32);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgname = packageName.c_str();
@@ -2175,7 +2359,7 @@ binder::Status InstalldNativeService::idmap(const std::string& targetApkPath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(targetApkPath);
     CHECK_ARGUMENT_PATH(overlayApkPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* target_apk = targetApkPath.c_str();
     const char* overlay_apk = overlayApkPath.c_str();
@@ -2262,7 +2446,7 @@ fail:
 binder::Status InstalldNativeService::removeIdmap(const std::string& overlayApkPath) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(overlayApkPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* overlay_apk = overlayApkPath.c_str();
     char idmap_path[PATH_MAX];
@@ -2285,27 +2469,34 @@ binder::Status InstalldNativeService::restoreconAppData(const std::unique_ptr<st
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_UUID(uuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     binder::Status res = ok();
 
-    // SELINUX_ANDROID_RESTORECON_DATADATA flag is set by libselinux. Not needed here.
-    unsigned int seflags = SELINUX_ANDROID_RESTORECON_RECURSE;
     const char* uuid_ = uuid ? uuid->c_str() : nullptr;
     const char* pkgName = packageName.c_str();
-    const char* seinfo = seInfo.c_str();
 
     uid_t uid = multiuser_get_uid(userId, appId);
+    std::vector<std::string> paths;
     if (flags & FLAG_STORAGE_CE) {
-        auto path = create_data_user_ce_package_path(uuid_, userId, pkgName);
-        if (selinux_android_restorecon_pkgdir(path.c_str(), seinfo, uid, seflags) < 0) {
-            res = error("restorecon failed for " + path);
-        }
+        paths.push_back(create_data_user_ce_package_path(uuid_, userId, pkgName));
     }
     if (flags & FLAG_STORAGE_DE) {
-        auto path = create_data_user_de_package_path(uuid_, userId, pkgName);
-        if (selinux_android_restorecon_pkgdir(path.c_str(), seinfo, uid, seflags) < 0) {
-            res = error("restorecon failed for " + path);
+        paths.push_back(create_data_user_de_package_path(uuid_, userId, pkgName));
+    }
+
+    // The CE and DE trees are relabeled at the same time. errno is per thread, so each
+    // failure keeps its own for the error.
+    std::vector<int> errors(paths.size());
+    for_each_in_parallel(paths.size(), paths.size(), [&](size_t i) {
+        if (restorecon_app_data_cached(paths[i], seInfo, uid, flags & FLAG_FORCE) != 0) {
+            errors[i] = errno != 0 ? errno : EIO;
+        }
+    });
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (errors[i] != 0) {
+            errno = errors[i];
+            res = error("restorecon failed for " + paths[i]);
         }
     }
     return res;
@@ -2315,7 +2506,7 @@ binder::Status InstalldNativeService::createOatDir(const std::string& oatDir,
         const std::string& instructionSet) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(oatDir);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* oat_dir = oatDir.c_str();
     const char* instruction_set = instructionSet.c_str();
@@ -2340,7 +2531,7 @@ binder::Status InstalldNativeService::createOatDir(const std::string& oatDir,
 binder::Status InstalldNativeService::rmPackageDir(const std::string& packageDir) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(packageDir);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     if (validate_apk_path(packageDir.c_str())) {
         return error("Invalid path " + packageDir);
@@ -2356,7 +2547,7 @@ binder::Status InstalldNativeService::linkFile(const std::string& relativePath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(fromBase);
     CHECK_ARGUMENT_PATH(toBase);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* relative_path = relativePath.c_str();
     const char* from_base = fromBase.c_str();
@@ -2386,7 +2577,7 @@ binder::Status InstalldNativeService::moveAb(const std::string& apkPath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(apkPath);
     CHECK_ARGUMENT_PATH(outputPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* apk_path = apkPath.c_str();
     const char* instruction_set = instructionSet.c_str();
@@ -2401,7 +2592,7 @@ binder::Status InstalldNativeService::deleteOdex(const std::string& apkPath,
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(apkPath);
     CHECK_ARGUMENT_PATH(outputPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     const char* apk_path = apkPath.c_str();
     const char* instruction_set = instructionSet.c_str();
@@ -2430,24 +2621,12 @@ struct fsverity_measurement {
 
 #endif
 
-binder::Status InstalldNativeService::installApkVerity(const std::string& filePath,
-        const ::android::base::unique_fd& verityInputAshmem, int32_t contentSize) {
-    ENFORCE_UID(AID_SYSTEM);
-    CHECK_ARGUMENT_PATH(filePath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
-
-    if (!android::base::GetBoolProperty(kPropApkVerityMode, false)) {
-        return ok();
-    }
-#ifndef NDEBUG
-    ASSERT_PAGE_SIZE_4K();
-#endif
-    // TODO: also check fsverity support in the current file system if compiled with DEBUG.
-    // TODO: change ashmem to some temporary file to support huge apk.
-    if (!ashmem_valid(verityInputAshmem.get())) {
-        return error("FD is not an ashmem");
-    }
-
+/**
+ * Appends the verity data to the file at the next page boundary beyond its end, where fsverity
+ * starts, and enables fsverity on it.
+ */
+static binder::Status append_and_enable_verity(const std::string& filePath, const char* data,
+        size_t size) {
     // 1. Seek to the next page boundary beyond the end of the file.
     ::android::base::unique_fd wfd(open(filePath.c_str(), O_WRONLY));
     if (wfd.get() < 0) {
@@ -2466,9 +2645,46 @@ binder::Status InstalldNativeService::installApkVerity(const std::string& filePa
         return error("Failed to lseek " + filePath);
     }
 
-    // 2. Write everything in the ashmem to the file.  Note that allocated
-    //    ashmem size is multiple of page size, which is different from the
-    //    actual content size.
+    // 2. Write the verity data.
+    const char* cursor = data;
+    size_t remaining = size;
+    while (remaining > 0) {
+        int ret = TEMP_FAILURE_RETRY(write(wfd.get(), cursor, remaining));
+        if (ret < 0) {
+            return error("Failed to write to " + filePath + " (" + std::to_string(remaining) +
+                         + "/" + std::to_string(size) + ")");
+        }
+        cursor += ret;
+        remaining -= ret;
+    }
+    wfd.reset();
+
+    // 3. Enable fsverity (needs readonly fd. Once it's done, the file becomes immutable.
+    ::android::base::unique_fd rfd(open(filePath.c_str(), O_RDONLY));
+    if (ioctl(rfd.get(), FS_IOC_ENABLE_VERITY, nullptr) < 0) {
+        return error("Failed to enable fsverity on " + filePath);
+    }
+    return ok();
+}
+
+binder::Status InstalldNativeService::installApkVerity(const std::string& filePath,
+        const ::android::base::unique_fd& verityInputAshmem, int32_t contentSize) {
+    ENFORCE_UID(AID_SYSTEM);
+    CHECK_ARGUMENT_PATH(filePath);
+    LOCK_EXCLUSIVE();
+
+    if (!android::base::GetBoolProperty(kPropApkVerityMode, false)) {
+        return ok();
+    }
+#ifndef NDEBUG
+    ASSERT_PAGE_SIZE_4K();
+#endif
+    // TODO: also check fsverity support in the current file system if compiled with DEBUG.
+    // TODO: change ashmem to some temporary file to support huge apk.
+    if (!ashmem_valid(verityInputAshmem.get())) {
+        return error("FD is not an ashmem");
+    }
+
     int shmSize = ashmem_get_size_region(verityInputAshmem.get());
     if (shmSize < 0) {
         return error("Failed to get ashmem size: " + std::to_string(shmSize));
@@ -2491,32 +2707,44 @@ binder::Status InstalldNativeService::installApkVerity(const std::string& filePa
     if (data.get() == MAP_FAILED) {
         return error("Failed to mmap the ashmem");
     }
-    char* cursor = reinterpret_cast<char*>(data.get());
-    int remaining = contentSize;
-    while (remaining > 0) {
-        int ret = TEMP_FAILURE_RETRY(write(wfd.get(), cursor, remaining));
-        if (ret < 0) {
-            return error("Failed to write to " + filePath + " (" + std::to_string(remaining) +
-                         + "/" + std::to_string(contentSize) + ")");
-        }
-        cursor += ret;
-        remaining -= ret;
-    }
-    wfd.reset();
+    return append_and_enable_verity(filePath, reinterpret_cast<const char*>(data.get()),
+            contentSize);
+}
 
-    // 3. Enable fsverity (needs readonly fd. Once it's done, the file becomes immutable.
-    ::android::base::unique_fd rfd(open(filePath.c_str(), O_RDONLY));
-    if (ioctl(rfd.get(), FS_IOC_ENABLE_VERITY, nullptr) < 0) {
-        return error("Failed to enable fsverity on " + filePath);
+// Building the tree is bound by hashing, so it uses the cores it can get.
+static constexpr size_t kApkVerityThreads = 8;
+
+binder::Status InstalldNativeService::generateAndInstallApkVerity(const std::string& filePath) {
+    ENFORCE_UID(AID_SYSTEM);
+    CHECK_ARGUMENT_PATH(filePath);
+    LOCK_EXCLUSIVE();
+
+    if (!android::base::GetBoolProperty(kPropApkVerityMode, false)) {
+        return ok();
     }
-    return ok();
+#ifndef NDEBUG
+    ASSERT_PAGE_SIZE_4K();
+#endif
+    std::vector<uint8_t> verity;
+    {
+        ::android::base::unique_fd fd(open(filePath.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd.get() < 0) {
+            return error("Failed to open " + filePath);
+        }
+        std::string error_msg;
+        if (!build_apk_verity(fd.get(), kApkVerityThreads, &verity, &error_msg)) {
+            return error("Failed to build verity data for " + filePath + ": " + error_msg);
+        }
+    }
+    return append_and_enable_verity(filePath, reinterpret_cast<const char*>(verity.data()),
+            verity.size());
 }
 
 binder::Status InstalldNativeService::assertFsverityRootHashMatches(const std::string& filePath,
         const std::vector<uint8_t>& expectedHash) {
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PATH(filePath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     if (!android::base::GetBoolProperty(kPropApkVerityMode, false)) {
         return ok();
@@ -2555,7 +2783,7 @@ binder::Status InstalldNativeService::reconcileSecondaryDexFile(
     CHECK_ARGUMENT_UUID(volumeUuid);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
     CHECK_ARGUMENT_PATH(dexPath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     bool result = android::installd::reconcile_secondary_dex_file(
             dexPath, packageName, uid, isas, volumeUuid, storage_flag, _aidl_return);
@@ -2579,6 +2807,23 @@ binder::Status InstalldNativeService::hashSecondaryDexFile(
     return result ? ok() : error();
 }
 
+binder::Status InstalldNativeService::reconcileAndHashSecondaryDexFiles(
+        const std::vector<std::string>& dexPaths, const std::string& packageName, int32_t uid,
+        const std::vector<std::string>& isas, const std::unique_ptr<std::string>& volumeUuid,
+        int32_t storageFlag, std::vector<uint8_t>* hashes, std::vector<int32_t>* _aidl_return) {
+    ENFORCE_UID(AID_SYSTEM);
+    CHECK_ARGUMENT_UUID(volumeUuid);
+    CHECK_ARGUMENT_PACKAGE_NAME(packageName);
+    for (const std::string& dexPath : dexPaths) {
+        CHECK_ARGUMENT_PATH(dexPath);
+    }
+    LOCK_EXCLUSIVE();
+
+    bool result = android::installd::reconcile_and_hash_secondary_dex_files(
+            dexPaths, packageName, uid, isas, volumeUuid, storageFlag, _aidl_return, hashes);
+    return result ? ok() : error();
+}
+
 binder::Status InstalldNativeService::invalidateMounts() {
     ENFORCE_UID(AID_SYSTEM);
     std::lock_guard<std::recursive_mutex> lock(mMountsLock);
@@ -2667,7 +2912,7 @@ binder::Status InstalldNativeService::prepareAppProfile(const std::string& packa
     ENFORCE_UID(AID_SYSTEM);
     CHECK_ARGUMENT_PACKAGE_NAME(packageName);
     CHECK_ARGUMENT_PATH(codePath);
-    std::lock_guard<std::recursive_mutex> lock(mLock);
+    LOCK_EXCLUSIVE();
 
     *_aidl_return = prepare_app_profile(packageName, userId, appId, profileName, codePath,
         dexMetadata);
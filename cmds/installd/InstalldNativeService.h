@@ -21,6 +21,8 @@
 #include <inttypes.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 
@@ -34,6 +36,8 @@
 namespace android {
 namespace installd {
 
+class CacheTracker;
+
 class InstalldNativeService : public BinderService<InstalldNativeService>, public os::BnInstalld {
 public:
     static status_t start();
@@ -124,6 +128,7 @@ public:
             const std::unique_ptr<std::string>& outputPath);
     binder::Status installApkVerity(const std::string& filePath,
             const ::android::base::unique_fd& verityInput, int32_t contentSize);
+    binder::Status generateAndInstallApkVerity(const std::string& filePath);
     binder::Status assertFsverityRootHashMatches(const std::string& filePath,
             const std::vector<uint8_t>& expectedHash);
     binder::Status reconcileSecondaryDexFile(const std::string& dexPath,
@@ -132,6 +137,10 @@ public:
     binder::Status hashSecondaryDexFile(const std::string& dexPath,
         const std::string& packageName, int32_t uid, const std::unique_ptr<std::string>& volumeUuid,
         int32_t storageFlag, std::vector<uint8_t>* _aidl_return);
+    binder::Status reconcileAndHashSecondaryDexFiles(const std::vector<std::string>& dexPaths,
+        const std::string& packageName, int32_t uid, const std::vector<std::string>& isas,
+        const std::unique_ptr<std::string>& volumeUuid, int32_t storageFlag,
+        std::vector<uint8_t>* hashes, std::vector<int32_t>* _aidl_return);
 
     binder::Status invalidateMounts();
     binder::Status isQuotaSupported(const std::unique_ptr<std::string>& volumeUuid,
@@ -144,6 +153,13 @@ public:
 
 private:
     std::recursive_mutex mLock;
+    /* Signalled whenever a dexopt job or exclusive operation finishes */
+    std::condition_variable_any mDexoptCondition;
+    /* Map from binder thread to the dexopt job it's running; dexopt jobs run
+     * concurrently without holding mLock, other operations wait them out */
+    std::unordered_map<pid_t, std::string> mDexoptJobs;
+    /* Number of operations waiting for running dexopt jobs to finish */
+    int mExclusiveWaiting = 0;
 
     std::recursive_mutex mMountsLock;
     std::recursive_mutex mQuotasLock;
@@ -155,6 +171,10 @@ private:
 
     /* Map from UID to cache quota size */
     std::unordered_map<uid_t, int64_t> mCacheQuotas;
+    /* Map from UID to tracker whose loaded items freeCache may reuse */
+    std::unordered_map<uid_t, std::shared_ptr<CacheTracker>> mCacheTrackers;
+
+    void waitForDexoptJobsLocked(std::unique_lock<std::recursive_mutex>& lock);
 
     std::string findDataMediaPath(const std::unique_ptr<std::string>& uuid, userid_t userid);
     std::string findQuotaDeviceForUuid(const std::unique_ptr<std::string>& uuid);
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_PACKAGE_MANAGER
+
+#include "apk_verity.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/stringprintf.h>
+#include <openssl/sha.h>
+#include <utils/Trace.h>
+
+#include "utils.h"
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace installd {
+
+// These must match ApkVerityBuilder in the framework, which computes the same data when the
+// caller provides it, and the experimental fs-verity format of the kernel.
+static constexpr size_t kChunkSize = 4096;
+static constexpr size_t kDigestSize = SHA256_DIGEST_LENGTH;
+static constexpr size_t kFsverityHeaderSize = 64;
+static constexpr size_t kFsverityExtensionsSize = 48;
+static constexpr uint8_t kSalt[8] = {};
+
+static constexpr off64_t kEocdSize = 22;
+static constexpr off64_t kEocdMaxCommentSize = 0xffff;
+static constexpr uint32_t kEocdMagic = 0x06054b50;
+static constexpr off64_t kEocdCentralDirOffsetFieldOffset = 16;
+static constexpr size_t kEocdCentralDirOffsetFieldSize = 4;
+static constexpr off64_t kEocdCommentSizeFieldOffset = 20;
+
+static constexpr char kApkSigBlockMagic[] = "APK Sig Block 42";
+static constexpr size_t kApkSigBlockMagicSize = sizeof(kApkSigBlockMagic) - 1;
+// Size field and magic at the end of the block.
+static constexpr size_t kApkSigBlockFooterSize = 8 + kApkSigBlockMagicSize;
+
+// Chunks read by one pread() of the leaf level.
+static constexpr size_t kChunksPerRead = 64;
+
+namespace {
+
+struct SignatureInfo {
+    off64_t signing_block_offset;
+    off64_t central_dir_offset;
+    off64_t eocd_offset;
+};
+
+}  // namespace
+
+template <typename T>
+static T get_le(const uint8_t* data) {
+    T value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+template <typename T>
+static void put_le(std::vector<uint8_t>* out, T value) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+    out->insert(out->end(), data, data + sizeof(value));
+}
+
+static bool read_at(int fd, off64_t offset, uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(pread64(fd, data, size, offset));
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool find_signature_info(int fd, off64_t file_size, SignatureInfo* info,
+        std::string* error_msg) {
+    // The end of central directory record is at the end of the file, before its comment.
+    off64_t search_size = std::min(file_size, kEocdSize + kEocdMaxCommentSize);
+    std::vector<uint8_t> tail(search_size);
+    if (!read_at(fd, file_size - search_size, tail.data(), tail.size())) {
+        *error_msg = "Failed to read the end of the file";
+        return false;
+    }
+    off64_t eocd = -1;
+    for (off64_t i = search_size - kEocdSize; i >= 0; i--) {
+        if (get_le<uint32_t>(&tail[i]) == kEocdMagic &&
+                get_le<uint16_t>(&tail[i + kEocdCommentSizeFieldOffset]) ==
+                        search_size - kEocdSize - i) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        *error_msg = "Not a zip file";
+        return false;
+    }
+    info->eocd_offset = file_size - search_size + eocd;
+    info->central_dir_offset = get_le<uint32_t>(&tail[eocd + kEocdCentralDirOffsetFieldOffset]);
+    if (info->central_dir_offset > info->eocd_offset ||
+            info->central_dir_offset < static_cast<off64_t>(kApkSigBlockFooterSize)) {
+        *error_msg = "Invalid central directory offset";
+        return false;
+    }
+
+    // The APK Signing Block is right before the central directory and ends with its size
+    // (excluding the size field at its start) and magic.
+    uint8_t footer[kApkSigBlockFooterSize];
+    if (!read_at(fd, info->central_dir_offset - sizeof(footer), footer, sizeof(footer))) {
+        *error_msg = "Failed to read the APK Signing Block";
+        return false;
+    }
+    if (memcmp(footer + 8, kApkSigBlockMagic, kApkSigBlockMagicSize)) {
+        *error_msg = "No APK Signing Block";
+        return false;
+    }
+    uint64_t block_size = get_le<uint64_t>(footer);
+    if (block_size < sizeof(footer) ||
+            block_size + 8 > static_cast<uint64_t>(info->central_dir_offset)) {
+        *error_msg = "Invalid APK Signing Block size";
+        return false;
+    }
+    info->signing_block_offset = info->central_dir_offset - block_size - 8;
+
+    // Elided data must be whole chunks, so that the chunks of the file map to the tree.
+    if (info->signing_block_offset % kChunkSize != 0 || (block_size + 8) % kChunkSize != 0) {
+        *error_msg = "APK Signing Block is not page aligned";
+        return false;
+    }
+    return true;
+}
+
+// Returns the offset of each level in the tree, root level first, followed by the tree size.
+static std::vector<size_t> get_level_offsets(uint64_t data_size) {
+    std::vector<size_t> level_sizes;
+    while (true) {
+        uint64_t digests_size = (data_size + kChunkSize - 1) / kChunkSize * kDigestSize;
+        level_sizes.push_back((digests_size + kChunkSize - 1) / kChunkSize * kChunkSize);
+        if (digests_size <= kChunkSize) {
+            break;
+        }
+        data_size = digests_size;
+    }
+
+    std::vector<size_t> offsets(1, 0);
+    for (auto size = level_sizes.rbegin(); size != level_sizes.rend(); size++) {
+        offsets.push_back(offsets.back() + *size);
+    }
+    return offsets;
+}
+
+static void hash_chunk(const uint8_t* chunk, uint8_t* digest) {
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, kSalt, sizeof(kSalt));
+    SHA256_Update(&ctx, chunk, kChunkSize);
+    SHA256_Final(digest, &ctx);
+}
+
+/**
+ * Hashes the chunks [begin, end) of the APK as seen by the tree, which is the file without its
+ * signing block, with the central directory offset in the end of central directory record
+ * replaced by the offset of the signing block, and zero-padded to whole chunks.
+ */
+static bool hash_leaf_chunks(int fd, off64_t file_size, const SignatureInfo& info,
+        size_t begin, size_t end, uint8_t* leaves) {
+    const off64_t signing_block_size = info.central_dir_offset - info.signing_block_offset;
+    const off64_t data_size = file_size - signing_block_size;
+    const off64_t patch_offset =
+            info.eocd_offset + kEocdCentralDirOffsetFieldOffset - signing_block_size;
+    const uint32_t patch = info.signing_block_offset;
+    const size_t signing_block_chunk = info.signing_block_offset / kChunkSize;
+
+    std::vector<uint8_t> buffer(kChunksPerRead * kChunkSize);
+    for (size_t chunk = begin; chunk < end;) {
+        // Reads stop at the signing block, so that each one is contiguous in the file.
+        size_t count = std::min(end - chunk, kChunksPerRead);
+        if (chunk < signing_block_chunk) {
+            count = std::min(count, signing_block_chunk - chunk);
+        }
+        const off64_t offset = chunk * kChunkSize;
+        const size_t size = std::min<off64_t>(count * kChunkSize, data_size - offset);
+        const off64_t file_offset =
+                chunk < signing_block_chunk ? offset : offset + signing_block_size;
+        if (!read_at(fd, file_offset, buffer.data(), size)) {
+            return false;
+        }
+        std::fill(buffer.begin() + size, buffer.end(), 0);
+
+        // The patched field may straddle two reads.
+        for (size_t i = 0; i < sizeof(patch); i++) {
+            off64_t position = patch_offset + i - offset;
+            if (position >= 0 && position < static_cast<off64_t>(size)) {
+                buffer[position] = reinterpret_cast<const uint8_t*>(&patch)[i];
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            hash_chunk(&buffer[i * kChunkSize], &leaves[(chunk + i) * kDigestSize]);
+        }
+        chunk += count;
+    }
+    return true;
+}
+
+static void put_fsverity_header(std::vector<uint8_t>* out, uint64_t file_size) {
+    const size_t start = out->size();
+    const char magic[] = "TrueBrew";
+    out->insert(out->end(), magic, magic + 8);
+    out->push_back(1);                 // major version
+    out->push_back(0);                 // minor version
+    out->push_back(12);                // log2 of the data block size
+    out->push_back(7);                 // log2 of the number of digests per tree block
+    put_le<uint16_t>(out, 1);          // meta algorithm, SHA-256
+    put_le<uint16_t>(out, 1);          // data algorithm, SHA-256
+    put_le<uint32_t>(out, 0);          // flags
+    put_le<uint32_t>(out, 0);          // reserved
+    put_le<uint64_t>(out, file_size);  // original file size
+    out->push_back(2);                 // authenticated extension count
+    out->push_back(0);                 // unauthenticated extension count
+    out->insert(out->end(), kSalt, kSalt + sizeof(kSalt));
+    out->resize(start + kFsverityHeaderSize, 0);
+}
+
+static void put_fsverity_extensions(std::vector<uint8_t>* out, const SignatureInfo& info) {
+    const size_t start = out->size();
+
+    // Elide the signing block.
+    put_le<uint32_t>(out, 8 + 16);  // size of the extension
+    put_le<uint16_t>(out, 1);       // elide
+    put_le<uint16_t>(out, 0);       // reserved
+    put_le<uint64_t>(out, info.signing_block_offset);
+    put_le<uint64_t>(out, info.central_dir_offset - info.signing_block_offset);
+
+    // Patch the central directory offset to where the signing block was.
+    put_le<uint32_t>(out, 8 + 8 + kEocdCentralDirOffsetFieldSize);
+    put_le<uint16_t>(out, 2);       // patch
+    put_le<uint16_t>(out, 0);       // reserved
+    put_le<uint64_t>(out, info.eocd_offset + kEocdCentralDirOffsetFieldOffset);
+    put_le<uint32_t>(out, info.signing_block_offset);
+    out->resize(start + kFsverityExtensionsSize, 0);  // extensions are 8 byte aligned
+}
+
+bool build_apk_verity(int fd, size_t max_threads, std::vector<uint8_t>* out_verity,
+        std::string* error_msg) {
+    ATRACE_NAME("build_apk_verity");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        *error_msg = StringPrintf("Failed to stat: %s", strerror(errno));
+        return false;
+    }
+    SignatureInfo info;
+    if (!find_signature_info(fd, st.st_size, &info, error_msg)) {
+        return false;
+    }
+
+    const uint64_t data_size = st.st_size - (info.central_dir_offset - info.signing_block_offset);
+    const std::vector<size_t> offsets = get_level_offsets(data_size);
+    const size_t tree_size = offsets.back();
+    out_verity->assign(tree_size, 0);
+    uint8_t* tree = out_verity->data();
+
+    // Leaf level, split into one contiguous range per thread so that each reads sequentially.
+    const size_t leaf_count = (data_size + kChunkSize - 1) / kChunkSize;
+    const size_t num_ranges = std::max<size_t>(1, std::min(max_threads, leaf_count));
+    const size_t range_size = (leaf_count + num_ranges - 1) / num_ranges;
+    uint8_t* leaves = tree + offsets[offsets.size() - 2];
+    std::atomic<bool> failed(false);
+    for_each_in_parallel(num_ranges, num_ranges, [&](size_t i) {
+        size_t begin = i * range_size;
+        size_t end = std::min(leaf_count, begin + range_size);
+        if (begin < end && !hash_leaf_chunks(fd, st.st_size, info, begin, end, leaves)) {
+            failed = true;
+        }
+    });
+    if (failed) {
+        *error_msg = "Failed to read the file";
+        return false;
+    }
+
+    // Each upper level hashes the chunks of the level below it. These are 128 times smaller
+    // than the level below, so they are not worth splitting.
+    for (size_t level = offsets.size() - 2; level-- > 0;) {
+        const uint8_t* input = tree + offsets[level + 1];
+        const size_t chunks = (offsets[level + 2] - offsets[level + 1]) / kChunkSize;
+        for (size_t i = 0; i < chunks; i++) {
+            hash_chunk(input + i * kChunkSize, tree + offsets[level] + i * kDigestSize);
+        }
+    }
+
+    put_fsverity_header(out_verity, st.st_size);
+    put_fsverity_extensions(out_verity, info);
+    // Reverse offset of the header from the end of the file, including this field.
+    put_le<uint32_t>(out_verity, kFsverityHeaderSize + kFsverityExtensionsSize + 4);
+    return true;
+}
+
+}  // namespace installd
+}  // namespace android
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INSTALLD_APK_VERITY_H
+#define ANDROID_INSTALLD_APK_VERITY_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace installd {
+
+/**
+ * Builds the apk-verity data of the APK open at 'fd', in the layout the
+ * framework's ApkVerityBuilder produces: the Merkle tree of the APK with its
+ * APK Signing Block elided, root level first, followed by the fs-verity header,
+ * its extensions and the reverse offset of the header. The data is meant to be
+ * appended after the APK at the next page boundary.
+ *
+ * The leaf level is most of the work, so it is split among up to 'max_threads'
+ * threads, each reading and hashing its own part of the file.
+ */
+bool build_apk_verity(int fd, size_t max_threads, std::vector<uint8_t>* out_verity,
+        std::string* error_msg);
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // ANDROID_INSTALLD_APK_VERITY_H
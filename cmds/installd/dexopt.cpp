@@ -15,12 +15,15 @@
  */
 #define LOG_TAG "installed"
 
+#include <algorithm>
 #include <array>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/capability.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -28,7 +31,9 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <iomanip>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -823,6 +828,13 @@ static void run_profman_copy_and_update(unique_fd&& profile_fd,
             /*copy_and_update*/true);
 }
 
+// Returns true if the profile is known to be empty. Current profiles are truncated once their
+// data has been merged into the reference profile, so empty ones have nothing new to offer.
+static bool is_empty_profile(const unique_fd& profile_fd) {
+    struct stat st;
+    return fstat(profile_fd.get(), &st) == 0 && st.st_size == 0;
+}
+
 // Decides if profile guided compilation is needed or not based on existing profiles.
 // The location is the package name for primary apks or the dex path for secondary dex files.
 // Returns true if there is enough information in the current profiles that makes it
@@ -835,9 +847,13 @@ static bool analyze_profiles(uid_t uid, const std::string& package_name,
     unique_fd reference_profile_fd;
     open_profile_files(uid, package_name, location, is_secondary_dex,
         &profiles_fd, &reference_profile_fd);
+    // Empty current profiles can't change the reference profile, so don't make profman
+    // open them; when they're all empty this also spares us the fork and exec.
+    profiles_fd.erase(std::remove_if(profiles_fd.begin(), profiles_fd.end(),
+            is_empty_profile), profiles_fd.end());
     if (profiles_fd.empty() || (reference_profile_fd.get() < 0)) {
-        // Skip profile guided compilation because no profiles were found.
-        // Or if the reference profile info couldn't be opened.
+        // Skip profile guided compilation because no profiles were found, or only
+        // empty ones. Or if the reference profile info couldn't be opened.
         return false;
     }
 
@@ -2154,6 +2170,101 @@ enum ReconcileSecondaryDexResult {
     kReconcileSecondaryDexAccessIOError = 4,
 };
 
+// Reconciles the secondary dex 'dex_path' once the capabilities have been dropped to those of
+// 'uid'. Returns a ReconcileSecondaryDexResult.
+static int reconcile_secondary_dex_file_as_app(const std::string& dex_path,
+        const std::string& pkgname, int uid, const std::vector<std::string>& isas,
+        const char* volume_uuid_cstr, int storage_flag) {
+    if (!validate_secondary_dex_path(pkgname.c_str(), dex_path.c_str(), volume_uuid_cstr,
+            uid, storage_flag)) {
+        LOG(ERROR) << "Could not validate secondary dex path " << dex_path;
+        return kReconcileSecondaryDexValidationError;
+    }
+
+    SecondaryDexAccess access_check = check_secondary_dex_access(dex_path);
+    switch (access_check) {
+        case kSecondaryDexAccessDoesNotExist:
+             // File does not exist. Proceed with cleaning.
+            break;
+        case kSecondaryDexAccessReadOk: return kReconcileSecondaryDexExists;
+        case kSecondaryDexAccessIOError: return kReconcileSecondaryDexAccessIOError;
+        case kSecondaryDexAccessPermissionError: return kReconcileSecondaryDexValidationError;
+        default:
+            LOG(ERROR) << "Unexpected result from check_secondary_dex_access: " << access_check;
+            return kReconcileSecondaryDexValidationError;
+    }
+
+    // The secondary dex does not exist anymore or it's. Clear any generated files.
+    char oat_path[PKG_PATH_MAX];
+    char oat_dir[PKG_PATH_MAX];
+    char oat_isa_dir[PKG_PATH_MAX];
+    bool result = true;
+    for (size_t i = 0; i < isas.size(); i++) {
+        std::string error_msg;
+        if (!create_secondary_dex_oat_layout(
+                dex_path,isas[i], oat_dir, oat_isa_dir, oat_path, &error_msg)) {
+            LOG(ERROR) << error_msg;
+            return kReconcileSecondaryDexValidationError;
+        }
+
+        // Delete oat/vdex/art files.
+        result = unlink_if_exists(oat_path) && result;
+        result = unlink_if_exists(create_vdex_filename(oat_path)) && result;
+        result = unlink_if_exists(create_image_filename(oat_path)) && result;
+
+        // Delete profiles.
+        std::string current_profile = create_current_profile_path(
+            multiuser_get_user_id(uid), pkgname, dex_path, /*is_secondary*/true);
+        std::string reference_profile = create_reference_profile_path(
+            pkgname, dex_path, /*is_secondary*/true);
+        result = unlink_if_exists(current_profile) && result;
+        result = unlink_if_exists(reference_profile) && result;
+
+        // We upgraded once the location of current profile for secondary dex files.
+        // Check for any previous left-overs and remove them as well.
+        std::string old_current_profile = dex_path + ".prof";
+        result = unlink_if_exists(old_current_profile);
+
+        // Try removing the directories as well, they might be empty.
+        result = rmdir_if_empty(oat_isa_dir) && result;
+        result = rmdir_if_empty(oat_dir) && result;
+    }
+    if (!result) {
+        PLOG(ERROR) << "Failed to clean secondary dex artifacts for location " << dex_path;
+    }
+    return result ? kReconcileSecondaryDexCleanedUp : kReconcileSecondaryDexAccessIOError;
+}
+
+// Interprets the ReconcileSecondaryDexResult 'return_code' of 'dex_path', with the same return
+// value and out_secondary_dex_exists as reconcile_secondary_dex_file.
+static bool process_reconcile_result(const std::string& dex_path, int return_code,
+        /*out*/bool* out_secondary_dex_exists) {
+    LOG(DEBUG) << "Reconcile secondary dex path " << dex_path << " result=" << return_code;
+
+    switch (return_code) {
+        case kReconcileSecondaryDexCleanedUp:
+        case kReconcileSecondaryDexValidationError:
+            // If we couldn't validate assume the dex file does not exist.
+            // This will purge the entry from the PM records.
+            *out_secondary_dex_exists = false;
+            return true;
+        case kReconcileSecondaryDexExists:
+            *out_secondary_dex_exists = true;
+            return true;
+        case kReconcileSecondaryDexAccessIOError:
+            // We had an access IO error.
+            // Return false so that we can try again.
+            // The value of out_secondary_dex_exists does not matter in this case and by convention
+            // is set to false.
+            *out_secondary_dex_exists = false;
+            return false;
+        default:
+            LOG(ERROR) << "Unexpected code from reconcile_secondary_dex_file: " << return_code;
+            *out_secondary_dex_exists = false;
+            return false;
+    }
+}
+
 // Reconcile the secondary dex 'dex_path' and its generated oat files.
 // Return true if all the parameters are valid and the secondary dex file was
 //   processed successfully (i.e. the dex_path either exists, or if not, its corresponding
@@ -2186,64 +2297,8 @@ bool reconcile_secondary_dex_file(const std::string& dex_path,
         drop_capabilities(uid);
 
         const char* volume_uuid_cstr = volume_uuid == nullptr ? nullptr : volume_uuid->c_str();
-        if (!validate_secondary_dex_path(pkgname.c_str(), dex_path.c_str(), volume_uuid_cstr,
-                uid, storage_flag)) {
-            LOG(ERROR) << "Could not validate secondary dex path " << dex_path;
-            _exit(kReconcileSecondaryDexValidationError);
-        }
-
-        SecondaryDexAccess access_check = check_secondary_dex_access(dex_path);
-        switch (access_check) {
-            case kSecondaryDexAccessDoesNotExist:
-                 // File does not exist. Proceed with cleaning.
-                break;
-            case kSecondaryDexAccessReadOk: _exit(kReconcileSecondaryDexExists);
-            case kSecondaryDexAccessIOError: _exit(kReconcileSecondaryDexAccessIOError);
-            case kSecondaryDexAccessPermissionError: _exit(kReconcileSecondaryDexValidationError);
-            default:
-                LOG(ERROR) << "Unexpected result from check_secondary_dex_access: " << access_check;
-                _exit(kReconcileSecondaryDexValidationError);
-        }
-
-        // The secondary dex does not exist anymore or it's. Clear any generated files.
-        char oat_path[PKG_PATH_MAX];
-        char oat_dir[PKG_PATH_MAX];
-        char oat_isa_dir[PKG_PATH_MAX];
-        bool result = true;
-        for (size_t i = 0; i < isas.size(); i++) {
-            std::string error_msg;
-            if (!create_secondary_dex_oat_layout(
-                    dex_path,isas[i], oat_dir, oat_isa_dir, oat_path, &error_msg)) {
-                LOG(ERROR) << error_msg;
-                _exit(kReconcileSecondaryDexValidationError);
-            }
-
-            // Delete oat/vdex/art files.
-            result = unlink_if_exists(oat_path) && result;
-            result = unlink_if_exists(create_vdex_filename(oat_path)) && result;
-            result = unlink_if_exists(create_image_filename(oat_path)) && result;
-
-            // Delete profiles.
-            std::string current_profile = create_current_profile_path(
-                multiuser_get_user_id(uid), pkgname, dex_path, /*is_secondary*/true);
-            std::string reference_profile = create_reference_profile_path(
-                pkgname, dex_path, /*is_secondary*/true);
-            result = unlink_if_exists(current_profile) && result;
-            result = unlink_if_exists(reference_profile) && result;
-
-            // We upgraded once the location of current profile for secondary dex files.
-            // Check for any previous left-overs and remove them as well.
-            std::string old_current_profile = dex_path + ".prof";
-            result = unlink_if_exists(old_current_profile);
-
-            // Try removing the directories as well, they might be empty.
-            result = rmdir_if_empty(oat_isa_dir) && result;
-            result = rmdir_if_empty(oat_dir) && result;
-        }
-        if (!result) {
-            PLOG(ERROR) << "Failed to clean secondary dex artifacts for location " << dex_path;
-        }
-        _exit(result ? kReconcileSecondaryDexCleanedUp : kReconcileSecondaryDexAccessIOError);
+        _exit(reconcile_secondary_dex_file_as_app(dex_path, pkgname, uid, isas, volume_uuid_cstr,
+                storage_flag));
     }
 
     int return_code = wait_child(pid);
@@ -2253,30 +2308,63 @@ bool reconcile_secondary_dex_file(const std::string& dex_path,
         return_code = WEXITSTATUS(return_code);
     }
 
-    LOG(DEBUG) << "Reconcile secondary dex path " << dex_path << " result=" << return_code;
+    return process_reconcile_result(dex_path, return_code, out_secondary_dex_exists);
+}
 
-    switch (return_code) {
-        case kReconcileSecondaryDexCleanedUp:
-        case kReconcileSecondaryDexValidationError:
-            // If we couldn't validate assume the dex file does not exist.
-            // This will purge the entry from the PM records.
-            *out_secondary_dex_exists = false;
+// Adds the contents of 'fd' to 'ctx'. Regular files are mapped so that they are hashed without
+// copying them through a buffer; anything that cannot be mapped is read instead.
+// Returns false if the file could not be read.
+static bool hash_fd(int fd, SHA256_CTX* ctx) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            SHA256_Update(ctx, data, st.st_size);
+            munmap(data, st.st_size);
             return true;
-        case kReconcileSecondaryDexExists:
-            *out_secondary_dex_exists = true;
+        }
+    }
+
+    std::vector<uint8_t> buffer(65536);
+    while (true) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
+        if (bytes_read == 0) {
             return true;
-        case kReconcileSecondaryDexAccessIOError:
-            // We had an access IO error.
-            // Return false so that we can try again.
-            // The value of out_secondary_dex_exists does not matter in this case and by convention
-            // is set to false.
-            *out_secondary_dex_exists = false;
-            return false;
-        default:
-            LOG(ERROR) << "Unexpected code from reconcile_secondary_dex_file: " << return_code;
-            *out_secondary_dex_exists = false;
+        } else if (bytes_read == -1) {
             return false;
+        }
+
+        SHA256_Update(ctx, buffer.data(), bytes_read);
+    }
+}
+
+// Hashes the already validated secondary dex 'dex_path' once the capabilities have been dropped
+// to those of the app. Returns 0 on success, with out_hashed set to false if the file does not
+// exist or is not accessible to the app, or a DexoptReturnCodes error.
+static int hash_secondary_dex_file_as_app(const std::string& dex_path,
+        /*out*/std::array<uint8_t, SHA256_DIGEST_LENGTH>* out_hash, /*out*/bool* out_hashed) {
+    *out_hashed = false;
+    unique_fd fd(TEMP_FAILURE_RETRY(open(dex_path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW)));
+    if (fd == -1) {
+        if (errno == EACCES || errno == ENOENT) {
+            // Not treated as an error.
+            return 0;
+        }
+        PLOG(ERROR) << "Failed to open secondary dex " << dex_path;
+        return DexoptReturnCodes::kHashOpenPath;
     }
+
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    if (!hash_fd(fd, &ctx)) {
+        PLOG(ERROR) << "Failed to read secondary dex " << dex_path;
+        return DexoptReturnCodes::kHashReadDex;
+    }
+
+    SHA256_Final(out_hash->data(), &ctx);
+    *out_hashed = true;
+    return 0;
 }
 
 // Compute and return the hash (SHA-256) of the secondary dex file at dex_path.
@@ -2318,34 +2406,12 @@ bool hash_secondary_dex_file(const std::string& dex_path, const std::string& pkg
             _exit(DexoptReturnCodes::kHashValidatePath);
         }
 
-        unique_fd fd(TEMP_FAILURE_RETRY(open(dex_path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW)));
-        if (fd == -1) {
-            if (errno == EACCES || errno == ENOENT) {
-                // Not treated as an error.
-                _exit(0);
-            }
-            PLOG(ERROR) << "Failed to open secondary dex " << dex_path;
-            _exit(DexoptReturnCodes::kHashOpenPath);
-        }
-
-        SHA256_CTX ctx;
-        SHA256_Init(&ctx);
-
-        std::vector<uint8_t> buffer(65536);
-        while (true) {
-            ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
-            if (bytes_read == 0) {
-                break;
-            } else if (bytes_read == -1) {
-                PLOG(ERROR) << "Failed to read secondary dex " << dex_path;
-                _exit(DexoptReturnCodes::kHashReadDex);
-            }
-
-            SHA256_Update(&ctx, buffer.data(), bytes_read);
-        }
-
         std::array<uint8_t, SHA256_DIGEST_LENGTH> hash;
-        SHA256_Final(hash.data(), &ctx);
+        bool hashed;
+        int result = hash_secondary_dex_file_as_app(dex_path, &hash, &hashed);
+        if (result != 0 || !hashed) {
+            _exit(result);
+        }
         if (!WriteFully(pipe_write, hash.data(), hash.size())) {
             _exit(DexoptReturnCodes::kHashWrite);
         }
@@ -2363,6 +2429,122 @@ bool hash_secondary_dex_file(const std::string& dex_path, const std::string& pkg
     return wait_child(pid) == 0;
 }
 
+// Result of one file of reconcile_and_hash_secondary_dex_files, sent from the child process
+// to installd.
+struct SecondaryDexBatchResult {
+    uint32_t index;
+    int32_t flags;
+    std::array<uint8_t, SHA256_DIGEST_LENGTH> hash;
+};
+// The workers of the child share the pipe, so each result must be written atomically.
+static_assert(sizeof(SecondaryDexBatchResult) <= PIPE_BUF, "result too large for the pipe");
+
+// Number of secondary dex files reconciled and hashed at the same time.
+static constexpr size_t kSecondaryDexBatchThreads = 4;
+
+bool reconcile_and_hash_secondary_dex_files(const std::vector<std::string>& dex_paths,
+        const std::string& pkgname, int uid, const std::vector<std::string>& isas,
+        const std::unique_ptr<std::string>& volume_uuid, int storage_flag,
+        /*out*/std::vector<int32_t>* out_results, /*out*/std::vector<uint8_t>* out_hashes) {
+    // Files without a result from the child keep the error flag so that they can be retried.
+    out_results->assign(dex_paths.size(), SECONDARY_DEX_ERROR);
+    out_hashes->assign(dex_paths.size() * SHA256_DIGEST_LENGTH, 0);
+    if (isas.size() == 0) {
+        LOG(ERROR) << "reconcile_and_hash_secondary_dex_files called with empty isas vector";
+        return false;
+    }
+
+    if (storage_flag != FLAG_STORAGE_CE && storage_flag != FLAG_STORAGE_DE) {
+        LOG(ERROR) << "reconcile_and_hash_secondary_dex_files called with invalid storage_flag: "
+                << storage_flag;
+        return false;
+    }
+
+    if (dex_paths.empty()) {
+        return true;
+    }
+
+    unique_fd pipe_read, pipe_write;
+    if (!Pipe(&pipe_read, &pipe_write)) {
+        PLOG(ERROR) << "Failed to create pipe";
+        return false;
+    }
+
+    // Like reconcile_secondary_dex_file and hash_secondary_dex_file, the files are only accessed
+    // with the capabilities of the app. A single child handles the whole batch instead of
+    // forking twice per file, and processes the files in parallel since most of the time is
+    // spent waiting for storage.
+    pid_t pid = fork();
+    if (pid == 0) {
+        // child -- drop privileges before continuing. The workers are created afterwards so
+        // that they inherit the reduced credentials.
+        drop_capabilities(uid);
+        pipe_read.reset();
+
+        const char* volume_uuid_cstr = volume_uuid == nullptr ? nullptr : volume_uuid->c_str();
+        std::atomic<size_t> next_index(0);
+        auto worker = [&]() {
+            for (size_t i = next_index++; i < dex_paths.size(); i = next_index++) {
+                SecondaryDexBatchResult result = {};
+                result.index = i;
+
+                bool exists;
+                int return_code = reconcile_secondary_dex_file_as_app(dex_paths[i], pkgname, uid,
+                        isas, volume_uuid_cstr, storage_flag);
+                if (!process_reconcile_result(dex_paths[i], return_code, &exists)) {
+                    result.flags = SECONDARY_DEX_ERROR;
+                } else if (exists) {
+                    bool hashed;
+                    result.flags = SECONDARY_DEX_EXISTS;
+                    if (hash_secondary_dex_file_as_app(dex_paths[i], &result.hash, &hashed) != 0) {
+                        result.flags |= SECONDARY_DEX_ERROR;
+                    } else if (hashed) {
+                        result.flags |= SECONDARY_DEX_HASHED;
+                    }
+                }
+
+                if (!WriteFully(pipe_write, &result, sizeof(result))) {
+                    _exit(DexoptReturnCodes::kHashWrite);
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        const size_t num_threads = std::min(kSecondaryDexBatchThreads, dex_paths.size());
+        for (size_t i = 1; i < num_threads; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        _exit(0);
+    }
+
+    // parent
+    pipe_write.reset();
+
+    // Results arrive as the files are done. If the child dies part way, for instance because a
+    // mapped file was truncated, the files it reported keep their results.
+    SecondaryDexBatchResult result;
+    while (ReadFully(pipe_read, &result, sizeof(result))) {
+        if (result.index >= dex_paths.size()) {
+            LOG(ERROR) << "Invalid secondary dex result index " << result.index;
+            continue;
+        }
+        (*out_results)[result.index] = result.flags;
+        std::copy(result.hash.begin(), result.hash.end(),
+                out_hashes->begin() + result.index * SHA256_DIGEST_LENGTH);
+    }
+
+    int return_code = wait_child(pid);
+    if (return_code != 0) {
+        LOG(WARNING) << "reconcile and hash of secondary dex files of " << pkgname
+                << " failed: " << return_code;
+    }
+    return true;
+}
+
 // Helper for move_ab, so that we can have common failure-case cleanup.
 static bool unlink_and_rename(const char* from, const char* to) {
     // Check whether "from" exists, and if so whether it's regular. If it is, unlink. Otherwise,
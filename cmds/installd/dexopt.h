@@ -102,6 +102,16 @@ bool hash_secondary_dex_file(const std::string& dex_path,
         const std::string& pkgname, int uid, const std::unique_ptr<std::string>& volume_uuid,
         int storage_flag, std::vector<uint8_t>* out_secondary_dex_hash);
 
+// Reconciles and then hashes each of the secondary dex files 'dex_paths' of one package, as
+// reconcile_secondary_dex_file and hash_secondary_dex_file would, in a single child process.
+// out_results gets a combination of the SECONDARY_DEX_* flags for each file, and out_hashes the
+// SHA-256 hash of each file flagged SECONDARY_DEX_HASHED (zeros for the others).
+// Returns false if the parameters are invalid.
+bool reconcile_and_hash_secondary_dex_files(const std::vector<std::string>& dex_paths,
+        const std::string& pkgname, int uid, const std::vector<std::string>& isas,
+        const std::unique_ptr<std::string>& volume_uuid, int storage_flag,
+        /*out*/std::vector<int32_t>* out_results, /*out*/std::vector<uint8_t>* out_hashes);
+
 int dexopt(const char *apk_path, uid_t uid, const char *pkgName, const char *instruction_set,
         int dexopt_needed, const char* oat_dir, int dexopt_flags, const char* compiler_filter,
         const char* volume_uuid, const char* class_loader_context, const char* se_info,
@@ -75,6 +75,11 @@ constexpr int DEXOPT_MASK =
 constexpr int FLAG_STORAGE_DE = 1 << 0;
 constexpr int FLAG_STORAGE_CE = 1 << 1;
 
+// Per file results of reconcileAndHashSecondaryDexFiles.
+constexpr int SECONDARY_DEX_EXISTS = 1 << 0;
+constexpr int SECONDARY_DEX_HASHED = 1 << 1;
+constexpr int SECONDARY_DEX_ERROR  = 1 << 2;
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
 }  // namespace installd
@@ -15,6 +15,9 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <limits>
 #include <random>
@@ -22,6 +25,8 @@
 #include <selinux/android.h>
 #include <selinux/avc.h>
 #include <stdlib.h>
+#include <set>
+#include <shared_mutex>
 #include <string.h>
 #include <sys/capability.h>
 #include <sys/prctl.h>
@@ -30,8 +35,10 @@
 
 #include <android-base/logging.h>
 #include <android-base/macros.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <cutils/fs.h>
 #include <cutils/properties.h>
 #include <dex2oat_return_codes.h>
@@ -111,7 +118,7 @@ class OTAPreoptService {
     //
     // 4) Prepare(compile) boot image, if necessary.
     //
-    // 5) Run update.
+    // 5) Run update, of one package or of a batch of them.
     int Main(int argc, char** argv) {
         if (!ReadArguments(argc, argv)) {
             LOG(ERROR) << "Failed reading command line.";
@@ -135,12 +142,14 @@ class OTAPreoptService {
 
         PrepareEnvironment();
 
-        if (!PrepareBootImage(/* force */ false)) {
-            LOG(ERROR) << "Failed preparing boot image.";
-            return 5;
+        for (const OTAPreoptParameters& parameters : batch_) {
+            if (!PrepareBootImage(parameters.instruction_set, /* force */ false)) {
+                LOG(ERROR) << "Failed preparing boot image.";
+                return 5;
+            }
         }
 
-        int dexopt_retcode = RunPreopt();
+        int dexopt_retcode = RunBatch();
 
         return dexopt_retcode;
     }
@@ -294,7 +303,19 @@ private:
     }
 
     bool ReadArguments(int argc, char** argv) {
-        return parameters_.ReadArguments(argc, const_cast<const char**>(argv));
+        if (argc > 2 && strcmp(argv[2], "batch") == 0) {
+            if (!OTAPreoptParameters::ReadBatchArguments(argc, const_cast<const char**>(argv),
+                                                         &batch_)) {
+                return false;
+            }
+            parameters_ = batch_.front();
+            return true;
+        }
+        if (!parameters_.ReadArguments(argc, const_cast<const char**>(argv))) {
+            return false;
+        }
+        batch_.push_back(parameters_);
+        return true;
     }
 
     void PrepareEnvironment() {
@@ -309,12 +330,11 @@ private:
 
     // Ensure that we have the right boot image. The first time any app is
     // compiled, we'll try to generate it.
-    bool PrepareBootImage(bool force) const {
-        if (parameters_.instruction_set == nullptr) {
+    bool PrepareBootImage(const char* isa, bool force) const {
+        if (isa == nullptr) {
             LOG(ERROR) << "Instruction set missing.";
             return false;
         }
-        const char* isa = parameters_.instruction_set;
 
         // Check whether the file exists where expected.
         std::string dalvik_cache = GetOTADataDirectory() + "/" + DALVIK_CACHE;
@@ -516,7 +536,7 @@ private:
         return (strcmp(arg, "!") == 0) ? nullptr : arg;
     }
 
-    bool ShouldSkipPreopt() const {
+    bool ShouldSkipPreopt(const OTAPreoptParameters& parameters) const {
         // There's one thing we have to be careful about: we may/will be asked to compile an app
         // living in the system image. This may be a valid request - if the app wasn't compiled,
         // e.g., if the system image wasn't large enough to include preopted files. However, the
@@ -538,9 +558,9 @@ private:
         //       jar content must be exactly the same).
 
         //       (This is ugly as it's the only thing where we need to understand the contents
-        //        of parameters_, but it beats postponing the decision or using the call-
+        //        of the parameters, but it beats postponing the decision or using the call-
         //        backs to do weird things.)
-        const char* apk_path = parameters_.apk_path;
+        const char* apk_path = parameters.apk_path;
         CHECK(apk_path != nullptr);
         if (StartsWith(apk_path, android_root_)) {
             const char* last_slash = strrchr(apk_path, '/');
@@ -568,35 +588,48 @@ private:
         return false;
     }
 
-    // Run dexopt with the parameters of parameters_.
+    // Run dexopt with the given parameters.
     // TODO(calin): embed the profile name in the parameters.
-    int Dexopt() {
+    int Dexopt(const OTAPreoptParameters& parameters) {
+        // The boot image is only regenerated while no package is compiled against it.
+        std::shared_lock<std::shared_mutex> lock(boot_image_lock_);
         std::string dummy;
-        return dexopt(parameters_.apk_path,
-                      parameters_.uid,
-                      parameters_.pkgName,
-                      parameters_.instruction_set,
-                      parameters_.dexopt_needed,
-                      parameters_.oat_dir,
-                      parameters_.dexopt_flags,
-                      parameters_.compiler_filter,
-                      parameters_.volume_uuid,
-                      parameters_.shared_libraries,
-                      parameters_.se_info,
-                      parameters_.downgrade,
-                      parameters_.target_sdk_version,
-                      parameters_.profile_name,
-                      parameters_.dex_metadata_path,
-                      parameters_.compilation_reason,
+        return dexopt(parameters.apk_path,
+                      parameters.uid,
+                      parameters.pkgName,
+                      parameters.instruction_set,
+                      parameters.dexopt_needed,
+                      parameters.oat_dir,
+                      parameters.dexopt_flags,
+                      parameters.compiler_filter,
+                      parameters.volume_uuid,
+                      parameters.shared_libraries,
+                      parameters.se_info,
+                      parameters.downgrade,
+                      parameters.target_sdk_version,
+                      parameters.profile_name,
+                      parameters.dex_metadata_path,
+                      parameters.compilation_reason,
                       &dummy);
     }
 
-    int RunPreopt() {
-        if (ShouldSkipPreopt()) {
+    // Regenerates a boot image that dex2oat could not use. This is done at most once per
+    // instruction set, so the other packages of a batch that saw the same stale image just
+    // retry with the new one.
+    bool RegenerateBootImage(const char* isa) {
+        std::unique_lock<std::shared_mutex> lock(boot_image_lock_);
+        if (!regenerated_boot_images_.insert(isa).second) {
+            return true;
+        }
+        return PrepareBootImage(isa, /* force */ true);
+    }
+
+    int RunPreopt(OTAPreoptParameters& parameters) {
+        if (ShouldSkipPreopt(parameters)) {
             return 0;
         }
 
-        int dexopt_result = Dexopt();
+        int dexopt_result = Dexopt(parameters);
         if (dexopt_result == 0) {
             return 0;
         }
@@ -605,13 +638,13 @@ private:
         // Then regenerate and retry.
         if (WEXITSTATUS(dexopt_result) ==
                 static_cast<int>(art::dex2oat::ReturnCode::kCreateRuntime)) {
-            if (!PrepareBootImage(/* force */ true)) {
+            if (!RegenerateBootImage(parameters.instruction_set)) {
                 LOG(ERROR) << "Forced boot image creating failed. Original error return was "
                         << dexopt_result;
                 return dexopt_result;
             }
 
-            int dexopt_result_boot_image_retry = Dexopt();
+            int dexopt_result_boot_image_retry = Dexopt(parameters);
             if (dexopt_result_boot_image_retry == 0) {
                 return 0;
             }
@@ -619,13 +652,91 @@ private:
 
         // If this was a profile-guided run, we may have profile version issues. Try to downgrade,
         // if possible.
-        if ((parameters_.dexopt_flags & DEXOPT_PROFILE_GUIDED) == 0) {
+        if ((parameters.dexopt_flags & DEXOPT_PROFILE_GUIDED) == 0) {
             return dexopt_result;
         }
 
         LOG(WARNING) << "Downgrading compiler filter in an attempt to progress compilation";
-        parameters_.dexopt_flags &= ~DEXOPT_PROFILE_GUIDED;
-        return Dexopt();
+        parameters.dexopt_flags &= ~DEXOPT_PROFILE_GUIDED;
+        return Dexopt(parameters);
+    }
+
+    // Returns how many packages of a batch are compiled at once. This follows
+    // dalvik.vm.dexopt-max-jobs of the new system, like installd, but defaults to two since the
+    // compilations of an OTA mostly wait on each other's I/O. It is never more than the number
+    // of online cores, or one on low-ram devices.
+    size_t GetBatchJobs() const {
+        char value[kPropertyValueMax];
+        GetProperty("ro.config.low_ram", value, "false");
+        if (strcmp(value, "true") == 0) {
+            return 1;
+        }
+        GetProperty("dalvik.vm.dexopt-max-jobs", value, "2");
+        size_t jobs;
+        if (!android::base::ParseUint(value, &jobs) || jobs == 0) {
+            jobs = 1;
+        }
+        long cpus = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+        return std::min<size_t>(jobs, cpus);
+    }
+
+    // Asks the kernel to start reading the APK into the page cache, so that it is there by the
+    // time its package is compiled. Returns the size of the APK.
+    static int64_t Prefetch(const char* apk_path) {
+        android::base::unique_fd fd(open(apk_path, O_RDONLY | O_CLOEXEC));
+        struct stat st;
+        if (fd.get() < 0 || fstat(fd.get(), &st) != 0) {
+            return 0;
+        }
+        posix_fadvise(fd.get(), 0, 0, POSIX_FADV_WILLNEED);
+        return st.st_size;
+    }
+
+    // Compiles the packages of the batch, a few at a time, while the APKs of the packages
+    // queued after them are read ahead. Returns the result of the first package that failed.
+    int RunBatch() {
+        if (batch_.size() == 1) {
+            return RunPreopt(batch_.front());
+        }
+
+        const size_t jobs = GetBatchJobs();
+        const auto start = std::chrono::steady_clock::now();
+        std::atomic<size_t> prefetched(0);
+        std::atomic<int64_t> prefetched_bytes(0);
+        // Keeps the APKs of the next kPrefetchDepth packages after those being compiled on their
+        // way into the page cache.
+        auto prefetch_until = [&](size_t end) {
+            end = std::min(end, batch_.size());
+            size_t i = prefetched.load();
+            while (i < end) {
+                if (prefetched.compare_exchange_weak(i, i + 1)) {
+                    prefetched_bytes += Prefetch(batch_[i].apk_path);
+                    i++;
+                }
+            }
+        };
+
+        std::vector<int> results(batch_.size(), 0);
+        for_each_in_parallel(batch_.size(), jobs, [&](size_t i) {
+            prefetch_until(i + jobs + kPrefetchDepth);
+            results[i] = RunPreopt(batch_[i]);
+        });
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+        const size_t failed = std::count_if(results.begin(), results.end(),
+                                            [](int result) { return result != 0; });
+        LOG(INFO) << "Preopted " << batch_.size() << " packages (" << failed << " failed) with "
+                << jobs << " jobs in " << elapsed.count() << "ms, "
+                << prefetched_bytes * 1000 / 1024 / 1024 / std::max<int64_t>(elapsed.count(), 1)
+                << " MiB/s of APKs";
+
+        for (int result : results) {
+            if (result != 0) {
+                return result;
+            }
+        }
+        return 0;
     }
 
     ////////////////////////////////////
@@ -743,6 +854,8 @@ private:
     // The index of the instruction-set string inside the package parameters. Needed for
     // some special-casing that requires knowledge of the instruction-set.
     static constexpr size_t kISAIndex = 3;
+    // Packages of a batch whose APKs are read ahead beyond those being compiled.
+    static constexpr size_t kPrefetchDepth = 2;
 
     // Stores the system properties read out of the B partition. We need to use these properties
     // to compile, instead of the A properties we could get from init/get_property.
@@ -755,6 +868,12 @@ private:
     std::string asec_mountpoint_;
 
     OTAPreoptParameters parameters_;
+    // The packages to compile. A single package unless run in batch mode, in which case
+    // parameters_ is the first package, for the values common to all of them.
+    std::vector<OTAPreoptParameters> batch_;
+
+    std::shared_mutex boot_image_lock_;
+    std::set<std::string> regenerated_boot_images_;
 
     // Store environment values we need to set.
     std::vector<std::string> environ_;
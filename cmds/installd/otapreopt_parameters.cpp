@@ -108,6 +108,36 @@ bool OTAPreoptParameters::ReadArguments(int argc, const char** argv) {
     return ReadArgumentsPostV1(version, argv, true);
 }
 
+bool OTAPreoptParameters::ReadBatchArguments(int argc, const char** argv,
+                                             std::vector<OTAPreoptParameters>* out) {
+    out->clear();
+    if (argc < 4 || std::string("batch").compare(argv[2]) != 0) {
+        LOG(ERROR) << "Missing batch parameters";
+        return false;
+    }
+
+    // Parse each package as if it had its own command line.
+    int start = 3;
+    while (start <= argc) {
+        int end = start;
+        while (end < argc && std::string("--").compare(argv[end]) != 0) {
+            end++;
+        }
+        std::vector<const char*> package_argv = { argv[0], argv[1] };
+        package_argv.insert(package_argv.end(), argv + start, argv + end);
+        package_argv.push_back(nullptr);
+
+        OTAPreoptParameters parameters;
+        if (!parameters.ReadArguments(package_argv.size() - 1, package_argv.data())) {
+            LOG(ERROR) << "Failed reading batch entry " << out->size();
+            return false;
+        }
+        out->push_back(parameters);
+        start = end + 1;
+    }
+    return true;
+}
+
 static int ReplaceMask(int input, int old_mask, int new_mask) {
     return (input & old_mask) != 0 ? new_mask : 0;
 }
@@ -19,6 +19,7 @@
 
 #include <string>
 #include <sys/types.h>
+#include <vector>
 
 namespace android {
 namespace installd {
@@ -27,6 +28,13 @@ class OTAPreoptParameters {
   public:
     bool ReadArguments(int argc, const char** argv);
 
+    // Reads the arguments of a batch of packages:
+    //   target-slot batch {PACKAGE_ARGUMENTS} [-- {PACKAGE_ARGUMENTS}]...
+    // where each PACKAGE_ARGUMENTS is what ReadArguments() expects after the target slot.
+    // The parameters point into argv, like those of ReadArguments().
+    static bool ReadBatchArguments(int argc, const char** argv,
+                                   std::vector<OTAPreoptParameters>* out);
+
   private:
     bool ReadArgumentsV1(const char** argv);
     bool ReadArgumentsPostV1(uint32_t version, const char** argv, bool versioned);
@@ -24,6 +24,10 @@ STATUS_FD="$2"
 # Maximum number of packages/steps.
 MAXIMUM_PACKAGES=1000
 
+# Maximum number of packages handed to one otapreopt run. otapreopt compiles
+# the packages of a batch concurrently and reads ahead the next ones' APKs.
+BATCH_SIZE=8
+
 # First ensure the system is booted. This is to work around issues when cmd would
 # infinitely loop trying to get a service manager (which will never come up in that
 # mode). b/30797145
@@ -60,9 +64,23 @@ print -u${STATUS_FD} "global_progress $PROGRESS"
 
 i=0
 while ((i<MAXIMUM_PACKAGES)) ; do
-  DEXOPT_PARAMS=$(cmd otadexopt next)
-
-  /system/bin/otapreopt_chroot $STATUS_FD $TARGET_SLOT_SUFFIX $DEXOPT_PARAMS >&- 2>&-
+  BATCH=""
+  j=0
+  while ((j<BATCH_SIZE)) ; do
+    DEXOPT_PARAMS=$(cmd otadexopt next)
+    if [ -n "$BATCH" ] ; then
+      BATCH="$BATCH --"
+    fi
+    BATCH="$BATCH $DEXOPT_PARAMS"
+    j=$((j+1))
+
+    DONE=$(cmd otadexopt done)
+    if [ "$DONE" != "OTA incomplete." ] ; then
+      break
+    fi
+  done
+
+  /system/bin/otapreopt_chroot $STATUS_FD $TARGET_SLOT_SUFFIX batch $BATCH >&- 2>&-
 
   PROGRESS=$(cmd otadexopt progress)
   print -u${STATUS_FD} "global_progress $PROGRESS"
@@ -70,7 +88,7 @@ while ((i<MAXIMUM_PACKAGES)) ; do
   DONE=$(cmd otadexopt done)
   if [ "$DONE" = "OTA incomplete." ] ; then
     sleep 1
-    i=$((i+1))
+    i=$((i+j))
     continue
   fi
   break
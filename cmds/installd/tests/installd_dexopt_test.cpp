@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -667,6 +668,37 @@ TEST_F(ReconcileTest, ReconcileSecondaryAcessViaDifferentUidError) {
         /*binder_ok*/ true, /*dex_ok */ false, /*odex_deleted*/ false, kSystemUid);
 }
 
+TEST_F(ReconcileTest, ReconcileAndHashSecondaryBatch) {
+    LOG(INFO) << "ReconcileAndHashSecondaryBatch";
+    std::string missing_dex = secondary_dex_ce_ + ".missing";
+    std::vector<std::string> dex_paths = { secondary_dex_ce_, missing_dex, secondary_dex_ce_link_ };
+    std::vector<std::string> isas = { kRuntimeIsa };
+
+    std::vector<uint8_t> expected_hash;
+    binder::Status status = service_->hashSecondaryDexFile(secondary_dex_ce_, package_name_,
+            kTestAppUid, volume_uuid_, FLAG_STORAGE_CE, &expected_hash);
+    ASSERT_TRUE(status.isOk()) << status.toString8().c_str();
+    ASSERT_EQ(32u, expected_hash.size());  // SHA-256
+
+    std::vector<uint8_t> hashes;
+    std::vector<int32_t> results;
+    status = service_->reconcileAndHashSecondaryDexFiles(dex_paths, package_name_,
+            kTestAppUid, isas, volume_uuid_, FLAG_STORAGE_CE, &hashes, &results);
+    ASSERT_TRUE(status.isOk()) << status.toString8().c_str();
+    ASSERT_EQ(dex_paths.size(), results.size());
+    ASSERT_EQ(dex_paths.size() * expected_hash.size(), hashes.size());
+
+    ASSERT_EQ(SECONDARY_DEX_EXISTS | SECONDARY_DEX_HASHED, results[0]);
+    ASSERT_EQ(0, results[1]);
+    ASSERT_EQ(SECONDARY_DEX_EXISTS | SECONDARY_DEX_HASHED, results[2]);
+    ASSERT_TRUE(std::equal(expected_hash.begin(), expected_hash.end(), hashes.begin()));
+    ASSERT_TRUE(std::equal(expected_hash.begin(), expected_hash.end(),
+            hashes.begin() + 2 * expected_hash.size()));
+
+    // The artifacts of the files that still exist are kept.
+    ASSERT_EQ(0, access(GetSecondaryDexArtifact(secondary_dex_ce_, "odex").c_str(), F_OK));
+}
+
 class ProfileTest : public DexoptTest {
   protected:
     std::string cur_profile_;
@@ -885,6 +917,16 @@ TEST_F(ProfileTest, ProfileMergeOkNoReference) {
     mergePackageProfiles(package_name_, "primary.prof", /*expected_result*/ true);
 }
 
+// Current profiles are truncated once merged, so an empty one has nothing
+// new and should not trigger recompilation.
+TEST_F(ProfileTest, ProfileMergeSkipEmptyCurrent) {
+    LOG(INFO) << "ProfileMergeSkipEmptyCurrent";
+
+    SetupProfiles(/*setup_ref*/ true);
+    ASSERT_EQ(0, ::truncate(cur_profile_.c_str(), 0));
+    mergePackageProfiles(package_name_, "primary.prof", /*expected_result*/ false);
+}
+
 TEST_F(ProfileTest, ProfileMergeFailWrongPackage) {
     LOG(INFO) << "ProfileMergeFailWrongPackage";
 
@@ -227,5 +227,37 @@ TEST_F(OTAPreoptTest, ReadArgumentsFailInvalidSlot) {
     ASSERT_FALSE(params.ReadArguments(args.size() - 1, args.data()));
 }
 
+TEST_F(OTAPreoptTest, ReadBatchArguments) {
+    // otapreopt target-slot batch {PACKAGE_ARGUMENTS} -- {PACKAGE_ARGUMENTS}
+    std::vector<const char*> first = getArgs(7, true);
+    std::vector<const char*> second = getArgs(2, false);
+    second[4] = "bar.apk";
+    std::vector<const char*> args = { "otapreopt", "a", "batch" };
+    args.insert(args.end(), first.begin() + 2, first.end() - 1);
+    args.push_back("--");
+    args.insert(args.end(), second.begin() + 2, second.end() - 1);
+    args.push_back(nullptr);
+
+    std::vector<OTAPreoptParameters> batch;
+    ASSERT_TRUE(OTAPreoptParameters::ReadBatchArguments(args.size() - 1, args.data(), &batch));
+    ASSERT_EQ(2u, batch.size());
+    verifyPackageParameters(batch[0], 7, true, first.data());
+    verifyPackageParameters(batch[1], 2, false, second.data());
+}
+
+TEST_F(OTAPreoptTest, ReadBatchArgumentsFailEmptyEntry) {
+    std::vector<const char*> package = getArgs(7, true);
+    std::vector<const char*> args = { "otapreopt", "a", "batch" };
+    args.insert(args.end(), package.begin() + 2, package.end() - 1);
+    args.push_back("--");
+    args.push_back(nullptr);
+
+    std::vector<OTAPreoptParameters> batch;
+    ASSERT_FALSE(OTAPreoptParameters::ReadBatchArguments(args.size() - 1, args.data(), &batch));
+
+    std::vector<const char*> empty = { "otapreopt", "a", "batch", nullptr };
+    ASSERT_FALSE(OTAPreoptParameters::ReadBatchArguments(empty.size() - 1, empty.data(), &batch));
+}
+
 }  // namespace installd
 }  // namespace android
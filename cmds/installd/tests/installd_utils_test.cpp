@@ -16,11 +16,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <sys/stat.h>
+
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 
 #include "InstalldNativeService.h"
+#include "apk_verity.h"
 #include "globals.h"
 #include "utils.h"
 
@@ -40,6 +47,8 @@
 
 #define TEST_PROFILE_DIR "/data/misc/profiles"
 
+using android::base::StringPrintf;
+
 namespace android {
 namespace installd {
 
@@ -529,5 +538,167 @@ TEST_F(UtilsTest, ValidateApkPathSubdirs) {
     EXPECT_NE(0, validate_apk_path_subdirs("/data/app/com.example/dir/dir/dir//file"));
 }
 
+TEST_F(UtilsTest, CalculateTreeSizes) {
+    char root[] = "/data/local/tmp/installd_utils_test_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(root));
+    std::vector<std::string> paths;
+    for (int i = 0; i < 6; i++) {
+        std::string path = StringPrintf("%s/tree%d", root, i);
+        ASSERT_EQ(0, mkdir(path.c_str(), 0700));
+        ASSERT_EQ(0, mkdir((path + "/sub").c_str(), 0700));
+        std::string contents(4096 * (i + 1), 'a');
+        ASSERT_TRUE(android::base::WriteStringToFile(contents, path + "/sub/file"));
+        paths.push_back(path);
+    }
+    paths.push_back(StringPrintf("%s/missing", root));
+
+    std::vector<int64_t> sizes;
+    calculate_tree_sizes(paths, &sizes);
+    ASSERT_EQ(paths.size(), sizes.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        int64_t size = 0;
+        calculate_tree_size(paths[i], &size);
+        EXPECT_EQ(size, sizes[i]) << paths[i];
+    }
+    EXPECT_EQ(0, sizes.back());
+
+    system(StringPrintf("rm -rf %s", root).c_str());
+}
+
+TEST_F(UtilsTest, CalculateTreeSizeMatchesEntries) {
+    char root[] = "/data/local/tmp/installd_utils_test_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(root));
+    // wide and deep enough for the walking threads to take directories from each other
+    std::vector<std::string> entries = { root };
+    for (int i = 0; i < 8; i++) {
+        std::string dir = StringPrintf("%s/dir%d", root, i);
+        ASSERT_EQ(0, mkdir(dir.c_str(), 0700));
+        entries.push_back(dir);
+        for (int j = 0; j < 8; j++) {
+            std::string sub = StringPrintf("%s/sub%d", dir.c_str(), j);
+            ASSERT_EQ(0, mkdir(sub.c_str(), 0700));
+            entries.push_back(sub);
+            std::string file = sub + "/file";
+            ASSERT_TRUE(android::base::WriteStringToFile(std::string(4096 * j, 'a'), file));
+            entries.push_back(file);
+        }
+    }
+    // symlinks are measured, not followed
+    std::string link = StringPrintf("%s/link", root);
+    ASSERT_EQ(0, symlink(root, link.c_str()));
+    entries.push_back(link);
+
+    int64_t expected = 0;
+    for (const auto& entry : entries) {
+        struct stat s;
+        ASSERT_EQ(0, lstat(entry.c_str(), &s)) << entry;
+        expected += s.st_blocks * 512;
+    }
+
+    int64_t size = 0;
+    EXPECT_EQ(0, calculate_tree_size(root, &size));
+    EXPECT_EQ(expected, size);
+
+    size = 0;
+    EXPECT_EQ(0, calculate_tree_size(root, &size, getegid()));
+    EXPECT_EQ(expected, size);
+    size = 0;
+    EXPECT_EQ(0, calculate_tree_size(root, &size, -1, getegid()));
+    EXPECT_EQ(0, size);
+
+    system(StringPrintf("rm -rf %s", root).c_str());
+}
+
+TEST_F(UtilsTest, BuildApkVerity) {
+    // Four chunks of entries, a one chunk APK Signing Block, the central directory and the end
+    // of central directory record pointing at it.
+    std::string apk(4 * 4096, 'e');
+    const uint32_t signing_block_offset = apk.size();
+    const uint64_t signing_block_size = 4096 - 8;
+    apk.append(reinterpret_cast<const char*>(&signing_block_size), 8);
+    apk.append(4096 - 8 - 24, 's');
+    apk.append(reinterpret_cast<const char*>(&signing_block_size), 8);
+    apk.append("APK Sig Block 42");
+    const uint32_t central_dir_offset = apk.size();
+    apk.append(100, 'c');
+    apk.append("PK\x05\x06", 4);
+    apk.append(12, '\0');
+    apk.append(reinterpret_cast<const char*>(&central_dir_offset), 4);
+    apk.append(2, '\0');
+
+    char path[] = "/data/local/tmp/installd_utils_test_XXXXXX";
+    android::base::unique_fd fd(mkstemp(path));
+    ASSERT_NE(-1, fd.get());
+    ASSERT_TRUE(android::base::WriteStringToFd(apk, fd.get()));
+
+    std::vector<uint8_t> verity;
+    std::string error_msg;
+    ASSERT_TRUE(build_apk_verity(fd.get(), 1, &verity, &error_msg)) << error_msg;
+    // A single tree level, the 64 byte header, two extensions and the reverse offset.
+    ASSERT_EQ(4096u + 64 + 48 + 4, verity.size());
+    EXPECT_EQ(0, memcmp(&verity[4096], "TrueBrew", 8));
+    uint32_t reverse_offset;
+    memcpy(&reverse_offset, &verity[verity.size() - 4], 4);
+    EXPECT_EQ(64u + 48 + 4, reverse_offset);
+    uint64_t elided[2];
+    memcpy(elided, &verity[4096 + 64 + 8], sizeof(elided));
+    EXPECT_EQ(signing_block_offset, elided[0]);
+    EXPECT_EQ(central_dir_offset - signing_block_offset, elided[1]);
+
+    // Hashing in parallel gives the same data.
+    std::vector<uint8_t> parallel_verity;
+    ASSERT_TRUE(build_apk_verity(fd.get(), 4, &parallel_verity, &error_msg)) << error_msg;
+    EXPECT_EQ(verity, parallel_verity);
+
+    // APKs without an APK Signing Block have no apk-verity data.
+    ASSERT_EQ(0, ftruncate(fd.get(), 0));
+    ASSERT_EQ(0, lseek(fd.get(), 0, SEEK_SET));
+    ASSERT_TRUE(android::base::WriteStringToFd(apk.substr(central_dir_offset), fd.get()));
+    EXPECT_FALSE(build_apk_verity(fd.get(), 1, &verity, &error_msg));
+
+    unlink(path);
+}
+
+TEST_F(UtilsTest, CopyDirectoryRecursive) {
+    char root[] = "/data/local/tmp/installd_utils_test_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(root));
+    std::string from = StringPrintf("%s/from", root);
+    std::string to = StringPrintf("%s/to", root);
+    ASSERT_EQ(0, mkdir(from.c_str(), 0751));
+    ASSERT_EQ(0, mkdir((from + "/sub").c_str(), 0700));
+    std::string contents(3 * 4096 + 17, 'a');
+    ASSERT_TRUE(android::base::WriteStringToFile(contents, from + "/sub/file"));
+    ASSERT_EQ(0, chmod((from + "/sub/file").c_str(), 0640));
+    ASSERT_EQ(0, symlink("sub/file", (from + "/link").c_str()));
+
+    // Existing destination files are replaced
+    ASSERT_EQ(0, mkdir(to.c_str(), 0700));
+    ASSERT_EQ(0, mkdir((to + "/sub").c_str(), 0700));
+    ASSERT_TRUE(android::base::WriteStringToFile("stale", to + "/sub/file"));
+
+    EXPECT_EQ(0, copy_directory_recursive(from, to));
+
+    std::string copied;
+    ASSERT_TRUE(android::base::ReadFileToString(to + "/sub/file", &copied));
+    EXPECT_EQ(contents, copied);
+
+    struct stat from_st, to_st;
+    ASSERT_EQ(0, lstat((from + "/sub/file").c_str(), &from_st));
+    ASSERT_EQ(0, lstat((to + "/sub/file").c_str(), &to_st));
+    EXPECT_EQ(0640u, to_st.st_mode & 07777);
+    EXPECT_EQ(from_st.st_mtime, to_st.st_mtime);
+
+    ASSERT_EQ(0, lstat(from.c_str(), &from_st));
+    ASSERT_EQ(0, lstat(to.c_str(), &to_st));
+    EXPECT_EQ(0751u, to_st.st_mode & 07777);
+    EXPECT_EQ(from_st.st_mtime, to_st.st_mtime);
+
+    std::string target;
+    ASSERT_TRUE(android::base::Readlink(to + "/link", &target));
+    EXPECT_EQ("sub/file", target);
+
+    system(StringPrintf("rm -rf %s", root).c_str());
+}
+
 }  // namespace installd
 }  // namespace android
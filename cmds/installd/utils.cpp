@@ -19,18 +19,28 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <fts.h>
+#include <linux/fs.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
 #include <sys/statvfs.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 #include <cutils/fs.h>
 #include <cutils/properties.h>
+#include <diskusage/dirsize.h>
 #include <log/log.h>
 #include <private/android_filesystem_config.h>
 
@@ -334,47 +344,56 @@ std::vector<userid_t> get_known_users(const char* volume_uuid) {
     return users;
 }
 
-int calculate_tree_size(const std::string& path, int64_t* size,
-        int32_t include_gid, int32_t exclude_gid, bool exclude_apps) {
-    FTS *fts;
-    FTSENT *p;
-    int64_t matchedSize = 0;
-    char *argv[] = { (char*) path.c_str(), nullptr };
-    if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL))) {
+struct tree_size_filter {
+    int32_t include_gid;
+    int32_t exclude_gid;
+    bool exclude_apps;
+};
+
+static int filter_tree_size(const struct stat* s, void* cookie) {
+    const tree_size_filter* filter = static_cast<const tree_size_filter*>(cookie);
+    int32_t uid = s->st_uid;
+    int32_t gid = s->st_gid;
+    int32_t user_uid = multiuser_get_app_id(uid);
+    int32_t user_gid = multiuser_get_app_id(gid);
+    if (filter->exclude_apps && ((user_uid >= AID_APP_START && user_uid <= AID_APP_END)
+            || (user_gid >= AID_CACHE_GID_START && user_gid <= AID_CACHE_GID_END)
+            || (user_gid >= AID_SHARED_GID_START && user_gid <= AID_SHARED_GID_END))) {
+        // Don't traverse inside or measure
+        return 0;
+    }
+    if (filter->include_gid != -1 && gid != filter->include_gid) {
+        return DIRSIZE_DESCEND;
+    }
+    if (filter->exclude_gid != -1 && gid == filter->exclude_gid) {
+        return DIRSIZE_DESCEND;
+    }
+    return DIRSIZE_MEASURE | DIRSIZE_DESCEND;
+}
+
+// Measures the tree like fts with FTS_PHYSICAL | FTS_XDEV would walk it, with up to max_threads
+// threads, or a default number if it is 0.
+static int calculate_tree_size(const std::string& path, int64_t* size,
+        int32_t include_gid, int32_t exclude_gid, bool exclude_apps, int max_threads) {
+    struct stat s;
+    if (lstat(path.c_str(), &s) != 0) {
         if (errno != ENOENT) {
-            PLOG(ERROR) << "Failed to fts_open " << path;
+            PLOG(ERROR) << "Failed to lstat " << path;
         }
         return -1;
     }
-    while ((p = fts_read(fts)) != NULL) {
-        switch (p->fts_info) {
-        case FTS_D:
-        case FTS_DEFAULT:
-        case FTS_F:
-        case FTS_SL:
-        case FTS_SLNONE:
-            int32_t uid = p->fts_statp->st_uid;
-            int32_t gid = p->fts_statp->st_gid;
-            int32_t user_uid = multiuser_get_app_id(uid);
-            int32_t user_gid = multiuser_get_app_id(gid);
-            if (exclude_apps && ((user_uid >= AID_APP_START && user_uid <= AID_APP_END)
-                    || (user_gid >= AID_CACHE_GID_START && user_gid <= AID_CACHE_GID_END)
-                    || (user_gid >= AID_SHARED_GID_START && user_gid <= AID_SHARED_GID_END))) {
-                // Don't traverse inside or measure
-                fts_set(fts, p, FTS_SKIP);
-                break;
-            }
-            if (include_gid != -1 && gid != include_gid) {
-                break;
-            }
-            if (exclude_gid != -1 && gid == exclude_gid) {
-                break;
-            }
-            matchedSize += (p->fts_statp->st_blocks * 512);
-            break;
+    tree_size_filter filter = { include_gid, exclude_gid, exclude_apps };
+    const int what = filter_tree_size(&s, &filter);
+    int64_t matchedSize = (what & DIRSIZE_MEASURE) ? stat_size(&s) : 0;
+    if (S_ISDIR(s.st_mode) && (what & DIRSIZE_DESCEND)) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            PLOG(ERROR) << "Failed to open " << path;
+        } else {
+            matchedSize += calculate_dir_size_filtered(fd, DIRSIZE_XDEV, filter_tree_size,
+                    &filter, max_threads);
         }
     }
-    fts_close(fts);
 #if MEASURE_DEBUG
     if ((include_gid == -1) && (exclude_gid == -1)) {
         LOG(DEBUG) << "Measured " << path << " size " << matchedSize;
@@ -387,6 +406,43 @@ int calculate_tree_size(const std::string& path, int64_t* size,
     return 0;
 }
 
+int calculate_tree_size(const std::string& path, int64_t* size,
+        int32_t include_gid, int32_t exclude_gid, bool exclude_apps) {
+    return calculate_tree_size(path, size, include_gid, exclude_gid, exclude_apps, 0);
+}
+
+// Walking more trees at once than this mostly makes the walks compete for the disk.
+static constexpr size_t MAX_TREE_SIZE_THREADS = 4;
+
+void calculate_tree_sizes(const std::vector<std::string>& paths, std::vector<int64_t>* sizes) {
+    sizes->assign(paths.size(), 0);
+    // The trees already keep the threads busy, so each is walked by one.
+    for_each_in_parallel(paths.size(), MAX_TREE_SIZE_THREADS, [&](size_t i) {
+        calculate_tree_size(paths[i], &(*sizes)[i], -1, -1, false, 1);
+    });
+}
+
+void for_each_in_parallel(size_t count, size_t max_threads,
+        const std::function<void(size_t)>& fn) {
+    std::atomic<size_t> next(0);
+    auto run = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+    const size_t numThreads = std::min<size_t>(
+            std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), max_threads),
+            count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; i++) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
 /**
  * Checks whether the package name is valid. Returns -1 on error and
  * 0 on success.
@@ -648,6 +704,172 @@ int copy_dir_files(const char *srcname,
     return res;
 }
 
+static constexpr size_t kCopyChunkSize = 8 * 1024 * 1024;
+
+/**
+ * Copy the contents of one regular file into another without bouncing the
+ * data through userspace: clone the extents when the filesystem supports
+ * it, otherwise use copy_file_range(), falling back to sendfile() where the
+ * kernel can't copy across these two files.
+ */
+static int copy_file_data(int src_fd, int dst_fd, off64_t len) {
+#ifdef FICLONE
+    if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+        return 0;
+    }
+#endif
+    bool use_copy_file_range = true;
+    off64_t copied = 0;
+    while (copied < len) {
+        size_t chunk = static_cast<size_t>(std::min<off64_t>(len - copied, kCopyChunkSize));
+        ssize_t res = -1;
+#ifdef __NR_copy_file_range
+        if (use_copy_file_range) {
+            res = syscall(__NR_copy_file_range, src_fd, nullptr, dst_fd, nullptr, chunk, 0);
+            if (res < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+                    || errno == EOPNOTSUPP)) {
+                use_copy_file_range = false;
+            }
+        }
+#else
+        use_copy_file_range = false;
+#endif
+        if (!use_copy_file_range) {
+            res = sendfile(dst_fd, src_fd, nullptr, chunk);
+        }
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        } else if (res == 0) {
+            // Source was truncated underneath us
+            break;
+        }
+        copied += res;
+    }
+    return 0;
+}
+
+static int copy_file(const char* from, const char* to, const struct stat& st) {
+    unique_fd src_fd(TEMP_FAILURE_RETRY(open(from, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    if (src_fd == -1) {
+        PLOG(ERROR) << "Failed to open " << from;
+        return -1;
+    }
+    if (unlink(to) != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to remove " << to;
+        return -1;
+    }
+    unique_fd dst_fd(TEMP_FAILURE_RETRY(open(to,
+            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)));
+    if (dst_fd == -1) {
+        PLOG(ERROR) << "Failed to create " << to;
+        return -1;
+    }
+    if (copy_file_data(src_fd.get(), dst_fd.get(), st.st_size) != 0) {
+        PLOG(ERROR) << "Failed to copy " << from << " to " << to;
+        return -1;
+    }
+
+    // Change ownership before mode, since chown clears any setuid bits
+    struct timespec times[] = { st.st_atim, st.st_mtim };
+    if (fchown(dst_fd.get(), st.st_uid, st.st_gid) != 0
+            || fchmod(dst_fd.get(), st.st_mode & 07777) != 0
+            || futimens(dst_fd.get(), times) != 0) {
+        PLOG(ERROR) << "Failed to preserve attributes of " << to;
+        return -1;
+    }
+    return 0;
+}
+
+static int copy_symlink(const char* from, const char* to, const struct stat& st) {
+    std::string target;
+    if (!android::base::Readlink(from, &target)) {
+        PLOG(ERROR) << "Failed to readlink " << from;
+        return -1;
+    }
+    if (unlink(to) != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to remove " << to;
+        return -1;
+    }
+    struct timespec times[] = { st.st_atim, st.st_mtim };
+    if (symlink(target.c_str(), to) != 0
+            || lchown(to, st.st_uid, st.st_gid) != 0
+            || utimensat(AT_FDCWD, to, times, AT_SYMLINK_NOFOLLOW) != 0) {
+        PLOG(ERROR) << "Failed to copy symlink " << from << " to " << to;
+        return -1;
+    }
+    return 0;
+}
+
+int copy_directory_recursive(const std::string& from, const std::string& to) {
+    FTS *fts;
+    FTSENT *p;
+    char *argv[] = { (char*) from.c_str(), nullptr };
+    if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL))) {
+        PLOG(ERROR) << "Failed to fts_open " << from;
+        return -1;
+    }
+
+    int res = 0;
+    while ((p = fts_read(fts)) != NULL) {
+        std::string dst = to + (p->fts_path + from.size());
+        const struct stat& st = *p->fts_statp;
+        switch (p->fts_info) {
+        case FTS_D:
+            if (mkdir(dst.c_str(), 0700) != 0) {
+                struct stat dst_st;
+                if (errno != EEXIST || lstat(dst.c_str(), &dst_st) != 0
+                        || !S_ISDIR(dst_st.st_mode)) {
+                    PLOG(ERROR) << "Failed to mkdir " << dst;
+                    fts_set(fts, p, FTS_SKIP);
+                    res = -1;
+                }
+            }
+            break;
+        case FTS_DP: {
+            // Attributes are applied last, so that copying children doesn't
+            // bump the modified time or trip over a read-only mode
+            struct timespec times[] = { st.st_atim, st.st_mtim };
+            if (lchown(dst.c_str(), st.st_uid, st.st_gid) != 0
+                    || chmod(dst.c_str(), st.st_mode & 07777) != 0
+                    || utimensat(AT_FDCWD, dst.c_str(), times, AT_SYMLINK_NOFOLLOW) != 0) {
+                PLOG(ERROR) << "Failed to preserve attributes of " << dst;
+                res = -1;
+            }
+            break;
+        }
+        case FTS_F:
+            if (copy_file(p->fts_path, dst.c_str(), st) != 0) {
+                res = -1;
+            }
+            break;
+        case FTS_SL:
+        case FTS_SLNONE:
+            if (copy_symlink(p->fts_path, dst.c_str(), st) != 0) {
+                res = -1;
+            }
+            break;
+        case FTS_DEFAULT:
+            if ((unlink(dst.c_str()) != 0 && errno != ENOENT)
+                    || mknod(dst.c_str(), st.st_mode, st.st_rdev) != 0
+                    || lchown(dst.c_str(), st.st_uid, st.st_gid) != 0) {
+                PLOG(ERROR) << "Failed to copy special file " << p->fts_path;
+                res = -1;
+            }
+            break;
+        case FTS_DC:
+        case FTS_DNR:
+        case FTS_ERR:
+        case FTS_NS:
+            LOG(ERROR) << "Failed to read " << p->fts_path << ": " << strerror(p->fts_errno);
+            res = -1;
+            break;
+        }
+    }
+    fts_close(fts);
+    return res;
+}
+
 int64_t data_disk_free(const std::string& data_path) {
     struct statvfs sfs;
     if (statvfs(data_path.c_str(), &sfs) == 0) {
@@ -18,6 +18,7 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -96,6 +97,15 @@ std::vector<userid_t> get_known_users(const char* volume_uuid);
 
 int calculate_tree_size(const std::string& path, int64_t* size,
         int32_t include_gid = -1, int32_t exclude_gid = -1, bool exclude_apps = false);
+// Measures each of the given trees like calculate_tree_size(), walking several of them at once.
+// (*sizes)[i] is set to the size of paths[i], 0 if it could not be measured.
+void calculate_tree_sizes(const std::vector<std::string>& paths, std::vector<int64_t>* sizes);
+
+// Calls fn(i) for each i in [0, count), with up to max_threads calls running at once. Each
+// thread takes the next index nobody has started yet, so one slow call does not hold up the
+// others queued behind it.
+void for_each_in_parallel(size_t count, size_t max_threads,
+        const std::function<void(size_t)>& fn);
 
 int create_user_config_path(char path[PKG_PATH_MAX], userid_t userid);
 
@@ -114,6 +124,10 @@ int delete_dir_contents_fd(int dfd, const char *name);
 
 int copy_dir_files(const char *srcname, const char *dstname, uid_t owner, gid_t group);
 
+// Copies the tree at "from" to "to" like "cp -F -p -R -P -d", replacing existing files and
+// preserving ownership, modes and timestamps. The copy is done in-kernel where possible.
+int copy_directory_recursive(const std::string& from, const std::string& to);
+
 int64_t data_disk_free(const std::string& data_path);
 
 int get_path_inode(const std::string& path, ino_t *inode);
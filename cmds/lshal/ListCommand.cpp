@@ -18,12 +18,14 @@
 
 #include <getopt.h>
 
+#include <atomic>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <regex>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/parseint.h>
@@ -50,6 +52,9 @@ using ::android::hidl::manager::V1_0::IServiceManager;
 namespace android {
 namespace lshal {
 
+// Maximum number of binderized services that are queried at the same time.
+static constexpr size_t MAX_FETCH_BINDERIZED_THREADS = 8;
+
 vintf::SchemaType toSchemaType(Partition p) {
     return (p == Partition::SYSTEM) ? vintf::SchemaType::FRAMEWORK : vintf::SchemaType::DEVICE;
 }
@@ -165,6 +170,7 @@ bool ListCommand::getPidInfo(
             uint64_t ptr;
             if (!::android::base::ParseUint(ptrString.c_str(), &ptr)) {
                 // Should not reach here, but just be tolerant.
+                std::lock_guard<std::mutex> lock(mErrLock);
                 err() << "Could not parse number " << ptrString << std::endl;
                 return;
             }
@@ -174,6 +180,7 @@ bool ListCommand::getPidInfo(
                 for (const std::string &pidStr : split(line.substr(pos + proc.size()), ' ')) {
                     int32_t pid;
                     if (!::android::base::ParseInt(pidStr, &pid)) {
+                        std::lock_guard<std::mutex> lock(mErrLock);
                         err() << "Could not parse number " << pidStr << std::endl;
                         return;
                     }
@@ -212,13 +219,20 @@ bool ListCommand::getPidInfo(
 }
 
 const PidInfo* ListCommand::getPidInfoCached(pid_t serverPid) {
-    auto pair = mCachedPidInfos.insert({serverPid, PidInfo{}});
-    if (pair.second /* did insertion take place? */) {
-        if (!getPidInfo(serverPid, &pair.first->second)) {
-            return nullptr;
+    CachedPidInfo* cached;
+    {
+        std::lock_guard<std::mutex> lock(mCachedPidInfosLock);
+        auto& slot = mCachedPidInfos[serverPid];
+        if (slot == nullptr) {
+            slot = std::make_unique<CachedPidInfo>();
         }
+        cached = slot.get();
     }
-    return &pair.first->second;
+    // Parse outside of the lock so that different PIDs are parsed concurrently.
+    std::call_once(cached->once, [&] {
+        cached->valid = getPidInfo(serverPid, &cached->info);
+    });
+    return cached->valid ? &cached->info : nullptr;
 }
 
 // Must process hwbinder services first, then passthrough services.
@@ -571,13 +585,43 @@ Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
 
     Status status = OK;
     std::map<std::string, TableEntry> allTableEntries;
+    std::vector<TableEntry*> entries;
     for (const auto &fqInstanceName : fqInstanceNames) {
         // create entry and default assign all fields.
         TableEntry& entry = allTableEntries[fqInstanceName];
         entry.interfaceName = fqInstanceName;
         entry.transport = mode;
+        entries.push_back(&entry);
+    }
 
-        status |= fetchBinderizedEntry(manager, &entry);
+    // Query the services on a few threads, as each query blocks on the service process.
+    // Warnings are buffered per entry and printed in order afterwards.
+    std::vector<Status> statuses(entries.size(), OK);
+    std::vector<std::stringstream> errors(entries.size());
+    std::atomic<size_t> next{0};
+    const auto deadline = std::chrono::steady_clock::now() + FETCH_BINDERIZED_WAIT;
+    const auto fetchEntries = [&] {
+        for (size_t i = next++; i < entries.size(); i = next++) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                errors[i] << "Warning: Skipping \"" << entries[i]->interfaceName
+                          << "\": timed out fetching binderized services" << std::endl;
+                statuses[i] = DUMP_BINDERIZED_ERROR | TRANSACTION_ERROR;
+                continue;
+            }
+            statuses[i] = fetchBinderizedEntry(manager, entries[i], errors[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(entries.size(), MAX_FETCH_BINDERIZED_THREADS); ++i) {
+        threads.emplace_back(fetchEntries);
+    }
+    fetchEntries();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        err() << errors[i].str();
+        status |= statuses[i];
     }
 
     for (auto& pair : allTableEntries) {
@@ -587,10 +631,10 @@ Status ListCommand::fetchBinderized(const sp<IServiceManager> &manager) {
 }
 
 Status ListCommand::fetchBinderizedEntry(const sp<IServiceManager> &manager,
-                                         TableEntry *entry) {
+                                         TableEntry *entry, std::ostream &errors) {
     Status status = OK;
     const auto handleError = [&](Status additionalError, const std::string& msg) {
-        err() << "Warning: Skipping \"" << entry->interfaceName << "\": " << msg << std::endl;
+        errors << "Warning: Skipping \"" << entry->interfaceName << "\": " << msg << std::endl;
         status |= DUMP_BINDERIZED_ERROR | additionalError;
     };
 
@@ -21,6 +21,8 @@
 #include <stdint.h>
 
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -88,13 +90,16 @@ protected:
     Status fetchBinderized(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager);
     Status fetchAllLibraries(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager);
 
+    // Fetch the information of one binderized service. Warnings are written to errors.
+    // Called concurrently for different entries by fetchBinderized.
     Status fetchBinderizedEntry(const sp<::android::hidl::manager::V1_0::IServiceManager> &manager,
-                                TableEntry *entry);
+                                TableEntry *entry, std::ostream &errors);
 
     // Get relevant information for a PID by parsing files under /d/binder.
     // It is a virtual member function so that it can be mocked.
     virtual bool getPidInfo(pid_t serverPid, PidInfo *info) const;
-    // Retrieve from mCachedPidInfos and call getPidInfo if necessary.
+    // Retrieve from mCachedPidInfos and call getPidInfo if necessary. Thread-safe; getPidInfo
+    // is only called once per PID.
     const PidInfo* getPidInfoCached(pid_t serverPid);
 
     void dumpTable(const NullableOStream<std::ostream>& out) const;
@@ -145,7 +150,16 @@ protected:
     std::map<pid_t, std::string> mCmdlines;
 
     // Cache for getPidInfo.
-    std::map<pid_t, PidInfo> mCachedPidInfos;
+    struct CachedPidInfo {
+        std::once_flag once;
+        bool valid = false;
+        PidInfo info{};
+    };
+    std::mutex mCachedPidInfosLock;
+    std::map<pid_t, std::unique_ptr<CachedPidInfo>> mCachedPidInfos;
+
+    // Serializes the warnings of getPidInfo, which runs on the fetchBinderized threads.
+    mutable std::mutex mErrLock;
 
     // Cache for getPartition.
     std::map<pid_t, Partition> mPartitions;
@@ -26,6 +26,8 @@ namespace android {
 namespace lshal {
 
 static constexpr std::chrono::milliseconds IPC_CALL_WAIT{500};
+// Binderized services that are not queried yet after this time are skipped.
+static constexpr std::chrono::seconds FETCH_BINDERIZED_WAIT{10};
 
 class BackgroundTaskState {
 public:
@@ -417,6 +417,42 @@ TEST_F(ListTest, Fetch) {
 
 }
 
+// Binderized services are fetched concurrently; each server PID must still be parsed once.
+TEST_F(ListTest, FetchManyServices) {
+    static constexpr pid_t kCount = 40;
+    ON_CALL(*serviceManager, list(_)).WillByDefault(Invoke(
+        [] (IServiceManager::list_cb cb) {
+            std::vector<hidl_string> names;
+            for (pid_t id = 1; id <= kCount; ++id) {
+                names.push_back(getFqInstanceName(id));
+            }
+            cb(names);
+            return hardware::Void();
+        }));
+    for (pid_t id = 1; id <= kCount; ++id) {
+        EXPECT_CALL(*mockList, getPidInfo(id, _)).Times(1);
+    }
+
+    EXPECT_EQ(0u, mockList->fetch());
+    EXPECT_EQ("", err.str());
+
+    size_t tableIndex = 0;
+    mockList->forEachTable([&](const Table& table) {
+        if (tableIndex++ != 0) {
+            return;
+        }
+        ASSERT_EQ(static_cast<size_t>(kCount), table.size());
+        for (const auto& entry : table) {
+            pid_t id = getIdFromInstanceName(splitFirst(entry.interfaceName, '/').second);
+            EXPECT_EQ(getFqInstanceName(id), entry.interfaceName);
+            EXPECT_EQ(id, entry.serverPid);
+            EXPECT_EQ(getPtr(id), entry.serverObjectAddress);
+            EXPECT_EQ(getClients(id), entry.clientPids);
+            EXPECT_EQ(getPidInfoFromId(id).threadUsage, entry.threadUsage);
+        }
+    });
+}
+
 TEST_F(ListTest, DumpVintf) {
     const std::string expected =
         "<!-- \n"
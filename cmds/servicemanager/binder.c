@@ -289,9 +289,14 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
             break;
         }
         case BR_FAILED_REPLY:
-            r = -1;
-            break;
         case BR_DEAD_REPLY:
+            if (!bio) {
+                /* a oneway call from binder_send_oneway(), whose target
+                 * may well be gone, is no reason to stop */
+                ALOGW("parse: oneway transaction failed: %s\n",
+                      cmd == BR_DEAD_REPLY ? "dead" : "failed");
+                break;
+            }
             r = -1;
             break;
         default:
@@ -386,6 +391,33 @@ fail:
     return -1;
 }
 
+int binder_send_oneway(struct binder_state *bs,
+                       struct binder_io *msg, uint32_t target, uint32_t code)
+{
+    struct {
+        uint32_t cmd;
+        struct binder_transaction_data txn;
+    } __attribute__((packed)) writebuf;
+
+    if (msg->flags & BIO_F_OVERFLOW) {
+        fprintf(stderr,"binder: txn buffer overflow\n");
+        return -1;
+    }
+
+    writebuf.cmd = BC_TRANSACTION;
+    writebuf.txn.target.handle = target;
+    writebuf.txn.cookie = 0;
+    writebuf.txn.code = code;
+    writebuf.txn.flags = TF_ONE_WAY;
+    writebuf.txn.data_size = msg->data - msg->data0;
+    writebuf.txn.offsets_size = ((char*) msg->offs) - ((char*) msg->offs0);
+    writebuf.txn.data.ptr.buffer = (uintptr_t)msg->data0;
+    writebuf.txn.data.ptr.offsets = (uintptr_t)msg->offs0;
+
+    /* the BR_TRANSACTION_COMPLETE, or the error, is read by binder_loop() */
+    return binder_write(bs, &writebuf, sizeof(writebuf)) < 0 ? -1 : 0;
+}
+
 void binder_loop(struct binder_state *bs, binder_handler func)
 {
     int res;
@@ -39,6 +39,13 @@ enum {
     SVC_MGR_CHECK_SERVICE,
     SVC_MGR_ADD_SERVICE,
     SVC_MGR_LIST_SERVICES,
+    SVC_MGR_REGISTER_FOR_NOTIFICATIONS,
+};
+
+enum {
+    /* Sent to the callbacks given to SVC_MGR_REGISTER_FOR_NOTIFICATIONS,
+     * must match the definition in IServiceManager.cpp */
+    SVC_MGR_NOTIFY_SERVICE = 1,
 };
 
 typedef int (*binder_handler)(struct binder_state *bs,
@@ -56,6 +63,13 @@ int binder_call(struct binder_state *bs,
                 struct binder_io *msg, struct binder_io *reply,
                 uint32_t target, uint32_t code);
 
+/* send a oneway binder call
+ * - returns zero if the transaction could be written, delivery failures
+ *   are only logged later on
+ */
+int binder_send_oneway(struct binder_state *bs,
+                       struct binder_io *msg, uint32_t target, uint32_t code);
+
 /* release any state associate with the binder_io
  * - call once any necessary data has been extracted from the
  *   binder_io after binder_call() returns
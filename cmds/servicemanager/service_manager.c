@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <cutils/android_filesystem_config.h>
 #include <cutils/multiuser.h>
@@ -135,6 +136,8 @@ static int svc_can_find(const uint16_t *name, size_t name_len, pid_t spid, uid_t
 struct svcinfo
 {
     struct svcinfo *next;
+    struct svcinfo *hash_next;
+    uint32_t hash;
     uint32_t handle;
     struct binder_death death;
     int allow_isolated;
@@ -143,14 +146,40 @@ struct svcinfo
     uint16_t name[0];
 };
 
+// All services, most recently added first, in the order SVC_MGR_LIST_SERVICES
+// walks them. Services are never removed, a dead one keeps its entry with a
+// handle of 0 until it registers again.
 struct svcinfo *svclist = NULL;
 
+// Index of svclist by name, for lookups
+#define SVC_HASH_SIZE 512
+static struct svcinfo *svchash[SVC_HASH_SIZE];
+
+// Lookup latency, logged every SVC_LOOKUP_STATS_PERIOD lookups
+#define SVC_LOOKUP_STATS_PERIOD 65536
+static uint64_t svc_lookup_count;
+static uint64_t svc_lookup_total_ns;
+static uint64_t svc_lookup_max_ns;
+
+static uint32_t svc_hash(const uint16_t *s16, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ s16[i]) * 16777619u;
+    }
+    return hash;
+}
+
 struct svcinfo *find_svc(const uint16_t *s16, size_t len)
 {
     struct svcinfo *si;
+    uint32_t hash = svc_hash(s16, len);
 
-    for (si = svclist; si; si = si->next) {
-        if ((len == si->len) &&
+    for (si = svchash[hash % SVC_HASH_SIZE]; si; si = si->hash_next) {
+        if ((hash == si->hash) && (len == si->len) &&
             !memcmp(s16, si->name, len * sizeof(uint16_t))) {
             return si;
         }
@@ -158,6 +187,124 @@ struct svcinfo *find_svc(const uint16_t *s16, size_t len)
     return NULL;
 }
 
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void record_lookup(uint64_t start_ns)
+{
+    uint64_t ns = now_ns() - start_ns;
+
+    svc_lookup_count++;
+    svc_lookup_total_ns += ns;
+    if (ns > svc_lookup_max_ns) {
+        svc_lookup_max_ns = ns;
+    }
+    if (svc_lookup_count % SVC_LOOKUP_STATS_PERIOD == 0) {
+        ALOGI("%" PRIu64 " service lookups, avg %" PRIu64 " ns, max %" PRIu64 " ns\n",
+              svc_lookup_count, svc_lookup_total_ns / svc_lookup_count, svc_lookup_max_ns);
+    }
+}
+
+// Clients waiting for a service to be added, most recent first. A waiter is
+// dropped once notified. The oldest ones go when there are too many, their
+// clients fall back to polling.
+struct svcwaiter
+{
+    struct svcwaiter *next;
+    uint32_t handle;
+    uid_t uid;
+    size_t len;
+    uint16_t name[0];
+};
+
+#define SVC_MAX_WAITERS 256
+static struct svcwaiter *waiterlist = NULL;
+static size_t waiter_count = 0;
+
+static int is_isolated(uid_t uid)
+{
+    uid_t appid = uid % AID_USER;
+    return appid >= AID_ISOLATED_START && appid <= AID_ISOLATED_END;
+}
+
+static void free_waiter(struct binder_state *bs, struct svcwaiter *w)
+{
+    binder_release(bs, w->handle);
+    free(w);
+    waiter_count--;
+}
+
+static void notify_waiters(struct binder_state *bs, struct svcinfo *si)
+{
+    struct svcwaiter **wp = &waiterlist;
+
+    while (*wp) {
+        struct svcwaiter *w = *wp;
+        if ((w->len != si->len) || memcmp(w->name, si->name, si->len * sizeof(uint16_t))) {
+            wp = &w->next;
+            continue;
+        }
+        if (si->allow_isolated || !is_isolated(w->uid)) {
+            unsigned data[128/4];
+            struct binder_io msg;
+
+            bio_init(&msg, data, sizeof(data), 4);
+            bio_put_string16(&msg, si->name);
+            bio_put_ref(&msg, si->handle);
+            binder_send_oneway(bs, &msg, w->handle, SVC_MGR_NOTIFY_SERVICE);
+        }
+        *wp = w->next;
+        free_waiter(bs, w);
+    }
+}
+
+int do_register_for_notifications(struct binder_state *bs, const uint16_t *s, size_t len,
+                                  uint32_t handle, uid_t uid, pid_t spid)
+{
+    struct svcwaiter *w;
+
+    if (!handle || (len == 0) || (len > 127))
+        return -1;
+
+    if (!svc_can_find(s, len, spid, uid)) {
+        return -1;
+    }
+
+    if (waiter_count >= SVC_MAX_WAITERS) {
+        struct svcwaiter **wp = &waiterlist;
+        while ((*wp)->next) {
+            wp = &(*wp)->next;
+        }
+        ALOGW("too many service waiters, dropping the one for '%s'\n",
+              str8((*wp)->name, (*wp)->len));
+        free_waiter(bs, *wp);
+        *wp = NULL;
+    }
+
+    w = malloc(sizeof(*w) + (len + 1) * sizeof(uint16_t));
+    if (!w) {
+        ALOGE("register_for_notifications('%s') uid=%d - OUT OF MEMORY\n",
+             str8(s, len), uid);
+        return -1;
+    }
+    w->handle = handle;
+    w->uid = uid;
+    w->len = len;
+    memcpy(w->name, s, len * sizeof(uint16_t));
+    w->name[len] = '\0';
+    w->next = waiterlist;
+    waiterlist = w;
+    waiter_count++;
+
+    binder_acquire(bs, handle);
+    return 0;
+}
+
 void svcinfo_death(struct binder_state *bs, void *ptr)
 {
     struct svcinfo *si = (struct svcinfo* ) ptr;
@@ -186,8 +333,7 @@ uint32_t do_find_service(const uint16_t *s, size_t len, uid_t uid, pid_t spid)
     if (!si->allow_isolated) {
         // If this service doesn't allow access from isolated processes,
         // then check the uid to see if it is isolated.
-        uid_t appid = uid % AID_USER;
-        if (appid >= AID_ISOLATED_START && appid <= AID_ISOLATED_END) {
+        if (is_isolated(uid)) {
             return 0;
         }
     }
@@ -240,10 +386,14 @@ int do_add_service(struct binder_state *bs, const uint16_t *s, size_t len, uint3
         si->dumpsys_priority = dumpsys_priority;
         si->next = svclist;
         svclist = si;
+        si->hash = svc_hash(s, len);
+        si->hash_next = svchash[si->hash % SVC_HASH_SIZE];
+        svchash[si->hash % SVC_HASH_SIZE] = si;
     }
 
     binder_acquire(bs, handle);
     binder_link_to_death(bs, handle, &si->death);
+    notify_waiters(bs, si);
     return 0;
 }
 
@@ -259,6 +409,7 @@ int svcmgr_handler(struct binder_state *bs,
     uint32_t strict_policy;
     int allow_isolated;
     uint32_t dumpsys_priority;
+    uint64_t start_ns;
 
     //ALOGI("target=%p code=%d pid=%d uid=%d\n",
     //      (void*) txn->target.ptr, txn->code, txn->sender_pid, txn->sender_euid);
@@ -304,7 +455,9 @@ int svcmgr_handler(struct binder_state *bs,
         if (s == NULL) {
             return -1;
         }
+        start_ns = now_ns();
         handle = do_find_service(s, len, txn->sender_euid, txn->sender_pid);
+        record_lookup(start_ns);
         if (!handle)
             break;
         bio_put_ref(reply, handle);
@@ -323,6 +476,17 @@ int svcmgr_handler(struct binder_state *bs,
             return -1;
         break;
 
+    case SVC_MGR_REGISTER_FOR_NOTIFICATIONS:
+        s = bio_get_string16(msg, &len);
+        if (s == NULL) {
+            return -1;
+        }
+        handle = bio_get_ref(msg);
+        if (do_register_for_notifications(bs, s, len, handle, txn->sender_euid,
+                                          txn->sender_pid))
+            return -1;
+        break;
+
     case SVC_MGR_LIST_SERVICES: {
         uint32_t n = bio_get_uint32(msg);
         uint32_t req_dumpsys_priority = bio_get_uint32(msg);
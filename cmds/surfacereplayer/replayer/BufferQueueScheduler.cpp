@@ -72,6 +72,21 @@ void BufferQueueScheduler::setSurfaceControl(
     mCondition.notify_one();
 }
 
+void BufferQueueScheduler::runEvent(const BufferEvent& event) {
+    if (mSurfaceControl == nullptr) {
+        ALOGE("Buffer update of %d Layer before it was created", mSurfaceId);
+        return;
+    }
+    if (!mDequeueTimeoutSet) {
+        mSurfaceControl->getSurface()->setDequeueTimeout(DEQUEUE_TIMEOUT);
+        mDequeueTimeoutSet = true;
+    }
+
+    bufferUpdate(event.dimensions);
+    fillSurface(event.event);
+    mColor.modulate();
+}
+
 void BufferQueueScheduler::bufferUpdate(const Dimensions& dimensions) {
     sp<Surface> s = mSurfaceControl->getSurface();
     s->setBuffersDimensions(dimensions.width, dimensions.height);
@@ -101,7 +116,9 @@ void BufferQueueScheduler::fillSurface(const std::shared_ptr<Event>& event) {
         }
     }
 
-    event->readyToExecute();
+    if (event != nullptr) {
+        event->readyToExecute();
+    }
 
     status = s->unlockAndPost();
 
@@ -33,6 +33,7 @@
 namespace android {
 
 auto constexpr LAYER_ALPHA = 190;
+auto constexpr DEQUEUE_TIMEOUT = 100000000;  // 100ms
 
 struct Dimensions {
     Dimensions() = default;
@@ -60,6 +61,10 @@ class BufferQueueScheduler {
 
     void setSurfaceControl(const sp<SurfaceControl>& surfaceControl, const HSV& color);
 
+    // Updates the buffer on the calling thread, for the single-threaded replay modes. Dequeues
+    // time out rather than wait for a composition that the caller would have to trigger.
+    void runEvent(const BufferEvent& event);
+
   private:
     void bufferUpdate(const Dimensions& dimensions);
 
@@ -72,6 +77,7 @@ class BufferQueueScheduler {
     const int mSurfaceId;
 
     bool mContinueScheduling;
+    bool mDequeueTimeoutSet = false;
 
     std::queue<BufferEvent> mBufferEvents;
     std::mutex mMutex;
@@ -51,6 +51,12 @@ void printHelpMenu() {
 
     std::cout << "  -l  Indefinitely loop the replayer\n";
 
+    std::cout << "  -d  Replay on one thread, executing the increments up to each recorded vsync "
+                 "on a vsync of the display\n";
+
+    std::cout << "  -b  Replay on one thread as fast as possible and report the frame rate "
+                 "SurfaceFlinger keeps up with\n";
+
     std::cout << "  -h  Display help menu\n";
 
     std::cout << std::endl;
@@ -63,9 +69,10 @@ int main(int argc, char** argv) {
     bool pauseBeginning = false;
     int numThreads = DEFAULT_THREADS;
     long stopHere = -1;
+    ReplayMode mode = ReplayMode::Threaded;
 
     int opt = 0;
-    while ((opt = getopt(argc, argv, "mt:s:nlh?")) != -1) {
+    while ((opt = getopt(argc, argv, "mt:s:nldbh?")) != -1) {
         switch (opt) {
             case 'm':
                 pauseBeginning = true;
@@ -82,6 +89,12 @@ int main(int argc, char** argv) {
             case 'l':
                 loop = true;
                 break;
+            case 'd':
+                mode = ReplayMode::VSync;
+                break;
+            case 'b':
+                mode = ReplayMode::Benchmark;
+                break;
             case 'h':
             case '?':
                 printHelpMenu();
@@ -102,7 +115,7 @@ int main(int argc, char** argv) {
 
     status_t status = NO_ERROR;
     do {
-        android::Replayer r(filename, pauseBeginning, numThreads, wait, stopHere);
+        android::Replayer r(filename, pauseBeginning, numThreads, wait, stopHere, mode);
         status = r.replay();
     } while(loop);
 
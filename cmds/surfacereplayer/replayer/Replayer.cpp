@@ -22,6 +22,9 @@
 
 #include <android-base/file.h>
 
+#include <errno.h>
+#include <poll.h>
+
 #include <gui/BufferQueue.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/LayerState.h>
@@ -33,6 +36,7 @@
 #include <utils/String8.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
@@ -50,13 +54,22 @@ using namespace android;
 
 std::atomic_bool Replayer::sReplayingManually(false);
 
+// Events hand increments over to the main thread in the threaded mode; the single-threaded modes
+// execute increments as they come and pass no event.
+static void readyToExecute(const std::shared_ptr<Event>& event) {
+    if (event != nullptr) {
+        event->readyToExecute();
+    }
+}
+
 Replayer::Replayer(const std::string& filename, bool replayManually, int numThreads, bool wait,
-        nsecs_t stopHere)
+        nsecs_t stopHere, ReplayMode mode)
       : mTrace(),
         mLoaded(false),
         mIncrementIndex(0),
         mCurrentTime(0),
         mNumThreads(numThreads),
+        mMode(mode),
         mWaitForTimeStamps(wait),
         mStopTimeStamp(stopHere) {
     srand(RAND_COLOR_SEED);
@@ -82,12 +95,14 @@ Replayer::Replayer(const std::string& filename, bool replayManually, int numThre
     }
 }
 
-Replayer::Replayer(const Trace& t, bool replayManually, int numThreads, bool wait, nsecs_t stopHere)
+Replayer::Replayer(const Trace& t, bool replayManually, int numThreads, bool wait, nsecs_t stopHere,
+        ReplayMode mode)
       : mTrace(t),
         mLoaded(true),
         mIncrementIndex(0),
         mCurrentTime(0),
         mNumThreads(numThreads),
+        mMode(mode),
         mWaitForTimeStamps(wait),
         mStopTimeStamp(stopHere) {
     srand(RAND_COLOR_SEED);
@@ -101,6 +116,10 @@ Replayer::Replayer(const Trace& t, bool replayManually, int numThreads, bool wai
 }
 
 status_t Replayer::replay() {
+    if (mMode != ReplayMode::Threaded) {
+        return replaySingleThreaded();
+    }
+
     signal(SIGINT, Replayer::stopAutoReplayHandler); //for manual control
 
     ALOGV("There are %d increments.", mTrace.increment_size());
@@ -180,6 +199,172 @@ void Replayer::stopAutoReplayHandler(int /*signal*/) {
     sReplayingManually.store(true);
 }
 
+status_t Replayer::replaySingleThreaded() {
+    signal(SIGINT, Replayer::stopSingleThreadedReplayHandler);
+
+    ALOGV("There are %d increments.", mTrace.increment_size());
+
+    status_t status = loadSurfaceComposerClient();
+
+    if (status != NO_ERROR) {
+        ALOGE("Couldn't create SurfaceComposerClient (%d)", status);
+        return status;
+    }
+
+    // In VSync mode the display drives composition and the recorded vsyncs only mark the frame
+    // boundaries; in Benchmark mode they are injected as soon as the frame is set up.
+    const bool benchmark = mMode == ReplayMode::Benchmark;
+    std::unique_ptr<DisplayEventReceiver> receiver;
+    if (benchmark) {
+        SurfaceComposerClient::enableVSyncInjections(true);
+    } else {
+        receiver = std::make_unique<DisplayEventReceiver>();
+        status = receiver->initCheck();
+        if (status != NO_ERROR) {
+            ALOGE("Couldn't create DisplayEventReceiver (%d)", status);
+            return status;
+        }
+        receiver->setVsyncRate(1);
+    }
+
+    std::vector<nsecs_t> frameTimes;
+    int32_t bufferUpdates = 0;
+    const nsecs_t start = systemTime();
+    nsecs_t frameStart = start;
+    for (const Increment& increment : mTrace.increment()) {
+        if (increment.increment_case() != Increment::kVsyncEvent) {
+            if (increment.increment_case() == Increment::kBufferUpdate) {
+                bufferUpdates++;
+            }
+            status = executeIncrement(increment);
+            if (status != NO_ERROR) {
+                break;
+            }
+            continue;
+        }
+
+        doDeleteSurfaceControls();
+        if (benchmark) {
+            // The recorded time has passed long ago, and SurfaceFlinger expects vsyncs to advance.
+            SurfaceComposerClient::injectVSync(systemTime());
+        } else {
+            status = waitForDisplayVSync(receiver.get());
+            if (status != NO_ERROR) {
+                ALOGE("Couldn't wait for vsync (%d)", status);
+                break;
+            }
+        }
+
+        const nsecs_t now = systemTime();
+        frameTimes.push_back(now - frameStart);
+        frameStart = now;
+    }
+    const nsecs_t elapsed = systemTime() - start;
+
+    if (benchmark) {
+        SurfaceComposerClient::enableVSyncInjections(false);
+        printBenchmarkResults(elapsed, std::move(frameTimes), bufferUpdates);
+    }
+
+    return status;
+}
+
+status_t Replayer::executeIncrement(const Increment& increment) {
+    switch (increment.increment_case()) {
+        case increment.kTransaction:
+            return doTransaction(increment.transaction(), nullptr);
+        case increment.kSurfaceCreation:
+            return createSurfaceControl(increment.surface_creation(), nullptr);
+        case increment.kSurfaceDeletion:
+            return deleteSurfaceControl(increment.surface_deletion(), nullptr);
+        case increment.kBufferUpdate: {
+            auto layerId = increment.buffer_update().id();
+            if (mBufferQueueSchedulers.count(layerId) == 0) {
+                mBufferQueueSchedulers[layerId] = std::make_shared<BufferQueueScheduler>(
+                        mLayers[layerId], mColors[layerId], layerId);
+            }
+
+            Dimensions dimensions(increment.buffer_update().w(), increment.buffer_update().h());
+            mBufferQueueSchedulers[layerId]->runEvent(BufferEvent(nullptr, dimensions));
+            return NO_ERROR;
+        }
+        case increment.kVsyncEvent:
+            return injectVSyncEvent(increment.vsync_event(), nullptr);
+        case increment.kDisplayCreation:
+            createDisplay(increment.display_creation(), nullptr);
+            return NO_ERROR;
+        case increment.kDisplayDeletion:
+            deleteDisplay(increment.display_deletion(), nullptr);
+            return NO_ERROR;
+        case increment.kPowerModeUpdate:
+            updatePowerMode(increment.power_mode_update(), nullptr);
+            return NO_ERROR;
+        default:
+            ALOGE("Unknown Increment Type: %d", increment.increment_case());
+            return BAD_VALUE;
+    }
+}
+
+status_t Replayer::waitForDisplayVSync(DisplayEventReceiver* receiver) {
+    DisplayEventReceiver::Event events[8];
+    while (true) {
+        struct pollfd fd = {receiver->getFd(), POLLIN, 0};
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+
+        bool vsync = false;
+        ssize_t count;
+        while ((count = receiver->getEvents(events, 8)) > 0) {
+            for (ssize_t i = 0; i < count; i++) {
+                if (events[i].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                    vsync = true;
+                }
+            }
+        }
+        if (count < 0 && count != -EAGAIN) {
+            return count;
+        }
+        if (vsync) {
+            return NO_ERROR;
+        }
+    }
+}
+
+void Replayer::stopSingleThreadedReplayHandler(int /*signal*/) {
+    SurfaceComposerClient::enableVSyncInjections(false);
+    exit(0);
+}
+
+void Replayer::printBenchmarkResults(nsecs_t elapsed, std::vector<nsecs_t> frameTimes,
+        int32_t bufferUpdates) {
+    const double seconds = elapsed / 1e9;
+    std::cout << "Replayed " << mTrace.increment_size() << " increments in " << elapsed / 1000000
+              << " ms" << std::endl;
+    std::cout << "Buffer updates: " << bufferUpdates << " (" << bufferUpdates / seconds << "/s)"
+              << std::endl;
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    // The time between two injected vsyncs includes waiting for SurfaceFlinger to release a
+    // buffer, so it is bound by how fast the previous frames were composed.
+    std::sort(frameTimes.begin(), frameTimes.end());
+    nsecs_t total = 0;
+    for (nsecs_t frameTime : frameTimes) {
+        total += frameTime;
+    }
+    auto percentile = [&](size_t p) { return frameTimes[(frameTimes.size() - 1) * p / 100]; };
+    std::cout << "Frames: " << frameTimes.size() << " (" << frameTimes.size() / seconds << "/s)"
+              << std::endl;
+    std::cout << "Frame time (us): avg " << total / frameTimes.size() / 1000 << ", p50 "
+              << percentile(50) / 1000 << ", p90 " << percentile(90) / 1000 << ", p99 "
+              << percentile(99) / 1000 << ", max " << frameTimes.back() / 1000 << std::endl;
+}
+
 std::vector<std::string> split(const std::string& s, const char delim) {
     std::vector<std::string> elems;
     std::stringstream ss(s);
@@ -349,9 +534,11 @@ status_t Replayer::doTransaction(const Transaction& t, const std::shared_ptr<Eve
         liveTransaction.setAnimationTransaction();
     }
 
-    event->readyToExecute();
+    readyToExecute(event);
 
-    liveTransaction.apply(t.synchronous());
+    // Synchronous transactions would wait for a vsync the single-threaded benchmark only injects
+    // after the frame is set up.
+    liveTransaction.apply(t.synchronous() && mMode != ReplayMode::Benchmark);
 
     ALOGV("Ended Transaction");
 
@@ -366,6 +553,10 @@ status_t Replayer::doSurfaceTransaction(
     for (const SurfaceChange& change : surfaceChanges) {
         std::unique_lock<std::mutex> lock(mLayerLock);
         if (mLayers[change.id()] == nullptr) {
+            if (mMode != ReplayMode::Threaded) {
+                ALOGE("Transaction of %d Layer before it was created", change.id());
+                continue;
+            }
             mLayerCond.wait(lock, [&] { return (mLayers[change.id()] != nullptr); });
         }
 
@@ -435,6 +626,10 @@ void Replayer::doDisplayTransaction(SurfaceComposerClient::Transaction& t,
         ALOGV("Doing display transaction");
         std::unique_lock<std::mutex> lock(mDisplayLock);
         if (mDisplays[change.id()] == nullptr) {
+            if (mMode != ReplayMode::Threaded) {
+                ALOGE("Transaction of %d Display before it was created", change.id());
+                continue;
+            }
             mDisplayCond.wait(lock, [&] { return (mDisplays[change.id()] != nullptr); });
         }
 
@@ -603,7 +798,7 @@ void Replayer::setDisplayProjection(SurfaceComposerClient::Transaction& t,
 
 status_t Replayer::createSurfaceControl(
         const SurfaceCreation& create, const std::shared_ptr<Event>& event) {
-    event->readyToExecute();
+    readyToExecute(event);
 
     ALOGV("Creating Surface Control: ID: %d", create.id());
     sp<SurfaceControl> surfaceControl = mComposerClient->createSurface(
@@ -634,7 +829,7 @@ status_t Replayer::createSurfaceControl(
 status_t Replayer::deleteSurfaceControl(
         const SurfaceDeletion& delete_, const std::shared_ptr<Event>& event) {
     ALOGV("Deleting %d Surface Control", delete_.id());
-    event->readyToExecute();
+    readyToExecute(event);
 
     std::lock_guard<std::mutex> lock1(mPendingLayersLock);
 
@@ -672,7 +867,7 @@ status_t Replayer::injectVSyncEvent(
 
     doDeleteSurfaceControls();
 
-    event->readyToExecute();
+    readyToExecute(event);
 
     SurfaceComposerClient::injectVSync(vSyncEvent.when());
 
@@ -681,7 +876,7 @@ status_t Replayer::injectVSyncEvent(
 
 void Replayer::createDisplay(const DisplayCreation& create, const std::shared_ptr<Event>& event) {
     ALOGV("Creating display");
-    event->readyToExecute();
+    readyToExecute(event);
 
     std::lock_guard<std::mutex> lock(mDisplayLock);
     sp<IBinder> display = SurfaceComposerClient::createDisplay(
@@ -695,7 +890,7 @@ void Replayer::createDisplay(const DisplayCreation& create, const std::shared_pt
 
 void Replayer::deleteDisplay(const DisplayDeletion& delete_, const std::shared_ptr<Event>& event) {
     ALOGV("Delete display");
-    event->readyToExecute();
+    readyToExecute(event);
 
     std::lock_guard<std::mutex> lock(mDisplayLock);
     SurfaceComposerClient::destroyDisplay(mDisplays[delete_.id()]);
@@ -704,7 +899,7 @@ void Replayer::deleteDisplay(const DisplayDeletion& delete_, const std::shared_p
 
 void Replayer::updatePowerMode(const PowerModeUpdate& pmu, const std::shared_ptr<Event>& event) {
     ALOGV("Updating power mode");
-    event->readyToExecute();
+    readyToExecute(event);
     SurfaceComposerClient::setDisplayPowerMode(mDisplays[pmu.id()], pmu.mode());
 }
 
@@ -715,6 +910,9 @@ void Replayer::waitUntilTimestamp(int64_t timestamp) {
 
 void Replayer::waitUntilDeferredTransactionLayerExists(
         const DeferredTransactionChange& dtc, std::unique_lock<std::mutex>& lock) {
+    if (mMode != ReplayMode::Threaded) {
+        return;
+    }
     if (mLayers.count(dtc.layer_id()) == 0 || mLayers[dtc.layer_id()] == nullptr) {
         mLayerCond.wait(lock, [&] { return (mLayers[dtc.layer_id()] != nullptr); });
     }
@@ -23,6 +23,7 @@
 
 #include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
 
+#include <gui/DisplayEventReceiver.h>
 #include <gui/SurfaceComposerClient.h>
 #include <gui/SurfaceControl.h>
 
@@ -37,6 +38,7 @@
 #include <thread>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace android {
 
@@ -50,12 +52,25 @@ typedef int32_t display_id;
 typedef google::protobuf::RepeatedPtrField<SurfaceChange> SurfaceChanges;
 typedef google::protobuf::RepeatedPtrField<DisplayChange> DisplayChanges;
 
+// How the increments of a trace are replayed.
+enum class ReplayMode {
+    // Each increment is set up on its own thread and executed at its recorded time.
+    Threaded,
+    // Increments are executed in order on one thread. The ones up to each recorded vsync are
+    // executed on a vsync of the display, so every replay composes the same frames.
+    VSync,
+    // Increments are executed in order on one thread without waiting, injecting a vsync for each
+    // recorded one, and the rate SurfaceFlinger keeps up with is reported.
+    Benchmark,
+};
+
 class Replayer {
   public:
     Replayer(const std::string& filename, bool replayManually = false,
-            int numThreads = DEFAULT_THREADS, bool wait = true, nsecs_t stopHere = -1);
+            int numThreads = DEFAULT_THREADS, bool wait = true, nsecs_t stopHere = -1,
+            ReplayMode mode = ReplayMode::Threaded);
     Replayer(const Trace& trace, bool replayManually = false, int numThreads = DEFAULT_THREADS,
-            bool wait = true, nsecs_t stopHere = -1);
+            bool wait = true, nsecs_t stopHere = -1, ReplayMode mode = ReplayMode::Threaded);
 
     status_t replay();
 
@@ -67,6 +82,14 @@ class Replayer {
 
     status_t dispatchEvent(int index);
 
+    // The single-threaded replay modes; manual replay is not supported in them.
+    status_t replaySingleThreaded();
+    status_t executeIncrement(const Increment& increment);
+    status_t waitForDisplayVSync(DisplayEventReceiver* receiver);
+    static void stopSingleThreadedReplayHandler(int signal);
+    void printBenchmarkResults(nsecs_t elapsed, std::vector<nsecs_t> frameTimes,
+            int32_t bufferUpdates);
+
     status_t doTransaction(const Transaction& transaction, const std::shared_ptr<Event>& event);
     status_t createSurfaceControl(const SurfaceCreation& create,
             const std::shared_ptr<Event>& event);
@@ -131,6 +154,7 @@ class Replayer {
     int32_t mIncrementIndex = 0;
     int64_t mCurrentTime = 0;
     int32_t mNumThreads = DEFAULT_THREADS;
+    ReplayMode mMode = ReplayMode::Threaded;
 
     Increment mCurrentIncrement;
 
@@ -19,12 +19,37 @@
 #define __LIBDISKUSAGE_DIRSIZE_H
 
 #include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/stat.h>
 
 __BEGIN_DECLS
 
 int64_t stat_size(struct stat *s);
+
+/* Returns the size of the entries under the directory dfd, but not of dfd
+ * itself, walking it with several threads. Closes dfd. */
 int64_t calculate_dir_size(int dfd);
 
+/* What calculate_dir_size_filtered() does with an entry, returned by the
+ * filter. */
+#define DIRSIZE_MEASURE  0x1    /* add the size of the entry */
+#define DIRSIZE_DESCEND  0x2    /* for a directory, walk the entries under it */
+
+/* Flags of calculate_dir_size_filtered(). */
+#define DIRSIZE_XDEV     0x1    /* don't walk into other file systems */
+
+/* Receives the lstat() of every entry of the tree, from any of the walking
+ * threads, and returns DIRSIZE_MEASURE and/or DIRSIZE_DESCEND. */
+typedef int (*dirsize_filter_t)(const struct stat *s, void *cookie);
+
+/* Like calculate_dir_size(), but only measuring and walking the entries
+ * filter allows; a NULL filter allows everything. Directories are read with
+ * getdents64() into large buffers, and walked by up to max_threads threads,
+ * or a default number if it is 0, which take subdirectories from each other
+ * as they run out. Closes dfd. */
+int64_t calculate_dir_size_filtered(int dfd, int flags, dirsize_filter_t filter,
+                                    void *cookie, int max_threads);
+
 __END_DECLS
 
 #endif /* __LIBDISKUSAGE_DIRSIZE_H */
@@ -240,12 +240,17 @@ struct PointerCoords {
     void scale(float scale);
     void applyOffset(float xOffset, float yOffset);
 
+    // Position accessors for the resampling and velocity tracking loops. The axes are
+    // constants within range, so these inline to a bit test and a load instead of the
+    // range check and bit scan of getAxisValue().
     inline float getX() const {
-        return getAxisValue(AMOTION_EVENT_AXIS_X);
+        return BitSet64::hasBit(bits, AMOTION_EVENT_AXIS_X)
+                ? values[BitSet64::getIndexOfBit(bits, AMOTION_EVENT_AXIS_X)] : 0;
     }
 
     inline float getY() const {
-        return getAxisValue(AMOTION_EVENT_AXIS_Y);
+        return BitSet64::hasBit(bits, AMOTION_EVENT_AXIS_Y)
+                ? values[BitSet64::getIndexOfBit(bits, AMOTION_EVENT_AXIS_Y)] : 0;
     }
 
 #ifdef __ANDROID__
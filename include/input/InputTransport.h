@@ -47,6 +47,10 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+        // Carries the shared memory of the channel as an ancillary fd.
+        TYPE_SHARED_MEMORY = 4,
+        // Tells a reader waiting on the socket that the shared memory has messages.
+        TYPE_WAKEUP = 5,
     };
 
     struct Header {
@@ -128,6 +132,8 @@ struct InputMessage {
     size_t size() const;
 };
 
+class SharedMemoryTransport;
+
 /*
  * An input channel consists of a local unix domain socket used to send and receive
  * input messages across processes.  Each channel has a descriptive name for debugging purposes.
@@ -178,12 +184,54 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Sends messages to the other endpoint with as few system calls as possible.
+     * Each message still travels on its own, in order.
+     *
+     * outSent is set to the number of messages that were sent. Those after that
+     * have not been sent at all.
+     *
+     * Returns OK if all messages were sent, otherwise the error that stopped at
+     * message outSent, as for sendMessage().
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outSent);
+
+    /* Receives up to maxCount messages sent by the other endpoint with a single
+     * system call.
+     *
+     * outCount is set to the number of messages received, which is at least
+     * one on success.
+     *
+     * Returns OK on success, otherwise the same errors as receiveMessage().
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t maxCount, size_t* outCount);
+
+    /* Moves the messages of both directions to rings in memory shared with the
+     * other endpoint, after which the socket only carries wakeups. This must be
+     * called on the server end before any message is sent; the client end
+     * switches over when it receives the memory.
+     *
+     * Once this is enabled, a reader must keep receiving until it gets WOULD_BLOCK
+     * before waiting on the fd again, since the fd no longer stays readable while
+     * messages are pending.
+     *
+     * Returns OK on success, otherwise the channel keeps using the socket in
+     * both directions.
+     */
+    status_t enableSharedMemoryTransport();
+
     /* Returns a new object that has a duplicate of this channel's fd. */
     sp<InputChannel> dup() const;
 
 private:
+    status_t sendSocketMessage(const InputMessage* msg, int fd);
+    status_t receiveSocketMessage(InputMessage* msg, int* outFd);
+    // Consumes the messages that only concern the transport, together with fd.
+    bool handleTransportMessage(const InputMessage* msg, int fd);
+    status_t wakeSharedMemoryReader();
+
     std::string mName;
     int mFd;
+    sp<SharedMemoryTransport> mSharedMemory;
 };
 
 /*
@@ -321,7 +369,8 @@ public:
      *
      * Should be called after calling consume() to determine whether the consumer
      * has a deferred event to be processed.  Deferred events are somewhat special in
-     * that they have already been removed from the input channel.  If the input channel
+     * that they have already been removed from the input channel, this includes the
+     * messages read ahead from the channel along with the one being consumed.  If the input channel
      * becomes empty, the client may need to do extra work to ensure that it processes
      * the deferred event despite the fact that the input channel's file descriptor
      * is not readable.
@@ -346,6 +395,9 @@ private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // How far past the frame time touches are predicted to, 0 to resample behind it instead.
+    const nsecs_t mResamplePrediction;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
@@ -356,6 +408,17 @@ private:
     // call to consume and that still needs to be handled.
     bool mMsgDeferred;
 
+    // Messages read from the input channel in one go by the last call to
+    // receiveMessage() that are yet to be handed out.
+    enum { RECEIVE_BATCH_SIZE = 8 };
+    InputMessage mReceivedMsgs[RECEIVE_BATCH_SIZE];
+    size_t mReceivedMsgsIndex;
+    size_t mReceivedMsgsCount;
+
+    // Finished signals of a sequence chain, sent together. Kept around so that
+    // it only needs to grow once.
+    Vector<InputMessage> mFinishedMsgs;
+
     // Batched motion events per device and source.
     struct Batch {
         Vector<InputMessage> samples;
@@ -401,11 +464,14 @@ private:
         }
     };
     struct TouchState {
+        // Enough samples to fit the velocity of a pointer when predicting.
+        static const size_t HISTORY_SIZE = 4;
+
         int32_t deviceId;
         int32_t source;
         size_t historyCurrent;
         size_t historySize;
-        History history[2];
+        History history[HISTORY_SIZE];
         History lastResample;
 
         void initialize(int32_t deviceId, int32_t source) {
@@ -418,15 +484,16 @@ private:
         }
 
         void addHistory(const InputMessage& msg) {
-            historyCurrent ^= 1;
-            if (historySize < 2) {
+            historyCurrent = (historyCurrent + 1) % HISTORY_SIZE;
+            if (historySize < HISTORY_SIZE) {
                 historySize += 1;
             }
             history[historyCurrent].initializeFrom(msg);
         }
 
+        // Index 0 is the most recent sample.
         const History* getHistory(size_t index) const {
-            return &history[(historyCurrent + index) & 1];
+            return &history[(historyCurrent + HISTORY_SIZE - index) % HISTORY_SIZE];
         }
 
         bool recentCoordinatesAreIdentical(uint32_t id) const {
@@ -472,6 +539,7 @@ private:
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
 
+    status_t receiveMessage(InputMessage* msg);
     status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
 
     static void rewriteMessage(TouchState& state, InputMessage& msg);
@@ -481,8 +549,11 @@ private:
     static bool canAddSample(const Batch& batch, const InputMessage* msg);
     static ssize_t findSampleNoLaterThan(const Batch& batch, nsecs_t time);
     static bool shouldResampleTool(int32_t toolType);
+    static bool fitPointerVelocity(const TouchState& state, uint32_t id,
+            float* outVx, float* outVy);
 
     static bool isTouchResamplingEnabled();
+    static nsecs_t getResamplePrediction();
 };
 
 } // namespace android
@@ -183,11 +183,17 @@ private:
     };
 
     float chooseWeight(uint32_t index) const;
+    bool computeEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
 
     const uint32_t mDegree;
     const Weighting mWeighting;
     uint32_t mIndex;
     Movement mMovements[HISTORY_SIZE];
+
+    // Estimators solved since the last movement was added.  Velocity is often queried
+    // for every pointer on every frame, but it only changes with a new movement.
+    mutable BitSet32 mCachedEstimatorIdBits;
+    mutable VelocityTracker::Estimator mCachedEstimators[MAX_POINTER_ID + 1];
 };
 
 
@@ -20,11 +20,15 @@
 #include <utils/misc.h>
 #include <binder/BpBinder.h>
 #include <binder/IInterface.h>
+#include <binder/IPCThreadState.h>
 #include <binder/IResultReceiver.h>
 #include <binder/IShellCallback.h>
 #include <binder/Parcel.h>
+#include <private/android_filesystem_config.h>
+#include <private/binder/TransactionStats.h>
 
 #include <stdio.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -258,6 +262,20 @@ status_t BBinder::onTransact(
             return NO_ERROR;
         }
 
+        case TRANSACTION_STATS_TRANSACTION: {
+            const uid_t uid = IPCThreadState::self()->getCallingUid();
+            if (uid != AID_ROOT && uid != AID_SYSTEM && uid != AID_SHELL && uid != getuid()) {
+                return PERMISSION_DENIED;
+            }
+            int fd = data.readFileDescriptor();
+            int argc = data.readInt32();
+            Vector<String16> args;
+            for (int i = 0; i < argc && data.dataAvail() > 0; i++) {
+               args.add(data.readString16());
+            }
+            return TransactionStats::self().command(fd, args);
+        }
+
         default:
             return UNKNOWN_TRANSACTION;
     }
@@ -61,12 +61,20 @@ private:
         // Note that this cannot be meaningfully copied.
     };
 
+    // The heaps are spread over shards by binder address, so that clients
+    // mapping different heaps don't contend for one lock.
+    enum { NUM_SHARDS = 8 };
+    struct shard_t {
+        Mutex lock;  // Protects entire vector below.
+        KeyedVector< wp<IBinder>, heap_info_t > heaps;
+        // We do not use the copy-on-write capabilities of KeyedVector.
+        // TODO: Reimplemement based on standard C++ container?
+    };
+
     void free_heap(const wp<IBinder>& binder);
+    shard_t& shard(const wp<IBinder>& binder);
 
-    Mutex mHeapCacheLock;  // Protects entire vector below.
-    KeyedVector< wp<IBinder>, heap_info_t > mHeapCache;
-    // We do not use the copy-on-write capabilities of KeyedVector.
-    // TODO: Reimplemement based on standard C++ container?
+    shard_t mShards[NUM_SHARDS];
 };
 
 static sp<HeapCache> gHeapCache = new HeapCache();
@@ -129,13 +137,19 @@ class BpMemory : public BpInterface<IMemory>
 {
 public:
     explicit BpMemory(const sp<IBinder>& impl);
+    // for IMemory::readFromParcel(), with the heap, offset and size that were
+    // sent along
+    BpMemory(const sp<IBinder>& impl, const sp<IBinder>& heap, ssize_t offset, size_t size);
     virtual ~BpMemory();
     virtual sp<IMemoryHeap> getMemory(ssize_t* offset=0, size_t* size=0) const;
 
 private:
+    void setMemory(const sp<IBinder>& heap, ssize_t offset, size_t size) const;
+
     mutable sp<IMemoryHeap> mHeap;
     mutable ssize_t mOffset;
     mutable size_t mSize;
+    mutable sp<IBinder> mSentHeap;
 };
 
 /******************************************************************************/
@@ -170,6 +184,39 @@ ssize_t IMemory::offset() const {
     return offset;
 }
 
+status_t IMemory::writeToParcel(Parcel* parcel, const sp<IMemory>& memory)
+{
+    status_t err = parcel->writeStrongBinder(IInterface::asBinder(memory));
+    if (err != NO_ERROR || memory == 0) {
+        return err;
+    }
+    ssize_t offset = 0;
+    size_t size = 0;
+    sp<IMemoryHeap> heap = memory->getMemory(&offset, &size);
+    if ((err = parcel->writeStrongBinder(IInterface::asBinder(heap))) != NO_ERROR) {
+        return err;
+    }
+    if ((err = parcel->writeInt32(offset)) != NO_ERROR) {
+        return err;
+    }
+    return parcel->writeInt32(size);
+}
+
+sp<IMemory> IMemory::readFromParcel(const Parcel& parcel)
+{
+    sp<IBinder> binder = parcel.readStrongBinder();
+    if (binder == 0) {
+        return 0;
+    }
+    sp<IBinder> heap = parcel.readStrongBinder();
+    ssize_t offset = parcel.readInt32();
+    size_t size = parcel.readInt32();
+    if (binder->localBinder() != 0 || heap == 0) {
+        return interface_cast<IMemory>(binder);
+    }
+    return new BpMemory(binder, heap, offset, size);
+}
+
 /******************************************************************************/
 
 BpMemory::BpMemory(const sp<IBinder>& impl)
@@ -177,35 +224,56 @@ BpMemory::BpMemory(const sp<IBinder>& impl)
 {
 }
 
+BpMemory::BpMemory(const sp<IBinder>& impl, const sp<IBinder>& heap,
+        ssize_t offset, size_t size)
+    : BpInterface<IMemory>(impl), mOffset(offset), mSize(size), mSentHeap(heap)
+{
+}
+
 BpMemory::~BpMemory()
 {
 }
 
+void BpMemory::setMemory(const sp<IBinder>& heap, ssize_t o, size_t s) const
+{
+    // Share the proxy that maps the heap, if there is one, rather than have
+    // another one dup its file descriptor.
+    mHeap = gHeapCache->get_heap(heap);
+    if (mHeap != 0) {
+        size_t heapSize = mHeap->getSize();
+        if (s <= heapSize
+                && o >= 0
+                && (static_cast<size_t>(o) <= heapSize - s)) {
+            mOffset = o;
+            mSize = s;
+        } else {
+            // Hm.
+            android_errorWriteWithInfoLog(0x534e4554,
+                "26877992", -1, NULL, 0);
+            mOffset = 0;
+            mSize = 0;
+        }
+    }
+}
+
 sp<IMemoryHeap> BpMemory::getMemory(ssize_t* offset, size_t* size) const
 {
     if (mHeap == 0) {
-        Parcel data, reply;
-        data.writeInterfaceToken(IMemory::getInterfaceDescriptor());
-        if (remote()->transact(GET_MEMORY, data, &reply) == NO_ERROR) {
-            sp<IBinder> heap = reply.readStrongBinder();
-            ssize_t o = reply.readInt32();
-            size_t s = reply.readInt32();
-            if (heap != 0) {
-                mHeap = interface_cast<IMemoryHeap>(heap);
-                if (mHeap != 0) {
-                    size_t heapSize = mHeap->getSize();
-                    if (s <= heapSize
-                            && o >= 0
-                            && (static_cast<size_t>(o) <= heapSize - s)) {
-                        mOffset = o;
-                        mSize = s;
-                    } else {
-                        // Hm.
-                        android_errorWriteWithInfoLog(0x534e4554,
-                            "26877992", -1, NULL, 0);
-                        mOffset = 0;
-                        mSize = 0;
-                    }
+        if (mSentHeap != 0) {
+            // the heap, offset and size came with this IMemory, check them
+            // the same way as the ones from the remote object
+            sp<IBinder> heap = mSentHeap;
+            mSentHeap.clear();
+            setMemory(heap, mOffset, mSize);
+        } else {
+            Parcel data, reply;
+            data.writeInterfaceToken(IMemory::getInterfaceDescriptor());
+            if (remote()->transact(GET_MEMORY, data, &reply) == NO_ERROR) {
+                sp<IBinder> heap = reply.readStrongBinder();
+                ssize_t o = reply.readInt32();
+                size_t s = reply.readInt32();
+                if (heap != 0) {
+                    setMemory(heap, o, s);
                 }
             }
         }
@@ -419,12 +487,19 @@ void HeapCache::binderDied(const wp<IBinder>& binder)
     free_heap(binder);
 }
 
+HeapCache::shard_t& HeapCache::shard(const wp<IBinder>& binder)
+{
+    // skip the low bits, which are the same for all allocations
+    return mShards[(uintptr_t(binder.unsafe_get()) >> 4) % NUM_SHARDS];
+}
+
 sp<IMemoryHeap> HeapCache::find_heap(const sp<IBinder>& binder)
 {
-    Mutex::Autolock _l(mHeapCacheLock);
-    ssize_t i = mHeapCache.indexOfKey(binder);
+    shard_t& s = shard(binder);
+    Mutex::Autolock _l(s.lock);
+    ssize_t i = s.heaps.indexOfKey(binder);
     if (i>=0) {
-        heap_info_t& info = mHeapCache.editValueAt(i);
+        heap_info_t& info = s.heaps.editValueAt(i);
         ALOGD_IF(VERBOSE,
                 "found binder=%p, heap=%p, size=%zu, fd=%d, count=%d",
                 binder.get(), info.heap.get(),
@@ -440,7 +515,7 @@ sp<IMemoryHeap> HeapCache::find_heap(const sp<IBinder>& binder)
         info.count = 1;
         //ALOGD("adding binder=%p, heap=%p, count=%d",
         //      binder.get(), info.heap.get(), info.count);
-        mHeapCache.add(binder, info);
+        s.heaps.add(binder, info);
         return info.heap;
     }
 }
@@ -453,10 +528,11 @@ void HeapCache::free_heap(const wp<IBinder>& binder)
 {
     sp<IMemoryHeap> rel;
     {
-        Mutex::Autolock _l(mHeapCacheLock);
-        ssize_t i = mHeapCache.indexOfKey(binder);
+        shard_t& s = shard(binder);
+        Mutex::Autolock _l(s.lock);
+        ssize_t i = s.heaps.indexOfKey(binder);
         if (i>=0) {
-            heap_info_t& info(mHeapCache.editValueAt(i));
+            heap_info_t& info(s.heaps.editValueAt(i));
             if (--info.count == 0) {
                 ALOGD_IF(VERBOSE,
                         "removing binder=%p, heap=%p, size=%zu, fd=%d, count=%d",
@@ -465,8 +541,8 @@ void HeapCache::free_heap(const wp<IBinder>& binder)
                         static_cast<BpMemoryHeap*>(info.heap.get())
                             ->mHeapId.load(memory_order_relaxed),
                         info.count);
-                rel = mHeapCache.valueAt(i).heap;
-                mHeapCache.removeItemsAt(i);
+                rel = s.heaps.valueAt(i).heap;
+                s.heaps.removeItemsAt(i);
             }
         } else {
             ALOGE("free_heap binder=%p not found!!!", binder.unsafe_get());
@@ -477,24 +553,27 @@ void HeapCache::free_heap(const wp<IBinder>& binder)
 sp<IMemoryHeap> HeapCache::get_heap(const sp<IBinder>& binder)
 {
     sp<IMemoryHeap> realHeap;
-    Mutex::Autolock _l(mHeapCacheLock);
-    ssize_t i = mHeapCache.indexOfKey(binder);
-    if (i>=0)   realHeap = mHeapCache.valueAt(i).heap;
+    shard_t& s = shard(binder);
+    Mutex::Autolock _l(s.lock);
+    ssize_t i = s.heaps.indexOfKey(binder);
+    if (i>=0)   realHeap = s.heaps.valueAt(i).heap;
     else        realHeap = interface_cast<IMemoryHeap>(binder);
     return realHeap;
 }
 
 void HeapCache::dump_heaps()
 {
-    Mutex::Autolock _l(mHeapCacheLock);
-    int c = mHeapCache.size();
-    for (int i=0 ; i<c ; i++) {
-        const heap_info_t& info = mHeapCache.valueAt(i);
-        BpMemoryHeap const* h(static_cast<BpMemoryHeap const *>(info.heap.get()));
-        ALOGD("hey=%p, heap=%p, count=%d, (fd=%d, base=%p, size=%zu)",
-                mHeapCache.keyAt(i).unsafe_get(),
-                info.heap.get(), info.count,
-                h->mHeapId.load(memory_order_relaxed), h->mBase, h->mSize);
+    for (shard_t& s : mShards) {
+        Mutex::Autolock _l(s.lock);
+        int c = s.heaps.size();
+        for (int i=0 ; i<c ; i++) {
+            const heap_info_t& info = s.heaps.valueAt(i);
+            BpMemoryHeap const* h(static_cast<BpMemoryHeap const *>(info.heap.get()));
+            ALOGD("hey=%p, heap=%p, count=%d, (fd=%d, base=%p, size=%zu)",
+                    s.heaps.keyAt(i).unsafe_get(),
+                    info.heap.get(), info.count,
+                    h->mHeapId.load(memory_order_relaxed), h->mBase, h->mSize);
+        }
     }
 }
 
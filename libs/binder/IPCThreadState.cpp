@@ -29,6 +29,7 @@
 
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
+#include <private/binder/TransactionStats.h>
 
 #include <errno.h>
 #include <inttypes.h>
@@ -36,10 +37,13 @@
 #include <sched.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #if LOG_NDEBUG
 
 #define IF_LOG_TRANSACTIONS() if (false)
@@ -105,7 +109,9 @@ static const char *kCommandStrings[] = {
     "BC_EXIT_LOOPER",
     "BC_REQUEST_DEATH_NOTIFICATION",
     "BC_CLEAR_DEATH_NOTIFICATION",
-    "BC_DEAD_BINDER_DONE"
+    "BC_DEAD_BINDER_DONE",
+    "BC_TRANSACTION_SG",
+    "BC_REPLY_SG"
 };
 
 static const char* getReturnString(uint32_t cmd)
@@ -218,6 +224,15 @@ static const void* printCommand(TextOutput& out, const void* _cmd)
             out << dedent;
         } break;
 
+        case BC_TRANSACTION_SG:
+        case BC_REPLY_SG: {
+            out << ": " << indent;
+            const binder_size_t* buffersSize =
+                (const binder_size_t *)printBinderTransactionData(out, cmd);
+            out << endl << "buffers=" << (void*)*buffersSize << " bytes" << dedent;
+            cmd = (const int32_t *)(buffersSize + 1);
+        } break;
+
         case BC_ACQUIRE_RESULT: {
             const int32_t res = *cmd++;
             out << ": " << res << (res ? " (SUCCESS)" : " (FAILURE)");
@@ -275,10 +290,27 @@ static pthread_mutex_t gTLSMutex = PTHREAD_MUTEX_INITIALIZER;
 static bool gHaveTLS = false;
 static pthread_key_t gTLS = 0;
 static bool gShutdown = false;
+
+// This thread's state, so that self() needs no pthread_getspecific. gTLS
+// still owns the state, and its destructor tears the state down at thread
+// exit; this is cleared before the state is deleted.
+static thread_local IPCThreadState* gThreadState = nullptr;
 static bool gDisableBackgroundScheduling = false;
 
+// Larger parcel data buffers are not worth keeping around
+static const size_t PARCEL_DATA_POOL_MAX_CAPACITY = 8 * 1024;
+
+// A oneway batch is sent early once it holds this much transaction data, or
+// this many transactions, so that it does not take up too much of the
+// receiving process's async buffer space at once.
+static const size_t ONEWAY_BATCH_MAX_SIZE = 32 * 1024;
+static const size_t ONEWAY_BATCH_MAX_COUNT = 64;
+
 IPCThreadState* IPCThreadState::self()
 {
+    IPCThreadState* const cached = gThreadState;
+    if (cached) return cached;
+
     if (gHaveTLS) {
 restart:
         const pthread_key_t k = gTLS;
@@ -309,6 +341,9 @@ restart:
 
 IPCThreadState* IPCThreadState::selfOrNull()
 {
+    IPCThreadState* const cached = gThreadState;
+    if (cached) return cached;
+
     if (gHaveTLS) {
         const pthread_key_t k = gTLS;
         IPCThreadState* st = (IPCThreadState*)pthread_getspecific(k);
@@ -325,6 +360,7 @@ void IPCThreadState::shutdown()
         // XXX Need to wait for all thread pool threads to exit!
         IPCThreadState* st = (IPCThreadState*)pthread_getspecific(gTLS);
         if (st) {
+            gThreadState = nullptr;
             delete st;
             pthread_setspecific(gTLS, NULL);
         }
@@ -404,6 +440,43 @@ void IPCThreadState::clearCaller()
     mCallingUid = getuid();
 }
 
+void IPCThreadState::beginOnewayBatch()
+{
+    mOnewayBatchDepth++;
+}
+
+status_t IPCThreadState::endOnewayBatch()
+{
+    LOG_ALWAYS_FATAL_IF(mOnewayBatchDepth == 0, "endOnewayBatch() without beginOnewayBatch()");
+    if (--mOnewayBatchDepth > 0) {
+        return NO_ERROR;
+    }
+    flushOnewayBatch();
+    const status_t result = mOnewayBatchError;
+    mOnewayBatchError = NO_ERROR;
+    return result;
+}
+
+void IPCThreadState::flushOnewayBatch()
+{
+    const size_t count = mOnewayBatch.size();
+    for (size_t i = 0; i < count; i++) {
+        // The first round trip writes out the whole batch. Each transaction
+        // then completes with its own BR_TRANSACTION_COMPLETE, or an error,
+        // after which the driver stops reading the rest and the next round
+        // trip writes it again.
+        const status_t err = waitForResponse(NULL, NULL);
+        if (err != NO_ERROR && mOnewayBatchError == NO_ERROR) {
+            mOnewayBatchError = mLastError = err;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        delete mOnewayBatch[i];
+    }
+    mOnewayBatch.clear();
+    mOnewayBatchSize = 0;
+}
+
 void IPCThreadState::flushCommands()
 {
     if (mProcess->mDriverFD <= 0)
@@ -423,6 +496,10 @@ void IPCThreadState::flushCommands()
 void IPCThreadState::blockUntilThreadAvailable()
 {
     pthread_mutex_lock(&mProcess->mThreadCountLock);
+    if (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads) {
+        mProcess->mBlockedCallersCount++;
+        mProcess->growThreadPoolLocked();
+    }
     while (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads) {
         ALOGW("Waiting for thread to be free. mExecutingThreadsCount=%lu mMaxThreads=%lu\n",
                 static_cast<unsigned long>(mProcess->mExecutingThreadsCount),
@@ -449,6 +526,10 @@ status_t IPCThreadState::getAndExecuteCommand()
 
         pthread_mutex_lock(&mProcess->mThreadCountLock);
         mProcess->mExecutingThreadsCount++;
+        mProcess->mPeakExecutingThreadsCount = std::max(mProcess->mPeakExecutingThreadsCount,
+                mProcess->mExecutingThreadsCount);
+        mProcess->mWindowPeakExecutingThreadsCount = std::max(
+                mProcess->mWindowPeakExecutingThreadsCount, mProcess->mExecutingThreadsCount);
         if (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs == 0) {
             mProcess->mStarvationStartTimeMs = uptimeMillis();
@@ -457,17 +538,28 @@ status_t IPCThreadState::getAndExecuteCommand()
 
         result = executeCommand(cmd);
 
+        // An idle thread blocks in the driver and can only find out that it
+        // is no longer needed here, once it is done with a command and no
+        // more are queued up for it.
+        const bool canRetire = mIsPooledThread && result == NO_ERROR &&
+                mIn.dataPosition() >= mIn.dataSize();
+
         pthread_mutex_lock(&mProcess->mThreadCountLock);
         mProcess->mExecutingThreadsCount--;
+        int64_t starvationTimeMs = 0;
         if (mProcess->mExecutingThreadsCount < mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs != 0) {
-            int64_t starvationTimeMs = uptimeMillis() - mProcess->mStarvationStartTimeMs;
+            starvationTimeMs = uptimeMillis() - mProcess->mStarvationStartTimeMs;
             if (starvationTimeMs > 100) {
                 ALOGE("binder thread pool (%zu threads) starved for %" PRId64 " ms",
                       mProcess->mMaxThreads, starvationTimeMs);
             }
             mProcess->mStarvationStartTimeMs = 0;
         }
+        if (mProcess->threadPoolCommandDoneLocked(starvationTimeMs, canRetire)) {
+            // joinThreadPool() lets the thread go
+            result = TIMED_OUT;
+        }
         pthread_cond_broadcast(&mProcess->mThreadCountDecrement);
         pthread_mutex_unlock(&mProcess->mThreadCountLock);
     }
@@ -531,6 +623,13 @@ void IPCThreadState::joinThreadPool(bool isMain)
 
     mOut.writeInt32(isMain ? BC_ENTER_LOOPER : BC_REGISTER_LOOPER);
 
+    if (!isMain) {
+        pthread_mutex_lock(&mProcess->mThreadCountLock);
+        mProcess->mPooledThreadsCount++;
+        pthread_mutex_unlock(&mProcess->mThreadCountLock);
+        mIsPooledThread = true;
+    }
+
     status_t result;
     do {
         processPendingDerefs();
@@ -553,6 +652,13 @@ void IPCThreadState::joinThreadPool(bool isMain)
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS LEAVING THE THREAD POOL err=%d\n",
         (void*)pthread_self(), getpid(), result);
 
+    if (!isMain) {
+        mIsPooledThread = false;
+        pthread_mutex_lock(&mProcess->mThreadCountLock);
+        mProcess->mPooledThreadsCount--;
+        pthread_mutex_unlock(&mProcess->mThreadCountLock);
+    }
+
     mOut.writeInt32(BC_EXIT_LOOPER);
     talkWithDriver(false);
 }
@@ -599,6 +705,8 @@ status_t IPCThreadState::transact(int32_t handle,
 
     flags |= TF_ACCEPT_FDS;
 
+    const nsecs_t startTime = TransactionStats::isEnabled() ? systemTime() : 0;
+
     IF_LOG_TRANSACTIONS() {
         TextOutput::Bundle _b(alog);
         alog << "BC_TRANSACTION thr " << (void*)pthread_self() << " / hand "
@@ -608,6 +716,38 @@ status_t IPCThreadState::transact(int32_t handle,
 
     LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
         (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
+
+    if (mOnewayBatchDepth > 0) {
+        if ((flags & TF_ONE_WAY) != 0) {
+            // The driver reads the data from the parcel when the batch is
+            // sent, which may be after the caller is done with it.
+            Parcel* copy = new Parcel;
+            if (copy->appendFrom(&data, 0, data.dataSize()) == NO_ERROR) {
+                err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+                if (err != NO_ERROR) {
+                    delete copy;
+                    return (mLastError = err);
+                }
+                mOnewayBatch.push(copy);
+                mOnewayBatchSize += copy->dataSize();
+                if (mOnewayBatchSize >= ONEWAY_BATCH_MAX_SIZE ||
+                        mOnewayBatch.size() >= ONEWAY_BATCH_MAX_COUNT) {
+                    flushOnewayBatch();
+                }
+                if (startTime != 0) {
+                    TransactionStats::self().record(TransactionStats::CLIENT, data, code,
+                            systemTime() - startTime);
+                }
+                return NO_ERROR;
+            }
+            // e.g. it holds external buffers, send it on its own
+            delete copy;
+        }
+        // Keeps the transactions in order, and the replies waited for below
+        // from being mixed up with the completions of the batch.
+        flushOnewayBatch();
+    }
+
     err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
 
     if (err != NO_ERROR) {
@@ -648,14 +788,67 @@ status_t IPCThreadState::transact(int32_t handle,
         err = waitForResponse(NULL, NULL);
     }
 
+    if (startTime != 0) {
+        TransactionStats::self().record(TransactionStats::CLIENT, data, code,
+                systemTime() - startTime);
+    }
+
     return err;
 }
 
+// Writes a reference count command for the handle to mOut. An increment
+// that follows a decrement of the same kind on the same handle, with nothing
+// else written since, cancels it out instead: e.g. a proxy that is destroyed
+// and recreated for the same handle within one batch sends nothing. Returns
+// whether the command was written.
+//
+// Only a decrement followed by an increment can cancel. The other way round
+// can't happen within a batch, as the temp reference taken for an increment
+// keeps the proxy alive until the driver has seen it.
+bool IPCThreadState::writeRefCommand(int32_t cmd, int32_t handle)
+{
+    const size_t kCommandSize = 2 * sizeof(int32_t);
+
+    if (mOut.dataSize() != mRefCommandsEnd) {
+        mRefCommandsStart = mOut.dataSize();
+    }
+
+    const int32_t cancelled = cmd == BC_ACQUIRE ? BC_RELEASE
+            : cmd == BC_INCREFS ? BC_DECREFS : 0;
+    // Look for the latest command on the handle, so that e.g. a release
+    // followed by a decrefs isn't reordered by an acquire.
+    for (size_t pos = mOut.dataSize(); cancelled && pos > mRefCommandsStart;) {
+        pos -= kCommandSize;
+        int32_t command[2];
+        memcpy(command, mOut.data() + pos, kCommandSize);
+        if (command[1] != handle) continue;
+        if (command[0] != cancelled) break;
+
+        LOG_REMOTEREFS("IPCThreadState: %s cancels pending %s on handle %d\n",
+                kCommandStrings[cmd & 0xff], kCommandStrings[cancelled & 0xff], handle);
+        const size_t end = mOut.dataSize();
+        for (size_t next = pos + kCommandSize; next < end; next += kCommandSize) {
+            memcpy(command, mOut.data() + next, kCommandSize);
+            mOut.setDataPosition(next - kCommandSize);
+            mOut.writeInt32(command[0]);
+            mOut.writeInt32(command[1]);
+        }
+        mOut.setDataSize(end - kCommandSize);
+        mOut.setDataPosition(end - kCommandSize);
+        mRefCommandsEnd = mOut.dataSize();
+        return false;
+    }
+
+    mOut.writeInt32(cmd);
+    mOut.writeInt32(handle);
+    mRefCommandsEnd = mOut.dataSize();
+    return true;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle, BpBinder *proxy)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
-    mOut.writeInt32(BC_ACQUIRE);
-    mOut.writeInt32(handle);
+    if (!writeRefCommand(BC_ACQUIRE, handle)) return;
     // Create a temp reference until the driver has handled this command.
     proxy->incStrong(mProcess.get());
     mPostWriteStrongDerefs.push(proxy);
@@ -664,15 +857,13 @@ void IPCThreadState::incStrongHandle(int32_t handle, BpBinder *proxy)
 void IPCThreadState::decStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::decStrongHandle(%d)\n", handle);
-    mOut.writeInt32(BC_RELEASE);
-    mOut.writeInt32(handle);
+    writeRefCommand(BC_RELEASE, handle);
 }
 
 void IPCThreadState::incWeakHandle(int32_t handle, BpBinder *proxy)
 {
     LOG_REMOTEREFS("IPCThreadState::incWeakHandle(%d)\n", handle);
-    mOut.writeInt32(BC_INCREFS);
-    mOut.writeInt32(handle);
+    if (!writeRefCommand(BC_INCREFS, handle)) return;
     // Create a temp reference until the driver has handled this command.
     proxy->getWeakRefs()->incWeak(mProcess.get());
     mPostWriteWeakDerefs.push(proxy->getWeakRefs());
@@ -681,8 +872,7 @@ void IPCThreadState::incWeakHandle(int32_t handle, BpBinder *proxy)
 void IPCThreadState::decWeakHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::decWeakHandle(%d)\n", handle);
-    mOut.writeInt32(BC_DECREFS);
-    mOut.writeInt32(handle);
+    writeRefCommand(BC_DECREFS, handle);
 }
 
 status_t IPCThreadState::attemptIncStrongHandle(int32_t handle)
@@ -735,10 +925,19 @@ status_t IPCThreadState::clearDeathNotification(int32_t handle, BpBinder* proxy)
 
 IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
+      mRefCommandsStart(0),
+      mRefCommandsEnd(0),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mNestedCpuTime(0),
+      mIsPooledThread(false),
+      mOnewayBatchDepth(0),
+      mOnewayBatchSize(0),
+      mOnewayBatchError(NO_ERROR),
+      mParcelDataPoolCount(0)
 {
     pthread_setspecific(gTLS, this);
+    gThreadState = this;
     clearCaller();
     mIn.setDataCapacity(256);
     mOut.setDataCapacity(256);
@@ -746,6 +945,52 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    // shutdown() still has us as the thread's state at this point, make sure
+    // nothing makes it back into the pool once it's gone.
+    mIn.freeData();
+    mOut.freeData();
+    for (size_t i = 0; i < mOnewayBatch.size(); i++) {
+        delete mOnewayBatch[i];
+    }
+    clearParcelDataPool();
+}
+
+uint8_t* IPCThreadState::takeParcelData(size_t desired, size_t* outCapacity)
+{
+    // Hand out the smallest buffer that is large enough
+    size_t best = mParcelDataPoolCount;
+    for (size_t i = 0; i < mParcelDataPoolCount; i++) {
+        if (mParcelDataPool[i].capacity >= desired && (best == mParcelDataPoolCount ||
+                mParcelDataPool[i].capacity < mParcelDataPool[best].capacity)) {
+            best = i;
+        }
+    }
+    if (best == mParcelDataPoolCount) {
+        return NULL;
+    }
+    uint8_t* data = mParcelDataPool[best].data;
+    *outCapacity = mParcelDataPool[best].capacity;
+    mParcelDataPool[best] = mParcelDataPool[--mParcelDataPoolCount];
+    return data;
+}
+
+bool IPCThreadState::recycleParcelData(uint8_t* data, size_t capacity)
+{
+    if (capacity > PARCEL_DATA_POOL_MAX_CAPACITY ||
+            mParcelDataPoolCount >= PARCEL_DATA_POOL_SIZE) {
+        return false;
+    }
+    mParcelDataPool[mParcelDataPoolCount].data = data;
+    mParcelDataPool[mParcelDataPoolCount].capacity = capacity;
+    mParcelDataPoolCount++;
+    return true;
+}
+
+void IPCThreadState::clearParcelDataPool()
+{
+    while (mParcelDataPoolCount > 0) {
+        free(mParcelDataPool[--mParcelDataPoolCount].data);
+    }
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
@@ -929,6 +1174,7 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
                 mOut.remove(0, bwr.write_consumed);
             else {
                 mOut.setDataSize(0);
+                mRefCommandsStart = mRefCommandsEnd = 0;
                 processPostWriteDerefs();
             }
         }
@@ -982,6 +1228,18 @@ status_t IPCThreadState::writeTransactionData(int32_t cmd, uint32_t binderFlags,
         return (mLastError = err);
     }
 
+    // External buffers are gathered by the driver, which needs to know how
+    // much room to make for them in the target process.
+    const size_t buffersSize = err == NO_ERROR ? data.ipcBuffersSize() : 0;
+    if (buffersSize > 0) {
+        binder_transaction_data_sg trsg;
+        trsg.transaction_data = tr;
+        trsg.buffers_size = buffersSize;
+        mOut.writeInt32(cmd == BC_REPLY ? BC_REPLY_SG : BC_TRANSACTION_SG);
+        mOut.write(&trsg, sizeof(trsg));
+        return NO_ERROR;
+    }
+
     mOut.writeInt32(cmd);
     mOut.write(&tr, sizeof(tr));
 
@@ -1113,6 +1371,10 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                     << ", offsets addr="
                     << reinterpret_cast<const size_t*>(tr.data.ptr.offsets) << endl;
             }
+            const nsecs_t startTime = TransactionStats::isEnabled() ? systemTime() : 0;
+            const nsecs_t startCpuTime = startTime != 0 ? systemTime(SYSTEM_TIME_THREAD) : 0;
+            const int64_t origNestedCpuTime = mNestedCpuTime;
+            mNestedCpuTime = 0;
             if (tr.target.ptr) {
                 // We only have a weak reference on the target object, so we must first try to
                 // safely acquire a strong reference before doing anything else with it.
@@ -1128,6 +1390,19 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
             } else {
                 error = the_context_object->transact(tr.code, buffer, &reply, tr.flags);
             }
+            if (startTime != 0) {
+                TransactionStats::self().record(TransactionStats::SERVER, buffer, tr.code,
+                        systemTime() - startTime);
+                // Charge the caller for the CPU this thread spent on its behalf, but not for
+                // the transactions of other callers that came in while it was waiting on a
+                // reply of its own.
+                const nsecs_t cpuTime = systemTime(SYSTEM_TIME_THREAD) - startCpuTime;
+                TransactionStats::self().recordCallerCpu(mCallingUid,
+                        cpuTime - mNestedCpuTime);
+                mNestedCpuTime = origNestedCpuTime + cpuTime;
+            } else {
+                mNestedCpuTime = origNestedCpuTime;
+            }
 
             //ALOGI("<<<< TRANSACT from pid %d restore pid %d uid %d\n",
             //     mCallingPid, origPid, origUid);
@@ -1196,12 +1471,16 @@ void IPCThreadState::threadDestructor(void *st)
 {
         IPCThreadState* const self = static_cast<IPCThreadState*>(st);
         if (self) {
+                // pthread has already cleared gTLS, but self() keeps finding
+                // this state through the cache until it is deleted, rather
+                // than creating another one for the flush.
                 self->flushCommands();
 #if defined(__ANDROID__)
         if (self->mProcess->mDriverFD > 0) {
             ioctl(self->mProcess->mDriverFD, BINDER_THREAD_EXIT, 0);
         }
 #endif
+                if (gThreadState == self) gThreadState = nullptr;
                 delete self;
         }
 }
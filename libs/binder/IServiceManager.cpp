@@ -25,6 +25,9 @@
 #endif
 #include <binder/Parcel.h>
 #include <cutils/properties.h>
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
 #include <utils/CallStack.h>
@@ -33,8 +36,187 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+
 namespace android {
 
+// Must match SVC_MGR_NOTIFY_SERVICE in cmds/servicemanager/binder.h
+static const uint32_t NOTIFY_SERVICE_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION;
+
+// Services retrieved through defaultServiceManager(), see
+// setServiceCacheEnabled()
+class ServiceCache : public IBinder::DeathRecipient
+{
+public:
+    sp<IBinder> get(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t i = mServices.indexOfKey(name);
+        return i >= 0 ? mServices.valueAt(i) : NULL;
+    }
+
+    void put(const String16& name, const sp<IBinder>& service)
+    {
+        // Services in this process cannot die without us knowing, and one
+        // that died already is not worth keeping.
+        if (service->remoteBinder() != NULL && service->linkToDeath(this) != NO_ERROR) {
+            return;
+        }
+        bool added = false;
+        {
+            AutoMutex _l(mLock);
+            if (mServices.indexOfKey(name) < 0) {
+                mServices.add(name, service);
+                added = true;
+            }
+        }
+        if (!added) {
+            // lost a race with another thread, whose copy is kept
+            unlink(service);
+        }
+    }
+
+    void remove(const String16& name)
+    {
+        sp<IBinder> service;
+        {
+            AutoMutex _l(mLock);
+            ssize_t i = mServices.indexOfKey(name);
+            if (i < 0) return;
+            service = mServices.valueAt(i);
+            mServices.removeItemsAt(i);
+        }
+        unlink(service);
+    }
+
+    void clear()
+    {
+        KeyedVector<String16, sp<IBinder> > services;
+        {
+            AutoMutex _l(mLock);
+            services = mServices;
+            mServices.clear();
+        }
+        for (size_t i = 0; i < services.size(); i++) {
+            unlink(services.valueAt(i));
+        }
+    }
+
+    virtual void binderDied(const wp<IBinder>& who)
+    {
+        AutoMutex _l(mLock);
+        for (size_t i = mServices.size(); i > 0; i--) {
+            if (mServices.valueAt(i - 1).get() == who.unsafe_get()) {
+                mServices.removeItemsAt(i - 1);
+            }
+        }
+    }
+
+private:
+    void unlink(const sp<IBinder>& service)
+    {
+        if (service->remoteBinder() != NULL) {
+            service->unlinkToDeath(this);
+        }
+    }
+
+    Mutex mLock;
+    KeyedVector<String16, sp<IBinder> > mServices;
+};
+
+static std::atomic<bool> gServiceCacheEnabled(false);
+static Mutex gServiceCacheLock;
+static sp<ServiceCache> gServiceCache;
+
+static sp<ServiceCache> serviceCache()
+{
+    if (!gServiceCacheEnabled.load(std::memory_order_relaxed)) return NULL;
+    AutoMutex _l(gServiceCacheLock);
+    return gServiceCache;
+}
+
+void setServiceCacheEnabled(bool enabled)
+{
+    sp<ServiceCache> cache;
+    {
+        AutoMutex _l(gServiceCacheLock);
+        if (enabled) {
+            if (gServiceCache == NULL) gServiceCache = new ServiceCache;
+        } else {
+            cache = gServiceCache;
+            gServiceCache = NULL;
+        }
+        gServiceCacheEnabled.store(enabled, std::memory_order_relaxed);
+    }
+    if (cache != NULL) cache->clear();
+}
+
+// How long to wait before checking again for a service that did not show up
+static nsecs_t servicePollInterval()
+{
+    if (!gSystemBootCompleted) {
+        char bootCompleted[PROPERTY_VALUE_MAX];
+        property_get("sys.boot_completed", bootCompleted, "0");
+        gSystemBootCompleted = strcmp(bootCompleted, "1") == 0 ? true : false;
+    }
+    return ms2ns(gSystemBootCompleted ? 1000 : 100);
+}
+
+// Receives the service waitForService() is waiting for from the service
+// manager, as soon as it is added.
+class ServiceNotification : public BBinder
+{
+public:
+    explicit ServiceNotification(const String16& name) : mName(name) {}
+
+    sp<IBinder> wait(nsecs_t timeout)
+    {
+        AutoMutex _l(mLock);
+        if (mService == NULL) {
+            mCondition.waitRelative(mLock, timeout);
+        }
+        return mService;
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                                uint32_t flags)
+    {
+        if (code != NOTIFY_SERVICE_TRANSACTION) {
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+        const String16 name = data.readString16();
+        const sp<IBinder> service = data.readStrongBinder();
+        if (name != mName || service == NULL) {
+            return BAD_VALUE;
+        }
+        AutoMutex _l(mLock);
+        mService = service;
+        mCondition.broadcast();
+        return NO_ERROR;
+    }
+
+private:
+    const String16 mName;
+    Mutex mLock;
+    Condition mCondition;
+    sp<IBinder> mService;
+};
+
+sp<IBinder> IServiceManager::waitForService(const String16& name, nsecs_t timeout) const
+{
+    const nsecs_t deadline = systemTime() + timeout;
+    for (;;) {
+        sp<IBinder> svc = checkService(name);
+        if (svc != NULL) return svc;
+
+        const nsecs_t remaining = deadline - systemTime();
+        if (remaining <= 0) return NULL;
+        usleep(ns2us(std::min(remaining, servicePollInterval())));
+    }
+}
+
 sp<IServiceManager> defaultServiceManager()
 {
     if (gDefaultServiceManager != NULL) return gDefaultServiceManager;
@@ -148,40 +330,68 @@ public:
 
         const bool isVendorService =
             strcmp(ProcessState::self()->getDriverName().c_str(), "/dev/vndbinder") == 0;
-        const long timeout = uptimeMillis() + 5000;
-        if (!gSystemBootCompleted) {
-            char bootCompleted[PROPERTY_VALUE_MAX];
-            property_get("sys.boot_completed", bootCompleted, "0");
-            gSystemBootCompleted = strcmp(bootCompleted, "1") == 0 ? true : false;
+        if (isVendorService) {
+            ALOGI("Waiting for vendor service %s...", String8(name).string());
+            CallStack stack(LOG_TAG);
+        } else {
+            ALOGI("Waiting for service %s...", String8(name).string());
         }
-        // retry interval in millisecond.
-        const long sleepTime = gSystemBootCompleted ? 1000 : 100;
-
-        int n = 0;
-        while (uptimeMillis() < timeout) {
-            n++;
-            if (isVendorService) {
-                ALOGI("Waiting for vendor service %s...", String8(name).string());
-                CallStack stack(LOG_TAG);
-            } else if (n%10 == 0) {
-                ALOGI("Waiting for service %s...", String8(name).string());
-            }
-            usleep(1000*sleepTime);
 
-            sp<IBinder> svc = checkService(name);
-            if (svc != NULL) return svc;
-        }
+        svc = waitForService(name, ms2ns(5000));
+        if (svc != NULL) return svc;
         ALOGW("Service %s didn't start. Returning NULL", String8(name).string());
         return NULL;
     }
 
     virtual sp<IBinder> checkService( const String16& name) const
     {
+        const sp<ServiceCache> cache = serviceCache();
+        if (cache != NULL) {
+            sp<IBinder> svc = cache->get(name);
+            if (svc != NULL) return svc;
+        }
+
         Parcel data, reply;
         data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
         data.writeString16(name);
         remote()->transact(CHECK_SERVICE_TRANSACTION, data, &reply);
-        return reply.readStrongBinder();
+        sp<IBinder> svc = reply.readStrongBinder();
+        if (svc != NULL && cache != NULL) cache->put(name, svc);
+        return svc;
+    }
+
+    virtual sp<IBinder> waitForService(const String16& name, nsecs_t timeout) const
+    {
+        sp<IBinder> svc = checkService(name);
+        if (svc != NULL) return svc;
+
+        sp<ServiceNotification> notification = new ServiceNotification(name);
+        Parcel data, reply;
+        data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+        data.writeString16(name);
+        data.writeStrongBinder(notification);
+        if (remote()->transact(REGISTER_FOR_NOTIFICATIONS_TRANSACTION, data, &reply) != NO_ERROR) {
+            // a service manager that does not know about notifications
+            return IServiceManager::waitForService(name, timeout);
+        }
+
+        // Checking again covers the service being added before the
+        // registration, and polling a notification that may never arrive
+        // without a thread pool.
+        const nsecs_t deadline = systemTime() + timeout;
+        for (;;) {
+            svc = checkService(name);
+            if (svc != NULL) return svc;
+
+            const nsecs_t remaining = deadline - systemTime();
+            if (remaining <= 0) return NULL;
+            svc = notification->wait(std::min(remaining, servicePollInterval()));
+            if (svc != NULL) {
+                const sp<ServiceCache> cache = serviceCache();
+                if (cache != NULL) cache->put(name, svc);
+                return svc;
+            }
+        }
     }
 
     virtual status_t addService(const String16& name, const sp<IBinder>& service,
@@ -192,6 +402,8 @@ public:
         data.writeStrongBinder(service);
         data.writeInt32(allowIsolated ? 1 : 0);
         data.writeInt32(dumpsysPriority);
+        const sp<ServiceCache> cache = serviceCache();
+        if (cache != NULL) cache->remove(name);
         status_t err = remote()->transact(ADD_SERVICE_TRANSACTION, data, &reply);
         return err == NO_ERROR ? reply.readExceptionCode() : err;
     }
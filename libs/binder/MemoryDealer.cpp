@@ -25,6 +25,10 @@
 #include <utils/String8.h>
 #include <utils/threads.h>
 
+#include <atomic>
+#include <memory>
+
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -120,20 +124,45 @@ private:
 
 // ----------------------------------------------------------------------------
 
-class SimpleBestFitAllocator
+class MemoryAllocator
+{
+public:
+    virtual ~MemoryAllocator() { }
+
+    // returns the offset of the allocation, or NO_MEMORY
+    virtual ssize_t     allocate(size_t size) = 0;
+    virtual status_t    deallocate(size_t offset) = 0;
+    virtual void        dump(String8& res, const char* what) const = 0;
+
+    void dump(const char* what) const;
+};
+
+// ----------------------------------------------------------------------------
+
+class SimpleBestFitAllocator : public MemoryAllocator
 {
+public:
     enum {
         PAGE_ALIGNED = 0x00000001
     };
-public:
+
+    struct stats_t {
+        size_t allocatedSize;
+        size_t freeSize;
+        size_t freeChunks;
+        size_t largestFreeChunk;
+    };
+
     explicit SimpleBestFitAllocator(size_t size);
-    ~SimpleBestFitAllocator();
+    virtual ~SimpleBestFitAllocator();
 
-    size_t      allocate(size_t size, uint32_t flags = 0);
-    status_t    deallocate(size_t offset);
+    virtual ssize_t allocate(size_t size) { return allocate(size, 0); }
+    ssize_t     allocate(size_t size, uint32_t flags);
+    virtual status_t deallocate(size_t offset);
     size_t      size() const;
-    void        dump(const char* what) const;
-    void        dump(String8& res, const char* what) const;
+    stats_t     getStats() const;
+    using MemoryAllocator::dump;
+    virtual void dump(String8& res, const char* what) const;
 
     static size_t getAllocationAlignment() { return kMemoryAlign; }
 
@@ -152,6 +181,7 @@ private:
 
     ssize_t  alloc(size_t size, uint32_t flags);
     chunk_t* dealloc(size_t start);
+    stats_t  getStats_l() const;
     void     dump_l(const char* what) const;
     void     dump_l(String8& res, const char* what) const;
 
@@ -163,6 +193,72 @@ private:
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Allocations of up to half a page are rounded up to a power of two and taken
+ * from the free list of their size class. A size class that runs out of
+ * blocks takes a page from a SimpleBestFitAllocator covering the whole heap,
+ * and larger allocations are whole pages taken from it directly.
+ *
+ * The free lists are lock-free stacks. Their links live in arrays on the side,
+ * one per page, because the heap may not be mapped, or writable, here; and
+ * their heads carry a counter, bumped on every update, against ABA races.
+ */
+class SizeClassAllocator : public MemoryAllocator
+{
+public:
+    explicit SizeClassAllocator(size_t size);
+    virtual ~SizeClassAllocator();
+
+    virtual ssize_t     allocate(size_t size);
+    virtual status_t    deallocate(size_t offset);
+    virtual void        dump(String8& res, const char* what) const;
+
+private:
+    enum {
+        // pages that aren't in use, or hold a large allocation
+        FREE_PAGE = -1,
+        LARGE_PAGE = -2,
+    };
+
+    static const int kMinClassShift = 5; // kMemoryAlign
+    static const int kMaxClasses = 16;
+
+    struct page_t {
+        page_t() : sizeClass(FREE_PAGE), size(0) { }
+        // the size class of the page, or FREE_PAGE or LARGE_PAGE
+        std::atomic<int> sizeClass;
+        // the size of the large allocation starting on the page
+        size_t size;
+        // for each block of the page, the block after it in the free list
+        std::unique_ptr<std::atomic<uint32_t>[]> next;
+    };
+
+    struct size_class_t {
+        size_class_t() : head(0), pages(0), blocksInUse(0) { }
+        // the first free block, as offset/kMemoryAlign + 1 or 0 if there is
+        // none, in the low 32 bits, and the update count in the high 32 bits
+        std::atomic<uint64_t> head;
+        std::atomic<size_t> pages;
+        std::atomic<size_t> blocksInUse;
+    };
+
+    std::atomic<uint32_t>& link(uint32_t block, int sizeClass) const;
+    ssize_t pop(int sizeClass);
+    void    push(int sizeClass, uint32_t first, uint32_t last);
+    ssize_t refill(int sizeClass);
+
+    const size_t            mPageSize;
+    const int               mPageShift;
+    int                     mNumClasses;
+    SimpleBestFitAllocator  mPageAllocator;
+    std::unique_ptr<page_t[]> mPages;
+    size_class_t            mClasses[kMaxClasses];
+    std::atomic<size_t>     mLargeAllocations;
+    std::atomic<size_t>     mLargeSize;
+};
+
+// ----------------------------------------------------------------------------
+
 Allocation::Allocation(
         const sp<MemoryDealer>& dealer,
         const sp<IMemoryHeap>& heap, ssize_t offset, size_t size)
@@ -233,6 +329,17 @@ MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags)
 {    
 }
 
+MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags,
+        allocator_t allocator)
+    : mHeap(new MemoryHeapBase(size, flags, name))
+{
+    if (allocator == SIZE_CLASSES) {
+        mAllocator = new SizeClassAllocator(size);
+    } else {
+        mAllocator = new SimpleBestFitAllocator(size);
+    }
+}
+
 MemoryDealer::~MemoryDealer()
 {
     delete mAllocator;
@@ -262,7 +369,7 @@ const sp<IMemoryHeap>& MemoryDealer::heap() const {
     return mHeap;
 }
 
-SimpleBestFitAllocator* MemoryDealer::allocator() const {
+MemoryAllocator* MemoryDealer::allocator() const {
     return mAllocator;
 }
 
@@ -274,6 +381,15 @@ size_t MemoryDealer::getAllocationAlignment()
 
 // ----------------------------------------------------------------------------
 
+void MemoryAllocator::dump(const char* what) const
+{
+    String8 result;
+    dump(result, what);
+    ALOGD("%s", result.string());
+}
+
+// ----------------------------------------------------------------------------
+
 // align all the memory blocks on a cache-line boundary
 const int SimpleBestFitAllocator::kMemoryAlign = 32;
 
@@ -306,7 +422,7 @@ size_t SimpleBestFitAllocator::size() const
     return mHeapSize;
 }
 
-size_t SimpleBestFitAllocator::allocate(size_t size, uint32_t flags)
+ssize_t SimpleBestFitAllocator::allocate(size_t size, uint32_t flags)
 {
     Mutex::Autolock _l(mLock);
     ssize_t offset = alloc(size, flags);
@@ -421,10 +537,27 @@ SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
     return 0;
 }
 
-void SimpleBestFitAllocator::dump(const char* what) const
+SimpleBestFitAllocator::stats_t SimpleBestFitAllocator::getStats() const
 {
     Mutex::Autolock _l(mLock);
-    dump_l(what);
+    return getStats_l();
+}
+
+SimpleBestFitAllocator::stats_t SimpleBestFitAllocator::getStats_l() const
+{
+    stats_t stats = {};
+    for (chunk_t const* cur = mList.head(); cur; cur = cur->next) {
+        const size_t size = cur->size * kMemoryAlign;
+        if (cur->free) {
+            stats.freeSize += size;
+            stats.freeChunks++;
+            if (size > stats.largestFreeChunk)
+                stats.largestFreeChunk = size;
+        } else {
+            stats.allocatedSize += size;
+        }
+    }
+    return stats;
 }
 
 void SimpleBestFitAllocator::dump_l(const char* what) const
@@ -478,6 +611,203 @@ void SimpleBestFitAllocator::dump_l(String8& result,
     snprintf(buffer, SIZE,
             "  size allocated: %u (%u KB)\n", int(size), int(size/1024));
     result.append(buffer);
+
+    // the free memory that isn't in the largest free chunk can only serve
+    // smaller allocations
+    const stats_t stats = getStats_l();
+    snprintf(buffer, SIZE,
+            "  size free: %u KB in %u chunks, largest %u KB, fragmentation %u%%\n",
+            unsigned(stats.freeSize/1024), unsigned(stats.freeChunks),
+            unsigned(stats.largestFreeChunk/1024),
+            stats.freeSize ? unsigned(100 - stats.largestFreeChunk * 100 / stats.freeSize) : 0);
+    result.append(buffer);
+}
+
+// ----------------------------------------------------------------------------
+
+SizeClassAllocator::SizeClassAllocator(size_t size)
+    : mPageSize(getpagesize()),
+      mPageShift(__builtin_ctz(mPageSize)),
+      mNumClasses(0),
+      mPageAllocator(size),
+      mPages(new page_t[mPageAllocator.size() >> mPageShift]),
+      mLargeAllocations(0),
+      mLargeSize(0)
+{
+    // size classes from kMemoryAlign to half a page, the largest size that
+    // fits at least two blocks in a page
+    while (mNumClasses < kMaxClasses &&
+            (size_t(1) << (kMinClassShift + mNumClasses)) <= mPageSize / 2) {
+        mNumClasses++;
+    }
+    LOG_ALWAYS_FATAL_IF(mPageAllocator.size() / SimpleBestFitAllocator::getAllocationAlignment()
+            >= UINT32_MAX, "heap of %zu bytes is too large", mPageAllocator.size());
+}
+
+SizeClassAllocator::~SizeClassAllocator()
+{
+}
+
+std::atomic<uint32_t>& SizeClassAllocator::link(uint32_t block, int sizeClass) const
+{
+    const size_t offset = size_t(block) << kMinClassShift;
+    const page_t& page = mPages[offset >> mPageShift];
+    return page.next[(offset & (mPageSize - 1)) >> (kMinClassShift + sizeClass)];
+}
+
+ssize_t SizeClassAllocator::pop(int sizeClass)
+{
+    size_class_t& c = mClasses[sizeClass];
+    uint64_t head = c.head.load(std::memory_order_acquire);
+    while (uint32_t(head)) {
+        const uint32_t block = uint32_t(head) - 1;
+        // if another thread pops this block first, the link may be stale, but
+        // then the count in the head changed and the exchange fails
+        const uint32_t next = link(block, sizeClass).load(std::memory_order_relaxed);
+        const uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+        if (c.head.compare_exchange_weak(head, newHead,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+            return ssize_t(block) << kMinClassShift;
+        }
+    }
+    return NO_MEMORY;
+}
+
+void SizeClassAllocator::push(int sizeClass, uint32_t first, uint32_t last)
+{
+    size_class_t& c = mClasses[sizeClass];
+    std::atomic<uint32_t>& lastLink = link(last, sizeClass);
+    uint64_t head = c.head.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do {
+        lastLink.store(uint32_t(head), std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | (first + 1);
+    } while (!c.head.compare_exchange_weak(head, newHead,
+            std::memory_order_release, std::memory_order_relaxed));
+}
+
+ssize_t SizeClassAllocator::refill(int sizeClass)
+{
+    const ssize_t offset = mPageAllocator.allocate(mPageSize,
+            SimpleBestFitAllocator::PAGE_ALIGNED);
+    if (offset < 0) {
+        return NO_MEMORY;
+    }
+
+    // keep the first block, and push the others in one go
+    const size_t blockShift = kMinClassShift + sizeClass;
+    const size_t blocks = mPageSize >> blockShift;
+    page_t& page = mPages[offset >> mPageShift];
+    if (!page.next) {
+        page.next.reset(new std::atomic<uint32_t>[mPageSize >> kMinClassShift]);
+    }
+    const uint32_t first = uint32_t(offset >> kMinClassShift);
+    const uint32_t step = uint32_t(1) << sizeClass;
+    for (size_t i = 1; i + 1 < blocks; i++) {
+        page.next[i].store(first + (i + 1) * step + 1, std::memory_order_relaxed);
+    }
+    page.sizeClass.store(sizeClass, std::memory_order_relaxed);
+    mClasses[sizeClass].pages++;
+    push(sizeClass, first + step, first + (blocks - 1) * step);
+    return offset;
+}
+
+ssize_t SizeClassAllocator::allocate(size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    if (size > mPageSize / 2) {
+        size = (size + mPageSize - 1) & ~(mPageSize - 1);
+        const ssize_t offset = mPageAllocator.allocate(size,
+                SimpleBestFitAllocator::PAGE_ALIGNED);
+        if (offset >= 0) {
+            page_t& page = mPages[offset >> mPageShift];
+            page.size = size;
+            page.sizeClass.store(LARGE_PAGE, std::memory_order_relaxed);
+            mLargeAllocations++;
+            mLargeSize += size;
+        }
+        return offset;
+    }
+
+    int sizeClass = 0;
+    while ((size_t(1) << (kMinClassShift + sizeClass)) < size) {
+        sizeClass++;
+    }
+    ssize_t offset = pop(sizeClass);
+    if (offset < 0) {
+        offset = refill(sizeClass);
+    }
+    if (offset >= 0) {
+        mClasses[sizeClass].blocksInUse++;
+    }
+    return offset;
+}
+
+status_t SizeClassAllocator::deallocate(size_t offset)
+{
+    if (offset >= mPageAllocator.size()) {
+        return NAME_NOT_FOUND;
+    }
+    page_t& page = mPages[offset >> mPageShift];
+    const int sizeClass = page.sizeClass.load(std::memory_order_relaxed);
+    if (sizeClass == LARGE_PAGE) {
+        if (offset & (mPageSize - 1)) {
+            return NAME_NOT_FOUND;
+        }
+        mLargeAllocations--;
+        mLargeSize -= page.size;
+        page.sizeClass.store(FREE_PAGE, std::memory_order_relaxed);
+        return mPageAllocator.deallocate(offset);
+    }
+    if (sizeClass == FREE_PAGE ||
+            (offset & ((size_t(1) << (kMinClassShift + sizeClass)) - 1))) {
+        return NAME_NOT_FOUND;
+    }
+    // freeing a block twice corrupts its free list; don't
+    const uint32_t block = uint32_t(offset >> kMinClassShift);
+    mClasses[sizeClass].blocksInUse--;
+    push(sizeClass, block, block);
+    return NO_ERROR;
+}
+
+void SizeClassAllocator::dump(String8& result, const char* what) const
+{
+    result.appendFormat("  %s (%p, size=%u, size classes)\n",
+            what, this, unsigned(mPageAllocator.size()));
+
+    size_t classesSize = 0;
+    size_t classesFree = 0;
+    for (int i = 0; i < mNumClasses; i++) {
+        const size_class_t& c = mClasses[i];
+        const size_t pages = c.pages.load(std::memory_order_relaxed);
+        if (!pages) {
+            continue;
+        }
+        const size_t blockSize = size_t(1) << (kMinClassShift + i);
+        const size_t blocks = (pages * mPageSize) / blockSize;
+        const size_t inUse = c.blocksInUse.load(std::memory_order_relaxed);
+        classesSize += pages * mPageSize;
+        classesFree += (blocks - inUse) * blockSize;
+        result.appendFormat("  class %5zu: %zu pages, %zu/%zu blocks in use, %zu KB free\n",
+                blockSize, pages, inUse, blocks, (blocks - inUse) * blockSize / 1024);
+    }
+    result.appendFormat("  large: %zu allocations, %zu KB\n",
+            mLargeAllocations.load(std::memory_order_relaxed),
+            mLargeSize.load(std::memory_order_relaxed) / 1024);
+
+    // the free blocks of the size classes only serve their class, and the
+    // free pages outside the largest run only serve smaller allocations
+    const SimpleBestFitAllocator::stats_t pages = mPageAllocator.getStats();
+    result.appendFormat("  size classes: %zu KB, %zu KB free (%zu%%)\n",
+            classesSize / 1024, classesFree / 1024,
+            classesSize ? classesFree * 100 / classesSize : 0);
+    result.appendFormat("  free pages: %zu KB in %zu runs, largest %zu KB, "
+            "fragmentation %zu%%\n",
+            pages.freeSize / 1024, pages.freeChunks, pages.largestFreeChunk / 1024,
+            pages.freeSize ? 100 - pages.largestFreeChunk * 100 / pages.freeSize : 0);
 }
 
 
@@ -30,6 +30,10 @@
 #include <sys/resource.h>
 #include <unistd.h>
 
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include <binder/Binder.h>
 #include <binder/BpBinder.h>
 #include <binder/IPCThreadState.h>
@@ -89,6 +93,8 @@ namespace android {
 static pthread_mutex_t gParcelGlobalAllocSizeLock = PTHREAD_MUTEX_INITIALIZER;
 static size_t gParcelGlobalAllocSize = 0;
 static size_t gParcelGlobalAllocCount = 0;
+static size_t gParcelGlobalPoolHitCount = 0;
+static size_t gParcelGlobalPoolMissCount = 0;
 
 static size_t gMaxFds = 0;
 
@@ -101,6 +107,23 @@ enum {
     BLOB_ASHMEM_MUTABLE = 2,
 };
 
+// Maximum size of an external buffer to copy in-place.
+static const size_t EXTERNAL_BUFFER_INPLACE_LIMIT = 16 * 1024;
+
+enum {
+    EXTERNAL_BUFFER_INPLACE = 0,
+    EXTERNAL_BUFFER_PTR = 1,
+};
+
+// Buffer objects are larger than the other objects
+static size_t object_size(const uint8_t* data, binder_size_t offset)
+{
+    const binder_object_header* hdr
+            = reinterpret_cast<const binder_object_header*>(data + offset);
+    return hdr->type == BINDER_TYPE_PTR
+            ? sizeof(binder_buffer_object) : sizeof(flat_binder_object);
+}
+
 void acquire_object(const sp<ProcessState>& proc,
     const flat_binder_object& obj, const void* who, size_t* outAshmemSize)
 {
@@ -138,6 +161,9 @@ void acquire_object(const sp<ProcessState>& proc,
             }
             return;
         }
+        case BINDER_TYPE_PTR:
+            // the buffer belongs to the caller
+            return;
     }
 
     ALOGD("Invalid object type 0x%08x", obj.hdr.type);
@@ -189,6 +215,8 @@ static void release_object(const sp<ProcessState>& proc,
             }
             return;
         }
+        case BINDER_TYPE_PTR:
+            return;
     }
 
     ALOGE("Invalid object type 0x%08x", obj.hdr.type);
@@ -377,6 +405,20 @@ size_t Parcel::getGlobalAllocCount() {
     return count;
 }
 
+size_t Parcel::getGlobalPoolHitCount() {
+    pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+    size_t count = gParcelGlobalPoolHitCount;
+    pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+    return count;
+}
+
+size_t Parcel::getGlobalPoolMissCount() {
+    pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+    size_t count = gParcelGlobalPoolMissCount;
+    pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+    return count;
+}
+
 const uint8_t* Parcel::data() const
 {
     return mData;
@@ -495,7 +537,11 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
     // Count objects in range
     for (int i = 0; i < (int) size; i++) {
         size_t off = objects[i];
-        if ((off >= offset) && (off + sizeof(flat_binder_object) <= offset + len)) {
+        if ((off >= offset) && (off + object_size(data, off) <= offset + len)) {
+            if (object_size(data, off) != sizeof(flat_binder_object)) {
+                // external buffers may not outlive the source parcel
+                return INVALID_OPERATION;
+            }
             if (firstIndex == -1) {
                 firstIndex = i;
             }
@@ -763,11 +809,78 @@ restart_write:
     return NULL;
 }
 
+namespace {
+
+// Most strings sent as UTF-16 are ASCII (package names, permissions, intent
+// actions), so the conversions below handle the leading ASCII run of a string
+// directly and leave only the rest to the generic UTF-8/UTF-16 converters.
+
+// Returns the length of the leading run of ASCII characters of |str|.
+size_t asciiPrefixLength(const uint8_t* str, size_t len) {
+    size_t i = 0;
+#if defined(__aarch64__)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(str + i)) >= 0x80) break;
+    }
+#endif
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t chars;
+        memcpy(&chars, str + i, sizeof(chars));
+        if (chars & 0x8080808080808080ULL) break;
+    }
+    while (i < len && str[i] < 0x80) i++;
+    return i;
+}
+
+// Widens the |len| ASCII characters of |src| to UTF-16.
+void widenAscii(const uint8_t* src, size_t len, char16_t* dst) {
+    size_t i = 0;
+#if defined(__aarch64__)
+    uint16_t* out = reinterpret_cast<uint16_t*>(dst);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chars = vld1q_u8(src + i);
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(chars)));
+        vst1q_u16(out + i + 8, vmovl_high_u8(chars));
+    }
+#endif
+    for (; i < len; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// Narrows the leading ASCII characters of |src| into |dst|, stopping at the
+// first other one. Returns the number of characters narrowed.
+size_t narrowAscii(const char16_t* src, size_t len, char* dst) {
+    size_t i = 0;
+#if defined(__aarch64__)
+    const uint16_t* in = reinterpret_cast<const uint16_t*>(src);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t chars = vld1q_u16(in + i);
+        if (vmaxvq_u16(chars) >= 0x80) break;
+        vst1_u8(reinterpret_cast<uint8_t*>(dst) + i, vmovn_u16(chars));
+    }
+#endif
+    for (; i < len && src[i] < 0x80; i++) {
+        dst[i] = static_cast<char>(src[i]);
+    }
+    return i;
+}
+
+} // namespace
+
 status_t Parcel::writeUtf8AsUtf16(const std::string& str) {
     const uint8_t* strData = (uint8_t*)str.data();
     const size_t strLen= str.length();
-    const ssize_t utf16Len = utf8_to_utf16_length(strData, strLen);
-    if (utf16Len < 0 || utf16Len > std::numeric_limits<int32_t>::max()) {
+    const size_t asciiLen = asciiPrefixLength(strData, strLen);
+    ssize_t utf16Len = asciiLen;
+    if (asciiLen < strLen) {
+        const ssize_t restLen = utf8_to_utf16_length(strData + asciiLen, strLen - asciiLen);
+        if (restLen < 0) {
+            return BAD_VALUE;
+        }
+        utf16Len += restLen;
+    }
+    if (utf16Len > std::numeric_limits<int32_t>::max()) {
         return BAD_VALUE;
     }
 
@@ -782,7 +895,14 @@ status_t Parcel::writeUtf8AsUtf16(const std::string& str) {
         return NO_MEMORY;
     }
 
-    utf8_to_utf16(strData, strLen, (char16_t*)dst, (size_t) utf16Len + 1);
+    char16_t* utf16 = (char16_t*)dst;
+    widenAscii(strData, asciiLen, utf16);
+    if (asciiLen < strLen) {
+        utf8_to_utf16(strData + asciiLen, strLen - asciiLen, utf16 + asciiLen,
+                      (size_t) utf16Len - asciiLen + 1);
+    } else {
+        utf16[utf16Len] = 0;
+    }
 
     return NO_ERROR;
 }
@@ -1086,20 +1206,99 @@ status_t Parcel::writeStrongBinder(const sp<IBinder>& val)
 
 status_t Parcel::writeStrongBinderVector(const std::vector<sp<IBinder>>& val)
 {
+    status_t err = reserveObjects(val.size(),
+            sizeof(int32_t) + val.size() * sizeof(flat_binder_object));
+    if (err != NO_ERROR) return err;
     return writeTypedVector(val, &Parcel::writeStrongBinder);
 }
 
 status_t Parcel::writeStrongBinderVector(const std::unique_ptr<std::vector<sp<IBinder>>>& val)
 {
+    if (val) {
+        status_t err = reserveObjects(val->size(),
+                sizeof(int32_t) + val->size() * sizeof(flat_binder_object));
+        if (err != NO_ERROR) return err;
+    }
     return writeNullableTypedVector(val, &Parcel::writeStrongBinder);
 }
 
+// Reads the binders of a vector written by writeStrongBinderVector(), looking
+// up the proxies of all the remote ones at once.
+status_t Parcel::readStrongBinders(std::vector<sp<IBinder>>* val, bool nullable) const
+{
+    int32_t size;
+    status_t status = readInt32(&size);
+    if (status != OK) {
+        return status;
+    }
+    if (size < 0) {
+        return UNEXPECTED_NULL;
+    }
+    // each binder takes a whole object, don't let a bogus size allocate more
+    if (static_cast<size_t>(size) > dataAvail() / sizeof(flat_binder_object)) {
+        return BAD_TYPE;
+    }
+
+    val->clear();
+    val->resize(static_cast<size_t>(size));
+    std::vector<int32_t> handles;
+    std::vector<size_t> handleIndices;
+    for (size_t i = 0; i < val->size(); i++) {
+        const flat_binder_object* flat = readObject(false);
+        if (flat == NULL) {
+            return BAD_TYPE;
+        }
+        switch (flat->hdr.type) {
+            case BINDER_TYPE_BINDER:
+                (*val)[i] = reinterpret_cast<IBinder*>(flat->cookie);
+                if (!nullable && (*val)[i] == NULL) {
+                    return UNEXPECTED_NULL;
+                }
+                break;
+            case BINDER_TYPE_HANDLE:
+                handles.push_back(flat->handle);
+                handleIndices.push_back(i);
+                break;
+            default:
+                return BAD_TYPE;
+        }
+    }
+
+    std::vector<sp<IBinder>> proxies;
+    ProcessState::self()->getStrongProxiesForHandles(handles, &proxies);
+    for (size_t i = 0; i < proxies.size(); i++) {
+        if (!nullable && proxies[i] == NULL) {
+            return UNEXPECTED_NULL;
+        }
+        (*val)[handleIndices[i]] = proxies[i];
+    }
+    return OK;
+}
+
 status_t Parcel::readStrongBinderVector(std::unique_ptr<std::vector<sp<IBinder>>>* val) const {
-    return readNullableTypedVector(val, &Parcel::readNullableStrongBinder);
+    const size_t start = dataPosition();
+    int32_t size;
+    status_t status = readInt32(&size);
+    val->reset();
+
+    if (status != OK || size < 0) {
+        return status;
+    }
+
+    setDataPosition(start);
+    val->reset(new std::vector<sp<IBinder>>());
+
+    status = readStrongBinders(val->get(), true);
+
+    if (status != OK) {
+        val->reset();
+    }
+
+    return status;
 }
 
 status_t Parcel::readStrongBinderVector(std::vector<sp<IBinder>>* val) const {
-    return readTypedVector(val, &Parcel::readStrongBinder);
+    return readStrongBinders(val, false);
 }
 
 status_t Parcel::writeWeakBinder(const wp<IBinder>& val)
@@ -1185,10 +1384,18 @@ status_t Parcel::writeUniqueFileDescriptor(const base::unique_fd& fd) {
 }
 
 status_t Parcel::writeUniqueFileDescriptorVector(const std::vector<base::unique_fd>& val) {
+    status_t err = reserveObjects(val.size(),
+            sizeof(int32_t) + val.size() * sizeof(flat_binder_object));
+    if (err != NO_ERROR) return err;
     return writeTypedVector(val, &Parcel::writeUniqueFileDescriptor);
 }
 
 status_t Parcel::writeUniqueFileDescriptorVector(const std::unique_ptr<std::vector<base::unique_fd>>& val) {
+    if (val) {
+        status_t err = reserveObjects(val->size(),
+                sizeof(int32_t) + val->size() * sizeof(flat_binder_object));
+        if (err != NO_ERROR) return err;
+    }
     return writeNullableTypedVector(val, &Parcel::writeUniqueFileDescriptor);
 }
 
@@ -1256,6 +1463,38 @@ status_t Parcel::writeDupImmutableBlobFileDescriptor(int fd)
     return writeDupFileDescriptor(fd);
 }
 
+status_t Parcel::writeExternalBuffer(const void* data, size_t len)
+{
+    if (len > INT32_MAX) {
+        // don't accept size_t values which may have come from an
+        // inadvertent conversion from a negative int.
+        return BAD_VALUE;
+    }
+
+    status_t status = writeInt32(len);
+    if (status) return status;
+
+    if (len < EXTERNAL_BUFFER_INPLACE_LIMIT) {
+        ALOGV("writeExternalBuffer: write in place");
+        status = writeInt32(EXTERNAL_BUFFER_INPLACE);
+        if (status) return status;
+        return write(data, len);
+    }
+
+    ALOGV("writeExternalBuffer: write as buffer object");
+    status = writeInt32(EXTERNAL_BUFFER_PTR);
+    if (status) return status;
+
+    binder_buffer_object obj;
+    obj.hdr.type = BINDER_TYPE_PTR;
+    obj.flags = 0;
+    obj.buffer = reinterpret_cast<binder_uintptr_t>(data);
+    obj.length = len;
+    obj.parent = 0;
+    obj.parent_offset = 0;
+    return writeBufferObject(obj);
+}
+
 status_t Parcel::write(const FlattenableHelperInterface& val)
 {
     status_t err;
@@ -1345,6 +1584,34 @@ restart_write:
     goto restart_write;
 }
 
+status_t Parcel::writeBufferObject(const binder_buffer_object& val)
+{
+    const bool enoughData = (mDataPos+sizeof(val)) <= mDataCapacity;
+    const bool enoughObjects = mObjectsSize < mObjectsCapacity;
+    if (enoughData && enoughObjects) {
+restart_write:
+        *reinterpret_cast<binder_buffer_object*>(mData+mDataPos) = val;
+        mObjects[mObjectsSize] = mDataPos;
+        mObjectsSize++;
+        return finishWrite(sizeof(binder_buffer_object));
+    }
+
+    if (!enoughData) {
+        const status_t err = growData(sizeof(val));
+        if (err != NO_ERROR) return err;
+    }
+    if (!enoughObjects) {
+        size_t newSize = ((mObjectsSize+2)*3)/2;
+        if (newSize*sizeof(binder_size_t) < mObjectsSize) return NO_MEMORY;   // overflow
+        binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+        if (objects == NULL) return NO_MEMORY;
+        mObjects = objects;
+        mObjectsCapacity = newSize;
+    }
+
+    goto restart_write;
+}
+
 status_t Parcel::writeNoException()
 {
     binder::Status status;
@@ -1481,7 +1748,7 @@ data_sorted:
             // hint. Iterate until we find the right object
             size_t nextObject = mNextObjectHint;
             do {
-                if (mDataPos < mObjects[nextObject] + sizeof(flat_binder_object)) {
+                if (mDataPos < mObjects[nextObject] + object_size(mData, mObjects[nextObject])) {
                     // Requested info overlaps with an object
                     ALOGE("Attempt to read from protected data in Parcel %p", this);
                     return PERMISSION_DENIED;
@@ -1983,16 +2250,24 @@ status_t Parcel::readUtf8FromUtf16(std::string* str) const {
        return NO_ERROR;
     }
 
+    // ASCII characters take as many bytes in UTF-8 as there are in UTF-16.
+    str->resize(utf16Size);
+    const size_t asciiSize = narrowAscii(src, utf16Size, &((*str)[0]));
+    if (asciiSize == utf16Size) {
+        return NO_ERROR;
+    }
+
     // Allow for closing '\0'
-    ssize_t utf8Size = utf16_to_utf8_length(src, utf16Size) + 1;
+    ssize_t utf8Size = utf16_to_utf8_length(src + asciiSize, utf16Size - asciiSize) + 1;
     if (utf8Size < 1) {
+        str->clear();
         return BAD_VALUE;
     }
     // Note that while it is probably safe to assume string::resize keeps a
     // spare byte around for the trailing null, we still pass the size including the trailing null
-    str->resize(utf8Size);
-    utf16_to_utf8(src, utf16Size, &((*str)[0]), utf8Size);
-    str->resize(utf8Size - 1);
+    str->resize(asciiSize + utf8Size);
+    utf16_to_utf8(src + asciiSize, utf16Size - asciiSize, &((*str)[asciiSize]), utf8Size);
+    str->resize(asciiSize + utf8Size - 1);
     return NO_ERROR;
 }
 
@@ -2286,6 +2561,38 @@ status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
     return NO_ERROR;
 }
 
+status_t Parcel::readExternalBuffer(const void** outData, size_t* outLen) const
+{
+    int32_t len;
+    status_t status = readInt32(&len);
+    if (status) return status;
+    if (len < 0) return BAD_VALUE;
+
+    int32_t bufferType;
+    status = readInt32(&bufferType);
+    if (status) return status;
+
+    const void* ptr;
+    if (bufferType == EXTERNAL_BUFFER_INPLACE) {
+        ALOGV("readExternalBuffer: read in place");
+        ptr = readInplace(len);
+    } else if (bufferType == EXTERNAL_BUFFER_PTR) {
+        ALOGV("readExternalBuffer: read from buffer object");
+        // The driver copied the buffer into our transaction buffer, and
+        // pointed the object at the copy.
+        const binder_buffer_object* obj = readBufferObject();
+        if (!obj || obj->length != static_cast<binder_size_t>(len)) return BAD_VALUE;
+        ptr = reinterpret_cast<const void*>(obj->buffer);
+    } else {
+        return BAD_TYPE;
+    }
+    if (!ptr) return BAD_VALUE;
+
+    *outData = ptr;
+    *outLen = len;
+    return NO_ERROR;
+}
+
 status_t Parcel::read(FlattenableHelperInterface& val) const
 {
     // size
@@ -2352,44 +2659,9 @@ const flat_binder_object* Parcel::readObject(bool nullMetaData) const
         }
 
         // Ensure that this object is valid...
-        binder_size_t* const OBJS = mObjects;
-        const size_t N = mObjectsSize;
-        size_t opos = mNextObjectHint;
-
-        if (N > 0) {
-            ALOGV("Parcel %p looking for obj at %zu, hint=%zu",
-                 this, DPOS, opos);
-
-            // Start at the current hint position, looking for an object at
-            // the current data position.
-            if (opos < N) {
-                while (opos < (N-1) && OBJS[opos] < DPOS) {
-                    opos++;
-                }
-            } else {
-                opos = N-1;
-            }
-            if (OBJS[opos] == DPOS) {
-                // Found it!
-                ALOGV("Parcel %p found obj %zu at index %zu with forward search",
-                     this, DPOS, opos);
-                mNextObjectHint = opos+1;
-                ALOGV("readObject Setting data pos of %p to %zu", this, mDataPos);
-                return obj;
-            }
-
-            // Look backwards for it...
-            while (opos > 0 && OBJS[opos] > DPOS) {
-                opos--;
-            }
-            if (OBJS[opos] == DPOS) {
-                // Found it!
-                ALOGV("Parcel %p found obj %zu at index %zu with backward search",
-                     this, DPOS, opos);
-                mNextObjectHint = opos+1;
-                ALOGV("readObject Setting data pos of %p to %zu", this, mDataPos);
-                return obj;
-            }
+        if (findObject(DPOS)) {
+            ALOGV("readObject Setting data pos of %p to %zu", this, mDataPos);
+            return obj;
         }
         ALOGW("Attempt to read object from Parcel %p at offset %zu that is not in the object list",
              this, DPOS);
@@ -2397,6 +2669,66 @@ const flat_binder_object* Parcel::readObject(bool nullMetaData) const
     return NULL;
 }
 
+bool Parcel::findObject(size_t pos) const
+{
+    binder_size_t* const OBJS = mObjects;
+    const size_t N = mObjectsSize;
+    size_t opos = mNextObjectHint;
+
+    if (N > 0) {
+        ALOGV("Parcel %p looking for obj at %zu, hint=%zu",
+             this, pos, opos);
+
+        // Start at the current hint position, looking for an object at
+        // the current data position.
+        if (opos < N) {
+            while (opos < (N-1) && OBJS[opos] < pos) {
+                opos++;
+            }
+        } else {
+            opos = N-1;
+        }
+        if (OBJS[opos] == pos) {
+            // Found it!
+            ALOGV("Parcel %p found obj %zu at index %zu with forward search",
+                 this, pos, opos);
+            mNextObjectHint = opos+1;
+            return true;
+        }
+
+        // Look backwards for it...
+        while (opos > 0 && OBJS[opos] > pos) {
+            opos--;
+        }
+        if (OBJS[opos] == pos) {
+            // Found it!
+            ALOGV("Parcel %p found obj %zu at index %zu with backward search",
+                 this, pos, opos);
+            mNextObjectHint = opos+1;
+            return true;
+        }
+    }
+    return false;
+}
+
+const binder_buffer_object* Parcel::readBufferObject() const
+{
+    const size_t DPOS = mDataPos;
+    if ((DPOS+sizeof(binder_buffer_object)) <= mDataSize) {
+        const binder_buffer_object* obj
+                = reinterpret_cast<const binder_buffer_object*>(mData+DPOS);
+        mDataPos = DPOS + sizeof(binder_buffer_object);
+        // Only top level buffers are written, see writeExternalBuffer()
+        if (obj->hdr.type == BINDER_TYPE_PTR && obj->flags == 0 && findObject(DPOS)) {
+            ALOGV("readBufferObject Setting data pos of %p to %zu", this, mDataPos);
+            return obj;
+        }
+        ALOGW("Attempt to read buffer object from Parcel %p at offset %zu that is not in the "
+              "object list", this, DPOS);
+    }
+    return NULL;
+}
+
 void Parcel::closeFileDescriptors()
 {
     size_t i = mObjectsSize;
@@ -2434,6 +2766,22 @@ size_t Parcel::ipcObjectsCount() const
     return mObjectsSize;
 }
 
+size_t Parcel::ipcBuffersSize() const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < mObjectsSize; i++) {
+        const binder_object_header* hdr
+                = reinterpret_cast<const binder_object_header*>(mData+mObjects[i]);
+        if (hdr->type == BINDER_TYPE_PTR) {
+            // the driver keeps each buffer 64-bit aligned
+            const binder_buffer_object* obj
+                    = reinterpret_cast<const binder_buffer_object*>(hdr);
+            size += (obj->length + 7) & ~static_cast<binder_size_t>(7);
+        }
+    }
+    return size;
+}
+
 void Parcel::ipcSetDataReference(const uint8_t* data, size_t dataSize,
     const binder_size_t* objects, size_t objectsCount, release_func relFunc, void* relCookie)
 {
@@ -2459,7 +2807,7 @@ void Parcel::ipcSetDataReference(const uint8_t* data, size_t dataSize,
             mObjectsSize = 0;
             break;
         }
-        minOffset = offset + sizeof(flat_binder_object);
+        minOffset = offset + object_size(mData, offset);
     }
     scanForFds();
 }
@@ -2518,6 +2866,31 @@ void Parcel::acquireObjects()
     }
 }
 
+// Data buffers go back to the IPCThreadState of the thread freeing them, so
+// that the next parcels it writes don't need to go through the allocator.
+uint8_t* Parcel::allocData(size_t desired, size_t* outCapacity, bool* outPooled)
+{
+    IPCThreadState* self = IPCThreadState::selfOrNull();
+    if (self != NULL) {
+        uint8_t* data = self->takeParcelData(desired, outCapacity);
+        if (data != NULL) {
+            *outPooled = true;
+            return data;
+        }
+    }
+    *outCapacity = desired;
+    *outPooled = false;
+    return (uint8_t*)malloc(desired);
+}
+
+void Parcel::releaseData(uint8_t* data, size_t capacity)
+{
+    IPCThreadState* self = IPCThreadState::selfOrNull();
+    if (self == NULL || !self->recycleParcelData(data, capacity)) {
+        free(data);
+    }
+}
+
 void Parcel::freeData()
 {
     freeDataNoInit();
@@ -2545,7 +2918,7 @@ void Parcel::freeDataNoInit()
               gParcelGlobalAllocCount--;
             }
             pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
-            free(mData);
+            releaseData(mData, mDataCapacity);
         }
         if (mObjects) free(mObjects);
     }
@@ -2565,6 +2938,26 @@ status_t Parcel::growData(size_t len)
             : continueWrite(newSize);
 }
 
+status_t Parcel::reserveObjects(size_t count, size_t len)
+{
+    if (count > INT32_MAX || len > INT32_MAX) {
+        // a vector this large fails to write anyway, leave it to the writes
+        return NO_ERROR;
+    }
+    if (mDataPos + len > mDataCapacity) {
+        const status_t err = growData(mDataPos + len - mDataSize);
+        if (err != NO_ERROR) return err;
+    }
+    if (mObjectsSize + count > mObjectsCapacity) {
+        const size_t newSize = mObjectsSize + count;
+        binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+        if (objects == NULL) return NO_MEMORY;
+        mObjects = objects;
+        mObjectsCapacity = newSize;
+    }
+    return NO_ERROR;
+}
+
 status_t Parcel::restartWrite(size_t desired)
 {
     if (desired > INT32_MAX) {
@@ -2647,7 +3040,9 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        bool pooled;
+        uint8_t* data = allocData(desired, &capacity, &pooled);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2657,7 +3052,7 @@ status_t Parcel::continueWrite(size_t desired)
         if (objectsSize) {
             objects = (binder_size_t*)calloc(objectsSize, sizeof(binder_size_t));
             if (!objects) {
-                free(data);
+                releaseData(data, capacity);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -2681,17 +3076,22 @@ status_t Parcel::continueWrite(size_t desired)
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
         mOwner = NULL;
 
-        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
+        if (pooled) {
+            gParcelGlobalPoolHitCount++;
+        } else {
+            gParcelGlobalPoolMissCount++;
+        }
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
         mData = data;
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
         mObjectsSize = mObjectsCapacity = objectsSize;
         mNextObjectHint = 0;
         mObjectsSorted = false;
@@ -2748,7 +3148,9 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        bool pooled;
+        uint8_t* data = allocData(desired, &capacity, &pooled);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2759,17 +3161,22 @@ status_t Parcel::continueWrite(size_t desired)
             ALOGE("continueWrite: %zu/%p/%zu/%zu", mDataCapacity, mObjects, mObjectsCapacity, desired);
         }
 
-        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
+        if (pooled) {
+            gParcelGlobalPoolHitCount++;
+        } else {
+            gParcelGlobalPoolMissCount++;
+        }
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
         mData = data;
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %zu", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
@@ -18,8 +18,10 @@
 
 #include <stdint.h>
 #include <utils/Log.h>
+#include <binder/ActivityManager.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <binder/IUidObserver.h>
 #include <binder/PermissionCache.h>
 #include <utils/String8.h>
 
@@ -31,47 +33,83 @@ ANDROID_SINGLETON_STATIC_INSTANCE(PermissionCache) ;
 
 // ----------------------------------------------------------------------------
 
-PermissionCache::PermissionCache() {
+class UidGoneObserver : public BnUidObserver {
+public:
+    virtual void onUidGone(uid_t uid, bool /*disabled*/) {
+        PermissionCache::invalidate(uid);
+    }
+    virtual void onUidActive(uid_t /*uid*/) { }
+    virtual void onUidIdle(uid_t /*uid*/, bool /*disabled*/) { }
+};
+
+// ----------------------------------------------------------------------------
+
+PermissionCache::PermissionCache()
+    : mHits(0), mMisses(0), mDeniedHits(0) {
 }
 
 status_t PermissionCache::check(bool* granted,
         const String16& permission, uid_t uid) const {
-    Mutex::Autolock _l(mLock);
+    const Shard& s = shard(uid);
+    Mutex::Autolock _l(s.lock);
     Entry e;
     e.name = permission;
     e.uid  = uid;
-    ssize_t index = mCache.indexOf(e);
+    ssize_t index = s.cache.indexOf(e);
     if (index >= 0) {
-        *granted = mCache.itemAt(index).granted;
-        return NO_ERROR;
+        const Entry& entry = s.cache.itemAt(index);
+        if (entry.granted || systemTime() < entry.expires) {
+            *granted = entry.granted;
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            if (!entry.granted) {
+                mDeniedHits.fetch_add(1, std::memory_order_relaxed);
+            }
+            return NO_ERROR;
+        }
     }
+    mMisses.fetch_add(1, std::memory_order_relaxed);
     return NAME_NOT_FOUND;
 }
 
 void PermissionCache::cache(const String16& permission,
         uid_t uid, bool granted) {
-    Mutex::Autolock _l(mLock);
     Entry e;
-    ssize_t index = mPermissionNamesPool.indexOf(permission);
-    if (index > 0) {
-        e.name = mPermissionNamesPool.itemAt(index);
-    } else {
-        mPermissionNamesPool.add(permission);
-        e.name = permission;
+    {
+        Mutex::Autolock _l(mPoolLock);
+        ssize_t index = mPermissionNamesPool.indexOf(permission);
+        if (index >= 0) {
+            e.name = mPermissionNamesPool.itemAt(index);
+        } else {
+            mPermissionNamesPool.add(permission);
+            e.name = permission;
+        }
     }
     // note, we don't need to store the pid, which is not actually used in
     // permission checks
     e.uid  = uid;
     e.granted = granted;
-    index = mCache.indexOf(e);
-    if (index < 0) {
-        mCache.add(e);
-    }
+    e.expires = granted ? 0 : systemTime() + DENIAL_TIMEOUT;
+    Shard& s = shard(uid);
+    Mutex::Autolock _l(s.lock);
+    // replaces an expired denial
+    s.cache.add(e);
 }
 
 void PermissionCache::purge() {
-    Mutex::Autolock _l(mLock);
-    mCache.clear();
+    for (Shard& s : mShards) {
+        Mutex::Autolock _l(s.lock);
+        s.cache.clear();
+    }
+}
+
+void PermissionCache::purge(uid_t uid) {
+    Shard& s = shard(uid);
+    Mutex::Autolock _l(s.lock);
+    for (size_t i = s.cache.size(); i > 0; i--) {
+        if (s.cache.itemAt(i - 1).uid == uid) {
+            s.cache.removeAt(i - 1);
+        }
+    }
 }
 
 bool PermissionCache::checkCallingPermission(const String16& permission) {
@@ -109,5 +147,39 @@ bool PermissionCache::checkPermission(
     return granted;
 }
 
+void PermissionCache::invalidate(uid_t uid) {
+    PermissionCache::getInstance().purge(uid);
+}
+
+void PermissionCache::invalidateAll() {
+    PermissionCache::getInstance().purge();
+}
+
+void PermissionCache::invalidateOnUidGone(const String16& callingPackage) {
+    static sp<IUidObserver> sObserver;
+    static Mutex sObserverLock;
+    Mutex::Autolock _l(sObserverLock);
+    if (sObserver == NULL) {
+        sObserver = new UidGoneObserver();
+        ActivityManager am;
+        am.registerUidObserver(sObserver, ActivityManager::UID_OBSERVER_GONE,
+                ActivityManager::PROCESS_STATE_UNKNOWN, callingPackage);
+    }
+}
+
+PermissionCache::Stats PermissionCache::getStats() {
+    const PermissionCache& pc(PermissionCache::getInstance());
+    Stats stats;
+    stats.hits = pc.mHits.load(std::memory_order_relaxed);
+    stats.misses = pc.mMisses.load(std::memory_order_relaxed);
+    stats.deniedHits = pc.mDeniedHits.load(std::memory_order_relaxed);
+    stats.entries = 0;
+    for (const Shard& s : pc.mShards) {
+        Mutex::Autolock _l(s.lock);
+        stats.entries += s.cache.size();
+    }
+    return stats;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
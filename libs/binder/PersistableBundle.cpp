@@ -19,7 +19,11 @@
 #include <binder/PersistableBundle.h>
 #include <private/binder/ParcelValTypes.h>
 
+#include <string.h>
+
+#include <atomic>
 #include <limits>
+#include <mutex>
 
 #include <binder/IBinder.h>
 #include <binder/Parcel.h>
@@ -29,6 +33,7 @@
 using android::BAD_TYPE;
 using android::BAD_VALUE;
 using android::NO_ERROR;
+using android::NOT_ENOUGH_DATA;
 using android::Parcel;
 using android::sp;
 using android::status_t;
@@ -68,6 +73,42 @@ namespace android {
 
 namespace os {
 
+namespace {
+std::atomic<bool> gLazyUnparcel(false);
+}  // namespace
+
+struct PersistableBundle::LazyData {
+    struct Entry {
+        // Points into |parcel|.
+        const char16_t* key;
+        size_t key_length;
+        int32_t type;
+        size_t value_pos;
+    };
+
+    int32_t magic;
+    // Key-value pairs as parcelled, starting with their count.
+    Parcel parcel;
+    std::vector<Entry> entries;
+    // Serializes reads, which move |parcel|'s data position.
+    std::mutex lock;
+
+    // Indexes the entries of |parcel| without unpacking their values.
+    status_t index();
+    status_t skipValue(int32_t type);
+    status_t skipArray(size_t element_size);
+
+    const Entry* find(const String16& key) const {
+        for (const Entry& entry : entries) {
+            if (entry.key_length == key.size() &&
+                memcmp(entry.key, key.string(), key.size() * sizeof(char16_t)) == 0) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+};
+
 #define RETURN_IF_FAILED(calledOnce)                                     \
     {                                                                    \
         status_t returnStatus = calledOnce;                              \
@@ -86,6 +127,10 @@ namespace os {
          }                                                               \
     }
 
+void PersistableBundle::setLazyUnparcel(bool lazy) {
+    gLazyUnparcel = lazy;
+}
+
 status_t PersistableBundle::writeToParcel(Parcel* parcel) const {
     /*
      * Keep implementation in sync with writeToParcelInner() in
@@ -98,6 +143,15 @@ status_t PersistableBundle::writeToParcel(Parcel* parcel) const {
         return NO_ERROR;
     }
 
+    // A bundle that was never unpacked goes back out as it came in.
+    if (mLazy != nullptr) {
+        const size_t length = mLazy->parcel.dataSize();
+        RETURN_IF_FAILED(parcel->writeInt32(static_cast<int32_t>(length)));
+        RETURN_IF_FAILED(parcel->writeInt32(mLazy->magic));
+        RETURN_IF_FAILED(parcel->write(mLazy->parcel.data(), length));
+        return NO_ERROR;
+    }
+
     size_t length_pos = parcel->dataPosition();
     RETURN_IF_FAILED(parcel->writeInt32(1));  // dummy, will hold length
     RETURN_IF_FAILED(parcel->writeInt32(BUNDLE_MAGIC_NATIVE));
@@ -137,6 +191,9 @@ bool PersistableBundle::empty() const {
 }
 
 size_t PersistableBundle::size() const {
+    if (mLazy != nullptr) {
+        return mLazy->entries.size();
+    }
     return (mBoolMap.size() +
             mIntMap.size() +
             mLongMap.size() +
@@ -151,6 +208,8 @@ size_t PersistableBundle::size() const {
 }
 
 size_t PersistableBundle::erase(const String16& key) {
+    // All the setters come through here first.
+    unparcel();
     RETURN_IF_ENTRY_ERASED(mBoolMap, key);
     RETURN_IF_ENTRY_ERASED(mIntMap, key);
     RETURN_IF_ENTRY_ERASED(mLongMap, key);
@@ -164,6 +223,149 @@ size_t PersistableBundle::erase(const String16& key) {
     return mPersistableBundleMap.erase(key);
 }
 
+status_t PersistableBundle::LazyData::index() {
+    int32_t num_entries;
+    RETURN_IF_FAILED(parcel.readInt32(&num_entries));
+
+    for (; num_entries > 0; --num_entries) {
+        Entry entry;
+        entry.key = parcel.readString16Inplace(&entry.key_length);
+        if (entry.key == nullptr) {
+            return UNEXPECTED_NULL;
+        }
+        RETURN_IF_FAILED(parcel.readInt32(&entry.type));
+        entry.value_pos = parcel.dataPosition();
+        RETURN_IF_FAILED(skipValue(entry.type));
+        entries.push_back(entry);
+    }
+    return NO_ERROR;
+}
+
+status_t PersistableBundle::LazyData::skipValue(int32_t type) {
+    // Fails where readFromParcelInner() would fail to read the value.
+    switch (type) {
+        case VAL_STRING: {
+            size_t length;
+            return parcel.readString16Inplace(&length) != nullptr ? NO_ERROR : UNEXPECTED_NULL;
+        }
+        case VAL_INTEGER:
+        case VAL_BOOLEAN:
+            return parcel.readInplace(sizeof(int32_t)) != nullptr ? NO_ERROR : NOT_ENOUGH_DATA;
+        case VAL_LONG:
+        case VAL_DOUBLE:
+            return parcel.readInplace(sizeof(int64_t)) != nullptr ? NO_ERROR : NOT_ENOUGH_DATA;
+        case VAL_STRINGARRAY: {
+            int32_t count;
+            RETURN_IF_FAILED(parcel.readInt32(&count));
+            if (count < 0) {
+                return UNEXPECTED_NULL;
+            }
+            for (; count > 0; --count) {
+                size_t length;
+                if (parcel.readString16Inplace(&length) == nullptr) {
+                    return UNEXPECTED_NULL;
+                }
+            }
+            return NO_ERROR;
+        }
+        case VAL_INTARRAY:
+        case VAL_BOOLEANARRAY:
+            // Parcel writes bools as int32s.
+            return skipArray(sizeof(int32_t));
+        case VAL_LONGARRAY:
+        case VAL_DOUBLEARRAY:
+            return skipArray(sizeof(int64_t));
+        case VAL_PERSISTABLEBUNDLE: {
+            int32_t length;
+            RETURN_IF_FAILED(parcel.readInt32(&length));
+            if (length < 0) {
+                return UNEXPECTED_NULL;
+            }
+            if (length == 0) {
+                return NO_ERROR;
+            }
+            int32_t magic;
+            RETURN_IF_FAILED(parcel.readInt32(&magic));
+            if (magic != BUNDLE_MAGIC && magic != BUNDLE_MAGIC_NATIVE) {
+                ALOGE("Bad magic number for PersistableBundle: 0x%08x", magic);
+                return BAD_VALUE;
+            }
+            return parcel.readInplace(length) != nullptr ? NO_ERROR : NOT_ENOUGH_DATA;
+        }
+        default:
+            ALOGE("Unrecognized type: %d", type);
+            return BAD_TYPE;
+    }
+}
+
+status_t PersistableBundle::LazyData::skipArray(size_t element_size) {
+    int32_t count;
+    RETURN_IF_FAILED(parcel.readInt32(&count));
+    if (count < 0) {
+        return UNEXPECTED_NULL;
+    }
+    if (static_cast<size_t>(count) > std::numeric_limits<int32_t>::max() / element_size) {
+        return BAD_VALUE;
+    }
+    return parcel.readInplace(count * element_size) != nullptr ? NO_ERROR : NOT_ENOUGH_DATA;
+}
+
+status_t PersistableBundle::readLazily(const Parcel* parcel, int32_t magic, size_t length) {
+    const void* data = parcel->readInplace(length);
+    if (data == nullptr) {
+        ALOGE("Bad length in parcel: %zu", length);
+        return BAD_VALUE;
+    }
+
+    std::shared_ptr<LazyData> lazy = std::make_shared<LazyData>();
+    lazy->magic = magic;
+    RETURN_IF_FAILED(lazy->parcel.setData(static_cast<const uint8_t*>(data), length));
+    RETURN_IF_FAILED(lazy->index());
+    mLazy = std::move(lazy);
+    return NO_ERROR;
+}
+
+void PersistableBundle::unparcel() {
+    if (mLazy == nullptr) return;
+
+    // Copies of this bundle keep their reference to the parcelled contents.
+    std::shared_ptr<LazyData> lazy = std::move(mLazy);
+    std::lock_guard<std::mutex> lock(lazy->lock);
+    lazy->parcel.setDataPosition(0);
+    if (readEntries(&lazy->parcel) != NO_ERROR) {
+        // Cannot happen, the contents were all checked when they were indexed.
+        ALOGE("Failed to unparcel bundle");
+    }
+}
+
+template <typename T>
+bool PersistableBundle::getLazyValue(const String16& key, int32_t type,
+                                     status_t (Parcel::*read)(T*) const, T* out) const {
+    std::lock_guard<std::mutex> lock(mLazy->lock);
+    const LazyData::Entry* entry = mLazy->find(key);
+    if (entry == nullptr || entry->type != type) return false;
+    mLazy->parcel.setDataPosition(entry->value_pos);
+    return (mLazy->parcel.*read)(out) == NO_ERROR;
+}
+
+set<String16> PersistableBundle::getLazyKeys(int32_t type) const {
+    set<String16> keys;
+    for (const LazyData::Entry& entry : mLazy->entries) {
+        if (entry.type == type) {
+            keys.emplace(entry.key, entry.key_length);
+        }
+    }
+    return keys;
+}
+
+bool PersistableBundle::lazyEquals(const PersistableBundle& lhs, const PersistableBundle& rhs) {
+    PersistableBundle unparcelled_lhs(lhs);
+    PersistableBundle unparcelled_rhs(rhs);
+    unparcelled_lhs.unparcel();
+    unparcelled_rhs.unparcel();
+    return unparcelled_lhs == unparcelled_rhs;
+}
+
 void PersistableBundle::putBoolean(const String16& key, bool value) {
     erase(key);
     mBoolMap[key] = value;
@@ -220,90 +422,139 @@ void PersistableBundle::putPersistableBundle(const String16& key, const Persista
 }
 
 bool PersistableBundle::getBoolean(const String16& key, bool* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_BOOLEAN, &Parcel::readBool, out);
+    }
     return getValue(key, out, mBoolMap);
 }
 
 bool PersistableBundle::getInt(const String16& key, int32_t* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_INTEGER, &Parcel::readInt32, out);
+    }
     return getValue(key, out, mIntMap);
 }
 
 bool PersistableBundle::getLong(const String16& key, int64_t* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_LONG, &Parcel::readInt64, out);
+    }
     return getValue(key, out, mLongMap);
 }
 
 bool PersistableBundle::getDouble(const String16& key, double* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_DOUBLE, &Parcel::readDouble, out);
+    }
     return getValue(key, out, mDoubleMap);
 }
 
 bool PersistableBundle::getString(const String16& key, String16* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_STRING, &Parcel::readString16, out);
+    }
     return getValue(key, out, mStringMap);
 }
 
 bool PersistableBundle::getBooleanVector(const String16& key, vector<bool>* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_BOOLEANARRAY, &Parcel::readBoolVector, out);
+    }
     return getValue(key, out, mBoolVectorMap);
 }
 
 bool PersistableBundle::getIntVector(const String16& key, vector<int32_t>* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_INTARRAY, &Parcel::readInt32Vector, out);
+    }
     return getValue(key, out, mIntVectorMap);
 }
 
 bool PersistableBundle::getLongVector(const String16& key, vector<int64_t>* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_LONGARRAY, &Parcel::readInt64Vector, out);
+    }
     return getValue(key, out, mLongVectorMap);
 }
 
 bool PersistableBundle::getDoubleVector(const String16& key, vector<double>* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_DOUBLEARRAY, &Parcel::readDoubleVector, out);
+    }
     return getValue(key, out, mDoubleVectorMap);
 }
 
 bool PersistableBundle::getStringVector(const String16& key, vector<String16>* out) const {
+    if (mLazy != nullptr) {
+        return getLazyValue(key, VAL_STRINGARRAY, &Parcel::readString16Vector, out);
+    }
     return getValue(key, out, mStringVectorMap);
 }
 
 bool PersistableBundle::getPersistableBundle(const String16& key, PersistableBundle* out) const {
+    if (mLazy != nullptr) {
+        std::lock_guard<std::mutex> lock(mLazy->lock);
+        const LazyData::Entry* entry = mLazy->find(key);
+        if (entry == nullptr || entry->type != VAL_PERSISTABLEBUNDLE) return false;
+        mLazy->parcel.setDataPosition(entry->value_pos);
+        *out = PersistableBundle();
+        return out->readFromParcel(&mLazy->parcel) == NO_ERROR;
+    }
     return getValue(key, out, mPersistableBundleMap);
 }
 
 set<String16> PersistableBundle::getBooleanKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_BOOLEAN);
     return getKeys(mBoolMap);
 }
 
 set<String16> PersistableBundle::getIntKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_INTEGER);
     return getKeys(mIntMap);
 }
 
 set<String16> PersistableBundle::getLongKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_LONG);
     return getKeys(mLongMap);
 }
 
 set<String16> PersistableBundle::getDoubleKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_DOUBLE);
     return getKeys(mDoubleMap);
 }
 
 set<String16> PersistableBundle::getStringKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_STRING);
     return getKeys(mStringMap);
 }
 
 set<String16> PersistableBundle::getBooleanVectorKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_BOOLEANARRAY);
     return getKeys(mBoolVectorMap);
 }
 
 set<String16> PersistableBundle::getIntVectorKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_INTARRAY);
     return getKeys(mIntVectorMap);
 }
 
 set<String16> PersistableBundle::getLongVectorKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_LONGARRAY);
     return getKeys(mLongVectorMap);
 }
 
 set<String16> PersistableBundle::getDoubleVectorKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_DOUBLEARRAY);
     return getKeys(mDoubleVectorMap);
 }
 
 set<String16> PersistableBundle::getStringVectorKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_STRINGARRAY);
     return getKeys(mStringVectorMap);
 }
 
 set<String16> PersistableBundle::getPersistableBundleKeys() const {
+    if (mLazy != nullptr) return getLazyKeys(VAL_PERSISTABLEBUNDLE);
     return getKeys(mPersistableBundleMap);
 }
 
@@ -398,6 +649,16 @@ status_t PersistableBundle::readFromParcelInner(const Parcel* parcel, size_t len
         return BAD_VALUE;
     }
 
+    // Only an empty bundle is read lazily, values read into a bundle that
+    // has some already are merged with them.
+    if (gLazyUnparcel && empty()) {
+        return readLazily(parcel, magic, length);
+    }
+    unparcel();
+    return readEntries(parcel);
+}
+
+status_t PersistableBundle::readEntries(const Parcel* parcel) {
     /*
      * To keep this implementation in sync with unparcel() in
      * frameworks/base/core/java/android/os/BaseBundle.java, the number of
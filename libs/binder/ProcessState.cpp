@@ -25,6 +25,7 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String8.h>
+#include <utils/SystemClock.h>
 #include <utils/threads.h>
 
 #include <private/binder/binder_module.h>
@@ -32,6 +33,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -40,9 +42,17 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+
 #define BINDER_VM_SIZE ((1 * 1024 * 1024) - sysconf(_SC_PAGE_SIZE) * 2)
 #define DEFAULT_MAX_BINDER_THREADS 15
 
+// All threads busy for this long makes an adaptive pool grow
+#define THREAD_POOL_GROW_STARVATION_MS 10
+// A thread retires when fewer than half of the pool were ever busy at
+// once during this long
+#define THREAD_POOL_IDLE_WINDOW_MS 10000
+
 // -------------------------------------------------------------------------
 
 namespace android {
@@ -243,10 +253,33 @@ ProcessState::handle_entry* ProcessState::lookupHandleLocked(int32_t handle)
 
 sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 {
-    sp<IBinder> result;
+    AutoMutex _l(mLock);
+    return getStrongProxyForHandleLocked(handle);
+}
+
+void ProcessState::getStrongProxiesForHandles(const std::vector<int32_t>& handles,
+        std::vector<sp<IBinder>>* outProxies)
+{
+    outProxies->clear();
+    if (handles.empty()) {
+        return;
+    }
+    outProxies->reserve(handles.size());
 
     AutoMutex _l(mLock);
 
+    // Make room for the largest handle up front, the table then grows once
+    // for the whole batch rather than for every new handle in it.
+    lookupHandleLocked(*std::max_element(handles.begin(), handles.end()));
+    for (int32_t handle : handles) {
+        outProxies->push_back(getStrongProxyForHandleLocked(handle));
+    }
+}
+
+sp<IBinder> ProcessState::getStrongProxyForHandleLocked(int32_t handle)
+{
+    sp<IBinder> result;
+
     handle_entry* e = lookupHandleLocked(handle);
 
     if (e != NULL) {
@@ -360,16 +393,99 @@ void ProcessState::spawnPooledThread(bool isMain)
 }
 
 status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
-    status_t result = NO_ERROR;
-    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads) != -1) {
-        mMaxThreads = maxThreads;
-    } else {
-        result = -errno;
-        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+    pthread_mutex_lock(&mThreadCountLock);
+    mAdaptiveThreadPool = false;
+    const status_t result = setDriverMaxThreadsLocked(maxThreads);
+    pthread_mutex_unlock(&mThreadCountLock);
+    return result;
+}
+
+status_t ProcessState::setThreadPoolAdaptive(size_t minThreads, size_t maxThreads) {
+    if (minThreads > maxThreads) {
+        return BAD_VALUE;
     }
+    pthread_mutex_lock(&mThreadCountLock);
+    mAdaptiveThreadPool = true;
+    mAdaptiveMinThreads = minThreads;
+    mAdaptiveMaxThreads = maxThreads;
+    mWindowPeakExecutingThreadsCount = mExecutingThreadsCount;
+    mWindowStartTimeMs = uptimeMillis();
+    const status_t result = setDriverMaxThreadsLocked(minThreads);
+    pthread_mutex_unlock(&mThreadCountLock);
     return result;
 }
 
+status_t ProcessState::setDriverMaxThreadsLocked(size_t maxThreads) {
+    // The driver counts every thread it ever had started against its limit,
+    // including the ones that retired since.
+    size_t driverMaxThreads = maxThreads + mRetiredThreadsCount;
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
+        const status_t result = -errno;
+        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+        return result;
+    }
+    mMaxThreads = maxThreads;
+    return NO_ERROR;
+}
+
+bool ProcessState::growThreadPoolLocked() {
+    if (!mAdaptiveThreadPool || mMaxThreads >= mAdaptiveMaxThreads) {
+        return false;
+    }
+    const size_t maxThreads = std::min(mAdaptiveMaxThreads,
+            mMaxThreads + std::max<size_t>(mMaxThreads / 2, 1));
+    ALOGI("binder thread pool starved, growing from %zu to %zu threads", mMaxThreads, maxThreads);
+    return setDriverMaxThreadsLocked(maxThreads) == NO_ERROR;
+}
+
+bool ProcessState::threadPoolCommandDoneLocked(int64_t starvationTimeMs, bool canRetire) {
+    if (starvationTimeMs > 0) {
+        mStarvationCount++;
+        mStarvationTotalTimeMs += starvationTimeMs;
+        mLongestStarvationTimeMs = std::max(mLongestStarvationTimeMs, starvationTimeMs);
+        if (starvationTimeMs >= THREAD_POOL_GROW_STARVATION_MS && growThreadPoolLocked()) {
+            return false;
+        }
+    }
+    if (!mAdaptiveThreadPool) {
+        return false;
+    }
+
+    const int64_t now = uptimeMillis();
+    if (now - mWindowStartTimeMs < THREAD_POOL_IDLE_WINDOW_MS) {
+        return false;
+    }
+    const size_t peak = mWindowPeakExecutingThreadsCount;
+    mWindowPeakExecutingThreadsCount = mExecutingThreadsCount;
+    mWindowStartTimeMs = now;
+
+    // At most one thread retires per window, so that a pool that became idle
+    // shrinks gradually rather than all at once.
+    if (!canRetire || mPooledThreadsCount <= mAdaptiveMinThreads ||
+            peak * 2 >= mPooledThreadsCount) {
+        return false;
+    }
+    mRetiredThreadsCount++;
+    setDriverMaxThreadsLocked(mMaxThreads > mAdaptiveMinThreads ? mMaxThreads - 1
+            : mAdaptiveMinThreads);
+    return true;
+}
+
+void ProcessState::dumpThreadPool(String8& result) {
+    pthread_mutex_lock(&mThreadCountLock);
+    result.appendFormat("Binder thread pool: %zu pooled threads, %zu executing, max %zu",
+            mPooledThreadsCount, mExecutingThreadsCount, mMaxThreads);
+    if (mAdaptiveThreadPool) {
+        result.appendFormat(" (adaptive %zu-%zu, %zu retired)", mAdaptiveMinThreads,
+                mAdaptiveMaxThreads, mRetiredThreadsCount);
+    }
+    result.appendFormat("\n  peak executing=%zu, starved %zu times for %" PRId64 " ms"
+            " (longest %" PRId64 " ms), %zu callers blocked waiting for a thread\n",
+            mPeakExecutingThreadsCount, mStarvationCount, mStarvationTotalTimeMs,
+            mLongestStarvationTimeMs, mBlockedCallersCount);
+    pthread_mutex_unlock(&mThreadCountLock);
+}
+
 void ProcessState::giveThreadPoolName() {
     androidSetThreadName( makeBinderThreadName().string() );
 }
@@ -415,6 +531,18 @@ ProcessState::ProcessState(const char *driver)
     , mExecutingThreadsCount(0)
     , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
     , mStarvationStartTimeMs(0)
+    , mPooledThreadsCount(0)
+    , mRetiredThreadsCount(0)
+    , mAdaptiveThreadPool(false)
+    , mAdaptiveMinThreads(0)
+    , mAdaptiveMaxThreads(0)
+    , mPeakExecutingThreadsCount(0)
+    , mWindowPeakExecutingThreadsCount(0)
+    , mWindowStartTimeMs(0)
+    , mStarvationCount(0)
+    , mStarvationTotalTimeMs(0)
+    , mLongestStarvationTimeMs(0)
+    , mBlockedCallersCount(0)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+
+#include <private/binder/TransactionStats.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+namespace android {
+
+// Interface descriptors are short, anything longer is not one
+static const size_t MAX_DESCRIPTOR_LENGTH = 256;
+
+std::atomic<bool> TransactionStats::sEnabled(false);
+
+TransactionStats& TransactionStats::self()
+{
+    // Never destroyed, binder threads may still be recording at exit
+    static TransactionStats* sStats = new TransactionStats;
+    return *sStats;
+}
+
+// Finds the interface descriptor written by Parcel::writeInterfaceToken() at
+// the start of the data, without going through the Parcel read functions so
+// that transactions without one are not logged as bad reads.
+static const char16_t* getDescriptor(const Parcel& data, size_t* outLen)
+{
+    const uint8_t* bytes = data.data();
+    const size_t size = data.dataSize();
+    if (bytes == NULL || size < 2 * sizeof(int32_t)) {
+        return NULL;
+    }
+    int32_t len;
+    memcpy(&len, bytes + sizeof(int32_t), sizeof(len));
+    if (len < 0 || static_cast<size_t>(len) > MAX_DESCRIPTOR_LENGTH ||
+            2 * sizeof(int32_t) + (len + 1) * sizeof(char16_t) > size) {
+        return NULL;
+    }
+    const char16_t* str = reinterpret_cast<const char16_t*>(bytes + 2 * sizeof(int32_t));
+    for (int32_t i = 0; i < len; i++) {
+        if (str[i] < 0x20 || str[i] > 0x7e) {
+            return NULL;
+        }
+    }
+    if (str[len] != 0) {
+        return NULL;
+    }
+    *outLen = len;
+    return str;
+}
+
+// FNV-1a
+static uint64_t hashEntry(TransactionStats::Side side, uint32_t code,
+        const char16_t* descriptor, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    mix(&side, sizeof(side));
+    mix(&code, sizeof(code));
+    mix(descriptor, len * sizeof(char16_t));
+    return hash;
+}
+
+void TransactionStats::record(Side side, const Parcel& data, uint32_t code, nsecs_t duration)
+{
+    static const char16_t sNoDescriptor[] = { 0 };
+    size_t len = 0;
+    const char16_t* descriptor = getDescriptor(data, &len);
+    if (descriptor == NULL) {
+        descriptor = sNoDescriptor;
+    }
+    const uint64_t hash = hashEntry(side, code, descriptor, len);
+
+    const uint64_t us = static_cast<uint64_t>(std::max<nsecs_t>(duration, 0)) / 1000;
+    const size_t bucket = us == 0 ? 0 : std::min<size_t>(64 - __builtin_clzll(us),
+            BUCKET_COUNT - 1);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mEntries.find(hash);
+    if (it == mEntries.end()) {
+        if (mEntries.size() >= MAX_ENTRIES) {
+            mDropped++;
+            return;
+        }
+        Entry entry = {};
+        entry.descriptor = String16(descriptor, len);
+        entry.code = code;
+        entry.side = side;
+        it = mEntries.emplace(hash, entry).first;
+    }
+
+    Entry& entry = it->second;
+    if (entry.code != code || entry.side != side || entry.descriptor.size() != len ||
+            memcmp(entry.descriptor.string(), descriptor, len * sizeof(char16_t)) != 0) {
+        // hash collision
+        mDropped++;
+        return;
+    }
+    entry.count++;
+    entry.total += duration;
+    entry.max = std::max(entry.max, duration);
+    entry.buckets[bucket]++;
+}
+
+void TransactionStats::recordCallerCpu(uid_t uid, nsecs_t cpuTime)
+{
+    cpuTime = std::max<nsecs_t>(cpuTime, 0);
+    std::lock_guard<std::mutex> lock(mLock);
+    CallerEntry& entry = mCallers[uid];
+    entry.uid = uid;
+    entry.count++;
+    entry.cpuTime += cpuTime;
+    entry.maxCpuTime = std::max(entry.maxCpuTime, cpuTime);
+}
+
+void TransactionStats::reset()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.clear();
+    mDropped = 0;
+    mCallers.clear();
+}
+
+status_t TransactionStats::command(int fd, const Vector<String16>& args)
+{
+    if (args.size() > 0) {
+        if (args[0] == String16("enable")) {
+            sEnabled.store(true, std::memory_order_relaxed);
+        } else if (args[0] == String16("disable")) {
+            sEnabled.store(false, std::memory_order_relaxed);
+        } else if (args[0] == String16("reset")) {
+            reset();
+        } else {
+            return BAD_VALUE;
+        }
+        return NO_ERROR;
+    }
+
+    String8 result;
+    dump(result);
+    ProcessState::self()->dumpThreadPool(result);
+    if (write(fd, result.string(), result.size()) < 0) {
+        return -errno;
+    }
+    return NO_ERROR;
+}
+
+void TransactionStats::dump(String8& result) const
+{
+    std::vector<const Entry*> entries;
+    std::lock_guard<std::mutex> lock(mLock);
+    entries.reserve(mEntries.size());
+    for (const auto& it : mEntries) {
+        entries.push_back(&it.second);
+    }
+    // slowest first, by total time spent
+    std::sort(entries.begin(), entries.end(), [](const Entry* lhs, const Entry* rhs) {
+        return lhs->total > rhs->total;
+    });
+
+    result.appendFormat("Binder transaction stats (pid %d, %s): %zu entries, %" PRIu64
+            " samples dropped\n", getpid(), isEnabled() ? "enabled" : "disabled",
+            entries.size(), mDropped);
+    for (const Entry* entry : entries) {
+        const String8 descriptor(entry->descriptor);
+        result.appendFormat("  %s %s code=%u: count=%" PRIu64 " avg=%.1fus max=%.1fus\n",
+                entry->side == CLIENT ? "client" : "server",
+                descriptor.size() > 0 ? descriptor.string() : "<no descriptor>",
+                entry->code, entry->count,
+                entry->count > 0 ? entry->total / 1000.0 / entry->count : 0.0,
+                entry->max / 1000.0);
+        result.append("   ");
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            if (entry->buckets[i] == 0) continue;
+            if (i == BUCKET_COUNT - 1) {
+                result.appendFormat(" >=%" PRIu64 "us:%" PRIu64, uint64_t(1) << (i - 1),
+                        entry->buckets[i]);
+            } else {
+                result.appendFormat(" <%" PRIu64 "us:%" PRIu64, uint64_t(1) << i,
+                        entry->buckets[i]);
+            }
+        }
+        result.append("\n");
+    }
+
+    std::vector<const CallerEntry*> callers;
+    callers.reserve(mCallers.size());
+    nsecs_t totalCpuTime = 0;
+    for (const auto& it : mCallers) {
+        callers.push_back(&it.second);
+        totalCpuTime += it.second.cpuTime;
+    }
+    // busiest first
+    std::sort(callers.begin(), callers.end(), [](const CallerEntry* lhs, const CallerEntry* rhs) {
+        return lhs->cpuTime > rhs->cpuTime;
+    });
+
+    result.appendFormat("Binder server CPU time by calling uid: %zu uids, %.1fms total\n",
+            callers.size(), totalCpuTime / 1000000.0);
+    uint64_t otherCount = 0;
+    nsecs_t otherCpuTime = 0;
+    for (size_t i = 0; i < callers.size(); i++) {
+        const CallerEntry* caller = callers[i];
+        if (i >= MAX_DUMPED_CALLERS) {
+            otherCount += caller->count;
+            otherCpuTime += caller->cpuTime;
+            continue;
+        }
+        result.appendFormat("  uid %u: count=%" PRIu64 " cpu=%.1fms avg=%.1fus max=%.1fus"
+                " (%.1f%%)\n", caller->uid, caller->count, caller->cpuTime / 1000000.0,
+                caller->count > 0 ? caller->cpuTime / 1000.0 / caller->count : 0.0,
+                caller->maxCpuTime / 1000.0,
+                totalCpuTime > 0 ? caller->cpuTime * 100.0 / totalCpuTime : 0.0);
+    }
+    if (otherCount > 0) {
+        result.appendFormat("  %zu other uids: count=%" PRIu64 " cpu=%.1fms\n",
+                callers.size() - MAX_DUMPED_CALLERS, otherCount, otherCpuTime / 1000000.0);
+    }
+}
+
+}; // namespace android
@@ -59,6 +59,11 @@ public:
         SHELL_COMMAND_TRANSACTION = B_PACK_CHARS('_','C','M','D'),
         INTERFACE_TRANSACTION   = B_PACK_CHARS('_', 'N', 'T', 'F'),
         SYSPROPS_TRANSACTION    = B_PACK_CHARS('_', 'S', 'P', 'R'),
+        // Controls and dumps the transaction latency stats and the thread
+        // pool occupancy of the process hosting the binder: a file descriptor
+        // to dump to followed by the argument count and arguments, "enable",
+        // "disable" or "reset".
+        TRANSACTION_STATS_TRANSACTION = B_PACK_CHARS('_', 'T', 'S', 'T'),
 
         // Corresponds to TF_ONE_WAY -- an asynchronous call.
         FLAG_ONEWAY             = 0x00000001
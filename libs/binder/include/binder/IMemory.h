@@ -79,6 +79,13 @@ public:
     void* pointer() const;
     size_t size() const;
     ssize_t offset() const;
+
+    // Writes memory, which may be null, along with its heap, offset and size,
+    // so that the IMemory readFromParcel() returns knows them without calling
+    // getMemory() on the remote object. Senders and receivers must agree to
+    // use these instead of writeStrongBinder() and readStrongBinder().
+    static status_t writeToParcel(Parcel* parcel, const sp<IMemory>& memory);
+    static sp<IMemory> readFromParcel(const Parcel& parcel);
 };
 
 class BnMemory : public BnInterface<IMemory>
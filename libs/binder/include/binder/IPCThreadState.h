@@ -31,6 +31,7 @@ namespace android {
 
 class IPCThreadState
 {
+    friend class Parcel;
 public:
     static  IPCThreadState*     self();
     static  IPCThreadState*     selfOrNull();  // self(), but won't instantiate
@@ -64,6 +65,15 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // The oneway transactions this thread makes between the two calls
+            // are queued up and sent to the driver together, in a single
+            // ioctl, when the outermost batch ends. They report NO_ERROR
+            // right away, endOnewayBatch() returns the first error. Any other
+            // transaction made in between sends the queued ones first. See
+            // OnewayTransactionBatch.
+            void                beginOnewayBatch();
+            status_t            endOnewayBatch();
+
             void                incStrongHandle(int32_t handle, BpBinder *proxy);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle, BpBinder *proxy);
@@ -107,9 +117,18 @@ private:
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
             void                processPostWriteDerefs();
+            bool                writeRefCommand(int32_t cmd, int32_t handle);
 
             void                clearCaller();
 
+            void                flushOnewayBatch();
+
+            // Parcel data buffers freed by this thread are kept around for
+            // the next parcels it writes.
+            uint8_t*            takeParcelData(size_t desired, size_t* outCapacity);
+            bool                recycleParcelData(uint8_t* data, size_t capacity);
+            void                clearParcelDataPool();
+
     static  void                threadDestructor(void *st);
     static  void                freeBuffer(Parcel* parcel,
                                            const uint8_t* data, size_t dataSize,
@@ -123,11 +142,52 @@ private:
             Vector<RefBase::weakref_type*> mPostWriteWeakDerefs;
             Parcel              mIn;
             Parcel              mOut;
+            // The reference count commands at the end of mOut, which nothing
+            // else has been written after and which may still be cancelled
+            size_t              mRefCommandsStart;
+            size_t              mRefCommandsEnd;
             status_t            mLastError;
             pid_t               mCallingPid;
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+            // CPU time of the transactions served by this thread while it
+            // served the current one, which their own callers are charged for
+            int64_t             mNestedCpuTime;
+            // Set while this thread serves the pool on behalf of the driver
+            // and may leave it again, see ProcessState::setThreadPoolAdaptive()
+            bool                mIsPooledThread;
+            size_t              mOnewayBatchDepth;
+            // copies of the data of the queued oneway transactions
+            Vector<Parcel*>     mOnewayBatch;
+            size_t              mOnewayBatchSize;
+            status_t            mOnewayBatchError;
+
+    struct ParcelData {
+            uint8_t*            data;
+            size_t              capacity;
+    };
+    enum { PARCEL_DATA_POOL_SIZE = 4 };
+            ParcelData          mParcelDataPool[PARCEL_DATA_POOL_SIZE];
+            size_t              mParcelDataPoolCount;
+};
+
+// Batches the oneway transactions the calling thread makes while in scope,
+// e.g. a burst of listener callbacks:
+//
+//     OnewayTransactionBatch batch;
+//     for (auto& listener : listeners) listener->onEvent(event);
+class OnewayTransactionBatch
+{
+public:
+    OnewayTransactionBatch() : mState(IPCThreadState::self()) { mState->beginOnewayBatch(); }
+    ~OnewayTransactionBatch() { mState->endOnewayBatch(); }
+
+private:
+    OnewayTransactionBatch(const OnewayTransactionBatch&);
+    OnewayTransactionBatch& operator=(const OnewayTransactionBatch&);
+
+    IPCThreadState* const mState;
 };
 
 }; // namespace android
@@ -21,6 +21,7 @@
 #include <binder/IInterface.h>
 #include <utils/Vector.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -70,16 +71,33 @@ public:
      */
     virtual Vector<String16> listServices(int dumpsysFlags = DUMP_FLAG_PRIORITY_ALL) = 0;
 
+    /**
+     * Retrieve a service, blocking for up to timeout until it is
+     * registered. The service manager tells the caller as soon as the
+     * service is added, provided the process runs a binder thread pool to
+     * hear about it, otherwise this falls back to polling.
+     */
+    virtual sp<IBinder>         waitForService(const String16& name, nsecs_t timeout) const;
+
     enum {
         GET_SERVICE_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION,
         CHECK_SERVICE_TRANSACTION,
         ADD_SERVICE_TRANSACTION,
         LIST_SERVICES_TRANSACTION,
+        REGISTER_FOR_NOTIFICATIONS_TRANSACTION,
     };
 };
 
 sp<IServiceManager> defaultServiceManager();
 
+/**
+ * Lets defaultServiceManager() remember the services it retrieved until they
+ * die, so that looking them up again needs no call to the service manager.
+ * Off by default: a service replaced by another one registered under the same
+ * name while it is still alive is not noticed.
+ */
+void setServiceCacheEnabled(bool enabled);
+
 template<typename INTERFACE>
 status_t getService(const String16& name, sp<INTERFACE>* outService)
 {
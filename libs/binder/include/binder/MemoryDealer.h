@@ -27,15 +27,30 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
-class SimpleBestFitAllocator;
+class MemoryAllocator;
 
 // ----------------------------------------------------------------------------
 
 class MemoryDealer : public RefBase
 {
 public:
+    // How the allocations are carved out of the heap.
+    enum allocator_t {
+        // Best fit in a list of chunks, under a single lock. Packs any mix of
+        // sizes tightly, but slows down as the heap fragments.
+        BEST_FIT = 0,
+        // Power-of-two size classes of up to half a page, which take whole
+        // pages from the heap and recycle their blocks through lock-free free
+        // lists. Larger allocations take whole pages, best fit. Suits many
+        // small, short-lived allocations; the pages a size class takes stay
+        // with it for the life of the dealer.
+        SIZE_CLASSES = 1,
+    };
+
     MemoryDealer(size_t size, const char* name = 0,
             uint32_t flags = 0 /* or bits such as MemoryHeapBase::READ_ONLY */ );
+    MemoryDealer(size_t size, const char* name, uint32_t flags,
+            allocator_t allocator);
 
     virtual sp<IMemory> allocate(size_t size);
     virtual void        deallocate(size_t offset);
@@ -51,10 +66,10 @@ protected:
 
 private:
     const sp<IMemoryHeap>&      heap() const;
-    SimpleBestFitAllocator*     allocator() const;
+    MemoryAllocator*            allocator() const;
 
     sp<IMemoryHeap>             mHeap;
-    SimpleBestFitAllocator*     mAllocator;
+    MemoryAllocator*            mAllocator;
 };
 
 
@@ -231,6 +231,13 @@ public:
     // as long as it keeps a dup of the blob file descriptor handy for later.
     status_t            writeDupImmutableBlobFileDescriptor(int fd);
 
+    // Writes a buffer owned by the caller to the parcel.
+    // Large buffers are not copied into the parcel, the driver copies them
+    // straight into the receiving process by way of a scatter-gather buffer
+    // object instead. The data must stay valid and unchanged until the parcel
+    // has been sent or destroyed.
+    status_t            writeExternalBuffer(const void* data, size_t len);
+
     status_t            writeObject(const flat_binder_object& val, bool nullMetaData);
 
     // Like Parcel.java's writeNoException().  Just writes a zero int32.
@@ -375,6 +382,10 @@ public:
     // The caller should call release() on the blob after reading its contents.
     status_t            readBlob(size_t len, ReadableBlob* outBlob) const;
 
+    // Reads a buffer written with writeExternalBuffer(). The data belongs to
+    // the parcel and remains valid as long as the parcel's data does.
+    status_t            readExternalBuffer(const void** outData, size_t* outLen) const;
+
     const flat_binder_object* readObject(bool nullMetaData) const;
 
     // Explicitly close all file descriptors in the parcel.
@@ -383,6 +394,10 @@ public:
     // Debugging: get metrics on current allocations.
     static size_t       getGlobalAllocSize();
     static size_t       getGlobalAllocCount();
+    // The number of allocations served from, or missed by, the data buffers
+    // that binder threads keep around for reuse.
+    static size_t       getGlobalPoolHitCount();
+    static size_t       getGlobalPoolMissCount();
 
 private:
     typedef void        (*release_func)(Parcel* parcel,
@@ -394,6 +409,7 @@ private:
     size_t              ipcDataSize() const;
     uintptr_t           ipcObjects() const;
     size_t              ipcObjectsCount() const;
+    size_t              ipcBuffersSize() const;
     void                ipcSetDataReference(const uint8_t* data, size_t dataSize,
                                             const binder_size_t* objects, size_t objectsCount,
                                             release_func relFunc, void* relCookie);
@@ -409,12 +425,22 @@ private:
     void                releaseObjects();
     void                acquireObjects();
     status_t            growData(size_t len);
+    // Makes room for 'count' more objects and 'len' more bytes of data, so
+    // that writing a vector of them reallocates at most once.
+    status_t            reserveObjects(size_t count, size_t len);
+    status_t            readStrongBinders(std::vector<sp<IBinder>>* val,
+                                          bool nullable) const;
     status_t            restartWrite(size_t desired);
     status_t            continueWrite(size_t desired);
+    status_t            writeBufferObject(const binder_buffer_object& val);
+    const binder_buffer_object* readBufferObject() const;
+    bool                findObject(size_t pos) const;
     status_t            writePointer(uintptr_t val);
     status_t            readPointer(uintptr_t *pArg) const;
     uintptr_t           readPointer() const;
     void                freeDataNoInit();
+    static uint8_t*     allocData(size_t desired, size_t* outCapacity, bool* outPooled);
+    static void         releaseData(uint8_t* data, size_t capacity);
     void                initState();
     void                scanForFds() const;
     status_t            validateReadData(size_t len) const;
@@ -22,9 +22,12 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <utils/String16.h>
 #include <utils/Singleton.h>
 #include <utils/SortedVector.h>
+#include <utils/Timers.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -32,32 +35,71 @@ namespace android {
 /*
  * PermissionCache caches permission checks for a given uid.
  *
- * Currently the cache is not updated when there is a permission change,
- * for instance when an application is uninstalled.
+ * Grants are kept until the uid is invalidated, denials for
+ * DENIAL_TIMEOUT only, so that callers denied on every transaction don't
+ * cost a binder call each, yet see a permission granted to them later.
+ *
+ * The cache is not updated by itself when there is a permission change,
+ * for instance when an application is uninstalled, unless the process calls
+ * invalidateOnUidGone(): a uid's processes are killed when a permission is
+ * revoked from it or when it is uninstalled.
  *
  * IMPORTANT: for the reason stated above, only system permissions are safe
- * to cache. This restriction may be lifted at a later time.
+ * to cache in processes that don't. This restriction may be lifted at a
+ * later time.
  *
  */
 
 class PermissionCache : Singleton<PermissionCache> {
+public:
+    // how long a denial is cached
+    static const nsecs_t DENIAL_TIMEOUT = 5000000000LL; // 5s
+
+    struct Stats {
+        uint64_t    hits;
+        uint64_t    misses;
+        // the hits that returned a cached denial
+        uint64_t    deniedHits;
+        size_t      entries;
+    };
+
+private:
     struct Entry {
         String16    name;
         uid_t       uid;
         bool        granted;
+        // for denials, when the entry stops being used
+        nsecs_t     expires;
         inline bool operator < (const Entry& e) const {
             return (uid == e.uid) ? (name < e.name) : (uid < e.uid);
         }
     };
-    mutable Mutex mLock;
+
+    // the entries are spread over shards by uid, so that services checking
+    // the permissions of many callers don't contend for one lock
+    enum { NUM_SHARDS = 16 };
+    struct Shard {
+        mutable Mutex lock;
+        // this is our cache per say. it stores pooled names.
+        SortedVector< Entry > cache;
+    };
+
+    Shard mShards[NUM_SHARDS];
+    mutable Mutex mPoolLock;
     // we pool all the permission names we see, as many permissions checks
     // will have identical names
     SortedVector< String16 > mPermissionNamesPool;
-    // this is our cache per say. it stores pooled names.
-    SortedVector< Entry > mCache;
+
+    mutable std::atomic<uint64_t> mHits;
+    mutable std::atomic<uint64_t> mMisses;
+    mutable std::atomic<uint64_t> mDeniedHits;
+
+    Shard& shard(uid_t uid) { return mShards[uid % NUM_SHARDS]; }
+    const Shard& shard(uid_t uid) const { return mShards[uid % NUM_SHARDS]; }
 
     // free the whole cache, but keep the permission name pool
     void purge();
+    void purge(uid_t uid);
 
     status_t check(bool* granted,
             const String16& permission, uid_t uid) const;
@@ -74,6 +116,18 @@ public:
 
     static bool checkPermission(const String16& permission,
             pid_t pid, uid_t uid);
+
+    // Forget the permissions of uid, or of everyone, e.g. when the process
+    // learns about a permission change by itself.
+    static void invalidate(uid_t uid);
+    static void invalidateAll();
+
+    // Forget the permissions of a uid whenever all its processes are gone.
+    // This blocks until the activity manager is up; callingPackage is passed
+    // to it.
+    static void invalidateOnUidGone(const String16& callingPackage);
+
+    static Stats getStats();
 };
 
 // ---------------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #define ANDROID_PERSISTABLE_BUNDLE_H
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -42,6 +43,15 @@ public:
     status_t writeToParcel(Parcel* parcel) const override;
     status_t readFromParcel(const Parcel* parcel) override;
 
+    /*
+     * Makes readFromParcel() in this process keep the bundle's parcelled
+     * contents and an index of its keys rather than unpacking every value.
+     * Getters then read only the value they are asked for, writeToParcel()
+     * copies the contents back out as they are, and the first modification
+     * unpacks the whole bundle. Off by default.
+     */
+    static void setLazyUnparcel(bool lazy);
+
     bool empty() const;
     size_t size() const;
     size_t erase(const String16& key);
@@ -94,6 +104,9 @@ public:
     std::set<String16> getPersistableBundleKeys() const;
 
     friend bool operator==(const PersistableBundle& lhs, const PersistableBundle& rhs) {
+        if (lhs.mLazy != nullptr || rhs.mLazy != nullptr) {
+            return PersistableBundle::lazyEquals(lhs, rhs);
+        }
         return (lhs.mBoolMap == rhs.mBoolMap && lhs.mIntMap == rhs.mIntMap &&
                 lhs.mLongMap == rhs.mLongMap && lhs.mDoubleMap == rhs.mDoubleMap &&
                 lhs.mStringMap == rhs.mStringMap && lhs.mBoolVectorMap == rhs.mBoolVectorMap &&
@@ -109,8 +122,22 @@ public:
     }
 
 private:
+    struct LazyData;
+
     status_t writeToParcelInner(Parcel* parcel) const;
     status_t readFromParcelInner(const Parcel* parcel, size_t length);
+    status_t readEntries(const Parcel* parcel);
+    status_t readLazily(const Parcel* parcel, int32_t magic, size_t length);
+    void unparcel();
+    template <typename T>
+    bool getLazyValue(const String16& key, int32_t type,
+                      status_t (Parcel::*read)(T*) const, T* out) const;
+    std::set<String16> getLazyKeys(int32_t type) const;
+    static bool lazyEquals(const PersistableBundle& lhs, const PersistableBundle& rhs);
+
+    // Parcelled contents of a bundle read lazily, shared by its copies; the
+    // maps below are empty while this is set.
+    std::shared_ptr<LazyData> mLazy;
 
     std::map<String16, bool> mBoolMap;
     std::map<String16, int32_t> mIntMap;
@@ -26,6 +26,8 @@
 
 #include <pthread.h>
 
+#include <vector>
+
 // ---------------------------------------------------------------------------
 namespace android {
 
@@ -63,11 +65,26 @@ public:
 
             sp<IBinder>         getStrongProxyForHandle(int32_t handle);
             wp<IBinder>         getWeakProxyForHandle(int32_t handle);
+            // Like getStrongProxyForHandle() for each of the handles, taking
+            // the lock and growing the handle table once for all of them.
+            void                getStrongProxiesForHandles(
+                                    const std::vector<int32_t>& handles,
+                                    std::vector<sp<IBinder>>* outProxies);
             void                expungeHandle(int32_t handle, IBinder* binder);
 
             void                spawnPooledThread(bool isMain);
             
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
+
+            // Lets the number of pooled threads follow the load instead of
+            // the fixed ceiling above: the driver may start up to minThreads
+            // threads, the limit grows towards maxThreads whenever all of them
+            // are busy for a while, and threads retire again once the pool
+            // has been mostly idle.
+            status_t            setThreadPoolAdaptive(size_t minThreads, size_t maxThreads);
+
+            // Occupancy and starvation stats of the thread pool.
+            void                dumpThreadPool(String8& result);
             void                giveThreadPoolName();
 
             String8             getDriverName();
@@ -84,12 +101,21 @@ private:
             ProcessState&       operator=(const ProcessState& o);
             String8             makeBinderThreadName();
 
+            // These are called with mThreadCountLock held.
+            status_t            setDriverMaxThreadsLocked(size_t maxThreads);
+            bool                growThreadPoolLocked();
+            // Returns true if the calling thread, done with a command, should
+            // leave the pool.
+            bool                threadPoolCommandDoneLocked(int64_t starvationTimeMs,
+                                                            bool canRetire);
+
             struct handle_entry {
                 IBinder* binder;
                 RefBase::weakref_type* refs;
             };
 
             handle_entry*       lookupHandleLocked(int32_t handle);
+            sp<IBinder>         getStrongProxyForHandleLocked(int32_t handle);
 
             String8             mDriverName;
             int                 mDriverFD;
@@ -104,6 +130,25 @@ private:
             size_t              mMaxThreads;
             // Time when thread pool was emptied
             int64_t             mStarvationStartTimeMs;
+            // Number of threads started by the driver still in the pool.
+            size_t              mPooledThreadsCount;
+            // Pooled threads that left because the pool was idle. The driver
+            // keeps counting them against its limit.
+            size_t              mRetiredThreadsCount;
+            // Adaptive sizing, see setThreadPoolAdaptive().
+            bool                mAdaptiveThreadPool;
+            size_t              mAdaptiveMinThreads;
+            size_t              mAdaptiveMaxThreads;
+            // Most threads executing at once, overall and in the current
+            // window over which idleness is measured.
+            size_t              mPeakExecutingThreadsCount;
+            size_t              mWindowPeakExecutingThreadsCount;
+            int64_t             mWindowStartTimeMs;
+            // Starvation events, and callers blockUntilThreadAvailable() held.
+            size_t              mStarvationCount;
+            int64_t             mStarvationTotalTimeMs;
+            int64_t             mLongestStarvationTimeMs;
+            size_t              mBlockedCallersCount;
 
     mutable Mutex               mLock;  // protects everything below.
 
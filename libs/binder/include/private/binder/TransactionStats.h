@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
+#define ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <utils/Errors.h>
+#include <utils/String16.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Parcel;
+class String8;
+
+// Latency histograms of the transactions this process makes and serves, per
+// interface descriptor and transaction code, and the CPU time its binder
+// threads spend serving each calling uid. Recording is off by default, and
+// costs a single relaxed load per transaction until it is switched on through
+// IBinder::TRANSACTION_STATS_TRANSACTION.
+class TransactionStats
+{
+public:
+    enum Side {
+        CLIENT = 0,
+        SERVER = 1,
+    };
+
+    static TransactionStats& self();
+
+    static inline bool isEnabled() {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    // data is the transaction data, whose interface token names the entry
+    void record(Side side, const Parcel& data, uint32_t code, nsecs_t duration);
+
+    // cpuTime is the thread CPU time spent serving a transaction of uid
+    void recordCallerCpu(uid_t uid, nsecs_t cpuTime);
+
+    // Handles "enable", "disable" and "reset", and dumps the histograms to fd
+    // without arguments.
+    status_t command(int fd, const Vector<String16>& args);
+
+    void dump(String8& result) const;
+
+private:
+    // Bucket i counts the transactions that took less than 2^i us
+    enum { BUCKET_COUNT = 20 };
+    // Bounds the memory used when some process makes up codes
+    enum { MAX_ENTRIES = 1024 };
+    // Shown in the dump, the rest of the callers is summed up
+    enum { MAX_DUMPED_CALLERS = 32 };
+
+    struct Entry {
+        String16 descriptor;
+        uint32_t code;
+        Side side;
+        uint64_t count;
+        nsecs_t total;
+        nsecs_t max;
+        uint64_t buckets[BUCKET_COUNT];
+    };
+
+    struct CallerEntry {
+        uid_t uid;
+        uint64_t count;
+        nsecs_t cpuTime;
+        nsecs_t maxCpuTime;
+    };
+
+    TransactionStats() = default;
+
+    void reset();
+
+    static std::atomic<bool> sEnabled;
+
+    mutable std::mutex mLock;
+    // keyed by a hash of the entry's side, code and descriptor
+    std::unordered_map<uint64_t, Entry> mEntries;
+    uint64_t mDropped = 0;
+    // there are only so many uids, this needs no bound
+    std::unordered_map<uid_t, CallerEntry> mCallers;
+};
+
+}; // namespace android
+
+#endif // ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
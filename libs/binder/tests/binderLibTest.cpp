@@ -20,13 +20,18 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <gtest/gtest.h>
 
 #include <binder/Binder.h>
 #include <binder/IBinder.h>
+#include <binder/IMemory.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <binder/MemoryDealer.h>
 
 #include <sys/epoll.h>
 
@@ -70,6 +75,7 @@ enum BinderLibTestTranscationCode {
     BINDER_LIB_TEST_DELAYED_EXIT_TRANSACTION,
     BINDER_LIB_TEST_GET_PTR_SIZE_TRANSACTION,
     BINDER_LIB_TEST_CREATE_BINDER_TRANSACTION,
+    BINDER_LIB_TEST_GET_MEMORY_TRANSACTION,
 };
 
 pid_t start_server_process(int arg2, bool usePoll = false)
@@ -386,6 +392,26 @@ TEST_F(BinderLibTest, NopTransaction) {
     EXPECT_EQ(NO_ERROR, ret);
 }
 
+TEST_F(BinderLibTest, ParcelDataIsReused) {
+    const int kTransactions = 10;
+    status_t ret;
+    {
+        // warm up this thread's pool
+        Parcel data, reply;
+        data.writeInt32(0);
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    const size_t hits = Parcel::getGlobalPoolHitCount();
+    for (int i = 0; i < kTransactions; i++) {
+        Parcel data, reply;
+        data.writeInt32(i);
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    EXPECT_GE(Parcel::getGlobalPoolHitCount() - hits, (size_t)kTransactions);
+}
+
 TEST_F(BinderLibTest, SetError) {
     int32_t testValue[] = { 0, -123, 123 };
     for (size_t i = 0; i < ARRAY_SIZE(testValue); i++) {
@@ -543,6 +569,50 @@ TEST_F(BinderLibTest, CallBack)
     EXPECT_EQ(NO_ERROR, ret);
 }
 
+TEST_F(BinderLibTest, OnewayBatch)
+{
+    status_t ret;
+    sp<BinderLibTestCallBack> callBacks[3];
+
+    IPCThreadState::self()->beginOnewayBatch();
+    for (size_t i = 0; i < sizeof(callBacks) / sizeof(callBacks[0]); i++) {
+        // the parcels are gone by the time the batch is sent
+        Parcel data, reply;
+        callBacks[i] = new BinderLibTestCallBack();
+        data.writeStrongBinder(callBacks[i]);
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_CALL_BACK, data, &reply, TF_ONE_WAY);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    ret = IPCThreadState::self()->endOnewayBatch();
+    EXPECT_EQ(NO_ERROR, ret);
+
+    for (size_t i = 0; i < sizeof(callBacks) / sizeof(callBacks[0]); i++) {
+        ret = callBacks[i]->waitEvent(5);
+        EXPECT_EQ(NO_ERROR, ret);
+        ret = callBacks[i]->getResult();
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+}
+
+static void* addServiceLater(void* name)
+{
+    usleep(100000);
+    defaultServiceManager()->addService(*static_cast<String16*>(name), new BBinder());
+    return NULL;
+}
+
+TEST_F(BinderLibTest, WaitForService)
+{
+    String16 name(binderLibTestServiceName);
+    name.append(String16(".wait"));
+    pthread_t thread;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, addServiceLater, &name));
+    sp<IBinder> service = defaultServiceManager()->waitForService(name, s2ns(5));
+    EXPECT_TRUE(service != NULL);
+    pthread_join(thread, NULL);
+}
+
 TEST_F(BinderLibTest, AddServer)
 {
     sp<IBinder> server = addServer();
@@ -763,6 +833,79 @@ TEST_F(BinderLibTest, PassFile) {
     close(pipefd[0]);
 }
 
+static status_t sendTransactionStatsCommand(int fd, const char* arg) {
+    // any local binder reaches the stats of this process
+    sp<IBinder> binder = new BBinder();
+    Parcel data, reply;
+    data.writeFileDescriptor(fd);
+    if (arg != NULL) {
+        data.writeInt32(1);
+        data.writeString16(String16(arg));
+    } else {
+        data.writeInt32(0);
+    }
+    return binder->transact(IBinder::TRANSACTION_STATS_TRANSACTION, data, &reply);
+}
+
+TEST_F(BinderLibTest, TransactionStats) {
+    int ret;
+    int pipefd[2];
+    char buf[4096];
+
+    ret = pipe2(pipefd, O_NONBLOCK);
+    ASSERT_EQ(0, ret);
+
+    EXPECT_EQ(NO_ERROR, sendTransactionStatsCommand(pipefd[1], "reset"));
+    EXPECT_EQ(NO_ERROR, sendTransactionStatsCommand(pipefd[1], "enable"));
+    for (int i = 0; i < 3; i++) {
+        Parcel data, reply;
+        data.writeInterfaceToken(String16("binderLibTest.stats"));
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_TRANSACTION, data, &reply);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    EXPECT_EQ(NO_ERROR, sendTransactionStatsCommand(pipefd[1], "disable"));
+    EXPECT_EQ(NO_ERROR, sendTransactionStatsCommand(pipefd[1], NULL));
+    EXPECT_EQ(BAD_VALUE, sendTransactionStatsCommand(pipefd[1], "bogus"));
+
+    ret = read(pipefd[0], buf, sizeof(buf) - 1);
+    ASSERT_GT(ret, 0);
+    buf[ret] = '\0';
+    char expected[128];
+    snprintf(expected, sizeof(expected), "client binderLibTest.stats code=%u: count=3 ",
+             (unsigned)BINDER_LIB_TEST_NOP_TRANSACTION);
+    EXPECT_NE(nullptr, strstr(buf, expected)) << buf;
+    // this process serves no transactions of its own
+    EXPECT_NE(nullptr, strstr(buf, "Binder server CPU time by calling uid: 0 uids")) << buf;
+    EXPECT_NE(nullptr, strstr(buf, "Binder thread pool: ")) << buf;
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+TEST_F(BinderLibTest, AdaptiveThreadPoolRejectsBadRange) {
+    EXPECT_EQ(BAD_VALUE, ProcessState::self()->setThreadPoolAdaptive(4, 2));
+}
+
+TEST_F(BinderLibTest, Utf8AsUtf16RoundTrip) {
+    // ASCII runs of every length around the vector widths, alone and followed
+    // by two- and four-byte UTF-8 characters.
+    for (size_t len = 0; len < 40; len++) {
+        const std::string ascii(len, 'a');
+        for (const std::string& str : {ascii, ascii + "\xc3\xa9", ascii + "\xf0\x9f\x98\x80z"}) {
+            Parcel data;
+            EXPECT_EQ(NO_ERROR, data.writeUtf8AsUtf16(str));
+            data.setDataPosition(0);
+            String16 utf16;
+            EXPECT_EQ(NO_ERROR, data.readString16(&utf16));
+            EXPECT_EQ(String16(str.c_str()), utf16);
+            data.setDataPosition(0);
+            std::string utf8;
+            EXPECT_EQ(NO_ERROR, data.readUtf8FromUtf16(&utf8));
+            EXPECT_EQ(str, utf8);
+        }
+    }
+}
+
 TEST_F(BinderLibTest, PromoteLocal) {
     sp<IBinder> strong = new BBinder();
     wp<IBinder> weak = strong;
@@ -806,6 +949,33 @@ TEST_F(BinderLibTest, CheckHandleZeroBinderHighBitsZeroCookie) {
     EXPECT_EQ((uint64_t)0, (uint64_t)fb->binder >> 32);
 }
 
+TEST_F(BinderLibTest, StrongBinderVector) {
+    sp<IBinder> local = new BBinder();
+    std::vector<sp<IBinder>> binders = { m_server, local, m_server };
+    Parcel data;
+    EXPECT_EQ(NO_ERROR, data.writeStrongBinderVector(binders));
+    EXPECT_EQ(binders.size(), data.objectsCount());
+
+    std::vector<sp<IBinder>> readBinders;
+    data.setDataPosition(0);
+    EXPECT_EQ(NO_ERROR, data.readStrongBinderVector(&readBinders));
+    EXPECT_EQ(binders, readBinders);
+
+    binders.push_back(NULL);
+    std::unique_ptr<std::vector<sp<IBinder>>> nullable(
+            new std::vector<sp<IBinder>>(binders));
+    Parcel nullData;
+    EXPECT_EQ(NO_ERROR, nullData.writeStrongBinderVector(nullable));
+    nullData.setDataPosition(0);
+    EXPECT_EQ(NO_ERROR, nullData.readStrongBinderVector(&nullable));
+    ASSERT_TRUE(nullable != nullptr);
+    EXPECT_EQ(binders, *nullable);
+
+    // the null binder is not allowed in a non-nullable vector
+    nullData.setDataPosition(0);
+    EXPECT_EQ(UNEXPECTED_NULL, nullData.readStrongBinderVector(&readBinders));
+}
+
 TEST_F(BinderLibTest, FreedBinder) {
     status_t ret;
 
@@ -902,6 +1072,36 @@ TEST_F(BinderLibTest, OnewayQueueing)
     EXPECT_EQ(NO_ERROR, ret);
 }
 
+TEST_F(BinderLibTest, MemoryWithHeap)
+{
+    const size_t size = 100;
+    sp<IMemory> memory[2];
+    for (auto& m : memory) {
+        Parcel data, reply;
+        data.writeInt32(size);
+        EXPECT_EQ(NO_ERROR, m_server->transact(BINDER_LIB_TEST_GET_MEMORY_TRANSACTION,
+                        data, &reply));
+        m = IMemory::readFromParcel(reply);
+        ASSERT_TRUE(m != NULL);
+        EXPECT_EQ(0u, reply.dataAvail());
+    }
+
+    for (auto& m : memory) {
+        EXPECT_EQ(size, m->size());
+        const uint8_t* p = static_cast<const uint8_t*>(m->pointer());
+        ASSERT_TRUE(p != NULL);
+        EXPECT_EQ(ssize_t(size), std::count(p, p + size, 0xa5));
+    }
+    // both are mapped through the same mapping of their heap
+    EXPECT_EQ(memory[0]->getMemory()->base(), memory[1]->getMemory()->base());
+    EXPECT_NE(memory[0]->pointer(), memory[1]->pointer());
+
+    Parcel parcel;
+    EXPECT_EQ(NO_ERROR, IMemory::writeToParcel(&parcel, NULL));
+    parcel.setDataPosition(0);
+    EXPECT_TRUE(IMemory::readFromParcel(parcel) == NULL);
+}
+
 class BinderLibTestService : public BBinder
 {
     public:
@@ -1178,6 +1378,17 @@ class BinderLibTestService : public BBinder
                 }
                 return NO_ERROR;
             }
+            case BINDER_LIB_TEST_GET_MEMORY_TRANSACTION: {
+                if (m_dealer == NULL) {
+                    m_dealer = new MemoryDealer(4096, "binderLibTest");
+                }
+                sp<IMemory> memory = m_dealer->allocate(data.readInt32());
+                if (memory == NULL) {
+                    return NO_MEMORY;
+                }
+                memset(memory->pointer(), 0xa5, memory->size());
+                return IMemory::writeToParcel(reply, memory);
+            }
             default:
                 return UNKNOWN_TRANSACTION;
             };
@@ -1189,6 +1400,7 @@ class BinderLibTestService : public BBinder
         pthread_cond_t m_serverWaitCond;
         bool m_serverStartRequested;
         sp<IBinder> m_serverStarted;
+        sp<MemoryDealer> m_dealer;
         sp<IBinder> m_strongRef;
         bool m_callbackPending;
         sp<IBinder> m_callback;
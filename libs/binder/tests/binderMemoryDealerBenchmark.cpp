@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryDealer.h>
+
+#include <random>
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+const size_t kHeapSize = 8 << 20;
+// the allocations a client keeps alive at a time
+const size_t kLiveAllocations = 256;
+
+// One dealer per allocator, shared by the threads of a benchmark.
+sp<MemoryDealer> getDealer(MemoryDealer::allocator_t allocator) {
+    static sp<MemoryDealer> bestFit =
+            new MemoryDealer(kHeapSize, "BestFit", 0, MemoryDealer::BEST_FIT);
+    static sp<MemoryDealer> sizeClasses =
+            new MemoryDealer(kHeapSize, "SizeClasses", 0, MemoryDealer::SIZE_CLASSES);
+    return allocator == MemoryDealer::SIZE_CLASSES ? sizeClasses : bestFit;
+}
+
+// Allocates and frees one buffer of range(1) bytes at a time.
+void BM_AllocateFree(benchmark::State& state) {
+    sp<MemoryDealer> dealer = getDealer(MemoryDealer::allocator_t(state.range(0)));
+    while (state.KeepRunning()) {
+        sp<IMemory> memory = dealer->allocate(state.range(1));
+        if (memory == nullptr) {
+            state.SkipWithError("allocation failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_AllocateFree)->Apply([](benchmark::internal::Benchmark* b) {
+    for (int allocator : {MemoryDealer::BEST_FIT, MemoryDealer::SIZE_CLASSES}) {
+        for (int size : {64, 1024, 16 << 10}) {
+            b->Args({allocator, size});
+        }
+    }
+})->ThreadRange(1, 4);
+
+// Replaces random ones among kLiveAllocations buffers of random sizes of up to
+// range(1) bytes, which fragments the heap the way a busy media service does.
+void BM_Churn(benchmark::State& state) {
+    sp<MemoryDealer> dealer = getDealer(MemoryDealer::allocator_t(state.range(0)));
+    std::mt19937 random(state.thread_index);
+    std::uniform_int_distribution<size_t> size(1, state.range(1));
+    std::vector<sp<IMemory>> live(kLiveAllocations);
+    while (state.KeepRunning()) {
+        sp<IMemory>& memory = live[random() % live.size()];
+        memory.clear();
+        memory = dealer->allocate(size(random));
+        if (memory == nullptr) {
+            state.SkipWithError("allocation failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_Churn)->Apply([](benchmark::internal::Benchmark* b) {
+    for (int allocator : {MemoryDealer::BEST_FIT, MemoryDealer::SIZE_CLASSES}) {
+        for (int maxSize : {512, 2048}) {
+            b->Args({allocator, maxSize});
+        }
+    }
+})->ThreadRange(1, 4);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <binder/Binder.h>
+#include <binder/IBinder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/PersistableBundle.h>
+#include <binder/ProcessState.h>
+#include <utils/String8.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+const char kServiceName[] = "binderParcelBenchmark";
+
+enum BenchmarkServiceCode {
+    SEND_INPLACE = IBinder::FIRST_CALL_TRANSACTION,
+    SEND_EXTERNAL,
+};
+
+// Touches the payload in place, so that neither side makes any copy besides
+// the ones under test.
+class BenchmarkService : public BBinder {
+public:
+    status_t onTransact(uint32_t code, const Parcel& data, Parcel* reply,
+                        uint32_t /* flags */) override {
+        const void* payload = nullptr;
+        size_t len = 0;
+        switch (code) {
+            case SEND_INPLACE:
+                len = data.readInt32();
+                payload = data.readInplace(len);
+                break;
+            case SEND_EXTERNAL:
+                if (data.readExternalBuffer(&payload, &len) != NO_ERROR) {
+                    payload = nullptr;
+                }
+                break;
+            default:
+                return UNKNOWN_TRANSACTION;
+        }
+        if (payload == nullptr) {
+            return BAD_VALUE;
+        }
+        return reply->writeInt32(static_cast<const uint8_t*>(payload)[len - 1]);
+    }
+};
+
+sp<IBinder> gService;
+
+// The payload is copied into the parcel, then the driver copies the parcel.
+void BM_SendInplace(benchmark::State& state) {
+    const std::vector<uint8_t> payload(state.range(0), 0xa5);
+    while (state.KeepRunning()) {
+        Parcel data, reply;
+        data.writeByteVector(payload);
+        if (gService->transact(SEND_INPLACE, data, &reply) != NO_ERROR) {
+            state.SkipWithError("transact failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SendInplace)->RangeMultiplier(4)->Range(16 << 10, 512 << 10);
+
+// The driver gathers the payload straight from the caller's memory.
+void BM_SendExternal(benchmark::State& state) {
+    const std::vector<uint8_t> payload(state.range(0), 0xa5);
+    while (state.KeepRunning()) {
+        Parcel data, reply;
+        data.writeExternalBuffer(payload.data(), payload.size());
+        if (gService->transact(SEND_EXTERNAL, data, &reply) != NO_ERROR) {
+            state.SkipWithError("transact failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SendExternal)->RangeMultiplier(4)->Range(16 << 10, 512 << 10);
+
+// A string of |len| bytes, plain ASCII or with a two-byte UTF-8 character
+// every eight bytes.
+std::string makeUtf8String(size_t len, bool ascii) {
+    std::string str;
+    while (str.size() < len) {
+        if (!ascii && str.size() % 8 == 6 && str.size() + 2 <= len) {
+            str += "\xc3\xa9";
+        } else {
+            str += 'a' + str.size() % 26;
+        }
+    }
+    return str;
+}
+
+// Parcel-only string conversions; arg 0 is the length, arg 1 is 0 for plain
+// ASCII strings and 1 for mostly-ASCII ones.
+void BM_WriteUtf8AsUtf16(benchmark::State& state) {
+    const std::string str = makeUtf8String(state.range(0), state.range(1) == 0);
+    Parcel parcel;
+    while (state.KeepRunning()) {
+        parcel.setDataPosition(0);
+        parcel.writeUtf8AsUtf16(str);
+    }
+    state.SetBytesProcessed(state.iterations() * str.size());
+}
+BENCHMARK(BM_WriteUtf8AsUtf16)->RangeMultiplier(8)->Ranges({{8, 4 << 10}, {0, 1}});
+
+void BM_ReadUtf8FromUtf16(benchmark::State& state) {
+    const std::string str = makeUtf8String(state.range(0), state.range(1) == 0);
+    Parcel parcel;
+    parcel.writeUtf8AsUtf16(str);
+    std::string result;
+    while (state.KeepRunning()) {
+        parcel.setDataPosition(0);
+        parcel.readUtf8FromUtf16(&result);
+    }
+    state.SetBytesProcessed(state.iterations() * str.size());
+}
+BENCHMARK(BM_ReadUtf8FromUtf16)->RangeMultiplier(8)->Ranges({{8, 4 << 10}, {0, 1}});
+
+// Reads a bundle of arg 0 string and int extras and looks one of them up;
+// arg 1 is 0 to unpack the bundle eagerly and 1 to read it lazily.
+void BM_ReadPersistableBundle(benchmark::State& state) {
+    os::PersistableBundle bundle;
+    for (int i = 0; i < state.range(0); i++) {
+        String16 key(String8::format("android.intent.extra.KEY_%d", i));
+        if (i % 2 == 0) {
+            bundle.putString(key, String16("com.example.package.value"));
+        } else {
+            bundle.putInt(key, i);
+        }
+    }
+    Parcel parcel;
+    bundle.writeToParcel(&parcel);
+    const String16 key("android.intent.extra.KEY_1");
+
+    os::PersistableBundle::setLazyUnparcel(state.range(1) != 0);
+    while (state.KeepRunning()) {
+        parcel.setDataPosition(0);
+        os::PersistableBundle read;
+        read.readFromParcel(&parcel);
+        int32_t value;
+        benchmark::DoNotOptimize(read.getInt(key, &value));
+    }
+    os::PersistableBundle::setLazyUnparcel(false);
+}
+BENCHMARK(BM_ReadPersistableBundle)->RangeMultiplier(4)->Ranges({{4, 64}, {0, 1}});
+
+} // namespace
+
+int main(int argc, char** argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the service goes away with the benchmark
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        defaultServiceManager()->addService(String16(kServiceName), new BenchmarkService);
+        IPCThreadState::self()->joinThreadPool();
+        return EXIT_FAILURE;
+    }
+
+    ::benchmark::Initialize(&argc, argv);
+    gService = defaultServiceManager()->getService(String16(kServiceName));
+    if (gService == nullptr) {
+        fprintf(stderr, "failed to get %s\n", kServiceName);
+        kill(pid, SIGKILL);
+        return EXIT_FAILURE;
+    }
+    ::benchmark::RunSpecifiedBenchmarks();
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return EXIT_SUCCESS;
+}
@@ -8,9 +8,11 @@
 #include <cstdio>
 
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <tuple>
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
@@ -19,8 +21,20 @@ using namespace android;
 
 enum BinderWorkerServiceCode {
     BINDER_NOP = IBinder::FIRST_CALL_TRANSACTION,
+    // Relays the call to another worker until the depth it carries runs out.
+    BINDER_NESTED,
 };
 
+// What each transaction carries and how the servers handle it. These are set
+// from the command line before the workers fork.
+static int fd_count = 0;
+static int binder_count = 0;
+static int oneway_burst = 0;
+static int nested_depth = 0;
+static int server_delay_us = 0;
+static int server_count = 0;
+static int max_threads = 0;
+
 #define ASSERT_TRUE(cond) \
 do { \
     if (!(cond)) {\
@@ -34,19 +48,48 @@ class BinderWorkerService : public BBinder
 public:
     BinderWorkerService() {}
     ~BinderWorkerService() {}
+    void setPeers(const vector<sp<IBinder> >& peers) {
+        lock_guard<mutex> lock(m_lock);
+        m_peers = peers;
+    }
     virtual status_t onTransact(uint32_t code,
                                 const Parcel& data, Parcel* reply,
                                 uint32_t flags = 0) {
         (void)flags;
-        (void)data;
         (void)reply;
+        if (server_delay_us > 0) {
+            usleep(server_delay_us);
+        }
         switch (code) {
         case BINDER_NOP:
             return NO_ERROR;
+        case BINDER_NESTED: {
+            int32_t depth = data.readInt32();
+            sp<IBinder> peer = pickPeer();
+            // Peers are only known once every worker has started, so calls
+            // arriving earlier end here.
+            if (depth <= 0 || peer == nullptr) {
+                return NO_ERROR;
+            }
+            Parcel nestedData, nestedReply;
+            nestedData.writeInt32(depth - 1);
+            return peer->transact(BINDER_NESTED, nestedData, &nestedReply);
+        }
         default:
             return UNKNOWN_TRANSACTION;
         };
     }
+private:
+    sp<IBinder> pickPeer() {
+        lock_guard<mutex> lock(m_lock);
+        if (m_peers.empty()) {
+            return nullptr;
+        }
+        return m_peers[rand() % m_peers.size()];
+    }
+
+    mutex m_lock;
+    vector<sp<IBinder> > m_peers;
 };
 
 class Pipe {
@@ -184,6 +227,9 @@ void worker_fx(int num,
                Pipe p)
 {
     // Create BinderWorkerService and for go.
+    if (max_threads > 0) {
+        ProcessState::self()->setThreadPoolMaxThreadCount(max_threads);
+    }
     ProcessState::self()->startThreadPool();
     sp<IServiceManager> serviceMgr = defaultServiceManager();
     sp<BinderWorkerService> service = new BinderWorkerService;
@@ -194,33 +240,56 @@ void worker_fx(int num,
     p.wait();
 
     // If client/server pairs, then half the workers are
-    // servers and half are clients
-    int server_count = cs_pair ? worker_count / 2 : worker_count;
+    // servers and half are clients. With -S, that many
+    // workers are servers and the rest are clients.
+    bool dedicated_servers = cs_pair || server_count > 0;
+    int servers = server_count > 0 ? server_count : cs_pair ? worker_count / 2 : worker_count;
 
     // Get references to other binder services.
     cout << "Created BinderWorker" << num << endl;
     (void)worker_count;
     vector<sp<IBinder> > workers;
-    for (int i = 0; i < server_count; i++) {
+    for (int i = 0; i < servers; i++) {
         if (num == i)
             continue;
         workers.push_back(serviceMgr->getService(generateServiceName(i)));
     }
+    service->setPeers(workers);
+
+    int null_fd = -1;
+    if (fd_count > 0) {
+        null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        ASSERT_TRUE(null_fd >= 0);
+    }
+    uint32_t code = nested_depth > 0 ? BINDER_NESTED : BINDER_NOP;
 
     // Run the benchmark if client
     ProcResults results;
     chrono::time_point<chrono::high_resolution_clock> start, end;
-    for (int i = 0; (!cs_pair || num >= server_count) && i < iterations; i++) {
+    for (int i = 0; (!dedicated_servers || num >= servers) && i < iterations; i++) {
         Parcel data, reply;
-        int target = cs_pair ? num % server_count : rand() % workers.size();
+        int target = dedicated_servers ? num % servers : rand() % workers.size();
         int sz = payload_size;
 
+        if (code == BINDER_NESTED) {
+            data.writeInt32(nested_depth);
+        }
         while (sz >= sizeof(uint32_t)) {
             data.writeInt32(0);
             sz -= sizeof(uint32_t);
         }
+        for (int j = 0; j < fd_count; j++) {
+            data.writeFileDescriptor(null_fd);
+        }
+        for (int j = 0; j < binder_count; j++) {
+            data.writeStrongBinder(service);
+        }
+        // A oneway burst is timed up to the synchronous call that follows it.
         start = chrono::high_resolution_clock::now();
-        status_t ret = workers[target]->transact(BINDER_NOP, data, &reply);
+        for (int j = 0; j < oneway_burst; j++) {
+            workers[target]->transact(code, data, nullptr, IBinder::FLAG_ONEWAY);
+        }
+        status_t ret = workers[target]->transact(code, data, &reply);
         end = chrono::high_resolution_clock::now();
 
         uint64_t cur_time = uint64_t(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
@@ -329,6 +398,31 @@ void run_main(int iterations,
     }
 }
 
+// Times IPCThreadState::self(), which every transaction calls several times.
+// This runs in a child so that the parent never opens the binder driver,
+// which the workers must not inherit.
+void measure_self_lookup(int iterations)
+{
+    pid_t pid = fork();
+    if (pid) {
+        int status;
+        waitpid(pid, &status, 0);
+        return;
+    }
+
+    IPCThreadState::self();
+    chrono::time_point<chrono::high_resolution_clock> start, end;
+    start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        IPCThreadState* volatile self = IPCThreadState::self();
+        (void)self;
+    }
+    end = chrono::high_resolution_clock::now();
+    double ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    cout << "IPCThreadState::self(): " << ns / iterations << "ns" << endl;
+    exit(EXIT_SUCCESS);
+}
+
 int main(int argc, char *argv[])
 {
     int workers = 2;
@@ -336,6 +430,7 @@ int main(int argc, char *argv[])
     int payload_size = 0;
     bool cs_pair = false;
     bool training_round = false;
+    bool self_lookup = false;
     (void)argc;
     (void)argv;
 
@@ -343,11 +438,19 @@ int main(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         if (string(argv[i]) == "--help") {
             cout << "Usage: binderThroughputTest [OPTIONS]" << endl;
+            cout << "\t-b N    : Send N binder objects with each transaction." << endl;
+            cout << "\t-d N    : Make servers take N microseconds per transaction." << endl;
+            cout << "\t-f N    : Send N file descriptors with each transaction." << endl;
             cout << "\t-i N    : Specify number of iterations." << endl;
+            cout << "\t-l      : Also time IPCThreadState::self() lookups." << endl;
             cout << "\t-m N    : Specify expected max latency in microseconds." << endl;
+            cout << "\t-n N    : Have servers relay each call N levels deep." << endl;
+            cout << "\t-o N    : Precede each call with a burst of N oneway calls." << endl;
             cout << "\t-p      : Split workers into client/server pairs." << endl;
             cout << "\t-s N    : Specify payload size." << endl;
+            cout << "\t-S N    : Make N workers servers and the rest clients." << endl;
             cout << "\t-t N    : Run training round." << endl;
+            cout << "\t-T N    : Limit each worker's binder thread pool to N threads." << endl;
             cout << "\t-w N    : Specify total number of workers." << endl;
             return 0;
         }
@@ -364,6 +467,30 @@ int main(int argc, char *argv[])
         if (string(argv[i]) == "-s") {
             payload_size = atoi(argv[i+1]);
             i++;
+            continue;
+        }
+        if (string(argv[i]) == "-b" || string(argv[i]) == "-d" || string(argv[i]) == "-f" ||
+                string(argv[i]) == "-n" || string(argv[i]) == "-o" || string(argv[i]) == "-S" ||
+                string(argv[i]) == "-T") {
+            if (i + 1 >= argc || atoi(argv[i+1]) < 0) {
+                cout << argv[i] << " needs a non-negative count." << endl;
+                exit(EXIT_FAILURE);
+            }
+            int value = atoi(argv[i+1]);
+            switch (argv[i][1]) {
+            case 'b': binder_count = value; break;
+            case 'd': server_delay_us = value; break;
+            case 'f': fd_count = value; break;
+            case 'n': nested_depth = value; break;
+            case 'o': oneway_burst = value; break;
+            case 'S': server_count = value; break;
+            case 'T': max_threads = value; break;
+            }
+            i++;
+            continue;
+        }
+        if (string(argv[i]) == "-l") {
+            self_lookup = true;
         }
         if (string(argv[i]) == "-p") {
             // client/server pairs instead of spreading
@@ -390,6 +517,16 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (server_count >= workers) {
+        cout << "-S needs to leave at least one client among the " << workers << " workers."
+             << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (self_lookup) {
+        measure_self_lookup(iterations * 100);
+    }
+
     if (training_round) {
         cout << "Start training round" << endl;
         run_main(iterations, workers, payload_size, cs_pair, training_round=true);
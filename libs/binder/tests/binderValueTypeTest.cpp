@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits>
 #include <cstddef>
 #include <vector>
@@ -109,3 +110,67 @@ TEST(ValueType, HandlesSwap) {
     ASSERT_TRUE(value_b.getInt(&int_x));
     ASSERT_EQ(31337, int_x);
 }
+
+static PersistableBundle makeTestBundle() {
+    PersistableBundle nested;
+    nested.putString(String16("name"), String16("Lovely"));
+
+    PersistableBundle bundle;
+    bundle.putBoolean(String16("bool"), true);
+    bundle.putInt(String16("int"), 31337);
+    bundle.putLong(String16("long"), 13370133701337l);
+    bundle.putDouble(String16("double"), 3.14159265358979323846);
+    bundle.putString(String16("string"), String16("Lovely"));
+    bundle.putBooleanVector(String16("bools"), {true, false});
+    bundle.putIntVector(String16("ints"), {31337, 0});
+    bundle.putLongVector(String16("longs"), {13370133701337l});
+    bundle.putDoubleVector(String16("doubles"), {});
+    bundle.putStringVector(String16("strings"), {String16("Lovely"), String16()});
+    bundle.putPersistableBundle(String16("bundle"), nested);
+    return bundle;
+}
+
+TEST(PersistableBundle, HandlesLazyUnparcel) {
+    const PersistableBundle bundle = makeTestBundle();
+    android::Parcel parcel;
+    ASSERT_EQ(android::NO_ERROR, bundle.writeToParcel(&parcel));
+
+    PersistableBundle::setLazyUnparcel(true);
+    PersistableBundle lazy;
+    parcel.setDataPosition(0);
+    ASSERT_EQ(android::NO_ERROR, lazy.readFromParcel(&parcel));
+    PersistableBundle::setLazyUnparcel(false);
+    ASSERT_EQ(parcel.dataSize(), parcel.dataPosition());
+
+    ASSERT_EQ(bundle.size(), lazy.size());
+    ASSERT_EQ(bundle.getIntKeys(), lazy.getIntKeys());
+    ASSERT_EQ(bundle.getStringVectorKeys(), lazy.getStringVectorKeys());
+    int32_t int_x;
+    ASSERT_TRUE(lazy.getInt(String16("int"), &int_x));
+    ASSERT_EQ(31337, int_x);
+    ASSERT_FALSE(lazy.getInt(String16("long"), &int_x));
+    ASSERT_FALSE(lazy.getInt(String16("missing"), &int_x));
+    vector<String16> strings;
+    ASSERT_TRUE(lazy.getStringVector(String16("strings"), &strings));
+    ASSERT_EQ(2u, strings.size());
+    PersistableBundle nested;
+    ASSERT_TRUE(lazy.getPersistableBundle(String16("bundle"), &nested));
+    String16 name;
+    ASSERT_TRUE(nested.getString(String16("name"), &name));
+    ASSERT_EQ(String16("Lovely"), name);
+    ASSERT_EQ(bundle, lazy);
+
+    // Written back out unchanged...
+    android::Parcel copy;
+    ASSERT_EQ(android::NO_ERROR, lazy.writeToParcel(&copy));
+    ASSERT_EQ(parcel.dataSize(), copy.dataSize());
+    ASSERT_EQ(0, memcmp(parcel.data(), copy.data(), parcel.dataSize()));
+
+    // ...and unpacked when modified.
+    lazy.putInt(String16("int"), 0);
+    ASSERT_EQ(bundle.size(), lazy.size());
+    ASSERT_NE(bundle, lazy);
+    int64_t long_x;
+    ASSERT_TRUE(lazy.getLong(String16("long"), &long_x));
+    ASSERT_EQ(13370133701337l, long_x);
+}
@@ -15,10 +15,8 @@
  * limitations under the License.
  */
 
-#include <dirent.h>
-#include <fcntl.h>
+#include <stddef.h>
 #include <sys/stat.h>
-#include <unistd.h>
 
 #include <diskusage/dirsize.h>
 
@@ -29,43 +27,5 @@ int64_t stat_size(struct stat *s)
 
 int64_t calculate_dir_size(int dfd)
 {
-    int64_t size = 0;
-    struct stat s;
-    DIR *d;
-    struct dirent *de;
-
-    d = fdopendir(dfd);
-    if (d == NULL) {
-        close(dfd);
-        return 0;
-    }
-
-    while ((de = readdir(d))) {
-        const char *name = de->d_name;
-        if (de->d_type == DT_DIR) {
-            int subfd;
-
-            /* always skip "." and ".." */
-            if (name[0] == '.') {
-                if (name[1] == 0)
-                    continue;
-                if ((name[1] == '.') && (name[2] == 0))
-                    continue;
-            }
-
-            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-                size += stat_size(&s);
-            }
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-            if (subfd >= 0) {
-                size += calculate_dir_size(subfd);
-            }
-        } else {
-            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-                size += stat_size(&s);
-            }
-        }
-    }
-    closedir(d);
-    return size;
+    return calculate_dir_size_filtered(dfd, 0, NULL, NULL, 0);
 }
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <diskusage/dirsize.h>
+
+namespace {
+
+// Walking a tree with more threads than this mostly makes them compete for
+// the disk.
+constexpr int kDefaultMaxThreads = 4;
+constexpr size_t kDirentBufferSize = 32 * 1024;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// An open directory, closed once it has been read and all its
+// subdirectories have been opened.
+struct DirFd {
+    explicit DirFd(int fd) : fd(fd) {}
+    ~DirFd() { close(fd); }
+    const int fd;
+};
+
+// A directory to walk: name under parent, or fd for the root.
+struct Task {
+    std::shared_ptr<DirFd> parent;
+    std::string name;
+    int fd = -1;
+};
+
+class TreeWalk {
+public:
+    TreeWalk(int flags, dirsize_filter_t filter, void* cookie, int threads)
+        : mFlags(flags), mFilter(filter), mCookie(cookie), mQueues(threads) {}
+
+    int64_t run(int dfd) {
+        struct stat s;
+        if (fstat(dfd, &s) != 0) {
+            close(dfd);
+            return 0;
+        }
+        mDev = s.st_dev;
+
+        Task root;
+        root.fd = dfd;
+        push(0, std::move(root));
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < mQueues.size(); i++) {
+            threads.emplace_back([this, i]() { work(i); });
+        }
+        work(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return mSize;
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void push(size_t self, Task&& task) {
+        mPending++;
+        {
+            std::lock_guard<std::mutex> lock(mQueues[self].lock);
+            mQueues[self].tasks.push_back(std::move(task));
+        }
+        wake();
+    }
+
+    void wake() {
+        mWakeups++;
+        if (mIdle > 0) {
+            std::lock_guard<std::mutex> lock(mIdleLock);
+            mIdleCond.notify_all();
+        }
+    }
+
+    // Takes the last directory this thread queued, which keeps its walk depth
+    // first and the open directories few, or else steals the first one
+    // another thread queued, which likely has the most under it.
+    bool take(size_t self, Task* task) {
+        for (;;) {
+            const uint64_t wakeups = mWakeups;
+            for (size_t i = 0; i < mQueues.size(); i++) {
+                Queue& queue = mQueues[(self + i) % mQueues.size()];
+                std::lock_guard<std::mutex> lock(queue.lock);
+                if (!queue.tasks.empty()) {
+                    if (i == 0) {
+                        *task = std::move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                    } else {
+                        *task = std::move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                    }
+                    return true;
+                }
+            }
+            if (mPending == 0) {
+                return false;
+            }
+            // Sleep until a directory is queued or the last one is done.
+            std::unique_lock<std::mutex> lock(mIdleLock);
+            mIdle++;
+            mIdleCond.wait(lock, [&]() { return mWakeups != wakeups; });
+            mIdle--;
+        }
+    }
+
+    void work(size_t self) {
+        std::unique_ptr<char[]> buffer(new char[kDirentBufferSize]);
+        int64_t size = 0;
+        Task task;
+        while (take(self, &task)) {
+            size += walk(self, &task, buffer.get());
+            if (--mPending == 0) {
+                wake();
+            }
+        }
+        mSize += size;
+    }
+
+    int64_t walk(size_t self, Task* task, char* buffer) {
+        int fd = task->fd;
+        if (fd < 0) {
+            fd = openat(task->parent->fd, task->name.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        }
+        task->parent.reset();
+        if (fd < 0) {
+            return 0;
+        }
+        auto dir = std::make_shared<DirFd>(fd);
+
+        int64_t size = 0;
+        long n;
+        while ((n = syscall(__NR_getdents64, fd, buffer, kDirentBufferSize)) > 0) {
+            for (long pos = 0; pos < n;) {
+                const linux_dirent64* de = reinterpret_cast<linux_dirent64*>(buffer + pos);
+                pos += de->d_reclen;
+
+                const char* name = de->d_name;
+                /* always skip "." and ".." */
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                    continue;
+                }
+
+                struct stat s;
+                if (fstatat(fd, name, &s, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                const int what = mFilter ? mFilter(&s, mCookie)
+                                         : DIRSIZE_MEASURE | DIRSIZE_DESCEND;
+                if (what & DIRSIZE_MEASURE) {
+                    size += stat_size(&s);
+                }
+                if (S_ISDIR(s.st_mode) && (what & DIRSIZE_DESCEND) &&
+                        !((mFlags & DIRSIZE_XDEV) && s.st_dev != mDev)) {
+                    Task child;
+                    child.parent = dir;
+                    child.name = name;
+                    push(self, std::move(child));
+                }
+            }
+        }
+        return size;
+    }
+
+    const int mFlags;
+    const dirsize_filter_t mFilter;
+    void* const mCookie;
+    dev_t mDev = 0;
+
+    std::vector<Queue> mQueues;
+    // the directories queued or being walked
+    std::atomic<size_t> mPending{0};
+    std::atomic<int64_t> mSize{0};
+
+    std::mutex mIdleLock;
+    std::condition_variable mIdleCond;
+    std::atomic<int> mIdle{0};
+    std::atomic<uint64_t> mWakeups{0};
+};
+
+} // namespace
+
+int64_t calculate_dir_size_filtered(int dfd, int flags, dirsize_filter_t filter,
+                                    void* cookie, int max_threads) {
+    if (max_threads <= 0) {
+        max_threads = std::min<int>(std::max<int>(std::thread::hardware_concurrency(), 1),
+                                    kDefaultMaxThreads);
+    }
+    TreeWalk walk(flags, filter, cookie, max_threads);
+    return walk.run(dfd);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <graphicsenv/GpuStats.h>
+
+#include <binder/Parcel.h>
+
+#define RETURN_ON_ERROR(X) do {status_t res = (X); if (res != NO_ERROR) return res;} while(false)
+
+namespace android {
+
+status_t GpuStats::writeToParcel(Parcel* parcel) const {
+    RETURN_ON_ERROR(parcel->writeUint64(blobCacheHits));
+    RETURN_ON_ERROR(parcel->writeUint64(blobCacheMisses));
+    RETURN_ON_ERROR(parcel->writeUint64(blobCacheSystemHits));
+    RETURN_ON_ERROR(parcel->writeUint64(blobCacheEvictions));
+    RETURN_ON_ERROR(parcel->writeUint64(blobCacheTotalSize));
+    RETURN_ON_ERROR(parcel->writeUint64(shaderCompiles));
+    RETURN_ON_ERROR(parcel->writeInt64(shaderCompileNs));
+    RETURN_ON_ERROR(parcel->writeUint64(programLinks));
+    RETURN_ON_ERROR(parcel->writeInt64(programLinkNs));
+    RETURN_ON_ERROR(parcel->writeInt64(driverLoadNs));
+    return NO_ERROR;
+}
+
+status_t GpuStats::readFromParcel(const Parcel* parcel) {
+    RETURN_ON_ERROR(parcel->readUint64(&blobCacheHits));
+    RETURN_ON_ERROR(parcel->readUint64(&blobCacheMisses));
+    RETURN_ON_ERROR(parcel->readUint64(&blobCacheSystemHits));
+    RETURN_ON_ERROR(parcel->readUint64(&blobCacheEvictions));
+    RETURN_ON_ERROR(parcel->readUint64(&blobCacheTotalSize));
+    RETURN_ON_ERROR(parcel->readUint64(&shaderCompiles));
+    RETURN_ON_ERROR(parcel->readInt64(&shaderCompileNs));
+    RETURN_ON_ERROR(parcel->readUint64(&programLinks));
+    RETURN_ON_ERROR(parcel->readInt64(&programLinkNs));
+    RETURN_ON_ERROR(parcel->readInt64(&driverLoadNs));
+    return NO_ERROR;
+}
+
+bool GpuStats::operator==(const GpuStats& other) const {
+    return blobCacheHits == other.blobCacheHits &&
+            blobCacheMisses == other.blobCacheMisses &&
+            blobCacheSystemHits == other.blobCacheSystemHits &&
+            blobCacheEvictions == other.blobCacheEvictions &&
+            blobCacheTotalSize == other.blobCacheTotalSize &&
+            shaderCompiles == other.shaderCompiles &&
+            shaderCompileNs == other.shaderCompileNs &&
+            programLinks == other.programLinks &&
+            programLinkNs == other.programLinkNs &&
+            driverLoadNs == other.driverLoadNs;
+}
+
+} // namespace android
@@ -18,9 +18,15 @@
 #define LOG_TAG "GraphicsEnv"
 #include <graphicsenv/GraphicsEnv.h>
 
+#include <unistd.h>
+
+#include <initializer_list>
 #include <mutex>
 
 #include <android/dlext.h>
+#include <binder/IServiceManager.h>
+#include <cutils/properties.h>
+#include <graphicsenv/IGpuService.h>
 #include <log/log.h>
 
 // TODO(b/37049319) Get this from a header once one exists
@@ -47,6 +53,18 @@ namespace android {
 }
 
 void GraphicsEnv::setDriverPath(const std::string path) {
+    std::lock_guard<std::mutex> lock(mDriverLock);
+    if (mDriverPreloaded && path != mDriverPath) {
+        // The preloaded namespace stays alive, but won't be used for drivers
+        // loaded from now on.
+        ALOGV("switching driver path from preloaded '%s' to '%s'", mDriverPath.c_str(),
+                path.c_str());
+        mDriverPath = path;
+        mDriverPreloaded = false;
+        mDriverNamespace = nullptr;
+        mDriverNamespaceCreated = false;
+        return;
+    }
     if (!mDriverPath.empty()) {
         ALOGV("ignoring attempt to change driver path from '%s' to '%s'",
                 mDriverPath.c_str(), path.c_str());
@@ -82,26 +100,114 @@ void GraphicsEnv::setDebugLayers(const std::string layers) {
     mDebugLayers = layers;
 }
 
+void GraphicsEnv::setLayerCacheFilename(const std::string filename) {
+    ALOGV("setting Vulkan layer cache to '%s'", filename.c_str());
+    mLayerCacheFilename = filename;
+}
+
+const std::string GraphicsEnv::getLayerCacheFilename() {
+    return mLayerCacheFilename;
+}
+
+void GraphicsEnv::setBlobCacheMaxTotalSize(size_t size) {
+    ALOGV("setting blob cache total size to %zu", size);
+    mBlobCacheMaxTotalSize = size;
+}
+
+size_t GraphicsEnv::getBlobCacheMaxTotalSize() {
+    return mBlobCacheMaxTotalSize;
+}
+
+void GraphicsEnv::sendGpuStats(const GpuStats& stats) {
+    sp<IGpuService> gpuService;
+    {
+        std::lock_guard<std::mutex> lock(mGpuServiceLock);
+        if (mGpuService == nullptr || !IInterface::asBinder(mGpuService)->isBinderAlive()) {
+            // checkService doesn't wait for the service to start.
+            sp<IBinder> binder = defaultServiceManager()->checkService(String16("gpu"));
+            mGpuService = interface_cast<IGpuService>(binder);
+        }
+        gpuService = mGpuService;
+    }
+    if (gpuService == nullptr) {
+        ALOGV("no GPU service to send the GPU stats to");
+        return;
+    }
+    gpuService->setGpuStats(getpid(), stats);
+}
+
 android_namespace_t* GraphicsEnv::getDriverNamespace() {
-    static std::once_flag once;
-    std::call_once(once, [this]() {
-        if (mDriverPath.empty())
-            return;
-        // If the sphal namespace isn't configured for a device, don't support updatable drivers.
-        // We need a parent namespace to inherit the default search path from.
-        auto sphalNamespace = android_get_exported_namespace("sphal");
-        if (!sphalNamespace) return;
-        mDriverNamespace = android_create_namespace("gfx driver",
-                                                    nullptr,             // ld_library_path
-                                                    mDriverPath.c_str(), // default_library_path
-                                                    ANDROID_NAMESPACE_TYPE_SHARED |
-                                                            ANDROID_NAMESPACE_TYPE_ISOLATED,
-                                                    nullptr, // permitted_when_isolated_path
-                                                    sphalNamespace);
-    });
+    std::lock_guard<std::mutex> lock(mDriverLock);
+    return getDriverNamespaceLocked();
+}
+
+android_namespace_t* GraphicsEnv::getDriverNamespaceLocked() {
+    if (mDriverNamespaceCreated || mDriverPath.empty()) {
+        return mDriverNamespace;
+    }
+    mDriverNamespaceCreated = true;
+
+    // If the sphal namespace isn't configured for a device, don't support updatable drivers.
+    // We need a parent namespace to inherit the default search path from.
+    auto sphalNamespace = android_get_exported_namespace("sphal");
+    if (!sphalNamespace) return nullptr;
+    mDriverNamespace = android_create_namespace("gfx driver",
+                                                nullptr,             // ld_library_path
+                                                mDriverPath.c_str(), // default_library_path
+                                                ANDROID_NAMESPACE_TYPE_SHARED |
+                                                        ANDROID_NAMESPACE_TYPE_ISOLATED,
+                                                nullptr, // permitted_when_isolated_path
+                                                sphalNamespace);
     return mDriverNamespace;
 }
 
+// Loads <prefix><subname>.so from the namespace, with the subname taken from the first of
+// the properties that names a library there, the way libEGL and libvulkan look for drivers.
+// The library is never unloaded, so that the drivers find it already loaded.
+static bool preloadLibrary(android_namespace_t* ns, const char* prefix,
+                           std::initializer_list<const char*> subnameProperties) {
+    const android_dlextinfo dlextinfo = {
+            .flags = ANDROID_DLEXT_USE_NAMESPACE,
+            .library_namespace = ns,
+    };
+    char prop[PROPERTY_VALUE_MAX];
+    for (auto key : subnameProperties) {
+        if (property_get(key, prop, nullptr) <= 0) continue;
+        const std::string name = std::string(prefix) + prop + ".so";
+        if (android_dlopen_ext(name.c_str(), RTLD_LOCAL | RTLD_NOW, &dlextinfo)) {
+            ALOGV("preloaded %s", name.c_str());
+            return true;
+        }
+    }
+    return false;
+}
+
+void GraphicsEnv::preloadDriver(const std::string path) {
+    std::lock_guard<std::mutex> lock(mDriverLock);
+    if (!mDriverPath.empty()) {
+        ALOGV("ignoring attempt to preload driver '%s' with driver path '%s' set", path.c_str(),
+                mDriverPath.c_str());
+        return;
+    }
+    ALOGV("preloading driver from '%s'", path.c_str());
+    mDriverPath = path;
+    mDriverPreloaded = true;
+
+    android_namespace_t* ns = getDriverNamespaceLocked();
+    if (!ns) return;
+
+    // See Loader::load_updated_driver in libEGL.
+    const auto eglProperties = {"ro.hardware.egl", "ro.board.platform"};
+    if (!preloadLibrary(ns, "libGLES_", eglProperties)) {
+        preloadLibrary(ns, "libEGL_", eglProperties);
+        preloadLibrary(ns, "libGLESv1_CM_", eglProperties);
+        preloadLibrary(ns, "libGLESv2_", eglProperties);
+    }
+
+    // See LoadDriver in libvulkan.
+    preloadLibrary(ns, "vulkan.", {"ro.hardware.vulkan", "ro.board.platform"});
+}
+
 } // namespace android
 
 extern "C" android_namespace_t* android_getDriverNamespace() {
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GRAPHICSENV_GPU_STATS_H
+#define ANDROID_GRAPHICSENV_GPU_STATS_H
+
+#include <stdint.h>
+
+#include <binder/Parcelable.h>
+
+namespace android {
+
+/*
+ * The GPU setup costs of a process, that EGL reports to the GPU service.
+ * The counts are totals since the process started.
+ */
+class GpuStats : public Parcelable {
+public:
+    GpuStats() = default;
+    virtual ~GpuStats() = default;
+
+    virtual status_t writeToParcel(Parcel* parcel) const;
+    virtual status_t readFromParcel(const Parcel* parcel);
+
+    bool operator==(const GpuStats& other) const;
+    bool operator!=(const GpuStats& other) const { return !(*this == other); }
+
+    // EGL blob cache lookups; systemHits are the misses found in the system cache.
+    uint64_t blobCacheHits = 0;
+    uint64_t blobCacheMisses = 0;
+    uint64_t blobCacheSystemHits = 0;
+    uint64_t blobCacheEvictions = 0;
+    uint64_t blobCacheTotalSize = 0;
+    // glCompileShader and glLinkProgram calls, and the time spent in them.
+    uint64_t shaderCompiles = 0;
+    int64_t shaderCompileNs = 0;
+    uint64_t programLinks = 0;
+    int64_t programLinkNs = 0;
+    // The time it took to load the EGL and GLES driver, 0 if it isn't loaded.
+    int64_t driverLoadNs = 0;
+};
+
+} // namespace android
+
+#endif // ANDROID_GRAPHICSENV_GPU_STATS_H
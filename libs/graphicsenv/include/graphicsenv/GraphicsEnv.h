@@ -17,12 +17,18 @@
 #ifndef ANDROID_UI_GRAPHICS_ENV_H
 #define ANDROID_UI_GRAPHICS_ENV_H 1
 
+#include <mutex>
 #include <string>
 
+#include <utils/StrongPointer.h>
+
 struct android_namespace_t;
 
 namespace android {
 
+class GpuStats;
+class IGpuService;
+
 class GraphicsEnv {
 public:
     static GraphicsEnv& getInstance();
@@ -35,6 +41,13 @@ public:
     void setDriverPath(const std::string path);
     android_namespace_t* getDriverNamespace();
 
+    // Set the driver path, then create the driver namespace and load the GLES
+    // and Vulkan drivers in it right away. This is meant for the zygote, so
+    // that the apps forked from it share the loaded drivers copy-on-write
+    // rather than each loading them again. Forked processes use this driver
+    // unless they set a different driver path before loading a driver.
+    void preloadDriver(const std::string path);
+
     void setLayerPaths(android_namespace_t* appNamespace, const std::string layerPaths);
     android_namespace_t* getAppNamespace();
     const std::string getLayerPaths();
@@ -42,13 +55,38 @@ public:
     void setDebugLayers(const std::string layers);
     const std::string getDebugLayers();
 
+    // Set a file the Vulkan loader can cache the layers it finds in the layer
+    // search paths in, e.g. in the app's code cache directory, so that layer
+    // libraries that haven't changed aren't loaded just to enumerate them.
+    void setLayerCacheFilename(const std::string filename);
+    const std::string getLayerCacheFilename();
+
+    // Set the total size of the EGL blob cache of this process, overriding
+    // the device default, e.g. for apps that compile many shaders. It must be
+    // set before EGL is initialized; 0 restores the device default.
+    void setBlobCacheMaxTotalSize(size_t size);
+    size_t getBlobCacheMaxTotalSize();
+
+    // Send the GPU statistics of this process to the GPU service, e.g. for
+    // dumpsys gpu. Does nothing if the service isn't running.
+    void sendGpuStats(const GpuStats& stats);
+
 private:
     GraphicsEnv() = default;
+    android_namespace_t* getDriverNamespaceLocked();
+
+    std::mutex mDriverLock;
     std::string mDriverPath;
+    bool mDriverPreloaded = false;
+    bool mDriverNamespaceCreated = false;
     std::string mDebugLayers;
     std::string mLayerPaths;
+    std::string mLayerCacheFilename;
+    size_t mBlobCacheMaxTotalSize = 0;
     android_namespace_t* mDriverNamespace = nullptr;
     android_namespace_t* mAppNamespace = nullptr;
+    std::mutex mGpuServiceLock;
+    sp<IGpuService> mGpuService;
 };
 
 } // namespace android
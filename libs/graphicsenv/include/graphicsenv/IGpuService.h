@@ -0,0 +1,57 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GRAPHICSENV_IGPUSERVICE_H
+#define ANDROID_GRAPHICSENV_IGPUSERVICE_H
+
+#include <sys/types.h>
+
+#include <binder/IInterface.h>
+#include <graphicsenv/GpuStats.h>
+
+namespace android {
+
+/*
+ * This class defines the Binder IPC interface for GPU-related queries and
+ * control.
+ */
+class IGpuService : public IInterface {
+public:
+    DECLARE_META_INTERFACE(GpuService);
+
+    // Records the GPU statistics of process pid, replacing the ones it
+    // reported before.  This is a one-way call: one-way calls don't carry the
+    // caller's PID, so processes report their own.
+    virtual void setGpuStats(pid_t pid, const GpuStats& stats) = 0;
+};
+
+class BnGpuService: public BnInterface<IGpuService> {
+public:
+    enum {
+        SET_GPU_STATS = IBinder::FIRST_CALL_TRANSACTION,
+    };
+
+protected:
+    virtual status_t shellCommand(int in, int out, int err,
+        Vector<String16>& args) = 0;
+
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags = 0) override;
+};
+
+} // namespace android
+
+#endif // ANDROID_GRAPHICSENV_IGPUSERVICE_H
@@ -16,9 +16,22 @@
 
 #include <gui/BufferHubConsumer.h>
 
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <ui/FenceTime.h>
+
 namespace android {
 
 using namespace dvr;
+using pdx::LocalHandle;
 
 /* static */
 sp<BufferHubConsumer> BufferHubConsumer::Create(const std::shared_ptr<ConsumerQueue>& queue) {
@@ -38,10 +51,70 @@ sp<BufferHubConsumer> BufferHubConsumer::Create(const std::shared_ptr<ConsumerQu
     return consumer;
 }
 
-status_t BufferHubConsumer::acquireBuffer(BufferItem* /*buffer*/, nsecs_t /*presentWhen*/,
-                                          uint64_t /*maxFrameNumber*/) {
-    ALOGE("BufferHubConsumer::acquireBuffer: not implemented.");
-    return INVALID_OPERATION;
+BufferHubConsumer::~BufferHubConsumer() {
+    stopEventThread();
+}
+
+status_t BufferHubConsumer::acquireBuffer(BufferItem* buffer, nsecs_t presentWhen,
+                                          uint64_t maxFrameNumber) {
+    if (buffer == nullptr) {
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Like BufferQueueConsumer, allow one buffer over the maximum so that the consumer can acquire
+    // a new buffer before releasing the old one.
+    if (mAcquiredCount > mMaxAcquiredBufferCount) {
+        ALOGE("acquireBuffer: max acquired buffer count reached: %d (max %d)", mAcquiredCount,
+              mMaxAcquiredBufferCount);
+        return INVALID_OPERATION;
+    }
+
+    if (mPendingItems.empty()) {
+        return NO_BUFFER_AVAILABLE;
+    }
+
+    // Drop the buffers that are superseded by a later buffer that is also due, as
+    // BufferQueueConsumer does when the consumer is behind.
+    auto isDue = [presentWhen, maxFrameNumber](const BufferItem& item) {
+        if (maxFrameNumber != 0 && item.mFrameNumber > maxFrameNumber) {
+            return false;
+        }
+        return presentWhen == 0 || item.mIsAutoTimestamp || item.mTimestamp <= presentWhen;
+    };
+    while (presentWhen != 0 && mPendingItems.size() > 1 && isDue(mPendingItems[1])) {
+        releaseSlotLocked(mPendingItems.front().mSlot, mPendingItems.front().mFence);
+        mPendingItems.pop_front();
+    }
+
+    const BufferItem& front = mPendingItems.front();
+    if (maxFrameNumber != 0 && front.mFrameNumber > maxFrameNumber) {
+        return PRESENT_LATER;
+    }
+    // Buffers with a desired present time far in the future are treated as due, as an app using
+    // the wrong clock would otherwise never have them presented.
+    constexpr nsecs_t kMaxReasonableNsec = 1000000000ULL;
+    if (presentWhen != 0 && !front.mIsAutoTimestamp && front.mTimestamp > presentWhen &&
+        front.mTimestamp - presentWhen < kMaxReasonableNsec) {
+        return PRESENT_LATER;
+    }
+
+    *buffer = front;
+    mPendingItems.pop_front();
+
+    Slot& slot = mSlots[buffer->mSlot];
+    if (!slot.mBufferSent) {
+        buffer->mGraphicBuffer = slot.mBuffer->buffer()->buffer();
+        slot.mBufferSent = true;
+    } else {
+        buffer->mGraphicBuffer = nullptr;
+    }
+    buffer->mAcquireCalled = buffer->mGraphicBuffer == nullptr;
+    slot.mAcquired = true;
+    slot.mFrameNumber = buffer->mFrameNumber;
+    mAcquiredCount++;
+    return NO_ERROR;
 }
 
 status_t BufferHubConsumer::detachBuffer(int /*slot*/) {
@@ -54,38 +127,223 @@ status_t BufferHubConsumer::attachBuffer(int* /*outSlot*/, const sp<GraphicBuffe
     return INVALID_OPERATION;
 }
 
-status_t BufferHubConsumer::releaseBuffer(int /*buf*/, uint64_t /*frameNumber*/,
-                                          EGLDisplay /*display*/, EGLSyncKHR /*fence*/,
-                                          const sp<Fence>& /*releaseFence*/) {
-    ALOGE("BufferHubConsumer::releaseBuffer: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::releaseBuffer(int buf, uint64_t frameNumber, EGLDisplay /*display*/,
+                                          EGLSyncKHR /*fence*/, const sp<Fence>& releaseFence) {
+    // EGL sync objects cannot be passed through BufferHub; consumers signal completion with the
+    // release fence instead.
+    if (buf < 0 || buf >= int(BufferHubQueue::kMaxQueueCapacity) || releaseFence == nullptr) {
+        ALOGE("releaseBuffer: slot %d out of range or fence %p NULL", buf, releaseFence.get());
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    Slot& slot = mSlots[buf];
+    if (!slot.mAcquired || slot.mFrameNumber != frameNumber) {
+        // The buffer was removed, or reused for a later frame, after it was acquired.
+        return STALE_BUFFER_SLOT;
+    }
+
+    slot.mAcquired = false;
+    mAcquiredCount--;
+    return releaseSlotLocked(buf, releaseFence);
+}
+
+status_t BufferHubConsumer::releaseSlotLocked(int slot, const sp<Fence>& releaseFence) {
+    const auto& buffer = mSlots[slot].mBuffer;
+    if (buffer == nullptr) {
+        return STALE_BUFFER_SLOT;
+    }
+
+    LocalHandle fenceFd(releaseFence != nullptr && releaseFence->isValid() ? releaseFence->dup()
+                                                                           : -1);
+    DvrNativeBufferMetadata metadata = {};
+    const int ret = buffer->ReleaseAsync(&metadata, fenceFd);
+    if (ret < 0) {
+        ALOGE("releaseBuffer: failed to release slot %d: %s", slot, strerror(-ret));
+        return ret;
+    }
+    return NO_ERROR;
 }
 
-status_t BufferHubConsumer::consumerConnect(const sp<IConsumerListener>& /*consumer*/,
+status_t BufferHubConsumer::consumerConnect(const sp<IConsumerListener>& consumer,
                                             bool /*controlledByApp*/) {
-    ALOGE("BufferHubConsumer::consumerConnect: not implemented.");
+    if (consumer == nullptr) {
+        ALOGE("consumerConnect: consumer listener may not be NULL");
+        return BAD_VALUE;
+    }
 
-    // TODO(b/73267953): Make BufferHub honor producer and consumer connection. Returns NO_ERROR to
-    // make IGraphicBufferConsumer_test happy.
+    std::lock_guard<std::mutex> lock(mMutex);
+    mListener = consumer;
+    if (mEventThread.joinable()) {
+        return NO_ERROR;
+    }
+
+    mStopEventFd = LocalHandle(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (!mStopEventFd) {
+        ALOGE("consumerConnect: failed to create event fd: %s", strerror(errno));
+        mListener = nullptr;
+        return NO_INIT;
+    }
+    mQueue->SetBufferRemovedCallback([this](const std::shared_ptr<BufferHubBuffer>& buffer) {
+        onBufferRemovedLocked(buffer);
+    });
+    mEventThread = std::thread(&BufferHubConsumer::eventLoop, this);
     return NO_ERROR;
 }
 
 status_t BufferHubConsumer::consumerDisconnect() {
-    ALOGE("BufferHubConsumer::consumerDisconnect: not implemented.");
+    stopEventThread();
 
-    // TODO(b/73267953): Make BufferHub honor producer and consumer connection. Returns NO_ERROR to
-    // make IGraphicBufferConsumer_test happy.
+    std::lock_guard<std::mutex> lock(mMutex);
+    mListener = nullptr;
     return NO_ERROR;
 }
 
-status_t BufferHubConsumer::getReleasedBuffers(uint64_t* /*slotMask*/) {
-    ALOGE("BufferHubConsumer::getReleasedBuffers: not implemented.");
-    return INVALID_OPERATION;
+void BufferHubConsumer::stopEventThread() {
+    if (!mEventThread.joinable()) {
+        return;
+    }
+
+    const uint64_t value = 1;
+    if (write(mStopEventFd.Get(), &value, sizeof(value)) != sizeof(value)) {
+        ALOGE("stopEventThread: failed to signal event thread: %s", strerror(errno));
+    }
+    mEventThread.join();
+    mStopEventFd.Close();
 }
 
-status_t BufferHubConsumer::setDefaultBufferSize(uint32_t /*w*/, uint32_t /*h*/) {
-    ALOGE("BufferHubConsumer::setDefaultBufferSize: not implemented.");
-    return INVALID_OPERATION;
+void BufferHubConsumer::eventLoop() {
+    pthread_setname_np(pthread_self(), "BufferHubConsumer");
+
+    pollfd fds[] = {
+            {mQueue->queue_fd(), POLLIN, 0},
+            {mStopEventFd.Get(), POLLIN, 0},
+    };
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("eventLoop: failed to poll: %s", strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+
+        std::vector<BufferItem> items;
+        sp<IConsumerListener> listener;
+        bool buffersReleased;
+        bool hungUp;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mQueue->HandleQueueEvents()) {
+                ALOGE("eventLoop: failed to handle queue events");
+            }
+            acquirePostedBuffersLocked(&items);
+            listener = mListener;
+            buffersReleased = mBuffersReleasedPending;
+            mBuffersReleasedPending = false;
+            hungUp = mQueue->hung_up();
+        }
+
+        // Call the listener without holding the lock, as it may acquire buffers right away.
+        if (listener != nullptr) {
+            if (buffersReleased) {
+                listener->onBuffersReleased();
+            }
+            for (const BufferItem& item : items) {
+                listener->onFrameAvailable(item);
+            }
+        }
+
+        if (hungUp) {
+            ALOGI("eventLoop: the producer queue hung up");
+            return;
+        }
+    }
+}
+
+void BufferHubConsumer::acquirePostedBuffersLocked(std::vector<BufferItem>* outItems) {
+    while (mQueue->count() > 0) {
+        size_t slot;
+        DvrNativeBufferMetadata metadata;
+        LocalHandle fence;
+        auto status = mQueue->Dequeue(0, &slot, &metadata, &fence);
+        if (!status) {
+            ALOGE("acquirePostedBuffers: failed to acquire buffer: %s",
+                  status.GetErrorMessage().c_str());
+            return;
+        }
+
+        std::shared_ptr<BufferConsumer> buffer = status.take();
+        if (mSlots[slot].mBuffer != buffer) {
+            mSlots[slot].mBuffer = buffer;
+            mSlots[slot].mBufferSent = false;
+        }
+
+        BufferItem item;
+        item.mSlot = int(slot);
+        item.mFrameNumber = ++mFrameCounter;
+        item.mFence = fence ? sp<Fence>(new Fence(fence.Release())) : Fence::NO_FENCE;
+        item.mFenceTime = std::make_shared<FenceTime>(item.mFence);
+        item.mCrop = Rect(metadata.crop_left, metadata.crop_top, metadata.crop_right,
+                          metadata.crop_bottom);
+        item.mTransform = uint32_t(metadata.transform);
+        item.mScalingMode = uint32_t(metadata.scaling_mode);
+        item.mTimestamp = metadata.timestamp;
+        item.mIsAutoTimestamp = metadata.is_auto_timestamp != 0;
+        item.mDataSpace = android_dataspace(metadata.dataspace);
+        item.mQueuedBuffer = true;
+        // Identify the buffer for onFrameAvailable; acquireBuffer decides whether the consumer
+        // still needs it.
+        item.mGraphicBuffer = buffer->buffer()->buffer();
+
+        mPendingItems.push_back(item);
+        mPendingItems.back().mGraphicBuffer = nullptr;
+        outItems->push_back(item);
+    }
+}
+
+void BufferHubConsumer::onBufferRemovedLocked(const std::shared_ptr<BufferHubBuffer>& buffer) {
+    for (size_t slot = 0; slot < BufferHubQueue::kMaxQueueCapacity; slot++) {
+        if (mSlots[slot].mBuffer == buffer) {
+            if (mSlots[slot].mAcquired) {
+                mAcquiredCount--;
+            }
+            mPendingItems.erase(std::remove_if(mPendingItems.begin(), mPendingItems.end(),
+                                               [slot](const BufferItem& item) {
+                                                   return item.mSlot == int(slot);
+                                               }),
+                                mPendingItems.end());
+            mSlots[slot] = Slot();
+            mReleasedSlotMask |= 1ULL << slot;
+            mBuffersReleasedPending = true;
+            return;
+        }
+    }
+}
+
+status_t BufferHubConsumer::getReleasedBuffers(uint64_t* slotMask) {
+    if (slotMask == nullptr) {
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    *slotMask = mReleasedSlotMask;
+    mReleasedSlotMask = 0;
+    return NO_ERROR;
+}
+
+status_t BufferHubConsumer::setDefaultBufferSize(uint32_t w, uint32_t h) {
+    if (w == 0 || h == 0) {
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDefaultWidth = w;
+    mDefaultHeight = h;
+    return NO_ERROR;
 }
 
 status_t BufferHubConsumer::setMaxBufferCount(int /*bufferCount*/) {
@@ -93,32 +351,38 @@ status_t BufferHubConsumer::setMaxBufferCount(int /*bufferCount*/) {
     return INVALID_OPERATION;
 }
 
-status_t BufferHubConsumer::setMaxAcquiredBufferCount(int /*maxAcquiredBuffers*/) {
-    ALOGE("BufferHubConsumer::setMaxAcquiredBufferCount: not implemented.");
+status_t BufferHubConsumer::setMaxAcquiredBufferCount(int maxAcquiredBuffers) {
+    if (maxAcquiredBuffers < 1 || maxAcquiredBuffers > int(BufferHubQueue::kMaxQueueCapacity)) {
+        return BAD_VALUE;
+    }
 
-    // TODO(b/73267953): Make BufferHub honor producer and consumer connection. Returns NO_ERROR to
-    // make IGraphicBufferConsumer_test happy.
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxAcquiredBufferCount = maxAcquiredBuffers;
     return NO_ERROR;
 }
 
-status_t BufferHubConsumer::setConsumerName(const String8& /*name*/) {
-    ALOGE("BufferHubConsumer::setConsumerName: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::setConsumerName(const String8& name) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mConsumerName = name;
+    return NO_ERROR;
 }
 
-status_t BufferHubConsumer::setDefaultBufferFormat(PixelFormat /*defaultFormat*/) {
-    ALOGE("BufferHubConsumer::setDefaultBufferFormat: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::setDefaultBufferFormat(PixelFormat defaultFormat) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDefaultFormat = defaultFormat;
+    return NO_ERROR;
 }
 
-status_t BufferHubConsumer::setDefaultBufferDataSpace(android_dataspace /*defaultDataSpace*/) {
-    ALOGE("BufferHubConsumer::setDefaultBufferDataSpace: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::setDefaultBufferDataSpace(android_dataspace defaultDataSpace) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDefaultDataSpace = defaultDataSpace;
+    return NO_ERROR;
 }
 
-status_t BufferHubConsumer::setConsumerUsageBits(uint64_t /*usage*/) {
-    ALOGE("BufferHubConsumer::setConsumerUsageBits: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::setConsumerUsageBits(uint64_t usage) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mConsumerUsage = usage;
+    return NO_ERROR;
 }
 
 status_t BufferHubConsumer::setConsumerIsProtected(bool /*isProtected*/) {
@@ -126,9 +390,10 @@ status_t BufferHubConsumer::setConsumerIsProtected(bool /*isProtected*/) {
     return INVALID_OPERATION;
 }
 
-status_t BufferHubConsumer::setTransformHint(uint32_t /*hint*/) {
-    ALOGE("BufferHubConsumer::setTransformHint: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::setTransformHint(uint32_t hint) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTransformHint = hint;
+    return NO_ERROR;
 }
 
 status_t BufferHubConsumer::getSidebandStream(sp<NativeHandle>* /*outStream*/) const {
@@ -147,9 +412,27 @@ status_t BufferHubConsumer::discardFreeBuffers() {
     return INVALID_OPERATION;
 }
 
-status_t BufferHubConsumer::dumpState(const String8& /*prefix*/, String8* /*outResult*/) const {
-    ALOGE("BufferHubConsumer::dumpState: not implemented.");
-    return INVALID_OPERATION;
+status_t BufferHubConsumer::dumpState(const String8& prefix, String8* outResult) const {
+    if (outResult == nullptr) {
+        return BAD_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    outResult->appendFormat("%s-BufferHubConsumer name=%s queue_id=%d default=%ux%u format=%d "
+                            "dataspace=%d usage=%#" PRIx64 " transformHint=%u\n",
+                            prefix.string(), mConsumerName.string(), mQueue->id(), mDefaultWidth,
+                            mDefaultHeight, mDefaultFormat, int(mDefaultDataSpace), mConsumerUsage,
+                            mTransformHint);
+    outResult->appendFormat("%s  capacity=%zu pending=%zu acquired=%d (max %d) frame=%" PRIu64
+                            "\n",
+                            prefix.string(), mQueue->capacity(), mPendingItems.size(),
+                            mAcquiredCount, mMaxAcquiredBufferCount, mFrameCounter);
+    for (const BufferItem& item : mPendingItems) {
+        outResult->appendFormat("%s  [%02d] frame=%" PRIu64 " timestamp=%" PRId64 "%s\n",
+                                prefix.string(), item.mSlot, item.mFrameNumber, item.mTimestamp,
+                                item.mIsAutoTimestamp ? " (auto)" : "");
+    }
+    return NO_ERROR;
 }
 
 IBinder* BufferHubConsumer::onAsBinder() {
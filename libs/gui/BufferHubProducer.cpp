@@ -216,7 +216,9 @@ status_t BufferHubProducer::dequeueBuffer(int* out_slot, sp<Fence>* out_fence, u
     *out_slot = int(slot);
     ret = NO_ERROR;
 
-    if (buffers_[slot].mIsReallocating) {
+    // Like BufferQueueProducer, ask for requestBuffer whenever the producer does not have the
+    // slot's current buffer yet.
+    if (buffers_[slot].mIsReallocating || !buffers_[slot].mRequestBufferCalled) {
         ret |= BUFFER_NEEDS_REALLOCATION;
         buffers_[slot].mIsReallocating = false;
     }
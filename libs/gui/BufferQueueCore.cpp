@@ -27,6 +27,9 @@
 #endif
 
 #include <inttypes.h>
+#include <sched.h>
+
+#include <algorithm>
 
 #include <cutils/properties.h>
 #include <cutils/atomic.h>
@@ -40,6 +43,8 @@
 
 #include <system/window.h>
 
+#include <ui/GraphicBufferPool.h>
+
 namespace android {
 
 static String8 getUniqueName() {
@@ -54,7 +59,7 @@ static uint64_t getUniqueId() {
     return id | counter++;
 }
 
-BufferQueueCore::BufferQueueCore() :
+BufferQueueCore::BufferQueueCore(bool lowContention) :
     mMutex(),
     mIsAbandoned(false),
     mConsumerControlledByApp(false),
@@ -63,6 +68,7 @@ BufferQueueCore::BufferQueueCore() :
     mConsumerUsageBits(0),
     mConsumerIsProtected(false),
     mConnectedApi(NO_CONNECTED_API),
+    mConnectedUid(-1),
     mLinkedToDeath(),
     mConnectedProducerListener(),
     mSlots(),
@@ -72,6 +78,9 @@ BufferQueueCore::BufferQueueCore() :
     mUnusedSlots(),
     mActiveBuffers(),
     mDequeueCondition(),
+    mLowContention(lowContention),
+    mDequeueSequence(0),
+    mDequeueWaiters(0),
     mDequeueBufferCannotBlock(false),
     mDefaultBufferFormat(PIXEL_FORMAT_RGBA_8888),
     mDefaultWidth(1),
@@ -224,6 +233,16 @@ void BufferQueueCore::clearBufferSlotLocked(int slot) {
     }
 }
 
+void BufferQueueCore::recycleBufferLocked(int slot) {
+    const BufferSlot& bufferSlot(mSlots[slot]);
+    if (mConnectedUid < 0 || bufferSlot.mGraphicBuffer == NULL ||
+            bufferSlot.mEglFence != EGL_NO_SYNC_KHR || slot == mSharedBufferSlot) {
+        return;
+    }
+    GraphicBufferPool::getInstance().recycle(static_cast<uint64_t>(mConnectedUid),
+            bufferSlot.mGraphicBuffer, bufferSlot.mFence);
+}
+
 void BufferQueueCore::freeAllBuffersLocked() {
     for (int s : mFreeSlots) {
         clearBufferSlotLocked(s);
@@ -231,6 +250,7 @@ void BufferQueueCore::freeAllBuffersLocked() {
 
     for (int s : mFreeBuffers) {
         mFreeSlots.insert(s);
+        recycleBufferLocked(s);
         clearBufferSlotLocked(s);
     }
     mFreeBuffers.clear();
@@ -313,6 +333,52 @@ void BufferQueueCore::waitWhileAllocatingLocked() const {
     }
 }
 
+// How long a producer spins in low contention mode before going to sleep.
+static constexpr nsecs_t DEQUEUE_SPIN_TIME = 100000; // 100us
+
+status_t BufferQueueCore::waitForDequeueConditionLocked(nsecs_t timeout) {
+    if (mLowContention) {
+        // The consumer usually releases a buffer within a fraction of a
+        // frame, so look for that before paying for a sleep and a wakeup.
+        const uint32_t sequence = mDequeueSequence.load(std::memory_order_acquire);
+        const nsecs_t spinStart = systemTime();
+        mMutex.unlock();
+        bool signaled = false;
+        do {
+            sched_yield();
+            signaled = mDequeueSequence.load(std::memory_order_acquire) != sequence;
+        } while (!signaled && systemTime() - spinStart < DEQUEUE_SPIN_TIME);
+        mMutex.lock();
+        if (signaled || mDequeueSequence.load(std::memory_order_relaxed) != sequence) {
+            return NO_ERROR;
+        }
+        if (timeout >= 0) {
+            timeout = std::max(timeout - (systemTime() - spinStart), nsecs_t(0));
+        }
+    }
+
+    status_t result = NO_ERROR;
+    mDequeueWaiters++;
+    if (timeout >= 0) {
+        result = mDequeueCondition.waitRelative(mMutex, timeout);
+    } else {
+        mDequeueCondition.wait(mMutex);
+    }
+    mDequeueWaiters--;
+    return result;
+}
+
+void BufferQueueCore::signalDequeueConditionLocked() {
+    if (!mLowContention) {
+        mDequeueCondition.broadcast();
+        return;
+    }
+    mDequeueSequence.fetch_add(1, std::memory_order_release);
+    if (mDequeueWaiters > 0) {
+        mDequeueCondition.broadcast();
+    }
+}
+
 #if DEBUG_ONLY_CODE
 void BufferQueueCore::validateConsistencyLocked() const {
     static const useconds_t PAUSE_TIME = 0;
@@ -41,6 +41,8 @@
 
 #include <system/window.h>
 
+#include <ui/GraphicBufferPool.h>
+
 namespace android {
 
 static constexpr uint32_t BQ_LAYER_COUNT = 1;
@@ -162,7 +164,7 @@ status_t BufferQueueProducer::setMaxDequeuedBufferCount(
         if (delta < 0) {
             listener = mCore->mConsumerListener;
         }
-        mCore->mDequeueCondition.broadcast();
+        mCore->signalDequeueConditionLocked();
     } // Autolock scope
 
     // Call back without lock held
@@ -214,7 +216,7 @@ status_t BufferQueueProducer::setAsyncMode(bool async) {
         }
         mCore->mAsyncMode = async;
         VALIDATE_CONSISTENCY();
-        mCore->mDequeueCondition.broadcast();
+        mCore->signalDequeueConditionLocked();
         if (delta < 0) {
             listener = mCore->mConsumerListener;
         }
@@ -245,6 +247,23 @@ int BufferQueueProducer::getFreeSlotLocked() const {
     return slot;
 }
 
+sp<GraphicBuffer> BufferQueueProducer::createGraphicBuffer(int64_t owner,
+        uint32_t width, uint32_t height, PixelFormat format, uint64_t usage,
+        std::string requestorName, sp<Fence>* outFence) const {
+    if (owner >= 0) {
+        sp<GraphicBuffer> buffer = GraphicBufferPool::getInstance().take(
+                static_cast<uint64_t>(owner), width, height, format,
+                BQ_LAYER_COUNT, usage, outFence);
+        if (buffer != NULL) {
+            BQ_LOGV("createGraphicBuffer: reusing a recycled buffer");
+            return buffer;
+        }
+    }
+    *outFence = Fence::NO_FENCE;
+    return new GraphicBuffer(width, height, format, BQ_LAYER_COUNT, usage,
+            std::move(requestorName));
+}
+
 status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
         int* found) const {
     auto callerString = (caller == FreeSlotCaller::Dequeue) ?
@@ -332,14 +351,9 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
                     (acquiredCount <= mCore->mMaxAcquiredBufferCount)) {
                 return WOULD_BLOCK;
             }
-            if (mDequeueTimeout >= 0) {
-                status_t result = mCore->mDequeueCondition.waitRelative(
-                        mCore->mMutex, mDequeueTimeout);
-                if (result == TIMED_OUT) {
-                    return result;
-                }
-            } else {
-                mCore->mDequeueCondition.wait(mCore->mMutex);
+            status_t result = mCore->waitForDequeueConditionLocked(mDequeueTimeout);
+            if (result == TIMED_OUT) {
+                return result;
             }
         }
     } // while (tryAgain)
@@ -378,6 +392,7 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
     EGLDisplay eglDisplay = EGL_NO_DISPLAY;
     EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
     bool attachedByConsumer = false;
+    int64_t owner = -1;
 
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
@@ -423,6 +438,7 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
                         return BAD_VALUE;
                     }
                     mCore->mFreeSlots.insert(found);
+                    mCore->recycleBufferLocked(found);
                     mCore->clearBufferSlotLocked(found);
                     found = BufferItem::INVALID_BUFFER_SLOT;
                     continue;
@@ -453,6 +469,8 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
         if ((buffer == NULL) ||
                 buffer->needsReallocation(width, height, format, BQ_LAYER_COUNT, usage))
         {
+            mCore->recycleBufferLocked(found);
+            owner = mCore->mConnectedUid;
             mSlots[found].mAcquireCalled = false;
             mSlots[found].mGraphicBuffer = NULL;
             mSlots[found].mRequestBufferCalled = false;
@@ -499,9 +517,10 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
 
     if (returnFlags & BUFFER_NEEDS_REALLOCATION) {
         BQ_LOGV("dequeueBuffer: allocating a new buffer for slot %d", *outSlot);
-        sp<GraphicBuffer> graphicBuffer = new GraphicBuffer(
-                width, height, format, BQ_LAYER_COUNT, usage,
-                {mConsumerName.string(), mConsumerName.size()});
+        sp<Fence> fence;
+        sp<GraphicBuffer> graphicBuffer = createGraphicBuffer(owner,
+                width, height, format, usage,
+                {mConsumerName.string(), mConsumerName.size()}, &fence);
 
         status_t error = graphicBuffer->initCheck();
 
@@ -511,6 +530,7 @@ status_t BufferQueueProducer::dequeueBuffer(int* outSlot, sp<android::Fence>* ou
             if (error == NO_ERROR && !mCore->mIsAbandoned) {
                 graphicBuffer->setGenerationNumber(mCore->mGenerationNumber);
                 mSlots[*outSlot].mGraphicBuffer = graphicBuffer;
+                *outFence = fence;
             }
 
             mCore->mIsAllocating = false;
@@ -608,7 +628,7 @@ status_t BufferQueueProducer::detachBuffer(int slot) {
         mCore->mActiveBuffers.erase(slot);
         mCore->mFreeSlots.insert(slot);
         mCore->clearBufferSlotLocked(slot);
-        mCore->mDequeueCondition.broadcast();
+        mCore->signalDequeueConditionLocked();
         VALIDATE_CONSISTENCY();
         listener = mCore->mConsumerListener;
     }
@@ -932,7 +952,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mCore->mBufferHasBeenQueued = true;
-        mCore->mDequeueCondition.broadcast();
+        mCore->signalDequeueConditionLocked();
         mCore->mLastQueuedSlot = slot;
 
         output->width = mCore->mDefaultWidth;
@@ -1060,7 +1080,7 @@ status_t BufferQueueProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
     }
 
     mSlots[slot].mFence = fence;
-    mCore->mDequeueCondition.broadcast();
+    mCore->signalDequeueConditionLocked();
     VALIDATE_CONSISTENCY();
 
     return NO_ERROR;
@@ -1212,6 +1232,7 @@ status_t BufferQueueProducer::connect(const sp<IProducerListener>& listener,
             break;
     }
     mCore->mConnectedPid = IPCThreadState::self()->getCallingPid();
+    mCore->mConnectedUid = IPCThreadState::self()->getCallingUid();
     mCore->mBufferHasBeenQueued = false;
     mCore->mDequeueBufferCannotBlock = false;
     if (mDequeueTimeout < 0) {
@@ -1283,8 +1304,9 @@ status_t BufferQueueProducer::disconnect(int api, DisconnectMode mode) {
                     mCore->mConnectedProducerListener = NULL;
                     mCore->mConnectedApi = BufferQueueCore::NO_CONNECTED_API;
                     mCore->mConnectedPid = -1;
+                    mCore->mConnectedUid = -1;
                     mCore->mSidebandStream.clear();
-                    mCore->mDequeueCondition.broadcast();
+                    mCore->signalDequeueConditionLocked();
                     listener = mCore->mConsumerListener;
                 } else if (mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
                     BQ_LOGE("disconnect: not connected (req=%d)", api);
@@ -1335,6 +1357,7 @@ void BufferQueueProducer::allocateBuffers(uint32_t width, uint32_t height,
         PixelFormat allocFormat = PIXEL_FORMAT_UNKNOWN;
         uint64_t allocUsage = 0;
         std::string allocName;
+        int64_t owner = -1;
         { // Autolock scope
             Mutex::Autolock lock(mCore->mMutex);
             mCore->waitWhileAllocatingLocked();
@@ -1355,18 +1378,33 @@ void BufferQueueProducer::allocateBuffers(uint32_t width, uint32_t height,
             allocFormat = format != 0 ? format : mCore->mDefaultBufferFormat;
             allocUsage = usage | mCore->mConsumerUsageBits;
             allocName.assign(mCore->mConsumerName.string(), mCore->mConsumerName.size());
+            owner = mCore->mConnectedUid;
 
             mCore->mIsAllocating = true;
         } // Autolock scope
 
+        // Take what the recycled buffer pool has, then allocate the rest in a
+        // single request
         Vector<sp<GraphicBuffer>> buffers;
-        for (size_t i = 0; i <  newBufferCount; ++i) {
-            sp<GraphicBuffer> graphicBuffer = new GraphicBuffer(
-                    allocWidth, allocHeight, allocFormat, BQ_LAYER_COUNT,
-                    allocUsage, allocName);
-
-            status_t result = graphicBuffer->initCheck();
+        Vector<sp<Fence>> fences;
+        while (owner >= 0 && buffers.size() < newBufferCount) {
+            sp<Fence> fence;
+            sp<GraphicBuffer> graphicBuffer = GraphicBufferPool::getInstance().take(
+                    static_cast<uint64_t>(owner), allocWidth, allocHeight,
+                    allocFormat, BQ_LAYER_COUNT, allocUsage, &fence);
+            if (graphicBuffer == NULL) {
+                break;
+            }
+            buffers.push_back(graphicBuffer);
+            fences.push_back(fence);
+        }
 
+        if (buffers.size() < newBufferCount) {
+            std::vector<sp<GraphicBuffer>> allocated;
+            status_t result = GraphicBuffer::allocateBuffers(
+                    static_cast<uint32_t>(newBufferCount - buffers.size()),
+                    allocWidth, allocHeight, allocFormat, BQ_LAYER_COUNT,
+                    allocUsage, allocName, &allocated);
             if (result != NO_ERROR) {
                 BQ_LOGE("allocateBuffers: failed to allocate buffer (%u x %u, format"
                         " %u, usage %#" PRIx64 ")", width, height, format, usage);
@@ -1375,7 +1413,10 @@ void BufferQueueProducer::allocateBuffers(uint32_t width, uint32_t height,
                 mCore->mIsAllocatingCondition.broadcast();
                 return;
             }
-            buffers.push_back(graphicBuffer);
+            for (const sp<GraphicBuffer>& graphicBuffer : allocated) {
+                buffers.push_back(graphicBuffer);
+                fences.push_back(Fence::NO_FENCE);
+            }
         }
 
         { // Autolock scope
@@ -1403,7 +1444,7 @@ void BufferQueueProducer::allocateBuffers(uint32_t width, uint32_t height,
                 auto slot = mCore->mFreeSlots.begin();
                 mCore->clearBufferSlotLocked(*slot); // Clean up the slot first
                 mSlots[*slot].mGraphicBuffer = buffers[i];
-                mSlots[*slot].mFence = Fence::NO_FENCE;
+                mSlots[*slot].mFence = fences[i];
 
                 // freeBufferLocked puts this slot on the free slots list. Since
                 // we then attached a buffer, move the slot to free buffer list.
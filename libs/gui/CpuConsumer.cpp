@@ -35,6 +35,7 @@ CpuConsumer::CpuConsumer(const sp<IGraphicBufferConsumer>& bq,
         size_t maxLockedBuffers, bool controlledByApp) :
     ConsumerBase(bq, controlledByApp),
     mMaxLockedBuffers(maxLockedBuffers),
+    mPersistentMapping(false),
     mCurrentLockedBuffers(0)
 {
     // Create tracking entries for locked buffers
@@ -87,7 +88,8 @@ static bool isPossiblyYUV(PixelFormat format) {
     }
 }
 
-status_t CpuConsumer::lockBufferItem(const BufferItem& item, LockedBuffer* outBuffer) const {
+status_t CpuConsumer::lockBufferItem(const BufferItem& item, const Rect& region,
+                                     LockedBuffer* outBuffer) const {
     android_ycbcr ycbcr = android_ycbcr();
 
     PixelFormat format = item.mGraphicBuffer->getPixelFormat();
@@ -95,7 +97,7 @@ status_t CpuConsumer::lockBufferItem(const BufferItem& item, LockedBuffer* outBu
     if (isPossiblyYUV(format)) {
         int fenceFd = item.mFence.get() ? item.mFence->dup() : -1;
         status_t err = item.mGraphicBuffer->lockAsyncYCbCr(GraphicBuffer::USAGE_SW_READ_OFTEN,
-                                                           item.mCrop, &ycbcr, fenceFd);
+                                                           region, &ycbcr, fenceFd);
         if (err == OK) {
             flexFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
             if (format != HAL_PIXEL_FORMAT_YCbCr_420_888) {
@@ -119,7 +121,7 @@ status_t CpuConsumer::lockBufferItem(const BufferItem& item, LockedBuffer* outBu
         void* bufferPointer = nullptr;
         int fenceFd = item.mFence.get() ? item.mFence->dup() : -1;
         status_t err = item.mGraphicBuffer->lockAsync(GraphicBuffer::USAGE_SW_READ_OFTEN,
-                                                      item.mCrop, &bufferPointer, fenceFd);
+                                                      region, &bufferPointer, fenceFd);
         if (err != OK) {
             CC_LOGE("Unable to lock buffer for CPU reading: %s (%d)", strerror(-err), err);
             return err;
@@ -148,6 +150,72 @@ status_t CpuConsumer::lockBufferItem(const BufferItem& item, LockedBuffer* outBu
     return OK;
 }
 
+status_t CpuConsumer::lockMappedBufferLocked(const BufferItem& item, LockedBuffer* outBuffer) {
+    MappedBuffer& mapped = mMappedBuffers[item.mSlot];
+    if (mapped.mGraphicBuffer != item.mGraphicBuffer) {
+        unmapBufferLocked(item.mSlot);
+
+        // Lock the whole buffer since the mapping outlives this frame's crop.
+        const sp<GraphicBuffer>& buffer = item.mGraphicBuffer;
+        status_t err = lockBufferItem(item, Rect(buffer->getWidth(), buffer->getHeight()),
+                                      outBuffer);
+        if (err != OK) {
+            return err;
+        }
+        mapped.mGraphicBuffer = buffer;
+        mapped.mLayout = *outBuffer;
+        mapped.mInUse = true;
+        return OK;
+    }
+
+    // The buffer is still locked, so only wait for the producer to finish.
+    if (item.mFence.get()) {
+        status_t err = item.mFence->waitForever("CpuConsumer::lockNextBuffer");
+        if (err != OK) {
+            CC_LOGE("Failed to wait for acquire fence: %s (%d)", strerror(-err), err);
+            return err;
+        }
+    }
+
+    *outBuffer = mapped.mLayout;
+    outBuffer->crop = item.mCrop;
+    outBuffer->transform = item.mTransform;
+    outBuffer->scalingMode = item.mScalingMode;
+    outBuffer->timestamp = item.mTimestamp;
+    outBuffer->dataSpace = item.mDataSpace;
+    outBuffer->frameNumber = item.mFrameNumber;
+    mapped.mInUse = true;
+
+    return OK;
+}
+
+void CpuConsumer::unmapBufferLocked(int slotIndex) {
+    MappedBuffer& mapped = mMappedBuffers[slotIndex];
+    if (mapped.mGraphicBuffer != nullptr && !mapped.mInUse) {
+        status_t err = mapped.mGraphicBuffer->unlock();
+        if (err != OK) {
+            CC_LOGE("%s: Unable to unlock graphic buffer in slot %d", __FUNCTION__, slotIndex);
+        }
+    }
+    mapped = MappedBuffer();
+}
+
+void CpuConsumer::setPersistentMapping(bool enabled) {
+    Mutex::Autolock _l(mMutex);
+
+    if (!enabled) {
+        for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+            unmapBufferLocked(i);
+        }
+    }
+    mPersistentMapping = enabled;
+}
+
+void CpuConsumer::freeBufferLocked(int slotIndex) {
+    unmapBufferLocked(slotIndex);
+    ConsumerBase::freeBufferLocked(slotIndex);
+}
+
 status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     status_t err;
 
@@ -176,7 +244,11 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
         b.mGraphicBuffer = mSlots[b.mSlot].mGraphicBuffer;
     }
 
-    err = lockBufferItem(b, nativeBuffer);
+    if (mPersistentMapping) {
+        err = lockMappedBufferLocked(b, nativeBuffer);
+    } else {
+        err = lockBufferItem(b, b.mCrop, nativeBuffer);
+    }
     if (err != OK) {
         return err;
     }
@@ -189,6 +261,7 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     ab.mSlot = b.mSlot;
     ab.mGraphicBuffer = b.mGraphicBuffer;
     ab.mLockedBufferId = getLockedBufferId(*nativeBuffer);
+    ab.mPersistent = mPersistentMapping;
 
     mCurrentLockedBuffers++;
 
@@ -209,11 +282,26 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
     AcquiredBuffer& ab = mAcquiredBuffers.editItemAt(lockedIdx);
 
     int fenceFd = -1;
-    status_t err = ab.mGraphicBuffer->unlockAsync(&fenceFd);
-    if (err != OK) {
-        CC_LOGE("%s: Unable to unlock graphic buffer %zd", __FUNCTION__,
-                lockedIdx);
-        return err;
+    MappedBuffer* mapped = nullptr;
+    if (ab.mPersistent && ab.mSlot >= 0) {
+        mapped = &mMappedBuffers[ab.mSlot];
+        if (mapped->mGraphicBuffer != ab.mGraphicBuffer) {
+            // The slot was freed or persistent mapping was disabled while the
+            // buffer was held, so the lock is ours to undo.
+            mapped = nullptr;
+        }
+    }
+    if (mapped != nullptr) {
+        // Reads are done by the time the buffer is unlocked, so the buffer
+        // stays mapped and is released without a fence.
+        mapped->mInUse = false;
+    } else {
+        status_t err = ab.mGraphicBuffer->unlockAsync(&fenceFd);
+        if (err != OK) {
+            CC_LOGE("%s: Unable to unlock graphic buffer %zd", __FUNCTION__,
+                    lockedIdx);
+            return err;
+        }
     }
 
     sp<Fence> fence(fenceFd >= 0 ? new Fence(fenceFd) : Fence::NO_FENCE);
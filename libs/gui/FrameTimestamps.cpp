@@ -313,6 +313,22 @@ void ProducerFrameEventHistory::updateSignalTimes() {
     mReleaseTimeline.updateSignalTimes();
 }
 
+nsecs_t ProducerFrameEventHistory::getSignalTime(FrameEvent event,
+        const std::shared_ptr<FenceTime>& fence) {
+    switch (event) {
+        case FrameEvent::ACQUIRE:
+            return mAcquireTimeline.getSignalTime(fence);
+        case FrameEvent::GPU_COMPOSITION_DONE:
+            return mGpuCompositionDoneTimeline.getSignalTime(fence);
+        case FrameEvent::DISPLAY_PRESENT:
+            return mPresentTimeline.getSignalTime(fence);
+        case FrameEvent::RELEASE:
+            return mReleaseTimeline.getSignalTime(fence);
+        default:
+            return fence->getSignalTime();
+    }
+}
+
 void ProducerFrameEventHistory::applyFenceDelta(FenceTimeline* timeline,
         std::shared_ptr<FenceTime>* dst, const FenceTime::Snapshot& src) const {
     if (CC_UNLIKELY(dst == nullptr || dst->get() == nullptr)) {
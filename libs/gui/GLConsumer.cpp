@@ -201,6 +201,22 @@ status_t GLConsumer::updateTexImage() {
     GLC_LOGV("updateTexImage");
     Mutex::Autolock lock(mMutex);
 
+    return updateTexImageLocked(true);
+}
+
+status_t GLConsumer::updateTexImage(sp<Fence>* outFence) {
+    ATRACE_CALL();
+    GLC_LOGV("updateTexImage(outFence)");
+    Mutex::Autolock lock(mMutex);
+
+    status_t err = updateTexImageLocked(false);
+    *outFence = (err == NO_ERROR && mCurrentFence->isValid() &&
+                 mCurrentFence->getStatus() != Fence::Status::Signaled)
+            ? mCurrentFence : Fence::NO_FENCE;
+    return err;
+}
+
+status_t GLConsumer::updateTexImageLocked(bool waitForFence) {
     if (mAbandoned) {
         GLC_LOGE("updateTexImage: GLConsumer is abandoned!");
         return NO_INIT;
@@ -240,7 +256,7 @@ status_t GLConsumer::updateTexImage() {
     }
 
     // Bind the new buffer to the GL texture, and wait until it's ready.
-    return bindTextureImageLocked();
+    return bindTextureImageLocked(waitForFence);
 }
 
 
@@ -478,7 +494,7 @@ status_t GLConsumer::updateAndReleaseLocked(const BufferItem& item,
     return err;
 }
 
-status_t GLConsumer::bindTextureImageLocked() {
+status_t GLConsumer::bindTextureImageLocked(bool waitForFence) {
     if (mEglDisplay == EGL_NO_DISPLAY) {
         ALOGE("bindTextureImage: invalid display");
         return INVALID_OPERATION;
@@ -527,7 +543,7 @@ status_t GLConsumer::bindTextureImageLocked() {
     }
 
     // Wait for the new buffer to be ready.
-    return doGLFenceWaitLocked();
+    return waitForFence ? doGLFenceWaitLocked() : NO_ERROR;
 }
 
 status_t GLConsumer::checkAndUpdateEglStateLocked(bool contextCheck) {
@@ -983,7 +999,9 @@ status_t GLConsumer::doGLFenceWaitLocked() const {
         return INVALID_OPERATION;
     }
 
-    if (mCurrentFence->isValid()) {
+    // A buffer that is already ready, as most are by the time they are
+    // latched, needs neither an EGL sync object nor a wait.
+    if (mCurrentFence->isValid() && mCurrentFence->getStatus() != Fence::Status::Signaled) {
         if (SyncFeatures::getInstance().useWaitSync() &&
             SyncFeatures::getInstance().useNativeFenceSync()) {
             // Create an EGLSyncKHR from the current fence.
@@ -1013,22 +1013,69 @@ IGraphicBufferProducer::QueueBufferInput::QueueBufferInput(const Parcel& parcel)
     parcel.read(*this);
 }
 
+// The flattened QueueBufferInput starts with a word of these flags, which say
+// which of the optional fields follow the timestamp and dataspace. Fields that
+// are left out have the values most frames queue with, so a typical frame
+// takes 16 bytes rather than over 70. The top byte holds the encoding version.
+namespace {
+
+enum QueueBufferInputFields : uint32_t {
+    QBI_AUTO_TIMESTAMP = 1 << 0,
+    QBI_GET_FRAME_TIMESTAMPS = 1 << 1,
+    QBI_CROP = 1 << 2,              // otherwise Rect::EMPTY_RECT
+    QBI_SCALING_MODE = 1 << 3,      // otherwise 0
+    QBI_TRANSFORM = 1 << 4,         // otherwise 0
+    QBI_STICKY_TRANSFORM = 1 << 5,  // otherwise 0
+    QBI_FENCE = 1 << 6,             // otherwise Fence::NO_FENCE
+    QBI_DAMAGE = 1 << 7,            // otherwise QBI_DAMAGE_INVALID or Region()
+    QBI_DAMAGE_INVALID = 1 << 8,    // Region::INVALID_REGION
+    QBI_HDR_METADATA = 1 << 9,      // otherwise no metadata
+};
+
+constexpr uint32_t QBI_VERSION = 1;
+constexpr uint32_t QBI_VERSION_SHIFT = 24;
+
+bool isSingleRect(const Region& region, const Rect& rect) {
+    return region.isRect() && region.getBounds() == rect;
+}
+
+} // namespace
+
+uint32_t IGraphicBufferProducer::QueueBufferInput::getFields() const {
+    uint32_t fields = QBI_VERSION << QBI_VERSION_SHIFT;
+    if (isAutoTimestamp) fields |= QBI_AUTO_TIMESTAMP;
+    if (getFrameTimestamps) fields |= QBI_GET_FRAME_TIMESTAMPS;
+    if (crop != Rect::EMPTY_RECT) fields |= QBI_CROP;
+    if (scalingMode != 0) fields |= QBI_SCALING_MODE;
+    if (transform != 0) fields |= QBI_TRANSFORM;
+    if (stickyTransform != 0) fields |= QBI_STICKY_TRANSFORM;
+    if (fence->isValid()) fields |= QBI_FENCE;
+    if (isSingleRect(surfaceDamage, Rect::INVALID_RECT)) {
+        fields |= QBI_DAMAGE_INVALID;
+    } else if (!isSingleRect(surfaceDamage, Rect::EMPTY_RECT)) {
+        fields |= QBI_DAMAGE;
+    }
+    if (hdrMetadata.validTypes != 0) fields |= QBI_HDR_METADATA;
+    return fields;
+}
+
 constexpr size_t IGraphicBufferProducer::QueueBufferInput::minFlattenedSize() {
-    return sizeof(timestamp) +
-            sizeof(isAutoTimestamp) +
-            sizeof(dataSpace) +
-            sizeof(crop) +
-            sizeof(scalingMode) +
-            sizeof(transform) +
-            sizeof(stickyTransform) +
-            sizeof(getFrameTimestamps);
+    return sizeof(uint32_t) +
+            sizeof(timestamp) +
+            sizeof(dataSpace);
 }
 
 size_t IGraphicBufferProducer::QueueBufferInput::getFlattenedSize() const {
-    return minFlattenedSize() +
-            fence->getFlattenedSize() +
-            surfaceDamage.getFlattenedSize() +
-            hdrMetadata.getFlattenedSize();
+    const uint32_t fields = getFields();
+    size_t size = minFlattenedSize();
+    if (fields & QBI_CROP) size += sizeof(crop);
+    if (fields & QBI_SCALING_MODE) size += sizeof(scalingMode);
+    if (fields & QBI_TRANSFORM) size += sizeof(transform);
+    if (fields & QBI_STICKY_TRANSFORM) size += sizeof(stickyTransform);
+    if (fields & QBI_FENCE) size += fence->getFlattenedSize();
+    if (fields & QBI_DAMAGE) size += surfaceDamage.getFlattenedSize();
+    if (fields & QBI_HDR_METADATA) size += hdrMetadata.getFlattenedSize();
+    return size;
 }
 
 size_t IGraphicBufferProducer::QueueBufferInput::getFdCount() const {
@@ -1042,25 +1089,37 @@ status_t IGraphicBufferProducer::QueueBufferInput::flatten(
         return NO_MEMORY;
     }
 
+    const uint32_t fields = getFields();
+    FlattenableUtils::write(buffer, size, fields);
     FlattenableUtils::write(buffer, size, timestamp);
-    FlattenableUtils::write(buffer, size, isAutoTimestamp);
     FlattenableUtils::write(buffer, size, dataSpace);
-    FlattenableUtils::write(buffer, size, crop);
-    FlattenableUtils::write(buffer, size, scalingMode);
-    FlattenableUtils::write(buffer, size, transform);
-    FlattenableUtils::write(buffer, size, stickyTransform);
-    FlattenableUtils::write(buffer, size, getFrameTimestamps);
-
-    status_t result = fence->flatten(buffer, size, fds, count);
-    if (result != NO_ERROR) {
-        return result;
+    if (fields & QBI_CROP) FlattenableUtils::write(buffer, size, crop);
+    if (fields & QBI_SCALING_MODE) FlattenableUtils::write(buffer, size, scalingMode);
+    if (fields & QBI_TRANSFORM) FlattenableUtils::write(buffer, size, transform);
+    if (fields & QBI_STICKY_TRANSFORM) FlattenableUtils::write(buffer, size, stickyTransform);
+
+    status_t result = NO_ERROR;
+    if (fields & QBI_FENCE) {
+        result = fence->flatten(buffer, size, fds, count);
+        if (result != NO_ERROR) {
+            return result;
+        }
     }
-    result = surfaceDamage.flatten(buffer, size);
-    if (result != NO_ERROR) {
-        return result;
+    if (fields & QBI_DAMAGE) {
+        result = surfaceDamage.flatten(buffer, size);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        FlattenableUtils::advance(buffer, size, surfaceDamage.getFlattenedSize());
     }
-    FlattenableUtils::advance(buffer, size, surfaceDamage.getFlattenedSize());
-    return hdrMetadata.flatten(buffer, size);
+    if (fields & QBI_HDR_METADATA) {
+        result = hdrMetadata.flatten(buffer, size);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        FlattenableUtils::advance(buffer, size, hdrMetadata.getFlattenedSize());
+    }
+    return NO_ERROR;
 }
 
 status_t IGraphicBufferProducer::QueueBufferInput::unflatten(
@@ -1070,26 +1129,68 @@ status_t IGraphicBufferProducer::QueueBufferInput::unflatten(
         return NO_MEMORY;
     }
 
+    uint32_t fields = 0;
+    FlattenableUtils::read(buffer, size, fields);
+    if ((fields >> QBI_VERSION_SHIFT) != QBI_VERSION) {
+        return BAD_VALUE;
+    }
     FlattenableUtils::read(buffer, size, timestamp);
-    FlattenableUtils::read(buffer, size, isAutoTimestamp);
     FlattenableUtils::read(buffer, size, dataSpace);
-    FlattenableUtils::read(buffer, size, crop);
-    FlattenableUtils::read(buffer, size, scalingMode);
-    FlattenableUtils::read(buffer, size, transform);
-    FlattenableUtils::read(buffer, size, stickyTransform);
-    FlattenableUtils::read(buffer, size, getFrameTimestamps);
-
-    fence = new Fence();
-    status_t result = fence->unflatten(buffer, size, fds, count);
-    if (result != NO_ERROR) {
-        return result;
+    isAutoTimestamp = (fields & QBI_AUTO_TIMESTAMP) ? 1 : 0;
+    getFrameTimestamps = (fields & QBI_GET_FRAME_TIMESTAMPS) != 0;
+
+    crop = Rect::EMPTY_RECT;
+    scalingMode = 0;
+    transform = 0;
+    stickyTransform = 0;
+    if (fields & QBI_CROP) {
+        if (size < sizeof(crop)) return NO_MEMORY;
+        FlattenableUtils::read(buffer, size, crop);
     }
-    result = surfaceDamage.unflatten(buffer, size);
-    if (result != NO_ERROR) {
-        return result;
+    if (fields & QBI_SCALING_MODE) {
+        if (size < sizeof(scalingMode)) return NO_MEMORY;
+        FlattenableUtils::read(buffer, size, scalingMode);
+    }
+    if (fields & QBI_TRANSFORM) {
+        if (size < sizeof(transform)) return NO_MEMORY;
+        FlattenableUtils::read(buffer, size, transform);
+    }
+    if (fields & QBI_STICKY_TRANSFORM) {
+        if (size < sizeof(stickyTransform)) return NO_MEMORY;
+        FlattenableUtils::read(buffer, size, stickyTransform);
+    }
+
+    status_t result = NO_ERROR;
+    if (fields & QBI_FENCE) {
+        fence = new Fence();
+        result = fence->unflatten(buffer, size, fds, count);
+        if (result != NO_ERROR) {
+            return result;
+        }
+    } else {
+        fence = Fence::NO_FENCE;
+    }
+    if (fields & QBI_DAMAGE) {
+        result = surfaceDamage.unflatten(buffer, size);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        FlattenableUtils::advance(buffer, size, surfaceDamage.getFlattenedSize());
+    } else if (fields & QBI_DAMAGE_INVALID) {
+        surfaceDamage = Region::INVALID_REGION;
+    } else {
+        surfaceDamage = Region();
+    }
+    if (fields & QBI_HDR_METADATA) {
+        result = hdrMetadata.unflatten(buffer, size);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        FlattenableUtils::advance(buffer, size, hdrMetadata.getFlattenedSize());
+    } else {
+        hdrMetadata = HdrMetadata();
     }
-    FlattenableUtils::advance(buffer, size, surfaceDamage.getFlattenedSize());
-    return hdrMetadata.unflatten(buffer, size);
+    return NO_ERROR;
 }
 
 // ----------------------------------------------------------------------------
@@ -105,7 +105,7 @@ public:
     virtual status_t captureScreen(const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
                                    Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
                                    int32_t minLayerZ, int32_t maxLayerZ, bool useIdentityTransform,
-                                   ISurfaceComposer::Rotation rotation) {
+                                   ISurfaceComposer::Rotation rotation, sp<Fence>* outFence) {
         Parcel data, reply;
         data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
         data.writeStrongBinder(display);
@@ -116,6 +116,7 @@ public:
         data.writeInt32(maxLayerZ);
         data.writeInt32(static_cast<int32_t>(useIdentityTransform));
         data.writeInt32(static_cast<int32_t>(rotation));
+        data.writeBool(outFence != nullptr);
         status_t err = remote()->transact(BnSurfaceComposer::CAPTURE_SCREEN, data, &reply);
 
         if (err != NO_ERROR) {
@@ -129,18 +130,23 @@ public:
 
         *outBuffer = new GraphicBuffer();
         reply.read(**outBuffer);
+        if (outFence != nullptr) {
+            *outFence = new Fence();
+            err = reply.read(**outFence);
+        }
         return err;
     }
 
     virtual status_t captureLayers(const sp<IBinder>& layerHandleBinder,
                                    sp<GraphicBuffer>* outBuffer, const Rect& sourceCrop,
-                                   float frameScale, bool childrenOnly) {
+                                   float frameScale, bool childrenOnly, sp<Fence>* outFence) {
         Parcel data, reply;
         data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
         data.writeStrongBinder(layerHandleBinder);
         data.write(sourceCrop);
         data.writeFloat(frameScale);
         data.writeBool(childrenOnly);
+        data.writeBool(outFence != nullptr);
         status_t err = remote()->transact(BnSurfaceComposer::CAPTURE_LAYERS, data, &reply);
 
         if (err != NO_ERROR) {
@@ -154,6 +160,10 @@ public:
 
         *outBuffer = new GraphicBuffer();
         reply.read(**outBuffer);
+        if (outFence != nullptr) {
+            *outFence = new Fence();
+            err = reply.read(**outFence);
+        }
 
         return err;
     }
@@ -615,13 +625,19 @@ status_t BnSurfaceComposer::onTransact(
             int32_t maxLayerZ = data.readInt32();
             bool useIdentityTransform = static_cast<bool>(data.readInt32());
             int32_t rotation = data.readInt32();
+            bool wantFence = data.readBool();
 
+            sp<Fence> outFence;
             status_t res = captureScreen(display, &outBuffer, sourceCrop, reqWidth, reqHeight,
                                          minLayerZ, maxLayerZ, useIdentityTransform,
-                                         static_cast<ISurfaceComposer::Rotation>(rotation));
+                                         static_cast<ISurfaceComposer::Rotation>(rotation),
+                                         wantFence ? &outFence : nullptr);
             reply->writeInt32(res);
             if (res == NO_ERROR) {
                 reply->write(*outBuffer);
+                if (wantFence) {
+                    reply->write(*outFence);
+                }
             }
             return NO_ERROR;
         }
@@ -633,12 +649,17 @@ status_t BnSurfaceComposer::onTransact(
             data.read(sourceCrop);
             float frameScale = data.readFloat();
             bool childrenOnly = data.readBool();
+            bool wantFence = data.readBool();
 
+            sp<Fence> outFence;
             status_t res = captureLayers(layerHandleBinder, &outBuffer, sourceCrop, frameScale,
-                                         childrenOnly);
+                                         childrenOnly, wantFence ? &outFence : nullptr);
             reply->writeInt32(res);
             if (res == NO_ERROR) {
                 reply->write(*outBuffer);
+                if (wantFence) {
+                    reply->write(*outFence);
+                }
             }
             return NO_ERROR;
         }
@@ -16,6 +16,8 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+
 #define LOG_TAG "StreamSplitter"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 //#define LOG_NDEBUG 0
@@ -58,13 +60,13 @@ status_t StreamSplitter::createSplitter(
 
 StreamSplitter::StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue)
       : mIsAbandoned(false), mMutex(), mReleaseCondition(),
-        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(), mBuffers() {}
+        mInput(inputQueue), mOutputs(), mBuffers() {}
 
 StreamSplitter::~StreamSplitter() {
     mInput->consumerDisconnect();
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
+    Vector<Output>::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
-        (*output)->disconnect(NATIVE_WINDOW_API_CPU);
+        output->mProducer->disconnect(NATIVE_WINDOW_API_CPU);
     }
 
     if (mBuffers.size() > 0) {
@@ -74,10 +76,20 @@ StreamSplitter::~StreamSplitter() {
 
 status_t StreamSplitter::addOutput(
         const sp<IGraphicBufferProducer>& outputQueue) {
+    return addOutput(outputQueue, DROP_POLICY_BLOCK, MAX_OUTSTANDING_BUFFERS);
+}
+
+status_t StreamSplitter::addOutput(
+        const sp<IGraphicBufferProducer>& outputQueue, DropPolicy policy,
+        size_t maxQueuedBuffers) {
     if (outputQueue == NULL) {
         ALOGE("addOutput: outputQueue must not be NULL");
         return BAD_VALUE;
     }
+    if (maxQueuedBuffers == 0) {
+        ALOGE("addOutput: maxQueuedBuffers must not be 0");
+        return BAD_VALUE;
+    }
 
     Mutex::Autolock lock(mMutex);
 
@@ -91,8 +103,32 @@ status_t StreamSplitter::addOutput(
         return status;
     }
 
-    mOutputs.push_back(outputQueue);
+    Output output;
+    output.mProducer = outputQueue;
+    output.mPolicy = policy;
+    output.mMaxQueuedBuffers = maxQueuedBuffers;
+    output.mQueuedBuffers = 0;
+    mOutputs.push_back(output);
+
+    return NO_ERROR;
+}
+
+status_t StreamSplitter::getOutputStats(
+        const sp<IGraphicBufferProducer>& outputQueue,
+        OutputStats* outStats) const {
+    if (outStats == NULL) {
+        ALOGE("getOutputStats: outStats must not be NULL");
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock lock(mMutex);
 
+    ssize_t index = findOutputLocked(outputQueue);
+    if (index < 0) {
+        ALOGE("getOutputStats: not an output of this splitter");
+        return BAD_VALUE;
+    }
+    *outStats = mOutputs[index].mStats;
     return NO_ERROR;
 }
 
@@ -105,14 +141,15 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     ATRACE_CALL();
     Mutex::Autolock lock(mMutex);
 
-    // The current policy is that if any one consumer is consuming buffers too
-    // slowly, the splitter will stall the rest of the outputs by not acquiring
-    // any more buffers from the input. This will cause back pressure on the
-    // input queue, slowing down its producer.
+    // If any DROP_POLICY_BLOCK output is consuming buffers too slowly, the
+    // splitter stalls the rest of the outputs by not acquiring any more
+    // buffers from the input. This will cause back pressure on the input
+    // queue, slowing down its producer. DROP_POLICY_LATEST outputs never
+    // stall the splitter; they skip buffers instead.
 
-    // If there are too many outstanding buffers, we block until a buffer is
-    // released back to the input in onBufferReleased
-    while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
+    // If a blocking output is full, we block until it releases a buffer in
+    // onBufferReleasedByOutput
+    while (isBlockedLocked()) {
         mReleaseCondition.wait(mMutex);
 
         // If the splitter is abandoned while we are waiting, the release
@@ -123,7 +160,6 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             return;
         }
     }
-    ++mOutstandingBuffers;
 
     // Acquire and detach the buffer from the input
     BufferItem bufferItem;
@@ -139,8 +175,9 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             "detaching buffer from input failed (%d)", status);
 
     // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
+    sp<BufferTracker> tracker(new BufferTracker(bufferItem.mGraphicBuffer));
+    tracker->setQueueTime(systemTime());
+    mBuffers.add(bufferItem.mGraphicBuffer->getId(), tracker);
 
     IGraphicBufferProducer::QueueBufferInput queueInput(
             bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
@@ -149,17 +186,29 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             bufferItem.mTransform, bufferItem.mFence);
 
     // Attach and queue the buffer to each of the outputs
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
+    size_t releaseCount = 0;
+    Vector<Output>::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
+        if (output->mQueuedBuffers >= output->mMaxQueuedBuffers) {
+            // Only DROP_POLICY_LATEST outputs can be full here. Skip this
+            // buffer for the output, counting it as released by the output.
+            ++output->mStats.droppedBuffers;
+            releaseCount = tracker->incrementReleaseCountLocked();
+            ALOGV("dropped buffer %#" PRIx64 " for output %p",
+                    bufferItem.mGraphicBuffer->getId(),
+                    output->mProducer.get());
+            continue;
+        }
+
         int slot;
-        status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
+        status = output->mProducer->attachBuffer(&slot,
+                bufferItem.mGraphicBuffer);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
             // that, increment the release count so that we still release this
             // buffer eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+            releaseCount = tracker->incrementReleaseCountLocked();
             continue;
         } else {
             LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
@@ -167,22 +216,31 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
         }
 
         IGraphicBufferProducer::QueueBufferOutput queueOutput;
-        status = (*output)->queueBuffer(slot, queueInput, &queueOutput);
+        status = output->mProducer->queueBuffer(slot, queueInput, &queueOutput);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
             // that, increment the release count so that we still release this
             // buffer eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+            releaseCount = tracker->incrementReleaseCountLocked();
             continue;
         } else {
             LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
                     "queueing buffer to output failed (%d)", status);
         }
 
+        ++output->mQueuedBuffers;
+        ++output->mStats.queuedBuffers;
+
         ALOGV("queued buffer %#" PRIx64 " to output %p",
-                bufferItem.mGraphicBuffer->getId(), output->get());
+                bufferItem.mGraphicBuffer->getId(), output->mProducer.get());
+    }
+
+    // If no output took the buffer, nobody will release it. The producer may
+    // still be writing it, so hand its fence back.
+    if (releaseCount == mOutputs.size()) {
+        tracker->mergeFence(bufferItem.mFence);
+        releaseToInputLocked(tracker);
     }
 }
 
@@ -207,7 +265,20 @@ void StreamSplitter::onBufferReleasedByOutput(
     ALOGV("detached buffer %#" PRIx64 " from output %p",
           buffer->getId(), from.get());
 
-    const sp<BufferTracker>& tracker = mBuffers.editValueFor(buffer->getId());
+    sp<BufferTracker> tracker = mBuffers.editValueFor(buffer->getId());
+
+    ssize_t index = findOutputLocked(from);
+    if (index >= 0) {
+        Output& output = mOutputs.editItemAt(index);
+        --output.mQueuedBuffers;
+        nsecs_t latency = systemTime() - tracker->getQueueTime();
+        ++output.mStats.releasedBuffers;
+        output.mStats.totalLatency += latency;
+        output.mStats.maxLatency = std::max(output.mStats.maxLatency, latency);
+
+        // A blocked onFrameAvailable may be waiting for this output
+        mReleaseCondition.broadcast();
+    }
 
     // Merge the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
@@ -221,6 +292,12 @@ void StreamSplitter::onBufferReleasedByOutput(
         return;
     }
 
+    releaseToInputLocked(tracker);
+}
+
+void StreamSplitter::releaseToInputLocked(const sp<BufferTracker>& tracker) {
+    const sp<GraphicBuffer>& buffer = tracker->getBuffer();
+
     // If we've been abandoned, we can't return the buffer to the input, so just
     // stop tracking it and move on
     if (mIsAbandoned) {
@@ -230,7 +307,7 @@ void StreamSplitter::onBufferReleasedByOutput(
 
     // Attach and release the buffer back to the input
     int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
+    status_t status = mInput->attachBuffer(&consumerSlot, buffer);
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "attaching buffer to input failed (%d)", status);
 
@@ -244,10 +321,27 @@ void StreamSplitter::onBufferReleasedByOutput(
     // We no longer need to track the buffer once it has been returned to the
     // input
     mBuffers.removeItem(buffer->getId());
+}
 
-    // Notify any waiting onFrameAvailable calls
-    --mOutstandingBuffers;
-    mReleaseCondition.signal();
+bool StreamSplitter::isBlockedLocked() const {
+    Vector<Output>::const_iterator output = mOutputs.begin();
+    for (; output != mOutputs.end(); ++output) {
+        if (output->mPolicy == DROP_POLICY_BLOCK &&
+                output->mQueuedBuffers >= output->mMaxQueuedBuffers) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ssize_t StreamSplitter::findOutputLocked(
+        const sp<IGraphicBufferProducer>& producer) const {
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        if (mOutputs[i].mProducer == producer) {
+            return static_cast<ssize_t>(i);
+        }
+    }
+    return -1;
 }
 
 void StreamSplitter::onAbandonedLocked() {
@@ -276,7 +370,8 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
 }
 
 StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0),
+        mQueueTime(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
@@ -22,6 +22,8 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+
 #include <android/native_window.h>
 
 #include <utils/Log.h>
@@ -92,11 +94,13 @@ Surface::Surface(const sp<IGraphicBufferProducer>& bufferProducer, bool controll
     mTransformHint = 0;
     mConsumerRunningBehind = false;
     mConnectedToCpu = false;
+    mPostedFrames = 0;
     mProducerControlledByApp = controlledByApp;
     mSwapIntervalZero = false;
 }
 
 Surface::~Surface() {
+    setDequeueAhead(false);
     if (mConnectedToCpu) {
         Surface::disconnect(NATIVE_WINDOW_API_CPU);
     }
@@ -119,6 +123,7 @@ void Surface::setSidebandStream(const sp<NativeHandle>& stream) {
 }
 
 void Surface::allocateBuffers() {
+    cancelDequeueAhead();
     uint32_t reqWidth = mReqWidth ? mReqWidth : mUserWidth;
     uint32_t reqHeight = mReqHeight ? mReqHeight : mUserHeight;
     mGraphicBufferProducer->allocateBuffers(reqWidth, reqHeight,
@@ -126,6 +131,7 @@ void Surface::allocateBuffers() {
 }
 
 status_t Surface::setGenerationNumber(uint32_t generation) {
+    cancelDequeueAhead();
     status_t result = mGraphicBufferProducer->setGenerationNumber(generation);
     if (result == NO_ERROR) {
         mGenerationNumber = generation;
@@ -143,6 +149,7 @@ String8 Surface::getConsumerName() const {
 }
 
 status_t Surface::setDequeueTimeout(nsecs_t timeout) {
+    cancelDequeueAhead();
     return mGraphicBufferProducer->setDequeueTimeout(timeout);
 }
 
@@ -242,6 +249,7 @@ static void getFrameTimestamp(nsecs_t *dst, const nsecs_t& src) {
 }
 
 static void getFrameTimestampFence(nsecs_t *dst,
+        ProducerFrameEventHistory* history, FrameEvent event,
         const std::shared_ptr<FenceTime>& src, bool fenceShouldBeKnown) {
     if (dst != nullptr) {
         if (!fenceShouldBeKnown) {
@@ -249,7 +257,7 @@ static void getFrameTimestampFence(nsecs_t *dst,
             return;
         }
 
-        nsecs_t signalTime = src->getSignalTime();
+        nsecs_t signalTime = history->getSignalTime(event, src);
         *dst = (signalTime == Fence::SIGNAL_TIME_PENDING) ?
                     NATIVE_WINDOW_TIMESTAMP_PENDING :
                 (signalTime == Fence::SIGNAL_TIME_INVALID) ?
@@ -308,15 +316,17 @@ status_t Surface::getFrameTimestamps(uint64_t frameNumber,
     getFrameTimestamp(outLastRefreshStartTime, events->lastRefreshStartTime);
     getFrameTimestamp(outDequeueReadyTime, events->dequeueReadyTime);
 
-    getFrameTimestampFence(outAcquireTime, events->acquireFence,
-            events->hasAcquireInfo());
-    getFrameTimestampFence(outGpuCompositionDoneTime,
-            events->gpuCompositionDoneFence,
+    ProducerFrameEventHistory* history = mFrameEventHistory.get();
+    getFrameTimestampFence(outAcquireTime, history, FrameEvent::ACQUIRE,
+            events->acquireFence, events->hasAcquireInfo());
+    getFrameTimestampFence(outGpuCompositionDoneTime, history,
+            FrameEvent::GPU_COMPOSITION_DONE, events->gpuCompositionDoneFence,
             events->hasGpuCompositionDoneInfo());
-    getFrameTimestampFence(outDisplayPresentTime, events->displayPresentFence,
+    getFrameTimestampFence(outDisplayPresentTime, history,
+            FrameEvent::DISPLAY_PRESENT, events->displayPresentFence,
             events->hasDisplayPresentInfo());
-    getFrameTimestampFence(outReleaseTime, events->releaseFence,
-            events->hasReleaseInfo());
+    getFrameTimestampFence(outReleaseTime, history, FrameEvent::RELEASE,
+            events->releaseFence, events->hasReleaseInfo());
 
     return NO_ERROR;
 }
@@ -464,6 +474,7 @@ int Surface::setSwapInterval(int interval) {
     if (interval > maxSwapInterval)
         interval = maxSwapInterval;
 
+    cancelDequeueAhead();
     mSwapIntervalZero = (interval == 0);
     mGraphicBufferProducer->setAsyncMode(mSwapIntervalZero);
 
@@ -510,10 +521,21 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
     nsecs_t startTime = systemTime();
 
     FrameEventHistoryDelta frameTimestamps;
-    status_t result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence, reqWidth, reqHeight,
-                                                            reqFormat, reqUsage, &mBufferAge,
-                                                            enableFrameTimestamps ? &frameTimestamps
-                                                                                  : nullptr);
+    status_t result;
+    DequeueAhead dequeue;
+    if (takeDequeueAhead(reqWidth, reqHeight, reqFormat, reqUsage, enableFrameTimestamps,
+                         &dequeue)) {
+        buf = dequeue.slot;
+        fence = dequeue.fence;
+        result = dequeue.result;
+        mBufferAge = dequeue.bufferAge;
+        frameTimestamps = std::move(dequeue.frameTimestamps);
+    } else {
+        result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence, reqWidth, reqHeight,
+                                                       reqFormat, reqUsage, &mBufferAge,
+                                                       enableFrameTimestamps ? &frameTimestamps
+                                                                             : nullptr);
+    }
     mLastDequeueDuration = systemTime() - startTime;
 
     if (result < 0) {
@@ -781,6 +803,10 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
 
     mQueueBufferCondition.broadcast();
 
+    if (err == OK) {
+        requestDequeueAheadLocked();
+    }
+
     return err;
 }
 
@@ -1204,6 +1230,7 @@ int Surface::connect(
         int api, const sp<IProducerListener>& listener, bool reportBufferRemoval) {
     ATRACE_CALL();
     ALOGV("Surface::connect");
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
     IGraphicBufferProducer::QueueBufferOutput output;
     mReportRemovedBuffers = reportBufferRemoval;
@@ -1224,6 +1251,7 @@ int Surface::connect(
         mConnectedToCpu = true;
         // Clear the dirty region in case we're switching from a non-CPU API
         mDirtyRegion.clear();
+        mPostedFrames = 0;
     } else if (!err) {
         // Initialize the dirty region for tracking surface damage
         mDirtyRegion = Region::INVALID_REGION;
@@ -1236,6 +1264,7 @@ int Surface::connect(
 int Surface::disconnect(int api, IGraphicBufferProducer::DisconnectMode mode) {
     ATRACE_CALL();
     ALOGV("Surface::disconnect");
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
     mRemovedBuffers.clear();
     mSharedBufferSlot = BufferItem::INVALID_BUFFER_SLOT;
@@ -1263,6 +1292,7 @@ int Surface::detachNextBuffer(sp<GraphicBuffer>* outBuffer,
         sp<Fence>* outFence) {
     ATRACE_CALL();
     ALOGV("Surface::detachNextBuffer");
+    cancelDequeueAhead();
 
     if (outBuffer == NULL || outFence == NULL) {
         return BAD_VALUE;
@@ -1305,6 +1335,7 @@ int Surface::attachBuffer(ANativeWindowBuffer* buffer)
 {
     ATRACE_CALL();
     ALOGV("Surface::attachBuffer");
+    cancelDequeueAhead();
 
     Mutex::Autolock lock(mMutex);
     if (mReportRemovedBuffers) {
@@ -1363,6 +1394,7 @@ int Surface::setBufferCount(int bufferCount)
 {
     ATRACE_CALL();
     ALOGV("Surface::setBufferCount");
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
 
     status_t err = NO_ERROR;
@@ -1387,6 +1419,7 @@ int Surface::setBufferCount(int bufferCount)
 int Surface::setMaxDequeuedBufferCount(int maxDequeuedBuffers) {
     ATRACE_CALL();
     ALOGV("Surface::setMaxDequeuedBufferCount");
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
 
     status_t err = mGraphicBufferProducer->setMaxDequeuedBufferCount(
@@ -1400,6 +1433,7 @@ int Surface::setMaxDequeuedBufferCount(int maxDequeuedBuffers) {
 int Surface::setAsyncMode(bool async) {
     ATRACE_CALL();
     ALOGV("Surface::setAsyncMode");
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
 
     status_t err = mGraphicBufferProducer->setAsyncMode(async);
@@ -1412,6 +1446,7 @@ int Surface::setAsyncMode(bool async) {
 int Surface::setSharedBufferMode(bool sharedBufferMode) {
     ATRACE_CALL();
     ALOGV("Surface::setSharedBufferMode (%d)", sharedBufferMode);
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
 
     status_t err = mGraphicBufferProducer->setSharedBufferMode(
@@ -1428,6 +1463,7 @@ int Surface::setSharedBufferMode(bool sharedBufferMode) {
 int Surface::setAutoRefresh(bool autoRefresh) {
     ATRACE_CALL();
     ALOGV("Surface::setAutoRefresh (%d)", autoRefresh);
+    cancelDequeueAhead();
     Mutex::Autolock lock(mMutex);
 
     status_t err = mGraphicBufferProducer->setAutoRefresh(autoRefresh);
@@ -1703,8 +1739,27 @@ status_t Surface::lock(
                 backBuffer->format == frontBuffer->format);
 
         if (canCopyBack) {
-            // copy the area that is invalid and not repainted this round
-            const Region copyback(mDirtyRegion.subtract(newDirtyRegion));
+            uint64_t bufferAge;
+            {
+                Mutex::Autolock lock(mMutex);
+                bufferAge = mBufferAge;
+            }
+            // The back buffer still holds the frame posted bufferAge frames
+            // ago, so only what the frames since then repainted has to be
+            // copied from the front buffer. Without a usable age, copy the
+            // whole area that is invalid and not repainted this round.
+            Region copyback;
+            const size_t history = std::min(mPostedFrames,
+                    static_cast<size_t>(POSTED_DIRTY_HISTORY));
+            if (bufferAge > 0 && bufferAge - 1 <= history) {
+                for (uint64_t i = 1; i < bufferAge; i++) {
+                    copyback.orSelf(mPostedDirtyRegions[
+                            (mPostedFrames - i) % POSTED_DIRTY_HISTORY]);
+                }
+                copyback.subtractSelf(newDirtyRegion);
+            } else {
+                copyback = mDirtyRegion.subtract(newDirtyRegion);
+            }
             if (!copyback.isEmpty()) {
                 copyBlt(backBuffer, frontBuffer, copyback, &fenceFd);
             }
@@ -1713,6 +1768,7 @@ status_t Surface::lock(
             // region to make sure they redraw the whole buffer
             newDirtyRegion.set(bounds);
             mDirtyRegion.clear();
+            mPostedFrames = 0;
             Mutex::Autolock lock(mMutex);
             for (size_t i=0 ; i<NUM_BUFFER_SLOTS ; i++) {
                 mSlots[i].dirtyRegion.clear();
@@ -1747,6 +1803,7 @@ status_t Surface::lock(
             err = INVALID_OPERATION;
         } else {
             mLockedBuffer = backBuffer;
+            mLockedDirtyRegion = newDirtyRegion;
             outBuffer->width  = backBuffer->width;
             outBuffer->height = backBuffer->height;
             outBuffer->stride = backBuffer->stride;
@@ -1772,6 +1829,13 @@ status_t Surface::unlockAndPost()
     ALOGE_IF(err, "queueBuffer (handle=%p) failed (%s)",
             mLockedBuffer->handle, strerror(-err));
 
+    if (err == NO_ERROR) {
+        mPostedDirtyRegions[mPostedFrames % POSTED_DIRTY_HISTORY] = mLockedDirtyRegion;
+        mPostedFrames++;
+    } else {
+        // the buffer ages no longer match the history
+        mPostedFrames = 0;
+    }
     mPostedBuffer = mLockedBuffer;
     mLockedBuffer = 0;
     return err;
@@ -1812,6 +1876,157 @@ status_t Surface::getAndFlushRemovedBuffers(std::vector<sp<GraphicBuffer>>* out)
     return OK;
 }
 
+void Surface::setDequeueAhead(bool enable) {
+    ATRACE_CALL();
+    ALOGV("Surface::setDequeueAhead (%d)", enable);
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mDequeueAheadMutex);
+        if (enable == mDequeueAheadEnabled) {
+            return;
+        }
+        mDequeueAheadEnabled = enable;
+        mDequeueAheadExit = !enable;
+        if (enable) {
+            mDequeueAheadThread = std::thread(&Surface::dequeueAheadLoop, this);
+            return;
+        }
+        thread = std::move(mDequeueAheadThread);
+    }
+    mDequeueAheadCondition.notify_all();
+    thread.join();
+    // Return the buffer the helper thread may have dequeued before it exited
+    cancelDequeueAhead();
+}
+
+void Surface::requestDequeueAheadLocked() {
+    // mMutex must be locked when calling this method.
+    if (mSharedBufferMode) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mDequeueAheadMutex);
+    if (!mDequeueAheadEnabled || mDequeueAhead.pending) {
+        return;
+    }
+    mDequeueAhead = DequeueAhead();
+    mDequeueAhead.pending = true;
+    mDequeueAhead.width = mReqWidth ? mReqWidth : mUserWidth;
+    mDequeueAhead.height = mReqHeight ? mReqHeight : mUserHeight;
+    mDequeueAhead.format = mReqFormat;
+    mDequeueAhead.usage = mReqUsage;
+    mDequeueAhead.enableFrameTimestamps = mEnableFrameTimestamps;
+    mDequeueAheadCondition.notify_all();
+}
+
+bool Surface::takeDequeueAhead(uint32_t width, uint32_t height, PixelFormat format,
+        uint64_t usage, bool enableFrameTimestamps, DequeueAhead* outDequeue) {
+    {
+        std::unique_lock<std::mutex> lock(mDequeueAheadMutex);
+        if (!mDequeueAhead.pending) {
+            return false;
+        }
+        ATRACE_NAME("waitForDequeueAhead");
+        mDequeueAheadCondition.wait(lock, [this] {
+            return mDequeueAhead.done || !mDequeueAheadThread.joinable();
+        });
+        *outDequeue = std::move(mDequeueAhead);
+        mDequeueAhead = DequeueAhead();
+    }
+    if (!outDequeue->done || outDequeue->result < 0) {
+        // Let the caller dequeue again, and report the error if it persists
+        return false;
+    }
+    if (outDequeue->width != width || outDequeue->height != height ||
+            outDequeue->format != format || outDequeue->usage != usage ||
+            outDequeue->enableFrameTimestamps != enableFrameTimestamps) {
+        ALOGV("takeDequeueAhead: buffer parameters changed, cancelling slot %d",
+                outDequeue->slot);
+        cancelDequeuedAhead(*outDequeue);
+        return false;
+    }
+    return true;
+}
+
+void Surface::cancelDequeueAhead() {
+    DequeueAhead dequeue;
+    {
+        std::unique_lock<std::mutex> lock(mDequeueAheadMutex);
+        if (!mDequeueAhead.pending) {
+            return;
+        }
+        mDequeueAheadCondition.wait(lock, [this] {
+            return mDequeueAhead.done || !mDequeueAheadThread.joinable();
+        });
+        dequeue = std::move(mDequeueAhead);
+        mDequeueAhead = DequeueAhead();
+    }
+    if (dequeue.done && dequeue.result >= 0) {
+        cancelDequeuedAhead(dequeue);
+    }
+}
+
+void Surface::cancelDequeuedAhead(const DequeueAhead& dequeue) {
+    if (dequeue.slot < 0 || dequeue.slot >= NUM_BUFFER_SLOTS) {
+        return;
+    }
+    Mutex::Autolock lock(mMutex);
+    // The dequeue may have changed the slots, as if dequeueBuffer had
+    // returned it
+    if (dequeue.result & IGraphicBufferProducer::RELEASE_ALL_BUFFERS) {
+        freeAllBuffers();
+    }
+    if (dequeue.result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+        sp<GraphicBuffer>& gbuf(mSlots[dequeue.slot].buffer);
+        if (mReportRemovedBuffers && gbuf != nullptr) {
+            mRemovedBuffers.push_back(gbuf);
+        }
+        gbuf = nullptr;
+    }
+    if (dequeue.enableFrameTimestamps) {
+        mFrameEventHistory->applyDelta(dequeue.frameTimestamps);
+    }
+    mGraphicBufferProducer->cancelBuffer(dequeue.slot, dequeue.fence);
+}
+
+void Surface::dequeueAheadLoop() {
+    std::unique_lock<std::mutex> lock(mDequeueAheadMutex);
+    while (true) {
+        mDequeueAheadCondition.wait(lock, [this] {
+            return mDequeueAheadExit || (mDequeueAhead.pending && !mDequeueAhead.done);
+        });
+        if (mDequeueAheadExit) {
+            return;
+        }
+        uint32_t width = mDequeueAhead.width;
+        uint32_t height = mDequeueAhead.height;
+        PixelFormat format = mDequeueAhead.format;
+        uint64_t usage = mDequeueAhead.usage;
+        bool enableFrameTimestamps = mDequeueAhead.enableFrameTimestamps;
+        lock.unlock();
+
+        int slot = -1;
+        sp<Fence> fence;
+        uint64_t bufferAge = 0;
+        FrameEventHistoryDelta frameTimestamps;
+        status_t result;
+        {
+            ATRACE_NAME("dequeueAhead");
+            result = mGraphicBufferProducer->dequeueBuffer(&slot, &fence, width, height,
+                    format, usage, &bufferAge,
+                    enableFrameTimestamps ? &frameTimestamps : nullptr);
+        }
+
+        lock.lock();
+        mDequeueAhead.result = result;
+        mDequeueAhead.slot = slot;
+        mDequeueAhead.fence = fence;
+        mDequeueAhead.bufferAge = bufferAge;
+        mDequeueAhead.frameTimestamps = std::move(frameTimestamps);
+        mDequeueAhead.done = true;
+        mDequeueAheadCondition.notify_all();
+    }
+}
+
 status_t Surface::attachAndQueueBuffer(Surface* surface, sp<GraphicBuffer> buffer) {
     if (buffer == nullptr) {
         return BAD_VALUE;
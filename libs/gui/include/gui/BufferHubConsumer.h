@@ -17,14 +17,26 @@
 #ifndef ANDROID_GUI_BUFFERHUBCONSUMER_H_
 #define ANDROID_GUI_BUFFERHUBCONSUMER_H_
 
+#include <gui/BufferItem.h>
 #include <gui/IGraphicBufferConsumer.h>
 #include <private/dvr/buffer_hub_queue_client.h>
 #include <private/dvr/buffer_hub_queue_parcelable.h>
 
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace android {
 
+// BufferHubConsumer implements IGraphicBufferConsumer on top of a BufferHub consumer queue. It
+// acquires buffers from BufferHub on a thread of its own as the producer posts them, and hands them
+// out in post order through acquireBuffer, so that IConsumerListener users such as ConsumerBase see
+// the same sequence of callbacks as with a BufferQueue.
 class BufferHubConsumer : public IGraphicBufferConsumer {
 public:
+    ~BufferHubConsumer() override;
+
     // Creates a BufferHubConsumer instance by importing an existing producer queue.
     static sp<BufferHubConsumer> Create(const std::shared_ptr<dvr::ConsumerQueue>& queue);
 
@@ -100,11 +112,66 @@ public:
     IBinder* onAsBinder() override;
 
 private:
+    struct Slot {
+        // The buffer BufferHub has imported at this slot.
+        std::shared_ptr<dvr::BufferConsumer> mBuffer;
+        // Whether the GraphicBuffer of |mBuffer| has been handed to the consumer.
+        bool mBufferSent{false};
+        // Whether the consumer holds the buffer, and the frame it holds.
+        bool mAcquired{false};
+        uint64_t mFrameNumber{0};
+    };
+
     // Private constructor to force use of |Create|.
     BufferHubConsumer() = default;
 
+    // Waits for queue events while a consumer is connected, and notifies the consumer listener of
+    // posted and removed buffers.
+    void eventLoop();
+
+    // Acquires the buffers the producer has posted and appends them to |mPendingItems| and
+    // |outItems|. Called with |mMutex| held.
+    void acquirePostedBuffersLocked(std::vector<BufferItem>* outItems);
+
+    // Returns the buffer at |slot| to the producer. Called with |mMutex| held.
+    status_t releaseSlotLocked(int slot, const sp<Fence>& releaseFence);
+
+    // Called by |mQueue| with |mMutex| held when the producer removes a buffer.
+    void onBufferRemovedLocked(const std::shared_ptr<dvr::BufferHubBuffer>& buffer);
+
+    void stopEventThread();
+
     // Concrete implementation backed by BufferHubBuffer.
     std::shared_ptr<dvr::ConsumerQueue> mQueue;
+
+    // Guards everything below, and all access to |mQueue|.
+    mutable std::mutex mMutex;
+
+    Slot mSlots[dvr::BufferHubQueue::kMaxQueueCapacity];
+
+    // Buffers posted by the producer and not yet acquired by the consumer, in post order.
+    std::deque<BufferItem> mPendingItems;
+    uint64_t mFrameCounter{0};
+    int mAcquiredCount{0};
+    int mMaxAcquiredBufferCount{1};
+
+    // Slots whose buffers were removed since the last getReleasedBuffers call.
+    uint64_t mReleasedSlotMask{0};
+    bool mBuffersReleasedPending{false};
+
+    sp<IConsumerListener> mListener;
+    std::thread mEventThread;
+    pdx::LocalHandle mStopEventFd;
+
+    // Consumer settings. BufferHub buffers are allocated by the producer with the geometry and
+    // format it requests, so these are only reported by dumpState.
+    String8 mConsumerName;
+    uint32_t mDefaultWidth{1};
+    uint32_t mDefaultHeight{1};
+    PixelFormat mDefaultFormat{PIXEL_FORMAT_RGBA_8888};
+    android_dataspace mDefaultDataSpace{HAL_DATASPACE_UNKNOWN};
+    uint64_t mConsumerUsage{0};
+    uint32_t mTransformHint{0};
 };
 
 } // namespace android
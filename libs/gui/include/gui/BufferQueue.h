@@ -75,9 +75,16 @@ public:
     // BufferQueue manages a pool of gralloc memory slots to be used by
     // producers and consumers. allocator is used to allocate all the
     // needed gralloc buffers.
+    //
+    // lowContention suits pipelines where the producer waits for the
+    // consumer to release a buffer on every frame (camera preview, games
+    // rendering at the display rate): a producer that runs out of buffers
+    // spins briefly instead of sleeping right away, and acquire and release
+    // only wake up producers that are actually asleep.
     static void createBufferQueue(sp<IGraphicBufferProducer>* outProducer,
             sp<IGraphicBufferConsumer>* outConsumer,
-            bool consumerIsSurfaceFlinger = false);
+            bool consumerIsSurfaceFlinger = false,
+            bool lowContention = false);
 
 #ifndef NO_BUFFERHUB
     // Creates an IGraphicBufferProducer and IGraphicBufferConsumer pair backed by BufferHub.
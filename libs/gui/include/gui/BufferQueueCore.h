@@ -31,6 +31,7 @@
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
+#include <atomic>
 #include <list>
 #include <set>
 
@@ -78,8 +79,9 @@ public:
     typedef Vector<BufferItem> Fifo;
 
     // BufferQueueCore manages a pool of gralloc memory slots to be used by
-    // producers and consumers.
-    BufferQueueCore();
+    // producers and consumers. lowContention selects the low contention mode
+    // described at mLowContention.
+    explicit BufferQueueCore(bool lowContention = false);
     virtual ~BufferQueueCore();
 
 private:
@@ -119,8 +121,15 @@ private:
     // given slot.
     void clearBufferSlotLocked(int slot);
 
+    // recycleBufferLocked hands the GraphicBuffer of the given slot to the
+    // GraphicBufferPool, so that the connected producer can get it back if it
+    // asks for a buffer with the same attributes soon. The slot must be FREE,
+    // or just taken off the free list, and is left untouched.
+    void recycleBufferLocked(int slot);
+
     // freeAllBuffersLocked frees the GraphicBuffer and sync resources for
     // all slots, even if they're currently dequeued, queued, or acquired.
+    // The free buffers are recycled.
     void freeAllBuffersLocked();
 
     // discardFreeBuffersLocked releases all currently-free buffers held by the
@@ -135,6 +144,17 @@ private:
     // waitWhileAllocatingLocked blocks until mIsAllocating is false.
     void waitWhileAllocatingLocked() const;
 
+    // waitForDequeueConditionLocked blocks until signalDequeueConditionLocked
+    // is called or the timeout (in nanoseconds, negative for none) expires.
+    // Like a condition wait, mMutex is released while blocked, so the caller
+    // must check the state of the queue again afterwards.
+    status_t waitForDequeueConditionLocked(nsecs_t timeout);
+
+    // signalDequeueConditionLocked wakes up the producers blocked in
+    // waitForDequeueConditionLocked. It must be called whenever a buffer is
+    // acquired or released, or the max buffer count changes.
+    void signalDequeueConditionLocked();
+
 #if DEBUG_ONLY_CODE
     // validateConsistencyLocked ensures that the free lists are in sync with
     // the information stored in mSlots
@@ -182,6 +202,9 @@ private:
     int mConnectedApi;
     // PID of the process which last successfully called connect(...)
     pid_t mConnectedPid;
+    // UID of that process, or -1 if no producer is connected. Recycled buffers
+    // are only shared between queues whose producers have the same UID.
+    int64_t mConnectedUid;
 
     // mLinkedToDeath is used to set a binder death notification on
     // the producer.
@@ -220,6 +243,22 @@ private:
     // synchronous mode.
     mutable Condition mDequeueCondition;
 
+    // mLowContention is set when the producer and consumer are expected to
+    // hand buffers back and forth on every frame. A producer running out of
+    // buffers then spins for a short while on mDequeueSequence before
+    // sleeping on mDequeueCondition, and mDequeueCondition is only broadcast
+    // when a producer actually sleeps on it, which saves a futex wakeup per
+    // acquire and release.
+    const bool mLowContention;
+
+    // mDequeueSequence is incremented by every signalDequeueConditionLocked
+    // call. It is read without mMutex by spinning producers.
+    std::atomic<uint32_t> mDequeueSequence;
+
+    // mDequeueWaiters is the number of producers sleeping on
+    // mDequeueCondition.
+    int mDequeueWaiters;
+
     // mDequeueBufferCannotBlock indicates whether dequeueBuffer is allowed to
     // block. This flag is set during connect when both the producer and
     // consumer are controlled by the application.
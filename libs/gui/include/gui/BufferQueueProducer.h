@@ -198,6 +198,14 @@ private:
     // BufferQueueCore::INVALID_BUFFER_SLOT otherwise
     int getFreeSlotLocked() const;
 
+    // Returns a buffer recycled by a queue of the same owner (see
+    // BufferQueueCore::mConnectedUid) if the GraphicBufferPool has one with
+    // these attributes, or allocates a new one. outFence must be waited on
+    // before writing to the buffer.
+    sp<GraphicBuffer> createGraphicBuffer(int64_t owner, uint32_t width,
+            uint32_t height, PixelFormat format, uint64_t usage,
+            std::string requestorName, sp<Fence>* outFence) const;
+
     void addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
             FrameEventHistoryDelta* outDelta);
 
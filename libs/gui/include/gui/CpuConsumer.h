@@ -111,6 +111,22 @@ class CpuConsumer : public ConsumerBase
     // lockNextBuffer.
     status_t unlockBuffer(const LockedBuffer &nativeBuffer);
 
+    // Enables or disables persistent mapping. When enabled, a buffer stays
+    // locked for CPU reading after unlockBuffer returns it to the queue, and
+    // the next lockNextBuffer of the same buffer only waits for its acquire
+    // fence and reuses the mapping, including the YUV plane pointers, instead
+    // of locking it again through gralloc. Buffers are unlocked when their
+    // slot is freed or when persistent mapping is disabled.
+    //
+    // Since gralloc only performs cache maintenance when a buffer is locked,
+    // this should only be enabled when the producer's writes are coherent
+    // with CPU reads, e.g. for CPU producers or uncached buffers. Buffers are
+    // still locked again whenever the buffer in a slot changes.
+    void setPersistentMapping(bool enabled);
+
+  protected:
+    virtual void freeBufferLocked(int slotIndex) override;
+
   private:
     // Maximum number of buffers that can be locked at a time
     const size_t mMaxLockedBuffers;
@@ -125,25 +141,51 @@ class CpuConsumer : public ConsumerBase
         int mSlot;
         sp<GraphicBuffer> mGraphicBuffer;
         uintptr_t mLockedBufferId;
+        // Whether the lock is owned by mMappedBuffers rather than this entry
+        bool mPersistent;
 
         AcquiredBuffer() :
                 mSlot(BufferQueue::INVALID_BUFFER_SLOT),
-                mLockedBufferId(kUnusedId) {
+                mLockedBufferId(kUnusedId),
+                mPersistent(false) {
         }
 
         void reset() {
             mSlot = BufferQueue::INVALID_BUFFER_SLOT;
             mGraphicBuffer.clear();
             mLockedBufferId = kUnusedId;
+            mPersistent = false;
         }
     };
 
+    // Tracking for buffers kept locked by persistent mapping, per slot
+    struct MappedBuffer {
+        sp<GraphicBuffer> mGraphicBuffer;
+        // The plane layout returned when the buffer was locked
+        LockedBuffer mLayout;
+        // Whether the buffer is currently acquired by the user
+        bool mInUse;
+
+        MappedBuffer() : mInUse(false) {}
+    };
+
     size_t findAcquiredBufferLocked(uintptr_t id) const;
 
-    status_t lockBufferItem(const BufferItem& item, LockedBuffer* outBuffer) const;
+    status_t lockBufferItem(const BufferItem& item, const Rect& region,
+            LockedBuffer* outBuffer) const;
+
+    status_t lockMappedBufferLocked(const BufferItem& item, LockedBuffer* outBuffer);
+
+    // Unlocks the persistent mapping of a slot, unless the user still holds
+    // the buffer, in which case unlockBuffer unlocks it.
+    void unmapBufferLocked(int slotIndex);
 
     Vector<AcquiredBuffer> mAcquiredBuffers;
 
+    MappedBuffer mMappedBuffers[BufferQueue::NUM_BUFFER_SLOTS];
+
+    bool mPersistentMapping;
+
     // Count of currently locked buffers
     size_t mCurrentLockedBuffers;
 };
@@ -145,6 +145,11 @@ public:
 
     void updateSignalTimes();
 
+    // Returns the signal time of a fence recorded for the given event, using
+    // the event's timeline to avoid polling fences that can't have signaled.
+    nsecs_t getSignalTime(FrameEvent event,
+            const std::shared_ptr<FenceTime>& fence);
+
 protected:
     void applyFenceDelta(FenceTimeline* timeline,
             std::shared_ptr<FenceTime>* dst,
@@ -98,6 +98,14 @@ public:
     // This calls doGLFenceWait to ensure proper synchronization.
     status_t updateTexImage();
 
+    // Like updateTexImage, but never waits for the new buffer to be ready,
+    // even when the driver can't make the GPU wait for it. The texture is bound
+    // to the new buffer on return, and outFence is set to the fence that must
+    // signal before the texture is sampled, e.g. by calling eglWaitSyncKHR on
+    // it or by waiting on it later. outFence is Fence::NO_FENCE if the buffer
+    // is already ready.
+    status_t updateTexImage(sp<Fence>* outFence);
+
     // releaseTexImage releases the texture acquired in updateTexImage().
     // This is intended to be used in single buffer mode.
     //
@@ -280,8 +288,11 @@ protected:
 
     // Binds mTexName and the current buffer to mTexTarget.  Uses
     // mCurrentTexture if it's set, mCurrentTextureImage if not.  If the
-    // bind succeeds, this calls doGLFenceWait.
-    status_t bindTextureImageLocked();
+    // bind succeeds and waitForFence is set, this calls doGLFenceWait.
+    status_t bindTextureImageLocked(bool waitForFence = true);
+
+    // Shared by both updateTexImage variants.
+    status_t updateTexImageLocked(bool waitForFence);
 
     // Gets the current EGLDisplay and EGLContext values, and compares them
     // to mEglDisplay and mEglContext.  If the fields have been previously
@@ -359,7 +370,9 @@ private:
 
     // doGLFenceWaitLocked inserts a wait command into the OpenGL ES command
     // stream to ensure that it is safe for future OpenGL ES commands to
-    // access the current texture buffer.
+    // access the current texture buffer. Only if the driver can't make the GPU
+    // wait does it block until the buffer is ready. Fences that have already
+    // signaled need no wait at all.
     status_t doGLFenceWaitLocked() const;
 
     // syncForReleaseLocked performs the synchronization needed to release the
@@ -367,6 +367,9 @@ public:
         void setHdrMetadata(const HdrMetadata& metadata) { hdrMetadata = metadata; }
 
     private:
+        // Which of the optional fields get flattened
+        uint32_t getFields() const;
+
         int64_t timestamp{0};
         int isAutoTimestamp{0};
         android_dataspace dataSpace{HAL_DATASPACE_UNKNOWN};
@@ -27,6 +27,7 @@
 
 #include <binder/IInterface.h>
 
+#include <ui/Fence.h>
 #include <ui/FrameStats.h>
 #include <ui/PixelFormat.h>
 #include <ui/GraphicBuffer.h>
@@ -173,18 +174,25 @@ public:
 
     /* Capture the specified screen. requires READ_FRAME_BUFFER permission
      * This function will fail if there is a secure window on screen.
+     *
+     * If outFence is not null, the call returns as soon as the capture has been
+     * submitted to the GPU and outFence signals once outBuffer holds the
+     * result. Otherwise the call blocks until the buffer is ready.
      */
     virtual status_t captureScreen(const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
                                    Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
                                    int32_t minLayerZ, int32_t maxLayerZ, bool useIdentityTransform,
-                                   Rotation rotation = eRotateNone) = 0;
+                                   Rotation rotation = eRotateNone,
+                                   sp<Fence>* outFence = nullptr) = 0;
 
     /**
      * Capture a subtree of the layer hierarchy, potentially ignoring the root node.
+     * outFence is handled as in captureScreen.
      */
     virtual status_t captureLayers(const sp<IBinder>& layerHandleBinder,
                                    sp<GraphicBuffer>* outBuffer, const Rect& sourceCrop,
-                                   float frameScale = 1.0, bool childrenOnly = false) = 0;
+                                   float frameScale = 1.0, bool childrenOnly = false,
+                                   sp<Fence>* outFence = nullptr) = 0;
 
     /* Clears the frame statistics for animations.
      *
@@ -24,6 +24,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -39,6 +40,31 @@ class IGraphicBufferProducer;
 // again only once all of the outputs have released it.
 class StreamSplitter : public BnConsumerListener {
 public:
+    // How an output behaves once it holds as many buffers as its queue depth
+    enum DropPolicy {
+        // The output throttles the input: no more buffers are acquired from
+        // the input until the output releases one.
+        DROP_POLICY_BLOCK,
+        // Buffers that arrive while the output is full are not sent to it, so
+        // it only receives the latest buffer once it has room again and never
+        // stalls the other outputs.
+        DROP_POLICY_LATEST,
+    };
+
+    // Statistics for one output, since it was added
+    struct OutputStats {
+        // Buffers queued to the output
+        uint64_t queuedBuffers = 0;
+        // Buffers not sent to the output because it was full
+        uint64_t droppedBuffers = 0;
+        // Buffers the output has released
+        uint64_t releasedBuffers = 0;
+        // Sum and maximum of the time between queueing a buffer to the
+        // output and the output releasing it
+        nsecs_t totalLatency = 0;
+        nsecs_t maxLatency = 0;
+    };
+
     // createSplitter creates a new splitter, outSplitter, using inputQueue as
     // the input BufferQueue. Output BufferQueues must be added using addOutput
     // before queueing any buffers to the input.
@@ -63,6 +89,19 @@ public:
     // of other error codes.
     status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue);
 
+    // Like addOutput above, but with the given drop policy and queue depth.
+    // maxQueuedBuffers is the number of buffers the output may hold (queued or
+    // acquired) before its drop policy applies. BAD_VALUE is returned if it is
+    // 0. addOutput above uses DROP_POLICY_BLOCK and a queue depth of 2.
+    status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue,
+            DropPolicy policy, size_t maxQueuedBuffers);
+
+    // getOutputStats fills outStats with the statistics of an output added with
+    // addOutput. BAD_VALUE is returned if outStats is NULL or outputQueue is
+    // not an output of this splitter.
+    status_t getOutputStats(const sp<IGraphicBufferProducer>& outputQueue,
+            OutputStats* outStats) const;
+
     // setName sets the consumer name of the input queue
     void setName(const String8& name);
 
@@ -104,6 +143,14 @@ private:
     // acquire. This must be called with mMutex locked.
     void onAbandonedLocked();
 
+    // Returns true if a DROP_POLICY_BLOCK output is full, in which case no more
+    // buffers may be acquired from the input
+    bool isBlockedLocked() const;
+
+    // Releases a buffer that all outputs are done with back to the input and
+    // stops tracking it
+    void releaseToInputLocked(const sp<BufferTracker>& tracker);
+
     // This is a thin wrapper class that lets us determine which BufferQueue
     // the IProducerListener::onBufferReleased callback is associated with. We
     // create one of these per output BufferQueue, and then pass the producer
@@ -139,6 +186,10 @@ private:
         // Only called while mMutex is held
         size_t incrementReleaseCountLocked() { return ++mReleaseCount; }
 
+        // When the buffer was queued to the outputs
+        nsecs_t getQueueTime() const { return mQueueTime; }
+        void setQueueTime(nsecs_t queueTime) { mQueueTime = queueTime; }
+
     private:
         // Only destroy through LightRefBase
         friend LightRefBase<BufferTracker>;
@@ -151,6 +202,16 @@ private:
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
         sp<Fence> mMergedFence;
         size_t mReleaseCount;
+        nsecs_t mQueueTime;
+    };
+
+    struct Output {
+        sp<IGraphicBufferProducer> mProducer;
+        DropPolicy mPolicy;
+        size_t mMaxQueuedBuffers;
+        // Buffers queued to the output that it hasn't released yet
+        size_t mQueuedBuffers;
+        OutputStats mStats;
     };
 
     // Only called from createSplitter
@@ -159,19 +220,23 @@ private:
     // Must be accessed through RefBase
     virtual ~StreamSplitter();
 
+    // The queue depth of outputs added without one
     static const int MAX_OUTSTANDING_BUFFERS = 2;
 
+    // Returns the index in mOutputs of the given producer, or -1 if there is
+    // none
+    ssize_t findOutputLocked(const sp<IGraphicBufferProducer>& producer) const;
+
     // mIsAbandoned is set to true when an output dies. Once the StreamSplitter
     // has been abandoned, it will continue to detach buffers from other
     // outputs, but it will disconnect from the input and not attempt to
     // communicate with it further.
     bool mIsAbandoned;
 
-    Mutex mMutex;
+    mutable Mutex mMutex;
     Condition mReleaseCondition;
-    int mOutstandingBuffers;
     sp<IGraphicBufferConsumer> mInput;
-    Vector<sp<IGraphicBufferProducer> > mOutputs;
+    Vector<Output> mOutputs;
 
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
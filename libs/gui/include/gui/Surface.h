@@ -31,6 +31,10 @@
 
 #include <system/window.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace android {
 
 class ISurfaceComposer;
@@ -166,6 +170,15 @@ public:
     // Returns the CLOCK_MONOTONIC start time of the last dequeueBuffer call
     nsecs_t getLastDequeueStartTime() const;
 
+    /* Enables or disables dequeueing buffers ahead. When enabled, the next
+     * buffer is dequeued from the BufferQueue on a helper thread as soon as
+     * one is queued, so that the following dequeueBuffer call doesn't wait
+     * on the rendering thread for the binder round-trip, or for the consumer
+     * to release a buffer. It is disabled by default, and has no effect in
+     * shared buffer mode.
+     */
+    void setDequeueAhead(bool enable);
+
 protected:
     virtual ~Surface();
 
@@ -423,6 +436,16 @@ protected:
     // buffer as the number of frames that have elapsed since it was last queued
     uint64_t mBufferAge;
 
+    // The regions the most recent CPU frames repainted, indexed by frame
+    // number modulo POSTED_DIRTY_HISTORY, and the number of frames posted
+    // since the history was last reset. With the buffer age, they tell lock
+    // how little of the front buffer it has to copy back. Must be used from
+    // the lock/unlock thread.
+    enum { POSTED_DIRTY_HISTORY = 4 };
+    Region mPostedDirtyRegions[POSTED_DIRTY_HISTORY];
+    size_t mPostedFrames;
+    Region mLockedDirtyRegion;
+
     // Stores the current generation number. See setGenerationNumber and
     // IGraphicBufferProducer::setGenerationNumber for more information.
     uint32_t mGenerationNumber;
@@ -462,6 +485,43 @@ protected:
 
     bool mReportRemovedBuffers = false;
     std::vector<sp<GraphicBuffer>> mRemovedBuffers;
+
+private:
+    // A dequeueBuffer done ahead on the helper thread, and the parameters it
+    // was requested with. It is only used if they still match when the buffer
+    // is dequeued, and is cancelled before any call that could race with it.
+    struct DequeueAhead {
+        bool pending = false; // requested and not yet taken or cancelled
+        bool done = false;    // the helper thread has dequeued
+        uint32_t width = 0;
+        uint32_t height = 0;
+        PixelFormat format = 0;
+        uint64_t usage = 0;
+        bool enableFrameTimestamps = false;
+        status_t result = NO_ERROR;
+        int slot = -1;
+        sp<Fence> fence;
+        uint64_t bufferAge = 0;
+        FrameEventHistoryDelta frameTimestamps;
+    };
+
+    // mMutex must be locked when calling this method.
+    void requestDequeueAheadLocked();
+    // Takes the buffer dequeued ahead if it was requested with the same
+    // parameters, waiting for the helper thread if necessary.
+    bool takeDequeueAhead(uint32_t width, uint32_t height, PixelFormat format, uint64_t usage,
+            bool enableFrameTimestamps, DequeueAhead* outDequeue);
+    void cancelDequeueAhead();
+    void cancelDequeuedAhead(const DequeueAhead& dequeue);
+    void dequeueAheadLoop();
+
+    // Guards the dequeue-ahead state. mMutex, if needed, is taken first.
+    std::mutex mDequeueAheadMutex;
+    std::condition_variable mDequeueAheadCondition;
+    std::thread mDequeueAheadThread;
+    bool mDequeueAheadEnabled = false;
+    bool mDequeueAheadExit = false;
+    DequeueAhead mDequeueAhead;
 };
 
 } // namespace android
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferHubConsumer_test"
+
+#include <gtest/gtest.h>
+
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IConsumerListener.h>
+#include <gui/IProducerListener.h>
+#include <system/window.h>
+#include <utils/Condition.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kBufferWidth = 16;
+constexpr uint32_t kBufferHeight = 8;
+constexpr PixelFormat kBufferFormat = PIXEL_FORMAT_RGBA_8888;
+constexpr uint64_t kBufferUsage = GRALLOC_USAGE_SW_READ_OFTEN;
+constexpr nsecs_t kFrameTimeoutNs = seconds_to_nanoseconds(1);
+
+class FrameListener : public BnConsumerListener {
+public:
+    void onFrameAvailable(const BufferItem& item) override {
+        Mutex::Autolock lock(mMutex);
+        mItems.push_back(item);
+        mCondition.signal();
+    }
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    // Returns false if no frame arrives within the timeout.
+    bool waitForFrame(BufferItem* outItem) {
+        Mutex::Autolock lock(mMutex);
+        while (mItems.empty()) {
+            if (mCondition.waitRelative(mMutex, kFrameTimeoutNs) != NO_ERROR) {
+                return false;
+            }
+        }
+        *outItem = mItems.front();
+        mItems.erase(mItems.begin());
+        return true;
+    }
+
+private:
+    Mutex mMutex;
+    Condition mCondition;
+    std::vector<BufferItem> mItems;
+};
+
+} // namespace
+
+class BufferHubConsumerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        BufferQueue::createBufferHubQueue(&mProducer, &mConsumer);
+        mListener = new FrameListener;
+        ASSERT_EQ(NO_ERROR, mConsumer->consumerConnect(mListener, false));
+
+        IGraphicBufferProducer::QueueBufferOutput output;
+        ASSERT_EQ(NO_ERROR,
+                  mProducer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false,
+                                     &output));
+    }
+
+    void TearDown() override {
+        mProducer->disconnect(NATIVE_WINDOW_API_CPU);
+        mConsumer->consumerDisconnect();
+    }
+
+    // Dequeues a buffer and queues it with |timestamp|. Returns the slot.
+    int queueFrame(int64_t timestamp) {
+        int slot;
+        sp<Fence> fence;
+        status_t ret = mProducer->dequeueBuffer(&slot, &fence, kBufferWidth, kBufferHeight,
+                                                kBufferFormat, kBufferUsage, nullptr, nullptr);
+        if (ret & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            EXPECT_EQ(NO_ERROR, mProducer->requestBuffer(slot, &buffer));
+        } else {
+            EXPECT_EQ(NO_ERROR, ret);
+        }
+
+        const IGraphicBufferProducer::QueueBufferInput input(timestamp, false,
+                                                             HAL_DATASPACE_UNKNOWN,
+                                                             Rect(kBufferWidth / 2, kBufferHeight),
+                                                             NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                             Fence::NO_FENCE);
+        IGraphicBufferProducer::QueueBufferOutput output;
+        EXPECT_EQ(NO_ERROR, mProducer->queueBuffer(slot, input, &output));
+        return slot;
+    }
+
+    sp<IGraphicBufferProducer> mProducer;
+    sp<IGraphicBufferConsumer> mConsumer;
+    sp<FrameListener> mListener;
+};
+
+TEST_F(BufferHubConsumerTest, AcquireRelease) {
+    BufferItem item;
+    EXPECT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE, mConsumer->acquireBuffer(&item, 0));
+
+    const int slot = queueFrame(1234);
+
+    BufferItem available;
+    ASSERT_TRUE(mListener->waitForFrame(&available));
+    EXPECT_EQ(slot, available.mSlot);
+    ASSERT_NE(nullptr, available.mGraphicBuffer.get());
+    EXPECT_EQ(kBufferWidth, available.mGraphicBuffer->getWidth());
+
+    ASSERT_EQ(NO_ERROR, mConsumer->acquireBuffer(&item, 0));
+    EXPECT_EQ(slot, item.mSlot);
+    EXPECT_EQ(available.mFrameNumber, item.mFrameNumber);
+    EXPECT_EQ(1234, item.mTimestamp);
+    EXPECT_EQ(Rect(kBufferWidth / 2, kBufferHeight), item.mCrop);
+    // The buffer is handed out with the first acquire of its slot only.
+    ASSERT_NE(nullptr, item.mGraphicBuffer.get());
+    EXPECT_EQ(NO_ERROR,
+              mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                       EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+
+    // Releasing a frame twice is rejected.
+    EXPECT_EQ(IGraphicBufferConsumer::STALE_BUFFER_SLOT,
+              mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                       EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+
+    const int nextSlot = queueFrame(5678);
+    ASSERT_TRUE(mListener->waitForFrame(&available));
+
+    BufferItem nextItem;
+    ASSERT_EQ(NO_ERROR, mConsumer->acquireBuffer(&nextItem, 0));
+    EXPECT_EQ(nextSlot, nextItem.mSlot);
+    EXPECT_GT(nextItem.mFrameNumber, item.mFrameNumber);
+    if (nextSlot == slot) {
+        EXPECT_EQ(nullptr, nextItem.mGraphicBuffer.get());
+    }
+    EXPECT_EQ(NO_ERROR,
+              mConsumer->releaseBuffer(nextItem.mSlot, nextItem.mFrameNumber, EGL_NO_DISPLAY,
+                                       EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+}
+
+TEST_F(BufferHubConsumerTest, PresentLater) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    queueFrame(now + ms2ns(100));
+
+    BufferItem available;
+    ASSERT_TRUE(mListener->waitForFrame(&available));
+
+    BufferItem item;
+    EXPECT_EQ(IGraphicBufferConsumer::PRESENT_LATER, mConsumer->acquireBuffer(&item, now));
+    EXPECT_EQ(IGraphicBufferConsumer::PRESENT_LATER,
+              mConsumer->acquireBuffer(&item, 0, available.mFrameNumber - 1));
+    ASSERT_EQ(NO_ERROR, mConsumer->acquireBuffer(&item, now + ms2ns(100)));
+    EXPECT_EQ(NO_ERROR,
+              mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                                       EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+}
+
+} // namespace android
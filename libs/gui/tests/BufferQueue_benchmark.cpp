@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IProducerListener.h>
+
+#include <binder/Parcel.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <system/window.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace android;
+
+namespace {
+
+// Wakes up the consumer thread whenever a frame is queued.
+class FrameAvailableListener : public BnConsumerListener {
+public:
+    void onFrameAvailable(const BufferItem& /* item */) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingFrames++;
+        mCondition.notify_one();
+    }
+    void onBuffersReleased() override {}
+    void onSidebandStreamChanged() override {}
+
+    // Returns false once stop() has been called.
+    bool waitForFrame() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this] { return mPendingFrames > 0 || mStopped; });
+        if (mPendingFrames == 0) return false;
+        mPendingFrames--;
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopped = true;
+        mCondition.notify_one();
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    int mPendingFrames = 0;
+    bool mStopped = false;
+};
+
+// Runs a producer and a consumer trading buffers back and forth as fast as
+// they can, which makes the producer wait for a release on nearly every
+// dequeue.
+void RunProducerConsumerHandoff(benchmark::State& state, const sp<IGraphicBufferProducer>& producer,
+                                const sp<IGraphicBufferConsumer>& consumer) {
+    sp<FrameAvailableListener> listener = new FrameAvailableListener;
+    consumer->consumerConnect(listener, false);
+    IGraphicBufferProducer::QueueBufferOutput output;
+    producer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false, &output);
+
+    std::thread consumerThread([&] {
+        while (listener->waitForFrame()) {
+            BufferItem item;
+            if (consumer->acquireBuffer(&item, 0) == NO_ERROR) {
+                consumer->releaseHelper(item.mSlot, item.mFrameNumber, Fence::NO_FENCE);
+            }
+        }
+    });
+
+    const IGraphicBufferProducer::QueueBufferInput input(0, false, HAL_DATASPACE_UNKNOWN,
+                                                         Rect(0, 0, 1, 1),
+                                                         NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                                                         Fence::NO_FENCE);
+    while (state.KeepRunning()) {
+        int slot;
+        sp<Fence> fence;
+        const status_t result =
+                producer->dequeueBuffer(&slot, &fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN,
+                                        nullptr, nullptr);
+        if (result == IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            producer->requestBuffer(slot, &buffer);
+        } else if (result != NO_ERROR) {
+            state.SkipWithError("dequeueBuffer failed");
+            break;
+        }
+        producer->queueBuffer(slot, input, &output);
+    }
+
+    listener->stop();
+    consumerThread.join();
+    producer->disconnect(NATIVE_WINDOW_API_CPU);
+    consumer->consumerDisconnect();
+}
+
+// range(0) selects the low contention mode.
+void BM_ProducerConsumerHandoff(benchmark::State& state) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer, false, state.range(0) != 0);
+    RunProducerConsumerHandoff(state, producer, consumer);
+}
+BENCHMARK(BM_ProducerConsumerHandoff)->Arg(0)->Arg(1)->UseRealTime();
+
+// Flattens and unflattens a QueueBufferInput through a Parcel, the way every
+// queueBuffer call across binder does. range(0) selects a frame with the usual
+// defaults (0) or one that sets every optional field except the fence (1).
+void BM_QueueBufferInputParcel(benchmark::State& state) {
+    IGraphicBufferProducer::QueueBufferInput input(0, true, HAL_DATASPACE_UNKNOWN,
+                                                   Rect::EMPTY_RECT, 0, 0, Fence::NO_FENCE);
+    input.setSurfaceDamage(Region::INVALID_REGION);
+    if (state.range(0) != 0) {
+        HdrMetadata hdrMetadata;
+        hdrMetadata.validTypes = HdrMetadata::CTA861_3;
+        hdrMetadata.cta8613 = {1000.0f, 500.0f};
+        input = IGraphicBufferProducer::QueueBufferInput(1, false, HAL_DATASPACE_V0_SRGB,
+                                                         Rect(0, 0, 64, 64),
+                                                         NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW,
+                                                         NATIVE_WINDOW_TRANSFORM_ROT_90,
+                                                         Fence::NO_FENCE,
+                                                         NATIVE_WINDOW_TRANSFORM_FLIP_H, true);
+        input.setSurfaceDamage(Region(Rect(0, 0, 8, 8)));
+        input.setHdrMetadata(hdrMetadata);
+    }
+
+    Parcel parcel;
+    while (state.KeepRunning()) {
+        parcel.setDataSize(0);
+        parcel.write(input);
+        parcel.setDataPosition(0);
+        IGraphicBufferProducer::QueueBufferInput output(parcel);
+        benchmark::DoNotOptimize(output);
+    }
+    parcel.setDataSize(0);
+    parcel.write(input);
+    state.SetLabel(std::to_string(parcel.dataSize()) + " bytes");
+}
+BENCHMARK(BM_QueueBufferInputParcel)->Arg(0)->Arg(1);
+
+#ifndef NO_BUFFERHUB
+// The same handoff through BufferHub queues, for comparison with
+// BM_ProducerConsumerHandoff. Frames reach the consumer through the
+// BufferHubConsumer event thread, whose CPU time is not counted.
+void BM_BufferHubProducerConsumerHandoff(benchmark::State& state) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferHubQueue(&producer, &consumer);
+    RunProducerConsumerHandoff(state, producer, consumer);
+}
+BENCHMARK(BM_BufferHubProducerConsumerHandoff)->UseRealTime();
+#endif
+
+} // namespace
+
+BENCHMARK_MAIN();
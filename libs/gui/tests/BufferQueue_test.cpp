@@ -786,6 +786,54 @@ TEST_F(BufferQueueTest, TestTimeouts) {
     ASSERT_GE(systemTime() - startTime, TIMEOUT);
 }
 
+TEST_F(BufferQueueTest, LowContentionDequeueWaitsForRelease) {
+    BufferQueue::createBufferQueue(&mProducer, &mConsumer, false, true);
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    IGraphicBufferProducer::QueueBufferInput input(0ull, false,
+            HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+
+    // Queue two buffers and acquire the first one, which leaves no free
+    // buffer for the producer.
+    for (int i = 0; i < 2; ++i) {
+        int slot = BufferQueue::INVALID_BUFFER_SLOT;
+        sp<Fence> fence = Fence::NO_FENCE;
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0, nullptr, nullptr));
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+    }
+    BufferItem item;
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+
+    // The dequeue times out like in the default mode...
+    const auto TIMEOUT = ms2ns(50);
+    mProducer->setDequeueTimeout(TIMEOUT);
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence = Fence::NO_FENCE;
+    auto startTime = systemTime();
+    ASSERT_EQ(TIMED_OUT, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0, nullptr, nullptr));
+    ASSERT_GE(systemTime() - startTime, TIMEOUT);
+
+    // ...and returns the released buffer once the consumer lets go of it,
+    // whether the producer is still spinning or already asleep.
+    mProducer->setDequeueTimeout(-1);
+    std::thread releaseThread([&] {
+        std::this_thread::sleep_for(20ms);
+        mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber, EGL_NO_DISPLAY,
+                EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+    });
+    EXPECT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0, nullptr, nullptr));
+    EXPECT_EQ(item.mSlot, slot);
+    releaseThread.join();
+}
+
 TEST_F(BufferQueueTest, CanAttachWhileDisallowingAllocation) {
     createBufferQueue();
     sp<DummyConsumer> dc(new DummyConsumer);
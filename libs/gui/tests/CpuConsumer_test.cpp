@@ -682,6 +682,50 @@ TEST_P(CpuConsumerTest, FromCpuLockMax) {
     }
 }
 
+TEST_P(CpuConsumerTest, FromCpuPersistentMapping) {
+    status_t err;
+    CpuConsumerTestParams params = GetParam();
+
+    ASSERT_NO_FATAL_FAILURE(configureANW(mANW, params, params.maxLockedBuffers + 1));
+    mCC->setPersistentMapping(true);
+
+    // Cycle through the buffers a few times so mapped buffers are reused.
+    const int numFrames = (params.maxLockedBuffers + 1) * 3;
+    for (int i = 0; i < numFrames; i++) {
+        const int64_t time = 1000L + i;
+        uint32_t stride;
+        ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, time, &stride));
+
+        CpuConsumer::LockedBuffer b;
+        err = mCC->lockNextBuffer(&b);
+        ASSERT_NO_ERROR(err, "getNextBuffer error: ");
+
+        ASSERT_TRUE(b.data != NULL);
+        EXPECT_EQ(params.width,  b.width);
+        EXPECT_EQ(params.height, b.height);
+        EXPECT_EQ(params.format, b.format);
+        EXPECT_EQ(stride, b.stride);
+        EXPECT_EQ(time, b.timestamp);
+
+        checkAnyBuffer(b, GetParam().format);
+
+        err = mCC->unlockBuffer(b);
+        ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+    }
+
+    // Disabling persistent mapping while a buffer is held leaves its unlock
+    // to unlockBuffer.
+    uint32_t stride;
+    ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, 1L, &stride));
+    CpuConsumer::LockedBuffer b;
+    err = mCC->lockNextBuffer(&b);
+    ASSERT_NO_ERROR(err, "getNextBuffer error: ");
+    mCC->setPersistentMapping(false);
+    checkAnyBuffer(b, GetParam().format);
+    err = mCC->unlockBuffer(b);
+    ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+}
+
 TEST_P(CpuConsumerTest, FromCpuInvalid) {
     status_t err = mCC->lockNextBuffer(nullptr);
     ASSERT_EQ(BAD_VALUE, err) << "lockNextBuffer did not fail";
@@ -802,4 +802,60 @@ INSTANTIATE_TEST_CASE_P(IGraphicBufferProducerBackends, IGraphicBufferProducerTe
                         ::testing::Values(USE_BUFFER_QUEUE_PRODUCER));
 #endif
 
+// Fields left at their usual values are not written to the parcel, but must
+// still come back as they were sent.
+TEST(QueueBufferInputTest, ParcelRoundTrip) {
+    HdrMetadata hdrMetadata;
+    hdrMetadata.validTypes = HdrMetadata::CTA861_3;
+    hdrMetadata.cta8613 = {1000.0f, 500.0f};
+    const Region damage(Rect(0, 0, 8, 8));
+
+    for (const Region& region : {Region(), Region::INVALID_REGION, damage}) {
+        for (bool populated : {false, true}) {
+            IGraphicBufferProducer::QueueBufferInput input(populated ? 42 : 0, !populated,
+                    HAL_DATASPACE_UNKNOWN, populated ? Rect(0, 0, 4, 4) : Rect::EMPTY_RECT,
+                    populated ? NATIVE_WINDOW_SCALING_MODE_SCALE_CROP : 0,
+                    populated ? NATIVE_WINDOW_TRANSFORM_ROT_90 : 0, Fence::NO_FENCE,
+                    populated ? NATIVE_WINDOW_TRANSFORM_FLIP_H : 0, populated);
+            input.setSurfaceDamage(region);
+            if (populated) {
+                input.setHdrMetadata(hdrMetadata);
+            }
+
+            Parcel parcel;
+            ASSERT_OK(parcel.write(input));
+            parcel.setDataPosition(0);
+            IGraphicBufferProducer::QueueBufferInput output(parcel);
+
+            int64_t timestamp[2];
+            bool isAutoTimestamp[2];
+            android_dataspace dataSpace[2];
+            Rect crop[2];
+            int scalingMode[2];
+            uint32_t transform[2];
+            sp<Fence> fence[2];
+            uint32_t stickyTransform[2];
+            bool getFrameTimestamps[2];
+            input.deflate(&timestamp[0], &isAutoTimestamp[0], &dataSpace[0], &crop[0],
+                          &scalingMode[0], &transform[0], &fence[0], &stickyTransform[0],
+                          &getFrameTimestamps[0]);
+            output.deflate(&timestamp[1], &isAutoTimestamp[1], &dataSpace[1], &crop[1],
+                           &scalingMode[1], &transform[1], &fence[1], &stickyTransform[1],
+                           &getFrameTimestamps[1]);
+            EXPECT_EQ(timestamp[0], timestamp[1]);
+            EXPECT_EQ(isAutoTimestamp[0], isAutoTimestamp[1]);
+            EXPECT_EQ(dataSpace[0], dataSpace[1]);
+            EXPECT_EQ(crop[0], crop[1]);
+            EXPECT_EQ(scalingMode[0], scalingMode[1]);
+            EXPECT_EQ(transform[0], transform[1]);
+            EXPECT_FALSE(fence[1]->isValid());
+            EXPECT_EQ(stickyTransform[0], stickyTransform[1]);
+            EXPECT_EQ(getFrameTimestamps[0], getFrameTimestamps[1]);
+            EXPECT_TRUE(output.getSurfaceDamage().isRect());
+            EXPECT_EQ(region.getBounds(), output.getSurfaceDamage().getBounds());
+            EXPECT_EQ(input.getHdrMetadata(), output.getHdrMetadata());
+        }
+    }
+}
+
 } // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_test"
+
+#include <gtest/gtest.h>
+
+#include <binder/Parcel.h>
+#include <gui/LayerState.h>
+
+namespace android {
+
+TEST(LayerStateTest, WritesOnlyChangedFields) {
+    layer_state_t state;
+    state.what = layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged;
+    state.x = 12.0f;
+    state.y = 34.0f;
+    state.alpha = 0.5f;
+    // not flagged, so not sent
+    state.w = 100;
+    state.crop = Rect(0, 0, 10, 10);
+    state.transparentRegion = Region(Rect(0, 0, 5, 5));
+
+    Parcel p;
+    ASSERT_EQ(NO_ERROR, state.write(p));
+    // null surface, what, x, y, alpha
+    EXPECT_EQ(sizeof(flat_binder_object) + 4 * sizeof(uint32_t), p.dataSize());
+
+    layer_state_t read;
+    p.setDataPosition(0);
+    ASSERT_EQ(NO_ERROR, read.read(p));
+    EXPECT_EQ(state.what, read.what);
+    EXPECT_EQ(12.0f, read.x);
+    EXPECT_EQ(34.0f, read.y);
+    EXPECT_EQ(0.5f, read.alpha);
+    EXPECT_EQ(0u, read.w);
+    EXPECT_FALSE(read.crop.isValid());
+    EXPECT_TRUE(read.transparentRegion.isEmpty());
+}
+
+TEST(LayerStateTest, RoundTripsAllChanges) {
+    layer_state_t state;
+    state.what = layer_state_t::eRelativeLayerChanged | layer_state_t::eSizeChanged |
+            layer_state_t::eMatrixChanged | layer_state_t::eTransparentRegionChanged |
+            layer_state_t::eFlagsChanged | layer_state_t::eLayerStackChanged |
+            layer_state_t::eCropChanged | layer_state_t::eFinalCropChanged |
+            layer_state_t::eOverrideScalingModeChanged | layer_state_t::eColorChanged |
+            layer_state_t::eDeferTransaction;
+    state.z = -3;
+    state.w = 640;
+    state.h = 480;
+    state.matrix.dsdx = 2.0f;
+    state.transparentRegion = Region(Rect(1, 2, 3, 4));
+    state.flags = layer_state_t::eLayerOpaque;
+    state.mask = layer_state_t::eLayerOpaque | layer_state_t::eLayerHidden;
+    state.layerStack = 7;
+    state.crop = Rect(1, 1, 9, 9);
+    state.finalCrop = Rect(2, 2, 8, 8);
+    state.overrideScalingMode = 1;
+    state.color = half3(0.25f, 0.5f, 0.75f);
+    state.frameNumber = 42;
+
+    Parcel p;
+    ASSERT_EQ(NO_ERROR, state.write(p));
+    layer_state_t read;
+    p.setDataPosition(0);
+    ASSERT_EQ(NO_ERROR, read.read(p));
+    EXPECT_EQ(p.dataSize(), p.dataPosition());
+
+    EXPECT_EQ(state.what, read.what);
+    EXPECT_EQ(state.z, read.z);
+    EXPECT_EQ(state.w, read.w);
+    EXPECT_EQ(state.h, read.h);
+    EXPECT_EQ(state.matrix.dsdx, read.matrix.dsdx);
+    EXPECT_EQ(state.transparentRegion.getBounds(), read.transparentRegion.getBounds());
+    EXPECT_EQ(state.flags, read.flags);
+    EXPECT_EQ(state.mask, read.mask);
+    EXPECT_EQ(state.layerStack, read.layerStack);
+    EXPECT_EQ(state.crop, read.crop);
+    EXPECT_EQ(state.finalCrop, read.finalCrop);
+    EXPECT_EQ(state.overrideScalingMode, read.overrideScalingMode);
+    EXPECT_EQ(state.color, read.color);
+    EXPECT_EQ(state.frameNumber, read.frameNumber);
+}
+
+TEST(LayerStateTest, MergesColor) {
+    layer_state_t state;
+    layer_state_t other;
+    other.what = layer_state_t::eColorChanged;
+    other.color = half3(1.0f, 0.0f, 0.0f);
+    state.merge(other);
+    EXPECT_EQ(static_cast<uint32_t>(layer_state_t::eColorChanged), state.what);
+    EXPECT_EQ(other.color, state.color);
+}
+
+} // namespace android
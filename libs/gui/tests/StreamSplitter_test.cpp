@@ -195,6 +195,90 @@ TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
                                            nullptr, nullptr));
 }
 
+TEST_F(StreamSplitterTest, LatestOnlyOutputDoesNotBlock) {
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> fastProducer;
+    sp<IGraphicBufferConsumer> fastConsumer;
+    BufferQueue::createBufferQueue(&fastProducer, &fastConsumer);
+    ASSERT_EQ(OK, fastConsumer->consumerConnect(new DummyListener, false));
+
+    sp<IGraphicBufferProducer> slowProducer;
+    sp<IGraphicBufferConsumer> slowConsumer;
+    BufferQueue::createBufferQueue(&slowProducer, &slowConsumer);
+    ASSERT_EQ(OK, slowConsumer->consumerConnect(new DummyListener, false));
+
+    sp<StreamSplitter> splitter;
+    status_t status = StreamSplitter::createSplitter(inputConsumer, &splitter);
+    ASSERT_EQ(OK, status);
+    ASSERT_EQ(OK, splitter->addOutput(fastProducer));
+    ASSERT_EQ(OK, splitter->addOutput(slowProducer,
+            StreamSplitter::DROP_POLICY_LATEST, 1));
+    ASSERT_EQ(BAD_VALUE, splitter->addOutput(slowProducer,
+            StreamSplitter::DROP_POLICY_LATEST, 0));
+
+    ASSERT_EQ(OK, fastProducer->allowAllocation(false));
+    ASSERT_EQ(OK, slowProducer->allowAllocation(false));
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    IGraphicBufferProducer::QueueBufferInput qbInput(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+
+    // Queue two buffers. The slow output keeps the first one, so the second
+    // one is only sent to the fast output.
+    for (int frame = 0; frame < 2; ++frame) {
+        int slot;
+        sp<Fence> fence;
+        sp<GraphicBuffer> buffer;
+        ASSERT_LE(0, inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN, nullptr, nullptr));
+        ASSERT_EQ(OK, inputProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, inputProducer->queueBuffer(slot, qbInput, &qbOutput));
+
+        BufferItem item;
+        ASSERT_EQ(OK, fastConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, fastConsumer->releaseBuffer(item.mSlot,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    BufferItem item;
+    ASSERT_EQ(OK, slowConsumer->acquireBuffer(&item, 0));
+    BufferItem droppedItem;
+    ASSERT_EQ(BufferQueue::NO_BUFFER_AVAILABLE,
+            slowConsumer->acquireBuffer(&droppedItem, 0));
+
+    StreamSplitter::OutputStats stats;
+    ASSERT_EQ(OK, splitter->getOutputStats(fastProducer, &stats));
+    EXPECT_EQ(2u, stats.queuedBuffers);
+    EXPECT_EQ(0u, stats.droppedBuffers);
+    EXPECT_EQ(2u, stats.releasedBuffers);
+
+    ASSERT_EQ(OK, splitter->getOutputStats(slowProducer, &stats));
+    EXPECT_EQ(1u, stats.queuedBuffers);
+    EXPECT_EQ(1u, stats.droppedBuffers);
+    EXPECT_EQ(0u, stats.releasedBuffers);
+
+    // The second buffer was released by every output it was sent to, so it
+    // can be dequeued from the input without allocating
+    ASSERT_EQ(OK, inputProducer->allowAllocation(false));
+    int slot;
+    sp<Fence> fence;
+    ASSERT_LE(0, inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN, nullptr, nullptr));
+
+    ASSERT_EQ(OK, slowConsumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, splitter->getOutputStats(slowProducer, &stats));
+    EXPECT_EQ(1u, stats.releasedBuffers);
+}
+
 TEST_F(StreamSplitterTest, OutputAbandonment) {
     sp<IGraphicBufferProducer> inputProducer;
     sp<IGraphicBufferConsumer> inputConsumer;
@@ -20,6 +20,8 @@
 #include <math.h>
 #include <limits.h>
 
+#include <algorithm>
+
 #include <input/Input.h>
 #include <input/InputEventLabels.h>
 
@@ -29,6 +31,9 @@
 
 namespace android {
 
+// Number of samples MotionEvent::transform gathers into contiguous arrays at a time.
+static const size_t TRANSFORM_BATCH_SIZE = 64;
+
 // --- InputEvent ---
 
 void InputEvent::initialize(int32_t deviceId, int32_t source) {
@@ -121,22 +126,20 @@ status_t PointerCoords::setAxisValue(int32_t axis, float value) {
     return OK;
 }
 
-static inline void scaleAxisValue(PointerCoords& c, int axis, float scaleFactor) {
-    float value = c.getAxisValue(axis);
-    if (value != 0) {
-        c.setAxisValue(axis, value * scaleFactor);
-    }
-}
-
 void PointerCoords::scale(float scaleFactor) {
     // No need to scale pressure or size since they are normalized.
     // No need to scale orientation since it is meaningless to do so.
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_X, scaleFactor);
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_Y, scaleFactor);
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_TOUCH_MAJOR, scaleFactor);
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_TOUCH_MINOR, scaleFactor);
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_TOOL_MAJOR, scaleFactor);
-    scaleAxisValue(*this, AMOTION_EVENT_AXIS_TOOL_MINOR, scaleFactor);
+    // Walk the present axes that need scaling once instead of looking each one up.
+    uint64_t scaledBits = bits & (BitSet64::valueForBit(AMOTION_EVENT_AXIS_X)
+            | BitSet64::valueForBit(AMOTION_EVENT_AXIS_Y)
+            | BitSet64::valueForBit(AMOTION_EVENT_AXIS_TOUCH_MAJOR)
+            | BitSet64::valueForBit(AMOTION_EVENT_AXIS_TOUCH_MINOR)
+            | BitSet64::valueForBit(AMOTION_EVENT_AXIS_TOOL_MAJOR)
+            | BitSet64::valueForBit(AMOTION_EVENT_AXIS_TOOL_MINOR));
+    while (!BitSet64::isEmpty(scaledBits)) {
+        uint32_t axis = BitSet64::clearFirstMarkedBit(scaledBits);
+        values[BitSet64::getIndexOfBit(bits, axis)] *= scaleFactor;
+    }
 }
 
 void PointerCoords::applyOffset(float xOffset, float yOffset) {
@@ -348,8 +351,9 @@ void MotionEvent::scale(float scaleFactor) {
     mYPrecision *= scaleFactor;
 
     size_t numSamples = mSamplePointerCoords.size();
+    PointerCoords* coords = mSamplePointerCoords.editArray();
     for (size_t i = 0; i < numSamples; i++) {
-        mSamplePointerCoords.editItemAt(i).scale(scaleFactor);
+        coords[i].scale(scaleFactor);
     }
 }
 
@@ -365,6 +369,37 @@ static void transformPoint(const float matrix[9], float x, float y, float *outX,
     *outY = newY * newZ;
 }
 
+// Transforms 'count' points in place.  Windows are almost always positioned with an affine
+// matrix, often a pure translation, so those skip the perspective divide and reduce to
+// straight-line loops over the contiguous arrays that the compiler vectorizes.
+static void transformPoints(const float matrix[9], float* xs, float* ys, size_t count) {
+    if (matrix[6] != 0 || matrix[7] != 0 || matrix[8] != 1) {
+        for (size_t i = 0; i < count; i++) {
+            transformPoint(matrix, xs[i], ys[i], &xs[i], &ys[i]);
+        }
+        return;
+    }
+
+    if (matrix[0] == 1 && matrix[1] == 0 && matrix[3] == 0 && matrix[4] == 1) {
+        const float tx = matrix[2];
+        const float ty = matrix[5];
+        for (size_t i = 0; i < count; i++) {
+            xs[i] += tx;
+            ys[i] += ty;
+        }
+        return;
+    }
+
+    const float m0 = matrix[0], m1 = matrix[1], m2 = matrix[2];
+    const float m3 = matrix[3], m4 = matrix[4], m5 = matrix[5];
+    for (size_t i = 0; i < count; i++) {
+        float x = xs[i];
+        float y = ys[i];
+        xs[i] = m0 * x + m1 * y + m2;
+        ys[i] = m3 * x + m4 * y + m5;
+    }
+}
+
 static float transformAngle(const float matrix[9], float angleRadians,
         float originX, float originY) {
     // Construct and transform a vector oriented at the specified clockwise angle from vertical.
@@ -404,19 +439,41 @@ void MotionEvent::transform(const float matrix[9]) {
     float originX, originY;
     transformPoint(matrix, 0, 0, &originX, &originY);
 
-    // Apply the transformation to all samples.
+    // Apply the transformation to all samples, gathering their positions into contiguous
+    // arrays a batch at a time so that they are transformed together.
+    // The transformed orientation only depends on the matrix and the original orientation,
+    // which rarely changes from one sample to the next, so the last one is remembered
+    // to avoid the trigonometry.
+    float xs[TRANSFORM_BATCH_SIZE];
+    float ys[TRANSFORM_BATCH_SIZE];
+    bool haveLastOrientation = false;
+    float lastOrientation = 0;
+    float lastTransformedOrientation = 0;
     size_t numSamples = mSamplePointerCoords.size();
-    for (size_t i = 0; i < numSamples; i++) {
-        PointerCoords& c = mSamplePointerCoords.editItemAt(i);
-        float x = c.getAxisValue(AMOTION_EVENT_AXIS_X) + oldXOffset;
-        float y = c.getAxisValue(AMOTION_EVENT_AXIS_Y) + oldYOffset;
-        transformPoint(matrix, x, y, &x, &y);
-        c.setAxisValue(AMOTION_EVENT_AXIS_X, x - mXOffset);
-        c.setAxisValue(AMOTION_EVENT_AXIS_Y, y - mYOffset);
-
-        float orientation = c.getAxisValue(AMOTION_EVENT_AXIS_ORIENTATION);
-        c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION,
-                transformAngle(matrix, orientation, originX, originY));
+    PointerCoords* coords = mSamplePointerCoords.editArray();
+    for (size_t start = 0; start < numSamples; start += TRANSFORM_BATCH_SIZE) {
+        size_t count = std::min(numSamples - start, TRANSFORM_BATCH_SIZE);
+        PointerCoords* batch = coords + start;
+        for (size_t i = 0; i < count; i++) {
+            xs[i] = batch[i].getX() + oldXOffset;
+            ys[i] = batch[i].getY() + oldYOffset;
+        }
+        transformPoints(matrix, xs, ys, count);
+
+        for (size_t i = 0; i < count; i++) {
+            PointerCoords& c = batch[i];
+            c.setAxisValue(AMOTION_EVENT_AXIS_X, xs[i] - mXOffset);
+            c.setAxisValue(AMOTION_EVENT_AXIS_Y, ys[i] - mYOffset);
+
+            float orientation = c.getAxisValue(AMOTION_EVENT_AXIS_ORIENTATION);
+            if (!haveLastOrientation || orientation != lastOrientation) {
+                haveLastOrientation = true;
+                lastOrientation = orientation;
+                lastTransformedOrientation = transformAngle(matrix, orientation,
+                        originX, originY);
+            }
+            c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, lastTransformedOrientation);
+        }
     }
 }
 
@@ -23,10 +23,15 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+
+#include <cutils/ashmem.h>
 #include <cutils/properties.h>
 #include <log/log.h>
 
@@ -40,6 +45,9 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Most messages exchanged by a single sendmmsg() or recvmmsg() call.
+static const size_t MAX_MESSAGES_PER_CALL = 16;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -58,6 +66,10 @@ static const nsecs_t RESAMPLE_MAX_DELTA = 20 * NANOS_PER_MS;
 // far into the future.  This time is further bounded by 50% of the last time delta.
 static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
 
+// Upper bound of ro.input.resample_prediction_ms, about a frame at 60Hz.  Predicting
+// further than that mostly overshoots.
+static const nsecs_t RESAMPLE_MAX_PREDICTION_TARGET = 16 * NANOS_PER_MS;
+
 template<typename T>
 inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
@@ -78,6 +90,8 @@ bool InputMessage::isValid(size_t actualSize) const {
             return body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
+        case TYPE_SHARED_MEMORY:
+        case TYPE_WAKEUP:
             return true;
         }
     }
@@ -97,6 +111,185 @@ size_t InputMessage::size() const {
 }
 
 
+// --- SharedMemoryTransport ---
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the rings are shared with another process");
+
+/*
+ * A pair of single producer, single consumer rings of input messages, one for
+ * each direction, in memory shared by both ends of a channel. The socket is
+ * only used to hand over the memory and to wake up a reader that is waiting
+ * on it, so a burst of events costs a single system call.
+ *
+ * The peer may write anything at any time in the shared memory, so nothing
+ * read from it is trusted before it has been copied out and validated.
+ */
+class SharedMemoryTransport : public RefBase {
+public:
+    // Creates the memory on the server end. outFd is what the peer must map.
+    static sp<SharedMemoryTransport> create(const std::string& name, int* outFd);
+    // Maps the memory created by the server, on the client end.
+    static sp<SharedMemoryTransport> map(int fd);
+
+    // Returns WOULD_BLOCK if the ring is full.
+    status_t push(const InputMessage* msg);
+    // Returns WOULD_BLOCK if the ring is empty, BAD_VALUE if the peer broke it.
+    status_t pop(InputMessage* msg);
+
+    // Lets the writer know it must wake the reader up after its next push.
+    void announceWaiting();
+    // Returns whether the reader is waiting, and is to be woken up by the caller.
+    bool takeWaiter();
+
+private:
+    enum { RING_SLOT_COUNT = 16 };
+
+    struct Slot {
+        uint32_t size;
+        uint32_t padding;
+        InputMessage msg;
+    };
+
+    struct Ring {
+        std::atomic<uint32_t> head; // next slot written, only moved by the writer
+        std::atomic<uint32_t> tail; // next slot read, only moved by the reader
+        std::atomic<uint32_t> readerWaiting;
+        uint8_t padding[64 - 3 * sizeof(uint32_t)]; // keeps the slots apart
+        Slot slots[RING_SLOT_COUNT];
+    };
+
+    // rings[0] carries the server's messages, rings[1] the client's.
+    struct Region {
+        Ring rings[2];
+    };
+
+    SharedMemoryTransport(Region* region, bool server);
+    virtual ~SharedMemoryTransport();
+
+    Region* mRegion;
+    Ring* mTx;
+    Ring* mRx;
+};
+
+sp<SharedMemoryTransport> SharedMemoryTransport::create(const std::string& name, int* outFd) {
+    int fd = ashmem_create_region(name.c_str(), sizeof(Region));
+    if (fd < 0) {
+        ALOGE("channel '%s' ~ Could not create shared memory.  errno=%d", name.c_str(), errno);
+        return NULL;
+    }
+    void* addr = mmap(NULL, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("channel '%s' ~ Could not map shared memory.  errno=%d", name.c_str(), errno);
+        ::close(fd);
+        return NULL;
+    }
+    Region* region = static_cast<Region*>(addr);
+    for (Ring& ring : region->rings) {
+        ring.head.store(0, std::memory_order_relaxed);
+        ring.tail.store(0, std::memory_order_relaxed);
+        // Nobody has announced itself yet, the first push must wake the reader.
+        ring.readerWaiting.store(1, std::memory_order_relaxed);
+    }
+    *outFd = fd;
+    return new SharedMemoryTransport(region, true);
+}
+
+sp<SharedMemoryTransport> SharedMemoryTransport::map(int fd) {
+    int size = ashmem_get_size_region(fd);
+    if (size < 0 || size_t(size) != sizeof(Region)) {
+        ALOGE("Shared memory of the wrong size: %d, expected %zu", size, sizeof(Region));
+        return NULL;
+    }
+    void* addr = mmap(NULL, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("Could not map shared memory.  errno=%d", errno);
+        return NULL;
+    }
+    return new SharedMemoryTransport(static_cast<Region*>(addr), false);
+}
+
+SharedMemoryTransport::SharedMemoryTransport(Region* region, bool server) :
+        mRegion(region),
+        mTx(&region->rings[server ? 0 : 1]),
+        mRx(&region->rings[server ? 1 : 0]) {
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    munmap(mRegion, sizeof(Region));
+}
+
+status_t SharedMemoryTransport::push(const InputMessage* msg) {
+    const uint32_t head = mTx->head.load(std::memory_order_relaxed);
+    const uint32_t tail = mTx->tail.load(std::memory_order_acquire);
+    if (head - tail >= RING_SLOT_COUNT) {
+        return WOULD_BLOCK;
+    }
+    Slot& slot = mTx->slots[head % RING_SLOT_COUNT];
+    const size_t size = msg->size();
+    slot.size = size;
+    memcpy(&slot.msg, msg, size);
+    // Sequentially consistent with announceWaiting(), so that either the reader
+    // sees the message or takeWaiter() sees the reader.
+    mTx->head.store(head + 1, std::memory_order_seq_cst);
+    return OK;
+}
+
+status_t SharedMemoryTransport::pop(InputMessage* msg) {
+    const uint32_t tail = mRx->tail.load(std::memory_order_relaxed);
+    const uint32_t head = mRx->head.load(std::memory_order_seq_cst);
+    if (head == tail) {
+        return WOULD_BLOCK;
+    }
+    if (head - tail > RING_SLOT_COUNT) {
+        return BAD_VALUE;
+    }
+    const Slot& slot = mRx->slots[tail % RING_SLOT_COUNT];
+    const uint32_t size = slot.size;
+    if (size > sizeof(InputMessage)) {
+        return BAD_VALUE;
+    }
+    memcpy(msg, &slot.msg, size);
+    mRx->tail.store(tail + 1, std::memory_order_release);
+    return msg->isValid(size) ? OK : BAD_VALUE;
+}
+
+void SharedMemoryTransport::announceWaiting() {
+    mRx->readerWaiting.store(1, std::memory_order_seq_cst);
+}
+
+bool SharedMemoryTransport::takeWaiter() {
+    return mTx->readerWaiting.exchange(0, std::memory_order_seq_cst) != 0;
+}
+
+// Returns the first fd passed along with a message, and closes any other.
+static int takeFd(struct msghdr* hdr) {
+    int fd = -1;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int received;
+            memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (fd < 0) {
+                fd = received;
+            } else {
+                ::close(received);
+            }
+        }
+    }
+    return fd;
+}
+
+static void closeFd(int fd) {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+
 // --- InputChannel ---
 
 InputChannel::InputChannel(const std::string& name, int fd) :
@@ -145,14 +338,55 @@ status_t InputChannel::openInputChannelPair(const std::string& name,
     std::string clientChannelName = name;
     clientChannelName += " (client)";
     outClientChannel = new InputChannel(clientChannelName, sockets[1]);
+
+    if (property_get_bool("debug.input.shared_memory_transport", false)) {
+        status_t result = outServerChannel->enableSharedMemoryTransport();
+        if (result) {
+            ALOGW("channel '%s' ~ Falling back to the socket transport.  status=%d",
+                    name.c_str(), result);
+        }
+    }
     return OK;
 }
 
 status_t InputChannel::sendMessage(const InputMessage* msg) {
+    if (mSharedMemory != NULL) {
+        status_t result = mSharedMemory->push(msg);
+        if (result) {
+            return result;
+        }
+        return wakeSharedMemoryReader();
+    }
+    return sendSocketMessage(msg, -1);
+}
+
+status_t InputChannel::sendSocketMessage(const InputMessage* msg, int fd) {
     size_t msgLength = msg->size();
+    struct iovec iov;
+    iov.iov_base = const_cast<InputMessage*>(msg);
+    iov.iov_len = msgLength;
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        hdr.msg_control = &control;
+        hdr.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
     ssize_t nWrite;
     do {
-        nWrite = ::send(mFd, msg, msgLength, MSG_DONTWAIT | MSG_NOSIGNAL);
+        nWrite = ::sendmsg(mFd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
     } while (nWrite == -1 && errno == EINTR);
 
     if (nWrite < 0) {
@@ -185,9 +419,49 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
 }
 
 status_t InputChannel::receiveMessage(InputMessage* msg) {
+    for (;;) {
+        if (mSharedMemory != NULL) {
+            status_t result = mSharedMemory->pop(msg);
+            if (result != WOULD_BLOCK) {
+                return result;
+            }
+        }
+
+        int fd;
+        status_t result = receiveSocketMessage(msg, &fd);
+        if (result == WOULD_BLOCK && mSharedMemory != NULL) {
+            // Ask for a wakeup, then look again in case the writer had missed it.
+            mSharedMemory->announceWaiting();
+            return mSharedMemory->pop(msg);
+        }
+        if (result) {
+            return result;
+        }
+        if (!handleTransportMessage(msg, fd)) {
+            return OK;
+        }
+    }
+}
+
+status_t InputChannel::receiveSocketMessage(InputMessage* msg, int* outFd) {
+    *outFd = -1;
+    struct iovec iov;
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(InputMessage);
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = &control;
+    hdr.msg_controllen = sizeof(control);
+
     ssize_t nRead;
     do {
-        nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
+        nRead = ::recvmsg(mFd, &hdr, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
     } while (nRead == -1 && errno == EINTR);
 
     if (nRead < 0) {
@@ -204,10 +478,13 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
         return -error;
     }
 
+    int fd = takeFd(&hdr);
+
     if (nRead == 0) { // check for EOF
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ receive message failed because peer was closed", mName.c_str());
 #endif
+        closeFd(fd);
         return DEAD_OBJECT;
     }
 
@@ -215,18 +492,251 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ received invalid message", mName.c_str());
 #endif
+        closeFd(fd);
         return BAD_VALUE;
     }
 
 #if DEBUG_CHANNEL_MESSAGES
     ALOGD("channel '%s' ~ received message of type %d", mName.c_str(), msg->header.type);
 #endif
+    *outFd = fd;
+    return OK;
+}
+
+bool InputChannel::handleTransportMessage(const InputMessage* msg, int fd) {
+    switch (msg->header.type) {
+    case InputMessage::TYPE_SHARED_MEMORY:
+        if (mSharedMemory == NULL && fd >= 0) {
+            mSharedMemory = SharedMemoryTransport::map(fd);
+            if (mSharedMemory == NULL) {
+                ALOGE("channel '%s' ~ could not map the shared memory sent by the peer, "
+                        "messages will be lost", mName.c_str());
+            }
+        }
+        closeFd(fd);
+        return true;
+    case InputMessage::TYPE_WAKEUP:
+        closeFd(fd);
+        return true;
+    }
+    closeFd(fd);
+    return false;
+}
+
+status_t InputChannel::wakeSharedMemoryReader() {
+    if (!mSharedMemory->takeWaiter()) {
+        return OK;
+    }
+    InputMessage msg;
+    msg.header.type = InputMessage::TYPE_WAKEUP;
+    msg.header.padding = 0;
+    status_t result = sendSocketMessage(&msg, -1);
+    // A full socket is already holding wakeups the reader has yet to see.
+    return result == WOULD_BLOCK ? OK : result;
+}
+
+status_t InputChannel::enableSharedMemoryTransport() {
+    if (mSharedMemory != NULL) {
+        return OK;
+    }
+    int fd;
+    sp<SharedMemoryTransport> transport = SharedMemoryTransport::create(mName, &fd);
+    if (transport == NULL) {
+        return NO_MEMORY;
+    }
+    InputMessage msg;
+    msg.header.type = InputMessage::TYPE_SHARED_MEMORY;
+    msg.header.padding = 0;
+    status_t result = sendSocketMessage(&msg, fd);
+    ::close(fd);
+    if (result) {
+        ALOGE("channel '%s' ~ could not send the shared memory to the peer, status=%d",
+                mName.c_str(), result);
+        return result;
+    }
+    mSharedMemory = transport;
+    return OK;
+}
+
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count,
+        size_t* outSent) {
+    struct mmsghdr headers[MAX_MESSAGES_PER_CALL];
+    struct iovec iovs[MAX_MESSAGES_PER_CALL];
+
+    *outSent = 0;
+    if (mSharedMemory != NULL) {
+        status_t result = OK;
+        while (*outSent < count) {
+            result = mSharedMemory->push(&msgs[*outSent]);
+            if (result) {
+                break;
+            }
+            *outSent += 1;
+        }
+        if (*outSent) {
+            status_t wakeResult = wakeSharedMemoryReader();
+            if (!result) {
+                result = wakeResult;
+            }
+        }
+        return result;
+    }
+
+    while (*outSent < count) {
+        const size_t n = min(count - *outSent, MAX_MESSAGES_PER_CALL);
+        memset(headers, 0, sizeof(headers[0]) * n);
+        for (size_t i = 0; i < n; i++) {
+            iovs[i].iov_base = const_cast<InputMessage*>(&msgs[*outSent + i]);
+            iovs[i].iov_len = msgs[*outSent + i].size();
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nSent;
+        do {
+            nSent = ::sendmmsg(mFd, headers, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending %zu messages, errno=%d", mName.c_str(),
+                    n, error);
+#endif
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return WOULD_BLOCK;
+            }
+            if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED
+                    || error == ECONNRESET) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (headers[i].msg_len != iovs[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.c_str(), msgs[*outSent].header.type);
+#endif
+                return DEAD_OBJECT;
+            }
+            *outSent += 1;
+        }
+
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent %d messages", mName.c_str(), nSent);
+#endif
+    }
     return OK;
 }
 
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t maxCount,
+        size_t* outCount) {
+    struct mmsghdr headers[MAX_MESSAGES_PER_CALL];
+    struct iovec iovs[MAX_MESSAGES_PER_CALL];
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } controls[MAX_MESSAGES_PER_CALL];
+
+    *outCount = 0;
+    if (mSharedMemory != NULL) {
+        status_t result = receiveMessage(&msgs[0]);
+        if (result) {
+            return result;
+        }
+        *outCount = 1;
+        while (*outCount < maxCount && mSharedMemory->pop(&msgs[*outCount]) == OK) {
+            *outCount += 1;
+        }
+        return OK;
+    }
+
+    const size_t n = min(maxCount, MAX_MESSAGES_PER_CALL);
+    memset(headers, 0, sizeof(headers[0]) * n);
+    for (size_t i = 0; i < n; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(InputMessage);
+        headers[i].msg_hdr.msg_iov = &iovs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_control = &controls[i];
+        headers[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    int nRead;
+    do {
+        nRead = ::recvmmsg(mFd, headers, n, MSG_DONTWAIT | MSG_CMSG_CLOEXEC, NULL);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.c_str(), errno);
+#endif
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+
+    // Whatever follows the end of the stream or a bad message is dropped, the
+    // channel is of no use anymore anyway.
+    status_t result = OK;
+    for (int i = 0; i < nRead; i++) {
+        int fd = takeFd(&headers[i].msg_hdr);
+        if (result) {
+            closeFd(fd);
+            continue;
+        }
+        if (headers[i].msg_len == 0) { // check for EOF
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ receive message failed because peer was closed",
+                    mName.c_str());
+#endif
+            closeFd(fd);
+            result = DEAD_OBJECT;
+            continue;
+        }
+        if (!msgs[i].isValid(headers[i].msg_len)) {
+            ALOGE("channel '%s' ~ received invalid message", mName.c_str());
+            closeFd(fd);
+            result = BAD_VALUE;
+            continue;
+        }
+        if (handleTransportMessage(&msgs[i], fd)) {
+            continue;
+        }
+        if (*outCount != size_t(i)) {
+            memcpy(&msgs[*outCount], &msgs[i], headers[i].msg_len);
+        }
+        *outCount += 1;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %zu messages", mName.c_str(), *outCount);
+#endif
+    if (*outCount) {
+        return OK;
+    }
+    if (result) {
+        return result;
+    }
+    // Only transport messages, the shared memory may already hold more.
+    return receiveMessages(msgs, maxCount, outCount);
+}
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
-    return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    sp<InputChannel> channel = new InputChannel(getName(), fd);
+    channel->mSharedMemory = mSharedMemory;
+    return channel;
 }
 
 
@@ -376,7 +886,9 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mResamplePrediction(mResampleTouch ? getResamplePrediction() : 0),
+        mChannel(channel), mMsgDeferred(false),
+        mReceivedMsgsIndex(0), mReceivedMsgsCount(0) {
 }
 
 InputConsumer::~InputConsumer() {
@@ -397,6 +909,17 @@ bool InputConsumer::isTouchResamplingEnabled() {
     return true;
 }
 
+nsecs_t InputConsumer::getResamplePrediction() {
+    // The frame time is the vsync the app draws for, its frame reaches the display some
+    // time later.  How much later depends on the device's pipeline, so products that want
+    // touches predicted to the present time say by how much.
+    nsecs_t prediction = property_get_int32("ro.input.resample_prediction_ms", 0) * NANOS_PER_MS;
+    if (prediction < 0) {
+        return 0;
+    }
+    return min(prediction, RESAMPLE_MAX_PREDICTION_TARGET);
+}
+
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent,
         int32_t* displayId) {
@@ -418,7 +941,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -531,7 +1054,9 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
         }
 
         nsecs_t sampleTime = frameTime;
-        if (mResampleTouch) {
+        if (mResamplePrediction > 0) {
+            sampleTime += mResamplePrediction;
+        } else if (mResampleTouch) {
             sampleTime -= RESAMPLE_LATENCY;
         }
         ssize_t split = findSampleNoLaterThan(batch, sampleTime);
@@ -765,7 +1290,8 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
 #endif
             return;
         }
-        nsecs_t maxPredict = current->eventTime + min(delta / 2, RESAMPLE_MAX_PREDICTION);
+        nsecs_t maxPredict = current->eventTime + min(delta / 2, RESAMPLE_MAX_PREDICTION)
+                + mResamplePrediction;
         if (sampleTime > maxPredict) {
 #if DEBUG_RESAMPLING
             ALOGD("Sample time is too far in the future, adjusting prediction "
@@ -806,7 +1332,22 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         PointerCoords& resampledCoords = touchState.lastResample.pointers[i];
         const PointerCoords& currentCoords = current->getPointerById(id);
         resampledCoords.copyFrom(currentCoords);
-        if (other->idBits.hasBit(id)
+        float vx, vy;
+        if (!next && mResamplePrediction > 0
+                && shouldResampleTool(event->getToolType(i))
+                && fitPointerVelocity(touchState, id, &vx, &vy)) {
+            // Extrapolate along the velocity fitted to the recent samples, which is less
+            // sensitive to jitter than the line through the last two.
+            float dt = (sampleTime - current->eventTime) * 0.000000001f;
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, currentCoords.getX() + vx * dt);
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, currentCoords.getY() + vy * dt);
+#if DEBUG_RESAMPLING
+            ALOGD("[%d] - out (%0.3f, %0.3f), cur (%0.3f, %0.3f), "
+                    "velocity (%0.3f, %0.3f), dt %0.3f",
+                    id, resampledCoords.getX(), resampledCoords.getY(),
+                    currentCoords.getX(), currentCoords.getY(), vx, vy, dt);
+#endif
+        } else if (other->idBits.hasBit(id)
                 && shouldResampleTool(event->getToolType(i))) {
             const PointerCoords& otherCoords = other->getPointerById(id);
             resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X,
@@ -838,6 +1379,60 @@ bool InputConsumer::shouldResampleTool(int32_t toolType) {
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
 }
 
+/**
+ * Fits a line through the recent samples of a pointer by least squares and returns its
+ * slope in pixels per second.  Samples further apart than RESAMPLE_MAX_DELTA end the fit,
+ * the pointer probably stopped in between.
+ */
+bool InputConsumer::fitPointerVelocity(const TouchState& state, uint32_t id,
+        float* outVx, float* outVy) {
+    const History* current = state.getHistory(0);
+    float t[TouchState::HISTORY_SIZE];
+    float x[TouchState::HISTORY_SIZE];
+    float y[TouchState::HISTORY_SIZE];
+    size_t count = 0;
+    nsecs_t lastTime = current->eventTime;
+    for (size_t i = 0; i < state.historySize; i++) {
+        const History* history = state.getHistory(i);
+        if (!history->hasPointerId(id) || lastTime - history->eventTime > RESAMPLE_MAX_DELTA) {
+            break;
+        }
+        const PointerCoords& coords = history->getPointerById(id);
+        t[count] = (history->eventTime - current->eventTime) * 0.000000001f;
+        x[count] = coords.getX();
+        y[count] = coords.getY();
+        lastTime = history->eventTime;
+        count += 1;
+    }
+    if (count < 2) {
+        return false;
+    }
+
+    float tmean = 0, xmean = 0, ymean = 0;
+    for (size_t i = 0; i < count; i++) {
+        tmean += t[i];
+        xmean += x[i];
+        ymean += y[i];
+    }
+    tmean /= count;
+    xmean /= count;
+    ymean /= count;
+
+    float stt = 0, stx = 0, sty = 0;
+    for (size_t i = 0; i < count; i++) {
+        float dt = t[i] - tmean;
+        stt += dt * dt;
+        stx += dt * (x[i] - xmean);
+        sty += dt * (y[i] - ymean);
+    }
+    if (stt <= 0) {
+        return false;
+    }
+    *outVx = stx / stt;
+    *outVy = sty / stt;
+    return true;
+}
+
 status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
 #if DEBUG_TRANSPORT_ACTIONS
     ALOGD("channel '%s' consumer ~ sendFinishedSignal: seq=%u, handled=%s",
@@ -864,20 +1459,29 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
                  mSeqChains.removeAt(i);
              }
         }
-        status_t status = OK;
-        while (!status && chainIndex > 0) {
-            chainIndex--;
-            status = sendUnchainedFinishedSignal(chainSeqs[chainIndex], handled);
-        }
-        if (status) {
-            // An error occurred so at least one signal was not sent, reconstruct the chain.
-            for (;;) {
-                SeqChain seqChain;
-                seqChain.seq = chainIndex != 0 ? chainSeqs[chainIndex - 1] : seq;
-                seqChain.chain = chainSeqs[chainIndex];
-                mSeqChains.push(seqChain);
-                if (!chainIndex) break;
-                chainIndex--;
+        if (chainIndex) {
+            // Send them all at once, the last message of the batch included.
+            const size_t count = chainIndex + 1;
+            if (mFinishedMsgs.size() < count) {
+                mFinishedMsgs.resize(count);
+            }
+            InputMessage* msgs = mFinishedMsgs.editArray();
+            for (size_t i = 0; i < count; i++) {
+                msgs[i].header.type = InputMessage::TYPE_FINISHED;
+                msgs[i].body.finished.seq = i < chainIndex ? chainSeqs[chainIndex - 1 - i] : seq;
+                msgs[i].body.finished.handled = handled;
+            }
+            size_t sent;
+            status_t status = mChannel->sendMessages(msgs, count, &sent);
+            if (status) {
+                // At least one signal was not sent, reconstruct the chain of the
+                // remaining ones.
+                for (size_t i = sent + 1; i < count; i++) {
+                    SeqChain seqChain;
+                    seqChain.seq = msgs[i].body.finished.seq;
+                    seqChain.chain = msgs[i - 1].body.finished.seq;
+                    mSeqChains.push(seqChain);
+                }
             }
             return status;
         }
@@ -887,6 +1491,21 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
     return sendUnchainedFinishedSignal(seq, handled);
 }
 
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (!mReceivedMsgsCount) {
+        status_t result = mChannel->receiveMessages(mReceivedMsgs, RECEIVE_BATCH_SIZE,
+                &mReceivedMsgsCount);
+        if (result) {
+            return result;
+        }
+        mReceivedMsgsIndex = 0;
+    }
+    const InputMessage& received = mReceivedMsgs[mReceivedMsgsIndex++];
+    memcpy(msg, &received, received.size());
+    mReceivedMsgsCount--;
+    return OK;
+}
+
 status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled) {
     InputMessage msg;
     msg.header.type = InputMessage::TYPE_FINISHED;
@@ -896,7 +1515,7 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
 }
 
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mReceivedMsgsCount;
 }
 
 bool InputConsumer::hasPendingBatch() const {
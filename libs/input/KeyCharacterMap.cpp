@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #ifdef __ANDROID__
 #include <binder/Parcel.h>
@@ -33,6 +34,8 @@
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
+#include "KeyMapFileCache.h"
+
 // Enables debug output for the parser.
 #define DEBUG_PARSER 0
 
@@ -87,6 +90,11 @@ static String8 toString(const char16_t* chars, size_t numChars) {
 
 sp<KeyCharacterMap> KeyCharacterMap::sEmpty = new KeyCharacterMap();
 
+static KeyMapFileCache<KeyCharacterMap>& getFileCache() {
+    static KeyMapFileCache<KeyCharacterMap> cache;
+    return cache;
+}
+
 KeyCharacterMap::KeyCharacterMap() :
     mType(KEYBOARD_TYPE_UNKNOWN) {
 }
@@ -110,6 +118,17 @@ status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    // The format decides which declarations are accepted, so it is part of the key
+    const std::string cacheKey = std::to_string(format) + ":" + filename.string();
+    struct stat st;
+    const bool cacheable = stat(filename.string(), &st) == 0;
+    if (cacheable) {
+        *outMap = getFileCache().get(cacheKey, st);
+        if (*outMap != nullptr) {
+            return OK;
+        }
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -117,6 +136,9 @@ status_t KeyCharacterMap::load(const String8& filename,
     } else {
         status = load(tokenizer, format, outMap);
         delete tokenizer;
+        if (!status && cacheable) {
+            getFileCache().put(cacheKey, st, *outMap);
+        }
     }
     return status;
 }
@@ -17,6 +17,7 @@
 #define LOG_TAG "KeyLayoutMap"
 
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include <android/keycodes.h>
 #include <input/InputEventLabels.h>
@@ -27,6 +28,8 @@
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
+#include "KeyMapFileCache.h"
+
 // Enables debug output for the parser.
 #define DEBUG_PARSER 0
 
@@ -43,6 +46,11 @@ static const char* WHITESPACE = " \t\r";
 
 // --- KeyLayoutMap ---
 
+static KeyMapFileCache<KeyLayoutMap>& getFileCache() {
+    static KeyMapFileCache<KeyLayoutMap> cache;
+    return cache;
+}
+
 KeyLayoutMap::KeyLayoutMap() {
 }
 
@@ -52,6 +60,15 @@ KeyLayoutMap::~KeyLayoutMap() {
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    struct stat st;
+    const bool cacheable = stat(filename.string(), &st) == 0;
+    if (cacheable) {
+        *outMap = getFileCache().get(filename.string(), st);
+        if (*outMap != nullptr) {
+            return NO_ERROR;
+        }
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -75,6 +92,9 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
 #endif
             if (!status) {
                 *outMap = map;
+                if (cacheable) {
+                    getFileCache().put(filename.string(), st, map);
+                }
             }
         }
         delete tokenizer;
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_KEY_MAP_FILE_CACHE_H
+#define _LIBINPUT_KEY_MAP_FILE_CACHE_H
+
+#include <sys/stat.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <utils/RefBase.h>
+
+namespace android {
+
+/*
+ * Keeps the maps parsed from key map files, so that loading an unchanged
+ * file again, such as when a keyboard reconnects, returns the map that was
+ * already parsed instead of tokenizing the file again. The maps are never
+ * modified once loaded, so they can be shared.
+ *
+ * A file is considered unchanged while its inode, size and modification
+ * time stay the same.
+ */
+template <typename T>
+class KeyMapFileCache {
+public:
+    /* Returns the map cached under key for the file described by st, or null. */
+    sp<T> get(const std::string& key, const struct stat& st) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto entry = mEntries.find(key);
+        if (entry == mEntries.end() || !entry->second.matches(st)) {
+            return nullptr;
+        }
+        return entry->second.map;
+    }
+
+    void put(const std::string& key, const struct stat& st, const sp<T>& map) {
+        std::lock_guard<std::mutex> lock(mLock);
+        // Devices use a handful of key map files, this only bounds the cache when
+        // files keep changing.
+        if (mEntries.size() >= MAX_ENTRIES && mEntries.find(key) == mEntries.end()) {
+            mEntries.clear();
+        }
+        mEntries[key] = Entry{map, st.st_dev, st.st_ino, st.st_size, st.st_mtime};
+    }
+
+private:
+    static constexpr size_t MAX_ENTRIES = 64;
+
+    struct Entry {
+        sp<T> map;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        time_t mtime;
+
+        bool matches(const struct stat& st) const {
+            return dev == st.st_dev && ino == st.st_ino && size == st.st_size &&
+                    mtime == st.st_mtime;
+        }
+    };
+
+    std::mutex mLock;
+    std::map<std::string, Entry> mEntries;
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_KEY_MAP_FILE_CACHE_H
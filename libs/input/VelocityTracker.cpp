@@ -317,27 +317,23 @@ void VelocityTracker::addMovement(const MotionEvent* event) {
         pointerIndex[i] = idBits.getIndexOfBit(event->getPointerId(i));
     }
 
-    nsecs_t eventTime;
     Position positions[pointerCount];
 
-    size_t historySize = event->getHistorySize();
-    for (size_t h = 0; h < historySize; h++) {
-        eventTime = event->getHistoricalEventTime(h);
+    // Walk the samples, the historical ones followed by the current one, directly instead of
+    // looking up each coordinate through the historical accessors.
+    const size_t sampleCount = event->getHistorySize() + 1;
+    const size_t samplePointerCount = event->getPointerCount();
+    const nsecs_t* sampleEventTimes = event->getSampleEventTimes();
+    const PointerCoords* samplePointerCoords = event->getSamplePointerCoords();
+    for (size_t h = 0; h < sampleCount; h++) {
         for (size_t i = 0; i < pointerCount; i++) {
             uint32_t index = pointerIndex[i];
-            positions[index].x = event->getHistoricalRawX(i, h);
-            positions[index].y = event->getHistoricalRawY(i, h);
+            positions[index].x = samplePointerCoords[i].getX();
+            positions[index].y = samplePointerCoords[i].getY();
         }
-        addMovement(eventTime, idBits, positions);
+        addMovement(sampleEventTimes[h], idBits, positions);
+        samplePointerCoords += samplePointerCount;
     }
-
-    eventTime = event->getEventTime();
-    for (size_t i = 0; i < pointerCount; i++) {
-        uint32_t index = pointerIndex[i];
-        positions[index].x = event->getRawX(i);
-        positions[index].y = event->getRawY(i);
-    }
-    addMovement(eventTime, idBits, positions);
 }
 
 bool VelocityTracker::getVelocity(uint32_t id, float* outVx, float* outVy) const {
@@ -371,11 +367,13 @@ LeastSquaresVelocityTrackerStrategy::~LeastSquaresVelocityTrackerStrategy() {
 void LeastSquaresVelocityTrackerStrategy::clear() {
     mIndex = 0;
     mMovements[0].idBits.clear();
+    mCachedEstimatorIdBits.clear();
 }
 
 void LeastSquaresVelocityTrackerStrategy::clearPointers(BitSet32 idBits) {
     BitSet32 remainingIdBits(mMovements[mIndex].idBits.value & ~idBits.value);
     mMovements[mIndex].idBits = remainingIdBits;
+    mCachedEstimatorIdBits.value &= ~idBits.value;
 }
 
 void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet32 idBits,
@@ -391,6 +389,7 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
     for (uint32_t i = 0; i < count; i++) {
         movement.positions[i] = positions[i];
     }
+    mCachedEstimatorIdBits.clear();
 }
 
 /**
@@ -400,9 +399,11 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * Returns true if a solution is found, false otherwise.
  *
  * The input consists of two vectors of data points X and Y with indices 0..m-1
- * along with a weight vector W of the same size.
+ * along with a weight vector W of the same size.  Several Y vectors, one per axis,
+ * may be fitted against the same X and W at once, in which case they share the QR
+ * decomposition below.
  *
- * The output is a vector B with indices 0..n that describes a polynomial
+ * The output is a vector B with indices 0..n, for each Y, that describes a polynomial
  * that fits the data, such the sum of W[i] * W[i] * abs(Y[i] - (B[0] + B[1] X[i]
  * + B[2] X[i]^2 ... B[n] X[i]^n)) for all i between 0 and m-1 is minimized.
  *
@@ -442,12 +443,11 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * http://en.wikipedia.org/wiki/Numerical_methods_for_linear_least_squares
  * http://en.wikipedia.org/wiki/Gram-Schmidt
  */
-static bool solveLeastSquares(const float* x, const float* y,
-        const float* w, uint32_t m, uint32_t n, float* outB, float* outDet) {
+static bool solveLeastSquares(const float* x, const float* const* ys, uint32_t axisCount,
+        const float* w, uint32_t m, uint32_t n, float* const* outBs, float* outDets) {
 #if DEBUG_STRATEGY
-    ALOGD("solveLeastSquares: m=%d, n=%d, x=%s, y=%s, w=%s", int(m), int(n),
-            vectorToString(x, m).c_str(), vectorToString(y, m).c_str(),
-            vectorToString(w, m).c_str());
+    ALOGD("solveLeastSquares: m=%d, n=%d, axisCount=%d, x=%s, w=%s", int(m), int(n),
+            int(axisCount), vectorToString(x, m).c_str(), vectorToString(w, m).c_str());
 #endif
 
     // Expand the X vector to a matrix A, pre-multiplied by the weights.
@@ -510,98 +510,129 @@ static bool solveLeastSquares(const float* x, const float* y,
     ALOGD("  - qr=%s", matrixToString(&qr[0][0], m, n, false /*rowMajor*/).c_str());
 #endif
 
-    // Solve R B = Qt W Y to find B.  This is easy because R is upper triangular.
-    // We just work from bottom-right to top-left calculating B's coefficients.
-    float wy[m];
-    for (uint32_t h = 0; h < m; h++) {
-        wy[h] = y[h] * w[h];
-    }
-    for (uint32_t i = n; i != 0; ) {
-        i--;
-        outB[i] = vectorDot(&q[i][0], wy, m);
-        for (uint32_t j = n - 1; j > i; j--) {
-            outB[i] -= r[i][j] * outB[j];
+    // The decomposition only depends on X and W, so it is shared by all axes.
+    for (uint32_t axis = 0; axis < axisCount; axis++) {
+        const float* y = ys[axis];
+        float* outB = outBs[axis];
+
+        // Solve R B = Qt W Y to find B.  This is easy because R is upper triangular.
+        // We just work from bottom-right to top-left calculating B's coefficients.
+        float wy[m];
+        for (uint32_t h = 0; h < m; h++) {
+            wy[h] = y[h] * w[h];
+        }
+        for (uint32_t i = n; i != 0; ) {
+            i--;
+            outB[i] = vectorDot(&q[i][0], wy, m);
+            for (uint32_t j = n - 1; j > i; j--) {
+                outB[i] -= r[i][j] * outB[j];
+            }
+            outB[i] /= r[i][i];
         }
-        outB[i] /= r[i][i];
-    }
 #if DEBUG_STRATEGY
-    ALOGD("  - b=%s", vectorToString(outB, n).c_str());
+        ALOGD("  - y=%s, b=%s", vectorToString(y, m).c_str(), vectorToString(outB, n).c_str());
 #endif
 
-    // Calculate the coefficient of determination as 1 - (SSerr / SStot) where
-    // SSerr is the residual sum of squares (variance of the error),
-    // and SStot is the total sum of squares (variance of the data) where each
-    // has been weighted.
-    float ymean = 0;
-    for (uint32_t h = 0; h < m; h++) {
-        ymean += y[h];
-    }
-    ymean /= m;
+        // Calculate the coefficient of determination as 1 - (SSerr / SStot) where
+        // SSerr is the residual sum of squares (variance of the error),
+        // and SStot is the total sum of squares (variance of the data) where each
+        // has been weighted.
+        float ymean = 0;
+        for (uint32_t h = 0; h < m; h++) {
+            ymean += y[h];
+        }
+        ymean /= m;
 
-    float sserr = 0;
-    float sstot = 0;
-    for (uint32_t h = 0; h < m; h++) {
-        float err = y[h] - outB[0];
-        float term = 1;
-        for (uint32_t i = 1; i < n; i++) {
-            term *= x[h];
-            err -= term * outB[i];
+        float sserr = 0;
+        float sstot = 0;
+        for (uint32_t h = 0; h < m; h++) {
+            float err = y[h] - outB[0];
+            float term = 1;
+            for (uint32_t i = 1; i < n; i++) {
+                term *= x[h];
+                err -= term * outB[i];
+            }
+            sserr += w[h] * w[h] * err * err;
+            float var = y[h] - ymean;
+            sstot += w[h] * w[h] * var * var;
         }
-        sserr += w[h] * w[h] * err * err;
-        float var = y[h] - ymean;
-        sstot += w[h] * w[h] * var * var;
-    }
-    *outDet = sstot > 0.000001f ? 1.0f - (sserr / sstot) : 1;
+        outDets[axis] = sstot > 0.000001f ? 1.0f - (sserr / sstot) : 1;
 #if DEBUG_STRATEGY
-    ALOGD("  - sserr=%f", sserr);
-    ALOGD("  - sstot=%f", sstot);
-    ALOGD("  - det=%f", *outDet);
+        ALOGD("  - sserr=%f", sserr);
+        ALOGD("  - sstot=%f", sstot);
+        ALOGD("  - det=%f", outDets[axis]);
 #endif
+    }
     return true;
 }
 
 /*
  * Optimized unweighted second-order least squares fit. About 2x speed improvement compared to
- * the default implementation
+ * the default implementation.  The sums of the powers of X are shared by all axes, and the
+ * slope of each axis is written to outSlopes.
  */
-static float solveUnweightedLeastSquaresDeg2(const float* x, const float* y, size_t count) {
-    float sxi = 0, sxiyi = 0, syi = 0, sxi2 = 0, sxi3 = 0, sxi2yi = 0, sxi4 = 0;
-
+static void solveUnweightedLeastSquaresDeg2(const float* x, const float* const* ys,
+        uint32_t axisCount, size_t count, float* outSlopes) {
+    float sxi = 0, sxi2 = 0, sxi3 = 0, sxi4 = 0;
     for (size_t i = 0; i < count; i++) {
         float xi = x[i];
-        float yi = y[i];
         float xi2 = xi*xi;
         float xi3 = xi2*xi;
         float xi4 = xi3*xi;
-        float xi2yi = xi2*yi;
-        float xiyi = xi*yi;
 
         sxi += xi;
         sxi2 += xi2;
-        sxiyi += xiyi;
-        sxi2yi += xi2yi;
-        syi += yi;
         sxi3 += xi3;
         sxi4 += xi4;
     }
 
     float Sxx = sxi2 - sxi*sxi / count;
-    float Sxy = sxiyi - sxi*syi / count;
     float Sxx2 = sxi3 - sxi*sxi2 / count;
-    float Sx2y = sxi2yi - sxi2*syi / count;
     float Sx2x2 = sxi4 - sxi2*sxi2 / count;
-
-    float numerator = Sxy*Sx2x2 - Sx2y*Sxx2;
     float denominator = Sxx*Sx2x2 - Sxx2*Sxx2;
-    if (denominator == 0) {
-        ALOGW("division by 0 when computing velocity, Sxx=%f, Sx2x2=%f, Sxx2=%f", Sxx, Sx2x2, Sxx2);
-        return 0;
+
+    for (uint32_t axis = 0; axis < axisCount; axis++) {
+        const float* y = ys[axis];
+        float sxiyi = 0, syi = 0, sxi2yi = 0;
+        for (size_t i = 0; i < count; i++) {
+            float xi = x[i];
+            float yi = y[i];
+
+            sxiyi += xi*yi;
+            sxi2yi += xi*xi*yi;
+            syi += yi;
+        }
+
+        float Sxy = sxiyi - sxi*syi / count;
+        float Sx2y = sxi2yi - sxi2*syi / count;
+
+        float numerator = Sxy*Sx2x2 - Sx2y*Sxx2;
+        if (denominator == 0) {
+            ALOGW("division by 0 when computing velocity, Sxx=%f, Sx2x2=%f, Sxx2=%f",
+                    Sxx, Sx2x2, Sxx2);
+            outSlopes[axis] = 0;
+        } else {
+            outSlopes[axis] = numerator/denominator;
+        }
     }
-    return numerator/denominator;
 }
 
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
+    if (mCachedEstimatorIdBits.hasBit(id)) {
+        *outEstimator = mCachedEstimators[id];
+        return true;
+    }
+    if (!computeEstimator(id, outEstimator)) {
+        return false;
+    }
+    mCachedEstimatorIdBits.markBit(id);
+    mCachedEstimators[id] = *outEstimator;
+    return true;
+}
+
+bool LeastSquaresVelocityTrackerStrategy::computeEstimator(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) const {
     outEstimator->clear();
 
     // Iterate over movement samples in reverse time order and collect samples.
@@ -636,6 +667,7 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
     }
 
     // Calculate a least squares polynomial fit.
+    const float* ys[2] = { x, y };
     uint32_t degree = mDegree;
     if (degree > m - 1) {
         degree = m - 1;
@@ -647,20 +679,22 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
             outEstimator->confidence = 1;
             outEstimator->xCoeff[0] = 0; // only slope is calculated, set rest of coefficients = 0
             outEstimator->yCoeff[0] = 0;
-            outEstimator->xCoeff[1] = solveUnweightedLeastSquaresDeg2(time, x, m);
-            outEstimator->yCoeff[1] = solveUnweightedLeastSquaresDeg2(time, y, m);
+            float slopes[2];
+            solveUnweightedLeastSquaresDeg2(time, ys, 2, m, slopes);
+            outEstimator->xCoeff[1] = slopes[0];
+            outEstimator->yCoeff[1] = slopes[1];
             outEstimator->xCoeff[2] = 0;
             outEstimator->yCoeff[2] = 0;
             return true;
         }
 
-        float xdet, ydet;
+        float dets[2];
+        float* coeffs[2] = { outEstimator->xCoeff, outEstimator->yCoeff };
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        if (solveLeastSquares(time, ys, 2, w, m, n, coeffs, dets)) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
-            outEstimator->confidence = xdet * ydet;
+            outEstimator->confidence = dets[0] * dets[1];
 #if DEBUG_STRATEGY
             ALOGD("estimate: degree=%d, xCoeff=%s, yCoeff=%s, confidence=%f",
                     int(outEstimator->degree),
@@ -108,6 +108,132 @@ TEST_F(InputChannelTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
             << "server channel should receive the correct message from client channel";
 }
 
+TEST_F(InputChannelTest, SendMessages_ReceiveMessages_KeepsMessagesApartAndInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair("channel name",
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    const size_t count = 20;
+    InputMessage msgs[count];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < count; i++) {
+        msgs[i].header.type = InputMessage::TYPE_FINISHED;
+        msgs[i].body.finished.seq = i + 1;
+        msgs[i].body.finished.handled = i % 2;
+    }
+    size_t sent;
+    EXPECT_EQ(OK, clientChannel->sendMessages(msgs, count, &sent))
+            << "client channel should be able to send messages to server channel";
+    EXPECT_EQ(count, sent);
+
+    InputMessage received[count];
+    size_t receivedCount = 0;
+    while (receivedCount < count) {
+        size_t n;
+        ASSERT_EQ(OK, serverChannel->receiveMessages(&received[receivedCount],
+                count - receivedCount, &n))
+                << "server channel should be able to receive messages from client channel";
+        ASSERT_GT(n, 0U);
+        receivedCount += n;
+    }
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(InputMessage::TYPE_FINISHED, received[i].header.type);
+        EXPECT_EQ(i + 1, received[i].body.finished.seq);
+        EXPECT_EQ(bool(i % 2), received[i].body.finished.handled);
+    }
+
+    size_t n;
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessages(received, count, &n))
+            << "receiveMessages should have returned WOULD_BLOCK";
+    EXPECT_EQ(0U, n);
+}
+
+TEST_F(InputChannelTest, SharedMemoryTransport_SendAndReceive) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair("channel name",
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+    ASSERT_EQ(OK, serverChannel->enableSharedMemoryTransport())
+            << "should have moved the channel to shared memory";
+
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_KEY;
+    serverMsg.body.key.action = AKEY_EVENT_ACTION_DOWN;
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+            << "server channel should be able to send message to client channel";
+
+    InputMessage clientMsg;
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive message from server channel";
+    EXPECT_EQ(serverMsg.header.type, clientMsg.header.type)
+            << "client channel should receive the key message, not the transport ones";
+    EXPECT_EQ(serverMsg.body.key.action, clientMsg.body.key.action);
+
+    InputMessage clientReply;
+    memset(&clientReply, 0, sizeof(InputMessage));
+    clientReply.header.type = InputMessage::TYPE_FINISHED;
+    clientReply.body.finished.seq = 0x11223344;
+    clientReply.body.finished.handled = true;
+    EXPECT_EQ(OK, clientChannel->sendMessage(&clientReply))
+            << "client channel should be able to send message to server channel";
+
+    InputMessage serverReply;
+    EXPECT_EQ(OK, serverChannel->receiveMessage(&serverReply))
+            << "server channel should be able to receive message from client channel";
+    EXPECT_EQ(clientReply.header.type, serverReply.header.type);
+    EXPECT_EQ(clientReply.body.finished.seq, serverReply.body.finished.seq);
+    EXPECT_EQ(clientReply.body.finished.handled, serverReply.body.finished.handled);
+
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&clientMsg))
+            << "receiveMessage should have returned WOULD_BLOCK";
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessage(&serverReply))
+            << "receiveMessage should have returned WOULD_BLOCK";
+
+    clientChannel.clear(); // close client channel
+
+    EXPECT_EQ(DEAD_OBJECT, serverChannel->sendMessage(&serverMsg))
+            << "sendMessage should have returned DEAD_OBJECT once waking up the peer fails";
+}
+
+TEST_F(InputChannelTest, SharedMemoryTransport_WhenRingIsFull_ReturnsWouldBlock) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair("channel name",
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+    ASSERT_EQ(OK, serverChannel->enableSharedMemoryTransport())
+            << "should have moved the channel to shared memory";
+
+    InputMessage msg;
+    memset(&msg, 0, sizeof(InputMessage));
+    msg.header.type = InputMessage::TYPE_KEY;
+    size_t sent = 0;
+    while (serverChannel->sendMessage(&msg) == OK) {
+        msg.body.key.seq = ++sent;
+        ASSERT_LT(sent, 1000U) << "the ring should have filled up";
+    }
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->sendMessage(&msg));
+
+    for (size_t i = 0; i < sent; i++) {
+        InputMessage received;
+        ASSERT_EQ(OK, clientChannel->receiveMessage(&received));
+        EXPECT_EQ(i, received.body.key.seq)
+                << "messages should come out of the ring in order";
+    }
+    EXPECT_EQ(OK, serverChannel->sendMessage(&msg))
+            << "the ring should have room again once the client has read it";
+}
+
 TEST_F(InputChannelTest, ReceiveSignal_WhenNoSignalPresent_ReturnsAnError) {
     sp<InputChannel> serverChannel, clientChannel;
 
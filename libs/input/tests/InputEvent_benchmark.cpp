@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <input/Input.h>
+
+namespace android {
+
+// Number of pointers moving together, like a two finger scroll.
+static const size_t POINTER_COUNT = 2;
+
+// Builds a move carrying 'historySize' historical samples, like the batch a window
+// receives once per frame.
+static void initializeMotionEvent(MotionEvent* event, size_t historySize) {
+    PointerProperties pointerProperties[POINTER_COUNT];
+    PointerCoords pointerCoords[POINTER_COUNT];
+    for (size_t i = 0; i < POINTER_COUNT; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerCoords[i].clear();
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 1);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, 8);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, 6);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, 0.25f);
+    }
+    for (size_t h = 0; h <= historySize; h++) {
+        for (size_t i = 0; i < POINTER_COUNT; i++) {
+            pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 100 + h + i * 50);
+            pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 200 + h + i * 50);
+        }
+        if (h == 0) {
+            event->initialize(0, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE, 0, 0,
+                    0, 0, 0, 0, 0, 1, 1, 0, 0, POINTER_COUNT, pointerProperties,
+                    pointerCoords);
+        } else {
+            event->addSample(h, pointerCoords);
+        }
+    }
+}
+
+static void BM_MotionEventTransform(benchmark::State& state, const float* matrix) {
+    MotionEvent event;
+    initializeMotionEvent(&event, state.range(0));
+
+    while (state.KeepRunning()) {
+        event.transform(matrix);
+        benchmark::DoNotOptimize(event.getRawX(0));
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) + 1) * POINTER_COUNT);
+}
+
+static float sTranslate[9] = { 1, 0, 10, 0, 1, -10, 0, 0, 1 };
+static float sRotate[9] = { 0, -1, 0, 1, 0, 0, 0, 0, 1 };
+static float sPerspective[9] = { 1, 0, 0, 0, 1, 0, 0.0001f, 0, 1 };
+BENCHMARK_CAPTURE(BM_MotionEventTransform, translate, sTranslate)->Arg(0)->Arg(16)->Arg(64);
+BENCHMARK_CAPTURE(BM_MotionEventTransform, rotate, sRotate)->Arg(0)->Arg(16)->Arg(64);
+BENCHMARK_CAPTURE(BM_MotionEventTransform, perspective, sPerspective)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_MotionEventScale(benchmark::State& state) {
+    MotionEvent event;
+    initializeMotionEvent(&event, state.range(0));
+
+    float scaleFactor = 2.0f;
+    while (state.KeepRunning()) {
+        event.scale(scaleFactor);
+        scaleFactor = 1.0f / scaleFactor;
+        benchmark::DoNotOptimize(event.getRawX(0));
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) + 1) * POINTER_COUNT);
+}
+BENCHMARK(BM_MotionEventScale)->Arg(0)->Arg(16)->Arg(64);
+
+} // namespace android
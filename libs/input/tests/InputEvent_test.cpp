@@ -591,4 +591,70 @@ TEST_F(MotionEventTest, Transform) {
     ASSERT_NEAR(originalRawY, event.getRawY(0), 0.001);
 }
 
+static void initializeEventWithLongHistory(MotionEvent* event, size_t pointerCount,
+        size_t historySize) {
+    PointerProperties pointerProperties[MAX_POINTERS];
+    PointerCoords pointerCoords[MAX_POINTERS];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerCoords[i].clear();
+    }
+    for (size_t h = 0; h <= historySize; h++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 10 + h * 3 + i * 100);
+            pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 20 + h * 2 + i * 100);
+            pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, 0.5f);
+        }
+        if (h == 0) {
+            event->initialize(0, 0, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0,
+                    X_OFFSET, Y_OFFSET, 0, 0, 0, 0, pointerCount, pointerProperties,
+                    pointerCoords);
+        } else {
+            event->addSample(h, pointerCoords);
+        }
+    }
+}
+
+TEST_F(MotionEventTest, Transform_AffineAcrossBatches) {
+    // Enough samples that the points are transformed in several batches.
+    const size_t pointerCount = 3;
+    const size_t historySize = 40;
+    MotionEvent original;
+    initializeEventWithLongHistory(&original, pointerCount, historySize);
+
+    const float translate[9] = { 1, 0, 5, 0, 1, -7, 0, 0, 1 };
+    const float scaleTranslate[9] = { 2, 0, 5, 0, 2, -7, 0, 0, 1 };
+    const float perspective[9] = { 1, 0, 0, 0, 1, 0, 0.001f, 0, 1 };
+    for (const float* matrix : { translate, scaleTranslate, perspective }) {
+        MotionEvent event;
+        event.copyFrom(&original, true);
+        event.transform(matrix);
+
+        ASSERT_EQ(historySize, event.getHistorySize());
+        for (size_t h = 0; h < historySize; h++) {
+            for (size_t i = 0; i < pointerCount; i++) {
+                float x = original.getHistoricalX(i, h);
+                float y = original.getHistoricalY(i, h);
+                float z = matrix[6] * x + matrix[7] * y + matrix[8];
+                ASSERT_NEAR((matrix[0] * x + matrix[1] * y + matrix[2]) / z,
+                        event.getHistoricalX(i, h), 0.001);
+                ASSERT_NEAR((matrix[3] * x + matrix[4] * y + matrix[5]) / z,
+                        event.getHistoricalY(i, h), 0.001);
+            }
+        }
+    }
+
+    // A uniform scale does not rotate the orientation.
+    MotionEvent event;
+    event.copyFrom(&original, true);
+    event.transform(scaleTranslate);
+    for (size_t h = 0; h < historySize; h++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            ASSERT_NEAR(0.5f, event.getHistoricalOrientation(i, h), 0.001);
+        }
+    }
+    ASSERT_NEAR(0.5f, event.getOrientation(pointerCount - 1), 0.001);
+}
+
 } // namespace android
@@ -299,6 +299,57 @@ TEST_F(InputPublisherAndConsumerTest,
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishBatchedMotionEvents_FinishesEverySample) {
+    status_t status;
+    const uint32_t sampleCount = 5;
+    PointerProperties pointerProperties;
+    PointerCoords pointerCoords;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    pointerCoords.clear();
+
+    for (uint32_t seq = 1; seq <= sampleCount; seq++) {
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, seq);
+        status = mPublisher->publishMotionEvent(seq, 1, AINPUT_SOURCE_TOUCHSCREEN, 0,
+                AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, seq,
+                1, &pointerProperties, &pointerCoords);
+        ASSERT_EQ(OK, status)
+                << "publisher publishMotionEvent should return OK";
+    }
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    int32_t displayId;
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event,
+            &displayId);
+    ASSERT_EQ(OK, status)
+            << "consumer consume should return OK";
+    ASSERT_TRUE(event != NULL)
+            << "consumer should have returned non-NULL event";
+    ASSERT_EQ(AINPUT_EVENT_TYPE_MOTION, event->getType());
+    EXPECT_EQ(sampleCount, consumeSeq)
+            << "consumer should have returned the last sample's sequence number";
+    EXPECT_EQ(sampleCount - 1, static_cast<MotionEvent*>(event)->getHistorySize())
+            << "consumer should have batched every sample";
+    EXPECT_FALSE(mConsumer->hasDeferredEvent());
+
+    status = mConsumer->sendFinishedSignal(consumeSeq, true);
+    ASSERT_EQ(OK, status)
+            << "consumer sendFinishedSignal should return OK";
+
+    for (uint32_t seq = 1; seq <= sampleCount; seq++) {
+        uint32_t finishedSeq = 0;
+        bool handled = false;
+        status = mPublisher->receiveFinishedSignal(&finishedSeq, &handled);
+        ASSERT_EQ(OK, status)
+                << "publisher receiveFinishedSignal should return OK";
+        EXPECT_EQ(seq, finishedSeq)
+                << "publisher should receive the finished signals in order";
+        EXPECT_TRUE(handled);
+    }
+}
+
 TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <input/Input.h>
+#include <input/InputTransport.h>
+
+namespace android {
+
+// Delivers the samples a high rate touchscreen produces during one display
+// frame, which the consumer batches into a single event, and finishes them.
+static void BM_PublishConsumeFrame(benchmark::State& state) {
+    sp<InputChannel> serverChannel, clientChannel;
+    if (InputChannel::openInputChannelPair("benchmark", serverChannel, clientChannel)) {
+        state.SkipWithError("could not open channel pair");
+        return;
+    }
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    PreallocatedInputEventFactory factory;
+
+    const uint32_t samplesPerFrame = state.range(0);
+    PointerProperties properties[2];
+    PointerCoords coords[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        properties[i].clear();
+        properties[i].id = i;
+        properties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        coords[i].clear();
+    }
+
+    uint32_t seq = 0;
+    nsecs_t eventTime = 0;
+    while (state.KeepRunning()) {
+        for (uint32_t i = 0; i < samplesPerFrame; i++) {
+            coords[0].setAxisValue(AMOTION_EVENT_AXIS_X, i);
+            coords[1].setAxisValue(AMOTION_EVENT_AXIS_Y, i);
+            publisher.publishMotionEvent(++seq, 1, AINPUT_SOURCE_TOUCHSCREEN, 0,
+                    AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ++eventTime,
+                    2, properties, coords);
+        }
+
+        uint32_t consumeSeq;
+        InputEvent* event;
+        int32_t displayId;
+        if (consumer.consume(&factory, true /*consumeBatches*/, -1, &consumeSeq, &event,
+                &displayId) != OK) {
+            state.SkipWithError("consume failed");
+            break;
+        }
+        consumer.sendFinishedSignal(consumeSeq, true);
+
+        uint32_t finishedSeq;
+        bool handled;
+        while (publisher.receiveFinishedSignal(&finishedSeq, &handled) == OK) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * samplesPerFrame);
+}
+BENCHMARK(BM_PublishConsumeFrame)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <input/VelocityTracker.h>
+
+namespace android {
+
+// Number of pointers moving together, like a two finger fling.
+static const uint32_t POINTER_COUNT = 2;
+
+// Adds one movement per display frame of a steady 120Hz touchscreen, and queries the
+// velocity of every pointer as many times per frame as the benchmark argument says, the
+// way a view hierarchy with several scrolling containers does.
+static void BM_VelocityTrackerFrame(benchmark::State& state, const char* strategy) {
+    VelocityTracker tracker(strategy);
+    const uint32_t queriesPerFrame = state.range(0);
+
+    BitSet32 idBits;
+    for (uint32_t i = 0; i < POINTER_COUNT; i++) {
+        idBits.markBit(i);
+    }
+    VelocityTracker::Position positions[POINTER_COUNT];
+
+    nsecs_t eventTime = 0;
+    while (state.KeepRunning()) {
+        eventTime += 8333333;
+        for (uint32_t i = 0; i < POINTER_COUNT; i++) {
+            positions[i].x = eventTime * 0.000001f * (i + 1);
+            positions[i].y = eventTime * 0.000002f * (i + 1);
+        }
+        tracker.addMovement(eventTime, idBits, positions);
+
+        for (uint32_t i = 0; i < queriesPerFrame; i++) {
+            for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+                float vx, vy;
+                tracker.getVelocity(id, &vx, &vy);
+                benchmark::DoNotOptimize(vx);
+                benchmark::DoNotOptimize(vy);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * queriesPerFrame * POINTER_COUNT);
+}
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, impulse, "impulse")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, lsq1, "lsq1")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, lsq2, "lsq2")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, lsq3, "lsq3")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, wlsq2_delta, "wlsq2-delta")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, wlsq2_central, "wlsq2-central")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, wlsq2_recent, "wlsq2-recent")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, int1, "int1")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, int2, "int2")->Arg(1)->Arg(4);
+BENCHMARK_CAPTURE(BM_VelocityTrackerFrame, legacy, "legacy")->Arg(1)->Arg(4);
+
+} // namespace android
@@ -661,4 +661,35 @@ TEST_F(VelocityTrackerTest, SailfishFlingDownFast3) {
 }
 
 
+TEST_F(VelocityTrackerTest, LeastSquaresVelocityFollowsNewMovements) {
+    // The estimator is reused between queries, it must not be once the pointer moves again.
+    VelocityTracker vt("lsq2");
+    BitSet32 idBits;
+    idBits.markBit(DEFAULT_POINTER_ID);
+    VelocityTracker::Position position;
+    float Vx, Vy;
+
+    for (nsecs_t i = 0; i < 5; i++) {
+        position.x = 10 * i; // 1000 px/s
+        position.y = 0;
+        vt.addMovement(i * 10000000, idBits, &position);
+    }
+    ASSERT_TRUE(vt.getVelocity(DEFAULT_POINTER_ID, &Vx, &Vy));
+    checkVelocity(Vx, 1000);
+    float firstVx = Vx;
+    ASSERT_TRUE(vt.getVelocity(DEFAULT_POINTER_ID, &Vx, &Vy));
+    ASSERT_EQ(firstVx, Vx);
+
+    for (nsecs_t i = 5; i < 20; i++) {
+        position.x = 40 + 30 * (i - 4); // 3000 px/s
+        vt.addMovement(i * 10000000, idBits, &position);
+    }
+    ASSERT_TRUE(vt.getVelocity(DEFAULT_POINTER_ID, &Vx, &Vy));
+    checkVelocity(Vx, 3000);
+
+    vt.clearPointers(idBits);
+    ASSERT_FALSE(vt.getVelocity(DEFAULT_POINTER_ID, &Vx, &Vy));
+}
+
+
 } // namespace android
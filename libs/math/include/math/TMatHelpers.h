@@ -26,6 +26,7 @@
 #include <stdexcept>
 
 #include <math/quat.h>
+#include <math/TSimdHelpers.h>
 #include <math/TVecHelpers.h>
 
 #include  <utils/String8.h>
@@ -81,6 +82,11 @@ template<typename MATRIX>
 MATRIX PURE gaussJordanInverse(const MATRIX& src) {
     typedef typename MATRIX::value_type T;
     static constexpr unsigned int N = MATRIX::NUM_ROWS;
+    MATRIX result(MATRIX::NO_INIT);
+    if (simd::inverse(src, &result)) {
+        return result;
+    }
+
     MATRIX tmp(src);
     MATRIX inverted(1);
 
@@ -253,6 +259,9 @@ CONSTEXPR MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
             "invalid dimension of matrix multiply result.");
 
     MATRIX_R res(MATRIX_R::NO_INIT);
+    if (simd::useSimd(lhs[0][0]) && simd::multiply(lhs, rhs, &res)) {
+        return res;
+    }
     for (size_t col = 0; col < MATRIX_R::NUM_COLS; ++col) {
         res[col] = lhs * rhs[col];
     }
@@ -265,6 +274,9 @@ CONSTEXPR MATRIX PURE transpose(const MATRIX& m) {
     // for now we only handle square matrix transpose
     static_assert(MATRIX::NUM_COLS == MATRIX::NUM_ROWS, "transpose only supports square matrices");
     MATRIX result(MATRIX::NO_INIT);
+    if (simd::useSimd(m[0][0]) && simd::transpose(m, &result)) {
+        return result;
+    }
     for (size_t col = 0; col < MATRIX::NUM_COLS; ++col) {
         for (size_t row = 0; row < MATRIX::NUM_ROWS; ++row) {
             result[col][row] = transpose(m[row][col]);
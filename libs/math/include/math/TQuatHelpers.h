@@ -23,6 +23,7 @@
 
 #include <iostream>
 
+#include <math/TSimdHelpers.h>
 #include <math/vec3.h>
 
 #define PURE __attribute__((pure))
@@ -96,7 +97,7 @@ public:
         //            q.w*r.w - dot(q.xyz, r.xyz),
         //            q.w*r.xyz + r.w*q.xyz + cross(q.xyz, r.xyz));
 
-        return QUATERNION<T>(
+        return simd::useSimd(q.w) && simd::useSimd(r.w) ? simd::product(q, r) : QUATERNION<T>(
                 q.w*r.w - q.x*r.x - q.y*r.y - q.z*r.z,
                 q.w*r.x + q.x*r.w + q.y*r.z - q.z*r.y,
                 q.w*r.y - q.x*r.z + q.y*r.w + q.z*r.x,
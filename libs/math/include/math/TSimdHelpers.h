@@ -0,0 +1,255 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string.h>
+
+/*
+ * SIMD versions of the float4, mat4 and quat operations, written with the
+ * compiler vector extensions: they compile to NEON on ARM and to SSE on x86.
+ * Define MATH_NO_SIMD to always use the generic scalar code.
+ */
+#if !defined(MATH_NO_SIMD) && (defined(__ARM_NEON) || defined(__SSE2__)) && defined(__has_builtin)
+#if __has_builtin(__builtin_shufflevector)
+#define MATH_HAS_SIMD 1
+#endif
+#endif
+
+#ifndef MATH_HAS_SIMD
+#define MATH_HAS_SIMD 0
+#endif
+
+namespace android {
+namespace details {
+
+template <typename T> class TMat44;
+template <typename T> class TQuaternion;
+template <typename T> class TVec4;
+
+namespace simd {
+// -------------------------------------------------------------------------------------
+
+/*
+ * No user serviceable parts here.
+ *
+ * Don't use this file directly, instead include ui/mat*.h
+ */
+
+/*
+ * Returns whether the SIMD code should be used for an operation on value.
+ * The generic code is kept for constant expressions, which can't use the
+ * vector extensions, and when the optimizer can fold the operands anyway.
+ */
+template <typename T>
+inline constexpr bool useSimd(const T&) {
+    return false;
+}
+
+inline constexpr bool useSimd(float value) {
+    return MATH_HAS_SIMD && !__builtin_constant_p(value);
+}
+
+// By default, operations have no SIMD version
+template <typename R, typename A, typename B>
+inline bool multiply(const A&, const B&, R*) { return false; }
+template <typename MATRIX>
+inline bool transpose(const MATRIX&, MATRIX*) { return false; }
+template <typename MATRIX>
+inline bool inverse(const MATRIX&, MATRIX*) { return false; }
+
+#if MATH_HAS_SIMD
+
+typedef float float4_t __attribute__((vector_size(16)));
+
+// float4, mat4 and quat are tightly packed but only aligned on floats
+inline float4_t load(const float* p) {
+    float4_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store(float* p, float4_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+template <int I>
+inline float4_t splat(float4_t v) {
+    return __builtin_shufflevector(v, v, I, I, I, I);
+}
+
+// cross product of the first three components
+inline float4_t cross3(float4_t a, float4_t b) {
+    return __builtin_shufflevector(a, a, 1, 2, 0, 3) * __builtin_shufflevector(b, b, 2, 0, 1, 3) -
+           __builtin_shufflevector(a, a, 2, 0, 1, 3) * __builtin_shufflevector(b, b, 1, 2, 0, 3);
+}
+
+inline float dot3(float4_t a, float4_t b) {
+    const float4_t p = a * b;
+    return p[0] + p[1] + p[2];
+}
+
+inline void transpose4(float4_t& c0, float4_t& c1, float4_t& c2, float4_t& c3) {
+    const float4_t t0 = __builtin_shufflevector(c0, c1, 0, 4, 1, 5);
+    const float4_t t1 = __builtin_shufflevector(c2, c3, 0, 4, 1, 5);
+    const float4_t t2 = __builtin_shufflevector(c0, c1, 2, 6, 3, 7);
+    const float4_t t3 = __builtin_shufflevector(c2, c3, 2, 6, 3, 7);
+    c0 = __builtin_shufflevector(t0, t1, 0, 1, 4, 5);
+    c1 = __builtin_shufflevector(t0, t1, 2, 3, 6, 7);
+    c2 = __builtin_shufflevector(t2, t3, 0, 1, 4, 5);
+    c3 = __builtin_shufflevector(t2, t3, 2, 3, 6, 7);
+}
+
+// Column-major 4x4 matrix times a vector. out may alias the inputs.
+inline void multiplyMat4Vec4(const float* m, const float* v, float* out) {
+    const float4_t x = load(v);
+    store(out, load(m) * splat<0>(x) + load(m + 4) * splat<1>(x) +
+               load(m + 8) * splat<2>(x) + load(m + 12) * splat<3>(x));
+}
+
+// Column-major 4x4 matrices product. out may alias the inputs.
+inline void multiplyMat4(const float* lhs, const float* rhs, float* out) {
+    const float4_t l0 = load(lhs);
+    const float4_t l1 = load(lhs + 4);
+    const float4_t l2 = load(lhs + 8);
+    const float4_t l3 = load(lhs + 12);
+    float4_t r[4] = {load(rhs), load(rhs + 4), load(rhs + 8), load(rhs + 12)};
+    for (int col = 0; col < 4; col++) {
+        store(out + col * 4, l0 * splat<0>(r[col]) + l1 * splat<1>(r[col]) +
+                             l2 * splat<2>(r[col]) + l3 * splat<3>(r[col]));
+    }
+}
+
+inline void transposeMat4(const float* m, float* out) {
+    float4_t c0 = load(m);
+    float4_t c1 = load(m + 4);
+    float4_t c2 = load(m + 8);
+    float4_t c3 = load(m + 12);
+    transpose4(c0, c1, c2, c3);
+    store(out, c0);
+    store(out + 4, c1);
+    store(out + 8, c2);
+    store(out + 12, c3);
+}
+
+/*
+ * Inverse of a column-major 4x4 matrix from its cofactors, expressed with
+ * cross products of the 3D columns (see E. Lengyel, Foundations of Game
+ * Engine Development, Vol. 1). Unlike the generic Gauss-Jordan elimination it
+ * doesn't pivot, which is fine for the transforms this is used on.
+ */
+inline void inverseMat4(const float* m, float* out) {
+    const float4_t a = load(m);
+    const float4_t b = load(m + 4);
+    const float4_t c = load(m + 8);
+    const float4_t d = load(m + 12);
+    const float4_t x = splat<3>(a);
+    const float4_t y = splat<3>(b);
+    const float4_t z = splat<3>(c);
+    const float4_t w = splat<3>(d);
+
+    float4_t s = cross3(a, b);
+    float4_t t = cross3(c, d);
+    float4_t u = a * y - b * x;
+    float4_t v = c * w - d * z;
+
+    const float invDet = 1.0f / (dot3(s, v) + dot3(t, u));
+    s *= invDet;
+    t *= invDet;
+    u *= invDet;
+    v *= invDet;
+
+    // rows of the inverse
+    float4_t r0 = cross3(b, v) + t * y;
+    float4_t r1 = cross3(v, a) - t * x;
+    float4_t r2 = cross3(d, u) + s * w;
+    float4_t r3 = cross3(u, c) - s * z;
+    r0[3] = -dot3(b, t);
+    r1[3] = dot3(a, t);
+    r2[3] = -dot3(d, s);
+    r3[3] = dot3(c, s);
+
+    transpose4(r0, r1, r2, r3);
+    store(out, r0);
+    store(out + 4, r1);
+    store(out + 8, r2);
+    store(out + 12, r3);
+}
+
+// Hamilton product of quaternions stored as x, y, z, w. out may alias the inputs.
+inline void multiplyQuat(const float* p, const float* q, float* out) {
+    const float4_t a = load(p);
+    const float4_t b = load(q);
+    const float4_t sign = {1.0f, 1.0f, 1.0f, -1.0f};
+    store(out, splat<3>(a) * b +
+               __builtin_shufflevector(a, a, 0, 1, 2, 0) *
+                       __builtin_shufflevector(b, b, 3, 3, 3, 0) * sign +
+               __builtin_shufflevector(a, a, 1, 2, 0, 1) *
+                       __builtin_shufflevector(b, b, 2, 0, 1, 1) * sign -
+               __builtin_shufflevector(a, a, 2, 0, 1, 2) *
+                       __builtin_shufflevector(b, b, 1, 2, 0, 2));
+}
+
+template <typename T>
+inline const float* asFloats(const T& v) {
+    return reinterpret_cast<const float*>(&v);
+}
+
+template <typename T>
+inline float* asFloats(T* v) {
+    return reinterpret_cast<float*>(v);
+}
+
+inline bool multiply(const TMat44<float>& lhs, const TMat44<float>& rhs, TMat44<float>* out) {
+    multiplyMat4(asFloats(lhs), asFloats(rhs), asFloats(out));
+    return true;
+}
+
+inline bool multiply(const TMat44<float>& lhs, const TVec4<float>& rhs, TVec4<float>* out) {
+    multiplyMat4Vec4(asFloats(lhs), asFloats(rhs), asFloats(out));
+    return true;
+}
+
+inline bool multiply(const TQuaternion<float>& lhs, const TQuaternion<float>& rhs,
+        TQuaternion<float>* out) {
+    multiplyQuat(asFloats(lhs), asFloats(rhs), asFloats(out));
+    return true;
+}
+
+inline bool transpose(const TMat44<float>& m, TMat44<float>* out) {
+    transposeMat4(asFloats(m), asFloats(out));
+    return true;
+}
+
+inline bool inverse(const TMat44<float>& m, TMat44<float>* out) {
+    inverseMat4(asFloats(m), asFloats(out));
+    return true;
+}
+
+#endif // MATH_HAS_SIMD
+
+// Returns the product as a value, for the single expression constexpr functions
+template <typename A, typename B>
+inline A product(const A& lhs, const B& rhs) {
+    A out(A::NO_INIT);
+    multiply(lhs, rhs, &out);
+    return out;
+}
+
+// -------------------------------------------------------------------------------------
+}  // namespace simd
+}  // namespace details
+}  // namespace android
@@ -524,6 +524,9 @@ template <typename T, typename U>
 CONSTEXPR typename TMat44<T>::col_type PURE operator *(const TMat44<T>& lhs, const TVec4<U>& rhs) {
     // Result is initialized to zero.
     typename TMat44<T>::col_type result;
+    if (simd::useSimd(lhs[0][0]) && simd::multiply(lhs, rhs, &result)) {
+        return result;
+    }
     for (size_t col = 0; col < TMat44<T>::NUM_COLS; ++col) {
         result += lhs[col] * rhs[col];
     }
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Built as mat_benchmark and as mat_benchmark_generic, with MATH_NO_SIMD
+// defined, to compare the SIMD and the generic versions of the operators.
+
+#include <benchmark/benchmark.h>
+
+#include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec4.h>
+
+using android::mat4;
+using android::quat;
+using android::vec4;
+
+namespace {
+
+const mat4 kMatrix = mat4::translate(vec4(10, 20, 30, 1)) *
+                     mat4::rotate(0.5f, vec4(0, 0, 1, 0)) *
+                     mat4::scale(vec4(2, 3, 4, 1));
+
+void BM_Mat4Multiply(benchmark::State& state) {
+    mat4 lhs = kMatrix;
+    const mat4 rhs = inverse(kMatrix);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs);
+        benchmark::DoNotOptimize(lhs * rhs);
+    }
+}
+BENCHMARK(BM_Mat4Multiply);
+
+void BM_Mat4MultiplyVec4(benchmark::State& state) {
+    const mat4 m = kMatrix;
+    vec4 v(1, 2, 3, 1);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(m * v);
+    }
+}
+BENCHMARK(BM_Mat4MultiplyVec4);
+
+void BM_Mat4Transpose(benchmark::State& state) {
+    mat4 m = kMatrix;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m);
+        benchmark::DoNotOptimize(transpose(m));
+    }
+}
+BENCHMARK(BM_Mat4Transpose);
+
+void BM_Mat4Inverse(benchmark::State& state) {
+    mat4 m = kMatrix;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m);
+        benchmark::DoNotOptimize(inverse(m));
+    }
+}
+BENCHMARK(BM_Mat4Inverse);
+
+void BM_QuatMultiply(benchmark::State& state) {
+    quat lhs = quat::fromAxisAngle(android::vec3(0, 0, 1), 0.5f);
+    const quat rhs = quat::fromAxisAngle(android::vec3(1, 0, 0), 0.25f);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs);
+        benchmark::DoNotOptimize(lhs * rhs);
+    }
+}
+BENCHMARK(BM_QuatMultiply);
+
+} // namespace
+
+BENCHMARK_MAIN();
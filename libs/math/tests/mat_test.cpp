@@ -163,6 +163,42 @@ TEST_F(MatTest, ElementAccess) {
     EXPECT_FLOAT_EQ(m(3, 2), 100);
 }
 
+TEST_F(MatTest, MatchesDoublePrecision) {
+    // mat4 uses SIMD versions of the operators when available, mat4d never does
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<float> distribution(-10.0, 10.0);
+    auto rand_gen = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        mat4 a;
+        mat4 b;
+        vec4 v(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+        for (size_t c = 0; c < 4; c++) {
+            a[c] = vec4(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+            b[c] = vec4(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+        }
+        const mat4d ad(a);
+        const mat4d bd(b);
+        const double4 vd(v);
+
+        const mat4 product = a * b;
+        const mat4d productd = ad * bd;
+        const vec4 av = a * v;
+        const double4 avd = ad * vd;
+        const mat4 t = transpose(a);
+        const mat4 inv = inverse(a);
+        const mat4d invd = inverse(ad);
+        for (size_t c = 0; c < 4; c++) {
+            EXPECT_NEAR(avd[c], av[c], 1e-3);
+            for (size_t r = 0; r < 4; r++) {
+                EXPECT_NEAR(productd[c][r], product[c][r], 1e-3);
+                EXPECT_EQ(a[r][c], t[c][r]);
+                EXPECT_NEAR(invd[c][r], inv[c][r], 1e-3 * std::max(1.0, std::abs(invd[c][r])));
+            }
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 // MAT 3
 //------------------------------------------------------------------------------
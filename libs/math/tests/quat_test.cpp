@@ -298,4 +298,28 @@ TEST_F(QuatTest, MultiplicationExhaustive) {
     }
 }
 
+TEST_F(QuatTest, MatchesDoublePrecision) {
+    // quat uses a SIMD version of the product when available, quatd never does
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<float> distribution(-10.0, 10.0);
+    auto rand_gen = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        quat a(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+        quat b(rand_gen(), rand_gen(), rand_gen(), rand_gen());
+        quat ab = a * b;
+        quatd abd = quatd(a) * quatd(b);
+
+        EXPECT_NEAR(abd.x, ab.x, 1e-3);
+        EXPECT_NEAR(abd.y, ab.y, 1e-3);
+        EXPECT_NEAR(abd.z, ab.z, 1e-3);
+        EXPECT_NEAR(abd.w, ab.w, 1e-3);
+    }
+
+    // the SIMD version is only used at run time
+    constexpr quat q(1, 2, 3, 4);
+    constexpr quat qq = q * q;
+    static_assert(qq.w == -28, "quat * quat");
+}
+
 }; // namespace android
@@ -20,10 +20,14 @@
 
 #include <errno.h>
 #include <sys/socket.h>
+#include <unistd.h>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <cutils/native_handle.h>
 #include <log/log.h>
+#include <sync/sync.h>
 #include <utils/StrongPointer.h>
 #include <ui/GraphicBuffer.h>
 #include <system/graphics.h>
@@ -36,6 +40,203 @@ static constexpr int kFdBufferSize = 128 * sizeof(int);  // 128 ints
 
 using namespace android;
 
+// ----------------------------------------------------------------------------
+// Plane locking and persistent mappings
+// ----------------------------------------------------------------------------
+
+static bool isValidCpuUsage(uint64_t usage) {
+    return !(usage & ~(AHARDWAREBUFFER_USAGE_CPU_READ_MASK |
+                       AHARDWAREBUFFER_USAGE_CPU_WRITE_MASK));
+}
+
+static bool isYCbCrFormat(uint32_t format) {
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YCBCR_420_888:
+        case HAL_PIXEL_FORMAT_YCBCR_422_SP:
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+        case HAL_PIXEL_FORMAT_YCBCR_422_I:
+        case HAL_PIXEL_FORMAT_YV12:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns the size of a pixel of a single plane format, or 0 if it has no defined size.
+static uint32_t bytesPerPixel(uint32_t format) {
+    switch (format) {
+        case HAL_PIXEL_FORMAT_BLOB:
+        case HAL_PIXEL_FORMAT_Y8:
+        case HAL_PIXEL_FORMAT_STENCIL_8:
+            return 1;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_DEPTH_16:
+        case HAL_PIXEL_FORMAT_Y16:
+        case HAL_PIXEL_FORMAT_RAW16:
+            return 2;
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_DEPTH_24:
+            return 3;
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+        case HAL_PIXEL_FORMAT_RGBA_1010102:
+        case HAL_PIXEL_FORMAT_DEPTH_24_STENCIL_8:
+        case HAL_PIXEL_FORMAT_DEPTH_32F:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGBA_FP16:
+        case HAL_PIXEL_FORMAT_DEPTH_32F_STENCIL_8:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+// Locks the buffer with gralloc usage bits and describes every plane of the locked area,
+// so that YUV callers don't need a second round trip to gralloc for the chroma planes.
+static status_t lockPlanes(GraphicBuffer* gBuffer, uint64_t usage, int32_t fence,
+        const Rect& bounds, AHardwareBuffer_Planes* outPlanes) {
+    uint32_t format = uint32_t(gBuffer->getPixelFormat());
+    if (isYCbCrFormat(format)) {
+        android_ycbcr ycbcr;
+        status_t err = gBuffer->lockAsyncYCbCr(uint32_t(usage), bounds, &ycbcr, fence);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        outPlanes->planeCount = 3;
+        outPlanes->planes[0].data = ycbcr.y;
+        outPlanes->planes[0].pixelStride = 1;
+        outPlanes->planes[0].rowStride = uint32_t(ycbcr.ystride);
+        outPlanes->planes[1].data = ycbcr.cb;
+        outPlanes->planes[1].pixelStride = uint32_t(ycbcr.chroma_step);
+        outPlanes->planes[1].rowStride = uint32_t(ycbcr.cstride);
+        outPlanes->planes[2].data = ycbcr.cr;
+        outPlanes->planes[2].pixelStride = uint32_t(ycbcr.chroma_step);
+        outPlanes->planes[2].rowStride = uint32_t(ycbcr.cstride);
+        return NO_ERROR;
+    }
+
+    void* data = nullptr;
+    status_t err = gBuffer->lockAsync(usage, usage, bounds, &data, fence);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    uint32_t pixelStride = bytesPerPixel(format);
+    outPlanes->planeCount = 1;
+    outPlanes->planes[0].data = data;
+    outPlanes->planes[0].pixelStride = pixelStride;
+    outPlanes->planes[0].rowStride = pixelStride * gBuffer->getStride();
+    return NO_ERROR;
+}
+
+// A buffer that AHardwareBuffer_map() keeps locked until AHardwareBuffer_unmap().
+struct PersistentMapping {
+    sp<GraphicBuffer> buffer;   // keeps the buffer alive while it is mapped
+    uint64_t usage;             // AHARDWAREBUFFER_USAGE_CPU_* bits it was mapped with
+    AHardwareBuffer_Planes planes;
+};
+
+static std::mutex& getMappingsLock() {
+    static std::mutex& lock = *new std::mutex;
+    return lock;
+}
+
+// Guarded by getMappingsLock().
+static std::unordered_map<const GraphicBuffer*, PersistentMapping>& getMappings() {
+    static auto& mappings = *new std::unordered_map<const GraphicBuffer*, PersistentMapping>;
+    return mappings;
+}
+
+// Waits for and closes a fence that gralloc would otherwise have consumed.
+static void waitAndCloseFence(int fence) {
+    if (fence >= 0) {
+        sync_wait(fence, -1);
+        close(fence);
+    }
+}
+
+static bool coversUsage(uint64_t mappedUsage, uint64_t usage) {
+    return (!(usage & AHARDWAREBUFFER_USAGE_CPU_READ_MASK) ||
+                    (mappedUsage & AHARDWAREBUFFER_USAGE_CPU_READ_MASK)) &&
+            (!(usage & AHARDWAREBUFFER_USAGE_CPU_WRITE_MASK) ||
+                    (mappedUsage & AHARDWAREBUFFER_USAGE_CPU_WRITE_MASK));
+}
+
+// Returns true if the buffer is mapped, having set 'result' to the outcome of locking the
+// mapping for 'usage'. Returns false if the caller has to lock the buffer through gralloc.
+static bool lockMapped(const GraphicBuffer* gBuffer, uint64_t usage, int32_t fence,
+        AHardwareBuffer_Planes* outPlanes, int* result) {
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        auto it = mappings.find(gBuffer);
+        if (it == mappings.end()) {
+            return false;
+        }
+        if (!coversUsage(it->second.usage, usage)) {
+            ALOGE("AHardwareBuffer usage %#" PRIx64 " is not covered by its mapping (%#" PRIx64
+                    ")", usage, it->second.usage);
+            *result = INVALID_OPERATION;
+        } else {
+            *outPlanes = it->second.planes;
+            *result = NO_ERROR;
+        }
+    }
+    // Don't hold up every other buffer while waiting for this one.
+    waitAndCloseFence(fence);
+    return true;
+}
+
+// Unlocks and locks a mapped buffer again, which is when gralloc does its cache maintenance.
+static int remap(AHardwareBuffer* buffer, int32_t fence, AHardwareBuffer_Planes* outPlanes) {
+    if (!buffer) return BAD_VALUE;
+
+    GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    uint64_t usage;
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        auto it = mappings.find(gBuffer);
+        if (it == mappings.end()) {
+            waitAndCloseFence(fence);
+            return INVALID_OPERATION;
+        }
+        usage = it->second.usage;
+    }
+
+    int releaseFence = -1;
+    status_t err = gBuffer->unlockAsync(&releaseFence);
+    AHardwareBuffer_Planes planes;
+    if (err == NO_ERROR) {
+        waitAndCloseFence(releaseFence);
+        err = lockPlanes(gBuffer, AHardwareBuffer_convertToGrallocUsageBits(usage), fence,
+                Rect(gBuffer->getWidth(), gBuffer->getHeight()), &planes);
+    } else {
+        waitAndCloseFence(fence);
+    }
+
+    sp<GraphicBuffer> unmapped;
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        auto it = mappings.find(gBuffer);
+        if (it != mappings.end()) {
+            if (err == NO_ERROR) {
+                it->second.planes = planes;
+            } else {
+                ALOGE("Failed to remap AHardwareBuffer (%s); it is no longer mapped",
+                        strerror(-err));
+                unmapped = std::move(it->second.buffer);
+                mappings.erase(it);
+            }
+        }
+    }
+    if (err == NO_ERROR && outPlanes) {
+        *outPlanes = planes;
+    }
+    return err;
+}
+
 // ----------------------------------------------------------------------------
 // Public functions
 // ----------------------------------------------------------------------------
@@ -119,15 +320,23 @@ int AHardwareBuffer_lock(AHardwareBuffer* buffer, uint64_t usage,
         int32_t fence, const ARect* rect, void** outVirtualAddress) {
     if (!buffer) return BAD_VALUE;
 
-    if (usage & ~(AHARDWAREBUFFER_USAGE_CPU_READ_MASK |
-                  AHARDWAREBUFFER_USAGE_CPU_WRITE_MASK)) {
+    if (!isValidCpuUsage(usage)) {
         ALOGE("Invalid usage flags passed to AHardwareBuffer_lock; only "
                 " AHARDWAREBUFFER_USAGE_CPU_* flags are allowed");
         return BAD_VALUE;
     }
 
-    usage = AHardwareBuffer_convertToGrallocUsageBits(usage);
     GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    AHardwareBuffer_Planes planes;
+    int result;
+    if (lockMapped(gBuffer, usage, fence, &planes, &result)) {
+        if (result == NO_ERROR && outVirtualAddress) {
+            *outVirtualAddress = planes.planes[0].data;
+        }
+        return result;
+    }
+
+    usage = AHardwareBuffer_convertToGrallocUsageBits(usage);
     Rect bounds;
     if (!rect) {
         bounds.set(Rect(gBuffer->getWidth(), gBuffer->getHeight()));
@@ -141,6 +350,121 @@ int AHardwareBuffer_unlock(AHardwareBuffer* buffer, int32_t* fence) {
     if (!buffer) return BAD_VALUE;
 
     GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        if (mappings.find(gBuffer) != mappings.end()) {
+            // The mapping stays locked; it is flushed explicitly.
+            if (fence != nullptr) *fence = -1;
+            return NO_ERROR;
+        }
+    }
+
+    if (fence == nullptr)
+        return gBuffer->unlock();
+    else
+        return gBuffer->unlockAsync(fence);
+}
+
+int AHardwareBuffer_lockPlanes(AHardwareBuffer* buffer, uint64_t usage,
+        int32_t fence, const ARect* rect, AHardwareBuffer_Planes* outPlanes) {
+    if (!buffer || !outPlanes) return BAD_VALUE;
+
+    if (!isValidCpuUsage(usage)) {
+        ALOGE("Invalid usage flags passed to AHardwareBuffer_lockPlanes; only "
+                " AHARDWAREBUFFER_USAGE_CPU_* flags are allowed");
+        return BAD_VALUE;
+    }
+
+    GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    int result;
+    if (lockMapped(gBuffer, usage, fence, outPlanes, &result)) {
+        return result;
+    }
+
+    Rect bounds;
+    if (!rect) {
+        bounds.set(Rect(gBuffer->getWidth(), gBuffer->getHeight()));
+    } else {
+        bounds.set(Rect(rect->left, rect->top, rect->right, rect->bottom));
+    }
+    return lockPlanes(gBuffer, AHardwareBuffer_convertToGrallocUsageBits(usage), fence,
+            bounds, outPlanes);
+}
+
+int AHardwareBuffer_map(AHardwareBuffer* buffer, uint64_t usage, int32_t fence,
+        AHardwareBuffer_Planes* outPlanes) {
+    if (!buffer) return BAD_VALUE;
+
+    if (!usage || !isValidCpuUsage(usage)) {
+        ALOGE("Invalid usage flags passed to AHardwareBuffer_map; only "
+                " AHARDWAREBUFFER_USAGE_CPU_* flags are allowed");
+        return BAD_VALUE;
+    }
+
+    GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        if (mappings.find(gBuffer) != mappings.end()) {
+            ALOGE("AHardwareBuffer is already mapped");
+            return INVALID_OPERATION;
+        }
+    }
+
+    // Lock without holding the mappings lock, since gralloc waits for the fence.
+    PersistentMapping mapping;
+    status_t err = lockPlanes(gBuffer, AHardwareBuffer_convertToGrallocUsageBits(usage), fence,
+            Rect(gBuffer->getWidth(), gBuffer->getHeight()), &mapping.planes);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    mapping.buffer = gBuffer;
+    mapping.usage = usage;
+    if (outPlanes) {
+        *outPlanes = mapping.planes;
+    }
+
+    bool inserted;
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        inserted = getMappings().emplace(gBuffer, mapping).second;
+    }
+    if (!inserted) {
+        // Another thread mapped the buffer in the meantime.
+        ALOGE("AHardwareBuffer is already mapped");
+        gBuffer->unlock();
+        return INVALID_OPERATION;
+    }
+    return NO_ERROR;
+}
+
+int AHardwareBuffer_flushMapped(AHardwareBuffer* buffer, AHardwareBuffer_Planes* outPlanes) {
+    return remap(buffer, -1, outPlanes);
+}
+
+int AHardwareBuffer_invalidateMapped(AHardwareBuffer* buffer, int32_t fence,
+        AHardwareBuffer_Planes* outPlanes) {
+    return remap(buffer, fence, outPlanes);
+}
+
+int AHardwareBuffer_unmap(AHardwareBuffer* buffer, int32_t* fence) {
+    if (!buffer) return BAD_VALUE;
+
+    GraphicBuffer* gBuffer = AHardwareBuffer_to_GraphicBuffer(buffer);
+    sp<GraphicBuffer> mapped;
+    {
+        std::lock_guard<std::mutex> lock(getMappingsLock());
+        auto& mappings = getMappings();
+        auto it = mappings.find(gBuffer);
+        if (it == mappings.end()) {
+            return INVALID_OPERATION;
+        }
+        // Dropped at the end of the call, which may release the buffer.
+        mapped = std::move(it->second.buffer);
+        mappings.erase(it);
+    }
+
     if (fence == nullptr)
         return gBuffer->unlock();
     else
@@ -208,6 +208,23 @@ typedef struct AHardwareBuffer_Desc {
     uint64_t    rfu1;       ///< Initialize to zero, reserved for future use.
 } AHardwareBuffer_Desc;
 
+/**
+ * Holds data for a single image plane.
+ */
+typedef struct AHardwareBuffer_Plane {
+    void*       data;        ///< Points to first byte in plane
+    uint32_t    pixelStride; ///< Distance in bytes from one pixel of the plane to the next
+    uint32_t    rowStride;   ///< Distance in bytes from the first pixel of one row to the next
+} AHardwareBuffer_Plane;
+
+/**
+ * Holds all image planes that contain the pixel data.
+ */
+typedef struct AHardwareBuffer_Planes {
+    uint32_t               planeCount; ///< Number of distinct planes
+    AHardwareBuffer_Plane  planes[4];  ///< Array of image planes
+} AHardwareBuffer_Planes;
+
 typedef struct AHardwareBuffer AHardwareBuffer;
 
 /**
@@ -286,6 +303,90 @@ int AHardwareBuffer_lock(AHardwareBuffer* buffer, uint64_t usage,
  */
 int AHardwareBuffer_unlock(AHardwareBuffer* buffer, int32_t* fence);
 
+#if __ANDROID_API__ >= 29
+
+/**
+ * Lock an AHardwareBuffer for direct CPU access, like AHardwareBuffer_lock(),
+ * and return the layout of every image plane in \a outPlanes in the same call.
+ *
+ * YUV buffers are returned as three planes in Y, Cb, Cr order; the
+ * pixelStride of the chroma planes tells whether they are interleaved. All
+ * other formats are returned as a single plane. pixelStride and rowStride are
+ * 0 for formats that do not have a defined size per pixel.
+ *
+ * \return 0 on success, -EINVAL if \a buffer or \a outPlanes is NULL or if
+ * the usage flags are not a combination of AHARDWAREBUFFER_USAGE_CPU_*, or an
+ * error number if the lock fails for any reason.
+ */
+int AHardwareBuffer_lockPlanes(AHardwareBuffer* buffer, uint64_t usage,
+        int32_t fence, const ARect* rect, AHardwareBuffer_Planes* outPlanes);
+
+/**
+ * Map the whole AHardwareBuffer for CPU access with the given
+ * AHARDWAREBUFFER_USAGE_CPU_* usage, and keep it mapped until
+ * AHardwareBuffer_unmap() is called. The mapping holds a reference to the
+ * buffer.
+ *
+ * While the buffer is mapped, AHardwareBuffer_lock() and
+ * AHardwareBuffer_lockPlanes() for a subset of the mapped usage only wait for
+ * their fence and return the mapping, and AHardwareBuffer_unlock() returns
+ * immediately with no fence. Neither of them synchronizes CPU caches, so the
+ * caller must use AHardwareBuffer_flushMapped() after writing data that other
+ * users of the buffer read, and AHardwareBuffer_invalidateMapped() before
+ * reading data that they wrote.
+ *
+ * If \a outPlanes is not NULL, it is filled with the layout of the mapping as
+ * described for AHardwareBuffer_lockPlanes().
+ *
+ * \return 0 on success, -EINVAL if \a buffer is NULL or if the usage flags are
+ * not a non-empty combination of AHARDWAREBUFFER_USAGE_CPU_*, -ENOSYS if the
+ * buffer is already mapped, or an error number if the lock fails for any
+ * reason.
+ */
+int AHardwareBuffer_map(AHardwareBuffer* buffer, uint64_t usage, int32_t fence,
+        AHardwareBuffer_Planes* outPlanes);
+
+/**
+ * Make the CPU writes to a buffer mapped with AHardwareBuffer_map() visible
+ * to the other users of the buffer.
+ *
+ * The mapping may move. If \a outPlanes is not NULL, it is filled with the
+ * layout of the mapping after the call.
+ *
+ * \return 0 on success, -EINVAL if \a buffer is NULL, -ENOSYS if the buffer is
+ * not mapped, or an error number if the flush fails for any reason, in which
+ * case the buffer is no longer mapped.
+ */
+int AHardwareBuffer_flushMapped(AHardwareBuffer* buffer, AHardwareBuffer_Planes* outPlanes);
+
+/**
+ * Make the writes of the other users of a buffer mapped with
+ * AHardwareBuffer_map() visible to the CPU. If fence is not negative, it
+ * specifies a fence file descriptor that is signaled when those writes are
+ * done. The call takes ownership of the fence.
+ *
+ * The mapping may move. If \a outPlanes is not NULL, it is filled with the
+ * layout of the mapping after the call.
+ *
+ * \return 0 on success, -EINVAL if \a buffer is NULL, -ENOSYS if the buffer is
+ * not mapped, or an error number if the invalidation fails for any reason, in
+ * which case the buffer is no longer mapped.
+ */
+int AHardwareBuffer_invalidateMapped(AHardwareBuffer* buffer, int32_t fence,
+        AHardwareBuffer_Planes* outPlanes);
+
+/**
+ * Unmap a buffer mapped with AHardwareBuffer_map(), making its CPU writes
+ * visible to the other users of the buffer, and drop the reference held by the
+ * mapping. \a fence is set as for AHardwareBuffer_unlock().
+ *
+ * \return 0 on success, -EINVAL if \a buffer is NULL, -ENOSYS if the buffer is
+ * not mapped, or an error number if the unlock fails for any reason.
+ */
+int AHardwareBuffer_unmap(AHardwareBuffer* buffer, int32_t* fence);
+
+#endif // __ANDROID_API__ >= 29
+
 /**
  * Send the AHardwareBuffer to an AF_UNIX socket.
  *
@@ -106,3 +106,47 @@ EXPECT_TRUE(TestUsageConversion(
         AHARDWAREBUFFER_USAGE_GPU_COLOR_OUTPUT | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE |
         AHARDWAREBUFFER_USAGE_VENDOR_1 | AHARDWAREBUFFER_USAGE_VENDOR_13));
 }
+
+TEST(AHardwareBufferTest, PersistentMappingSurvivesLockAndUnlock) {
+    AHardwareBuffer_Desc desc = {};
+    desc.width = 16;
+    desc.height = 16;
+    desc.layers = 1;
+    desc.format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+    desc.usage = AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN | AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN;
+    AHardwareBuffer* buffer = nullptr;
+    ASSERT_EQ(0, AHardwareBuffer_allocate(&desc, &buffer));
+    AHardwareBuffer_describe(buffer, &desc);
+
+    AHardwareBuffer_Planes planes;
+    ASSERT_EQ(0, AHardwareBuffer_map(buffer, desc.usage, -1, &planes));
+    ASSERT_EQ(1u, planes.planeCount);
+    EXPECT_EQ(4u, planes.planes[0].pixelStride);
+    EXPECT_EQ(desc.stride * 4, planes.planes[0].rowStride);
+    EXPECT_NE(0, AHardwareBuffer_map(buffer, desc.usage, -1, nullptr));
+
+    // Locking a mapped buffer hands out the mapping without going through gralloc.
+    void* data = nullptr;
+    ASSERT_EQ(0, AHardwareBuffer_lock(buffer, AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN, -1,
+            nullptr, &data));
+    EXPECT_EQ(planes.planes[0].data, data);
+    static_cast<uint8_t*>(data)[0] = 0x42;
+    int32_t fence = 0;
+    EXPECT_EQ(0, AHardwareBuffer_unlock(buffer, &fence));
+    EXPECT_EQ(-1, fence);
+
+    ASSERT_EQ(0, AHardwareBuffer_flushMapped(buffer, &planes));
+    ASSERT_EQ(0, AHardwareBuffer_invalidateMapped(buffer, -1, &planes));
+    EXPECT_EQ(0x42, static_cast<uint8_t*>(planes.planes[0].data)[0]);
+
+    AHardwareBuffer_Planes lockedPlanes;
+    ASSERT_EQ(0, AHardwareBuffer_lockPlanes(buffer, AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, -1,
+            nullptr, &lockedPlanes));
+    EXPECT_EQ(planes.planes[0].data, lockedPlanes.planes[0].data);
+    EXPECT_EQ(0, AHardwareBuffer_unlock(buffer, nullptr));
+
+    EXPECT_EQ(0, AHardwareBuffer_unmap(buffer, nullptr));
+    EXPECT_NE(0, AHardwareBuffer_unmap(buffer, nullptr));
+    EXPECT_NE(0, AHardwareBuffer_flushMapped(buffer, nullptr));
+    AHardwareBuffer_release(buffer);
+}
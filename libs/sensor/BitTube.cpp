@@ -21,9 +21,13 @@
 #include <sys/socket.h>
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <binder/Parcel.h>
+#include <cutils/ashmem.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -32,21 +36,37 @@ namespace android {
 // we really need.  So we make it smaller.
 static const size_t DEFAULT_SOCKET_BUFFER_SIZE = 4 * 1024;
 
+// Sent on the socket when objects are added to the shared ring of a receiver that may be
+// waiting.  It is shorter than any object, so it cannot be mistaken for one.
+static const uint8_t SHARED_RING_WAKEUP = 1;
+
+// Header of the shared memory region, followed by capacity slots of objSize bytes.  head and
+// tail only ever increase, and wrap around together.
+struct BitTube::SharedRing {
+    std::atomic<uint32_t> head; // written by the sender
+    std::atomic<uint32_t> tail; // written by the receiver
+    // Objects sent through the socket that have not been received yet. The ring is not used
+    // while there are any, so that the receiver gets the objects in order.
+    std::atomic<uint32_t> socketPending;
+    uint32_t objSize;
+    uint32_t capacity;
+};
+
 
 BitTube::BitTube()
-    : mSendFd(-1), mReceiveFd(-1)
+    : mSendFd(-1), mReceiveFd(-1), mSharedRing(nullptr), mSharedRingSize(0), mSharedRingFd(-1)
 {
     init(DEFAULT_SOCKET_BUFFER_SIZE, DEFAULT_SOCKET_BUFFER_SIZE);
 }
 
 BitTube::BitTube(size_t bufsize)
-    : mSendFd(-1), mReceiveFd(-1)
+    : mSendFd(-1), mReceiveFd(-1), mSharedRing(nullptr), mSharedRingSize(0), mSharedRingFd(-1)
 {
     init(bufsize, bufsize);
 }
 
 BitTube::BitTube(const Parcel& data)
-    : mSendFd(-1), mReceiveFd(-1)
+    : mSendFd(-1), mReceiveFd(-1), mSharedRing(nullptr), mSharedRingSize(0), mSharedRingFd(-1)
 {
     mReceiveFd = dup(data.readFileDescriptor());
     if (mReceiveFd < 0) {
@@ -54,6 +74,9 @@ BitTube::BitTube(const Parcel& data)
         ALOGE("BitTube(Parcel): can't dup filedescriptor (%s)",
                 strerror(-mReceiveFd));
     }
+    if (data.readInt32()) {
+        mapSharedRing(data.readFileDescriptor());
+    }
 }
 
 BitTube::~BitTube()
@@ -63,6 +86,12 @@ BitTube::~BitTube()
 
     if (mReceiveFd >= 0)
         close(mReceiveFd);
+
+    if (mSharedRingFd >= 0)
+        close(mSharedRingFd);
+
+    if (mSharedRing != nullptr)
+        munmap(mSharedRing, mSharedRingSize);
 }
 
 void BitTube::init(size_t rcvbuf, size_t sndbuf) {
@@ -102,6 +131,115 @@ int BitTube::getSendFd() const
     return mSendFd;
 }
 
+status_t BitTube::enableSharedRing(size_t objSize, size_t capacity)
+{
+    if (mSharedRing != nullptr || mSendFd < 0 || objSize <= sizeof(SHARED_RING_WAKEUP)
+            || objSize > UINT32_MAX || capacity == 0 || capacity > UINT32_MAX) {
+        return BAD_VALUE;
+    }
+    const size_t size = sizeof(SharedRing) + objSize * capacity;
+    int fd = ashmem_create_region("BitTube", size);
+    if (fd < 0) {
+        ALOGE("BitTube: can't create shared ring (%s)", strerror(errno));
+        return NO_MEMORY;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("BitTube: can't map shared ring (%s)", strerror(errno));
+        close(fd);
+        return NO_MEMORY;
+    }
+    mSharedRing = static_cast<SharedRing*>(addr);
+    mSharedRing->objSize = static_cast<uint32_t>(objSize);
+    mSharedRing->capacity = static_cast<uint32_t>(capacity);
+    mSharedRingSize = size;
+    mSharedRingFd = fd;
+    return NO_ERROR;
+}
+
+void BitTube::mapSharedRing(int fd)
+{
+    const int size = ashmem_get_size_region(fd);
+    if (size < static_cast<int>(sizeof(SharedRing))) {
+        ALOGE("BitTube(Parcel): invalid shared ring (%s)", strerror(errno));
+        return;
+    }
+    void* addr = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("BitTube(Parcel): can't map shared ring (%s)", strerror(errno));
+        return;
+    }
+    SharedRing* ring = static_cast<SharedRing*>(addr);
+    if (ring->objSize <= sizeof(SHARED_RING_WAKEUP) || ring->capacity == 0
+            || sizeof(SharedRing) + size_t(ring->objSize) * ring->capacity
+                    > static_cast<size_t>(size)) {
+        ALOGE("BitTube(Parcel): shared ring does not fit its region");
+        munmap(addr, static_cast<size_t>(size));
+        return;
+    }
+    mSharedRing = ring;
+    mSharedRingSize = static_cast<size_t>(size);
+}
+
+ssize_t BitTube::pushSharedRing(void const* objects, size_t count, size_t objSize)
+{
+    SharedRing* ring = mSharedRing;
+    if (objSize != ring->objSize || ring->socketPending.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    // The receiver may be in another process, do not trust its tail.
+    const uint32_t head = ring->head.load(std::memory_order_relaxed);
+    const uint32_t used = head - ring->tail.load(std::memory_order_acquire);
+    if (used > ring->capacity || count > ring->capacity - used) {
+        return 0;
+    }
+
+    char* slots = reinterpret_cast<char*>(ring + 1);
+    const char* src = static_cast<const char*>(objects);
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(slots + size_t((head + i) % ring->capacity) * objSize, src + i * objSize,
+                objSize);
+    }
+    ring->head.store(head + static_cast<uint32_t>(count), std::memory_order_seq_cst);
+
+    // If the receiver had caught up with the ring, it may have gone back to waiting on the
+    // socket.  Both sides order their head and tail accesses sequentially, so either it sees
+    // the new head or this sees its tail.
+    if (ring->tail.load(std::memory_order_seq_cst) == head) {
+        ssize_t size = write(&SHARED_RING_WAKEUP, sizeof(SHARED_RING_WAKEUP));
+        if (size < 0 && size != -EAGAIN) {
+            return size;
+        }
+    }
+    return static_cast<ssize_t>(count);
+}
+
+ssize_t BitTube::popSharedRing(void* objects, size_t count, size_t objSize)
+{
+    SharedRing* ring = mSharedRing;
+    const uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t available = ring->head.load(std::memory_order_seq_cst) - tail;
+    if (available > ring->capacity) {
+        ALOGE("BitTube: shared ring is corrupted");
+        return -EINVAL;
+    }
+    if (available > count) {
+        available = static_cast<uint32_t>(count);
+    }
+
+    const char* slots = reinterpret_cast<const char*>(ring + 1);
+    char* dst = static_cast<char*>(objects);
+    const size_t ringObjSize = ring->objSize;
+    const size_t copySize = objSize < ringObjSize ? objSize : ringObjSize;
+    for (uint32_t i = 0; i < available; i++) {
+        memcpy(dst + i * objSize, slots + size_t((tail + i) % ring->capacity) * ringObjSize,
+                copySize);
+    }
+    ring->tail.store(tail + available, std::memory_order_seq_cst);
+    return static_cast<ssize_t>(available);
+}
+
 ssize_t BitTube::write(void const* vaddr, size_t size)
 {
     ssize_t err, len;
@@ -136,6 +274,15 @@ status_t BitTube::writeToParcel(Parcel* reply) const
     status_t result = reply->writeDupFileDescriptor(mReceiveFd);
     close(mReceiveFd);
     mReceiveFd = -1;
+    if (result == NO_ERROR) {
+        result = reply->writeInt32(mSharedRingFd >= 0);
+    }
+    if (result == NO_ERROR && mSharedRingFd >= 0) {
+        // The mapping stays, only the receiver needs the region from now on.
+        result = reply->writeDupFileDescriptor(mSharedRingFd);
+        close(mSharedRingFd);
+        mSharedRingFd = -1;
+    }
     return result;
 }
 
@@ -143,8 +290,21 @@ status_t BitTube::writeToParcel(Parcel* reply) const
 ssize_t BitTube::sendObjects(const sp<BitTube>& tube,
         void const* events, size_t count, size_t objSize)
 {
+    if (tube->mSharedRing != nullptr) {
+        ssize_t pushed = tube->pushSharedRing(events, count, objSize);
+        if (pushed != 0) {
+            return pushed;
+        }
+        // The whole batch goes through the socket, and so does everything after it until the
+        // receiver has taken it.
+        tube->mSharedRing->socketPending.fetch_add(1, std::memory_order_seq_cst);
+    }
+
     const char* vaddr = reinterpret_cast<const char*>(events);
     ssize_t size = tube->write(vaddr, count*objSize);
+    if (size < 0 && tube->mSharedRing != nullptr) {
+        tube->mSharedRing->socketPending.fetch_sub(1, std::memory_order_seq_cst);
+    }
 
     // should never happen because of SOCK_SEQPACKET
     LOG_ALWAYS_FATAL_IF((size >= 0) && (size % static_cast<ssize_t>(objSize)),
@@ -159,7 +319,25 @@ ssize_t BitTube::recvObjects(const sp<BitTube>& tube,
         void* events, size_t count, size_t objSize)
 {
     char* vaddr = reinterpret_cast<char*>(events);
-    ssize_t size = tube->read(vaddr, count*objSize);
+    ssize_t size;
+    for (;;) {
+        if (tube->mSharedRing != nullptr) {
+            // The ring only has objects sent before the ones on the socket.
+            ssize_t popped = tube->popSharedRing(events, count, objSize);
+            if (popped != 0) {
+                return popped;
+            }
+        }
+        size = tube->read(vaddr, count*objSize);
+        if (tube->mSharedRing == nullptr || size <= 0) {
+            break;
+        }
+        if (size == static_cast<ssize_t>(sizeof(SHARED_RING_WAKEUP))) {
+            continue;
+        }
+        tube->mSharedRing->socketPending.fetch_sub(1, std::memory_order_seq_cst);
+        break;
+    }
 
     // should never happen because of SOCK_SEQPACKET
     LOG_ALWAYS_FATAL_IF((size >= 0) && (size % static_cast<ssize_t>(objSize)),
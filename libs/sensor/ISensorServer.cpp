@@ -16,6 +16,7 @@
 
 #include <sensor/ISensorServer.h>
 
+#include <fcntl.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -42,6 +43,7 @@ enum {
     GET_DYNAMIC_SENSOR_LIST,
     CREATE_SENSOR_DIRECT_CONNECTION,
     SET_OPERATION_PARAMETER,
+    GET_SENSOR_LIST_STATE,
 };
 
 class BpSensorServer : public BpInterface<ISensorServer>
@@ -90,6 +92,19 @@ public:
         return v;
     }
 
+    virtual int getSensorListState()
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorServer::getInterfaceDescriptor());
+        status_t err = remote()->transact(GET_SENSOR_LIST_STATE, data, &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        // The parcel owns the fd it read.
+        int fd = reply.readFileDescriptor();
+        return fd < 0 ? fd : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+
     virtual sp<ISensorEventConnection> createSensorEventConnection(const String8& packageName,
              int mode, const String16& opPackageName)
     {
@@ -192,6 +207,14 @@ status_t BnSensorServer::onTransact(
             }
             return NO_ERROR;
         }
+        case GET_SENSOR_LIST_STATE: {
+            CHECK_INTERFACE(ISensorServer, data, reply);
+            int fd = getSensorListState();
+            if (fd < 0) {
+                return fd;
+            }
+            return reply->writeFileDescriptor(fd, true /* takeOwnership */);
+        }
         case CREATE_SENSOR_DIRECT_CONNECTION: {
             CHECK_INTERFACE(ISensorServer, data, reply);
             const String16& opPackageName = data.readString16();
@@ -18,9 +18,14 @@
 
 #include <sensor/SensorManager.h>
 
+#include <errno.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include <cutils/ashmem.h>
 #include <cutils/native_handle.h>
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
@@ -93,13 +98,15 @@ SensorManager& SensorManager::getInstanceForPackage(const String16& packageName)
 }
 
 SensorManager::SensorManager(const String16& opPackageName)
-    : mSensorList(0), mOpPackageName(opPackageName), mDirectConnectionHandle(1) {
+    : mSensorList(0), mSensorListState(NULL), mDynamicSensorGeneration(0),
+      mDynamicSensorsValid(false), mOpPackageName(opPackageName), mDirectConnectionHandle(1) {
     // okay we're not locked here, but it's not needed during construction
     assertStateLocked();
 }
 
 SensorManager::~SensorManager() {
     free(mSensorList);
+    unmapSensorListStateLocked();
 }
 
 status_t SensorManager::waitForSensorService(sp<ISensorServer> *server) {
@@ -130,6 +137,9 @@ void SensorManager::sensorManagerDied() {
     free(mSensorList);
     mSensorList = NULL;
     mSensors.clear();
+    unmapSensorListStateLocked();
+    mDynamicSensors.clear();
+    mDynamicSensorsValid = false;
 }
 
 status_t SensorManager::assertStateLocked() {
@@ -160,23 +170,58 @@ status_t SensorManager::assertStateLocked() {
         mDeathObserver = new DeathObserver(*const_cast<SensorManager *>(this));
         IInterface::asBinder(mSensorServer)->linkToDeath(mDeathObserver);
 
-        mSensors = mSensorServer->getSensorList(mOpPackageName);
-        size_t count = mSensors.size();
-        mSensorList =
-                static_cast<Sensor const**>(malloc(count * sizeof(Sensor*)));
-        LOG_ALWAYS_FATAL_IF(mSensorList == NULL, "mSensorList NULL");
+        mapSensorListStateLocked();
+    }
 
-        for (size_t i=0 ; i<count ; i++) {
-            mSensorList[i] = mSensors.array() + i;
-        }
+    return NO_ERROR;
+}
+
+status_t SensorManager::assertSensorListLocked() {
+    status_t err = assertStateLocked();
+    if (err != NO_ERROR || mSensorList != NULL) {
+        return err;
     }
 
+    mSensors = mSensorServer->getSensorList(mOpPackageName);
+    size_t count = mSensors.size();
+    mSensorList =
+            static_cast<Sensor const**>(malloc(count * sizeof(Sensor*)));
+    LOG_ALWAYS_FATAL_IF(mSensorList == NULL, "mSensorList NULL");
+
+    for (size_t i=0 ; i<count ; i++) {
+        mSensorList[i] = mSensors.array() + i;
+    }
     return NO_ERROR;
 }
 
+void SensorManager::mapSensorListStateLocked() {
+    unmapSensorListStateLocked();
+
+    int fd = mSensorServer->getSensorListState();
+    if (fd < 0) {
+        return;
+    }
+    if (ashmem_get_size_region(fd) >= static_cast<int>(sizeof(SensorListState))) {
+        void* addr = mmap(nullptr, sizeof(SensorListState), PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            mSensorListState = static_cast<const SensorListState*>(addr);
+        } else {
+            ALOGE("can't map the sensor list state (%s)", strerror(errno));
+        }
+    }
+    close(fd);
+}
+
+void SensorManager::unmapSensorListStateLocked() {
+    if (mSensorListState != NULL) {
+        munmap(const_cast<SensorListState*>(mSensorListState), sizeof(SensorListState));
+        mSensorListState = NULL;
+    }
+}
+
 ssize_t SensorManager::getSensorList(Sensor const* const** list) {
     Mutex::Autolock _l(mLock);
-    status_t err = assertStateLocked();
+    status_t err = assertSensorListLocked();
     if (err < 0) {
         return static_cast<ssize_t>(err);
     }
@@ -191,8 +236,24 @@ ssize_t SensorManager::getDynamicSensorList(Vector<Sensor> & dynamicSensors) {
         return static_cast<ssize_t>(err);
     }
 
+    // Read the generation before the list, so that a change made meanwhile is seen next time.
+    uint32_t generation = 0;
+    bool reusable = false;
+    if (mSensorListState != NULL) {
+        generation = mSensorListState->dynamicSensorGeneration.load(std::memory_order_acquire);
+        reusable = mSensorListState->restrictedDynamicSensorCount.load(
+                std::memory_order_acquire) == 0;
+    }
+    if (reusable && mDynamicSensorsValid && generation == mDynamicSensorGeneration) {
+        dynamicSensors = mDynamicSensors;
+        return static_cast<ssize_t>(dynamicSensors.size());
+    }
+
     dynamicSensors = mSensorServer->getDynamicSensorList(mOpPackageName);
     size_t count = dynamicSensors.size();
+    mDynamicSensors = dynamicSensors;
+    mDynamicSensorGeneration = generation;
+    mDynamicSensorsValid = reusable;
 
     return static_cast<ssize_t>(count);
 }
@@ -200,7 +261,7 @@ ssize_t SensorManager::getDynamicSensorList(Vector<Sensor> & dynamicSensors) {
 Sensor const* SensorManager::getDefaultSensor(int type)
 {
     Mutex::Autolock _l(mLock);
-    if (assertStateLocked() == NO_ERROR) {
+    if (assertSensorListLocked() == NO_ERROR) {
         bool wakeUpSensor = false;
         // For the following sensor types, return a wake-up sensor. These types are by default
         // defined as wake-up sensors. For the rest of the sensor types defined in sensors.h return
@@ -48,6 +48,12 @@ public:
     // get the send file-descriptor.
     int getSendFd() const;
 
+    // Makes sendObjects() copy objects of the given size into a ring of that many objects in
+    // shared memory, which recvObjects() takes them from, rather than through the socket.
+    // The socket then only carries wakeups, and the objects that did not fit in the ring.
+    // Must be called on the sending side before the BitTube is parceled.
+    status_t enableSharedRing(size_t objSize, size_t capacity);
+
     // send objects (sized blobs). All objects are guaranteed to be written or the call fails.
     template <typename T>
     static ssize_t sendObjects(const sp<BitTube>& tube,
@@ -67,7 +73,14 @@ public:
     status_t writeToParcel(Parcel* reply) const;
 
 private:
+    struct SharedRing;
+
     void init(size_t rcvbuf, size_t sndbuf);
+    void mapSharedRing(int fd);
+
+    // Returns the number of objects written to the ring, 0 if they must go to the socket.
+    ssize_t pushSharedRing(void const* objects, size_t count, size_t objSize);
+    ssize_t popSharedRing(void* objects, size_t count, size_t objSize);
 
     // send a message. The write is guaranteed to send the whole message or fail.
     ssize_t write(void const* vaddr, size_t size);
@@ -79,6 +92,10 @@ private:
     int mSendFd;
     mutable int mReceiveFd;
 
+    SharedRing* mSharedRing;
+    size_t mSharedRingSize;
+    mutable int mSharedRingFd;
+
     static ssize_t sendObjects(const sp<BitTube>& tube,
             void const* events, size_t count, size_t objSize);
 
@@ -19,6 +19,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include <utils/Errors.h>
 #include <utils/StrongPointer.h>
 #include <utils/Vector.h>
@@ -36,6 +38,15 @@ class Sensor;
 class String8;
 class String16;
 
+// Layout of the read-only region returned by ISensorServer::getSensorListState().
+struct SensorListState {
+    // Incremented when a dynamic sensor is connected or disconnected.
+    std::atomic<uint32_t> dynamicSensorGeneration;
+    // Number of connected dynamic sensors that need a permission, which may be listed or not
+    // depending on the caller without any change of the generation.
+    std::atomic<uint32_t> restrictedDynamicSensorCount;
+};
+
 class ISensorServer : public IInterface
 {
 public:
@@ -43,6 +54,9 @@ public:
 
     virtual Vector<Sensor> getSensorList(const String16& opPackageName) = 0;
     virtual Vector<Sensor> getDynamicSensorList(const String16& opPackageName) = 0;
+    // Returns the fd of a read-only ashmem region holding a SensorListState, which the caller
+    // owns, or a negative error code.
+    virtual int getSensorListState() = 0;
 
     virtual sp<ISensorEventConnection> createSensorEventConnection(const String8& packageName,
              int mode, const String16& opPackageName) = 0;
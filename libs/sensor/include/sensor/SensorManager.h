@@ -48,6 +48,7 @@ namespace android {
 class ISensorServer;
 class Sensor;
 class SensorEventQueue;
+struct SensorListState;
 // ----------------------------------------------------------------------------
 
 class SensorManager : public ASensorManager
@@ -73,6 +74,10 @@ private:
 
     SensorManager(const String16& opPackageName);
     status_t assertStateLocked();
+    // Also fetches the sensor list, which is only done when first needed.
+    status_t assertSensorListLocked();
+    void mapSensorListStateLocked();
+    void unmapSensorListStateLocked();
 
 private:
     static Mutex sLock;
@@ -82,6 +87,12 @@ private:
     sp<ISensorServer> mSensorServer;
     Sensor const** mSensorList;
     Vector<Sensor> mSensors;
+    // Mapped from the service, NULL if it does not publish one.
+    const SensorListState* mSensorListState;
+    // The last dynamic sensor list, reused while its generation is current.
+    Vector<Sensor> mDynamicSensors;
+    uint32_t mDynamicSensorGeneration;
+    bool mDynamicSensorsValid;
     sp<IBinder::DeathRecipient> mDeathObserver;
     const String16 mOpPackageName;
     std::unordered_map<int, sp<ISensorEventConnection>> mDirectConnection;
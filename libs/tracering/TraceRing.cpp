@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TraceRing"
+
+#include <tracering/TraceRing.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include <log/log.h>
+#include <utils/String8.h>
+
+namespace android {
+
+namespace {
+
+// One file per process, named after its pid.
+constexpr const char* kTraceRingDir = "/data/misc/trace_ring";
+
+constexpr uint32_t kMagic = 0x54524e47;  // "TRNG"
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kMaxThreads = 32;
+constexpr uint32_t kRecordsPerThread = 2048;
+
+struct Record {
+    uint64_t timestamp;
+    char type;
+    char name[TraceRing::kMaxNameLength + 1];
+};
+static_assert(sizeof(Record) == 64, "Record should fill a cache line");
+
+// Written only by its thread; the head is the index of the next record, and
+// is published after the record it follows is written.
+struct ThreadRing {
+    std::atomic<int32_t> tid;
+    std::atomic<uint64_t> head;
+    Record records[kRecordsPerThread];
+};
+
+struct RingFile {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> threads;
+    ThreadRing thread[kMaxThreads];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "rings are shared with other processes");
+
+std::atomic<RingFile*> gRing{nullptr};
+std::mutex gInitLock;
+
+thread_local ThreadRing* tRing = nullptr;
+thread_local bool tNoRing = false;
+
+ThreadRing* currentThreadRing() {
+    if (tRing != nullptr || tNoRing) {
+        return tRing;
+    }
+    RingFile* ring = gRing.load(std::memory_order_acquire);
+    if (ring == nullptr) {
+        return nullptr;
+    }
+    uint32_t index = ring->threads.fetch_add(1, std::memory_order_relaxed);
+    if (index >= kMaxThreads) {
+        tNoRing = true;
+        return nullptr;
+    }
+    ring->thread[index].tid.store(gettid(), std::memory_order_release);
+    tRing = &ring->thread[index];
+    return tRing;
+}
+
+void record(char type, const char* name) {
+    ThreadRing* ring = currentThreadRing();
+    if (ring == nullptr) {
+        return;
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    Record& record = ring->records[head % kRecordsPerThread];
+    record.timestamp = systemTime(SYSTEM_TIME_BOOTTIME);
+    record.type = type;
+    strlcpy(record.name, name, sizeof(record.name));
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool isProcessAlive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Removes the rings of processes that are gone.
+void removeStaleRings() {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kTraceRingDir), closedir);
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir.get())) {
+        pid_t pid = atoi(entry->d_name);
+        if (pid > 0 && !isProcessAlive(pid)) {
+            unlinkat(dirfd(dir.get()), entry->d_name, 0);
+        }
+    }
+}
+
+void collectProcess(pid_t pid, nsecs_t since, std::vector<TraceRing::Event>* events) {
+    String8 path = String8::format("%s/%d", kTraceRingDir, pid);
+    int fd = open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(RingFile))) {
+        map = mmap(nullptr, sizeof(RingFile), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    const RingFile* ring = static_cast<const RingFile*>(map);
+    if (ring->magic == kMagic && ring->version == kVersion) {
+        uint32_t threads = std::min(ring->threads.load(std::memory_order_relaxed), kMaxThreads);
+        std::unique_ptr<Record[]> records(new Record[kRecordsPerThread]);
+        for (uint32_t i = 0; i < threads; i++) {
+            const ThreadRing& thread = ring->thread[i];
+            pid_t tid = thread.tid.load(std::memory_order_acquire);
+            uint64_t head = thread.head.load(std::memory_order_acquire);
+            memcpy(records.get(), thread.records, sizeof(thread.records));
+            // Records the thread wrote while they were copied are not trusted, including the
+            // one it may be writing now.
+            uint64_t newHead = thread.head.load(std::memory_order_acquire);
+            uint64_t first = newHead >= kRecordsPerThread ? newHead - kRecordsPerThread + 1 : 0;
+            for (uint64_t index = first; index < head; index++) {
+                const Record& record = records[index % kRecordsPerThread];
+                if (static_cast<nsecs_t>(record.timestamp) < since) {
+                    continue;
+                }
+                events->push_back({pid, tid, static_cast<nsecs_t>(record.timestamp),
+                                   record.type,
+                                   std::string(record.name,
+                                               strnlen(record.name, sizeof(record.name)))});
+            }
+        }
+    }
+    munmap(map, sizeof(RingFile));
+}
+
+} // namespace
+
+bool TraceRing::init() {
+    std::lock_guard<std::mutex> lock(gInitLock);
+    if (gRing.load(std::memory_order_relaxed) != nullptr) {
+        return true;
+    }
+    removeStaleRings();
+
+    String8 path = String8::format("%s/%d", kTraceRingDir, getpid());
+    int fd = open(path.string(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        ALOGW("Failed to create %s: %s", path.string(), strerror(errno));
+        return false;
+    }
+    // The file is sparse, so only the records threads actually write use memory.
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(RingFile)) == 0) {
+        map = mmap(nullptr, sizeof(RingFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        ALOGW("Failed to map %s: %s", path.string(), strerror(errno));
+        unlink(path.string());
+        return false;
+    }
+
+    RingFile* ring = static_cast<RingFile*>(map);
+    ring->magic = kMagic;
+    ring->version = kVersion;
+    gRing.store(ring, std::memory_order_release);
+    return true;
+}
+
+void TraceRing::begin(const char* name) {
+    record('B', name);
+}
+
+void TraceRing::end() {
+    record('E', "");
+}
+
+std::vector<TraceRing::Event> TraceRing::collect(nsecs_t since) {
+    std::vector<Event> events;
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kTraceRingDir), closedir);
+    if (!dir) {
+        return events;
+    }
+    while (struct dirent* entry = readdir(dir.get())) {
+        pid_t pid = atoi(entry->d_name);
+        if (pid > 0 && isProcessAlive(pid)) {
+            collectProcess(pid, since, &events);
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event& lhs, const Event& rhs) {
+        return lhs.timestamp < rhs.timestamp;
+    });
+    return events;
+}
+
+} // namespace android
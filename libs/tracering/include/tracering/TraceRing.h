@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TRACERING_H
+#define ANDROID_TRACERING_H
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+// Always-on tracing of userspace sections into per-thread rings in shared memory, which
+// atrace collects with --ring_dump. Unlike ATRACE_*, which write each event to trace_marker,
+// recording an event only reads the clock and copies its name: no syscall and no lock.
+//
+// Each thread of a process that called init() records its most recent events in its own
+// ring, overwriting the oldest ones. Events of other processes, and of threads started after
+// all rings are taken, are dropped.
+class TraceRing {
+public:
+    // Maps the shared rings of the calling process. Can be called more than once.
+    static bool init();
+
+    // Records the start of a section. Names longer than kMaxNameLength are truncated.
+    static void begin(const char* name);
+
+    // Records the end of the last section started on the calling thread.
+    static void end();
+
+    static constexpr size_t kMaxNameLength = 54;
+
+    // An event collected from the rings of a process.
+    struct Event {
+        pid_t pid;
+        pid_t tid;
+        // SYSTEM_TIME_BOOTTIME, the clock atrace uses for the kernel trace.
+        nsecs_t timestamp;
+        // 'B' for begin() or 'E' for end().
+        char type;
+        std::string name;
+    };
+
+    // Returns the events of all processes recorded at or after |since|, in time order.
+    static std::vector<Event> collect(nsecs_t since);
+};
+
+// Records a section for the lifetime of the object.
+class ScopedTraceRing {
+public:
+    explicit ScopedTraceRing(const char* name) {
+        TraceRing::begin(name);
+    }
+
+    ~ScopedTraceRing() {
+        TraceRing::end();
+    }
+};
+
+} // namespace android
+
+#define TRACE_RING_NAME(name) ::android::ScopedTraceRing ___traceRing(name)
+#define TRACE_RING_CALL() TRACE_RING_NAME(__FUNCTION__)
+
+#endif // ANDROID_TRACERING_H
@@ -16,6 +16,8 @@
 
 #include <ui/ColorSpace.h>
 
+#include <algorithm>
+
 using namespace std::placeholders;
 
 namespace android {
@@ -82,6 +84,15 @@ static ColorSpace::transfer_function toEOTF(float gamma) {
     return std::bind(safePow, _1, gamma);
 }
 
+// Returns whether function wraps the function pointer target. Static functions
+// such as saturate() only match when the std::function was created in this
+// translation unit, which is the case of the built-in color spaces.
+template<typename Function>
+static bool isFunction(const std::function<float(float)>& function, Function* target) {
+    Function* const* pointer = function.target<Function*>();
+    return pointer != nullptr && *pointer == target;
+}
+
 static constexpr std::array<float2, 3> computePrimaries(const mat3& rgbToXYZ) {
     float3 r(rgbToXYZ * float3{1, 0, 0});
     float3 g(rgbToXYZ * float3{0, 1, 0});
@@ -111,6 +122,9 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(computePrimaries(rgbToXYZ))
         , mWhitePoint(computeWhitePoint(rgbToXYZ)) {
+    mTransfer = isFunction(mOETF, linearResponse) && isFunction(mEOTF, linearResponse)
+            ? Transfer::LINEAR : Transfer::CUSTOM;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 ColorSpace::ColorSpace(
@@ -127,6 +141,9 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(computePrimaries(rgbToXYZ))
         , mWhitePoint(computeWhitePoint(rgbToXYZ)) {
+    mTransfer = parameters.e == 0.0f && parameters.f == 0.0f
+            ? Transfer::PARAMETRIC : Transfer::FULL_PARAMETRIC;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 ColorSpace::ColorSpace(
@@ -143,6 +160,8 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(computePrimaries(rgbToXYZ))
         , mWhitePoint(computeWhitePoint(rgbToXYZ)) {
+    mTransfer = gamma == 1.0f ? Transfer::LINEAR : Transfer::GAMMA;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 ColorSpace::ColorSpace(
@@ -160,6 +179,9 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(primaries)
         , mWhitePoint(whitePoint) {
+    mTransfer = isFunction(mOETF, linearResponse) && isFunction(mEOTF, linearResponse)
+            ? Transfer::LINEAR : Transfer::CUSTOM;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 ColorSpace::ColorSpace(
@@ -177,6 +199,9 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(primaries)
         , mWhitePoint(whitePoint) {
+    mTransfer = parameters.e == 0.0f && parameters.f == 0.0f
+            ? Transfer::PARAMETRIC : Transfer::FULL_PARAMETRIC;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 ColorSpace::ColorSpace(
@@ -194,6 +219,8 @@ ColorSpace::ColorSpace(
         , mClamper(std::move(clamper))
         , mPrimaries(primaries)
         , mWhitePoint(whitePoint) {
+    mTransfer = gamma == 1.0f ? Transfer::LINEAR : Transfer::GAMMA;
+    mSaturates = isFunction(mClamper, saturate<float>);
 }
 
 constexpr mat3 ColorSpace::computeXYZMatrix(
@@ -351,6 +378,129 @@ const ColorSpace ColorSpace::ACEScg() {
     };
 }
 
+// ------------------------------------------------------------------------------------------------
+// Batch conversions
+
+static_assert(sizeof(float3) == 3 * sizeof(float), "float3 arrays must be tightly packed");
+
+// Number of values a connector converts per pass, so that they stay in cache
+static constexpr size_t BATCH_SIZE = 256;
+
+static inline const float* asFloats(const float3* v) {
+    return reinterpret_cast<const float*>(v);
+}
+
+static inline float* asFloats(float3* v) {
+    return reinterpret_cast<float*>(v);
+}
+
+template<typename Function>
+static inline void applyEach(const float* in, float* out, size_t count, Function function) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = function(in[i]);
+    }
+}
+
+static inline void multiply(const mat3& m, const float3* in, float3* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = m * in[i];
+    }
+}
+
+void ColorSpace::applyOETF(const float* in, float* out, size_t count) const noexcept {
+    const TransferParameters p = mParameters;
+    switch (mTransfer) {
+        case Transfer::LINEAR:
+            std::copy(in, in + count, out);
+            break;
+        case Transfer::GAMMA:
+            applyEach(in, out, count, [e = 1.0f / p.g](float x) { return safePow(x, e); });
+            break;
+        case Transfer::PARAMETRIC:
+            applyEach(in, out, count, [&p](float x) { return rcpResponse(x, p); });
+            break;
+        case Transfer::FULL_PARAMETRIC:
+            applyEach(in, out, count, [&p](float x) { return rcpFullResponse(x, p); });
+            break;
+        case Transfer::CUSTOM:
+            applyEach(in, out, count, [this](float x) { return mOETF(x); });
+            break;
+    }
+}
+
+void ColorSpace::applyEOTF(const float* in, float* out, size_t count) const noexcept {
+    const TransferParameters p = mParameters;
+    switch (mTransfer) {
+        case Transfer::LINEAR:
+            std::copy(in, in + count, out);
+            break;
+        case Transfer::GAMMA:
+            applyEach(in, out, count, [g = p.g](float x) { return safePow(x, g); });
+            break;
+        case Transfer::PARAMETRIC:
+            applyEach(in, out, count, [&p](float x) { return response(x, p); });
+            break;
+        case Transfer::FULL_PARAMETRIC:
+            applyEach(in, out, count, [&p](float x) { return fullResponse(x, p); });
+            break;
+        case Transfer::CUSTOM:
+            applyEach(in, out, count, [this](float x) { return mEOTF(x); });
+            break;
+    }
+}
+
+void ColorSpace::applyClamper(const float* in, float* out, size_t count) const noexcept {
+    if (mSaturates) {
+        applyEach(in, out, count, saturate<float>);
+    } else {
+        applyEach(in, out, count, [this](float x) { return mClamper(x); });
+    }
+}
+
+void ColorSpace::fromLinear(const float3* in, float3* out, size_t count) const noexcept {
+    applyOETF(asFloats(in), asFloats(out), count * 3);
+}
+
+void ColorSpace::toLinear(const float3* in, float3* out, size_t count) const noexcept {
+    applyEOTF(asFloats(in), asFloats(out), count * 3);
+}
+
+void ColorSpace::xyzToRGB(const float3* in, float3* out, size_t count) const noexcept {
+    multiply(mXYZtoRGB, in, out, count);
+    applyOETF(asFloats(out), asFloats(out), count * 3);
+    applyClamper(asFloats(out), asFloats(out), count * 3);
+}
+
+void ColorSpace::rgbToXYZ(const float3* in, float3* out, size_t count) const noexcept {
+    applyEOTF(asFloats(in), asFloats(out), count * 3);
+    multiply(mRGBtoXYZ, out, out, count);
+}
+
+void ColorSpaceConnector::transform(const float3* in, float3* out, size_t count) const noexcept {
+    for (size_t offset = 0; offset < count; offset += BATCH_SIZE) {
+        const size_t n = std::min(BATCH_SIZE, count - offset);
+        float3* values = out + offset;
+        mSource.applyClamper(asFloats(in + offset), asFloats(values), n * 3);
+        mSource.applyEOTF(asFloats(values), asFloats(values), n * 3);
+        multiply(mTransform, values, values, n);
+        mDestination.applyOETF(asFloats(values), asFloats(values), n * 3);
+        mDestination.applyClamper(asFloats(values), asFloats(values), n * 3);
+    }
+}
+
+void ColorSpaceConnector::transformLinear(
+        const float3* in, float3* out, size_t count) const noexcept {
+    for (size_t offset = 0; offset < count; offset += BATCH_SIZE) {
+        const size_t n = std::min(BATCH_SIZE, count - offset);
+        float3* values = out + offset;
+        mSource.applyClamper(asFloats(in + offset), asFloats(values), n * 3);
+        multiply(mTransform, values, values, n);
+        mDestination.applyClamper(asFloats(values), asFloats(values), n * 3);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
 std::unique_ptr<float3> ColorSpace::createLUT(uint32_t size,
         const ColorSpace& src, const ColorSpace& dst) {
 
@@ -364,9 +514,11 @@ std::unique_ptr<float3> ColorSpace::createLUT(uint32_t size,
 
     for (uint32_t z = 0; z < size; z++) {
         for (int32_t y = int32_t(size - 1); y >= 0; y--) {
+            float3* row = data;
             for (uint32_t x = 0; x < size; x++) {
-                *data++ = connector.transform({x * m, y * m, z * m});
+                *data++ = {x * m, y * m, z * m};
             }
+            connector.transform(row, row, size);
         }
     }
 
@@ -285,23 +285,52 @@ void FenceTimeline::push(const std::shared_ptr<FenceTime>& fence) {
             // we are removing it from the timeline.
             front->getSignalTime();
         }
-        mQueue.pop();
+        mQueue.pop_front();
     }
-    mQueue.push(fence);
+    mQueue.push_back(fence);
 }
 
 void FenceTimeline::updateSignalTimes() {
-    while (!mQueue.empty()) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    updateSignalTimesLocked();
+}
+
+nsecs_t FenceTimeline::getSignalTime(const std::shared_ptr<FenceTime>& fence) {
+    nsecs_t signalTime = fence->getCachedSignalTime();
+    if (signalTime != Fence::SIGNAL_TIME_PENDING) {
+        return signalTime;
+    }
+
+    {
         std::lock_guard<std::mutex> lock(mMutex);
+        updateSignalTimesLocked();
+        signalTime = fence->getCachedSignalTime();
+        if (signalTime != Fence::SIGNAL_TIME_PENDING) {
+            return signalTime;
+        }
+        // The front of the queue is still pending, so anything after it is
+        // too.
+        for (const auto& entry : mQueue) {
+            if (entry.lock() == fence) {
+                return Fence::SIGNAL_TIME_PENDING;
+            }
+        }
+    }
+
+    return fence->getSignalTime();
+}
+
+void FenceTimeline::updateSignalTimesLocked() {
+    while (!mQueue.empty()) {
         std::shared_ptr<FenceTime> fence = mQueue.front().lock();
         if (!fence) {
             // The shared_ptr no longer exists and no one cares about the
             // timestamp anymore.
-            mQueue.pop();
+            mQueue.pop_front();
             continue;
         } else if (fence->getSignalTime() != Fence::SIGNAL_TIME_PENDING) {
             // The fence has signaled and we've removed the sp<Fence> ref.
-            mQueue.pop();
+            mQueue.pop_front();
             continue;
         } else {
             // The fence didn't signal yet. Break since the later ones
@@ -44,6 +44,31 @@ sp<GraphicBuffer> GraphicBuffer::from(ANativeWindowBuffer* anwb) {
     return static_cast<GraphicBuffer *>(anwb);
 }
 
+status_t GraphicBuffer::allocateBuffers(uint32_t count, uint32_t inWidth,
+        uint32_t inHeight, PixelFormat inFormat, uint32_t inLayerCount,
+        uint64_t inUsage, std::string requestorName,
+        std::vector<sp<GraphicBuffer>>* outBuffers)
+{
+    std::vector<buffer_handle_t> handles(count);
+    uint32_t outStride = 0;
+    status_t err = GraphicBufferAllocator::get().allocate(inWidth, inHeight,
+            inFormat, inLayerCount, inUsage, count, handles.data(), &outStride,
+            std::move(requestorName));
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    outBuffers->clear();
+    outBuffers->reserve(count);
+    for (buffer_handle_t handle : handles) {
+        sp<GraphicBuffer> buffer(new GraphicBuffer());
+        buffer->initWithAllocatedHandle(handle, inWidth, inHeight, inFormat,
+                inLayerCount, inUsage, outStride);
+        outBuffers->push_back(buffer);
+    }
+    return NO_ERROR;
+}
+
 GraphicBuffer::GraphicBuffer()
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
       mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0)
@@ -167,23 +192,34 @@ status_t GraphicBuffer::initWithSize(uint32_t inWidth, uint32_t inHeight,
 {
     GraphicBufferAllocator& allocator = GraphicBufferAllocator::get();
     uint32_t outStride = 0;
+    buffer_handle_t outHandle;
     status_t err = allocator.allocate(inWidth, inHeight, inFormat, inLayerCount,
-            inUsage, &handle, &outStride, mId,
+            inUsage, &outHandle, &outStride, mId,
             std::move(requestorName));
     if (err == NO_ERROR) {
-        mBufferMapper.getTransportSize(handle, &mTransportNumFds, &mTransportNumInts);
-
-        width = static_cast<int>(inWidth);
-        height = static_cast<int>(inHeight);
-        format = inFormat;
-        layerCount = inLayerCount;
-        usage = inUsage;
-        usage_deprecated = int(usage);
-        stride = static_cast<int>(outStride);
+        initWithAllocatedHandle(outHandle, inWidth, inHeight, inFormat,
+                inLayerCount, inUsage, outStride);
     }
     return err;
 }
 
+void GraphicBuffer::initWithAllocatedHandle(buffer_handle_t inHandle,
+        uint32_t inWidth, uint32_t inHeight, PixelFormat inFormat,
+        uint32_t inLayerCount, uint64_t inUsage, uint32_t inStride)
+{
+    handle = inHandle;
+    mOwner = ownData;
+    mBufferMapper.getTransportSize(handle, &mTransportNumFds, &mTransportNumInts);
+
+    width = static_cast<int>(inWidth);
+    height = static_cast<int>(inHeight);
+    format = inFormat;
+    layerCount = inLayerCount;
+    usage = inUsage;
+    usage_deprecated = int(usage);
+    stride = static_cast<int>(inStride);
+}
+
 status_t GraphicBuffer::initWithHandle(const native_handle_t* handle,
         HandleWrapMethod method, uint32_t width, uint32_t height,
         PixelFormat format, uint32_t layerCount, uint64_t usage,
@@ -462,8 +498,9 @@ status_t GraphicBuffer::unflatten(
 
     if (handle != 0) {
         buffer_handle_t importedHandle;
-        status_t err = mBufferMapper.importBuffer(handle, uint32_t(width), uint32_t(height),
-                uint32_t(layerCount), format, usage, uint32_t(stride), &importedHandle);
+        status_t err = mBufferMapper.importBuffer(mId, handle, uint32_t(width),
+                uint32_t(height), uint32_t(layerCount), format, usage, uint32_t(stride),
+                &importedHandle);
         if (err != NO_ERROR) {
             width = height = stride = format = usage_deprecated = 0;
             layerCount = 0;
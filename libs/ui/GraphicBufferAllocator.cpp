@@ -22,6 +22,10 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <map>
+#include <thread>
+
 #include <grallocusage/GrallocUsageConversion.h>
 
 #include <log/log.h>
@@ -31,6 +35,7 @@
 
 #include <ui/Gralloc2.h>
 #include <ui/GraphicBufferMapper.h>
+#include <ui/GraphicBufferPool.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -40,6 +45,7 @@ ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferAllocator )
 Mutex GraphicBufferAllocator::sLock;
 KeyedVector<buffer_handle_t,
     GraphicBufferAllocator::alloc_rec_t> GraphicBufferAllocator::sAllocList;
+GraphicBufferAllocator::alloc_stats_t GraphicBufferAllocator::sAllocStats;
 
 GraphicBufferAllocator::GraphicBufferAllocator()
   : mMapper(GraphicBufferMapper::getInstance()),
@@ -80,11 +86,48 @@ void GraphicBufferAllocator::dump(String8& result) const
     }
     snprintf(buffer, SIZE, "Total allocated (estimate): %.2f KB\n", total/1024.0);
     result.append(buffer);
+    const alloc_stats_t& stats(sAllocStats);
+    snprintf(buffer, SIZE, "Allocation requests: %" PRIu64 " (%" PRIu64 " buffers), "
+            "latency avg %.3f ms, max %.3f ms\n",
+            stats.requests, stats.buffers,
+            stats.requests ? stats.totalTime / 1e6 / stats.requests : 0.0,
+            stats.maxTime / 1e6);
+    result.append(buffer);
+
+    GraphicBufferPool::getInstance().dump(result);
 
     std::string deviceDump = mAllocator->dumpDebugInfo();
     result.append(deviceDump.c_str(), deviceDump.size());
 }
 
+std::vector<GraphicBufferAllocator::usage_total_t>
+GraphicBufferAllocator::getUsageTotals() const
+{
+    std::map<uint64_t, usage_total_t> totals;
+    {
+        Mutex::Autolock _l(sLock);
+        const KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
+        for (size_t i = 0; i < list.size(); i++) {
+            const alloc_rec_t& rec(list.valueAt(i));
+            usage_total_t& total = totals[rec.usage];
+            total.usage = rec.usage;
+            total.count++;
+            total.size += rec.size;
+        }
+    }
+
+    std::vector<usage_total_t> result;
+    result.reserve(totals.size());
+    for (const auto& entry : totals) {
+        result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(),
+            [](const usage_total_t& a, const usage_total_t& b) {
+                return a.size > b.size;
+            });
+    return result;
+}
+
 void GraphicBufferAllocator::dumpToSystemLog()
 {
     String8 s;
@@ -96,6 +139,31 @@ status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
         PixelFormat format, uint32_t layerCount, uint64_t usage,
         buffer_handle_t* handle, uint32_t* stride,
         uint64_t /*graphicBufferId*/, std::string requestorName)
+{
+    return allocate(width, height, format, layerCount, usage, 1, handle,
+            stride, std::move(requestorName));
+}
+
+void GraphicBufferAllocator::allocateAsync(uint32_t width, uint32_t height,
+        PixelFormat format, uint32_t layerCount, uint64_t usage,
+        uint32_t count, std::string requestorName, AllocateCallback callback)
+{
+    std::thread([=]() {
+        std::vector<buffer_handle_t> handles(count);
+        uint32_t stride = 0;
+        status_t error = allocate(width, height, format, layerCount, usage,
+                count, handles.data(), &stride, requestorName);
+        if (error != NO_ERROR) {
+            handles.clear();
+        }
+        callback(error, handles, stride);
+    }).detach();
+}
+
+status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
+        PixelFormat format, uint32_t layerCount, uint64_t usage,
+        uint32_t count, buffer_handle_t* handles, uint32_t* stride,
+        std::string requestorName)
 {
     ATRACE_CALL();
 
@@ -115,7 +183,14 @@ status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
     info.format = static_cast<Gralloc2::PixelFormat>(format);
     info.usage = usage;
 
-    Gralloc2::Error error = mAllocator->allocate(info, stride, handle);
+    nsecs_t start = systemTime();
+    Gralloc2::Error error = mAllocator->allocate(info, count, stride, handles);
+    if (error == Gralloc2::Error::NO_RESOURCES &&
+            GraphicBufferPool::getInstance().trim() > 0) {
+        // idle buffers kept for reuse are not worth failing an allocation
+        error = mAllocator->allocate(info, count, stride, handles);
+    }
+    nsecs_t duration = systemTime() - start;
     if (error == Gralloc2::Error::NONE) {
         Mutex::Autolock _l(sLock);
         KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
@@ -129,13 +204,21 @@ status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
         rec.usage = usage;
         rec.size = static_cast<size_t>(height * (*stride) * bpp);
         rec.requestorName = std::move(requestorName);
-        list.add(*handle, rec);
+        for (uint32_t i = 0; i < count; i++) {
+            list.add(handles[i], rec);
+        }
+
+        alloc_stats_t& stats(sAllocStats);
+        stats.requests++;
+        stats.buffers += count;
+        stats.totalTime += duration;
+        stats.maxTime = std::max(stats.maxTime, duration);
 
         return NO_ERROR;
     } else {
-        ALOGE("Failed to allocate (%u x %u) layerCount %u format %d "
+        ALOGE("Failed to allocate %u x (%u x %u) layerCount %u format %d "
                 "usage %" PRIx64 ": %d",
-                width, height, layerCount, format, usage,
+                count, width, height, layerCount, format, usage,
                 error);
         return NO_MEMORY;
     }
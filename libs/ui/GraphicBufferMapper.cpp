@@ -20,6 +20,8 @@
 
 #include <ui/GraphicBufferMapper.h>
 
+#include <sys/stat.h>
+
 #include <grallocusage/GrallocUsageConversion.h>
 
 // We would eliminate the non-conforming zero-length array, but we can't since
@@ -85,6 +87,81 @@ status_t GraphicBufferMapper::importBuffer(buffer_handle_t rawHandle,
     return NO_ERROR;
 }
 
+status_t GraphicBufferMapper::importBuffer(uint64_t bufferId,
+        buffer_handle_t rawHandle, uint32_t width, uint32_t height,
+        uint32_t layerCount, PixelFormat format, uint64_t usage,
+        uint32_t stride, buffer_handle_t* outHandle)
+{
+    ATRACE_CALL();
+
+    struct stat st;
+    if (rawHandle == nullptr || rawHandle->numFds < 1 ||
+            fstat(rawHandle->data[0], &st) != 0) {
+        return importBuffer(rawHandle, width, height, layerCount, format,
+                usage, stride, outHandle);
+    }
+
+    auto matches = [&](const ImportedBuffer& imported) {
+        return imported.dev == st.st_dev && imported.ino == st.st_ino &&
+                imported.width == width && imported.height == height &&
+                imported.layerCount == layerCount &&
+                imported.format == format && imported.usage == usage &&
+                imported.stride == stride;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mImportLock);
+        auto it = mImportedBuffers.find(bufferId);
+        if (it != mImportedBuffers.end() && matches(it->second)) {
+            it->second.refCount++;
+            *outHandle = it->second.handle;
+            return NO_ERROR;
+        }
+    }
+
+    // Import without holding the lock, since it calls into the mapper
+    buffer_handle_t bufferHandle;
+    status_t err = importBuffer(rawHandle, width, height, layerCount, format,
+            usage, stride, &bufferHandle);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    std::lock_guard<std::mutex> lock(mImportLock);
+    auto it = mImportedBuffers.find(bufferId);
+    if (it != mImportedBuffers.end()) {
+        if (matches(it->second)) {
+            // Another thread imported the buffer meanwhile
+            it->second.refCount++;
+            *outHandle = it->second.handle;
+            mMapper->freeBuffer(bufferHandle);
+            return NO_ERROR;
+        }
+        // A different buffer with the same id is cached; leave this one
+        // uncached
+        *outHandle = bufferHandle;
+        return NO_ERROR;
+    }
+
+    ImportedBuffer imported = {};
+    imported.handle = bufferHandle;
+    imported.refCount = 1;
+    imported.dev = st.st_dev;
+    imported.ino = st.st_ino;
+    imported.width = width;
+    imported.height = height;
+    imported.layerCount = layerCount;
+    imported.format = format;
+    imported.usage = usage;
+    imported.stride = stride;
+    mImportedBuffers.emplace(bufferId, imported);
+    mImportedBufferIds.emplace(bufferHandle, bufferId);
+
+    *outHandle = bufferHandle;
+
+    return NO_ERROR;
+}
+
 void GraphicBufferMapper::getTransportSize(buffer_handle_t handle,
             uint32_t* outTransportNumFds, uint32_t* outTransportNumInts)
 {
@@ -95,6 +172,19 @@ status_t GraphicBufferMapper::freeBuffer(buffer_handle_t handle)
 {
     ATRACE_CALL();
 
+    {
+        std::lock_guard<std::mutex> lock(mImportLock);
+        auto idIt = mImportedBufferIds.find(handle);
+        if (idIt != mImportedBufferIds.end()) {
+            auto it = mImportedBuffers.find(idIt->second);
+            if (--it->second.refCount > 0) {
+                return NO_ERROR;
+            }
+            mImportedBuffers.erase(it);
+            mImportedBufferIds.erase(idIt);
+        }
+    }
+
     mMapper->freeBuffer(handle);
 
     return NO_ERROR;
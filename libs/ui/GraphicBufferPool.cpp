@@ -0,0 +1,194 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferPool"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <ui/GraphicBufferPool.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferPool )
+
+// Idle buffers not reused within this time are freed
+static constexpr nsecs_t MAX_IDLE_TIME = s2ns(3);
+
+// How often the eviction thread looks for idle buffers
+static constexpr auto EVICTION_PERIOD = std::chrono::seconds(1);
+
+static size_t getBufferSize(const sp<GraphicBuffer>& buffer) {
+    uint32_t bpp = bytesPerPixel(buffer->getPixelFormat());
+    if (bpp == 0) {
+        // YUV and implementation defined formats, assume the worst
+        bpp = 4;
+    }
+    return static_cast<size_t>(buffer->getStride()) * buffer->getHeight() *
+            buffer->getLayerCount() * bpp;
+}
+
+GraphicBufferPool::GraphicBufferPool()
+{
+    const int32_t budgetKb = property_get_int32("debug.ui.buffer_pool_budget_kb", 0);
+    mBudget = static_cast<size_t>(std::max(budgetKb, 0)) * 1024;
+}
+
+GraphicBufferPool::~GraphicBufferPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+        mCondition.notify_all();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+bool GraphicBufferPool::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBudget > 0;
+}
+
+sp<GraphicBuffer> GraphicBufferPool::take(Owner owner, uint32_t width,
+        uint32_t height, PixelFormat format, uint32_t layerCount,
+        uint64_t usage, sp<Fence>* outFence) {
+    ATRACE_CALL();
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto entry = mEntries.begin(); entry != mEntries.end(); ++entry) {
+        const sp<GraphicBuffer>& buffer = entry->buffer;
+        // A buffer still referenced elsewhere in the process, by a consumer
+        // that has not processed its release yet for instance, is not idle.
+        if (entry->owner != owner || buffer->getWidth() != width ||
+                buffer->getHeight() != height ||
+                buffer->getPixelFormat() != format ||
+                buffer->getLayerCount() != layerCount ||
+                buffer->getUsage() != usage || buffer->getStrongCount() != 1) {
+            continue;
+        }
+        sp<GraphicBuffer> result = buffer;
+        *outFence = entry->fence;
+        mSize -= entry->size;
+        mEntries.erase(entry);
+        mHits++;
+        return result;
+    }
+    mMisses++;
+    return nullptr;
+}
+
+void GraphicBufferPool::recycle(Owner owner, const sp<GraphicBuffer>& buffer,
+        const sp<Fence>& releaseFence) {
+    if (buffer == nullptr) {
+        return;
+    }
+    const size_t size = getBufferSize(buffer);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (size > mBudget) {
+        return;
+    }
+
+    const nsecs_t now = systemTime();
+    mEntries.push_front({owner, buffer,
+            releaseFence != nullptr ? releaseFence : Fence::NO_FENCE, size, now});
+    mSize += size;
+    evictLocked(now);
+
+    if (!mThread.joinable()) {
+        mThread = std::thread(&GraphicBufferPool::threadMain, this);
+        pthread_setname_np(mThread.native_handle(), "BufferPoolEvict");
+    }
+    mCondition.notify_all();
+}
+
+size_t GraphicBufferPool::trim() {
+    ATRACE_CALL();
+    std::list<Entry> entries;
+    size_t size;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entries.swap(mEntries);
+        size = mSize;
+        mSize = 0;
+        mEvictions += entries.size();
+    }
+    // the buffers are freed here, outside of the lock
+    entries.clear();
+    return size;
+}
+
+void GraphicBufferPool::setBudget(size_t budget) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBudget = budget;
+    evictLocked(systemTime());
+}
+
+void GraphicBufferPool::evictLocked(nsecs_t now) {
+    const size_t evicted = mEvicted.size();
+    while (!mEntries.empty() && (mSize > mBudget ||
+            now - mEntries.back().recycleTime >= MAX_IDLE_TIME)) {
+        mEvicted.push_back(std::move(mEntries.back().buffer));
+        mSize -= mEntries.back().size;
+        mEntries.pop_back();
+        mEvictions++;
+    }
+    if (mEvicted.size() != evicted) {
+        mCondition.notify_all();
+    }
+}
+
+void GraphicBufferPool::threadMain() {
+    std::vector<sp<GraphicBuffer>> evicted;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRunning) {
+        if (mEvicted.empty()) {
+            if (mEntries.empty()) {
+                mCondition.wait(lock);
+            } else {
+                mCondition.wait_for(lock, EVICTION_PERIOD);
+            }
+            evictLocked(systemTime());
+        }
+
+        // Free the buffers without holding the lock, gralloc can be slow
+        evicted.swap(mEvicted);
+        lock.unlock();
+        evicted.clear();
+        lock.lock();
+    }
+}
+
+void GraphicBufferPool::dump(String8& result) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    result.appendFormat("Buffer pool: %zu idle buffers, %.2f KiB of %.2f KiB, "
+            "hits=%" PRIu64 " misses=%" PRIu64 " evictions=%" PRIu64 "\n",
+            mEntries.size(), static_cast<double>(mSize) / 1024.0,
+            static_cast<double>(mBudget) / 1024.0, mHits, mMisses, mEvictions);
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
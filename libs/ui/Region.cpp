@@ -19,6 +19,8 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#include <algorithm>
+
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/CallStack.h>
@@ -55,10 +57,24 @@ enum {
 
 const Region Region::INVALID_REGION(Rect::INVALID_RECT);
 
+// All empty regions share the same storage so that constructing or clearing
+// a Region doesn't allocate; Vector's copy-on-write semantics take care of
+// detaching it on the first modification. It is never destroyed, since
+// static Regions may outlive it.
+static const Vector<Rect>& emptyStorage() {
+    static const Vector<Rect>* const storage = [] {
+        Vector<Rect>* v = new Vector<Rect>();
+        v->add(Rect(0,0));
+        return v;
+    }();
+    return *storage;
+}
+
 // ----------------------------------------------------------------------------
 
-Region::Region() {
-    mStorage.add(Rect(0,0));
+Region::Region()
+    : mStorage(emptyStorage())
+{
 }
 
 Region::Region(const Region& rhs)
@@ -245,26 +261,29 @@ bool Region::contains(int x, int y) const {
 
 void Region::clear()
 {
-    mStorage.clear();
-    mStorage.add(Rect(0,0));
+    mStorage = emptyStorage();
 }
 
 void Region::set(const Rect& r)
 {
-    mStorage.clear();
-    mStorage.add(r);
+    if (mStorage.size() == 1) {
+        // overwrite in place when the storage isn't shared, rather than
+        // shrinking and growing it again
+        mStorage.replaceAt(r, 0);
+    } else {
+        mStorage.clear();
+        mStorage.add(r);
+    }
 }
 
 void Region::set(int32_t w, int32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    set(Rect(w, h));
 }
 
 void Region::set(uint32_t w, uint32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    set(Rect(w, h));
 }
 
 bool Region::isTriviallyEqual(const Region& region) const {
@@ -589,6 +608,98 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
     return result;
 }
 
+// Computes the operations whose result can be derived from the bounds alone,
+// without running the spanner. This covers most of the single rectangle
+// regions handled by SurfaceFlinger. rhs is expected to be already offset.
+// Returns false when the general algorithm must be used.
+static bool trivial_operation(uint32_t op, Region& dst,
+        const Region& lhs, const Rect& rhs)
+{
+    const Rect lhsBounds(lhs.getBounds());
+    if (!lhsBounds.isValid() || !rhs.isValid()) {
+        return false;
+    }
+
+    if (rhs.isEmpty()) {
+        if (op == op_and) {
+            dst.clear();
+        } else {
+            dst = lhs;
+        }
+        return true;
+    }
+
+    if (lhsBounds.isEmpty()) {
+        if (op == op_and || op == op_nand) {
+            dst.clear();
+        } else {
+            dst.set(rhs);
+        }
+        return true;
+    }
+
+    Rect common;
+    const bool intersects = lhsBounds.intersect(rhs, &common);
+    if (!intersects) {
+        if (op == op_and) {
+            dst.clear();
+            return true;
+        }
+        if (op == op_nand) {
+            dst = lhs;
+            return true;
+        }
+    }
+
+    if (!lhs.isRect()) {
+        return false;
+    }
+
+    const bool rhsContainsLhs = rhs.left <= lhsBounds.left && rhs.top <= lhsBounds.top &&
+            rhs.right >= lhsBounds.right && rhs.bottom >= lhsBounds.bottom;
+    switch (op) {
+        case op_and:
+            dst.set(common);
+            return true;
+        case op_nand:
+            if (rhsContainsLhs) {
+                dst.clear();
+                return true;
+            }
+            return false;
+        case op_or: {
+            const bool lhsContainsRhs = lhsBounds.left <= rhs.left &&
+                    lhsBounds.top <= rhs.top && lhsBounds.right >= rhs.right &&
+                    lhsBounds.bottom >= rhs.bottom;
+            if (lhsContainsRhs) {
+                dst = lhs;
+                return true;
+            }
+            if (rhsContainsLhs) {
+                dst.set(rhs);
+                return true;
+            }
+            // rectangles sharing a band or a column merge into a single one
+            // when they overlap or touch
+            const bool sameBand = lhsBounds.top == rhs.top && lhsBounds.bottom == rhs.bottom &&
+                    lhsBounds.right >= rhs.left && rhs.right >= lhsBounds.left;
+            const bool sameColumn = lhsBounds.left == rhs.left &&
+                    lhsBounds.right == rhs.right && lhsBounds.bottom >= rhs.top &&
+                    rhs.bottom >= lhsBounds.top;
+            if (sameBand || sameColumn) {
+                dst.set(Rect(std::min(lhsBounds.left, rhs.left),
+                        std::min(lhsBounds.top, rhs.top),
+                        std::max(lhsBounds.right, rhs.right),
+                        std::max(lhsBounds.bottom, rhs.bottom)));
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
 void Region::boolean_operation(uint32_t op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -599,6 +710,26 @@ void Region::boolean_operation(uint32_t op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !(VALIDATE_WITH_CORECG || VALIDATE_REGIONS)
+    if (rhs.isRect()) {
+        if (trivial_operation(op, dst, lhs, rhs.getBounds().offsetBy(dx, dy))) {
+            return;
+        }
+    } else if (op == op_and || op == op_nand) {
+        // disjoint bounds make intersection and subtraction trivial
+        // regardless of the number of rectangles
+        Rect common;
+        if (!lhs.getBounds().intersect(rhs.getBounds().offsetBy(dx, dy), &common)) {
+            if (op == op_and) {
+                dst.clear();
+            } else {
+                dst = lhs;
+            }
+            return;
+        }
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -714,6 +845,11 @@ void Region::boolean_operation(uint32_t op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    if (rhs != Rect::INVALID_RECT &&
+            trivial_operation(op, dst, lhs, Rect(rhs).offsetBy(dx, dy))) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
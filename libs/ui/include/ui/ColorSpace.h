@@ -19,6 +19,7 @@
 
 #include <array>
 #include <cmath>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <string>
@@ -180,6 +181,19 @@ public:
         return mRGBtoXYZ * toLinear(rgb);
     }
 
+    /**
+     * Batch versions of the conversions above, converting count values
+     * from in to out. in and out may point to the same array.
+     *
+     * The transfer functions of color spaces defined by transfer parameters
+     * or by a gamma value are evaluated inline, without going through the
+     * std::function callbacks.
+     */
+    void fromLinear(const float3* in, float3* out, size_t count) const noexcept;
+    void toLinear(const float3* in, float3* out, size_t count) const noexcept;
+    void xyzToRGB(const float3* in, float3* out, size_t count) const noexcept;
+    void rgbToXYZ(const float3* in, float3* out, size_t count) const noexcept;
+
     constexpr const std::string& getName() const noexcept {
         return mName;
     }
@@ -254,6 +268,22 @@ public:
             const ColorSpace& src, const ColorSpace& dst);
 
 private:
+    friend class ColorSpaceConnector;
+
+    // How the transfer functions were defined
+    enum class Transfer {
+        CUSTOM,
+        LINEAR,
+        GAMMA,
+        PARAMETRIC,
+        FULL_PARAMETRIC,
+    };
+
+    // Batch transfer and clamping functions, on count floats
+    void applyOETF(const float* in, float* out, size_t count) const noexcept;
+    void applyEOTF(const float* in, float* out, size_t count) const noexcept;
+    void applyClamper(const float* in, float* out, size_t count) const noexcept;
+
     static constexpr mat3 computeXYZMatrix(
             const std::array<float2, 3>& primaries, const float2& whitePoint);
 
@@ -273,6 +303,10 @@ private:
 
     std::array<float2, 3> mPrimaries;
     float2 mWhitePoint;
+
+    Transfer mTransfer = Transfer::CUSTOM;
+    // Whether mClamper is the default saturate
+    bool mSaturates = false;
 };
 
 class ColorSpaceConnector {
@@ -294,6 +328,13 @@ public:
         return apply(mTransform * linear, mDestination.getClamper());
     }
 
+    /**
+     * Batch versions of transform() and transformLinear(), converting count
+     * values from in to out. in and out may point to the same array.
+     */
+    void transform(const float3* in, float3* out, size_t count) const noexcept;
+    void transformLinear(const float3* in, float3* out, size_t count) const noexcept;
+
 private:
     ColorSpace mSource;
     ColorSpace mDestination;
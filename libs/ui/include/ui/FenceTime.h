@@ -22,6 +22,7 @@
 #include <utils/Timers.h>
 
 #include <atomic>
+#include <deque>
 #include <mutex>
 #include <queue>
 #include <unordered_map>
@@ -153,8 +154,8 @@ private:
 // if FenceTimeline did nothing. i.e. they should eventually call
 // Fence::getSignalTime(), not only Fence::getCachedSignalTime().
 //
-// push() and updateSignalTimes() are safe to call simultaneously from
-// different threads.
+// push(), updateSignalTimes() and getSignalTime() are safe to call
+// simultaneously from different threads.
 class FenceTimeline {
 public:
     static constexpr size_t MAX_ENTRIES = 64;
@@ -162,9 +163,17 @@ public:
     void push(const std::shared_ptr<FenceTime>& fence);
     void updateSignalTimes();
 
+    // Returns the signal time of a fence, polling at most the oldest pending
+    // fence of the timeline. A fence queued behind a pending one is reported
+    // as pending without a syscall, since it can't have signaled yet.
+    // Fences that aren't in the timeline are polled directly.
+    nsecs_t getSignalTime(const std::shared_ptr<FenceTime>& fence);
+
 private:
+    void updateSignalTimesLocked();
+
     mutable std::mutex mMutex;
-    std::queue<std::weak_ptr<FenceTime>> mQueue;
+    std::deque<std::weak_ptr<FenceTime>> mQueue;
 };
 
 // Used by test code to create or get FenceTimes for a given Fence.
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <string>
+#include <vector>
 
 #include <ui/ANativeObjectBase.h>
 #include <ui/PixelFormat.h>
@@ -75,6 +76,14 @@ public:
 
     static sp<GraphicBuffer> from(ANativeWindowBuffer *);
 
+    // Allocates count buffers with the same attributes in a single request
+    // to the allocator, which is cheaper than allocating them one at a time.
+    // outBuffers is only modified on success.
+    static status_t allocateBuffers(uint32_t count, uint32_t inWidth,
+            uint32_t inHeight, PixelFormat inFormat, uint32_t inLayerCount,
+            uint64_t inUsage, std::string requestorName,
+            std::vector<sp<GraphicBuffer>>* outBuffers);
+
 
     // Create a GraphicBuffer to be unflatten'ed into or be reallocated.
     GraphicBuffer();
@@ -231,6 +240,11 @@ private:
             PixelFormat format, uint32_t layerCount,
             uint64_t usage, uint32_t stride);
 
+    // Takes ownership of a handle returned by GraphicBufferAllocator
+    void initWithAllocatedHandle(buffer_handle_t inHandle, uint32_t inWidth,
+            uint32_t inHeight, PixelFormat inFormat, uint32_t inLayerCount,
+            uint64_t inUsage, uint32_t inStride);
+
     void free_handle();
 
     GraphicBufferMapper& mBufferMapper;
@@ -20,8 +20,10 @@
 
 #include <stdint.h>
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <cutils/native_handle.h>
 
@@ -31,6 +33,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/Singleton.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -51,11 +54,42 @@ public:
             buffer_handle_t* handle, uint32_t* stride, uint64_t graphicBufferId,
             std::string requestorName);
 
+    // Allocates count buffers with the same attributes in a single request
+    // to the allocator. handles must have room for count handles, which all
+    // have the returned stride and must each be freed with free.
+    status_t allocate(uint32_t w, uint32_t h, PixelFormat format,
+            uint32_t layerCount, uint64_t usage, uint32_t count,
+            buffer_handle_t* handles, uint32_t* stride,
+            std::string requestorName);
+
+    // Called with the result of allocateAsync. On success, the callback owns
+    // the handles.
+    typedef std::function<void(status_t error,
+            const std::vector<buffer_handle_t>& handles, uint32_t stride)>
+            AllocateCallback;
+
+    // Like the batched allocate above, but allocates on a separate thread and
+    // calls callback from that thread when done.
+    void allocateAsync(uint32_t w, uint32_t h, PixelFormat format,
+            uint32_t layerCount, uint64_t usage, uint32_t count,
+            std::string requestorName, AllocateCallback callback);
+
     status_t free(buffer_handle_t handle);
 
     void dump(String8& res) const;
     static void dumpToSystemLog();
 
+    // Number and estimated size, in bytes, of the allocated buffers of one
+    // usage.
+    struct usage_total_t {
+        uint64_t usage;
+        size_t count;
+        size_t size;
+    };
+
+    // Returns the totals of the allocated buffers by usage, largest first.
+    std::vector<usage_total_t> getUsageTotals() const;
+
 private:
     struct alloc_rec_t {
         uint32_t width;
@@ -71,6 +105,15 @@ private:
     static Mutex sLock;
     static KeyedVector<buffer_handle_t, alloc_rec_t> sAllocList;
 
+    // allocation latency statistics, protected by sLock
+    struct alloc_stats_t {
+        uint64_t requests;
+        uint64_t buffers;
+        nsecs_t totalTime;
+        nsecs_t maxTime;
+    };
+    static alloc_stats_t sAllocStats;
+
     friend class Singleton<GraphicBufferAllocator>;
     GraphicBufferAllocator();
     ~GraphicBufferAllocator();
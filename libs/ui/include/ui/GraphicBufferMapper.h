@@ -21,6 +21,8 @@
 #include <sys/types.h>
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <ui/PixelFormat.h>
 #include <utils/Singleton.h>
@@ -54,6 +56,17 @@ public:
             PixelFormat format, uint64_t usage, uint32_t stride,
             buffer_handle_t* outHandle);
 
+    // Like importBuffer above, but for a buffer identified by bufferId (see
+    // GraphicBuffer::getId). When the same buffer is still imported through
+    // this method, the existing handle is returned and reference counted
+    // instead of importing the buffer again. outHandle must still be freed
+    // with freeBuffer, which frees the handle once its last reference is
+    // gone.
+    status_t importBuffer(uint64_t bufferId, buffer_handle_t rawHandle,
+            uint32_t width, uint32_t height, uint32_t layerCount,
+            PixelFormat format, uint64_t usage, uint32_t stride,
+            buffer_handle_t* outHandle);
+
     status_t freeBuffer(buffer_handle_t handle);
 
     void getTransportSize(buffer_handle_t handle,
@@ -90,7 +103,29 @@ private:
 
     GraphicBufferMapper();
 
+    // A handle imported by the caching importBuffer, and what it was
+    // imported with
+    struct ImportedBuffer {
+        buffer_handle_t handle;
+        size_t refCount;
+        // Identifies the allocation the first fd refers to, so that a
+        // recycled buffer id is not mistaken for the imported buffer
+        dev_t dev;
+        ino_t ino;
+        uint32_t width;
+        uint32_t height;
+        uint32_t layerCount;
+        PixelFormat format;
+        uint64_t usage;
+        uint32_t stride;
+    };
+
     const std::unique_ptr<const Gralloc2::Mapper> mMapper;
+
+    std::mutex mImportLock;
+    std::unordered_map<uint64_t, ImportedBuffer> mImportedBuffers;
+    // Maps the imported handles back to their buffer ids
+    std::unordered_map<buffer_handle_t, uint64_t> mImportedBufferIds;
 };
 
 // ---------------------------------------------------------------------------
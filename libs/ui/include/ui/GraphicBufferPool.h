@@ -0,0 +1,125 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UI_GRAPHIC_BUFFER_POOL_H
+#define ANDROID_UI_GRAPHIC_BUFFER_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+
+#include <utils/Singleton.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+/*
+ * A process-wide pool of idle GraphicBuffers, so that a buffer queue dropping
+ * its buffers (on a resize or a reconnect, say) and allocating new ones shortly
+ * after with the same attributes gets the old ones back instead of going
+ * through gralloc twice.
+ *
+ * Buffers are only handed back to the owner that recycled them, so one client
+ * never gets to see the contents of another client's buffers. Idle buffers are
+ * freed on a background thread once they have not been reused for a while, or
+ * as soon as the pool goes over its memory budget. The pool is disabled while
+ * the budget is 0, which is the default unless debug.ui.buffer_pool_budget_kb
+ * is set.
+ */
+class GraphicBufferPool : public Singleton<GraphicBufferPool>
+{
+public:
+    static inline GraphicBufferPool& get() { return getInstance(); }
+
+    // Identifies the clients allowed to share buffers, e.g. a uid
+    typedef uint64_t Owner;
+
+    bool isEnabled() const;
+
+    // Returns an idle buffer of the owner with exactly these attributes, or
+    // NULL if there is none. outFence is set to the fence that must be waited
+    // on before writing to the buffer.
+    sp<GraphicBuffer> take(Owner owner, uint32_t width, uint32_t height,
+            PixelFormat format, uint32_t layerCount, uint64_t usage,
+            sp<Fence>* outFence);
+
+    // Hands a buffer the caller no longer needs to the pool. releaseFence
+    // signals when the last reader is done with it. The buffer must not be
+    // written to by anyone afterwards.
+    void recycle(Owner owner, const sp<GraphicBuffer>& buffer,
+            const sp<Fence>& releaseFence);
+
+    // Drops every idle buffer, e.g. when an allocation failed. Returns the
+    // number of bytes released.
+    size_t trim();
+
+    // Sets the memory budget, in bytes. Buffers over budget are evicted
+    // starting with the least recently recycled ones.
+    void setBudget(size_t budget);
+
+    void dump(String8& result) const;
+
+private:
+    struct Entry {
+        Owner owner;
+        sp<GraphicBuffer> buffer;
+        sp<Fence> fence;
+        size_t size;
+        nsecs_t recycleTime;
+    };
+
+    friend class Singleton<GraphicBufferPool>;
+    GraphicBufferPool();
+    ~GraphicBufferPool();
+
+    // Moves the entries that must go to mEvicted, and wakes up the eviction
+    // thread if there were any.
+    void evictLocked(nsecs_t now);
+    void threadMain();
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool mRunning = true;
+
+    size_t mBudget = 0;
+    size_t mSize = 0;
+    // most recently recycled first
+    std::list<Entry> mEntries;
+    // buffers waiting to be freed by the eviction thread
+    std::vector<sp<GraphicBuffer>> mEvicted;
+
+    // statistics
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+    uint64_t mEvictions = 0;
+};
+
+}; // namespace android
+
+#endif // ANDROID_UI_GRAPHIC_BUFFER_POOL_H
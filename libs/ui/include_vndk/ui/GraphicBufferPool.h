@@ -0,0 +1 @@
+../../include/ui/GraphicBufferPool.h
\ No newline at end of file
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferPoolTest"
+
+#include <ui/GraphicBuffer.h>
+#include <ui/GraphicBufferPool.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kTestWidth = 1024;
+constexpr uint32_t kTestHeight = 1;
+constexpr uint32_t kTestFormat = HAL_PIXEL_FORMAT_BLOB;
+constexpr uint32_t kTestLayerCount = 1;
+constexpr uint64_t kTestUsage = GraphicBuffer::USAGE_SW_WRITE_OFTEN;
+
+constexpr GraphicBufferPool::Owner kOwner = 10001;
+constexpr GraphicBufferPool::Owner kOtherOwner = 10002;
+
+} // namespace
+
+class GraphicBufferPoolTest : public testing::Test {
+protected:
+    GraphicBufferPoolTest() : mPool(GraphicBufferPool::get()) {
+        mPool.trim();
+        mPool.setBudget(1024 * 1024);
+    }
+
+    ~GraphicBufferPoolTest() override {
+        mPool.trim();
+        mPool.setBudget(0);
+    }
+
+    sp<GraphicBuffer> allocate() {
+        return new GraphicBuffer(kTestWidth, kTestHeight, kTestFormat, kTestLayerCount,
+                                 kTestUsage);
+    }
+
+    sp<GraphicBuffer> take(GraphicBufferPool::Owner owner, uint32_t width = kTestWidth) {
+        sp<Fence> fence;
+        return mPool.take(owner, width, kTestHeight, kTestFormat, kTestLayerCount, kTestUsage,
+                          &fence);
+    }
+
+    GraphicBufferPool& mPool;
+};
+
+TEST_F(GraphicBufferPoolTest, ReturnsRecycledBufferToItsOwner) {
+    sp<GraphicBuffer> buffer = allocate();
+    ASSERT_EQ(NO_ERROR, buffer->initCheck());
+    const GraphicBuffer* raw = buffer.get();
+
+    mPool.recycle(kOwner, buffer, Fence::NO_FENCE);
+    buffer.clear();
+
+    EXPECT_EQ(nullptr, take(kOtherOwner).get());
+    EXPECT_EQ(nullptr, take(kOwner, kTestWidth * 2).get());
+    EXPECT_EQ(raw, take(kOwner).get());
+    EXPECT_EQ(nullptr, take(kOwner).get());
+}
+
+TEST_F(GraphicBufferPoolTest, SkipsBuffersStillInUse) {
+    sp<GraphicBuffer> buffer = allocate();
+    ASSERT_EQ(NO_ERROR, buffer->initCheck());
+
+    mPool.recycle(kOwner, buffer, Fence::NO_FENCE);
+    EXPECT_EQ(nullptr, take(kOwner).get());
+
+    buffer.clear();
+    EXPECT_NE(nullptr, take(kOwner).get());
+}
+
+TEST_F(GraphicBufferPoolTest, StaysWithinBudget) {
+    mPool.setBudget(0);
+    mPool.recycle(kOwner, allocate(), Fence::NO_FENCE);
+    EXPECT_EQ(nullptr, take(kOwner).get());
+
+    // BLOB buffers are accounted at 4 bytes per pixel, so only the most
+    // recent one fits.
+    sp<GraphicBuffer> first = allocate();
+    sp<GraphicBuffer> second = allocate();
+    ASSERT_EQ(NO_ERROR, second->initCheck());
+    mPool.setBudget(second->getStride() * kTestHeight * 4 * 3 / 2);
+    const GraphicBuffer* raw = second.get();
+    mPool.recycle(kOwner, first, Fence::NO_FENCE);
+    mPool.recycle(kOwner, second, Fence::NO_FENCE);
+    first.clear();
+    second.clear();
+
+    EXPECT_EQ(raw, take(kOwner).get());
+    EXPECT_EQ(nullptr, take(kOwner).get());
+}
+
+} // namespace android
@@ -21,6 +21,10 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
+#include <vector>
+
 namespace android {
 
 namespace {
@@ -61,4 +65,44 @@ TEST_F(GraphicBufferTest, DetachedBuffer) {
     EXPECT_FALSE(buffer->isDetachedBuffer());
 }
 
+TEST_F(GraphicBufferTest, UnflattenReusesImportedHandle) {
+    sp<GraphicBuffer> buffer(
+            new GraphicBuffer(kTestWidth, kTestHeight, kTestFormat, kTestLayerCount, kTestUsage));
+    ASSERT_EQ(NO_ERROR, buffer->initCheck());
+
+    std::vector<uint8_t> data(buffer->getFlattenedSize());
+    std::vector<int> fds(buffer->getFdCount());
+    void* flatData = data.data();
+    size_t flatSize = data.size();
+    int* flatFds = fds.data();
+    size_t flatCount = fds.size();
+    ASSERT_EQ(NO_ERROR, buffer->flatten(flatData, flatSize, flatFds, flatCount));
+
+    // unflatten takes ownership of the fds, so give each copy its own.
+    auto unflatten = [&](const sp<GraphicBuffer>& out) {
+        std::vector<int> dupFds;
+        for (int fd : fds) {
+            dupFds.push_back(dup(fd));
+        }
+        const void* inData = data.data();
+        size_t inSize = data.size();
+        const int* inFds = dupFds.data();
+        size_t inCount = dupFds.size();
+        return out->unflatten(inData, inSize, inFds, inCount);
+    };
+
+    sp<GraphicBuffer> first(new GraphicBuffer());
+    sp<GraphicBuffer> second(new GraphicBuffer());
+    ASSERT_EQ(NO_ERROR, unflatten(first));
+    ASSERT_EQ(NO_ERROR, unflatten(second));
+    EXPECT_EQ(buffer->getId(), second->getId());
+    EXPECT_EQ(first->handle, second->handle);
+
+    // The handle stays imported while any buffer still uses it.
+    first.clear();
+    void* vaddr;
+    ASSERT_EQ(NO_ERROR, second->lock(kTestUsage, &vaddr));
+    EXPECT_EQ(NO_ERROR, second->unlock());
+}
+
 } // namespace android
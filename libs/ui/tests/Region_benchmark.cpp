@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+using android::Rect;
+using android::Region;
+
+namespace {
+
+// A region made of a grid of n x n rects, sharing n Y bands, similar to what
+// multi-window layouts produce in SurfaceFlinger.
+Region makeGrid(int n, int offset) {
+    Region r;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            const int l = offset + i * 100;
+            const int t = offset + j * 100;
+            r.orSelf(Rect(l, t, l + 80, t + 80));
+        }
+    }
+    return r;
+}
+
+// Single rect operands are handled without running the spanner.
+void BM_RectAndRect(benchmark::State& state) {
+    const Region lhs(Rect(0, 0, 1080, 1920));
+    const Rect rhs(0, 100, 1080, 1820);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs.intersect(rhs));
+    }
+}
+BENCHMARK(BM_RectAndRect);
+
+void BM_RectOrRect(benchmark::State& state) {
+    const Region lhs(Rect(0, 0, 1080, 100));
+    const Rect rhs(0, 100, 1080, 1920);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs.merge(rhs));
+    }
+}
+BENCHMARK(BM_RectOrRect);
+
+// Overlapping rects producing several bands still go through the spanner.
+void BM_RectSubtractRect(benchmark::State& state) {
+    const Region lhs(Rect(0, 0, 1080, 1920));
+    const Rect rhs(100, 100, 980, 1820);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs.subtract(rhs));
+    }
+}
+BENCHMARK(BM_RectSubtractRect);
+
+void BM_GridOperation(benchmark::State& state) {
+    const Region lhs(makeGrid(state.range(0), 0));
+    const Region rhs(makeGrid(state.range(0), 40));
+    const uint32_t op = state.range(1);
+    while (state.KeepRunning()) {
+        switch (op) {
+            case 0: benchmark::DoNotOptimize(lhs.merge(rhs)); break;
+            case 1: benchmark::DoNotOptimize(lhs.intersect(rhs)); break;
+            default: benchmark::DoNotOptimize(lhs.subtract(rhs)); break;
+        }
+    }
+}
+BENCHMARK(BM_GridOperation)->ArgPair(2, 0)->ArgPair(2, 1)->ArgPair(2, 2)
+        ->ArgPair(8, 0)->ArgPair(8, 1)->ArgPair(8, 2);
+
+// Disjoint bounds short-circuit intersection and subtraction.
+void BM_GridDisjoint(benchmark::State& state) {
+    const Region lhs(makeGrid(8, 0));
+    const Region rhs(makeGrid(8, 10000));
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(lhs.intersect(rhs));
+    }
+}
+BENCHMARK(BM_GridDisjoint);
+
+}  // namespace
+
+BENCHMARK_MAIN();
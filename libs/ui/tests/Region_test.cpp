@@ -152,5 +152,85 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+static bool rectContains(const Rect& r, int x, int y) {
+    return x >= r.left && x < r.right && y >= r.top && y < r.bottom;
+}
+
+TEST_F(RegionTest, Random_RectOperations) {
+    srandom(12345);
+
+    for (int iter = 0; iter < ITER_MAX; iter++) {
+        // include empty and degenerate rects, which take the trivial paths
+        int l = random() % X_MAX, t = random() % Y_MAX;
+        const Rect a(l, t, l + random() % (X_MAX - l + 1), t + random() % (Y_MAX - t + 1));
+        l = random() % X_MAX;
+        t = random() % Y_MAX;
+        const Rect b(l, t, l + random() % (X_MAX - l + 1), t + random() % (Y_MAX - t + 1));
+
+        const Region ra(a);
+        const Region rb(b);
+        const Region orRegion = ra.merge(b);
+        const Region andRegion = ra.intersect(b);
+        const Region nandRegion = ra.subtract(b);
+        const Region xorRegion = ra.mergeExclusive(rb);
+        for (int x = 0; x < X_MAX; x++) {
+            for (int y = 0; y < Y_MAX; y++) {
+                const bool inA = rectContains(a, x, y);
+                const bool inB = rectContains(b, x, y);
+                EXPECT_EQ(inA || inB, orRegion.contains(x, y));
+                EXPECT_EQ(inA && inB, andRegion.contains(x, y));
+                EXPECT_EQ(inA && !inB, nandRegion.contains(x, y));
+                EXPECT_EQ(inA != inB, xorRegion.contains(x, y));
+            }
+        }
+        EXPECT_TRUE((orRegion ^ (ra | rb)).isEmpty());
+        EXPECT_TRUE((andRegion ^ (ra & rb)).isEmpty());
+    }
+}
+
+TEST_F(RegionTest, RectOperations_MergeAdjacent) {
+    Region r(Rect(0, 0, 10, 10));
+    r.orSelf(Rect(10, 0, 20, 10));
+    EXPECT_TRUE(r.isRect());
+    EXPECT_EQ(Rect(0, 0, 20, 10), r.getBounds());
+
+    r.orSelf(Rect(0, 10, 20, 30));
+    EXPECT_TRUE(r.isRect());
+    EXPECT_EQ(Rect(0, 0, 20, 30), r.getBounds());
+
+    r.subtractSelf(Rect(-5, -5, 25, 35));
+    EXPECT_TRUE(r.isEmpty());
+}
+
+TEST_F(RegionTest, DisjointBounds_Operations) {
+    Region r(Rect(0, 0, 10, 10));
+    r.orSelf(Rect(20, 20, 30, 30));
+    ASSERT_FALSE(r.isRect());
+
+    Region other(Rect(40, 0, 50, 10));
+    other.orSelf(Rect(60, 20, 70, 30));
+
+    EXPECT_TRUE(r.intersect(other).isEmpty());
+    EXPECT_TRUE(r.subtract(other).isTriviallyEqual(r));
+    EXPECT_TRUE((r.subtract(other) ^ r).isEmpty());
+}
+
+TEST_F(RegionTest, EmptyRegions_ShareStorage) {
+    Region a;
+    Region b(Rect(0, 0, 10, 10));
+    b.clear();
+    EXPECT_TRUE(a.isTriviallyEqual(b));
+
+    // modifying one of them must not affect the other
+    a.orSelf(Rect(0, 0, 5, 5));
+    EXPECT_FALSE(a.isEmpty());
+    EXPECT_TRUE(b.isEmpty());
+    EXPECT_TRUE(Region().isEmpty());
+
+    a.set(Rect(1, 2, 3, 4));
+    EXPECT_EQ(Rect(1, 2, 3, 4), a.getBounds());
+    EXPECT_TRUE(Region().isEmpty());
+}
+
 }; // namespace android
 
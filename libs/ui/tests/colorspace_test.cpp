@@ -19,6 +19,8 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include <vector>
+
 #include <ui/ColorSpace.h>
 
 #include <gtest/gtest.h>
@@ -27,6 +29,9 @@ namespace android {
 
 class ColorSpaceTest : public testing::Test {
 protected:
+    static bool isNear(const float3& a, const float3& b) {
+        return all(lessThan(abs(a - b), float3{1e-5f}));
+    }
 };
 
 TEST_F(ColorSpaceTest, XYZ) {
@@ -180,4 +185,55 @@ TEST_F(ColorSpaceTest, LUT) {
 
 }
 
+TEST_F(ColorSpaceTest, Batch) {
+    const ColorSpace spaces[] = {
+        ColorSpace::sRGB(), ColorSpace::linearSRGB(), ColorSpace::extendedSRGB(),
+        ColorSpace::BT2020(), ColorSpace::AdobeRGB(), ColorSpace::ProPhotoRGB(),
+        ColorSpace::ACES(),
+    };
+
+    // more values than a connector converts per pass, some out of range
+    std::vector<float3> values;
+    for (int i = 0; i < 600; i++) {
+        values.push_back({i / 500.0f, 1.0f - i / 400.0f, (i % 7) / 6.0f});
+    }
+    std::vector<float3> out(values.size());
+
+    for (const auto& space : spaces) {
+        space.toLinear(values.data(), out.data(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(space.toLinear(values[i]), out[i])) << space.getName() << " " << i;
+        }
+
+        space.fromLinear(values.data(), out.data(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(space.fromLinear(values[i]), out[i])) << space.getName() << " " << i;
+        }
+
+        space.rgbToXYZ(values.data(), out.data(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(space.rgbToXYZ(values[i]), out[i])) << space.getName() << " " << i;
+        }
+
+        space.xyzToRGB(values.data(), out.data(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(space.xyzToRGB(values[i]), out[i])) << space.getName() << " " << i;
+        }
+
+        ColorSpaceConnector connector(space, ColorSpace::DisplayP3());
+        out = values;
+        connector.transform(out.data(), out.data(), out.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(connector.transform(values[i]), out[i]))
+                    << space.getName() << " " << i;
+        }
+
+        connector.transformLinear(values.data(), out.data(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            EXPECT_TRUE(isNear(connector.transformLinear(values[i]), out[i]))
+                    << space.getName() << " " << i;
+        }
+    }
+}
+
 }; // namespace android
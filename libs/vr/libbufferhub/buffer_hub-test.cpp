@@ -7,8 +7,10 @@
 #include <sys/eventfd.h>
 #include <ui/DetachedBufferHandle.h>
 
+#include <atomic>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #define RETRY_EINTR(fnc_call)                 \
   ([&]() -> decltype(fnc_call) {              \
@@ -333,6 +335,42 @@ TEST_F(LibBufferHubTest, TestAsyncStateTransitions) {
   EXPECT_FALSE(invalid_fence.IsValid());
 }
 
+TEST_F(LibBufferHubTest, TestConcurrentAcquire) {
+  std::unique_ptr<BufferProducer> p = BufferProducer::Create(
+      kWidth, kHeight, kFormat, kUsage, sizeof(uint64_t));
+  ASSERT_TRUE(p.get() != nullptr);
+  std::unique_ptr<BufferConsumer> c =
+      BufferConsumer::Import(p->CreateConsumer());
+  ASSERT_TRUE(c.get() != nullptr);
+
+  DvrNativeBufferMetadata metadata;
+  LocalHandle invalid_fence;
+  EXPECT_EQ(0, p->PostAsync(&metadata, invalid_fence));
+  EXPECT_LT(0, RETRY_EINTR(c->Poll(kPollTimeoutMs)));
+
+  // The state transition is a single atomic update, so only one of the threads
+  // racing to acquire the buffer may succeed.
+  const int kThreadCount = 4;
+  std::atomic<int> acquired{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreadCount; i++) {
+    threads.emplace_back([&c, &acquired]() {
+      DvrNativeBufferMetadata thread_metadata;
+      LocalHandle fence;
+      if (c->AcquireAsync(&thread_metadata, &fence) == 0)
+        acquired++;
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(1, acquired.load());
+  EXPECT_TRUE(IsBufferAcquired(p->buffer_state()));
+  EXPECT_EQ(0, c->ReleaseAsync(&metadata, invalid_fence));
+  EXPECT_LT(0, RETRY_EINTR(p->Poll(kPollTimeoutMs)));
+  EXPECT_TRUE(IsBufferReleased(p->buffer_state()));
+}
+
 TEST_F(LibBufferHubTest, TestZeroConsumer) {
   std::unique_ptr<BufferProducer> p = BufferProducer::Create(
       kWidth, kHeight, kFormat, kUsage, sizeof(uint64_t));
@@ -272,14 +272,19 @@ int BufferConsumer::LocalAcquire(DvrNativeBufferMetadata* out_meta,
 
   // Only check producer bit and this consumer buffer's particular consumer bit.
   // The buffer is can be acquired iff: 1) producer bit is set; 2) consumer bit
-  // is not set.
-  uint64_t buffer_state = buffer_state_->load();
-  if (!BufferHubDefs::IsBufferPosted(buffer_state, buffer_state_bit())) {
-    ALOGE("BufferConsumer::LocalAcquire: not posted, id=%d state=%" PRIx64
-          " buffer_state_bit=%" PRIx64 ".",
-          id(), buffer_state, buffer_state_bit());
-    return -EBUSY;
-  }
+  // is not set. Other consumers may set their bits concurrently, so retry until
+  // this consumer's bit is set or the buffer is no longer posted to it.
+  uint64_t buffer_state = buffer_state_->load(std::memory_order_acquire);
+  do {
+    if (!BufferHubDefs::IsBufferPosted(buffer_state, buffer_state_bit())) {
+      ALOGE("BufferConsumer::LocalAcquire: not posted, id=%d state=%" PRIx64
+            " buffer_state_bit=%" PRIx64 ".",
+            id(), buffer_state, buffer_state_bit());
+      return -EBUSY;
+    }
+  } while (!buffer_state_->compare_exchange_weak(
+      buffer_state, buffer_state | buffer_state_bit(),
+      std::memory_order_acq_rel, std::memory_order_acquire));
 
   // Copy the canonical metadata.
   void* metadata_ptr = reinterpret_cast<void*>(&metadata_header_->metadata);
@@ -297,9 +302,6 @@ int BufferConsumer::LocalAcquire(DvrNativeBufferMetadata* out_meta,
   if (fence_state & BufferHubDefs::kProducerStateBit) {
     *out_fence = shared_acquire_fence_.Duplicate();
   }
-
-  // Set the consumer bit unique to this consumer.
-  BufferHubDefs::ModifyBufferState(buffer_state_, 0ULL, buffer_state_bit());
   return 0;
 }
 
@@ -487,7 +489,7 @@ int BufferProducer::LocalPost(const DvrNativeBufferMetadata* meta,
     return error;
 
   // Check invalid state transition.
-  uint64_t buffer_state = buffer_state_->load();
+  uint64_t buffer_state = buffer_state_->load(std::memory_order_acquire);
   if (!BufferHubDefs::IsBufferGained(buffer_state)) {
     ALOGE("BufferProducer::LocalPost: not gained, id=%d state=%" PRIx64 ".",
           id(), buffer_state);
@@ -508,9 +510,15 @@ int BufferProducer::LocalPost(const DvrNativeBufferMetadata* meta,
   if (const int error = UpdateSharedFence(ready_fence, shared_acquire_fence_))
     return error;
 
-  // Set the producer bit atomically to transit into posted state.
-  BufferHubDefs::ModifyBufferState(buffer_state_, 0ULL,
-                                   BufferHubDefs::kProducerStateBit);
+  // Set the producer bit atomically to transit into posted state. The release
+  // ordering publishes the metadata written above to the consumers.
+  if (!buffer_state_->compare_exchange_strong(
+          buffer_state, BufferHubDefs::kProducerStateBit,
+          std::memory_order_acq_rel, std::memory_order_acquire)) {
+    ALOGE("BufferProducer::LocalPost: raced to post id=%d state=%" PRIx64 ".",
+          id(), buffer_state);
+    return -EBUSY;
+  }
   return 0;
 }
 
@@ -542,7 +550,7 @@ int BufferProducer::PostAsync(const DvrNativeBufferMetadata* meta,
 
 int BufferProducer::LocalGain(DvrNativeBufferMetadata* out_meta,
                               LocalHandle* out_fence) {
-  uint64_t buffer_state = buffer_state_->load();
+  uint64_t buffer_state = buffer_state_->load(std::memory_order_acquire);
   ALOGD_IF(TRACE, "BufferProducer::LocalGain: buffer=%d, state=%" PRIx64 ".",
            id(), buffer_state);
 
@@ -583,7 +591,13 @@ int BufferProducer::LocalGain(DvrNativeBufferMetadata* out_meta,
   }
 
   // Clear out all bits and the buffer is now back to gained state.
-  buffer_state_->store(0ULL);
+  if (!buffer_state_->compare_exchange_strong(buffer_state, 0ULL,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+    ALOGE("BufferProducer::LocalGain: raced to gain id=%d state=%" PRIx64 ".",
+          id(), buffer_state);
+    return -EBUSY;
+  }
   return 0;
 }
 
@@ -272,6 +272,9 @@ typedef int (*DvrPoseClientDataCapturePtr)(DvrPoseClient* client,
     const DvrPoseDataCaptureRequest* request);
 typedef int (*DvrPoseClientDataReaderDestroyPtr)(DvrPoseClient* client,
                                                  uint64_t data_type);
+typedef int (*DvrPoseClientPredictPtr)(DvrPoseClient* client,
+                                       const int64_t* timestamps_ns,
+                                       size_t count, DvrPose* out_poses);
 
 // dvr_pose.h
 typedef int (*DvrPoseClientGetDataReaderPtr)(DvrPoseClient* client,
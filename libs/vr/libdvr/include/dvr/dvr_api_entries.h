@@ -181,3 +181,4 @@ DVR_V1_API_ENTRY(ReadBufferQueueReleaseBuffer);
 DVR_V1_API_ENTRY(PoseClientGetDataReader);
 DVR_V1_API_ENTRY(PoseClientDataCapture);
 DVR_V1_API_ENTRY(PoseClientDataReaderDestroy);
+DVR_V1_API_ENTRY(PoseClientPredict);
@@ -1,11 +1,15 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
 #include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #include <pdx/rpc/argument_encoder.h>
@@ -403,6 +407,113 @@ class TestRunner {
   std::vector<TestEntry> tests_;
 };
 
+bool SendAll(int fd, const void* data, size_t size) {
+  auto* ptr = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t ret = TEMP_FAILURE_RETRY(send(fd, ptr, size, 0));
+    if (ret <= 0)
+      return false;
+    ptr += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+bool ReceiveAll(int fd, void* data, size_t size) {
+  auto* ptr = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t ret = TEMP_FAILURE_RETRY(recv(fd, ptr, size, 0));
+    if (ret <= 0)
+      return false;
+    ptr += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+// Round trip of a |size| byte payload between two threads, either copied
+// through a socket pair or through a shared mapping with only its length on
+// the socket. These are the two ways the UDS transport sends request data;
+// the size where the shared path starts winning is the threshold to use.
+std::chrono::nanoseconds TransferTest(size_t size, size_t iteration_count,
+                                      bool shared) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    std::cerr << "Failed to create socket pair: " << strerror(errno)
+              << std::endl;
+    exit(1);
+  }
+  void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    std::cerr << "Failed to map shared region: " << strerror(errno)
+              << std::endl;
+    exit(1);
+  }
+
+  std::vector<uint8_t> source(size, '*');
+  std::vector<uint8_t> destination(size);
+  std::thread receiver([&] {
+    for (size_t i = 0; i < iteration_count; i++) {
+      char ack = 0;
+      if (shared) {
+        uint64_t length = 0;
+        if (!ReceiveAll(fds[1], &length, sizeof(length)))
+          return;
+        memcpy(destination.data(), region, length);
+      } else if (!ReceiveAll(fds[1], destination.data(), size)) {
+        return;
+      }
+      if (!SendAll(fds[1], &ack, sizeof(ack)))
+        return;
+    }
+  });
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < iteration_count; i++) {
+    char ack = 0;
+    if (shared) {
+      uint64_t length = size;
+      memcpy(region, source.data(), size);
+      SendAll(fds[0], &length, sizeof(length));
+    } else {
+      SendAll(fds[0], source.data(), size);
+    }
+    ReceiveAll(fds[0], &ack, sizeof(ack));
+  }
+  auto stop = std::chrono::high_resolution_clock::now();
+
+  receiver.join();
+  munmap(region, size);
+  close(fds[0]);
+  close(fds[1]);
+  return stop - start;
+}
+
+void RunTransferTests(size_t iteration_count) {
+  using float_seconds = std::chrono::duration<double>;
+  const std::string separator(50, '=');
+  std::cout << separator << std::endl;
+  std::cout << "Transfer benchmarks (" << iteration_count << " iterations)"
+            << std::endl;
+  std::cout << separator << std::endl;
+  std::cout << std::setw(10) << "Size" << " | " << std::setw(10) << "Socket, s"
+            << " | " << std::setw(10) << "Shared, s" << " | " << std::setw(8)
+            << "Speedup" << std::endl;
+  for (size_t size : {1024, 4096, 16384, 32768, 65536, 262144, 1048576}) {
+    auto socket_seconds = std::chrono::duration_cast<float_seconds>(
+        TransferTest(size, iteration_count, false));
+    auto shared_seconds = std::chrono::duration_cast<float_seconds>(
+        TransferTest(size, iteration_count, true));
+    std::cout << std::setw(10) << size << " | " << std::fixed
+              << std::setprecision(3) << std::setw(10)
+              << socket_seconds.count() << " | " << std::setw(10)
+              << shared_seconds.count() << " | " << std::setw(8)
+              << socket_seconds.count() / shared_seconds.count() << std::endl;
+  }
+  std::cout << separator << std::endl;
+}
+
 std::string GenerateContainerName(const std::string& type, size_t count) {
   std::stringstream ss;
   ss << type << "(" << count << ")";
@@ -511,5 +622,9 @@ int main(int /*argc*/, char** /*argv*/) {
 
   // Finally, run all the tests.
   test_runner.RunTests(iteration_count, buffers);
+
+  // Compare copying large payloads through a socket with passing them in
+  // shared memory.
+  RunTransferTests(10000);
   return 0;
 }
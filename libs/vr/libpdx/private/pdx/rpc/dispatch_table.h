@@ -0,0 +1,198 @@
+#ifndef ANDROID_PDX_RPC_DISPATCH_TABLE_H_
+#define ANDROID_PDX_RPC_DISPATCH_TABLE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pdx/rpc/remote_method.h>
+#include <pdx/service.h>
+
+namespace android {
+namespace pdx {
+namespace rpc {
+
+// Evaluates to the class of a pointer to member type.
+template <typename T>
+struct MemberPointerClass;
+
+template <typename Member, typename Class>
+struct MemberPointerClass<Member Class::*> {
+  using Type = Class;
+};
+
+// Adapts a method of a service class to the handler signature used by
+// DispatchTable. |method| is a template argument so that every handler is a
+// plain function, which lets the table be an array of function pointers.
+template <typename RemoteMethodType, typename Method, Method method>
+struct DispatchEntry {
+  using Class = typename MemberPointerClass<Method>::Type;
+
+  static void Invoke(Class& instance, Message& message) {
+    DispatchRemoteMethod<RemoteMethodType>(instance, method, message);
+  }
+};
+
+// Builds a DispatchTable entry that dispatches |method_type| (a
+// PDX_REMOTE_METHOD) to the member function |method|.
+#define PDX_DISPATCH_METHOD(method_type, method)                            \
+  {                                                                         \
+    method_type::Opcode, #method_type,                                      \
+        &::android::pdx::rpc::DispatchEntry<method_type, decltype(method),  \
+                                            method>::Invoke                 \
+  }
+
+// Dispatches messages to the handlers of the remote methods a service
+// implements, looking them up by opcode. This replaces the switch statement of
+// DispatchRemoteMethod calls in HandleMessage:
+//
+//   dispatch_table_{
+//       PDX_DISPATCH_METHOD(MyRPC::Foo, &MyService::OnFoo),
+//       PDX_DISPATCH_METHOD(MyRPC::Bar, &MyService::OnBar),
+//   }
+//
+//   Status<void> MyService::HandleMessage(Message& message) {
+//     if (dispatch_table_.Dispatch(*this, message))
+//       return {};
+//     return Service::HandleMessage(message);
+//   }
+//
+// The table also records the number of calls and the time spent in the handler
+// of every method, see DumpStats().
+template <typename Class>
+class DispatchTable {
+ public:
+  using Handler = void (*)(Class& instance, Message& message);
+
+  struct Entry {
+    int opcode;
+    const char* name;
+    Handler handler;
+  };
+
+  struct MethodStats {
+    uint64_t calls{0};
+    std::chrono::nanoseconds total_time{0};
+    std::chrono::nanoseconds max_time{0};
+  };
+
+  DispatchTable(std::initializer_list<Entry> entries)
+      : entries_{entries}, stats_{new AtomicStats[entries.size()]} {
+    std::sort(
+        entries_.begin(), entries_.end(),
+        [](const Entry& a, const Entry& b) { return a.opcode < b.opcode; });
+    if (entries_.empty())
+      return;
+
+    // Opcodes of a remote API are usually a small range of enum values, so
+    // index them directly. Fall back to binary search for sparse opcodes.
+    min_opcode_ = entries_.front().opcode;
+    const int64_t span =
+        static_cast<int64_t>(entries_.back().opcode) - min_opcode_ + 1;
+    if (span <= kMaxDenseSpan) {
+      index_.assign(span, -1);
+      for (size_t i = 0; i < entries_.size(); i++)
+        index_[entries_[i].opcode - min_opcode_] = i;
+    }
+  }
+
+  // Dispatches |message| if its opcode is in the table. Returns false
+  // otherwise, leaving the message for the caller to handle.
+  bool Dispatch(Class& instance, Message& message) {
+    const int index = Find(message.GetOp());
+    if (index < 0)
+      return false;
+
+    const auto start = std::chrono::steady_clock::now();
+    entries_[index].handler(instance, message);
+    const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    AtomicStats& stats = stats_[index];
+    stats.calls.fetch_add(1, std::memory_order_relaxed);
+    stats.total_time.fetch_add(duration.count(), std::memory_order_relaxed);
+    int64_t max_time = stats.max_time.load(std::memory_order_relaxed);
+    while (duration.count() > max_time &&
+           !stats.max_time.compare_exchange_weak(max_time, duration.count(),
+                                                 std::memory_order_relaxed)) {
+    }
+    return true;
+  }
+
+  // Returns true if the table has a handler for |opcode|.
+  bool Contains(int opcode) const { return Find(opcode) >= 0; }
+
+  // Returns the call statistics of the method with |opcode|.
+  MethodStats GetStats(int opcode) const {
+    MethodStats method_stats;
+    const int index = Find(opcode);
+    if (index >= 0) {
+      const AtomicStats& stats = stats_[index];
+      method_stats.calls = stats.calls.load(std::memory_order_relaxed);
+      method_stats.total_time = std::chrono::nanoseconds(
+          stats.total_time.load(std::memory_order_relaxed));
+      method_stats.max_time = std::chrono::nanoseconds(
+          stats.max_time.load(std::memory_order_relaxed));
+    }
+    return method_stats;
+  }
+
+  // Returns one line per method that was called, for DumpState().
+  std::string DumpStats() const {
+    std::ostringstream stream;
+    for (const auto& entry : entries_) {
+      const MethodStats stats = GetStats(entry.opcode);
+      if (stats.calls == 0)
+        continue;
+      stream << entry.name << ": calls=" << stats.calls
+             << " avg_us=" << stats.total_time.count() / stats.calls / 1000
+             << " max_us=" << stats.max_time.count() / 1000 << std::endl;
+    }
+    return stream.str();
+  }
+
+ private:
+  enum : int64_t { kMaxDenseSpan = 256 };
+
+  struct AtomicStats {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<int64_t> total_time{0};
+    std::atomic<int64_t> max_time{0};
+  };
+
+  int Find(int opcode) const {
+    if (!index_.empty()) {
+      const int64_t offset = static_cast<int64_t>(opcode) - min_opcode_;
+      if (offset < 0 || offset >= static_cast<int64_t>(index_.size()))
+        return -1;
+      return index_[offset];
+    }
+
+    auto search = std::lower_bound(
+        entries_.begin(), entries_.end(), opcode,
+        [](const Entry& entry, int value) { return entry.opcode < value; });
+    if (search == entries_.end() || search->opcode != opcode)
+      return -1;
+    return search - entries_.begin();
+  }
+
+  std::vector<Entry> entries_;
+  std::unique_ptr<AtomicStats[]> stats_;
+  int min_opcode_{0};
+  std::vector<int> index_;
+
+  DispatchTable(const DispatchTable&) = delete;
+  void operator=(const DispatchTable&) = delete;
+};
+
+}  // namespace rpc
+}  // namespace pdx
+}  // namespace android
+
+#endif  // ANDROID_PDX_RPC_DISPATCH_TABLE_H_
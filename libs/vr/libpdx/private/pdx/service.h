@@ -615,6 +615,13 @@ class Service : public std::enable_shared_from_this<Service> {
    */
   Status<void> ReceiveAndDispatch();
 
+  /*
+   * Dispatches a message previously received on this Service instance's
+   * endpoint. ReceiveAndDispatch() is equivalent to receiving a message with
+   * endpoint()->MessageReceive() and passing it to this method.
+   */
+  Status<void> DispatchMessage(Message& message);
+
  private:
   friend class Message;
 
@@ -1,18 +1,22 @@
 #ifndef ANDROID_PDX_SERVICE_DISPATCHER_H_
 #define ANDROID_PDX_SERVICE_DISPATCHER_H_
 
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <pdx/file_handle.h>
+#include <pdx/service.h>
 
 namespace android {
 namespace pdx {
 
-class Service;
-
 /*
  * ServiceDispatcher manages a list of Service instances and handles message
  * reception and dispatch to the services. This makes repetitive dispatch tasks
@@ -68,6 +72,19 @@ class ServiceDispatcher {
    */
   int EnterDispatchLoop();
 
+  /*
+   * Starts |thread_count| threads that run the dispatch loop until the
+   * dispatcher is canceled or destroyed. Messages for different channels are
+   * handled in parallel by the threads in the pool, while messages for the
+   * same channel are handled one at a time, in the order they were received.
+   * The same ordering applies to threads entering the dispatcher through the
+   * methods above.
+   *
+   * Returns 0 on success; -EBUSY if the dispatcher is canceled or a thread
+   * pool is already running.
+   */
+  int StartThreadPool(size_t thread_count);
+
   /*
    * Sets the canceled state of the dispatcher. When canceled is true, any
    * threads blocked waiting for messages will return. This method waits until
@@ -87,6 +104,22 @@ class ServiceDispatcher {
   int ThreadEnter();
   void ThreadExit();
 
+  // Receives one message from |service| and dispatches it, after any earlier
+  // messages for the same channel are handled.
+  void ReceiveAndDispatchService(Service* service);
+
+  // Messages received for a channel while another thread is handling one of
+  // its messages. The thread handling the channel drains the queue.
+  struct ChannelQueue {
+    std::deque<Message> pending;
+  };
+  using ChannelKey = std::pair<Service*, int>;
+
+  std::mutex channel_mutex_;
+  std::map<ChannelKey, ChannelQueue> busy_channels_;
+
+  std::vector<std::thread> pool_threads_;
+
   std::mutex mutex_;
   std::condition_variable condition_;
   std::atomic<bool> canceled_{false};
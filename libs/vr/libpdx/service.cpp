@@ -656,6 +656,10 @@ Status<void> Service::ReceiveAndDispatch() {
     return status;
   }
 
+  return DispatchMessage(message);
+}
+
+Status<void> Service::DispatchMessage(Message& message) {
   std::shared_ptr<Service> service = message.GetService();
 
   if (!service) {
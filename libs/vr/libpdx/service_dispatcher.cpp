@@ -50,7 +50,12 @@ ServiceDispatcher::ServiceDispatcher() {
   }
 }
 
-ServiceDispatcher::~ServiceDispatcher() { SetCanceled(true); }
+ServiceDispatcher::~ServiceDispatcher() {
+  SetCanceled(true);
+
+  for (auto& thread : pool_threads_)
+    thread.join();
+}
 
 int ServiceDispatcher::ThreadEnter() {
   std::lock_guard<std::mutex> autolock(mutex_);
@@ -131,7 +136,7 @@ int ServiceDispatcher::ReceiveAndDispatch(int timeout) {
 
       ALOGI_IF(TRACE, "Dispatching message: fd=%d\n",
                service->endpoint()->epoll_fd());
-      service->ReceiveAndDispatch();
+      ReceiveAndDispatchService(service);
     }
   }
 
@@ -163,7 +168,7 @@ int ServiceDispatcher::EnterDispatchLoop() {
 
         ALOGI_IF(TRACE, "Dispatching message: fd=%d\n",
                  service->endpoint()->epoll_fd());
-        service->ReceiveAndDispatch();
+        ReceiveAndDispatchService(service);
       }
     }
   }
@@ -172,6 +177,57 @@ int ServiceDispatcher::EnterDispatchLoop() {
   return 0;
 }
 
+int ServiceDispatcher::StartThreadPool(size_t thread_count) {
+  std::lock_guard<std::mutex> autolock(mutex_);
+
+  if (canceled_ || !pool_threads_.empty())
+    return -EBUSY;
+
+  for (size_t i = 0; i < thread_count; i++) {
+    pool_threads_.emplace_back([this] {
+      int ret = EnterDispatchLoop();
+      ALOGE_IF(ret < 0 && ret != -EBUSY,
+               "ServiceDispatcher: Dispatch thread exited because: %s\n",
+               strerror(-ret));
+    });
+  }
+  return 0;
+}
+
+void ServiceDispatcher::ReceiveAndDispatchService(Service* service) {
+  Message message;
+  const auto status = service->endpoint()->MessageReceive(&message);
+  if (!status) {
+    ALOGE("Failed to receive message: %s\n", status.GetErrorMessage().c_str());
+    return;
+  }
+
+  const ChannelKey key{service, message.GetChannelId()};
+  {
+    std::lock_guard<std::mutex> autolock(channel_mutex_);
+    auto search = busy_channels_.find(key);
+    if (search != busy_channels_.end()) {
+      search->second.pending.push_back(std::move(message));
+      return;
+    }
+    busy_channels_.emplace(key, ChannelQueue{});
+  }
+
+  // This thread now owns the channel until its queue is empty.
+  for (;;) {
+    service->DispatchMessage(message);
+
+    std::lock_guard<std::mutex> autolock(channel_mutex_);
+    auto& queue = busy_channels_[key];
+    if (queue.pending.empty()) {
+      busy_channels_.erase(key);
+      return;
+    }
+    message = std::move(queue.pending.front());
+    queue.pending.pop_front();
+  }
+}
+
 void ServiceDispatcher::SetCanceled(bool cancel) {
   std::unique_lock<std::mutex> lock(mutex_);
   canceled_ = cancel;
@@ -5,6 +5,7 @@
 
 #include <gmock/gmock.h>
 #include <pdx/mock_service_endpoint.h>
+#include <pdx/rpc/dispatch_table.h>
 
 using android::pdx::BorrowedChannelHandle;
 using android::pdx::BorrowedHandle;
@@ -21,6 +22,8 @@ using android::pdx::RemoteChannelHandle;
 using android::pdx::RemoteHandle;
 using android::pdx::Service;
 using android::pdx::Status;
+using android::pdx::rpc::DispatchTable;
+using android::pdx::rpc::Void;
 
 using testing::A;
 using testing::ByMove;
@@ -154,6 +157,32 @@ class ServiceMessageTest : public ServiceTest {
   std::unique_ptr<Message> message_;
 };
 
+struct TestMethods {
+  PDX_REMOTE_METHOD(GetValue, kTestOp, int(Void));
+  PDX_REMOTE_METHOD(GetOtherValue, kTestOp + 1000, int(Void));
+};
+
+class DispatchTestService {
+ public:
+  DispatchTestService()
+      : dispatch_table_{
+            PDX_DISPATCH_METHOD(TestMethods::GetValue,
+                                &DispatchTestService::OnGetValue),
+            PDX_DISPATCH_METHOD(TestMethods::GetOtherValue,
+                                &DispatchTestService::OnGetOtherValue),
+        } {}
+
+  DispatchTable<DispatchTestService>& dispatch_table() {
+    return dispatch_table_;
+  }
+
+ private:
+  int OnGetValue(Message& /*message*/) { return 42; }
+  int OnGetOtherValue(Message& /*message*/) { return 7; }
+
+  DispatchTable<DispatchTestService> dispatch_table_;
+};
+
 }  // anonymous namespace
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -333,6 +362,41 @@ TEST_F(ServiceTest, HandleMessageCustom) {
   EXPECT_TRUE(service_->Service::HandleMessage(message));
 }
 
+TEST_F(ServiceTest, DispatchTable) {
+  DispatchTestService dispatch_service;
+  auto& table = dispatch_service.dispatch_table();
+  EXPECT_TRUE(table.Contains(kTestOp));
+  EXPECT_TRUE(table.Contains(kTestOp + 1000));
+  EXPECT_FALSE(table.Contains(kTestOp + 1));
+
+  MessageInfo info;
+  SetupMessageInfoAndDefaultExpectations(&info, kTestOp);
+  Message message{info};
+
+  EXPECT_CALL(*endpoint(), MessageReply(&message, 42))
+      .WillOnce(Return(Status<void>{}));
+
+  EXPECT_TRUE(table.Dispatch(dispatch_service, message));
+  EXPECT_EQ(1u, table.GetStats(kTestOp).calls);
+  EXPECT_EQ(0u, table.GetStats(kTestOp + 1000).calls);
+  EXPECT_NE(std::string::npos, table.DumpStats().find("GetValue: calls=1"));
+}
+
+TEST_F(ServiceTest, DispatchTableUnknownOpcode) {
+  DispatchTestService dispatch_service;
+  auto& table = dispatch_service.dispatch_table();
+
+  MessageInfo info;
+  SetupMessageInfoAndDefaultExpectations(&info, kTestOp + 1);
+  Message message{info};
+
+  EXPECT_FALSE(table.Dispatch(dispatch_service, message));
+  EXPECT_EQ("", table.DumpStats());
+
+  ExpectDefaultHandleMessage();
+  EXPECT_TRUE(service_->Service::HandleMessage(message));
+}
+
 TEST_F(ServiceTest, ReplyMessageWithoutService) {
   MessageInfo info;
   SetupMessageInfo(&info, kTestOp);
@@ -86,16 +86,59 @@ Status<void> ReadAndDiscardData(const BorrowedHandle& socket_fd, size_t size) {
   return ErrorStatus(EIO);
 }
 
+// Makes sure |shared_data| can hold |send_len| bytes. A new region has to be
+// passed to the service again.
+bool ReserveSharedData(SharedDataRegion* shared_data, size_t send_len,
+                       bool* shared_data_sent) {
+  if (shared_data->size() >= send_len)
+    return true;
+
+  // Leave room to grow so that slowly growing payloads do not replace the
+  // region on every request.
+  *shared_data_sent = false;
+  auto status =
+      shared_data->Create(std::max(send_len, 2 * shared_data->size()));
+  ALOGW_IF(!status, "ReserveSharedData: Failed to create shared data: %s",
+           status.GetErrorMessage().c_str());
+  return status.ok();
+}
+
+Status<void> SendSharedRequest(const BorrowedHandle& socket_fd,
+                               TransactionState* transaction_state,
+                               const iovec* send_vector, size_t send_count,
+                               SharedDataRegion* shared_data,
+                               bool* shared_data_sent) {
+  auto* data = static_cast<uint8_t*>(shared_data->data());
+  for (size_t i = 0; i < send_count; i++) {
+    memcpy(data, send_vector[i].iov_base, send_vector[i].iov_len);
+    data += send_vector[i].iov_len;
+  }
+
+  auto& request = transaction_state->request;
+  request.send_data_shared = true;
+  if (!*shared_data_sent)
+    request.shared_data_fd = shared_data->fd();
+  auto status = SendData(socket_fd, request);
+  if (status)
+    *shared_data_sent = true;
+  return status;
+}
+
 Status<void> SendRequest(const BorrowedHandle& socket_fd,
                          TransactionState* transaction_state, int opcode,
                          const iovec* send_vector, size_t send_count,
-                         size_t max_recv_len) {
+                         size_t max_recv_len, SharedDataRegion* shared_data,
+                         bool* shared_data_sent) {
   size_t send_len = CountVectorSize(send_vector, send_count);
   InitRequest(&transaction_state->request, opcode, send_len, max_recv_len,
               false);
   if (send_len == 0) {
     send_vector = nullptr;
     send_count = 0;
+  } else if (send_len >= kSharedDataThreshold &&
+             ReserveSharedData(shared_data, send_len, shared_data_sent)) {
+    return SendSharedRequest(socket_fd, transaction_state, send_vector,
+                             send_count, shared_data, shared_data_sent);
   }
   return SendData(socket_fd, transaction_state->request, send_vector,
                   send_count);
@@ -105,11 +148,27 @@ Status<void> ReceiveResponse(const BorrowedHandle& socket_fd,
                              TransactionState* transaction_state,
                              const iovec* receive_vector, size_t receive_count,
                              size_t max_recv_len) {
-  auto status = ReceiveData(socket_fd, &transaction_state->response);
+  std::vector<uint8_t> inline_data;
+  auto status =
+      ReceiveData(socket_fd, &transaction_state->response, &inline_data);
   if (!status)
     return status;
 
-  if (transaction_state->response.recv_len > 0) {
+  const size_t recv_len = transaction_state->response.recv_len;
+  if (recv_len > 0 && inline_data.size() == recv_len) {
+    // Small payloads arrive together with the header.
+    const uint8_t* data = inline_data.data();
+    size_t size_remaining = recv_len;
+    for (size_t i = 0; i < receive_count && size_remaining > 0; i++) {
+      size_t size_to_copy = std::min(size_remaining, receive_vector[i].iov_len);
+      memcpy(receive_vector[i].iov_base, data, size_to_copy);
+      data += size_to_copy;
+      size_remaining -= size_to_copy;
+    }
+    // As below, more data than the caller's buffers can hold is an error.
+    if (size_remaining > 0)
+      status.SetError(EIO);
+  } else if (recv_len > 0) {
     std::vector<iovec> read_buffers;
     size_t size_remaining = 0;
     if (transaction_state->response.recv_len != max_recv_len) {
@@ -192,7 +251,8 @@ Status<int> ClientChannel::SendAndReceive(void* transaction_state, int opcode,
   size_t max_recv_len = CountVectorSize(receive_vector, receive_count);
 
   auto status = SendRequest(BorrowedHandle{channel_handle_.value()}, state,
-                            opcode, send_vector, send_count, max_recv_len);
+                            opcode, send_vector, send_count, max_recv_len,
+                            &shared_data_, &shared_data_sent_);
   if (status) {
     status = ReceiveResponse(BorrowedHandle{channel_handle_.value()}, state,
                              receive_vector, receive_count, max_recv_len);
@@ -1,11 +1,13 @@
 #include "uds/ipc_helper.h"
 
 #include <alloca.h>
+#include <cutils/ashmem.h>
 #include <errno.h>
 #include <log/log.h>
 #include <poll.h>
 #include <string.h>
 #include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 
@@ -171,6 +173,8 @@ struct MessagePreamble {
   uint32_t magic{0};
   uint32_t data_size{0};
   uint32_t fd_count{0};
+  // Bytes following the payload that the receiver should read with it.
+  uint32_t inline_data_size{0};
 };
 
 Status<void> SendPayload::Send(const BorrowedHandle& socket_fd) {
@@ -193,6 +197,9 @@ Status<void> SendPayload::Send(const BorrowedHandle& socket_fd,
   preamble.magic = kMagicPreamble;
   preamble.data_size = buffer_.size();
   preamble.fd_count = file_handles_.size();
+  const size_t data_size = CountVectorSize(data_vec, vec_count);
+  if (data_size <= kMaxInlineDataSize)
+    preamble.inline_data_size = data_size;
 
   msghdr msg = {};
   msg.msg_iovlen = 2 + vec_count;
@@ -302,7 +309,8 @@ Status<void> ReceivePayload::Receive(const BorrowedHandle& socket_fd,
     return ret;
   }
 
-  buffer_.resize(preamble.data_size);
+  buffer_.resize(preamble.data_size + preamble.inline_data_size);
+  payload_size_ = preamble.data_size;
   file_handles_.clear();
   read_pos_ = 0;
 
@@ -337,9 +345,14 @@ Status<void> ReceivePayload::Receive(const BorrowedHandle& socket_fd,
   return ret;
 }
 
+void ReceivePayload::TakeInlineData(std::vector<uint8_t>* data) {
+  data->assign(buffer_.begin() + payload_size_, buffer_.end());
+  buffer_.resize(payload_size_);
+}
+
 // MessageReader
 MessageReader::BufferSection ReceivePayload::GetNextReadBufferSection() {
-  return {buffer_.data() + read_pos_, &*buffer_.end()};
+  return {buffer_.data() + read_pos_, buffer_.data() + payload_size_};
 }
 
 void ReceivePayload::ConsumeReadBufferSectionData(const void* new_start) {
@@ -407,6 +420,55 @@ void InitRequest(android::pdx::uds::RequestHeader<BorrowedHandle>* request,
   request->send_len = send_len;
   request->max_recv_len = max_recv_len;
   request->is_impulse = is_impulse;
+  request->send_data_shared = false;
+  request->shared_data_fd = BorrowedHandle{};
+}
+
+SharedDataRegion::~SharedDataRegion() { Unmap(); }
+
+void SharedDataRegion::Unmap() {
+  if (data_)
+    munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+  fd_.Close();
+}
+
+Status<void> SharedDataRegion::Create(size_t size) {
+  Unmap();
+
+  const size_t page_size = getpagesize();
+  size = (size + page_size - 1) & ~(page_size - 1);
+  LocalHandle fd{ashmem_create_region("pdx-shared-data", size)};
+  if (!fd)
+    return ErrorStatus(errno);
+
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.Get(), 0);
+  if (data == MAP_FAILED)
+    return ErrorStatus(errno);
+
+  fd_ = std::move(fd);
+  data_ = data;
+  size_ = size;
+  return {};
+}
+
+Status<void> SharedDataRegion::Map(LocalHandle fd) {
+  Unmap();
+
+  const int size = ashmem_get_size_region(fd.Get());
+  if (size <= 0)
+    return ErrorStatus(EINVAL);
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.Get(), 0);
+  if (data == MAP_FAILED)
+    return ErrorStatus(errno);
+
+  fd_ = std::move(fd);
+  data_ = data;
+  size_ = size;
+  return {};
 }
 
 Status<void> WaitForEndpoint(const std::string& endpoint_path,
@@ -6,6 +6,7 @@
 #include <mutex>
 
 #include <uds/channel_event_set.h>
+#include <uds/ipc_helper.h>
 #include <uds/channel_manager.h>
 #include <uds/service_endpoint.h>
 
@@ -89,6 +90,11 @@ class ClientChannel : public pdx::ClientChannel {
   LocalChannelHandle channel_handle_;
   ChannelEventReceiver* channel_data_;
   std::mutex socket_mutex_;
+
+  // Protected by |socket_mutex_|. The region is reused for every large
+  // request, since transactions on a channel never overlap.
+  SharedDataRegion shared_data_;
+  bool shared_data_sent_{false};
 };
 
 }  // namespace uds
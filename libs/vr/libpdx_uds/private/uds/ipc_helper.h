@@ -5,6 +5,7 @@
 #include <utility>
 #include <vector>
 
+#include <pdx/file_handle.h>
 #include <pdx/rpc/serializable.h>
 #include <pdx/rpc/serialization.h>
 #include <pdx/status.h>
@@ -14,6 +15,45 @@ namespace android {
 namespace pdx {
 namespace uds {
 
+// Requests with at least this many bytes of payload are passed to the service
+// in a shared memory region instead of being copied through the socket. Run
+// pdx_encoder_performance_test to see where the crossover is on a device.
+constexpr size_t kSharedDataThreshold = 32 * 1024;
+
+// Data of up to this many bytes sent after a payload is announced in the
+// message preamble, letting the receiver read it together with the payload
+// instead of with a separate call.
+constexpr size_t kMaxInlineDataSize = 4096;
+
+// A shared memory region that a client channel reuses for every large request
+// it sends. The service maps it once per channel, when the client first
+// passes its file descriptor along with a request.
+class SharedDataRegion {
+ public:
+  SharedDataRegion() = default;
+  ~SharedDataRegion();
+
+  // Creates a writable region of at least |size| bytes.
+  Status<void> Create(size_t size);
+  // Maps the region behind |fd| for reading.
+  Status<void> Map(LocalHandle fd);
+
+  explicit operator bool() const { return data_ != nullptr; }
+  BorrowedHandle fd() const { return fd_.Borrow(); }
+  void* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  void Unmap();
+
+  LocalHandle fd_;
+  void* data_{nullptr};
+  size_t size_{0};
+
+  SharedDataRegion(const SharedDataRegion&) = delete;
+  void operator=(const SharedDataRegion&) = delete;
+};
+
 // Test interfaces used for unit-testing payload sending/receiving over sockets.
 class SendInterface {
  public:
@@ -99,9 +139,13 @@ class ReceivePayload : public MessageReader, public InputResourceMapper {
   bool GetChannelHandle(ChannelReference ref,
                         LocalChannelHandle* handle) override;
 
+  // Moves out the data that the sender inlined after the payload, if any.
+  void TakeInlineData(std::vector<uint8_t>* data);
+
  private:
   RecvInterface* receiver_;
   ByteBuffer buffer_;
+  size_t payload_size_{0};
   std::vector<LocalHandle> file_handles_;
   size_t read_pos_{0};
 };
@@ -138,11 +182,16 @@ class RequestHeader {
   std::vector<ChannelInfo<FileHandleType>> channels;
   std::array<uint8_t, 32> impulse_payload;
   bool is_impulse{false};
+  // When set, the |send_len| bytes of payload are in the channel's shared
+  // data region rather than following the header on the socket.
+  bool send_data_shared{false};
+  // Set when the client replaces the channel's shared data region.
+  FileHandleType shared_data_fd;
 
  private:
   PDX_SERIALIZABLE_MEMBERS(RequestHeader, op, send_len, max_recv_len,
                            file_descriptors, channels, impulse_payload,
-                           is_impulse);
+                           is_impulse, send_data_shared, shared_data_fd);
 };
 
 template <typename FileHandleType>
@@ -191,13 +240,28 @@ inline Status<void> ReceiveData(const BorrowedHandle& socket_fd, T* data) {
   return status;
 }
 
+template <typename T>
+inline Status<void> ReceiveData(const BorrowedHandle& socket_fd, T* data,
+                                std::vector<uint8_t>* inline_data) {
+  ReceivePayload payload;
+  Status<void> status = payload.Receive(socket_fd);
+  if (status && rpc::Deserialize(data, &payload) != rpc::ErrorCode::NO_ERROR)
+    status.SetError(EIO);
+  if (status)
+    payload.TakeInlineData(inline_data);
+  return status;
+}
+
 template <typename FileHandleType>
 inline Status<void> ReceiveData(const BorrowedHandle& socket_fd,
-                                RequestHeader<FileHandleType>* request) {
+                                RequestHeader<FileHandleType>* request,
+                                std::vector<uint8_t>* inline_data = nullptr) {
   ReceivePayload payload;
   Status<void> status = payload.Receive(socket_fd, &request->cred);
   if (status && rpc::Deserialize(request, &payload) != rpc::ErrorCode::NO_ERROR)
     status.SetError(EIO);
+  if (status && inline_data)
+    payload.TakeInlineData(inline_data);
   return status;
 }
 
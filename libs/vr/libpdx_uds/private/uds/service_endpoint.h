@@ -13,6 +13,7 @@
 #include <pdx/service.h>
 #include <pdx/service_endpoint.h>
 #include <uds/channel_event_set.h>
+#include <uds/ipc_helper.h>
 
 namespace android {
 namespace pdx {
@@ -112,6 +113,8 @@ class Endpoint : public pdx::Endpoint {
     LocalHandle data_fd;
     ChannelEventSet event_set;
     Channel* channel_state{nullptr};
+    // The region the client passes large request payloads in, if any.
+    std::shared_ptr<SharedDataRegion> shared_data;
   };
 
   // This class must be instantiated using Create() static methods above.
@@ -138,6 +141,9 @@ class Endpoint : public pdx::Endpoint {
       LocalHandle channel_fd, Channel* channel_state);
   Status<void> CloseChannelLocked(int32_t channel_id);
   Status<void> ReenableEpollEvent(const BorrowedHandle& channel_fd);
+  Status<std::shared_ptr<SharedDataRegion>> GetSharedData(int32_t channel_id,
+                                                          LocalHandle fd,
+                                                          size_t size);
   Channel* GetChannelState(int32_t channel_id);
   BorrowedHandle GetChannelSocketFd(int32_t channel_id);
   Status<std::pair<BorrowedHandle, BorrowedHandle>> GetChannelEventFd(
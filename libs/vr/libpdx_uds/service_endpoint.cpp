@@ -104,12 +104,18 @@ struct MessageState {
   }
 
   Status<size_t> ReadData(const iovec* vector, size_t vector_length) {
-    size_t size_remaining = request_data.size() - request_data_read_pos;
+    const uint8_t* data = request_data.data();
+    size_t data_size = request_data.size();
+    if (shared_request_data) {
+      data = static_cast<const uint8_t*>(shared_request_data->data());
+      data_size = request.send_len;
+    }
+
+    size_t size_remaining = data_size - request_data_read_pos;
     size_t size = 0;
     for (size_t i = 0; i < vector_length && size_remaining > 0; i++) {
       size_t size_to_copy = std::min(size_remaining, vector[i].iov_len);
-      memcpy(vector[i].iov_base, request_data.data() + request_data_read_pos,
-             size_to_copy);
+      memcpy(vector[i].iov_base, data + request_data_read_pos, size_to_copy);
       size += size_to_copy;
       request_data_read_pos += size_to_copy;
       size_remaining -= size_to_copy;
@@ -121,6 +127,8 @@ struct MessageState {
   android::pdx::uds::ResponseHeader<BorrowedHandle> response;
   std::vector<LocalHandle> sockets_to_close;
   std::vector<uint8_t> request_data;
+  // Holds the payload instead of |request_data| for large requests.
+  std::shared_ptr<android::pdx::uds::SharedDataRegion> shared_request_data;
   size_t request_data_read_pos{0};
   std::vector<uint8_t> response_data;
 };
@@ -306,6 +314,34 @@ Status<std::pair<int32_t, Endpoint::ChannelData*>> Endpoint::OnNewChannelLocked(
   }
 }
 
+Status<std::shared_ptr<SharedDataRegion>> Endpoint::GetSharedData(
+    int32_t channel_id, LocalHandle fd, size_t size) {
+  std::lock_guard<std::mutex> autolock(channel_mutex_);
+  auto channel_data = channels_.find(channel_id);
+  if (channel_data == channels_.end())
+    return ErrorStatus{EINVAL};
+
+  auto& shared_data = channel_data->second.shared_data;
+  if (fd) {
+    // Messages still reading from the previous region keep it mapped.
+    auto region = std::make_shared<SharedDataRegion>();
+    auto status = region->Map(std::move(fd));
+    if (!status) {
+      ALOGE("Endpoint::GetSharedData: Failed to map shared data: %s",
+            status.GetErrorMessage().c_str());
+      return status.error_status();
+    }
+    shared_data = std::move(region);
+  }
+
+  if (!shared_data || shared_data->size() < size) {
+    ALOGE("Endpoint::GetSharedData: No shared data for %zu bytes on channel %d",
+          size, channel_id);
+    return ErrorStatus{EIO};
+  }
+  return shared_data;
+}
+
 Status<void> Endpoint::ReenableEpollEvent(const BorrowedHandle& fd) {
   epoll_event event;
   event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
@@ -498,7 +534,8 @@ Status<void> Endpoint::ReceiveMessageForChannel(
     const BorrowedHandle& channel_fd, Message* message) {
   RequestHeader<LocalHandle> request;
   int32_t channel_id = GetChannelId(channel_fd);
-  auto status = ReceiveData(channel_fd.Borrow(), &request);
+  std::vector<uint8_t> inline_data;
+  auto status = ReceiveData(channel_fd.Borrow(), &request, &inline_data);
   if (!status) {
     if (status.error() == ESHUTDOWN) {
       BuildCloseMessage(channel_id, message);
@@ -532,10 +569,23 @@ Status<void> Endpoint::ReceiveMessageForChannel(
   *message = Message{info};
   auto* state = static_cast<MessageState*>(message->GetState());
   state->request = std::move(request);
-  if (request.send_len > 0 && !request.is_impulse) {
-    state->request_data.resize(request.send_len);
-    status = ReceiveData(channel_fd, state->request_data.data(),
-                         state->request_data.size());
+  if (state->request.send_data_shared) {
+    auto shared_data =
+        GetSharedData(channel_id, std::move(state->request.shared_data_fd),
+                      state->request.send_len);
+    if (shared_data)
+      state->shared_request_data = shared_data.take();
+    else
+      status = shared_data.error_status();
+  } else if (request.send_len > 0 && !request.is_impulse) {
+    if (inline_data.size() == request.send_len) {
+      // Small payloads arrive together with the header.
+      state->request_data = std::move(inline_data);
+    } else {
+      state->request_data.resize(request.send_len);
+      status = ReceiveData(channel_fd, state->request_data.data(),
+                           state->request_data.size());
+    }
   }
 
   if (status && request.is_impulse)
@@ -642,11 +692,11 @@ Status<void> Endpoint::MessageReply(Message* message, int return_code) {
 
   state->response.ret_code = return_code;
   state->response.recv_len = state->response_data.size();
-  auto status = SendData(channel_socket, state->response);
-  if (status && !state->response_data.empty()) {
-    status = SendData(channel_socket, state->response_data.data(),
-                      state->response_data.size());
-  }
+  // Send the header and the payload with a single call.
+  iovec response_vec = {state->response_data.data(),
+                        state->response_data.size()};
+  auto status = SendData(channel_socket, state->response, &response_vec,
+                         state->response_data.empty() ? 0 : 1);
 
   if (status)
     status = ReenableEpollEvent(channel_socket);
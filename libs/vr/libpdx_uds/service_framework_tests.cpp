@@ -11,6 +11,7 @@
 #include <numeric>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <pdx/channel_handle.h>
@@ -695,6 +696,39 @@ TEST_F(ServiceFrameworkTest, LargeDataSum) {
   ASSERT_EQ(expected_sum, sum);
 }
 
+TEST_F(ServiceFrameworkTest, ThreadPool) {
+  // Create a test service and add it to the dispatcher.
+  auto service = TestService::Create(kTestService1);
+  ASSERT_NE(nullptr, service);
+  ASSERT_EQ(0, dispatcher_->AddService(service));
+  ASSERT_EQ(0, dispatcher_->StartThreadPool(3));
+  EXPECT_EQ(-EBUSY, dispatcher_->StartThreadPool(3));
+
+  auto data_array = std::make_unique<std::array<int, kLargeDataSize>>();
+  std::iota(data_array->begin(), data_array->end(), 0);
+  int expected_sum = std::accumulate(data_array->begin(), data_array->end(), 0);
+
+  // Several clients talking to the service at once.
+  const int kClientCount = 4;
+  std::atomic<int> correct_sums{0};
+  std::vector<std::thread> client_threads;
+  for (int i = 0; i < kClientCount; i++) {
+    client_threads.emplace_back([&] {
+      auto client = TestClient::Create(kTestService1);
+      if (!client)
+        return;
+      for (int j = 0; j < 10; j++) {
+        if (client->SendLargeDataReturnSum(*data_array) == expected_sum)
+          correct_sums++;
+      }
+    });
+  }
+  for (auto& thread : client_threads)
+    thread.join();
+
+  EXPECT_EQ(kClientCount * 10, correct_sums);
+}
+
 TEST_F(ServiceFrameworkTest, Cancel) {
   // Create a test service and add it to the dispatcher.
   auto service = TestService::Create(kTestService1, nullptr, true);
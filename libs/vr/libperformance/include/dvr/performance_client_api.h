@@ -2,6 +2,7 @@
 #define ANDROID_DVR_PERFORMANCE_CLIENT_API_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #ifdef __cplusplus
@@ -66,6 +67,20 @@ int dvrSetSchedulerClass(pid_t task_id, const char* scheduler_class);
 /// @returns Returns 0 on success or a negative errno error code on error.
 int dvrGetCpuPartition(pid_t task_id, char* partition, size_t size);
 
+/// Reports frame deadline results for a task.
+///
+/// When adaptive placement is enabled in performanced, tasks that miss frame
+/// deadlines are moved to more capable CPU partitions and given a higher
+/// minimum CPU utilization, and are moved back once they keep up again.
+/// Reporting several frames per call keeps the RPC rate low.
+///
+/// @param task_id The task id of the task that produced the frames. When
+/// task_id is 0 the current task id is substituted.
+/// @param frames Number of frames finished since the last report.
+/// @param missed Number of those frames that missed their deadline.
+/// @returns Returns 0 on success or a negative errno error code on error.
+int dvrReportFrameDeadlines(pid_t task_id, uint32_t frames, uint32_t missed);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
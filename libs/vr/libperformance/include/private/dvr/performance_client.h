@@ -4,6 +4,7 @@
 #include <sys/types.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <tuple>
 
@@ -25,6 +26,8 @@ class PerformanceClient : public pdx::ClientBase<PerformanceClient> {
   int GetCpuPartition(pid_t task_id, std::string* partition_out);
   int GetCpuPartition(pid_t task_id, char* partition_out, std::size_t size);
 
+  int ReportFrameDeadlines(pid_t task_id, uint32_t frames, uint32_t missed);
+
  private:
   friend BASE;
 
@@ -1,6 +1,7 @@
 #ifndef ANDROID_DVR_PERFORMANCE_RPC_H_
 #define ANDROID_DVR_PERFORMANCE_RPC_H_
 
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <string>
@@ -22,6 +23,7 @@ struct PerformanceRPC {
     kOpSetSchedulerClass,
     kOpGetCpuPartition,
     kOpSetSchedulerPolicy,
+    kOpReportFrameDeadlines,
   };
 
   // Methods.
@@ -32,6 +34,8 @@ struct PerformanceRPC {
   PDX_REMOTE_METHOD(GetCpuPartition, kOpGetCpuPartition, std::string(pid_t));
   PDX_REMOTE_METHOD(SetSchedulerPolicy, kOpSetSchedulerPolicy,
                     void(pid_t, const std::string&));
+  PDX_REMOTE_METHOD(ReportFrameDeadlines, kOpReportFrameDeadlines,
+                    void(pid_t, uint32_t, uint32_t));
 };
 
 }  // namespace dvr
@@ -110,6 +110,16 @@ int PerformanceClient::GetCpuPartition(pid_t task_id, char* partition_out,
   return 0;
 }
 
+int PerformanceClient::ReportFrameDeadlines(pid_t task_id, uint32_t frames,
+                                            uint32_t missed) {
+  if (task_id == 0)
+    task_id = gettid();
+
+  return ReturnStatusOrError(
+      InvokeRemoteMethod<PerformanceRPC::ReportFrameDeadlines>(task_id, frames,
+                                                               missed));
+}
+
 }  // namespace dvr
 }  // namespace android
 
@@ -146,3 +156,12 @@ extern "C" int dvrGetCpuPartition(pid_t task_id, char* partition, size_t size) {
   else
     return error;
 }
+
+extern "C" int dvrReportFrameDeadlines(pid_t task_id, uint32_t frames,
+                                       uint32_t missed) {
+  int error;
+  if (auto client = android::dvr::PerformanceClient::Create(&error))
+    return client->ReportFrameDeadlines(task_id, frames, missed);
+  else
+    return error;
+}
@@ -24,7 +24,6 @@ using android::pdx::ErrorStatus;
 using android::pdx::Message;
 using android::pdx::Status;
 using android::pdx::default_transport::Endpoint;
-using android::pdx::rpc::DispatchRemoteMethod;
 
 namespace {
 
@@ -41,7 +40,23 @@ DisplayService::DisplayService(Hwc2::Composer* hidl,
                                hwc2_display_t primary_display_id,
                                RequestDisplayCallback request_display_callback)
     : BASE("DisplayService",
-           Endpoint::Create(display::DisplayProtocol::kClientPath)) {
+           Endpoint::Create(display::DisplayProtocol::kClientPath)),
+      dispatch_table_{
+          PDX_DISPATCH_METHOD(DisplayProtocol::GetMetrics,
+                              &DisplayService::OnGetMetrics),
+          PDX_DISPATCH_METHOD(DisplayProtocol::GetConfigurationData,
+                              &DisplayService::OnGetConfigurationData),
+          PDX_DISPATCH_METHOD(DisplayProtocol::CreateSurface,
+                              &DisplayService::OnCreateSurface),
+          PDX_DISPATCH_METHOD(DisplayProtocol::SetupGlobalBuffer,
+                              &DisplayService::OnSetupGlobalBuffer),
+          PDX_DISPATCH_METHOD(DisplayProtocol::DeleteGlobalBuffer,
+                              &DisplayService::OnDeleteGlobalBuffer),
+          PDX_DISPATCH_METHOD(DisplayProtocol::GetGlobalBuffer,
+                              &DisplayService::OnGetGlobalBuffer),
+          PDX_DISPATCH_METHOD(DisplayProtocol::IsVrAppRunning,
+                              &DisplayService::IsVrAppRunning),
+      } {
     hardware_composer_.Initialize(
         hidl, primary_display_id, request_display_callback);
 }
@@ -109,6 +124,10 @@ std::string DisplayService::DumpState(size_t /*max_length*/) {
   stream << std::endl;
 
   stream << hardware_composer_.Dump();
+  stream << std::endl;
+
+  stream << "Methods:" << std::endl;
+  stream << dispatch_table_.DumpStats();
   return stream.str();
 }
 
@@ -128,42 +147,10 @@ Status<void> DisplayService::HandleMessage(pdx::Message& message) {
   ALOGD_IF(TRACE, "DisplayService::HandleMessage: opcode=%d", message.GetOp());
   ATRACE_NAME("DisplayService::HandleMessage");
 
-  switch (message.GetOp()) {
-    case DisplayProtocol::GetMetrics::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::GetMetrics>(
-          *this, &DisplayService::OnGetMetrics, message);
-      return {};
-
-    case DisplayProtocol::GetConfigurationData::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::GetConfigurationData>(
-          *this, &DisplayService::OnGetConfigurationData, message);
-      return {};
-
-    case DisplayProtocol::CreateSurface::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::CreateSurface>(
-          *this, &DisplayService::OnCreateSurface, message);
-      return {};
-
-    case DisplayProtocol::SetupGlobalBuffer::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::SetupGlobalBuffer>(
-          *this, &DisplayService::OnSetupGlobalBuffer, message);
-      return {};
-
-    case DisplayProtocol::DeleteGlobalBuffer::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::DeleteGlobalBuffer>(
-          *this, &DisplayService::OnDeleteGlobalBuffer, message);
-      return {};
-
-    case DisplayProtocol::GetGlobalBuffer::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::GetGlobalBuffer>(
-          *this, &DisplayService::OnGetGlobalBuffer, message);
-      return {};
-
-    case DisplayProtocol::IsVrAppRunning::Opcode:
-      DispatchRemoteMethod<DisplayProtocol::IsVrAppRunning>(
-          *this, &DisplayService::IsVrAppRunning, message);
-      return {};
+  if (dispatch_table_.Dispatch(*this, message))
+    return {};
 
+  switch (message.GetOp()) {
     // Direct the surface specific messages to the surface instance.
     case DisplayProtocol::SetAttributes::Opcode:
     case DisplayProtocol::CreateQueue::Opcode:
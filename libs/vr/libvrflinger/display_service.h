@@ -2,6 +2,7 @@
 #define ANDROID_DVR_SERVICES_DISPLAYD_DISPLAY_SERVICE_H_
 
 #include <dvr/dvr_api.h>
+#include <pdx/rpc/dispatch_table.h>
 #include <pdx/service.h>
 #include <pdx/status.h>
 #include <private/dvr/buffer_hub_client.h>
@@ -121,6 +122,8 @@ class DisplayService : public pdx::ServiceBase<DisplayService> {
   std::unordered_map<DvrGlobalBufferKey, std::unique_ptr<IonBuffer>>
       global_buffers_;
 
+  pdx::rpc::DispatchTable<DisplayService> dispatch_table_;
+
   DisplayService(const DisplayService&) = delete;
   void operator=(const DisplayService&) = delete;
 };
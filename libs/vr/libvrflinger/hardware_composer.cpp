@@ -52,6 +52,8 @@ const char kRightEyeOffsetProperty[] = "dvr.right_eye_offset_ns";
 
 const char kUseExternalDisplayProperty[] = "persist.vr.use_external_display";
 
+const char kAdaptivePostOffsetProperty[] = "dvr.adaptive_post_offset";
+
 // How long to wait after boot finishes before we turn the display off.
 constexpr int kBootFinishedDisplayOffTimeoutSec = 10;
 
@@ -61,6 +63,19 @@ constexpr int64_t kDefaultVsyncPeriodNs = 16666667;
 // Hardware composer reports dpi as dots per thousand inches (dpi * 1000).
 constexpr int kDefaultDpi = 400000;
 
+// Number of frames to record before the post offset is derived from them.
+constexpr size_t kMinPostOffsetFrames = 16;
+// Percentile of the recorded post durations to schedule the wakeup for.
+constexpr size_t kPostDurationPercentile = 95;
+// Bounds of the slack added to the post duration estimate, and how much it
+// shrinks for every frame that makes its vsync.
+constexpr int64_t kMinPostOffsetMarginNs = 1000000;
+constexpr int64_t kMaxPostOffsetMarginNs = 16000000;
+constexpr int64_t kPostOffsetMarginDecayNs = 10000;
+
+// Number of frames to batch into each frame deadline report to performanced.
+constexpr uint32_t kFrameDeadlineReportFrames = 30;
+
 // Get time offset from a vsync to when the pose for that vsync should be
 // predicted out to. For example, if scanout gets halfway through the frame
 // at the halfway point between vsyncs, then this could be half the period.
@@ -823,6 +838,14 @@ void HardwareComposer::PostThread() {
       last_vsync_timestamp_ = GetSystemClockNs();
       vsync_prediction_interval_ = 1;
       retire_fence_fds_.clear();
+
+      adaptive_post_offset_ =
+          property_get_bool(kAdaptivePostOffsetProperty, true);
+      post_offset_estimator_.Reset();
+
+      report_frame_deadlines_ = true;
+      unreported_frames_ = 0;
+      unreported_misses_ = 0;
     }
 
     int64_t vsync_timestamp = 0;
@@ -872,17 +895,25 @@ void HardwareComposer::PostThread() {
     if (vsync_callback_)
       vsync_callback_(vsync_timestamp, /*frame_time_estimate*/ 0, vsync_count_);
 
+    const int64_t display_time_est_ns =
+        vsync_timestamp + target_display_->vsync_period_ns;
     {
-      // Sleep until shortly before vsync.
+      // Sleep until shortly before vsync. With the adaptive offset the wakeup
+      // is as late as the recent post durations allow, so that PostLayers()
+      // latches the newest buffers of the surfaces.
       ATRACE_NAME("sleep");
 
-      const int64_t display_time_est_ns =
-          vsync_timestamp + target_display_->vsync_period_ns;
+      const int64_t post_offset_ns =
+          adaptive_post_offset_
+              ? post_offset_estimator_.GetPostOffset(
+                    post_thread_config_.frame_post_offset_ns)
+              : post_thread_config_.frame_post_offset_ns;
+      ATRACE_INT64("post_offset_ns", post_offset_ns);
+
       const int64_t now_ns = GetSystemClockNs();
-      const int64_t sleep_time_ns = display_time_est_ns - now_ns -
-                                    post_thread_config_.frame_post_offset_ns;
-      const int64_t wakeup_time_ns =
-          display_time_est_ns - post_thread_config_.frame_post_offset_ns;
+      const int64_t sleep_time_ns =
+          display_time_est_ns - now_ns - post_offset_ns;
+      const int64_t wakeup_time_ns = display_time_est_ns - post_offset_ns;
 
       ATRACE_INT64("sleep_time_ns", sleep_time_ns);
       if (sleep_time_ns > 0) {
@@ -897,6 +928,7 @@ void HardwareComposer::PostThread() {
       }
     }
 
+    const int64_t post_start_ns = GetSystemClockNs();
     {
       auto status = composer_callback_->GetVsyncTime(target_display_->id);
 
@@ -926,9 +958,81 @@ void HardwareComposer::PostThread() {
     }
 
     PostLayers(target_display_->id);
+
+    const int64_t post_end_ns = GetSystemClockNs();
+    const bool missed_vsync = post_end_ns > display_time_est_ns;
+    post_offset_estimator_.AddFrame(post_end_ns - post_start_ns, missed_vsync);
+    ReportFrameDeadline(missed_vsync);
   }
 }
 
+void HardwareComposer::ReportFrameDeadline(bool missed) {
+  if (!report_frame_deadlines_)
+    return;
+
+  unreported_frames_++;
+  if (missed)
+    unreported_misses_++;
+  if (unreported_frames_ < kFrameDeadlineReportFrames)
+    return;
+
+  if (!performance_client_)
+    performance_client_ = PerformanceClient::Create(nullptr);
+
+  // Drop the frames if performanced is not available; they only matter while
+  // the placement is being adapted.
+  if (performance_client_) {
+    const int error = performance_client_->ReportFrameDeadlines(
+        0, unreported_frames_, unreported_misses_);
+    if (error < 0) {
+      // Stop reporting until the post thread resumes, rather than sending a
+      // failing RPC every report period.
+      ALOGW(
+          "HardwareComposer::ReportFrameDeadline: Failed to report frame "
+          "deadlines: %s",
+          strerror(-error));
+      performance_client_.reset();
+      report_frame_deadlines_ = false;
+    }
+  }
+
+  unreported_frames_ = 0;
+  unreported_misses_ = 0;
+}
+
+void PostOffsetEstimator::Reset() {
+  frame_count_ = 0;
+  next_frame_ = 0;
+  margin_ns_ = kMinPostOffsetMarginNs;
+}
+
+void PostOffsetEstimator::AddFrame(int64_t post_duration_ns,
+                                   bool missed_vsync) {
+  post_durations_ns_[next_frame_] = post_duration_ns;
+  next_frame_ = (next_frame_ + 1) % kFrameCount;
+  if (frame_count_ < kFrameCount)
+    frame_count_++;
+
+  if (missed_vsync) {
+    margin_ns_ = std::min(margin_ns_ * 2, kMaxPostOffsetMarginNs);
+  } else {
+    margin_ns_ = std::max(margin_ns_ - kPostOffsetMarginDecayNs,
+                          kMinPostOffsetMarginNs);
+  }
+}
+
+int64_t PostOffsetEstimator::GetPostOffset(int64_t max_offset_ns) const {
+  if (frame_count_ < kMinPostOffsetFrames)
+    return max_offset_ns;
+
+  std::array<int64_t, kFrameCount> durations_ns = post_durations_ns_;
+  auto percentile = durations_ns.begin() +
+                    (frame_count_ - 1) * kPostDurationPercentile / 100;
+  std::nth_element(durations_ns.begin(), percentile,
+                   durations_ns.begin() + frame_count_);
+  return std::min(max_offset_ns, *percentile + margin_ns_);
+}
+
 bool HardwareComposer::UpdateTargetDisplay() {
   bool target_display_changed = false;
   auto displays = composer_callback_->GetDisplays();
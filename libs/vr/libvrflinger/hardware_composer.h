@@ -23,6 +23,7 @@
 #include <pdx/file_handle.h>
 #include <pdx/rpc/variant.h>
 #include <private/dvr/buffer_hub_client.h>
+#include <private/dvr/performance_client.h>
 #include <private/dvr/shared_buffer_helpers.h>
 
 #include "acquired_buffer.h"
@@ -290,6 +291,35 @@ class Layer {
   void operator=(const Layer&) = delete;
 };
 
+// Learns how long the post thread takes from waking up before vsync to handing
+// a frame to HWC, so that it can wake up as late as possible and latch the
+// newest buffers while still making the vsync.
+class PostOffsetEstimator {
+ public:
+  PostOffsetEstimator() { Reset(); }
+
+  // Forgets the recorded frames, e.g. when the target display changes.
+  void Reset();
+
+  // Records the time from waking up to presenting a frame, and whether the
+  // frame was presented too late for its vsync.
+  void AddFrame(int64_t post_duration_ns, bool missed_vsync);
+
+  // Returns how long before vsync to wake up. |max_offset_ns| is the
+  // configured offset, which is used until enough frames are recorded.
+  int64_t GetPostOffset(int64_t max_offset_ns) const;
+
+ private:
+  static constexpr size_t kFrameCount = 64;
+
+  std::array<int64_t, kFrameCount> post_durations_ns_;
+  size_t frame_count_;
+  size_t next_frame_;
+  // Slack added to the post duration estimate, which grows when frames miss
+  // their vsync and shrinks back while they do not.
+  int64_t margin_ns_;
+};
+
 // HardwareComposer encapsulates the hardware composer HAL, exposing a
 // simplified API to post buffers to the display.
 //
@@ -437,6 +467,10 @@ class HardwareComposer {
   // Called on the post thread to create the Composer instance.
   void CreateComposer();
 
+  // Counts a posted frame and periodically reports the frame deadline misses
+  // of the post thread to performanced. Called only from the post thread.
+  void ReportFrameDeadline(bool missed);
+
   // Called on the post thread when the post thread is resumed.
   void OnPostThreadResumed();
   // Called on the post thread when the post thread is paused or quits.
@@ -520,6 +554,18 @@ class HardwareComposer {
   // Counter tracking the number of skipped frames.
   int frame_skip_count_ = 0;
 
+  // Whether to schedule the post thread wakeup from the measured post
+  // durations instead of the fixed configured offset.
+  bool adaptive_post_offset_ = true;
+  PostOffsetEstimator post_offset_estimator_;
+
+  // Frame deadline results not yet reported to performanced, which adapts the
+  // placement of the post thread to them.
+  std::unique_ptr<PerformanceClient> performance_client_;
+  bool report_frame_deadlines_ = true;
+  uint32_t unreported_frames_ = 0;
+  uint32_t unreported_misses_ = 0;
+
   // Fd array for tracking retire fences that are returned by hwc. This allows
   // us to detect when the display driver begins queuing frames.
   std::vector<pdx::LocalHandle> retire_fence_fds_;
@@ -12,6 +12,7 @@ typedef struct float32x4x4_t { float32x4_t val[4]; } float32x4x4_t;
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <dvr/dvr_pose.h>
@@ -116,6 +117,21 @@ int dvrPoseClientLogController(DvrPoseClient* client, bool enable);
 // @return Zero on success, negative error code on failure.
 int dvrPoseClientPoll(DvrPoseClient* client, DvrPose* state);
 
+// Predicts the newest sensor pose for each of the given timestamps.
+//
+// The pose is read from the shared sensor pose ring without any IPC, like
+// dvrPoseClientPoll(), and extrapolated from its angular velocity, velocity
+// and acceleration. Predicting for several timestamps in one call, for
+// example the start and end of scanout, reuses the work shared between them.
+//
+// @param client Pointer to the pose client.
+// @param timestamps_ns Array of |count| CLOCK_MONOTONIC times to predict for.
+// @param count Number of timestamps.
+// @param out_poses Array of |count| structs to store the predicted poses.
+// @return Zero on success, negative error code on failure.
+int dvrPoseClientPredict(DvrPoseClient* client, const int64_t* timestamps_ns,
+                         size_t count, DvrPose* out_poses);
+
 // Freezes the pose to the provided state.
 //
 // Future poll operations will return this state until a different state is
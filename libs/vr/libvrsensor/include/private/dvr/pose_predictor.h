@@ -0,0 +1,24 @@
+#ifndef ANDROID_DVR_POSE_PREDICTOR_H_
+#define ANDROID_DVR_POSE_PREDICTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dvr/dvr_pose.h>
+
+namespace android {
+namespace dvr {
+
+// Extrapolates |pose| to each of the |count| times in |timestamps_ns|, storing
+// the results in |out_poses|. The orientation is rotated at the constant
+// angular velocity of |pose|, and the position is integrated from its velocity
+// and acceleration. The rate terms are computed once and the per timestamp
+// work is done on whole float32x4_t vectors, so predicting the poses of
+// several frames or eyes at once costs little more than one.
+void PredictPoses(const DvrPose& pose, const int64_t* timestamps_ns,
+                  size_t count, DvrPose* out_poses);
+
+}  // namespace dvr
+}  // namespace android
+
+#endif  // ANDROID_DVR_POSE_PREDICTOR_H_
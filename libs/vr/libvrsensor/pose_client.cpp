@@ -12,6 +12,7 @@
 #include <private/dvr/buffer_hub_queue_client.h>
 #include <private/dvr/display_client.h>
 #include <private/dvr/pose-ipc.h>
+#include <private/dvr/pose_predictor.h>
 #include <private/dvr/shared_buffer_helpers.h>
 
 using android::dvr::ConsumerQueue;
@@ -59,6 +60,22 @@ class PoseClient : public pdx::ClientBase<PoseClient> {
     return -EINVAL;
   }
 
+  // Predicts the newest sensor pose to each of |timestamps_ns|. Like Poll(),
+  // this only reads the shared broadcast ring.
+  int Predict(const int64_t* timestamps_ns, size_t count,
+              DvrPose* out_poses) {
+    if (!timestamps_ns || !out_poses)
+      return -EINVAL;
+
+    DvrPose state;
+    const int ret = Poll(&state);
+    if (ret < 0)
+      return ret;
+
+    PredictPoses(state, timestamps_ns, count, out_poses);
+    return 0;
+  }
+
   int GetPose(uint32_t vsync_count, DvrPoseAsync* out_pose) {
     const auto vsync_buffer = GetVsyncBuffer();
     if (vsync_buffer) {
@@ -340,6 +357,11 @@ int dvrPoseClientPoll(DvrPoseClient* client, DvrPose* state) {
   return PoseClient::FromC(client)->Poll(state);
 }
 
+int dvrPoseClientPredict(DvrPoseClient* client, const int64_t* timestamps_ns,
+                         size_t count, DvrPose* out_poses) {
+  return PoseClient::FromC(client)->Predict(timestamps_ns, count, out_poses);
+}
+
 int dvrPoseClientFreeze(DvrPoseClient* client, const DvrPose* frozen_state) {
   return PoseClient::FromC(client)->Freeze(*frozen_state);
 }
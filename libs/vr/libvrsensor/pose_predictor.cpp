@@ -0,0 +1,77 @@
+#include <private/dvr/pose_predictor.h>
+
+#include <cmath>
+
+namespace android {
+namespace dvr {
+
+namespace {
+
+// Below this rotation angle, in radians, sin(x) is replaced by x to avoid
+// dividing by a vanishing angular speed.
+constexpr float kSmallAngle = 1e-4f;
+
+float32x4_t Splat(float value) {
+  return float32x4_t{value, value, value, value};
+}
+
+// Returns the Hamilton product a * b of quaternions stored as x,y,z,w.
+float32x4_t QuatMultiply(float32x4_t a, float32x4_t b) {
+  const float32x4_t b_wzyx = {b[3], -b[2], b[1], -b[0]};
+  const float32x4_t b_zwxy = {b[2], b[3], -b[0], -b[1]};
+  const float32x4_t b_yxwz = {-b[1], b[0], b[3], -b[2]};
+  return Splat(a[3]) * b + Splat(a[0]) * b_wzyx + Splat(a[1]) * b_zwxy +
+         Splat(a[2]) * b_yxwz;
+}
+
+float32x4_t QuatNormalize(float32x4_t q) {
+  const float32x4_t squared = q * q;
+  const float norm =
+      std::sqrt(squared[0] + squared[1] + squared[2] + squared[3]);
+  return norm > 0.0f ? q * Splat(1.0f / norm) : q;
+}
+
+}  // anonymous namespace
+
+void PredictPoses(const DvrPose& pose, const int64_t* timestamps_ns,
+                  size_t count, DvrPose* out_poses) {
+  // The rotation axis and speed are shared by all the predictions.
+  float32x4_t axis = pose.angular_velocity;
+  axis[3] = 0.0f;
+  const float32x4_t squared = axis * axis;
+  const float speed = std::sqrt(squared[0] + squared[1] + squared[2]);
+  const float32x4_t half_acceleration = pose.acceleration * Splat(0.5f);
+
+  for (size_t i = 0; i < count; i++) {
+    const float dt = (timestamps_ns[i] - pose.timestamp_ns) * 1e-9f;
+    const float32x4_t dt4 = Splat(dt);
+    DvrPose& out = out_poses[i];
+    out = pose;
+    out.timestamp_ns = timestamps_ns[i];
+
+    // Rotate by speed * dt radians about the axis, after the current
+    // orientation.
+    const float half_angle = 0.5f * speed * dt;
+    float32x4_t delta;
+    if (std::fabs(half_angle) < kSmallAngle) {
+      delta = axis * Splat(0.5f * dt);
+    } else {
+      delta = axis * Splat(std::sin(half_angle) / speed);
+    }
+    delta[3] = std::cos(half_angle);
+    out.orientation = QuatNormalize(QuatMultiply(pose.orientation, delta));
+
+    // Integrate the position with constant acceleration. The pad lanes are
+    // left as they were.
+    const float32x4_t position =
+        pose.position + (pose.velocity + half_acceleration * dt4) * dt4;
+    const float32x4_t velocity = pose.velocity + pose.acceleration * dt4;
+    out.position = float32x4_t{position[0], position[1], position[2],
+                               pose.position[3]};
+    out.velocity = float32x4_t{velocity[0], velocity[1], velocity[2],
+                               pose.velocity[3]};
+  }
+}
+
+}  // namespace dvr
+}  // namespace android
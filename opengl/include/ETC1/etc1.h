@@ -22,6 +22,14 @@
 #define ETC1_RGB8_OES 0x8D64
 #endif
 
+// Encoder quality levels for etc1_encode_image_quality().
+// ETC1_QUALITY_HIGH searches all the block encodings, like etc1_encode_block.
+// ETC1_QUALITY_FAST only tries the most likely block orientation and stops
+// searching the modifier tables when the error increases. It is several times
+// faster, and is meant for textures compressed at runtime.
+#define ETC1_QUALITY_FAST 0
+#define ETC1_QUALITY_HIGH 1
+
 typedef unsigned char etc1_byte;
 typedef int etc1_bool;
 typedef unsigned int etc1_uint32;
@@ -67,6 +75,18 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut);
 
+// Encode an entire image with the given quality, on up to threadCount threads.
+// Same arguments as etc1_encode_image, which uses ETC1_QUALITY_HIGH.
+// quality is ETC1_QUALITY_FAST or ETC1_QUALITY_HIGH.
+// threadCount is the maximum number of threads to use, 0 for the number of CPUs.
+// Small images are encoded on fewer threads. The output does not depend on the
+// number of threads.
+// returns non-zero if there is an error.
+
+int etc1_encode_image_quality(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, int quality, etc1_uint32 threadCount);
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that
@@ -20,6 +20,7 @@ LOCAL_SRC_FILES:= \
 	matrix.cpp.arm		        \
 	mipmap.cpp.arm		        \
 	primitives.cpp.arm	        \
+	tiling.cpp		            \
 	vertex.cpp.arm
 
 LOCAL_CFLAGS += -DLOG_TAG=\"libagl\"
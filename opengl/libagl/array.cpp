@@ -963,21 +963,33 @@ void compileElement__generic(ogles_context_t* c,
 void compileElements__generic(ogles_context_t* c,
         vertex_t* v, GLint first, GLsizei count)
 {
+    // The batch is fetched, transformed and projected in separate passes:
+    // each pass calls a single function, and the transform handles all
+    // the vertices at once.
+    vertex_t* const batch = v;
     const GLubyte* vp = c->arrays.vertex.element(
             first & vertex_cache_t::INDEX_MASK);
     const size_t stride = c->arrays.vertex.stride;
-    transform_t const* const mvp = &c->transforms.mvp;
+    GLsizei n = count;
     do {
         v->flags = 0;
         v->index = first++;
         v->obj.z = 0;
         v->obj.w = 0x10000;
         c->arrays.vertex.fetch(c, v->obj.v, vp);
-        c->arrays.mvp_transform(mvp, &v->clip, &v->obj);
-        c->arrays.perspective(c, v);
         vp += stride;
         v++;
-    } while (--count);
+    } while (--n);
+
+    ogles_transform_vertices(&c->transforms.mvp, c->arrays.vertex.size,
+            batch, count);
+
+    v = batch;
+    n = count;
+    do {
+        c->arrays.perspective(c, v);
+        v++;
+    } while (--n);
 }
 
 /*
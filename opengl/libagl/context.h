@@ -44,6 +44,7 @@ const unsigned int OGLES_NUM_COMPRESSED_TEXTURE_FORMATS = 10
 class EGLTextureObject;
 class EGLSurfaceManager;
 class EGLBufferObjectManager;
+struct tiling_t;
 
 namespace gl {
 
@@ -629,6 +630,7 @@ struct ogles_context_t {
     uint32_t                transformTextures : 1;
     EGLSurfaceManager*      surfaceManager;
     EGLBufferObjectManager* bufferObjectManager;
+    tiling_t*               tiling;
 
     GLenum                  error;
 
@@ -25,6 +25,11 @@
 #include "vertex.h"
 #include "light.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OGLES_NEON_TRANSFORM 1
+#endif
+
 #if defined(__arm__) && defined(__thumb__)
 #warning "matrix.cpp should not be compiled in thumb on ARM."
 #endif
@@ -772,6 +777,112 @@ void point4__mvui(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
     lhs->w = rw;
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark matrix * vertices
+#endif
+
+#if OGLES_NEON_TRANSFORM
+
+// These compute the 4 coordinates of a vertex at once, with the same 64-bit
+// products and shifts as mla2a(), mla3a() and mla4(): the results are the
+// same as the pointN__generic() ones.
+
+static void points2__neon(const GLfixed* m, vertex_t* v, size_t count) {
+    const int32x4_t c0 = vld1q_s32(m + 0);
+    const int32x4_t c1 = vld1q_s32(m + 4);
+    const int32x4_t c3 = vld1q_s32(m + 12);
+    do {
+        const int32x2_t rx = vdup_n_s32(v->obj.x);
+        const int32x2_t ry = vdup_n_s32(v->obj.y);
+        int64x2_t lo = vmull_s32(vget_low_s32(c0), rx);
+        int64x2_t hi = vmull_s32(vget_high_s32(c0), rx);
+        lo = vmlal_s32(lo, vget_low_s32(c1), ry);
+        hi = vmlal_s32(hi, vget_high_s32(c1), ry);
+        const int32x4_t r = vcombine_s32(
+                vshrn_n_s64(lo, 16), vshrn_n_s64(hi, 16));
+        vst1q_s32(v->clip.v, vaddq_s32(r, c3));
+        v++;
+    } while (--count);
+}
+
+static void points3__neon(const GLfixed* m, vertex_t* v, size_t count) {
+    const int32x4_t c0 = vld1q_s32(m + 0);
+    const int32x4_t c1 = vld1q_s32(m + 4);
+    const int32x4_t c2 = vld1q_s32(m + 8);
+    const int32x4_t c3 = vld1q_s32(m + 12);
+    do {
+        const int32x2_t rx = vdup_n_s32(v->obj.x);
+        const int32x2_t ry = vdup_n_s32(v->obj.y);
+        const int32x2_t rz = vdup_n_s32(v->obj.z);
+        int64x2_t lo = vmull_s32(vget_low_s32(c0), rx);
+        int64x2_t hi = vmull_s32(vget_high_s32(c0), rx);
+        lo = vmlal_s32(lo, vget_low_s32(c1), ry);
+        hi = vmlal_s32(hi, vget_high_s32(c1), ry);
+        lo = vmlal_s32(lo, vget_low_s32(c2), rz);
+        hi = vmlal_s32(hi, vget_high_s32(c2), rz);
+        const int32x4_t r = vcombine_s32(
+                vshrn_n_s64(lo, 16), vshrn_n_s64(hi, 16));
+        vst1q_s32(v->clip.v, vaddq_s32(r, c3));
+        v++;
+    } while (--count);
+}
+
+static void points4__neon(const GLfixed* m, vertex_t* v, size_t count) {
+    const int32x4_t c0 = vld1q_s32(m + 0);
+    const int32x4_t c1 = vld1q_s32(m + 4);
+    const int32x4_t c2 = vld1q_s32(m + 8);
+    const int32x4_t c3 = vld1q_s32(m + 12);
+    do {
+        const int32x2_t rx = vdup_n_s32(v->obj.x);
+        const int32x2_t ry = vdup_n_s32(v->obj.y);
+        const int32x2_t rz = vdup_n_s32(v->obj.z);
+        const int32x2_t rw = vdup_n_s32(v->obj.w);
+        int64x2_t lo = vmull_s32(vget_low_s32(c0), rx);
+        int64x2_t hi = vmull_s32(vget_high_s32(c0), rx);
+        lo = vmlal_s32(lo, vget_low_s32(c1), ry);
+        hi = vmlal_s32(hi, vget_high_s32(c1), ry);
+        lo = vmlal_s32(lo, vget_low_s32(c2), rz);
+        hi = vmlal_s32(hi, vget_high_s32(c2), rz);
+        lo = vmlal_s32(lo, vget_low_s32(c3), rw);
+        hi = vmlal_s32(hi, vget_high_s32(c3), rw);
+        // mla4() rounds
+        vst1q_s32(v->clip.v, vcombine_s32(
+                vrshrn_n_s64(lo, 16), vrshrn_n_s64(hi, 16)));
+        v++;
+    } while (--count);
+}
+
+#endif
+
+void ogles_transform_vertices(transform_t const* mx, int size,
+        vertex_t* v, size_t count)
+{
+    if (!count)
+        return;
+    void (* const point)(transform_t const*, vec4_t*, vec4_t const*) =
+            mx->pointv[size - 2];
+#if OGLES_NEON_TRANSFORM
+    if (point == point2__generic) {
+        points2__neon(mx->matrix.m, v, count);
+        return;
+    }
+    if (point == point3__generic) {
+        points3__neon(mx->matrix.m, v, count);
+        return;
+    }
+    if (point == point4__generic) {
+        points4__neon(mx->matrix.m, v, count);
+        return;
+    }
+#endif
+    do {
+        point(mx, &v->clip, &v->obj);
+        v++;
+    } while (--count);
+}
+
 void point2__nop(transform_t const*, vec4_t* lhs, vec4_t const* rhs) {
     lhs->z = 0;
     lhs->w = 0x10000;
@@ -46,6 +46,11 @@ void ogles_scissor(ogles_context_t* c,
 void ogles_viewport(ogles_context_t* c,
         GLint x, GLint y, GLsizei w, GLsizei h);
 
+// Transforms the object coordinates of |count| consecutive vertices into
+// their clip coordinates, like mx->pointv[size-2] does for one vertex.
+void ogles_transform_vertices(transform_t const* mx, int size,
+        vertex_t* v, size_t count);
+
 inline void ogles_validate_transform(
         ogles_context_t* c, uint32_t want)
 {
@@ -25,6 +25,7 @@
 #include "matrix.h"
 #include "vertex.h"
 #include "fp.h"
+#include "tiling.h"
 #include "TextureObjectManager.h"
 
 extern "C" void iterators0032(const void* that,
@@ -626,7 +627,7 @@ void triangle(ogles_context_t* c,
     if (ggl_likely(enables & mask))
         lerp_triangle(c, v0, v1, v2);
 
-    c->rasterizer.procs.trianglex(c, v0->window.v, v1->window.v, v2->window.v);
+    ogles_tiled_trianglex(c, v0->window.v, v1->window.v, v2->window.v);
 }
 
 void lerp_triangle(ogles_context_t* c,
@@ -25,6 +25,7 @@
 #include "vertex.h"
 #include "light.h"
 #include "texture.h"
+#include "tiling.h"
 #include "BufferObjectManager.h"
 #include "TextureObjectManager.h"
 
@@ -87,6 +88,7 @@ ogles_context_t *ogles_init(size_t extra)
     ogles_init_vertex(c);
     ogles_init_light(c);
     ogles_init_texture(c);
+    ogles_init_tiling(c);
 
     c->rasterizer.base = base;
     c->point.size = TRI_ONE;
@@ -103,6 +105,7 @@ ogles_context_t *ogles_init(size_t extra)
 
 void ogles_uninit(ogles_context_t* c)
 {
+    ogles_uninit_tiling(c);
     ogles_uninit_array(c);
     ogles_uninit_matrix(c);
     ogles_uninit_vertex(c);
@@ -21,6 +21,7 @@
 #include "fp.h"
 #include "state.h"
 #include "texture.h"
+#include "tiling.h"
 #include "TextureObjectManager.h"
 
 #include <ETC1/etc1.h>
@@ -735,7 +736,7 @@ static void drawTexxOESImp(GLfixed x, GLfixed y, GLfixed z, GLfixed w, GLfixed h
     c->rasterizer.procs.disable(c, GGL_W_LERP);
     c->rasterizer.procs.disable(c, GGL_AA);
     c->rasterizer.procs.shadeModel(c, GL_FLAT);
-    c->rasterizer.procs.recti(c,
+    ogles_tiled_recti(c,
             gglFixedToIntRound(x),
             gglFixedToIntRound(y),
             gglFixedToIntRound(x)+w,
@@ -813,7 +814,7 @@ static void drawTexiOES(GLint x, GLint y, GLint z, GLint w, GLint h, ogles_conte
             c->rasterizer.procs.disable(c, GGL_W_LERP);
             c->rasterizer.procs.disable(c, GGL_AA);
             c->rasterizer.procs.shadeModel(c, GL_FLAT);
-            c->rasterizer.procs.recti(c, x, y, x+w, y+h);
+            ogles_tiled_recti(c, x, y, x+w, y+h);
 
             ogles_unlock_textures(c);
 
@@ -0,0 +1,266 @@
+/* libs/opengles/tiling.cpp
+**
+** Copyright 2018, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License"); 
+** you may not use this file except in compliance with the License. 
+** You may obtain a copy of the License at 
+**
+**     http://www.apache.org/licenses/LICENSE-2.0 
+**
+** Unless required by applicable law or agreed to in writing, software 
+** distributed under the License is distributed on an "AS IS" BASIS, 
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+** See the License for the specific language governing permissions and 
+** limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include "context.h"
+#include "tiling.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// Handing a band to a worker costs a copy of the rasterizer and a wake-up,
+// which only pays off for bands of at least this many rows.
+static const int MIN_ROWS_PER_BAND = 32;
+static const int MAX_WORKERS = 7;
+
+struct tiling_job_t {
+    enum { TRIANGLE, RECT } type;
+    const GGLcoord* v[3];
+    GGLint rect[4];
+};
+
+struct tiling_t;
+
+struct tiling_worker_t {
+    tiling_t*   tiling;
+    int         index;
+    pthread_t   thread;
+    // private copy of the rasterizer, with the scissor of the band
+    context_t*  rasterizer;
+    uint32_t    top;
+    uint32_t    bottom;
+};
+
+struct tiling_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+    tiling_job_t    job;
+    // bumped for every job, workers wait for it to change
+    uint32_t        generation;
+    int             activeWorkers;
+    int             pending;
+    bool            exit;
+    int             workerCount;
+    tiling_worker_t workers[MAX_WORKERS];
+};
+
+static void rasterize(context_t* r, const tiling_job_t& job,
+        uint32_t top, uint32_t bottom)
+{
+    const uint32_t savedTop = r->state.scissor.top;
+    const uint32_t savedBottom = r->state.scissor.bottom;
+    r->state.scissor.top = top;
+    r->state.scissor.bottom = bottom;
+    if (job.type == tiling_job_t::TRIANGLE) {
+        r->procs.trianglex(r, job.v[0], job.v[1], job.v[2]);
+    } else {
+        const GGLint t = max(job.rect[1], GGLint(top));
+        const GGLint b = min(job.rect[3], GGLint(bottom));
+        if (t < b)
+            r->procs.recti(r, job.rect[0], t, job.rect[2], b);
+    }
+    r->state.scissor.top = savedTop;
+    r->state.scissor.bottom = savedBottom;
+}
+
+static void* tiling_thread(void* arg)
+{
+    tiling_worker_t* w = static_cast<tiling_worker_t*>(arg);
+    tiling_t* t = w->tiling;
+    uint32_t generation = 0;
+    pthread_mutex_lock(&t->lock);
+    while (true) {
+        while (!t->exit && t->generation == generation)
+            pthread_cond_wait(&t->work, &t->lock);
+        if (t->exit)
+            break;
+        generation = t->generation;
+        if (w->index >= t->activeWorkers)
+            continue;
+        const tiling_job_t job = t->job;
+        pthread_mutex_unlock(&t->lock);
+        rasterize(w->rasterizer, job, w->top, w->bottom);
+        pthread_mutex_lock(&t->lock);
+        if (--t->pending == 0)
+            pthread_cond_signal(&t->done);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
+
+// Rasterizes the job in |bands| bands of the rows [top, bottom), the first one
+// on the calling thread. The rasterizer must be validated.
+static void dispatch(ogles_context_t* c, const tiling_job_t& job,
+        uint32_t top, uint32_t bottom, int bands)
+{
+    tiling_t* t = c->tiling;
+    const uint32_t rows = bottom - top;
+    pthread_mutex_lock(&t->lock);
+    for (int i=1 ; i<bands ; i++) {
+        tiling_worker_t& w = t->workers[i-1];
+        memcpy(w.rasterizer, &c->rasterizer, sizeof(context_t));
+        w.top = top + (rows * i) / bands;
+        w.bottom = top + (rows * (i+1)) / bands;
+    }
+    t->job = job;
+    t->activeWorkers = bands - 1;
+    t->pending = bands - 1;
+    t->generation++;
+    pthread_cond_broadcast(&t->work);
+    pthread_mutex_unlock(&t->lock);
+
+    rasterize(&c->rasterizer, job, top, top + rows / bands);
+
+    pthread_mutex_lock(&t->lock);
+    while (t->pending)
+        pthread_cond_wait(&t->done, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Returns the number of bands worth using for the rows [top, bottom), which
+// are clipped to the scissor.
+static int band_count(ogles_context_t* c, int32_t* top, int32_t* bottom)
+{
+    const context_t& r = c->rasterizer;
+    // the coverage buffer of antialiasing is shared by the whole rasterizer
+    if (!c->tiling || (r.state.enables & GGL_ENABLE_AA))
+        return 1;
+    *top = max(*top, int32_t(r.state.scissor.top));
+    *bottom = min(*bottom, int32_t(r.state.scissor.bottom));
+    if (*bottom - *top < 2 * MIN_ROWS_PER_BAND)
+        return 1;
+    return min((*bottom - *top) / MIN_ROWS_PER_BAND,
+            c->tiling->workerCount + 1);
+}
+
+// ----------------------------------------------------------------------------
+
+void ogles_init_tiling(ogles_context_t* c)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.agl.tiling_threads", value, "0");
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const int workerCount = min(min(atoi(value), int(cpus) - 1), MAX_WORKERS);
+    if (workerCount <= 0)
+        return;
+
+    tiling_t* t = new tiling_t();
+    pthread_mutex_init(&t->lock, 0);
+    pthread_cond_init(&t->work, 0);
+    pthread_cond_init(&t->done, 0);
+    for (int i=0 ; i<workerCount ; i++) {
+        tiling_worker_t& w = t->workers[i];
+        w.tiling = t;
+        w.index = i;
+        void* rasterizer = 0;
+        if (posix_memalign(&rasterizer, 32, sizeof(context_t)))
+            break;
+        w.rasterizer = static_cast<context_t*>(rasterizer);
+        if (pthread_create(&w.thread, 0, tiling_thread, &w)) {
+            free(w.rasterizer);
+            break;
+        }
+        t->workerCount++;
+    }
+    c->tiling = t;
+    if (t->workerCount == 0) {
+        ALOGW("failed to start the tiling threads");
+        ogles_uninit_tiling(c);
+    }
+}
+
+void ogles_uninit_tiling(ogles_context_t* c)
+{
+    tiling_t* t = c->tiling;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->exit = true;
+    pthread_cond_broadcast(&t->work);
+    pthread_mutex_unlock(&t->lock);
+    for (int i=0 ; i<t->workerCount ; i++) {
+        pthread_join(t->workers[i].thread, 0);
+        free(t->workers[i].rasterizer);
+    }
+    pthread_cond_destroy(&t->done);
+    pthread_cond_destroy(&t->work);
+    pthread_mutex_destroy(&t->lock);
+    delete t;
+    c->tiling = 0;
+}
+
+void ogles_tiled_trianglex(ogles_context_t* c,
+        const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2)
+{
+    int32_t top = min(v0[1], v1[1], v2[1]) >> TRI_FRACTION_BITS;
+    int32_t bottom =
+            (max(v0[1], v1[1], v2[1]) + TRI_ONE - 1) >> TRI_FRACTION_BITS;
+    const int bands = band_count(c, &top, &bottom);
+    if (ggl_likely(bands < 2)) {
+        c->rasterizer.procs.trianglex(c, v0, v1, v2);
+        return;
+    }
+
+    // Pick the span functions before copying the rasterizer: with an empty
+    // scissor, this only validates the state.
+    const uint32_t savedBottom = c->rasterizer.state.scissor.bottom;
+    c->rasterizer.state.scissor.bottom = c->rasterizer.state.scissor.top;
+    c->rasterizer.procs.trianglex(c, v0, v1, v2);
+    c->rasterizer.state.scissor.bottom = savedBottom;
+
+    tiling_job_t job;
+    job.type = tiling_job_t::TRIANGLE;
+    job.v[0] = v0;
+    job.v[1] = v1;
+    job.v[2] = v2;
+    dispatch(c, job, top, bottom, bands);
+}
+
+void ogles_tiled_recti(ogles_context_t* c,
+        GGLint l, GGLint t, GGLint r, GGLint b)
+{
+    int32_t top = t;
+    int32_t bottom = b;
+    const int bands = band_count(c, &top, &bottom);
+    if (ggl_likely(bands < 2 || l >= r)) {
+        c->rasterizer.procs.recti(c, l, t, r, b);
+        return;
+    }
+
+    // an empty rect only validates the state
+    c->rasterizer.procs.recti(c, l, t, l, t);
+
+    tiling_job_t job;
+    job.type = tiling_job_t::RECT;
+    job.rect[0] = l;
+    job.rect[1] = t;
+    job.rect[2] = r;
+    job.rect[3] = b;
+    dispatch(c, job, top, bottom, bands);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
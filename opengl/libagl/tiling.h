@@ -0,0 +1,54 @@
+/* libs/opengles/tiling.h
+**
+** Copyright 2018, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License"); 
+** you may not use this file except in compliance with the License. 
+** You may obtain a copy of the License at 
+**
+**     http://www.apache.org/licenses/LICENSE-2.0 
+**
+** Unless required by applicable law or agreed to in writing, software 
+** distributed under the License is distributed on an "AS IS" BASIS, 
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
+** See the License for the specific language governing permissions and 
+** limitations under the License.
+*/
+
+#ifndef ANDROID_OPENGLES_TILING_H
+#define ANDROID_OPENGLES_TILING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <private/pixelflinger/ggl_context.h>
+
+#include <GLES/gl.h>
+
+namespace android {
+
+namespace gl {
+struct ogles_context_t;
+};
+
+// Tiling splits large primitives in horizontal bands of the color buffer and
+// rasterizes the bands on worker threads. Each band is a copy of the
+// rasterizer with its own scissor, so every pixel is still written by a
+// single thread, in primitive order, with the same fixed-point iterators:
+// the output is the same as without tiling.
+//
+// It is enabled by setting debug.egl.agl.tiling_threads to the number of
+// worker threads.
+void ogles_init_tiling(ogles_context_t* c);
+void ogles_uninit_tiling(ogles_context_t* c);
+
+// Drop-in replacements for c->rasterizer.procs.trianglex and recti
+void ogles_tiled_trianglex(ogles_context_t* c,
+        const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2);
+void ogles_tiled_recti(ogles_context_t* c,
+        GGLint l, GGLint t, GGLint r, GGLint b);
+
+}; // namespace android
+
+#endif // ANDROID_OPENGLES_TILING_H
@@ -23,7 +23,8 @@
 
 #include <cutils/properties.h>
 #include <log/log.h>
-#include <chrono>
+
+#include <algorithm>
 
 namespace android {
 
@@ -40,16 +41,11 @@ BlobCache::BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize
         mMaxTotalSize(maxTotalSize),
         mMaxKeySize(maxKeySize),
         mMaxValueSize(maxValueSize),
-        mTotalSize(0) {
-    int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
-#ifdef _WIN32
-    srand(now);
-#else
-    mRandState[0] = (now >> 0) & 0xFFFF;
-    mRandState[1] = (now >> 16) & 0xFFFF;
-    mRandState[2] = (now >> 32) & 0xFFFF;
-#endif
-    ALOGV("initializing random seed using %lld", (unsigned long long)now);
+        mTotalSize(0),
+        mUseCount(0),
+        mHits(0),
+        mMisses(0),
+        mEvictions(0) {
 }
 
 void BlobCache::set(const void* key, size_t keySize, const void* value,
@@ -101,7 +97,8 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
                     break;
                 }
             }
-            mCacheEntries.insert(index, CacheEntry(keyBlob, valueBlob));
+            index = mCacheEntries.insert(index, CacheEntry(keyBlob, valueBlob));
+            index->setLastUse(++mUseCount);
             mTotalSize = newTotalSize;
             ALOGV("set: created new cache entry with %zu byte key and %zu byte value",
                     keySize, valueSize);
@@ -123,6 +120,7 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
                 }
             }
             index->setValue(valueBlob);
+            index->setLastUse(++mUseCount);
             mTotalSize = newTotalSize;
             ALOGV("set: updated existing cache entry with %zu byte key and %zu byte "
                     "value", keySize, valueSize);
@@ -143,8 +141,11 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
     auto index = std::lower_bound(mCacheEntries.begin(), mCacheEntries.end(), dummyEntry);
     if (index == mCacheEntries.end() || dummyEntry < *index) {
         ALOGV("get: no cache entry found for key of size %zu", keySize);
+        mMisses++;
         return 0;
     }
+    mHits++;
+    index->setLastUse(++mUseCount);
 
     // The key was found. Return the value if the caller's buffer is large
     // enough.
@@ -174,6 +175,19 @@ size_t BlobCache::getFlattenedSize() const {
     return size;
 }
 
+std::vector<const BlobCache::CacheEntry*> BlobCache::sortByLastUse(
+        const std::vector<CacheEntry>& entries) {
+    std::vector<const CacheEntry*> sorted;
+    sorted.reserve(entries.size());
+    for (const CacheEntry& e : entries) {
+        sorted.push_back(&e);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const CacheEntry* lhs, const CacheEntry* rhs) {
+        return lhs->getLastUse() < rhs->getLastUse();
+    });
+    return sorted;
+}
+
 int BlobCache::flatten(void* buffer, size_t size) const {
     // Write the cache header
     if (size < sizeof(Header)) {
@@ -192,9 +206,9 @@ int BlobCache::flatten(void* buffer, size_t size) const {
     // Write cache entries
     uint8_t* byteBuffer = reinterpret_cast<uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header) + header->mBuildIdLength);
-    for (const CacheEntry& e :  mCacheEntries) {
-        std::shared_ptr<Blob> const& keyBlob = e.getKey();
-        std::shared_ptr<Blob> const& valueBlob = e.getValue();
+    for (const CacheEntry* e : sortByLastUse(mCacheEntries)) {
+        std::shared_ptr<Blob> const& keyBlob = e->getKey();
+        std::shared_ptr<Blob> const& valueBlob = e->getValue();
         size_t keySize = keyBlob->getSize();
         size_t valueSize = valueBlob->getSize();
 
@@ -225,8 +239,13 @@ int BlobCache::flatten(void* buffer, size_t size) const {
 }
 
 int BlobCache::unflatten(void const* buffer, size_t size) {
+    return unflatten(buffer, size, true);
+}
+
+int BlobCache::unflatten(void const* buffer, size_t size, bool copyData) {
     // All errors should result in the BlobCache being in an empty state.
     mCacheEntries.clear();
+    mTotalSize = 0;
 
     // Read the cache header
     if (size < sizeof(Header)) {
@@ -248,13 +267,18 @@ int BlobCache::unflatten(void const* buffer, size_t size) {
         return 0;
     }
 
-    // Read cache entries
+    // Read cache entries.  Rather than setting them one by one, which would
+    // insert each of them into the sorted entry vector, append them all and
+    // sort them once.  They were flattened from least to most recently used,
+    // so their use counts follow the order in which they are read.
     const uint8_t* byteBuffer = reinterpret_cast<const uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header) + header->mBuildIdLength);
     size_t numEntries = header->mNumEntries;
+    mCacheEntries.reserve(std::min(numEntries, size / sizeof(EntryHeader)));
     for (size_t i = 0; i < numEntries; i++) {
         if (byteOffset + sizeof(EntryHeader) > size) {
             mCacheEntries.clear();
+            mTotalSize = 0;
             ALOGE("unflatten: not enough room for cache entry headers");
             return -EINVAL;
         }
@@ -268,36 +292,71 @@ int BlobCache::unflatten(void const* buffer, size_t size) {
         size_t totalSize = align4(entrySize);
         if (byteOffset + totalSize > size) {
             mCacheEntries.clear();
+            mTotalSize = 0;
             ALOGE("unflatten: not enough room for cache entry headers");
             return -EINVAL;
         }
 
-        const uint8_t* data = eheader->mData;
-        set(data, keySize, data + keySize, valueSize);
+        // Entries that set would not cache under the current limits are
+        // dropped.
+        if (keySize != 0 && keySize <= mMaxKeySize &&
+                valueSize != 0 && valueSize <= mMaxValueSize) {
+            const uint8_t* data = eheader->mData;
+            std::shared_ptr<Blob> keyBlob(new Blob(data, keySize, copyData));
+            std::shared_ptr<Blob> valueBlob(new Blob(data + keySize, valueSize, copyData));
+            mCacheEntries.push_back(CacheEntry(keyBlob, valueBlob));
+            mCacheEntries.back().setLastUse(++mUseCount);
+            mTotalSize += keySize + valueSize;
+        }
 
         byteOffset += totalSize;
     }
 
+    // Keep the most recently used of any duplicate keys.
+    std::stable_sort(mCacheEntries.begin(), mCacheEntries.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < mCacheEntries.size(); i++) {
+        if (kept > 0 && !(mCacheEntries[kept - 1] < mCacheEntries[i])) {
+            // Same key as the previous entry, which was used less recently.
+            const CacheEntry& previous = mCacheEntries[kept - 1];
+            mTotalSize -= previous.getKey()->getSize() + previous.getValue()->getSize();
+            kept--;
+        }
+        mCacheEntries[kept++] = mCacheEntries[i];
+    }
+    mCacheEntries.resize(kept);
+
+    if (mTotalSize > mMaxTotalSize) {
+        clean();
+    }
+
     return 0;
 }
 
-long int BlobCache::blob_random() {
-#ifdef _WIN32
-    return rand();
-#else
-    return nrand48(mRandState);
-#endif
+BlobCache::Stats BlobCache::getStats() const {
+    return {mHits, mMisses, mEvictions, mCacheEntries.size(), mTotalSize};
 }
 
 void BlobCache::clean() {
-    // Remove a random cache entry until the total cache size gets below half
-    // the maximum total cache size.
-    while (mTotalSize > mMaxTotalSize / 2) {
-        size_t i = size_t(blob_random() % (mCacheEntries.size()));
-        const CacheEntry& entry(mCacheEntries[i]);
-        mTotalSize -= entry.getKey()->getSize() + entry.getValue()->getSize();
-        mCacheEntries.erase(mCacheEntries.begin() + i);
+    // Find the most recent use such that removing it and every entry used
+    // before it gets the total cache size below half the maximum total cache
+    // size, then remove them all in a single pass.
+    uint64_t lastEvictedUse = 0;
+    size_t totalSize = mTotalSize;
+    for (const CacheEntry* e : sortByLastUse(mCacheEntries)) {
+        if (totalSize <= mMaxTotalSize / 2) {
+            break;
+        }
+        totalSize -= e->getKey()->getSize() + e->getValue()->getSize();
+        lastEvictedUse = e->getLastUse();
     }
+    auto evicted = std::remove_if(mCacheEntries.begin(), mCacheEntries.end(),
+            [lastEvictedUse](const CacheEntry& e) {
+                return e.getLastUse() <= lastEvictedUse;
+            });
+    mEvictions += mCacheEntries.end() - evicted;
+    mCacheEntries.erase(evicted, mCacheEntries.end());
+    mTotalSize = totalSize;
 }
 
 bool BlobCache::isCleanable() const {
@@ -335,18 +394,21 @@ size_t BlobCache::Blob::getSize() const {
     return mSize;
 }
 
-BlobCache::CacheEntry::CacheEntry() {
+BlobCache::CacheEntry::CacheEntry():
+        mLastUse(0) {
 }
 
 BlobCache::CacheEntry::CacheEntry(
         const std::shared_ptr<Blob>& key, const std::shared_ptr<Blob>& value):
         mKey(key),
-        mValue(value) {
+        mValue(value),
+        mLastUse(0) {
 }
 
 BlobCache::CacheEntry::CacheEntry(const CacheEntry& ce):
         mKey(ce.mKey),
-        mValue(ce.mValue) {
+        mValue(ce.mValue),
+        mLastUse(ce.mLastUse) {
 }
 
 bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
@@ -356,6 +418,7 @@ bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
 const BlobCache::CacheEntry& BlobCache::CacheEntry::operator=(const CacheEntry& rhs) {
     mKey = rhs.mKey;
     mValue = rhs.mValue;
+    mLastUse = rhs.mLastUse;
     return *this;
 }
 
@@ -371,4 +434,12 @@ void BlobCache::CacheEntry::setValue(const std::shared_ptr<Blob>& value) {
     mValue = value;
 }
 
+uint64_t BlobCache::CacheEntry::getLastUse() const {
+    return mLastUse;
+}
+
+void BlobCache::CacheEntry::setLastUse(uint64_t lastUse) {
+    mLastUse = lastUse;
+}
+
 } // namespace android
@@ -18,6 +18,7 @@
 #define ANDROID_BLOB_CACHE_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <memory>
 #include <vector>
@@ -97,6 +98,28 @@ public:
     //
     int unflatten(void const* buffer, size_t size);
 
+    // Stats counts the lookups and evictions since the cache was created.
+    struct Stats {
+        // hits is the number of get calls that found their key.
+        uint64_t hits;
+
+        // misses is the number of get calls that did not find their key.
+        uint64_t misses;
+
+        // evictions is the number of entries evicted to make room for others.
+        uint64_t evictions;
+
+        // entries is the number of entries currently in the cache.
+        size_t entries;
+
+        // totalSize is the combined size of the keys and values currently in
+        // the cache.
+        size_t totalSize;
+    };
+
+    // getStats returns the cache's current statistics.
+    Stats getStats() const;
+
 protected:
     // mMaxTotalSize is the maximum size that all cache entries can occupy. This
     // includes space for both keys and values. When a call to BlobCache::set
@@ -105,15 +128,19 @@ protected:
     // will be evicted from the cache to make room for the new entry.
     const size_t mMaxTotalSize;
 
+    // unflatten with copyData set to false makes the cache entries refer to
+    // the keys and values in 'buffer' instead of copying them, so 'buffer'
+    // must stay valid and unmodified for as long as the entries it holds are
+    // in the cache.  Setting one of these entries replaces it with a copy of
+    // the new value, so the buffer itself is never written to.
+    int unflatten(void const* buffer, size_t size, bool copyData);
+
 private:
     // Copying is disallowed.
     BlobCache(const BlobCache&);
     void operator=(const BlobCache&);
 
-    // A random function helper to get around MinGW not having nrand48()
-    long int blob_random();
-
-    // clean evicts a randomly chosen set of entries from the cache such that
+    // clean evicts the least recently used entries from the cache such that
     // the total size of all remaining entries is less than mMaxTotalSize/2.
     void clean();
 
@@ -163,6 +190,9 @@ private:
 
         void setValue(const std::shared_ptr<Blob>& value);
 
+        uint64_t getLastUse() const;
+        void setLastUse(uint64_t lastUse);
+
     private:
 
         // mKey is the key that identifies the cache entry.
@@ -170,6 +200,10 @@ private:
 
         // mValue is the cached data associated with the key.
         std::shared_ptr<Blob> mValue;
+
+        // mLastUse is the value of BlobCache::mUseCount when the entry was
+        // last set or retrieved.
+        uint64_t mLastUse;
     };
 
     // A Header is the header for the entire BlobCache serialization format. No
@@ -218,6 +252,11 @@ private:
         uint8_t mData[];
     };
 
+    // sortByLastUse returns pointers to the given entries, ordered from least
+    // to most recently used. flatten writes the entries in this order so that
+    // unflatten, which sets them one after the other, restores their recency.
+    static std::vector<const CacheEntry*> sortByLastUse(const std::vector<CacheEntry>& entries);
+
     // mMaxKeySize is the maximum key size that will be cached. Calls to
     // BlobCache::set with a keySize parameter larger than mMaxKeySize will
     // simply not add the key/value pair to the cache.
@@ -232,12 +271,17 @@ private:
     // the cache.
     size_t mTotalSize;
 
-    // mRandState is the pseudo-random number generator state. It is passed to
-    // nrand48 to generate random numbers when needed.
-    unsigned short mRandState[3];
+    // mUseCount is incremented by every set and successful get, and orders
+    // the entries from least to most recently used.
+    uint64_t mUseCount;
+
+    // mHits, mMisses and mEvictions are the counters reported by getStats.
+    uint64_t mHits;
+    uint64_t mMisses;
+    uint64_t mEvictions;
 
-    // mCacheEntries stores all the cache entries that are resident in memory.
-    // Cache entries are added to it by the 'set' method.
+    // mCacheEntries stores all the cache entries that are resident in memory,
+    // sorted by key. Cache entries are added to it by the 'set' method.
     std::vector<CacheEntry> mCacheEntries;
 };
 
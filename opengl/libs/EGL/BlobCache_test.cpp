@@ -18,6 +18,7 @@
 #include <stdio.h>
 
 #include <memory>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -267,6 +268,50 @@ TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
     ASSERT_EQ(maxEntries/2 + 1, numCached);
 }
 
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsLeastRecentlyUsed) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Use the first entries again, in reverse order.
+    for (int i = maxEntries/2 - 1; i >= 0; i--) {
+        uint8_t k = i;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+    // Insert one more entry, causing a cache overflow.
+    {
+        uint8_t k = maxEntries;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // The entries that were not used again are the ones evicted.
+    for (int i = 0; i < maxEntries+1; i++) {
+        uint8_t k = i;
+        bool used = i < maxEntries/2 || i == maxEntries;
+        ASSERT_EQ(used ? size_t(1) : size_t(0), mBC->get(&k, 1, NULL, 0)) << "key " << i;
+    }
+}
+
+TEST_F(BlobCacheTest, StatsCountHitsMissesAndEvictions) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries + 1; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    uint8_t k = maxEntries;
+    mBC->get(&k, 1, NULL, 0);
+    mBC->get("abcd", 4, NULL, 0);
+    mBC->get("abcd", 4, NULL, 0);
+
+    BlobCache::Stats stats = mBC->getStats();
+    ASSERT_EQ(uint64_t(1), stats.hits);
+    ASSERT_EQ(uint64_t(2), stats.misses);
+    ASSERT_EQ(uint64_t(maxEntries - maxEntries/2), stats.evictions);
+    ASSERT_EQ(size_t(maxEntries/2 + 1), stats.entries);
+    ASSERT_EQ(size_t(2 * (maxEntries/2 + 1)), stats.totalSize);
+}
+
 class BlobCacheFlattenTest : public BlobCacheTest {
 protected:
     virtual void SetUp() {
@@ -342,6 +387,62 @@ TEST_F(BlobCacheFlattenTest, FlattenDoesntChangeCache) {
     }
 }
 
+TEST_F(BlobCacheFlattenTest, UnflattenRestoresRecency) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Make the entry set first the most recently used.
+    {
+        uint8_t k = 0;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+
+    roundTrip();
+
+    // Insert one more entry in the copy, causing a cache overflow.
+    {
+        uint8_t k = maxEntries;
+        mBC2->set(&k, 1, "x", 1);
+    }
+    uint8_t k = 0;
+    ASSERT_EQ(size_t(1), mBC2->get(&k, 1, NULL, 0));
+    k = 1;
+    ASSERT_EQ(size_t(0), mBC2->get(&k, 1, NULL, 0));
+}
+
+// MappedBlobCache exposes the loading of entries in place, as FileBlobCache
+// does for the mapped cache file.
+class MappedBlobCache : public BlobCache {
+public:
+    using BlobCache::BlobCache;
+    using BlobCache::unflatten;
+};
+
+TEST_F(BlobCacheFlattenTest, UnflattenWithoutCopyLeavesBufferUnmodified) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("ab", 2, "efgh", 4);
+    mBC->set("cd", 2, "mnop", 4);
+
+    size_t size = mBC->getFlattenedSize();
+    std::vector<uint8_t> flat(size);
+    ASSERT_EQ(OK, mBC->flatten(flat.data(), size));
+    const std::vector<uint8_t> original(flat);
+
+    MappedBlobCache mapped(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE);
+    ASSERT_EQ(OK, mapped.unflatten(flat.data(), size, false));
+    ASSERT_EQ(size_t(4), mapped.get("ab", 2, buf, 4));
+    ASSERT_EQ(0, memcmp(buf, "efgh", 4));
+
+    mapped.set("ab", 2, "qrst", 4);
+    ASSERT_EQ(size_t(4), mapped.get("ab", 2, buf, 4));
+    ASSERT_EQ(0, memcmp(buf, "qrst", 4));
+    ASSERT_EQ(size_t(4), mapped.get("cd", 2, buf, 4));
+    ASSERT_EQ(0, memcmp(buf, "mnop", 4));
+    ASSERT_EQ(original, flat);
+}
+
 TEST_F(BlobCacheFlattenTest, FlattenCatchesBufferTooSmall) {
     // Fill up the entire cache with 1 char key/value pairs.
     const int maxEntries = MAX_TOTAL_SIZE / 2;
@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -27,20 +28,36 @@
 static const char* cacheFileMagic = "EGL$";
 static const size_t cacheFileHeaderSize = 8;
 
+// Journal file header: the magic, then the length and contents of the build
+// id of the device that wrote the journal, padded to 4 bytes.
+static const char* journalFileMagic = "EGJ$";
+static const char* journalFileSuffix = ".journal";
+
 namespace android {
 
+// crc32c computes the same checksum as a bit at a time, a byte at a time
+// using a table of the remainders of each byte value.
 static uint32_t crc32c(const uint8_t* buf, size_t len) {
-    const uint32_t polyBits = 0x82F63B78;
-    uint32_t r = 0;
-    for (size_t i = 0; i < len; i++) {
-        r ^= buf[i];
-        for (int j = 0; j < 8; j++) {
-            if (r & 1) {
-                r = (r >> 1) ^ polyBits;
-            } else {
-                r >>= 1;
+    static const struct Table {
+        uint32_t remainders[256];
+        Table() {
+            const uint32_t polyBits = 0x82F63B78;
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t r = i;
+                for (int j = 0; j < 8; j++) {
+                    if (r & 1) {
+                        r = (r >> 1) ^ polyBits;
+                    } else {
+                        r >>= 1;
+                    }
+                }
+                remainders[i] = r;
             }
         }
+    } table;
+    uint32_t r = 0;
+    for (size_t i = 0; i < len; i++) {
+        r = (r >> 8) ^ table.remainders[(r ^ buf[i]) & 0xFF];
     }
     return r;
 }
@@ -48,139 +65,313 @@ static uint32_t crc32c(const uint8_t* buf, size_t len) {
 FileBlobCache::FileBlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize,
         const std::string& filename)
         : BlobCache(maxKeySize, maxValueSize, maxTotalSize)
-        , mFilename(filename) {
+        , mFilename(filename)
+        , mMappedFile(nullptr)
+        , mMappedFileSize(0)
+        , mJournalSize(0) {
     if (mFilename.length() > 0) {
-        size_t headerSize = cacheFileHeaderSize;
+        loadFile();
+        loadJournal();
+    }
+}
 
-        int fd = open(mFilename.c_str(), O_RDONLY, 0);
-        if (fd == -1) {
-            if (errno != ENOENT) {
-                ALOGE("error opening cache file %s: %s (%d)", mFilename.c_str(),
-                        strerror(errno), errno);
-            }
-            return;
-        }
+void FileBlobCache::loadFile() {
+    size_t headerSize = cacheFileHeaderSize;
 
-        struct stat statBuf;
-        if (fstat(fd, &statBuf) == -1) {
-            ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
-            close(fd);
-            return;
+    int fd = open(mFilename.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", mFilename.c_str(),
+                    strerror(errno), errno);
         }
+        return;
+    }
 
-        // Sanity check the size before trying to mmap it.
-        size_t fileSize = statBuf.st_size;
-        if (fileSize > mMaxTotalSize * 2) {
-            ALOGE("cache file is too large: %#" PRIx64,
-                  static_cast<off64_t>(statBuf.st_size));
-            close(fd);
-            return;
-        }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+        close(fd);
+        return;
+    }
 
-        uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
-                PROT_READ, MAP_PRIVATE, fd, 0));
-        if (buf == MAP_FAILED) {
-            ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
-                    errno);
-            close(fd);
-            return;
-        }
+    // Sanity check the size before trying to mmap it.
+    size_t fileSize = statBuf.st_size;
+    if (fileSize > mMaxTotalSize * 2) {
+        ALOGE("cache file is too large: %#" PRIx64,
+              static_cast<off64_t>(statBuf.st_size));
+        close(fd);
+        return;
+    }
 
-        // Check the file magic and CRC
-        size_t cacheSize = fileSize - headerSize;
-        if (memcmp(buf, cacheFileMagic, 4) != 0) {
-            ALOGE("cache file has bad mojo");
-            close(fd);
-            return;
+    uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
+            PROT_READ, MAP_PRIVATE, fd, 0));
+    if (buf == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
+                errno);
+        close(fd);
+        return;
+    }
+
+    close(fd);
+
+    // Check the file magic and CRC
+    size_t cacheSize = fileSize - headerSize;
+    if (fileSize < headerSize || memcmp(buf, cacheFileMagic, 4) != 0) {
+        ALOGE("cache file has bad mojo");
+        munmap(buf, fileSize);
+        return;
+    }
+    uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
+    if (crc32c(buf + headerSize, cacheSize) != *crc) {
+        ALOGE("cache file failed CRC check");
+        munmap(buf, fileSize);
+        return;
+    }
+
+    // The entries refer to the keys and values in the mapping rather
+    // than copies of them, so the mapping is kept until the cache is
+    // destroyed.  It stays valid when the cache is written back to disk,
+    // since writeFile replaces the file instead of overwriting it.
+    int err = unflatten(buf + headerSize, cacheSize, false);
+    if (err < 0) {
+        ALOGE("error reading cache contents: %s (%d)", strerror(-err),
+                -err);
+        munmap(buf, fileSize);
+        return;
+    }
+
+    mMappedFile = buf;
+    mMappedFileSize = fileSize;
+}
+
+namespace {
+
+// A JournalEntryHeader precedes the key and value of each journal entry,
+// which are padded to 4 bytes.
+struct JournalEntryHeader {
+    uint32_t keySize;
+    uint32_t valueSize;
+    // crc is the checksum of the key and value, which also tells apart an
+    // entry that was not completely written.
+    uint32_t crc;
+    uint8_t data[];
+};
+
+size_t align4(size_t size) {
+    return (size + 3) & ~3;
+}
+
+size_t journalHeaderSize(size_t buildIdLength) {
+    return align4(4 + sizeof(uint32_t) + buildIdLength);
+}
+
+} // namespace
+
+void FileBlobCache::loadJournal() {
+    std::string journalName = mFilename + journalFileSuffix;
+    int fd = open(journalName.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache journal %s: %s (%d)", journalName.c_str(),
+                    strerror(errno), errno);
         }
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        if (crc32c(buf + headerSize, cacheSize) != *crc) {
-            ALOGE("cache file failed CRC check");
-            close(fd);
-            return;
+        return;
+    }
+
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache journal: %s (%d)", strerror(errno), errno);
+        close(fd);
+        return;
+    }
+    // The journal is compacted once it outgrows the cache, but one more
+    // batch of entries may have been appended since.
+    size_t fileSize = statBuf.st_size;
+    if (fileSize > mMaxTotalSize * 4) {
+        ALOGE("cache journal is too large: %#" PRIx64,
+              static_cast<off64_t>(statBuf.st_size));
+        close(fd);
+        return;
+    }
+    uint8_t* buf = nullptr;
+    if (fileSize > 0) {
+        buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
+    }
+    close(fd);
+    if (buf == nullptr || buf == MAP_FAILED) {
+        return;
+    }
+
+    char buildId[PROPERTY_VALUE_MAX];
+    uint32_t buildIdLength = property_get("ro.build.id", buildId, "");
+    size_t offset = journalHeaderSize(buildIdLength);
+    if (fileSize < offset || memcmp(buf, journalFileMagic, 4) != 0 ||
+            *reinterpret_cast<const uint32_t*>(buf + 4) != buildIdLength ||
+            memcmp(buf + 8, buildId, buildIdLength) != 0) {
+        // Like the cache file, a journal from another build is ignored.
+        munmap(buf, fileSize);
+        return;
+    }
+
+    // Unlike the cache file, the journal entries are copied, as the journal
+    // is removed once its entries are in the cache file.
+    while (offset + sizeof(JournalEntryHeader) <= fileSize) {
+        const JournalEntryHeader* entry =
+                reinterpret_cast<const JournalEntryHeader*>(buf + offset);
+        size_t dataSize = size_t(entry->keySize) + entry->valueSize;
+        size_t entrySize = align4(sizeof(JournalEntryHeader) + dataSize);
+        if (offset + entrySize > fileSize || crc32c(entry->data, dataSize) != entry->crc) {
+            ALOGE("cache journal is truncated or corrupted after %zu bytes", offset);
+            break;
         }
+        set(entry->data, entry->keySize, entry->data + entry->keySize, entry->valueSize);
+        offset += entrySize;
+    }
+    mJournalSize = offset;
+    munmap(buf, fileSize);
+}
 
-        int err = unflatten(buf + headerSize, cacheSize);
-        if (err < 0) {
-            ALOGE("error reading cache contents: %s (%d)", strerror(-err),
-                    -err);
-            munmap(buf, fileSize);
+void FileBlobCache::addJournalEntry(const void* key, size_t keySize, const void* value,
+        size_t valueSize, std::vector<uint8_t>* journal) {
+    size_t offset = journal->size();
+    journal->resize(offset + align4(sizeof(JournalEntryHeader) + keySize + valueSize));
+    JournalEntryHeader* entry = reinterpret_cast<JournalEntryHeader*>(journal->data() + offset);
+    entry->keySize = keySize;
+    entry->valueSize = valueSize;
+    entry->crc = 0;
+    memcpy(entry->data, key, keySize);
+    memcpy(entry->data + keySize, value, valueSize);
+    memset(entry->data + keySize + valueSize, 0,
+            journal->size() - offset - sizeof(JournalEntryHeader) - keySize - valueSize);
+}
+
+void FileBlobCache::appendToJournal(const std::string& filename, std::vector<uint8_t>* journal) {
+    // Checksum the entries here rather than in addJournalEntry, so that
+    // it is done on the thread writing the journal.
+    for (size_t offset = 0; offset < journal->size();) {
+        JournalEntryHeader* entry =
+                reinterpret_cast<JournalEntryHeader*>(journal->data() + offset);
+        size_t dataSize = size_t(entry->keySize) + entry->valueSize;
+        entry->crc = crc32c(entry->data, dataSize);
+        offset += align4(sizeof(JournalEntryHeader) + dataSize);
+    }
+
+    std::string journalName = filename + journalFileSuffix;
+    int fd = open(journalName.c_str(), O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC,
+            S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error opening cache journal %s: %s (%d)", journalName.c_str(),
+                strerror(errno), errno);
+        return;
+    }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == 0 && statBuf.st_size == 0) {
+        char buildId[PROPERTY_VALUE_MAX];
+        uint32_t buildIdLength = property_get("ro.build.id", buildId, "");
+        std::vector<uint8_t> header(journalHeaderSize(buildIdLength));
+        memcpy(header.data(), journalFileMagic, 4);
+        memcpy(header.data() + 4, &buildIdLength, sizeof(buildIdLength));
+        memcpy(header.data() + 8, buildId, buildIdLength);
+        if (write(fd, header.data(), header.size()) == -1) {
+            ALOGE("error writing cache journal: %s (%d)", strerror(errno), errno);
             close(fd);
+            unlink(journalName.c_str());
             return;
         }
+    }
+    // A write that fails partway leaves a truncated entry, which loadJournal
+    // ignores along with anything after it.
+    if (write(fd, journal->data(), journal->size()) == -1) {
+        ALOGE("error writing cache journal: %s (%d)", strerror(errno), errno);
+    }
+    close(fd);
+}
 
-        munmap(buf, fileSize);
-        close(fd);
+size_t FileBlobCache::getJournalSize() const {
+    return mJournalSize;
+}
+
+FileBlobCache::~FileBlobCache() {
+    if (mMappedFile != nullptr) {
+        munmap(mMappedFile, mMappedFileSize);
     }
 }
 
 void FileBlobCache::writeToFile() {
-    if (mFilename.length() > 0) {
-        size_t cacheSize = getFlattenedSize();
-        size_t headerSize = cacheFileHeaderSize;
-        const char* fname = mFilename.c_str();
+    std::vector<uint8_t> contents;
+    if (serialize(&contents)) {
+        writeFile(mFilename, &contents);
+    }
+}
 
-        // Try to create the file with no permissions so we can write it
-        // without anyone trying to read it.
-        int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-        if (fd == -1) {
-            if (errno == EEXIST) {
-                // The file exists, delete it and try again.
-                if (unlink(fname) == -1) {
-                    // No point in retrying if the unlink failed.
-                    ALOGE("error unlinking cache file %s: %s (%d)", fname,
-                            strerror(errno), errno);
-                    return;
-                }
-                // Retry now that we've unlinked the file.
-                fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-            }
-            if (fd == -1) {
-                ALOGE("error creating cache file %s: %s (%d)", fname,
+bool FileBlobCache::serialize(std::vector<uint8_t>* contents) const {
+    if (mFilename.length() == 0) {
+        return false;
+    }
+    size_t cacheSize = getFlattenedSize();
+    size_t headerSize = cacheFileHeaderSize;
+    contents->resize(headerSize + cacheSize);
+
+    int err = flatten(contents->data() + headerSize, cacheSize);
+    if (err < 0) {
+        ALOGE("error writing cache contents: %s (%d)", strerror(-err),
+                -err);
+        return false;
+    }
+    return true;
+}
+
+void FileBlobCache::writeFile(const std::string& filename, std::vector<uint8_t>* contents) {
+    size_t headerSize = cacheFileHeaderSize;
+    size_t cacheSize = contents->size() - headerSize;
+    uint8_t* buf = contents->data();
+    const char* fname = filename.c_str();
+
+    // Write the file magic and CRC
+    memcpy(buf, cacheFileMagic, 4);
+    uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
+    *crc = crc32c(buf + headerSize, cacheSize);
+
+    // Try to create the file with no permissions so we can write it
+    // without anyone trying to read it.
+    int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
+    if (fd == -1) {
+        if (errno == EEXIST) {
+            // The file exists, delete it and try again.
+            if (unlink(fname) == -1) {
+                // No point in retrying if the unlink failed.
+                ALOGE("error unlinking cache file %s: %s (%d)", fname,
                         strerror(errno), errno);
                 return;
             }
+            // Retry now that we've unlinked the file.
+            fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
         }
-
-        size_t fileSize = headerSize + cacheSize;
-
-        uint8_t* buf = new uint8_t [fileSize];
-        if (!buf) {
-            ALOGE("error allocating buffer for cache contents: %s (%d)",
+        if (fd == -1) {
+            ALOGE("error creating cache file %s: %s (%d)", fname,
                     strerror(errno), errno);
-            close(fd);
-            unlink(fname);
             return;
         }
+    }
 
-        int err = flatten(buf + headerSize, cacheSize);
-        if (err < 0) {
-            ALOGE("error writing cache contents: %s (%d)", strerror(-err),
-                    -err);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    if (write(fd, buf, contents->size()) == -1) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno),
+                errno);
+        close(fd);
+        unlink(fname);
+        return;
+    }
 
-        // Write the file magic and CRC
-        memcpy(buf, cacheFileMagic, 4);
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        *crc = crc32c(buf + headerSize, cacheSize);
+    fchmod(fd, S_IRUSR);
+    close(fd);
 
-        if (write(fd, buf, fileSize) == -1) {
-            ALOGE("error writing cache file: %s (%d)", strerror(errno),
-                    errno);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    // The cache file now holds all the entries of the journal.
+    std::string journalName = filename + journalFileSuffix;
+    unlink(journalName.c_str());
+}
 
-        delete [] buf;
-        fchmod(fd, S_IRUSR);
-        close(fd);
-    }
+const std::string& FileBlobCache::getFilename() const {
+    return mFilename;
 }
 
 }
@@ -19,23 +19,72 @@
 
 #include "BlobCache.h"
 #include <string>
+#include <vector>
 
 namespace android {
 
+// The cache is saved as an entire snapshot in the cache file, plus a journal
+// file next to it to which entries set since the snapshot are appended.
 class FileBlobCache : public BlobCache {
 public:
     // FileBlobCache attempts to load the saved cache contents from disk into
-    // BlobCache.
+    // BlobCache, the snapshot first and then the journal.
     FileBlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize,
             const std::string& filename);
+    ~FileBlobCache();
 
     // writeToFile attempts to save the current contents of BlobCache to
     // disk.
     void writeToFile();
 
+    // serialize fills contents with the current contents of BlobCache, in
+    // the cache file format.  It returns false if the cache is not backed by
+    // a file or could not be serialized.  Only the serialization needs the
+    // cache to be protected from concurrent access, so callers can then write
+    // the contents with writeFile without holding their lock.
+    bool serialize(std::vector<uint8_t>* contents) const;
+
+    // writeFile checksums the contents returned by serialize and saves them
+    // to the given file, then removes the journal, whose entries they hold.
+    static void writeFile(const std::string& filename, std::vector<uint8_t>* contents);
+
+    // addJournalEntry adds a key/value pair that was set in the cache to
+    // journal, to be appended to the journal file by appendToJournal.
+    static void addJournalEntry(const void* key, size_t keySize, const void* value,
+            size_t valueSize, std::vector<uint8_t>* journal);
+
+    // appendToJournal appends the entries added by addJournalEntry to the
+    // journal of the given cache file.  Unlike writeFile, it only writes the
+    // new entries, so it can be done after every batch of them.
+    static void appendToJournal(const std::string& filename, std::vector<uint8_t>* journal);
+
+    // getJournalSize returns the size of the journal loaded at construction.
+    size_t getJournalSize() const;
+
+    // getFilename returns the name of the file backing the cache.
+    const std::string& getFilename() const;
+
 private:
+    // loadFile loads the snapshot of the cache in the cache file.
+    void loadFile();
+
+    // loadJournal sets the entries of the journal in the cache, up to the
+    // first one that fails its checksum.
+    void loadJournal();
+
     // mFilename is the name of the file for storing cache contents.
     std::string mFilename;
+
+    // mMappedFile is the read-only mapping of the cache file loaded at
+    // construction, which holds the keys and values of the loaded entries.
+    // It is null if no file was loaded.
+    uint8_t* mMappedFile;
+
+    // mMappedFileSize is the size of mMappedFile in bytes.
+    size_t mMappedFileSize;
+
+    // mJournalSize is the size of the journal loaded at construction.
+    size_t mJournalSize;
 };
 
 } // namespace android
@@ -19,10 +19,12 @@
 
 #include "Loader.h"
 
+#include <chrono>
 #include <string>
 
 #include <dirent.h>
 #include <dlfcn.h>
+#include <inttypes.h>
 
 #include <android/dlext.h>
 #include <cutils/properties.h>
@@ -163,13 +165,23 @@ int Loader::driver_t::set(void* hnd, int32_t api)
 // ----------------------------------------------------------------------------
 
 Loader::Loader()
-    : getProcAddress(NULL)
+    : getProcAddress(NULL),
+      loadTimes()
 {
 }
 
 Loader::~Loader() {
 }
 
+const egl_driver_load_times_t& Loader::getLoadTimes() const {
+    return loadTimes;
+}
+
+static int64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
 static void* load_wrapper(const char* path) {
     void* so = do_dlopen(path, RTLD_NOW | RTLD_LOCAL);
     ALOGE_IF(!so, "dlopen(\"%s\") failed: %s", path, dlerror());
@@ -220,6 +232,7 @@ void* Loader::open(egl_connection_t* cnx)
 {
     ATRACE_CALL();
 
+    auto start = std::chrono::steady_clock::now();
     void* dso;
     driver_t* hnd = 0;
 
@@ -240,9 +253,18 @@ void* Loader::open(egl_connection_t* cnx)
 
     LOG_ALWAYS_FATAL_IF(!hnd, "couldn't find an OpenGL ES implementation");
 
+    auto wrappersStart = std::chrono::steady_clock::now();
     cnx->libEgl   = load_wrapper(EGL_WRAPPER_DIR "/libEGL.so");
     cnx->libGles2 = load_wrapper(EGL_WRAPPER_DIR "/libGLESv2.so");
     cnx->libGles1 = load_wrapper(EGL_WRAPPER_DIR "/libGLESv1_CM.so");
+    loadTimes.openWrappersNs = elapsedNs(wrappersStart);
+    loadTimes.totalNs = elapsedNs(start);
+    ALOGD("loaded the GLES driver in %" PRId64 "ms: opening %" PRId64 "ms, "
+            "resolving %" PRId64 "ms, %u unimplemented GLES entry points",
+            loadTimes.totalNs / 1000000,
+            (loadTimes.openDriversNs + loadTimes.openWrappersNs) / 1000000,
+            (loadTimes.resolveEglNs + loadTimes.resolveGlesNs) / 1000000,
+            loadTimes.unimplementedGlesEntries);
 
     LOG_ALWAYS_FATAL_IF(!cnx->libEgl,
             "couldn't load system EGL wrapper libraries");
@@ -259,13 +281,14 @@ void Loader::close(void* driver)
     delete hnd;
 }
 
-void Loader::init_api(void* dso,
+uint32_t Loader::init_api(void* dso,
         char const * const * api,
         __eglMustCastToProperFunctionPointerType* curr,
         getProcAddressType getProcAddress)
 {
     ATRACE_CALL();
 
+    uint32_t unimplemented = 0;
     const ssize_t SIZE = 256;
     char scrap[SIZE];
     while (*api) {
@@ -298,6 +321,7 @@ void Loader::init_api(void* dso,
         if (f == NULL) {
             //ALOGD("%s", name);
             f = (__eglMustCastToProperFunctionPointerType)gl_unimplemented;
+            unimplemented++;
 
             /*
              * GL_EXT_debug_label is special, we always report it as
@@ -315,6 +339,7 @@ void Loader::init_api(void* dso,
         *curr++ = f;
         api++;
     }
+    return unimplemented;
 }
 
 static void* load_system_driver(const char* kind) {
@@ -485,6 +510,7 @@ void *Loader::load_driver(const char* kind,
 {
     ATRACE_CALL();
 
+    auto start = std::chrono::steady_clock::now();
     void* dso = nullptr;
 #ifndef __ANDROID_VNDK__
     android_namespace_t* ns = android_getDriverNamespace();
@@ -497,7 +523,9 @@ void *Loader::load_driver(const char* kind,
         if (!dso)
             return NULL;
     }
+    loadTimes.openDriversNs += elapsedNs(start);
 
+    start = std::chrono::steady_clock::now();
     if (mask & EGL) {
         getProcAddress = (getProcAddressType)dlsym(dso, "eglGetProcAddress");
 
@@ -522,20 +550,33 @@ void *Loader::load_driver(const char* kind,
             *curr++ = f;
             api++;
         }
+        loadTimes.resolveEglNs += elapsedNs(start);
     }
 
+    start = std::chrono::steady_clock::now();
     if (mask & GLESv1_CM) {
-        init_api(dso, gl_names,
+        loadTimes.unimplementedGlesEntries += init_api(dso, gl_names,
             (__eglMustCastToProperFunctionPointerType*)
                 &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
             getProcAddress);
     }
 
     if (mask & GLESv2) {
-      init_api(dso, gl_names,
-            (__eglMustCastToProperFunctionPointerType*)
-                &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
-            getProcAddress);
+        if (mask & GLESv1_CM) {
+            // A single GLES library resolves the same names to the same entry
+            // points for both versions, so only look them up once.
+            memcpy(&cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
+                    &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
+                    sizeof(cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl));
+        } else {
+            loadTimes.unimplementedGlesEntries += init_api(dso, gl_names,
+                (__eglMustCastToProperFunctionPointerType*)
+                    &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
+                getProcAddress);
+        }
+    }
+    if (mask & (GLESv1_CM | GLESv2)) {
+        loadTimes.resolveGlesNs += elapsedNs(start);
     }
 
     return dso;
@@ -21,6 +21,8 @@
 
 #include <EGL/egl.h>
 
+#include <private/EGL/display.h>
+
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
@@ -45,19 +47,25 @@ class Loader {
     
     getProcAddressType getProcAddress;
 
+    // Where the time spent in open went.
+    egl_driver_load_times_t loadTimes;
+
 public:
     static Loader& getInstance();
     ~Loader();
     
     void* open(egl_connection_t* cnx);
     void close(void* driver);
+
+    const egl_driver_load_times_t& getLoadTimes() const;
     
 private:
     Loader();
     void *load_driver(const char* kind, egl_connection_t* cnx, uint32_t mask);
 
+    // Returns the number of entry points the driver doesn't implement.
     static __attribute__((noinline))
-    void init_api(void* dso, 
+    uint32_t init_api(void* dso,
             char const * const * api, 
             __eglMustCastToProperFunctionPointerType* curr, 
             getProcAddressType getProcAddress); 
@@ -33,10 +33,10 @@
 #include <cutils/properties.h>
 #include <log/log.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
-#include <unordered_map>
 #include <string>
 #include <thread>
 
@@ -44,6 +44,7 @@
 
 #include "egl_display.h"
 #include "egl_object.h"
+#include "egl_stats.h"
 #include "egl_tls.h"
 #include "egl_trace.h"
 
@@ -246,11 +247,73 @@ static const extention_map_t sExtensionMap[] = {
          !strcmp((procname), "eglAwakenProcessIMG"))
 
 // accesses protected by sExtensionMapMutex
-static std::unordered_map<std::string, __eglMustCastToProperFunctionPointerType> sGLExtentionMap;
-
 static int sGLExtentionSlot = 0;
 static pthread_mutex_t sExtensionMapMutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * sProcAddressCache remembers what eglGetProcAddress() returned for each name
+ * it was asked for, builtin or extension, found or not, as engines ask for the
+ * same names over and over. It is an open-addressing hash table that is read
+ * without locking: entries are only ever added, under sExtensionMapMutex, and
+ * an entry's name is published after its address.
+ */
+struct proc_address_cache_entry_t {
+    std::atomic<const char*> name;
+    __eglMustCastToProperFunctionPointerType address;
+};
+
+static constexpr size_t PROC_ADDRESS_CACHE_SIZE = 2048;
+// Probes stay short as long as the table is at most 3/4 full.
+static constexpr size_t PROC_ADDRESS_CACHE_MAX_ENTRIES = PROC_ADDRESS_CACHE_SIZE / 4 * 3;
+
+static proc_address_cache_entry_t sProcAddressCache[PROC_ADDRESS_CACHE_SIZE];
+static size_t sProcAddressCacheEntries = 0; // protected by sExtensionMapMutex
+
+static size_t hashProcName(const char* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ uint8_t(*c)) * 16777619u;
+    }
+    return hash;
+}
+
+static bool findCachedProcAddress(const char* name,
+        __eglMustCastToProperFunctionPointerType* address) {
+    size_t mask = PROC_ADDRESS_CACHE_SIZE - 1;
+    for (size_t i = hashProcName(name) & mask; ; i = (i + 1) & mask) {
+        const proc_address_cache_entry_t& entry = sProcAddressCache[i];
+        const char* entryName = entry.name.load(std::memory_order_acquire);
+        if (entryName == nullptr) {
+            return false;
+        }
+        if (!strcmp(entryName, name)) {
+            *address = entry.address;
+            return true;
+        }
+    }
+}
+
+static void cacheProcAddressLocked(const char* name,
+        __eglMustCastToProperFunctionPointerType address) {
+    if (sProcAddressCacheEntries >= PROC_ADDRESS_CACHE_MAX_ENTRIES) {
+        return;
+    }
+    size_t mask = PROC_ADDRESS_CACHE_SIZE - 1;
+    size_t i = hashProcName(name) & mask;
+    while (sProcAddressCache[i].name.load(std::memory_order_relaxed) != nullptr) {
+        i = (i + 1) & mask;
+    }
+    // The copy of the name is never freed, like the table.
+    const char* entryName = strdup(name);
+    if (entryName == nullptr) {
+        return;
+    }
+    sProcAddressCache[i].address = address;
+    sProcAddressCache[i].name.store(entryName, std::memory_order_release);
+    sProcAddressCacheEntries++;
+}
+
 static void(*findProcAddress(const char* name,
         const extention_map_t* map, size_t n))() {
     for (uint32_t i=0 ; i<n ; i++) {
@@ -323,6 +386,10 @@ EGLBoolean eglTerminate(EGLDisplay dpy)
     egl_display_ptr dp = get_display(dpy);
     if (!dp) return setError(EGL_BAD_DISPLAY, (EGLBoolean)EGL_FALSE);
 
+    // Apps that terminate the display when they go to the background report
+    // their stats here.
+    egl_report_gpu_stats();
+
     EGLBoolean res = dp->terminate();
 
     return res;
@@ -857,9 +924,15 @@ EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
         return setError(EGL_BAD_SURFACE, (EGLBoolean)EGL_FALSE);
 
     egl_surface_t * const s = get_surface(surface);
+    const bool isWindow = s->getNativeWindow() != nullptr;
     EGLBoolean result = s->cnx->egl.eglDestroySurface(dp->disp.dpy, s->surface);
     if (result == EGL_TRUE) {
         _s.terminate();
+        // A window going away is a good time to report what it took to set it
+        // up, e.g. when an activity is destroyed.
+        if (isWindow) {
+            egl_report_gpu_stats();
+        }
     }
     return result;
 }
@@ -1178,6 +1251,56 @@ static __eglMustCastToProperFunctionPointerType findBuiltinWrapper(
     return NULL;
 }
 
+// Called with sExtensionMapMutex held, the first time a name is asked for.
+static __eglMustCastToProperFunctionPointerType findUncachedProcAddress(
+        const char* procname) {
+    __eglMustCastToProperFunctionPointerType addr;
+    addr = findProcAddress(procname, sExtensionMap, NELEM(sExtensionMap));
+    if (addr) return addr;
+
+    addr = findBuiltinWrapper(procname);
+    if (addr) return addr;
+
+    /*
+     * Since eglGetProcAddress() is not associated to anything, it needs
+     * to return a function pointer that "works" regardless of what
+     * the current context is.
+     *
+     * For this reason, we return a "forwarder", a small stub that takes
+     * care of calling the function associated with the context
+     * currently bound.
+     *
+     * This is the first time we're seeing this extension, so we go through
+     * all our implementations and call eglGetProcAddress() and record the
+     * result in the appropriate implementation hooks and return the
+     * address of the forwarder corresponding to that hook set.
+     *
+     */
+
+    const int slot = sGLExtentionSlot;
+
+    ALOGE_IF(slot >= MAX_NUMBER_OF_GL_EXTENSIONS,
+            "no more slots for eglGetProcAddress(\"%s\")",
+            procname);
+
+    if (slot < MAX_NUMBER_OF_GL_EXTENSIONS) {
+        egl_connection_t* const cnx = &gEGLImpl;
+        if (cnx->dso && cnx->egl.eglGetProcAddress) {
+            // Extensions are independent of the bound context
+            addr =
+            cnx->hooks[egl_connection_t::GLESv1_INDEX]->ext.extensions[slot] =
+            cnx->hooks[egl_connection_t::GLESv2_INDEX]->ext.extensions[slot] =
+                    cnx->egl.eglGetProcAddress(procname);
+        }
+
+        if (addr) {
+            addr = gExtensionForwarders[slot];
+            sGLExtentionSlot++;
+        }
+    }
+    return addr;
+}
+
 __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
 {
     // eglGetProcAddress() could be the very first function called
@@ -1186,6 +1309,13 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
 
     clearError();
 
+    // Names are only cached once the drivers are initialized, and filtered
+    // names are never cached.
+    __eglMustCastToProperFunctionPointerType addr;
+    if (findCachedProcAddress(procname, &addr)) {
+        return addr;
+    }
+
     if (egl_init_drivers() == EGL_FALSE) {
         setError(EGL_BAD_PARAMETER, NULL);
         return  NULL;
@@ -1195,64 +1325,13 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
         return NULL;
     }
 
-    __eglMustCastToProperFunctionPointerType addr;
-    addr = findProcAddress(procname, sExtensionMap, NELEM(sExtensionMap));
-    if (addr) return addr;
-
-    addr = findBuiltinWrapper(procname);
-    if (addr) return addr;
-
-    // this protects accesses to sGLExtentionMap and sGLExtentionSlot
+    // this protects accesses to sGLExtentionSlot and to additions to
+    // sProcAddressCache
     pthread_mutex_lock(&sExtensionMapMutex);
-
-        /*
-         * Since eglGetProcAddress() is not associated to anything, it needs
-         * to return a function pointer that "works" regardless of what
-         * the current context is.
-         *
-         * For this reason, we return a "forwarder", a small stub that takes
-         * care of calling the function associated with the context
-         * currently bound.
-         *
-         * We first look for extensions we've already resolved, if we're seeing
-         * this extension for the first time, we go through all our
-         * implementations and call eglGetProcAddress() and record the
-         * result in the appropriate implementation hooks and return the
-         * address of the forwarder corresponding to that hook set.
-         *
-         */
-
-        const std::string name(procname);
-
-    auto& extentionMap = sGLExtentionMap;
-    auto pos = extentionMap.find(name);
-        addr = (pos != extentionMap.end()) ? pos->second : nullptr;
-        const int slot = sGLExtentionSlot;
-
-        ALOGE_IF(slot >= MAX_NUMBER_OF_GL_EXTENSIONS,
-                "no more slots for eglGetProcAddress(\"%s\")",
-                procname);
-
-        if (!addr && (slot < MAX_NUMBER_OF_GL_EXTENSIONS)) {
-            bool found = false;
-
-            egl_connection_t* const cnx = &gEGLImpl;
-            if (cnx->dso && cnx->egl.eglGetProcAddress) {
-                // Extensions are independent of the bound context
-                addr =
-                cnx->hooks[egl_connection_t::GLESv1_INDEX]->ext.extensions[slot] =
-                cnx->hooks[egl_connection_t::GLESv2_INDEX]->ext.extensions[slot] =
-                        cnx->egl.eglGetProcAddress(procname);
-                if (addr) found = true;
-            }
-
-            if (found) {
-                addr = gExtensionForwarders[slot];
-                extentionMap[name] = addr;
-                sGLExtentionSlot++;
-            }
-        }
-
+    if (!findCachedProcAddress(procname, &addr)) {
+        addr = findUncachedProcAddress(procname);
+        cacheProcAddressLocked(procname, addr);
+    }
     pthread_mutex_unlock(&sExtensionMapMutex);
     return addr;
 }
@@ -19,6 +19,7 @@
 #include "../egl_impl.h"
 
 #include "egl_display.h"
+#include "egl_stats.h"
 
 #include <private/EGL/cache.h>
 
@@ -26,12 +27,25 @@
 
 #include <thread>
 
+#include <cutils/properties.h>
 #include <log/log.h>
 
-// Cache size limits.
+#ifndef __ANDROID_VNDK__
+#include <graphicsenv/GraphicsEnv.h>
+#endif
+
+// Cache size limits.  The value and total sizes default to the device's
+// ro.egl.blob_cache.max_value_size and ro.egl.blob_cache.max_total_size, and
+// apps can be given a different total size through GraphicsEnv.
 static const size_t maxKeySize = 12 * 1024;
-static const size_t maxValueSize = 64 * 1024;
-static const size_t maxTotalSize = 2 * 1024 * 1024;
+static const size_t defaultMaxValueSize = 64 * 1024;
+static const size_t defaultMaxTotalSize = 4 * 1024 * 1024;
+
+// The system cache is a read-only cache file, in the same format as the app
+// caches, of the shaders that are common to the device's processes.  Its
+// mapping is shared by all of them.
+static const char* systemCacheFilename = "/system/etc/egl_blob_cache";
+static const size_t systemCacheMaxTotalSize = 8 * 1024 * 1024;
 
 // The time in seconds to wait before saving newly inserted cache entries.
 static const unsigned int deferredSaveDelay = 4;
@@ -47,6 +61,10 @@ void egl_set_cache_filename(const char* filename) {
     egl_cache_t::get()->setCacheFilename(filename);
 }
 
+void egl_get_cache_stats(egl_cache_stats_t* stats) {
+    *stats = egl_cache_t::get()->getStats();
+}
+
 //
 // Callback functions passed to EGL.
 //
@@ -64,7 +82,10 @@ static EGLsizeiANDROID getBlob(const void* key, EGLsizeiANDROID keySize,
 // egl_cache_t definition
 //
 egl_cache_t::egl_cache_t() :
-        mInitialized(false) {
+        mInitialized(false),
+        mMaxTotalSize(0),
+        mSavePending(false),
+        mJournalSize(0) {
 }
 
 egl_cache_t::~egl_cache_t() {
@@ -115,11 +136,16 @@ void egl_cache_t::initialize(egl_display_t *display) {
 }
 
 void egl_cache_t::terminate() {
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (mBlobCache) {
-        mBlobCache->writeToFile();
+    std::lock_guard<std::mutex> writeLock(mWriteMutex);
+    std::string filename;
+    std::vector<uint8_t> journal;
+    std::vector<uint8_t> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        takePendingSaveLocked(&filename, &journal, &snapshot);
+        mBlobCache = NULL;
     }
-    mBlobCache = NULL;
+    writePendingSave(filename, &journal, &snapshot);
 }
 
 void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
@@ -134,16 +160,27 @@ void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
     if (mInitialized) {
         BlobCache* bc = getBlobCacheLocked();
         bc->set(key, keySize, value, valueSize);
+        if (!mBlobCache->getFilename().empty()) {
+            FileBlobCache::addJournalEntry(key, keySize, value, valueSize, &mPendingJournal);
+        }
 
         if (!mSavePending) {
             mSavePending = true;
             std::thread deferredSaveThread([this]() {
                 sleep(deferredSaveDelay);
-                std::lock_guard<std::mutex> lock(mMutex);
-                if (mInitialized && mBlobCache) {
-                    mBlobCache->writeToFile();
+                std::lock_guard<std::mutex> writeLock(mWriteMutex);
+                std::string filename;
+                std::vector<uint8_t> journal;
+                std::vector<uint8_t> snapshot;
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    if (mInitialized) {
+                        takePendingSaveLocked(&filename, &journal, &snapshot);
+                    }
+                    mSavePending = false;
                 }
-                mSavePending = false;
+                writePendingSave(filename, &journal, &snapshot);
+                egl_report_gpu_stats();
             });
             deferredSaveThread.detach();
         }
@@ -161,7 +198,11 @@ EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
 
     if (mInitialized) {
         BlobCache* bc = getBlobCacheLocked();
-        return bc->get(key, keySize, value, valueSize);
+        EGLsizeiANDROID size = bc->get(key, keySize, value, valueSize);
+        if (size == 0 && mSystemBlobCache) {
+            size = mSystemBlobCache->get(key, keySize, value, valueSize);
+        }
+        return size;
     }
     return 0;
 }
@@ -171,9 +212,71 @@ void egl_cache_t::setCacheFilename(const char* filename) {
     mFilename = filename;
 }
 
+egl_cache_stats_t egl_cache_t::getStats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    egl_cache_stats_t stats = {};
+    stats.maxTotalSize = mMaxTotalSize;
+    if (mSystemBlobCache) {
+        stats.systemHits = mSystemBlobCache->getStats().hits;
+    }
+    if (mBlobCache) {
+        BlobCache::Stats bcStats = mBlobCache->getStats();
+        stats.hits = bcStats.hits;
+        stats.misses = bcStats.misses;
+        stats.evictions = bcStats.evictions;
+        stats.entries = bcStats.entries;
+        stats.totalSize = bcStats.totalSize;
+    }
+    return stats;
+}
+
+void egl_cache_t::takePendingSaveLocked(std::string* filename, std::vector<uint8_t>* journal,
+        std::vector<uint8_t>* snapshot) {
+    if (!mBlobCache || mPendingJournal.empty()) {
+        return;
+    }
+    *filename = mBlobCache->getFilename();
+    if (mJournalSize + mPendingJournal.size() > mMaxTotalSize &&
+            mBlobCache->serialize(snapshot)) {
+        // The snapshot holds the pending entries too.
+        mPendingJournal.clear();
+        mJournalSize = 0;
+        return;
+    }
+    journal->swap(mPendingJournal);
+    mJournalSize += journal->size();
+}
+
+void egl_cache_t::writePendingSave(const std::string& filename, std::vector<uint8_t>* journal,
+        std::vector<uint8_t>* snapshot) {
+    if (!snapshot->empty()) {
+        FileBlobCache::writeFile(filename, snapshot);
+    } else if (!journal->empty()) {
+        FileBlobCache::appendToJournal(filename, journal);
+    }
+}
+
 BlobCache* egl_cache_t::getBlobCacheLocked() {
     if (mBlobCache == nullptr) {
-        mBlobCache.reset(new FileBlobCache(maxKeySize, maxValueSize, maxTotalSize, mFilename));
+        size_t maxValueSize = property_get_int64("ro.egl.blob_cache.max_value_size",
+                defaultMaxValueSize);
+        mMaxTotalSize = property_get_int64("ro.egl.blob_cache.max_total_size",
+                defaultMaxTotalSize);
+#ifndef __ANDROID_VNDK__
+        size_t appMaxTotalSize = GraphicsEnv::getInstance().getBlobCacheMaxTotalSize();
+        if (appMaxTotalSize != 0) {
+            mMaxTotalSize = appMaxTotalSize;
+        }
+#endif
+        ALOGV("blob cache limits: %zu byte values, %zu bytes in total", maxValueSize,
+                mMaxTotalSize);
+        mBlobCache.reset(new FileBlobCache(maxKeySize, maxValueSize, mMaxTotalSize, mFilename));
+        if (!mSystemBlobCache && access(systemCacheFilename, R_OK) == 0) {
+            mSystemBlobCache.reset(new FileBlobCache(maxKeySize, maxValueSize,
+                    systemCacheMaxTotalSize, systemCacheFilename));
+        }
+        mPendingJournal.clear();
+        mJournalSize = mBlobCache->getJournalSize();
     }
     return mBlobCache.get();
 }
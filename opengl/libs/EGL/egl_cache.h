@@ -22,9 +22,12 @@
 
 #include "FileBlobCache.h"
 
+#include <private/EGL/cache.h>
+
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -67,6 +70,9 @@ public:
     // cache contents from one program invocation to another.
     void setCacheFilename(const char* filename);
 
+    // getStats returns the statistics of the cache since it was last loaded.
+    egl_cache_stats_t getStats();
+
 private:
     // Creation and (the lack of) destruction is handled internally.
     egl_cache_t();
@@ -82,6 +88,18 @@ private:
     // possible.
     BlobCache* getBlobCacheLocked();
 
+    // takePendingSaveLocked moves the journal entries that are pending to
+    // journal.  Once the journal has grown larger than the cache, it instead
+    // serializes the whole cache to snapshot, to compact the journal.
+    void takePendingSaveLocked(std::string* filename, std::vector<uint8_t>* journal,
+            std::vector<uint8_t>* snapshot);
+
+    // writePendingSave writes what takePendingSaveLocked returned.  It must
+    // be called with mWriteMutex held but without mMutex, so that the
+    // checksums and the file I/O don't block the driver.
+    static void writePendingSave(const std::string& filename, std::vector<uint8_t>* journal,
+            std::vector<uint8_t>* snapshot);
+
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
@@ -95,6 +113,15 @@ private:
     // first time it's needed.
     std::unique_ptr<FileBlobCache> mBlobCache;
 
+    // mSystemBlobCache is the read-only system-wide cache, looked up when a
+    // key is not in mBlobCache.  It is NULL if the device has none.  It is
+    // loaded with mBlobCache, and never saved.
+    std::unique_ptr<FileBlobCache> mSystemBlobCache;
+
+    // mMaxTotalSize is the total size limit of mBlobCache, which is set when
+    // it is created.
+    size_t mMaxTotalSize;
+
     // mFilename is the name of the file for storing cache contents in between
     // program invocations.  It is initialized to an empty string at
     // construction time, and can be set with the setCacheFilename method.  An
@@ -109,10 +136,23 @@ private:
     // contents to disk.
     bool mSavePending;
 
+    // mPendingJournal holds the key/value pairs inserted via setBlob since
+    // the last save, which the deferred save appends to the journal file.
+    std::vector<uint8_t> mPendingJournal;
+
+    // mJournalSize is the size of the journal file, including the pending
+    // entries that are being written to it.
+    size_t mJournalSize;
+
     // mMutex is the mutex used to prevent concurrent access to the member
     // variables. It must be locked whenever the member variables are accessed.
     mutable std::mutex mMutex;
 
+    // mWriteMutex serializes saves, so that the cache file and journal are
+    // written in the order their contents were taken.  It is locked before
+    // mMutex, and held while writing to disk.
+    std::mutex mWriteMutex;
+
     // sCache is the singleton egl_cache_t object.
     static egl_cache_t sCache;
 };
@@ -70,6 +70,10 @@ int egl_get_init_count(EGLDisplay dpy) {
     return eglDisplay ? eglDisplay->getRefsCount() : 0;
 }
 
+void egl_get_driver_load_times(egl_driver_load_times_t* times) {
+    *times = Loader::getInstance().getLoadTimes();
+}
+
 egl_display_t egl_display_t::sDisplay[NUM_DISPLAYS];
 
 egl_display_t::egl_display_t() :
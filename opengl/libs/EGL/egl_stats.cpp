@@ -0,0 +1,97 @@
+/*
+ ** Copyright 2018, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "egl_stats.h"
+
+#include "../egl_impl.h"
+
+#include <private/EGL/cache.h>
+#include <private/EGL/display.h>
+#include <private/EGL/shader.h>
+
+#include <atomic>
+#include <mutex>
+
+#ifndef __ANDROID_VNDK__
+#include <graphicsenv/GpuStats.h>
+#include <graphicsenv/GraphicsEnv.h>
+#endif
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+static std::atomic<uint64_t> sShaderCompiles(0);
+static std::atomic<int64_t> sShaderCompileNs(0);
+static std::atomic<uint64_t> sProgramLinks(0);
+static std::atomic<int64_t> sProgramLinkNs(0);
+
+void egl_record_shader_compile(int64_t durationNs) {
+    sShaderCompiles.fetch_add(1, std::memory_order_relaxed);
+    sShaderCompileNs.fetch_add(durationNs, std::memory_order_relaxed);
+}
+
+void egl_record_program_link(int64_t durationNs) {
+    sProgramLinks.fetch_add(1, std::memory_order_relaxed);
+    sProgramLinkNs.fetch_add(durationNs, std::memory_order_relaxed);
+}
+
+void egl_get_shader_stats(egl_shader_stats_t* stats) {
+    stats->compiles = sShaderCompiles.load(std::memory_order_relaxed);
+    stats->compileNs = sShaderCompileNs.load(std::memory_order_relaxed);
+    stats->links = sProgramLinks.load(std::memory_order_relaxed);
+    stats->linkNs = sProgramLinkNs.load(std::memory_order_relaxed);
+}
+
+void egl_report_gpu_stats() {
+#ifndef __ANDROID_VNDK__
+    egl_cache_stats_t cacheStats;
+    egl_get_cache_stats(&cacheStats);
+    egl_shader_stats_t shaderStats;
+    egl_get_shader_stats(&shaderStats);
+    egl_driver_load_times_t loadTimes;
+    egl_get_driver_load_times(&loadTimes);
+
+    GpuStats stats;
+    stats.blobCacheHits = cacheStats.hits;
+    stats.blobCacheMisses = cacheStats.misses;
+    stats.blobCacheSystemHits = cacheStats.systemHits;
+    stats.blobCacheEvictions = cacheStats.evictions;
+    stats.blobCacheTotalSize = cacheStats.totalSize;
+    stats.shaderCompiles = shaderStats.compiles;
+    stats.shaderCompileNs = shaderStats.compileNs;
+    stats.programLinks = shaderStats.links;
+    stats.programLinkNs = shaderStats.linkNs;
+    stats.driverLoadNs = loadTimes.totalNs;
+
+    // Processes that load EGL without using it, like the zygote, never send
+    // anything.
+    static std::mutex sLastStatsMutex;
+    static GpuStats sLastStats;
+    {
+        std::lock_guard<std::mutex> lock(sLastStatsMutex);
+        if (stats == sLastStats) {
+            return;
+        }
+        sLastStats = stats;
+    }
+    GraphicsEnv::getInstance().sendGpuStats(stats);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
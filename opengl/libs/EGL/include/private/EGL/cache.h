@@ -16,10 +16,31 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <cutils/compiler.h>
 
 namespace android {
 
 ANDROID_API void egl_set_cache_filename(const char* filename);
 
+// egl_cache_stats_t is a snapshot of the blob cache statistics, counted since
+// the cache was last loaded.
+struct egl_cache_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // systemHits counts the lookups that missed the app's cache, but were found
+    // in the read-only system cache.
+    uint64_t systemHits;
+    size_t entries;
+    size_t totalSize;
+    size_t maxTotalSize;
+};
+
+// egl_get_cache_stats fills stats with the blob cache statistics, e.g. for
+// dumpsys gfxinfo.
+ANDROID_API void egl_get_cache_stats(egl_cache_stats_t* stats);
+
 } // namespace android
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <EGL/egl.h>
 
 #include <cutils/compiler.h>
@@ -24,4 +26,23 @@ namespace android {
 
 ANDROID_API int egl_get_init_count(EGLDisplay dpy);
 
+// egl_driver_load_times_t breaks down the time it took to load the EGL and
+// GLES driver, in nanoseconds.
+struct egl_driver_load_times_t {
+    // openDriversNs is spent opening the driver libraries.
+    int64_t openDriversNs;
+    // resolveEglNs and resolveGlesNs are spent looking up their entry points.
+    int64_t resolveEglNs;
+    int64_t resolveGlesNs;
+    // openWrappersNs is spent opening the system EGL and GLES libraries.
+    int64_t openWrappersNs;
+    int64_t totalNs;
+    // unimplementedGlesEntries counts the GLES entry points the driver lacks.
+    uint32_t unimplementedGlesEntries;
+};
+
+// egl_get_driver_load_times fills times with the cost of loading the driver,
+// e.g. for dumpsys; they are all 0 until the driver is loaded.
+ANDROID_API void egl_get_driver_load_times(egl_driver_load_times_t* times);
+
 } // namespace android
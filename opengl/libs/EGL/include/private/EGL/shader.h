@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <cutils/compiler.h>
+
+namespace android {
+
+// egl_shader_stats_t counts the glCompileShader and glLinkProgram calls of the
+// process, with the time the driver spent in them, in nanoseconds.  Drivers
+// that compile lazily do part of that work in later calls, which isn't counted.
+struct egl_shader_stats_t {
+    uint64_t compiles;
+    int64_t compileNs;
+    uint64_t links;
+    int64_t linkNs;
+};
+
+// egl_get_shader_stats fills stats with the shader statistics of the process.
+ANDROID_API void egl_get_shader_stats(egl_shader_stats_t* stats);
+
+} // namespace android
@@ -16,6 +16,11 @@
 
 #include <string.h>
 
+#ifndef _WIN32
+#include <thread>
+#include <vector>
+#endif
+
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
  The number of bits that represent a 4x4 texel block is 64 bits if
@@ -163,9 +168,19 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
+// pOut is the top left pixel of the block, and stride the size of a row of
+// pixels in bytes.
+
 static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
+void decode_subblock(etc1_byte* pOut, etc1_uint32 stride, int r, int g, int b,
+        const int* table, etc1_uint32 low, bool second, bool flipped) {
+    // A subblock only has 4 colors: clamp them once instead of once per pixel.
+    etc1_byte colors[4][3];
+    for (int i = 0; i < 4; i++) {
+        colors[i][0] = clamp(r + table[i]);
+        colors[i][1] = clamp(g + table[i]);
+        colors[i][2] = clamp(b + table[i]);
+    }
     int baseX = 0;
     int baseY = 0;
     if (second) {
@@ -186,18 +201,16 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
         }
         int k = y + (x * 4);
         int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+        const etc1_byte* color = colors[offset];
+        etc1_byte* q = pOut + 3 * x + stride * y;
+        *q++ = color[0];
+        *q++ = color[1];
+        *q++ = color[2];
     }
 }
 
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
-
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+static
+void decode_block(const etc1_byte* pIn, etc1_byte* pOut, etc1_uint32 stride) {
     etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
     etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
     int r1, r2, g1, g2, b1, b2;
@@ -226,8 +239,15 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     const int* tableA = kModifierTable + tableIndexA * 4;
     const int* tableB = kModifierTable + tableIndexB * 4;
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    decode_subblock(pOut, stride, r1, g1, b1, tableA, low, false, flipped);
+    decode_subblock(pOut, stride, r2, g2, b2, tableB, low, true, flipped);
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    decode_block(pIn, pOut, 4 * 3);
 }
 
 typedef struct {
@@ -429,9 +449,14 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
     pBaseColors[5] = b2;
 }
 
+// With ETC1_QUALITY_FAST, the search over the modifier tables of a subblock
+// stops at the first table that does worse than the previous one: the error
+// of a subblock is usually convex in the table index.
+
 static
 void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
-        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped) {
+        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped,
+        int quality) {
     pCompressed->score = ~0;
     pCompressed->high = (flipped ? 1 : 0);
     pCompressed->low = 0;
@@ -442,7 +467,9 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
 
     int originalHigh = pCompressed->high;
 
+    const bool fast = quality == ETC1_QUALITY_FAST;
     const int* pModifierTable = kModifierTable;
+    etc1_uint32 previousScore = ~0;
     for (int i = 0; i < 8; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = 0;
@@ -450,10 +477,15 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
         temp.low = 0;
         etc_encode_subblock_helper(pIn, inMask, &temp, flipped, false,
                 pBaseColors, pModifierTable);
+        if (fast && temp.score > previousScore) {
+            break;
+        }
+        previousScore = temp.score;
         take_best(pCompressed, &temp);
     }
     pModifierTable = kModifierTable;
     etc_compressed firstHalf = *pCompressed;
+    previousScore = ~0;
     for (int i = 0; i < 8; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = firstHalf.score;
@@ -461,6 +493,10 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
         temp.low = firstHalf.low;
         etc_encode_subblock_helper(pIn, inMask, &temp, flipped, true,
                 pBaseColors + 3, pModifierTable);
+        if (fast && temp.score > previousScore) {
+            break;
+        }
+        previousScore = temp.score;
         if (i == 0) {
             *pCompressed = temp;
         } else {
@@ -469,6 +505,28 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
     }
 }
 
+// Returns the weighted squared error of the pixels of the two subblocks to
+// their average colors, which is how well an orientation can do at best.
+
+static
+etc1_uint32 etc_orientation_error(const etc1_byte* pIn, etc1_uint32 inMask,
+        const etc1_byte* pColors, bool flipped) {
+    etc1_uint32 error = 0;
+    for (int i = 0; i < 16; i++) {
+        if (!(inMask & (1 << i))) {
+            continue;
+        }
+        int x = i & 3;
+        int y = i >> 2;
+        bool second = flipped ? y >= 2 : x >= 2;
+        const etc1_byte* p = pIn + i * 3;
+        const etc1_byte* c = pColors + (second ? 3 : 0);
+        error += 3 * square(p[0] - c[0]) + 6 * square(p[1] - c[1])
+                + square(p[2] - c[2]);
+    }
+    return error;
+}
+
 static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
     pOut[0] = (etc1_byte)(d >> 24);
     pOut[1] = (etc1_byte)(d >> 16);
@@ -481,8 +539,9 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 // pixel is valid or not. Invalid pixel color values are ignored when compressing.
 // Output is an ETC1 compressed version of the data.
 
-void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
-        etc1_byte* pOut) {
+static
+void etc_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut, int quality) {
     etc1_byte colors[6];
     etc1_byte flippedColors[6];
     etc_average_colors_subblock(pIn, inMask, colors, false, false);
@@ -491,29 +550,39 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
     etc_average_colors_subblock(pIn, inMask, flippedColors + 3, true, true);
 
     etc_compressed a, b;
-    etc_encode_block_helper(pIn, inMask, colors, &a, false);
-    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true);
-    take_best(&a, &b);
+    if (quality == ETC1_QUALITY_FAST) {
+        // Only encode the orientation that fits the pixels best.
+        bool flipped = etc_orientation_error(pIn, inMask, flippedColors, true)
+                < etc_orientation_error(pIn, inMask, colors, false);
+        etc_encode_block_helper(pIn, inMask, flipped ? flippedColors : colors,
+                &a, flipped, quality);
+    } else {
+        etc_encode_block_helper(pIn, inMask, colors, &a, false, quality);
+        etc_encode_block_helper(pIn, inMask, flippedColors, &b, true, quality);
+        take_best(&a, &b);
+    }
     writeBigEndian(pOut, a.high);
     writeBigEndian(pOut + 4, a.low);
 }
 
+void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut) {
+    etc_encode_block(pIn, inMask, pOut, ETC1_QUALITY_HIGH);
+}
+
 // Return the size of the encoded image data (does not include size of PKM header).
 
 etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
     return (((width + 3) & ~3) * ((height + 3) & ~3)) >> 1;
 }
 
-// Encode an entire image.
-// pIn - pointer to the image data. Formatted such that the Red component of
-//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
-// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+// Encode the rows of blocks of an image from pixel row yBegin to yEnd.
+// pOut - pointer to the encoded data of the block row at yBegin.
 
-int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
+static void etc_encode_rows(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, etc1_uint32 yBegin, etc1_uint32 yEndRow,
+        int quality) {
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
@@ -521,9 +590,8 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
     etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    for (etc1_uint32 y = yBegin; y < yEndRow; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -550,11 +618,79 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
                     }
                 }
             }
-            etc1_encode_block(block, mask, encoded);
+            etc_encode_block(block, mask, encoded, quality);
             memcpy(pOut, encoded, sizeof(encoded));
             pOut += sizeof(encoded);
         }
     }
+}
+
+// Images with fewer rows of blocks per thread are encoded on fewer threads.
+static const etc1_uint32 kMinBlockRowsPerThread = 16;
+
+// Encode an entire image.
+// pIn - pointer to the image data. Formatted such that the Red component of
+//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
+// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+
+int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    return etc1_encode_image_quality(pIn, width, height, pixelSize, stride,
+            pOut, ETC1_QUALITY_HIGH, 0);
+}
+
+int etc1_encode_image_quality(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, int quality, etc1_uint32 threadCount) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    if (quality != ETC1_QUALITY_FAST && quality != ETC1_QUALITY_HIGH) {
+        return -1;
+    }
+
+    etc1_uint32 encodedHeight = (height + 3) & ~3;
+    etc1_uint32 blockRows = encodedHeight / 4;
+
+#ifdef _WIN32
+    threadCount = 1;
+#else
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+#endif
+    if (threadCount > blockRows / kMinBlockRowsPerThread) {
+        threadCount = blockRows / kMinBlockRowsPerThread;
+    }
+    if (threadCount <= 1) {
+        etc_encode_rows(pIn, width, height, pixelSize, stride, pOut, 0,
+                encodedHeight, quality);
+        return 0;
+    }
+
+#ifndef _WIN32
+    // Each thread encodes a contiguous range of block rows, and the calling
+    // thread encodes the last one.
+    const etc1_uint32 rowSize = ((width + 3) & ~3) / 4 * ETC1_ENCODED_BLOCK_SIZE;
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    etc1_uint32 blockRow = 0;
+    for (etc1_uint32 i = 0; i < threadCount; i++) {
+        etc1_uint32 end = blockRows * (i + 1) / threadCount;
+        etc1_byte* out = pOut + rowSize * blockRow;
+        if (i + 1 < threadCount) {
+            threads.emplace_back(etc_encode_rows, pIn, width, height, pixelSize,
+                    stride, out, blockRow * 4, end * 4, quality);
+        } else {
+            etc_encode_rows(pIn, width, height, pixelSize, stride, out,
+                    blockRow * 4, end * 4, quality);
+        }
+        blockRow = end;
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#endif
     return 0;
 }
 
@@ -586,7 +722,13 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
             if (xEnd > 4) {
                 xEnd = 4;
             }
-            etc1_decode_block(pIn, block);
+            if (pixelSize == 3 && xEnd == 4 && yEnd == 4) {
+                // Whole blocks are decoded in place.
+                decode_block(pIn, pOut + pixelSize * x + stride * y, stride);
+                pIn += ETC1_ENCODED_BLOCK_SIZE;
+                continue;
+            }
+            decode_block(pIn, block, 4 * 3);
             pIn += ETC1_ENCODED_BLOCK_SIZE;
             for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
                 const etc1_byte* q = block + (cy * 4) * 3;
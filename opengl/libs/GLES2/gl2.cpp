@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 
 #include <log/log.h>
 #include <cutils/properties.h>
@@ -298,6 +299,8 @@ extern "C" {
     void __glGetFloatv(GLenum pname, GLfloat * data);
     void __glGetIntegerv(GLenum pname, GLint * data);
     void __glGetInteger64v(GLenum pname, GLint64 * data);
+    void __glCompileShader(GLuint shader);
+    void __glLinkProgram(GLuint program);
 }
 
 const GLubyte * glGetString(GLenum name) {
@@ -369,3 +372,32 @@ void glGetInteger64v(GLenum pname, GLint64 * data) {
     gl_hooks_t::gl_t const * const _c = &getGlThreadSpecific()->gl;
     if (_c) _c->glGetInteger64v(pname, data);
 }
+
+/*
+ * glCompileShader() and glLinkProgram() are timed for the shader statistics
+ * reported by EGL.
+ */
+
+static int64_t systemTimeNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+void glCompileShader(GLuint shader) {
+    gl_hooks_t::gl_t const * const _c = &getGlThreadSpecific()->gl;
+    if (_c) {
+        int64_t start = systemTimeNs();
+        _c->glCompileShader(shader);
+        egl_record_shader_compile(systemTimeNs() - start);
+    }
+}
+
+void glLinkProgram(GLuint program) {
+    gl_hooks_t::gl_t const * const _c = &getGlThreadSpecific()->gl;
+    if (_c) {
+        int64_t start = systemTimeNs();
+        _c->glLinkProgram(program);
+        egl_record_program_link(systemTimeNs() - start);
+    }
+}
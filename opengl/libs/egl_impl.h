@@ -31,6 +31,11 @@ EGLAPI const GLubyte * egl_get_string_for_current_context(GLenum name);
 EGLAPI const GLubyte * egl_get_string_for_current_context(GLenum name, GLuint index);
 EGLAPI GLint egl_get_num_extensions_for_current_context();
 
+// Called by the GLES wrappers with the time spent in glCompileShader and
+// glLinkProgram, for egl_get_shader_stats.
+EGLAPI void egl_record_shader_compile(int64_t durationNs);
+EGLAPI void egl_record_program_link(int64_t durationNs);
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 // ----------------------------------------------------------------------------
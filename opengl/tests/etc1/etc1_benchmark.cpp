@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encodes and decodes a 1024x1024 RGB image. EncodeHigh on one thread is the
+// encoder as it was before the quality and thread parameters were added.
+
+#include <benchmark/benchmark.h>
+
+#include <ETC1/etc1.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace {
+
+const etc1_uint32 kSize = 1024;
+const etc1_uint32 kStride = kSize * 3;
+
+// A smooth image with some noise, closer to real textures than random data.
+const std::vector<etc1_byte>& getImage() {
+    static std::vector<etc1_byte> image = [] {
+        std::vector<etc1_byte> pixels(kStride * kSize);
+        srand(1);
+        for (etc1_uint32 y = 0; y < kSize; y++) {
+            for (etc1_uint32 x = 0; x < kSize; x++) {
+                etc1_byte* p = &pixels[y * kStride + x * 3];
+                p[0] = (x + y) / 8;
+                p[1] = 128 + 100 * sin(x / 40.0) * cos(y / 30.0);
+                p[2] = (x * y / 97 + rand() % 8) & 0xff;
+            }
+        }
+        return pixels;
+    }();
+    return image;
+}
+
+void benchmarkEncode(benchmark::State& state, int quality) {
+    const std::vector<etc1_byte>& image = getImage();
+    std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(kSize, kSize));
+    const etc1_uint32 threads = state.range(0);
+    while (state.KeepRunning()) {
+        etc1_encode_image_quality(image.data(), kSize, kSize, 3, kStride,
+                                  encoded.data(), quality, threads);
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    state.SetBytesProcessed(state.iterations() * image.size());
+}
+
+// The argument is the number of threads, 0 for one per CPU.
+void BM_EncodeHigh(benchmark::State& state) {
+    benchmarkEncode(state, ETC1_QUALITY_HIGH);
+}
+BENCHMARK(BM_EncodeHigh)->Arg(1)->Arg(0);
+
+void BM_EncodeFast(benchmark::State& state) {
+    benchmarkEncode(state, ETC1_QUALITY_FAST);
+}
+BENCHMARK(BM_EncodeFast)->Arg(1)->Arg(0);
+
+void BM_Decode(benchmark::State& state) {
+    const std::vector<etc1_byte>& image = getImage();
+    std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(kSize, kSize));
+    etc1_encode_image(image.data(), kSize, kSize, 3, kStride, encoded.data());
+    std::vector<etc1_byte> decoded(image.size());
+    while (state.KeepRunning()) {
+        etc1_decode_image(encoded.data(), decoded.data(), kSize, kSize, 3,
+                          kStride);
+        benchmark::DoNotOptimize(decoded.data());
+    }
+    state.SetBytesProcessed(state.iterations() * decoded.size());
+}
+BENCHMARK(BM_Decode);
+
+}  // namespace
+
+BENCHMARK_MAIN();
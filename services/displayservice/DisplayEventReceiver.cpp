@@ -89,10 +89,17 @@ int DisplayEventReceiver::AttachedEvent::handleEvent(int fd, int events, void* /
         return 1; // keep the callback
     }
 
-    constexpr size_t SIZE = 1;
+    // Drain everything that is pending and only pass the latest vsync on, as
+    // a client that fell behind has no use for the stale ones and each
+    // callback is a HIDL transaction. Hotplug events are all delivered, in
+    // order, as the framework's DisplayEventDispatcher does.
+    constexpr size_t SIZE = 100;
 
     ssize_t n;
     FwkReceiver::Event buf[SIZE];
+    bool gotVsync = false;
+    uint64_t vsyncTimestamp = 0;
+    uint32_t vsyncCount = 0;
     while ((n = mFwkReceiver.getEvents(buf, SIZE)) > 0) {
         for (size_t i = 0; i < static_cast<size_t>(n); ++i) {
             const FwkReceiver::Event &event = buf[i];
@@ -102,12 +109,9 @@ int DisplayEventReceiver::AttachedEvent::handleEvent(int fd, int events, void* /
 
             switch(buf[i].header.type) {
                 case FwkReceiver::DISPLAY_EVENT_VSYNC: {
-                    auto ret = mCallback->onVsync(timestamp, event.vsync.count);
-                    if (!ret.isOk()) {
-                        LOG(ERROR) << "AttachedEvent handleEvent fails on onVsync callback"
-                                   << " because of " << ret.description();
-                        return 0;  // remove the callback
-                    }
+                    gotVsync = true;
+                    vsyncTimestamp = timestamp;
+                    vsyncCount = event.vsync.count;
                 } break;
                 case FwkReceiver::DISPLAY_EVENT_HOTPLUG: {
                     auto ret = mCallback->onHotplug(timestamp, event.hotplug.connected);
@@ -124,6 +128,15 @@ int DisplayEventReceiver::AttachedEvent::handleEvent(int fd, int events, void* /
         }
     }
 
+    if (gotVsync) {
+        auto ret = mCallback->onVsync(vsyncTimestamp, vsyncCount);
+        if (!ret.isOk()) {
+            LOG(ERROR) << "AttachedEvent handleEvent fails on onVsync callback"
+                       << " because of " << ret.description();
+            return 0;  // remove the callback
+        }
+    }
+
     return 1; // keep on going
 }
 
@@ -31,6 +31,11 @@
 #include <sys/utsname.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <future>
+#include <string>
+#include <vector>
+
 #define LOG_TAG "EventHub"
 
 // #define LOG_NDEBUG 0
@@ -71,6 +76,9 @@ namespace android {
 
 static const char *WAKE_LOCK_ID = "KeyEvents";
 static const char *DEVICE_PATH = "/dev/input";
+// Maximum number of threads probing the devices found when scanning DEVICE_PATH.
+static const size_t MAX_PROBE_THREADS = 4;
+static const char *WAKEUP_COALESCE_BUDGET_PROPERTY = "ro.input.wakeup_coalesce_budget_ms";
 
 static inline const char* toString(bool value) {
     return value ? "true" : "false";
@@ -147,7 +155,8 @@ EventHub::Device::Device(int fd, int32_t id, const String8& path,
         fd(fd), id(id), path(path), identifier(identifier),
         classes(0), configuration(NULL), virtualKeyMap(NULL),
         ffEffectPlaying(false), ffEffectId(-1), controllerNumber(0),
-        timestampOverrideSec(0), timestampOverrideUsec(0), enabled(true),
+        timestampOverrideSec(0), timestampOverrideUsec(0), keyMapLoaded(false),
+        identifyTime(0), configurationTime(0), keyMapTime(0), probeTime(0), enabled(true),
         isVirtual(fd < 0) {
     memset(keyBitmask, 0, sizeof(keyBitmask));
     memset(absBitmask, 0, sizeof(absBitmask));
@@ -203,9 +212,14 @@ EventHub::EventHub(void) :
         mOpeningDevices(0), mClosingDevices(0),
         mNeedToSendFinishedDeviceScan(false),
         mNeedToReopenDevices(false), mNeedToScanDevices(true),
-        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false) {
+        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false),
+        mCoalescedWakeupCount(0) {
     acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
+    // Off by default.  Products that trade latency for battery size it against their
+    // display refresh period, samples held back longer than a frame are of no use.
+    mWakeupCoalesceBudget = ms2ns(property_get_int32(WAKEUP_COALESCE_BUDGET_PROPERTY, 0));
+
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
@@ -745,6 +759,8 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
     RawEvent* event = buffer;
     size_t capacity = bufferSize;
     bool awoken = false;
+    bool urgent = false;
+    nsecs_t coalesceDeadline = 0;
     for (;;) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
@@ -946,6 +962,11 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
                                         event->when, time, now);
                             }
                         }
+                        if (iev.type == EV_SYN && iev.code == SYN_REPORT) {
+                            device->readLatency.record(now - event->when);
+                        } else if (iev.type == EV_KEY || iev.type == EV_SW) {
+                            urgent = true;
+                        }
                         event->deviceId = deviceId;
                         event->type = iev.type;
                         event->code = iev.code;
@@ -982,12 +1003,47 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
         // Report added or removed devices immediately.
         if (deviceChanged) {
+            urgent = true;
             continue;
         }
 
         // Return now if we have collected any events or if we were explicitly awoken.
         if (event != buffer || awoken) {
-            break;
+            if (awoken || urgent || mWakeupCoalesceBudget <= 0
+                    || capacity < bufferSize / 4) {
+                break;
+            }
+
+            // Only motion samples have been read so far.  Hold them back for a little while
+            // so that the samples that follow share this wakeup of the reader.  Key and
+            // switch changes, device changes and wake() still return right away.
+            nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (coalesceDeadline == 0) {
+                coalesceDeadline = time + mWakeupCoalesceBudget;
+            }
+            int coalesceMillis = toMillisecondTimeoutDelay(time, coalesceDeadline);
+            if (timeoutMillis >= 0 && timeoutMillis < coalesceMillis) {
+                coalesceMillis = timeoutMillis;
+            }
+            if (coalesceMillis <= 0) {
+                break;
+            }
+
+            // Keep the wake lock, the events read so far have not been processed yet.
+            mPendingEventIndex = 0;
+            mLock.unlock();
+            int pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS,
+                    coalesceMillis);
+            mLock.lock();
+
+            if (pollResult <= 0) {
+                // Timed out or failed, deliver what we have.
+                mPendingEventCount = 0;
+                break;
+            }
+            mPendingEventCount = size_t(pollResult);
+            mCoalescedWakeupCount += 1;
+            continue;
         }
 
         // Poll for events.  Mind the wake lock dance!
@@ -1108,14 +1164,23 @@ status_t EventHub::unregisterDeviceFromEpollLocked(Device* device) {
 }
 
 status_t EventHub::openDeviceLocked(const char *devicePath) {
+    Device* device = probeDeviceLocked(devicePath, mNextDeviceId++);
+    if (device == NULL) {
+        return -1;
+    }
+    return addProbedDeviceLocked(device);
+}
+
+EventHub::Device* EventHub::probeDeviceLocked(const char *devicePath, int32_t deviceId) {
     char buffer[80];
 
     ALOGV("Opening device: %s", devicePath);
 
+    const nsecs_t probeStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
     int fd = open(devicePath, O_RDWR | O_CLOEXEC | O_NONBLOCK);
     if(fd < 0) {
         ALOGE("could not open %s, %s\n", devicePath, strerror(errno));
-        return -1;
+        return NULL;
     }
 
     InputDeviceIdentifier identifier;
@@ -1134,7 +1199,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         if (identifier.name == item) {
             ALOGI("ignoring event id %s driver %s\n", devicePath, item.string());
             close(fd);
-            return -1;
+            return NULL;
         }
     }
 
@@ -1143,7 +1208,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     if(ioctl(fd, EVIOCGVERSION, &driverVersion)) {
         ALOGE("could not get driver version for %s, %s\n", devicePath, strerror(errno));
         close(fd);
-        return -1;
+        return NULL;
     }
 
     // Get device identifier.
@@ -1151,7 +1216,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     if(ioctl(fd, EVIOCGID, &inputId)) {
         ALOGE("could not get device input id for %s, %s\n", devicePath, strerror(errno));
         close(fd);
-        return -1;
+        return NULL;
     }
     identifier.bus = inputId.bustype;
     identifier.product = inputId.product;
@@ -1174,12 +1239,11 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         identifier.uniqueId.setTo(buffer);
     }
 
-    // Fill in the descriptor.
-    assignDescriptorLocked(identifier);
-
     // Allocate device.  (The device object takes ownership of the fd at this point.)
-    int32_t deviceId = mNextDeviceId++;
+    // The descriptor is assigned when the device is added.
     Device* device = new Device(fd, deviceId, String8(devicePath), identifier);
+    nsecs_t stepStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    device->identifyTime = stepStartTime - probeStartTime;
 
     ALOGV("add device %d: %s\n", deviceId, devicePath);
     ALOGV("  bus:        %04x\n"
@@ -1190,12 +1254,13 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     ALOGV("  name:       \"%s\"\n", identifier.name.string());
     ALOGV("  location:   \"%s\"\n", identifier.location.string());
     ALOGV("  unique id:  \"%s\"\n", identifier.uniqueId.string());
-    ALOGV("  descriptor: \"%s\"\n", identifier.descriptor.string());
     ALOGV("  driver:     v%d.%d.%d\n",
         driverVersion >> 16, (driverVersion >> 8) & 0xff, driverVersion & 0xff);
 
     // Load the configuration file for the device.
     loadConfigurationLocked(device);
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    device->configurationTime = now - stepStartTime;
 
     // Figure out the kinds of events the device reports.
     ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(device->keyBitmask)), device->keyBitmask);
@@ -1290,6 +1355,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     }
 
     // Configure virtual keys.
+    stepStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
     if ((device->classes & INPUT_DEVICE_CLASS_TOUCH)) {
         // Load the virtual keys for the touch screen, if any.
         // We do this now so that we can make sure to load the keymap if necessary.
@@ -1306,17 +1372,12 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         // Load the keymap for the device.
         keyMapStatus = loadKeyMapLocked(device);
     }
+    device->keyMapLoaded = !keyMapStatus;
+    now = systemTime(SYSTEM_TIME_MONOTONIC);
+    device->keyMapTime = now - stepStartTime;
 
     // Configure the keyboard, gamepad or virtual keyboard.
     if (device->classes & INPUT_DEVICE_CLASS_KEYBOARD) {
-        // Register the keyboard as a built-in keyboard if it is eligible.
-        if (!keyMapStatus
-                && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD
-                && isEligibleBuiltInKeyboard(device->identifier,
-                        device->configuration, &device->keyMap)) {
-            mBuiltInKeyboardId = device->id;
-        }
-
         // 'Q' key support = cheap test of whether this is an alpha-capable kbd
         if (hasKeycodeLocked(device, AKEYCODE_Q)) {
             device->classes |= INPUT_DEVICE_CLASS_ALPHAKEY;
@@ -1345,7 +1406,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         ALOGV("Dropping device: id=%d, path='%s', name='%s'",
                 deviceId, devicePath, device->identifier.name.string());
         delete device;
-        return -1;
+        return NULL;
     }
 
     // Determine whether the device has a mic.
@@ -1358,13 +1419,30 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         device->classes |= INPUT_DEVICE_CLASS_EXTERNAL;
     }
 
+    device->probeTime = systemTime(SYSTEM_TIME_MONOTONIC) - probeStartTime;
+    return device;
+}
+
+status_t EventHub::addProbedDeviceLocked(Device* device) {
+    // Fill in the descriptor, unique among the devices added so far.
+    assignDescriptorLocked(device->identifier);
+    ALOGV("  descriptor: \"%s\"\n", device->identifier.descriptor.string());
+
+    // Register the keyboard as a built-in keyboard if it is eligible.
+    if ((device->classes & INPUT_DEVICE_CLASS_KEYBOARD)
+            && device->keyMapLoaded
+            && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD
+            && isEligibleBuiltInKeyboard(device->identifier,
+                    device->configuration, &device->keyMap)) {
+        mBuiltInKeyboardId = device->id;
+    }
+
     if (device->classes & (INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_DPAD)
             && device->classes & INPUT_DEVICE_CLASS_GAMEPAD) {
         device->controllerNumber = getNextControllerNumberLocked(device);
         setLedForControllerLocked(device);
     }
 
-
     if (registerDeviceForEpollLocked(device) != OK) {
         delete device;
         return -1;
@@ -1373,13 +1451,15 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     configureFd(device);
 
     ALOGI("New device: id=%d, fd=%d, path='%s', name='%s', classes=0x%x, "
-            "configuration='%s', keyLayout='%s', keyCharacterMap='%s', builtinKeyboard=%s, ",
-         deviceId, fd, devicePath, device->identifier.name.string(),
+            "configuration='%s', keyLayout='%s', keyCharacterMap='%s', builtinKeyboard=%s, "
+            "probe time=%0.3fms",
+         device->id, device->fd, device->path.string(), device->identifier.name.string(),
          device->classes,
          device->configurationFile.string(),
          device->keyMap.keyLayoutFile.string(),
          device->keyMap.keyCharacterMapFile.string(),
-         toString(mBuiltInKeyboardId == deviceId));
+         toString(mBuiltInKeyboardId == device->id),
+         device->probeTime / 1000000.0);
 
     addDeviceLocked(device);
     return OK;
@@ -1717,15 +1797,49 @@ status_t EventHub::scanDirLocked(const char *dirname)
     strcpy(devname, dirname);
     filename = devname + strlen(devname);
     *filename++ = '/';
+    std::vector<std::string> devicePaths;
     while((de = readdir(dir))) {
         if(de->d_name[0] == '.' &&
            (de->d_name[1] == '\0' ||
             (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
         strcpy(filename, de->d_name);
-        openDeviceLocked(devname);
+        devicePaths.push_back(devname);
     }
     closedir(dir);
+
+    // Probing a device only touches that device, so the nodes are probed on
+    // worker threads while this thread holds mLock. The devices are then added
+    // in directory order, which assigns descriptors, the built-in keyboard and
+    // controller numbers just like opening them one after the other.
+    const size_t deviceCount = devicePaths.size();
+    std::vector<int32_t> deviceIds(deviceCount);
+    for (size_t i = 0; i < deviceCount; i++) {
+        deviceIds[i] = mNextDeviceId++;
+    }
+    std::vector<Device*> devices(deviceCount, NULL);
+    const size_t threadCount = std::min(deviceCount, MAX_PROBE_THREADS);
+    auto probe = [&](size_t first) {
+        for (size_t i = first; i < deviceCount; i += threadCount) {
+            devices[i] = probeDeviceLocked(devicePaths[i].c_str(), deviceIds[i]);
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < threadCount; i++) {
+        workers.push_back(std::async(std::launch::async, probe, i));
+    }
+    if (threadCount > 0) {
+        probe(0);
+    }
+    for (auto& worker : workers) {
+        worker.get();
+    }
+
+    for (Device* device : devices) {
+        if (device != NULL) {
+            addProbedDeviceLocked(device);
+        }
+    }
     return 0;
 }
 
@@ -1743,6 +1857,9 @@ void EventHub::dump(std::string& dump) {
         AutoMutex _l(mLock);
 
         dump += StringPrintf(INDENT "BuiltInKeyboardId: %d\n", mBuiltInKeyboardId);
+        dump += StringPrintf(INDENT "WakeupCoalesceBudget: %0.1fms\n",
+                mWakeupCoalesceBudget * 0.000001f);
+        dump += StringPrintf(INDENT "CoalescedWakeups: %" PRIu64 "\n", mCoalescedWakeupCount);
 
         dump += INDENT "Devices:\n";
 
@@ -1774,6 +1891,13 @@ void EventHub::dump(std::string& dump) {
                     device->configurationFile.string());
             dump += StringPrintf(INDENT3 "HaveKeyboardLayoutOverlay: %s\n",
                     toString(device->overlayKeyMap != NULL));
+            dump += INDENT3 "ReadLatency: ";
+            device->readLatency.dump(dump);
+            dump += "\n";
+            dump += StringPrintf(INDENT3 "ProbeTime: %0.3fms (identify %0.3fms, "
+                    "configuration %0.3fms, key maps %0.3fms)\n",
+                    device->probeTime * 0.000001f, device->identifyTime * 0.000001f,
+                    device->configurationTime * 0.000001f, device->keyMapTime * 0.000001f);
         }
     } // release lock
 }
@@ -36,6 +36,8 @@
 #include <linux/input.h>
 #include <sys/epoll.h>
 
+#include "LatencyHistogram.h"
+
 /* Convenience constants. */
 
 #define BTN_FIRST 0x100  // first button code
@@ -345,7 +347,7 @@ private:
         int fd; // may be -1 if device is closed
         const int32_t id;
         const String8 path;
-        const InputDeviceIdentifier identifier;
+        InputDeviceIdentifier identifier; // the descriptor is assigned when added
 
         uint32_t classes;
 
@@ -373,6 +375,18 @@ private:
         int32_t timestampOverrideSec;
         int32_t timestampOverrideUsec;
 
+        // From the kernel timestamp of each SYN_REPORT to when it was read.
+        LatencyHistogram readLatency;
+
+        bool keyMapLoaded;
+
+        // Time spent probing the device when it was opened. The identify step
+        // opens the node and queries its identity.
+        nsecs_t identifyTime;
+        nsecs_t configurationTime;
+        nsecs_t keyMapTime;
+        nsecs_t probeTime;
+
         Device(int fd, int32_t id, const String8& path, const InputDeviceIdentifier& identifier);
         ~Device();
 
@@ -393,6 +407,12 @@ private:
     };
 
     status_t openDeviceLocked(const char *devicePath);
+    // Opens and classifies a device node, returns NULL if the device is not
+    // used. Only touches the new device and state that does not change while
+    // mLock is held, so several devices can be probed concurrently.
+    Device* probeDeviceLocked(const char *devicePath, int32_t deviceId);
+    // Finishes opening a probed device and adds it.
+    status_t addProbedDeviceLocked(Device* device);
     void createVirtualKeyboardLocked();
     void addDeviceLocked(Device* device);
     void assignDescriptorLocked(InputDeviceIdentifier& identifier);
@@ -480,6 +500,10 @@ private:
     size_t mPendingEventIndex;
     bool mPendingINotify;
 
+    // How long motion samples may be held back to wait for more, 0 if they are not.
+    nsecs_t mWakeupCoalesceBudget;
+    uint64_t mCoalescedWakeupCount;
+
     bool mUsingEpollWakeup;
 };
 
@@ -46,16 +46,22 @@
 #include "InputDispatcher.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <sstream>
 #include <stddef.h>
+#include <string.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <android-base/chrono_utils.h>
 #include <android-base/stringprintf.h>
 #include <log/log.h>
 #include <utils/Trace.h>
+#include <tracering/TraceRing.h>
 #include <powermanager/PowerManager.h>
 #include <ui/Region.h>
 
@@ -96,6 +102,10 @@ constexpr std::chrono::milliseconds SLOW_INTERCEPTION_THRESHOLD = 50ms;
 // Number of recent events to keep for debugging purposes.
 constexpr size_t RECENT_QUEUE_MAX_SIZE = 10;
 
+// Most events a dispatch worker publishes to a connection before giving the other connections
+// scheduled on it a turn.
+constexpr size_t MAX_WORKER_PUBLISH_BATCH = 16;
+
 
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
@@ -236,23 +246,151 @@ static void dumpRegion(std::string& dump, const Region& region) {
 }
 
 
+// --- EntryPool ---
+
+// A bounded free list of the blocks of one type of entry the dispatcher allocates and frees
+// for every event, to keep the allocator out of the dispatch loop.  Events may be allocated
+// and released without holding the dispatcher lock, when they are injected for instance, so
+// each pool has a lock of its own.
+//
+// A pool keeps the blocks of the size it is first asked for, which is the size of its type
+// since nothing derives from the pooled entries.
+class EntryPool {
+public:
+    EntryPool(const char* name, size_t maxFreeBlocks) :
+            mName(name), mBlockSize(0), mMaxFreeBlocks(maxFreeBlocks),
+            mFreeBlocks(NULL), mFreeBlockCount(0), mAllocations(0), mReuses(0) {
+    }
+
+    void* allocate(size_t size) {
+        {
+            AutoMutex _l(mLock);
+            if (mBlockSize == 0) {
+                mBlockSize = size;
+            }
+            if (size == mBlockSize) {
+                mAllocations++;
+                if (mFreeBlocks != NULL) {
+                    FreeBlock* block = mFreeBlocks;
+                    mFreeBlocks = block->next;
+                    mFreeBlockCount--;
+                    mReuses++;
+                    return block;
+                }
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void free(void* ptr, size_t size) {
+        {
+            AutoMutex _l(mLock);
+            if (size == mBlockSize && mFreeBlockCount < mMaxFreeBlocks) {
+                FreeBlock* block = static_cast<FreeBlock*>(ptr);
+                block->next = mFreeBlocks;
+                mFreeBlocks = block;
+                mFreeBlockCount++;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+    void dump(std::string& dump) {
+        AutoMutex _l(mLock);
+        dump += StringPrintf(INDENT2 "%s: freeBlocks=%zu/%zu, blockSize=%zu, "
+                "allocations=%" PRIu64 ", reuses=%" PRIu64 "\n",
+                mName, mFreeBlockCount, mMaxFreeBlocks, mBlockSize, mAllocations, mReuses);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    const char* const mName;
+    size_t mBlockSize;
+    const size_t mMaxFreeBlocks;
+
+    Mutex mLock;
+    FreeBlock* mFreeBlocks;
+    size_t mFreeBlockCount;
+    uint64_t mAllocations;
+    uint64_t mReuses;
+};
+
+// The pools are never destroyed, entries may still be released while the process exits.
+static EntryPool& getKeyEntryPool() {
+    static EntryPool* sPool = new EntryPool("KeyEntry", 64);
+    return *sPool;
+}
+
+// A motion entry holds its pointer arrays, which makes up most of its size.
+static EntryPool& getMotionEntryPool() {
+    static EntryPool* sPool = new EntryPool("MotionEntry", 128);
+    return *sPool;
+}
+
+static EntryPool& getDispatchEntryPool() {
+    static EntryPool* sPool = new EntryPool("DispatchEntry", 256);
+    return *sPool;
+}
+
+
 // --- InputDispatcher ---
 
 InputDispatcher::InputDispatcher(const sp<InputDispatcherPolicyInterface>& policy) :
     mPolicy(policy),
-    mPendingEvent(NULL), mLastDropReason(DROP_REASON_NOT_DROPPED),
+    mPendingEvent(NULL), mInboundHandoffWakePending(false),
+    mLastDropReason(DROP_REASON_NOT_DROPPED),
     mAppSwitchSawKeyDown(false), mAppSwitchDueTime(LONG_LONG_MAX),
     mNextUnblockedEvent(NULL),
     mDispatchEnabled(false), mDispatchFrozen(false), mInputFilterEnabled(false),
-    mInputTargetWaitCause(INPUT_TARGET_WAIT_CAUSE_NONE) {
+    mInputFilterGeneration(0),
+    mInputTargetWaitCause(INPUT_TARGET_WAIT_CAUSE_NONE),
+    mNextDispatchWorker(0), mDispatchWorkersExiting(false) {
     mLooper = new Looper(false);
 
+    mWakeupTimerTime = LONG_LONG_MAX;
+    mWakeupTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mWakeupTimerFd < 0) {
+        ALOGW("Could not create the wakeup timer, deadlines will be rounded up to the next "
+                "millisecond.  errno=%d", errno);
+    } else {
+        mLooper->addFd(mWakeupTimerFd, 0, ALOOPER_EVENT_INPUT, handleWakeupTimerCallback, this);
+    }
+
+    // Dispatch cycles are always traced into the in-process trace rings, for post-hoc debugging.
+    TraceRing::init();
+
     mKeyRepeatState.lastKeyEntry = NULL;
 
     policy->getDispatcherConfiguration(&mConfig);
+
+    for (size_t i = 0; i < mConfig.dispatchWorkerCount; i++) {
+        mDispatchWorkers.push(new DispatchWorker(this));
+    }
+    for (size_t i = 0; i < mDispatchWorkers.size(); i++) {
+        mDispatchWorkers[i]->run(StringPrintf("InputDispatch%zu", i).c_str(),
+                PRIORITY_URGENT_DISPLAY);
+    }
 }
 
 InputDispatcher::~InputDispatcher() {
+    { // acquire lock
+        AutoMutex _l(mLock);
+
+        mDispatchWorkersExiting = true;
+        for (size_t i = 0; i < mDispatchWorkers.size(); i++) {
+            mDispatchWorkers[i]->condition.broadcast();
+        }
+    }
+
+    for (size_t i = 0; i < mDispatchWorkers.size(); i++) {
+        mDispatchWorkers[i]->requestExitAndWait();
+    }
+    mDispatchWorkers.clear();
+
     { // acquire lock
         AutoMutex _l(mLock);
 
@@ -264,14 +402,23 @@ InputDispatcher::~InputDispatcher() {
     while (mConnectionsByFd.size() != 0) {
         unregisterInputChannel(mConnectionsByFd.valueAt(0)->inputChannel);
     }
+
+    if (mWakeupTimerFd >= 0) {
+        mLooper->removeFd(mWakeupTimerFd);
+        close(mWakeupTimerFd);
+    }
 }
 
 void InputDispatcher::dispatchOnce() {
+    TRACE_RING_CALL();
     nsecs_t nextWakeupTime = LONG_LONG_MAX;
     { // acquire lock
         AutoMutex _l(mLock);
         mDispatcherIsAliveCondition.broadcast();
 
+        // The dispatch loop below handles whatever the handed off events require.
+        takeInboundHandoffLocked();
+
         // Run a dispatch loop if there are no pending commands.
         // The dispatch loop might enqueue commands to run afterwards.
         if (!haveCommandsLocked()) {
@@ -285,12 +432,53 @@ void InputDispatcher::dispatchOnce() {
         }
     } // release lock
 
-    // Wait for callback or timeout or wake.  (make sure we round up, not down)
+    // Wait for callback or timeout or wake.
+    if (mWakeupTimerFd >= 0 && nextWakeupTime != LONG_LONG_MIN) {
+        armWakeupTimer(nextWakeupTime);
+        mLooper->pollOnce(-1);
+        return;
+    }
+
+    // Without the timer, make sure we round up, not down.
     nsecs_t currentTime = now();
     int timeoutMillis = toMillisecondTimeoutDelay(currentTime, nextWakeupTime);
     mLooper->pollOnce(timeoutMillis);
 }
 
+void InputDispatcher::armWakeupTimer(nsecs_t when) {
+    if (when == mWakeupTimerTime) {
+        return;
+    }
+
+    // An absolute expiration in the past fires right away; all zeroes disarms the timer.
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (when != LONG_LONG_MAX) {
+        when = std::max(when, nsecs_t(1));
+        spec.it_value.tv_sec = when / 1000000000LL;
+        spec.it_value.tv_nsec = when % 1000000000LL;
+    }
+    if (timerfd_settime(mWakeupTimerFd, TFD_TIMER_ABSTIME, &spec, NULL)) {
+        ALOGW("Could not arm the wakeup timer.  errno=%d", errno);
+        // Poll without a timeout rather than sleep past the deadline.
+        mWakeupTimerTime = LONG_LONG_MIN;
+        mLooper->wake();
+        return;
+    }
+    mWakeupTimerTime = when;
+}
+
+int InputDispatcher::handleWakeupTimerCallback(int fd, int events, void* data) {
+    InputDispatcher* d = static_cast<InputDispatcher*>(data);
+
+    // Consume the expiration.  The dispatch loop that follows computes the next deadline.
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        d->mWakeupTimerTime = LONG_LONG_MAX;
+    }
+    return 1; // keep the callback
+}
+
 void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
     nsecs_t currentTime = now();
 
@@ -448,6 +636,9 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     bool needWake = mInboundQueue.isEmpty();
     mInboundQueue.enqueueAtTail(entry);
     traceInboundQueueLengthLocked();
+    if (entry->enqueueTime == 0) {
+        entry->enqueueTime = now();
+    }
 
     switch (entry->type) {
     case EventEntry::TYPE_KEY: {
@@ -455,6 +646,7 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
         // If the application takes too long to catch up then we drop all events preceding
         // the app switch key.
         KeyEntry* keyEntry = static_cast<KeyEntry*>(entry);
+        recordDeviceLatencyLocked(keyEntry->deviceId, entry);
         if (isAppSwitchKeyEventLocked(keyEntry)) {
             if (keyEntry->action == AKEY_EVENT_ACTION_DOWN) {
                 mAppSwitchSawKeyDown = true;
@@ -478,6 +670,7 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
         // If the application takes too long to catch up then we drop all events preceding
         // the touch into the other window.
         MotionEntry* motionEntry = static_cast<MotionEntry*>(entry);
+        recordDeviceLatencyLocked(motionEntry->deviceId, entry);
         if (motionEntry->action == AMOTION_EVENT_ACTION_DOWN
                 && (motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
                 && mInputTargetWaitCause == INPUT_TARGET_WAIT_CAUSE_APPLICATION_NOT_READY
@@ -504,6 +697,50 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     return needWake;
 }
 
+void InputDispatcher::handOffInboundEvent(EventEntry* entry, uint32_t filterGeneration) {
+    // The time spent in the handoff counts as time in the inbound queue.
+    entry->enqueueTime = now();
+    while (!mInboundHandoff.push(entry, filterGeneration)) {
+        // The dispatcher thread has fallen behind, so make room in its stead.  This also
+        // keeps the events in order.
+        AutoMutex _l(mLock);
+        takeInboundHandoffLocked();
+    }
+
+    if (!mInboundHandoffWakePending.exchange(true)) {
+        mLooper->wake();
+    }
+}
+
+bool InputDispatcher::takeInboundHandoffLocked() {
+    // Cleared before taking the events, so that any event handed off after the last one
+    // taken here wakes the dispatcher up again.
+    mInboundHandoffWakePending = false;
+
+    bool needWake = false;
+    InboundHandoff::Slot slot;
+    while (mInboundHandoff.pop(&slot)) {
+        if (slot.filterGeneration != mInputFilterGeneration) {
+            releaseInboundEventLocked(slot.entry);
+            continue;
+        }
+        needWake |= enqueueInboundEventLocked(slot.entry);
+    }
+    return needWake;
+}
+
+void InputDispatcher::recordDeviceLatencyLocked(int32_t deviceId, const EventEntry* entry) {
+    // Injected events carry whatever time the injector chose.
+    if (entry->policyFlags & POLICY_FLAG_INJECTED) {
+        return;
+    }
+    ssize_t index = mDeviceLatencies.indexOfKey(deviceId);
+    if (index < 0) {
+        index = mDeviceLatencies.add(deviceId, LatencyHistogram());
+    }
+    mDeviceLatencies.editValueAt(index).record(entry->enqueueTime - entry->eventTime);
+}
+
 void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
     entry->refCount += 1;
     mRecentQueue.enqueueAtTail(entry);
@@ -514,9 +751,13 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
+    const std::vector<uint32_t>* candidates = mWindowIndex.findCandidates(displayId, x, y);
+    if (candidates == NULL) {
+        return NULL;
+    }
+
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
+    for (uint32_t i : *candidates) {
         sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         if (windowInfo->displayId == displayId) {
@@ -652,6 +893,7 @@ InputDispatcher::CommandEntry* InputDispatcher::postCommandLocked(Command comman
 }
 
 void InputDispatcher::drainInboundQueueLocked() {
+    takeInboundHandoffLocked();
     while (! mInboundQueue.isEmpty()) {
         EventEntry* entry = mInboundQueue.dequeueAtHead();
         releaseInboundEventLocked(entry);
@@ -1246,8 +1488,9 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
+        static const std::vector<uint32_t> sNoCandidates;
+        const std::vector<uint32_t>* candidates = mWindowIndex.findCandidates(displayId, x, y);
+        for (uint32_t i : candidates != NULL ? *candidates : sNoCandidates) {
             sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             if (windowInfo->displayId != displayId) {
@@ -1657,12 +1900,18 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
+    const std::vector<uint32_t>* candidates = mWindowIndex.findCandidates(displayId, x, y);
+    if (candidates == NULL) {
+        return false;
+    }
+
+    // Only the windows in front of this one can obscure it.
+    const uint32_t zOrder = mWindowIndex.getZOrder(windowHandle);
+    for (uint32_t i : *candidates) {
+        if (i >= zOrder) {
             break;
         }
+        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
 
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->displayId == displayId
@@ -2008,112 +2257,236 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             connection->getInputChannelName().c_str());
 #endif
 
+    if (!mDispatchWorkers.isEmpty()) {
+        if (connection->status == Connection::STATUS_NORMAL
+                && !connection->outboundQueue.isEmpty()) {
+            scheduleDispatchCycleLocked(connection);
+        }
+        return;
+    }
+
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
         DispatchEntry* dispatchEntry = connection->outboundQueue.head;
         dispatchEntry->deliveryTime = currentTime;
 
         // Publish the event.
-        status_t status;
-        EventEntry* eventEntry = dispatchEntry->eventEntry;
-        switch (eventEntry->type) {
-        case EventEntry::TYPE_KEY: {
-            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
-
-            // Publish the key event.
-            status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
-                    keyEntry->deviceId, keyEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    keyEntry->keyCode, keyEntry->scanCode,
-                    keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
-                    keyEntry->eventTime);
-            break;
+        PublishRequest request;
+        request.initialize(dispatchEntry);
+        status_t status = publishDispatchEntry(connection, request);
+
+        // Check the result.
+        if (status) {
+            handlePublishErrorLocked(currentTime, connection, status);
+            return;
         }
 
-        case EventEntry::TYPE_MOTION: {
-            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+        // Re-enqueue the event on the wait queue.
+        connection->outboundQueue.dequeue(dispatchEntry);
+        traceOutboundQueueLengthLocked(connection);
+        connection->waitQueue.enqueueAtTail(dispatchEntry);
+        traceWaitQueueLengthLocked(connection);
+    }
+}
 
-            PointerCoords scaledCoords[MAX_POINTERS];
-            const PointerCoords* usingCoords = motionEntry->pointerCoords;
+status_t InputDispatcher::publishDispatchEntry(const sp<Connection>& connection,
+        const PublishRequest& request) {
+    const EventEntry* eventEntry = request.eventEntry;
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        const KeyEntry* keyEntry = static_cast<const KeyEntry*>(eventEntry);
 
-            // Set the X and Y offset depending on the input source.
-            float xOffset, yOffset;
-            if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
-                    && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
-                float scaleFactor = dispatchEntry->scaleFactor;
-                xOffset = dispatchEntry->xOffset * scaleFactor;
-                yOffset = dispatchEntry->yOffset * scaleFactor;
-                if (scaleFactor != 1.0f) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i] = motionEntry->pointerCoords[i];
-                        scaledCoords[i].scale(scaleFactor);
-                    }
-                    usingCoords = scaledCoords;
-                }
-            } else {
-                xOffset = 0.0f;
-                yOffset = 0.0f;
+        // Publish the key event.
+        return connection->inputPublisher.publishKeyEvent(request.seq,
+                keyEntry->deviceId, keyEntry->source,
+                request.resolvedAction, request.resolvedFlags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+    }
 
-                // We don't want the dispatch target to know.
-                if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i].clear();
-                    }
-                    usingCoords = scaledCoords;
+    case EventEntry::TYPE_MOTION: {
+        const MotionEntry* motionEntry = static_cast<const MotionEntry*>(eventEntry);
+
+        PointerCoords scaledCoords[MAX_POINTERS];
+        const PointerCoords* usingCoords = motionEntry->pointerCoords;
+
+        // Set the X and Y offset depending on the input source.
+        float xOffset, yOffset;
+        if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
+                && !(request.targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
+            float scaleFactor = request.scaleFactor;
+            xOffset = request.xOffset * scaleFactor;
+            yOffset = request.yOffset * scaleFactor;
+            if (scaleFactor != 1.0f) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i] = motionEntry->pointerCoords[i];
+                    scaledCoords[i].scale(scaleFactor);
                 }
+                usingCoords = scaledCoords;
             }
+        } else {
+            xOffset = 0.0f;
+            yOffset = 0.0f;
 
-            // Publish the motion event.
-            status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
-                    motionEntry->deviceId, motionEntry->source, motionEntry->displayId,
-                    dispatchEntry->resolvedAction, motionEntry->actionButton,
-                    dispatchEntry->resolvedFlags, motionEntry->edgeFlags,
-                    motionEntry->metaState, motionEntry->buttonState,
-                    xOffset, yOffset, motionEntry->xPrecision, motionEntry->yPrecision,
-                    motionEntry->downTime, motionEntry->eventTime,
-                    motionEntry->pointerCount, motionEntry->pointerProperties,
-                    usingCoords);
-            break;
+            // We don't want the dispatch target to know.
+            if (request.targetFlags & InputTarget::FLAG_ZERO_COORDS) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i].clear();
+                }
+                usingCoords = scaledCoords;
+            }
         }
 
-        default:
-            ALOG_ASSERT(false);
-            return;
-        }
+        // Publish the motion event.
+        return connection->inputPublisher.publishMotionEvent(request.seq,
+                motionEntry->deviceId, motionEntry->source, motionEntry->displayId,
+                request.resolvedAction, motionEntry->actionButton,
+                request.resolvedFlags, motionEntry->edgeFlags,
+                motionEntry->metaState, motionEntry->buttonState,
+                xOffset, yOffset, motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->eventTime,
+                motionEntry->pointerCount, motionEntry->pointerProperties,
+                usingCoords);
+    }
 
-        // Check the result.
-        if (status) {
-            if (status == WOULD_BLOCK) {
-                if (connection->waitQueue.isEmpty()) {
-                    ALOGE("channel '%s' ~ Could not publish event because the pipe is full. "
-                            "This is unexpected because the wait queue is empty, so the pipe "
-                            "should be empty and we shouldn't have any problems writing an "
-                            "event to it, status=%d", connection->getInputChannelName().c_str(),
-                            status);
-                    abortBrokenDispatchCycleLocked(currentTime, connection, true /*notify*/);
-                } else {
-                    // Pipe is full and we are waiting for the app to finish process some events
-                    // before sending more events to it.
+    default:
+        ALOG_ASSERT(false);
+        return BAD_VALUE;
+    }
+}
+
+void InputDispatcher::handlePublishErrorLocked(nsecs_t currentTime,
+        const sp<Connection>& connection, status_t status) {
+    if (status == WOULD_BLOCK) {
+        if (connection->waitQueue.isEmpty()) {
+            ALOGE("channel '%s' ~ Could not publish event because the pipe is full. "
+                    "This is unexpected because the wait queue is empty, so the pipe "
+                    "should be empty and we shouldn't have any problems writing an "
+                    "event to it, status=%d", connection->getInputChannelName().c_str(),
+                    status);
+            abortBrokenDispatchCycleLocked(currentTime, connection, true /*notify*/);
+        } else {
+            // Pipe is full and we are waiting for the app to finish process some events
+            // before sending more events to it.
 #if DEBUG_DISPATCH_CYCLE
-                    ALOGD("channel '%s' ~ Could not publish event because the pipe is full, "
-                            "waiting for the application to catch up",
-                            connection->getInputChannelName().c_str());
+            ALOGD("channel '%s' ~ Could not publish event because the pipe is full, "
+                    "waiting for the application to catch up",
+                    connection->getInputChannelName().c_str());
 #endif
-                    connection->inputPublisherBlocked = true;
-                }
-            } else {
-                ALOGE("channel '%s' ~ Could not publish event due to an unexpected error, "
-                        "status=%d", connection->getInputChannelName().c_str(), status);
-                abortBrokenDispatchCycleLocked(currentTime, connection, true /*notify*/);
-            }
-            return;
+            connection->inputPublisherBlocked = true;
         }
+    } else {
+        ALOGE("channel '%s' ~ Could not publish event due to an unexpected error, "
+                "status=%d", connection->getInputChannelName().c_str(), status);
+        abortBrokenDispatchCycleLocked(currentTime, connection, true /*notify*/);
+    }
+}
 
-        // Re-enqueue the event on the wait queue.
+void InputDispatcher::scheduleDispatchCycleLocked(const sp<Connection>& connection) {
+    if (connection->dispatchScheduled) {
+        return; // the worker picks up whatever was enqueued in the meantime
+    }
+    connection->dispatchScheduled = true;
+
+    const sp<DispatchWorker>& worker = mDispatchWorkers[connection->dispatchWorker];
+    worker->queue.push(connection);
+    if (worker->queue.size() > worker->maxQueueDepth) {
+        worker->maxQueueDepth = worker->queue.size();
+    }
+    worker->condition.signal();
+}
+
+bool InputDispatcher::runDispatchWorker(DispatchWorker* worker) {
+    AutoMutex _l(mLock);
+
+    while (worker->queue.isEmpty() && !mDispatchWorkersExiting) {
+        worker->condition.wait(mLock);
+    }
+    if (mDispatchWorkersExiting) {
+        return false;
+    }
+
+    sp<Connection> connection = worker->queue[0];
+    worker->queue.removeAt(0);
+    runDispatchWorkerCycleLocked(worker, connection);
+    return true;
+}
+
+void InputDispatcher::runDispatchWorkerCycleLocked(DispatchWorker* worker,
+        const sp<Connection>& connection) {
+#if DEBUG_DISPATCH_CYCLE
+    ALOGD("channel '%s' ~ runDispatchWorkerCycle",
+            connection->getInputChannelName().c_str());
+#endif
+
+    // The entries move to the wait queue before they are published, since the application
+    // may well finish them before the lock is reacquired.
+    PublishRequest requests[MAX_WORKER_PUBLISH_BATCH];
+    size_t count = 0;
+    nsecs_t currentTime = now();
+    while (connection->status == Connection::STATUS_NORMAL
+            && !connection->outboundQueue.isEmpty() && count < MAX_WORKER_PUBLISH_BATCH) {
+        DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+        dispatchEntry->deliveryTime = currentTime;
+        requests[count].initialize(dispatchEntry);
+        requests[count].eventEntry->refCount += 1;
         connection->outboundQueue.dequeue(dispatchEntry);
-        traceOutboundQueueLengthLocked(connection);
         connection->waitQueue.enqueueAtTail(dispatchEntry);
+        count += 1;
+    }
+    if (count == 0) {
+        connection->dispatchScheduled = false;
+        return;
+    }
+    traceOutboundQueueLengthLocked(connection);
+    traceWaitQueueLengthLocked(connection);
+    const uint32_t generation = connection->dispatchGeneration;
+
+    size_t published = 0;
+    status_t status = OK;
+    mLock.unlock();
+    while (published < count) {
+        status = publishDispatchEntry(connection, requests[published]);
+        if (status) {
+            break;
+        }
+        published += 1;
+    }
+    mLock.lock();
+
+    for (size_t i = 0; i < count; i++) {
+        requests[i].eventEntry->release();
+    }
+    worker->cycleCount += 1;
+    worker->eventCount += published;
+
+    // Unless the queues were drained in the meantime, the entries that were not published
+    // are still at the tail of the wait queue since they cannot have been finished.
+    if (connection->dispatchGeneration == generation && published != count) {
+        for (size_t i = count; i-- > published; ) {
+            DispatchEntry* dispatchEntry = requests[i].dispatchEntry;
+            connection->waitQueue.dequeue(dispatchEntry);
+            connection->outboundQueue.enqueueAtHead(dispatchEntry);
+        }
+        traceOutboundQueueLengthLocked(connection);
         traceWaitQueueLengthLocked(connection);
+        handlePublishErrorLocked(now(), connection, status);
+    }
+
+    if (!status && connection->status == Connection::STATUS_NORMAL
+            && !connection->outboundQueue.isEmpty()) {
+        worker->queue.push(connection);
+        if (worker->queue.size() > worker->maxQueueDepth) {
+            worker->maxQueueDepth = worker->queue.size();
+        }
+    } else {
+        connection->dispatchScheduled = false;
+    }
+
+    if (status) {
+        // Let the dispatcher thread run the commands posted for a broken connection.
+        mLooper->wake();
     }
 }
 
@@ -2143,6 +2516,7 @@ void InputDispatcher::abortBrokenDispatchCycleLocked(nsecs_t currentTime,
 #endif
 
     // Clear the dispatch queues.
+    connection->dispatchGeneration += 1;
     drainDispatchQueueLocked(&connection->outboundQueue);
     traceOutboundQueueLengthLocked(connection);
     drainDispatchQueueLocked(&connection->waitQueue);
@@ -2415,17 +2789,8 @@ void InputDispatcher::notifyConfigurationChanged(const NotifyConfigurationChange
     ALOGD("notifyConfigurationChanged - eventTime=%" PRId64, args->eventTime);
 #endif
 
-    bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
-
-        ConfigurationChangedEntry* newEntry = new ConfigurationChangedEntry(args->eventTime);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
-    }
+    ConfigurationChangedEntry* newEntry = new ConfigurationChangedEntry(args->eventTime);
+    handOffInboundEvent(newEntry, mInputFilterGeneration);
 }
 
 void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
@@ -2495,37 +2860,23 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
                 std::to_string(t.duration().count()).c_str());
     }
 
-    bool needWake;
-    { // acquire lock
-        mLock.lock();
-
-        if (shouldSendKeyToInputFilterLocked(args)) {
-            mLock.unlock();
-
-            policyFlags |= POLICY_FLAG_FILTERED;
-            if (!mPolicy->filterInputEvent(&event, policyFlags)) {
-                return; // event was consumed by the filter
-            }
-
-            mLock.lock();
+    uint32_t filterGeneration = mInputFilterGeneration;
+    if (shouldSendKeyToInputFilter(args)) {
+        policyFlags |= POLICY_FLAG_FILTERED;
+        if (!mPolicy->filterInputEvent(&event, policyFlags)) {
+            return; // event was consumed by the filter
         }
-
-        int32_t repeatCount = 0;
-        KeyEntry* newEntry = new KeyEntry(args->eventTime,
-                args->deviceId, args->source, policyFlags,
-                args->action, flags, keyCode, args->scanCode,
-                metaState, repeatCount, args->downTime);
-
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
     }
+
+    int32_t repeatCount = 0;
+    KeyEntry* newEntry = new KeyEntry(args->eventTime,
+            args->deviceId, args->source, policyFlags,
+            args->action, flags, keyCode, args->scanCode,
+            metaState, repeatCount, args->downTime);
+    handOffInboundEvent(newEntry, filterGeneration);
 }
 
-bool InputDispatcher::shouldSendKeyToInputFilterLocked(const NotifyKeyArgs* args) {
+bool InputDispatcher::shouldSendKeyToInputFilter(const NotifyKeyArgs* args) {
     return mInputFilterEnabled;
 }
 
@@ -2570,47 +2921,33 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 std::to_string(t.duration().count()).c_str());
     }
 
-    bool needWake;
-    { // acquire lock
-        mLock.lock();
-
-        if (shouldSendMotionToInputFilterLocked(args)) {
-            mLock.unlock();
-
-            MotionEvent event;
-            event.initialize(args->deviceId, args->source, args->action, args->actionButton,
-                    args->flags, args->edgeFlags, args->metaState, args->buttonState,
-                    0, 0, args->xPrecision, args->yPrecision,
-                    args->downTime, args->eventTime,
-                    args->pointerCount, args->pointerProperties, args->pointerCoords);
-
-            policyFlags |= POLICY_FLAG_FILTERED;
-            if (!mPolicy->filterInputEvent(&event, policyFlags)) {
-                return; // event was consumed by the filter
-            }
+    uint32_t filterGeneration = mInputFilterGeneration;
+    if (shouldSendMotionToInputFilter(args)) {
+        MotionEvent event;
+        event.initialize(args->deviceId, args->source, args->action, args->actionButton,
+                args->flags, args->edgeFlags, args->metaState, args->buttonState,
+                0, 0, args->xPrecision, args->yPrecision,
+                args->downTime, args->eventTime,
+                args->pointerCount, args->pointerProperties, args->pointerCoords);
 
-            mLock.lock();
+        policyFlags |= POLICY_FLAG_FILTERED;
+        if (!mPolicy->filterInputEvent(&event, policyFlags)) {
+            return; // event was consumed by the filter
         }
-
-        // Just enqueue a new motion event.
-        MotionEntry* newEntry = new MotionEntry(args->eventTime,
-                args->deviceId, args->source, policyFlags,
-                args->action, args->actionButton, args->flags,
-                args->metaState, args->buttonState,
-                args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
-                args->displayId,
-                args->pointerCount, args->pointerProperties, args->pointerCoords, 0, 0);
-
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
     }
+
+    // Just enqueue a new motion event.
+    MotionEntry* newEntry = new MotionEntry(args->eventTime,
+            args->deviceId, args->source, policyFlags,
+            args->action, args->actionButton, args->flags,
+            args->metaState, args->buttonState,
+            args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
+            args->displayId,
+            args->pointerCount, args->pointerProperties, args->pointerCoords, 0, 0);
+    handOffInboundEvent(newEntry, filterGeneration);
 }
 
-bool InputDispatcher::shouldSendMotionToInputFilterLocked(const NotifyMotionArgs* args) {
+bool InputDispatcher::shouldSendMotionToInputFilter(const NotifyMotionArgs* args) {
     // TODO: support sending secondary display events to input filter
     return mInputFilterEnabled && isMainDisplay(args->displayId);
 }
@@ -2634,17 +2971,8 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
             args->eventTime, args->deviceId);
 #endif
 
-    bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
-
-        DeviceResetEntry* newEntry = new DeviceResetEntry(args->eventTime, args->deviceId);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
-    }
+    DeviceResetEntry* newEntry = new DeviceResetEntry(args->eventTime, args->deviceId);
+    handOffInboundEvent(newEntry, mInputFilterGeneration);
 }
 
 int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displayId,
@@ -2762,7 +3090,8 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displ
     injectionState->refCount += 1;
     lastInjectedEntry->injectionState = injectionState;
 
-    bool needWake = false;
+    // Notified events come first, as they would have without the handoff.
+    bool needWake = takeInboundHandoffLocked();
     for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
         EventEntry* nextEntry = entry->next;
         needWake |= enqueueInboundEventLocked(entry);
@@ -2939,6 +3268,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
                 foundHoveredWindow = true;
             }
         }
+        mWindowIndex.build(mWindowHandles);
 
         if (!foundHoveredWindow) {
             mLastHoverWindowHandle = NULL;
@@ -3090,6 +3420,7 @@ void InputDispatcher::setInputFilterEnabled(bool enabled) {
         }
 
         mInputFilterEnabled = enabled;
+        mInputFilterGeneration++;
         resetAndDropEverythingLocked("input filter is being enabled or disabled");
     } // release lock
 
@@ -3279,6 +3610,7 @@ void InputDispatcher::dumpDispatchStateLocked(std::string& dump) {
     } else {
         dump += INDENT "Windows: <none>\n";
     }
+    mWindowIndex.dump(dump);
 
     if (!mMonitoringChannels.isEmpty()) {
         dump += INDENT "MonitoringChannels:\n";
@@ -3383,11 +3715,48 @@ void InputDispatcher::dumpDispatchStateLocked(std::string& dump) {
             } else {
                 dump += INDENT3 "WaitQueue: <empty>\n";
             }
+
+            dump += INDENT3 "QueueLatency: ";
+            connection->queueLatency.dump(dump);
+            dump += "\n" INDENT3 "AppLatency: ";
+            connection->appLatency.dump(dump);
+            dump += "\n" INDENT3 "EndToEndLatency: ";
+            connection->endToEndLatency.dump(dump);
+            dump += "\n";
         }
     } else {
         dump += INDENT "Connections: <none>\n";
     }
 
+    if (!mDeviceLatencies.isEmpty()) {
+        dump += INDENT "DeviceLatencies:\n";
+        for (size_t i = 0; i < mDeviceLatencies.size(); i++) {
+            dump += StringPrintf(INDENT2 "%d: ", mDeviceLatencies.keyAt(i));
+            mDeviceLatencies.valueAt(i).dump(dump);
+            dump += "\n";
+        }
+    } else {
+        dump += INDENT "DeviceLatencies: <none>\n";
+    }
+
+    if (!mDispatchWorkers.isEmpty()) {
+        dump += INDENT "DispatchWorkers:\n";
+        for (size_t i = 0; i < mDispatchWorkers.size(); i++) {
+            const sp<DispatchWorker>& worker = mDispatchWorkers[i];
+            dump += StringPrintf(INDENT2 "%zu: queueDepth=%zu, maxQueueDepth=%zu, "
+                    "cycles=%" PRIu64 ", events=%" PRIu64 "\n",
+                    i, worker->queue.size(), worker->maxQueueDepth,
+                    worker->cycleCount, worker->eventCount);
+        }
+    } else {
+        dump += INDENT "DispatchWorkers: <none>\n";
+    }
+
+    dump += INDENT "EntryPools:\n";
+    getKeyEntryPool().dump(dump);
+    getMotionEntryPool().dump(dump);
+    getDispatchEntryPool().dump(dump);
+
     if (isAppSwitchPendingLocked()) {
         dump += StringPrintf(INDENT "AppSwitch: pending, due in %0.1fms\n",
                 (mAppSwitchDueTime - now()) / 1000000.0);
@@ -3419,6 +3788,9 @@ status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChan
         }
 
         sp<Connection> connection = new Connection(inputChannel, inputWindowHandle, monitor);
+        if (!mDispatchWorkers.isEmpty()) {
+            connection->dispatchWorker = mNextDispatchWorker++ % mDispatchWorkers.size();
+        }
 
         int fd = inputChannel->getFd();
         mConnectionsByFd.add(fd, connection);
@@ -3633,6 +4005,14 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
     DispatchEntry* dispatchEntry = connection->findWaitQueueEntry(seq);
     if (dispatchEntry) {
         nsecs_t eventDuration = finishTime - dispatchEntry->deliveryTime;
+        const EventEntry* eventEntry = dispatchEntry->eventEntry;
+        if (eventEntry->enqueueTime != 0) {
+            connection->queueLatency.record(dispatchEntry->deliveryTime - eventEntry->enqueueTime);
+            if (!(eventEntry->policyFlags & POLICY_FLAG_INJECTED)) {
+                connection->endToEndLatency.record(finishTime - eventEntry->eventTime);
+            }
+        }
+        connection->appLatency.record(eventDuration);
         if (eventDuration > SLOW_EVENT_PROCESSING_WARNING_TIMEOUT) {
             std::string msg =
                     StringPrintf("Window '%s' spent %0.1fms processing the last input event: ",
@@ -3926,6 +4306,37 @@ void InputDispatcher::monitor() {
 }
 
 
+// --- InputDispatcher::InboundHandoff ---
+
+InputDispatcher::InboundHandoff::InboundHandoff() :
+        mHead(0), mTail(0) {
+}
+
+bool InputDispatcher::InboundHandoff::push(EventEntry* entry, uint32_t filterGeneration) {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mHead.load(std::memory_order_acquire) == CAPACITY) {
+        return false;
+    }
+
+    Slot& slot = mSlots[tail % CAPACITY];
+    slot.entry = entry;
+    slot.filterGeneration = filterGeneration;
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputDispatcher::InboundHandoff::pop(Slot* outSlot) {
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if (head == mTail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    *outSlot = mSlots[head % CAPACITY];
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+
 // --- InputDispatcher::InjectionState ---
 
 InputDispatcher::InjectionState::InjectionState(int32_t injectorPid, int32_t injectorUid) :
@@ -3951,7 +4362,7 @@ void InputDispatcher::InjectionState::release() {
 // --- InputDispatcher::EventEntry ---
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
-        refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
+        refCount(1), type(type), eventTime(eventTime), enqueueTime(0), policyFlags(policyFlags),
         injectionState(NULL), dispatchInProgress(false) {
 }
 
@@ -4023,6 +4434,14 @@ InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
 InputDispatcher::KeyEntry::~KeyEntry() {
 }
 
+void* InputDispatcher::KeyEntry::operator new(size_t size) {
+    return getKeyEntryPool().allocate(size);
+}
+
+void InputDispatcher::KeyEntry::operator delete(void* ptr, size_t size) {
+    getKeyEntryPool().free(ptr, size);
+}
+
 void InputDispatcher::KeyEntry::appendDescription(std::string& msg) const {
     msg += StringPrintf("KeyEvent(deviceId=%d, source=0x%08x, action=%s, "
             "flags=0x%08x, keyCode=%d, scanCode=%d, metaState=0x%08x, "
@@ -4068,6 +4487,14 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime, int32_t deviceId,
 InputDispatcher::MotionEntry::~MotionEntry() {
 }
 
+void* InputDispatcher::MotionEntry::operator new(size_t size) {
+    return getMotionEntryPool().allocate(size);
+}
+
+void InputDispatcher::MotionEntry::operator delete(void* ptr, size_t size) {
+    getMotionEntryPool().free(ptr, size);
+}
+
 void InputDispatcher::MotionEntry::appendDescription(std::string& msg) const {
     msg += StringPrintf("MotionEvent(deviceId=%d, source=0x%08x, action=%s, actionButton=0x%08x, "
             "flags=0x%08x, metaState=0x%08x, buttonState=0x%08x, "
@@ -4102,6 +4529,14 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return getDispatchEntryPool().allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* ptr, size_t size) {
+    getDispatchEntryPool().free(ptr, size);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
@@ -4112,6 +4547,177 @@ uint32_t InputDispatcher::DispatchEntry::nextSeq() {
 }
 
 
+// --- InputDispatcher::PublishRequest ---
+
+void InputDispatcher::PublishRequest::initialize(DispatchEntry* entry) {
+    dispatchEntry = entry;
+    seq = entry->seq;
+    eventEntry = entry->eventEntry;
+    targetFlags = entry->targetFlags;
+    xOffset = entry->xOffset;
+    yOffset = entry->yOffset;
+    scaleFactor = entry->scaleFactor;
+    resolvedAction = entry->resolvedAction;
+    resolvedFlags = entry->resolvedFlags;
+}
+
+
+// --- InputDispatcher::WindowIndex ---
+
+// Windows that are hit-tested whatever the point of the display, regardless of their bounds.
+static bool takesTouchesAnywhere(const InputWindowInfo* info) {
+    int32_t flags = info->layoutParamsFlags;
+    return (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0
+            || (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+}
+
+static void unionRect(Rect* rect, const Rect& other) {
+    if (other.isEmpty()) {
+        return;
+    }
+    if (rect->isEmpty()) {
+        *rect = other;
+        return;
+    }
+    rect->left = std::min(rect->left, other.left);
+    rect->top = std::min(rect->top, other.top);
+    rect->right = std::max(rect->right, other.right);
+    rect->bottom = std::max(rect->bottom, other.bottom);
+}
+
+// Bounds of the points where the window can be touched or obscure another window.
+static Rect getWindowBounds(const InputWindowInfo* info) {
+    Rect bounds(info->frameLeft, info->frameTop, info->frameRight, info->frameBottom);
+    unionRect(&bounds, info->touchableRegion.getBounds());
+    return bounds;
+}
+
+static int32_t getCell(int32_t value, int32_t start, int32_t end, int32_t count) {
+    return int32_t((int64_t(value) - start) * count / (int64_t(end) - start));
+}
+
+void InputDispatcher::WindowIndex::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    mGrids.clear();
+    mZOrders.clear();
+    mWindowCount = windowHandles.size();
+
+    // Find the bounds of every display first, invisible windows can neither be touched
+    // nor obscure anything.
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        mZOrders.add(windowHandles[i].get(), i);
+        const InputWindowInfo* info = windowHandles[i]->getInfo();
+        if (!info->visible) {
+            continue;
+        }
+        Grid* grid = NULL;
+        for (Grid& g : mGrids) {
+            if (g.displayId == info->displayId) {
+                grid = &g;
+                break;
+            }
+        }
+        if (grid == NULL) {
+            mGrids.emplace_back();
+            grid = &mGrids.back();
+            grid->displayId = info->displayId;
+            grid->bounds = Rect::EMPTY_RECT;
+        }
+        if (!takesTouchesAnywhere(info)) {
+            unionRect(&grid->bounds, getWindowBounds(info));
+        }
+    }
+
+    for (Grid& grid : mGrids) {
+        grid.columns = std::min(grid.bounds.getWidth(), int32_t(MAX_GRID_SIZE));
+        grid.rows = std::min(grid.bounds.getHeight(), int32_t(MAX_GRID_SIZE));
+        if (grid.bounds.isEmpty()) {
+            grid.columns = grid.rows = 0;
+        }
+        grid.cells.resize(grid.columns * grid.rows);
+    }
+
+    // Then list the windows in the cells they intersect, front to back.
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        const InputWindowInfo* info = windowHandles[i]->getInfo();
+        if (!info->visible) {
+            continue;
+        }
+        for (Grid& grid : mGrids) {
+            if (grid.displayId != info->displayId) {
+                continue;
+            }
+            if (takesTouchesAnywhere(info)) {
+                grid.anywhere.push_back(i);
+                for (std::vector<uint32_t>& cell : grid.cells) {
+                    cell.push_back(i);
+                }
+                break;
+            }
+            const Rect bounds = getWindowBounds(info);
+            if (bounds.isEmpty()) {
+                break;
+            }
+            const Rect& b = grid.bounds;
+            const int32_t left = getCell(bounds.left, b.left, b.right, grid.columns);
+            const int32_t right = getCell(bounds.right - 1, b.left, b.right, grid.columns);
+            const int32_t top = getCell(bounds.top, b.top, b.bottom, grid.rows);
+            const int32_t bottom = getCell(bounds.bottom - 1, b.top, b.bottom, grid.rows);
+            for (int32_t row = top; row <= bottom; row++) {
+                for (int32_t column = left; column <= right; column++) {
+                    grid.cells[row * grid.columns + column].push_back(i);
+                }
+            }
+            break;
+        }
+    }
+}
+
+const std::vector<uint32_t>* InputDispatcher::WindowIndex::findCandidates(int32_t displayId,
+        int32_t x, int32_t y) const {
+    for (const Grid& grid : mGrids) {
+        if (grid.displayId != displayId) {
+            continue;
+        }
+        const Rect& b = grid.bounds;
+        if (grid.cells.empty() || x < b.left || x >= b.right || y < b.top || y >= b.bottom) {
+            return &grid.anywhere;
+        }
+        const int32_t column = getCell(x, b.left, b.right, grid.columns);
+        const int32_t row = getCell(y, b.top, b.bottom, grid.rows);
+        return &grid.cells[row * grid.columns + column];
+    }
+    return NULL;
+}
+
+uint32_t InputDispatcher::WindowIndex::getZOrder(
+        const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = mZOrders.indexOfKey(windowHandle.get());
+    return index >= 0 ? mZOrders.valueAt(index) : mWindowCount;
+}
+
+void InputDispatcher::WindowIndex::dump(std::string& dump) const {
+    if (mGrids.empty()) {
+        dump += INDENT "WindowIndex: <empty>\n";
+        return;
+    }
+    dump += INDENT "WindowIndex:\n";
+    for (const Grid& grid : mGrids) {
+        size_t entries = 0;
+        size_t maxEntries = 0;
+        for (const std::vector<uint32_t>& cell : grid.cells) {
+            entries += cell.size();
+            maxEntries = std::max(maxEntries, cell.size());
+        }
+        dump += StringPrintf(INDENT2 "displayId=%d, bounds=[%d,%d][%d,%d], cells=%dx%d, "
+                "entries=%zu, maxCellEntries=%zu, anywhere=%zu\n",
+                grid.displayId, grid.bounds.left, grid.bounds.top,
+                grid.bounds.right, grid.bounds.bottom, grid.columns, grid.rows,
+                entries, maxEntries, grid.anywhere.size());
+    }
+}
+
+
 // --- InputDispatcher::InputState ---
 
 InputDispatcher::InputState::InputState() {
@@ -4472,7 +5078,8 @@ InputDispatcher::Connection::Connection(const sp<InputChannel>& inputChannel,
         const sp<InputWindowHandle>& inputWindowHandle, bool monitor) :
         status(STATUS_NORMAL), inputChannel(inputChannel), inputWindowHandle(inputWindowHandle),
         monitor(monitor),
-        inputPublisher(inputChannel), inputPublisherBlocked(false) {
+        inputPublisher(inputChannel), inputPublisherBlocked(false),
+        dispatchWorker(0), dispatchScheduled(false), dispatchGeneration(0) {
 }
 
 InputDispatcher::Connection::~Connection() {
@@ -4629,6 +5236,18 @@ bool InputDispatcher::TouchState::isSlippery() const {
 }
 
 
+// --- InputDispatcher::DispatchWorker ---
+
+InputDispatcher::DispatchWorker::DispatchWorker(InputDispatcher* dispatcher) :
+        Thread(/*canCallJava*/ false), maxQueueDepth(0), cycleCount(0), eventCount(0),
+        mDispatcher(dispatcher) {
+}
+
+bool InputDispatcher::DispatchWorker::threadLoop() {
+    return mDispatcher->runDispatchWorker(this);
+}
+
+
 // --- InputDispatcherThread ---
 
 InputDispatcherThread::InputDispatcherThread(const sp<InputDispatcherInterface>& dispatcher) :
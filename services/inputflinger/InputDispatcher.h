@@ -32,9 +32,13 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include <atomic>
+#include <vector>
+
 #include "InputWindow.h"
 #include "InputApplication.h"
 #include "InputListener.h"
+#include "LatencyHistogram.h"
 
 
 namespace android {
@@ -180,9 +184,14 @@ struct InputDispatcherConfiguration {
     // The key repeat inter-key delay.
     nsecs_t keyRepeatDelay;
 
+    // The number of worker threads publishing events to the connections, or 0 to
+    // publish them on the dispatcher thread itself.
+    size_t dispatchWorkerCount;
+
     InputDispatcherConfiguration() :
             keyRepeatTimeout(500 * 1000000LL),
-            keyRepeatDelay(50 * 1000000LL) { }
+            keyRepeatDelay(50 * 1000000LL),
+            dispatchWorkerCount(0) { }
 };
 
 
@@ -377,6 +386,8 @@ public:
 
     virtual void dispatchOnce();
 
+    /* Notifications must come from one thread at a time, as the reader's flushes do.
+     * They are handed off to the dispatcher thread without taking the dispatcher lock. */
     virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args);
     virtual void notifyKey(const NotifyKeyArgs* args);
     virtual void notifyMotion(const NotifyMotionArgs* args);
@@ -436,6 +447,7 @@ private:
         mutable int32_t refCount;
         int32_t type;
         nsecs_t eventTime;
+        nsecs_t enqueueTime; // when it entered the inbound queue, 0 if it never did
         uint32_t policyFlags;
         InjectionState* injectionState;
 
@@ -500,6 +512,10 @@ private:
         virtual void appendDescription(std::string& msg) const;
         void recycle();
 
+        // Allocated from a pool, see EntryPool.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+
     protected:
         virtual ~KeyEntry();
     };
@@ -532,6 +548,10 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(std::string& msg) const;
 
+        // Allocated from a pool along with the pointer arrays, see EntryPool.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+
     protected:
         virtual ~MotionEntry();
     };
@@ -555,6 +575,10 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        // Allocated from a pool, see EntryPool.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -569,6 +593,23 @@ private:
         static uint32_t nextSeq();
     };
 
+    // What it takes to publish a dispatch entry, copied out so that a dispatch worker can
+    // publish it without holding the lock while the entry may be released.  The worker
+    // holds a reference to the event in the meantime.
+    struct PublishRequest {
+        DispatchEntry* dispatchEntry; // only valid with the lock held, see Connection
+        uint32_t seq;
+        EventEntry* eventEntry;
+        int32_t targetFlags;
+        float xOffset;
+        float yOffset;
+        float scaleFactor;
+        int32_t resolvedAction;
+        int32_t resolvedFlags;
+
+        void initialize(DispatchEntry* entry);
+    };
+
     // A command entry captures state and behavior for an action to be performed in the
     // dispatch loop after the initial processing has taken place.  It is essentially
     // a kind of continuation used to postpone sensitive policy interactions to a point
@@ -676,6 +717,31 @@ private:
         }
     };
 
+    /* Lock-free single-producer single-consumer ring of notified events on their way to
+     * the inbound queue.  The producer is the notifying thread and the consumer is
+     * whichever thread holds mLock. */
+    class InboundHandoff {
+    public:
+        struct Slot {
+            EventEntry* entry;
+            uint32_t filterGeneration; // mInputFilterGeneration when the event was notified
+        };
+
+        InboundHandoff();
+
+        // Returns false if the ring is full.
+        bool push(EventEntry* entry, uint32_t filterGeneration);
+        // Returns false if the ring is empty.
+        bool pop(Slot* outSlot);
+
+    private:
+        static const size_t CAPACITY = 256;
+
+        Slot mSlots[CAPACITY];
+        std::atomic<size_t> mHead; // written by the consumer
+        std::atomic<size_t> mTail; // written by the producer
+    };
+
     /* Specifies which events are to be canceled and why. */
     struct CancelationOptions {
         enum Mode {
@@ -828,6 +894,22 @@ private:
         // yet received a "finished" response from the application.
         Queue<DispatchEntry> waitQueue;
 
+        // The dispatch worker publishing to this connection, if there are any.  A connection
+        // is only ever queued once on its worker, which keeps its events in order.
+        size_t dispatchWorker;
+        bool dispatchScheduled;
+
+        // Incremented whenever the dispatch queues are drained, so that a worker can tell
+        // whether the entries it published without holding the lock are still there.
+        uint32_t dispatchGeneration;
+
+        // Latencies of the events this connection finished: from the inbound queue to the
+        // socket, from the socket to the finished signal, and from the kernel timestamp to
+        // the finished signal.
+        LatencyHistogram queueLatency;
+        LatencyHistogram appLatency;
+        LatencyHistogram endToEndLatency;
+
         explicit Connection(const sp<InputChannel>& inputChannel,
                 const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
 
@@ -855,10 +937,51 @@ private:
 
     Condition mDispatcherIsAliveCondition;
 
+    // Publishes events to the connections scheduled on it, in parallel with the dispatcher
+    // thread and the other workers.
+    class DispatchWorker : public Thread {
+    public:
+        explicit DispatchWorker(InputDispatcher* dispatcher);
+
+        Condition condition;
+        Vector<sp<Connection> > queue; // guarded by the dispatcher lock
+
+        // Statistics, guarded by the dispatcher lock.
+        size_t maxQueueDepth;
+        uint64_t cycleCount;
+        uint64_t eventCount;
+
+    private:
+        virtual bool threadLoop();
+
+        InputDispatcher* mDispatcher;
+    };
+
+    Vector<sp<DispatchWorker> > mDispatchWorkers;
+    size_t mNextDispatchWorker;
+    bool mDispatchWorkersExiting;
+
+    bool runDispatchWorker(DispatchWorker* worker);
+    void runDispatchWorkerCycleLocked(DispatchWorker* worker, const sp<Connection>& connection);
+    void scheduleDispatchCycleLocked(const sp<Connection>& connection);
+    static status_t publishDispatchEntry(const sp<Connection>& connection,
+            const PublishRequest& request);
+
     sp<Looper> mLooper;
 
+    // Wakes mLooper up at the exact time of the next deadline, which the millisecond timeout
+    // of pollOnce() would round up.  -1 if the timer could not be created.
+    int mWakeupTimerFd;
+    nsecs_t mWakeupTimerTime; // when the timer is armed to expire, LONG_LONG_MAX if it is not
+    void armWakeupTimer(nsecs_t when);
+    static int handleWakeupTimerCallback(int fd, int events, void* data);
+
     EventEntry* mPendingEvent;
     Queue<EventEntry> mInboundQueue;
+    InboundHandoff mInboundHandoff;
+    // Set once the dispatcher has been woken up for the events in mInboundHandoff, so that
+    // a batch of notifications costs a single wake.
+    std::atomic<bool> mInboundHandoffWakePending;
     Queue<EventEntry> mRecentQueue;
     Queue<CommandEntry> mCommandQueue;
 
@@ -869,6 +992,12 @@ private:
     // Enqueues an inbound event.  Returns true if mLooper->wake() should be called.
     bool enqueueInboundEventLocked(EventEntry* entry);
 
+    // Hands a notified event off to the dispatcher thread.
+    void handOffInboundEvent(EventEntry* entry, uint32_t filterGeneration);
+    // Moves the handed off events to the inbound queue.  Returns true if mLooper->wake()
+    // should be called.
+    bool takeInboundHandoffLocked();
+
     // Cleans up input state when dropping an inbound event.
     void dropInboundEventLocked(EventEntry* entry, DropReason dropReason);
 
@@ -896,6 +1025,10 @@ private:
     // All registered connections mapped by channel file descriptor.
     KeyedVector<int, sp<Connection> > mConnectionsByFd;
 
+    // From the kernel timestamp to the inbound queue, per input device.
+    KeyedVector<int32_t, LatencyHistogram> mDeviceLatencies;
+    void recordDeviceLatencyLocked(int32_t deviceId, const EventEntry* entry);
+
     ssize_t getConnectionIndexLocked(const sp<InputChannel>& inputChannel);
 
     // Input channels that will receive a copy of all input events.
@@ -939,8 +1072,8 @@ private:
     CommandEntry* postCommandLocked(Command command);
 
     // Input filter processing.
-    bool shouldSendKeyToInputFilterLocked(const NotifyKeyArgs* args);
-    bool shouldSendMotionToInputFilterLocked(const NotifyMotionArgs* args);
+    bool shouldSendKeyToInputFilter(const NotifyKeyArgs* args);
+    bool shouldSendMotionToInputFilter(const NotifyMotionArgs* args);
 
     // Inbound event processing.
     void drainInboundQueueLocked();
@@ -950,10 +1083,54 @@ private:
     // Dispatch state.
     bool mDispatchEnabled;
     bool mDispatchFrozen;
-    bool mInputFilterEnabled;
+    std::atomic<bool> mInputFilterEnabled;
+    // Incremented when the input filter is enabled or disabled.  Events notified before
+    // then are dropped along with everything else that was inbound.
+    std::atomic<uint32_t> mInputFilterGeneration;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
 
+    // Spatial index of the visible windows in mWindowHandles, so that hit-testing and
+    // occlusion checks only look at the windows that may contain a point instead of all of
+    // them.  Each display is divided into a grid of cells, and each cell lists the windows
+    // whose frame or touchable region intersects it, front to back.  Windows that take
+    // touches anywhere (touch modal or watching outside touches) are listed everywhere.
+    // Rebuilt by setInputWindows().
+    class WindowIndex {
+    public:
+        void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+        // Returns the indices in mWindowHandles of the windows that may contain the point,
+        // front to back, or NULL if there is no visible window on the display.
+        const std::vector<uint32_t>* findCandidates(int32_t displayId,
+                int32_t x, int32_t y) const;
+
+        // Returns the index of the window in mWindowHandles, or the number of windows if
+        // it is not one of them.
+        uint32_t getZOrder(const sp<InputWindowHandle>& windowHandle) const;
+
+        void dump(std::string& dump) const;
+
+    private:
+        enum { MAX_GRID_SIZE = 16 };
+
+        struct Grid {
+            int32_t displayId;
+            // The bounds of the windows that do not take touches anywhere.
+            Rect bounds;
+            int32_t columns, rows;
+            std::vector<std::vector<uint32_t> > cells;
+            // The windows that take touches anywhere, for points out of the bounds.
+            std::vector<uint32_t> anywhere;
+        };
+
+        std::vector<Grid> mGrids;
+        KeyedVector<const InputWindowHandle*, uint32_t> mZOrders;
+        uint32_t mWindowCount = 0;
+    };
+
+    WindowIndex mWindowIndex;
+
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
 
@@ -1072,6 +1249,9 @@ private:
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    // Handles a failure to publish the head of the outbound queue.
+    void handlePublishErrorLocked(nsecs_t currentTime, const sp<Connection>& connection,
+            status_t status);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
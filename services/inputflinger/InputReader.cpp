@@ -52,6 +52,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <cutils/properties.h>
 #include <log/log.h>
 
 #include <android-base/stringprintf.h>
@@ -84,6 +85,9 @@ static const nsecs_t TOUCH_DATA_TIMEOUT = ms2ns(20);
 // data.
 static const nsecs_t STYLUS_DATA_LATENCY = ms2ns(10);
 
+// Mask of INPUT_DEVICE_CLASS_* whose devices map their raw events on a thread of their own.
+static const char* DEDICATED_THREAD_CLASSES_PROPERTY = "ro.input.dedicated_thread_classes";
+
 // --- Static Functions ---
 
 template<typename T>
@@ -339,16 +343,40 @@ void TouchAffineTransformation::applyTo(float& x, float& y) const {
 }
 
 
+// --- AutoDeviceLock ---
+
+// Holds the lock of a device that maps its events on a dedicated thread while the caller
+// calls into it. Does nothing for the devices of the reader thread.
+class AutoDeviceLock {
+public:
+    explicit AutoDeviceLock(InputDevice* device) : mLock(device->getThreadLock()) {
+        if (mLock) {
+            mLock->lock();
+        }
+    }
+
+    ~AutoDeviceLock() {
+        if (mLock) {
+            mLock->unlock();
+        }
+    }
+
+private:
+    Mutex* mLock;
+};
+
+
 // --- InputReader ---
 
 InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         const sp<InputReaderPolicyInterface>& policy,
         const sp<InputListenerInterface>& listener) :
-        mContext(this), mEventHub(eventHub), mPolicy(policy),
-        mGlobalMetaState(0), mGeneration(1),
+        mContext(this), mEventHub(eventHub), mPolicy(policy), mListener(listener),
+        mDeviceThreadRequests(0), mGlobalMetaState(0), mGeneration(1),
         mDisableVirtualKeysTimeout(LLONG_MIN), mNextTimeout(LLONG_MAX),
         mConfigurationChangesToRefresh(0) {
     mQueuedListener = new QueuedInputListener(listener);
+    mDedicatedThreadClasses = uint32_t(property_get_int32(DEDICATED_THREAD_CLASSES_PROPERTY, 0));
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -359,6 +387,14 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
 }
 
 InputReader::~InputReader() {
+    for (size_t i = 0; i < mDeviceThreads.size(); i++) {
+        mDeviceThreads.valueAt(i)->requestStop();
+        mDeviceThreads.valueAt(i)->requestExitAndWait();
+    }
+    for (size_t i = 0; i < mStoppedDeviceThreads.size(); i++) {
+        mStoppedDeviceThreads[i]->requestExitAndWait();
+        delete mStoppedDeviceThreads[i]->getDevice();
+    }
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
@@ -369,6 +405,7 @@ void InputReader::loopOnce() {
     int32_t timeoutMillis;
     bool inputDevicesChanged = false;
     Vector<InputDeviceInfo> inputDevices;
+    Vector<sp<DeviceThread> > stoppedDeviceThreads;
     { // acquire lock
         AutoMutex _l(mLock);
 
@@ -387,6 +424,7 @@ void InputReader::loopOnce() {
     } // release lock
 
     size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
+    nsecs_t readTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -394,8 +432,11 @@ void InputReader::loopOnce() {
 
         if (count) {
             processEventsLocked(mEventBuffer, count);
+            mProcessingLatency.record(systemTime(SYSTEM_TIME_MONOTONIC) - readTime);
         }
 
+        handleDeviceThreadRequestsLocked();
+
         if (mNextTimeout != LLONG_MAX) {
             nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
             if (now >= mNextTimeout) {
@@ -411,6 +452,9 @@ void InputReader::loopOnce() {
             inputDevicesChanged = true;
             getInputDevicesLocked(inputDevices);
         }
+
+        stoppedDeviceThreads = mStoppedDeviceThreads;
+        mStoppedDeviceThreads.clear();
     } // release lock
 
     // Send out a message that the describes the changed input devices.
@@ -425,7 +469,16 @@ void InputReader::loopOnce() {
     // resulting in a deadlock.  This situation is actually quite plausible because the
     // listener is actually the input dispatcher, which calls into the window manager,
     // which occasionally calls into the input reader.
-    mQueuedListener->flush();
+    { // acquire flush lock
+        AutoMutex _l(mFlushLock);
+        mQueuedListener->flush();
+    } // release flush lock
+
+    // The threads of removed devices are joined without the lock for the same reason.
+    for (size_t i = 0; i < stoppedDeviceThreads.size(); i++) {
+        stoppedDeviceThreads[i]->requestExitAndWait();
+        delete stoppedDeviceThreads[i]->getDevice();
+    }
 }
 
 void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
@@ -495,6 +548,38 @@ void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
     if (device->getClasses() & INPUT_DEVICE_CLASS_EXTERNAL_STYLUS) {
         notifyExternalStylusPresenceChanged();
     }
+
+    if (shouldUseDedicatedThreadLocked(device)) {
+        startDeviceThreadLocked(device);
+    }
+}
+
+bool InputReader::shouldUseDedicatedThreadLocked(InputDevice* device) {
+    // External styluses are fused with touches on the reader thread.
+    if (device->isIgnored() || (device->getClasses() & INPUT_DEVICE_CLASS_EXTERNAL_STYLUS)) {
+        return false;
+    }
+
+    bool dedicatedThread = device->getClasses() & mDedicatedThreadClasses;
+    device->getConfiguration().tryGetProperty(String8("device.dedicatedThread"),
+            dedicatedThread);
+    return dedicatedThread;
+}
+
+void InputReader::startDeviceThreadLocked(InputDevice* device) {
+    sp<DeviceThread> thread = new DeviceThread(this, device);
+    device->setThreadLock(thread->getDeviceLock());
+    std::string name = StringPrintf("InputReader:%d", device->getId());
+    status_t result = thread->run(name.c_str(), PRIORITY_URGENT_DISPLAY);
+    if (result) {
+        ALOGE("Could not start the thread of device %d, mapping its events on the reader "
+                "thread.  status=%d", device->getId(), result);
+        device->setThreadLock(NULL);
+        return;
+    }
+
+    ALOGI("Device %d maps its events on a dedicated thread.", device->getId());
+    mDeviceThreads.add(device->getId(), thread);
 }
 
 void InputReader::removeDeviceLocked(nsecs_t when, int32_t deviceId) {
@@ -521,8 +606,25 @@ void InputReader::removeDeviceLocked(nsecs_t when, int32_t deviceId) {
         notifyExternalStylusPresenceChanged();
     }
 
-    device->reset(when);
-    delete device;
+    sp<DeviceThread> thread;
+    ssize_t threadIndex = mDeviceThreads.indexOfKey(deviceId);
+    if (threadIndex >= 0) {
+        thread = mDeviceThreads.valueAt(threadIndex);
+        mDeviceThreads.removeItemsAt(threadIndex);
+        thread->requestStop();
+    }
+
+    { // acquire device lock
+        AutoDeviceLock _dl(device);
+        device->reset(when);
+    } // release device lock
+
+    if (thread != NULL) {
+        // Deleted by loopOnce() once the thread is done with it.
+        mStoppedDeviceThreads.push(thread);
+    } else {
+        delete device;
+    }
 }
 
 InputDevice* InputReader::createDeviceLocked(int32_t deviceId, int32_t controllerNumber,
@@ -614,6 +716,11 @@ void InputReader::processEventsForDeviceLocked(int32_t deviceId,
         return;
     }
 
+    if (device->getThreadLock()) {
+        mDeviceThreads.valueFor(deviceId)->enqueueEvents(rawEvents, count);
+        return;
+    }
+
     device->process(rawEvents, count);
 }
 
@@ -621,6 +728,7 @@ void InputReader::timeoutExpiredLocked(nsecs_t when) {
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
         if (!device->isIgnored()) {
+            AutoDeviceLock _dl(device);
             device->timeoutExpired(when);
         }
     }
@@ -648,6 +756,7 @@ void InputReader::refreshConfigurationLocked(uint32_t changes) {
         } else {
             for (size_t i = 0; i < mDevices.size(); i++) {
                 InputDevice* device = mDevices.valueAt(i);
+                AutoDeviceLock _dl(device);
                 device->configure(now, &mConfig, changes);
             }
         }
@@ -655,12 +764,14 @@ void InputReader::refreshConfigurationLocked(uint32_t changes) {
 }
 
 void InputReader::updateGlobalMetaStateLocked() {
-    mGlobalMetaState = 0;
+    int32_t globalMetaState = 0;
 
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
-        mGlobalMetaState |= device->getMetaState();
+        AutoDeviceLock _dl(device);
+        globalMetaState |= device->getMetaState();
     }
+    mGlobalMetaState = globalMetaState;
 }
 
 int32_t InputReader::getGlobalMetaStateLocked() {
@@ -684,6 +795,7 @@ void InputReader::getExternalStylusDevicesLocked(Vector<InputDeviceInfo>& outDev
 void InputReader::dispatchExternalStylusState(const StylusState& state) {
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
+        AutoDeviceLock _dl(device);
         device->updateExternalStylusState(state);
     }
 }
@@ -709,6 +821,7 @@ bool InputReader::shouldDropVirtualKeyLocked(nsecs_t now,
 void InputReader::fadePointerLocked() {
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
+        AutoDeviceLock _dl(device);
         device->fadePointer();
     }
 }
@@ -724,6 +837,21 @@ int32_t InputReader::bumpGenerationLocked() {
     return ++mGeneration;
 }
 
+void InputReader::postDeviceThreadRequest(uint32_t request) {
+    mDeviceThreadRequests |= request;
+    mEventHub->wake();
+}
+
+void InputReader::handleDeviceThreadRequestsLocked() {
+    uint32_t requests = mDeviceThreadRequests.exchange(0);
+    if (requests & DEVICE_THREAD_REQUEST_UPDATE_GLOBAL_META_STATE) {
+        updateGlobalMetaStateLocked();
+    }
+    if (requests & DEVICE_THREAD_REQUEST_FADE_POINTER) {
+        fadePointerLocked();
+    }
+}
+
 void InputReader::getInputDevices(Vector<InputDeviceInfo>& outInputDevices) {
     AutoMutex _l(mLock);
     getInputDevicesLocked(outInputDevices);
@@ -736,6 +864,7 @@ void InputReader::getInputDevicesLocked(Vector<InputDeviceInfo>& outInputDevices
     for (size_t i = 0; i < numDevices; i++) {
         InputDevice* device = mDevices.valueAt(i);
         if (!device->isIgnored()) {
+            AutoDeviceLock _dl(device);
             outInputDevices.push();
             device->getDeviceInfo(&outInputDevices.editTop());
         }
@@ -770,6 +899,7 @@ int32_t InputReader::getStateLocked(int32_t deviceId, uint32_t sourceMask, int32
         if (deviceIndex >= 0) {
             InputDevice* device = mDevices.valueAt(deviceIndex);
             if (! device->isIgnored() && sourcesMatchMask(device->getSources(), sourceMask)) {
+                AutoDeviceLock _dl(device);
                 result = (device->*getStateFunc)(sourceMask, code);
             }
         }
@@ -780,6 +910,7 @@ int32_t InputReader::getStateLocked(int32_t deviceId, uint32_t sourceMask, int32
             if (! device->isIgnored() && sourcesMatchMask(device->getSources(), sourceMask)) {
                 // If any device reports AKEY_STATE_DOWN or AKEY_STATE_VIRTUAL, return that
                 // value.  Otherwise, return AKEY_STATE_UP as long as one device reports it.
+                AutoDeviceLock _dl(device);
                 int32_t currentResult = (device->*getStateFunc)(sourceMask, code);
                 if (currentResult >= AKEY_STATE_DOWN) {
                     return currentResult;
@@ -804,6 +935,7 @@ void InputReader::toggleCapsLockState(int32_t deviceId) {
         return;
     }
 
+    AutoDeviceLock _dl(device);
     device->updateMetaState(AKEYCODE_CAPS_LOCK);
 }
 
@@ -823,6 +955,7 @@ bool InputReader::markSupportedKeyCodesLocked(int32_t deviceId, uint32_t sourceM
         if (deviceIndex >= 0) {
             InputDevice* device = mDevices.valueAt(deviceIndex);
             if (! device->isIgnored() && sourcesMatchMask(device->getSources(), sourceMask)) {
+                AutoDeviceLock _dl(device);
                 result = device->markSupportedKeyCodes(sourceMask,
                         numCodes, keyCodes, outFlags);
             }
@@ -832,6 +965,7 @@ bool InputReader::markSupportedKeyCodesLocked(int32_t deviceId, uint32_t sourceM
         for (size_t i = 0; i < numDevices; i++) {
             InputDevice* device = mDevices.valueAt(i);
             if (! device->isIgnored() && sourcesMatchMask(device->getSources(), sourceMask)) {
+                AutoDeviceLock _dl(device);
                 result |= device->markSupportedKeyCodes(sourceMask,
                         numCodes, keyCodes, outFlags);
             }
@@ -860,6 +994,7 @@ void InputReader::vibrate(int32_t deviceId, const nsecs_t* pattern, size_t patte
     ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
     if (deviceIndex >= 0) {
         InputDevice* device = mDevices.valueAt(deviceIndex);
+        AutoDeviceLock _dl(device);
         device->vibrate(pattern, patternSize, repeat, token);
     }
 }
@@ -870,6 +1005,7 @@ void InputReader::cancelVibrate(int32_t deviceId, int32_t token) {
     ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
     if (deviceIndex >= 0) {
         InputDevice* device = mDevices.valueAt(deviceIndex);
+        AutoDeviceLock _dl(device);
         device->cancelVibrate(token);
     }
 }
@@ -894,8 +1030,19 @@ void InputReader::dump(std::string& dump) {
 
     dump += "Input Reader State:\n";
 
+    dump += INDENT "ProcessingLatency: ";
+    mProcessingLatency.dump(dump);
+    dump += "\n";
+
+    dump += StringPrintf(INDENT "DedicatedThreadClasses: 0x%08x\n", mDedicatedThreadClasses);
+    for (size_t i = 0; i < mDeviceThreads.size(); i++) {
+        mDeviceThreads.valueAt(i)->dump(dump);
+    }
+
     for (size_t i = 0; i < mDevices.size(); i++) {
-        mDevices.valueAt(i)->dump(dump);
+        InputDevice* device = mDevices.valueAt(i);
+        AutoDeviceLock _dl(device);
+        device->dump(dump);
     }
 
     dump += INDENT "Configuration:\n";
@@ -972,13 +1119,20 @@ InputReader::ContextImpl::ContextImpl(InputReader* reader) :
         mReader(reader) {
 }
 
+// Device threads call the context without the reader lock, so what needs it is either left
+// to the reader thread or kept by the device thread itself.
+
 void InputReader::ContextImpl::updateGlobalMetaState() {
+    if (DeviceThread::getCurrent()) {
+        mReader->postDeviceThreadRequest(DEVICE_THREAD_REQUEST_UPDATE_GLOBAL_META_STATE);
+        return;
+    }
     // lock is already held by the input loop
     mReader->updateGlobalMetaStateLocked();
 }
 
 int32_t InputReader::ContextImpl::getGlobalMetaState() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, or the state is read atomically
     return mReader->getGlobalMetaStateLocked();
 }
 
@@ -994,26 +1148,48 @@ bool InputReader::ContextImpl::shouldDropVirtualKey(nsecs_t now,
 }
 
 void InputReader::ContextImpl::fadePointer() {
+    if (DeviceThread::getCurrent()) {
+        mReader->postDeviceThreadRequest(DEVICE_THREAD_REQUEST_FADE_POINTER);
+        return;
+    }
     // lock is already held by the input loop
     mReader->fadePointerLocked();
 }
 
 void InputReader::ContextImpl::requestTimeoutAtTime(nsecs_t when) {
+    DeviceThread* thread = DeviceThread::getCurrent();
+    if (thread) {
+        thread->requestTimeoutAtTime(when);
+        return;
+    }
     // lock is already held by the input loop
     mReader->requestTimeoutAtTimeLocked(when);
 }
 
 int32_t InputReader::ContextImpl::bumpGeneration() {
+    if (DeviceThread::getCurrent()) {
+        // Wake the reader thread up so that it reports the change.
+        int32_t generation = mReader->bumpGenerationLocked();
+        mReader->mEventHub->wake();
+        return generation;
+    }
     // lock is already held by the input loop
     return mReader->bumpGenerationLocked();
 }
 
 void InputReader::ContextImpl::getExternalStylusDevices(Vector<InputDeviceInfo>& outDevices) {
+    // External styluses are only fused with the touches of the reader thread.
+    if (DeviceThread::getCurrent()) {
+        return;
+    }
     // lock is already held by whatever called refreshConfigurationLocked
     mReader->getExternalStylusDevicesLocked(outDevices);
 }
 
 void InputReader::ContextImpl::dispatchExternalStylusState(const StylusState& state) {
+    if (DeviceThread::getCurrent()) {
+        return;
+    }
     mReader->dispatchExternalStylusState(state);
 }
 
@@ -1022,6 +1198,10 @@ InputReaderPolicyInterface* InputReader::ContextImpl::getPolicy() {
 }
 
 InputListenerInterface* InputReader::ContextImpl::getListener() {
+    DeviceThread* thread = DeviceThread::getCurrent();
+    if (thread) {
+        return thread->getListener();
+    }
     return mReader->mQueuedListener.get();
 }
 
@@ -1030,6 +1210,116 @@ EventHubInterface* InputReader::ContextImpl::getEventHub() {
 }
 
 
+// --- InputReader::DeviceThread ---
+
+thread_local InputReader::DeviceThread* InputReader::DeviceThread::sCurrent = NULL;
+
+InputReader::DeviceThread::DeviceThread(InputReader* reader, InputDevice* device) :
+        Thread(/*canCallJava*/ true), mReader(reader), mDevice(device),
+        mQueuedListener(new QueuedInputListener(reader->mListener)),
+        mNextTimeout(LLONG_MAX), mPendingTime(0) {
+}
+
+InputReader::DeviceThread::~DeviceThread() {
+}
+
+InputReader::DeviceThread* InputReader::DeviceThread::getCurrent() {
+    return sCurrent;
+}
+
+void InputReader::DeviceThread::enqueueEvents(const RawEvent* rawEvents, size_t count) {
+    AutoMutex _l(mQueueLock);
+    if (mPendingEvents.empty()) {
+        mPendingTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mQueueCondition.signal();
+    }
+    mPendingEvents.insert(mPendingEvents.end(), rawEvents, rawEvents + count);
+}
+
+void InputReader::DeviceThread::requestTimeoutAtTime(nsecs_t when) {
+    AutoMutex _l(mQueueLock);
+    if (when < mNextTimeout) {
+        mNextTimeout = when;
+        mQueueCondition.signal();
+    }
+}
+
+void InputReader::DeviceThread::requestStop() {
+    AutoMutex _l(mQueueLock);
+    requestExit();
+    mQueueCondition.signal();
+}
+
+void InputReader::DeviceThread::dump(std::string& dump) {
+    size_t pendingEventCount;
+    { // acquire lock
+        AutoMutex _l(mQueueLock);
+        pendingEventCount = mPendingEvents.size();
+    } // release lock
+
+    AutoMutex _l(mDeviceLock);
+    dump += StringPrintf(INDENT "DeviceThread %d: pendingEvents=%zu, processingLatency: ",
+            mDevice->getId(), pendingEventCount);
+    mProcessingLatency.dump(dump);
+    dump += "\n";
+}
+
+status_t InputReader::DeviceThread::readyToRun() {
+    sCurrent = this;
+    return OK;
+}
+
+bool InputReader::DeviceThread::threadLoop() {
+    bool timeoutExpired = false;
+    nsecs_t pendingTime;
+    { // acquire lock
+        AutoMutex _l(mQueueLock);
+        while (mPendingEvents.empty() && !exitPending()) {
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (now >= mNextTimeout) {
+                mNextTimeout = LLONG_MAX;
+                timeoutExpired = true;
+                break;
+            }
+            if (mNextTimeout == LLONG_MAX) {
+                mQueueCondition.wait(mQueueLock);
+            } else {
+                mQueueCondition.waitRelative(mQueueLock, mNextTimeout - now);
+            }
+        }
+        if (exitPending()) {
+            return false;
+        }
+        mEvents.swap(mPendingEvents);
+        mPendingEvents.clear();
+        pendingTime = mPendingTime;
+    } // release lock
+
+    { // acquire device lock
+        AutoMutex _l(mDeviceLock);
+        // The device may have been removed and reset while we were waiting.
+        if (exitPending()) {
+            return false;
+        }
+
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (!mEvents.empty()) {
+            mDevice->process(mEvents.data(), mEvents.size());
+            mProcessingLatency.record(systemTime(SYSTEM_TIME_MONOTONIC) - pendingTime);
+        }
+        if (timeoutExpired) {
+            mDevice->timeoutExpired(now);
+        }
+    } // release device lock
+
+    { // acquire flush lock
+        AutoMutex _l(mReader->mFlushLock);
+        mQueuedListener->flush();
+    } // release flush lock
+    return true;
+}
+
+
 // --- InputReaderThread ---
 
 InputReaderThread::InputReaderThread(const sp<InputReaderInterface>& reader) :
@@ -1049,7 +1339,8 @@ bool InputReaderThread::threadLoop() {
 
 InputDevice::InputDevice(InputReaderContext* context, int32_t id, int32_t generation,
         int32_t controllerNumber, const InputDeviceIdentifier& identifier, uint32_t classes) :
-        mContext(context), mId(id), mGeneration(generation), mControllerNumber(controllerNumber),
+        mContext(context), mThreadLock(NULL), mId(id), mGeneration(generation),
+        mControllerNumber(controllerNumber),
         mIdentifier(identifier), mClasses(classes),
         mSources(0), mIsExternal(false), mHasMic(false), mDropUntilNextSync(false) {
 }
@@ -6608,6 +6899,12 @@ void TouchInputMapper::assignPointerIds(const RawState* last, RawState* current)
         return;
     }
 
+    // Same pointers moving a little from one sample to the next.
+    if (currentPointerCount == lastPointerCount
+            && assignPointerIdsByMutualNearest(last, current)) {
+        return;
+    }
+
     // General case.
     // We build a heap of squared euclidean distances between current and last pointers
     // associated with the current and last pointer indices.  Then, we find the best
@@ -6762,6 +7059,91 @@ void TouchInputMapper::assignPointerIds(const RawState* last, RawState* current)
     }
 }
 
+bool TouchInputMapper::assignPointerIdsByMutualNearest(const RawState* last,
+        RawState* current) {
+    // The greedy matching of assignPointerIds() pairs up pointers by increasing
+    // distance. When every current pointer and the last pointer nearest to it
+    // are each other's strictly nearest pointers, it produces exactly these
+    // pairs, so they can be assigned without building the distance heap.
+    const uint32_t pointerCount = current->rawPointerData.pointerCount;
+    uint32_t nearestLast[MAX_POINTERS];
+    uint64_t nearestLastDistance[MAX_POINTERS];
+    bool nearestLastUnique[MAX_POINTERS];
+    uint32_t nearestCurrent[MAX_POINTERS];
+    uint64_t nearestCurrentDistance[MAX_POINTERS];
+    bool nearestCurrentUnique[MAX_POINTERS];
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        nearestLastDistance[i] = UINT64_MAX;
+        nearestLastUnique[i] = false;
+        nearestCurrentDistance[i] = UINT64_MAX;
+        nearestCurrentUnique[i] = false;
+    }
+
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        const RawPointerData::Pointer& currentPointer =
+                current->rawPointerData.pointers[currentPointerIndex];
+        for (uint32_t lastPointerIndex = 0; lastPointerIndex < pointerCount;
+                lastPointerIndex++) {
+            const RawPointerData::Pointer& lastPointer =
+                    last->rawPointerData.pointers[lastPointerIndex];
+            if (currentPointer.toolType != lastPointer.toolType) {
+                continue;
+            }
+            int64_t deltaX = currentPointer.x - lastPointer.x;
+            int64_t deltaY = currentPointer.y - lastPointer.y;
+            uint64_t distance = uint64_t(deltaX * deltaX + deltaY * deltaY);
+
+            if (distance < nearestLastDistance[currentPointerIndex]) {
+                nearestLast[currentPointerIndex] = lastPointerIndex;
+                nearestLastDistance[currentPointerIndex] = distance;
+                nearestLastUnique[currentPointerIndex] = true;
+            } else if (distance == nearestLastDistance[currentPointerIndex]) {
+                nearestLastUnique[currentPointerIndex] = false;
+            }
+            if (distance < nearestCurrentDistance[lastPointerIndex]) {
+                nearestCurrent[lastPointerIndex] = currentPointerIndex;
+                nearestCurrentDistance[lastPointerIndex] = distance;
+                nearestCurrentUnique[lastPointerIndex] = true;
+            } else if (distance == nearestCurrentDistance[lastPointerIndex]) {
+                nearestCurrentUnique[lastPointerIndex] = false;
+            }
+        }
+    }
+
+    // Mutual nearest pointers form a one to one mapping, since a last pointer
+    // can only have one nearest current pointer.
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        if (!nearestLastUnique[currentPointerIndex]) {
+            return false;
+        }
+        uint32_t lastPointerIndex = nearestLast[currentPointerIndex];
+        if (!nearestCurrentUnique[lastPointerIndex]
+                || nearestCurrent[lastPointerIndex] != currentPointerIndex) {
+            return false;
+        }
+    }
+
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        uint32_t lastPointerIndex = nearestLast[currentPointerIndex];
+        uint32_t id = last->rawPointerData.pointers[lastPointerIndex].id;
+        current->rawPointerData.pointers[currentPointerIndex].id = id;
+        current->rawPointerData.idToIndex[id] = currentPointerIndex;
+        current->rawPointerData.markIdBit(id,
+                current->rawPointerData.isHovering(currentPointerIndex));
+
+#if DEBUG_POINTER_ASSIGNMENT
+        ALOGD("assignPointerIds - nearest: cur=%" PRIu32 ", last=%" PRIu32
+                ", id=%" PRIu32 ", distance=%" PRIu64,
+                currentPointerIndex, lastPointerIndex, id,
+                nearestLastDistance[currentPointerIndex]);
+#endif
+    }
+    return true;
+}
+
 int32_t TouchInputMapper::getKeyCodeState(uint32_t sourceMask, int32_t keyCode) {
     if (mCurrentVirtualKey.down && mCurrentVirtualKey.keyCode == keyCode) {
         return AKEY_STATE_VIRTUAL;
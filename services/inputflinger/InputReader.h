@@ -38,6 +38,9 @@
 #include <stddef.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <vector>
+
 // Maximum supported size of a vibration pattern.
 // Must be at least 2.
 #define MAX_VIBRATE_PATTERN_SIZE 100
@@ -411,6 +414,12 @@ public:
  * uses a single Mutex to guard its state.  The Mutex may be held while calling into the
  * EventHub or the InputReaderPolicy but it is never held while calling into the
  * InputListener.
+ *
+ * Devices of the classes in the ro.input.dedicated_thread_classes property, or whose input
+ * device configuration sets device.dedicatedThread, have their raw events mapped on a thread
+ * of their own, so that a burst from a high rate device does not hold back the others.
+ * Everything else about these devices still happens on the reader thread, which holds the
+ * lock of the device while it calls into it.
  */
 class InputReader : public InputReaderInterface {
 public:
@@ -474,6 +483,56 @@ protected:
 
     friend class ContextImpl;
 
+    /* Maps the raw events of one device. The reader thread queues the events and the
+     * device thread processes them under the device lock, then flushes what its mappers
+     * notified to the listener. */
+    class DeviceThread : public Thread {
+    public:
+        DeviceThread(InputReader* reader, InputDevice* device);
+        virtual ~DeviceThread();
+
+        // Returns the device thread the caller runs on, or NULL on any other thread.
+        static DeviceThread* getCurrent();
+
+        inline InputDevice* getDevice() const { return mDevice; }
+        inline Mutex* getDeviceLock() { return &mDeviceLock; }
+        inline QueuedInputListener* getListener() const { return mQueuedListener.get(); }
+
+        void enqueueEvents(const RawEvent* rawEvents, size_t count);
+        void requestTimeoutAtTime(nsecs_t when);
+        // Asks the thread to exit without processing anything else.
+        void requestStop();
+
+        void dump(std::string& dump);
+
+    private:
+        InputReader* mReader;
+        InputDevice* mDevice;
+        sp<QueuedInputListener> mQueuedListener;
+
+        // Guards the state of the device.
+        Mutex mDeviceLock;
+
+        Mutex mQueueLock;
+        Condition mQueueCondition;
+        std::vector<RawEvent> mPendingEvents; // guarded by mQueueLock
+        nsecs_t mNextTimeout; // guarded by mQueueLock
+
+        // Events being processed, only used on the device thread.
+        std::vector<RawEvent> mEvents;
+
+        // From when the events are queued to when they have been processed.
+        LatencyHistogram mProcessingLatency; // guarded by mDeviceLock
+        nsecs_t mPendingTime; // guarded by mQueueLock
+
+        static thread_local DeviceThread* sCurrent;
+
+        virtual status_t readyToRun();
+        virtual bool threadLoop();
+    };
+
+    friend class DeviceThread;
+
 private:
     Mutex mLock;
 
@@ -481,8 +540,13 @@ private:
 
     sp<EventHubInterface> mEventHub;
     sp<InputReaderPolicyInterface> mPolicy;
+    sp<InputListenerInterface> mListener;
     sp<QueuedInputListener> mQueuedListener;
 
+    // Held while flushing events to the listener, which the reader thread and the device
+    // threads do without the reader lock, so that it sees a single ordered stream of events.
+    Mutex mFlushLock;
+
     InputReaderConfiguration mConfig;
 
     // The event queue.
@@ -491,6 +555,28 @@ private:
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
+    // From when getEvents returns to when its events have been processed.
+    LatencyHistogram mProcessingLatency;
+
+    // Device classes whose devices get a thread of their own.
+    uint32_t mDedicatedThreadClasses;
+    KeyedVector<int32_t, sp<DeviceThread> > mDeviceThreads;
+    // Threads of removed devices, which are joined and their devices deleted without the
+    // lock since they may be busy flushing to the listener.
+    Vector<sp<DeviceThread> > mStoppedDeviceThreads;
+
+    // Work that device threads leave to the reader thread.
+    enum {
+        DEVICE_THREAD_REQUEST_UPDATE_GLOBAL_META_STATE = 1 << 0,
+        DEVICE_THREAD_REQUEST_FADE_POINTER = 1 << 1,
+    };
+    std::atomic<uint32_t> mDeviceThreadRequests;
+    void postDeviceThreadRequest(uint32_t request);
+    void handleDeviceThreadRequestsLocked();
+
+    bool shouldUseDedicatedThreadLocked(InputDevice* device);
+    void startDeviceThreadLocked(InputDevice* device);
+
     // low-level input event decoding and device management
     void processEventsLocked(const RawEvent* rawEvents, size_t count);
 
@@ -501,7 +587,9 @@ private:
 
     void handleConfigurationChangedLocked(nsecs_t when);
 
-    int32_t mGlobalMetaState;
+    // Atomic, as well as the other state below that device threads read or change without
+    // the lock.
+    std::atomic<int32_t> mGlobalMetaState;
     void updateGlobalMetaStateLocked();
     int32_t getGlobalMetaStateLocked();
 
@@ -511,12 +599,12 @@ private:
 
     void fadePointerLocked();
 
-    int32_t mGeneration;
+    std::atomic<int32_t> mGeneration;
     int32_t bumpGenerationLocked();
 
     void getInputDevicesLocked(Vector<InputDeviceInfo>& outInputDevices);
 
-    nsecs_t mDisableVirtualKeysTimeout;
+    std::atomic<nsecs_t> mDisableVirtualKeysTimeout;
     void disableVirtualKeysUntilLocked(nsecs_t time);
     bool shouldDropVirtualKeyLocked(nsecs_t now,
             InputDevice* device, int32_t keyCode, int32_t scanCode);
@@ -603,6 +691,11 @@ public:
 
     void notifyReset(nsecs_t when);
 
+    // Set while the device maps its raw events on a dedicated thread, see InputReader. Any
+    // other thread holds it while calling into the device.
+    inline Mutex* getThreadLock() const { return mThreadLock; }
+    inline void setThreadLock(Mutex* lock) { mThreadLock = lock; }
+
     inline const PropertyMap& getConfiguration() { return mConfiguration; }
     inline EventHubInterface* getEventHub() { return mContext->getEventHub(); }
 
@@ -628,6 +721,7 @@ public:
 
 private:
     InputReaderContext* mContext;
+    Mutex* mThreadLock;
     int32_t mId;
     int32_t mGeneration;
     int32_t mControllerNumber;
@@ -1468,6 +1562,10 @@ protected:
         }
     };
 
+    // Matches the pointers of current to those of last, and assigns them the
+    // ids of the last pointers, or fresh ids. Protected for the benchmarks.
+    static void assignPointerIds(const RawState* last, RawState* current);
+
     Vector<RawState> mRawStatesPending;
     RawState mCurrentRawState;
     CookedState mCurrentCookedState;
@@ -1869,7 +1967,10 @@ private:
     bool isPointInsideSurface(int32_t x, int32_t y);
     const VirtualKey* findVirtualKeyHit(int32_t x, int32_t y);
 
-    static void assignPointerIds(const RawState* last, RawState* current);
+    // Pairs up the current and last pointers when each of them has a strictly
+    // nearest pointer, of the same tool type, that has it as its own nearest
+    // pointer. Returns false without assigning any id if that is not the case.
+    static bool assignPointerIdsByMutualNearest(const RawState* last, RawState* current);
 
     const char* modeToString(DeviceMode deviceMode);
 };
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/stringprintf.h>
+
+using android::base::StringPrintf;
+
+namespace android {
+
+// --- LatencyHistogram ---
+
+LatencyHistogram::LatencyHistogram() :
+        mCount(0), mTotal(0), mMax(0) {
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+void LatencyHistogram::record(nsecs_t latency) {
+    if (latency < 0) {
+        latency = 0; // clocks of different devices may disagree slightly
+    }
+    const uint64_t us = uint64_t(latency) / 1000;
+    size_t bucket = us == 0 ? 0 : size_t(64 - __builtin_clzll(us));
+    if (bucket >= BUCKET_COUNT) {
+        bucket = BUCKET_COUNT - 1;
+    }
+    mCount += 1;
+    mTotal += latency;
+    if (latency > mMax) {
+        mMax = latency;
+    }
+    mBuckets[bucket] += 1;
+}
+
+nsecs_t LatencyHistogram::getPercentile(uint32_t percentile) const {
+    if (mCount == 0) {
+        return 0;
+    }
+    const uint64_t rank = (mCount * percentile + 99) / 100;
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_COUNT - 1; i++) {
+        count += mBuckets[i];
+        if (count >= rank) {
+            return std::min(nsecs_t(1000) << i, mMax);
+        }
+    }
+    return mMax;
+}
+
+void LatencyHistogram::dump(std::string& dump) const {
+    if (mCount == 0) {
+        dump += "<none>";
+        return;
+    }
+    dump += StringPrintf("count=%" PRIu64 ", avg=%0.3fms, max=%0.3fms, "
+            "p50<=%0.3fms, p90<=%0.3fms, p99<=%0.3fms",
+            mCount, mTotal * 0.000001 / mCount, mMax * 0.000001,
+            getPercentile(50) * 0.000001, getPercentile(90) * 0.000001,
+            getPercentile(99) * 0.000001);
+}
+
+} // namespace android
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_LATENCY_HISTOGRAM_H
+#define _UI_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Counts the latencies of one stage of the input pipeline in power of two buckets of
+ * microseconds, cheaply enough to record every event.  Not thread-safe, the owner's lock
+ * guards it.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(nsecs_t latency);
+
+    inline uint64_t getCount() const { return mCount; }
+
+    // Returns an upper bound of the given percentile, in nanoseconds, or 0 if nothing was
+    // recorded.
+    nsecs_t getPercentile(uint32_t percentile) const;
+
+    // Appends the count, average, maximum and percentiles on a single line.
+    void dump(std::string& dump) const;
+
+private:
+    // Bucket i counts the latencies under 2^i us, the last one everything above.
+    enum { BUCKET_COUNT = 21 };
+
+    uint64_t mCount;
+    nsecs_t mTotal;
+    nsecs_t mMax;
+    uint64_t mBuckets[BUCKET_COUNT];
+};
+
+} // namespace android
+
+#endif // _UI_LATENCY_HISTOGRAM_H
@@ -48,6 +48,10 @@ public:
     FakeInputDispatcherPolicy() {
     }
 
+    void setDispatchWorkerCount(size_t count) {
+        mConfig.dispatchWorkerCount = count;
+    }
+
 private:
     virtual void notifyConfigurationChanged(nsecs_t) {
     }
@@ -97,6 +101,32 @@ private:
 };
 
 
+// --- FakeWindowHandle ---
+
+class FakeWindowHandle : public InputWindowHandle {
+public:
+    FakeWindowHandle(const sp<InputChannel>& inputChannel, int32_t displayId,
+            int32_t layoutParamsFlags, const Rect& frame) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->inputChannel = inputChannel;
+        mInfo->name = inputChannel->getName();
+        mInfo->layoutParamsFlags = layoutParamsFlags;
+        mInfo->frameLeft = frame.left;
+        mInfo->frameTop = frame.top;
+        mInfo->frameRight = frame.right;
+        mInfo->frameBottom = frame.bottom;
+        mInfo->touchableRegion = Region(frame);
+        mInfo->visible = true;
+        mInfo->displayId = displayId;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+};
+
+
 // --- InputDispatcherTest ---
 
 class InputDispatcherTest : public testing::Test {
@@ -253,4 +283,65 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+TEST_F(InputDispatcherTest, DispatchWorkers_AreDumpedAndStoppedWithTheDispatcher) {
+    std::string dump;
+    mDispatcher->dump(dump);
+    ASSERT_NE(std::string::npos, dump.find("DispatchWorkers: <none>"))
+            << "Should publish on the dispatcher thread by default.";
+
+    mFakePolicy->setDispatchWorkerCount(2);
+    sp<InputDispatcher> dispatcher = new InputDispatcher(mFakePolicy);
+    dump.clear();
+    dispatcher->dump(dump);
+    ASSERT_NE(std::string::npos, dump.find("1: queueDepth=0, maxQueueDepth=0"))
+            << "Should report the queue depth of every worker.";
+
+    // Destroying the dispatcher must not hang on its workers.
+    dispatcher.clear();
+}
+
+TEST_F(InputDispatcherTest, SetInputWindows_IndexesVisibleWindowsPerDisplay) {
+    sp<InputChannel> serverChannel, clientChannel;
+    ASSERT_EQ(OK, InputChannel::openInputChannelPair("window", serverChannel, clientChannel));
+
+    const int32_t notTouchModal = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+    Vector<sp<InputWindowHandle> > windowHandles;
+    windowHandles.push(new FakeWindowHandle(serverChannel, DISPLAY_ID, notTouchModal,
+            Rect(100, 100, 200, 200)));
+    windowHandles.push(new FakeWindowHandle(serverChannel, DISPLAY_ID, notTouchModal,
+            Rect(0, 0, 1080, 1920)));
+    windowHandles.push(new FakeWindowHandle(serverChannel, DISPLAY_ID + 1, /*touch modal*/ 0,
+            Rect(0, 0, 640, 480)));
+    mDispatcher->setInputWindows(windowHandles);
+
+    std::string dump;
+    mDispatcher->dump(dump);
+    ASSERT_NE(std::string::npos, dump.find("displayId=0, bounds=[0,0][1080,1920], "
+            "cells=16x16, entries=260, maxCellEntries=2, anywhere=0"))
+            << "The small window should only be listed in the cell it intersects.";
+    ASSERT_NE(std::string::npos, dump.find("displayId=1, bounds=[0,0][0,0], "
+            "cells=0x0, entries=0, maxCellEntries=0, anywhere=1"))
+            << "A touch modal window should be a candidate anywhere on its display.";
+
+    mDispatcher->setInputWindows(Vector<sp<InputWindowHandle> >());
+}
+
+TEST_F(InputDispatcherTest, ReleasedEntries_AreKeptForReuse) {
+    NotifyKeyArgs args(ARBITRARY_TIME, DEVICE_ID, AINPUT_SOURCE_KEYBOARD, /*policyFlags*/ 0,
+            AKEY_EVENT_ACTION_DOWN, /*flags*/ 0, AKEYCODE_A, KEY_A, AMETA_NONE, ARBITRARY_TIME);
+    mDispatcher->notifyKey(&args);
+
+    // Destroying the dispatcher releases the key entry it never got to dispatch.
+    mDispatcher.clear();
+    mDispatcher = new InputDispatcher(mFakePolicy);
+
+    std::string dump;
+    mDispatcher->dump(dump);
+    ASSERT_NE(std::string::npos, dump.find("EntryPools:"));
+    ASSERT_NE(std::string::npos, dump.find("KeyEntry: freeBlocks="))
+            << "Should report the key entry pool.";
+    ASSERT_EQ(std::string::npos, dump.find("KeyEntry: freeBlocks=0/"))
+            << "The released key entry should have been kept for reuse.";
+}
+
 } // namespace android
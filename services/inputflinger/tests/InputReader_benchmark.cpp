@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputReader.h"
+
+#include <benchmark/benchmark.h>
+
+namespace android {
+
+// Exposes the pointer id assignment of TouchInputMapper. Never instantiated.
+class PointerIdAssigner : public TouchInputMapper {
+public:
+    using TouchInputMapper::RawState;
+    using TouchInputMapper::assignPointerIds;
+};
+
+typedef PointerIdAssigner::RawState RawState;
+
+static void setPointer(RawState* state, uint32_t index, int32_t x, int32_t y) {
+    RawPointerData::Pointer& pointer = state->rawPointerData.pointers[index];
+    pointer.x = x;
+    pointer.y = y;
+    pointer.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    pointer.isHovering = false;
+}
+
+// Pointers spread over the screen, each moving a few pixels per sample, the way fingers
+// move on a touchscreen that does not report tracking ids.
+static void BM_AssignPointerIdsMoving(benchmark::State& state) {
+    const uint32_t pointerCount = state.range(0);
+    RawState last, current;
+    last.clear();
+    current.clear();
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        setPointer(&last, i, 100 + 150 * i, 200 + 100 * (i % 3));
+        last.rawPointerData.pointers[i].id = i;
+        last.rawPointerData.idToIndex[i] = i;
+        last.rawPointerData.markIdBit(i, false);
+    }
+    last.rawPointerData.pointerCount = pointerCount;
+
+    int32_t step = 0;
+    while (state.KeepRunning()) {
+        step = (step + 1) % 8;
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            setPointer(&current, i, 100 + 150 * i + step, 200 + 100 * (i % 3) - step);
+        }
+        current.rawPointerData.pointerCount = pointerCount;
+        PointerIdAssigner::assignPointerIds(&last, &current);
+        benchmark::DoNotOptimize(current.rawPointerData.touchingIdBits);
+    }
+    state.SetItemsProcessed(state.iterations() * pointerCount);
+}
+BENCHMARK(BM_AssignPointerIdsMoving)->Arg(2)->Arg(5)->Arg(10);
+
+// Pairs of pointers crossing each other, so that the nearest pointers are ambiguous and
+// the ids are assigned by the general matching.
+static void BM_AssignPointerIdsCrossing(benchmark::State& state) {
+    const uint32_t pointerCount = state.range(0);
+    RawState last, current;
+    last.clear();
+    current.clear();
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        setPointer(&last, i, 100 + 10 * i, 500);
+        last.rawPointerData.pointers[i].id = i;
+        last.rawPointerData.idToIndex[i] = i;
+        last.rawPointerData.markIdBit(i, false);
+    }
+    last.rawPointerData.pointerCount = pointerCount;
+
+    while (state.KeepRunning()) {
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            setPointer(&current, i, 100 + 10 * i + (i % 2 ? -5 : 5), 500);
+        }
+        current.rawPointerData.pointerCount = pointerCount;
+        PointerIdAssigner::assignPointerIds(&last, &current);
+        benchmark::DoNotOptimize(current.rawPointerData.touchingIdBits);
+    }
+    state.SetItemsProcessed(state.iterations() * pointerCount);
+}
+BENCHMARK(BM_AssignPointerIdsCrossing)->Arg(2)->Arg(10);
+
+// One more pointer than in the last sample, as when a finger goes down.
+static void BM_AssignPointerIdsPointerDown(benchmark::State& state) {
+    const uint32_t pointerCount = state.range(0);
+    RawState last, current;
+    last.clear();
+    current.clear();
+    for (uint32_t i = 0; i < pointerCount - 1; i++) {
+        setPointer(&last, i, 100 + 150 * i, 200);
+        last.rawPointerData.pointers[i].id = i;
+        last.rawPointerData.idToIndex[i] = i;
+        last.rawPointerData.markIdBit(i, false);
+    }
+    last.rawPointerData.pointerCount = pointerCount - 1;
+
+    while (state.KeepRunning()) {
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            setPointer(&current, i, 102 + 150 * i, 201);
+        }
+        current.rawPointerData.pointerCount = pointerCount;
+        PointerIdAssigner::assignPointerIds(&last, &current);
+        benchmark::DoNotOptimize(current.rawPointerData.touchingIdBits);
+    }
+    state.SetItemsProcessed(state.iterations() * pointerCount);
+}
+BENCHMARK(BM_AssignPointerIdsPointerDown)->Arg(2)->Arg(10);
+
+} // namespace android
+
+BENCHMARK_MAIN();
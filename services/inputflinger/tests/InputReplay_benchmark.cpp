@@ -0,0 +1,813 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputDispatcher.h"
+#include "../InputReader.h"
+
+#include <linux/input.h>
+#include <poll.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <input/InputTransport.h>
+
+namespace android {
+
+// Size of the display the touch traces are recorded on.
+static const int32_t DISPLAY_WIDTH = 1080;
+static const int32_t DISPLAY_HEIGHT = 1920;
+
+// How long the consumer waits for the next event before giving up on a run.
+static const int CONSUME_TIMEOUT_MILLIS = 1000;
+
+// Number of frames of movement in every gesture of the traces.
+static const int32_t GESTURE_FRAME_COUNT = 100;
+
+
+// --- ReplayTrace ---
+
+// An input device as EventHub describes it.
+struct ReplayDevice {
+    int32_t id;
+    String8 name;
+    uint32_t classes;
+    bool direct;
+    KeyedVector<int32_t, RawAbsoluteAxisInfo> absoluteAxes;
+    KeyedVector<int32_t, int32_t> keyCodes; // by scan code
+
+    ReplayDevice(int32_t id, const char* name, uint32_t classes, bool direct) :
+            id(id), name(name), classes(classes), direct(direct) {
+    }
+
+    void addAxis(int32_t axis, int32_t minValue, int32_t maxValue, int32_t flat = 0) {
+        RawAbsoluteAxisInfo info;
+        info.clear();
+        info.valid = true;
+        info.minValue = minValue;
+        info.maxValue = maxValue;
+        info.flat = flat;
+        absoluteAxes.add(axis, info);
+    }
+
+    void addKey(int32_t scanCode, int32_t keyCode) {
+        keyCodes.add(scanCode, keyCode);
+    }
+};
+
+// Raw evdev events of some devices, in the order the kernel reports them. The replay
+// stamps the events with the time they are read, so the traces only hold their order.
+struct ReplayTrace {
+    std::vector<ReplayDevice> devices;
+    std::vector<RawEvent> events;
+
+    void add(int32_t deviceId, int32_t type, int32_t code, int32_t value) {
+        RawEvent event;
+        event.when = 0;
+        event.deviceId = deviceId;
+        event.type = type;
+        event.code = code;
+        event.value = value;
+        events.push_back(event);
+    }
+
+    void sync(int32_t deviceId) {
+        add(deviceId, EV_SYN, SYN_REPORT, 0);
+    }
+};
+
+static ReplayDevice createTouchscreen(int32_t id, const char* name) {
+    ReplayDevice device(id, name, INPUT_DEVICE_CLASS_TOUCH | INPUT_DEVICE_CLASS_TOUCH_MT,
+            true /*direct*/);
+    device.addAxis(ABS_MT_SLOT, 0, 9);
+    device.addAxis(ABS_MT_TRACKING_ID, 0, 65535);
+    device.addAxis(ABS_MT_POSITION_X, 0, DISPLAY_WIDTH - 1);
+    device.addAxis(ABS_MT_POSITION_Y, 0, DISPLAY_HEIGHT - 1);
+    device.addAxis(ABS_MT_PRESSURE, 0, 255);
+    device.addAxis(ABS_MT_TOUCH_MAJOR, 0, 255);
+    return device;
+}
+
+// Fingers going down together, swiping across the screen and going up, on a touchscreen
+// reporting slots.
+static ReplayTrace createMultiTouchTrace(int32_t fingerCount) {
+    const int32_t deviceId = 1;
+    ReplayTrace trace;
+    trace.devices.push_back(createTouchscreen(deviceId, "Replay Touchscreen"));
+
+    for (int32_t frame = 0; frame <= GESTURE_FRAME_COUNT; frame++) {
+        for (int32_t slot = 0; slot < fingerCount; slot++) {
+            trace.add(deviceId, EV_ABS, ABS_MT_SLOT, slot);
+            if (frame == 0) {
+                trace.add(deviceId, EV_ABS, ABS_MT_TRACKING_ID, slot + 1);
+                trace.add(deviceId, EV_ABS, ABS_MT_PRESSURE, 100);
+                trace.add(deviceId, EV_ABS, ABS_MT_TOUCH_MAJOR, 20);
+            }
+            trace.add(deviceId, EV_ABS, ABS_MT_POSITION_X, 100 + 80 * slot + 8 * frame);
+            trace.add(deviceId, EV_ABS, ABS_MT_POSITION_Y, 1500 - 12 * frame);
+        }
+        trace.sync(deviceId);
+    }
+    for (int32_t slot = 0; slot < fingerCount; slot++) {
+        trace.add(deviceId, EV_ABS, ABS_MT_SLOT, slot);
+        trace.add(deviceId, EV_ABS, ABS_MT_TRACKING_ID, -1);
+    }
+    trace.sync(deviceId);
+    return trace;
+}
+
+static ReplayTrace createTwoFingerTrace() {
+    return createMultiTouchTrace(2);
+}
+
+static ReplayTrace createTenFingerTrace() {
+    return createMultiTouchTrace(10);
+}
+
+// A stylus drawing a stroke with varying pressure on a touchscreen that reports tool types.
+static ReplayTrace createStylusTrace() {
+    const int32_t deviceId = 2;
+    ReplayTrace trace;
+    ReplayDevice device = createTouchscreen(deviceId, "Replay Stylus");
+    device.addAxis(ABS_MT_TOOL_TYPE, 0, MT_TOOL_MAX);
+    trace.devices.push_back(device);
+
+    trace.add(deviceId, EV_ABS, ABS_MT_SLOT, 0);
+    trace.add(deviceId, EV_ABS, ABS_MT_TRACKING_ID, 1);
+    trace.add(deviceId, EV_ABS, ABS_MT_TOOL_TYPE, MT_TOOL_PEN);
+    for (int32_t frame = 0; frame <= GESTURE_FRAME_COUNT; frame++) {
+        trace.add(deviceId, EV_ABS, ABS_MT_POSITION_X, 200 + 6 * frame);
+        trace.add(deviceId, EV_ABS, ABS_MT_POSITION_Y, 400 + 9 * frame);
+        trace.add(deviceId, EV_ABS, ABS_MT_PRESSURE, 50 + frame);
+        trace.sync(deviceId);
+    }
+    trace.add(deviceId, EV_ABS, ABS_MT_TRACKING_ID, -1);
+    trace.sync(deviceId);
+    return trace;
+}
+
+// Both sticks of a gamepad moving, with a button pressed along the way.
+static ReplayTrace createGamepadTrace() {
+    const int32_t deviceId = 3;
+    ReplayTrace trace;
+    ReplayDevice device(deviceId, "Replay Gamepad", INPUT_DEVICE_CLASS_JOYSTICK
+            | INPUT_DEVICE_CLASS_GAMEPAD | INPUT_DEVICE_CLASS_KEYBOARD, false /*direct*/);
+    device.addAxis(ABS_X, -32768, 32767, 128);
+    device.addAxis(ABS_Y, -32768, 32767, 128);
+    device.addAxis(ABS_RX, -32768, 32767, 128);
+    device.addAxis(ABS_RY, -32768, 32767, 128);
+    device.addKey(BTN_A, AKEYCODE_BUTTON_A);
+    trace.devices.push_back(device);
+
+    for (int32_t frame = 0; frame < GESTURE_FRAME_COUNT; frame++) {
+        int32_t value = ((frame % 64) - 32) * 1000;
+        trace.add(deviceId, EV_ABS, ABS_X, value);
+        trace.add(deviceId, EV_ABS, ABS_Y, -value);
+        trace.add(deviceId, EV_ABS, ABS_RX, value / 2);
+        trace.add(deviceId, EV_ABS, ABS_RY, -value / 2);
+        if (frame == GESTURE_FRAME_COUNT / 4 || frame == GESTURE_FRAME_COUNT / 2) {
+            trace.add(deviceId, EV_KEY, BTN_A, frame == GESTURE_FRAME_COUNT / 4 ? 1 : 0);
+        }
+        trace.sync(deviceId);
+    }
+    return trace;
+}
+
+// Typing on a keyboard.
+static ReplayTrace createKeyboardTrace() {
+    static const struct {
+        int32_t scanCode;
+        int32_t keyCode;
+    } KEYS[] = {
+        { KEY_H, AKEYCODE_H }, { KEY_E, AKEYCODE_E }, { KEY_L, AKEYCODE_L },
+        { KEY_O, AKEYCODE_O }, { KEY_SPACE, AKEYCODE_SPACE }, { KEY_W, AKEYCODE_W },
+        { KEY_R, AKEYCODE_R }, { KEY_D, AKEYCODE_D },
+    };
+
+    const int32_t deviceId = 4;
+    ReplayTrace trace;
+    ReplayDevice device(deviceId, "Replay Keyboard",
+            INPUT_DEVICE_CLASS_KEYBOARD | INPUT_DEVICE_CLASS_ALPHAKEY, false /*direct*/);
+    for (const auto& key : KEYS) {
+        device.addKey(key.scanCode, key.keyCode);
+    }
+    trace.devices.push_back(device);
+
+    for (int32_t i = 0; i < GESTURE_FRAME_COUNT; i++) {
+        const auto& key = KEYS[i % (sizeof(KEYS) / sizeof(KEYS[0]))];
+        trace.add(deviceId, EV_KEY, key.scanCode, 1);
+        trace.sync(deviceId);
+        trace.add(deviceId, EV_KEY, key.scanCode, 0);
+        trace.sync(deviceId);
+    }
+    return trace;
+}
+
+
+// --- ReplayEventHub ---
+
+// Adds the devices of a trace, then hands out its events as fast as they are read, over
+// and over again.
+class ReplayEventHub : public EventHubInterface {
+    const ReplayTrace mTrace;
+    bool mDevicesAdded;
+    size_t mNextEvent;
+    size_t mEventsRead;
+
+protected:
+    virtual ~ReplayEventHub() { }
+
+public:
+    explicit ReplayEventHub(const ReplayTrace& trace) :
+            mTrace(trace), mDevicesAdded(false), mNextEvent(0), mEventsRead(0) {
+    }
+
+    // Returns the number of trace events read so far.
+    size_t getEventsRead() const {
+        return mEventsRead;
+    }
+
+    virtual uint32_t getDeviceClasses(int32_t deviceId) const {
+        const ReplayDevice* device = getDevice(deviceId);
+        return device ? device->classes : 0;
+    }
+
+    virtual InputDeviceIdentifier getDeviceIdentifier(int32_t deviceId) const {
+        InputDeviceIdentifier identifier;
+        const ReplayDevice* device = getDevice(deviceId);
+        if (device) {
+            identifier.name = device->name;
+        }
+        return identifier;
+    }
+
+    virtual int32_t getDeviceControllerNumber(int32_t) const {
+        return 0;
+    }
+
+    virtual void getConfiguration(int32_t, PropertyMap*) const {
+    }
+
+    virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
+            RawAbsoluteAxisInfo* outAxisInfo) const {
+        const ReplayDevice* device = getDevice(deviceId);
+        if (device) {
+            ssize_t index = device->absoluteAxes.indexOfKey(axis);
+            if (index >= 0) {
+                *outAxisInfo = device->absoluteAxes.valueAt(index);
+                return OK;
+            }
+        }
+        outAxisInfo->clear();
+        return -1;
+    }
+
+    virtual bool hasRelativeAxis(int32_t, int) const {
+        return false;
+    }
+
+    virtual bool hasInputProperty(int32_t deviceId, int property) const {
+        const ReplayDevice* device = getDevice(deviceId);
+        return device && property == INPUT_PROP_DIRECT && device->direct;
+    }
+
+    virtual status_t mapKey(int32_t deviceId, int32_t scanCode, int32_t, int32_t metaState,
+            int32_t* outKeycode, int32_t* outMetaState, uint32_t* outFlags) const {
+        *outMetaState = metaState;
+        *outFlags = 0;
+        const ReplayDevice* device = getDevice(deviceId);
+        if (device) {
+            ssize_t index = device->keyCodes.indexOfKey(scanCode);
+            if (index >= 0) {
+                *outKeycode = device->keyCodes.valueAt(index);
+                return OK;
+            }
+        }
+        *outKeycode = AKEYCODE_UNKNOWN;
+        return NAME_NOT_FOUND;
+    }
+
+    virtual status_t mapAxis(int32_t, int32_t, AxisInfo*) const {
+        return NAME_NOT_FOUND;
+    }
+
+    virtual void setExcludedDevices(const Vector<String8>&) {
+    }
+
+    virtual size_t getEvents(int, RawEvent* buffer, size_t bufferSize) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        size_t count = 0;
+        if (!mDevicesAdded) {
+            for (const ReplayDevice& device : mTrace.devices) {
+                buffer[count].when = now;
+                buffer[count].deviceId = device.id;
+                buffer[count].type = DEVICE_ADDED;
+                buffer[count].code = 0;
+                buffer[count].value = 0;
+                count++;
+            }
+            buffer[count].when = now;
+            buffer[count].deviceId = 0;
+            buffer[count].type = FINISHED_DEVICE_SCAN;
+            buffer[count].code = 0;
+            buffer[count].value = 0;
+            count++;
+            mDevicesAdded = true;
+            return count;
+        }
+
+        for (; count < bufferSize; count++) {
+            buffer[count] = mTrace.events[mNextEvent];
+            buffer[count].when = now;
+            mNextEvent = (mNextEvent + 1) % mTrace.events.size();
+        }
+        mEventsRead += count;
+        return count;
+    }
+
+    virtual int32_t getScanCodeState(int32_t, int32_t) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual int32_t getKeyCodeState(int32_t, int32_t) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual int32_t getSwitchState(int32_t, int32_t) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual status_t getAbsoluteAxisValue(int32_t, int32_t, int32_t*) const {
+        return -1;
+    }
+
+    virtual bool markSupportedKeyCodes(int32_t deviceId, size_t numCodes,
+            const int32_t* keyCodes, uint8_t* outFlags) const {
+        bool result = false;
+        const ReplayDevice* device = getDevice(deviceId);
+        if (device) {
+            for (size_t i = 0; i < numCodes; i++) {
+                for (size_t j = 0; j < device->keyCodes.size(); j++) {
+                    if (keyCodes[i] == device->keyCodes.valueAt(j)) {
+                        outFlags[i] = 1;
+                        result = true;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    virtual bool hasScanCode(int32_t deviceId, int32_t scanCode) const {
+        const ReplayDevice* device = getDevice(deviceId);
+        return device && device->keyCodes.indexOfKey(scanCode) >= 0;
+    }
+
+    virtual bool hasLed(int32_t, int32_t) const {
+        return false;
+    }
+
+    virtual void setLedState(int32_t, int32_t, bool) {
+    }
+
+    virtual void getVirtualKeyDefinitions(int32_t, Vector<VirtualKeyDefinition>&) const {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyCharacterMap(int32_t) const {
+        return NULL;
+    }
+
+    virtual bool setKeyboardLayoutOverlay(int32_t, const sp<KeyCharacterMap>&) {
+        return false;
+    }
+
+    virtual void vibrate(int32_t, nsecs_t) {
+    }
+
+    virtual void cancelVibrate(int32_t) {
+    }
+
+    virtual void requestReopenDevices() {
+    }
+
+    virtual void wake() {
+    }
+
+    virtual void dump(std::string&) {
+    }
+
+    virtual void monitor() {
+    }
+
+    virtual bool isDeviceEnabled(int32_t) {
+        return true;
+    }
+
+    virtual status_t enableDevice(int32_t) {
+        return OK;
+    }
+
+    virtual status_t disableDevice(int32_t) {
+        return OK;
+    }
+
+private:
+    const ReplayDevice* getDevice(int32_t deviceId) const {
+        for (const ReplayDevice& device : mTrace.devices) {
+            if (device.id == deviceId) {
+                return &device;
+            }
+        }
+        return NULL;
+    }
+};
+
+
+// --- ReplayReaderPolicy ---
+
+class ReplayReaderPolicy : public InputReaderPolicyInterface {
+    InputReaderConfiguration mConfig;
+
+protected:
+    virtual ~ReplayReaderPolicy() { }
+
+public:
+    ReplayReaderPolicy() {
+        DisplayViewport v;
+        v.displayId = ADISPLAY_ID_DEFAULT;
+        v.orientation = DISPLAY_ORIENTATION_0;
+        v.logicalRight = DISPLAY_WIDTH;
+        v.logicalBottom = DISPLAY_HEIGHT;
+        v.physicalRight = DISPLAY_WIDTH;
+        v.physicalBottom = DISPLAY_HEIGHT;
+        v.deviceWidth = DISPLAY_WIDTH;
+        v.deviceHeight = DISPLAY_HEIGHT;
+        mConfig.setPhysicalDisplayViewport(ViewportType::VIEWPORT_INTERNAL, v);
+    }
+
+private:
+    virtual void getReaderConfiguration(InputReaderConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual sp<PointerControllerInterface> obtainPointerController(int32_t) {
+        return NULL;
+    }
+
+    virtual void notifyInputDevicesChanged(const Vector<InputDeviceInfo>&) {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyboardLayoutOverlay(const InputDeviceIdentifier&) {
+        return NULL;
+    }
+
+    virtual String8 getDeviceAlias(const InputDeviceIdentifier&) {
+        return String8::empty();
+    }
+
+    virtual TouchAffineTransformation getTouchAffineTransformation(const String8&, int32_t) {
+        return TouchAffineTransformation();
+    }
+};
+
+
+// --- CountingInputListener ---
+
+// Counts the key and motion events going to the next stage, if there is one.
+class CountingInputListener : public InputListenerInterface {
+    sp<InputListenerInterface> mInner;
+    size_t mEventCount;
+
+protected:
+    virtual ~CountingInputListener() { }
+
+public:
+    explicit CountingInputListener(const sp<InputListenerInterface>& inner) :
+            mInner(inner), mEventCount(0) {
+    }
+
+    size_t getEventCount() const {
+        return mEventCount;
+    }
+
+    virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
+        if (mInner != NULL) {
+            mInner->notifyConfigurationChanged(args);
+        }
+    }
+
+    virtual void notifyKey(const NotifyKeyArgs* args) {
+        mEventCount++;
+        if (mInner != NULL) {
+            mInner->notifyKey(args);
+        }
+    }
+
+    virtual void notifyMotion(const NotifyMotionArgs* args) {
+        mEventCount++;
+        if (mInner != NULL) {
+            mInner->notifyMotion(args);
+        }
+    }
+
+    virtual void notifySwitch(const NotifySwitchArgs* args) {
+        if (mInner != NULL) {
+            mInner->notifySwitch(args);
+        }
+    }
+
+    virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+        if (mInner != NULL) {
+            mInner->notifyDeviceReset(args);
+        }
+    }
+};
+
+
+// --- ReplayDispatcherPolicy ---
+
+// Passes every event to the application, like the window manager policy does for a
+// device that is awake and unlocked.
+class ReplayDispatcherPolicy : public InputDispatcherPolicyInterface {
+protected:
+    virtual ~ReplayDispatcherPolicy() { }
+
+private:
+    virtual void notifyConfigurationChanged(nsecs_t) {
+    }
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>&, const sp<InputWindowHandle>&,
+            const std::string&) {
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>&) {
+    }
+
+    virtual void getDispatcherConfiguration(InputDispatcherConfiguration*) {
+    }
+
+    virtual bool filterInputEvent(const InputEvent*, uint32_t) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent*, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>&,
+            const KeyEvent*, uint32_t) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>&, const KeyEvent*, uint32_t,
+            KeyEvent*) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t, uint32_t, uint32_t, uint32_t) {
+    }
+
+    virtual void pokeUserActivity(nsecs_t, int32_t, int32_t) {
+    }
+
+    virtual bool checkInjectEventsPermissionNonReentrant(int32_t, int32_t) {
+        return false;
+    }
+};
+
+
+// --- ReplayWindowHandle ---
+
+// A focused window covering the display.
+class ReplayWindowHandle : public InputWindowHandle {
+public:
+    explicit ReplayWindowHandle(const sp<InputChannel>& inputChannel) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->inputChannel = inputChannel;
+        mInfo->name = inputChannel->getName();
+        mInfo->dispatchingTimeout = seconds_to_nanoseconds(5);
+        mInfo->frameRight = DISPLAY_WIDTH;
+        mInfo->frameBottom = DISPLAY_HEIGHT;
+        mInfo->scaleFactor = 1.0f;
+        mInfo->touchableRegion = Region(Rect(DISPLAY_WIDTH, DISPLAY_HEIGHT));
+        mInfo->visible = true;
+        mInfo->canReceiveKeys = true;
+        mInfo->hasFocus = true;
+        mInfo->displayId = ADISPLAY_ID_DEFAULT;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+};
+
+
+// --- DispatchPipeline ---
+
+// Runs an InputDispatcher on its own thread, like InputManager does, delivering to one
+// window whose events the benchmark thread consumes and finishes.
+class DispatchPipeline {
+public:
+    DispatchPipeline() :
+            mConsumedSamples(0), mConsumedEvents(0), mTotalLatency(0), mMaxLatency(0) {
+        mDispatcher = new InputDispatcher(new ReplayDispatcherPolicy());
+        InputChannel::openInputChannelPair("replay", mServerChannel, mClientChannel);
+        sp<InputWindowHandle> windowHandle = new ReplayWindowHandle(mServerChannel);
+        mDispatcher->registerInputChannel(mServerChannel, windowHandle, false /*monitor*/);
+        Vector<sp<InputWindowHandle> > windowHandles;
+        windowHandles.push(windowHandle);
+        mDispatcher->setInputWindows(windowHandles);
+        mDispatcher->setInputDispatchMode(true /*enabled*/, false /*frozen*/);
+        mConsumer.reset(new InputConsumer(mClientChannel));
+
+        mDispatcherThread = new InputDispatcherThread(mDispatcher);
+        mDispatcherThread->run("InputDispatcher", PRIORITY_URGENT_DISPLAY);
+    }
+
+    ~DispatchPipeline() {
+        // Disabling dispatch wakes the dispatcher thread up so that it sees the request.
+        mDispatcherThread->requestExit();
+        mDispatcher->setInputDispatchMode(false /*enabled*/, false /*frozen*/);
+        mDispatcherThread->requestExitAndWait();
+        mDispatcher->unregisterInputChannel(mServerChannel);
+    }
+
+    const sp<InputDispatcher>& getDispatcher() const {
+        return mDispatcher;
+    }
+
+    // Consumes and finishes events until sampleCount samples in total have arrived. Returns
+    // false if the dispatcher stops delivering them.
+    bool consumeUntil(size_t sampleCount) {
+        while (mConsumedSamples < sampleCount) {
+            uint32_t seq;
+            InputEvent* event;
+            int32_t displayId;
+            status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                    &seq, &event, &displayId);
+            if (status == WOULD_BLOCK) {
+                struct pollfd pollFd = { mClientChannel->getFd(), POLLIN, 0 };
+                if (poll(&pollFd, 1, CONSUME_TIMEOUT_MILLIS) <= 0) {
+                    return false;
+                }
+                continue;
+            }
+            if (status) {
+                return false;
+            }
+
+            // The oldest sample of a batch is the one that waited the longest.
+            nsecs_t eventTime;
+            if (event->getType() == AINPUT_EVENT_TYPE_MOTION) {
+                const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+                eventTime = motionEvent->getHistoricalEventTime(0);
+                mConsumedSamples += motionEvent->getHistorySize() + 1;
+            } else {
+                eventTime = static_cast<const KeyEvent*>(event)->getEventTime();
+                mConsumedSamples += 1;
+            }
+            nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - eventTime;
+            mTotalLatency += latency;
+            mMaxLatency = std::max(mMaxLatency, latency);
+            mConsumedEvents++;
+
+            mConsumer->sendFinishedSignal(seq, true /*handled*/);
+        }
+        return true;
+    }
+
+    // Describes the latency of the consumed events, from the time they were read or
+    // notified to the time they were consumed.
+    std::string getLatencyLabel() const {
+        char label[64];
+        snprintf(label, sizeof(label), "latency_avg_us=%.1f latency_max_us=%.1f",
+                mConsumedEvents ? mTotalLatency / mConsumedEvents / 1000.0 : 0.0,
+                mMaxLatency / 1000.0);
+        return label;
+    }
+
+private:
+    sp<InputDispatcher> mDispatcher;
+    sp<InputDispatcherThread> mDispatcherThread;
+    sp<InputChannel> mServerChannel;
+    sp<InputChannel> mClientChannel;
+    std::unique_ptr<InputConsumer> mConsumer;
+    PreallocatedInputEventFactory mEventFactory;
+
+    size_t mConsumedSamples;
+    size_t mConsumedEvents;
+    nsecs_t mTotalLatency;
+    nsecs_t mMaxLatency;
+};
+
+
+// --- Benchmarks ---
+
+// InputReader alone: raw events of a trace through the mappers, into a listener that only
+// counts what comes out.
+static void BM_ReaderReplay(benchmark::State& state, ReplayTrace (*createTrace)()) {
+    sp<ReplayEventHub> eventHub = new ReplayEventHub(createTrace());
+    sp<CountingInputListener> listener = new CountingInputListener(NULL);
+    sp<InputReader> reader = new InputReader(eventHub, new ReplayReaderPolicy(), listener);
+    reader->loopOnce(); // adds the devices
+
+    while (state.KeepRunning()) {
+        reader->loopOnce();
+    }
+    state.SetItemsProcessed(eventHub->getEventsRead());
+}
+BENCHMARK_CAPTURE(BM_ReaderReplay, two_finger, createTwoFingerTrace);
+BENCHMARK_CAPTURE(BM_ReaderReplay, ten_finger, createTenFingerTrace);
+BENCHMARK_CAPTURE(BM_ReaderReplay, stylus, createStylusTrace);
+BENCHMARK_CAPTURE(BM_ReaderReplay, gamepad, createGamepadTrace);
+BENCHMARK_CAPTURE(BM_ReaderReplay, keyboard, createKeyboardTrace);
+
+// InputDispatcher alone: moves of one finger notified in groups of the benchmark argument,
+// then consumed by the window.
+static void BM_DispatcherMotion(benchmark::State& state) {
+    const size_t eventsPerIteration = state.range(0);
+    DispatchPipeline pipeline;
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 100);
+    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 100);
+
+    const nsecs_t downTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t notifiedCount = 0;
+    int32_t action = AMOTION_EVENT_ACTION_DOWN;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < eventsPerIteration; i++) {
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 100 + (notifiedCount % 800));
+            NotifyMotionArgs args(systemTime(SYSTEM_TIME_MONOTONIC), 1 /*deviceId*/,
+                    AINPUT_SOURCE_TOUCHSCREEN, POLICY_FLAG_WAKE, action, 0 /*actionButton*/,
+                    0 /*flags*/, AMETA_NONE, 0 /*buttonState*/, AMOTION_EVENT_EDGE_FLAG_NONE,
+                    ADISPLAY_ID_DEFAULT, 0 /*deviceTimestamp*/, 1 /*pointerCount*/,
+                    &pointerProperties, &pointerCoords, 0, 0, downTime);
+            pipeline.getDispatcher()->notifyMotion(&args);
+            action = AMOTION_EVENT_ACTION_MOVE;
+            notifiedCount++;
+        }
+        if (!pipeline.consumeUntil(notifiedCount)) {
+            state.SkipWithError("The dispatcher stopped delivering events");
+            break;
+        }
+    }
+    state.SetItemsProcessed(notifiedCount);
+    state.SetLabel(pipeline.getLatencyLabel());
+}
+BENCHMARK(BM_DispatcherMotion)->Arg(1)->Arg(16);
+
+// Both stages: raw events of a trace through InputReader and InputDispatcher, into the
+// window that consumes them.
+static void BM_ReplayToWindow(benchmark::State& state, ReplayTrace (*createTrace)()) {
+    DispatchPipeline pipeline;
+    sp<ReplayEventHub> eventHub = new ReplayEventHub(createTrace());
+    sp<CountingInputListener> listener = new CountingInputListener(pipeline.getDispatcher());
+    sp<InputReader> reader = new InputReader(eventHub, new ReplayReaderPolicy(), listener);
+    reader->loopOnce(); // adds the devices
+
+    while (state.KeepRunning()) {
+        reader->loopOnce();
+        if (!pipeline.consumeUntil(listener->getEventCount())) {
+            state.SkipWithError("The dispatcher stopped delivering events");
+            break;
+        }
+    }
+    state.SetItemsProcessed(eventHub->getEventsRead());
+    state.SetLabel(pipeline.getLatencyLabel());
+}
+BENCHMARK_CAPTURE(BM_ReplayToWindow, two_finger, createTwoFingerTrace);
+BENCHMARK_CAPTURE(BM_ReplayToWindow, ten_finger, createTenFingerTrace);
+BENCHMARK_CAPTURE(BM_ReplayToWindow, stylus, createStylusTrace);
+BENCHMARK_CAPTURE(BM_ReplayToWindow, gamepad, createGamepadTrace);
+BENCHMARK_CAPTURE(BM_ReplayToWindow, keyboard, createKeyboardTrace);
+
+} // namespace android
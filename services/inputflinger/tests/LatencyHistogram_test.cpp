@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../LatencyHistogram.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+// --- LatencyHistogramTest ---
+
+TEST(LatencyHistogramTest, Empty_DumpsNone) {
+    LatencyHistogram histogram;
+
+    ASSERT_EQ(0U, histogram.getCount());
+    ASSERT_EQ(0, histogram.getPercentile(50));
+
+    std::string dump;
+    histogram.dump(dump);
+    ASSERT_EQ("<none>", dump);
+}
+
+TEST(LatencyHistogramTest, Record_BoundsPercentilesByBucketAndMaximum) {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 90; i++) {
+        histogram.record(ms2ns(1));
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.record(ms2ns(20));
+    }
+
+    ASSERT_EQ(100U, histogram.getCount());
+    ASSERT_EQ(us2ns(1024), histogram.getPercentile(50));
+    ASSERT_EQ(us2ns(1024), histogram.getPercentile(90));
+    ASSERT_EQ(ms2ns(20), histogram.getPercentile(99));
+
+    std::string dump;
+    histogram.dump(dump);
+    ASSERT_EQ("count=100, avg=2.900ms, max=20.000ms, "
+            "p50<=1.024ms, p90<=1.024ms, p99<=20.000ms", dump);
+}
+
+TEST(LatencyHistogramTest, Record_ClampsNegativeLatencies) {
+    LatencyHistogram histogram;
+    histogram.record(-ms2ns(5));
+
+    ASSERT_EQ(1U, histogram.getCount());
+    ASSERT_EQ(0, histogram.getPercentile(100));
+}
+
+} // namespace android
@@ -22,6 +22,10 @@
 #include <log/log.h>
 #include <hwbinder/IPCThreadState.h>
 #include <mediautils/SchedulingPolicyService.h>
+#include <utils/String8.h>
+
+#include <inttypes.h>
+#include <unistd.h>
 
 namespace android {
 namespace frameworks {
@@ -35,9 +39,32 @@ bool SchedulingPolicyService::isAllowed() {
     return IPCThreadState::self()->getCallingUid() == AID_CAMERASERVER;
 }
 
+bool SchedulingPolicyService::isValidPriority(int32_t priority) {
+    return priority >= static_cast<int32_t>(Priority::MIN) &&
+            priority <= static_cast<int32_t>(Priority::MAX);
+}
+
+bool SchedulingPolicyService::setPriority(int32_t pid, int32_t tid, int32_t priority) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    // TODO(b/37226359): decouple from and remove AIDL service
+    // this should always be allowed since we are in system_server.
+    int value = ::android::requestPriority(pid, tid, priority, false /* isForApp */);
+    nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    mRequestCount++;
+    if (value != 0) {
+        mFailedCount++;
+    }
+    mTotalLatency += latency;
+    if (latency > mMaxLatency) {
+        mMaxLatency = latency;
+    }
+    return value == 0 /* success */;
+}
+
 Return<bool> SchedulingPolicyService::requestPriority(int32_t pid, int32_t tid, int32_t priority) {
-    if (priority < static_cast<int32_t>(Priority::MIN) ||
-            priority > static_cast<int32_t>(Priority::MAX)) {
+    if (!isValidPriority(priority)) {
         return false;
     }
 
@@ -45,10 +72,31 @@ Return<bool> SchedulingPolicyService::requestPriority(int32_t pid, int32_t tid,
         return false;
     }
 
-    // TODO(b/37226359): decouple from and remove AIDL service
-    // this should always be allowed since we are in system_server.
-    int value = ::android::requestPriority(pid, tid, priority, false /* isForApp */);
-    return value == 0 /* success */;
+    return setPriority(pid, tid, priority);
+}
+
+bool SchedulingPolicyService::requestPriorities(int32_t pid, const hidl_vec<int32_t>& tids,
+        int32_t priority) {
+    if (!isValidPriority(priority)) {
+        return false;
+    }
+
+    if (!isAllowed()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        mBatchCount++;
+    }
+
+    // Keep going after a failure so one exited thread doesn't leave the
+    // rest of the pipeline at normal priority.
+    bool allSet = true;
+    for (int32_t tid : tids) {
+        allSet = setPriority(pid, tid, priority) && allSet;
+    }
+    return allSet;
 }
 
 Return<int32_t> SchedulingPolicyService::getMaxAllowedPriority() {
@@ -60,6 +108,27 @@ Return<int32_t> SchedulingPolicyService::getMaxAllowedPriority() {
     return 3;
 }
 
+Return<void> SchedulingPolicyService::debug(const hidl_handle& fd,
+        const hidl_vec<hidl_string>& /* options */) {
+    const native_handle_t* handle = fd.getNativeHandle();
+    if (handle == nullptr || handle->numFds < 1) {
+        return Void();
+    }
+
+    String8 result;
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        result.appendFormat("Priority requests: %" PRIu64 " (%" PRIu64 " failed, %" PRIu64
+                " batches)\n", mRequestCount, mFailedCount, mBatchCount);
+        if (mRequestCount > 0) {
+            result.appendFormat("Request latency: avg %.3f ms, max %.3f ms\n",
+                    mTotalLatency / 1e6 / mRequestCount, mMaxLatency / 1e6);
+        }
+    }
+    write(handle->data[0], result.string(), result.size());
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace schedulerservice
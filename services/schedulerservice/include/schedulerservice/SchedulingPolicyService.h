@@ -18,6 +18,9 @@
 #include <android/frameworks/schedulerservice/1.0/ISchedulingPolicyService.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <utils/Timers.h>
+
+#include <mutex>
 
 namespace android {
 namespace frameworks {
@@ -29,6 +32,7 @@ using ::android::frameworks::schedulerservice::V1_0::ISchedulingPolicyService;
 using ::android::hidl::base::V1_0::DebugInfo;
 using ::android::hidl::base::V1_0::IBase;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -39,8 +43,25 @@ using ::android::sp;
 struct SchedulingPolicyService : public ISchedulingPolicyService {
     Return<bool> requestPriority(int32_t pid, int32_t tid, int32_t priority) override;
     Return<int32_t> getMaxAllowedPriority() override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
+    // Raise the priority of several threads of one process, checking the
+    // caller and the priority once for the whole batch. Returns true only
+    // if every thread's priority was set.
+    bool requestPriorities(int32_t pid, const hidl_vec<int32_t>& tids, int32_t priority);
 private:
     bool isAllowed();
+    bool isValidPriority(int32_t priority);
+    bool setPriority(int32_t pid, int32_t tid, int32_t priority);
+
+    // Latency of the requests forwarded to the scheduling policy service,
+    // reported by lshal debug.
+    std::mutex mStatsLock;
+    uint64_t mRequestCount = 0;
+    uint64_t mFailedCount = 0;
+    uint64_t mBatchCount = 0;
+    nsecs_t mTotalLatency = 0;
+    nsecs_t mMaxLatency = 0;
 };
 
 }  // namespace implementation
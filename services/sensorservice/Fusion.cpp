@@ -487,7 +487,22 @@ void Fusion::predict(const vec3_t& w, float dT) {
     if (x0.w < 0)
         x0 = -x0;
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    // Phi*P*Phi' only has three distinct blocks, since Phi01 = 0, Phi11 = I33 and P is
+    // symmetric. Multiplying the blocks directly takes 6 3x3 products instead of the 16 of
+    // the generic 6x6 product.
+    //
+    //  Phi*P*Phi' = | (Phi00*P00 + Phi10*P01)*Phi00' + C*Phi10'  C   |
+    //               |                  C'                        P11 |
+    //
+    //  C = Phi00*P10 + Phi10*P11
+    const mat33_t& Phi00 = Phi[0][0];
+    const mat33_t& Phi10 = Phi[1][0];
+    const mat33_t C(Phi00*P[1][0] + Phi10*P[1][1]);
+    P[0][0] = (Phi00*P[0][0] + Phi10*transpose(P[1][0]))*transpose(Phi00)
+            + C*transpose(Phi10) + GQGt[0][0];
+    P[1][0] = C + GQGt[1][0];
+    P[0][1] = transpose(P[1][0]);
+    P[1][1] += GQGt[1][1];
 
     checkState();
 }
@@ -20,6 +20,7 @@
 #include <utils/Timers.h>
 
 #include <inttypes.h>
+#include <string.h>
 
 namespace android {
 namespace SensorServiceUtil {
@@ -31,17 +32,31 @@ namespace {
 
 RecentEventLogger::RecentEventLogger(int sensorType) :
         mSensorType(sensorType), mEventSize(eventSizeBySensorType(mSensorType)),
-        mRecentEvents(logSizeBySensorType(sensorType)), mMaskData(false) {
+        mLogSize(logSizeBySensorType(sensorType)),
+        // the 64 bit step count overlays the first two data words
+        mValueCount(sensorType == SENSOR_TYPE_STEP_COUNTER ? 2 : mEventSize),
+        mCount(0), mNext(0), mTimestamps(mLogSize), mWallTimes(mLogSize),
+        mValues(mLogSize * mValueCount), mMaskData(false) {
     // blank
 }
 
 void RecentEventLogger::addEvent(const sensors_event_t& event) {
+    timespec wallTime;
+    clock_gettime(CLOCK_REALTIME, &wallTime);
+
     std::lock_guard<std::mutex> lk(mLock);
-    mRecentEvents.emplace(event);
+    mTimestamps[mNext] = event.timestamp;
+    mWallTimes[mNext] = seconds_to_nanoseconds(wallTime.tv_sec) + wallTime.tv_nsec;
+    memcpy(&mValues[mNext * mValueCount], event.data, mValueCount * sizeof(float));
+    mLastEvent = event;
+    mNext = (mNext + 1) % mLogSize;
+    if (mCount < mLogSize) {
+        mCount++;
+    }
 }
 
 bool RecentEventLogger::isEmpty() const {
-    return mRecentEvents.size() == 0;
+    return mCount == 0;
 }
 
 std::string RecentEventLogger::dump() const {
@@ -50,22 +65,26 @@ std::string RecentEventLogger::dump() const {
     //TODO: replace String8 with std::string completely in this function
     String8 buffer;
 
-    buffer.appendFormat("last %zu events\n", mRecentEvents.size());
-    int j = 0;
-    for (int i = mRecentEvents.size() - 1; i >= 0; --i) {
-        const auto& ev = mRecentEvents[i];
-        struct tm * timeinfo = localtime(&(ev.mWallTime.tv_sec));
-        buffer.appendFormat("\t%2d (ts=%.9f, wall=%02d:%02d:%02d.%03d) ",
-                ++j, ev.mEvent.timestamp/1e9, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec,
-                (int) ns2ms(ev.mWallTime.tv_nsec));
+    buffer.appendFormat("last %zu events\n", mCount);
+    // oldest first
+    for (size_t j = 0; j < mCount; ++j) {
+        const size_t slot = (mNext + mLogSize - mCount + j) % mLogSize;
+        const time_t wallSec = mWallTimes[slot] / 1000000000;
+        struct tm * timeinfo = localtime(&wallSec);
+        buffer.appendFormat("\t%2zu (ts=%.9f, wall=%02d:%02d:%02d.%03d) ",
+                j + 1, mTimestamps[slot]/1e9, timeinfo->tm_hour, timeinfo->tm_min,
+                timeinfo->tm_sec, (int) ns2ms(mWallTimes[slot] % 1000000000));
 
         // data
+        const float* values = &mValues[slot * mValueCount];
         if (!mMaskData) {
             if (mSensorType == SENSOR_TYPE_STEP_COUNTER) {
-                buffer.appendFormat("%" PRIu64 ", ", ev.mEvent.u64.step_counter);
+                uint64_t stepCounter;
+                memcpy(&stepCounter, values, sizeof(stepCounter));
+                buffer.appendFormat("%" PRIu64 ", ", stepCounter);
             } else {
                 for (size_t k = 0; k < mEventSize; ++k) {
-                    buffer.appendFormat("%.2f, ", ev.mEvent.data[k]);
+                    buffer.appendFormat("%.2f, ", values[k]);
                 }
             }
         } else {
@@ -87,9 +106,8 @@ void RecentEventLogger::setFormat(std::string format) {
 bool RecentEventLogger::populateLastEvent(sensors_event_t *event) const {
     std::lock_guard<std::mutex> lk(mLock);
 
-    if (mRecentEvents.size()) {
-        // Index 0 contains the latest event emplace()'ed
-        *event = mRecentEvents[0].mEvent;
+    if (mCount) {
+        *event = mLastEvent;
         return true;
     } else {
         return false;
@@ -104,9 +122,5 @@ size_t RecentEventLogger::logSizeBySensorType(int sensorType) {
             sensorType == SENSOR_TYPE_LIGHT) ? LOG_SIZE_LARGE : LOG_SIZE;
 }
 
-RecentEventLogger::SensorEventLog::SensorEventLog(const sensors_event_t& e) : mEvent(e) {
-    clock_gettime(CLOCK_REALTIME, &mWallTime);
-}
-
 } // namespace SensorServiceUtil
 } // namespace android
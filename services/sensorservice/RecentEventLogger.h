@@ -17,13 +17,13 @@
 #ifndef ANDROID_SENSOR_SERVICE_UTIL_RECENT_EVENT_LOGGER_H
 #define ANDROID_SENSOR_SERVICE_UTIL_RECENT_EVENT_LOGGER_H
 
-#include "RingBuffer.h"
 #include "SensorServiceUtils.h"
 
 #include <hardware/sensors.h>
 #include <utils/String8.h>
 
 #include <mutex>
+#include <vector>
 
 namespace android {
 namespace SensorServiceUtil {
@@ -46,17 +46,21 @@ public:
     virtual void setFormat(std::string format) override;
 
 protected:
-    struct SensorEventLog {
-        explicit SensorEventLog(const sensors_event_t& e);
-        timespec mWallTime;
-        sensors_event_t mEvent;
-    };
-
     const int mSensorType;
     const size_t mEventSize;
 
     mutable std::mutex mLock;
-    RingBuffer<SensorEventLog> mRecentEvents;
+    // The events are kept as compact records in a circular buffer of mLogSize slots rather than
+    // as full sensors_event_t: a slot only holds the timestamps and the mValueCount data words
+    // the sensor type uses. Only the latest event is kept whole, for populateLastEvent().
+    const size_t mLogSize;
+    const size_t mValueCount;
+    size_t mCount;
+    size_t mNext;
+    std::vector<int64_t> mTimestamps;
+    std::vector<int64_t> mWallTimes; // CLOCK_REALTIME, in nanoseconds
+    std::vector<float> mValues;
+    sensors_event_t mLastEvent;
 
     bool mMaskData;
 
@@ -385,6 +385,17 @@ int SensorDevice::getHalDeviceVersion() const {
     return SENSORS_DEVICE_API_VERSION_1_4;
 }
 
+nsecs_t SensorDevice::getBatchReportLatency(int handle) const {
+    Mutex::Autolock _l(mLock);
+    const ssize_t index = mActivationCount.indexOfKey(handle);
+    if (index < 0) {
+        return 0;
+    }
+    // Clients which do not batch are merged in with their sampling period as batch period.
+    const BatchParams& params = mActivationCount.valueAt(index).bestBatchParams;
+    return params.mTBatch > params.mTSample && params.mTBatch != INT64_MAX ? params.mTBatch : 0;
+}
+
 status_t SensorDevice::flush(void* ident, int handle) {
     if (mSensors == nullptr) return NO_INIT;
     if (isClientDisabled(ident)) return INVALID_OPERATION;
@@ -84,6 +84,9 @@ public:
     status_t setDelay(void* ident, int handle, int64_t ns);
     status_t flush(void* ident, int handle);
     status_t setMode(uint32_t mode);
+    // Returns the batch report latency the sensor is configured with, or 0 if it is not active
+    // or one of its clients wants events as soon as they are available.
+    nsecs_t getBatchReportLatency(int handle) const;
 
     bool isDirectReportSupported() const;
     int32_t registerDirectChannel(const sensors_direct_mem_t *memory);
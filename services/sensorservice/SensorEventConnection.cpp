@@ -15,6 +15,7 @@
  */
 
 #include <sys/socket.h>
+#include <utils/SystemClock.h>
 #include <utils/threads.h>
 
 #include <sensor/SensorEventQueue.h>
@@ -30,11 +31,19 @@ namespace android {
 SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service, uid_t uid, String8 packageName, bool isDataInjectionMode,
         const String16& opPackageName, bool hasSensorAccess)
-    : mService(service), mUid(uid), mWakeLockRefCount(0), mHasLooperCallbacks(false),
+    : mService(service), mUid(uid), mWakeLockRefCount(0), mWakeLockHeldSince(0),
+      mWakeLockHeldTime(0), mHasLooperCallbacks(false),
       mDead(false), mDataInjectionMode(isDataInjectionMode), mEventCache(NULL),
       mCacheSize(0), mMaxCacheSize(0), mPackageName(packageName), mOpPackageName(opPackageName),
       mDestroyed(false), mHasSensorAccess(hasSensorAccess) {
     mChannel = new BitTube(mService->mSocketBufferSize);
+    // Injected events are written by the client, they keep going through the socket.
+    if (mService->mUseSharedEventRing && !mDataInjectionMode) {
+        // A single read drains the whole ring, so a wakeup is never left without events.
+        status_t err = mChannel->enableSharedRing(sizeof(sensors_event_t),
+                SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT);
+        ALOGW_IF(err != NO_ERROR, "can't enable shared event ring (%d)", err);
+    }
 #if DEBUG_CONNECTIONS
     mEventsReceived = mEventsSentFromCache = mEventsSent = 0;
     mTotalAcksNeeded = mTotalAcksReceived = 0;
@@ -55,8 +64,9 @@ void SensorService::SensorEventConnection::destroy() {
     }
 
     mService->cleanupConnection(this);
-    if (mEventCache != NULL) {
-        delete mEventCache;
+    {
+        Mutex::Autolock _l(mConnectionLock);
+        freeCacheLocked();
     }
     mDestroyed = true;
 }
@@ -73,14 +83,28 @@ bool SensorService::SensorEventConnection::needsWakeLock() {
 void SensorService::SensorEventConnection::resetWakeLockRefCount() {
     Mutex::Autolock _l(mConnectionLock);
     mWakeLockRefCount = 0;
+    updateWakeLockHoldTimeLocked();
+}
+
+void SensorService::SensorEventConnection::updateWakeLockHoldTimeLocked() {
+    if (mWakeLockRefCount > 0 && mWakeLockHeldSince == 0) {
+        mWakeLockHeldSince = elapsedRealtimeNano();
+    } else if (mWakeLockRefCount == 0 && mWakeLockHeldSince != 0) {
+        mWakeLockHeldTime += elapsedRealtimeNano() - mWakeLockHeldSince;
+        mWakeLockHeldSince = 0;
+    }
 }
 
 void SensorService::SensorEventConnection::dump(String8& result) {
     Mutex::Autolock _l(mConnectionLock);
     result.appendFormat("\tOperating Mode: %s\n",mDataInjectionMode ? "DATA_INJECTION" : "NORMAL");
-    result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %d | "
-            "max cache size %d\n", mPackageName.string(), mWakeLockRefCount, mUid, mCacheSize,
-            mMaxCacheSize);
+    nsecs_t wakeLockHeldTime = mWakeLockHeldTime;
+    if (mWakeLockHeldSince != 0) {
+        wakeLockHeldTime += elapsedRealtimeNano() - mWakeLockHeldSince;
+    }
+    result.appendFormat("\t %s | WakeLockRefCount %d | wake lock held %.3fs | uid %d | "
+            "cache size %d | max cache size %d\n", mPackageName.string(), mWakeLockRefCount,
+            wakeLockHeldTime / 1e9, mUid, mCacheSize, mMaxCacheSize);
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
         result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
@@ -315,33 +339,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
     if (mCacheSize != 0) {
         // There are some events in the cache which need to be sent first. Copy this buffer to
         // the end of cache.
-        if (mCacheSize + count <= mMaxCacheSize) {
-            memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-            mCacheSize += count;
-        } else {
-            // Check if any new sensors have registered on this connection which may have increased
-            // the max cache size that is desired.
-            if (mCacheSize + count < computeMaxCacheSizeLocked()) {
-                reAllocateCacheLocked(scratch, count);
-                delete sanitizedBuffer;
-                return status_t(NO_ERROR);
-            }
-            // Some events need to be dropped.
-            int remaningCacheSize = mMaxCacheSize - mCacheSize;
-            if (remaningCacheSize != 0) {
-                memcpy(&mEventCache[mCacheSize], scratch,
-                                                remaningCacheSize * sizeof(sensors_event_t));
-            }
-            int numEventsDropped = count - remaningCacheSize;
-            countFlushCompleteEventsLocked(mEventCache, numEventsDropped);
-            // Drop the first "numEventsDropped" in the cache.
-            memmove(mEventCache, &mEventCache[numEventsDropped],
-                    (mCacheSize - numEventsDropped) * sizeof(sensors_event_t));
-
-            // Copy the remainingEvents in scratch buffer to the end of cache.
-            memcpy(&mEventCache[mCacheSize - numEventsDropped], scratch + remaningCacheSize,
-                                            numEventsDropped * sizeof(sensors_event_t));
-        }
+        cacheEventsLocked(scratch, count);
         delete sanitizedBuffer;
         return status_t(NO_ERROR);
     }
@@ -352,6 +350,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
         if (index_wake_up_event >= 0) {
             scratch[index_wake_up_event].flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
             ++mWakeLockRefCount;
+            updateWakeLockHoldTimeLocked();
 #if DEBUG_CONNECTIONS
             ++mTotalAcksNeeded;
 #endif
@@ -369,17 +368,12 @@ status_t SensorService::SensorEventConnection::sendEvents(
             if (mWakeLockRefCount > 0) {
                 --mWakeLockRefCount;
             }
+            updateWakeLockHoldTimeLocked();
 #if DEBUG_CONNECTIONS
             --mTotalAcksNeeded;
 #endif
         }
-        if (mEventCache == NULL) {
-            mMaxCacheSize = computeMaxCacheSizeLocked();
-            mEventCache = new sensors_event_t[mMaxCacheSize];
-            mCacheSize = 0;
-        }
-        memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-        mCacheSize += count;
+        cacheEventsLocked(scratch, count);
 
         // Add this file descriptor to the looper to get a callback when this fd is available for
         // writing.
@@ -403,22 +397,70 @@ void SensorService::SensorEventConnection::setSensorAccess(const bool hasAccess)
     mHasSensorAccess = hasAccess;
 }
 
-void SensorService::SensorEventConnection::reAllocateCacheLocked(sensors_event_t const* scratch,
-                                                                 int count) {
-    sensors_event_t *eventCache_new;
-    const int new_cache_size = computeMaxCacheSizeLocked();
-    // Allocate new cache, copy over events from the old cache & scratch, free up memory.
-    eventCache_new = new sensors_event_t[new_cache_size];
-    memcpy(eventCache_new, mEventCache, mCacheSize * sizeof(sensors_event_t));
-    memcpy(&eventCache_new[mCacheSize], scratch, count * sizeof(sensors_event_t));
+void SensorService::SensorEventConnection::cacheEventsLocked(sensors_event_t const* scratch,
+                                                             int count) {
+    if (mCacheSize + count > mMaxCacheSize) {
+        // Check if any new sensors have registered on this connection which may have increased
+        // the max cache size that is desired.
+        growCacheLocked(computeMaxCacheSizeLocked());
+    }
+    if (mCacheSize + count <= mMaxCacheSize) {
+        memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
+        mCacheSize += count;
+        return;
+    }
 
-    ALOGD_IF(DEBUG_CONNECTIONS, "reAllocateCacheLocked maxCacheSize=%d %d", mMaxCacheSize,
-            new_cache_size);
+    // Some events need to be dropped, oldest first.
+    const int numEventsDropped = mCacheSize + count - mMaxCacheSize;
+    if (numEventsDropped < mCacheSize) {
+        countFlushCompleteEventsLocked(mEventCache, numEventsDropped);
+        memmove(mEventCache, &mEventCache[numEventsDropped],
+                (mCacheSize - numEventsDropped) * sizeof(sensors_event_t));
+        memcpy(&mEventCache[mCacheSize - numEventsDropped], scratch,
+                count * sizeof(sensors_event_t));
+    } else {
+        // The whole cache and the start of scratch go.
+        const int numScratchDropped = numEventsDropped - mCacheSize;
+        countFlushCompleteEventsLocked(mEventCache, mCacheSize);
+        countFlushCompleteEventsLocked(scratch, numScratchDropped);
+        if (mMaxCacheSize != 0) {
+            memcpy(mEventCache, scratch + numScratchDropped,
+                    mMaxCacheSize * sizeof(sensors_event_t));
+        }
+    }
+    mCacheSize = mMaxCacheSize;
+}
+
+void SensorService::SensorEventConnection::growCacheLocked(int newSize) {
+    if (newSize <= mMaxCacheSize) {
+        return;
+    }
+    const int granted = mService->reserveEventCache(newSize - mMaxCacheSize);
+    if (granted == 0) {
+        ALOGD_IF(DEBUG_CONNECTIONS, "event cache budget exhausted, package=%s",
+                mPackageName.string());
+        return;
+    }
+    newSize = mMaxCacheSize + granted;
+
+    ALOGD_IF(DEBUG_CONNECTIONS, "growCacheLocked maxCacheSize=%d %d", mMaxCacheSize, newSize);
 
-    delete mEventCache;
+    // Allocate new cache, copy over events from the old cache, free up memory.
+    sensors_event_t *eventCache_new = new sensors_event_t[newSize];
+    if (mCacheSize != 0) {
+        memcpy(eventCache_new, mEventCache, mCacheSize * sizeof(sensors_event_t));
+    }
+    delete[] mEventCache;
     mEventCache = eventCache_new;
-    mCacheSize += count;
-    mMaxCacheSize = new_cache_size;
+    mMaxCacheSize = newSize;
+}
+
+void SensorService::SensorEventConnection::freeCacheLocked() {
+    delete[] mEventCache;
+    mEventCache = NULL;
+    mService->releaseEventCache(mMaxCacheSize);
+    mCacheSize = 0;
+    mMaxCacheSize = 0;
 }
 
 void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
@@ -445,8 +487,10 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
             ssize_t size = SensorEventQueue::write(mChannel, &flushCompleteEvent, 1);
             if (size < 0) {
                 if (wakeUpSensor) --mWakeLockRefCount;
+                updateWakeLockHoldTimeLocked();
                 return;
             }
+            updateWakeLockHoldTimeLocked();
             ALOGD_IF(DEBUG_CONNECTIONS, "sent dropped flush complete event==%d ",
                     flushCompleteEvent.meta_data.sensor);
             flushInfo.mPendingFlushEventsToSend--;
@@ -472,6 +516,7 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
                 mEventCache[index_wake_up_event + numEventsSent].flags |=
                         WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
                 ++mWakeLockRefCount;
+                updateWakeLockHoldTimeLocked();
 #if DEBUG_CONNECTIONS
                 ++mTotalAcksNeeded;
 #endif
@@ -489,6 +534,7 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
                 if (mWakeLockRefCount > 0) {
                     --mWakeLockRefCount;
                 }
+                updateWakeLockHoldTimeLocked();
 #if DEBUG_CONNECTIONS
                 --mTotalAcksNeeded;
 #endif
@@ -506,8 +552,8 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
 #endif
     }
     ALOGD_IF(DEBUG_CONNECTIONS, "wrote all events from cache size=%d ", mCacheSize);
-    // All events from the cache have been sent. Reset cache size to zero.
-    mCacheSize = 0;
+    // All events from the cache have been sent. Give its memory back to the other connections.
+    freeCacheLocked();
     // There are no more events in the cache. We don't need to poll for write on the fd.
     // Update Looper registration.
     updateLooperRegistrationLocked(mService->getLooper());
@@ -593,6 +639,7 @@ int SensorService::SensorEventConnection::handleEvent(int fd, int events, void*
             Mutex::Autolock _l(mConnectionLock);
             mDead = true;
             mWakeLockRefCount = 0;
+            updateWakeLockHoldTimeLocked();
             updateLooperRegistrationLocked(mService->getLooper());
         }
         mService->checkWakeLockState();
@@ -607,8 +654,13 @@ int SensorService::SensorEventConnection::handleEvent(int fd, int events, void*
 
     if (events & ALOOPER_EVENT_INPUT) {
         unsigned char buf[sizeof(sensors_event_t)];
-        ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
-        {
+        // Acks which arrived back to back are all handled before the wake lock state is checked,
+        // rather than taking SensorService::mLock once per ack.
+        for (bool first = true; ; first = false) {
+            ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (!first && numBytesRead <= 0) {
+                break;
+            }
             Mutex::Autolock _l(mConnectionLock);
             if (numBytesRead == sizeof(sensors_event_t)) {
                 if (!mDataInjectionMode) {
@@ -649,6 +701,7 @@ int SensorService::SensorEventConnection::handleEvent(int fd, int events, void*
                // Read error, reset wakelock refcount.
                mWakeLockRefCount = 0;
            }
+            updateWakeLockHoldTimeLocked();
         }
         // Check if wakelock can be released by sensorservice. mConnectionLock needs to be released
         // here as checkWakeLockState() will need it.
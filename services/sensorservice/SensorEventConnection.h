@@ -104,9 +104,16 @@ private:
     // amongst wake-up sensors and non-wake up sensors.
     int computeMaxCacheSizeLocked() const;
 
-    // When more sensors register, the maximum cache size desired may change.  Compute max cache
-    // size, reallocate memory and copy over events from the older cache.
-    void reAllocateCacheLocked(sensors_event_t const* scratch, int count);
+    // Append events to mEventCache, growing it towards the size computeMaxCacheSizeLocked() asks
+    // for as far as SensorService's global cache budget allows. The oldest events are dropped
+    // when they still do not fit.
+    void cacheEventsLocked(sensors_event_t const* scratch, int count);
+
+    // Grow mEventCache to newSize events, or less if the global cache budget runs out.
+    void growCacheLocked(int newSize);
+
+    // Free mEventCache and return its room to the global cache budget.
+    void freeCacheLocked();
 
     // LooperCallback method. If there is data to read on this fd, it is an ack from the app that it
     // has read events from a wake up sensor, decrement mWakeLockRefCount.  If this fd is available
@@ -116,6 +123,10 @@ private:
     // Increment mPendingFlushEventsToSend for the given sensor handle.
     void incrementPendingFlushCount(int32_t handle);
 
+    // Starts or stops accounting wake lock hold time, must be called whenever mWakeLockRefCount
+    // changes.
+    void updateWakeLockHoldTimeLocked();
+
     // Add or remove the file descriptor associated with the BitTube to the looper. If mDead is set
     // to true or there are no more sensors for this connection, the file descriptor is removed if
     // it has been previously added to the Looper. Depending on the state of the connection FD may
@@ -133,6 +144,10 @@ private:
     // Number of events from wake up sensors which are still pending and haven't been delivered to
     // the corresponding application. It is incremented by one unit for each write to the socket.
     uint32_t mWakeLockRefCount;
+    // Time this connection has needed the wake lock for, in the elapsedRealtimeNano() time base.
+    // mWakeLockHeldSince is 0 while mWakeLockRefCount is 0.
+    nsecs_t mWakeLockHeldSince;
+    nsecs_t mWakeLockHeldTime;
 
     // If this flag is set to true, it means that the file descriptor associated with the BitTube
     // has been added to the Looper in SensorService. This flag is typically set when this
@@ -25,7 +25,7 @@ ANDROID_SINGLETON_STATIC_INSTANCE(SensorFusion)
 
 SensorFusion::SensorFusion()
     : mSensorDevice(SensorDevice::getInstance()),
-      mAttitude(mAttitudes[FUSION_9AXIS]),
+      mAttitude(mAttitudes[FUSION_9AXIS]), mRotationMatrixValid(0),
       mGyroTime(0), mAccTime(0)
 {
     sensor_t const* list;
@@ -69,6 +69,7 @@ SensorFusion::SensorFusion()
 }
 
 void SensorFusion::process(const sensors_event_t& event) {
+    mRotationMatrixValid = 0;
 
     if (event.type == mGyro.getType()) {
         float dT;
@@ -142,6 +143,7 @@ status_t SensorFusion::activate(int mode, void* ident, bool enabled) {
         mEnabled[mode] = newState;
         if (newState) {
             mFusions[mode].init(mode);
+            mRotationMatrixValid &= ~(1u << mode);
         }
     }
 
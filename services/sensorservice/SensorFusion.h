@@ -50,6 +50,12 @@ class SensorFusion : public Singleton<SensorFusion> {
     vec4_t &mAttitude;
     vec4_t mAttitudes[NUM_FUSION_MODE];
 
+    // Rotation matrices of the current sample, shared by all the virtual sensors reading them.
+    // A mode's bit is set in mRotationMatrixValid once its matrix has been computed, and all
+    // bits are cleared whenever a new sample is processed.
+    mutable mat33_t mRotationMatrices[NUM_FUSION_MODE];
+    mutable uint32_t mRotationMatrixValid;
+
     SortedVector<void*> mClients[3];
 
     float mEstimatedGyroRate;
@@ -73,8 +79,12 @@ public:
         return mFusions[mode].hasEstimate();
     }
 
-    mat33_t getRotationMatrix(int mode = FUSION_9AXIS) const {
-        return mFusions[mode].getRotationMatrix();
+    const mat33_t& getRotationMatrix(int mode = FUSION_9AXIS) const {
+        if (!(mRotationMatrixValid & (1u << mode))) {
+            mRotationMatrices[mode] = mFusions[mode].getRotationMatrix();
+            mRotationMatrixValid |= 1u << mode;
+        }
+        return mRotationMatrices[mode];
     }
 
     vec4_t getAttitude(int mode = FUSION_9AXIS) const {
@@ -47,15 +47,22 @@
 #include "SensorRecord.h"
 #include "SensorRegistrationInfo.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
 #include <sched.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <private/android_filesystem_config.h>
 
 namespace android {
@@ -85,7 +92,10 @@ static const String16 sManageSensorsPermission("android.permission.MANAGE_SENSOR
 
 SensorService::SensorService()
     : mInitCheck(NO_INIT), mSocketBufferSize(SOCKET_BUFFER_SIZE_NON_BATCHED),
-      mWakeLockAcquired(false) {
+      mUseSharedEventRing(false), mCoalesceWakeUps(false), mSensorListStateFd(-1),
+      mSensorListState(nullptr), mWakeLockAcquired(false),
+      mSendingEvents(false), mWakeLockAcquiredTime(0), mWakeLockHeldTime(0),
+      mWakeLockAcquisitions(0), mWakeLockOwner(-1), mEventCacheReserved(0) {
     mUidPolicy = new UidPolicy(this);
 }
 
@@ -261,6 +271,10 @@ void SensorService::onFirstRef() {
             if (fp) {
                 fclose(fp);
             }
+            mUseSharedEventRing = property_get_bool(SHARED_EVENT_RING_PROPERTY, false);
+            mCoalesceWakeUps = property_get_bool(WAKEUP_COALESCING_PROPERTY, false);
+
+            createSensorListState();
 
             mWakeLockAcquired = false;
             mLooper = new Looper(false);
@@ -314,11 +328,19 @@ const Sensor& SensorService::registerSensor(SensorInterface* s, bool isDebug, bo
 }
 
 const Sensor& SensorService::registerDynamicSensorLocked(SensorInterface* s, bool isDebug) {
-    return registerSensor(s, isDebug);
+    const Sensor& sensor = registerSensor(s, isDebug);
+    if (&sensor != &mSensors.getNonSensor()) {
+        updateSensorListState(sensor, true /* connected */);
+    }
+    return sensor;
 }
 
 bool SensorService::unregisterDynamicSensorLocked(int handle) {
+    sp<SensorInterface> si = mSensors.getInterface(handle);
     bool ret = mSensors.remove(handle);
+    if (ret && si != nullptr) {
+        updateSensorListState(si->getSensor(), false /* connected */);
+    }
 
     const auto i = mRecentEvent.find(handle);
     if (i != mRecentEvent.end()) {
@@ -337,6 +359,10 @@ SensorService::~SensorService() {
         delete entry.second;
     }
     mUidPolicy->unregisterSelf();
+    if (mSensorListState != nullptr) {
+        munmap(mSensorListState, sizeof(SensorListState));
+        close(mSensorListStateFd);
+    }
 }
 
 status_t SensorService::dump(int fd, const Vector<String16>& args) {
@@ -458,8 +484,26 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
 
             result.appendFormat("Socket Buffer size = %zd events\n",
                                 mSocketBufferSize/sizeof(sensors_event_t));
+            result.appendFormat("Event cache = %zu/%zu events\n", mEventCacheReserved.load(),
+                                EVENT_CACHE_BUDGET);
             result.appendFormat("WakeLock Status: %s \n", mWakeLockAcquired ? "acquired" :
                     "not held");
+            nsecs_t wakeLockHeldTime = mWakeLockHeldTime;
+            if (mWakeLockAcquired) {
+                wakeLockHeldTime += elapsedRealtimeNano() - mWakeLockAcquiredTime;
+            }
+            result.appendFormat("WakeLock held %.3fs over %u acquisitions, coalescing %s\n",
+                    wakeLockHeldTime / 1e9, mWakeLockAcquisitions,
+                    mCoalesceWakeUps ? "enabled" : "disabled");
+            if (!mWakeUpSensorStats.empty()) {
+                result.append("Wake up sensors:\n");
+                for (const auto& i : mWakeUpSensorStats) {
+                    result.appendFormat("%s (handle=0x%08x) | wake ups %u | coalesced flushes %u "
+                            "| wake lock held %.3fs\n", getSensorName(i.first).string(), i.first,
+                            i.second.wakeUps, i.second.coalescedFlushes,
+                            i.second.wakeLockHeldTime / 1e9);
+                }
+            }
             result.appendFormat("Mode :");
             switch(mCurrentOperatingMode) {
                case NORMAL:
@@ -614,12 +658,14 @@ void SensorService::cleanupAutoDisabledSensorLocked(const sp<SensorEventConnecti
 bool SensorService::threadLoop() {
     ALOGD("nuSensorService thread starting...");
 
-    // each virtual sensor could generate an event per "real" event, that's why we need to size
-    // numEventMax much smaller than MAX_RECEIVE_BUFFER_EVENT_COUNT.  in practice, this is too
-    // aggressive, but guaranteed to be enough.
+    // each active virtual sensor could generate an event per "real" event, that's why we need
+    // to size numEventMax smaller than MAX_RECEIVE_BUFFER_EVENT_COUNT.  in practice, this is too
+    // aggressive, but guaranteed to be enough.  The buffer is not made larger than what a
+    // client reads at once, since events are sent to connections a whole buffer at a time.
     const size_t vcount = mSensors.getVirtualSensors().size();
     const size_t minBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
-    const size_t numEventMax = minBufferSize / (1 + vcount);
+    size_t numEventMax = minBufferSize / (1 + vcount);
+    std::vector<int> wakeUpHandles;
 
     SensorDevice& device(SensorDevice::getInstance());
 
@@ -631,9 +677,22 @@ bool SensorService::threadLoop() {
             break;
         }
 
-        // Reset sensors_event_t.flags to zero for all events in the buffer.
+        // Reset sensors_event_t.flags to zero for all events in the buffer, and find the wake-up
+        // sensors that sent events. The sensor is looked up once per run of events of the same
+        // sensor, as large batched flushes are long runs.
+        wakeUpHandles.clear();
+        int runHandle = -1;
         for (int i = 0; i < count; i++) {
-             mSensorEventBuffer[i].flags = 0;
+            sensors_event_t& event = mSensorEventBuffer[i];
+            event.flags = 0;
+            const int handle = event.type == SENSOR_TYPE_META_DATA ?
+                    event.meta_data.sensor : event.sensor;
+            if (i == 0 || handle != runHandle) {
+                runHandle = handle;
+                if (isWakeUpSensorEvent(event)) {
+                    wakeUpHandles.push_back(handle);
+                }
+            }
         }
 
         // Make a copy of the connection vector as some connections may be removed during the course
@@ -651,16 +710,24 @@ bool SensorService::threadLoop() {
         // sending events to clients (incrementing SensorEventConnection::mWakeLockRefCount) should
         // not be interleaved with decrementing SensorEventConnection::mWakeLockRefCount and
         // releasing the wakelock.
-        bool bufferHasWakeUpEvent = false;
-        for (int i = 0; i < count; i++) {
-            if (isWakeUpSensorEvent(mSensorEventBuffer[i])) {
-                bufferHasWakeUpEvent = true;
-                break;
-            }
+        const bool bufferHasWakeUpEvent = !wakeUpHandles.empty();
+        const int wakeUpHandle = bufferHasWakeUpEvent ? wakeUpHandles[0] : -1;
+        const nsecs_t now = elapsedRealtimeNano();
+        for (int handle : wakeUpHandles) {
+            mWakeUpSensorStats[handle].lastEventTime = now;
         }
 
+        // Size the next poll for the virtual sensors that are active now rather than for all of
+        // them, so that batched flushes are drained in as few polls as possible.
+        numEventMax = minBufferSize / (1 + mActiveVirtualSensors.size());
+
         if (bufferHasWakeUpEvent && !mWakeLockAcquired) {
             setWakeLockAcquiredLocked(true);
+            mWakeLockOwner = wakeUpHandle;
+            mWakeUpSensorStats[wakeUpHandle].wakeUps++;
+            if (mCoalesceWakeUps && mCurrentOperatingMode == NORMAL) {
+                flushBatchedWakeUpSensorsLocked(now);
+            }
         }
         recordLastValueLocked(mSensorEventBuffer, count);
 
@@ -670,13 +737,27 @@ bool SensorService::threadLoop() {
             if (!mActiveVirtualSensors.empty()) {
                 size_t k = 0;
                 SensorFusion& fusion(SensorFusion::getInstance());
-                if (fusion.isEnabled()) {
-                    for (size_t i=0 ; i<size_t(count) ; i++) {
-                        fusion.process(event[i]);
+                const bool fusionEnabled = fusion.isEnabled();
+                std::vector<sp<SensorInterface>> virtualSensors;
+                virtualSensors.reserve(mActiveVirtualSensors.size());
+                for (int handle : mActiveVirtualSensors) {
+                    sp<SensorInterface> si = mSensors.getInterface(handle);
+                    if (si == nullptr) {
+                        ALOGE("handle %d is not an valid virtual sensor", handle);
+                        continue;
                     }
+                    virtualSensors.push_back(si);
                 }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
-                    for (int handle : mActiveVirtualSensors) {
+                // Each sample goes through the fusion once, then all the virtual sensors read
+                // the outputs derived from it, so they report the state at that sample.
+                for (size_t i=0 ; i<size_t(count) ; i++) {
+                    if (fusionEnabled) {
+                        fusion.process(event[i]);
+                    }
+                    if (k >= minBufferSize) {
+                        continue;
+                    }
+                    for (const sp<SensorInterface>& si : virtualSensors) {
                         if (count + k >= minBufferSize) {
                             ALOGE("buffer too small to hold all events: "
                                     "count=%zd, k=%zu, size=%zu",
@@ -684,12 +765,6 @@ bool SensorService::threadLoop() {
                             break;
                         }
                         sensors_event_t out;
-                        sp<SensorInterface> si = mSensors.getInterface(handle);
-                        if (si == nullptr) {
-                            ALOGE("handle %d is not an valid virtual sensor", handle);
-                            continue;
-                        }
-
                         if (si->process(&out, event[i])) {
                             mSensorEventBuffer[count + k] = out;
                             k++;
@@ -778,14 +853,27 @@ bool SensorService::threadLoop() {
             }
         }
 
-        // Send our events to clients. Check the state of wake lock for each client and release the
-        // lock if none of the clients need it.
-        bool needsWakeLock = false;
+        // Send our events to clients. Each connection is guarded by its own lock and the buffers
+        // are only used by this thread, so mLock is released meanwhile. Otherwise every binder
+        // call and every ack from a client waits for the whole fan-out, which grows with the
+        // number of listeners.
         size_t numConnections = activeConnections.size();
+        mSendingEvents = true;
+        mLock.unlock();
         for (size_t i=0 ; i < numConnections; ++i) {
             if (activeConnections[i] != 0) {
                 activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
                         mMapFlushEventsToConnections);
+            }
+        }
+        mLock.lock();
+        mSendingEvents = false;
+
+        // Check the state of wake lock for each client and release the lock if none of the
+        // clients need it.
+        bool needsWakeLock = false;
+        for (size_t i=0 ; i < numConnections; ++i) {
+            if (activeConnections[i] != 0) {
                 needsWakeLock |= activeConnections[i]->needsWakeLock();
                 // If the connection has one-shot sensors, it may be cleaned up after first trigger.
                 // Early check for one-shot sensors.
@@ -829,12 +917,74 @@ void SensorService::setWakeLockAcquiredLocked(bool acquire) {
         if (!mWakeLockAcquired) {
             acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_NAME);
             mWakeLockAcquired = true;
+            mWakeLockAcquiredTime = elapsedRealtimeNano();
+            mWakeLockAcquisitions++;
+            mWakeLockOwner = -1;
         }
         mLooper->wake();
     } else {
         if (mWakeLockAcquired) {
             release_wake_lock(WAKE_LOCK_NAME);
             mWakeLockAcquired = false;
+            const nsecs_t heldTime = elapsedRealtimeNano() - mWakeLockAcquiredTime;
+            mWakeLockHeldTime += heldTime;
+            if (mWakeLockOwner >= 0) {
+                mWakeUpSensorStats[mWakeLockOwner].wakeLockHeldTime += heldTime;
+            }
+        }
+    }
+}
+
+size_t SensorService::reserveEventCache(size_t count) {
+    size_t reserved = mEventCacheReserved.load(std::memory_order_relaxed);
+    size_t granted;
+    do {
+        if (reserved >= EVENT_CACHE_BUDGET) {
+            return 0;
+        }
+        granted = std::min(count, EVENT_CACHE_BUDGET - reserved);
+        if (granted == 0) {
+            return 0;
+        }
+    } while (!mEventCacheReserved.compare_exchange_weak(reserved, reserved + granted,
+            std::memory_order_relaxed));
+    return granted;
+}
+
+void SensorService::releaseEventCache(size_t count) {
+    mEventCacheReserved.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void SensorService::flushBatchedWakeUpSensorsLocked(nsecs_t now) {
+    SensorDevice& dev(SensorDevice::getInstance());
+    if (dev.getHalDeviceVersion() <= SENSORS_DEVICE_API_VERSION_1_0) {
+        return;
+    }
+    for (size_t i = 0; i < mActiveSensors.size(); ++i) {
+        const int handle = mActiveSensors.keyAt(i);
+        if (isVirtualSensor(handle)) {
+            continue;
+        }
+        sp<SensorInterface> si = getSensorInterfaceFromHandle(handle);
+        if (si == nullptr || !si->getSensor().isWakeUpSensor()) {
+            continue;
+        }
+        const int reportingMode = si->getSensor().getReportingMode();
+        if (reportingMode != AREPORTING_MODE_CONTINUOUS &&
+                reportingMode != AREPORTING_MODE_ON_CHANGE) {
+            continue;
+        }
+        const nsecs_t latency = dev.getBatchReportLatency(handle);
+        WakeUpSensorStats& stats = mWakeUpSensorStats[handle];
+        // Flushing sensors which reported recently would only make their batches smaller.
+        if (latency == 0 || now - stats.lastEventTime < latency / 2) {
+            continue;
+        }
+        if (si->flush(this, handle) == NO_ERROR) {
+            // No connection asked for this flush, its flush complete event is not sent to anyone.
+            mActiveSensors.valueAt(i)->addPendingFlushConnection(nullptr);
+            stats.lastEventTime = now;
+            stats.coalescedFlushes++;
         }
     }
 }
@@ -997,6 +1147,53 @@ Vector<Sensor> SensorService::getSensorList(const String16& /* opPackageName */)
     return accessibleSensorList;
 }
 
+void SensorService::createSensorListState() {
+    int fd = ashmem_create_region("SensorListState", sizeof(SensorListState));
+    if (fd < 0) {
+        ALOGE("can't create the sensor list state (%s)", strerror(errno));
+        return;
+    }
+    void* addr = mmap(nullptr, sizeof(SensorListState), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGE("can't map the sensor list state (%s)", strerror(errno));
+        close(fd);
+        return;
+    }
+    // Clients may only map the region read-only; the mapping above keeps its protection.
+    if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        ALOGE("can't make the sensor list state read-only (%s)", strerror(errno));
+        munmap(addr, sizeof(SensorListState));
+        close(fd);
+        return;
+    }
+    mSensorListState = new (addr) SensorListState();
+    mSensorListStateFd = fd;
+}
+
+void SensorService::updateSensorListState(const Sensor& sensor, bool connected) {
+    if (mSensorListState == nullptr) {
+        return;
+    }
+    if (sensor.getRequiredPermission().length() > 0) {
+        if (connected) {
+            mSensorListState->restrictedDynamicSensorCount++;
+        } else {
+            mSensorListState->restrictedDynamicSensorCount--;
+        }
+    }
+    // Clients read the generation first, so it is bumped last.
+    mSensorListState->dynamicSensorGeneration.fetch_add(1, std::memory_order_release);
+}
+
+int SensorService::getSensorListState() {
+    if (mSensorListState == nullptr) {
+        return NO_INIT;
+    }
+    int fd = fcntl(mSensorListStateFd, F_DUPFD_CLOEXEC, 0);
+    return fd < 0 ? -errno : fd;
+}
+
 Vector<Sensor> SensorService::getDynamicSensorList(const String16& opPackageName) {
     Vector<Sensor> accessibleSensorList;
     mSensors.forEachSensor(
@@ -1586,7 +1783,7 @@ void SensorService::checkWakeLockState() {
 }
 
 void SensorService::checkWakeLockStateLocked() {
-    if (!mWakeLockAcquired) {
+    if (!mWakeLockAcquired || mSendingEvents) {
         return;
     }
     bool releaseLock = true;
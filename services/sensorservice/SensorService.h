@@ -35,6 +35,7 @@
 #include <utils/Vector.h>
 #include <utils/threads.h>
 
+#include <atomic>
 #include <stdint.h>
 #include <sys/types.h>
 #include <unordered_map>
@@ -53,6 +54,15 @@
 #define MAX_SOCKET_BUFFER_SIZE_BATCHED (100 * 1024)
 // For older HALs which don't support batching, use a smaller socket buffer size.
 #define SOCKET_BUFFER_SIZE_NON_BATCHED (4 * 1024)
+// Max number of events all connections together keep in their caches while their sockets are
+// full, about 1 MB.
+#define EVENT_CACHE_BUDGET (1024 * 1024 / sizeof(sensors_event_t))
+// When set, events are passed to connections through a ring in shared memory, and the socket
+// is only used to wake the receiver up.
+#define SHARED_EVENT_RING_PROPERTY "debug.sensors.shared_event_ring"
+// When set, batched wake-up sensors are flushed whenever another wake-up sensor wakes the device
+// up, so that their events are delivered during the same wake up.
+#define WAKEUP_COALESCING_PROPERTY "debug.sensors.wakeup_coalescing"
 
 #define SENSOR_REGISTRATIONS_BUF_SIZE 200
 
@@ -190,6 +200,7 @@ private:
     // ISensorServer interface
     virtual Vector<Sensor> getSensorList(const String16& opPackageName);
     virtual Vector<Sensor> getDynamicSensorList(const String16& opPackageName);
+    virtual int getSensorListState();
     virtual sp<ISensorEventConnection> createSensorEventConnection(
             const String8& packageName,
             int requestedMode, const String16& opPackageName);
@@ -235,6 +246,16 @@ private:
     // seconds and wake the looper.
     void setWakeLockAcquiredLocked(bool acquire);
 
+    // Flush the FIFOs of the batched wake-up sensors which have not reported for at least half
+    // of their batch report latency, so that they are drained while the device is already awake
+    // instead of waking it up again later on their own.
+    void flushBatchedWakeUpSensorsLocked(nsecs_t now);
+
+    // Reserve room for up to count events in the EVENT_CACHE_BUDGET shared by the event caches of
+    // all connections. Returns how many events were granted, possibly fewer than asked for.
+    size_t reserveEventCache(size_t count);
+    void releaseEventCache(size_t count);
+
     // Send events from the event cache for this particular connection.
     void sendEventsFromCache(const sp<SensorEventConnection>& connection);
 
@@ -283,6 +304,16 @@ private:
     // Socket buffersize used to initialize BitTube. This size depends on whether batching is
     // supported or not.
     uint32_t mSocketBufferSize;
+    // Whether connections get their events through a ring in shared memory.
+    bool mUseSharedEventRing;
+    // Whether flushBatchedWakeUpSensorsLocked() is called when the device wakes up.
+    bool mCoalesceWakeUps;
+    // Published read-only to clients so that they can reuse their dynamic sensor lists,
+    // NULL if the region could not be created.
+    int mSensorListStateFd;
+    SensorListState* mSensorListState;
+    void createSensorListState();
+    void updateSensorListState(const Sensor& sensor, bool connected);
     sp<Looper> mLooper;
     sp<SensorEventAckReceiver> mAckReceiver;
 
@@ -292,6 +323,24 @@ private:
     std::unordered_set<int> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
     bool mWakeLockAcquired;
+    // True while threadLoop sends events to connections without holding mLock. The wake lock
+    // is not released meanwhile, threadLoop checks whether it is still needed once done.
+    bool mSendingEvents;
+    // Wake lock accounting, times are in the elapsedRealtimeNano() time base. mWakeLockOwner is
+    // the handle of the wake-up sensor which caused the current acquisition, if any.
+    nsecs_t mWakeLockAcquiredTime;
+    nsecs_t mWakeLockHeldTime;
+    uint32_t mWakeLockAcquisitions;
+    int mWakeLockOwner;
+    struct WakeUpSensorStats {
+        nsecs_t lastEventTime = 0;
+        uint32_t wakeUps = 0;
+        uint32_t coalescedFlushes = 0;
+        nsecs_t wakeLockHeldTime = 0;
+    };
+    std::unordered_map<int, WakeUpSensorStats> mWakeUpSensorStats;
+    // Events reserved from EVENT_CACHE_BUDGET, not protected by mLock.
+    std::atomic<size_t> mEventCacheReserved;
     sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
     wp<const SensorEventConnection> * mMapFlushEventsToConnections;
     std::unordered_map<int, RecentEventLogger*> mRecentEvent;
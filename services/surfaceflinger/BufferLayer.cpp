@@ -316,8 +316,7 @@ bool BufferLayer::onPostComposition(const std::shared_ptr<FenceTime>& glDoneFenc
     nsecs_t desiredPresentTime = mConsumer->getTimestamp();
     mFrameTracker.setDesiredPresentTime(desiredPresentTime);
 
-    const std::string layerName(getName().c_str());
-    mTimeStats.setDesiredTime(layerName, mCurrentFrameNumber, desiredPresentTime);
+    mTimeStats.setDesiredTime(mTimeStatsTracker.get(), mCurrentFrameNumber, desiredPresentTime);
 
     std::shared_ptr<FenceTime> frameReadyFence = mConsumer->getCurrentFenceTime();
     if (frameReadyFence->isValid()) {
@@ -329,14 +328,14 @@ bool BufferLayer::onPostComposition(const std::shared_ptr<FenceTime>& glDoneFenc
     }
 
     if (presentFence->isValid()) {
-        mTimeStats.setPresentFence(layerName, mCurrentFrameNumber, presentFence);
+        mTimeStats.setPresentFence(mTimeStatsTracker.get(), mCurrentFrameNumber, presentFence);
         mFrameTracker.setActualPresentFence(std::shared_ptr<FenceTime>(presentFence));
     } else {
         // The HWC doesn't support present fences, so use the refresh
         // timestamp instead.
         const nsecs_t actualPresentTime =
                 mFlinger->getHwComposer().getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
-        mTimeStats.setPresentTime(layerName, mCurrentFrameNumber, actualPresentTime);
+        mTimeStats.setPresentTime(mTimeStatsTracker.get(), mCurrentFrameNumber, actualPresentTime);
         mFrameTracker.setActualPresentTime(actualPresentTime);
     }
 
@@ -376,27 +375,19 @@ void BufferLayer::releasePendingBuffer(nsecs_t dequeueReadyTime) {
     }
 }
 
-Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime) {
+void BufferLayer::prepareLatch() {
     ATRACE_CALL();
 
-    if (android_atomic_acquire_cas(true, false, &mSidebandStreamChanged) == 0) {
-        // mSidebandStreamChanged was true
-        mSidebandStream = mConsumer->getSidebandStream();
-        // replicated in LayerBE until FE/BE is ready to be synchronized
-        getBE().compositionInfo.hwc.sidebandStream = mSidebandStream;
-        if (getBE().compositionInfo.hwc.sidebandStream != nullptr) {
-            setTransactionFlags(eTransactionNeeded);
-            mFlinger->setTransactionFlags(eTraversalNeeded);
-        }
-        recomputeVisibleRegions = true;
+    mPreparedLatch = PreparedLatch();
+    mPreparedLatch.prepared = true;
 
-        const State& s(getDrawingState());
-        return getTransform().transform(Region(Rect(s.active.w, s.active.h)));
+    // A sideband stream change is handled by latchBuffer instead
+    if (mSidebandStreamChanged) {
+        return;
     }
 
-    Region outDirtyRegion;
     if (mQueuedFrames <= 0 && !mAutoRefresh) {
-        return outDirtyRegion;
+        return;
     }
 
     // if we've already called updateTexImage() without going through
@@ -405,38 +396,79 @@ Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime
     // compositionComplete() call.
     // we'll trigger an update in onPreComposition().
     if (mRefreshPending) {
-        return outDirtyRegion;
+        return;
     }
 
     // If the head buffer's acquire fence hasn't signaled yet, return and
     // try again later
     if (!headFenceHasSignaled()) {
         mFlinger->signalLayerUpdate();
-        return outDirtyRegion;
+        return;
     }
 
     // Capture the old state of the layer for comparisons later
     const State& s(getDrawingState());
-    const bool oldOpacity = isOpaque(s);
-    sp<GraphicBuffer> oldBuffer = getBE().compositionInfo.mBuffer;
+    mPreparedLatch.oldOpacity = isOpaque(s);
+    mPreparedLatch.oldBuffer = getBE().compositionInfo.mBuffer;
 
     if (!allTransactionsSignaled()) {
         mFlinger->signalLayerUpdate();
-        return outDirtyRegion;
+        return;
     }
 
-    // This boolean is used to make sure that SurfaceFlinger's shadow copy
-    // of the buffer queue isn't modified when the buffer queue is returning
-    // BufferItem's that weren't actually queued. This can happen in shared
-    // buffer mode.
-    bool queuedBuffer = false;
-    LayerRejecter r(mDrawingState, getCurrentState(), recomputeVisibleRegions,
+    LayerRejecter r(mDrawingState, getCurrentState(), mPreparedLatch.recomputeVisibleRegions,
                     getProducerStickyTransform() != 0, mName.string(),
                     mOverrideScalingMode, mFreezeGeometryUpdates);
-    status_t updateResult =
-            mConsumer->updateTexImage(&r, mFlinger->mPrimaryDispSync,
-                                                    &mAutoRefresh, &queuedBuffer,
-                                                    mLastFrameNumberReceived);
+    mPreparedLatch.acquired = true;
+    mPreparedLatch.acquireResult =
+            mConsumer->acquireTexImage(&r, mFlinger->mPrimaryDispSync, &mAutoRefresh,
+                                       &mPreparedLatch.queuedBuffer, mLastFrameNumberReceived);
+}
+
+Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime) {
+    ATRACE_CALL();
+
+    if (!mPreparedLatch.prepared) {
+        prepareLatch();
+    }
+    const PreparedLatch latch = mPreparedLatch;
+    mPreparedLatch = PreparedLatch();
+
+    // A buffer acquired by prepareLatch() is applied first, a sideband stream
+    // change that raced with it is handled on the next latch.
+    if (!latch.acquired &&
+        android_atomic_acquire_cas(true, false, &mSidebandStreamChanged) == 0) {
+        // mSidebandStreamChanged was true
+        mSidebandStream = mConsumer->getSidebandStream();
+        // replicated in LayerBE until FE/BE is ready to be synchronized
+        getBE().compositionInfo.hwc.sidebandStream = mSidebandStream;
+        if (getBE().compositionInfo.hwc.sidebandStream != nullptr) {
+            setTransactionFlags(eTransactionNeeded);
+            mFlinger->setTransactionFlags(eTraversalNeeded);
+        }
+        recomputeVisibleRegions = true;
+
+        const State& s(getDrawingState());
+        return getTransform().transform(Region(Rect(s.active.w, s.active.h)));
+    }
+
+    Region outDirtyRegion;
+    if (!latch.acquired) {
+        return outDirtyRegion;
+    }
+
+    const State& s(getDrawingState());
+    const bool oldOpacity = latch.oldOpacity;
+    const sp<GraphicBuffer>& oldBuffer = latch.oldBuffer;
+    const bool queuedBuffer = latch.queuedBuffer;
+    if (latch.recomputeVisibleRegions) {
+        recomputeVisibleRegions = true;
+    }
+
+    status_t updateResult = latch.acquireResult;
+    if (updateResult == NO_ERROR) {
+        updateResult = mConsumer->applyTexImage();
+    }
     if (updateResult == BufferQueue::PRESENT_LATER) {
         // Producer doesn't want buffer to be displayed yet.  Signal a
         // layer update so we check again at the next opportunity.
@@ -447,7 +479,7 @@ Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime
         // and return early
         if (queuedBuffer) {
             Mutex::Autolock lock(mQueueItemLock);
-            mTimeStats.removeTimeRecord(getName().c_str(), mQueueItems[0].mFrameNumber);
+            mTimeStats.removeTimeRecord(mTimeStatsTracker.get(), mQueueItems[0].mFrameNumber);
             mQueueItems.removeAt(0);
             android_atomic_dec(&mQueuedFrames);
         }
@@ -461,7 +493,7 @@ Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime
             Mutex::Autolock lock(mQueueItemLock);
             mQueueItems.clear();
             android_atomic_and(0, &mQueuedFrames);
-            mTimeStats.clearLayerRecord(getName().c_str());
+            mTimeStats.clearLayerRecord(mTimeStatsTracker.get());
         }
 
         // Once we have hit this state, the shadow queue may no longer
@@ -482,14 +514,14 @@ Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime
         // Remove any stale buffers that have been dropped during
         // updateTexImage
         while (mQueueItems[0].mFrameNumber != currentFrameNumber) {
-            mTimeStats.removeTimeRecord(getName().c_str(), mQueueItems[0].mFrameNumber);
+            mTimeStats.removeTimeRecord(mTimeStatsTracker.get(), mQueueItems[0].mFrameNumber);
             mQueueItems.removeAt(0);
             android_atomic_dec(&mQueuedFrames);
         }
 
-        const std::string layerName(getName().c_str());
-        mTimeStats.setAcquireFence(layerName, currentFrameNumber, mQueueItems[0].mFenceTime);
-        mTimeStats.setLatchTime(layerName, currentFrameNumber, latchTime);
+        mTimeStats.setAcquireFence(mTimeStatsTracker.get(), currentFrameNumber,
+                                   mQueueItems[0].mFenceTime);
+        mTimeStats.setLatchTime(mTimeStatsTracker.get(), currentFrameNumber, latchTime);
 
         mQueueItems.removeAt(0);
     }
@@ -602,15 +634,75 @@ Region BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime
         }
     }
 
+    // The LayerRejecter may have changed the active geometry, and a new buffer size,
+    // transform or scaling mode changes the transform of the children.
+    if (recomputeVisibleRegions) {
+        mFlinger->invalidateLayerGeometry();
+    }
+
     // FIXME: postedRegion should be dirty & bounds
     Region dirtyRegion(Rect(s.active.w, s.active.h));
 
+    // A producer in shared buffer mode renders into the buffer that is already on screen,
+    // so only what it reports as damaged needs to be composed again.
+    if (mAutoRefresh && oldBuffer == getBE().compositionInfo.mBuffer &&
+        !recomputeVisibleRegions) {
+        dirtyRegion = computeFrontBufferDirtyRegion(queuedBuffer);
+    }
+
     // transform the dirty region to window-manager space
     outDirtyRegion = (getTransform().transform(dirtyRegion));
 
     return outDirtyRegion;
 }
 
+bool BufferLayer::isDeviceCompositedOnAllDisplays() const {
+    const auto& hwcLayers = getBE().mHwcLayers;
+    bool onAnyDisplay = false;
+    for (size_t dpy = 0; dpy < mFlinger->mDisplays.size(); dpy++) {
+        const sp<DisplayDevice>& hw(mFlinger->mDisplays[dpy]);
+        if (!belongsToDisplay(hw->getLayerStack(), hw->isPrimary())) {
+            continue;
+        }
+        // Displays without a hardware composer, and layers it hasn't taken, are composed
+        // by the client from the dirty region.
+        auto hwcLayer = hwcLayers.find(hw->getHwcDisplayId());
+        if (hwcLayer == hwcLayers.end() ||
+            (hwcLayer->second.compositionType != HWC2::Composition::Device &&
+             hwcLayer->second.compositionType != HWC2::Composition::Cursor)) {
+            return false;
+        }
+        onAnyDisplay = true;
+    }
+    return onAnyDisplay;
+}
+
+Region BufferLayer::computeFrontBufferDirtyRegion(bool queuedBuffer) const {
+    const State& s(getDrawingState());
+    const Rect bounds(s.active.w, s.active.h);
+
+    if (!queuedBuffer) {
+        // An auto refresh without a queue carries no damage. When the hardware composer
+        // scans the buffer out itself, the producer's writes reach the display with the
+        // next present, which the surface damage (the whole buffer) still triggers, so
+        // nothing has to be recomposed on the client side.
+        return isDeviceCompositedOnAllDisplays() ? Region() : Region(bounds);
+    }
+
+    // The damage of a queue is in buffer coordinates, which only match layer space when
+    // the buffer is shown as is.
+    const Region& damage = mConsumer->getSurfaceDamage();
+    const sp<GraphicBuffer>& buffer = getBE().compositionInfo.mBuffer;
+    const bool damageIsValid = !(damage.isRect() && damage.getBounds() == Rect::INVALID_RECT);
+    const bool isUntransformed = mCurrentTransform == 0 &&
+            (mCurrentCrop.isEmpty() || mCurrentCrop == buffer->getBounds()) &&
+            buffer->getWidth() == s.active.w && buffer->getHeight() == s.active.h;
+    if (mFlinger->mForceFullDamage || !damageIsValid || !isUntransformed) {
+        return Region(bounds);
+    }
+    return damage.intersect(bounds);
+}
+
 void BufferLayer::setDefaultBufferSize(uint32_t w, uint32_t h) {
     mConsumer->setDefaultBufferSize(w, h);
 }
@@ -676,6 +768,12 @@ void BufferLayer::setPerFrameData(const sp<const DisplayDevice>& displayDevice)
 
     uint32_t hwcSlot = 0;
     sp<GraphicBuffer> hwcBuffer;
+    if (!hwcInfo.bufferCache.isCached(getBE().compositionInfo.mBufferSlot,
+                                      getBE().compositionInfo.mBuffer)) {
+        // Keep the HWC cache no larger than the queue, so buffers the producer
+        // has freed are not held alive by stale HWC slots.
+        hwcInfo.bufferCache.setMaxSlots(mConsumer->getBufferCount());
+    }
     hwcInfo.bufferCache.getHwcBuffer(getBE().compositionInfo.mBufferSlot,
                                      getBE().compositionInfo.mBuffer, &hwcSlot, &hwcBuffer);
 
@@ -704,10 +802,14 @@ void BufferLayer::onFirstRef() {
     // Creates a custom BufferQueue for SurfaceFlingerConsumer to use
     sp<IGraphicBufferProducer> producer;
     sp<IGraphicBufferConsumer> consumer;
-    BufferQueue::createBufferQueue(&producer, &consumer, true);
+    if (mFlinger->mBufferQueuePool != nullptr) {
+        mFlinger->mBufferQueuePool->take(&producer, &consumer);
+    } else {
+        BufferQueue::createBufferQueue(&producer, &consumer, true);
+    }
     mProducer = new MonitoredProducer(producer, mFlinger, this);
     mConsumer = new BufferLayerConsumer(consumer,
-            mFlinger->getRenderEngine(), mTextureName, this);
+            mFlinger->getRenderEngine(), mTextureName, this, mFlinger->mImageCache.get());
     mConsumer->setConsumerUsageBits(getEffectiveUsage(0));
     mConsumer->setContentsChangedListener(this);
     mConsumer->setName(mName);
@@ -126,6 +126,7 @@ public:
      * to figure out if the content or size of a surface has changed.
      */
     Region latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime) override;
+    void prepareLatch() override;
     bool isBufferLatched() const override { return mRefreshPending; }
     void setDefaultBufferSize(uint32_t w, uint32_t h) override;
 
@@ -161,6 +162,14 @@ private:
     uint64_t getHeadFrameNumber() const;
     bool headFenceHasSignaled() const;
 
+    // Returns true if the last composition handed this layer to the hardware composer on
+    // every display showing it, so the displays read its buffer without client composition.
+    bool isDeviceCompositedOnAllDisplays() const;
+
+    // Returns the part of the layer, in layer space, that a relatch of the shared buffer
+    // in front-buffer mode changes.
+    Region computeFrontBufferDirtyRegion(bool queuedBuffer) const;
+
     // Returns the current scaling mode, unless mOverrideScalingMode
     // is set, in which case, it returns mOverrideScalingMode
     uint32_t getEffectiveScalingMode() const override;
@@ -193,6 +202,23 @@ private:
 
     bool mUpdateTexImageFailed; // This is only accessed on the main thread.
     bool mRefreshPending;
+
+    // The outcome of prepareLatch(), consumed by the next latchBuffer().
+    struct PreparedLatch {
+        bool prepared = false;
+        // Whether a buffer was acquired, or attempted to
+        bool acquired = false;
+        status_t acquireResult = NO_ERROR;
+        // This boolean is used to make sure that SurfaceFlinger's shadow copy
+        // of the buffer queue isn't modified when the buffer queue is returning
+        // BufferItem's that weren't actually queued. This can happen in shared
+        // buffer mode.
+        bool queuedBuffer = false;
+        bool recomputeVisibleRegions = false;
+        bool oldOpacity = false;
+        sp<GraphicBuffer> oldBuffer;
+    };
+    PreparedLatch mPreparedLatch;
 };
 
 } // namespace android
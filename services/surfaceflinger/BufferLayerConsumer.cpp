@@ -22,6 +22,7 @@
 #include "BufferLayerConsumer.h"
 
 #include "DispSync.h"
+#include "ImageCache.h"
 #include "Layer.h"
 #include "RenderEngine/Image.h"
 #include "RenderEngine/RenderEngine.h"
@@ -58,7 +59,8 @@ namespace android {
 static const mat4 mtxIdentity;
 
 BufferLayerConsumer::BufferLayerConsumer(const sp<IGraphicBufferConsumer>& bq,
-                                         RE::RenderEngine& engine, uint32_t tex, Layer* layer)
+                                         RE::RenderEngine& engine, uint32_t tex, Layer* layer,
+                                         ImageCache* imageCache)
       : ConsumerBase(bq, false),
         mCurrentCrop(Rect::EMPTY_RECT),
         mCurrentTransform(0),
@@ -76,6 +78,7 @@ BufferLayerConsumer::BufferLayerConsumer(const sp<IGraphicBufferConsumer>& bq,
         mRE(engine),
         mTexName(tex),
         mLayer(layer),
+        mImageCache(imageCache),
         mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT) {
     BLC_LOGV("BufferLayerConsumer");
 
@@ -153,16 +156,28 @@ status_t BufferLayerConsumer::updateTexImage(BufferRejecter* rejecter, const Dis
                                              uint64_t maxFrameNumber) {
     ATRACE_CALL();
     BLC_LOGV("updateTexImage");
+
+    status_t err = acquireTexImage(rejecter, dispSync, autoRefresh, queuedBuffer, maxFrameNumber);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    return applyTexImage();
+}
+
+status_t BufferLayerConsumer::acquireTexImage(BufferRejecter* rejecter, const DispSync& dispSync,
+                                              bool* autoRefresh, bool* queuedBuffer,
+                                              uint64_t maxFrameNumber) {
+    ATRACE_CALL();
+    BLC_LOGV("acquireTexImage");
     Mutex::Autolock lock(mMutex);
 
     if (mAbandoned) {
-        BLC_LOGE("updateTexImage: BufferLayerConsumer is abandoned!");
+        BLC_LOGE("acquireTexImage: BufferLayerConsumer is abandoned!");
         return NO_INIT;
     }
 
-    // Make sure RenderEngine is current
-    if (!mRE.isCurrent()) {
-        BLC_LOGE("updateTexImage: RenderEngine is not current");
+    if (mHasAcquiredItem) {
+        BLC_LOGE("acquireTexImage: the previously acquired buffer was not applied");
         return INVALID_OPERATION;
     }
 
@@ -178,7 +193,7 @@ status_t BufferLayerConsumer::updateTexImage(BufferRejecter* rejecter, const Dis
         } else if (err == BufferQueue::PRESENT_LATER) {
             // return the error, without logging
         } else {
-            BLC_LOGE("updateTexImage: acquire failed: %s (%d)", strerror(-err), err);
+            BLC_LOGE("acquireTexImage: acquire failed: %s (%d)", strerror(-err), err);
         }
         return err;
     }
@@ -200,8 +215,37 @@ status_t BufferLayerConsumer::updateTexImage(BufferRejecter* rejecter, const Dis
         return BUFFER_REJECTED;
     }
 
+    mAcquiredItem = item;
+    mHasAcquiredItem = true;
+    return NO_ERROR;
+}
+
+status_t BufferLayerConsumer::applyTexImage() {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mMutex);
+
+    if (!mHasAcquiredItem) {
+        // No buffer was available
+        return NO_ERROR;
+    }
+    BufferItem item = mAcquiredItem;
+    mAcquiredItem = BufferItem();
+    mHasAcquiredItem = false;
+
+    if (mAbandoned) {
+        BLC_LOGE("applyTexImage: BufferLayerConsumer is abandoned!");
+        return NO_INIT;
+    }
+
+    // Make sure RenderEngine is current
+    if (!mRE.isCurrent()) {
+        BLC_LOGE("applyTexImage: RenderEngine is not current");
+        releaseBufferLocked(item.mSlot, mSlots[item.mSlot].mGraphicBuffer);
+        return INVALID_OPERATION;
+    }
+
     // Release the previous buffer.
-    err = updateAndReleaseLocked(item, &mPendingRelease);
+    status_t err = updateAndReleaseLocked(item, &mPendingRelease);
     if (err != NO_ERROR) {
         return err;
     }
@@ -274,7 +318,7 @@ status_t BufferLayerConsumer::acquireBufferLocked(BufferItem* item, nsecs_t pres
     // before, so any prior EglImage created is using a stale buffer. This
     // replaces any old EglImage with a new one (using the new buffer).
     if (item->mGraphicBuffer != nullptr) {
-        mImages[item->mSlot] = new Image(item->mGraphicBuffer, mRE);
+        mImages[item->mSlot] = new Image(item->mGraphicBuffer, mRE, mImageCache);
     }
 
     return NO_ERROR;
@@ -478,6 +522,18 @@ int BufferLayerConsumer::getCurrentApi() const {
     return mCurrentApi;
 }
 
+size_t BufferLayerConsumer::getBufferCount() const {
+    Mutex::Autolock lock(mMutex);
+
+    size_t count = 0;
+    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        if (mSlots[i].mGraphicBuffer != nullptr) {
+            count++;
+        }
+    }
+    return count;
+}
+
 sp<GraphicBuffer> BufferLayerConsumer::getCurrentBuffer(int* outSlot) const {
     Mutex::Autolock lock(mMutex);
 
@@ -606,9 +662,11 @@ void BufferLayerConsumer::dumpLocked(String8& result, const char* prefix) const
     ConsumerBase::dumpLocked(result, prefix);
 }
 
-BufferLayerConsumer::Image::Image(sp<GraphicBuffer> graphicBuffer, RE::RenderEngine& engine)
+BufferLayerConsumer::Image::Image(sp<GraphicBuffer> graphicBuffer, RE::RenderEngine& engine,
+                                  ImageCache* cache)
       : mGraphicBuffer(graphicBuffer),
-        mImage{engine.createImage()},
+        mEngine(engine),
+        mCache(cache),
         mCreated(false),
         mCropWidth(0),
         mCropHeight(0) {}
@@ -622,9 +680,18 @@ status_t BufferLayerConsumer::Image::createIfNeeded(const Rect& imageCrop) {
         return OK;
     }
 
-    mCreated = mImage->setNativeWindowBuffer(mGraphicBuffer->getNativeBuffer(),
-                                             mGraphicBuffer->getUsage() & GRALLOC_USAGE_PROTECTED,
-                                             cropWidth, cropHeight);
+    if (mCache != nullptr) {
+        mImage = mCache->getImage(mEngine, mGraphicBuffer, cropWidth, cropHeight);
+        mCreated = mImage != nullptr;
+    } else {
+        if (mImage == nullptr) {
+            mImage = mEngine.createImage();
+        }
+        mCreated = mImage->setNativeWindowBuffer(mGraphicBuffer->getNativeBuffer(),
+                                                 mGraphicBuffer->getUsage() &
+                                                         GRALLOC_USAGE_PROTECTED,
+                                                 cropWidth, cropHeight);
+    }
     if (mCreated) {
         mCropWidth = cropWidth;
         mCropHeight = cropHeight;
@@ -34,6 +34,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class DispSync;
+class ImageCache;
 class Layer;
 class String8;
 
@@ -72,9 +73,10 @@ public:
 
     // BufferLayerConsumer constructs a new BufferLayerConsumer object.  The
     // tex parameter indicates the name of the RenderEngine texture to which
-    // images are to be streamed.
+    // images are to be streamed. The RE::Images of the buffers are taken
+    // from imageCache, if not null.
     BufferLayerConsumer(const sp<IGraphicBufferConsumer>& bq, RE::RenderEngine& engine,
-                        uint32_t tex, Layer* layer);
+                        uint32_t tex, Layer* layer, ImageCache* imageCache = nullptr);
 
     // Sets the contents changed listener. This should be used instead of
     // ConsumerBase::setFrameAvailableListener().
@@ -96,6 +98,14 @@ public:
     status_t updateTexImage(BufferRejecter* rejecter, const DispSync& dispSync, bool* autoRefresh,
                             bool* queuedBuffer, uint64_t maxFrameNumber);
 
+    // updateTexImage in two steps. acquireTexImage acquires and checks the
+    // next buffer and does not need RenderEngine, so it may be called from any
+    // thread. applyTexImage, which must be called next with RenderEngine
+    // current, releases the previous buffer and makes the acquired one current.
+    status_t acquireTexImage(BufferRejecter* rejecter, const DispSync& dispSync, bool* autoRefresh,
+                             bool* queuedBuffer, uint64_t maxFrameNumber);
+    status_t applyTexImage();
+
     // See BufferLayerConsumer::bindTextureImageLocked().
     status_t bindTextureImage();
 
@@ -156,6 +166,10 @@ public:
     // returned.
     sp<GraphicBuffer> getCurrentBuffer(int* outSlot = nullptr) const;
 
+    // getBufferCount returns the number of slots currently holding a buffer,
+    // which is how deep the producer has grown the queue.
+    size_t getBufferCount() const;
+
     // getCurrentCrop returns the cropping rectangle of the current buffer.
     Rect getCurrentCrop() const;
 
@@ -223,7 +237,7 @@ private:
     // also only creating new RE::Images from buffers when required.
     class Image : public LightRefBase<Image> {
     public:
-        Image(sp<GraphicBuffer> graphicBuffer, RE::RenderEngine& engine);
+        Image(sp<GraphicBuffer> graphicBuffer, RE::RenderEngine& engine, ImageCache* cache);
 
         Image(const Image& rhs) = delete;
         Image& operator=(const Image& rhs) = delete;
@@ -247,8 +261,13 @@ private:
         // mGraphicBuffer is the buffer that was used to create this image.
         sp<GraphicBuffer> mGraphicBuffer;
 
+        RE::RenderEngine& mEngine;
+
+        // mCache shares the images of mGraphicBuffer with the other layers.
+        ImageCache* const mCache;
+
         // mImage is the image created from mGraphicBuffer.
-        std::unique_ptr<RE::Image> mImage;
+        std::shared_ptr<RE::Image> mImage;
         bool mCreated;
         int32_t mCropWidth;
         int32_t mCropHeight;
@@ -362,6 +381,9 @@ private:
     // The layer for this BufferLayerConsumer
     const wp<Layer> mLayer;
 
+    // The SurfaceFlinger-wide cache of RE::Images, may be null
+    ImageCache* const mImageCache;
+
     wp<ContentsChangedListener> mContentsChangedListener;
 
     // mImages stores the buffers that have been allocated by the BufferQueue
@@ -384,6 +406,10 @@ private:
     // A release that is pending on the receipt of a new release fence from
     // presentDisplay
     PendingRelease mPendingRelease;
+
+    // The buffer acquired by acquireTexImage, waiting for applyTexImage.
+    BufferItem mAcquiredItem;
+    bool mHasAcquiredItem = false;
 };
 
 // ----------------------------------------------------------------------------
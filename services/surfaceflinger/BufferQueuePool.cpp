@@ -0,0 +1,87 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "BufferQueuePool.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <gui/BufferQueue.h>
+#include <utils/Trace.h>
+
+namespace android {
+
+BufferQueuePool::BufferQueuePool(size_t size)
+      : mSize(size), mThread(&BufferQueuePool::threadMain, this) {
+    pthread_setname_np(mThread.native_handle(), "BufferQueuePool");
+}
+
+BufferQueuePool::~BufferQueuePool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+void BufferQueuePool::take(sp<IGraphicBufferProducer>* outProducer,
+                           sp<IGraphicBufferConsumer>* outConsumer) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mEntries.empty()) {
+            *outProducer = std::move(mEntries.front().producer);
+            *outConsumer = std::move(mEntries.front().consumer);
+            mEntries.pop_front();
+            mHits++;
+            mCondition.notify_all();
+            return;
+        }
+        mMisses++;
+        mCondition.notify_all();
+    }
+    BufferQueue::createBufferQueue(outProducer, outConsumer, true);
+}
+
+void BufferQueuePool::threadMain() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this] { return mStopping || mEntries.size() < mSize; });
+        if (mStopping) {
+            return;
+        }
+
+        lock.unlock();
+        Entry entry;
+        {
+            ATRACE_NAME("BufferQueuePool::createBufferQueue");
+            BufferQueue::createBufferQueue(&entry.producer, &entry.consumer, true);
+        }
+        lock.lock();
+        mEntries.push_back(std::move(entry));
+    }
+}
+
+void BufferQueuePool::dump(String8& result) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    result.appendFormat("  buffer queue pool: %zu of %zu queues; hits=%" PRIu64
+                        " misses=%" PRIu64 "\n",
+                        mEntries.size(), mSize, mHits, mMisses);
+}
+
+} // namespace android
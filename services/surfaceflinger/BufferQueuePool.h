@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <gui/IGraphicBufferConsumer.h>
+#include <gui/IGraphicBufferProducer.h>
+#include <utils/String8.h>
+
+namespace android {
+
+/*
+ * BufferQueues made ahead of the buffer layers that will use them. The pool
+ * keeps up to size queues, and tops itself up on its own thread after a layer
+ * takes one, so the createSurface() call of the client doesn't pay for it.
+ *
+ * Queues are new when handed out, never recycled: an abandoned
+ * BufferQueueCore can't be brought back, and the client of a removed layer
+ * may still hold its producer.
+ */
+class BufferQueuePool {
+public:
+    explicit BufferQueuePool(size_t size);
+    ~BufferQueuePool();
+
+    // Hands out a queue of the pool, or a new one if the pool is empty.
+    // consumerIsSurfaceFlinger is set on all of them.
+    void take(sp<IGraphicBufferProducer>* outProducer, sp<IGraphicBufferConsumer>* outConsumer);
+
+    void dump(String8& result) const;
+
+private:
+    struct Entry {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+    };
+
+    void threadMain();
+
+    const size_t mSize;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<Entry> mEntries;
+    bool mStopping = false;
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+
+    std::thread mThread;
+};
+
+} // namespace android
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ClientCompositionCache.h"
+
+namespace android {
+
+static bool isSameRegion(const Region& lhs, const Region& rhs) {
+    if (lhs.isTriviallyEqual(rhs)) {
+        return true;
+    }
+    if (lhs.getBounds() != rhs.getBounds()) {
+        return false;
+    }
+    return lhs.subtract(rhs).isEmpty() && rhs.subtract(lhs).isEmpty();
+}
+
+bool ClientCompositionCache::matches(const std::vector<Entry>& entries,
+                                     const Region& dirtyRegion) const {
+    if (entries.size() != mEntries.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& lhs = entries[i];
+        const Entry& rhs = mEntries[i];
+        if (lhs.layer != rhs.layer || lhs.stateSequence != rhs.stateSequence ||
+            lhs.type != rhs.type || lhs.clearClientTarget != rhs.clearClientTarget ||
+            !isSameRegion(lhs.clip, rhs.clip)) {
+            return false;
+        }
+        // new content in a client layer shows up in the dirty region
+        if (lhs.type == HWC2::Composition::Client && !lhs.clip.intersect(dirtyRegion).isEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ClientCompositionCache::Action ClientCompositionCache::update(std::vector<Entry>&& entries,
+                                                              const Region& dirtyRegion,
+                                                              uint32_t threshold) {
+    if (threshold == 0 || !matches(entries, dirtyRegion)) {
+        invalidate();
+        mEntries = std::move(entries);
+        return Action::Compose;
+    }
+    if (mBuffer != nullptr) {
+        return Action::Reuse;
+    }
+    mStableFrames++;
+    return mStableFrames >= threshold ? Action::Flatten : Action::Compose;
+}
+
+void ClientCompositionCache::invalidate() {
+    mEntries.clear();
+    mStableFrames = 0;
+    mImage.reset();
+    mBuffer.clear();
+}
+
+void ClientCompositionCache::setBuffer(const sp<GraphicBuffer>& buffer,
+                                       std::unique_ptr<RE::Image> image) {
+    mBuffer = buffer;
+    mImage = std::move(image);
+}
+
+} // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <ui/GraphicBuffer.h>
+#include <ui/Region.h>
+
+#include "DisplayHardware/HWC2.h"
+#include "RenderEngine/Image.h"
+
+namespace android {
+
+class Layer;
+
+/*
+ * Tracks whether the client composited part of a display stays the same from
+ * one frame to the next. Once it has been stable for a number of frames, the
+ * client layers are rendered once into an offscreen buffer and the following
+ * frames copy that buffer into the client target instead of drawing each
+ * client layer again.
+ */
+class ClientCompositionCache {
+public:
+    enum class Action {
+        Compose, // draw the client layers into the client target as usual
+        Flatten, // draw the client layers into the cache buffer, then copy it
+        Reuse,   // the cache buffer already holds the client layers
+    };
+
+    // What doComposeSurfaces does with one visible layer of the display
+    struct Entry {
+        const Layer* layer;
+        // Layer::State::sequence, bumped by every state change
+        int32_t stateSequence;
+        HWC2::Composition type;
+        bool clearClientTarget;
+        // region of the client target touched by the layer, in screen space
+        Region clip;
+    };
+
+    // Records the layers about to be composed and the screen-space region
+    // being repainted, and decides how the client target should be produced.
+    // threshold is the number of identical frames before flattening.
+    Action update(std::vector<Entry>&& entries, const Region& dirtyRegion, uint32_t threshold);
+
+    // Forgets the recorded layers and releases the cache buffer.
+    void invalidate();
+
+    // Installs the buffer the client layers were flattened into, and the
+    // image used to sample it.
+    void setBuffer(const sp<GraphicBuffer>& buffer, std::unique_ptr<RE::Image> image);
+
+    const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
+    const RE::Image* getImage() const { return mImage.get(); }
+    uint32_t getStableFrames() const { return mStableFrames; }
+
+private:
+    bool matches(const std::vector<Entry>& entries, const Region& dirtyRegion) const;
+
+    std::vector<Entry> mEntries;
+    uint32_t mStableFrames = 0;
+    sp<GraphicBuffer> mBuffer;
+    std::unique_ptr<RE::Image> mImage;
+};
+
+} // namespace android
@@ -23,7 +23,9 @@
 #include <math.h>
 
 #include <algorithm>
+#include <cstdlib>
 
+#include <cutils/properties.h>
 #include <log/log.h>
 #include <utils/String8.h>
 #include <utils/Thread.h>
@@ -52,9 +54,26 @@ static const bool kEnableZeroPhaseTracer = false;
 // This is the threshold used to determine when hardware vsync events are
 // needed to re-synchronize the software vsync model with the hardware.  The
 // error metric used is the mean of the squared difference between each
-// present time and the nearest software-predicted vsync.
+// present time and the nearest software-predicted vsync, leaving out the
+// largest quarter of the differences so a single late fence does not count.
 static const nsecs_t kErrorThreshold = 160000000000; // 400 usec squared
 
+// Resync samples further from the fitted model than kOutlierScale times the
+// median distance, and at least kMinOutlierDistance, are left out of the fit.
+static const double kOutlierScale = 4.0;
+static const nsecs_t kMinOutlierDistance = 150000; // 150 usec
+
+// A resync interval that is off from a multiple of the modeled period by more
+// than this fraction of the period hints at a refresh rate switch.
+static const double kRateSwitchTolerance = 0.1;
+
+// Remembered periods within this fraction of an interval are reused.
+static const double kKnownPeriodTolerance = 0.01;
+
+// Listeners that are due within the coalescing slack of one that fires are fired
+// with it, but the slack is never more than this fraction of the period.
+static const nsecs_t kMaxCoalesceSlackDivisor = 10;
+
 #undef LOG_TAG
 #define LOG_TAG "DispSyncThread"
 class DispSyncThread : public Thread {
@@ -66,7 +85,10 @@ public:
             mPhase(0),
             mReferenceTime(0),
             mWakeupLatency(0),
-            mFrameNumber(0) {}
+            mFrameNumber(0),
+            mCoalesceSlack(0),
+            mDispatchCount(0),
+            mCoalescedCount(0) {}
 
     virtual ~DispSyncThread() {}
 
@@ -82,6 +104,19 @@ public:
         mCond.signal();
     }
 
+    void setCoalesceSlack(nsecs_t slack) {
+        Mutex::Autolock lock(mMutex);
+        mCoalesceSlack = max(slack, nsecs_t(0));
+        mCond.signal();
+    }
+
+    void dump(String8& result) {
+        Mutex::Autolock lock(mMutex);
+        result.appendFormat("[%s] coalesce slack: %" PRId64 " ns, dispatches: %" PRIu64
+                            ", events fired early: %" PRIu64 "\n",
+                            mName, mCoalesceSlack, mDispatchCount, mCoalescedCount);
+    }
+
     void stop() {
         if (kTraceDetailedInfo) ATRACE_CALL();
         Mutex::Autolock lock(mMutex);
@@ -275,19 +310,30 @@ private:
         Vector<CallbackInvocation> callbackInvocations;
         nsecs_t onePeriodAgo = now - mPeriod;
 
+        // Listeners whose events are only a little ahead are fired along with the due
+        // ones, with their own event times, instead of waking up again for each of them.
+        const nsecs_t slack = min(mCoalesceSlack, mPeriod / kMaxCoalesceSlackDivisor);
+        const nsecs_t deadline = now + slack;
+
         for (size_t i = 0; i < mEventListeners.size(); i++) {
             nsecs_t t = computeListenerNextEventTimeLocked(mEventListeners[i], onePeriodAgo);
 
-            if (t < now) {
+            if (t < deadline) {
                 CallbackInvocation ci;
                 ci.mCallback = mEventListeners[i].mCallback;
                 ci.mEventTime = t;
                 ALOGV("[%s] [%s] Preparing to fire", mName, mEventListeners[i].mName);
                 callbackInvocations.push(ci);
                 mEventListeners.editItemAt(i).mLastEventTime = t;
+                if (t >= now) {
+                    ++mCoalescedCount;
+                }
             }
         }
 
+        if (!callbackInvocations.empty()) {
+            ++mDispatchCount;
+        }
         return callbackInvocations;
     }
 
@@ -360,6 +406,11 @@ private:
 
     int64_t mFrameNumber;
 
+    // How far ahead of their event time listeners may be fired to share a wakeup.
+    nsecs_t mCoalesceSlack;
+    uint64_t mDispatchCount;
+    uint64_t mCoalescedCount;
+
     Vector<EventListener> mEventListeners;
 
     Mutex mMutex;
@@ -390,6 +441,11 @@ DispSync::~DispSync() {}
 void DispSync::init(bool hasSyncFramework, int64_t dispSyncPresentTimeOffset) {
     mIgnorePresentFences = !hasSyncFramework;
     mPresentTimeOffset = dispSyncPresentTimeOffset;
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.dispsync_coalesce_slack_us", value, "500");
+    mThread->setCoalesceSlack(us2ns(atoi(value)));
+
     mThread->run("DispSync", PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
 
     // set DispSync to SCHED_FIFO to minimize jitter
@@ -444,6 +500,11 @@ void DispSync::beginResync() {
     ALOGV("[%s] beginResync", mName);
     mModelUpdated = false;
     mNumResyncSamples = 0;
+    mMismatchedIntervals = 0;
+
+    if (mResyncCount++ == 0) {
+        mFirstResyncTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
 }
 
 bool DispSync::addResyncSample(nsecs_t timestamp) {
@@ -451,6 +512,8 @@ bool DispSync::addResyncSample(nsecs_t timestamp) {
 
     ALOGV("[%s] addResyncSample(%" PRId64 ")", mName, ns2us(timestamp));
 
+    checkRateSwitchLocked(timestamp);
+
     size_t idx = (mFirstResyncSample + mNumResyncSamples) % MAX_RESYNC_SAMPLES;
     mResyncSamples[idx] = timestamp;
     if (mNumResyncSamples == 0) {
@@ -492,6 +555,66 @@ bool DispSync::addResyncSample(nsecs_t timestamp) {
 
 void DispSync::endResync() {}
 
+void DispSync::checkRateSwitchLocked(nsecs_t timestamp) {
+    if (!mModelUpdated || mNumResyncSamples == 0) {
+        return;
+    }
+
+    const size_t last = (mFirstResyncSample + mNumResyncSamples - 1) % MAX_RESYNC_SAMPLES;
+    const nsecs_t interval = timestamp - mResyncSamples[last];
+    const nsecs_t period = mPeriod / (1 + mRefreshSkipCount);
+    const nsecs_t cycles = (interval + period / 2) / period;
+    const nsecs_t intervalErr = interval - cycles * period;
+    if (cycles > 0 && double(std::abs(intervalErr)) <= kRateSwitchTolerance * double(period)) {
+        mMismatchedIntervals = 0;
+        return;
+    }
+
+    // A single odd interval is treated as jitter and left to the outlier
+    // rejection of the fit.
+    if (++mMismatchedIntervals < RATE_SWITCH_INTERVALS) {
+        return;
+    }
+
+    // Samples from before the switch would only skew the fit, so restart the
+    // window from the last sample, which already came at the new rate.
+    ALOGV("[%s] Refresh rate switch, interval %" PRId64, mName, ns2us(interval));
+    mRateSwitchCount++;
+    mMismatchedIntervals = 0;
+    mFirstResyncSample = last;
+    mNumResyncSamples = 1;
+    mModelUpdated = false;
+    mPhase = 0;
+    mReferenceTime = mResyncSamples[last];
+
+    const nsecs_t knownPeriod = findKnownPeriodLocked(interval);
+    if (knownPeriod > 0) {
+        mPeriod = knownPeriod * (1 + mRefreshSkipCount);
+    }
+    mThread->updateModel(mPeriod, mPhase, mReferenceTime);
+}
+
+void DispSync::rememberPeriodLocked(nsecs_t period) {
+    for (size_t i = 0; i < mNumKnownPeriods; i++) {
+        if (std::abs(mKnownPeriods[i] - period) <= kKnownPeriodTolerance * double(period)) {
+            mKnownPeriods[i] = period;
+            return;
+        }
+    }
+    mKnownPeriods[mNextKnownPeriod] = period;
+    mNextKnownPeriod = (mNextKnownPeriod + 1) % NUM_KNOWN_PERIODS;
+    mNumKnownPeriods = min(mNumKnownPeriods + 1, size_t(NUM_KNOWN_PERIODS));
+}
+
+nsecs_t DispSync::findKnownPeriodLocked(nsecs_t interval) const {
+    for (size_t i = 0; i < mNumKnownPeriods; i++) {
+        if (std::abs(mKnownPeriods[i] - interval) <= kKnownPeriodTolerance * double(interval)) {
+            return mKnownPeriods[i];
+        }
+    }
+    return 0;
+}
+
 status_t DispSync::addEventListener(const char* name, nsecs_t phase, Callback* callback) {
     Mutex::Autolock lock(mMutex);
     return mThread->addEventListener(name, phase, callback);
@@ -528,52 +651,115 @@ nsecs_t DispSync::getPeriod() {
     return mPeriod;
 }
 
-void DispSync::updateModelLocked() {
-    ALOGV("[%s] updateModelLocked %zu", mName, mNumResyncSamples);
-    if (mNumResyncSamples >= MIN_RESYNC_SAMPLES_FOR_UPDATE) {
-        ALOGV("[%s] Computing...", mName);
-        nsecs_t durationSum = 0;
-        nsecs_t minDuration = INT64_MAX;
-        nsecs_t maxDuration = 0;
-        for (size_t i = 1; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            size_t prev = (idx + MAX_RESYNC_SAMPLES - 1) % MAX_RESYNC_SAMPLES;
-            nsecs_t duration = mResyncSamples[idx] - mResyncSamples[prev];
-            durationSum += duration;
-            minDuration = min(minDuration, duration);
-            maxDuration = max(maxDuration, duration);
-        }
+bool DispSync::fitModelLocked(nsecs_t* outPeriod, nsecs_t* outPhase,
+                              bool* outNewestRejected) const {
+    // Intentionally skip the first sample
+    const size_t count = mNumResyncSamples - 1;
+    nsecs_t samples[MAX_RESYNC_SAMPLES];
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = mResyncSamples[(mFirstResyncSample + i + 1) % MAX_RESYNC_SAMPLES];
+    }
 
-        // Exclude the min and max from the average
-        durationSum -= minDuration + maxDuration;
-        mPeriod = durationSum / (mNumResyncSamples - 3);
+    // The median interval is a first estimate of the period that neither a
+    // late sample nor a missed vsync can throw off
+    nsecs_t intervals[MAX_RESYNC_SAMPLES];
+    for (size_t i = 1; i < count; i++) {
+        intervals[i - 1] = samples[i] - samples[i - 1];
+    }
+    std::nth_element(intervals, intervals + (count - 1) / 2, intervals + count - 1);
+    const nsecs_t roughPeriod = intervals[(count - 1) / 2];
+    if (roughPeriod <= 0) {
+        return false;
+    }
 
-        ALOGV("[%s] mPeriod = %" PRId64, mName, ns2us(mPeriod));
+    // Number each sample with the vsync it belongs to, and fit
+    // sample = base + period * vsync by least squares
+    double vsyncs[MAX_RESYNC_SAMPLES];
+    double times[MAX_RESYNC_SAMPLES];
+    bool inliers[MAX_RESYNC_SAMPLES];
+    for (size_t i = 0; i < count; i++) {
+        times[i] = double(samples[i] - samples[0]);
+        vsyncs[i] = round(times[i] / double(roughPeriod));
+        inliers[i] = true;
+    }
 
-        double sampleAvgX = 0;
-        double sampleAvgY = 0;
-        double scale = 2.0 * M_PI / double(mPeriod);
-        // Intentionally skip the first sample
-        for (size_t i = 1; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            nsecs_t sample = mResyncSamples[idx] - mReferenceTime;
-            double samplePhase = double(sample % mPeriod) * scale;
-            sampleAvgX += cos(samplePhase);
-            sampleAvgY += sin(samplePhase);
+    double slope = 0;
+    double intercept = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!inliers[i]) continue;
+            n += 1;
+            sumX += vsyncs[i];
+            sumY += times[i];
+            sumXX += vsyncs[i] * vsyncs[i];
+            sumXY += vsyncs[i] * times[i];
+        }
+        const double det = n * sumXX - sumX * sumX;
+        if (n < MIN_RESYNC_SAMPLES_FOR_FIT || det <= 0) {
+            return false;
+        }
+        slope = (n * sumXY - sumX * sumY) / det;
+        intercept = (sumY - slope * sumX) / n;
+        if (pass == 1) {
+            break;
         }
 
-        sampleAvgX /= double(mNumResyncSamples - 1);
-        sampleAvgY /= double(mNumResyncSamples - 1);
+        // Then leave out the samples far from the first fit and fit again
+        double residuals[MAX_RESYNC_SAMPLES];
+        double sortedResiduals[MAX_RESYNC_SAMPLES];
+        for (size_t i = 0; i < count; i++) {
+            residuals[i] = fabs(times[i] - (intercept + slope * vsyncs[i]));
+            sortedResiduals[i] = residuals[i];
+        }
+        std::nth_element(sortedResiduals, sortedResiduals + count / 2, sortedResiduals + count);
+        const double threshold =
+                max(kOutlierScale * sortedResiduals[count / 2], double(kMinOutlierDistance));
+        for (size_t i = 0; i < count; i++) {
+            inliers[i] = residuals[i] <= threshold;
+        }
+    }
 
-        mPhase = nsecs_t(atan2(sampleAvgY, sampleAvgX) / scale);
+    const nsecs_t period = nsecs_t(slope + 0.5);
+    if (period <= 0) {
+        return false;
+    }
+    nsecs_t phase = (samples[0] + nsecs_t(intercept) - mReferenceTime) % period;
+    if (phase < 0) {
+        phase += period;
+    }
+    if (phase > period / 2) {
+        phase -= period;
+    }
 
-        ALOGV("[%s] mPhase = %" PRId64, mName, ns2us(mPhase));
+    *outPeriod = period;
+    *outPhase = phase;
+    *outNewestRejected = !inliers[count - 1];
+    return true;
+}
 
-        if (mPhase < -(mPeriod / 2)) {
-            mPhase += mPeriod;
-            ALOGV("[%s] Adjusting mPhase -> %" PRId64, mName, ns2us(mPhase));
+void DispSync::updateModelLocked() {
+    ALOGV("[%s] updateModelLocked %zu", mName, mNumResyncSamples);
+    if (mNumResyncSamples >= MIN_RESYNC_SAMPLES_FOR_UPDATE) {
+        ALOGV("[%s] Computing...", mName);
+        nsecs_t period;
+        nsecs_t phase;
+        bool newestRejected;
+        if (!fitModelLocked(&period, &phase, &newestRejected)) {
+            ALOGV("[%s] Too few consistent samples", mName);
+            return;
+        }
+        if (newestRejected) {
+            mRejectedSampleCount++;
         }
 
+        mPeriod = period;
+        mPhase = phase;
+        rememberPeriodLocked(mPeriod);
+
+        ALOGV("[%s] mPeriod = %" PRId64, mName, ns2us(mPeriod));
+        ALOGV("[%s] mPhase = %" PRId64, mName, ns2us(mPhase));
+
         if (kTraceDetailedInfo) {
             ATRACE_INT64("DispSync:Period", mPeriod);
             ATRACE_INT64("DispSync:Phase", mPhase + mPeriod / 2);
@@ -597,7 +783,7 @@ void DispSync::updateErrorLocked() {
     nsecs_t period = mPeriod / (1 + mRefreshSkipCount);
 
     int numErrSamples = 0;
-    nsecs_t sqErrSum = 0;
+    nsecs_t sqErrs[NUM_PRESENT_SAMPLES];
 
     for (size_t i = 0; i < NUM_PRESENT_SAMPLES; i++) {
         // Only check for the cached value of signal time to avoid unecessary
@@ -618,12 +804,19 @@ void DispSync::updateErrorLocked() {
         if (sampleErr > period / 2) {
             sampleErr -= period;
         }
-        sqErrSum += sampleErr * sampleErr;
-        numErrSamples++;
+        sqErrs[numErrSamples++] = sampleErr * sampleErr;
     }
 
     if (numErrSamples > 0) {
-        mError = sqErrSum / numErrSamples;
+        // Leave out the largest quarter of the errors, a noisy fence should
+        // not force a resync when the other fences agree with the model
+        std::sort(sqErrs, sqErrs + numErrSamples);
+        const int numUsed = numErrSamples - numErrSamples / 4;
+        nsecs_t sqErrSum = 0;
+        for (int i = 0; i < numUsed; i++) {
+            sqErrSum += sqErrs[i];
+        }
+        mError = sqErrSum / numUsed;
         mZeroErrSamplesCount = 0;
     } else {
         mError = 0;
@@ -664,6 +857,18 @@ void DispSync::dump(String8& result) const {
     result.appendFormat("mNumResyncSamplesSincePresent: %d (limit %d)\n",
                         mNumResyncSamplesSincePresent, MAX_RESYNC_SAMPLES_WITHOUT_PRESENT);
     result.appendFormat("mNumResyncSamples: %zd (max %d)\n", mNumResyncSamples, MAX_RESYNC_SAMPLES);
+    const nsecs_t sinceFirstResync = systemTime(SYSTEM_TIME_MONOTONIC) - mFirstResyncTime;
+    result.appendFormat("resyncs: %u (%.2f per minute), rate switches: %u, "
+                        "rejected resync samples: %u\n",
+                        mResyncCount,
+                        mResyncCount > 0 ? mResyncCount * 60.0e9 / max(sinceFirstResync, nsecs_t(1))
+                                         : 0.0,
+                        mRateSwitchCount, mRejectedSampleCount);
+    result.appendFormat("known periods:");
+    for (size_t i = 0; i < mNumKnownPeriods; i++) {
+        result.appendFormat(" %" PRId64 " ns", mKnownPeriods[i]);
+    }
+    result.appendFormat("\n");
 
     result.appendFormat("mResyncSamples:\n");
     nsecs_t previous = -1;
@@ -701,6 +906,7 @@ void DispSync::dump(String8& result) const {
         previous = presentTime;
     }
 
+    mThread->dump(result);
     result.appendFormat("current monotonic time: %" PRId64 "\n", now);
 }
 
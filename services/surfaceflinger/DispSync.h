@@ -132,11 +132,27 @@ private:
     void updateErrorLocked();
     void resetErrorLocked();
 
+    // fitModelLocked fits a period and phase to the resync samples by least
+    // squares, ignoring samples that lie far off the fitted line.  It returns
+    // false when too few samples are left to trust the fit.
+    bool fitModelLocked(nsecs_t* outPeriod, nsecs_t* outPhase, bool* outNewestRejected) const;
+
+    // checkRateSwitchLocked restarts the resync sample window when the
+    // hardware vsync intervals stop matching the modeled period.
+    void checkRateSwitchLocked(nsecs_t timestamp);
+
+    // Remember a fitted period, or look up a remembered one close to interval.
+    void rememberPeriodLocked(nsecs_t period);
+    nsecs_t findKnownPeriodLocked(nsecs_t interval) const;
+
     enum { MAX_RESYNC_SAMPLES = 32 };
     enum { MIN_RESYNC_SAMPLES_FOR_UPDATE = 6 };
     enum { NUM_PRESENT_SAMPLES = 8 };
     enum { MAX_RESYNC_SAMPLES_WITHOUT_PRESENT = 4 };
     enum { ACCEPTABLE_ZERO_ERR_SAMPLES_COUNT = 64 };
+    enum { MIN_RESYNC_SAMPLES_FOR_FIT = 4 };
+    enum { RATE_SWITCH_INTERVALS = 2 };
+    enum { NUM_KNOWN_PERIODS = 4 };
 
     const char* const mName;
 
@@ -180,6 +196,21 @@ private:
 
     int mRefreshSkipCount;
 
+    // Refresh periods the hardware was seen running at.  Switching back to
+    // one of them gives a usable model before enough samples are fitted.
+    nsecs_t mKnownPeriods[NUM_KNOWN_PERIODS]{};
+    size_t mNumKnownPeriods = 0;
+    size_t mNextKnownPeriod = 0;
+
+    // Number of consecutive resync intervals that did not match mPeriod.
+    int mMismatchedIntervals = 0;
+
+    // Counters reported by dump().
+    uint32_t mResyncCount = 0;
+    nsecs_t mFirstResyncTime = 0;
+    uint32_t mRateSwitchCount = 0;
+    uint32_t mRejectedSampleCount = 0;
+
     // mThread is the thread from which all the callbacks are called.
     sp<DispSyncThread> mThread;
 
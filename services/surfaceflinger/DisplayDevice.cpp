@@ -364,9 +364,42 @@ status_t DisplayDevice::prepareFrame(HWComposer& hwc) {
     return mDisplaySurface->prepareFrame(compositionType);
 }
 
+Region DisplayDevice::beginClientTargetUpdate(const Region& dirtyRegion, bool fullRepaint) const {
+    const Region bounds(getBounds());
+    if (fullRepaint) {
+        mClientTargetDamage = bounds;
+    } else {
+        mClientTargetDamage.orSelf(dirtyRegion);
+    }
+    mHasClientTargetDamage = true;
+
+    // a buffer of age N was last rendered N swaps ago, so it misses the
+    // damage of the N - 1 frames swapped since then as well as this one
+    const int32_t age = mSurface->queryBufferAge();
+    if (fullRepaint || age <= 0 || size_t(age - 1) > mClientTargetDamageHistory.size()) {
+        return bounds;
+    }
+    Region repaint(mClientTargetDamage);
+    for (int32_t i = 0; i < age - 1; i++) {
+        repaint.orSelf(mClientTargetDamageHistory[i]);
+    }
+    return repaint.intersect(bounds);
+}
+
 void DisplayDevice::swapBuffers(HWComposer& hwc) const {
     if (hwc.hasClientComposition(mHwcDisplayId) || hwc.hasFlipClientTargetRequest(mHwcDisplayId)) {
-        mSurface->swapBuffers();
+        if (mHasClientTargetDamage) {
+            mSurface->swapBuffersWithDamage(mClientTargetDamage);
+            mClientTargetDamageHistory.push_front(mClientTargetDamage);
+            if (mClientTargetDamageHistory.size() > kMaxClientTargetDamageHistory) {
+                mClientTargetDamageHistory.pop_back();
+            }
+        } else {
+            mSurface->swapBuffers();
+            mClientTargetDamageHistory.clear();
+        }
+        mClientTargetDamage.clear();
+        mHasClientTargetDamage = false;
     }
 
     status_t result = mDisplaySurface->advanceFrame();
@@ -467,10 +500,15 @@ void DisplayDevice::setActiveRenderIntent(RenderIntent renderIntent) {
     mActiveRenderIntent = renderIntent;
 }
 
-void DisplayDevice::setColorTransform(const mat4& transform) {
+void DisplayDevice::setColorTransform(const mat4& transform, uint64_t version) {
     const bool isIdentity = (transform == mat4());
     mColorTransform =
             isIdentity ? HAL_COLOR_TRANSFORM_IDENTITY : HAL_COLOR_TRANSFORM_ARBITRARY_MATRIX;
+    mColorTransformVersion = version;
+}
+
+uint64_t DisplayDevice::getColorTransformVersion() const {
+    return mColorTransformVersion;
 }
 
 android_color_transform_t DisplayDevice::getColorTransform() const {
@@ -541,6 +579,7 @@ status_t DisplayDevice::orientationToTransfrom(
 
 void DisplayDevice::setDisplaySize(const int newWidth, const int newHeight) {
     dirtyRegion.set(getBounds());
+    mClientTargetDamageHistory.clear();
 
     mSurface->setNativeWindow(nullptr);
 
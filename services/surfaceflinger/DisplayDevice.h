@@ -20,7 +20,9 @@
 #include "Transform.h"
 
 #include <stdlib.h>
+#include <deque>
 #include <unordered_map>
+#include <vector>
 
 #include <math/mat4.h>
 
@@ -35,6 +37,7 @@
 #include <utils/String8.h>
 #include <utils/Timers.h>
 
+#include "ClientCompositionCache.h"
 #include "RenderArea.h"
 #include "RenderEngine/Surface.h"
 
@@ -63,6 +66,21 @@ public:
     // region in screen space
     Region undefinedRegion;
     bool lastCompositionHadVisibleLayers;
+    // flattened client composition, only touched by doComposeSurfaces
+    mutable ClientCompositionCache clientCompositionCache;
+
+    // how each visible layer was composed in the previous frame
+    struct LayerComposition {
+        const Layer* layer;
+        HWC2::Composition type;
+        bool clearClientTarget;
+
+        bool operator==(const LayerComposition& rhs) const {
+            return layer == rhs.layer && type == rhs.type &&
+                    clearClientTarget == rhs.clearClientTarget;
+        }
+    };
+    mutable std::vector<LayerComposition> lastLayerCompositions;
 
     enum DisplayType {
         DISPLAY_ID_INVALID = -1,
@@ -169,6 +187,13 @@ public:
                           ui::Dataspace* outDataspace, ui::ColorMode* outMode,
                           ui::RenderIntent* outIntent) const;
 
+    // Records dirtyRegion (in screen space) as damage of the client target
+    // for this frame and returns the part of the client target that has to
+    // be redrawn, which depends on the age of the buffer being rendered into.
+    // Returns the whole display when the buffer content is unknown or when
+    // fullRepaint is set.
+    Region beginClientTargetUpdate(const Region& dirtyRegion, bool fullRepaint) const;
+
     void swapBuffers(HWComposer& hwc) const;
 
     // called after h/w composer has completed its set() call
@@ -199,7 +224,9 @@ public:
     ui::RenderIntent getActiveRenderIntent() const;
     void setActiveRenderIntent(ui::RenderIntent renderIntent);
     android_color_transform_t getColorTransform() const;
-    void setColorTransform(const mat4& transform);
+    // |version| identifies the transform, see SurfaceFlinger::State::colorMatrixVersion
+    void setColorTransform(const mat4& transform, uint64_t version);
+    uint64_t getColorTransformVersion() const;
     void setCompositionDataSpace(ui::Dataspace dataspace);
     ui::Dataspace getCompositionDataSpace() const;
 
@@ -235,6 +262,13 @@ private:
     int             mDisplayWidth;
     int             mDisplayHeight;
     mutable uint32_t mPageFlipCount;
+    // client target damage since the last swap, and damage of the previous
+    // swaps, most recent first. Only valid while every swap went through
+    // beginClientTargetUpdate().
+    static constexpr size_t kMaxClientTargetDamageHistory = 4;
+    mutable bool mHasClientTargetDamage = false;
+    mutable Region mClientTargetDamage;
+    mutable std::deque<Region> mClientTargetDamageHistory;
     String8         mDisplayName;
     bool            mIsSecure;
 
@@ -280,6 +314,8 @@ private:
     ui::Dataspace mCompositionDataSpace = ui::Dataspace::UNKNOWN;
     // Current color transform
     android_color_transform_t mColorTransform;
+    // Version of the current color transform, 0 until one is set
+    uint64_t mColorTransformVersion = 0;
 
     // Need to know if display is wide-color capable or not.
     // Initialized by SurfaceFlinger when the DisplayDevice is created.
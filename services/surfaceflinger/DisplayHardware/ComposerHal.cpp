@@ -510,6 +510,30 @@ Error Composer::presentDisplay(Display display, int* outPresentFence)
     return Error::NONE;
 }
 
+Error Composer::presentDisplays(const std::vector<Display>& displays,
+        std::vector<int>* outPresentFences, std::vector<Error>* outErrors)
+{
+    for (auto display : displays) {
+        mWriter.selectDisplay(display);
+        mWriter.presentDisplay();
+    }
+
+    Error error = execute();
+
+    // Errors returned by the composer do not name the display they belong
+    // to, so a display that got no present fence is the one that failed.
+    outPresentFences->assign(displays.size(), -1);
+    outErrors->assign(displays.size(), Error::NONE);
+    for (size_t i = 0; i < displays.size(); i++) {
+        mReader.takePresentFence(displays[i], &(*outPresentFences)[i]);
+        if (error != Error::NONE && (*outPresentFences)[i] < 0) {
+            (*outErrors)[i] = error;
+        }
+    }
+
+    return error;
+}
+
 Error Composer::setActiveConfig(Display display, Config config)
 {
     auto ret = mClient->setActiveConfig(display, config);
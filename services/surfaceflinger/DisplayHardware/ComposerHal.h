@@ -123,6 +123,11 @@ public:
                                    std::vector<int>* outReleaseFences) = 0;
 
     virtual Error presentDisplay(Display display, int* outPresentFence) = 0;
+    // Presents several displays with a single execution of the command
+    // buffer.  outPresentFences and outErrors are filled per display.
+    virtual Error presentDisplays(const std::vector<Display>& displays,
+                                  std::vector<int>* outPresentFences,
+                                  std::vector<Error>* outErrors) = 0;
 
     virtual Error setActiveConfig(Display display, Config config) = 0;
 
@@ -320,6 +325,8 @@ public:
                            std::vector<int>* outReleaseFences) override;
 
     Error presentDisplay(Display display, int* outPresentFence) override;
+    Error presentDisplays(const std::vector<Display>& displays, std::vector<int>* outPresentFences,
+                          std::vector<Error>* outErrors) override;
 
     Error setActiveConfig(Display display, Config config) override;
 
@@ -217,6 +217,33 @@ Error Device::flushCommands()
     return static_cast<Error>(mComposer->executeCommands());
 }
 
+void Device::presentDisplays(const std::vector<Display*>& displays,
+                             std::vector<sp<Fence>>* outPresentFences,
+                             std::vector<Error>* outErrors)
+{
+    std::vector<hwc2_display_t> displayIds;
+    displayIds.reserve(displays.size());
+    for (auto display : displays) {
+        displayIds.push_back(display->getId());
+    }
+
+    std::vector<int> presentFenceFds;
+    std::vector<Hwc2::Error> intErrors;
+    mComposer->presentDisplays(displayIds, &presentFenceFds, &intErrors);
+
+    outPresentFences->clear();
+    outErrors->clear();
+    for (size_t i = 0; i < displays.size(); i++) {
+        auto error = static_cast<Error>(intErrors[i]);
+        outErrors->push_back(error);
+        if (error == Error::None) {
+            outPresentFences->push_back(new Fence(presentFenceFds[i]));
+        } else {
+            outPresentFences->push_back(Fence::NO_FENCE);
+        }
+    }
+}
+
 // Display methods
 
 Display::Display(android::Hwc2::Composer& composer,
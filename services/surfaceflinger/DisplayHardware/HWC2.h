@@ -110,6 +110,12 @@ public:
     // This method provides an explicit way to flush state changes to HWC.
     Error flushCommands();
 
+    // Presents all of the given displays with a single call into HWC,
+    // returning a present fence and an error for each of them.
+    void presentDisplays(const std::vector<Display*>& displays,
+                         std::vector<android::sp<android::Fence>>* outPresentFences,
+                         std::vector<Error>* outErrors);
+
 private:
     // Initialization methods
 
@@ -597,6 +597,68 @@ status_t HWComposer::presentAndGetReleaseFences(int32_t displayId) {
     return NO_ERROR;
 }
 
+status_t HWComposer::presentAndGetReleaseFences(const std::vector<int32_t>& displayIds) {
+    ATRACE_CALL();
+
+    status_t result = NO_ERROR;
+    std::vector<int32_t> presentIds;
+    std::vector<HWC2::Display*> presentDisplays;
+    for (auto displayId : displayIds) {
+        RETURN_IF_INVALID_DISPLAY(displayId, BAD_INDEX);
+
+        auto& displayData = mDisplayData[displayId];
+        if (displayData.validateWasSkipped) {
+            // already presented by presentOrValidate in prepare
+            if (displayData.presentError != HWC2::Error::None) {
+                LOG_HWC_ERROR("present", displayData.presentError, displayId);
+                result = UNKNOWN_ERROR;
+            }
+            continue;
+        }
+        presentIds.push_back(displayId);
+        presentDisplays.push_back(displayData.hwcDisplay);
+    }
+
+    if (presentDisplays.empty()) {
+        // explicitly flush all pending commands
+        auto error = mHwcDevice->flushCommands();
+        if (error != HWC2::Error::None) {
+            ALOGE("%s: flushCommands failed: %s (%d)", __FUNCTION__, to_string(error).c_str(),
+                  static_cast<int32_t>(error));
+            return UNKNOWN_ERROR;
+        }
+        return result;
+    }
+
+    std::vector<sp<Fence>> presentFences;
+    std::vector<HWC2::Error> errors;
+    mHwcDevice->presentDisplays(presentDisplays, &presentFences, &errors);
+
+    for (size_t i = 0; i < presentIds.size(); i++) {
+        auto displayId = presentIds[i];
+        if (errors[i] != HWC2::Error::None) {
+            LOG_HWC_ERROR("present", errors[i], displayId);
+            result = UNKNOWN_ERROR;
+            continue;
+        }
+
+        auto& displayData = mDisplayData[displayId];
+        displayData.lastPresentFence = presentFences[i];
+
+        std::unordered_map<HWC2::Layer*, sp<Fence>> releaseFences;
+        auto error = displayData.hwcDisplay->getReleaseFences(&releaseFences);
+        if (error != HWC2::Error::None) {
+            LOG_HWC_ERROR("getReleaseFences", error, displayId);
+            result = UNKNOWN_ERROR;
+            continue;
+        }
+
+        displayData.releaseFences = std::move(releaseFences);
+    }
+
+    return result;
+}
+
 status_t HWComposer::setPowerMode(int32_t displayId, int32_t intMode) {
     ALOGV("setPowerMode(%d, %d)", displayId, intMode);
     RETURN_IF_INVALID_DISPLAY(displayId, BAD_INDEX);
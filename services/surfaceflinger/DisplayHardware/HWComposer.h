@@ -96,6 +96,10 @@ public:
     // Present layers to the display and read releaseFences.
     status_t presentAndGetReleaseFences(int32_t displayId);
 
+    // Same as above for several displays, presenting all of them with a single
+    // call into HWC.  Returns an error if any of the displays failed.
+    status_t presentAndGetReleaseFences(const std::vector<int32_t>& displayIds);
+
     // set power mode
     status_t setPowerMode(int32_t displayId, int mode);
 
@@ -18,37 +18,90 @@
 
 #include <gui/BufferQueue.h>
 
+#include <algorithm>
+
 namespace android {
 
 HWComposerBufferCache::HWComposerBufferCache()
+      : mMaxSlots(BufferQueue::NUM_BUFFER_SLOTS),
+        mHwcSlots(BufferQueue::NUM_BUFFER_SLOTS, -1)
 {
-    mBuffers.reserve(BufferQueue::NUM_BUFFER_SLOTS);
+    mEntries.reserve(BufferQueue::NUM_BUFFER_SLOTS);
+}
+
+int HWComposerBufferCache::normalizeSlot(int slot)
+{
+    if (slot == BufferQueue::INVALID_BUFFER_SLOT || slot < 0 ||
+            slot >= BufferQueue::NUM_BUFFER_SLOTS) {
+        // default to slot 0
+        return 0;
+    }
+    return slot;
 }
 
 void HWComposerBufferCache::getHwcBuffer(int slot,
         const sp<GraphicBuffer>& buffer,
         uint32_t* outSlot, sp<GraphicBuffer>* outBuffer)
 {
-    if (slot == BufferQueue::INVALID_BUFFER_SLOT || slot < 0) {
-        // default to slot 0
-        slot = 0;
-    }
+    slot = normalizeSlot(slot);
 
-    if (static_cast<size_t>(slot) >= mBuffers.size()) {
-        mBuffers.resize(slot + 1);
+    int hwcSlot = mHwcSlots[slot];
+    if (hwcSlot < 0) {
+        hwcSlot = static_cast<int>(assignHwcSlot(slot));
     }
 
-    *outSlot = slot;
+    *outSlot = static_cast<uint32_t>(hwcSlot);
 
-    if (mBuffers[slot] == buffer) {
+    Entry& entry = mEntries[hwcSlot];
+    entry.lastUsed = ++mUseCount;
+    if (entry.buffer == buffer) {
         // already cached in HWC, skip sending the buffer
         *outBuffer = nullptr;
     } else {
         *outBuffer = buffer;
 
         // update cache
-        mBuffers[slot] = buffer;
+        entry.buffer = buffer;
+    }
+}
+
+bool HWComposerBufferCache::isCached(int slot,
+        const sp<GraphicBuffer>& buffer) const
+{
+    int hwcSlot = mHwcSlots[normalizeSlot(slot)];
+    return hwcSlot >= 0 && mEntries[hwcSlot].buffer == buffer;
+}
+
+void HWComposerBufferCache::setMaxSlots(size_t maxSlots)
+{
+    mMaxSlots = std::max<size_t>(1, std::min<size_t>(maxSlots,
+            BufferQueue::NUM_BUFFER_SLOTS));
+}
+
+uint32_t HWComposerBufferCache::assignHwcSlot(int slot)
+{
+    size_t hwcSlot = mEntries.size();
+    if (hwcSlot < mMaxSlots) {
+        mEntries.emplace_back();
+    } else {
+        // Take over the least recently used HWC slot. Slots past a lowered
+        // limit are never handed out again.
+        hwcSlot = 0;
+        for (size_t i = 1; i < std::min(mEntries.size(), mMaxSlots); i++) {
+            if (mEntries[i].lastUsed < mEntries[hwcSlot].lastUsed) {
+                hwcSlot = i;
+            }
+        }
+        Entry& entry = mEntries[hwcSlot];
+        if (entry.slot >= 0) {
+            mHwcSlots[entry.slot] = -1;
+        }
+        entry = Entry();
     }
+
+    mEntries[hwcSlot].slot = slot;
+    mHwcSlots[slot] = static_cast<int>(hwcSlot);
+    return static_cast<uint32_t>(hwcSlot);
 }
 
 } // namespace android
@@ -46,13 +46,40 @@ public:
     //
     // outBuffer is set to buffer when buffer is not in the HWC cache;
     // otherwise, outBuffer is set to nullptr.
+    //
+    // HWC cache slots are handed out densely, in the order buffer queue slots
+    // are first seen, so that the HAL's cache only grows as large as the
+    // number of buffers actually cycling through the queue.
     void getHwcBuffer(int slot, const sp<GraphicBuffer>& buffer,
             uint32_t* outSlot, sp<GraphicBuffer>* outBuffer);
 
+    // Returns true if buffer is cached for the buffer queue slot.
+    bool isCached(int slot, const sp<GraphicBuffer>& buffer) const;
+
+    // Limits the number of HWC cache slots, e.g. to the depth of the buffer
+    // queue. Once all of them are in use, a new buffer queue slot takes the
+    // least recently used HWC slot, which also drops the reference to the
+    // buffer cached there.
+    void setMaxSlots(size_t maxSlots);
+
 private:
-    // a vector as we expect "slot" to be in the range of [0, 63] (that is,
-    // less than BufferQueue::NUM_BUFFER_SLOTS).
-    std::vector<sp<GraphicBuffer>> mBuffers;
+    struct Entry {
+        // The buffer queue slot using this HWC slot, or -1 for none
+        int slot = -1;
+        sp<GraphicBuffer> buffer;
+        uint64_t lastUsed = 0;
+    };
+
+    static int normalizeSlot(int slot);
+    uint32_t assignHwcSlot(int slot);
+
+    size_t mMaxSlots;
+    uint64_t mUseCount = 0;
+
+    // indexed by HWC slot
+    std::vector<Entry> mEntries;
+    // maps buffer queue slots, in the range of [0, 63], to HWC slots or -1
+    std::vector<int> mHwcSlots;
 };
 
 // ---------------------------------------------------------------------------
@@ -74,7 +74,8 @@ VirtualDisplaySurface::VirtualDisplaySurface(HWComposer& hwc, int32_t dispId,
     mDbgState(DBG_STATE_IDLE),
     mDbgLastCompositionType(COMPOSITION_UNKNOWN),
     mMustRecompose(false),
-    mForceHwcCopy(SurfaceFlinger::useHwcForRgbToYuv)
+    mForceHwcCopy(SurfaceFlinger::useHwcForRgbToYuv),
+    mFrameCounts{}
 {
     mSource[SOURCE_SINK] = sink;
     mSource[SOURCE_SCRATCH] = bqProducer;
@@ -236,6 +237,8 @@ void VirtualDisplaySurface::onFrameCommitted() {
             "Unexpected onFrameCommitted() in %s state", dbgStateStr());
     mDbgState = DBG_STATE_IDLE;
 
+    mFrameCounts[mCompositionType]++;
+
     sp<Fence> retireFence = mHwc.getPresentFence(mDisplayId);
     if (mCompositionType == COMPOSITION_MIXED && mFbProducerSlot >= 0) {
         // release the scratch buffer back to the pool
@@ -275,7 +278,18 @@ void VirtualDisplaySurface::onFrameCommitted() {
     resetPerFrameState();
 }
 
-void VirtualDisplaySurface::dumpAsString(String8& /* result */) const {
+void VirtualDisplaySurface::dumpAsString(String8& result) const {
+    if (mDisplayId < 0) {
+        result.appendFormat("  VirtualDisplaySurface: path: GLES (no HWC virtual display)\n");
+        return;
+    }
+    result.appendFormat("  VirtualDisplaySurface: path: HWC output buffer%s, "
+            "output format=%u usage=%#" PRIx64 "\n",
+            mForceHwcCopy ? " (GLES frames copied by HWC)" : "",
+            mOutputFormat, mOutputUsage);
+    result.appendFormat("   frames: HWC=%" PRIu64 " MIXED=%" PRIu64 " GLES=%" PRIu64 "\n",
+            mFrameCounts[COMPOSITION_HWC], mFrameCounts[COMPOSITION_MIXED],
+            mFrameCounts[COMPOSITION_GLES]);
 }
 
 void VirtualDisplaySurface::resizeBuffers(const uint32_t w, const uint32_t h) {
@@ -253,6 +253,10 @@ private:
     HWComposerBufferCache mHwcBufferCache;
 
     bool mForceHwcCopy;
+
+    // Committed frames by composition type, for dumpsys. Shows how often the
+    // HWC output buffer path is actually taken on this display.
+    uint64_t mFrameCounts[COMPOSITION_MIXED + 1];
 };
 
 // ---------------------------------------------------------------------------
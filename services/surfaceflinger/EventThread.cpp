@@ -19,8 +19,11 @@
 #include <pthread.h>
 #include <sched.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
 #include <cstdint>
+#include <vector>
 
 #include <cutils/compiler.h>
 #include <cutils/sched_policy.h>
@@ -95,13 +98,75 @@ sp<BnDisplayEventConnection> EventThread::createEventConnection() const {
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     std::lock_guard<std::mutex> lock(mMutex);
+    // idle connections are only looked at when a hotplug event is sent, so
+    // this is where the dead ones get cleaned up
+    for (size_t i = 0; i < mDisplayEventConnections.size();) {
+        if (mDisplayEventConnections[i].promote() == nullptr) {
+            mDisplayEventConnections.removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+    // a dead armed connection may have lived at the same address
+    mArmedConnections.remove(connection);
     mDisplayEventConnections.add(connection);
-    mCondition.notify_all();
     return NO_ERROR;
 }
 
 void EventThread::removeDisplayEventConnectionLocked(const wp<EventThread::Connection>& connection) {
     mDisplayEventConnections.remove(connection);
+    mArmedConnections.remove(connection);
+}
+
+void EventThread::armConnectionLocked(const sp<EventThread::Connection>& connection,
+                                      int32_t count) {
+    connection->count = count;
+    if (count < 0) {
+        // the thread turns vsync off by itself at the next vsync event
+        mArmedConnections.remove(connection);
+        return;
+    }
+
+    // The thread only sleeps without a timeout when no connection is armed,
+    // in any other case it is already waiting for the next vsync event.
+    const bool wasIdle = mArmedConnections.isEmpty();
+    mArmedConnections.add(connection);
+    if (wasIdle) {
+        mCondition.notify_all();
+    }
+}
+
+void EventThread::recordDeliveryLocked(const sp<EventThread::Connection>& connection,
+                                       const DisplayEventReceiver::Event& event, status_t err,
+                                       nsecs_t postTime) {
+    Connection::DeliveryStats& stats = connection->stats;
+    if (err == -EAGAIN || err == -EWOULDBLOCK) {
+        // The destination doesn't accept events anymore, it's probably
+        // full. For now, we just drop the events on the floor.
+        // FIXME: Note that some events cannot be dropped and would have
+        // to be re-sent later.
+        // Right-now we don't have the ability to do this.
+        ALOGW("EventThread: dropping event (%08x) for connection %p", event.header.type,
+              connection.get());
+        stats.dropped++;
+        return;
+    }
+    if (err < 0) {
+        // handle any other error on the pipe as fatal. the only
+        // reasonable thing to do is to clean-up this connection.
+        // The most common error we'll get here is -EPIPE.
+        removeDisplayEventConnectionLocked(connection);
+        return;
+    }
+
+    stats.delivered++;
+    if (event.header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+        const nsecs_t latency = postTime - event.header.timestamp;
+        stats.vsyncDelivered++;
+        stats.lastLatency = latency;
+        stats.maxLatency = std::max(stats.maxLatency, latency);
+        stats.totalLatency += latency;
+    }
 }
 
 void EventThread::setVsyncRate(uint32_t count, const sp<EventThread::Connection>& connection) {
@@ -109,8 +174,7 @@ void EventThread::setVsyncRate(uint32_t count, const sp<EventThread::Connection>
         std::lock_guard<std::mutex> lock(mMutex);
         const int32_t new_count = (count == 0) ? -1 : count;
         if (connection->count != new_count) {
-            connection->count = new_count;
-            mCondition.notify_all();
+            armConnectionLocked(connection, new_count);
         }
     }
 }
@@ -123,8 +187,7 @@ void EventThread::requestNextVsync(const sp<EventThread::Connection>& connection
     }
 
     if (connection->count < 0) {
-        connection->count = 0;
-        mCondition.notify_all();
+        armConnectionLocked(connection, 0);
     }
 }
 
@@ -172,32 +235,34 @@ void EventThread::onHotplugReceived(int type, bool connected) {
 }
 
 void EventThread::threadMain() NO_THREAD_SAFETY_ANALYSIS {
+    struct Delivery {
+        status_t err;
+        nsecs_t postTime;
+    };
+    std::vector<Delivery> deliveries;
+
     std::unique_lock<std::mutex> lock(mMutex);
     while (mKeepRunning) {
         DisplayEventReceiver::Event event;
         Vector<sp<EventThread::Connection> > signalConnections;
         signalConnections = waitForEventLocked(&lock, &event);
 
-        // dispatch events to listeners...
+        // dispatch events to listeners. The writes happen without the lock,
+        // so that connections asking for the next vsync (which is what they
+        // do right after reading this one) don't stall behind the whole
+        // fan-out. The strong references keep the connections alive.
         const size_t count = signalConnections.size();
+        deliveries.resize(count);
+        lock.unlock();
         for (size_t i = 0; i < count; i++) {
-            const sp<Connection>& conn(signalConnections[i]);
-            // now see if we still need to report this event
-            status_t err = conn->postEvent(event);
-            if (err == -EAGAIN || err == -EWOULDBLOCK) {
-                // The destination doesn't accept events anymore, it's probably
-                // full. For now, we just drop the events on the floor.
-                // FIXME: Note that some events cannot be dropped and would have
-                // to be re-sent later.
-                // Right-now we don't have the ability to do this.
-                ALOGW("EventThread: dropping event (%08x) for connection %p", event.header.type,
-                      conn.get());
-            } else if (err < 0) {
-                // handle any other error on the pipe as fatal. the only
-                // reasonable thing to do is to clean-up this connection.
-                // The most common error we'll get here is -EPIPE.
-                removeDisplayEventConnectionLocked(signalConnections[i]);
-            }
+            deliveries[i].err = signalConnections[i]->postEvent(event);
+            deliveries[i].postTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+        lock.lock();
+
+        for (size_t i = 0; i < count; i++) {
+            recordDeliveryLocked(signalConnections[i], event, deliveries[i].err,
+                                 deliveries[i].postTime);
         }
     }
 }
@@ -238,45 +303,56 @@ Vector<sp<EventThread::Connection> > EventThread::waitForEventLocked(
             }
         }
 
-        // find out connections waiting for events
-        size_t count = mDisplayEventConnections.size();
+        // find out connections waiting for vsync events. Only the armed
+        // ones can be, so idle connections cost nothing here.
+        size_t count = mArmedConnections.size();
         for (size_t i = 0; i < count;) {
-            sp<Connection> connection(mDisplayEventConnections[i].promote());
-            if (connection != nullptr) {
-                bool added = false;
-                if (connection->count >= 0) {
-                    // we need vsync events because at least
-                    // one connection is waiting for it
-                    waitForVSync = true;
-                    if (timestamp) {
-                        // we consume the event only if it's time
-                        // (ie: we received a vsync event)
-                        if (connection->count == 0) {
-                            // fired this time around
-                            connection->count = -1;
-                            signalConnections.add(connection);
-                            added = true;
-                        } else if (connection->count == 1 ||
-                                   (vsyncCount % connection->count) == 0) {
-                            // continuous event, and time to report it
-                            signalConnections.add(connection);
-                            added = true;
-                        }
-                    }
+            sp<Connection> connection(mArmedConnections[i].promote());
+            if (connection == nullptr) {
+                // we couldn't promote this reference, the connection has
+                // died, so clean-up! It is dropped from
+                // mDisplayEventConnections when a connection is registered.
+                mArmedConnections.removeAt(i);
+                --count;
+                continue;
+            }
+
+            // we need vsync events because at least
+            // one connection is waiting for it
+            waitForVSync = true;
+            if (timestamp) {
+                // we consume the event only if it's time
+                // (ie: we received a vsync event)
+                if (connection->count == 0) {
+                    // fired this time around
+                    connection->count = -1;
+                    mArmedConnections.removeAt(i);
+                    --count;
+                    signalConnections.add(connection);
+                    continue;
+                }
+                if (connection->count == 1 || (vsyncCount % connection->count) == 0) {
+                    // continuous event, and time to report it
+                    signalConnections.add(connection);
                 }
+            }
+            ++i;
+        }
 
-                if (eventPending && !timestamp && !added) {
-                    // we don't have a vsync event to process
-                    // (timestamp==0), but we have some pending
-                    // messages.
+        if (eventPending && !timestamp) {
+            // we don't have a vsync event to process
+            // (timestamp==0), but we have some pending
+            // messages, which go to every connection.
+            count = mDisplayEventConnections.size();
+            for (size_t i = 0; i < count;) {
+                sp<Connection> connection(mDisplayEventConnections[i].promote());
+                if (connection != nullptr) {
                     signalConnections.add(connection);
+                    ++i;
+                } else {
+                    mDisplayEventConnections.removeAt(i);
+                    --count;
                 }
-                ++i;
-            } else {
-                // we couldn't promote this reference, the connection has
-                // died, so clean-up!
-                mDisplayEventConnections.removeAt(i);
-                --count;
             }
         }
 
@@ -363,13 +439,23 @@ void EventThread::dump(String8& result) const {
     std::lock_guard<std::mutex> lock(mMutex);
     result.appendFormat("VSYNC state: %s\n", mDebugVsyncEnabled ? "enabled" : "disabled");
     result.appendFormat("  soft-vsync: %s\n", mUseSoftwareVSync ? "enabled" : "disabled");
-    result.appendFormat("  numListeners=%zu,\n  events-delivered: %u\n",
-                        mDisplayEventConnections.size(),
+    result.appendFormat("  numListeners=%zu, armed=%zu,\n  events-delivered: %u\n",
+                        mDisplayEventConnections.size(), mArmedConnections.size(),
                         mVSyncEvent[DisplayDevice::DISPLAY_PRIMARY].vsync.count);
     for (size_t i = 0; i < mDisplayEventConnections.size(); i++) {
         sp<Connection> connection = mDisplayEventConnections.itemAt(i).promote();
-        result.appendFormat("    %p: count=%d\n", connection.get(),
-                            connection != nullptr ? connection->count : 0);
+        if (connection == nullptr) {
+            result.appendFormat("    %p: dead\n", mDisplayEventConnections.itemAt(i).unsafe_get());
+            continue;
+        }
+        const Connection::DeliveryStats& stats = connection->stats;
+        const nsecs_t avgLatency =
+                stats.vsyncDelivered ? stats.totalLatency / nsecs_t(stats.vsyncDelivered) : 0;
+        result.appendFormat("    %p: count=%d delivered=%" PRIu64 " dropped=%" PRIu64
+                            " latency(us) last=%" PRId64 " avg=%" PRId64 " max=%" PRId64 "\n",
+                            connection.get(), connection->count, stats.delivered, stats.dropped,
+                            ns2us(stats.lastLatency), ns2us(avgLatency),
+                            ns2us(stats.maxLatency));
     }
 }
 
@@ -92,6 +92,18 @@ class EventThread : public android::EventThread, private VSyncSource::Callback {
         // count ==-1 : one-shot event that fired this round / disabled
         int32_t count;
 
+        // Delivery statistics, protected by EventThread::mMutex
+        struct DeliveryStats {
+            uint64_t delivered = 0;
+            uint64_t dropped = 0;
+            uint64_t vsyncDelivered = 0;
+            // time from the vsync timestamp to the event being written
+            nsecs_t lastLatency = 0;
+            nsecs_t maxLatency = 0;
+            nsecs_t totalLatency = 0;
+        };
+        DeliveryStats stats;
+
     private:
         virtual void onFirstRef();
         status_t stealReceiveChannel(gui::BitTube* outChannel) override;
@@ -137,6 +149,10 @@ private:
             REQUIRES(mMutex);
 
     void removeDisplayEventConnectionLocked(const wp<Connection>& connection) REQUIRES(mMutex);
+    void armConnectionLocked(const sp<Connection>& connection, int32_t count) REQUIRES(mMutex);
+    void recordDeliveryLocked(const sp<Connection>& connection,
+                              const DisplayEventReceiver::Event& event, status_t err,
+                              nsecs_t postTime) REQUIRES(mMutex);
     void enableVSyncLocked() REQUIRES(mMutex);
     void disableVSyncLocked() REQUIRES(mMutex);
 
@@ -154,6 +170,9 @@ private:
 
     // protected by mLock
     SortedVector<wp<Connection>> mDisplayEventConnections GUARDED_BY(mMutex);
+    // the subset of mDisplayEventConnections with count >= 0, which is all a
+    // vsync event needs to look at
+    SortedVector<wp<Connection>> mArmedConnections GUARDED_BY(mMutex);
     Vector<DisplayEventReceiver::Event> mPendingEvents GUARDED_BY(mMutex);
     DisplayEventReceiver::Event mVSyncEvent[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES] GUARDED_BY(
             mMutex);
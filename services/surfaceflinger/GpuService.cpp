@@ -16,59 +16,33 @@
 
 #include "GpuService.h"
 
-#include <binder/IResultReceiver.h>
-#include <binder/Parcel.h>
-#include <utils/String8.h>
-#include <vkjson.h>
-
-namespace android {
-
-// ----------------------------------------------------------------------------
-
-class BpGpuService : public BpInterface<IGpuService>
-{
-public:
-    explicit BpGpuService(const sp<IBinder>& impl) : BpInterface<IGpuService>(impl) {}
-};
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
 
-IMPLEMENT_META_INTERFACE(GpuService, "android.ui.IGpuService");
+#include <algorithm>
+#include <vector>
 
-status_t BnGpuService::onTransact(uint32_t code, const Parcel& data,
-        Parcel* reply, uint32_t flags)
-{
-    status_t status;
-    switch (code) {
-    case SHELL_COMMAND_TRANSACTION: {
-        int in = data.readFileDescriptor();
-        int out = data.readFileDescriptor();
-        int err = data.readFileDescriptor();
-        int argc = data.readInt32();
-        Vector<String16> args;
-        for (int i = 0; i < argc && data.dataAvail() > 0; i++) {
-           args.add(data.readString16());
-        }
-        sp<IBinder> unusedCallback;
-        sp<IResultReceiver> resultReceiver;
-        if ((status = data.readNullableStrongBinder(&unusedCallback)) != OK)
-            return status;
-        if ((status = data.readNullableStrongBinder(&resultReceiver)) != OK)
-            return status;
-        status = shellCommand(in, out, err, args);
-        if (resultReceiver != nullptr)
-            resultReceiver->send(status);
-        return OK;
-    }
+#include <android-base/file.h>
+#include <binder/IPCThreadState.h>
+#include <binder/PermissionCache.h>
+#include <hardware/gralloc.h>
+#include <private/android_filesystem_config.h>
+#include <ui/GraphicBufferAllocator.h>
+#include <vkjson.h>
 
-    default:
-        return BBinder::onTransact(code, data, reply, flags);
-    }
-}
+namespace android {
 
 // ----------------------------------------------------------------------------
 
 namespace {
     status_t cmd_help(int out);
     status_t cmd_vkjson(int out, int err);
+
+    std::string processName(pid_t pid);
+    bool processAlive(pid_t pid);
+    String8 usageNames(uint64_t usage);
 }
 
 const char* const GpuService::SERVICE_NAME = "gpu";
@@ -93,6 +67,107 @@ status_t GpuService::shellCommand(int /*in*/, int out, int err,
     return BAD_VALUE;
 }
 
+void GpuService::setGpuStats(pid_t pid, const GpuStats& stats) {
+    if (pid <= 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mProcessStats.find(pid);
+    if (it == mProcessStats.end()) {
+        if (mProcessStats.size() >= MAX_PROCESSES) {
+            // Forget a process that is gone, or else the one that reported
+            // the longest time ago.
+            auto victim = mProcessStats.begin();
+            for (auto i = mProcessStats.begin(); i != mProcessStats.end(); ++i) {
+                if (!processAlive(i->first)) {
+                    victim = i;
+                    break;
+                }
+                if (i->second.updateTime < victim->second.updateTime)
+                    victim = i;
+            }
+            mProcessStats.erase(victim);
+        }
+        it = mProcessStats.emplace(pid, ProcessStats{processName(pid), {}, 0}).first;
+    }
+    it->second.stats = stats;
+    it->second.updateTime = systemTime();
+}
+
+status_t GpuService::dump(int fd, const Vector<String16>& /*args*/) {
+    String8 result;
+
+    IPCThreadState* ipc = IPCThreadState::self();
+    const int pid = ipc->getCallingPid();
+    const int uid = ipc->getCallingUid();
+
+    if ((uid != AID_SHELL) &&
+            !PermissionCache::checkPermission(String16("android.permission.DUMP"), pid, uid)) {
+        result.appendFormat("Permission Denial: "
+                "can't dump GpuService from pid=%d, uid=%d\n", pid, uid);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            dumpProcessStats(result);
+        }
+        result.append("\n");
+        dumpGraphicBufferUsage(result);
+    }
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
+void GpuService::dumpProcessStats(String8& result) {
+    std::vector<std::pair<pid_t, const ProcessStats*>> processes;
+    for (const auto& entry : mProcessStats)
+        processes.emplace_back(entry.first, &entry.second);
+
+    // The processes that spent the most time setting up the GPU first.
+    auto setupNs = [](const GpuStats& s) {
+        return s.shaderCompileNs + s.programLinkNs + s.driverLoadNs;
+    };
+    std::sort(processes.begin(), processes.end(), [&](const auto& a, const auto& b) {
+        return setupNs(a.second->stats) > setupNs(b.second->stats);
+    });
+
+    const nsecs_t now = systemTime();
+    result.appendFormat("GPU stats of %zu processes:\n", processes.size());
+    for (const auto& process : processes) {
+        const GpuStats& s = process.second->stats;
+        const uint64_t lookups = s.blobCacheHits + s.blobCacheMisses;
+        result.appendFormat("  pid=%d name=%s alive=%d age=%" PRId64 "s\n",
+                process.first, process.second->name.c_str(), processAlive(process.first),
+                ns2s(now - process.second->updateTime));
+        result.appendFormat("    driverLoadMs=%.3f compiles=%" PRIu64 " compileMs=%.3f"
+                " links=%" PRIu64 " linkMs=%.3f\n",
+                s.driverLoadNs / 1e6, s.shaderCompiles, s.shaderCompileNs / 1e6,
+                s.programLinks, s.programLinkNs / 1e6);
+        result.appendFormat("    blobCacheHits=%" PRIu64 " blobCacheMisses=%" PRIu64
+                " blobCacheHitRate=%.1f%% blobCacheSystemHits=%" PRIu64
+                " blobCacheEvictions=%" PRIu64 " blobCacheKiB=%" PRIu64 "\n",
+                s.blobCacheHits, s.blobCacheMisses,
+                lookups ? 100.0 * s.blobCacheHits / lookups : 0.0,
+                s.blobCacheSystemHits, s.blobCacheEvictions, s.blobCacheTotalSize / 1024);
+    }
+}
+
+void GpuService::dumpGraphicBufferUsage(String8& result) {
+    // The buffers allocated in this process, which covers the composer's and
+    // the framebuffer's targets and the buffers of the layers queued to it.
+    std::vector<GraphicBufferAllocator::usage_total_t> totals =
+            GraphicBufferAllocator::get().getUsageTotals();
+    size_t totalSize = 0;
+    for (const auto& total : totals)
+        totalSize += total.size;
+
+    result.appendFormat("GraphicBuffer memory by usage: %.2f KiB\n", totalSize / 1024.0);
+    for (const auto& total : totals) {
+        result.appendFormat("  usage=0x%08" PRIx64 " count=%zu KiB=%.2f %s\n",
+                total.usage, total.count, total.size / 1024.0,
+                usageNames(total.usage).string());
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 namespace {
@@ -111,6 +186,56 @@ status_t cmd_help(int out) {
     return NO_ERROR;
 }
 
+std::string processName(pid_t pid) {
+    std::string cmdline;
+    if (!base::ReadFileToString(String8::format("/proc/%d/cmdline", pid).string(),
+            &cmdline)) {
+        return "<unknown>";
+    }
+    // The arguments are separated by NULs, keep the first.
+    cmdline.resize(strlen(cmdline.c_str()));
+    return cmdline.empty() ? "<unknown>" : cmdline;
+}
+
+bool processAlive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+String8 usageNames(uint64_t usage) {
+    static const struct {
+        uint64_t bit;
+        const char* name;
+    } kUsages[] = {
+        { GRALLOC_USAGE_HW_TEXTURE, "GPU_TEXTURE" },
+        { GRALLOC_USAGE_HW_RENDER, "GPU_RENDER_TARGET" },
+        { GRALLOC_USAGE_HW_2D, "2D" },
+        { GRALLOC_USAGE_HW_COMPOSER, "COMPOSER_OVERLAY" },
+        { GRALLOC_USAGE_HW_FB, "FRAMEBUFFER" },
+        { GRALLOC_USAGE_EXTERNAL_DISP, "EXTERNAL_DISP" },
+        { GRALLOC_USAGE_PROTECTED, "PROTECTED" },
+        { GRALLOC_USAGE_CURSOR, "CURSOR" },
+        { GRALLOC_USAGE_HW_VIDEO_ENCODER, "VIDEO_ENCODER" },
+        { GRALLOC_USAGE_HW_CAMERA_WRITE, "CAMERA_WRITE" },
+        { GRALLOC_USAGE_HW_CAMERA_READ, "CAMERA_READ" },
+        { GRALLOC_USAGE_RENDERSCRIPT, "RENDERSCRIPT" },
+    };
+
+    String8 names;
+    if (usage & GRALLOC_USAGE_SW_READ_MASK)
+        names.append("CPU_READ|");
+    if (usage & GRALLOC_USAGE_SW_WRITE_MASK)
+        names.append("CPU_WRITE|");
+    for (const auto& u : kUsages) {
+        if ((usage & u.bit) == u.bit) {
+            names.append(u.name);
+            names.append("|");
+        }
+    }
+    if (!names.isEmpty())
+        names.setTo(names.string(), names.size() - 1);
+    return names;
+}
+
 void vkjsonPrint(FILE* out) {
     std::string json = VkJsonInstanceToJson(VkJsonGetInstance());
     fwrite(json.data(), 1, json.size(), out);
@@ -17,28 +17,19 @@
 #ifndef ANDROID_GPUSERVICE_H
 #define ANDROID_GPUSERVICE_H
 
-#include <binder/IInterface.h>
-#include <cutils/compiler.h>
+#include <sys/types.h>
 
-namespace android {
+#include <map>
+#include <mutex>
+#include <string>
 
-/*
- * This class defines the Binder IPC interface for GPU-related queries and
- * control.
- */
-class IGpuService : public IInterface {
-public:
-    DECLARE_META_INTERFACE(GpuService);
-};
-
-class BnGpuService: public BnInterface<IGpuService> {
-protected:
-    virtual status_t shellCommand(int in, int out, int err,
-        Vector<String16>& args) = 0;
+#include <android-base/thread_annotations.h>
+#include <cutils/compiler.h>
+#include <graphicsenv/IGpuService.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 
-    virtual status_t onTransact(uint32_t code, const Parcel& data,
-            Parcel* reply, uint32_t flags = 0) override;
-};
+namespace android {
 
 class GpuService : public BnGpuService
 {
@@ -47,9 +38,32 @@ public:
 
     GpuService() ANDROID_API;
 
+    virtual void setGpuStats(pid_t pid, const GpuStats& stats) override;
+
 protected:
     virtual status_t shellCommand(int in, int out, int err,
         Vector<String16>& args) override;
+
+    // dumpsys gpu: the GPU stats of the processes, the costliest GPU setup
+    // first, and the GraphicBuffer memory by usage.
+    virtual status_t dump(int fd, const Vector<String16>& args) override;
+
+private:
+    // Processes that stopped reporting are forgotten, the oldest report
+    // first, past this number of processes.
+    static constexpr size_t MAX_PROCESSES = 64;
+
+    struct ProcessStats {
+        std::string name;
+        GpuStats stats;
+        nsecs_t updateTime;
+    };
+
+    void dumpProcessStats(String8& result) REQUIRES(mLock);
+    void dumpGraphicBufferUsage(String8& result);
+
+    std::mutex mLock;
+    std::map<pid_t, ProcessStats> mProcessStats GUARDED_BY(mLock);
 };
 
 } // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ImageCache.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <ui/PixelFormat.h>
+#include <utils/Trace.h>
+
+#include "RenderEngine/RenderEngine.h"
+
+namespace android {
+
+ImageCache::ImageCache(size_t maxBytes) : mMaxBytes(maxBytes) {}
+
+size_t ImageCache::getBufferSize(const sp<GraphicBuffer>& buffer) {
+    // Formats without a fixed pixel size are YUV formats, except for blobs,
+    // whose width is their size in bytes.
+    size_t bytesPerPixel = android::bytesPerPixel(buffer->getPixelFormat());
+    if (bytesPerPixel == 0) {
+        bytesPerPixel = buffer->getPixelFormat() == HAL_PIXEL_FORMAT_BLOB ? 1 : 2;
+    }
+    const size_t stride = std::max(buffer->getStride(), buffer->getWidth());
+    const size_t layerCount = std::max(buffer->getLayerCount(), 1u);
+    return stride * buffer->getHeight() * layerCount * bytesPerPixel;
+}
+
+std::shared_ptr<RE::Image> ImageCache::getImage(RE::RenderEngine& engine,
+                                                const sp<GraphicBuffer>& buffer,
+                                                int32_t cropWidth, int32_t cropHeight) {
+    const uint64_t id = buffer->getId();
+    {
+        Mutex::Autolock lock(mMutex);
+        auto entry = mEntries.find(id);
+        if (entry != mEntries.end() && entry->second.cropWidth == cropWidth &&
+            entry->second.cropHeight == cropHeight) {
+            mLru.splice(mLru.begin(), mLru, entry->second.lruPosition);
+            mHits++;
+            return entry->second.image;
+        }
+        mMisses++;
+    }
+
+    // Create the image outside of the lock, eglCreateImageKHR can be slow
+    ATRACE_NAME("ImageCache::createImage");
+    std::shared_ptr<RE::Image> image = engine.createImage();
+    if (!image->setNativeWindowBuffer(buffer->getNativeBuffer(),
+                                      buffer->getUsage() & GRALLOC_USAGE_PROTECTED, cropWidth,
+                                      cropHeight)) {
+        return nullptr;
+    }
+
+    const size_t bytes = getBufferSize(buffer);
+    if (bytes > mMaxBytes) {
+        return image;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    auto entry = mEntries.find(id);
+    if (entry != mEntries.end()) {
+        // Replaces the image of another crop size, or one created concurrently
+        mBytes -= entry->second.bytes;
+        mLru.erase(entry->second.lruPosition);
+        mEntries.erase(entry);
+    }
+    mLru.push_front(id);
+    mEntries.emplace(id, Entry{buffer, image, cropWidth, cropHeight, bytes, mLru.begin()});
+    mBytes += bytes;
+    evictLocked();
+    return image;
+}
+
+void ImageCache::evictLocked() {
+    while (mBytes > mMaxBytes && !mLru.empty()) {
+        auto entry = mEntries.find(mLru.back());
+        mBytes -= entry->second.bytes;
+        mEntries.erase(entry);
+        mLru.pop_back();
+        mEvictions++;
+    }
+}
+
+void ImageCache::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("  image cache: %zu images, %zu of %zu KiB; hits=%" PRIu64
+                        " misses=%" PRIu64 " evictions=%" PRIu64 "\n",
+                        mEntries.size(), mBytes / 1024, mMaxBytes / 1024, mHits, mMisses,
+                        mEvictions);
+}
+
+} // namespace android
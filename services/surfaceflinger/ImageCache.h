@@ -0,0 +1,86 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include <ui/GraphicBuffer.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+
+#include "RenderEngine/Image.h"
+
+namespace android {
+
+namespace RE {
+class RenderEngine;
+} // namespace RE
+
+/*
+ * RE::Images shared by all the layers, keyed by GraphicBuffer id. A buffer
+ * moving to another slot, or to another layer after a reconnect or a
+ * detach/attach, reuses its EGLImage instead of creating a new one.
+ *
+ * The cache keeps its buffers alive, so it drops the least recently used
+ * images once their buffers exceed maxBytes. Images still used by a layer
+ * stay valid after being dropped.
+ */
+class ImageCache {
+public:
+    explicit ImageCache(size_t maxBytes);
+
+    // Returns an image of buffer created with the given crop size, creating
+    // it with engine if there is none. Returns nullptr if the image can't be
+    // created. May be called from any thread.
+    std::shared_ptr<RE::Image> getImage(RE::RenderEngine& engine, const sp<GraphicBuffer>& buffer,
+                                        int32_t cropWidth, int32_t cropHeight);
+
+    void dump(String8& result) const;
+
+private:
+    struct Entry {
+        sp<GraphicBuffer> buffer;
+        std::shared_ptr<RE::Image> image;
+        int32_t cropWidth;
+        int32_t cropHeight;
+        size_t bytes;
+        // position in mLru
+        std::list<uint64_t>::iterator lruPosition;
+    };
+
+    // Estimates the memory of buffer
+    static size_t getBufferSize(const sp<GraphicBuffer>& buffer);
+
+    void evictLocked();
+
+    const size_t mMaxBytes;
+
+    mutable Mutex mMutex;
+    std::unordered_map<uint64_t, Entry> mEntries;
+    // buffer ids, the most recently used first
+    std::list<uint64_t> mLru;
+    size_t mBytes = 0;
+
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+    uint64_t mEvictions = 0;
+};
+
+} // namespace android
@@ -110,6 +110,7 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client, const String8& n
 
     mName = name;
     mTransactionName = String8("TX - ") + mName;
+    mTimeStatsTracker = mTimeStats.createLayerTracker(mName.string());
 
     mCurrentState.active.w = w;
     mCurrentState.active.h = h;
@@ -191,6 +192,9 @@ void Layer::onRemoved() {
     // the layer is removed from SF mLayersPendingRemoval
     abandon();
 
+    // nothing can be drawn or looked up by this name anymore, let a new layer have it
+    mFlinger->releaseLayerName(this);
+
     destroyAllHwcLayers();
 
     for (const auto& child : mCurrentChildren) {
@@ -296,6 +300,15 @@ static FloatRect reduce(const FloatRect& win, const Region& exclude) {
 
 Rect Layer::computeScreenBounds(bool reduceTransparentRegion) const {
     const Layer::State& s(getDrawingState());
+    const bool useCache = useGeometryCache();
+    if (useCache && mGeometryCache.hasScreenBounds) {
+        Rect win = mGeometryCache.screenBounds;
+        if (reduceTransparentRegion) {
+            win = reduce(win, getTransform().transform(s.activeTransparentRegion));
+        }
+        return win;
+    }
+
     Rect win(s.active.w, s.active.h);
 
     if (!s.crop.isEmpty()) {
@@ -324,6 +337,11 @@ Rect Layer::computeScreenBounds(bool reduceTransparentRegion) const {
         bounds.intersect(win, &win);
     }
 
+    if (useCache) {
+        mGeometryCache.screenBounds = win;
+        mGeometryCache.hasScreenBounds = true;
+    }
+
     if (reduceTransparentRegion) {
         auto const screenTransparentRegion = t.transform(s.activeTransparentRegion);
         win = reduce(win, screenTransparentRegion);
@@ -980,6 +998,8 @@ bool Layer::applyPendingStates(State* stateToCommit) {
 uint32_t Layer::doTransaction(uint32_t flags) {
     ATRACE_CALL();
 
+    mFlinger->invalidateLayerGeometry();
+
     pushPendingState();
     Layer::State c = getCurrentState();
     if (!applyPendingStates(&c)) {
@@ -1303,6 +1323,8 @@ bool Layer::setFinalCrop(const Rect& crop, bool immediate) {
 bool Layer::setOverrideScalingMode(int32_t scalingMode) {
     if (scalingMode == mOverrideScalingMode) return false;
     mOverrideScalingMode = scalingMode;
+    // isFixedSize() changes, and with it the transform of the children
+    mFlinger->invalidateLayerGeometry();
     setTransactionFlags(eTransactionNeeded);
     return true;
 }
@@ -1514,13 +1536,13 @@ void Layer::dumpFrameEvents(String8& result) {
 void Layer::onDisconnect() {
     Mutex::Autolock lock(mFrameEventHistoryMutex);
     mFrameEventHistory.onDisconnect();
-    mTimeStats.onDisconnect(getName().c_str());
+    mTimeStats.onDisconnect(mTimeStatsTracker.get());
 }
 
 void Layer::addAndGetFrameTimestamps(const NewFrameEventsEntry* newTimestamps,
                                      FrameEventHistoryDelta* outDelta) {
     if (newTimestamps) {
-        mTimeStats.setPostTime(getName().c_str(), newTimestamps->frameNumber,
+        mTimeStats.setPostTime(mTimeStatsTracker.get(), newTimestamps->frameNumber,
                                newTimestamps->postedTime);
     }
 
@@ -1589,6 +1611,7 @@ void Layer::setChildrenDrawingParent(const sp<Layer>& newParent) {
     for (const sp<Layer>& child : mDrawingChildren) {
         child->mDrawingParent = newParent;
     }
+    mFlinger->invalidateLayerGeometry();
 }
 
 bool Layer::reparent(const sp<IBinder>& newParentHandle) {
@@ -1842,7 +1865,24 @@ void Layer::traverseChildrenInZOrder(LayerVector::StateSet stateSet,
     traverseChildrenInZOrderInner(layersInTree, stateSet, visitor);
 }
 
+bool Layer::useGeometryCache() const {
+    if (std::this_thread::get_id() != mFlinger->mMainThreadId) {
+        return false;
+    }
+    const uint64_t generation = mFlinger->mGeometryGeneration.load(std::memory_order_relaxed);
+    if (mGeometryCache.generation != generation) {
+        mGeometryCache = GeometryCache();
+        mGeometryCache.generation = generation;
+    }
+    return true;
+}
+
 Transform Layer::getTransform() const {
+    const bool useCache = useGeometryCache();
+    if (useCache && mGeometryCache.hasTransform) {
+        return mGeometryCache.transform;
+    }
+
     Transform t;
     const auto& p = mDrawingParent.promote();
     if (p != nullptr) {
@@ -1870,14 +1910,33 @@ Transform Layer::getTransform() const {
             t = t * extraParentScaling;
         }
     }
-    return t * getDrawingState().active.transform;
+    t = t * getDrawingState().active.transform;
+
+    if (useCache) {
+        // classify the transform once, rather than in every copy handed out
+        t.getType();
+        mGeometryCache.transform = t;
+        mGeometryCache.hasTransform = true;
+    }
+    return t;
 }
 
 half Layer::getAlpha() const {
+    const bool useCache = useGeometryCache();
+    if (useCache && mGeometryCache.hasAlpha) {
+        return mGeometryCache.alpha;
+    }
+
     const auto& p = mDrawingParent.promote();
 
     half parentAlpha = (p != nullptr) ? p->getAlpha() : 1.0_hf;
-    return parentAlpha * getDrawingState().color.a;
+    const half alpha = parentAlpha * getDrawingState().color.a;
+
+    if (useCache) {
+        mGeometryCache.alpha = alpha;
+        mGeometryCache.hasAlpha = true;
+    }
+    return alpha;
 }
 
 half4 Layer::getColor() const {
@@ -151,6 +151,26 @@ public:
     Region visibleNonTransparentRegion;
     Region surfaceDamageRegion;
 
+    // Inputs and results of the last computeVisibleRegions() pass that
+    // computed this layer. SurfaceFlinger uses it to skip layers that sit
+    // above every geometry change in the layer stack.
+    struct VisibilityCache {
+        bool valid = false;
+        uint32_t generation = 0;
+        const DisplayDevice* display = nullptr;
+        const Layer* layerAbove = nullptr;
+        bool visible = false;
+        bool translucent = false;
+        bool opaqueAlpha = false;
+        Rect bounds;
+        Transform transform;
+        Region transparentRegion;
+        // aboveOpaqueLayers and aboveCoveredLayers including this layer
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+    };
+    VisibilityCache visibilityCache;
+
     // Layer serial number.  This gives layers an explicit ordering, so we
     // have a stable sort order when their layer stack and Z-order are
     // the same.
@@ -471,6 +491,13 @@ public:
         return {};
     }
 
+    /*
+     * prepareLatch - optionally called before latchBuffer, possibly on a
+     * worker thread and concurrently with the other layers, to do the part of
+     * the latch that neither needs RenderEngine nor touches other layers.
+     */
+    virtual void prepareLatch() {}
+
     virtual bool isBufferLatched() const { return false; }
 
     bool isPotentialCursor() const { return mPotentialCursor; }
@@ -701,6 +728,7 @@ public:
 
     sp<IBinder> getHandle();
     const String8& getName() const;
+    TimeStats::LayerTracker* getTimeStatsTracker() const { return mTimeStatsTracker.get(); }
     virtual void notifyAvailableFrames() {}
     virtual PixelFormat getPixelFormat() const { return PIXEL_FORMAT_NONE; }
     bool getPremultipledAlpha() const;
@@ -739,6 +767,7 @@ protected:
     FenceTimeline mReleaseTimeline;
 
     TimeStats& mTimeStats = TimeStats::getInstance();
+    std::shared_ptr<TimeStats::LayerTracker> mTimeStatsTracker;
 
     // main thread
     int mActiveBufferSlot;
@@ -803,6 +832,24 @@ private:
                                        const LayerVector::Visitor& visitor);
     LayerVector makeChildrenTraversalList(LayerVector::StateSet stateSet,
                                           const std::vector<Layer*>& layersInTree);
+
+    // Returns true if the geometry cache may be used, after resetting it if the geometry
+    // generation of SurfaceFlinger changed. Only the main thread uses the cache.
+    bool useGeometryCache() const;
+
+    // Geometry computed from the drawing state of this layer and its ancestors, valid for as
+    // long as SurfaceFlinger::mGeometryGeneration does not change.
+    struct GeometryCache {
+        uint64_t generation = 0;
+        bool hasTransform = false;
+        bool hasAlpha = false;
+        bool hasScreenBounds = false;
+        Transform transform;
+        half alpha;
+        // Without the transparent region reduction, which changes with every buffer.
+        Rect screenBounds;
+    };
+    mutable GeometryCache mGeometryCache;
 };
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LayerNameIndex"
+
+#include "LayerNameIndex.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include <log/log.h>
+
+namespace android {
+
+String8 LayerNameIndex::acquire(const String8& name) {
+    Mutex::Autolock lock(mMutex);
+    Slots& slots = mNames[std::string(name.string(), name.size())];
+
+    const size_t counter = slots.firstFree;
+    if (counter == slots.slots.size()) {
+        slots.slots.push_back({false, nullptr});
+    }
+    slots.slots[counter] = {true, nullptr};
+    slots.usedCount++;
+    mUsedCount++;
+    while (slots.firstFree < slots.slots.size() && slots.slots[slots.firstFree].used) {
+        slots.firstFree++;
+    }
+
+    // Tack on our counter whether there is a hit or not, so everyone gets a tag
+    String8 uniqueName = name + "#" + String8(std::to_string(counter).c_str());
+    if (counter > 0) {
+        mDuplicateCount++;
+        ALOGD("duplicate layer name: changing %s to %s", name.c_str(), uniqueName.c_str());
+    }
+    return uniqueName;
+}
+
+bool LayerNameIndex::parse(const String8& uniqueName, std::string* name, size_t* counter) {
+    const std::string str(uniqueName.string(), uniqueName.size());
+    const size_t hash = str.rfind('#');
+    if (hash == std::string::npos || hash + 1 == str.size()) {
+        return false;
+    }
+    char* end;
+    const unsigned long long value = strtoull(str.c_str() + hash + 1, &end, 10);
+    if (*end != '\0' || str[hash + 1] < '0' || str[hash + 1] > '9') {
+        return false;
+    }
+    *name = str.substr(0, hash);
+    *counter = value;
+    return true;
+}
+
+LayerNameIndex::Slot* LayerNameIndex::findLocked(const String8& uniqueName, Slots** outSlots,
+                                                 std::string* outName) {
+    size_t counter;
+    if (!parse(uniqueName, outName, &counter)) {
+        return nullptr;
+    }
+    auto it = mNames.find(*outName);
+    if (it == mNames.end() || counter >= it->second.slots.size() ||
+        !it->second.slots[counter].used) {
+        return nullptr;
+    }
+    *outSlots = &it->second;
+    return &it->second.slots[counter];
+}
+
+void LayerNameIndex::bind(const String8& uniqueName, const void* layer) {
+    Mutex::Autolock lock(mMutex);
+    Slots* slots;
+    std::string name;
+    Slot* slot = findLocked(uniqueName, &slots, &name);
+    if (slot != nullptr && slot->layer == nullptr) {
+        slot->layer = layer;
+    }
+}
+
+void LayerNameIndex::release(const String8& uniqueName, const void* layer) {
+    Mutex::Autolock lock(mMutex);
+    Slots* slots;
+    std::string name;
+    Slot* slot = findLocked(uniqueName, &slots, &name);
+    if (slot == nullptr || slot->layer != layer) {
+        return;
+    }
+
+    *slot = {false, nullptr};
+    slots->firstFree = std::min<size_t>(slots->firstFree, slot - slots->slots.data());
+    slots->usedCount--;
+    mUsedCount--;
+    if (slots->usedCount == 0) {
+        mNames.erase(name);
+        return;
+    }
+    while (!slots->slots.empty() && !slots->slots.back().used) {
+        slots->slots.pop_back();
+    }
+}
+
+void LayerNameIndex::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("Layer names: %zu held under %zu names, %" PRIu64 " duplicates renamed\n",
+                        mUsedCount, mNames.size(), mDuplicateCount);
+}
+
+} // namespace android
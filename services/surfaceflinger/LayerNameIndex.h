@@ -0,0 +1,77 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+
+namespace android {
+
+/*
+ * The unique names of the layers, "<name>#<n>" with the lowest n no other
+ * layer holds. A name is held from the creation of its layer until the layer
+ * is removed, so picking one takes a lookup of the base name rather than
+ * scans of the layer tree.
+ *
+ * May be called from any thread.
+ */
+class LayerNameIndex {
+public:
+    // Picks the unique name of a new layer named name. The name is reserved
+    // until the layer created with it is bound to it, or it is released.
+    String8 acquire(const String8& name);
+
+    // Makes layer the holder of a name acquired for it.
+    void bind(const String8& uniqueName, const void* layer);
+
+    // Frees uniqueName if it is held by layer, or still reserved if layer is
+    // nullptr. A layer that no longer holds its name can't free it for the
+    // one that got it since.
+    void release(const String8& uniqueName, const void* layer);
+
+    void dump(String8& result) const;
+
+private:
+    struct Slot {
+        bool used;
+        const void* layer;
+    };
+
+    struct Slots {
+        // indexed by the counter of the name
+        std::vector<Slot> slots;
+        size_t firstFree = 0;
+        size_t usedCount = 0;
+    };
+
+    // Splits uniqueName into the name it was acquired for and its counter
+    static bool parse(const String8& uniqueName, std::string* name, size_t* counter);
+
+    Slot* findLocked(const String8& uniqueName, Slots** outSlots, std::string* outName);
+
+    mutable Mutex mMutex;
+    std::unordered_map<std::string, Slots> mNames;
+    size_t mUsedCount = 0;
+    uint64_t mDuplicateCount = 0;
+};
+
+} // namespace android
@@ -15,9 +15,12 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <algorithm>
+
 #include <binder/IPCThreadState.h>
 
 #include <utils/Log.h>
@@ -33,6 +36,12 @@
 
 namespace android {
 
+// How long a background message may wait for a frame to be composed
+static const nsecs_t kMaxBackgroundDelay = ms2ns(100);
+
+// A frame message that waits longer than this in the looper was held up by other messages
+static const nsecs_t kFrameDelayThreshold = us2ns(500);
+
 // ---------------------------------------------------------------------------
 
 MessageBase::MessageBase() : MessageHandler() {}
@@ -54,25 +63,40 @@ namespace impl {
 
 void MessageQueue::Handler::dispatchRefresh() {
     if ((android_atomic_or(eventMaskRefresh, &mEventMask) & eventMaskRefresh) == 0) {
+        mRefreshSendTime = systemTime(SYSTEM_TIME_MONOTONIC);
         mQueue.mLooper->sendMessage(this, Message(MessageQueue::REFRESH));
     }
 }
 
 void MessageQueue::Handler::dispatchInvalidate() {
     if ((android_atomic_or(eventMaskInvalidate, &mEventMask) & eventMaskInvalidate) == 0) {
+        mInvalidateSendTime = systemTime(SYSTEM_TIME_MONOTONIC);
         mQueue.mLooper->sendMessage(this, Message(MessageQueue::INVALIDATE));
     }
 }
 
+void MessageQueue::Handler::dispatchBackgroundDeadline(nsecs_t relTime) {
+    mQueue.mLooper->sendMessageDelayed(relTime, this, Message(BACKGROUND_DEADLINE));
+}
+
 void MessageQueue::Handler::handleMessage(const Message& message) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     switch (message.what) {
         case INVALIDATE:
             android_atomic_and(~eventMaskInvalidate, &mEventMask);
+            mQueue.recordFrameDelay(now - mInvalidateSendTime, true);
             mQueue.mFlinger->onMessageReceived(message.what);
             break;
         case REFRESH:
             android_atomic_and(~eventMaskRefresh, &mEventMask);
+            mQueue.recordFrameDelay(now - mRefreshSendTime, false);
             mQueue.mFlinger->onMessageReceived(message.what);
+            // The frame has been composed, which leaves the rest of the vsync period for
+            // the work that was kept out of its way.
+            mQueue.runBackgroundMessages(false);
+            break;
+        case BACKGROUND_DEADLINE:
+            mQueue.runBackgroundMessages(true);
             break;
     }
 }
@@ -123,7 +147,20 @@ void MessageQueue::waitMessage() {
     } while (true);
 }
 
-status_t MessageQueue::postMessage(const sp<MessageBase>& messageHandler, nsecs_t relTime) {
+status_t MessageQueue::postMessage(const sp<MessageBase>& messageHandler, nsecs_t relTime,
+                                   uint32_t flags) {
+    if (flags & BACKGROUND) {
+        relTime = std::max(relTime, nsecs_t(0));
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        {
+            std::lock_guard<std::mutex> lock(mBackgroundLock);
+            mBackgroundMessages.push_back(
+                    {messageHandler, now + relTime, now + relTime + kMaxBackgroundDelay});
+        }
+        mHandler->dispatchBackgroundDeadline(relTime + kMaxBackgroundDelay);
+        return NO_ERROR;
+    }
+
     const Message dummyMessage;
     if (relTime > 0) {
         mLooper->sendMessageDelayed(relTime, messageHandler, dummyMessage);
@@ -133,6 +170,56 @@ status_t MessageQueue::postMessage(const sp<MessageBase>& messageHandler, nsecs_
     return NO_ERROR;
 }
 
+void MessageQueue::runBackgroundMessages(bool overdueOnly) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    std::vector<sp<MessageBase>> messages;
+    {
+        std::lock_guard<std::mutex> lock(mBackgroundLock);
+        auto it = mBackgroundMessages.begin();
+        while (it != mBackgroundMessages.end()) {
+            if (overdueOnly ? it->deadline <= now : it->readyTime <= now) {
+                messages.push_back(std::move(it->message));
+                it = mBackgroundMessages.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Messages may post more messages, so they run without the lock held.
+    const Message dummyMessage;
+    for (const sp<MessageBase>& message : messages) {
+        message->handleMessage(dummyMessage);
+    }
+}
+
+void MessageQueue::recordFrameDelay(nsecs_t delay, bool frameStart) {
+    if (frameStart) {
+        mFrameCount++;
+        mCurrentFrameDelayed = false;
+    }
+    if (delay > mMaxFrameDelay) {
+        mMaxFrameDelay = delay;
+    }
+    if (delay > kFrameDelayThreshold && !mCurrentFrameDelayed) {
+        mCurrentFrameDelayed = true;
+        mDelayedFrameCount++;
+    }
+}
+
+void MessageQueue::dump(String8& result) const {
+    size_t pendingBackgroundMessages;
+    {
+        std::lock_guard<std::mutex> lock(mBackgroundLock);
+        pendingBackgroundMessages = mBackgroundMessages.size();
+    }
+    result.appendFormat("MessageQueue: %" PRIu64 " of %" PRIu64
+                        " frames delayed by other messages (longest wait %.3f ms), "
+                        "%zu background messages pending\n",
+                        mDelayedFrameCount.load(), mFrameCount.load(),
+                        mMaxFrameDelay.load() / 1e6, pendingBackgroundMessages);
+}
+
 void MessageQueue::invalidate() {
     mEvents->requestNextVsync();
 }
@@ -22,6 +22,7 @@
 #include <sys/types.h>
 
 #include <utils/Looper.h>
+#include <utils/String8.h>
 #include <utils/Timers.h>
 #include <utils/threads.h>
 
@@ -30,7 +31,10 @@
 
 #include "Barrier.h"
 
+#include <atomic>
 #include <functional>
+#include <mutex>
+#include <vector>
 
 namespace android {
 
@@ -82,14 +86,23 @@ public:
         REFRESH = 1,
     };
 
+    // Flags for postMessage()
+    enum : uint32_t {
+        // The message is not urgent: it runs in the idle time after the frame in progress
+        // has been composed, or once it is overdue if no frame is composed by then.
+        BACKGROUND = 0x1,
+    };
+
     virtual ~MessageQueue();
 
     virtual void init(const sp<SurfaceFlinger>& flinger) = 0;
     virtual void setEventThread(EventThread* events) = 0;
     virtual void waitMessage() = 0;
-    virtual status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime = 0) = 0;
+    virtual status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime = 0,
+                                 uint32_t flags = 0) = 0;
     virtual void invalidate() = 0;
     virtual void refresh() = 0;
+    virtual void dump(String8& result) const = 0;
 };
 
 // ---------------------------------------------------------------------------
@@ -99,14 +112,26 @@ namespace impl {
 class MessageQueue final : public android::MessageQueue {
     class Handler : public MessageHandler {
         enum { eventMaskInvalidate = 0x1, eventMaskRefresh = 0x2, eventMaskTransaction = 0x4 };
+        // Sent when the oldest background message is overdue
+        enum { BACKGROUND_DEADLINE = 2 };
         MessageQueue& mQueue;
         int32_t mEventMask;
+        // When the pending INVALIDATE and REFRESH were sent to the looper
+        std::atomic<nsecs_t> mInvalidateSendTime{0};
+        std::atomic<nsecs_t> mRefreshSendTime{0};
 
     public:
         explicit Handler(MessageQueue& queue) : mQueue(queue), mEventMask(0) {}
         virtual void handleMessage(const Message& message);
         void dispatchRefresh();
         void dispatchInvalidate();
+        void dispatchBackgroundDeadline(nsecs_t relTime);
+    };
+
+    struct BackgroundMessage {
+        sp<MessageBase> message;
+        nsecs_t readyTime; // not run before this time
+        nsecs_t deadline;  // run at this time even if no frame was composed
     };
 
     friend class Handler;
@@ -118,21 +143,38 @@ class MessageQueue final : public android::MessageQueue {
     gui::BitTube mEventTube;
     sp<Handler> mHandler;
 
+    mutable std::mutex mBackgroundLock;
+    std::vector<BackgroundMessage> mBackgroundMessages; // guarded by mBackgroundLock
+
+    // Frames whose INVALIDATE or REFRESH waited behind other messages, main thread only
+    // for writing
+    std::atomic<uint64_t> mFrameCount{0};
+    std::atomic<uint64_t> mDelayedFrameCount{0};
+    std::atomic<nsecs_t> mMaxFrameDelay{0};
+    bool mCurrentFrameDelayed = false;
+
     static int cb_eventReceiver(int fd, int events, void* data);
     int eventReceiver(int fd, int events);
 
+    // Runs the background messages that are ready, or only the overdue ones
+    void runBackgroundMessages(bool overdueOnly);
+    void recordFrameDelay(nsecs_t delay, bool frameStart);
+
 public:
     ~MessageQueue() override = default;
     void init(const sp<SurfaceFlinger>& flinger) override;
     void setEventThread(android::EventThread* events) override;
 
     void waitMessage() override;
-    status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime = 0) override;
+    status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime = 0,
+                         uint32_t flags = 0) override;
 
     // sends INVALIDATE message at next VSYNC
     void invalidate() override;
     // sends REFRESH message at next VSYNC
     void refresh() override;
+
+    void dump(String8& result) const override;
 };
 
 // ---------------------------------------------------------------------------
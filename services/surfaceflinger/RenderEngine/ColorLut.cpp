@@ -0,0 +1,258 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ColorLut.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+namespace android {
+
+using TransferFunction = Description::TransferFunction;
+
+// The functions below follow the shader code of ProgramCache, see
+// generateEOTF(), generateToneMappingProcess() and generateOETF(), so that
+// the LUT matches the regular shaders.
+
+static float eotfHlg(float channel) {
+    const float a = 0.17883277f;
+    const float b = 0.28466892f;
+    const float c = 0.55991073f;
+    return channel <= 0.5f ? channel * channel / 3.0f : (expf((channel - c) / a) + b) / 12.0f;
+}
+
+static float eotfSt2084(float channel) {
+    const float m1 = (2610.0f / 4096.0f) / 4.0f;
+    const float m2 = (2523.0f / 4096.0f) * 128.0f;
+    const float c1 = (3424.0f / 4096.0f);
+    const float c2 = (2413.0f / 4096.0f) * 32.0f;
+    const float c3 = (2392.0f / 4096.0f) * 32.0f;
+
+    float tmp = powf(channel, 1.0f / m2);
+    tmp = std::max(tmp - c1, 0.0f) / (c2 - c3 * tmp);
+    return powf(tmp, 1.0f / m1);
+}
+
+static float oetfSrgb(float linear) {
+    return linear <= 0.0031308f ? linear * 12.92f : (powf(linear, 1.0f / 2.4f) * 1.055f) - 0.055f;
+}
+
+static vec3 eotf(TransferFunction transferFunction, const vec3& color) {
+    float (*channelEotf)(float) = transferFunction == TransferFunction::HLG ? eotfHlg : eotfSt2084;
+    return vec3(channelEotf(color.r), channelEotf(color.g), channelEotf(color.b));
+}
+
+// Converts relative light to absolute light
+static vec3 scaleLuminance(TransferFunction transferFunction, const vec3& color) {
+    if (transferFunction == TransferFunction::HLG) {
+        return color * 1000.0f * powf(std::max(color.y, 0.0f), 0.2f);
+    }
+    return color * 10000.0f;
+}
+
+// Tone maps absolute light to the display luminance range
+static vec3 toneMap(const vec3& color, float maxOutLumi) {
+    const float maxMasteringLumi = 1000.0f;
+    const float maxContentLumi = 1000.0f;
+    const float maxInLumi = std::min(maxMasteringLumi, maxContentLumi);
+
+    float nits = color.y;
+
+    // clamp to max input luminance
+    nits = std::min(std::max(nits, 0.0f), maxInLumi);
+
+    // scale [0.0, maxInLumi] to [0.0, maxOutLumi]
+    if (maxInLumi <= maxOutLumi) {
+        nits *= maxOutLumi / maxInLumi;
+    } else {
+        // three control points
+        const float x0 = 10.0f;
+        const float y0 = 17.0f;
+        float x1 = maxOutLumi * 0.75f;
+        float y1 = x1;
+        float x2 = x1 + (maxInLumi - x1) / 2.0f;
+        float y2 = y1 + (maxOutLumi - y1) * 0.75f;
+
+        // horizontal distances between the last three control points
+        float h12 = x2 - x1;
+        float h23 = maxInLumi - x2;
+        // tangents at the last three control points
+        float m1 = (y2 - y1) / h12;
+        float m3 = (maxOutLumi - y2) / h23;
+        float m2 = (m1 + m3) / 2.0f;
+
+        if (nits < x0) {
+            // scale [0.0, x0] to [0.0, y0] linearly
+            float slope = y0 / x0;
+            nits *= slope;
+        } else if (nits < x1) {
+            // scale [x0, x1] to [y0, y1] linearly
+            float slope = (y1 - y0) / (x1 - x0);
+            nits = y0 + (nits - x0) * slope;
+        } else if (nits < x2) {
+            // scale [x1, x2] to [y1, y2] using Hermite interp
+            float t = (nits - x1) / h12;
+            nits = (y1 * (1.0f + 2.0f * t) + h12 * m1 * t) * (1.0f - t) * (1.0f - t) +
+                    (y2 * (3.0f - 2.0f * t) + h12 * m2 * (t - 1.0f)) * t * t;
+        } else {
+            // scale [x2, maxInLumi] to [y2, maxOutLumi] using Hermite interp
+            float t = (nits - x2) / h23;
+            nits = (y2 * (1.0f + 2.0f * t) + h23 * m2 * t) * (1.0f - t) * (1.0f - t) +
+                    (maxOutLumi * (3.0f - 2.0f * t) + h23 * m3 * (t - 1.0f)) * t * t;
+        }
+    }
+
+    return color * (nits / std::max(1e-6f, color.y));
+}
+
+static vec3 clamp01(const vec3& color) {
+    return vec3(std::min(std::max(color.r, 0.0f), 1.0f), std::min(std::max(color.g, 0.0f), 1.0f),
+                std::min(std::max(color.b, 0.0f), 1.0f));
+}
+
+bool ColorLut::Params::operator==(const Params& other) const {
+    return inputTransferFunction == other.inputTransferFunction &&
+            inputTransformMatrix == other.inputTransformMatrix &&
+            outputTransformMatrix == other.outputTransformMatrix &&
+            displayMaxLuminance == other.displayMaxLuminance;
+}
+
+bool ColorLut::isSupported(const Description& description) {
+    return (description.mInputTransferFunction == TransferFunction::ST2084 ||
+            description.mInputTransferFunction == TransferFunction::HLG) &&
+            description.mOutputTransferFunction == TransferFunction::SRGB;
+}
+
+ColorLut::Params ColorLut::getParams(const Description& description) {
+    // Program::setUniforms() merges the saturation matrix with the input
+    // transform matrix when there is one, with the output one otherwise.
+    const bool hasInputTransformMatrix = description.hasInputTransformMatrix();
+    Params params;
+    params.inputTransferFunction = description.mInputTransferFunction;
+    params.inputTransformMatrix = hasInputTransformMatrix
+            ? mat4(description.mInputTransformMatrix) * description.mSaturationMatrix
+            : mat4();
+    params.outputTransformMatrix = description.mColorMatrix * description.mOutputTransformMatrix;
+    if (!hasInputTransformMatrix) {
+        params.outputTransformMatrix *= description.mSaturationMatrix;
+    }
+    params.displayMaxLuminance = description.mDisplayMaxLuminance;
+    return params;
+}
+
+vec3 ColorLut::convert(const Params& params, const vec3& signal) {
+    vec3 color = eotf(params.inputTransferFunction, signal);
+    color = (params.inputTransformMatrix * vec4(color, 1.0f)).xyz;
+    color = toneMap(scaleLuminance(params.inputTransferFunction, color),
+                    params.displayMaxLuminance) /
+            params.displayMaxLuminance;
+    color = clamp01((params.outputTransformMatrix * vec4(color, 1.0f)).xyz);
+    return vec3(oetfSrgb(color.r), oetfSrgb(color.g), oetfSrgb(color.b));
+}
+
+void ColorLut::generate(const Params& params, std::vector<uint8_t>* outTexels) {
+    outTexels->resize(SIZE * SIZE * SIZE * 4);
+    uint8_t* texel = outTexels->data();
+    for (uint32_t g = 0; g < SIZE; g++) {
+        for (uint32_t b = 0; b < SIZE; b++) {
+            for (uint32_t r = 0; r < SIZE; r++) {
+                const vec3 color = convert(params, vec3(r, g, b) / float(SIZE - 1));
+                texel[0] = uint8_t(color.r * 255.0f + 0.5f);
+                texel[1] = uint8_t(color.g * 255.0f + 0.5f);
+                texel[2] = uint8_t(color.b * 255.0f + 0.5f);
+                texel[3] = 255;
+                texel += 4;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+ColorLutCache::~ColorLutCache() {
+    for (const auto& entry : mEntries) {
+        glDeleteTextures(1, &entry.texture);
+    }
+}
+
+GLuint ColorLutCache::bindTexture(const Description& description) {
+    if (!ColorLut::isSupported(description)) {
+        return 0;
+    }
+
+    // The identity is not tracked, so that draws without a color matrix, e.g.
+    // on another display, don't restart the settle time.
+    const nsecs_t now = systemTime();
+    if (description.hasColorMatrix() && description.getColorMatrix() != mColorMatrix) {
+        mColorMatrix = description.getColorMatrix();
+        mColorMatrixTime = now;
+    }
+
+    const ColorLut::Params params = ColorLut::getParams(description);
+    auto found = std::find_if(mEntries.begin(), mEntries.end(),
+                              [&params](const Entry& entry) { return entry.params == params; });
+    if (found == mEntries.end() && description.hasColorMatrix() &&
+        now - mColorMatrixTime < COLOR_MATRIX_SETTLE_TIME) {
+        return 0;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + ColorLut::TEXTURE_UNIT);
+    if (found != mEntries.end()) {
+        std::rotate(mEntries.begin(), found, found + 1);
+        glBindTexture(GL_TEXTURE_2D, mEntries.front().texture);
+    } else {
+        ATRACE_NAME("ColorLutCache::generate");
+        nsecs_t time = -systemTime();
+        std::vector<uint8_t> texels;
+        ColorLut::generate(params, &texels);
+
+        GLuint texture;
+        if (mEntries.size() < MAX_ENTRIES) {
+            glGenTextures(1, &texture);
+            mEntries.insert(mEntries.begin(), {params, texture});
+        } else {
+            // reuse the texture of the least recently used conversion
+            texture = mEntries.back().texture;
+            mEntries.pop_back();
+            mEntries.insert(mEntries.begin(), {params, texture});
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ColorLut::SIZE * ColorLut::SIZE, ColorLut::SIZE,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        time += systemTime();
+        mGenerateCount++;
+        mGenerateTime += time;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    return mEntries.front().texture;
+}
+
+void ColorLutCache::dump(String8& result) const {
+    result.appendFormat("Color LUTs: %zu cached, %u generated in %.2f ms\n", mEntries.size(),
+                        mGenerateCount, mGenerateTime / 1e6);
+}
+
+} /* namespace android */
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SF_RENDER_ENGINE_COLOR_LUT_H_
+#define SF_RENDER_ENGINE_COLOR_LUT_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <GLES2/gl2.h>
+#include <math/mat4.h>
+#include <utils/Timers.h>
+
+#include "Description.h"
+
+namespace android {
+
+class String8;
+
+/*
+ * A ColorLut holds the whole color conversion of a draw, from the sampled
+ * signal to the output signal, evaluated over a grid of input values. The
+ * fragment shader then replaces the transfer functions, the transform matrices
+ * and the tone mapping by a trilinear lookup.
+ *
+ * GLES 2.0 has no 3D textures, so the grid is stored in a 2D texture of SIZE
+ * slices side by side: red goes along x within a slice, green along y, and
+ * blue selects the slice.
+ */
+class ColorLut {
+public:
+    static constexpr uint32_t SIZE = 33;
+    static constexpr GLint TEXTURE_UNIT = 1;
+
+    // Everything the conversion depends on. The output transfer function is
+    // always sRGB, see isSupported().
+    struct Params {
+        Description::TransferFunction inputTransferFunction;
+        // Applied after the EOTF, including the saturation matrix
+        mat4 inputTransformMatrix;
+        // Applied before the OETF, including the color matrix
+        mat4 outputTransformMatrix;
+        float displayMaxLuminance;
+
+        bool operator==(const Params& other) const;
+    };
+
+    // Returns whether draws with the description can use a LUT: PQ or HLG
+    // content tone mapped to an 8-bit sRGB encoded output. The color matrix is
+    // baked in the LUT along with the other matrices.
+    static bool isSupported(const Description& description);
+    static Params getParams(const Description& description);
+
+    // Converts one signal value, as the shader generated by ProgramCache does.
+    static vec3 convert(const Params& params, const vec3& signal);
+    // Fills outTexels with the SIZE^3 RGBA8 texels of the LUT texture.
+    static void generate(const Params& params, std::vector<uint8_t>* outTexels);
+};
+
+/*
+ * Keeps the LUT textures of the last few conversions. Must be used from the
+ * thread of the GL context.
+ */
+class ColorLutCache {
+public:
+    ColorLutCache() = default;
+    ~ColorLutCache();
+
+    // Binds the LUT texture of the description to ColorLut::TEXTURE_UNIT,
+    // generating it if needed, and returns its name. Returns 0 if the
+    // description can't use a LUT, or if its color matrix changed too recently
+    // to be worth a LUT. GL_TEXTURE0 is left active.
+    GLuint bindTexture(const Description& description);
+
+    void dump(String8& result) const;
+
+private:
+    static constexpr size_t MAX_ENTRIES = 4;
+    // Color matrices get animated, e.g. when night display turns on. A new
+    // color matrix only gets a LUT once it has stopped changing for this long,
+    // until then the regular shaders apply it.
+    static constexpr nsecs_t COLOR_MATRIX_SETTLE_TIME = 250000000; // 250 ms
+
+    struct Entry {
+        ColorLut::Params params;
+        GLuint texture;
+    };
+
+    // Most recently used first
+    std::vector<Entry> mEntries;
+    // Last color matrix other than the identity, and when it was first seen
+    mat4 mColorMatrix;
+    nsecs_t mColorMatrixTime = 0;
+    uint32_t mGenerateCount = 0;
+    nsecs_t mGenerateTime = 0;
+
+    ColorLutCache(const ColorLutCache&) = delete;
+    ColorLutCache& operator=(const ColorLutCache&) = delete;
+};
+
+} /* namespace android */
+
+#endif /* SF_RENDER_ENGINE_COLOR_LUT_H_ */
@@ -107,4 +107,8 @@ void Description::setDisplayMaxLuminance(const float maxLuminance) {
     mDisplayMaxLuminance = maxLuminance;
 }
 
+void Description::setColorLut(GLuint texName) {
+    mColorLut = texName;
+}
+
 } /* namespace android */
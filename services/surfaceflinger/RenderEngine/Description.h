@@ -29,7 +29,7 @@ class Program;
  * to generate a corresponding GLSL program and set the appropriate
  * uniform.
  *
- * Program and ProgramCache are friends and access the state directly
+ * ColorLut, Program and ProgramCache are friends and access the state directly
  */
 class Description {
 public:
@@ -64,7 +64,11 @@ public:
     void setOutputTransferFunction(TransferFunction transferFunction);
     void setDisplayMaxLuminance(const float maxLuminance);
 
+    // texture name of the ColorLut replacing the color conversion, 0 if none
+    void setColorLut(GLuint texName);
+
 private:
+    friend class ColorLut;
     friend class Program;
     friend class ProgramCache;
 
@@ -89,6 +93,8 @@ private:
 
     float mDisplayMaxLuminance;
 
+    GLuint mColorLut = 0;
+
     // projection matrix
     mat4 mProjectionMatrix;
     mat4 mColorMatrix;
@@ -30,8 +30,10 @@
 #include <utils/Trace.h>
 
 #include <cutils/compiler.h>
+#include <cutils/properties.h>
 #include <gui/ISurfaceComposer.h>
 #include <math.h>
+#include <stdlib.h>
 
 #include "Description.h"
 #include "GLES20RenderEngine.h"
@@ -57,6 +59,10 @@ bool checkGlError(const char* op, int lineNumber) {
 
 static constexpr bool outputDebugPPMs = false;
 
+// Size of the ring drawMesh streams vertices through. A layer is usually a quad of well under
+// a hundred bytes, so this holds many frames' worth before the storage has to be orphaned.
+static constexpr size_t vertexBufferSize = 64 * 1024;
+
 void writePPM(const char* basename, GLuint width, GLuint height) {
     ALOGV("writePPM #%s: %d x %d", basename, width, height);
 
@@ -122,6 +128,14 @@ GLES20RenderEngine::GLES20RenderEngine(uint32_t featureFlags)
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
+    // Vertex attrib state belongs to the context, programs built from the
+    // shader warmup context can't set it up for us.
+    glEnableVertexAttribArray(Program::position);
+
+    glGenBuffers(1, &mVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, nullptr, GL_STREAM_DRAW);
+
     const uint16_t protTexData[] = {0};
     glGenTextures(1, &mProtectedTexName);
     glBindTexture(GL_TEXTURE_2D, mProtectedTexName);
@@ -153,10 +167,17 @@ GLES20RenderEngine::GLES20RenderEngine(uint32_t featureFlags)
         mXyzToSrgb = mat4(srgb.getXYZtoRGB());
         mXyzToDisplayP3 = mat4(displayP3.getXYZtoRGB());
         mXyzToBt2020 = mat4(bt2020.getXYZtoRGB());
+
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.sf.color_lut", value, "1");
+        mUseColorLut = atoi(value) != 0 &&
+                mMaxTextureSize >= GLint(ColorLut::SIZE * ColorLut::SIZE);
     }
 }
 
-GLES20RenderEngine::~GLES20RenderEngine() {}
+GLES20RenderEngine::~GLES20RenderEngine() {
+    glDeleteBuffers(1, &mVertexBuffer);
+}
 
 size_t GLES20RenderEngine::getMaxTextureSize() const {
     return mMaxTextureSize;
@@ -311,16 +332,42 @@ void GLES20RenderEngine::setupFillWithColor(float r, float g, float b, float a)
     glDisable(GL_BLEND);
 }
 
+GLintptr GLES20RenderEngine::streamMesh(const Mesh& mesh) {
+    const size_t size = mesh.getVertexCount() * mesh.getByteStride();
+    if (size > vertexBufferSize) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return -1;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+    if (mVertexBufferOffset + size > vertexBufferSize) {
+        // Orphan the storage rather than overwrite vertices that queued draws may still read.
+        glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, nullptr, GL_STREAM_DRAW);
+        mVertexBufferOffset = 0;
+    }
+    const GLintptr offset = mVertexBufferOffset;
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, mesh.getPositions());
+    mVertexBufferOffset += size;
+    return offset;
+}
+
 void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
     ATRACE_CALL();
+    // Attribute pointers are offsets into the vertex buffer, unless the mesh was too large
+    // for it and is drawn from client memory.
+    const GLintptr offset = streamMesh(mesh);
+    const GLvoid* positions = offset < 0 ? mesh.getPositions()
+                                         : reinterpret_cast<const GLvoid*>(offset);
     if (mesh.getTexCoordsSize()) {
+        const GLvoid* texCoords = offset < 0 ? mesh.getTexCoords()
+                : reinterpret_cast<const GLvoid*>(offset + mesh.getVertexSize() * sizeof(float));
         glEnableVertexAttribArray(Program::texCoords);
         glVertexAttribPointer(Program::texCoords, mesh.getTexCoordsSize(), GL_FLOAT, GL_FALSE,
-                              mesh.getByteStride(), mesh.getTexCoords());
+                              mesh.getByteStride(), texCoords);
     }
 
     glVertexAttribPointer(Program::position, mesh.getVertexSize(), GL_FLOAT, GL_FALSE,
-                          mesh.getByteStride(), mesh.getPositions());
+                          mesh.getByteStride(), positions);
 
     // By default, DISPLAY_P3 is the only supported wide color output. However,
     // when HDR content is present, hardware composer may be able to handle
@@ -416,6 +463,12 @@ void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
             }
         }
 
+        // The tone mapping of HDR content is costly per pixel, sample the
+        // whole conversion from a LUT instead.
+        if (mUseColorLut) {
+            wideColorState.setColorLut(mColorLutCache.bindTexture(wideColorState));
+        }
+
         ProgramCache::getInstance().useProgram(wideColorState);
 
         glDrawArrays(mesh.getPrimitive(), 0, mesh.getVertexCount());
@@ -442,6 +495,9 @@ void GLES20RenderEngine::dump(String8& result) {
     result.appendFormat("RenderEngine last dataspace conversion: (%s) to (%s)\n",
                         dataspaceDetails(static_cast<android_dataspace>(mDataSpace)).c_str(),
                         dataspaceDetails(static_cast<android_dataspace>(mOutputDataSpace)).c_str());
+    if (mUseColorLut) {
+        mColorLutCache.dump(result);
+    }
 }
 
 bool GLES20RenderEngine::isHdrDataSpace(const Dataspace dataSpace) const {
@@ -23,6 +23,7 @@
 #include <GLES2/gl2.h>
 #include <Transform.h>
 
+#include "ColorLut.h"
 #include "Description.h"
 #include "ProgramCache.h"
 #include "RenderEngine.h"
@@ -107,11 +108,24 @@ protected:
     mat4 mXyzToDisplayP3;
     mat4 mXyzToBt2020;
 
+    // Whether HDR content tone mapped to SDR is converted through a ColorLut
+    bool mUseColorLut = false;
+    ColorLutCache mColorLutCache;
+
 private:
     // A data space is considered HDR data space if it has BT2020 color space
     // with PQ or HLG transfer function.
     bool isHdrDataSpace(const ui::Dataspace dataSpace) const;
     bool needsXYZTransformMatrix() const;
+
+    // Appends the vertices of a mesh to mVertexBuffer and returns their offset in it, or
+    // unbinds it and returns -1 if the mesh is larger than the whole ring.
+    GLintptr streamMesh(const Mesh& mesh);
+
+    // Ring that drawMesh streams vertices through, so draws source them from a buffer object
+    // instead of having the driver copy client arrays on every call.
+    GLuint mVertexBuffer = 0;
+    size_t mVertexBufferOffset = 0;
 };
 
 // ---------------------------------------------------------------------------
@@ -109,6 +109,13 @@ void GLExtensions::initWithEGLStrings(char const* eglVersion, char const* eglExt
     if (hasEGLExtension("EGL_IMG_context_priority")) {
         mHasContextPriority = true;
     }
+
+    if (hasEGLExtension("EGL_EXT_buffer_age")) {
+        mHasBufferAge = true;
+    }
+    if (hasEGLExtension("EGL_KHR_swap_buffers_with_damage")) {
+        mHasSwapBuffersWithDamage = true;
+    }
 }
 
 char const* GLExtensions::getEGLVersion() const {
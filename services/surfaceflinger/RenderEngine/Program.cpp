@@ -16,10 +16,15 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
+#include <GLES2/gl2ext.h>
+
 #include <log/log.h>
 #include <utils/String8.h>
 
 #include <math/mat4.h>
+#include "ColorLut.h"
 #include "Description.h"
 #include "Program.h"
 #include "ProgramCache.h"
@@ -54,25 +59,48 @@ Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const c
         glDeleteShader(fragmentId);
         glDeleteProgram(programId);
     } else {
-        mProgram = programId;
-        mVertexShader = vertexId;
-        mFragmentShader = fragmentId;
-        mInitialized = true;
-        mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
-        mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
-        mSamplerLoc = glGetUniformLocation(programId, "sampler");
-        mColorLoc = glGetUniformLocation(programId, "color");
-        mDisplayMaxLuminanceLoc = glGetUniformLocation(programId, "displayMaxLuminance");
-        mInputTransformMatrixLoc = glGetUniformLocation(programId, "inputTransformMatrix");
-        mOutputTransformMatrixLoc = glGetUniformLocation(programId, "outputTransformMatrix");
-
-        // set-up the default values for our uniforms
-        glUseProgram(programId);
-        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, mat4().asArray());
-        glEnableVertexAttribArray(0);
+        initialize(programId, vertexId, fragmentId);
     }
 }
 
+Program::Program(const ProgramCache::Key& /*needs*/, GLenum binaryFormat, const void* binary,
+                 GLsizei length)
+      : mInitialized(false) {
+    GLuint programId = glCreateProgram();
+    glProgramBinaryOES(programId, binaryFormat, binary, length);
+
+    // The driver may reject binaries produced by another version of itself,
+    // in which case the program must be built from source.
+    GLint status;
+    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        ALOGW("Program binary rejected by the driver");
+        glDeleteProgram(programId);
+    } else {
+        initialize(programId, 0, 0);
+    }
+}
+
+void Program::initialize(GLuint programId, GLuint vertexId, GLuint fragmentId) {
+    mProgram = programId;
+    mVertexShader = vertexId;
+    mFragmentShader = fragmentId;
+    mInitialized = true;
+    mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
+    mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
+    mSamplerLoc = glGetUniformLocation(programId, "sampler");
+    mColorLoc = glGetUniformLocation(programId, "color");
+    mDisplayMaxLuminanceLoc = glGetUniformLocation(programId, "displayMaxLuminance");
+    mInputTransformMatrixLoc = glGetUniformLocation(programId, "inputTransformMatrix");
+    mOutputTransformMatrixLoc = glGetUniformLocation(programId, "outputTransformMatrix");
+    mColorLutLoc = glGetUniformLocation(programId, "colorLut");
+
+    // set-up the default values for our uniforms
+    glUseProgram(programId);
+    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, mat4().asArray());
+    glEnableVertexAttribArray(0);
+}
+
 Program::~Program() {}
 
 bool Program::isValid() const {
@@ -83,6 +111,22 @@ void Program::use() {
     glUseProgram(mProgram);
 }
 
+bool Program::getBinary(GLenum* outFormat, std::vector<uint8_t>* outBinary) const {
+    if (!mInitialized) {
+        return false;
+    }
+    GLint length = 0;
+    glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return false;
+    }
+    outBinary->resize(length);
+    GLsizei written = 0;
+    glGetProgramBinaryOES(mProgram, length, &written, outFormat, outBinary->data());
+    outBinary->resize(written);
+    return written > 0;
+}
+
 GLuint Program::getAttrib(const char* name) const {
     // TODO: maybe use a local cache
     return glGetAttribLocation(mProgram, name);
@@ -122,24 +166,45 @@ String8& Program::dumpShader(String8& result, GLenum /*type*/) {
     return result;
 }
 
+// Stores value in cached, returns false if cached already had that value
+template <size_t N>
+static bool updateUniform(std::array<float, N>& cached, const float* value, bool force) {
+    if (!force && std::equal(cached.begin(), cached.end(), value)) {
+        return false;
+    }
+    std::copy(value, value + N, cached.begin());
+    return true;
+}
+
 void Program::setUniforms(const Description& desc) {
-    // TODO: we should have a mechanism here to not always reset uniforms that
-    // didn't change for this program.
+    // Uniforms keep their values in the program, only upload the ones that
+    // changed since this program was last used.
+    const bool force = !mUniformsSet;
+    mUniformsSet = true;
 
     if (mSamplerLoc >= 0) {
-        glUniform1i(mSamplerLoc, 0);
-        glUniformMatrix4fv(mTextureMatrixLoc, 1, GL_FALSE, desc.mTexture.getMatrix().asArray());
+        if (force) {
+            glUniform1i(mSamplerLoc, 0);
+        }
+        if (updateUniform(mTextureMatrix, desc.mTexture.getMatrix().asArray(), force)) {
+            glUniformMatrix4fv(mTextureMatrixLoc, 1, GL_FALSE, mTextureMatrix.data());
+        }
     }
     if (mColorLoc >= 0) {
         const float color[4] = {desc.mColor.r, desc.mColor.g, desc.mColor.b, desc.mColor.a};
-        glUniform4fv(mColorLoc, 1, color);
+        if (updateUniform(mColor, color, force)) {
+            glUniform4fv(mColorLoc, 1, mColor.data());
+        }
     }
     if (mInputTransformMatrixLoc >= 0) {
         // If the input transform matrix is not identity matrix, we want to merge
         // the saturation matrix with input transform matrix so that the saturation
         // matrix is applied at the correct stage.
         mat4 inputTransformMatrix = mat4(desc.mInputTransformMatrix) * desc.mSaturationMatrix;
-        glUniformMatrix4fv(mInputTransformMatrixLoc, 1, GL_FALSE, inputTransformMatrix.asArray());
+        if (updateUniform(mInputTransformMatrix, inputTransformMatrix.asArray(), force)) {
+            glUniformMatrix4fv(mInputTransformMatrixLoc, 1, GL_FALSE,
+                               mInputTransformMatrix.data());
+        }
     }
     if (mOutputTransformMatrixLoc >= 0) {
         // The output transform matrix and color matrix can be combined as one matrix
@@ -151,14 +216,23 @@ void Program::setUniforms(const Description& desc) {
         if (mInputTransformMatrixLoc < 0) {
             outputTransformMatrix *= desc.mSaturationMatrix;
         }
-        glUniformMatrix4fv(mOutputTransformMatrixLoc, 1, GL_FALSE,
-                           outputTransformMatrix.asArray());
+        if (updateUniform(mOutputTransformMatrix, outputTransformMatrix.asArray(), force)) {
+            glUniformMatrix4fv(mOutputTransformMatrixLoc, 1, GL_FALSE,
+                               mOutputTransformMatrix.data());
+        }
+    }
+    if (mColorLutLoc >= 0 && force) {
+        glUniform1i(mColorLutLoc, ColorLut::TEXTURE_UNIT);
     }
     if (mDisplayMaxLuminanceLoc >= 0) {
-        glUniform1f(mDisplayMaxLuminanceLoc, desc.mDisplayMaxLuminance);
+        if (updateUniform(mDisplayMaxLuminance, &desc.mDisplayMaxLuminance, force)) {
+            glUniform1f(mDisplayMaxLuminanceLoc, desc.mDisplayMaxLuminance);
+        }
     }
     // these uniforms are always present
-    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, desc.mProjectionMatrix.asArray());
+    if (updateUniform(mProjectionMatrix, desc.mProjectionMatrix.asArray(), force)) {
+        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, mProjectionMatrix.data());
+    }
 }
 
 } /* namespace android */
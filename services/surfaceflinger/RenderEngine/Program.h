@@ -19,6 +19,9 @@
 
 #include <stdint.h>
 
+#include <array>
+#include <vector>
+
 #include <GLES2/gl2.h>
 
 #include "Description.h"
@@ -37,6 +40,9 @@ public:
     enum { position = 0, texCoords = 1 };
 
     Program(const ProgramCache::Key& needs, const char* vertex, const char* fragment);
+    /* Loads a program binary previously returned by getBinary() */
+    Program(const ProgramCache::Key& needs, GLenum binaryFormat, const void* binary,
+            GLsizei length);
     ~Program();
 
     /* whether this object is usable */
@@ -45,6 +51,9 @@ public:
     /* Binds this program to the GLES context */
     void use();
 
+    /* Retrieves the linked program binary, requires GL_OES_get_program_binary */
+    bool getBinary(GLenum* outFormat, std::vector<uint8_t>* outBinary) const;
+
     /* Returns the location of the specified attribute */
     GLuint getAttrib(const char* name) const;
 
@@ -55,6 +64,7 @@ public:
     void setUniforms(const Description& desc);
 
 private:
+    void initialize(GLuint programId, GLuint vertexId, GLuint fragmentId);
     GLuint buildShader(const char* source, GLenum type);
     String8& dumpShader(String8& result, GLenum type);
 
@@ -84,6 +94,19 @@ private:
     /* location of transform matrix */
     GLint mInputTransformMatrixLoc;
     GLint mOutputTransformMatrixLoc;
+
+    /* location of the color LUT sampler uniform */
+    GLint mColorLutLoc;
+
+    /* values last uploaded to the uniforms, which the program keeps while
+     * other programs are in use. Updates to the same values are skipped. */
+    bool mUniformsSet = false;
+    std::array<float, 16> mTextureMatrix;
+    std::array<float, 4> mColor;
+    std::array<float, 16> mInputTransformMatrix;
+    std::array<float, 16> mOutputTransformMatrix;
+    std::array<float, 1> mDisplayMaxLuminance;
+    std::array<float, 16> mProjectionMatrix;
 };
 
 } /* namespace android */
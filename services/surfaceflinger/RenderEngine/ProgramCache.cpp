@@ -16,13 +16,25 @@
 
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#include <cutils/properties.h>
+#include <log/log.h>
 #include <utils/String8.h>
 #include <utils/Trace.h>
 
+#include "ColorLut.h"
 #include "Description.h"
+#include "GLExtensions.h"
 #include "Program.h"
 #include "ProgramCache.h"
 
@@ -78,12 +90,31 @@ Formatter& dedent(Formatter& f) {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(ProgramCache)
 
-ProgramCache::ProgramCache() {}
+// The persistent cache is a header followed by one entry per program:
+//   uint32_t key, uint32_t binaryFormat, uint32_t binaryLength, binary
+static constexpr uint32_t kPersistentCacheMagic = 0x53465043; // "SFPC"
+static constexpr uint32_t kPersistentCacheVersion = 1;
+static constexpr uint32_t kMaxProgramBinaryLength = 1024 * 1024;
+
+struct PersistentCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t driverId;
+    uint32_t count;
+};
+
+ProgramCache::ProgramCache() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.program_cache_path", value,
+                 "/data/misc/surfaceflinger/program_cache.bin");
+    mPersistentCachePath = value;
+    mHasProgramBinary = GLExtensions::getInstance().hasExtension("GL_OES_get_program_binary");
+}
 
 ProgramCache::~ProgramCache() {}
 
-void ProgramCache::primeCache(bool hasWideColor) {
-    uint32_t shaderCount = 0;
+void ProgramCache::primeCache(bool hasWideColor, bool sharedContext) {
+    std::vector<PersistedProgram> programs;
     uint32_t keyMask = Key::BLEND_MASK | Key::OPACITY_MASK | Key::ALPHA_MASK | Key::TEXTURE_MASK;
     // Prime the cache for all combinations of the above masks,
     // leaving off the experimental color matrix mask options.
@@ -96,12 +127,8 @@ void ProgramCache::primeCache(bool hasWideColor) {
         if (tex != Key::TEXTURE_OFF && tex != Key::TEXTURE_EXT && tex != Key::TEXTURE_2D) {
             continue;
         }
-        Program* program = mCache.valueFor(shaderKey);
-        if (program == nullptr) {
-            program = generateProgram(shaderKey);
-            mCache.add(shaderKey, program);
-            shaderCount++;
-        }
+        programs.emplace_back();
+        programs.back().key = shaderKey;
     }
 
     // Prime for sRGB->P3 conversion
@@ -115,18 +142,210 @@ void ProgramCache::primeCache(bool hasWideColor) {
             shaderKey.set(Key::OPACITY_MASK,
                           (i & 1) ? Key::OPACITY_OPAQUE : Key::OPACITY_TRANSLUCENT);
             shaderKey.set(Key::ALPHA_MASK, (i & 2) ? Key::ALPHA_LT_ONE : Key::ALPHA_EQ_ONE);
-            Program* program = mCache.valueFor(shaderKey);
-            if (program == nullptr) {
-                program = generateProgram(shaderKey);
-                mCache.add(shaderKey, program);
-                shaderCount++;
+            programs.emplace_back();
+            programs.back().key = shaderKey;
+        }
+    }
+
+    // Prime for all keys used by previous runs, the persisted entries
+    // replace the default ones so that their binaries get used
+    std::vector<PersistedProgram> persisted;
+    bool persistedBinaryMissing = false;
+    if (loadPersistentCache(&persisted)) {
+        for (auto& entry : persisted) {
+            persistedBinaryMissing |= entry.binary.empty();
+            auto found = std::find_if(programs.begin(), programs.end(),
+                                      [&entry](const PersistedProgram& program) {
+                                          return program.key.mKey == entry.key.mKey;
+                                      });
+            if (found != programs.end()) {
+                *found = std::move(entry);
+            } else {
+                programs.push_back(std::move(entry));
             }
         }
     }
 
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWarmupTotal = programs.size();
+        mWarmupDone = 0;
+        mWarmupInProgress = true;
+    }
+
+    uint32_t shaderCount = 0;
+    for (const auto& entry : programs) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mCache.indexOfKey(entry.key) >= 0) {
+                mWarmupDone++;
+                continue;
+            }
+        }
+
+        nsecs_t time = -systemTime();
+        Program* program = loadProgram(entry);
+        if (sharedContext) {
+            // the drawing context can only observe a complete program
+            glFinish();
+        }
+        time += systemTime();
+
+        std::lock_guard<std::mutex> lock(mLock);
+        mWarmupDone++;
+        // useProgram() may have compiled this key in the meantime
+        if (mCache.indexOfKey(entry.key) < 0) {
+            mCache.add(entry.key, program);
+            mCompileStats.push_back({entry.key, time, sharedContext, !entry.binary.empty()});
+            shaderCount++;
+        } else {
+            delete program;
+        }
+    }
+
     nsecs_t timeAfter = systemTime();
     float compileTimeMs = static_cast<float>(timeAfter - timeBefore) / 1.0E6;
-    ALOGD("shader cache generated - %u shaders in %f ms\n", shaderCount, compileTimeMs);
+    ALOGD("shader cache generated - %u shaders (%zu persisted) in %f ms\n", shaderCount,
+          persisted.size(), compileTimeMs);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWarmupInProgress = false;
+        mWarmupTime = timeAfter - timeBefore;
+    }
+
+    // Refresh the persistent cache so that the next run can load binaries
+    if (mHasProgramBinary && (persisted.empty() || persistedBinaryMissing)) {
+        savePersistentCache();
+    }
+}
+
+void ProgramCache::dump(String8& result) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    result.appendFormat("ProgramCache: %zu programs, warmup %s (%zu/%zu) in %.3f ms\n",
+                        mCache.size(), mWarmupInProgress ? "in progress" : "done", mWarmupDone,
+                        mWarmupTotal, mWarmupTime / 1.0E6);
+    result.appendFormat("    program switches=%" PRIu64 " reuses=%" PRIu64 "\n", mProgramSwitches,
+                        mProgramReuses);
+    for (const auto& stat : mCompileStats) {
+        result.appendFormat("    key=%08X %8.3f ms%s%s\n", stat.key.mKey, stat.time / 1.0E6,
+                            stat.sharedContext ? " (warmup thread)" : "",
+                            stat.fromBinary ? " (binary)" : "");
+    }
+}
+
+uint64_t ProgramCache::getDriverId() {
+    const GLExtensions& extensions = GLExtensions::getInstance();
+    std::string id(extensions.getVendor());
+    id.append(extensions.getRenderer());
+    id.append(extensions.getVersion());
+    return std::hash<std::string>()(id);
+}
+
+Program* ProgramCache::loadProgram(const PersistedProgram& persisted) {
+    if (!persisted.binary.empty()) {
+        Program* program =
+                new Program(persisted.key, persisted.binaryFormat, persisted.binary.data(),
+                            static_cast<GLsizei>(persisted.binary.size()));
+        if (program->isValid()) {
+            return program;
+        }
+        delete program;
+    }
+    return generateProgram(persisted.key);
+}
+
+bool ProgramCache::loadPersistentCache(std::vector<PersistedProgram>* outPrograms) const {
+    ATRACE_CALL();
+    if (mPersistentCachePath.isEmpty()) {
+        return false;
+    }
+    FILE* file = fopen(mPersistentCachePath.string(), "rbe");
+    if (file == nullptr) {
+        return false;
+    }
+
+    PersistentCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+            header.magic == kPersistentCacheMagic && header.version == kPersistentCacheVersion;
+    // binaries from another driver are useless, but the keys are still good
+    const bool binariesUsable = valid && mHasProgramBinary && header.driverId == getDriverId();
+    for (uint32_t i = 0; valid && i < header.count; i++) {
+        uint32_t entry[3];
+        if (fread(entry, sizeof(entry), 1, file) != 1 || entry[2] > kMaxProgramBinaryLength) {
+            valid = false;
+            break;
+        }
+        PersistedProgram program;
+        program.key.mKey = entry[0];
+        program.binaryFormat = entry[1];
+        program.binary.resize(entry[2]);
+        if (entry[2] > 0 && fread(program.binary.data(), entry[2], 1, file) != 1) {
+            valid = false;
+            break;
+        }
+        if (!binariesUsable) {
+            program.binary.clear();
+        }
+        outPrograms->push_back(std::move(program));
+    }
+    fclose(file);
+
+    if (!valid) {
+        ALOGW("Ignoring invalid program cache %s", mPersistentCachePath.string());
+        outPrograms->clear();
+    }
+    return valid;
+}
+
+void ProgramCache::savePersistentCache() const {
+    ATRACE_CALL();
+    if (mPersistentCachePath.isEmpty()) {
+        return;
+    }
+
+    // write to a temporary file first so that a crash never leaves a
+    // truncated cache behind
+    const String8 tmpPath = mPersistentCachePath + ".tmp";
+    FILE* file = fopen(tmpPath.string(), "wbe");
+    if (file == nullptr) {
+        ALOGV("Unable to write program cache %s", tmpPath.string());
+        return;
+    }
+
+    DefaultKeyedVector<Key, Program*> programs;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        programs = mCache;
+    }
+
+    PersistentCacheHeader header;
+    header.magic = kPersistentCacheMagic;
+    header.version = kPersistentCacheVersion;
+    header.driverId = getDriverId();
+    header.count = static_cast<uint32_t>(programs.size());
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    std::vector<uint8_t> binary;
+    for (size_t i = 0; success && i < programs.size(); i++) {
+        GLenum format = 0;
+        binary.clear();
+        const Program* program = programs.valueAt(i);
+        if (!mHasProgramBinary || program == nullptr || !program->getBinary(&format, &binary) ||
+            binary.size() > kMaxProgramBinaryLength) {
+            binary.clear();
+        }
+        const uint32_t entry[3] = {programs.keyAt(i).mKey, format,
+                                   static_cast<uint32_t>(binary.size())};
+        success = fwrite(entry, sizeof(entry), 1, file) == 1 &&
+                (binary.empty() || fwrite(binary.data(), binary.size(), 1, file) == 1);
+    }
+    success = (fclose(file) == 0) && success;
+
+    if (!success || rename(tmpPath.string(), mPersistentCachePath.string()) != 0) {
+        ALOGW("Failed to write program cache %s", mPersistentCachePath.string());
+        unlink(tmpPath.string());
+    }
 }
 
 ProgramCache::Key ProgramCache::computeKey(const Description& description) {
@@ -155,6 +374,7 @@ ProgramCache::Key ProgramCache::computeKey(const Description& description) {
 
     needs.set(Key::Y410_BT2020_MASK,
               description.mY410BT2020 ? Key::Y410_BT2020_ON : Key::Y410_BT2020_OFF);
+    needs.set(Key::COLOR_LUT_MASK, description.mColorLut ? Key::COLOR_LUT_ON : Key::COLOR_LUT_OFF);
 
     if (needs.hasTransformMatrix() || (needs.getInputTF() != needs.getOutputTF())) {
         switch (description.mInputTransferFunction) {
@@ -515,6 +735,24 @@ void ProgramCache::generateOETF(Formatter& fs, const Key& needs) {
     }
 }
 
+// Generate the lookup of the color conversion baked in a ColorLut. The slices
+// are filtered in the texture and blended here, along blue.
+void ProgramCache::generateColorLut(Formatter& fs) {
+    fs << "uniform sampler2D colorLut;";
+    fs << String8::format("const highp float colorLutSize = %u.0;", ColorLut::SIZE);
+    fs << R"__SHADER__(
+        highp vec3 ColorLut(const highp vec3 color) {
+            highp vec3 index = clamp(color, 0.0, 1.0) * (colorLutSize - 1.0);
+            highp float slice = min(floor(index.b), colorLutSize - 2.0);
+            highp vec2 texel = (index.rg + 0.5) / colorLutSize;
+            highp vec2 coords0 = vec2((slice + texel.x) / colorLutSize, texel.y);
+            highp vec2 coords1 = vec2((slice + 1.0 + texel.x) / colorLutSize, texel.y);
+            return mix(texture2D(colorLut, coords0).rgb, texture2D(colorLut, coords1).rgb,
+                    index.b - slice);
+        }
+    )__SHADER__";
+}
+
 String8 ProgramCache::generateVertexShader(const Key& needs) {
     Formatter vs;
     if (needs.isTexturing()) {
@@ -567,7 +805,9 @@ String8 ProgramCache::generateFragmentShader(const Key& needs) {
             )__SHADER__";
     }
 
-    if (needs.hasTransformMatrix() || (needs.getInputTF() != needs.getOutputTF())) {
+    if (needs.hasColorLut()) {
+        generateColorLut(fs);
+    } else if (needs.hasTransformMatrix() || (needs.getInputTF() != needs.getOutputTF())) {
         // Currently, display maximum luminance is needed when doing tone mapping.
         if (needs.needsToneMapping()) {
             fs << "uniform float displayMaxLuminance;";
@@ -639,7 +879,11 @@ String8 ProgramCache::generateFragmentShader(const Key& needs) {
             // avoid divide by 0 by adding 0.5/256 to the alpha channel
             fs << "gl_FragColor.rgb = gl_FragColor.rgb / (gl_FragColor.a + 0.0019);";
         }
-        fs << "gl_FragColor.rgb = OETF(OutputTransform(OOTF(InputTransform(EOTF(gl_FragColor.rgb)))));";
+        if (needs.hasColorLut()) {
+            fs << "gl_FragColor.rgb = ColorLut(gl_FragColor.rgb);";
+        } else {
+            fs << "gl_FragColor.rgb = OETF(OutputTransform(OOTF(InputTransform(EOTF(gl_FragColor.rgb)))));";
+        }
         if (!needs.isOpaque() && needs.isPremultiplied()) {
             // and re-premultiply if needed after gamma correction
             fs << "gl_FragColor.rgb = gl_FragColor.rgb * (gl_FragColor.a + 0.0019);";
@@ -667,23 +911,50 @@ void ProgramCache::useProgram(const Description& description) {
     // generate the key for the shader based on the description
     Key needs(computeKey(description));
 
+    // consecutive draws of layers of the same kind share the bound program,
+    // only the uniforms that changed need to be uploaded
+    if (mCurrentProgram != nullptr && needs.mKey == mCurrentKey.mKey) {
+        mProgramReuses++;
+        mCurrentProgram->setUniforms(description);
+        return;
+    }
+
     // look-up the program in the cache
-    Program* program = mCache.valueFor(needs);
+    Program* program;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        program = mCache.valueFor(needs);
+    }
     if (program == nullptr) {
-        // we didn't find our program, so generate one...
+        // we didn't find our program, either the warmup didn't get to it yet
+        // or it was never seen before, so generate one...
         nsecs_t time = -systemTime();
         program = generateProgram(needs);
-        mCache.add(needs, program);
         time += systemTime();
 
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mCache.add(needs, program);
+            mCompileStats.push_back({needs, time, false, false});
+            count = mCache.size();
+        }
+
         ALOGV(">>> generated new program: needs=%08X, time=%u ms (%zu programs)", needs.mKey,
-              uint32_t(ns2ms(time)), mCache.size());
+              uint32_t(ns2ms(time)), count);
+
+        // New keys only show up a handful of times over the lifetime of the
+        // device, record them so that the next boot can prime them.
+        savePersistentCache();
     }
 
     // here we have a suitable program for this description
     if (program->isValid()) {
         program->use();
         program->setUniforms(description);
+        mCurrentKey = needs;
+        mCurrentProgram = program;
+        mProgramSwitches++;
     }
 }
 
@@ -21,8 +21,13 @@
 
 #include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 #include <utils/TypeHelpers.h>
 
+#include <mutex>
+#include <vector>
+
 #include "Description.h"
 
 namespace android {
@@ -100,6 +105,11 @@ public:
             Y410_BT2020_MASK = 1 << Y410_BT2020_SHIFT,
             Y410_BT2020_OFF = 0 << Y410_BT2020_SHIFT,
             Y410_BT2020_ON = 1 << Y410_BT2020_SHIFT,
+
+            COLOR_LUT_SHIFT = 12,
+            COLOR_LUT_MASK = 1 << COLOR_LUT_SHIFT,
+            COLOR_LUT_OFF = 0 << COLOR_LUT_SHIFT,
+            COLOR_LUT_ON = 1 << COLOR_LUT_SHIFT,
         };
 
         inline Key() : mKey(0) {}
@@ -150,6 +160,7 @@ public:
             return inputTF != outputTF;
         }
         inline bool isY410BT2020() const { return (mKey & Y410_BT2020_MASK) == Y410_BT2020_ON; }
+        inline bool hasColorLut() const { return (mKey & COLOR_LUT_MASK) == COLOR_LUT_ON; }
 
         // this is the definition of a friend function -- not a method of class Needs
         friend inline int strictly_order_type(const Key& lhs, const Key& rhs) {
@@ -160,14 +171,38 @@ public:
     ProgramCache();
     ~ProgramCache();
 
-    // Generate shaders to populate the cache
-    void primeCache(bool hasWideColor);
+    // Generate shaders to populate the cache, including every key recorded
+    // in the persistent cache by previous runs. sharedContext must be set
+    // when called from a context other than the drawing one, sharing its
+    // objects; programs are then only published once complete.
+    void primeCache(bool hasWideColor, bool sharedContext = false);
+
+    // Dumps the warmup progress and the compile time of each program
+    void dump(String8& result) const;
 
     // useProgram lookup a suitable program in the cache or generates one
     // if none can be found.
     void useProgram(const Description& description);
 
 private:
+    // A program recorded in the persistent cache. binary is empty when the
+    // driver doesn't support GL_OES_get_program_binary or when the binary
+    // was produced by a different driver.
+    struct PersistedProgram {
+        Key key;
+        GLenum binaryFormat = 0;
+        std::vector<uint8_t> binary;
+    };
+
+    // Reads the persistent cache, returns false if it is missing or invalid
+    bool loadPersistentCache(std::vector<PersistedProgram>* outPrograms) const;
+    // Writes every program currently in mCache to the persistent cache
+    void savePersistentCache() const;
+    // Identifies the GLES driver that produced the program binaries
+    static uint64_t getDriverId();
+    // Loads a program from its binary, or from source if that fails
+    static Program* loadProgram(const PersistedProgram& persisted);
+
     // compute a cache Key from a Description
     static Key computeKey(const Description& description);
     // Generate EOTF based from Key.
@@ -178,6 +213,8 @@ private:
     static void generateOOTF(Formatter& fs, const Key& needs);
     // Generate OETF based from Key.
     static void generateOETF(Formatter& fs, const Key& needs);
+    // Generate the ColorLut lookup replacing the whole conversion.
+    static void generateColorLut(Formatter& fs);
     // generates a program from the Key
     static Program* generateProgram(const Key& needs);
     // generates the vertex shader from the Key
@@ -185,9 +222,38 @@ private:
     // generates the fragment shader from the Key
     static String8 generateFragmentShader(const Key& needs);
 
+    struct CompileStat {
+        Key key;
+        nsecs_t time;
+        bool sharedContext;
+        bool fromBinary;
+    };
+
+    // Protects mCache and the warmup state below, as the cache may be primed
+    // from a worker thread while useProgram() is being called.
+    mutable std::mutex mLock;
+
     // Key/Value map used for caching Programs. Currently the cache
     // is never shrunk.
     DefaultKeyedVector<Key, Program*> mCache;
+
+    bool mWarmupInProgress = false;
+    size_t mWarmupTotal = 0;
+    size_t mWarmupDone = 0;
+    nsecs_t mWarmupTime = 0;
+    std::vector<CompileStat> mCompileStats;
+
+    // Location of the persistent cache, empty if disabled
+    String8 mPersistentCachePath;
+    bool mHasProgramBinary = false;
+
+    // The program last bound by useProgram(), to skip the look-up and the
+    // glUseProgram call when consecutive draws need the same program. Only
+    // used by the RenderEngine thread.
+    Key mCurrentKey;
+    Program* mCurrentProgram = nullptr;
+    uint64_t mProgramSwitches = 0;
+    uint64_t mProgramReuses = 0;
 };
 
 ANDROID_BASIC_TYPES_TRAITS(ProgramCache::Key)
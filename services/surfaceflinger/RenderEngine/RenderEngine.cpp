@@ -22,11 +22,15 @@
 #include "GLExtensions.h"
 #include "Image.h"
 #include "Mesh.h"
+#include "ProgramCache.h"
 #include "RenderEngine.h"
 
 #include <SurfaceFlinger.h>
+#include <thread>
 #include <vector>
 
+#include <pthread.h>
+
 #include <android/hardware/configstore/1.0/ISurfaceFlingerConfigs.h>
 #include <configstore/Utils.h>
 
@@ -125,6 +129,8 @@ std::unique_ptr<RenderEngine> RenderEngine::create(int hwcFormat, uint32_t featu
             break;
     }
     engine->setEGLHandles(display, config, ctxt);
+    engine->mPbufferConfig = dummyConfig;
+    engine->mContextClientVersion = contextClientVersion;
 
     ALOGI("OpenGL ES informations:");
     ALOGI("vendor    : %s", extensions.getVendor());
@@ -399,6 +405,8 @@ void RenderEngine::dump(String8& result) {
     result.appendFormat("GLES: %s, %s, %s\n", extensions.getVendor(), extensions.getRenderer(),
                         extensions.getVersion());
     result.appendFormat("%s\n", extensions.getExtensions());
+
+    ProgramCache::getInstance().dump(result);
 }
 
 // ---------------------------------------------------------------------------
@@ -591,7 +599,44 @@ EGLConfig RenderEngine::chooseEglConfig(EGLDisplay display, int format, bool log
 }
 
 void RenderEngine::primeCache() const {
-    ProgramCache::getInstance().primeCache(mFeatureFlags & WIDE_COLOR_SUPPORT);
+    const bool hasWideColor = mFeatureFlags & WIDE_COLOR_SUPPORT;
+    if (!(mFeatureFlags & ASYNC_PRIME_CACHE)) {
+        ProgramCache::getInstance().primeCache(hasWideColor);
+        return;
+    }
+
+    // Programs are shared with mEGLContext, so they can be built from another
+    // context while the main thread keeps drawing. useProgram() compiles
+    // synchronously any key that the warmup didn't get to yet.
+    const EGLint contextAttributes[] = {EGL_CONTEXT_CLIENT_VERSION, mContextClientVersion,
+                                        EGL_NONE};
+    EGLContext context =
+            eglCreateContext(mEGLDisplay, mEGLConfig, mEGLContext, contextAttributes);
+    const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    EGLSurface pbuffer = context == EGL_NO_CONTEXT
+            ? EGL_NO_SURFACE
+            : eglCreatePbufferSurface(mEGLDisplay, mPbufferConfig, pbufferAttributes);
+    if (pbuffer == EGL_NO_SURFACE) {
+        ALOGW("Failed to create the shader warmup context, priming synchronously");
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(mEGLDisplay, context);
+        }
+        ProgramCache::getInstance().primeCache(hasWideColor);
+        return;
+    }
+
+    std::thread([display = mEGLDisplay, context, pbuffer, hasWideColor]() {
+        pthread_setname_np(pthread_self(), "ShaderWarmup");
+        if (eglMakeCurrent(display, pbuffer, pbuffer, context)) {
+            ProgramCache::getInstance().primeCache(hasWideColor, /*sharedContext*/ true);
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        } else {
+            ALOGE("Failed to make the shader warmup context current");
+        }
+        eglDestroySurface(display, pbuffer);
+        eglDestroyContext(display, context);
+        eglReleaseThread();
+    }).detach();
 }
 
 // ---------------------------------------------------------------------------
@@ -56,7 +56,8 @@ class RenderEngine;
 class RenderEngine {
 public:
     enum FeatureFlag {
-        WIDE_COLOR_SUPPORT = 1 << 0 // Platform has a wide color display
+        WIDE_COLOR_SUPPORT = 1 << 0, // Platform has a wide color display
+        ASYNC_PRIME_CACHE = 1 << 1,  // Prime the shader cache from a worker thread
     };
 
     virtual ~RenderEngine() = 0;
@@ -169,6 +170,11 @@ class RenderEngine : public RE::RenderEngine {
     EGLContext mEGLContext;
     void setEGLHandles(EGLDisplay display, EGLConfig config, EGLContext ctxt);
 
+    // Used to create the context sharing mEGLContext that primes the shader
+    // cache when ASYNC_PRIME_CACHE is set
+    EGLConfig mPbufferConfig = EGL_NO_CONFIG;
+    EGLint mContextClientVersion = 0;
+
     static bool overrideUseContextPriorityFromConfig(bool useContextPriority);
 
 protected:
@@ -16,8 +16,12 @@
 
 #include "Surface.h"
 
+#include "GLExtensions.h"
 #include "RenderEngine.h"
 
+#include <vector>
+
+#include <EGL/eglext.h>
 #include <log/log.h>
 
 namespace android {
@@ -52,7 +56,33 @@ void Surface::setNativeWindow(ANativeWindow* window) {
 }
 
 void Surface::swapBuffers() const {
-    if (!eglSwapBuffers(mEGLDisplay, mEGLSurface)) {
+    checkSwapBuffers(eglSwapBuffers(mEGLDisplay, mEGLSurface));
+}
+
+void Surface::swapBuffersWithDamage(const Region& damage) const {
+    if (damage.isEmpty() || !GLExtensions::getInstance().hasSwapBuffersWithDamage()) {
+        swapBuffers();
+        return;
+    }
+
+    // EGL wants the damage rectangles with a bottom-left origin
+    const int32_t height = queryHeight();
+    size_t count;
+    const Rect* rects = damage.getArray(&count);
+    std::vector<EGLint> eglRects;
+    eglRects.reserve(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        eglRects.push_back(rects[i].left);
+        eglRects.push_back(height - rects[i].bottom);
+        eglRects.push_back(rects[i].getWidth());
+        eglRects.push_back(rects[i].getHeight());
+    }
+    checkSwapBuffers(eglSwapBuffersWithDamageKHR(mEGLDisplay, mEGLSurface, eglRects.data(),
+                                                 static_cast<EGLint>(count)));
+}
+
+void Surface::checkSwapBuffers(EGLBoolean result) const {
+    if (!result) {
         EGLint error = eglGetError();
 
         const char format[] = "eglSwapBuffers(%p, %p) failed with 0x%08x";
@@ -82,6 +112,13 @@ EGLint Surface::querySurface(EGLint attrib) const {
     return value;
 }
 
+int32_t Surface::queryBufferAge() const {
+    if (!GLExtensions::getInstance().hasBufferAge()) {
+        return 0;
+    }
+    return querySurface(EGL_BUFFER_AGE_EXT);
+}
+
 int32_t Surface::queryRedSize() const {
     return queryConfig(EGL_RED_SIZE);
 }
@@ -20,6 +20,8 @@
 
 #include <EGL/egl.h>
 
+#include <ui/Region.h>
+
 struct ANativeWindow;
 
 namespace android {
@@ -34,6 +36,12 @@ public:
 
     virtual void setNativeWindow(ANativeWindow* window) = 0;
     virtual void swapBuffers() const = 0;
+    // damage is in screen space with a top-left origin; an empty damage
+    // region means the whole surface
+    virtual void swapBuffersWithDamage(const Region& damage) const = 0;
+
+    // age of the back buffer in frames, or 0 when its content is undefined
+    virtual int32_t queryBufferAge() const = 0;
 
     virtual int32_t queryRedSize() const = 0;
     virtual int32_t queryGreenSize() const = 0;
@@ -62,6 +70,9 @@ public:
 
     void setNativeWindow(ANativeWindow* window) override;
     void swapBuffers() const override;
+    void swapBuffersWithDamage(const Region& damage) const override;
+
+    int32_t queryBufferAge() const override;
 
     int32_t queryRedSize() const override;
     int32_t queryGreenSize() const override;
@@ -74,6 +85,7 @@ public:
 private:
     EGLint queryConfig(EGLint attrib) const;
     EGLint querySurface(EGLint attrib) const;
+    void checkSwapBuffers(EGLBoolean result) const;
 
     // methods internal to RenderEngine
     friend class RenderEngine;
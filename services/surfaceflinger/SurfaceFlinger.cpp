@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <algorithm>
 #include <errno.h>
+#include <future>
 #include <math.h>
 #include <mutex>
 #include <dlfcn.h>
@@ -57,6 +58,7 @@
 #include <utils/StopWatch.h>
 #include <utils/Timers.h>
 #include <utils/Trace.h>
+#include <tracering/TraceRing.h>
 
 #include <private/android_filesystem_config.h>
 #include <private/gui/SyncFeatures.h>
@@ -84,7 +86,9 @@
 
 #include "Effects/Daltonizer.h"
 
+#include "RenderEngine/Mesh.h"
 #include "RenderEngine/RenderEngine.h"
+#include "RenderEngine/Texture.h"
 #include <cutils/compiler.h>
 
 #include <android/hardware/configstore/1.0/ISurfaceFlingerConfigs.h>
@@ -319,9 +323,48 @@ SurfaceFlinger::SurfaceFlinger() : SurfaceFlinger(SkipInitialization) {
     mPropagateBackpressure = !atoi(value);
     ALOGI_IF(!mPropagateBackpressure, "Disabling backpressure propagation");
 
-    property_get("debug.sf.enable_hwc_vds", value, "0");
+    // HWC composition of virtual displays saves a GLES composition per frame
+    // for screen recording and casting, so use it whenever the HWC can.
+    property_get("debug.sf.enable_hwc_vds", value, "1");
     mUseHwcVirtualDisplays = atoi(value);
-    ALOGI_IF(!mUseHwcVirtualDisplays, "Enabling HWC virtual displays");
+    ALOGI_IF(!mUseHwcVirtualDisplays, "Disabling HWC virtual displays");
+
+    property_get("debug.sf.incremental_visible_regions", value, "0");
+    mUseIncrementalVisibleRegions = atoi(value);
+    ALOGI_IF(mUseIncrementalVisibleRegions, "Enabling incremental visible region computation");
+
+    property_get("debug.sf.parallel_display_composition", value, "0");
+    mParallelDisplayComposition = atoi(value);
+    ALOGI_IF(mParallelDisplayComposition, "Enabling parallel per-display composition");
+
+    property_get("debug.sf.parallel_latch", value, "0");
+    mParallelLatch = atoi(value);
+    ALOGI_IF(mParallelLatch, "Enabling parallel buffer latching");
+
+    property_get("debug.sf.image_cache_kb", value, "65536");
+    const size_t imageCacheBytes = size_t(std::max(0, atoi(value))) * 1024;
+    if (imageCacheBytes > 0) {
+        mImageCache = std::make_unique<ImageCache>(imageCacheBytes);
+    }
+
+    property_get("debug.sf.buffer_queue_pool_size", value, "2");
+    const int bufferQueuePoolSize = atoi(value);
+    if (bufferQueuePoolSize > 0) {
+        mBufferQueuePool = std::make_unique<BufferQueuePool>(bufferQueuePoolSize);
+    }
+
+    property_get("debug.sf.client_composition_cache_frames", value, "0");
+    mClientCompositionCacheFrames = atoi(value);
+    ALOGI_IF(mClientCompositionCacheFrames, "Flattening client composition after %u static frames",
+             mClientCompositionCacheFrames);
+
+    property_get("debug.sf.partial_update", value, "0");
+    mUsePartialUpdate = atoi(value);
+    ALOGI_IF(mUsePartialUpdate, "Enabling partial updates of the client target");
+
+    property_get("debug.sf.transaction_inbox", value, "0");
+    mUseTransactionInbox = atoi(value);
+    ALOGI_IF(mUseTransactionInbox, "Enabling asynchronous transaction coalescing");
 
     property_get("ro.sf.disable_triple_buffer", value, "1");
     mLayerTripleBufferingDisabled = atoi(value);
@@ -337,6 +380,20 @@ SurfaceFlinger::SurfaceFlinger() : SurfaceFlinger(SkipInitialization) {
     mVsyncModulator.setPhaseOffsets(sfVsyncPhaseOffsetNs - earlyWakeupOffsetOffsetNs,
             sfVsyncPhaseOffsetNs);
 
+    property_get("debug.sf.adaptive_phase_offset", value, "0");
+    const bool adaptivePhaseOffset = atoi(value);
+    property_get("debug.sf.adaptive_phase_offset_headroom_ns", value, "2000000");
+    mVsyncModulator.setAdaptive(adaptivePhaseOffset, atoi(value));
+    ALOGI_IF(adaptivePhaseOffset, "Enabling adaptive phase offset");
+
+    // Keeps the last layer states around, so that they can be dumped after a missed frame.
+    const int32_t flightRecorderKb =
+            property_get_int32("debug.sf.layer_trace_flight_recorder_kb", 0);
+    if (flightRecorderKb > 0) {
+        mTracing.enableFlightRecorder(size_t(flightRecorderKb) * 1024);
+        ALOGI("Enabling layer trace flight recorder, %d KiB", flightRecorderKb);
+    }
+
     // We should be reading 'persist.sys.sf.color_saturation' here
     // but since /data may be encrypted, we need to wait until after vold
     // comes online to attempt to read the property. The property is
@@ -483,7 +540,7 @@ void SurfaceFlinger::bootFinished()
     sp<LambdaMessage> readProperties = new LambdaMessage([&]() {
         readPersistentProperties();
     });
-    postMessageAsync(readProperties);
+    postMessageAsync(readProperties, 0, MessageQueue::BACKGROUND);
 }
 
 void SurfaceFlinger::deleteTextureAsync(uint32_t texture) {
@@ -498,7 +555,8 @@ void SurfaceFlinger::deleteTextureAsync(uint32_t texture) {
             return true;
         }
     };
-    postMessageAsync(new MessageDestroyGLTexture(getRenderEngine(), texture));
+    postMessageAsync(new MessageDestroyGLTexture(getRenderEngine(), texture), 0,
+                     MessageQueue::BACKGROUND);
 }
 
 class DispSyncSource final : public VSyncSource, private DispSync::Callback {
@@ -640,8 +698,32 @@ void SurfaceFlinger::init() {
 
     ALOGI("Phase offest NS: %" PRId64 "", vsyncPhaseOffsetNs);
 
+    // Frames are always traced into the in-process trace rings, for post-hoc debugging.
+    TraceRing::init();
+
     Mutex::Autolock _l(mStateLock);
 
+    // Time each phase of the initialization, for the log and dumpsys
+    const nsecs_t initStartTime = systemTime();
+    nsecs_t phaseStartTime = initStartTime;
+    auto endInitPhase = [&](const char* name) {
+        const nsecs_t now = systemTime();
+        mInitPhases.push_back({name, now - phaseStartTime});
+        phaseStartTime = now;
+    };
+
+    // Connecting to the composer HAL waits for its service to come up, and
+    // doesn't depend on anything else here: do it while the EventThreads and
+    // the RenderEngine are set up.
+    LOG_ALWAYS_FATAL_IF(mVrFlingerRequestsDisplay,
+            "Starting with vr flinger active is not currently supported.");
+    std::future<std::unique_ptr<Hwc2::Composer>> composer =
+            std::async(std::launch::async, [serviceName = getBE().mHwcServiceName]() {
+                ATRACE_NAME("connect composer");
+                return std::unique_ptr<Hwc2::Composer>(
+                        std::make_unique<Hwc2::impl::Composer>(serviceName));
+            });
+
     // start the EventThread
     mEventThreadSource =
             std::make_unique<DispSyncSource>(&mPrimaryDispSync, SurfaceFlinger::vsyncPhaseOffsetNs,
@@ -663,19 +745,23 @@ void SurfaceFlinger::init() {
                                                 "sfEventThread");
     mEventQueue->setEventThread(mSFEventThread.get());
     mVsyncModulator.setEventThread(mSFEventThread.get());
+    endInitPhase("event threads");
 
     // Get a RenderEngine for the given display / config (can't fail)
+    uint32_t renderEngineFeatures = 0;
+    if (hasWideColorDisplay) {
+        renderEngineFeatures |= RE::RenderEngine::WIDE_COLOR_SUPPORT;
+    }
+    if (property_get_bool("debug.sf.async_prime_cache", false)) {
+        renderEngineFeatures |= RE::RenderEngine::ASYNC_PRIME_CACHE;
+    }
     getBE().mRenderEngine =
-            RE::impl::RenderEngine::create(HAL_PIXEL_FORMAT_RGBA_8888,
-                                           hasWideColorDisplay
-                                                   ? RE::RenderEngine::WIDE_COLOR_SUPPORT
-                                                   : 0);
+            RE::impl::RenderEngine::create(HAL_PIXEL_FORMAT_RGBA_8888, renderEngineFeatures);
     LOG_ALWAYS_FATAL_IF(getBE().mRenderEngine == nullptr, "couldn't create RenderEngine");
+    endInitPhase("render engine");
 
-    LOG_ALWAYS_FATAL_IF(mVrFlingerRequestsDisplay,
-            "Starting with vr flinger active is not currently supported.");
-    getBE().mHwc.reset(
-            new HWComposer(std::make_unique<Hwc2::impl::Composer>(getBE().mHwcServiceName)));
+    getBE().mHwc.reset(new HWComposer(composer.get()));
+    endInitPhase("composer (after render engine)");
     getBE().mHwc->registerCallback(this, getBE().mComposerSequenceId);
     // Process any initial hotplug and resulting display changes.
     processDisplayHotplugEventsLocked();
@@ -685,6 +771,7 @@ void SurfaceFlinger::init() {
     // make the default display GLContext current so that we can create textures
     // when creating Layers (which may happens before we render something)
     getDefaultDisplayDeviceLocked()->makeCurrent();
+    endInitPhase("primary display");
 
     if (useVrFlinger) {
         auto vrFlingerRequestDisplayCallback = [this] (bool requestDisplay) {
@@ -717,8 +804,7 @@ void SurfaceFlinger::init() {
 
     // set initial conditions (e.g. unblank default device)
     initializeDisplays();
-
-    getBE().mRenderEngine->primeCache();
+    endInitPhase("initialize displays");
 
     // Inform native graphics APIs whether the present timestamp is supported:
     if (getHwComposer().hasCapability(
@@ -728,14 +814,24 @@ void SurfaceFlinger::init() {
         mStartPropertySetThread = new StartPropertySetThread(true);
     }
 
+    // The boot animation only needs the property set to start, so let it
+    // launch while the programs are compiled. Its first requests wait for
+    // the main thread like any other client.
     if (mStartPropertySetThread->Start() != NO_ERROR) {
         ALOGE("Run StartPropertySetThread failed!");
     }
 
+    getBE().mRenderEngine->primeCache();
+    endInitPhase("program cache");
+
     mLegacySrgbSaturationMatrix = getBE().mHwc->getDataspaceSaturationMatrix(HWC_DISPLAY_PRIMARY,
             Dataspace::SRGB_LINEAR);
 
-    ALOGV("Done initializing");
+    String8 phases;
+    for (const auto& phase : mInitPhases) {
+        phases.appendFormat(" %s=%.1fms", phase.first, phase.second / 1e6);
+    }
+    ALOGI("Initialized in %.1fms:%s", (systemTime() - initStartTime) / 1e6, phases.string());
 }
 
 void SurfaceFlinger::readPersistentProperties() {
@@ -1243,13 +1339,13 @@ void SurfaceFlinger::signalRefresh() {
 }
 
 status_t SurfaceFlinger::postMessageAsync(const sp<MessageBase>& msg,
-        nsecs_t reltime, uint32_t /* flags */) {
-    return mEventQueue->postMessage(msg, reltime);
+        nsecs_t reltime, uint32_t flags) {
+    return mEventQueue->postMessage(msg, reltime, flags);
 }
 
 status_t SurfaceFlinger::postMessageSync(const sp<MessageBase>& msg,
-        nsecs_t reltime, uint32_t /* flags */) {
-    status_t res = mEventQueue->postMessage(msg, reltime);
+        nsecs_t reltime, uint32_t flags) {
+    status_t res = mEventQueue->postMessage(msg, reltime, flags);
     if (res == NO_ERROR) {
         msg->wait();
     }
@@ -1475,6 +1571,7 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
     ATRACE_CALL();
     switch (what) {
         case MessageQueue::INVALIDATE: {
+            mFrameStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
             bool frameMissed = !mHadClientComposition &&
                     mPreviousPresentFence != Fence::NO_FENCE &&
                     (mPreviousPresentFence->getSignalTime() ==
@@ -1482,7 +1579,9 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
             ATRACE_INT("FrameMissed", static_cast<int>(frameMissed));
             if (frameMissed) {
                 mTimeStats.incrementMissedFrames();
+                mTracing.onFrameMissed();
                 if (mPropagateBackpressure) {
+                    mFrameStartTime = 0;
                     signalLayerUpdate();
                     break;
                 }
@@ -1501,6 +1600,8 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
                 // a new buffer was latched, or if HWC has requested a full
                 // repaint
                 signalRefresh();
+            } else {
+                mFrameStartTime = 0;
             }
             break;
         }
@@ -1512,6 +1613,9 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
 }
 
 bool SurfaceFlinger::handleMessageTransaction() {
+    if (mUseTransactionInbox) {
+        applyQueuedTransactions();
+    }
     uint32_t transactionFlags = peekTransactionFlags();
     if (transactionFlags) {
         handleTransaction(transactionFlags);
@@ -1522,24 +1626,35 @@ bool SurfaceFlinger::handleMessageTransaction() {
 
 bool SurfaceFlinger::handleMessageInvalidate() {
     ATRACE_CALL();
+    TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::HandlePageFlip);
     return handlePageFlip();
 }
 
 void SurfaceFlinger::handleMessageRefresh() {
     ATRACE_CALL();
+    TRACE_RING_CALL();
 
     mRefreshPending = false;
 
     nsecs_t refreshStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     preComposition(refreshStartTime);
-    rebuildLayerStacks();
-    setUpHWComposer();
+    {
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::RebuildLayerStacks);
+        rebuildLayerStacks();
+    }
+    {
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::SetUpHWComposer);
+        setUpHWComposer();
+    }
     doDebugFlashRegions();
     doTracing("handleRefresh");
     logLayerStats();
     doComposition();
-    postComposition(refreshStartTime);
+    {
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::PostComposition);
+        postComposition(refreshStartTime);
+    }
 
     mPreviousPresentFence = getBE().mHwc->getPresentFence(HWC_DISPLAY_PRIMARY);
 
@@ -1549,7 +1664,11 @@ void SurfaceFlinger::handleMessageRefresh() {
         mHadClientComposition = mHadClientComposition ||
                 getBE().mHwc->hasClientComposition(displayDevice->getHwcDisplayId());
     }
-    mVsyncModulator.onRefreshed(mHadClientComposition);
+    const nsecs_t frameStartTime = mFrameStartTime != 0 ? mFrameStartTime : refreshStartTime;
+    mFrameStartTime = 0;
+    mVsyncModulator.onRefreshed(mHadClientComposition,
+                                systemTime(SYSTEM_TIME_MONOTONIC) - frameStartTime,
+                                mPrimaryDispSync.getPeriod());
 
     mLayersWithQueuedFrames.clear();
 }
@@ -1568,7 +1687,7 @@ void SurfaceFlinger::doDebugFlashRegions()
             const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
             if (!dirtyRegion.isEmpty()) {
                 // redraw the whole screen
-                doComposeSurfaces(hw);
+                doComposeSurfaces(hw, Region(hw->bounds()));
 
                 // and draw the dirty region
                 const int32_t height = hw->getHeight();
@@ -1603,7 +1722,7 @@ void SurfaceFlinger::doDebugFlashRegions()
 void SurfaceFlinger::doTracing(const char* where) {
     ATRACE_CALL();
     ATRACE_NAME(where);
-    if (CC_UNLIKELY(mTracing.isEnabled())) {
+    if (CC_UNLIKELY(mTracing.isRecording())) {
         mTracing.traceLayers(where, dumpProtoInfo(LayerVector::StateSet::Drawing));
     }
 }
@@ -1750,8 +1869,7 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
         bool frameLatched = layer->onPostComposition(glCompositionDoneFenceTime,
                 presentFenceTime, compositorTiming);
         if (frameLatched) {
-            recordBufferingStats(layer->getName().string(),
-                    layer->getOccupancyHistory(false));
+            recordBufferingStats(layer, layer->getOccupancyHistory(false));
         }
     });
 
@@ -1821,17 +1939,19 @@ void SurfaceFlinger::rebuildLayerStacks() {
         mVisibleRegionsDirty = false;
         invalidateHwcGeometry();
 
+        std::vector<Region> dirtyRegions(mDisplays.size());
+        std::vector<Region> opaqueRegions(mDisplays.size());
+        computeDisplaysVisibleRegions(dirtyRegions, opaqueRegions);
+
         for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
-            Region opaqueRegion;
-            Region dirtyRegion;
+            const Region& opaqueRegion(opaqueRegions[dpy]);
+            const Region& dirtyRegion(dirtyRegions[dpy]);
             Vector<sp<Layer>> layersSortedByZ;
             Vector<sp<Layer>> layersNeedingFences;
             const sp<DisplayDevice>& displayDevice(mDisplays[dpy]);
             const Transform& tr(displayDevice->getTransform());
             const Rect bounds(displayDevice->getBounds());
             if (displayDevice->isDisplayOn()) {
-                computeVisibleRegions(displayDevice, dirtyRegion, opaqueRegion);
-
                 mDrawingState.traverseInZOrder([&](Layer* layer) {
                     bool hwcLayerDestroyed = false;
                     if (layer->belongsToDisplay(displayDevice->getLayerStack(),
@@ -1878,6 +1998,54 @@ void SurfaceFlinger::rebuildLayerStacks() {
     }
 }
 
+void SurfaceFlinger::computeDisplaysVisibleRegions(std::vector<Region>& outDirtyRegions,
+        std::vector<Region>& outOpaqueRegions) {
+    ATRACE_CALL();
+
+    // Displays showing distinct layer stacks never share a layer, so their
+    // visible regions can be computed concurrently. Mirrored displays write
+    // to the same layers and are always computed serially.
+    std::vector<size_t> displaysOn;
+    bool parallel = mParallelDisplayComposition;
+    for (size_t dpy = 0; dpy < mDisplays.size(); dpy++) {
+        const sp<DisplayDevice>& displayDevice(mDisplays[dpy]);
+        if (!displayDevice->isDisplayOn()) {
+            continue;
+        }
+        for (size_t other : displaysOn) {
+            if (mDisplays[other]->getLayerStack() == displayDevice->getLayerStack()) {
+                parallel = false;
+            }
+        }
+        displaysOn.push_back(dpy);
+    }
+
+    auto compute = [&](size_t dpy) {
+        const sp<DisplayDevice>& displayDevice(mDisplays[dpy]);
+        ATRACE_NAME(String8::format("computeVisibleRegions %s",
+                displayDevice->getDisplayName().string()).string());
+        computeVisibleRegions(displayDevice, outDirtyRegions[dpy], outOpaqueRegions[dpy]);
+    };
+
+    if (!parallel || displaysOn.size() < 2) {
+        for (size_t dpy : displaysOn) {
+            compute(dpy);
+        }
+        return;
+    }
+
+    // The first display is computed on the main thread while the other ones
+    // are handed out to worker threads, joined before returning.
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < displaysOn.size(); i++) {
+        workers.push_back(std::async(std::launch::async, compute, displaysOn[i]));
+    }
+    compute(displaysOn[0]);
+    for (auto& worker : workers) {
+        worker.get();
+    }
+}
+
 // Returns a data space that fits all visible layers.  The returned data space
 // can only be one of
 //  - Dataspace::SRGB (use legacy dataspace and let HWC saturate when colors are enhanced)
@@ -2024,8 +2192,9 @@ void SurfaceFlinger::setUpHWComposer() {
         if (hwcId < 0) {
             continue;
         }
-        if (mDrawingState.colorMatrixChanged) {
-            displayDevice->setColorTransform(mDrawingState.colorMatrix);
+        if (displayDevice->getColorTransformVersion() != mDrawingState.colorMatrixVersion) {
+            displayDevice->setColorTransform(mDrawingState.colorMatrix,
+                                             mDrawingState.colorMatrixVersion);
             status_t result = getBE().mHwc->setColorTransform(hwcId, mDrawingState.colorMatrix);
             ALOGE_IF(result != NO_ERROR, "Failed to set color transform on "
                     "display %zd: %d", displayId, result);
@@ -2061,14 +2230,13 @@ void SurfaceFlinger::setUpHWComposer() {
         }
     }
 
-    mDrawingState.colorMatrixChanged = false;
-
     for (size_t displayId = 0; displayId < mDisplays.size(); ++displayId) {
         auto& displayDevice = mDisplays[displayId];
         if (!displayDevice->isDisplayOn()) {
             continue;
         }
 
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::HwcValidate);
         status_t result = displayDevice->prepareFrame(*getBE().mHwc);
         ALOGE_IF(result != NO_ERROR, "prepareFrame for display %zd failed:"
                 " %d (%s)", displayId, result, strerror(-result));
@@ -2104,15 +2272,26 @@ void SurfaceFlinger::postFramebuffer()
     const nsecs_t now = systemTime();
     mDebugInSwapBuffers = now;
 
+    // Present all displays with a single round-trip to HWC.
+    std::vector<int32_t> hwcIds;
+    for (size_t displayId = 0; displayId < mDisplays.size(); ++displayId) {
+        auto& displayDevice = mDisplays[displayId];
+        const auto hwcId = displayDevice->getHwcDisplayId();
+        if (displayDevice->isDisplayOn() && hwcId >= 0) {
+            hwcIds.push_back(hwcId);
+        }
+    }
+    if (!hwcIds.empty()) {
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::HwcPresent);
+        getBE().mHwc->presentAndGetReleaseFences(hwcIds);
+    }
+
     for (size_t displayId = 0; displayId < mDisplays.size(); ++displayId) {
         auto& displayDevice = mDisplays[displayId];
         if (!displayDevice->isDisplayOn()) {
             continue;
         }
         const auto hwcId = displayDevice->getHwcDisplayId();
-        if (hwcId >= 0) {
-            getBE().mHwc->presentAndGetReleaseFences(hwcId);
-        }
         displayDevice->onSwapBuffersCompleted();
         displayDevice->makeCurrent();
         for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
@@ -2355,6 +2534,7 @@ void SurfaceFlinger::processDisplayChangesLocked() {
     const KeyedVector<wp<IBinder>, DisplayDeviceState>& draw(mDrawingState.displays);
     if (!curr.isIdenticalTo(draw)) {
         mVisibleRegionsDirty = true;
+        mVisibilityCacheGeneration++;
         const size_t cc = curr.size();
         size_t dc = draw.size();
 
@@ -2445,6 +2625,23 @@ void SurfaceFlinger::processDisplayChangesLocked() {
                             auto format = static_cast<ui::PixelFormat>(intFormat);
 
                             getBE().mHwc->allocateVirtualDisplay(width, height, &format, &hwcId);
+
+                            // A sink that touches the pixels with the CPU gets buffers in the
+                            // format it asked for, so the HWC can only write to it if it
+                            // accepted that format. Otherwise compose with GLES.
+                            int usage = 0;
+                            status = state.surface->query(NATIVE_WINDOW_CONSUMER_USAGE_BITS,
+                                                          &usage);
+                            ALOGE_IF(status != NO_ERROR, "Unable to query usage (%d)", status);
+                            if (hwcId >= 0 && static_cast<int>(format) != intFormat &&
+                                (usage &
+                                 (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK))) {
+                                ALOGI("HWC can't write format %d for virtual display %s, "
+                                      "using GLES",
+                                      intFormat, state.displayName.string());
+                                getBE().mHwc->disconnectDisplay(hwcId);
+                                hwcId = -1;
+                            }
                         }
 
                         // TODO: Plumb requested format back up to consumer
@@ -2636,8 +2833,7 @@ void SurfaceFlinger::commitTransaction()
     if (!mLayersPendingRemoval.isEmpty()) {
         // Notify removed layers now that they can't be drawn from
         for (const auto& l : mLayersPendingRemoval) {
-            recordBufferingStats(l->getName().string(),
-                    l->getOccupancyHistory(true));
+            recordBufferingStats(l.get(), l->getOccupancyHistory(true));
             l->onRemoved();
         }
         mLayersPendingRemoval.clear();
@@ -2648,12 +2844,13 @@ void SurfaceFlinger::commitTransaction()
     mAnimCompositionPending = mAnimTransactionPending;
 
     mDrawingState = mCurrentState;
-    // clear the "changed" flags in current state
-    mCurrentState.colorMatrixChanged = false;
 
     mDrawingState.traverseInZOrder([](Layer* layer) {
         layer->commitChildList();
     });
+    // the children lists and the Z order now stay the same until the next commit
+    mDrawingState.updateTraversalLists();
+    invalidateLayerGeometry();
     mTransactionPending = false;
     mAnimTransactionPending = false;
     mTransactionCV.broadcast();
@@ -2671,6 +2868,14 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
 
     outDirtyRegion.clear();
 
+    // The visibility of a layer only depends on the layer itself and on the
+    // layers above it. In incremental mode, as long as nothing changed from
+    // the top of the stack down to the current layer, the regions computed
+    // during the previous pass are still correct and are reused as is.
+    bool aboveChanged = !mUseIncrementalVisibleRegions;
+    const Layer* layerAbove = nullptr;
+    int32_t reusedLayers = 0;
+
     mDrawingState.traverseInReverseZOrder([&](Layer* layer) {
         // start with the whole surface at its current location
         const Layer::State& s(layer->getDrawingState());
@@ -2679,6 +2884,57 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
         if (!layer->belongsToDisplay(displayDevice->getLayerStack(), displayDevice->isPrimary()))
             return;
 
+        const bool visible = layer->isVisible();
+        const bool translucent = !layer->isOpaque(s);
+        const bool opaqueAlpha = layer->getAlpha() == 1.0f;
+        Rect bounds;
+        Transform tr;
+        if (CC_LIKELY(visible)) {
+            bounds = layer->computeScreenBounds();
+            tr = layer->getTransform();
+        }
+
+        Layer::VisibilityCache& cache(layer->visibilityCache);
+        if (!aboveChanged) {
+            if (cache.valid && cache.generation == mVisibilityCacheGeneration &&
+                    cache.display == displayDevice.get() && cache.layerAbove == layerAbove &&
+                    cache.visible == visible && cache.translucent == translucent &&
+                    cache.opaqueAlpha == opaqueAlpha && cache.bounds == bounds &&
+                    cache.transform == tr &&
+                    cache.transparentRegion.isTriviallyEqual(s.activeTransparentRegion)) {
+                // Nothing this layer depends on has changed: only its content
+                // may need to be redrawn.
+                if (layer->contentDirty) {
+                    outDirtyRegion.orSelf(layer->visibleRegion);
+                    layer->contentDirty = false;
+                } else if (!layer->coveredRegion.isEmpty()) {
+                    outDirtyRegion.orSelf(layer->visibleRegion.intersect(layer->coveredRegion));
+                }
+                aboveOpaqueLayers = cache.aboveOpaqueLayers;
+                aboveCoveredLayers = cache.aboveCoveredLayers;
+                layerAbove = layer;
+                reusedLayers++;
+                return;
+            }
+            aboveChanged = true;
+        }
+
+        // Remember the inputs of this pass; the accumulated regions are filled
+        // in once this layer has been processed.
+        if (mUseIncrementalVisibleRegions) {
+            cache.valid = true;
+            cache.generation = mVisibilityCacheGeneration;
+            cache.display = displayDevice.get();
+            cache.layerAbove = layerAbove;
+            cache.visible = visible;
+            cache.translucent = translucent;
+            cache.opaqueAlpha = opaqueAlpha;
+            cache.bounds = bounds;
+            cache.transform = tr;
+            cache.transparentRegion = s.activeTransparentRegion;
+        }
+        layerAbove = layer;
+
         /*
          * opaqueRegion: area of a surface that is fully opaque.
          */
@@ -2710,11 +2966,8 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
 
 
         // handle hidden surfaces by setting the visible region to empty
-        if (CC_LIKELY(layer->isVisible())) {
-            const bool translucent = !layer->isOpaque(s);
-            Rect bounds(layer->computeScreenBounds());
+        if (CC_LIKELY(visible)) {
             visibleRegion.set(bounds);
-            Transform tr = layer->getTransform();
             if (!visibleRegion.isEmpty()) {
                 // Remove the transparent area from the visible region
                 if (translucent) {
@@ -2730,7 +2983,7 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
 
                 // compute the opaque region
                 const int32_t layerOrientation = tr.getOrientation();
-                if (layer->getAlpha() == 1.0f && !translucent &&
+                if (opaqueAlpha && !translucent &&
                         ((layerOrientation & Transform::ROT_INVALID) == false)) {
                     // the opaque region is the layer's footprint
                     opaqueRegion = visibleRegion;
@@ -2740,6 +2993,10 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
 
         if (visibleRegion.isEmpty()) {
             layer->clearVisibilityRegions();
+            if (mUseIncrementalVisibleRegions) {
+                cache.aboveOpaqueLayers = aboveOpaqueLayers;
+                cache.aboveCoveredLayers = aboveCoveredLayers;
+            }
             return;
         }
 
@@ -2791,8 +3048,17 @@ void SurfaceFlinger::computeVisibleRegions(const sp<const DisplayDevice>& displa
         layer->setCoveredRegion(coveredRegion);
         layer->setVisibleNonTransparentRegion(
                 visibleRegion.subtract(transparentRegion));
+
+        if (mUseIncrementalVisibleRegions) {
+            cache.aboveOpaqueLayers = aboveOpaqueLayers;
+            cache.aboveCoveredLayers = aboveCoveredLayers;
+        }
     });
 
+    if (mUseIncrementalVisibleRegions) {
+        ATRACE_INT("VisibleRegionsReusedLayers", reusedLayers);
+    }
+
     outOpaqueRegion = aboveOpaqueLayers;
 }
 
@@ -2837,8 +3103,17 @@ bool SurfaceFlinger::handlePageFlip()
         }
     });
 
+    prepareLatches();
+
     for (auto& layer : mLayersWithQueuedFrames) {
-        const Region dirty(layer->latchBuffer(visibleRegions, latchTime));
+        // Each layer gets its own flag, so that BufferLayer::latchBuffer only invalidates the
+        // cached geometry of the layers when the geometry of that layer changed.
+        bool layerVisibleRegions = false;
+        const Region dirty(layer->latchBuffer(layerVisibleRegions, latchTime));
+        if (layerVisibleRegions) {
+            invalidateLayerGeometry();
+            visibleRegions = true;
+        }
         layer->useSurfaceDamage();
         invalidateLayerStack(layer, dirty);
         if (layer->isBufferLatched()) {
@@ -2864,6 +3139,34 @@ void SurfaceFlinger::invalidateHwcGeometry()
     mGeometryInvalid = true;
 }
 
+void SurfaceFlinger::prepareLatches() {
+    // Layers acquire their buffers from their own consumers, so this part of
+    // the latch can run concurrently. latchBuffer() then makes the acquired
+    // buffers current on the main thread, which owns the RenderEngine context.
+    const size_t layerCount = mLayersWithQueuedFrames.size();
+    if (!mParallelLatch || layerCount < 2) {
+        return;
+    }
+    ATRACE_CALL();
+
+    static constexpr size_t kMaxLatchWorkers = 4;
+    const size_t threadCount = std::min(layerCount, kMaxLatchWorkers);
+    auto prepare = [this, layerCount, threadCount](size_t first) {
+        for (size_t i = first; i < layerCount; i += threadCount) {
+            mLayersWithQueuedFrames[i]->prepareLatch();
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < threadCount; i++) {
+        workers.push_back(std::async(std::launch::async, prepare, i));
+    }
+    prepare(0);
+    for (auto& worker : workers) {
+        worker.get();
+    }
+}
+
 
 void SurfaceFlinger::doDisplayComposition(
         const sp<const DisplayDevice>& displayDevice,
@@ -2880,13 +3183,17 @@ void SurfaceFlinger::doDisplayComposition(
     }
 
     ALOGV("doDisplayComposition");
-    if (!doComposeSurfaces(displayDevice)) return;
+    {
+        TimeStats::ScopedStage stage(mTimeStats, TimeStats::CompositionStage::ComposeSurfaces);
+        if (!doComposeSurfaces(displayDevice, inDirtyRegion)) return;
+    }
 
     // swap buffers (presentation)
     displayDevice->swapBuffers(getHwComposer());
 }
 
-bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDevice)
+bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDevice,
+                                       const Region& dirtyRegion)
 {
     ALOGV("doComposeSurfaces");
 
@@ -2896,6 +3203,25 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDev
     const bool hasClientComposition = getBE().mHwc->hasClientComposition(hwcId);
     ATRACE_INT("hasClientComposition", hasClientComposition);
 
+    // a layer switching between client and device composition changes the
+    // client target without showing up in the dirty region
+    const bool usePartialUpdate =
+            mUsePartialUpdate && displayDevice->getDisplayType() != DisplayDevice::DISPLAY_VIRTUAL;
+    bool compositionChanged = false;
+    if (usePartialUpdate) {
+        std::vector<DisplayDevice::LayerComposition> compositions;
+        for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
+            compositions.push_back({layer.get(), layer->getCompositionType(hwcId),
+                                    layer->getClearClientTarget(hwcId)});
+        }
+        compositionChanged = compositions != displayDevice->lastLayerCompositions;
+        displayDevice->lastLayerCompositions = std::move(compositions);
+    }
+
+    // flattening draws the whole display, so this is decided before any
+    // scissor is set up
+    const auto cacheAction = prepareClientCompositionCache(displayDevice, dirtyRegion);
+
     bool applyColorMatrix = false;
     bool needsLegacyColorMatrix = false;
     bool legacyColorMatrixApplied = false;
@@ -2937,6 +3263,23 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDev
             return false;
         }
 
+        // only redraw the part of the client target that differs from the
+        // content of the buffer we are rendering into
+        Rect repaintBounds(displayDevice->getBounds());
+        if (usePartialUpdate) {
+            const bool fullRepaint =
+                    compositionChanged || cacheAction == ClientCompositionCache::Action::Flatten;
+            repaintBounds =
+                    displayDevice->beginClientTargetUpdate(dirtyRegion, fullRepaint).getBounds();
+            ATRACE_INT("PartialUpdateArea", repaintBounds.getWidth() * repaintBounds.getHeight());
+            if (repaintBounds != displayDevice->getBounds()) {
+                const uint32_t height = displayDevice->getHeight();
+                getBE().mRenderEngine->setScissor(repaintBounds.left,
+                        height - repaintBounds.bottom, repaintBounds.getWidth(),
+                        repaintBounds.getHeight());
+            }
+        }
+
         // Never touch the framebuffer if we don't have any framebuffer layers
         if (hasDeviceComposition) {
             // when using overlays, we assume a fully transparent framebuffer
@@ -2966,11 +3309,14 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDev
             // scissor on the main display. It should never be needed
             // anyways (though in theory it could since the API allows it).
             const Rect& bounds(displayDevice->getBounds());
-            const Rect& scissor(displayDevice->getScissor());
+            Rect scissor(displayDevice->getScissor());
             if (scissor != bounds) {
                 // scissor doesn't match the screen's dimensions, so we
                 // need to clear everything outside of it and enable
                 // the GL scissor so we don't draw anything where we shouldn't
+                if (!scissor.intersect(repaintBounds, &scissor)) {
+                    scissor.clear();
+                }
 
                 // enable scissor for this frame
                 const uint32_t height = displayDevice->getHeight();
@@ -2986,51 +3332,74 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDev
 
     ALOGV("Rendering client layers");
     const Transform& displayTransform = displayDevice->getTransform();
-    bool firstLayer = true;
-    for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
-        const Region clip(bounds.intersect(
-                displayTransform.transform(layer->visibleRegion)));
-        ALOGV("Layer: %s", layer->getName().string());
-        ALOGV("  Composition type: %s",
-                to_string(layer->getCompositionType(hwcId)).c_str());
-        if (!clip.isEmpty()) {
-            switch (layer->getCompositionType(hwcId)) {
-                case HWC2::Composition::Cursor:
-                case HWC2::Composition::Device:
-                case HWC2::Composition::Sideband:
-                case HWC2::Composition::SolidColor: {
-                    const Layer::State& state(layer->getDrawingState());
-                    if (layer->getClearClientTarget(hwcId) && !firstLayer &&
-                            layer->isOpaque(state) && (state.color.a == 1.0f)
-                            && hasClientComposition) {
-                        // never clear the very first layer since we're
-                        // guaranteed the FB is already cleared
-                        layer->clearWithOpenGL(renderArea);
-                    }
-                    break;
-                }
-                case HWC2::Composition::Client: {
-                    // switch color matrices lazily
-                    if (layer->isLegacyDataSpace() && needsLegacyColorMatrix) {
-                        if (!legacyColorMatrixApplied) {
-                            getRenderEngine().setSaturationMatrix(mLegacySrgbSaturationMatrix);
-                            legacyColorMatrixApplied = true;
+    auto composeLayers = [&]() {
+        bool firstLayer = true;
+        for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
+            const Region clip(bounds.intersect(
+                    displayTransform.transform(layer->visibleRegion)));
+            ALOGV("Layer: %s", layer->getName().string());
+            ALOGV("  Composition type: %s",
+                    to_string(layer->getCompositionType(hwcId)).c_str());
+            if (!clip.isEmpty()) {
+                switch (layer->getCompositionType(hwcId)) {
+                    case HWC2::Composition::Cursor:
+                    case HWC2::Composition::Device:
+                    case HWC2::Composition::Sideband:
+                    case HWC2::Composition::SolidColor: {
+                        const Layer::State& state(layer->getDrawingState());
+                        if (layer->getClearClientTarget(hwcId) && !firstLayer &&
+                                layer->isOpaque(state) && (state.color.a == 1.0f)
+                                && hasClientComposition) {
+                            // never clear the very first layer since we're
+                            // guaranteed the FB is already cleared
+                            layer->clearWithOpenGL(renderArea);
                         }
-                    } else if (legacyColorMatrixApplied) {
-                        getRenderEngine().setSaturationMatrix(mat4());
-                        legacyColorMatrixApplied = false;
+                        break;
                     }
+                    case HWC2::Composition::Client: {
+                        // switch color matrices lazily
+                        if (layer->isLegacyDataSpace() && needsLegacyColorMatrix) {
+                            if (!legacyColorMatrixApplied) {
+                                getRenderEngine().setSaturationMatrix(mLegacySrgbSaturationMatrix);
+                                legacyColorMatrixApplied = true;
+                            }
+                        } else if (legacyColorMatrixApplied) {
+                            getRenderEngine().setSaturationMatrix(mat4());
+                            legacyColorMatrixApplied = false;
+                        }
 
-                    layer->draw(renderArea, clip);
-                    break;
+                        layer->draw(renderArea, clip);
+                        break;
+                    }
+                    default:
+                        break;
                 }
-                default:
-                    break;
+            } else {
+                ALOGV("  Skipping for empty clip");
             }
-        } else {
-            ALOGV("  Skipping for empty clip");
+            firstLayer = false;
         }
-        firstLayer = false;
+    };
+
+    switch (cacheAction) {
+        case ClientCompositionCache::Action::Flatten:
+            if (flattenClientComposition(displayDevice, composeLayers)) {
+                if (legacyColorMatrixApplied) {
+                    getRenderEngine().setSaturationMatrix(mat4());
+                    legacyColorMatrixApplied = false;
+                }
+                drawClientCompositionCache(displayDevice);
+            } else {
+                displayDevice->clientCompositionCache.invalidate();
+                composeLayers();
+            }
+            break;
+        case ClientCompositionCache::Action::Reuse:
+            drawClientCompositionCache(displayDevice);
+            break;
+        case ClientCompositionCache::Action::Compose:
+            composeLayers();
+            break;
     }
 
     if (applyColorMatrix) {
@@ -3045,6 +3414,124 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& displayDev
     return true;
 }
 
+ClientCompositionCache::Action SurfaceFlinger::prepareClientCompositionCache(
+        const sp<const DisplayDevice>& displayDevice, const Region& dirtyRegion) {
+    ClientCompositionCache& cache = displayDevice->clientCompositionCache;
+    if (mClientCompositionCacheFrames == 0) {
+        return ClientCompositionCache::Action::Compose;
+    }
+
+    // Only the client target of a display that also has device layers is
+    // worth caching: it is cleared to transparent black and carries no color
+    // transform, so a copy of the flattened layers reproduces it exactly.
+    // Secure content never leaves the client target.
+    const auto hwcId = displayDevice->getHwcDisplayId();
+    bool eligible = getBE().mHwc->hasClientComposition(hwcId) &&
+            getBE().mHwc->hasDeviceComposition(hwcId) && !displayDevice->hasWideColorGamut() &&
+            displayDevice->getScissor() == displayDevice->getBounds();
+
+    const Region bounds(displayDevice->bounds());
+    const Transform& displayTransform = displayDevice->getTransform();
+    std::vector<ClientCompositionCache::Entry> entries;
+    for (auto& layer : displayDevice->getVisibleLayersSortedByZ()) {
+        if (!eligible) break;
+        const Layer::State& state(layer->getDrawingState());
+        ClientCompositionCache::Entry entry;
+        entry.layer = layer.get();
+        entry.stateSequence = state.sequence;
+        entry.type = layer->getCompositionType(hwcId);
+        entry.clearClientTarget = layer->getClearClientTarget(hwcId) && layer->isOpaque(state) &&
+                (state.color.a == 1.0f);
+        entry.clip = bounds.intersect(displayTransform.transform(layer->visibleRegion));
+        if (entry.type == HWC2::Composition::Client && layer->isSecure()) {
+            eligible = false;
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    if (!eligible) {
+        cache.invalidate();
+        return ClientCompositionCache::Action::Compose;
+    }
+    return cache.update(std::move(entries), dirtyRegion, mClientCompositionCacheFrames);
+}
+
+bool SurfaceFlinger::flattenClientComposition(const sp<const DisplayDevice>& displayDevice,
+                                              const std::function<void()>& composeLayers) {
+    ATRACE_CALL();
+    const uint32_t width = displayDevice->getWidth();
+    const uint32_t height = displayDevice->getHeight();
+    const uint32_t usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
+    sp<GraphicBuffer> buffer = new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                                 usage, "ClientCompositionCache");
+    if (buffer->initCheck() != NO_ERROR) {
+        ALOGW("Failed to allocate client composition cache for display %s",
+              displayDevice->getDisplayName().string());
+        return false;
+    }
+
+    std::unique_ptr<RE::Image> image = getRenderEngine().createImage();
+    if (!image->setNativeWindowBuffer(buffer->getNativeBuffer(), false, width, height)) {
+        return false;
+    }
+
+    {
+        // the viewport and projection set up by makeCurrent() match the
+        // buffer, so the layers land where they would in the client target
+        RE::BindNativeBufferAsFramebuffer bufferBond(getRenderEngine(), buffer->getNativeBuffer());
+        if (bufferBond.getStatus() != NO_ERROR) {
+            ALOGW("Failed to bind client composition cache for display %s",
+                  displayDevice->getDisplayName().string());
+            return false;
+        }
+        getRenderEngine().clearWithColor(0, 0, 0, 0);
+        composeLayers();
+    }
+
+    displayDevice->clientCompositionCache.setBuffer(buffer, std::move(image));
+    return true;
+}
+
+void SurfaceFlinger::drawClientCompositionCache(const sp<const DisplayDevice>& displayDevice) {
+    ATRACE_CALL();
+    const ClientCompositionCache& cache = displayDevice->clientCompositionCache;
+    auto& engine(getRenderEngine());
+    if (mClientCompositionCacheTexture == 0) {
+        engine.genTextures(1, &mClientCompositionCacheTexture);
+    }
+
+    const float width = displayDevice->getWidth();
+    const float height = displayDevice->getHeight();
+    engine.bindExternalTextureImage(mClientCompositionCacheTexture, *cache.getImage());
+    Texture texture(Texture::TEXTURE_EXTERNAL, mClientCompositionCacheTexture);
+    texture.setDimensions(width, height);
+    texture.setFiltering(false);
+
+    // the buffer was rendered with the client target's projection, so its
+    // texels map one to one onto GL window coordinates
+    Mesh mesh(Mesh::TRIANGLE_FAN, 4, 2, 2);
+    Mesh::VertexArray<vec2> position(mesh.getPositionArray<vec2>());
+    Mesh::VertexArray<vec2> texCoords(mesh.getTexCoordArray<vec2>());
+    position[0] = vec2(0, 0);
+    position[1] = vec2(0, height);
+    position[2] = vec2(width, height);
+    position[3] = vec2(width, 0);
+    texCoords[0] = vec2(0, 0);
+    texCoords[1] = vec2(0, 1);
+    texCoords[2] = vec2(1, 1);
+    texCoords[3] = vec2(1, 0);
+
+    // the client target was cleared to transparent black, so blending the
+    // premultiplied cache over it is a plain copy
+    engine.setupLayerTexturing(texture);
+    engine.setupLayerBlending(true /* premultipliedAlpha */, false /* opaque */,
+                              false /* disableTexture */, half4(1, 1, 1, 1));
+    engine.setSourceDataSpace(Dataspace::UNKNOWN);
+    engine.drawMesh(mesh);
+    engine.disableBlending();
+    engine.disableTexturing();
+}
+
 void SurfaceFlinger::drawWormhole(const sp<const DisplayDevice>& displayDevice, const Region& region) const {
     const int32_t height = displayDevice->getHeight();
     auto& engine(getRenderEngine());
@@ -3191,19 +3678,132 @@ bool SurfaceFlinger::containsAnyInvalidClientState(const Vector<ComposerState>&
     return false;
 }
 
+bool SurfaceFlinger::canQueueTransaction(const Vector<ComposerState>& states,
+        const Vector<DisplayState>& displays, uint32_t flags) const {
+    // Only these can be merged without depending on the order in which they
+    // are applied relative to other layers or to the same transaction.
+    constexpr uint32_t coalescableChanges = layer_state_t::ePositionChanged |
+            layer_state_t::eLayerChanged | layer_state_t::eSizeChanged |
+            layer_state_t::eAlphaChanged | layer_state_t::eMatrixChanged |
+            layer_state_t::eTransparentRegionChanged | layer_state_t::eFlagsChanged |
+            layer_state_t::eLayerStackChanged | layer_state_t::eCropChanged |
+            layer_state_t::eFinalCropChanged | layer_state_t::eOverrideScalingModeChanged;
+
+    if (flags != 0 || !displays.isEmpty() || states.isEmpty()) {
+        return false;
+    }
+    for (const ComposerState& state : states) {
+        if (state.state.what & ~coalescableChanges) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SurfaceFlinger::queueTransaction(const Vector<ComposerState>& states) {
+    ATRACE_CALL();
+    bool wasEmpty;
+    {
+        Mutex::Autolock _l(mTransactionInbox.lock);
+        wasEmpty = mTransactionInbox.states.isEmpty();
+        mTransactionInbox.queuedTransactions++;
+        mTransactionInbox.queuedStates += states.size();
+        for (const ComposerState& state : states) {
+            const auto key = std::make_pair(IInterface::asBinder(state.client).get(),
+                                            state.state.surface.get());
+            auto found = mTransactionInbox.indices.find(key);
+            if (found == mTransactionInbox.indices.end()) {
+                mTransactionInbox.indices.emplace(key, mTransactionInbox.states.size());
+                mTransactionInbox.states.add(state);
+                continue;
+            }
+
+            layer_state_t& queued(mTransactionInbox.states.editItemAt(found->second).state);
+            const layer_state_t& next(state.state);
+            if ((queued.what & next.what) & layer_state_t::eFlagsChanged) {
+                // layer_state_t::merge() replaces the mask, keep the flags
+                // set by the previous transaction instead
+                const uint8_t flags = (queued.flags & ~next.mask) | (next.flags & next.mask);
+                const uint8_t mask = queued.mask | next.mask;
+                queued.merge(next);
+                queued.flags = flags;
+                queued.mask = mask;
+            } else {
+                queued.merge(next);
+            }
+        }
+    }
+    if (wasEmpty) {
+        signalTransaction();
+    }
+}
+
+void SurfaceFlinger::applyQueuedTransactions() {
+    uint32_t transactionFlags;
+    {
+        Mutex::Autolock _l(mStateLock);
+        transactionFlags = applyQueuedTransactionsLocked();
+    }
+    if (transactionFlags) {
+        setTransactionFlags(transactionFlags);
+    }
+}
+
+uint32_t SurfaceFlinger::applyQueuedTransactionsLocked() {
+    Vector<ComposerState> states;
+    {
+        Mutex::Autolock _l(mTransactionInbox.lock);
+        if (mTransactionInbox.states.isEmpty()) {
+            return 0;
+        }
+        states = mTransactionInbox.states;
+        mTransactionInbox.states.clear();
+        mTransactionInbox.indices.clear();
+    }
+
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+    uint32_t transactionFlags = 0;
+    for (const ComposerState& state : states) {
+        transactionFlags |= setClientStateLocked(state);
+    }
+    if (transactionFlags && mInterceptor->isEnabled()) {
+        mInterceptor->saveTransaction(states, mCurrentState.displays, Vector<DisplayState>(), 0);
+    }
+    const nsecs_t duration = systemTime() - start;
+
+    Mutex::Autolock _l(mTransactionInbox.lock);
+    mTransactionInbox.appliedStates += states.size();
+    mTransactionInbox.flushes++;
+    mTransactionInbox.totalStateLockTime += duration;
+    mTransactionInbox.maxStateLockTime = std::max(mTransactionInbox.maxStateLockTime, duration);
+    return transactionFlags;
+}
+
 void SurfaceFlinger::setTransactionState(
         const Vector<ComposerState>& states,
         const Vector<DisplayState>& displays,
         uint32_t flags)
 {
     ATRACE_CALL();
-    Mutex::Autolock _l(mStateLock);
-    uint32_t transactionFlags = 0;
 
     if (containsAnyInvalidClientState(states)) {
         return;
     }
 
+    if (mUseTransactionInbox && canQueueTransaction(states, displays, flags)) {
+        queueTransaction(states);
+        return;
+    }
+
+    Mutex::Autolock _l(mStateLock);
+    uint32_t transactionFlags = 0;
+
+    if (mUseTransactionInbox) {
+        // transactions queued earlier must be applied first
+        transactionFlags |= applyQueuedTransactionsLocked();
+    }
+
     if (flags & eAnimation) {
         // For window updates that are part of an animation we must wait for
         // previous animation "frames" to be handled.
@@ -3524,6 +4124,7 @@ status_t SurfaceFlinger::createLayer(
 
     sp<Layer> layer;
 
+    const nsecs_t startTime = systemTime();
     String8 uniqueName = getUniqueLayerName(name);
 
     switch (flags & ISurfaceComposerClient::eFXSurfaceMask) {
@@ -3544,8 +4145,10 @@ status_t SurfaceFlinger::createLayer(
     }
 
     if (result != NO_ERROR) {
+        mLayerNames.release(uniqueName, nullptr);
         return result;
     }
+    mLayerNames.bind(uniqueName, layer.get());
 
     // window type is WINDOW_TYPE_DONT_SCREENSHOT from SurfaceControl.java
     // TODO b/64227542
@@ -3558,36 +4161,32 @@ status_t SurfaceFlinger::createLayer(
 
     result = addClientLayer(client, *handle, *gbp, layer, *parent);
     if (result != NO_ERROR) {
+        mLayerNames.release(uniqueName, layer.get());
         return result;
     }
     mInterceptor->saveSurfaceCreation(layer);
 
     setTransactionFlags(eTransactionNeeded);
+
+    const nsecs_t duration = systemTime() - startTime;
+    mLayerCreationCount++;
+    mLayerCreationTotalTime += duration;
+    if (duration > mLayerCreationMaxTime) {
+        mLayerCreationMaxTime = duration;
+    }
     return result;
 }
 
 String8 SurfaceFlinger::getUniqueLayerName(const String8& name)
 {
-    bool matchFound = true;
-    uint32_t dupeCounter = 0;
-
-    // Tack on our counter whether there is a hit or not, so everyone gets a tag
-    String8 uniqueName = name + "#" + String8(std::to_string(dupeCounter).c_str());
-
-    // Loop over layers until we're sure there is no matching name
-    while (matchFound) {
-        matchFound = false;
-        mDrawingState.traverseInZOrder([&](Layer* layer) {
-            if (layer->getName() == uniqueName) {
-                matchFound = true;
-                uniqueName = name + "#" + String8(std::to_string(++dupeCounter).c_str());
-            }
-        });
-    }
-
-    ALOGD_IF(dupeCounter > 0, "duplicate layer name: changing %s to %s", name.c_str(), uniqueName.c_str());
+    // Names are held until the layers are removed, which makes them unique
+    // among the layers of both states rather than only the drawing state's.
+    return mLayerNames.acquire(name);
+}
 
-    return uniqueName;
+void SurfaceFlinger::releaseLayerName(const Layer* layer)
+{
+    mLayerNames.release(layer->getName(), layer);
 }
 
 status_t SurfaceFlinger::createBufferLayer(const sp<Client>& client,
@@ -3841,10 +4440,22 @@ status_t SurfaceFlinger::doDump(int fd, const Vector<String16>& args, bool asPro
         }
 
         bool dumpAll = true;
+        bool protoSince = false;
+        uint64_t protoSinceGeneration = 0;
         size_t index = 0;
         size_t numArgs = args.size();
 
         if (numArgs) {
+            if ((index < numArgs) &&
+                    (args[index] == String16(PriorityDumper::PROTO_SINCE_ARG))) {
+                index++;
+                protoSince = true;
+                if (index < numArgs) {
+                    protoSinceGeneration = strtoull(String8(args[index]).string(), nullptr, 10);
+                    index++;
+                }
+            }
+
             if ((index < numArgs) &&
                     (args[index] == String16("--list"))) {
                 index++;
@@ -3921,6 +4532,15 @@ status_t SurfaceFlinger::doDump(int fd, const Vector<String16>& args, bool asPro
                 dumpAll = false;
             }
 
+            if ((index < numArgs) &&
+                (args[index] == String16("--dump-layer-trace"))) {
+                index++;
+                if (mTracing.dumpFlightRecorder("dumpsys") != NO_ERROR) {
+                    result.append("Layer trace flight recorder is not running\n");
+                }
+                dumpAll = false;
+            }
+
             if ((index < numArgs) && (args[index] == String16("--timestats"))) {
                 index++;
                 mTimeStats.parseArgs(asProto, args, index, result);
@@ -3930,7 +4550,9 @@ status_t SurfaceFlinger::doDump(int fd, const Vector<String16>& args, bool asPro
 
         if (dumpAll) {
             if (asProto) {
-                LayersProto layersProto = dumpProtoInfo(LayerVector::StateSet::Current);
+                LayersProto layersProto = protoSince
+                        ? dumpProtoInfoSince(protoSinceGeneration)
+                        : dumpProtoInfo(LayerVector::StateSet::Current);
                 result.append(layersProto.SerializeAsString().c_str(), layersProto.ByteSize());
             } else {
                 dumpAllLocked(args, index, result);
@@ -4038,8 +4660,11 @@ void SurfaceFlinger::dumpStaticScreenStats(String8& result) const
             SurfaceFlingerBE::NUM_BUCKETS - 1, bucketTimeSec, percent);
 }
 
-void SurfaceFlinger::recordBufferingStats(const char* layerName,
+void SurfaceFlinger::recordBufferingStats(Layer* layer,
         std::vector<OccupancyTracker::Segment>&& history) {
+    mTimeStats.recordBufferingStats(layer->getTimeStatsTracker(), history);
+
+    const char* layerName = layer->getName().string();
     Mutex::Autolock lock(getBE().mBufferingStatsMutex);
     auto& stats = getBE().mBufferingStats[layerName];
     for (const auto& segment : history) {
@@ -4139,6 +4764,49 @@ LayersProto SurfaceFlinger::dumpProtoInfo(LayerVector::StateSet stateSet) const
     return layersProto;
 }
 
+LayersProto SurfaceFlinger::dumpProtoInfoSince(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mLayerProtoGenerationsLock);
+
+    // A layer changed when its proto did, which also covers the state that is recomputed on
+    // every frame rather than set by clients. A new generation is only used when something
+    // changed, so repeated dumps of an idle screen keep returning the same one.
+    const uint64_t nextGeneration = mLayerProtoGeneration + 1;
+    bool changed = false;
+    std::unordered_map<int32_t, LayerProtoGeneration> generations;
+
+    LayersProto layersProto;
+    mCurrentState.traverseInZOrder([&](Layer* layer) {
+        LayerProto layerProto;
+        layer->writeToProto(&layerProto, LayerVector::StateSet::Current);
+        const int32_t id = layerProto.id();
+        const size_t hash = std::hash<std::string>()(layerProto.SerializeAsString());
+
+        LayerProtoGeneration entry = {hash, nextGeneration};
+        auto it = mLayerProtoGenerations.find(id);
+        if (it != mLayerProtoGenerations.end() && it->second.hash == hash) {
+            entry = it->second;
+        } else {
+            changed = true;
+        }
+        if (entry.generation > generation) {
+            layersProto.add_layers()->Swap(&layerProto);
+        }
+        layersProto.add_layer_ids(id);
+        generations[id] = entry;
+    });
+    // Layers were removed.
+    if (generations.size() != mLayerProtoGenerations.size()) {
+        changed = true;
+    }
+
+    if (changed) {
+        mLayerProtoGeneration = nextGeneration;
+    }
+    mLayerProtoGenerations = std::move(generations);
+    layersProto.set_generation(mLayerProtoGeneration);
+    return layersProto;
+}
+
 LayersProto SurfaceFlinger::dumpVisibleLayersProtoInfo(int32_t hwcId) const {
     LayersProto layersProto;
     const sp<DisplayDevice>& displayDevice(mDisplays[hwcId]);
@@ -4162,6 +4830,24 @@ LayersProto SurfaceFlinger::dumpVisibleLayersProtoInfo(int32_t hwcId) const {
     return layersProto;
 }
 
+void SurfaceFlinger::dumpTransactionInboxStats(String8& result) const {
+    Mutex::Autolock _l(mTransactionInbox.lock);
+    const TransactionInbox& inbox(mTransactionInbox);
+    const float coalesceRatio = inbox.appliedStates == 0 ? 0.0f
+            : float(inbox.queuedStates) / float(inbox.appliedStates);
+    const nsecs_t averageLockTime = inbox.flushes == 0 ? 0
+            : inbox.totalStateLockTime / nsecs_t(inbox.flushes);
+    result.append("Transaction inbox:\n");
+    result.appendFormat("  queued transactions: %" PRIu64 ", queued states: %" PRIu64
+            ", applied states: %" PRIu64 ", pending states: %zu\n",
+            inbox.queuedTransactions, inbox.queuedStates, inbox.appliedStates,
+            inbox.states.size());
+    result.appendFormat("  coalesce ratio: %.2f, flushes: %" PRIu64 "\n", coalesceRatio,
+            inbox.flushes);
+    result.appendFormat("  state lock hold time: average %" PRId64 " ns, max %" PRId64 " ns\n\n",
+            averageLockTime, inbox.maxStateLockTime);
+}
+
 void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         String8& result) const
 {
@@ -4212,6 +4898,14 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs, mVsyncModulator.getEarlyPhaseOffset(),
         dispSyncPresentTimeOffset, activeConfig->getVsyncPeriod());
     result.append("\n");
+    result.appendFormat("  current sf phase %" PRId64 " ns", mVsyncModulator.getPhaseOffset());
+    if (mVsyncModulator.isAdaptive()) {
+        result.appendFormat(", adaptive late sf phase %" PRId64 " ns, adaptive early sf phase %"
+                            PRId64 " ns",
+                            mVsyncModulator.getAdaptiveLatePhaseOffset(),
+                            mVsyncModulator.getAdaptiveEarlyPhaseOffset());
+    }
+    result.append("\n");
 
     // Dump static screen stats
     result.append("\n");
@@ -4220,6 +4914,13 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
 
     dumpBufferingStats(result);
 
+    mEventQueue->dump(result);
+    result.append("\n");
+
+    if (mUseTransactionInbox) {
+        dumpTransactionInboxStats(result);
+    }
+
     /*
      * Dump the visible layer list
      */
@@ -4288,6 +4989,29 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("  transaction time: %f us\n",
             inTransactionDuration/1000.0);
 
+    result.append("  init phases:");
+    for (const auto& phase : mInitPhases) {
+        result.appendFormat(" %s=%.1fms", phase.first, phase.second / 1e6);
+    }
+    result.append("\n");
+
+    if (mImageCache != nullptr) {
+        mImageCache->dump(result);
+    }
+    if (mBufferQueuePool != nullptr) {
+        mBufferQueuePool->dump(result);
+    }
+
+    const uint64_t layerCreationCount = mLayerCreationCount;
+    result.appendFormat("  layer creation: %" PRIu64 " layers, avg %.1f us, max %.1f us\n",
+                        layerCreationCount,
+                        layerCreationCount > 0
+                                ? mLayerCreationTotalTime / 1000.0 / layerCreationCount
+                                : 0.0,
+                        mLayerCreationMaxTime / 1000.0);
+    result.append("  ");
+    mLayerNames.dump(result);
+
     /*
      * VSYNC state
      */
@@ -4329,6 +5053,9 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     const GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
     alloc.dump(result);
 
+    mTracing.dump(result);
+    result.append("\n");
+
     /*
      * Dump VrFlinger state if in use.
      */
@@ -4394,7 +5121,7 @@ void SurfaceFlinger::updateColorMatrixLocked() {
 
     if (mCurrentState.colorMatrix != colorMatrix) {
         mCurrentState.colorMatrix = colorMatrix;
-        mCurrentState.colorMatrixChanged = true;
+        mCurrentState.colorMatrixVersion++;
         setTransactionFlags(eTransactionNeeded);
     }
 }
@@ -4709,7 +5436,8 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display, sp<GraphicBuf
                                        Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
                                        int32_t minLayerZ, int32_t maxLayerZ,
                                        bool useIdentityTransform,
-                                       ISurfaceComposer::Rotation rotation) {
+                                       ISurfaceComposer::Rotation rotation,
+                                       sp<Fence>* outFence) {
     ATRACE_CALL();
 
     if (CC_UNLIKELY(display == 0)) return BAD_VALUE;
@@ -4721,12 +5449,14 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display, sp<GraphicBuf
 
     auto traverseLayers = std::bind(std::mem_fn(&SurfaceFlinger::traverseLayersInDisplay), this,
                                     device, minLayerZ, maxLayerZ, std::placeholders::_1);
-    return captureScreenCommon(renderArea, traverseLayers, outBuffer, useIdentityTransform);
+    return captureScreenCommon(renderArea, traverseLayers, outBuffer, outFence,
+                               useIdentityTransform);
 }
 
 status_t SurfaceFlinger::captureLayers(const sp<IBinder>& layerHandleBinder,
                                        sp<GraphicBuffer>* outBuffer, const Rect& sourceCrop,
-                                       float frameScale, bool childrenOnly) {
+                                       float frameScale, bool childrenOnly,
+                                       sp<Fence>* outFence) {
     ATRACE_CALL();
 
     class LayerRenderArea : public RenderArea {
@@ -4835,12 +5565,13 @@ status_t SurfaceFlinger::captureLayers(const sp<IBinder>& layerHandleBinder,
             visitor(layer);
         });
     };
-    return captureScreenCommon(renderArea, traverseLayers, outBuffer, false);
+    return captureScreenCommon(renderArea, traverseLayers, outBuffer, outFence, false);
 }
 
 status_t SurfaceFlinger::captureScreenCommon(RenderArea& renderArea,
                                              TraverseLayersFunction traverseLayers,
                                              sp<GraphicBuffer>* outBuffer,
+                                             sp<Fence>* outFence,
                                              bool useIdentityTransform) {
     ATRACE_CALL();
 
@@ -4905,7 +5636,15 @@ status_t SurfaceFlinger::captureScreenCommon(RenderArea& renderArea,
         result = *captureResult;
     }
 
-    if (result == NO_ERROR) {
+    if (result != NO_ERROR) {
+        return result;
+    }
+
+    // Callers that asked for a fence wait for the GPU themselves, so neither this binder thread
+    // nor they block on the rendering.
+    if (outFence != nullptr) {
+        *outFence = syncFd >= 0 ? new Fence(syncFd) : Fence::NO_FENCE;
+    } else {
         sync_wait(syncFd, -1);
         close(syncFd);
     }
@@ -5111,11 +5850,36 @@ void SurfaceFlinger::checkScreenshot(size_t w, size_t s, size_t h, void const* v
 // ---------------------------------------------------------------------------
 
 void SurfaceFlinger::State::traverseInZOrder(const LayerVector::Visitor& visitor) const {
-    layersSortedByZ.traverseInZOrder(stateSet, visitor);
+    if (!traversalListsValid) {
+        layersSortedByZ.traverseInZOrder(stateSet, visitor);
+        return;
+    }
+    for (const auto& layer : layersInZOrder) {
+        visitor(layer.get());
+    }
 }
 
 void SurfaceFlinger::State::traverseInReverseZOrder(const LayerVector::Visitor& visitor) const {
-    layersSortedByZ.traverseInReverseZOrder(stateSet, visitor);
+    if (!traversalListsValid) {
+        layersSortedByZ.traverseInReverseZOrder(stateSet, visitor);
+        return;
+    }
+    for (const auto& layer : layersInReverseZOrder) {
+        visitor(layer.get());
+    }
+}
+
+void SurfaceFlinger::State::updateTraversalLists() {
+    ATRACE_CALL();
+    // clear() keeps the capacity, so that rebuilding does not allocate in the steady state
+    layersInZOrder.clear();
+    layersSortedByZ.traverseInZOrder(stateSet,
+                                     [&](Layer* layer) { layersInZOrder.emplace_back(layer); });
+    layersInReverseZOrder.clear();
+    layersSortedByZ.traverseInReverseZOrder(stateSet, [&](Layer* layer) {
+        layersInReverseZOrder.emplace_back(layer);
+    });
+    traversalListsValid = true;
 }
 
 void SurfaceFlinger::traverseLayersInDisplay(const sp<const DisplayDevice>& hw, int32_t minLayerZ,
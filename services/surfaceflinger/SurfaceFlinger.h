@@ -53,10 +53,13 @@
 #include <system/graphics.h>
 
 #include "Barrier.h"
+#include "BufferQueuePool.h"
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "EventThread.h"
 #include "FrameTracker.h"
+#include "ImageCache.h"
+#include "LayerNameIndex.h"
 #include "LayerStats.h"
 #include "LayerVector.h"
 #include "MessageQueue.h"
@@ -71,12 +74,14 @@
 
 #include "Effects/Daltonizer.h"
 
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 #include "RenderArea.h"
 
 #include <layerproto/LayerProtoHeader.h>
@@ -374,10 +379,11 @@ private:
             // We explicitly don't copy stateSet so that, e.g., mDrawingState
             // always uses the Drawing StateSet.
             layersSortedByZ = other.layersSortedByZ;
+            traversalListsValid = false;
             displays = other.displays;
-            colorMatrixChanged = other.colorMatrixChanged;
-            if (colorMatrixChanged) {
+            if (colorMatrixVersion != other.colorMatrixVersion) {
                 colorMatrix = other.colorMatrix;
+                colorMatrixVersion = other.colorMatrixVersion;
             }
             return *this;
         }
@@ -386,11 +392,28 @@ private:
         LayerVector layersSortedByZ;
         DefaultKeyedVector< wp<IBinder>, DisplayDeviceState> displays;
 
-        bool colorMatrixChanged = true;
+        // The client color matrix composed with the saturation matrix and the
+        // Daltonizer, recomputed only when one of them changes. Displays compare
+        // colorMatrixVersion with the version they last applied.
         mat4 colorMatrix;
+        uint64_t colorMatrixVersion = 1;
 
         void traverseInZOrder(const LayerVector::Visitor& visitor) const;
         void traverseInReverseZOrder(const LayerVector::Visitor& visitor) const;
+
+        // Flattens the layer tree into the traversal lists, which the traversals above
+        // then iterate instead of walking the tree. Only valid until the tree or the Z
+        // order of a layer changes, so it is called for the drawing state after every
+        // commit; any assignment to the state invalidates the lists.
+        void updateTraversalLists();
+
+    private:
+        // The whole layer tree in the order of the recursive traversals, relative Z
+        // included. Both orders are kept because the split of the children at Z 0 does
+        // not make one the exact reverse of the other with several layer stacks.
+        std::vector<sp<Layer>> layersInZOrder;
+        std::vector<sp<Layer>> layersInReverseZOrder;
+        bool traversalListsValid = false;
     };
 
     /* ------------------------------------------------------------------------
@@ -420,9 +443,10 @@ private:
     virtual status_t captureScreen(const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
                                    Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
                                    int32_t minLayerZ, int32_t maxLayerZ, bool useIdentityTransform,
-                                   ISurfaceComposer::Rotation rotation);
+                                   ISurfaceComposer::Rotation rotation, sp<Fence>* outFence);
     virtual status_t captureLayers(const sp<IBinder>& parentHandle, sp<GraphicBuffer>* outBuffer,
-                                   const Rect& sourceCrop, float frameScale, bool childrenOnly);
+                                   const Rect& sourceCrop, float frameScale, bool childrenOnly,
+                                   sp<Fence>* outFence);
     virtual status_t getDisplayStats(const sp<IBinder>& display,
             DisplayStatInfo* stats);
     virtual status_t getDisplayConfigs(const sp<IBinder>& display,
@@ -518,6 +542,15 @@ private:
     uint32_t setClientStateLocked(const ComposerState& composerState);
     uint32_t setDisplayStateLocked(const DisplayState& s);
     void setDestroyStateLocked(const ComposerState& composerState);
+    // Returns whether the transaction can be coalesced in mTransactionInbox
+    // instead of being applied immediately.
+    bool canQueueTransaction(const Vector<ComposerState>& states,
+            const Vector<DisplayState>& displays, uint32_t flags) const;
+    void queueTransaction(const Vector<ComposerState>& states);
+    // Applies the coalesced transactions, taking mStateLock.
+    void applyQueuedTransactions();
+    // Same as above, for callers already holding mStateLock.
+    uint32_t applyQueuedTransactionsLocked();
 
     /* ------------------------------------------------------------------------
      * Layer management
@@ -538,6 +571,9 @@ private:
 
     String8 getUniqueLayerName(const String8& name);
 
+    // Frees the unique name of a layer that is gone from both states
+    void releaseLayerName(const Layer* layer);
+
     // called in response to the window-manager calling
     // ISurfaceComposerClient::destroySurface()
     status_t onLayerRemoved(const sp<Client>& client, const sp<IBinder>& handle);
@@ -567,7 +603,7 @@ private:
     void renderScreenImplLocked(const RenderArea& renderArea, TraverseLayersFunction traverseLayers,
                                 bool yswap, bool useIdentityTransform);
     status_t captureScreenCommon(RenderArea& renderArea, TraverseLayersFunction traverseLayers,
-                                 sp<GraphicBuffer>* outBuffer,
+                                 sp<GraphicBuffer>* outBuffer, sp<Fence>* outFence,
                                  bool useIdentityTransform);
     status_t captureScreenImplLocked(const RenderArea& renderArea,
                                      TraverseLayersFunction traverseLayers,
@@ -643,6 +679,13 @@ private:
      * Compositing
      */
     void invalidateHwcGeometry();
+    // Calls Layer::prepareLatch() for each of mLayersWithQueuedFrames, on
+    // worker threads when enabled.
+    void prepareLatches();
+    // Computes the visible regions of every display that is on, indexed like
+    // mDisplays.
+    void computeDisplaysVisibleRegions(std::vector<Region>& outDirtyRegions,
+            std::vector<Region>& outOpaqueRegions);
     void computeVisibleRegions(const sp<const DisplayDevice>& displayDevice,
             Region& dirtyRegion, Region& opaqueRegion);
 
@@ -676,7 +719,17 @@ private:
 
     // compose surfaces for display hw. this fails if using GL and the surface
     // has been destroyed and is no longer valid.
-    bool doComposeSurfaces(const sp<const DisplayDevice>& displayDevice);
+    bool doComposeSurfaces(const sp<const DisplayDevice>& displayDevice,
+                           const Region& dirtyRegion);
+    // decide whether the client layers of the display can come from its
+    // ClientCompositionCache
+    ClientCompositionCache::Action prepareClientCompositionCache(
+            const sp<const DisplayDevice>& displayDevice, const Region& dirtyRegion);
+    // render the client layers into the cache buffer with composeLayers
+    bool flattenClientComposition(const sp<const DisplayDevice>& displayDevice,
+                                  const std::function<void()>& composeLayers);
+    // copy the cache buffer into the client target
+    void drawClientCompositionCache(const sp<const DisplayDevice>& displayDevice);
 
     void postFramebuffer();
     void drawWormhole(const sp<const DisplayDevice>& displayDevice, const Region& region) const;
@@ -733,11 +786,12 @@ private:
     // Not const because each Layer needs to query Fences and cache timestamps.
     void dumpFrameEventsLocked(String8& result);
 
-    void recordBufferingStats(const char* layerName,
-            std::vector<OccupancyTracker::Segment>&& history);
+    void recordBufferingStats(Layer* layer, std::vector<OccupancyTracker::Segment>&& history);
     void dumpBufferingStats(String8& result) const;
+    void dumpTransactionInboxStats(String8& result) const;
     void dumpWideColorInfo(String8& result) const;
     LayersProto dumpProtoInfo(LayerVector::StateSet stateSet) const;
+    LayersProto dumpProtoInfoSince(uint64_t generation);
     LayersProto dumpVisibleLayersProtoInfo(int32_t hwcId) const;
 
     bool isLayerTripleBufferingDisabled() const {
@@ -802,11 +856,37 @@ private:
     // don't need synchronization
     State mDrawingState{LayerVector::StateSet::Drawing};
     bool mVisibleRegionsDirty;
+    // When set, computeVisibleRegions() reuses the per-layer results of the
+    // previous pass for layers above the topmost geometry change.
+    bool mUseIncrementalVisibleRegions = false;
+    // Bumped whenever the display list changes, invalidating every
+    // Layer::VisibilityCache.
+    uint32_t mVisibilityCacheGeneration = 0;
+    // When set, the visible regions of displays showing distinct layer stacks
+    // are computed on worker threads.
+    bool mParallelDisplayComposition = false;
+    // When set, the buffers of the layers with queued frames are acquired on
+    // worker threads before being latched.
+    bool mParallelLatch = false;
+    // RE::Images of the layer buffers, shared by all layers. Null if disabled.
+    std::unique_ptr<ImageCache> mImageCache;
+    // BufferQueues made ahead for the buffer layers. Null if disabled.
+    std::unique_ptr<BufferQueuePool> mBufferQueuePool;
+    // Number of frames the client composition of a display must stay
+    // unchanged before it is flattened into a cached buffer, 0 to disable.
+    uint32_t mClientCompositionCacheFrames = 0;
+    uint32_t mClientCompositionCacheTexture = 0;
+    // When set, only the part of the client target that changed since the
+    // buffer being rendered into was last used is redrawn.
+    bool mUsePartialUpdate = false;
     bool mGeometryInvalid;
     bool mAnimCompositionPending;
     std::vector<sp<Layer>> mLayersWithQueuedFrames;
     sp<Fence> mPreviousPresentFence = Fence::NO_FENCE;
     bool mHadClientComposition = false;
+    // When the INVALIDATE message of the frame being refreshed was handled,
+    // 0 for refreshes that were not preceded by one.
+    nsecs_t mFrameStartTime = 0;
 
     struct HotplugEvent {
         hwc2_display_t display;
@@ -836,11 +916,43 @@ private:
     SurfaceTracing mTracing;
     LayerStats mLayerStats;
     TimeStats& mTimeStats = TimeStats::getInstance();
+
+    // Used by dumpProtoInfoSince() to tell which layers changed since a generation; keyed by
+    // layer id.
+    struct LayerProtoGeneration {
+        size_t hash;
+        uint64_t generation;
+    };
+    std::mutex mLayerProtoGenerationsLock;
+    uint64_t mLayerProtoGeneration = 0;
+    std::unordered_map<int32_t, LayerProtoGeneration> mLayerProtoGenerations;
+
     bool mUseHwcVirtualDisplays = false;
 
     // Restrict layers to use two buffers in their bufferqueues.
     bool mLayerTripleBufferingDisabled = false;
 
+    // Asynchronous transactions only touching per-layer properties are queued
+    // here by setTransactionState() without taking mStateLock. States
+    // targeting the same layer are merged (last writer wins per field) and
+    // applied once per vsync from handleMessageTransaction().
+    bool mUseTransactionInbox = false;
+    struct TransactionInbox {
+        mutable Mutex lock;
+        Vector<ComposerState> states;
+        // index in states, keyed by (client, surface handle)
+        std::map<std::pair<IBinder*, IBinder*>, size_t> indices;
+
+        // statistics
+        uint64_t queuedTransactions = 0;
+        uint64_t queuedStates = 0;
+        uint64_t appliedStates = 0;
+        uint64_t flushes = 0;
+        nsecs_t totalStateLockTime = 0;
+        nsecs_t maxStateLockTime = 0;
+    };
+    TransactionInbox mTransactionInbox;
+
     // these are thread safe
     mutable std::unique_ptr<MessageQueue> mEventQueue{std::make_unique<impl::MessageQueue>()};
     FrameTracker mAnimFrameTracker;
@@ -869,6 +981,14 @@ private:
 
     size_t mNumLayers;
 
+    // The unique names of the layers, from createLayer() to the commit that
+    // removes them
+    LayerNameIndex mLayerNames;
+    // Time spent in createLayer(), which runs on the main thread
+    std::atomic<uint64_t> mLayerCreationCount{0};
+    std::atomic<nsecs_t> mLayerCreationTotalTime{0};
+    std::atomic<nsecs_t> mLayerCreationMaxTime{0};
+
     // Verify that transaction is being called by an approved process:
     // either AID_GRAPHICS or AID_SYSTEM.
     status_t CheckTransactCodeCredentials(uint32_t code);
@@ -878,10 +998,21 @@ private:
     static bool useVrFlinger;
     std::thread::id mMainThreadId;
 
+    // Incremented whenever the drawing state geometry of a layer may have changed, so that the
+    // layers recompute their cached transform, alpha and bounds. Starts at 1 so that a zeroed
+    // cache is never valid.
+    std::atomic<uint64_t> mGeometryGeneration{1};
+    void invalidateLayerGeometry() {
+        mGeometryGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
     DisplayColorSetting mDisplayColorSetting = DisplayColorSetting::MANAGED;
     // Applied on sRGB layers when the render intent is non-colorimetric.
     mat4 mLegacySrgbSaturationMatrix;
 
+    // How long each phase of init() took
+    std::vector<std::pair<const char*, nsecs_t>> mInitPhases;
+
     using CreateBufferQueueFunction =
             std::function<void(sp<IGraphicBufferProducer>* /* outProducer */,
                                sp<IGraphicBufferConsumer>* /* outConsumer */,
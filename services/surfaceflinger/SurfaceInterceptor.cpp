@@ -21,7 +21,12 @@
 #include "SurfaceFlinger.h"
 #include "SurfaceInterceptor.h"
 
-#include <fstream>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 #include <android-base/file.h>
 #include <log/log.h>
@@ -29,6 +34,24 @@
 
 namespace android {
 
+namespace {
+
+// How often the writer thread looks for queued events.
+constexpr std::chrono::milliseconds WRITER_INTERVAL(5);
+
+// Tag of Trace.increment, a length-delimited field number 1.
+constexpr uint8_t INCREMENT_TAG = (1 << 3) | 2;
+
+void appendVarint(std::string* output, uint64_t value) {
+    while (value >= 0x80) {
+        output->push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    output->push_back(static_cast<char>(value));
+}
+
+} // namespace
+
 // ----------------------------------------------------------------------------
 
 SurfaceInterceptor::~SurfaceInterceptor() = default;
@@ -40,6 +63,10 @@ SurfaceInterceptor::SurfaceInterceptor(SurfaceFlinger* flinger)
 {
 }
 
+SurfaceInterceptor::~SurfaceInterceptor() {
+    disable();
+}
+
 void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
         const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays)
 {
@@ -47,10 +74,23 @@ void SurfaceInterceptor::enable(const SortedVector<sp<Layer>>& layers,
         return;
     }
     ATRACE_CALL();
+    // The trace is streamed to the file while it is taken, so that it does not build up in
+    // memory.
+    mOutputFd = open(mOutputFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (mOutputFd == -1) {
+        ALOGE("Could not save the proto file! Permission denied");
+        return;
+    }
+    mLastTimestamp = 0;
+    mDroppedIncrements = 0;
+    mWriteFailed = false;
+    mStopWriter = false;
+    mWriterThread = std::thread(&SurfaceInterceptor::writerMain, this);
+    pthread_setname_np(mWriterThread.native_handle(), "SurfaceInterceptor");
+
     mEnabled = true;
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    saveExistingDisplaysLocked(displays);
-    saveExistingSurfacesLocked(layers);
+    saveExistingDisplays(displays);
+    saveExistingSurfaces(layers);
 }
 
 void SurfaceInterceptor::disable() {
@@ -58,40 +98,193 @@ void SurfaceInterceptor::disable() {
         return;
     }
     ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
     mEnabled = false;
-    status_t err(writeProtoFileLocked());
-    ALOGE_IF(err == PERMISSION_DENIED, "Could not save the proto file! Permission denied");
-    ALOGE_IF(err == NOT_ENOUGH_DATA, "Could not save the proto file! There are missing fields");
-    mTrace.Clear();
+    // Events that are being saved still go into the trace.
+    while (mActiveSaves.load() != 0) {
+        std::this_thread::yield();
+    }
+    mStopWriter = true;
+    mWriterThread.join();
+    close(mOutputFd);
+    mOutputFd = -1;
+
+    ALOGE_IF(mWriteFailed, "Could not save the proto file! Permission denied");
+    ALOGE_IF(mDroppedIncrements > 0,
+            "Could not save %zu increments to the proto file! There are missing fields",
+            mDroppedIncrements);
 }
 
 bool SurfaceInterceptor::isEnabled() {
     return mEnabled;
 }
 
-void SurfaceInterceptor::saveExistingDisplaysLocked(
+SurfaceInterceptor::SaveScope::SaveScope(SurfaceInterceptor* interceptor)
+    :   mInterceptor(interceptor)
+{
+    // Sequentially consistent, so that disable() either sees this save or this save sees that
+    // tracing was disabled.
+    mInterceptor->mActiveSaves.fetch_add(1);
+    mEnabled = mInterceptor->mEnabled.load();
+}
+
+SurfaceInterceptor::SaveScope::~SaveScope() {
+    mInterceptor->mActiveSaves.fetch_sub(1);
+}
+
+SurfaceInterceptor::Event* SurfaceInterceptor::createEvent(Event::Type type) {
+    Event* event(new Event());
+    event->type = type;
+    event->timestamp = systemTime();
+    return event;
+}
+
+void SurfaceInterceptor::queueEvent(Event* event) {
+    Event* previous(mQueueHead.exchange(event, std::memory_order_acq_rel));
+    previous->next.store(event, std::memory_order_release);
+}
+
+void SurfaceInterceptor::queueIncrement(std::unique_ptr<Increment> increment) {
+    Event* event(createEvent(Event::Type::INCREMENT));
+    event->increment = std::move(increment);
+    queueEvent(event);
+}
+
+SurfaceInterceptor::Event* SurfaceInterceptor::popEvent() {
+    Event* tail(mQueueTail);
+    Event* next(tail->next.load(std::memory_order_acquire));
+    if (tail == &mQueueStub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        mQueueTail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        mQueueTail = next;
+        return tail;
+    }
+    if (tail != mQueueHead.load(std::memory_order_acquire)) {
+        // An event is being queued after the tail; pick it up on the next round.
+        return nullptr;
+    }
+    // The tail is the last event; requeue the stub behind it so the tail can be removed.
+    mQueueStub.next.store(nullptr, std::memory_order_relaxed);
+    queueEvent(&mQueueStub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        mQueueTail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void SurfaceInterceptor::writerMain() {
+    std::vector<Event*> events;
+    std::string output;
+    while (true) {
+        // Everything saved before the writer was stopped is in the queue by now.
+        const bool stop(mStopWriter.load());
+        while (Event* event = popEvent()) {
+            events.push_back(event);
+        }
+        if (events.empty()) {
+            if (stop) {
+                break;
+            }
+            std::this_thread::sleep_for(WRITER_INTERVAL);
+            continue;
+        }
+
+        ATRACE_NAME("SurfaceInterceptor::write");
+        // Threads take the timestamps before queueing their events, so they can be queued
+        // slightly out of order.
+        std::stable_sort(events.begin(), events.end(), [](const Event* lhs, const Event* rhs) {
+            return lhs->timestamp < rhs->timestamp;
+        });
+        for (Event* event : events) {
+            appendIncrement(*event, &output);
+            delete event;
+        }
+        events.clear();
+        if (!mWriteFailed && !android::base::WriteFully(mOutputFd, output.data(), output.size())) {
+            mWriteFailed = true;
+        }
+        output.clear();
+    }
+}
+
+void SurfaceInterceptor::appendIncrement(const Event& event, std::string* output) {
+    Increment localIncrement;
+    Increment* increment(event.increment.get());
+    switch (event.type) {
+        case Event::Type::INCREMENT:
+            break;
+        case Event::Type::SURFACE_DELETION:
+            increment = &localIncrement;
+            addSurfaceDeletion(increment, event.id);
+            break;
+        case Event::Type::BUFFER_UPDATE:
+            increment = &localIncrement;
+            addBufferUpdate(increment, event.id, event.width, event.height, event.value);
+            break;
+        case Event::Type::VSYNC:
+            increment = &localIncrement;
+            addVSyncUpdate(increment, static_cast<nsecs_t>(event.value));
+            break;
+        case Event::Type::DISPLAY_DELETION:
+            increment = &localIncrement;
+            addDisplayDeletion(increment, event.id);
+            break;
+        case Event::Type::POWER_MODE_UPDATE:
+            increment = &localIncrement;
+            addPowerModeUpdate(increment, event.id, event.mode);
+            break;
+    }
+    // Keep the timestamps of the stream increasing across batches.
+    mLastTimestamp = std::max(mLastTimestamp, event.timestamp);
+    increment->set_time_stamp(mLastTimestamp);
+
+    if (!increment->IsInitialized()) {
+        mDroppedIncrements++;
+        return;
+    }
+    const std::string encoded(increment->SerializeAsString());
+    output->push_back(static_cast<char>(INCREMENT_TAG));
+    appendVarint(output, encoded.size());
+    output->append(encoded);
+}
+
+void SurfaceInterceptor::saveExistingDisplays(
         const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays)
 {
     // Caveat: The initial snapshot does not capture the power mode of the existing displays
     ATRACE_CALL();
     for (size_t i = 0 ; i < displays.size() ; i++) {
-        addDisplayCreationLocked(createTraceIncrementLocked(), displays[i]);
-        addInitialDisplayStateLocked(createTraceIncrementLocked(), displays[i]);
+        std::unique_ptr<Increment> creation(new Increment());
+        addDisplayCreation(creation.get(), displays[i]);
+        queueIncrement(std::move(creation));
+        std::unique_ptr<Increment> state(new Increment());
+        addInitialDisplayState(state.get(), displays[i]);
+        queueIncrement(std::move(state));
     }
 }
 
-void SurfaceInterceptor::saveExistingSurfacesLocked(const SortedVector<sp<Layer>>& layers) {
+void SurfaceInterceptor::saveExistingSurfaces(const SortedVector<sp<Layer>>& layers) {
     ATRACE_CALL();
     for (const auto& l : layers) {
         l->traverseInZOrder(LayerVector::StateSet::Drawing, [this](Layer* layer) {
-            addSurfaceCreationLocked(createTraceIncrementLocked(), layer);
-            addInitialSurfaceStateLocked(createTraceIncrementLocked(), layer);
+            std::unique_ptr<Increment> creation(new Increment());
+            addSurfaceCreation(creation.get(), layer);
+            queueIncrement(std::move(creation));
+            std::unique_ptr<Increment> state(new Increment());
+            addInitialSurfaceState(state.get(), layer);
+            queueIncrement(std::move(state));
         });
     }
 }
 
-void SurfaceInterceptor::addInitialSurfaceStateLocked(Increment* increment,
+void SurfaceInterceptor::addInitialSurfaceState(Increment* increment,
         const sp<const Layer>& layer)
 {
     Transaction* transaction(increment->mutable_transaction());
@@ -99,53 +292,36 @@ void SurfaceInterceptor::addInitialSurfaceStateLocked(Increment* increment,
     transaction->set_animation(layer->mTransactionFlags & BnSurfaceComposer::eAnimation);
 
     const int32_t layerId(getLayerId(layer));
-    addPositionLocked(transaction, layerId, layer->mCurrentState.active.transform.tx(),
+    addPosition(transaction, layerId, layer->mCurrentState.active.transform.tx(),
             layer->mCurrentState.active.transform.ty());
-    addDepthLocked(transaction, layerId, layer->mCurrentState.z);
-    addAlphaLocked(transaction, layerId, layer->mCurrentState.color.a);
-    addTransparentRegionLocked(transaction, layerId, layer->mCurrentState.activeTransparentRegion);
-    addLayerStackLocked(transaction, layerId, layer->mCurrentState.layerStack);
-    addCropLocked(transaction, layerId, layer->mCurrentState.crop);
+    addDepth(transaction, layerId, layer->mCurrentState.z);
+    addAlpha(transaction, layerId, layer->mCurrentState.color.a);
+    addTransparentRegion(transaction, layerId, layer->mCurrentState.activeTransparentRegion);
+    addLayerStack(transaction, layerId, layer->mCurrentState.layerStack);
+    addCrop(transaction, layerId, layer->mCurrentState.crop);
     if (layer->mCurrentState.barrierLayer != nullptr) {
-        addDeferTransactionLocked(transaction, layerId, layer->mCurrentState.barrierLayer.promote(),
+        addDeferTransaction(transaction, layerId, layer->mCurrentState.barrierLayer.promote(),
                 layer->mCurrentState.frameNumber);
     }
-    addFinalCropLocked(transaction, layerId, layer->mCurrentState.finalCrop);
-    addOverrideScalingModeLocked(transaction, layerId, layer->getEffectiveScalingMode());
-    addFlagsLocked(transaction, layerId, layer->mCurrentState.flags);
+    addFinalCrop(transaction, layerId, layer->mCurrentState.finalCrop);
+    addOverrideScalingMode(transaction, layerId, layer->getEffectiveScalingMode());
+    addFlags(transaction, layerId, layer->mCurrentState.flags);
 }
 
-void SurfaceInterceptor::addInitialDisplayStateLocked(Increment* increment,
+void SurfaceInterceptor::addInitialDisplayState(Increment* increment,
         const DisplayDeviceState& display)
 {
     Transaction* transaction(increment->mutable_transaction());
     transaction->set_synchronous(false);
     transaction->set_animation(false);
 
-    addDisplaySurfaceLocked(transaction, display.displayId, display.surface);
-    addDisplayLayerStackLocked(transaction, display.displayId, display.layerStack);
-    addDisplaySizeLocked(transaction, display.displayId, display.width, display.height);
-    addDisplayProjectionLocked(transaction, display.displayId, display.orientation,
+    addDisplaySurface(transaction, display.displayId, display.surface);
+    addDisplayLayerStack(transaction, display.displayId, display.layerStack);
+    addDisplaySize(transaction, display.displayId, display.width, display.height);
+    addDisplayProjection(transaction, display.displayId, display.orientation,
             display.viewport, display.frame);
 }
 
-status_t SurfaceInterceptor::writeProtoFileLocked() {
-    ATRACE_CALL();
-    std::string output;
-
-    if (!mTrace.IsInitialized()) {
-        return NOT_ENOUGH_DATA;
-    }
-    if (!mTrace.SerializeToString(&output)) {
-        return PERMISSION_DENIED;
-    }
-    if (!android::base::WriteStringToFile(output, mOutputFileName, true)) {
-        return PERMISSION_DENIED;
-    }
-
-    return NO_ERROR;
-}
-
 const sp<const Layer> SurfaceInterceptor::getLayer(const wp<const IBinder>& weakHandle) {
     const sp<const IBinder>& handle(weakHandle.promote());
     const auto layerHandle(static_cast<const Layer::Handle*>(handle.get()));
@@ -162,13 +338,7 @@ int32_t SurfaceInterceptor::getLayerId(const sp<const Layer>& layer) {
     return layer->sequence;
 }
 
-Increment* SurfaceInterceptor::createTraceIncrementLocked() {
-    Increment* increment(mTrace.add_increment());
-    increment->set_time_stamp(systemTime());
-    return increment;
-}
-
-SurfaceChange* SurfaceInterceptor::createSurfaceChangeLocked(Transaction* transaction,
+SurfaceChange* SurfaceInterceptor::createSurfaceChange(Transaction* transaction,
         int32_t layerId)
 {
     SurfaceChange* change(transaction->add_surface_change());
@@ -176,7 +346,7 @@ SurfaceChange* SurfaceInterceptor::createSurfaceChangeLocked(Transaction* transa
     return change;
 }
 
-DisplayChange* SurfaceInterceptor::createDisplayChangeLocked(Transaction* transaction,
+DisplayChange* SurfaceInterceptor::createDisplayChange(Transaction* transaction,
         int32_t displayId)
 {
     DisplayChange* dispChange(transaction->add_display_change());
@@ -184,51 +354,51 @@ DisplayChange* SurfaceInterceptor::createDisplayChangeLocked(Transaction* transa
     return dispChange;
 }
 
-void SurfaceInterceptor::setProtoRectLocked(Rectangle* protoRect, const Rect& rect) {
+void SurfaceInterceptor::setProtoRect(Rectangle* protoRect, const Rect& rect) {
     protoRect->set_left(rect.left);
     protoRect->set_top(rect.top);
     protoRect->set_right(rect.right);
     protoRect->set_bottom(rect.bottom);
 }
 
-void SurfaceInterceptor::addPositionLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addPosition(Transaction* transaction, int32_t layerId,
         float x, float y)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     PositionChange* posChange(change->mutable_position());
     posChange->set_x(x);
     posChange->set_y(y);
 }
 
-void SurfaceInterceptor::addDepthLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addDepth(Transaction* transaction, int32_t layerId,
         uint32_t z)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     LayerChange* depthChange(change->mutable_layer());
     depthChange->set_layer(z);
 }
 
-void SurfaceInterceptor::addSizeLocked(Transaction* transaction, int32_t layerId, uint32_t w,
+void SurfaceInterceptor::addSize(Transaction* transaction, int32_t layerId, uint32_t w,
         uint32_t h)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     SizeChange* sizeChange(change->mutable_size());
     sizeChange->set_w(w);
     sizeChange->set_h(h);
 }
 
-void SurfaceInterceptor::addAlphaLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addAlpha(Transaction* transaction, int32_t layerId,
         float alpha)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     AlphaChange* alphaChange(change->mutable_alpha());
     alphaChange->set_alpha(alpha);
 }
 
-void SurfaceInterceptor::addMatrixLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addMatrix(Transaction* transaction, int32_t layerId,
         const layer_state_t::matrix22_t& matrix)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     MatrixChange* matrixChange(change->mutable_matrix());
     matrixChange->set_dsdx(matrix.dsdx);
     matrixChange->set_dtdx(matrix.dtdx);
@@ -236,69 +406,69 @@ void SurfaceInterceptor::addMatrixLocked(Transaction* transaction, int32_t layer
     matrixChange->set_dtdy(matrix.dtdy);
 }
 
-void SurfaceInterceptor::addTransparentRegionLocked(Transaction* transaction,
+void SurfaceInterceptor::addTransparentRegion(Transaction* transaction,
         int32_t layerId, const Region& transRegion)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     TransparentRegionHintChange* transparentChange(change->mutable_transparent_region_hint());
 
     for (const auto& rect : transRegion) {
         Rectangle* protoRect(transparentChange->add_region());
-        setProtoRectLocked(protoRect, rect);
+        setProtoRect(protoRect, rect);
     }
 }
 
-void SurfaceInterceptor::addFlagsLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addFlags(Transaction* transaction, int32_t layerId,
         uint8_t flags)
 {
     // There can be multiple flags changed
     if (flags & layer_state_t::eLayerHidden) {
-        SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+        SurfaceChange* change(createSurfaceChange(transaction, layerId));
         HiddenFlagChange* flagChange(change->mutable_hidden_flag());
         flagChange->set_hidden_flag(true);
     }
     if (flags & layer_state_t::eLayerOpaque) {
-        SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+        SurfaceChange* change(createSurfaceChange(transaction, layerId));
         OpaqueFlagChange* flagChange(change->mutable_opaque_flag());
         flagChange->set_opaque_flag(true);
     }
     if (flags & layer_state_t::eLayerSecure) {
-        SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+        SurfaceChange* change(createSurfaceChange(transaction, layerId));
         SecureFlagChange* flagChange(change->mutable_secure_flag());
         flagChange->set_secure_flag(true);
     }
 }
 
-void SurfaceInterceptor::addLayerStackLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addLayerStack(Transaction* transaction, int32_t layerId,
         uint32_t layerStack)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     LayerStackChange* layerStackChange(change->mutable_layer_stack());
     layerStackChange->set_layer_stack(layerStack);
 }
 
-void SurfaceInterceptor::addCropLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addCrop(Transaction* transaction, int32_t layerId,
         const Rect& rect)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     CropChange* cropChange(change->mutable_crop());
     Rectangle* protoRect(cropChange->mutable_rectangle());
-    setProtoRectLocked(protoRect, rect);
+    setProtoRect(protoRect, rect);
 }
 
-void SurfaceInterceptor::addFinalCropLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addFinalCrop(Transaction* transaction, int32_t layerId,
         const Rect& rect)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     FinalCropChange* finalCropChange(change->mutable_final_crop());
     Rectangle* protoRect(finalCropChange->mutable_rectangle());
-    setProtoRectLocked(protoRect, rect);
+    setProtoRect(protoRect, rect);
 }
 
-void SurfaceInterceptor::addDeferTransactionLocked(Transaction* transaction, int32_t layerId,
+void SurfaceInterceptor::addDeferTransaction(Transaction* transaction, int32_t layerId,
         const sp<const Layer>& layer, uint64_t frameNumber)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     if (layer == nullptr) {
         ALOGE("An existing layer could not be retrieved with the handle"
                 " for the deferred transaction");
@@ -309,15 +479,15 @@ void SurfaceInterceptor::addDeferTransactionLocked(Transaction* transaction, int
     deferTransaction->set_frame_number(frameNumber);
 }
 
-void SurfaceInterceptor::addOverrideScalingModeLocked(Transaction* transaction,
+void SurfaceInterceptor::addOverrideScalingMode(Transaction* transaction,
         int32_t layerId, int32_t overrideScalingMode)
 {
-    SurfaceChange* change(createSurfaceChangeLocked(transaction, layerId));
+    SurfaceChange* change(createSurfaceChange(transaction, layerId));
     OverrideScalingModeChange* overrideChange(change->mutable_override_scaling_mode());
     overrideChange->set_override_scaling_mode(overrideScalingMode);
 }
 
-void SurfaceInterceptor::addSurfaceChangesLocked(Transaction* transaction,
+void SurfaceInterceptor::addSurfaceChanges(Transaction* transaction,
         const layer_state_t& state)
 {
     const sp<const Layer> layer(getLayer(state.surface));
@@ -330,31 +500,31 @@ void SurfaceInterceptor::addSurfaceChangesLocked(Transaction* transaction,
     const int32_t layerId(getLayerId(layer));
 
     if (state.what & layer_state_t::ePositionChanged) {
-        addPositionLocked(transaction, layerId, state.x, state.y);
+        addPosition(transaction, layerId, state.x, state.y);
     }
     if (state.what & layer_state_t::eLayerChanged) {
-        addDepthLocked(transaction, layerId, state.z);
+        addDepth(transaction, layerId, state.z);
     }
     if (state.what & layer_state_t::eSizeChanged) {
-        addSizeLocked(transaction, layerId, state.w, state.h);
+        addSize(transaction, layerId, state.w, state.h);
     }
     if (state.what & layer_state_t::eAlphaChanged) {
-        addAlphaLocked(transaction, layerId, state.alpha);
+        addAlpha(transaction, layerId, state.alpha);
     }
     if (state.what & layer_state_t::eMatrixChanged) {
-        addMatrixLocked(transaction, layerId, state.matrix);
+        addMatrix(transaction, layerId, state.matrix);
     }
     if (state.what & layer_state_t::eTransparentRegionChanged) {
-        addTransparentRegionLocked(transaction, layerId, state.transparentRegion);
+        addTransparentRegion(transaction, layerId, state.transparentRegion);
     }
     if (state.what & layer_state_t::eFlagsChanged) {
-        addFlagsLocked(transaction, layerId, state.flags);
+        addFlags(transaction, layerId, state.flags);
     }
     if (state.what & layer_state_t::eLayerStackChanged) {
-        addLayerStackLocked(transaction, layerId, state.layerStack);
+        addLayerStack(transaction, layerId, state.layerStack);
     }
     if (state.what & layer_state_t::eCropChanged) {
-        addCropLocked(transaction, layerId, state.crop);
+        addCrop(transaction, layerId, state.crop);
     }
     if (state.what & layer_state_t::eDeferTransaction) {
         sp<Layer> otherLayer = nullptr;
@@ -368,35 +538,35 @@ void SurfaceInterceptor::addSurfaceChangesLocked(Transaction* transaction,
                 ALOGE("Attempt to defer transaction to to an unrecognized GraphicBufferProducer");
             }
         }
-        addDeferTransactionLocked(transaction, layerId, otherLayer, state.frameNumber);
+        addDeferTransaction(transaction, layerId, otherLayer, state.frameNumber);
     }
     if (state.what & layer_state_t::eFinalCropChanged) {
-        addFinalCropLocked(transaction, layerId, state.finalCrop);
+        addFinalCrop(transaction, layerId, state.finalCrop);
     }
     if (state.what & layer_state_t::eOverrideScalingModeChanged) {
-        addOverrideScalingModeLocked(transaction, layerId, state.overrideScalingMode);
+        addOverrideScalingMode(transaction, layerId, state.overrideScalingMode);
     }
 }
 
-void SurfaceInterceptor::addDisplayChangesLocked(Transaction* transaction,
+void SurfaceInterceptor::addDisplayChanges(Transaction* transaction,
         const DisplayState& state, int32_t displayId)
 {
     if (state.what & DisplayState::eSurfaceChanged) {
-        addDisplaySurfaceLocked(transaction, displayId, state.surface);
+        addDisplaySurface(transaction, displayId, state.surface);
     }
     if (state.what & DisplayState::eLayerStackChanged) {
-        addDisplayLayerStackLocked(transaction, displayId, state.layerStack);
+        addDisplayLayerStack(transaction, displayId, state.layerStack);
     }
     if (state.what & DisplayState::eDisplaySizeChanged) {
-        addDisplaySizeLocked(transaction, displayId, state.width, state.height);
+        addDisplaySize(transaction, displayId, state.width, state.height);
     }
     if (state.what & DisplayState::eDisplayProjectionChanged) {
-        addDisplayProjectionLocked(transaction, displayId, state.orientation, state.viewport,
+        addDisplayProjection(transaction, displayId, state.orientation, state.viewport,
                 state.frame);
     }
 }
 
-void SurfaceInterceptor::addTransactionLocked(Increment* increment,
+void SurfaceInterceptor::addTransaction(Increment* increment,
         const Vector<ComposerState>& stateUpdates,
         const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays,
         const Vector<DisplayState>& changedDisplays, uint32_t transactionFlags)
@@ -405,18 +575,18 @@ void SurfaceInterceptor::addTransactionLocked(Increment* increment,
     transaction->set_synchronous(transactionFlags & BnSurfaceComposer::eSynchronous);
     transaction->set_animation(transactionFlags & BnSurfaceComposer::eAnimation);
     for (const auto& compState: stateUpdates) {
-        addSurfaceChangesLocked(transaction, compState.state);
+        addSurfaceChanges(transaction, compState.state);
     }
     for (const auto& disp: changedDisplays) {
         ssize_t dpyIdx = displays.indexOfKey(disp.token);
         if (dpyIdx >= 0) {
             const DisplayDeviceState& dispState(displays.valueAt(dpyIdx));
-            addDisplayChangesLocked(transaction, disp, dispState.displayId);
+            addDisplayChanges(transaction, disp, dispState.displayId);
         }
     }
 }
 
-void SurfaceInterceptor::addSurfaceCreationLocked(Increment* increment,
+void SurfaceInterceptor::addSurfaceCreation(Increment* increment,
         const sp<const Layer>& layer)
 {
     SurfaceCreation* creation(increment->mutable_surface_creation());
@@ -426,29 +596,27 @@ void SurfaceInterceptor::addSurfaceCreationLocked(Increment* increment,
     creation->set_h(layer->mCurrentState.active.h);
 }
 
-void SurfaceInterceptor::addSurfaceDeletionLocked(Increment* increment,
-        const sp<const Layer>& layer)
-{
+void SurfaceInterceptor::addSurfaceDeletion(Increment* increment, int32_t layerId) {
     SurfaceDeletion* deletion(increment->mutable_surface_deletion());
-    deletion->set_id(getLayerId(layer));
+    deletion->set_id(layerId);
 }
 
-void SurfaceInterceptor::addBufferUpdateLocked(Increment* increment, const sp<const Layer>& layer,
-        uint32_t width, uint32_t height, uint64_t frameNumber)
+void SurfaceInterceptor::addBufferUpdate(Increment* increment, int32_t layerId, uint32_t width,
+        uint32_t height, uint64_t frameNumber)
 {
     BufferUpdate* update(increment->mutable_buffer_update());
-    update->set_id(getLayerId(layer));
+    update->set_id(layerId);
     update->set_w(width);
     update->set_h(height);
     update->set_frame_number(frameNumber);
 }
 
-void SurfaceInterceptor::addVSyncUpdateLocked(Increment* increment, nsecs_t timestamp) {
+void SurfaceInterceptor::addVSyncUpdate(Increment* increment, nsecs_t timestamp) {
     VSyncEvent* event(increment->mutable_vsync_event());
     event->set_when(timestamp);
 }
 
-void SurfaceInterceptor::addDisplaySurfaceLocked(Transaction* transaction, int32_t displayId,
+void SurfaceInterceptor::addDisplaySurface(Transaction* transaction, int32_t displayId,
         const sp<const IGraphicBufferProducer>& surface)
 {
     if (surface == nullptr) {
@@ -457,7 +625,7 @@ void SurfaceInterceptor::addDisplaySurfaceLocked(Transaction* transaction, int32
     uint64_t bufferQueueId = 0;
     status_t err(surface->getUniqueId(&bufferQueueId));
     if (err == NO_ERROR) {
-        DisplayChange* dispChange(createDisplayChangeLocked(transaction, displayId));
+        DisplayChange* dispChange(createDisplayChange(transaction, displayId));
         DispSurfaceChange* surfaceChange(dispChange->mutable_surface());
         surfaceChange->set_buffer_queue_id(bufferQueueId);
         surfaceChange->set_buffer_queue_name(surface->getConsumerName().string());
@@ -468,36 +636,36 @@ void SurfaceInterceptor::addDisplaySurfaceLocked(Transaction* transaction, int32
     }
 }
 
-void SurfaceInterceptor::addDisplayLayerStackLocked(Transaction* transaction,
+void SurfaceInterceptor::addDisplayLayerStack(Transaction* transaction,
         int32_t displayId, uint32_t layerStack)
 {
-    DisplayChange* dispChange(createDisplayChangeLocked(transaction, displayId));
+    DisplayChange* dispChange(createDisplayChange(transaction, displayId));
     LayerStackChange* layerStackChange(dispChange->mutable_layer_stack());
     layerStackChange->set_layer_stack(layerStack);
 }
 
-void SurfaceInterceptor::addDisplaySizeLocked(Transaction* transaction, int32_t displayId,
+void SurfaceInterceptor::addDisplaySize(Transaction* transaction, int32_t displayId,
         uint32_t w, uint32_t h)
 {
-    DisplayChange* dispChange(createDisplayChangeLocked(transaction, displayId));
+    DisplayChange* dispChange(createDisplayChange(transaction, displayId));
     SizeChange* sizeChange(dispChange->mutable_size());
     sizeChange->set_w(w);
     sizeChange->set_h(h);
 }
 
-void SurfaceInterceptor::addDisplayProjectionLocked(Transaction* transaction,
+void SurfaceInterceptor::addDisplayProjection(Transaction* transaction,
         int32_t displayId, int32_t orientation, const Rect& viewport, const Rect& frame)
 {
-    DisplayChange* dispChange(createDisplayChangeLocked(transaction, displayId));
+    DisplayChange* dispChange(createDisplayChange(transaction, displayId));
     ProjectionChange* projectionChange(dispChange->mutable_projection());
     projectionChange->set_orientation(orientation);
     Rectangle* viewportRect(projectionChange->mutable_viewport());
-    setProtoRectLocked(viewportRect, viewport);
+    setProtoRect(viewportRect, viewport);
     Rectangle* frameRect(projectionChange->mutable_frame());
-    setProtoRectLocked(frameRect, frame);
+    setProtoRect(frameRect, frame);
 }
 
-void SurfaceInterceptor::addDisplayCreationLocked(Increment* increment,
+void SurfaceInterceptor::addDisplayCreation(Increment* increment,
         const DisplayDeviceState& info)
 {
     DisplayCreation* creation(increment->mutable_display_creation());
@@ -507,12 +675,12 @@ void SurfaceInterceptor::addDisplayCreationLocked(Increment* increment,
     creation->set_is_secure(info.isSecure);
 }
 
-void SurfaceInterceptor::addDisplayDeletionLocked(Increment* increment, int32_t displayId) {
+void SurfaceInterceptor::addDisplayDeletion(Increment* increment, int32_t displayId) {
     DisplayDeletion* deletion(increment->mutable_display_deletion());
     deletion->set_id(displayId);
 }
 
-void SurfaceInterceptor::addPowerModeUpdateLocked(Increment* increment, int32_t displayId,
+void SurfaceInterceptor::addPowerModeUpdate(Increment* increment, int32_t displayId,
         int32_t mode)
 {
     PowerModeUpdate* powerModeUpdate(increment->mutable_power_mode_update());
@@ -528,9 +696,13 @@ void SurfaceInterceptor::saveTransaction(const Vector<ComposerState>& stateUpdat
         return;
     }
     ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addTransactionLocked(createTraceIncrementLocked(), stateUpdates, displays, changedDisplays,
-            flags);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    std::unique_ptr<Increment> increment(new Increment());
+    addTransaction(increment.get(), stateUpdates, displays, changedDisplays, flags);
+    queueIncrement(std::move(increment));
 }
 
 void SurfaceInterceptor::saveSurfaceCreation(const sp<const Layer>& layer) {
@@ -538,17 +710,26 @@ void SurfaceInterceptor::saveSurfaceCreation(const sp<const Layer>& layer) {
         return;
     }
     ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addSurfaceCreationLocked(createTraceIncrementLocked(), layer);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    std::unique_ptr<Increment> increment(new Increment());
+    addSurfaceCreation(increment.get(), layer);
+    queueIncrement(std::move(increment));
 }
 
 void SurfaceInterceptor::saveSurfaceDeletion(const sp<const Layer>& layer) {
     if (!mEnabled || layer == nullptr) {
         return;
     }
-    ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addSurfaceDeletionLocked(createTraceIncrementLocked(), layer);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    Event* event(createEvent(Event::Type::SURFACE_DELETION));
+    event->id = getLayerId(layer);
+    queueEvent(event);
 }
 
 void SurfaceInterceptor::saveBufferUpdate(const sp<const Layer>& layer, uint32_t width,
@@ -557,17 +738,29 @@ void SurfaceInterceptor::saveBufferUpdate(const sp<const Layer>& layer, uint32_t
     if (!mEnabled || layer == nullptr) {
         return;
     }
-    ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addBufferUpdateLocked(createTraceIncrementLocked(), layer, width, height, frameNumber);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    Event* event(createEvent(Event::Type::BUFFER_UPDATE));
+    event->id = getLayerId(layer);
+    event->width = width;
+    event->height = height;
+    event->value = frameNumber;
+    queueEvent(event);
 }
 
 void SurfaceInterceptor::saveVSyncEvent(nsecs_t timestamp) {
     if (!mEnabled) {
         return;
     }
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addVSyncUpdateLocked(createTraceIncrementLocked(), timestamp);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    Event* event(createEvent(Event::Type::VSYNC));
+    event->value = static_cast<uint64_t>(timestamp);
+    queueEvent(event);
 }
 
 void SurfaceInterceptor::saveDisplayCreation(const DisplayDeviceState& info) {
@@ -575,26 +768,40 @@ void SurfaceInterceptor::saveDisplayCreation(const DisplayDeviceState& info) {
         return;
     }
     ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addDisplayCreationLocked(createTraceIncrementLocked(), info);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    std::unique_ptr<Increment> increment(new Increment());
+    addDisplayCreation(increment.get(), info);
+    queueIncrement(std::move(increment));
 }
 
 void SurfaceInterceptor::saveDisplayDeletion(int32_t displayId) {
     if (!mEnabled) {
         return;
     }
-    ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addDisplayDeletionLocked(createTraceIncrementLocked(), displayId);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    Event* event(createEvent(Event::Type::DISPLAY_DELETION));
+    event->id = displayId;
+    queueEvent(event);
 }
 
 void SurfaceInterceptor::savePowerModeUpdate(int32_t displayId, int32_t mode) {
     if (!mEnabled) {
         return;
     }
-    ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-    addPowerModeUpdateLocked(createTraceIncrementLocked(), displayId, mode);
+    SaveScope scope(this);
+    if (!scope.isEnabled()) {
+        return;
+    }
+    Event* event(createEvent(Event::Type::POWER_MODE_UPDATE));
+    event->id = displayId;
+    event->mode = mode;
+    queueEvent(event);
 }
 
 } // namespace impl
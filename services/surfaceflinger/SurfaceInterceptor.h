@@ -19,7 +19,9 @@
 
 #include <frameworks/native/cmds/surfacereplayer/proto/src/trace.pb.h>
 
-#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include <gui/LayerState.h>
 
@@ -80,7 +82,7 @@ namespace impl {
 class SurfaceInterceptor final : public android::SurfaceInterceptor {
 public:
     explicit SurfaceInterceptor(SurfaceFlinger* const flinger);
-    ~SurfaceInterceptor() override = default;
+    ~SurfaceInterceptor() override;
 
     // Both vectors are used to capture the current state of SF as the initial snapshot in the trace
     void enable(const SortedVector<sp<Layer>>& layers,
@@ -106,73 +108,130 @@ public:
     void saveVSyncEvent(nsecs_t timestamp) override;
 
 private:
+    // An event waiting in the queue for the writer thread. Events with only a few values are
+    // recorded as such and converted to an Increment by the writer; the others, like
+    // transactions, need layer state and are converted by the thread that saves them.
+    struct Event {
+        enum class Type : uint8_t {
+            INCREMENT,
+            SURFACE_DELETION,
+            BUFFER_UPDATE,
+            VSYNC,
+            DISPLAY_DELETION,
+            POWER_MODE_UPDATE,
+        };
+
+        std::atomic<Event*> next{nullptr};
+        Type type = Type::INCREMENT;
+        nsecs_t timestamp = 0;
+        // Layer or display id.
+        int32_t id = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int32_t mode = 0;
+        // Buffer frame number, or vsync time.
+        uint64_t value = 0;
+        std::unique_ptr<Increment> increment;
+    };
+
+    // Keeps disable() from closing the trace while an event is being saved.
+    class SaveScope {
+    public:
+        explicit SaveScope(SurfaceInterceptor* interceptor);
+        ~SaveScope();
+        bool isEnabled() const { return mEnabled; }
+
+    private:
+        SurfaceInterceptor* const mInterceptor;
+        bool mEnabled;
+    };
+
+    // The queue is an intrusive multiple-producer, single-consumer list, so saving an event
+    // never blocks on the writer or on other threads saving events.
+    void queueEvent(Event* event);
+    void queueIncrement(std::unique_ptr<Increment> increment);
+    Event* popEvent();
+    Event* createEvent(Event::Type type);
+
+    void writerMain();
+    // Appends |event| to |output| as an encoded Trace.increment field.
+    void appendIncrement(const Event& event, std::string* output);
+
     // The creation increments of Surfaces and Displays do not contain enough information to capture
     // the initial state of each object, so a transaction with all of the missing properties is
     // performed at the initial snapshot for each display and surface.
-    void saveExistingDisplaysLocked(
+    void saveExistingDisplays(
             const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays);
-    void saveExistingSurfacesLocked(const SortedVector<sp<Layer>>& layers);
-    void addInitialSurfaceStateLocked(Increment* increment, const sp<const Layer>& layer);
-    void addInitialDisplayStateLocked(Increment* increment, const DisplayDeviceState& display);
+    void saveExistingSurfaces(const SortedVector<sp<Layer>>& layers);
+    void addInitialSurfaceState(Increment* increment, const sp<const Layer>& layer);
+    void addInitialDisplayState(Increment* increment, const DisplayDeviceState& display);
 
-    status_t writeProtoFileLocked();
     const sp<const Layer> getLayer(const wp<const IBinder>& weakHandle);
     const std::string getLayerName(const sp<const Layer>& layer);
     int32_t getLayerId(const sp<const Layer>& layer);
 
-    Increment* createTraceIncrementLocked();
-    void addSurfaceCreationLocked(Increment* increment, const sp<const Layer>& layer);
-    void addSurfaceDeletionLocked(Increment* increment, const sp<const Layer>& layer);
-    void addBufferUpdateLocked(Increment* increment, const sp<const Layer>& layer, uint32_t width,
-            uint32_t height, uint64_t frameNumber);
-    void addVSyncUpdateLocked(Increment* increment, nsecs_t timestamp);
-    void addDisplayCreationLocked(Increment* increment, const DisplayDeviceState& info);
-    void addDisplayDeletionLocked(Increment* increment, int32_t displayId);
-    void addPowerModeUpdateLocked(Increment* increment, int32_t displayId, int32_t mode);
+    void addSurfaceCreation(Increment* increment, const sp<const Layer>& layer);
+    void addSurfaceDeletion(Increment* increment, int32_t layerId);
+    void addBufferUpdate(Increment* increment, int32_t layerId, uint32_t width, uint32_t height,
+            uint64_t frameNumber);
+    void addVSyncUpdate(Increment* increment, nsecs_t timestamp);
+    void addDisplayCreation(Increment* increment, const DisplayDeviceState& info);
+    void addDisplayDeletion(Increment* increment, int32_t displayId);
+    void addPowerModeUpdate(Increment* increment, int32_t displayId, int32_t mode);
 
     // Add surface transactions to the trace
-    SurfaceChange* createSurfaceChangeLocked(Transaction* transaction, int32_t layerId);
-    void setProtoRectLocked(Rectangle* protoRect, const Rect& rect);
-    void addPositionLocked(Transaction* transaction, int32_t layerId, float x, float y);
-    void addDepthLocked(Transaction* transaction, int32_t layerId, uint32_t z);
-    void addSizeLocked(Transaction* transaction, int32_t layerId, uint32_t w, uint32_t h);
-    void addAlphaLocked(Transaction* transaction, int32_t layerId, float alpha);
-    void addMatrixLocked(Transaction* transaction, int32_t layerId,
+    SurfaceChange* createSurfaceChange(Transaction* transaction, int32_t layerId);
+    void setProtoRect(Rectangle* protoRect, const Rect& rect);
+    void addPosition(Transaction* transaction, int32_t layerId, float x, float y);
+    void addDepth(Transaction* transaction, int32_t layerId, uint32_t z);
+    void addSize(Transaction* transaction, int32_t layerId, uint32_t w, uint32_t h);
+    void addAlpha(Transaction* transaction, int32_t layerId, float alpha);
+    void addMatrix(Transaction* transaction, int32_t layerId,
             const layer_state_t::matrix22_t& matrix);
-    void addTransparentRegionLocked(Transaction* transaction, int32_t layerId,
+    void addTransparentRegion(Transaction* transaction, int32_t layerId,
             const Region& transRegion);
-    void addFlagsLocked(Transaction* transaction, int32_t layerId, uint8_t flags);
-    void addLayerStackLocked(Transaction* transaction, int32_t layerId, uint32_t layerStack);
-    void addCropLocked(Transaction* transaction, int32_t layerId, const Rect& rect);
-    void addDeferTransactionLocked(Transaction* transaction, int32_t layerId,
+    void addFlags(Transaction* transaction, int32_t layerId, uint8_t flags);
+    void addLayerStack(Transaction* transaction, int32_t layerId, uint32_t layerStack);
+    void addCrop(Transaction* transaction, int32_t layerId, const Rect& rect);
+    void addDeferTransaction(Transaction* transaction, int32_t layerId,
             const sp<const Layer>& layer, uint64_t frameNumber);
-    void addFinalCropLocked(Transaction* transaction, int32_t layerId, const Rect& rect);
-    void addOverrideScalingModeLocked(Transaction* transaction, int32_t layerId,
+    void addFinalCrop(Transaction* transaction, int32_t layerId, const Rect& rect);
+    void addOverrideScalingMode(Transaction* transaction, int32_t layerId,
             int32_t overrideScalingMode);
-    void addSurfaceChangesLocked(Transaction* transaction, const layer_state_t& state);
-    void addTransactionLocked(Increment* increment, const Vector<ComposerState>& stateUpdates,
+    void addSurfaceChanges(Transaction* transaction, const layer_state_t& state);
+    void addTransaction(Increment* increment, const Vector<ComposerState>& stateUpdates,
             const DefaultKeyedVector< wp<IBinder>, DisplayDeviceState>& displays,
             const Vector<DisplayState>& changedDisplays, uint32_t transactionFlags);
 
     // Add display transactions to the trace
-    DisplayChange* createDisplayChangeLocked(Transaction* transaction, int32_t displayId);
-    void addDisplaySurfaceLocked(Transaction* transaction, int32_t displayId,
+    DisplayChange* createDisplayChange(Transaction* transaction, int32_t displayId);
+    void addDisplaySurface(Transaction* transaction, int32_t displayId,
             const sp<const IGraphicBufferProducer>& surface);
-    void addDisplayLayerStackLocked(Transaction* transaction, int32_t displayId,
+    void addDisplayLayerStack(Transaction* transaction, int32_t displayId,
             uint32_t layerStack);
-    void addDisplaySizeLocked(Transaction* transaction, int32_t displayId, uint32_t w,
+    void addDisplaySize(Transaction* transaction, int32_t displayId, uint32_t w,
             uint32_t h);
-    void addDisplayProjectionLocked(Transaction* transaction, int32_t displayId,
+    void addDisplayProjection(Transaction* transaction, int32_t displayId,
             int32_t orientation, const Rect& viewport, const Rect& frame);
-    void addDisplayChangesLocked(Transaction* transaction,
+    void addDisplayChanges(Transaction* transaction,
             const DisplayState& state, int32_t displayId);
 
 
-    bool mEnabled {false};
+    std::atomic<bool> mEnabled {false};
+    std::atomic<int32_t> mActiveSaves {0};
     std::string mOutputFileName {DEFAULT_FILENAME};
-    std::mutex mTraceMutex {};
-    Trace mTrace {};
+    int mOutputFd {-1};
     SurfaceFlinger* const mFlinger;
+
+    std::atomic<Event*> mQueueHead {&mQueueStub};
+    // Only used by the writer thread.
+    Event* mQueueTail {&mQueueStub};
+    Event mQueueStub {};
+    std::thread mWriterThread {};
+    std::atomic<bool> mStopWriter {false};
+    nsecs_t mLastTimestamp {0};
+    size_t mDroppedIncrements {0};
+    bool mWriteFailed {false};
 };
 
 } // namespace impl
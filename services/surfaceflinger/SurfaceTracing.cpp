@@ -19,23 +19,86 @@
 
 #include "SurfaceTracing.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+
 #include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <layerproto/LayerProtoParser.h>
 #include <log/log.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 
 namespace android {
 
+namespace {
+
+// Tag of LayersTraceFileProto.entry, a length-delimited field number 2.
+constexpr uint8_t ENTRY_TAG = (2 << 3) | 2;
+
+void appendVarint(std::string& output, uint64_t value) {
+    while (value >= 0x80) {
+        output.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+// Writes the entries as a LayersTraceFileProto. They are already serialized, so the file is put
+// together from the encoded magic number followed by one length-delimited field per entry. Use
+// LayerProtoParser::expandTrace() to get the full state of every entry.
+template <typename Entries>
+status_t writeProtoFile(const Entries& entries, const std::string& fileName) {
+    ATRACE_CALL();
+
+    LayersTraceFileProto header;
+    header.set_magic_number(uint64_t(LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_H) << 32 |
+                            LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_L);
+    std::string output;
+    if (!header.SerializeToString(&output)) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    base::unique_fd fd(open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (fd == -1 || !base::WriteFully(fd, output.data(), output.size())) {
+        return PERMISSION_DENIED;
+    }
+    for (const auto& entry : entries) {
+        output.clear();
+        output.push_back(static_cast<char>(ENTRY_TAG));
+        appendVarint(output, entry.data.size());
+        if (!base::WriteFully(fd, output.data(), output.size()) ||
+            !base::WriteFully(fd, entry.data.data(), entry.data.size())) {
+            return PERMISSION_DENIED;
+        }
+    }
+    return NO_ERROR;
+}
+
+} // namespace
+
+SurfaceTracing::~SurfaceTracing() {
+    {
+        std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+        mStopThread = true;
+        mCondition.notify_all();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
 void SurfaceTracing::enable() {
     if (mEnabled) {
         return;
     }
     ATRACE_CALL();
-    mEnabled = true;
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
-
-    mTrace.set_magic_number(uint64_t(LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_H) << 32 |
-                            LayersTraceFileProto_MagicNumber_MAGIC_NUMBER_L);
+    // Flight recorder entries still pending go into the trace, which is fine as they are the
+    // latest states.
+    mEnabled = true;
+    resetBufferLocked(DEFAULT_BUFFER_SIZE);
+    startThreadLocked();
 }
 
 status_t SurfaceTracing::disable() {
@@ -43,12 +106,19 @@ status_t SurfaceTracing::disable() {
         return NO_ERROR;
     }
     ATRACE_CALL();
-    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    std::unique_lock<std::mutex> protoGuard(mTraceMutex);
     mEnabled = false;
-    status_t err(writeProtoFileLocked());
+    flushLocked(protoGuard);
+    std::deque<SerializedEntry> entries;
+    entries.swap(mBuffer);
+    resetBufferLocked(mFlightRecorderEnabled ? mFlightRecorderBufferSize : 0);
+
+    // The main thread may keep tracing for the flight recorder, so don't hold the lock while
+    // writing.
+    protoGuard.unlock();
+    status_t err(writeProtoFile(entries, mOutputFileName));
     ALOGE_IF(err == PERMISSION_DENIED, "Could not save the proto file! Permission denied");
     ALOGE_IF(err == NOT_ENOUGH_DATA, "Could not save the proto file! There are missing fields");
-    mTrace.Clear();
     return err;
 }
 
@@ -56,30 +126,186 @@ bool SurfaceTracing::isEnabled() {
     return mEnabled;
 }
 
+void SurfaceTracing::enableFlightRecorder(size_t bufferSize) {
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    mFlightRecorderEnabled = true;
+    mFlightRecorderBufferSize = bufferSize;
+    if (!mEnabled) {
+        resetBufferLocked(bufferSize);
+    }
+    startThreadLocked();
+}
+
+bool SurfaceTracing::isRecording() {
+    return mEnabled || mFlightRecorderEnabled;
+}
+
 void SurfaceTracing::traceLayers(const char* where, LayersProto layers) {
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->where = where;
+    entry->elapsedRealtimeNanos = elapsedRealtimeNano();
+    entry->layers.Swap(&layers);
+
     std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    if (!mThreadRunning) {
+        return;
+    }
+    if (mPending.size() >= MAX_PENDING_ENTRIES) {
+        mPending.pop();
+        mDroppedEntries++;
+    }
+    mPending.push(std::move(entry));
+    mCondition.notify_all();
+}
 
-    LayersTraceProto* entry = mTrace.add_entry();
-    entry->set_elapsed_realtime_nanos(elapsedRealtimeNano());
-    entry->set_where(where);
-    entry->mutable_layers()->Swap(&layers);
+status_t SurfaceTracing::dumpFlightRecorder(const char* reason) {
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    if (!mFlightRecorderEnabled || mEnabled) {
+        return INVALID_OPERATION;
+    }
+    mPendingDumpReason = reason;
+    mCondition.notify_all();
+    return NO_ERROR;
 }
 
-status_t SurfaceTracing::writeProtoFileLocked() {
-    ATRACE_CALL();
+void SurfaceTracing::onFrameMissed() {
+    if (!mFlightRecorderEnabled || mEnabled) {
+        return;
+    }
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    if (mLastJankDumpTime != 0 && now - mLastJankDumpTime < JANK_DUMP_INTERVAL) {
+        return;
+    }
+    mLastJankDumpTime = now;
+    mPendingDumpReason = "missed frame";
+    mCondition.notify_all();
+}
 
-    if (!mTrace.IsInitialized()) {
-        return NOT_ENOUGH_DATA;
+void SurfaceTracing::dump(String8& result) const {
+    std::lock_guard<std::mutex> protoGuard(mTraceMutex);
+    result.appendFormat("Layer tracing: %s, flight recorder: %s\n",
+                        mEnabled ? "enabled" : "disabled",
+                        mFlightRecorderEnabled ? "enabled" : "disabled");
+    result.appendFormat("  buffer: %zu of %zu KiB, %zu entries, %zu dropped, %zu pending\n",
+                        mBufferUsed / 1024, mBufferSize / 1024, mBuffer.size(), mDroppedEntries,
+                        mPending.size());
+    if (mFlightRecorderEnabled) {
+        result.appendFormat("  flight recorder dumps: %zu to %s\n", mFlightRecorderDumps,
+                            FLIGHT_RECORDER_FILENAME);
     }
-    std::string output;
-    if (!mTrace.SerializeToString(&output)) {
-        return PERMISSION_DENIED;
+}
+
+void SurfaceTracing::startThreadLocked() {
+    if (mThreadRunning) {
+        return;
     }
-    if (!android::base::WriteStringToFile(output, mOutputFileName, true)) {
-        return PERMISSION_DENIED;
+    mThreadRunning = true;
+    mThread = std::thread(&SurfaceTracing::threadMain, this);
+    pthread_setname_np(mThread.native_handle(), "SurfaceTracing");
+}
+
+void SurfaceTracing::threadMain() {
+    std::unique_lock<std::mutex> protoGuard(mTraceMutex);
+    while (true) {
+        mCondition.wait(protoGuard, [this] {
+            return mStopThread || !mPending.empty() || mPendingDumpReason != nullptr;
+        });
+        if (mStopThread) {
+            break;
+        }
+
+        if (!mPending.empty()) {
+            std::unique_ptr<Entry> entry = std::move(mPending.front());
+            mPending.pop();
+            mSerializing = true;
+            SerializedEntry serialized;
+            serialized.keyframe = mForceKeyframe || mEntriesSinceKeyframe >= KEYFRAME_INTERVAL;
+            mForceKeyframe = false;
+            protoGuard.unlock();
+
+            {
+                ATRACE_NAME("SurfaceTracing::serialize");
+                LayersTraceProto proto;
+                proto.set_elapsed_realtime_nanos(entry->elapsedRealtimeNanos);
+                proto.set_where(entry->where);
+                if (serialized.keyframe) {
+                    proto.mutable_layers()->Swap(&entry->layers);
+                    proto.SerializeToString(&serialized.data);
+                    mPreviousLayers.Swap(proto.mutable_layers());
+                    mEntriesSinceKeyframe = 0;
+                } else {
+                    *proto.mutable_delta() =
+                            LayerProtoParser::generateDelta(mPreviousLayers, entry->layers);
+                    proto.SerializeToString(&serialized.data);
+                    mPreviousLayers.Swap(&entry->layers);
+                    mEntriesSinceKeyframe++;
+                }
+            }
+
+            protoGuard.lock();
+            mSerializing = false;
+            addToBufferLocked(std::move(serialized));
+            mCondition.notify_all();
+            continue;
+        }
+
+        const char* reason = mPendingDumpReason;
+        mPendingDumpReason = nullptr;
+        if (mEnabled) {
+            // The buffer holds the trace being taken rather than the flight recorder.
+            continue;
+        }
+        std::deque<SerializedEntry> entries(mBuffer);
+        protoGuard.unlock();
+        status_t err = writeProtoFile(entries, FLIGHT_RECORDER_FILENAME);
+        ALOGE_IF(err != NO_ERROR, "Could not save the flight recorder (%s): %d", reason, err);
+        ALOGI_IF(err == NO_ERROR, "Saved %zu layer trace entries to %s (%s)", entries.size(),
+                 FLIGHT_RECORDER_FILENAME, reason);
+        protoGuard.lock();
+        if (err == NO_ERROR) {
+            mFlightRecorderDumps++;
+        }
     }
+}
 
-    return NO_ERROR;
+void SurfaceTracing::flushLocked(std::unique_lock<std::mutex>& lock) {
+    mCondition.wait(lock, [this] { return mPending.empty() && !mSerializing; });
+}
+
+void SurfaceTracing::resetBufferLocked(size_t size) {
+    mBuffer.clear();
+    mBufferSize = size;
+    mBufferUsed = 0;
+    mDroppedEntries = 0;
+    mForceKeyframe = true;
+}
+
+void SurfaceTracing::addToBufferLocked(SerializedEntry&& entry) {
+    const size_t size = entry.data.size();
+    // The next entry would be a delta of this one, so it has to be a keyframe.
+    if (size > mBufferSize) {
+        mDroppedEntries++;
+        mForceKeyframe = true;
+        return;
+    }
+    // Old entries are dropped up to the next keyframe, so the ring always starts with one.
+    while (!mBuffer.empty() && mBufferUsed + size > mBufferSize) {
+        do {
+            mBufferUsed -= mBuffer.front().data.size();
+            mBuffer.pop_front();
+            mDroppedEntries++;
+        } while (!mBuffer.empty() && !mBuffer.front().keyframe);
+    }
+    // A delta is of no use without the entry before it, either because the ring was reset
+    // while it was serialized or because it dropped everything up to this entry.
+    if (mBuffer.empty() && !entry.keyframe) {
+        mDroppedEntries++;
+        mForceKeyframe = true;
+        return;
+    }
+    mBufferUsed += size;
+    mBuffer.push_back(std::move(entry));
 }
 
 } // namespace android
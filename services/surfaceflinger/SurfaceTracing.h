@@ -18,8 +18,16 @@
 
 #include <layerproto/LayerProtoHeader.h>
 #include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
 
 using namespace android::surfaceflinger;
 
@@ -27,24 +35,96 @@ namespace android {
 
 /*
  * SurfaceTracing records layer states during surface flinging.
+ *
+ * The main thread only hands over the layer protos; they are serialized on a tracing thread into
+ * a ring buffer of bounded size, which drops the oldest entries when it is full. The ring is
+ * written out when tracing is disabled.
+ *
+ * In flight recorder mode a smaller ring is kept while no trace is being taken, and it is written
+ * to a separate file on demand or when frames are missed.
  */
 class SurfaceTracing {
 public:
+    ~SurfaceTracing();
+
     void enable();
     status_t disable();
     bool isEnabled();
 
+    // Keeps the last layer states in a ring buffer of |bufferSize| bytes whenever no trace is
+    // being taken.
+    void enableFlightRecorder(size_t bufferSize);
+    // True if traceLayers() should be called, either for a trace or for the flight recorder.
+    bool isRecording();
+
     void traceLayers(const char* where, LayersProto);
 
+    // Writes the flight recorder buffer to FLIGHT_RECORDER_FILENAME on the tracing thread.
+    // Returns INVALID_OPERATION if the flight recorder is off or a trace is being taken.
+    status_t dumpFlightRecorder(const char* reason);
+    // Dumps the flight recorder when a frame is missed, at most once per JANK_DUMP_INTERVAL.
+    void onFrameMissed();
+
+    void dump(String8& result) const;
+
 private:
     static constexpr auto DEFAULT_FILENAME = "/data/misc/wmtrace/layers_trace.pb";
+    static constexpr auto FLIGHT_RECORDER_FILENAME = "/data/misc/wmtrace/layers_flight.pb";
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 100 * 1024 * 1024;
+    // Snapshots waiting for the tracing thread; older ones are dropped if it falls behind.
+    static constexpr size_t MAX_PENDING_ENTRIES = 16;
+    static constexpr nsecs_t JANK_DUMP_INTERVAL = 10 * 1000000000LL;
+    // Entries are stored as deltas of the previous one, with a full state every
+    // KEYFRAME_INTERVAL entries so that the ring can drop old entries.
+    static constexpr size_t KEYFRAME_INTERVAL = 60;
+
+    struct Entry {
+        std::string where;
+        int64_t elapsedRealtimeNanos;
+        LayersProto layers;
+    };
 
-    status_t writeProtoFileLocked();
+    struct SerializedEntry {
+        std::string data;
+        bool keyframe;
+    };
+
+    void startThreadLocked();
+    void threadMain();
+    // Waits until the tracing thread has serialized all pending entries.
+    void flushLocked(std::unique_lock<std::mutex>& lock);
+
+    void resetBufferLocked(size_t size);
+    void addToBufferLocked(SerializedEntry&& entry);
 
     bool mEnabled = false;
     std::string mOutputFileName = DEFAULT_FILENAME;
-    std::mutex mTraceMutex;
-    LayersTraceFileProto mTrace;
+
+    mutable std::mutex mTraceMutex;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool mThreadRunning = false;
+    bool mStopThread = false;
+    bool mSerializing = false;
+    std::queue<std::unique_ptr<Entry>> mPending;
+
+    // Serialized LayersTraceProto entries, the oldest first. The first one is always a keyframe.
+    std::deque<SerializedEntry> mBuffer;
+    size_t mBufferSize = 0;
+    size_t mBufferUsed = 0;
+    size_t mDroppedEntries = 0;
+    // Set when the next entry cannot be a delta, because the one before it is gone.
+    bool mForceKeyframe = true;
+
+    // Only used by the tracing thread: the state the next delta is generated against.
+    LayersProto mPreviousLayers;
+    size_t mEntriesSinceKeyframe = 0;
+
+    bool mFlightRecorderEnabled = false;
+    size_t mFlightRecorderBufferSize = 0;
+    const char* mPendingDumpReason = nullptr;
+    nsecs_t mLastJankDumpTime = 0;
+    size_t mFlightRecorderDumps = 0;
 };
 
 } // namespace android
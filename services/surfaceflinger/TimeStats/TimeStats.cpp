@@ -27,10 +27,25 @@
 #include <utils/Trace.h>
 
 #include <algorithm>
+#include <limits>
 #include <regex>
 
 namespace android {
 
+// Lower bounds of the composition stage histogram buckets, in microseconds.
+static const std::array<int32_t, 34> stageHistogramConfig =
+        {0,    50,   100,  150,  200,  300,  400,   500,   600,   700,   800,   900,
+         1000, 1250, 1500, 1750, 2000, 2500, 3000,  3500,  4000,  5000,  6000,  7000,
+         8000, 10000, 12000, 14000, 16000, 20000, 25000, 33000, 50000, 100000};
+
+static const char* compositionStageName(size_t stage) {
+    static const char* const names[] = {
+            "handlePageFlip",  "rebuildLayerStacks", "setUpHWComposer", "hwcValidate",
+            "composeSurfaces", "hwcPresent",         "postComposition",
+    };
+    return names[stage];
+}
+
 TimeStats& TimeStats::getInstance() {
     static std::unique_ptr<TimeStats> sInstance;
     static std::once_flag sOnceFlag;
@@ -79,31 +94,93 @@ void TimeStats::parseArgs(bool asProto, const Vector<String16>& args, size_t& in
     }
 }
 
-void TimeStats::incrementTotalFrames() {
-    if (!mEnabled.load()) return;
+void TimeStats::recordCompositionStage(CompositionStage stage, nsecs_t duration) {
+    if (!mEnabled.load(std::memory_order_relaxed) || duration < 0) return;
+
+    static_assert(std::tuple_size<decltype(stageHistogramConfig)>::value == NUM_STAGE_BUCKETS,
+                  "stage histogram config does not match NUM_STAGE_BUCKETS");
+    const uint32_t micros = static_cast<uint32_t>(
+            std::min<nsecs_t>(ns2us(duration), std::numeric_limits<int32_t>::max()));
+    auto bucket = std::upper_bound(stageHistogramConfig.begin(), stageHistogramConfig.end(),
+                                   static_cast<int32_t>(micros)) - 1;
+
+    // only the main thread records, so the plain load/store of the maximum
+    // can only race with clear()
+    StageHistogram& histogram = mCompositionStages[static_cast<size_t>(stage)];
+    histogram.buckets[bucket - stageHistogramConfig.begin()].fetch_add(1,
+                                                                      std::memory_order_relaxed);
+    histogram.totalMicros.fetch_add(micros, std::memory_order_relaxed);
+    if (micros > histogram.maxMicros.load(std::memory_order_relaxed)) {
+        histogram.maxMicros.store(micros, std::memory_order_relaxed);
+    }
+}
+
+void TimeStats::recordBufferingStats(LayerTracker* tracker,
+                                     const std::vector<OccupancyTracker::Segment>& history) {
+    if (tracker == nullptr || !mEnabled.load() || history.empty()) return;
+
+    // A queue holding more than one buffer on average has frames waiting
+    // behind another one, each adding a refresh of latency. One holding a
+    // buffer less than half the time leaves composition with nothing new
+    // to latch more often than not.
+    static constexpr float kStuffedOccupancy = 1.0f;
+    static constexpr float kStarvedOccupancy = 0.5f;
 
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    timeStats.totalFrames++;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    // Only layers that TimeStats tracks frames for
+    TimeStatsHelper::TimeStatsLayer& timeStatsLayer = tracker->stats;
+    if (timeStatsLayer.statsStart == 0) return;
+    for (const auto& segment : history) {
+        const int64_t segmentMs = ns2ms(segment.totalTime);
+        timeStatsLayer.bufferedMs += segmentMs;
+        if (segment.occupancyAverage >= kStuffedOccupancy) {
+            timeStatsLayer.stuffedMs += segmentMs;
+        } else if (segment.occupancyAverage < kStarvedOccupancy) {
+            timeStatsLayer.starvedMs += segmentMs;
+        }
+    }
 }
 
-void TimeStats::incrementMissedFrames() {
+void TimeStats::collectCompositionStagesLocked() {
+    timeStats.compositionStages.clear();
+    for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+        const StageHistogram& histogram = mCompositionStages[stage];
+        TimeStatsHelper::CompositionStage compositionStage;
+        compositionStage.stageName = compositionStageName(stage);
+        for (size_t i = 0; i < NUM_STAGE_BUCKETS; i++) {
+            const int32_t count =
+                    static_cast<int32_t>(histogram.buckets[i].load(std::memory_order_relaxed));
+            if (count == 0) continue;
+            compositionStage.hist[stageHistogramConfig[i]] = count;
+            compositionStage.count += count;
+        }
+        if (compositionStage.count == 0) continue;
+        compositionStage.totalMicros =
+                static_cast<int64_t>(histogram.totalMicros.load(std::memory_order_relaxed));
+        compositionStage.maxMicros =
+                static_cast<int32_t>(histogram.maxMicros.load(std::memory_order_relaxed));
+        timeStats.compositionStages.push_back(std::move(compositionStage));
+    }
+}
+
+void TimeStats::incrementTotalFrames() {
     if (!mEnabled.load()) return;
 
-    ATRACE_CALL();
+    mTotalFrames.fetch_add(1, std::memory_order_relaxed);
+}
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    timeStats.missedFrames++;
+void TimeStats::incrementMissedFrames() {
+    if (!mEnabled.load()) return;
+
+    mMissedFrames.fetch_add(1, std::memory_order_relaxed);
 }
 
 void TimeStats::incrementClientCompositionFrames() {
     if (!mEnabled.load()) return;
 
-    ATRACE_CALL();
-
-    std::lock_guard<std::mutex> lock(mMutex);
-    timeStats.clientCompositionFrames++;
+    mClientCompositionFrames.fetch_add(1, std::memory_order_relaxed);
 }
 
 bool TimeStats::recordReadyLocked(const std::string& layerName, TimeRecord* timeRecord) {
@@ -163,10 +240,11 @@ static std::string getPackageName(const std::string& layerName) {
     return "";
 }
 
-void TimeStats::flushAvailableRecordsToStatsLocked(const std::string& layerName) {
+void TimeStats::flushAvailableRecordsToStatsLocked(LayerTracker* tracker) {
     ATRACE_CALL();
 
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    const std::string& layerName = tracker->layerName;
+    LayerRecord& layerRecord = tracker->layerRecord;
     TimeRecord& prevTimeRecord = layerRecord.prevTimeRecord;
     std::deque<TimeRecord>& timeRecords = layerRecord.timeRecords;
     while (!timeRecords.empty()) {
@@ -175,12 +253,12 @@ void TimeStats::flushAvailableRecordsToStatsLocked(const std::string& layerName)
               timeRecords[0].frameNumber, timeRecords[0].presentTime);
 
         if (prevTimeRecord.ready) {
-            if (!timeStats.stats.count(layerName)) {
-                timeStats.stats[layerName].layerName = layerName;
-                timeStats.stats[layerName].packageName = getPackageName(layerName);
-                timeStats.stats[layerName].statsStart = static_cast<int64_t>(std::time(0));
+            TimeStatsHelper::TimeStatsLayer& timeStatsLayer = tracker->stats;
+            if (timeStatsLayer.statsStart == 0) {
+                timeStatsLayer.layerName = layerName;
+                timeStatsLayer.packageName = getPackageName(layerName);
+                timeStatsLayer.statsStart = static_cast<int64_t>(std::time(0));
             }
-            TimeStatsHelper::TimeStatsLayer& timeStatsLayer = timeStats.stats[layerName];
             timeStatsLayer.totalFrames++;
 
             const int32_t postToPresentMs =
@@ -213,7 +291,7 @@ void TimeStats::flushAvailableRecordsToStatsLocked(const std::string& layerName)
                   timeRecords[0].frameNumber, presentToPresentMs);
             timeStatsLayer.deltas["present2present"].insert(presentToPresentMs);
 
-            timeStats.stats[layerName].statsEnd = static_cast<int64_t>(std::time(0));
+            timeStatsLayer.statsEnd = static_cast<int64_t>(std::time(0));
         }
         prevTimeRecord = timeRecords[0];
         timeRecords.pop_front();
@@ -221,6 +299,44 @@ void TimeStats::flushAvailableRecordsToStatsLocked(const std::string& layerName)
     }
 }
 
+void TimeStats::mergeLayerStats(const TimeStatsHelper::TimeStatsLayer& from,
+                                TimeStatsHelper::TimeStatsLayer* into) {
+    if (from.statsStart == 0) return;
+
+    if (into->statsStart == 0) {
+        into->layerName = from.layerName;
+        into->packageName = from.packageName;
+        into->statsStart = from.statsStart;
+    } else {
+        into->statsStart = std::min(into->statsStart, from.statsStart);
+    }
+    into->statsEnd = std::max(into->statsEnd, from.statsEnd);
+    into->totalFrames += from.totalFrames;
+    for (const auto& [name, histogram] : from.deltas) {
+        auto& hist = into->deltas[name].hist;
+        for (const auto& [delta, count] : histogram.hist) {
+            hist[delta] += count;
+        }
+    }
+    into->bufferedMs += from.bufferedMs;
+    into->stuffedMs += from.stuffedMs;
+    into->starvedMs += from.starvedMs;
+}
+
+void TimeStats::retireLayerTrackersLocked() {
+    // The registry holds the last reference to the trackers of destroyed
+    // layers, so nothing else can record to them anymore.
+    auto alive = std::partition(mLayerTrackers.begin(), mLayerTrackers.end(),
+                                [](const auto& tracker) { return tracker.use_count() > 1; });
+    for (auto it = alive; it != mLayerTrackers.end(); ++it) {
+        const TimeStatsHelper::TimeStatsLayer& stats = (*it)->stats;
+        if (stats.statsStart != 0) {
+            mergeLayerStats(stats, &timeStats.stats[stats.layerName]);
+        }
+    }
+    mLayerTrackers.erase(alive, mLayerTrackers.end());
+}
+
 static bool layerNameIsValid(const std::string& layerName) {
     // This regular expression captures the following layer names for instance:
     // 1) StatusBat#0
@@ -234,19 +350,28 @@ static bool layerNameIsValid(const std::string& layerName) {
     return std::regex_match(layerName.begin(), layerName.end(), re);
 }
 
-void TimeStats::setPostTime(const std::string& layerName, uint64_t frameNumber, nsecs_t postTime) {
-    if (!mEnabled.load()) return;
+std::shared_ptr<TimeStats::LayerTracker> TimeStats::createLayerTracker(
+        const std::string& layerName) {
+    if (!layerNameIsValid(layerName)) return nullptr;
+
+    auto tracker = std::make_shared<LayerTracker>(layerName);
+    std::lock_guard<std::mutex> lock(mMutex);
+    retireLayerTrackersLocked();
+    mLayerTrackers.push_back(tracker);
+    return tracker;
+}
+
+void TimeStats::setPostTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t postTime) {
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-PostTime[%" PRId64 "]", layerName.c_str(), frameNumber, postTime);
+    ALOGV("[%s]-[%" PRIu64 "]-PostTime[%" PRId64 "]", tracker->layerName.c_str(), frameNumber,
+          postTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName) && !layerNameIsValid(layerName)) {
-        return;
-    }
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
     if (layerRecord.timeRecords.size() == MAX_NUM_TIME_RECORDS) {
-        ALOGV("[%s]-timeRecords is already at its maximum size[%zu]", layerName.c_str(),
+        ALOGV("[%s]-timeRecords is already at its maximum size[%zu]", tracker->layerName.c_str(),
               MAX_NUM_TIME_RECORDS);
         // TODO(zzyiwei): if this happens, there must be a present fence missing
         // or waitData is not in the correct position. Need to think out a
@@ -267,84 +392,94 @@ void TimeStats::setPostTime(const std::string& layerName, uint64_t frameNumber,
         layerRecord.waitData = layerRecord.timeRecords.size() - 1;
 }
 
-void TimeStats::setLatchTime(const std::string& layerName, uint64_t frameNumber,
-                             nsecs_t latchTime) {
-    if (!mEnabled.load()) return;
+void TimeStats::setLatchTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t latchTime) {
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-LatchTime[%" PRId64 "]", layerName.c_str(), frameNumber, latchTime);
+    ALOGV("[%s]-[%" PRIu64 "]-LatchTime[%" PRId64 "]", tracker->layerName.c_str(), frameNumber,
+          latchTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.latchTime = latchTime;
     }
 }
 
-void TimeStats::setDesiredTime(const std::string& layerName, uint64_t frameNumber,
+void TimeStats::setDesiredTime(LayerTracker* tracker, uint64_t frameNumber,
                                nsecs_t desiredTime) {
-    if (!mEnabled.load()) return;
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-DesiredTime[%" PRId64 "]", layerName.c_str(), frameNumber,
+    ALOGV("[%s]-[%" PRIu64 "]-DesiredTime[%" PRId64 "]", tracker->layerName.c_str(), frameNumber,
           desiredTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.desiredTime = desiredTime;
     }
 }
 
-void TimeStats::setAcquireTime(const std::string& layerName, uint64_t frameNumber,
+void TimeStats::setAcquireTime(LayerTracker* tracker, uint64_t frameNumber,
                                nsecs_t acquireTime) {
-    if (!mEnabled.load()) return;
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-AcquireTime[%" PRId64 "]", layerName.c_str(), frameNumber,
+    ALOGV("[%s]-[%" PRIu64 "]-AcquireTime[%" PRId64 "]", tracker->layerName.c_str(), frameNumber,
           acquireTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.acquireTime = acquireTime;
     }
 }
 
-void TimeStats::setAcquireFence(const std::string& layerName, uint64_t frameNumber,
+void TimeStats::setAcquireFence(LayerTracker* tracker, uint64_t frameNumber,
                                 const std::shared_ptr<FenceTime>& acquireFence) {
-    if (!mEnabled.load()) return;
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-AcquireFenceTime[%" PRId64 "]", layerName.c_str(), frameNumber,
-          acquireFence->getSignalTime());
+    ALOGV("[%s]-[%" PRIu64 "]-AcquireFenceTime[%" PRId64 "]", tracker->layerName.c_str(),
+          frameNumber, acquireFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.acquireFence = acquireFence;
     }
 }
 
-void TimeStats::setPresentTime(const std::string& layerName, uint64_t frameNumber,
+void TimeStats::setPresentTime(LayerTracker* tracker, uint64_t frameNumber,
                                nsecs_t presentTime) {
-    if (!mEnabled.load()) return;
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-PresentTime[%" PRId64 "]", layerName.c_str(), frameNumber,
+    ALOGV("[%s]-[%" PRIu64 "]-PresentTime[%" PRId64 "]", tracker->layerName.c_str(), frameNumber,
           presentTime);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.presentTime = presentTime;
@@ -352,20 +487,22 @@ void TimeStats::setPresentTime(const std::string& layerName, uint64_t frameNumbe
         layerRecord.waitData++;
     }
 
-    flushAvailableRecordsToStatsLocked(layerName);
+    flushAvailableRecordsToStatsLocked(tracker);
 }
 
-void TimeStats::setPresentFence(const std::string& layerName, uint64_t frameNumber,
+void TimeStats::setPresentFence(LayerTracker* tracker, uint64_t frameNumber,
                                 const std::shared_ptr<FenceTime>& presentFence) {
-    if (!mEnabled.load()) return;
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-PresentFenceTime[%" PRId64 "]", layerName.c_str(), frameNumber,
-          presentFence->getSignalTime());
+    ALOGV("[%s]-[%" PRIu64 "]-PresentFenceTime[%" PRId64 "]", tracker->layerName.c_str(),
+          frameNumber, presentFence->getSignalTime());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
+    if (layerRecord.waitData < 0 ||
+        layerRecord.waitData >= static_cast<int32_t>(layerRecord.timeRecords.size()))
+        return;
     TimeRecord& timeRecord = layerRecord.timeRecords[layerRecord.waitData];
     if (timeRecord.frameNumber == frameNumber) {
         timeRecord.presentFence = presentFence;
@@ -373,44 +510,41 @@ void TimeStats::setPresentFence(const std::string& layerName, uint64_t frameNumb
         layerRecord.waitData++;
     }
 
-    flushAvailableRecordsToStatsLocked(layerName);
+    flushAvailableRecordsToStatsLocked(tracker);
 }
 
-void TimeStats::onDisconnect(const std::string& layerName) {
-    if (!mEnabled.load()) return;
+void TimeStats::onDisconnect(LayerTracker* tracker) {
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-onDisconnect", layerName.c_str());
+    ALOGV("[%s]-onDisconnect", tracker->layerName.c_str());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    flushAvailableRecordsToStatsLocked(layerName);
-    timeStatsTracker.erase(layerName);
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    flushAvailableRecordsToStatsLocked(tracker);
+    tracker->layerRecord = LayerRecord();
 }
 
-void TimeStats::clearLayerRecord(const std::string& layerName) {
-    if (!mEnabled.load()) return;
+void TimeStats::clearLayerRecord(LayerTracker* tracker) {
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-clearLayerRecord", layerName.c_str());
+    ALOGV("[%s]-clearLayerRecord", tracker->layerName.c_str());
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
     layerRecord.timeRecords.clear();
     layerRecord.prevTimeRecord.ready = false;
     layerRecord.waitData = -1;
 }
 
-void TimeStats::removeTimeRecord(const std::string& layerName, uint64_t frameNumber) {
-    if (!mEnabled.load()) return;
+void TimeStats::removeTimeRecord(LayerTracker* tracker, uint64_t frameNumber) {
+    if (tracker == nullptr || !mEnabled.load()) return;
 
     ATRACE_CALL();
-    ALOGV("[%s]-[%" PRIu64 "]-removeTimeRecord", layerName.c_str(), frameNumber);
+    ALOGV("[%s]-[%" PRIu64 "]-removeTimeRecord", tracker->layerName.c_str(), frameNumber);
 
-    std::lock_guard<std::mutex> lock(mMutex);
-    if (!timeStatsTracker.count(layerName)) return;
-    LayerRecord& layerRecord = timeStatsTracker[layerName];
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    LayerRecord& layerRecord = tracker->layerRecord;
     size_t removeAt = 0;
     for (const TimeRecord& record : layerRecord.timeRecords) {
         if (record.frameNumber == frameNumber) break;
@@ -451,11 +585,23 @@ void TimeStats::clear() {
     std::lock_guard<std::mutex> lock(mMutex);
     ALOGD("Cleared");
     timeStats.stats.clear();
+    for (const auto& tracker : mLayerTrackers) {
+        std::lock_guard<std::mutex> trackerLock(tracker->mutex);
+        tracker->stats = TimeStatsHelper::TimeStatsLayer();
+    }
     timeStats.statsStart = (mEnabled.load() ? static_cast<int64_t>(std::time(0)) : 0);
     timeStats.statsEnd = 0;
-    timeStats.totalFrames = 0;
-    timeStats.missedFrames = 0;
-    timeStats.clientCompositionFrames = 0;
+    mTotalFrames.store(0, std::memory_order_relaxed);
+    mMissedFrames.store(0, std::memory_order_relaxed);
+    mClientCompositionFrames.store(0, std::memory_order_relaxed);
+    timeStats.compositionStages.clear();
+    for (auto& histogram : mCompositionStages) {
+        for (auto& bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram.totalMicros.store(0, std::memory_order_relaxed);
+        histogram.maxMicros.store(0, std::memory_order_relaxed);
+    }
 }
 
 bool TimeStats::isEnabled() {
@@ -471,14 +617,30 @@ void TimeStats::dump(bool asProto, std::optional<uint32_t> maxLayers, String8& r
     }
 
     timeStats.statsEnd = static_cast<int64_t>(std::time(0));
+    timeStats.totalFrames = static_cast<int32_t>(mTotalFrames.load(std::memory_order_relaxed));
+    timeStats.missedFrames = static_cast<int32_t>(mMissedFrames.load(std::memory_order_relaxed));
+    timeStats.clientCompositionFrames =
+            static_cast<int32_t>(mClientCompositionFrames.load(std::memory_order_relaxed));
+    collectCompositionStagesLocked();
+
+    // Fold the live layers into a copy, so that their stats keep accumulating
+    // in their own trackers.
+    retireLayerTrackersLocked();
+    TimeStatsHelper::TimeStatsGlobal dumpStats = timeStats;
+    for (const auto& tracker : mLayerTrackers) {
+        std::lock_guard<std::mutex> trackerLock(tracker->mutex);
+        if (tracker->stats.statsStart != 0) {
+            mergeLayerStats(tracker->stats, &dumpStats.stats[tracker->layerName]);
+        }
+    }
 
     if (asProto) {
         ALOGD("Dumping TimeStats as proto");
-        SFTimeStatsGlobalProto timeStatsProto = timeStats.toProto(maxLayers);
+        SFTimeStatsGlobalProto timeStatsProto = dumpStats.toProto(maxLayers);
         result.append(timeStatsProto.SerializeAsString().c_str(), timeStatsProto.ByteSize());
     } else {
         ALOGD("Dumping TimeStats as text");
-        result.append(timeStats.toString(maxLayers).c_str());
+        result.append(dumpStats.toString(maxLayers).c_str());
         result.append("\n");
     }
 }
@@ -19,16 +19,22 @@
 #include <timestatsproto/TimeStatsHelper.h>
 #include <timestatsproto/TimeStatsProtoHeader.h>
 
+#include <gui/OccupancyTracker.h>
 #include <ui/FenceTime.h>
 
 #include <utils/String16.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
+#include <array>
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <unordered_map>
+#include <vector>
 
 using namespace android::surfaceflinger;
 
@@ -62,41 +68,116 @@ class TimeStats {
     };
 
 public:
+    // The frame records of one layer. Each layer owns its tracker and hands it
+    // to the per-frame calls below, so recording a frame neither looks the layer
+    // up by name nor takes the global lock; it only locks the tracker itself,
+    // which the layer's own binder and main thread calls share with dumpsys.
+    // The per-layer stats are merged into the global ones at dump time.
+    class LayerTracker {
+    public:
+        explicit LayerTracker(const std::string& layerName) : layerName(layerName) {}
+
+    private:
+        friend class TimeStats;
+
+        const std::string layerName;
+        std::mutex mutex;
+        LayerRecord layerRecord;
+        TimeStatsHelper::TimeStatsLayer stats;
+    };
+
+    // Stages of a refresh on the main thread
+    enum class CompositionStage : uint32_t {
+        HandlePageFlip,
+        RebuildLayerStacks,
+        SetUpHWComposer,
+        HwcValidate,
+        ComposeSurfaces,
+        HwcPresent,
+        PostComposition,
+        Count,
+    };
+
+    // Times the enclosing scope as one run of a composition stage
+    class ScopedStage {
+    public:
+        ScopedStage(TimeStats& timeStats, CompositionStage stage)
+              : mTimeStats(timeStats),
+                mStage(stage),
+                mStart(timeStats.mEnabled.load(std::memory_order_relaxed) ? systemTime() : 0) {}
+        ~ScopedStage() {
+            if (mStart != 0) mTimeStats.recordCompositionStage(mStage, systemTime() - mStart);
+        }
+
+    private:
+        TimeStats& mTimeStats;
+        const CompositionStage mStage;
+        const nsecs_t mStart;
+    };
+
     static TimeStats& getInstance();
     void parseArgs(bool asProto, const Vector<String16>& args, size_t& index, String8& result);
     void incrementTotalFrames();
     void incrementMissedFrames();
     void incrementClientCompositionFrames();
 
-    void setPostTime(const std::string& layerName, uint64_t frameNumber, nsecs_t postTime);
-    void setLatchTime(const std::string& layerName, uint64_t frameNumber, nsecs_t latchTime);
-    void setDesiredTime(const std::string& layerName, uint64_t frameNumber, nsecs_t desiredTime);
-    void setAcquireTime(const std::string& layerName, uint64_t frameNumber, nsecs_t acquireTime);
-    void setAcquireFence(const std::string& layerName, uint64_t frameNumber,
+    // Returns the tracker for a new layer, or nullptr if TimeStats never
+    // tracks layers of that name. The per-frame calls accept nullptr.
+    std::shared_ptr<LayerTracker> createLayerTracker(const std::string& layerName);
+
+    void setPostTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t postTime);
+    void setLatchTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t latchTime);
+    void setDesiredTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t desiredTime);
+    void setAcquireTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t acquireTime);
+    void setAcquireFence(LayerTracker* tracker, uint64_t frameNumber,
                          const std::shared_ptr<FenceTime>& acquireFence);
-    void setPresentTime(const std::string& layerName, uint64_t frameNumber, nsecs_t presentTime);
-    void setPresentFence(const std::string& layerName, uint64_t frameNumber,
+    void setPresentTime(LayerTracker* tracker, uint64_t frameNumber, nsecs_t presentTime);
+    void setPresentFence(LayerTracker* tracker, uint64_t frameNumber,
                          const std::shared_ptr<FenceTime>& presentFence);
-    void onDisconnect(const std::string& layerName);
-    void clearLayerRecord(const std::string& layerName);
-    void removeTimeRecord(const std::string& layerName, uint64_t frameNumber);
+    void onDisconnect(LayerTracker* tracker);
+    void clearLayerRecord(LayerTracker* tracker);
+    void removeTimeRecord(LayerTracker* tracker, uint64_t frameNumber);
+    // Lock free, so that the main thread never waits for dumpsys.
+    void recordCompositionStage(CompositionStage stage, nsecs_t duration);
+    // Accumulates the buffer queue occupancy of a layer into its stuffing and
+    // starvation times.
+    void recordBufferingStats(LayerTracker* tracker,
+                              const std::vector<OccupancyTracker::Segment>& history);
 
 private:
     TimeStats() = default;
 
-    bool recordReadyLocked(const std::string& layerName, TimeRecord* timeRecord);
-    void flushAvailableRecordsToStatsLocked(const std::string& layerName);
+    static bool recordReadyLocked(const std::string& layerName, TimeRecord* timeRecord);
+    static void flushAvailableRecordsToStatsLocked(LayerTracker* tracker);
+    static void mergeLayerStats(const TimeStatsHelper::TimeStatsLayer& from,
+                                TimeStatsHelper::TimeStatsLayer* into);
+    void retireLayerTrackersLocked();
 
     void enable();
     void disable();
     void clear();
     bool isEnabled();
     void dump(bool asProto, std::optional<uint32_t> maxLayers, String8& result);
+    void collectCompositionStagesLocked();
+
+    static constexpr size_t NUM_STAGE_BUCKETS = 34;
+    static constexpr size_t NUM_STAGES = static_cast<size_t>(CompositionStage::Count);
+
+    struct StageHistogram {
+        std::array<std::atomic<uint32_t>, NUM_STAGE_BUCKETS> buckets{};
+        std::atomic<uint64_t> totalMicros{0};
+        std::atomic<uint32_t> maxMicros{0};
+    };
 
     std::atomic<bool> mEnabled = false;
+    std::atomic<uint32_t> mTotalFrames = 0;
+    std::atomic<uint32_t> mMissedFrames = 0;
+    std::atomic<uint32_t> mClientCompositionFrames = 0;
     std::mutex mMutex;
+    // Per-layer stats in here are those of layers whose tracker is gone
     TimeStatsHelper::TimeStatsGlobal timeStats;
-    std::unordered_map<std::string, LayerRecord> timeStatsTracker;
+    std::vector<std::shared_ptr<LayerTracker>> mLayerTrackers;
+    std::array<StageHistogram, NUM_STAGES> mCompositionStages;
 };
 
 } // namespace android
@@ -78,6 +78,12 @@ std::string TimeStatsHelper::TimeStatsLayer::toString() const {
     if (iter != deltas.end()) {
         StringAppendF(&result, "averageFPS = %.3f\n", 1000.0 / iter->second.averageTime());
     }
+    if (bufferedMs > 0) {
+        StringAppendF(&result, "bufferedMs = %lld, stuffedMs = %lld, starvedMs = %lld\n",
+                      static_cast<long long int>(bufferedMs),
+                      static_cast<long long int>(stuffedMs),
+                      static_cast<long long int>(starvedMs));
+    }
     for (auto& ele : deltas) {
         StringAppendF(&result, "%s histogram is as below:\n", ele.first.c_str());
         StringAppendF(&result, "%s", ele.second.toString().c_str());
@@ -86,6 +92,34 @@ std::string TimeStatsHelper::TimeStatsLayer::toString() const {
     return result;
 }
 
+std::string TimeStatsHelper::CompositionStage::toString() const {
+    std::string result;
+    const float averageMillis = count ? (totalMicros / 1000.0f) / count : 0.0f;
+    StringAppendF(&result, "%s: count = %d, average = %.3fms, max = %.3fms\n", stageName.c_str(),
+                  count, averageMillis, maxMicros / 1000.0f);
+    for (auto& ele : hist) {
+        StringAppendF(&result, "%dus=%d ", ele.first, ele.second);
+    }
+    if (!hist.empty()) {
+        result.back() = '\n';
+    }
+    return result;
+}
+
+SFTimeStatsCompositionStageProto TimeStatsHelper::CompositionStage::toProto() const {
+    SFTimeStatsCompositionStageProto stageProto;
+    stageProto.set_stage_name(stageName);
+    stageProto.set_count(count);
+    stageProto.set_total_micros(totalMicros);
+    stageProto.set_max_micros(maxMicros);
+    for (auto& ele : hist) {
+        SFTimeStatsStageBucketProto* bucketProto = stageProto.add_histograms();
+        bucketProto->set_time_micros(ele.first);
+        bucketProto->set_count(ele.second);
+    }
+    return stageProto;
+}
+
 std::string TimeStatsHelper::TimeStatsGlobal::toString(std::optional<uint32_t> maxLayers) const {
     std::string result = "SurfaceFlinger TimeStats:\n";
     StringAppendF(&result, "statsStart = %lld\n", static_cast<long long int>(statsStart));
@@ -93,6 +127,13 @@ std::string TimeStatsHelper::TimeStatsGlobal::toString(std::optional<uint32_t> m
     StringAppendF(&result, "totalFrames= %d\n", totalFrames);
     StringAppendF(&result, "missedFrames= %d\n", missedFrames);
     StringAppendF(&result, "clientCompositionFrames= %d\n", clientCompositionFrames);
+    if (!compositionStages.empty()) {
+        StringAppendF(&result, "Composition stages are as below:\n");
+        for (auto& ele : compositionStages) {
+            StringAppendF(&result, "%s", ele.toString().c_str());
+        }
+    }
+    StringAppendF(&result, "%s", bufferingToString().c_str());
     StringAppendF(&result, "TimeStats for each layer is as below:\n");
     const auto dumpStats = generateDumpStats(maxLayers);
     for (auto& ele : dumpStats) {
@@ -109,6 +150,9 @@ SFTimeStatsLayerProto TimeStatsHelper::TimeStatsLayer::toProto() const {
     layerProto.set_stats_start(statsStart);
     layerProto.set_stats_end(statsEnd);
     layerProto.set_total_frames(totalFrames);
+    layerProto.set_buffered_millis(bufferedMs);
+    layerProto.set_stuffed_millis(stuffedMs);
+    layerProto.set_starved_millis(starvedMs);
     for (auto& ele : deltas) {
         SFTimeStatsDeltaProto* deltaProto = layerProto.add_deltas();
         deltaProto->set_delta_name(ele.first);
@@ -129,6 +173,10 @@ SFTimeStatsGlobalProto TimeStatsHelper::TimeStatsGlobal::toProto(
     globalProto.set_total_frames(totalFrames);
     globalProto.set_missed_frames(missedFrames);
     globalProto.set_client_composition_frames(clientCompositionFrames);
+    for (auto& ele : compositionStages) {
+        SFTimeStatsCompositionStageProto* stageProto = globalProto.add_composition_stages();
+        stageProto->CopyFrom(ele.toProto());
+    }
     const auto dumpStats = generateDumpStats(maxLayers);
     for (auto& ele : dumpStats) {
         SFTimeStatsLayerProto* layerProto = globalProto.add_stats();
@@ -137,6 +185,49 @@ SFTimeStatsGlobalProto TimeStatsHelper::TimeStatsGlobal::toProto(
     return globalProto;
 }
 
+std::string TimeStatsHelper::TimeStatsGlobal::bufferingToString() const {
+    struct PackageBuffering {
+        int64_t bufferedMs = 0;
+        int64_t stuffedMs = 0;
+        int64_t starvedMs = 0;
+        int64_t frames = 0;
+        double totalLatencyMs = 0;
+    };
+    std::map<std::string, PackageBuffering> packages;
+    for (auto& ele : stats) {
+        const TimeStatsLayer& layer = ele.second;
+        if (layer.bufferedMs == 0) continue;
+        PackageBuffering& package = packages[layer.packageName];
+        package.bufferedMs += layer.bufferedMs;
+        package.stuffedMs += layer.stuffedMs;
+        package.starvedMs += layer.starvedMs;
+        auto iter = layer.deltas.find("post2present");
+        if (iter != layer.deltas.end()) {
+            for (auto& histEle : iter->second.hist) {
+                package.frames += histEle.second;
+                package.totalLatencyMs += static_cast<double>(histEle.first) * histEle.second;
+            }
+        }
+    }
+
+    std::string result;
+    if (packages.empty()) {
+        return result;
+    }
+    StringAppendF(&result, "Buffering for each package is as below:\n");
+    for (auto& ele : packages) {
+        const PackageBuffering& package = ele.second;
+        StringAppendF(&result,
+                      "%s: bufferedMs = %lld, stuffed = %.1f%%, starved = %.1f%%, "
+                      "averagePost2present = %.3fms\n",
+                      ele.first.c_str(), static_cast<long long int>(package.bufferedMs),
+                      100.0 * package.stuffedMs / package.bufferedMs,
+                      100.0 * package.starvedMs / package.bufferedMs,
+                      package.frames ? package.totalLatencyMs / package.frames : 0.0);
+    }
+    return result;
+}
+
 std::vector<TimeStatsHelper::TimeStatsLayer const*>
 TimeStatsHelper::TimeStatsGlobal::generateDumpStats(std::optional<uint32_t> maxLayers) const {
     std::vector<TimeStatsLayer const*> dumpStats;
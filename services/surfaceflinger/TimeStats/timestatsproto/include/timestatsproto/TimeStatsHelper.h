@@ -17,6 +17,7 @@
 
 #include <timestatsproto/TimeStatsProtoHeader.h>
 
+#include <map>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -46,11 +47,29 @@ public:
         int64_t statsEnd = 0;
         int32_t totalFrames = 0;
         std::unordered_map<std::string, Histogram> deltas;
+        // From the buffer queue's occupancy history, in milliseconds
+        int64_t bufferedMs = 0;
+        int64_t stuffedMs = 0;
+        int64_t starvedMs = 0;
 
         std::string toString() const;
         SFTimeStatsLayerProto toProto() const;
     };
 
+    class CompositionStage {
+    public:
+        std::string stageName;
+        int32_t count = 0;
+        int64_t totalMicros = 0;
+        int32_t maxMicros = 0;
+        // Key is the lower bound of the bucket in microseconds
+        // Value is the number of times the stage fell in that bucket
+        std::map<int32_t, int32_t> hist;
+
+        std::string toString() const;
+        SFTimeStatsCompositionStageProto toProto() const;
+    };
+
     class TimeStatsGlobal {
     public:
         int64_t statsStart = 0;
@@ -59,6 +78,7 @@ public:
         int32_t missedFrames = 0;
         int32_t clientCompositionFrames = 0;
         std::unordered_map<std::string, TimeStatsLayer> stats;
+        std::vector<CompositionStage> compositionStages;
 
         std::string toString(std::optional<uint32_t> maxLayers) const;
         SFTimeStatsGlobalProto toProto(std::optional<uint32_t> maxLayers) const;
@@ -66,6 +86,7 @@ public:
     private:
         std::vector<TimeStatsLayer const*> generateDumpStats(
                 std::optional<uint32_t> maxLayers) const;
+        std::string bufferingToString() const;
     };
 };
 
@@ -16,6 +16,8 @@
 
 #include <math.h>
 
+#include <vector>
+
 #include <cutils/compiler.h>
 #include <utils/String8.h>
 #include <ui/Region.h>
@@ -63,6 +65,14 @@ Transform Transform::operator * (const Transform& rhs) const
     if (rhs.mType == IDENTITY)
         return r;
 
+    if (((mType | rhs.mType) & ~TRANSLATE) == 0) {
+        // two translations, which is what most layer hierarchies are made of
+        r.mMatrix[2][0] += rhs.mMatrix[2][0];
+        r.mMatrix[2][1] += rhs.mMatrix[2][1];
+        r.mType = (isZero(r.tx()) && isZero(r.ty())) ? IDENTITY : TRANSLATE;
+        return r;
+    }
+
     // TODO: we could use mType to optimize the matrix multiply
     const mat33& A(mMatrix);
     const mat33& B(rhs.mMatrix);
@@ -198,6 +208,10 @@ Rect Transform::makeBounds(int w, int h) const
 
 Rect Transform::transform(const Rect& bounds, bool roundOutwards) const
 {
+    if (!roundOutwards && isUnitOrientation()) {
+        return transformUnit(bounds, floorf(tx() + 0.5f), floorf(ty() + 0.5f));
+    }
+
     Rect r;
     vec2 lt( bounds.left,  bounds.top    );
     vec2 rt( bounds.right, bounds.top    );
@@ -245,16 +259,41 @@ FloatRect Transform::transform(const FloatRect& bounds) const
     return r;
 }
 
+// Returns the union of the given rects. Merging halves costs O(n log n) rects,
+// rather than the O(n^2) of adding the rects one at a time to a growing region.
+static Region mergeRects(const Rect* begin, const Rect* end)
+{
+    const size_t count = end - begin;
+    if (count == 0)
+        return Region();
+    if (count == 1)
+        return Region(*begin);
+    const Rect* middle = begin + count / 2;
+    return mergeRects(begin, middle).merge(mergeRects(middle, end));
+}
+
 Region Transform::transform(const Region& reg) const
 {
     Region out;
     if (CC_UNLIKELY(type() > TRANSLATE)) {
         if (CC_LIKELY(preserveRects())) {
-            Region::const_iterator it = reg.begin();
-            Region::const_iterator const end = reg.end();
-            while (it != end) {
-                out.orSelf(transform(*it++));
+            std::vector<Rect> rects;
+            rects.reserve(reg.end() - reg.begin());
+            if (isUnitOrientation()) {
+                // flips and 90 degrees rotations: no need for the float matrix
+                const int xpos = floorf(tx() + 0.5f);
+                const int ypos = floorf(ty() + 0.5f);
+                for (const Rect& r : reg) {
+                    if (!r.isEmpty())
+                        rects.push_back(transformUnit(r, xpos, ypos));
+                }
+            } else {
+                for (const Rect& r : reg) {
+                    if (!r.isEmpty())
+                        rects.push_back(transform(r));
+                }
             }
+            out = mergeRects(rects.data(), rects.data() + rects.size());
         } else {
             out.set(transform(reg.bounds()));
         }
@@ -319,6 +358,35 @@ uint32_t Transform::type() const
     return mType;
 }
 
+bool Transform::isUnitOrientation() const
+{
+    // a combination of flips and 90 degrees rotations, without any scaling
+    const uint32_t orient = getOrientation();
+    if (orient & ROT_INVALID)
+        return false;
+    const mat33& M(mMatrix);
+    if (orient & ROT_90)
+        return absIsOne(M[1][0]) && absIsOne(M[0][1]);
+    return absIsOne(M[0][0]) && absIsOne(M[1][1]);
+}
+
+Rect Transform::transformUnit(const Rect& bounds, int dx, int dy) const
+{
+    // the 2x2 part of the matrix only has 0 and +/-1, so integers are exact and
+    // opposite corners of the rect map to opposite corners.
+    const mat33& M(mMatrix);
+    const int a = M[0][0];
+    const int b = M[1][0];
+    const int c = M[0][1];
+    const int d = M[1][1];
+    const int x0 = a*bounds.left  + b*bounds.top;
+    const int x1 = a*bounds.right + b*bounds.bottom;
+    const int y0 = c*bounds.left  + d*bounds.top;
+    const int y1 = c*bounds.right + d*bounds.bottom;
+    return Rect(min(x0, x1) + dx, min(y0, y1) + dy,
+                max(x0, x1) + dx, max(y0, y1) + dy);
+}
+
 Transform Transform::inverse() const {
     // our 3x3 matrix is always of the form of a 2x2 transformation
     // followed by a translation: T*M, therefore:
@@ -372,6 +440,13 @@ bool Transform::preserveRects() const
     return (getOrientation() & ROT_INVALID) ? false : true;
 }
 
+bool Transform::operator == (const Transform& rhs) const
+{
+    const mat33& A(mMatrix);
+    const mat33& B(rhs.mMatrix);
+    return A[0] == B[0] && A[1] == B[1] && A[2] == B[2];
+}
+
 void Transform::dump(const char* name) const
 {
     type(); // updates the type
@@ -92,6 +92,9 @@ public:
 
             Transform inverse() const;
 
+            bool operator == (const Transform& rhs) const;
+            inline bool operator != (const Transform& rhs) const { return !operator==(rhs); }
+
             // for debugging
             void dump(const char* name) const;
 
@@ -105,6 +108,8 @@ private:
     enum { UNKNOWN_TYPE = 0x80000000 };
 
     uint32_t type() const;
+    bool isUnitOrientation() const;
+    Rect transformUnit(const Rect& bounds, int dx, int dy) const;
     static bool absIsOne(float f);
     static bool isZero(float f);
 
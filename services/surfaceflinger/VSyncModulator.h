@@ -18,6 +18,9 @@
 
 #include <utils/Errors.h>
 
+#include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <mutex>
 
 using namespace android::surfaceflinger;
@@ -34,6 +37,18 @@ private:
     // low-pass filter in case the client isn't quick enough in sending new transactions.
     const int MIN_EARLY_FRAME_COUNT = 2;
 
+    // Number of recent frame durations the adaptive offsets are computed from, and how many of
+    // them are needed before the measured distribution is trusted.
+    static constexpr size_t FRAME_DURATION_HISTORY = 64;
+    static constexpr size_t MIN_FRAME_DURATION_SAMPLES = 8;
+
+    // Percentile of the frame durations that has to fit before the next vsync.
+    static constexpr size_t FRAME_DURATION_PERCENTILE = 90;
+
+    // Adaptive offsets move only by at least this much, so that noise in the measurements does
+    // not reprogram DispSync on every frame.
+    static constexpr nsecs_t ADAPTIVE_OFFSET_HYSTERESIS = 500000;
+
 public:
 
     enum TransactionStart {
@@ -50,12 +65,45 @@ public:
         mEarlyPhaseOffset = early;
         mLatePhaseOffset = late;
         mPhaseOffset = late;
+        mAdaptiveEarlyPhaseOffset = early;
+        mAdaptiveLatePhaseOffset = late;
     }
 
     nsecs_t getEarlyPhaseOffset() const {
         return mEarlyPhaseOffset;
     }
 
+    nsecs_t getLatePhaseOffset() const {
+        return mLatePhaseOffset;
+    }
+
+    // The sf phase offset currently programmed
+    nsecs_t getPhaseOffset() const {
+        return mPhaseOffset;
+    }
+
+    // Lets the offsets follow the measured frame durations. The early and late offsets then only
+    // bound the range: a frame gets the latest offset that still leaves room for the usual
+    // duration of that kind of frame plus the headroom before the next vsync.
+    void setAdaptive(bool enabled, nsecs_t headroom) {
+        mAdaptive = enabled;
+        mAdaptiveHeadroom = headroom;
+        mAdaptiveEarlyPhaseOffset = mEarlyPhaseOffset;
+        mAdaptiveLatePhaseOffset = mLatePhaseOffset;
+    }
+
+    bool isAdaptive() const {
+        return mAdaptive;
+    }
+
+    nsecs_t getAdaptiveEarlyPhaseOffset() const {
+        return mAdaptiveEarlyPhaseOffset;
+    }
+
+    nsecs_t getAdaptiveLatePhaseOffset() const {
+        return mAdaptiveLatePhaseOffset;
+    }
+
     void setEventThread(EventThread* eventThread) {
         mEventThread = eventThread;
     }
@@ -80,8 +128,13 @@ public:
         updatePhaseOffsets();
     }
 
-    void onRefreshed(bool usedRenderEngine) {
+    // duration: how long SurfaceFlinger took to produce the frame, from waking up to presenting
+    // period: the current vsync period
+    void onRefreshed(bool usedRenderEngine, nsecs_t duration = 0, nsecs_t period = 0) {
         bool updatePhaseOffsetsNeeded = false;
+        if (mAdaptive && duration > 0 && period > 0) {
+            updatePhaseOffsetsNeeded = updateAdaptiveOffsets(usedRenderEngine, duration, period);
+        }
         if (mRemainingEarlyFrameCount > 0) {
             mRemainingEarlyFrameCount--;
             updatePhaseOffsetsNeeded = true;
@@ -102,21 +155,66 @@ private:
         // Do not change phase offsets if disabled.
         if (mEarlyPhaseOffset == mLatePhaseOffset) return;
 
-        if (shouldUseEarlyOffset()) {
-            if (mPhaseOffset != mEarlyPhaseOffset) {
-                if (mEventThread) {
-                    mEventThread->setPhaseOffset(mEarlyPhaseOffset);
-                }
-                mPhaseOffset = mEarlyPhaseOffset;
-            }
+        nsecs_t phaseOffset;
+        if (mTransactionStart == TransactionStart::EARLY) {
+            // the client explicitly asked for an early wakeup
+            phaseOffset = mEarlyPhaseOffset;
+        } else if (shouldUseEarlyOffset()) {
+            phaseOffset = mAdaptive ? mAdaptiveEarlyPhaseOffset.load() : mEarlyPhaseOffset;
         } else {
-            if (mPhaseOffset != mLatePhaseOffset) {
-                if (mEventThread) {
-                    mEventThread->setPhaseOffset(mLatePhaseOffset);
-                }
-                mPhaseOffset = mLatePhaseOffset;
+            phaseOffset = mAdaptive ? mAdaptiveLatePhaseOffset.load() : mLatePhaseOffset;
+        }
+
+        if (mPhaseOffset != phaseOffset) {
+            if (mEventThread) {
+                mEventThread->setPhaseOffset(phaseOffset);
             }
+            mPhaseOffset = phaseOffset;
+        }
+    }
+
+    struct FrameDurations {
+        std::array<nsecs_t, FRAME_DURATION_HISTORY> samples{};
+        size_t count = 0;
+        size_t next = 0;
+
+        void add(nsecs_t duration) {
+            samples[next] = duration;
+            next = (next + 1) % FRAME_DURATION_HISTORY;
+            count = std::min(count + 1, FRAME_DURATION_HISTORY);
+        }
+
+        nsecs_t percentile(size_t percent) const {
+            std::array<nsecs_t, FRAME_DURATION_HISTORY> sorted = samples;
+            const auto end = sorted.begin() + count;
+            const auto nth = sorted.begin() + (count - 1) * percent / 100;
+            std::nth_element(sorted.begin(), nth, end);
+            return *nth;
         }
+    };
+
+    // Records one frame and recomputes the offset for its kind of frame. Returns whether that
+    // offset changed.
+    bool updateAdaptiveOffsets(bool usedRenderEngine, nsecs_t duration, nsecs_t period) {
+        FrameDurations& durations =
+                usedRenderEngine ? mRenderEngineFrameDurations : mDeviceFrameDurations;
+        durations.add(duration);
+        if (durations.count < MIN_FRAME_DURATION_SAMPLES) return false;
+
+        // SurfaceFlinger wakes up phaseOffset after vsync and has until the next one to present,
+        // so the latest usable offset is whatever the frame and the headroom leave of the period.
+        const nsecs_t needed = durations.percentile(FRAME_DURATION_PERCENTILE) + mAdaptiveHeadroom;
+        const nsecs_t earliest = std::min(mEarlyPhaseOffset, mLatePhaseOffset);
+        const nsecs_t latest = std::max(mEarlyPhaseOffset, mLatePhaseOffset);
+        const nsecs_t target = std::clamp(period - needed, earliest, latest);
+
+        std::atomic<nsecs_t>& offset =
+                usedRenderEngine ? mAdaptiveEarlyPhaseOffset : mAdaptiveLatePhaseOffset;
+        const bool atBound = target == earliest || target == latest;
+        const nsecs_t delta = std::abs(target - offset.load());
+        if (delta == 0 || (delta < ADAPTIVE_OFFSET_HYSTERESIS && !atBound)) return false;
+        offset = target;
+        return true;
     }
 
     bool shouldUseEarlyOffset() {
@@ -131,6 +229,14 @@ private:
     std::atomic<TransactionStart> mTransactionStart = TransactionStart::NORMAL;
     std::atomic<bool> mLastFrameUsedRenderEngine = false;
     std::atomic<int> mRemainingEarlyFrameCount = 0;
+
+    // Only written on the main thread; the offsets are read from binder threads as well.
+    bool mAdaptive = false;
+    nsecs_t mAdaptiveHeadroom = 0;
+    FrameDurations mDeviceFrameDurations;
+    FrameDurations mRenderEngineFrameDurations;
+    std::atomic<nsecs_t> mAdaptiveEarlyPhaseOffset = 0;
+    std::atomic<nsecs_t> mAdaptiveLatePhaseOffset = 0;
 };
 
 } // namespace android
@@ -14,11 +14,21 @@
  * limitations under the License.
  */
 #include <android-base/stringprintf.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <layerproto/LayerProtoParser.h>
 #include <ui/DebugUtils.h>
 
+#include <map>
+
 using android::base::StringAppendF;
 using android::base::StringPrintf;
+using google::protobuf::RepeatedField;
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
 
 namespace android {
 namespace surfaceflinger {
@@ -318,5 +328,212 @@ std::string LayerProtoParser::Layer::to_string() const {
     return result;
 }
 
+namespace {
+
+// The encoded fields of a message by field number, including their tags. The occurrences of a
+// repeated field are kept together, in order.
+using FieldMap = std::map<uint32_t, std::string>;
+
+// A LayersProto split into its fields other than layers, and the fields of each layer by id.
+struct EncodedLayers {
+    FieldMap globalFields;
+    std::unordered_map<int32_t, FieldMap> layerFields;
+};
+
+// Calls |callback| with the number and encoding of every field of |encoded|.
+template <typename Callback>
+bool forEachField(const std::string& encoded, Callback callback) {
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(encoded.data()),
+                           static_cast<int>(encoded.size()));
+    while (true) {
+        const int start = input.CurrentPosition();
+        const uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return start == static_cast<int>(encoded.size());
+        }
+        if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+        callback(static_cast<uint32_t>(WireFormatLite::GetTagFieldNumber(tag)),
+                 encoded.substr(start, input.CurrentPosition() - start));
+    }
+}
+
+bool splitFields(const std::string& encoded, FieldMap* fields) {
+    return forEachField(encoded, [fields](uint32_t number, std::string&& field) {
+        (*fields)[number].append(field);
+    });
+}
+
+std::string joinFields(const FieldMap& fields) {
+    std::string encoded;
+    for (const auto& field : fields) {
+        encoded.append(field.second);
+    }
+    return encoded;
+}
+
+// Returns the payload of an encoded length-delimited field.
+std::string fieldPayload(const std::string& field) {
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(field.data()),
+                           static_cast<int>(field.size()));
+    uint32_t length = 0;
+    input.ReadTag();
+    input.ReadVarint32(&length);
+    return field.substr(input.CurrentPosition(), length);
+}
+
+// Splits |layersProto| from a single serialization; the layers are encoded in order, so the n-th
+// occurrence of the layers field is the n-th layer.
+bool splitLayers(const LayersProto& layersProto, EncodedLayers* encoded) {
+    int layerIndex = 0;
+    bool layersValid = true;
+    const bool valid = forEachField(layersProto.SerializeAsString(),
+                                    [&](uint32_t number, std::string&& field) {
+        if (number != LayersProto::kLayersFieldNumber) {
+            encoded->globalFields[number].append(field);
+            return;
+        }
+        const int32_t id = layersProto.layers(layerIndex++).id();
+        layersValid &= splitFields(fieldPayload(field), &encoded->layerFields[id]);
+    });
+    return valid && layersValid;
+}
+
+// Returns the encoded fields of |current| that |previous| does not have or has with another
+// value, and adds the numbers of the fields only |previous| has to |cleared|.
+std::string diffFields(const FieldMap& previous, const FieldMap& current,
+                       RepeatedField<uint32_t>* cleared) {
+    std::string changed;
+    for (const auto& field : current) {
+        auto it = previous.find(field.first);
+        if (it == previous.end() || it->second != field.second) {
+            changed.append(field.second);
+        }
+    }
+    for (const auto& field : previous) {
+        if (current.count(field.first) == 0) {
+            cleared->Add(field.first);
+        }
+    }
+    return changed;
+}
+
+bool applyFields(const std::string& changed, const RepeatedField<uint32_t>& cleared,
+                 FieldMap* fields) {
+    FieldMap changedFields;
+    if (!splitFields(changed, &changedFields)) {
+        return false;
+    }
+    for (auto& field : changedFields) {
+        (*fields)[field.first] = std::move(field.second);
+    }
+    for (uint32_t number : cleared) {
+        fields->erase(number);
+    }
+    return true;
+}
+
+} // namespace
+
+LayersDeltaProto LayerProtoParser::generateDelta(const LayersProto& previous,
+                                                 const LayersProto& current) {
+    LayersDeltaProto delta;
+    EncodedLayers previousFields;
+    EncodedLayers currentFields;
+    // Both are serialized here, so they always split.
+    splitLayers(previous, &previousFields);
+    splitLayers(current, &currentFields);
+
+    const std::string changedGlobals = diffFields(previousFields.globalFields,
+                                                  currentFields.globalFields,
+                                                  delta.mutable_cleared_fields());
+    if (!changedGlobals.empty()) {
+        delta.mutable_changed_fields()->ParseFromString(changedGlobals);
+    }
+
+    // Layers are only listed when they are added or changed, which is a few of them per frame.
+    const FieldMap noFields;
+    for (const LayerProto& layerProto : current.layers()) {
+        const int32_t id = layerProto.id();
+        delta.add_layer_ids(id);
+
+        auto it = previousFields.layerFields.find(id);
+        const FieldMap& previousLayer =
+                it != previousFields.layerFields.end() ? it->second : noFields;
+        LayerDeltaProto layerDelta;
+        const std::string changed =
+                diffFields(previousLayer, currentFields.layerFields[id],
+                           layerDelta.mutable_cleared_fields());
+        if (changed.empty() && layerDelta.cleared_fields_size() == 0 &&
+            it != previousFields.layerFields.end()) {
+            continue;
+        }
+        layerDelta.set_id(id);
+        layerDelta.mutable_changed_fields()->ParseFromString(changed);
+        delta.add_layers()->Swap(&layerDelta);
+    }
+    return delta;
+}
+
+bool LayerProtoParser::applyDelta(const LayersProto& previous, const LayersDeltaProto& delta,
+                                  LayersProto* layersProto) {
+    EncodedLayers fields;
+    if (!splitLayers(previous, &fields) ||
+        !applyFields(delta.changed_fields().SerializeAsString(), delta.cleared_fields(),
+                     &fields.globalFields)) {
+        return false;
+    }
+
+    std::unordered_map<int32_t, const LayerDeltaProto*> layerDeltas;
+    for (const LayerDeltaProto& layerDelta : delta.layers()) {
+        layerDeltas[layerDelta.id()] = &layerDelta;
+    }
+
+    std::string encoded = joinFields(fields.globalFields);
+    {
+        StringOutputStream stream(&encoded);
+        CodedOutputStream output(&stream);
+        for (int32_t id : delta.layer_ids()) {
+            auto layerFields = fields.layerFields.find(id);
+            auto layerDelta = layerDeltas.find(id);
+            FieldMap layer;
+            if (layerFields != fields.layerFields.end()) {
+                layer = std::move(layerFields->second);
+            } else if (layerDelta == layerDeltas.end()) {
+                // Neither in the previous state nor added.
+                return false;
+            }
+            if (layerDelta != layerDeltas.end() &&
+                !applyFields(layerDelta->second->changed_fields().SerializeAsString(),
+                             layerDelta->second->cleared_fields(), &layer)) {
+                return false;
+            }
+            const std::string layerEncoded = joinFields(layer);
+            output.WriteTag(WireFormatLite::MakeTag(LayersProto::kLayersFieldNumber,
+                                                    WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+            output.WriteVarint32(static_cast<uint32_t>(layerEncoded.size()));
+            output.WriteString(layerEncoded);
+        }
+    }
+    return layersProto->ParseFromString(encoded);
+}
+
+bool LayerProtoParser::expandTrace(LayersTraceFileProto* trace) {
+    const LayersProto* previous = nullptr;
+    for (LayersTraceProto& entry : *trace->mutable_entry()) {
+        if (entry.has_delta()) {
+            LayersProto layersProto;
+            if (previous == nullptr || !applyDelta(*previous, entry.delta(), &layersProto)) {
+                return false;
+            }
+            entry.mutable_layers()->Swap(&layersProto);
+            entry.clear_delta();
+        }
+        previous = &entry.layers();
+    }
+    return true;
+}
+
 } // namespace surfaceflinger
 } // namespace android
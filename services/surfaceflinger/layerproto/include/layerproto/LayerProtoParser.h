@@ -130,6 +130,17 @@ public:
     static std::vector<std::unique_ptr<Layer>> generateLayerTree(const LayersProto& layersProto);
     static std::string layersToString(std::vector<std::unique_ptr<LayerProtoParser::Layer>> layers);
 
+    // Returns the changes from |previous| to |current|, for a LayersTraceProto entry that
+    // follows one with |previous|.
+    static LayersDeltaProto generateDelta(const LayersProto& previous, const LayersProto& current);
+    // Reconstructs the full state from the previous one and a delta from generateDelta(). Returns
+    // false if the delta does not apply to |previous|.
+    static bool applyDelta(const LayersProto& previous, const LayersDeltaProto& delta,
+                           LayersProto* layersProto);
+    // Replaces the deltas in |trace| with the full layer states. Returns false if an entry cannot
+    // be reconstructed, e.g. when the trace does not start with a full state.
+    static bool expandTrace(LayersTraceFileProto* trace);
+
 private:
     static std::unordered_map<int32_t, Layer*> generateMap(const LayersProto& layersProto);
     static LayerProtoParser::Layer* generateLayer(const LayerProto& layerProto);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the transaction path of SurfaceFlinger from the client side: how
+// long apply() takes with many layers and many clients applying at once,
+// which is mostly time spent waiting on mStateLock and the main thread, and
+// how long it takes for a transaction to reach the display.
+
+#include <benchmark/benchmark.h>
+
+#include <gui/ISurfaceComposerClient.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <system/window.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+using Transaction = SurfaceComposerClient::Transaction;
+
+// Layers are stacked above everything else, like the test layers of Transaction_test
+constexpr int32_t kLayerZBase = INT32_MAX - 4096;
+constexpr uint32_t kLayerSize = 16;
+// Gives up on a frame that didn't make it to the display in this time
+constexpr nsecs_t kPresentTimeout = ms2ns(500);
+
+// Color layers of one client. They need no buffers, so only the
+// transactions themselves are measured.
+struct LayerSet {
+    sp<SurfaceComposerClient> client;
+    std::vector<sp<SurfaceControl>> layers;
+
+    bool create(size_t count, int32_t zBase) {
+        client = new SurfaceComposerClient;
+        if (client->initCheck() != NO_ERROR) return false;
+        Transaction t;
+        for (size_t i = 0; i < count; i++) {
+            sp<SurfaceControl> layer =
+                    client->createSurface(String8::format("TransactionBenchmark %zu", i),
+                                          kLayerSize, kLayerSize, PIXEL_FORMAT_RGBA_8888,
+                                          ISurfaceComposerClient::eFXSurfaceColor);
+            if (layer == nullptr) return false;
+            t.setLayer(layer, zBase + int32_t(i)).show(layer).setColor(layer, half3(0, 0, 1));
+            layers.push_back(layer);
+        }
+        return t.apply(true) == NO_ERROR;
+    }
+
+    // The change an animation makes to each of its layers on every frame
+    void animate(Transaction& t, int64_t frame) const {
+        for (size_t i = 0; i < layers.size(); i++) {
+            t.setPosition(layers[i], float((frame + i) % 64), float(i % 64));
+            t.setAlpha(layers[i], (frame % 2) ? 1.0f : 0.5f);
+        }
+    }
+};
+
+// Applies one transaction changing as many layers as the first argument, at
+// most at the rate given by the second argument in Hz (0 for as fast as
+// possible). Run with
+// several threads, each thread is its own client with its own layers.
+void BM_Apply(benchmark::State& state, bool synchronous) {
+    const size_t layerCount = size_t(state.range(0));
+    const int64_t rateHz = state.range(1);
+    LayerSet layerSet;
+    if (!layerSet.create(layerCount, kLayerZBase + int32_t(state.thread_index * layerCount))) {
+        state.SkipWithError("Failed to create layers");
+        return;
+    }
+
+    const auto interval = rateHz > 0 ? std::chrono::nanoseconds(1000000000 / rateHz)
+                                     : std::chrono::nanoseconds(0);
+    auto next = std::chrono::steady_clock::now();
+    nsecs_t maxApplyTime = 0;
+    int64_t frame = 0;
+    while (state.KeepRunning()) {
+        if (rateHz > 0) {
+            state.PauseTiming();
+            std::this_thread::sleep_until(next);
+            next += interval;
+            state.ResumeTiming();
+        }
+        Transaction t;
+        layerSet.animate(t, frame++);
+        const nsecs_t start = systemTime();
+        t.apply(synchronous);
+        maxApplyTime = std::max(maxApplyTime, systemTime() - start);
+    }
+    state.counters["layers"] = layerCount;
+    state.counters["max_apply_us"] = benchmark::Counter(maxApplyTime / 1000.0,
+                                                        benchmark::Counter::kAvgThreads);
+    state.SetItemsProcessed(state.iterations() * layerCount);
+}
+
+void BM_ApplyAsync(benchmark::State& state) {
+    BM_Apply(state, false);
+}
+BENCHMARK(BM_ApplyAsync)
+        ->Args({1, 0})
+        ->Args({16, 0})
+        ->Args({64, 0})
+        ->Args({64, 60})
+        ->ThreadRange(1, 8)
+        ->UseRealTime();
+
+void BM_ApplySync(benchmark::State& state) {
+    BM_Apply(state, true);
+}
+BENCHMARK(BM_ApplySync)
+        ->Args({1, 0})
+        ->Args({64, 0})
+        ->ThreadRange(1, 4)
+        ->UseRealTime();
+
+// Time from apply() to the present of the frame that shows the change. The
+// change goes with a new buffer on a probe layer, whose present time the
+// frame timestamps report.
+void BM_TimeToPresent(benchmark::State& state) {
+    const size_t layerCount = size_t(state.range(0));
+    LayerSet layerSet;
+    if (!layerSet.create(layerCount, kLayerZBase)) {
+        state.SkipWithError("Failed to create layers");
+        return;
+    }
+    sp<SurfaceControl> probe =
+            layerSet.client->createSurface(String8("TransactionBenchmark probe"), kLayerSize,
+                                      kLayerSize, PIXEL_FORMAT_RGBA_8888, 0);
+    if (probe == nullptr) {
+        state.SkipWithError("Failed to create the probe layer");
+        return;
+    }
+    Transaction().setLayer(probe, kLayerZBase - 1).show(probe).apply(true);
+    sp<Surface> surface = probe->getSurface();
+    surface->enableFrameTimestamps(true);
+
+    int64_t frame = 0;
+    int64_t missed = 0;
+    while (state.KeepRunning()) {
+        Transaction t;
+        layerSet.animate(t, frame++);
+        const nsecs_t start = systemTime();
+        t.apply();
+
+        const uint64_t frameNumber = surface->getNextFrameNumber();
+        ANativeWindow_Buffer buffer;
+        if (surface->lock(&buffer, nullptr) != NO_ERROR) {
+            state.SkipWithError("Failed to lock the probe buffer");
+            return;
+        }
+        surface->unlockAndPost();
+
+        nsecs_t presentTime = 0;
+        while (systemTime() - start < kPresentTimeout) {
+            nsecs_t present = 0;
+            surface->getFrameTimestamps(frameNumber, nullptr, nullptr, nullptr, nullptr,
+                                        nullptr, nullptr, &present, nullptr, nullptr);
+            // reported as pending until the display fence signals
+            if (present > 0) {
+                presentTime = present;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (presentTime == 0) {
+            missed++;
+            presentTime = start + kPresentTimeout;
+        }
+        state.SetIterationTime((presentTime - start) / 1e9);
+    }
+    state.counters["layers"] = layerCount;
+    state.counters["missed"] = missed;
+}
+BENCHMARK(BM_TimeToPresent)->Arg(1)->Arg(64)->UseManualTime();
+
+} // anonymous namespace
+
+BENCHMARK_MAIN();
@@ -2628,6 +2628,30 @@ TEST_F(ScreenCaptureTest, CaptureSize) {
     mCapture->checkPixel(30, 30, 0, 0, 0);
 }
 
+TEST_F(ScreenCaptureTest, CaptureWithFence) {
+    sp<SurfaceControl> redLayer = mComposerClient->createSurface(String8("Red surface"), 60, 60,
+                                                                 PIXEL_FORMAT_RGBA_8888, 0);
+
+    ASSERT_NO_FATAL_FAILURE(fillLayerColor(redLayer, Color::RED));
+
+    SurfaceComposerClient::Transaction().setLayer(redLayer, INT32_MAX - 1).show(redLayer).apply(
+            true);
+
+    sp<ISurfaceComposer> sf(ComposerService::getComposerService());
+    sp<GraphicBuffer> outBuffer;
+    sp<Fence> outFence;
+    ASSERT_EQ(NO_ERROR,
+              sf->captureLayers(redLayer->getHandle(), &outBuffer, Rect(0, 0, 30, 30), 0.5, false,
+                                &outFence));
+    ASSERT_NE(nullptr, outFence.get());
+    ASSERT_EQ(NO_ERROR, outFence->wait(Fence::TIMEOUT_NEVER));
+    ASSERT_EQ(15u, outBuffer->getWidth());
+    ASSERT_EQ(15u, outBuffer->getHeight());
+
+    mCapture = std::make_unique<ScreenCapture>(outBuffer);
+    mCapture->expectColor(Rect(0, 0, 15, 15), Color::RED);
+}
+
 TEST_F(ScreenCaptureTest, CaptureInvalidLayer) {
     sp<SurfaceControl> redLayer = mComposerClient->createSurface(String8("Red surface"), 60, 60,
                                                                  PIXEL_FORMAT_RGBA_8888, 0);
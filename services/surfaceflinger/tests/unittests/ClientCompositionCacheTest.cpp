@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include "ClientCompositionCache.h"
+
+namespace android {
+namespace {
+
+using Action = ClientCompositionCache::Action;
+
+constexpr uint32_t kThreshold = 3;
+
+// the cache only compares layer pointers, it never dereferences them
+const Layer* const kDeviceLayer = reinterpret_cast<const Layer*>(0x1000);
+const Layer* const kClientLayer = reinterpret_cast<const Layer*>(0x2000);
+
+class ClientCompositionCacheTest : public testing::Test {
+protected:
+    std::vector<ClientCompositionCache::Entry> makeEntries(int32_t clientSequence = 0) const {
+        std::vector<ClientCompositionCache::Entry> entries;
+        entries.push_back({kDeviceLayer, 0, HWC2::Composition::Device, true,
+                           Region(Rect(0, 0, 100, 50))});
+        entries.push_back({kClientLayer, clientSequence, HWC2::Composition::Client, false,
+                           Region(Rect(0, 50, 100, 100))});
+        return entries;
+    }
+
+    Action update(int32_t clientSequence = 0) {
+        return mCache.update(makeEntries(clientSequence), mDirty, kThreshold);
+    }
+
+    void flatten() {
+        ASSERT_EQ(Action::Flatten, update());
+        mCache.setBuffer(new GraphicBuffer(), nullptr);
+    }
+
+    ClientCompositionCache mCache;
+    Region mDirty;
+};
+
+TEST_F(ClientCompositionCacheTest, flattensAfterThresholdStableFrames) {
+    EXPECT_EQ(Action::Compose, update());
+    for (uint32_t i = 1; i < kThreshold; i++) {
+        EXPECT_EQ(Action::Compose, update());
+    }
+    flatten();
+    EXPECT_EQ(Action::Reuse, update());
+    EXPECT_EQ(Action::Reuse, update());
+}
+
+TEST_F(ClientCompositionCacheTest, disabledWithZeroThreshold) {
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(Action::Compose, mCache.update(makeEntries(), mDirty, 0));
+    }
+    EXPECT_EQ(nullptr, mCache.getBuffer());
+}
+
+TEST_F(ClientCompositionCacheTest, damageOnDeviceLayerKeepsCache) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+    mDirty.set(Rect(0, 0, 100, 50));
+    EXPECT_EQ(Action::Reuse, update());
+}
+
+TEST_F(ClientCompositionCacheTest, damageOnClientLayerInvalidates) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+    mDirty.set(Rect(10, 60, 20, 70));
+    EXPECT_EQ(Action::Compose, update());
+    EXPECT_EQ(nullptr, mCache.getBuffer());
+    EXPECT_EQ(0u, mCache.getStableFrames());
+}
+
+TEST_F(ClientCompositionCacheTest, stateChangeInvalidates) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+    EXPECT_EQ(Action::Compose, update(1));
+    EXPECT_EQ(nullptr, mCache.getBuffer());
+}
+
+TEST_F(ClientCompositionCacheTest, layerListChangeInvalidates) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+
+    auto entries = makeEntries();
+    entries.pop_back();
+    EXPECT_EQ(Action::Compose, mCache.update(std::move(entries), mDirty, kThreshold));
+    EXPECT_EQ(nullptr, mCache.getBuffer());
+}
+
+TEST_F(ClientCompositionCacheTest, clipChangeInvalidates) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+
+    auto entries = makeEntries();
+    entries[0].clip.set(Rect(0, 0, 100, 40));
+    EXPECT_EQ(Action::Compose, mCache.update(std::move(entries), mDirty, kThreshold));
+}
+
+TEST_F(ClientCompositionCacheTest, invalidateRestartsCounting) {
+    for (uint32_t i = 0; i < kThreshold; i++) {
+        update();
+    }
+    flatten();
+    mCache.invalidate();
+    EXPECT_EQ(nullptr, mCache.getBuffer());
+    EXPECT_EQ(Action::Compose, update());
+    for (uint32_t i = 1; i < kThreshold; i++) {
+        EXPECT_EQ(Action::Compose, update());
+    }
+    EXPECT_EQ(Action::Flatten, update());
+}
+
+} // namespace
+} // namespace android
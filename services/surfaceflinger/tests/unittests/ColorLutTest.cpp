@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include <ui/ColorSpace.h>
+
+#include "RenderEngine/ColorLut.h"
+
+namespace android {
+namespace {
+
+using TransferFunction = Description::TransferFunction;
+
+constexpr uint32_t kSize = ColorLut::SIZE;
+
+class ColorLutTest : public testing::Test {
+protected:
+    ColorLutTest() {
+        // BT2020 PQ content shown on an sRGB display, as GLES20RenderEngine sets it up
+        const ColorSpace srgb(ColorSpace::sRGB());
+        const ColorSpace bt2020(ColorSpace::BT2020());
+        mDescription.setInputTransformMatrix(bt2020.getRGBtoXYZ());
+        mDescription.setOutputTransformMatrix(mat4(srgb.getXYZtoRGB()));
+        mDescription.setInputTransferFunction(TransferFunction::ST2084);
+        mDescription.setOutputTransferFunction(TransferFunction::SRGB);
+        mDescription.setDisplayMaxLuminance(500.0f);
+    }
+
+    static const uint8_t* texel(const std::vector<uint8_t>& texels, uint32_t r, uint32_t g,
+                                uint32_t b) {
+        return &texels[((g * kSize + b) * kSize + r) * 4];
+    }
+
+    Description mDescription;
+};
+
+TEST_F(ColorLutTest, supportsHdrToSdrOnly) {
+    EXPECT_TRUE(ColorLut::isSupported(mDescription));
+
+    mDescription.setInputTransferFunction(TransferFunction::HLG);
+    EXPECT_TRUE(ColorLut::isSupported(mDescription));
+
+    mDescription.setOutputTransferFunction(TransferFunction::ST2084);
+    EXPECT_FALSE(ColorLut::isSupported(mDescription));
+
+    mDescription.setOutputTransferFunction(TransferFunction::SRGB);
+    mDescription.setInputTransferFunction(TransferFunction::SRGB);
+    EXPECT_FALSE(ColorLut::isSupported(mDescription));
+}
+
+TEST_F(ColorLutTest, bakesColorMatrix) {
+    const ColorLut::Params params = ColorLut::getParams(mDescription);
+    const vec3 signal(0.5f);
+    const vec3 color = ColorLut::convert(params, signal);
+
+    mDescription.setColorMatrix(mat4::scale(vec4(0.5f, 0.5f, 0.5f, 1.0f)));
+    EXPECT_TRUE(ColorLut::isSupported(mDescription));
+    const ColorLut::Params dimmed = ColorLut::getParams(mDescription);
+    EXPECT_FALSE(params == dimmed);
+    EXPECT_GT(color.g, ColorLut::convert(dimmed, signal).g);
+}
+
+TEST_F(ColorLutTest, paramsDependOnLuminance) {
+    const ColorLut::Params params = ColorLut::getParams(mDescription);
+    EXPECT_TRUE(params == ColorLut::getParams(mDescription));
+
+    mDescription.setDisplayMaxLuminance(1000.0f);
+    EXPECT_FALSE(params == ColorLut::getParams(mDescription));
+}
+
+TEST_F(ColorLutTest, texelsMatchConversion) {
+    const ColorLut::Params params = ColorLut::getParams(mDescription);
+    std::vector<uint8_t> texels;
+    ColorLut::generate(params, &texels);
+    ASSERT_EQ(kSize * kSize * kSize * 4, texels.size());
+
+    for (uint32_t i = 0; i < kSize; i += 4) {
+        const uint32_t r = i;
+        const uint32_t g = (i * 7) % kSize;
+        const uint32_t b = kSize - 1 - i;
+        const vec3 color = ColorLut::convert(params, vec3(r, g, b) / float(kSize - 1));
+        const uint8_t* actual = texel(texels, r, g, b);
+        EXPECT_EQ(uint8_t(color.r * 255.0f + 0.5f), actual[0]);
+        EXPECT_EQ(uint8_t(color.g * 255.0f + 0.5f), actual[1]);
+        EXPECT_EQ(uint8_t(color.b * 255.0f + 0.5f), actual[2]);
+        EXPECT_EQ(255, actual[3]);
+    }
+}
+
+TEST_F(ColorLutTest, grayRampIsMonotonic) {
+    const ColorLut::Params params = ColorLut::getParams(mDescription);
+    std::vector<uint8_t> texels;
+    ColorLut::generate(params, &texels);
+
+    EXPECT_EQ(0, texel(texels, 0, 0, 0)[1]);
+    // 10000 nits exceed the display, tone mapping clamps them to its white
+    EXPECT_EQ(255, texel(texels, kSize - 1, kSize - 1, kSize - 1)[1]);
+    for (uint32_t i = 1; i < kSize; i++) {
+        EXPECT_LE(texel(texels, i - 1, i - 1, i - 1)[1], texel(texels, i, i, i)[1]);
+    }
+}
+
+} // namespace
+} // namespace android
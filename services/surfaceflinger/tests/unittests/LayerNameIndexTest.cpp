@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include "LayerNameIndex.h"
+
+namespace android {
+namespace {
+
+// the index only compares layer pointers, it never dereferences them
+const void* const kLayerA = reinterpret_cast<const void*>(0x1000);
+const void* const kLayerB = reinterpret_cast<const void*>(0x2000);
+const void* const kLayerC = reinterpret_cast<const void*>(0x3000);
+
+TEST(LayerNameIndexTest, tagsEveryName) {
+    LayerNameIndex index;
+    EXPECT_EQ(String8("a#0"), index.acquire(String8("a")));
+    EXPECT_EQ(String8("b#0"), index.acquire(String8("b")));
+    EXPECT_EQ(String8("a#1"), index.acquire(String8("a")));
+    EXPECT_EQ(String8("a#1#0"), index.acquire(String8("a#1")));
+}
+
+TEST(LayerNameIndexTest, reusesLowestFreeCounter) {
+    LayerNameIndex index;
+    const String8 a0 = index.acquire(String8("a"));
+    const String8 a1 = index.acquire(String8("a"));
+    const String8 a2 = index.acquire(String8("a"));
+    index.bind(a0, kLayerA);
+    index.bind(a1, kLayerB);
+    index.bind(a2, kLayerC);
+
+    index.release(a1, kLayerB);
+    index.release(a0, kLayerA);
+    EXPECT_EQ(String8("a#0"), index.acquire(String8("a")));
+    EXPECT_EQ(String8("a#1"), index.acquire(String8("a")));
+    EXPECT_EQ(String8("a#3"), index.acquire(String8("a")));
+}
+
+TEST(LayerNameIndexTest, onlyHolderReleases) {
+    LayerNameIndex index;
+    const String8 a0 = index.acquire(String8("a"));
+    index.bind(a0, kLayerA);
+    index.release(a0, kLayerA);
+
+    // a layer that lost its name can't free it for the next holder
+    EXPECT_EQ(a0, index.acquire(String8("a")));
+    index.bind(a0, kLayerB);
+    index.release(a0, kLayerA);
+    index.release(a0, nullptr);
+    EXPECT_EQ(String8("a#1"), index.acquire(String8("a")));
+}
+
+TEST(LayerNameIndexTest, releasesReservation) {
+    LayerNameIndex index;
+    const String8 a0 = index.acquire(String8("a"));
+    index.release(a0, nullptr);
+    EXPECT_EQ(a0, index.acquire(String8("a")));
+
+    // names it never handed out are ignored
+    index.release(String8("a"), nullptr);
+    index.release(String8("a#"), nullptr);
+    index.release(String8("a#x"), nullptr);
+    index.release(String8("a#7"), nullptr);
+    EXPECT_EQ(String8("a#1"), index.acquire(String8("a")));
+}
+
+} // namespace
+} // namespace android
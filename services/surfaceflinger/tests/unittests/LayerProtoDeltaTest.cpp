@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include <layerproto/LayerProtoParser.h>
+
+namespace android {
+namespace {
+
+using surfaceflinger::LayerProto;
+using surfaceflinger::LayerProtoParser;
+using surfaceflinger::LayersDeltaProto;
+using surfaceflinger::LayersProto;
+using surfaceflinger::LayersTraceFileProto;
+
+class LayerProtoDeltaTest : public testing::Test {
+protected:
+    LayerProtoDeltaTest() {
+        mLayers.set_color_mode("native");
+        mLayers.mutable_resolution()->set_w(1080);
+        mLayers.mutable_resolution()->set_h(1920);
+        for (int32_t id = 1; id <= 4; id++) {
+            LayerProto* layer = mLayers.add_layers();
+            layer->set_id(id);
+            layer->set_name("layer" + std::to_string(id));
+            layer->set_z(id);
+            layer->add_children(id + 10);
+            layer->mutable_visible_region()->add_rect()->set_right(100 * id);
+            layer->mutable_active_buffer()->set_width(100 * id);
+        }
+    }
+
+    void expectRoundTrip(const LayersProto& current) {
+        LayersDeltaProto delta = LayerProtoParser::generateDelta(mLayers, current);
+        LayersProto reconstructed;
+        ASSERT_TRUE(LayerProtoParser::applyDelta(mLayers, delta, &reconstructed));
+        EXPECT_EQ(current.SerializeAsString(), reconstructed.SerializeAsString());
+    }
+
+    LayersProto mLayers;
+};
+
+TEST_F(LayerProtoDeltaTest, unchangedStateHasNoLayers) {
+    LayersDeltaProto delta = LayerProtoParser::generateDelta(mLayers, mLayers);
+    EXPECT_EQ(0, delta.layers_size());
+    EXPECT_FALSE(delta.has_changed_fields());
+    EXPECT_EQ(4, delta.layer_ids_size());
+    expectRoundTrip(mLayers);
+}
+
+TEST_F(LayerProtoDeltaTest, onlyChangedFieldsAreStored) {
+    LayersProto current = mLayers;
+    current.mutable_layers(1)->set_z(42);
+
+    LayersDeltaProto delta = LayerProtoParser::generateDelta(mLayers, current);
+    ASSERT_EQ(1, delta.layers_size());
+    EXPECT_EQ(2, delta.layers(0).id());
+    EXPECT_TRUE(delta.layers(0).changed_fields().has_z());
+    EXPECT_FALSE(delta.layers(0).changed_fields().has_name());
+    expectRoundTrip(current);
+}
+
+TEST_F(LayerProtoDeltaTest, clearedAndReplacedFields) {
+    LayersProto current = mLayers;
+    current.clear_resolution();
+    current.set_color_mode("srgb");
+    current.mutable_layers(0)->clear_active_buffer();
+    current.mutable_layers(1)->add_children(99);
+    current.mutable_layers(2)->mutable_visible_region()->clear_rect();
+    expectRoundTrip(current);
+}
+
+TEST_F(LayerProtoDeltaTest, addedRemovedAndReorderedLayers) {
+    LayersProto current = mLayers;
+    current.mutable_layers()->SwapElements(0, 3);
+    current.mutable_layers()->RemoveLast();
+    LayerProto* layer = current.add_layers();
+    layer->set_id(5);
+    layer->set_name("added");
+    expectRoundTrip(current);
+}
+
+TEST_F(LayerProtoDeltaTest, expandTrace) {
+    LayersProto second = mLayers;
+    second.mutable_layers(0)->set_z(7);
+    LayersProto third = second;
+    third.mutable_layers()->RemoveLast();
+
+    LayersTraceFileProto trace;
+    trace.add_entry()->mutable_layers()->CopyFrom(mLayers);
+    *trace.add_entry()->mutable_delta() = LayerProtoParser::generateDelta(mLayers, second);
+    *trace.add_entry()->mutable_delta() = LayerProtoParser::generateDelta(second, third);
+
+    ASSERT_TRUE(LayerProtoParser::expandTrace(&trace));
+    EXPECT_FALSE(trace.entry(2).has_delta());
+    EXPECT_EQ(second.SerializeAsString(), trace.entry(1).layers().SerializeAsString());
+    EXPECT_EQ(third.SerializeAsString(), trace.entry(2).layers().SerializeAsString());
+}
+
+TEST_F(LayerProtoDeltaTest, expandTraceNeedsFullState) {
+    LayersTraceFileProto trace;
+    *trace.add_entry()->mutable_delta() = LayerProtoParser::generateDelta(mLayers, mLayers);
+    EXPECT_FALSE(LayerProtoParser::expandTrace(&trace));
+}
+
+} // namespace
+} // namespace android
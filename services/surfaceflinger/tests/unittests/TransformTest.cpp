@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <math.h>
+
+#include <gtest/gtest.h>
+
+#include <ui/Region.h>
+
+#include "Transform.h"
+
+namespace android {
+namespace {
+
+const uint32_t kOrientations[] = {
+        Transform::ROT_0,  Transform::FLIP_H, Transform::FLIP_V,
+        Transform::ROT_90, Transform::ROT_180, Transform::ROT_270,
+        Transform::ROT_90 | Transform::FLIP_H, Transform::ROT_90 | Transform::FLIP_V,
+};
+
+// Transforms the corners of |bounds| with the float matrix.
+Rect transformCorners(const Transform& t, const Rect& bounds) {
+    const vec2 corners[] = {
+            t.transform(vec2(bounds.left, bounds.top)),
+            t.transform(vec2(bounds.right, bounds.top)),
+            t.transform(vec2(bounds.left, bounds.bottom)),
+            t.transform(vec2(bounds.right, bounds.bottom)),
+    };
+    float l = corners[0].x, t0 = corners[0].y, r = corners[0].x, b = corners[0].y;
+    for (const vec2& c : corners) {
+        l = fminf(l, c.x);
+        t0 = fminf(t0, c.y);
+        r = fmaxf(r, c.x);
+        b = fmaxf(b, c.y);
+    }
+    return Rect(floorf(l + 0.5f), floorf(t0 + 0.5f), floorf(r + 0.5f), floorf(b + 0.5f));
+}
+
+Region makeRegion() {
+    Region region(Rect(10, 20, 110, 60));
+    region.orSelf(Rect(40, 60, 300, 100));
+    region.orSelf(Rect(0, 80, 20, 150));
+    region.subtractSelf(Rect(50, 30, 70, 90));
+    return region;
+}
+
+Transform makeTransform(uint32_t orientation, float tx, float ty) {
+    Transform rotation;
+    rotation.set(orientation, 400, 300);
+    Transform translation;
+    translation.set(tx, ty);
+    return translation * rotation;
+}
+
+TEST(TransformTest, rectMatchesMatrix) {
+    const Rect rects[] = {Rect(0, 0, 400, 300), Rect(13, 27, 91, 155), Rect(-5, -7, 3, 2)};
+    for (uint32_t orientation : kOrientations) {
+        for (float translation : {0.0f, 12.0f, -3.5f, 7.25f}) {
+            const Transform t = makeTransform(orientation, translation, -translation);
+            for (const Rect& rect : rects) {
+                EXPECT_EQ(transformCorners(t, rect), t.transform(rect))
+                        << "orientation " << orientation << " translation " << translation;
+            }
+        }
+    }
+}
+
+TEST(TransformTest, regionMatchesRects) {
+    const Region region = makeRegion();
+    for (uint32_t orientation : kOrientations) {
+        const Transform t = makeTransform(orientation, 5, 9);
+        Region expected;
+        for (const Rect& rect : region) {
+            expected.orSelf(transformCorners(t, rect));
+        }
+        const Region actual = t.transform(region);
+        EXPECT_TRUE(expected.subtract(actual).isEmpty()) << "orientation " << orientation;
+        EXPECT_TRUE(actual.subtract(expected).isEmpty()) << "orientation " << orientation;
+    }
+}
+
+TEST(TransformTest, scaledRegionMatchesRects) {
+    const Region region = makeRegion();
+    Transform scale;
+    scale.set(2, 0, 0, 0.5f);
+    Region expected;
+    for (const Rect& rect : region) {
+        expected.orSelf(scale.transform(rect));
+    }
+    const Region actual = scale.transform(region);
+    EXPECT_TRUE(expected.subtract(actual).isEmpty());
+    EXPECT_TRUE(actual.subtract(expected).isEmpty());
+}
+
+TEST(TransformTest, composedTranslations) {
+    Transform a;
+    a.set(10, 20);
+    Transform b;
+    b.set(-4, 5);
+
+    const Transform ab = a * b;
+    EXPECT_EQ(Transform::TRANSLATE, ab.getType());
+    EXPECT_EQ(6.0f, ab.tx());
+    EXPECT_EQ(25.0f, ab.ty());
+    EXPECT_EQ(a.transform(b.transform(vec2(3, 7))), ab.transform(vec2(3, 7)));
+
+    Transform inverse;
+    inverse.set(-10, -20);
+    EXPECT_EQ(Transform::IDENTITY, (a * inverse).getType());
+}
+
+} // namespace
+} // namespace android
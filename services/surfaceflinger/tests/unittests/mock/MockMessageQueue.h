@@ -31,9 +31,10 @@ public:
     MOCK_METHOD1(init, void(const sp<SurfaceFlinger>&));
     MOCK_METHOD1(setEventThread, void(android::EventThread*));
     MOCK_METHOD0(waitMessage, void());
-    MOCK_METHOD2(postMessage, status_t(const sp<MessageBase>&, nsecs_t));
+    MOCK_METHOD3(postMessage, status_t(const sp<MessageBase>&, nsecs_t, uint32_t));
     MOCK_METHOD0(invalidate, void());
     MOCK_METHOD0(refresh, void());
+    MOCK_CONST_METHOD1(dump, void(String8&));
 };
 
 } // namespace mock
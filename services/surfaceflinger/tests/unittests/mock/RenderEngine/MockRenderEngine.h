@@ -85,6 +85,8 @@ public:
     MOCK_METHOD1(setAsync, void(bool));
     MOCK_METHOD1(setNativeWindow, void(ANativeWindow*));
     MOCK_CONST_METHOD0(swapBuffers, void());
+    MOCK_CONST_METHOD1(swapBuffersWithDamage, void(const Region&));
+    MOCK_CONST_METHOD0(queryBufferAge, int32_t());
     MOCK_CONST_METHOD0(queryRedSize, int32_t());
     MOCK_CONST_METHOD0(queryGreenSize, int32_t());
     MOCK_CONST_METHOD0(queryBlueSize, int32_t());
@@ -17,6 +17,7 @@
 #include "ThermalService.h"
 #include <android/os/IThermalService.h>
 #include <android/os/IThermalEventListener.h>
+#include <android/os/IThermalHeadroomListener.h>
 #include <android/os/Temperature.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -24,9 +25,51 @@
 #include <utils/Mutex.h>
 #include <utils/String16.h>
 
+#include <math.h>
+
 namespace android {
 namespace os {
 
+namespace {
+
+// Furthest a headroom forecast may look ahead.
+constexpr int32_t kMaxForecastSeconds = 60;
+
+// Headroom listeners are only told about moves at least this large, which
+// keeps sensor noise from turning into a callback per poll.
+constexpr float kHeadroomNotifyStep = 0.01f;
+
+}  // anonymous namespace
+
+constexpr size_t ThermalService::kHistorySize;
+
+float ThermalService::SensorHistory::latest() const {
+    return values[(next + kHistorySize - 1) % kHistorySize];
+}
+
+float ThermalService::SensorHistory::slope() const {
+    if (count < 2)
+        return 0.0f;
+
+    // Fit against times relative to the oldest sample to keep the sums
+    // within float precision.
+    size_t first = (next + kHistorySize - count) % kHistorySize;
+    double sumT = 0, sumV = 0, sumTT = 0, sumTV = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (first + i) % kHistorySize;
+        double t = (times[index] - times[first]) / 1e9;
+        double v = values[index];
+        sumT += t;
+        sumV += v;
+        sumTT += t * t;
+        sumTV += t * v;
+    }
+    double denominator = count * sumTT - sumT * sumT;
+    if (denominator <= 0)
+        return 0.0f;
+    return static_cast<float>((count * sumTV - sumT * sumV) / denominator);
+}
+
 /**
  * Notify registered listeners of a thermal throttling start/stop event.
  * @param temperature the temperature at which the event was generated
@@ -54,6 +97,115 @@ binder::Status ThermalService::isThrottling(bool* _aidl_return) {
     return binder::Status::ok();
 }
 
+/**
+ * Add polled temperature readings to the per-sensor histories and notify
+ * headroom listeners if the predicted headroom has moved noticeably.
+ * @param samples the readings of one poll of the thermal HAL
+ * @param when the time at which the readings were taken
+ */
+void ThermalService::addTemperatureSamples(
+    const std::vector<SensorSample>& samples, nsecs_t when) {
+    Mutex::Autolock _l(mHistoryLock);
+
+    for (const SensorSample& sample : samples) {
+        if (isnan(sample.value))
+            continue;
+        SensorHistory& history = mHistory[sample.name];
+        history.values[history.next] = sample.value;
+        history.times[history.next] = when;
+        history.next = (history.next + 1) % kHistorySize;
+        if (history.count < kHistorySize)
+            history.count++;
+        history.throttlingThreshold = sample.throttlingThreshold;
+    }
+
+    if (mHeadroomListeners.isEmpty())
+        return;
+
+    float headroom = predictHeadroomLocked(0);
+    float secondsToThrottling = predictSecondsToThrottlingLocked();
+    bool wasApproaching = mLastSecondsToThrottling >= 0;
+    bool isApproaching = secondsToThrottling >= 0;
+    if (isnan(headroom) ||
+        (!isnan(mLastHeadroom) &&
+         fabsf(headroom - mLastHeadroom) < kHeadroomNotifyStep &&
+         wasApproaching == isApproaching)) {
+        return;
+    }
+
+    mLastHeadroom = headroom;
+    mLastSecondsToThrottling = secondsToThrottling;
+    for (size_t i = 0; i < mHeadroomListeners.size(); i++) {
+        mHeadroomListeners[i]->notifyHeadroom(headroom, secondsToThrottling);
+    }
+}
+
+float ThermalService::predictHeadroomLocked(float forecastSeconds) const {
+    float headroom = NAN;
+    for (const auto& entry : mHistory) {
+        const SensorHistory& history = entry.second;
+        if (!(history.throttlingThreshold > 0) ||
+            isinf(history.throttlingThreshold))
+            continue;
+        float predicted = history.latest() + history.slope() * forecastSeconds;
+        float sensorHeadroom = predicted / history.throttlingThreshold;
+        if (isnan(headroom) || sensorHeadroom > headroom)
+            headroom = sensorHeadroom;
+    }
+    return headroom;
+}
+
+float ThermalService::predictSecondsToThrottlingLocked() const {
+    float seconds = -1.0f;
+    for (const auto& entry : mHistory) {
+        const SensorHistory& history = entry.second;
+        if (!(history.throttlingThreshold > 0) ||
+            isinf(history.throttlingThreshold))
+            continue;
+        float remaining = history.throttlingThreshold - history.latest();
+        float sensorSeconds;
+        if (remaining <= 0) {
+            sensorSeconds = 0;
+        } else {
+            float slope = history.slope();
+            if (slope <= 0)
+                continue;
+            sensorSeconds = remaining / slope;
+        }
+        if (seconds < 0 || sensorSeconds < seconds)
+            seconds = sensorSeconds;
+    }
+    return seconds;
+}
+
+/**
+ * Query the predicted thermal headroom of the hottest sensor.
+ * @param forecastSeconds how far ahead of now to predict
+ * @return the predicted temperature over the throttling threshold, or NaN
+ *         if no sensor with a known threshold has been sampled
+ */
+binder::Status ThermalService::getThermalHeadroom(
+    int32_t forecastSeconds, float* _aidl_return) {
+    if (forecastSeconds < 0 || forecastSeconds > kMaxForecastSeconds) {
+        return binder::Status::fromExceptionCode(
+            binder::Status::EX_ILLEGAL_ARGUMENT);
+    }
+    Mutex::Autolock _l(mHistoryLock);
+    *_aidl_return = predictHeadroomLocked(forecastSeconds);
+    return binder::Status::ok();
+}
+
+/**
+ * Query the predicted time until a sensor reaches its throttling threshold.
+ * @return the time in seconds, 0 if already there, or a negative value if
+ *         no sensor is heading there
+ */
+binder::Status ThermalService::getSecondsToThrottling(float* _aidl_return) {
+    Mutex::Autolock _l(mHistoryLock);
+    *_aidl_return = predictSecondsToThrottlingLocked();
+    return binder::Status::ok();
+}
+
 /**
  * Register a new thermal event listener.
  * @param listener the client's IThermalEventListener instance to which
@@ -102,12 +254,72 @@ binder::Status ThermalService::unregisterThermalEventListener(
     return binder::Status::ok();
 }
 
+/**
+ * Register a new thermal headroom listener. The listener is sent the
+ * current headroom right away if there is one.
+ * @param listener the client's IThermalHeadroomListener instance to which
+ *                 headroom updates are to be sent
+ */
+binder::Status ThermalService::registerThermalHeadroomListener(
+    const sp<IThermalHeadroomListener>& listener) {
+    if (listener == NULL)
+        return binder::Status::ok();
+    Mutex::Autolock _l(mHistoryLock);
+    for (size_t i = 0; i < mHeadroomListeners.size(); i++) {
+        if (IInterface::asBinder(mHeadroomListeners[i]) ==
+            IInterface::asBinder(listener)) {
+            return binder::Status::ok();
+        }
+    }
+
+    mHeadroomListeners.add(listener);
+    IInterface::asBinder(listener)->linkToDeath(this);
+
+    float headroom = predictHeadroomLocked(0);
+    if (!isnan(headroom)) {
+        listener->notifyHeadroom(headroom, predictSecondsToThrottlingLocked());
+    }
+    return binder::Status::ok();
+}
+
+/**
+ * Unregister a previously-registered thermal headroom listener.
+ * @param listener the client's IThermalHeadroomListener instance to which
+ *                 headroom updates are to no longer be sent
+ */
+binder::Status ThermalService::unregisterThermalHeadroomListener(
+    const sp<IThermalHeadroomListener>& listener) {
+    if (listener == NULL)
+        return binder::Status::ok();
+    Mutex::Autolock _l(mHistoryLock);
+    for (size_t i = 0; i < mHeadroomListeners.size(); i++) {
+        if (IInterface::asBinder(mHeadroomListeners[i]) ==
+            IInterface::asBinder(listener)) {
+            IInterface::asBinder(mHeadroomListeners[i])->unlinkToDeath(this);
+            mHeadroomListeners.removeAt(i);
+            break;
+        }
+    }
+
+    return binder::Status::ok();
+}
+
 void ThermalService::binderDied(const wp<IBinder>& who) {
-    Mutex::Autolock _l(mListenersLock);
+    {
+        Mutex::Autolock _l(mListenersLock);
 
-    for (size_t i = 0; i < mListeners.size(); i++) {
-        if (IInterface::asBinder(mListeners[i]) == who) {
-            mListeners.removeAt(i);
+        for (size_t i = 0; i < mListeners.size(); i++) {
+            if (IInterface::asBinder(mListeners[i]) == who) {
+                mListeners.removeAt(i);
+                return;
+            }
+        }
+    }
+
+    Mutex::Autolock _l(mHistoryLock);
+    for (size_t i = 0; i < mHeadroomListeners.size(); i++) {
+        if (IInterface::asBinder(mHeadroomListeners[i]) == who) {
+            mHeadroomListeners.removeAt(i);
             break;
         }
     }
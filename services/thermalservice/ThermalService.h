@@ -19,33 +19,85 @@
 
 #include <android/os/BnThermalService.h>
 #include <android/os/IThermalEventListener.h>
+#include <android/os/IThermalHeadroomListener.h>
 #include <android/os/Temperature.h>
 #include <utils/Mutex.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
+#include <math.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
 namespace android {
 namespace os {
 
 class ThermalService : public BnThermalService,
                        public IBinder::DeathRecipient {
 public:
-  ThermalService() : mThrottled(false) {};
+  ThermalService() : mThrottled(false), mLastHeadroom(NAN),
+      mLastSecondsToThrottling(-1.0f) {};
     void publish(const sp<ThermalService>& service);
     binder::Status notifyThrottling(
         const bool isThrottling, const Temperature& temperature);
 
+    // One reading of a named sensor, as polled from the thermal HAL.
+    struct SensorSample {
+        std::string name;
+        float value;
+        float throttlingThreshold;
+    };
+    // Add a poll's worth of readings, taken at 'when', to the sensor
+    // histories and send headroom listeners an update if warranted.
+    void addTemperatureSamples(
+        const std::vector<SensorSample>& samples, nsecs_t when);
+
 private:
+    // The last kHistorySize readings of one sensor, oldest first once the
+    // ring has wrapped at 'next'.
+    static constexpr size_t kHistorySize = 10;
+    struct SensorHistory {
+        SensorHistory() : count(0), next(0), throttlingThreshold(NAN) {}
+        float values[kHistorySize];
+        nsecs_t times[kHistorySize];
+        size_t count;
+        size_t next;
+        float throttlingThreshold;
+
+        float latest() const;
+        // Least-squares temperature trend in degrees per second.
+        float slope() const;
+    };
+
     Mutex mListenersLock;
     Vector<sp<IThermalEventListener> > mListeners;
     bool mThrottled;
     Temperature mThrottleTemperature;
 
+    Mutex mHistoryLock;
+    std::map<std::string, SensorHistory> mHistory;
+    Vector<sp<IThermalHeadroomListener> > mHeadroomListeners;
+    float mLastHeadroom;
+    float mLastSecondsToThrottling;
+
+    float predictHeadroomLocked(float forecastSeconds) const;
+    float predictSecondsToThrottlingLocked() const;
+
     binder::Status registerThermalEventListener(
         const sp<IThermalEventListener>& listener);
     binder::Status unregisterThermalEventListener(
         const sp<IThermalEventListener>& listener);
     binder::Status isThrottling(bool* _aidl_return);
+    binder::Status getThermalHeadroom(
+        int32_t forecastSeconds, float* _aidl_return);
+    binder::Status getSecondsToThrottling(float* _aidl_return);
+    binder::Status registerThermalHeadroomListener(
+        const sp<IThermalHeadroomListener>& listener);
+    binder::Status unregisterThermalHeadroomListener(
+        const sp<IThermalHeadroomListener>& listener);
     void binderDied(const wp<IBinder>& who);
 };
 
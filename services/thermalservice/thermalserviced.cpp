@@ -24,15 +24,27 @@
 #include <android/hardware/thermal/1.1/IThermal.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <cutils/properties.h>
+#include <hardware/thermal.h>
 #include <hidl/HidlTransportSupport.h>
+#include <utils/Timers.h>
+
+#include <math.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
 
 using namespace android;
 using ::android::hardware::thermal::V1_1::IThermal;
 using ::android::hardware::thermal::V1_0::Temperature;
+using ::android::hardware::thermal::V1_0::ThermalStatus;
+using ::android::hardware::thermal::V1_0::ThermalStatusCode;
 using ::android::hardware::thermal::V1_1::IThermalCallback;
 using ::android::hardware::thermal::V1_1::implementation::ThermalCallback;
 using ::android::hardware::configureRpcThreadpool;
 using ::android::hardware::hidl_death_recipient;
+using ::android::hardware::hidl_vec;
 using ::android::hidl::base::V1_0::IBase;
 using ::android::os::ThermalService;
 
@@ -59,6 +71,9 @@ struct ThermalServiceDeathRecipient : hidl_death_recipient {
 
 sp<ThermalServiceDeathRecipient> gThermalHalDied = nullptr;
 
+// How often the HAL's temperatures are sampled for headroom prediction.
+constexpr int32_t kDefaultPollIntervalMs = 1000;
+
 }  // anonymous namespace
 
 void ThermalServiceDaemon::thermalServiceStartup() {
@@ -68,9 +83,53 @@ void ThermalServiceDaemon::thermalServiceStartup() {
     // Register IThermalService object with IThermalCallback
     if (mThermalCallback != nullptr)
         mThermalCallback->registerThermalService(mThermalService);
+    startTemperaturePolling();
     IPCThreadState::self()->joinThreadPool();
 }
 
+// Sample the Thermal HAL's temperatures on a fixed interval so that
+// ThermalService can predict headroom ahead of the HAL's throttling
+// events. thermalservice.poll_interval_ms sets the interval; 0 disables it.
+void ThermalServiceDaemon::startTemperaturePolling() {
+    int32_t intervalMs = property_get_int32("thermalservice.poll_interval_ms",
+                                            kDefaultPollIntervalMs);
+    if (intervalMs <= 0) {
+        ALOGI("Temperature polling disabled, no thermal headroom prediction");
+        return;
+    }
+
+    sp<ThermalService> thermalService = mThermalService;
+    std::thread([thermalService, intervalMs]() {
+        std::vector<ThermalService::SensorSample> samples;
+        while (true) {
+            sp<IThermal> thermalHal = gThermalHal;
+            if (thermalHal != nullptr) {
+                samples.clear();
+                Return<void> ret = thermalHal->getTemperatures(
+                    [&samples](ThermalStatus status,
+                               const hidl_vec<Temperature>& temperatures) {
+                        if (status.code != ThermalStatusCode::SUCCESS)
+                            return;
+                        for (const Temperature& temperature : temperatures) {
+                            if (temperature.currentValue == UNKNOWN_TEMPERATURE)
+                                continue;
+                            samples.push_back({temperature.name,
+                                temperature.currentValue,
+                                temperature.throttlingThreshold ==
+                                    UNKNOWN_TEMPERATURE ? NAN :
+                                    temperature.throttlingThreshold});
+                        }
+                    });
+                if (ret.isOk() && !samples.empty()) {
+                    thermalService->addTemperatureSamples(
+                        samples, systemTime(SYSTEM_TIME_MONOTONIC));
+                }
+            }
+            usleep(intervalMs * 1000);
+        }
+    }).detach();
+}
+
 // Lookup Thermal HAL, register death notifier, register our
 // ThermalCallback with the Thermal HAL.
 void ThermalServiceDaemon::getThermalHal() {
@@ -30,6 +30,7 @@ class ThermalServiceDaemon {
     void thermalServiceStartup();
     void thermalCallbackStartup();
     void getThermalHal();
+    void startTemperaturePolling();
     ThermalServiceDaemon() {};
 
  private:
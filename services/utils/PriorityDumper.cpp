@@ -19,6 +19,7 @@
 namespace android {
 
 const char16_t PriorityDumper::PROTO_ARG[] = u"--proto";
+const char16_t PriorityDumper::PROTO_SINCE_ARG[] = u"--proto-since";
 const char16_t PriorityDumper::PRIORITY_ARG[] = u"--dump-priority";
 const char16_t PriorityDumper::PRIORITY_ARG_CRITICAL[] = u"CRITICAL";
 const char16_t PriorityDumper::PRIORITY_ARG_HIGH[] = u"HIGH";
@@ -54,9 +55,18 @@ status_t PriorityDumper::priorityDump(int fd, const Vector<String16>& args) {
     PriorityType priority = PriorityType::INVALID;
 
     Vector<String16> strippedArgs;
+    Vector<String16> protoSinceArgs;
     for (uint32_t argIndex = 0; argIndex < args.size(); argIndex++) {
         if (args[argIndex] == PROTO_ARG) {
             asProto = true;
+        } else if (args[argIndex] == PROTO_SINCE_ARG) {
+            asProto = true;
+            protoSinceArgs.clear();
+            protoSinceArgs.add(args[argIndex]);
+            if (argIndex + 1 < args.size()) {
+                argIndex++;
+                protoSinceArgs.add(args[argIndex]);
+            }
         } else if (args[argIndex] == PRIORITY_ARG) {
             if (argIndex + 1 < args.size()) {
                 argIndex++;
@@ -67,6 +77,8 @@ status_t PriorityDumper::priorityDump(int fd, const Vector<String16>& args) {
         }
     }
 
+    strippedArgs.insertVectorAt(protoSinceArgs, 0);
+
     switch (priority) {
         case PriorityType::CRITICAL:
             status = dumpCritical(fd, strippedArgs, asProto);
@@ -32,6 +32,7 @@ public:
     static const char16_t PRIORITY_ARG_HIGH[];
     static const char16_t PRIORITY_ARG_NORMAL[];
     static const char16_t PROTO_ARG[];
+    static const char16_t PROTO_SINCE_ARG[];
 
     // Parses the argument list searching for --dump_priority with a priority type
     // (HIGH, CRITICAL or NORMAL) and --proto. Matching arguments are stripped.
@@ -39,6 +40,10 @@ public:
     // method is called otherwise all supported sections are dumped.
     // If --proto is found, the dumpAsProto flag is set to dump sections in proto
     // format.
+    // --proto-since GENERATION asks for a proto dump of only what changed since a
+    // generation returned by a previous dump; services that don't support it dump
+    // everything. It also sets the dumpAsProto flag, and is moved with its
+    // generation to the front of the arguments passed to the dump methods.
     status_t priorityDump(int fd, const Vector<String16>& args);
 
     // Dumps CRITICAL priority sections.
@@ -208,6 +208,26 @@ TEST_F(PriorityDumperTest, protoArgAtEnd) {
     dumper_.priorityDump(fd, args);
 }
 
+TEST_F(PriorityDumperTest, protoSinceArg) {
+    Vector<String16> args;
+    addAll(args, {"args", "--proto-since", "42", "left", "behind"});
+    Vector<String16> strippedArgs;
+    addAll(strippedArgs, {"--proto-since", "42", "args", "left", "behind"});
+    EXPECT_CALL(dumper_, dumpAll(fd, ElementsAreArray(strippedArgs), /*asProto=*/true));
+
+    dumper_.priorityDump(fd, args);
+}
+
+TEST_F(PriorityDumperTest, protoSinceArgWithPriorityArgs) {
+    Vector<String16> args;
+    addAll(args, {"--dump-priority", "CRITICAL", "args", "--proto-since", "42"});
+    Vector<String16> strippedArgs;
+    addAll(strippedArgs, {"--proto-since", "42", "args"});
+    EXPECT_CALL(dumper_, dumpCritical(fd, ElementsAreArray(strippedArgs), /*asProto=*/true));
+
+    dumper_.priorityDump(fd, args);
+}
+
 TEST_F(PriorityDumperTest, protoArgWithInvalidPriorityType) {
     Vector<String16> args;
     addAll(args, {"--dump-priority", "NOT_SO_HIGH", "--proto", "args", "left", "behind"});
@@ -29,7 +29,8 @@ namespace android {
 namespace dvr {
 
 BufferHubService::BufferHubService()
-    : BASE("BufferHub", Endpoint::Create(BufferHubRPC::kClientPath)) {}
+    : BASE("BufferHub", Endpoint::Create(BufferHubRPC::kClientPath)),
+      buffer_pool_(BufferPool::GetDefaultConfig()) {}
 
 BufferHubService::~BufferHubService() {}
 
@@ -218,6 +219,9 @@ std::string BufferHubService::DumpState(size_t /*max_length*/) {
     }
   }
 
+  stream << std::endl;
+  stream << buffer_pool_.DumpState();
+
   return stream.str();
 }
 
@@ -297,9 +301,9 @@ Status<void> BufferHubService::OnCreateBuffer(Message& message, uint32_t width,
     return ErrorStatus(EALREADY);
   }
   const uint32_t kDefaultLayerCount = 1;
-  auto status = ProducerChannel::Create(this, buffer_id, width, height,
-                                        kDefaultLayerCount, format, usage,
-                                        meta_size_bytes);
+  auto status = ProducerChannel::Create(
+      this, message.GetProcessId(), buffer_id, width, height,
+      kDefaultLayerCount, format, usage, meta_size_bytes);
   if (status) {
     message.SetChannel(status.take());
     return {};
@@ -333,8 +337,9 @@ pdx::Status<void> BufferHubService::OnCreateDetachedBuffer(
   }
 
   std::unique_ptr<DetachedBufferChannel> channel =
-      DetachedBufferChannel::Create(this, buffer_id, width, height, layer_count,
-                                    format, usage, user_metadata_size);
+      DetachedBufferChannel::Create(this, message.GetProcessId(), buffer_id,
+                                    width, height, layer_count, format, usage,
+                                    user_metadata_size);
   if (!channel) {
     ALOGE(
         "BufferHubService::OnCreateDetachedBuffer: Failed to allocate buffer, "
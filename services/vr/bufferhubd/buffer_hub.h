@@ -9,6 +9,8 @@
 #include <pdx/service.h>
 #include <private/dvr/bufferhub_rpc.h>
 
+#include "buffer_pool.h"
+
 namespace android {
 namespace dvr {
 
@@ -141,9 +143,14 @@ class BufferHubService : public pdx::ServiceBase<BufferHubService> {
   bool IsInitialized() const override;
   std::string DumpState(size_t max_length) override;
 
+  // Allocates the buffers of new producers and retains buffers for reuse.
+  BufferPool& buffer_pool() { return buffer_pool_; }
+
  private:
   friend BASE;
 
+  BufferPool buffer_pool_;
+
   pdx::Status<void> OnCreateBuffer(pdx::Message& message, uint32_t width,
                                    uint32_t height, uint32_t format,
                                    uint64_t usage, size_t meta_size_bytes);
@@ -0,0 +1,193 @@
+#include "buffer_pool.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <ui/PixelFormat.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace android {
+namespace dvr {
+
+namespace {
+
+const char kPoolMaxBytesProperty[] = "persist.dvr.bufferhubd.pool_bytes";
+const char kPoolMaxBuffersPerClassProperty[] =
+    "persist.dvr.bufferhubd.pool_class_buffers";
+const char kPoolMaxBuffersPerClientProperty[] =
+    "persist.dvr.bufferhubd.pool_client_buffers";
+const char kPoolRetentionMsProperty[] =
+    "persist.dvr.bufferhubd.pool_retain_ms";
+
+const int64_t kDefaultPoolMaxBytes = 64 * 1024 * 1024;
+const int64_t kDefaultPoolMaxBuffersPerClass = 8;
+const int64_t kDefaultPoolMaxBuffersPerClient = 16;
+const int64_t kDefaultPoolRetentionMs = 30000;
+
+}  // anonymous namespace
+
+BufferPool::Config BufferPool::GetDefaultConfig() {
+  Config config;
+  config.max_bytes = std::max<int64_t>(
+      0, property_get_int64(kPoolMaxBytesProperty, kDefaultPoolMaxBytes));
+  config.max_buffers_per_class = std::max<int64_t>(
+      0, property_get_int64(kPoolMaxBuffersPerClassProperty,
+                            kDefaultPoolMaxBuffersPerClass));
+  config.max_buffers_per_client = std::max<int64_t>(
+      0, property_get_int64(kPoolMaxBuffersPerClientProperty,
+                            kDefaultPoolMaxBuffersPerClient));
+  config.retention_time = ms2ns(std::max<int64_t>(
+      0,
+      property_get_int64(kPoolRetentionMsProperty, kDefaultPoolRetentionMs)));
+  return config;
+}
+
+BufferPool::BufferPool(const Config& config) : config_(config) {}
+
+size_t BufferPool::GetBufferSize(const IonBuffer& buffer) {
+  // Formats without a fixed pixel size are YUV formats, except for blobs,
+  // whose width is their size in bytes.
+  size_t bytes_per_pixel = bytesPerPixel(buffer.format());
+  if (bytes_per_pixel == 0)
+    bytes_per_pixel = buffer.format() == HAL_PIXEL_FORMAT_BLOB ? 1 : 2;
+  const size_t stride = std::max(buffer.stride(), buffer.width());
+  const size_t layer_count = std::max(buffer.layer_count(), 1u);
+  return stride * buffer.height() * layer_count * bytes_per_pixel;
+}
+
+std::list<BufferPool::Entry>::iterator BufferPool::Free(
+    std::list<Entry>::iterator entry) {
+  retained_size_ -= entry->size;
+  return entries_.erase(entry);
+}
+
+void BufferPool::Expire(nsecs_t now) {
+  auto entry = entries_.begin();
+  while (entry != entries_.end() &&
+         now - entry->retained_time >= config_.retention_time) {
+    entry = Free(entry);
+    expired_++;
+  }
+}
+
+int BufferPool::Allocate(IonBuffer* buffer, uint32_t width, uint32_t height,
+                         uint32_t layer_count, uint32_t format,
+                         uint64_t usage) {
+  Expire(systemTime(SYSTEM_TIME_MONOTONIC));
+
+  const SizeClass size_class{width, height, layer_count, format, usage};
+  auto entry = std::find_if(
+      entries_.begin(), entries_.end(),
+      [&size_class](const Entry& e) { return e.size_class == size_class; });
+  if (entry != entries_.end()) {
+    *buffer = std::move(entry->buffer);
+    Free(entry);
+    hits_++;
+    return 0;
+  }
+
+  misses_++;
+  return buffer->Alloc(width, height, layer_count, format, usage);
+}
+
+void BufferPool::OnBufferFreed(pid_t client_pid, const IonBuffer& buffer) {
+  if (!buffer.IsValid() || config_.max_bytes == 0)
+    return;
+
+  const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+  Expire(now);
+
+  const SizeClass size_class{buffer.width(), buffer.height(),
+                             buffer.layer_count(), buffer.format(),
+                             buffer.usage()};
+  const size_t size = GetBufferSize(buffer);
+  if (size > config_.max_bytes)
+    return;
+
+  size_t class_count = 0;
+  size_t client_count = 0;
+  for (const auto& entry : entries_) {
+    if (entry.size_class == size_class)
+      class_count++;
+    if (entry.client_pid == client_pid)
+      client_count++;
+  }
+  if (class_count >= config_.max_buffers_per_class)
+    return;
+  if (client_count >= config_.max_buffers_per_client) {
+    quota_exceeded_++;
+    return;
+  }
+
+  // Make room by freeing the oldest buffers of any size class.
+  while (retained_size_ + size > config_.max_bytes) {
+    Free(entries_.begin());
+    evicted_++;
+  }
+
+  ATRACE_NAME("BufferPool::OnBufferFreed");
+  Entry entry{size_class, client_pid, size, now, IonBuffer()};
+  if (int ret = entry.buffer.Alloc(size_class.width, size_class.height,
+                                   size_class.layer_count, size_class.format,
+                                   size_class.usage)) {
+    ALOGW("BufferPool::OnBufferFreed: Failed to allocate buffer: %s",
+          strerror(-ret));
+    return;
+  }
+
+  retained_size_ += size;
+  retained_++;
+  entries_.push_back(std::move(entry));
+}
+
+std::string BufferPool::DumpState() const {
+  std::ostringstream stream;
+  stream << "Buffer Pool:\n";
+  stream << "Retained " << entries_.size() << " buffers, "
+         << retained_size_ / 1024 << " of " << config_.max_bytes / 1024
+         << " KiB; hits=" << hits_ << " misses=" << misses_
+         << " retained=" << retained_ << " expired=" << expired_
+         << " evicted=" << evicted_ << " quota_exceeded=" << quota_exceeded_
+         << std::endl;
+
+  stream << std::right;
+  stream << std::setw(6) << "Pid";
+  stream << " ";
+  stream << std::setw(14) << "Geometry";
+  stream << " ";
+  stream << std::setw(6) << "Format";
+  stream << " ";
+  stream << std::setw(10) << "Usage";
+  stream << " ";
+  stream << std::setw(10) << "KiB";
+  stream << std::endl;
+
+  for (const auto& entry : entries_) {
+    const SizeClass& size_class = entry.size_class;
+    stream << std::setw(6) << entry.client_pid;
+    stream << " ";
+    std::string dimensions = std::to_string(size_class.width) + "x" +
+                             std::to_string(size_class.height) + "x" +
+                             std::to_string(size_class.layer_count);
+    stream << std::setw(14) << dimensions;
+    stream << " ";
+    stream << std::setw(6) << size_class.format;
+    stream << " ";
+    stream << "0x" << std::hex << std::setfill('0');
+    stream << std::setw(8) << size_class.usage;
+    stream << std::dec << std::setfill(' ');
+    stream << " ";
+    stream << std::setw(10) << entry.size / 1024;
+    stream << std::endl;
+  }
+  return stream.str();
+}
+
+}  // namespace dvr
+}  // namespace android
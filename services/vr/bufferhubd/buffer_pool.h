@@ -0,0 +1,101 @@
+#ifndef ANDROID_DVR_BUFFERHUBD_BUFFER_POOL_H_
+#define ANDROID_DVR_BUFFERHUBD_BUFFER_POOL_H_
+
+#include <sys/types.h>
+
+#include <list>
+#include <string>
+
+#include <private/dvr/ion_buffer.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace dvr {
+
+// BufferPool keeps pre-allocated gralloc buffers of recently freed size
+// classes, so that apps recreating or resizing their queues mid-session do not
+// wait for large allocations. A freed buffer may still be mapped by clients
+// that imported it, so it is never handed out again; instead the pool
+// allocates a fresh buffer of the same size class when one is freed, and hands
+// that out on the next matching allocation.
+class BufferPool {
+ public:
+  struct Config {
+    // Total size of the retained buffers, in bytes. Zero disables the pool.
+    size_t max_bytes;
+    // Maximum number of retained buffers of one size class.
+    size_t max_buffers_per_class;
+    // Maximum number of buffers retained for the frees of one client process.
+    size_t max_buffers_per_client;
+    // Retained buffers that are not used within this time are freed.
+    nsecs_t retention_time;
+  };
+
+  // Returns the configuration from the system properties.
+  static Config GetDefaultConfig();
+
+  explicit BufferPool(const Config& config);
+
+  // Allocates |buffer| with the given parameters, taking a retained buffer if
+  // there is one. Returns 0 on success or a negative errno code otherwise.
+  int Allocate(IonBuffer* buffer, uint32_t width, uint32_t height,
+               uint32_t layer_count, uint32_t format, uint64_t usage);
+
+  // Called when |client_pid| frees |buffer|. Retains a fresh buffer of the
+  // same size class if the configuration allows it.
+  void OnBufferFreed(pid_t client_pid, const IonBuffer& buffer);
+
+  // Returns the pool statistics for BufferHubService::DumpState().
+  std::string DumpState() const;
+
+ private:
+  struct SizeClass {
+    uint32_t width;
+    uint32_t height;
+    uint32_t layer_count;
+    uint32_t format;
+    uint64_t usage;
+
+    bool operator==(const SizeClass& other) const {
+      return width == other.width && height == other.height &&
+             layer_count == other.layer_count && format == other.format &&
+             usage == other.usage;
+    }
+  };
+
+  struct Entry {
+    SizeClass size_class;
+    pid_t client_pid;
+    size_t size;
+    nsecs_t retained_time;
+    IonBuffer buffer;
+  };
+
+  // Estimates the memory used by |buffer|.
+  static size_t GetBufferSize(const IonBuffer& buffer);
+
+  // Frees the buffers retained for longer than the retention time.
+  void Expire(nsecs_t now);
+  std::list<Entry>::iterator Free(std::list<Entry>::iterator entry);
+
+  const Config config_;
+
+  // Retained buffers, the oldest first.
+  std::list<Entry> entries_;
+  size_t retained_size_{0};
+
+  size_t hits_{0};
+  size_t misses_{0};
+  size_t retained_{0};
+  size_t expired_{0};
+  size_t evicted_{0};
+  size_t quota_exceeded_{0};
+
+  BufferPool(const BufferPool&) = delete;
+  void operator=(const BufferPool&) = delete;
+};
+
+}  // namespace dvr
+}  // namespace android
+
+#endif  // ANDROID_DVR_BUFFERHUBD_BUFFER_POOL_H_
@@ -12,23 +12,25 @@ namespace android {
 namespace dvr {
 
 DetachedBufferChannel::DetachedBufferChannel(BufferHubService* service,
-                                             int buffer_id, int channel_id,
-                                             IonBuffer buffer,
+                                             pid_t client_pid, int buffer_id,
+                                             int channel_id, IonBuffer buffer,
                                              IonBuffer metadata_buffer,
                                              size_t user_metadata_size)
     : BufferHubChannel(service, buffer_id, channel_id, kDetachedBufferType),
+      client_pid_(client_pid),
       buffer_(std::move(buffer)),
       metadata_buffer_(std::move(metadata_buffer)),
       user_metadata_size_(user_metadata_size) {
 }
 
 DetachedBufferChannel::DetachedBufferChannel(BufferHubService* service,
-                                             int buffer_id, uint32_t width,
-                                             uint32_t height,
+                                             pid_t client_pid, int buffer_id,
+                                             uint32_t width, uint32_t height,
                                              uint32_t layer_count,
                                              uint32_t format, uint64_t usage,
                                              size_t user_metadata_size)
     : BufferHubChannel(service, buffer_id, buffer_id, kDetachedBufferType),
+      client_pid_(client_pid),
       user_metadata_size_(user_metadata_size) {
   // The size the of metadata buffer is used as the "width" parameter during
   // allocation. Thus it cannot overflow uint32_t.
@@ -39,7 +41,9 @@ DetachedBufferChannel::DetachedBufferChannel(BufferHubService* service,
     return;
   }
 
-  if (int ret = buffer_.Alloc(width, height, layer_count, format, usage)) {
+  BufferPool& pool = service->buffer_pool();
+  if (int ret = pool.Allocate(&buffer_, width, height, layer_count, format,
+                              usage)) {
     ALOGE(
         "DetachedBufferChannel::DetachedBufferChannel: Failed to allocate "
         "buffer: %s",
@@ -50,11 +54,11 @@ DetachedBufferChannel::DetachedBufferChannel(BufferHubService* service,
   // Buffer metadata has two parts: 1) a fixed sized metadata header; and 2)
   // user requested metadata.
   const size_t size = BufferHubDefs::kMetadataHeaderSize + user_metadata_size_;
-  if (int ret = metadata_buffer_.Alloc(size,
-                                       /*height=*/1,
-                                       /*layer_count=*/1,
-                                       BufferHubDefs::kMetadataFormat,
-                                       BufferHubDefs::kMetadataUsage)) {
+  if (int ret = pool.Allocate(&metadata_buffer_, size,
+                              /*height=*/1,
+                              /*layer_count=*/1,
+                              BufferHubDefs::kMetadataFormat,
+                              BufferHubDefs::kMetadataUsage)) {
     ALOGE(
         "DetachedBufferChannel::DetachedBufferChannel: Failed to allocate "
         "metadata: %s",
@@ -69,6 +73,10 @@ DetachedBufferChannel::~DetachedBufferChannel() {
            "buffer_id=%d.",
            channel_id(), buffer_id());
   Hangup();
+
+  // The buffers are moved out when the detached buffer is promoted.
+  service()->buffer_pool().OnBufferFreed(client_pid_, buffer_);
+  service()->buffer_pool().OnBufferFreed(client_pid_, metadata_buffer_);
 }
 
 BufferHubChannel::BufferInfo DetachedBufferChannel::GetBufferInfo() const {
@@ -132,8 +140,8 @@ Status<RemoteChannelHandle> DetachedBufferChannel::OnPromote(
   }
 
   std::unique_ptr<ProducerChannel> channel = ProducerChannel::Create(
-      service(), buffer_id(), channel_id, std::move(buffer_),
-      std::move(metadata_buffer_), user_metadata_size_);
+      service(), message.GetProcessId(), buffer_id(), channel_id,
+      std::move(buffer_), std::move(metadata_buffer_), user_metadata_size_);
   if (!channel) {
     ALOGE(
         "DetachedBufferChannel::OnPromote: Failed to create ProducerChannel "
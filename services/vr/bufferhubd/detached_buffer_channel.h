@@ -35,20 +35,23 @@ class DetachedBufferChannel : public BufferHubChannel {
 
  private:
   // Creates a detached buffer from existing IonBuffers.
-  DetachedBufferChannel(BufferHubService* service, int buffer_id,
-                        int channel_id, IonBuffer buffer,
+  DetachedBufferChannel(BufferHubService* service, pid_t client_pid,
+                        int buffer_id, int channel_id, IonBuffer buffer,
                         IonBuffer metadata_buffer, size_t user_metadata_size);
 
   // Allocates a new detached buffer.
-  DetachedBufferChannel(BufferHubService* service, int buffer_id,
-                        uint32_t width, uint32_t height, uint32_t layer_count,
-                        uint32_t format, uint64_t usage,
+  DetachedBufferChannel(BufferHubService* service, pid_t client_pid,
+                        int buffer_id, uint32_t width, uint32_t height,
+                        uint32_t layer_count, uint32_t format, uint64_t usage,
                         size_t user_metadata_size);
 
   pdx::Status<BufferDescription<pdx::BorrowedHandle>> OnImport(
       pdx::Message& message);
   pdx::Status<pdx::RemoteChannelHandle> OnPromote(pdx::Message& message);
 
+  // The process that created or detached the buffer.
+  const pid_t client_pid_;
+
   // Gralloc buffer handles.
   IonBuffer buffer_;
   IonBuffer metadata_buffer_;
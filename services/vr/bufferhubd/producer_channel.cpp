@@ -35,11 +35,12 @@ static inline uint64_t FindNextClearedBit(uint64_t bits) {
 
 }  // namespace
 
-ProducerChannel::ProducerChannel(BufferHubService* service, int buffer_id,
-                                 int channel_id, IonBuffer buffer,
-                                 IonBuffer metadata_buffer,
+ProducerChannel::ProducerChannel(BufferHubService* service, pid_t client_pid,
+                                 int buffer_id, int channel_id,
+                                 IonBuffer buffer, IonBuffer metadata_buffer,
                                  size_t user_metadata_size, int* error)
     : BufferHubChannel(service, buffer_id, channel_id, kProducerType),
+      client_pid_(client_pid),
       buffer_(std::move(buffer)),
       metadata_buffer_(std::move(metadata_buffer)),
       user_metadata_size_(user_metadata_size),
@@ -59,28 +60,31 @@ ProducerChannel::ProducerChannel(BufferHubService* service, int buffer_id,
   *error = InitializeBuffer();
 }
 
-ProducerChannel::ProducerChannel(BufferHubService* service, int channel_id,
-                                 uint32_t width, uint32_t height,
-                                 uint32_t layer_count, uint32_t format,
-                                 uint64_t usage, size_t user_metadata_size,
-                                 int* error)
+ProducerChannel::ProducerChannel(BufferHubService* service, pid_t client_pid,
+                                 int channel_id, uint32_t width,
+                                 uint32_t height, uint32_t layer_count,
+                                 uint32_t format, uint64_t usage,
+                                 size_t user_metadata_size, int* error)
     : BufferHubChannel(service, channel_id, channel_id, kProducerType),
+      client_pid_(client_pid),
       pending_consumers_(0),
       producer_owns_(true),
       user_metadata_size_(user_metadata_size),
       metadata_buf_size_(BufferHubDefs::kMetadataHeaderSize +
                          user_metadata_size) {
-  if (int ret = buffer_.Alloc(width, height, layer_count, format, usage)) {
+  BufferPool& pool = service->buffer_pool();
+  if (int ret = pool.Allocate(&buffer_, width, height, layer_count, format,
+                              usage)) {
     ALOGE("ProducerChannel::ProducerChannel: Failed to allocate buffer: %s",
           strerror(-ret));
     *error = ret;
     return;
   }
 
-  if (int ret = metadata_buffer_.Alloc(metadata_buf_size_, /*height=*/1,
-                                       /*layer_count=*/1,
-                                       BufferHubDefs::kMetadataFormat,
-                                       BufferHubDefs::kMetadataUsage)) {
+  if (int ret = pool.Allocate(&metadata_buffer_, metadata_buf_size_,
+                              /*height=*/1, /*layer_count=*/1,
+                              BufferHubDefs::kMetadataFormat,
+                              BufferHubDefs::kMetadataUsage)) {
     ALOGE("ProducerChannel::ProducerChannel: Failed to allocate metadata: %s",
           strerror(-ret));
     *error = ret;
@@ -138,11 +142,11 @@ int ProducerChannel::InitializeBuffer() {
 }
 
 std::unique_ptr<ProducerChannel> ProducerChannel::Create(
-    BufferHubService* service, int buffer_id, int channel_id, IonBuffer buffer,
-    IonBuffer metadata_buffer, size_t user_metadata_size) {
+    BufferHubService* service, pid_t client_pid, int buffer_id, int channel_id,
+    IonBuffer buffer, IonBuffer metadata_buffer, size_t user_metadata_size) {
   int error = 0;
   std::unique_ptr<ProducerChannel> producer(new ProducerChannel(
-      service, buffer_id, channel_id, std::move(buffer),
+      service, client_pid, buffer_id, channel_id, std::move(buffer),
       std::move(metadata_buffer), user_metadata_size, &error));
 
   if (error < 0)
@@ -152,13 +156,13 @@ std::unique_ptr<ProducerChannel> ProducerChannel::Create(
 }
 
 Status<std::shared_ptr<ProducerChannel>> ProducerChannel::Create(
-    BufferHubService* service, int channel_id, uint32_t width, uint32_t height,
-    uint32_t layer_count, uint32_t format, uint64_t usage,
-    size_t user_metadata_size) {
+    BufferHubService* service, pid_t client_pid, int channel_id,
+    uint32_t width, uint32_t height, uint32_t layer_count, uint32_t format,
+    uint64_t usage, size_t user_metadata_size) {
   int error;
-  std::shared_ptr<ProducerChannel> producer(
-      new ProducerChannel(service, channel_id, width, height, layer_count,
-                          format, usage, user_metadata_size, &error));
+  std::shared_ptr<ProducerChannel> producer(new ProducerChannel(
+      service, client_pid, channel_id, width, height, layer_count, format,
+      usage, user_metadata_size, &error));
   if (error < 0)
     return ErrorStatus(-error);
   else
@@ -174,6 +178,10 @@ ProducerChannel::~ProducerChannel() {
     consumer->OnProducerClosed();
   }
   Hangup();
+
+  // The buffers are moved out when the producer is detached.
+  service()->buffer_pool().OnBufferFreed(client_pid_, buffer_);
+  service()->buffer_pool().OnBufferFreed(client_pid_, metadata_buffer_);
 }
 
 BufferHubChannel::BufferInfo ProducerChannel::GetBufferInfo() const {
@@ -417,8 +425,9 @@ Status<RemoteChannelHandle> ProducerChannel::OnProducerDetach(
 
   std::unique_ptr<DetachedBufferChannel> channel =
       DetachedBufferChannel::Create(
-          service(), buffer_id(), channel_id, std::move(buffer_),
-          std::move(metadata_buffer_), user_metadata_size_);
+          service(), message.GetProcessId(), buffer_id(), channel_id,
+          std::move(buffer_), std::move(metadata_buffer_),
+          user_metadata_size_);
   if (!channel) {
     ALOGE("ProducerChannel::OnProducerDetach: Invalid buffer.");
     return ErrorStatus(EINVAL);
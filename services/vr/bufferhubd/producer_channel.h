@@ -30,16 +30,15 @@ class ProducerChannel : public BufferHubChannel {
   template <typename T>
   using BufferWrapper = pdx::rpc::BufferWrapper<T>;
 
-  static std::unique_ptr<ProducerChannel> Create(BufferHubService* service,
-                                                 int buffer_id, int channel_id,
-                                                 IonBuffer buffer,
-                                                 IonBuffer metadata_buffer,
-                                                 size_t user_metadata_size);
+  static std::unique_ptr<ProducerChannel> Create(
+      BufferHubService* service, pid_t client_pid, int buffer_id,
+      int channel_id, IonBuffer buffer, IonBuffer metadata_buffer,
+      size_t user_metadata_size);
 
   static pdx::Status<std::shared_ptr<ProducerChannel>> Create(
-      BufferHubService* service, int channel_id, uint32_t width,
-      uint32_t height, uint32_t layer_count, uint32_t format, uint64_t usage,
-      size_t user_metadata_size);
+      BufferHubService* service, pid_t client_pid, int channel_id,
+      uint32_t width, uint32_t height, uint32_t layer_count, uint32_t format,
+      uint64_t usage, size_t user_metadata_size);
 
   ~ProducerChannel() override;
 
@@ -68,6 +67,10 @@ class ProducerChannel : public BufferHubChannel {
                        size_t user_metadata_size);
 
  private:
+  // The process that created the buffer, which the buffer pool accounts the
+  // buffer to once it is freed.
+  pid_t client_pid_;
+
   std::vector<ConsumerChannel*> consumer_channels_;
   // This counts the number of consumers left to process this buffer. If this is
   // zero then the producer can re-acquire ownership.
@@ -98,12 +101,13 @@ class ProducerChannel : public BufferHubChannel {
   pdx::LocalHandle release_fence_fd_;
   pdx::LocalHandle dummy_fence_fd_;
 
-  ProducerChannel(BufferHubService* service, int buffer_id, int channel_id,
-                  IonBuffer buffer, IonBuffer metadata_buffer,
+  ProducerChannel(BufferHubService* service, pid_t client_pid, int buffer_id,
+                  int channel_id, IonBuffer buffer, IonBuffer metadata_buffer,
                   size_t user_metadata_size, int* error);
-  ProducerChannel(BufferHubService* service, int channel, uint32_t width,
-                  uint32_t height, uint32_t layer_count, uint32_t format,
-                  uint64_t usage, size_t user_metadata_size, int* error);
+  ProducerChannel(BufferHubService* service, pid_t client_pid, int channel,
+                  uint32_t width, uint32_t height, uint32_t layer_count,
+                  uint32_t format, uint64_t usage, size_t user_metadata_size,
+                  int* error);
 
   int InitializeBuffer();
   pdx::Status<BufferDescription<BorrowedHandle>> OnGetBuffer(Message& message);
@@ -223,8 +223,9 @@ ProducerQueueChannel::AllocateBuffer(Message& message, uint32_t width,
   auto buffer_handle = status.take();
 
   auto producer_channel_status =
-      ProducerChannel::Create(service(), buffer_id, width, height, layer_count,
-                              format, usage, config_.user_metadata_size);
+      ProducerChannel::Create(service(), message.GetProcessId(), buffer_id,
+                              width, height, layer_count, format, usage,
+                              config_.user_metadata_size);
   if (!producer_channel_status) {
     ALOGE(
         "ProducerQueueChannel::AllocateBuffer: Failed to create producer "
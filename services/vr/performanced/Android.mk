@@ -15,6 +15,7 @@
 LOCAL_PATH := $(call my-dir)
 
 sourceFiles := \
+	adaptive_placement.cpp \
 	cpu_set.cpp \
 	main.cpp \
 	performance_service.cpp \
@@ -0,0 +1,254 @@
+#include "adaptive_placement.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include <iomanip>
+#include <sstream>
+
+using android::pdx::ErrorStatus;
+using android::pdx::Status;
+
+namespace {
+
+const char kAdaptivePlacementProperty[] = "persist.dvr.performanced.adaptive";
+const char kBoostCpuSetProperty[] = "persist.dvr.performanced.boost_cpuset";
+
+const char kDefaultBoostCpuSet[] = "/system/performance";
+
+constexpr uint32_t kWindowFrames = 30;
+constexpr uint32_t kPromoteMisses = 2;
+constexpr uint32_t kDemoteWindows = 4;
+
+constexpr uint32_t kUtilClampHalf = 512;
+constexpr uint32_t kUtilClampMax = 1024;
+
+// Utilization clamping was added to sched_setattr() in Linux 5.3; older
+// kernel headers do not have these definitions.
+constexpr uint64_t kSchedFlagKeepAll = 0x08 | 0x10;
+constexpr uint64_t kSchedFlagUtilClampMin = 0x20;
+
+struct SchedAttr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+  uint32_t sched_util_min;
+  uint32_t sched_util_max;
+};
+
+}  // anonymous namespace
+
+namespace android {
+namespace dvr {
+
+AdaptivePlacement::Config AdaptivePlacement::GetDefaultConfig() {
+  char boost_cpuset[PROPERTY_VALUE_MAX];
+  property_get(kBoostCpuSetProperty, boost_cpuset, kDefaultBoostCpuSet);
+
+  Config config;
+  config.enabled = property_get_bool(kAdaptivePlacementProperty, false);
+  // Raising the clamp first lets the cpufreq governor react without moving
+  // the thread; a thread that still misses deadlines moves to the boost
+  // cpuset as well.
+  config.levels = {{"", kUtilClampHalf}, {boost_cpuset, kUtilClampMax}};
+  config.window_frames = kWindowFrames;
+  config.promote_misses = kPromoteMisses;
+  config.demote_windows = kDemoteWindows;
+  return config;
+}
+
+AdaptivePlacement::AdaptivePlacement(CpuSetManager* cpuset,
+                                     const Config& config)
+    : cpuset_(cpuset), config_(config) {}
+
+Status<void> AdaptivePlacement::ReportFrameDeadlines(const Task& task,
+                                                     uint32_t frames,
+                                                     uint32_t missed) {
+  if (missed > frames)
+    return ErrorStatus(EINVAL);
+  if (!config_.enabled)
+    return {};
+
+  // A task id that is new, or that was reused by another process, starts at
+  // level 0 with its current cpuset.
+  const pid_t task_id = task.task_id();
+  auto search = tasks_.find(task_id);
+  if (search == tasks_.end() ||
+      search->second.thread_group_id != task.thread_group_id()) {
+    RemoveExitedTasks();
+    TaskState& state = tasks_[task_id];
+    state = TaskState{};
+    state.thread_group_id = task.thread_group_id();
+    state.base_cpuset = task.GetCpuSetPath();
+    search = tasks_.find(task_id);
+  }
+
+  TaskState& state = search->second;
+  state.window_frames += frames;
+  state.window_misses += missed;
+  state.total_frames += frames;
+  state.total_misses += missed;
+  if (state.window_frames < config_.window_frames)
+    return {};
+
+  if (state.window_misses >= config_.promote_misses) {
+    state.clean_windows = 0;
+    if (state.level < config_.levels.size()) {
+      ApplyLevel(task_id, &state, state.level + 1);
+      state.promotions++;
+    }
+  } else if (state.window_misses == 0) {
+    if (++state.clean_windows >= config_.demote_windows && state.level > 0) {
+      ApplyLevel(task_id, &state, state.level - 1);
+      state.demotions++;
+      state.clean_windows = 0;
+    }
+  } else {
+    state.clean_windows = 0;
+  }
+
+  state.window_frames = 0;
+  state.window_misses = 0;
+  return {};
+}
+
+void AdaptivePlacement::Forget(pid_t task_id) {
+  auto search = tasks_.find(task_id);
+  if (search == tasks_.end())
+    return;
+
+  if (search->second.level > 0 && util_clamp_supported_)
+    SetUtilMin(task_id, 0);
+  tasks_.erase(search);
+}
+
+void AdaptivePlacement::ApplyLevel(pid_t task_id, TaskState* state,
+                                   size_t level) {
+  std::string target_cpuset = state->base_cpuset;
+  uint32_t util_min = 0;
+  if (level > 0) {
+    const Level& config = config_.levels[level - 1];
+    if (!config.cpuset.empty())
+      target_cpuset = config.cpuset;
+    util_min = config.util_min;
+  }
+
+  ALOGI(
+      "AdaptivePlacement::ApplyLevel: task=%d level=%zu->%zu cpuset=%s "
+      "util_min=%u",
+      task_id, state->level, level, target_cpuset.c_str(), util_min);
+  state->level = level;
+
+  auto target_set = cpuset_->Lookup(target_cpuset);
+  if (target_set) {
+    auto attach_status = target_set->AttachTask(task_id);
+    ALOGW_IF(!attach_status,
+             "AdaptivePlacement::ApplyLevel: Failed to attach task=%d to "
+             "cpuset=%s: %s",
+             task_id, target_cpuset.c_str(),
+             attach_status.GetErrorMessage().c_str());
+  } else {
+    ALOGW("AdaptivePlacement::ApplyLevel: Failed to lookup cpuset=%s",
+          target_cpuset.c_str());
+  }
+
+  if (util_clamp_supported_)
+    util_clamp_supported_ = SetUtilMin(task_id, util_min);
+}
+
+bool AdaptivePlacement::SetUtilMin(pid_t task_id, uint32_t util_min) {
+  SchedAttr attr{};
+  attr.size = sizeof(attr);
+  attr.sched_flags = kSchedFlagKeepAll | kSchedFlagUtilClampMin;
+  attr.sched_util_min = util_min;
+  attr.sched_util_max = kUtilClampMax;
+  if (syscall(__NR_sched_setattr, task_id, &attr, 0) == 0)
+    return true;
+
+  // Without utilization clamping only the cpuset levels take effect.
+  if (errno == EINVAL || errno == E2BIG || errno == ENOSYS) {
+    ALOGW(
+        "AdaptivePlacement::SetUtilMin: Utilization clamping is not "
+        "supported: %s",
+        strerror(errno));
+    return false;
+  }
+
+  ALOGW("AdaptivePlacement::SetUtilMin: Failed to set task=%d util_min=%u: %s",
+        task_id, util_min, strerror(errno));
+  return true;
+}
+
+void AdaptivePlacement::RemoveExitedTasks() {
+  for (auto it = tasks_.begin(); it != tasks_.end();) {
+    Task task(it->first);
+    if (!task || task.thread_group_id() != it->second.thread_group_id)
+      it = tasks_.erase(it);
+    else
+      ++it;
+  }
+}
+
+std::string AdaptivePlacement::DumpState() const {
+  std::ostringstream stream;
+  stream << "Adaptive placement: "
+         << (config_.enabled ? "enabled" : "disabled");
+  if (!config_.enabled) {
+    stream << std::endl;
+    return stream.str();
+  }
+  stream << " util_clamp=" << (util_clamp_supported_ ? "yes" : "no")
+         << std::endl;
+
+  stream << std::left;
+  stream << std::setw(7) << "Task";
+  stream << " ";
+  stream << std::setw(7) << "Tgid";
+  stream << " ";
+  stream << std::setw(5) << "Level";
+  stream << " ";
+  stream << std::setw(24) << "Base cpuset";
+  stream << " ";
+  stream << std::setw(10) << "Frames";
+  stream << " ";
+  stream << std::setw(8) << "Misses";
+  stream << " ";
+  stream << std::setw(5) << "Up";
+  stream << " ";
+  stream << std::setw(5) << "Down";
+  stream << std::endl;
+
+  for (const auto& pair : tasks_) {
+    const TaskState& state = pair.second;
+    stream << std::setw(7) << pair.first;
+    stream << " ";
+    stream << std::setw(7) << state.thread_group_id;
+    stream << " ";
+    stream << std::setw(5) << state.level;
+    stream << " ";
+    stream << std::setw(24) << state.base_cpuset;
+    stream << " ";
+    stream << std::setw(10) << state.total_frames;
+    stream << " ";
+    stream << std::setw(8) << state.total_misses;
+    stream << " ";
+    stream << std::setw(5) << state.promotions;
+    stream << " ";
+    stream << std::setw(5) << state.demotions;
+    stream << std::endl;
+  }
+  return stream.str();
+}
+
+}  // namespace dvr
+}  // namespace android
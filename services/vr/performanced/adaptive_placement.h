@@ -0,0 +1,103 @@
+#ifndef ANDROID_DVR_PERFORMANCED_ADAPTIVE_PLACEMENT_H_
+#define ANDROID_DVR_PERFORMANCED_ADAPTIVE_PLACEMENT_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pdx/status.h>
+
+#include "cpu_set.h"
+#include "task.h"
+
+namespace android {
+namespace dvr {
+
+// AdaptivePlacement moves the threads that report frame deadline misses, such
+// as the vrflinger post thread or an app's render thread, up a ladder of boost
+// levels while they miss deadlines, and back down once they keep up again.
+// Every level names a cpuset and a minimum utilization clamp; level 0 is the
+// placement the thread had when it first reported frames.
+//
+// Decisions are made once per window of reported frames. A window with at
+// least |promote_misses| misses moves the thread up one level; the thread
+// moves down one level only after |demote_windows| consecutive windows without
+// a miss, so that a thread that is just keeping up does not oscillate.
+class AdaptivePlacement {
+ public:
+  struct Level {
+    // Cpuset path to attach the thread to. Empty keeps the level 0 cpuset.
+    std::string cpuset;
+    // Minimum utilization clamp, from 0 to 1024.
+    uint32_t util_min;
+  };
+
+  struct Config {
+    bool enabled;
+    // Levels above level 0, in increasing order of boost.
+    std::vector<Level> levels;
+    uint32_t window_frames;
+    uint32_t promote_misses;
+    uint32_t demote_windows;
+  };
+
+  // Returns the configuration from the system properties.
+  static Config GetDefaultConfig();
+
+  AdaptivePlacement(CpuSetManager* cpuset, const Config& config);
+
+  bool enabled() const { return config_.enabled; }
+
+  // Records that |task| finished |frames| frames, |missed| of which missed
+  // their deadline, and updates its placement when a window completes.
+  pdx::Status<void> ReportFrameDeadlines(const Task& task, uint32_t frames,
+                                         uint32_t missed);
+
+  // Stops managing |task_id| and drops its utilization clamp, leaving its
+  // cpuset as it is. Called when a client sets the placement of the task
+  // explicitly.
+  void Forget(pid_t task_id);
+
+  // Returns the current placement decisions for PerformanceService::DumpState.
+  std::string DumpState() const;
+
+ private:
+  struct TaskState {
+    pid_t thread_group_id;
+    std::string base_cpuset;
+    size_t level;
+    uint32_t window_frames;
+    uint32_t window_misses;
+    uint32_t clean_windows;
+    uint64_t total_frames;
+    uint64_t total_misses;
+    uint32_t promotions;
+    uint32_t demotions;
+  };
+
+  // Moves |task_id| to |level|.
+  void ApplyLevel(pid_t task_id, TaskState* state, size_t level);
+
+  // Sets the minimum utilization clamp of |task_id|. Returns false if the
+  // kernel does not support utilization clamping.
+  bool SetUtilMin(pid_t task_id, uint32_t util_min);
+
+  // Removes the state of tasks that have exited.
+  void RemoveExitedTasks();
+
+  CpuSetManager* cpuset_;
+  const Config config_;
+  bool util_clamp_supported_{true};
+  std::unordered_map<pid_t, TaskState> tasks_;
+
+  AdaptivePlacement(const AdaptivePlacement&) = delete;
+  void operator=(const AdaptivePlacement&) = delete;
+};
+
+}  // namespace dvr
+}  // namespace android
+
+#endif  // ANDROID_DVR_PERFORMANCED_ADAPTIVE_PLACEMENT_H_
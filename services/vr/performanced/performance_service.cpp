@@ -23,7 +23,6 @@ using android::pdx::ErrorStatus;
 using android::pdx::Message;
 using android::pdx::Status;
 using android::pdx::default_transport::Endpoint;
-using android::pdx::rpc::DispatchRemoteMethod;
 
 namespace {
 
@@ -103,7 +102,20 @@ namespace dvr {
 
 PerformanceService::PerformanceService()
     : BASE("PerformanceService",
-           Endpoint::Create(PerformanceRPC::kClientPath)) {
+           Endpoint::Create(PerformanceRPC::kClientPath)),
+      adaptive_placement_{&cpuset_, AdaptivePlacement::GetDefaultConfig()},
+      dispatch_table_{
+          PDX_DISPATCH_METHOD(PerformanceRPC::SetSchedulerPolicy,
+                              &PerformanceService::OnSetSchedulerPolicy),
+          PDX_DISPATCH_METHOD(PerformanceRPC::SetCpuPartition,
+                              &PerformanceService::OnSetCpuPartition),
+          PDX_DISPATCH_METHOD(PerformanceRPC::SetSchedulerClass,
+                              &PerformanceService::OnSetSchedulerClass),
+          PDX_DISPATCH_METHOD(PerformanceRPC::GetCpuPartition,
+                              &PerformanceService::OnGetCpuPartition),
+          PDX_DISPATCH_METHOD(PerformanceRPC::ReportFrameDeadlines,
+                              &PerformanceService::OnReportFrameDeadlines),
+      } {
   cpuset_.Load(kCpuSetBasePath);
 
   Task task(getpid());
@@ -218,7 +230,8 @@ bool PerformanceService::IsInitialized() const {
 }
 
 std::string PerformanceService::DumpState(size_t /*max_length*/) {
-  return cpuset_.DumpState();
+  return cpuset_.DumpState() + adaptive_placement_.DumpState() +
+         dispatch_table_.DumpStats();
 }
 
 Status<void> PerformanceService::OnSetSchedulerPolicy(
@@ -289,6 +302,10 @@ Status<void> PerformanceService::OnSetSchedulerPolicy(
 
     sched_setscheduler(task_id, config.scheduler_policy, &param);
     prctl(PR_SET_TIMERSLACK_PID, config.timer_slack, task_id);
+
+    // An explicit policy takes precedence over the adaptive placement, which
+    // starts over from the new placement if the task keeps reporting frames.
+    adaptive_placement_.Forget(task_id);
     return {};
   } else {
     ALOGE(
@@ -320,6 +337,7 @@ Status<void> PerformanceService::OnSetCpuPartition(
   if (!attach_status)
     return attach_status;
 
+  adaptive_placement_.Forget(task_id);
   return {};
 }
 
@@ -365,32 +383,29 @@ Status<std::string> PerformanceService::OnGetCpuPartition(Message& message,
   return task.GetCpuSetPath();
 }
 
+Status<void> PerformanceService::OnReportFrameDeadlines(Message& message,
+                                                       pid_t task_id,
+                                                       uint32_t frames,
+                                                       uint32_t missed) {
+  // Frame deadlines drive the placement of the task, so reports need the same
+  // permissions as OnSetCpuPartition().
+  Task task(task_id);
+  if (!task || task.thread_group_id() != message.GetProcessId())
+    return ErrorStatus(EINVAL);
+
+  if (partition_permission_check_ &&
+      !partition_permission_check_(message, task)) {
+    return ErrorStatus(EINVAL);
+  }
+
+  return adaptive_placement_.ReportFrameDeadlines(task, frames, missed);
+}
+
 Status<void> PerformanceService::HandleMessage(Message& message) {
   ALOGD_IF(TRACE, "PerformanceService::HandleMessage: op=%d", message.GetOp());
-  switch (message.GetOp()) {
-    case PerformanceRPC::SetSchedulerPolicy::Opcode:
-      DispatchRemoteMethod<PerformanceRPC::SetSchedulerPolicy>(
-          *this, &PerformanceService::OnSetSchedulerPolicy, message);
-      return {};
-
-    case PerformanceRPC::SetCpuPartition::Opcode:
-      DispatchRemoteMethod<PerformanceRPC::SetCpuPartition>(
-          *this, &PerformanceService::OnSetCpuPartition, message);
-      return {};
-
-    case PerformanceRPC::SetSchedulerClass::Opcode:
-      DispatchRemoteMethod<PerformanceRPC::SetSchedulerClass>(
-          *this, &PerformanceService::OnSetSchedulerClass, message);
-      return {};
-
-    case PerformanceRPC::GetCpuPartition::Opcode:
-      DispatchRemoteMethod<PerformanceRPC::GetCpuPartition>(
-          *this, &PerformanceService::OnGetCpuPartition, message);
-      return {};
-
-    default:
-      return Service::HandleMessage(message);
-  }
+  if (dispatch_table_.Dispatch(*this, message))
+    return {};
+  return Service::HandleMessage(message);
 }
 
 }  // namespace dvr
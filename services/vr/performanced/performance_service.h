@@ -5,8 +5,10 @@
 #include <string>
 #include <unordered_map>
 
+#include <pdx/rpc/dispatch_table.h>
 #include <pdx/service.h>
 
+#include "adaptive_placement.h"
 #include "cpu_set.h"
 #include "task.h"
 
@@ -38,8 +40,12 @@ class PerformanceService : public pdx::ServiceBase<PerformanceService> {
                                         const std::string& scheduler_class);
   pdx::Status<std::string> OnGetCpuPartition(pdx::Message& message,
                                              pid_t task_id);
+  pdx::Status<void> OnReportFrameDeadlines(pdx::Message& message,
+                                           pid_t task_id, uint32_t frames,
+                                           uint32_t missed);
 
   CpuSetManager cpuset_;
+  AdaptivePlacement adaptive_placement_;
 
   int sched_fifo_min_priority_;
   int sched_fifo_max_priority_;
@@ -70,6 +76,8 @@ class PerformanceService : public pdx::ServiceBase<PerformanceService> {
   std::function<bool(const pdx::Message& message, const Task& task)>
       partition_permission_check_;
 
+  pdx::rpc::DispatchTable<PerformanceService> dispatch_table_;
+
   PerformanceService(const PerformanceService&) = delete;
   void operator=(const PerformanceService&) = delete;
 };
@@ -247,6 +247,29 @@ TEST(PerformanceTest, GetCpuPartition) {
   EXPECT_EQ(-EINVAL, error);
 }
 
+TEST(PerformanceTest, ReportFrameDeadlines) {
+  int error;
+
+  // Reports are accepted whether or not adaptive placement is enabled.
+  error = dvrReportFrameDeadlines(0, 30, 0);
+  EXPECT_EQ(0, error);
+
+  error = dvrReportFrameDeadlines(0, 30, 30);
+  EXPECT_EQ(0, error);
+
+  // Test reporting more misses than frames.
+  error = dvrReportFrameDeadlines(0, 1, 2);
+  EXPECT_EQ(-EINVAL, error);
+
+  // Test reporting frames for a task that doesn't belong to us.
+  error = dvrReportFrameDeadlines(1, 30, 0);
+  EXPECT_EQ(-EINVAL, error);
+
+  // Restore the default placement of this thread.
+  error = dvrSetCpuPartition(0, "/");
+  EXPECT_EQ(0, error);
+}
+
 TEST(PerformanceTest, Permissions) {
   int error;
 
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the overhead libvulkan adds on top of the driver: layer chaining
+// and extension filtering in instance and device creation, swapchain
+// creation, and the cost of calls going through the trampolines. The numbers
+// are only meaningful against a driver that does no work of its own, so run
+// this on a build whose Vulkan HAL is the null driver (vulkan.default); the
+// driver in use is reported in each benchmark's label.
+//
+// Benchmarks that take an argument run without layers (0) and with every
+// instance layer libvulkan can find (1). Layers enabled through
+// debug.vulkan.layers are active in both cases.
+
+#include <benchmark/benchmark.h>
+
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/Surface.h>
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+const char* const kInstanceExtensions[] = {
+    VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_ANDROID_SURFACE_EXTENSION_NAME,
+};
+const char* const kDeviceExtensions[] = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+};
+
+template <typename T, size_t N>
+constexpr uint32_t ArraySize(const T (&)[N]) {
+    return N;
+}
+
+class VulkanContext {
+   public:
+    ~VulkanContext() {
+        if (surface_ != VK_NULL_HANDLE)
+            vkDestroySurfaceKHR(instance_, surface_, nullptr);
+        if (command_pool_ != VK_NULL_HANDLE)
+            vkDestroyCommandPool(device_, command_pool_, nullptr);
+        if (device_ != VK_NULL_HANDLE)
+            vkDestroyDevice(device_, nullptr);
+        if (instance_ != VK_NULL_HANDLE)
+            vkDestroyInstance(instance_, nullptr);
+    }
+
+    // Selects which layers CreateInstance enables. Fails if layers were asked
+    // for and there are none.
+    bool SetUpLayers(benchmark::State& state) {
+        if (state.range(0) == 0)
+            return true;
+
+        uint32_t count = 0;
+        vkEnumerateInstanceLayerProperties(&count, nullptr);
+        layers_.resize(count);
+        vkEnumerateInstanceLayerProperties(&count, layers_.data());
+        layers_.resize(count);
+        if (layers_.empty()) {
+            state.SkipWithError("no Vulkan layers found");
+            return false;
+        }
+        for (const auto& layer : layers_)
+            layer_names_.push_back(layer.layerName);
+        return true;
+    }
+
+    VkResult CreateInstance(VkInstance* instance) const {
+        const VkApplicationInfo app_info = {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = "libvulkan_benchmark",
+            .apiVersion = VK_API_VERSION_1_0,
+        };
+        const VkInstanceCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pApplicationInfo = &app_info,
+            .enabledLayerCount = static_cast<uint32_t>(layer_names_.size()),
+            .ppEnabledLayerNames = layer_names_.data(),
+            .enabledExtensionCount = ArraySize(kInstanceExtensions),
+            .ppEnabledExtensionNames = kInstanceExtensions,
+        };
+        return vkCreateInstance(&create_info, nullptr, instance);
+    }
+
+    VkResult CreateDevice(VkDevice* device) const {
+        const float priority = 1.0f;
+        const VkDeviceQueueCreateInfo queue_info = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = 0,
+            .queueCount = 1,
+            .pQueuePriorities = &priority,
+        };
+        const VkDeviceCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .queueCreateInfoCount = 1,
+            .pQueueCreateInfos = &queue_info,
+            .enabledExtensionCount = ArraySize(kDeviceExtensions),
+            .ppEnabledExtensionNames = kDeviceExtensions,
+        };
+        return vkCreateDevice(gpu_, &create_info, nullptr, device);
+    }
+
+    VkResult CreateSwapchain(VkSwapchainKHR* swapchain) const {
+        const VkSwapchainCreateInfoKHR create_info = {
+            .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+            .surface = surface_,
+            .minImageCount = capabilities_.minImageCount,
+            .imageFormat = VK_FORMAT_R8G8B8A8_UNORM,
+            .imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+            .imageExtent = capabilities_.currentExtent,
+            .imageArrayLayers = 1,
+            .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+            .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+            .compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+            .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+            .clipped = VK_TRUE,
+        };
+        return vkCreateSwapchainKHR(device_, &create_info, nullptr, swapchain);
+    }
+
+    bool SetUpInstance(benchmark::State& state) {
+        if (!SetUpLayers(state) ||
+            !Check(state, CreateInstance(&instance_), "vkCreateInstance"))
+            return false;
+
+        uint32_t count = 1;
+        VkResult result = vkEnumeratePhysicalDevices(instance_, &count, &gpu_);
+        if (result == VK_SUCCESS && count == 0) {
+            state.SkipWithError("no Vulkan physical devices");
+            return false;
+        }
+        if (result != VK_INCOMPLETE &&
+            !Check(state, result, "vkEnumeratePhysicalDevices"))
+            return false;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(gpu_, &properties);
+        state.SetLabel(properties.deviceName);
+        return true;
+    }
+
+    bool SetUpDevice(benchmark::State& state) {
+        if (!SetUpInstance(state) ||
+            !Check(state, CreateDevice(&device_), "vkCreateDevice"))
+            return false;
+
+        const VkCommandPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .queueFamilyIndex = 0,
+        };
+        if (!Check(state, vkCreateCommandPool(device_, &pool_info, nullptr,
+                                              &command_pool_),
+                   "vkCreateCommandPool"))
+            return false;
+
+        const VkCommandBufferAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = command_pool_,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        if (!Check(state, vkAllocateCommandBuffers(device_, &alloc_info,
+                                                   &command_buffer_),
+                   "vkAllocateCommandBuffers"))
+            return false;
+
+        const VkCommandBufferBeginInfo begin_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        };
+        return Check(state, vkBeginCommandBuffer(command_buffer_, &begin_info),
+                     "vkBeginCommandBuffer");
+    }
+
+    // The surface is backed by an in-process BufferQueue, so swapchain
+    // creation does not depend on SurfaceFlinger.
+    bool SetUpSurface(benchmark::State& state) {
+        if (!SetUpDevice(state))
+            return false;
+
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&producer, &consumer);
+        consumer_ = new BufferItemConsumer(consumer, 0);
+        consumer_->setDefaultBufferSize(64, 64);
+        window_ = new Surface(producer);
+
+        const VkAndroidSurfaceCreateInfoKHR surface_info = {
+            .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
+            .window = window_.get(),
+        };
+        if (!Check(state, vkCreateAndroidSurfaceKHR(instance_, &surface_info,
+                                                    nullptr, &surface_),
+                   "vkCreateAndroidSurfaceKHR"))
+            return false;
+        return Check(state,
+                     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu_, surface_,
+                                                               &capabilities_),
+                     "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+    }
+
+    static bool Check(benchmark::State& state,
+                      VkResult result,
+                      const char* proc) {
+        if (result == VK_SUCCESS)
+            return true;
+        state.SkipWithError(proc);
+        return false;
+    }
+
+    VkPhysicalDevice gpu() const { return gpu_; }
+    VkDevice device() const { return device_; }
+    VkCommandBuffer command_buffer() const { return command_buffer_; }
+
+   private:
+    std::vector<VkLayerProperties> layers_;
+    std::vector<const char*> layer_names_;
+    VkInstance instance_ = VK_NULL_HANDLE;
+    VkPhysicalDevice gpu_ = VK_NULL_HANDLE;
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkCommandPool command_pool_ = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+    sp<BufferItemConsumer> consumer_;
+    sp<ANativeWindow> window_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
+    VkSurfaceCapabilitiesKHR capabilities_ = {};
+};
+
+void BM_CreateInstance(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpInstance(state))
+        return;
+    while (state.KeepRunning()) {
+        VkInstance instance;
+        if (!VulkanContext::Check(state, context.CreateInstance(&instance),
+                                  "vkCreateInstance"))
+            break;
+        vkDestroyInstance(instance, nullptr);
+    }
+}
+BENCHMARK(BM_CreateInstance)->Arg(0)->Arg(1);
+
+void BM_CreateDevice(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpInstance(state))
+        return;
+    while (state.KeepRunning()) {
+        VkDevice device;
+        if (!VulkanContext::Check(state, context.CreateDevice(&device),
+                                  "vkCreateDevice"))
+            break;
+        vkDestroyDevice(device, nullptr);
+    }
+}
+BENCHMARK(BM_CreateDevice)->Arg(0)->Arg(1);
+
+void BM_CreateSwapchain(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpSurface(state))
+        return;
+    while (state.KeepRunning()) {
+        VkSwapchainKHR swapchain;
+        if (!VulkanContext::Check(state, context.CreateSwapchain(&swapchain),
+                                  "vkCreateSwapchainKHR"))
+            break;
+        vkDestroySwapchainKHR(context.device(), swapchain, nullptr);
+    }
+}
+BENCHMARK(BM_CreateSwapchain)->Arg(0)->Arg(1)->UseRealTime();
+
+// An instance-level call, dispatched through the physical device.
+void BM_DispatchInstanceCall(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpInstance(state))
+        return;
+    while (state.KeepRunning()) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(
+            context.gpu(), VK_FORMAT_R8G8B8A8_UNORM, &properties);
+        benchmark::DoNotOptimize(properties);
+    }
+}
+BENCHMARK(BM_DispatchInstanceCall)->Arg(0)->Arg(1);
+
+// A device-level call through the exported trampoline.
+void BM_DispatchDeviceCall(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpDevice(state))
+        return;
+    const VkCommandBuffer command_buffer = context.command_buffer();
+    while (state.KeepRunning())
+        vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
+BENCHMARK(BM_DispatchDeviceCall)->Arg(0)->Arg(1);
+
+// The same call through vkGetDeviceProcAddr, which skips the trampoline. The
+// difference from BM_DispatchDeviceCall is the trampoline's cost.
+void BM_DispatchDeviceCallDirect(benchmark::State& state) {
+    VulkanContext context;
+    if (!context.SetUpDevice(state))
+        return;
+    const auto cmd_draw = reinterpret_cast<PFN_vkCmdDraw>(
+        vkGetDeviceProcAddr(context.device(), "vkCmdDraw"));
+    const VkCommandBuffer command_buffer = context.command_buffer();
+    while (state.KeepRunning())
+        cmd_draw(command_buffer, 3, 1, 0, 0);
+}
+BENCHMARK(BM_DispatchDeviceCallDirect)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <thread>
+
 #include "driver.h"
 
 namespace vulkan {
@@ -30,26 +32,47 @@ DebugReportCallbackList::Node* DebugReportCallbackList::AddCallback(
         return nullptr;
 
     // initialize and prepend node to the list
-    std::lock_guard<decltype(rwmutex_)> lock(rwmutex_);
-    head_.next = new (mem) Node{head_.next, info.flags, info.pfnCallback,
-                                info.pUserData, driver_handle};
-
-    return head_.next;
+    std::lock_guard<decltype(mutex_)> lock(mutex_);
+    Node* node = new (mem) Node(head_.next.load(), info.flags,
+                                info.pfnCallback, info.pUserData,
+                                driver_handle);
+    head_.next.store(node);
+    flags_.fetch_or(info.flags);
+
+    return node;
 }
 
 void DebugReportCallbackList::RemoveCallback(
     Node* node,
     const VkAllocationCallbacks& allocator) {
-    // remove node from the list
     {
-        std::lock_guard<decltype(rwmutex_)> lock(rwmutex_);
+        std::lock_guard<decltype(mutex_)> lock(mutex_);
+
+        // remove node from the list
+        VkDebugReportFlagsEXT flags = 0;
         Node* prev = &head_;
-        while (prev && prev->next != node)
-            prev = prev->next;
-        if (prev)
-            prev->next = node->next;
+        Node* next;
+        while ((next = prev->next.load()) && next != node) {
+            flags |= next->flags;
+            prev = next;
+        }
+        if (!next) {
+            ALOGE("DebugReportCallbackList::RemoveCallback: unknown callback");
+            return;
+        }
+        prev->next.store(node->next.load());
+        for (next = node->next.load(); next; next = next->next.load())
+            flags |= next->flags;
+        flags_.store(flags);
+
+        // wait for the messages that might still see the node
+        const uint32_t epoch = epoch_.load();
+        epoch_.store(epoch ^ 1);
+        while (readers_[epoch].load() != 0)
+            std::this_thread::yield();
     }
 
+    node->~Node();
     allocator.pfnFree(allocator.pUserData, node);
 }
 
@@ -60,14 +83,29 @@ void DebugReportCallbackList::Message(VkDebugReportFlagsEXT flags,
                                       int32_t message_code,
                                       const char* layer_prefix,
                                       const char* message) const {
-    std::shared_lock<decltype(rwmutex_)> lock(rwmutex_);
+    if ((flags_.load(std::memory_order_relaxed) & flags) == 0)
+        return;
+
+    // Join the current epoch. If RemoveCallback flipped it before we were
+    // counted, it might not have waited for us, so join the new one instead.
+    uint32_t epoch;
+    while (true) {
+        epoch = epoch_.load();
+        readers_[epoch].fetch_add(1);
+        if (epoch_.load() == epoch)
+            break;
+        readers_[epoch].fetch_sub(1);
+    }
+
     const Node* node = &head_;
-    while ((node = node->next)) {
+    while ((node = node->next.load())) {
         if ((node->flags & flags) != 0) {
             node->callback(flags, object_type, object, location, message_code,
                            layer_prefix, message, node->user_data);
         }
     }
+
+    readers_[epoch].fetch_sub(1);
 }
 
 void DebugReportLogger::Message(VkDebugReportFlagsEXT flags,
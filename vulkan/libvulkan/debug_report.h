@@ -18,7 +18,8 @@
 #define LIBVULKAN_DEBUG_REPORT_H 1
 
 #include <stdarg.h>
-#include <shared_mutex>
+#include <atomic>
+#include <mutex>
 #include <vulkan/vulkan.h>
 
 namespace vulkan {
@@ -30,6 +31,10 @@ VKAPI_ATTR void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReport
 VKAPI_ATTR void DebugReportMessageEXT(VkInstance instance, VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t messageCode, const char* pLayerPrefix, const char* pMessage);
 // clang-format on
 
+// Message walks the list without taking a lock, as validation layers can
+// report at very high rates. Nodes are published with atomic stores, and
+// RemoveCallback waits for the messages that might still see a node before
+// freeing it.
 class DebugReportCallbackList {
    private:
     // forward declaration
@@ -37,7 +42,10 @@ class DebugReportCallbackList {
 
    public:
     DebugReportCallbackList()
-        : head_{nullptr, 0, nullptr, nullptr, VK_NULL_HANDLE} {}
+        : head_(nullptr, 0, nullptr, nullptr, VK_NULL_HANDLE),
+          flags_(0),
+          epoch_(0),
+          readers_{{0}, {0}} {}
     DebugReportCallbackList(const DebugReportCallbackList&) = delete;
     DebugReportCallbackList& operator=(const DebugReportCallbackList&) = delete;
     ~DebugReportCallbackList() = default;
@@ -69,18 +77,38 @@ class DebugReportCallbackList {
 
    private:
     struct Node {
-        Node* next;
-
-        VkDebugReportFlagsEXT flags;
-        PFN_vkDebugReportCallbackEXT callback;
-        void* user_data;
-
-        VkDebugReportCallbackEXT driver_handle;
+        Node(Node* next_node,
+             VkDebugReportFlagsEXT report_flags,
+             PFN_vkDebugReportCallbackEXT report_callback,
+             void* report_user_data,
+             VkDebugReportCallbackEXT report_driver_handle)
+            : next(next_node),
+              flags(report_flags),
+              callback(report_callback),
+              user_data(report_user_data),
+              driver_handle(report_driver_handle) {}
+
+        std::atomic<Node*> next;
+
+        const VkDebugReportFlagsEXT flags;
+        const PFN_vkDebugReportCallbackEXT callback;
+        void* const user_data;
+
+        const VkDebugReportCallbackEXT driver_handle;
     };
 
-    // TODO(jessehall): replace with std::shared_mutex when available in libc++
-    mutable std::shared_timed_mutex rwmutex_;
+    // serializes AddCallback and RemoveCallback
+    std::mutex mutex_;
     Node head_;
+
+    // union of the flags of all callbacks, so that Message can return early
+    std::atomic<VkDebugReportFlagsEXT> flags_;
+
+    // Messages in flight, counted in the epoch they started in. Removing a
+    // callback flips the epoch and waits for the old one to drain, so that
+    // messages starting meanwhile do not hold it up.
+    std::atomic<uint32_t> epoch_;
+    mutable std::atomic<uint32_t> readers_[2];
 };
 
 class DebugReportLogger {
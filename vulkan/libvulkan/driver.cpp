@@ -76,17 +76,32 @@ class Hal {
 
     int GetDebugReportIndex() const { return debug_report_index_; }
 
+    // Enumerates the HAL instance extensions, which are queried once per
+    // process.
+    VkResult EnumerateInstanceExtensions(uint32_t* count,
+                                         VkExtensionProperties* props) const;
+
    private:
-    Hal() : dev_(nullptr), debug_report_index_(-1) {}
+    Hal()
+        : dev_(nullptr),
+          debug_report_index_(-1),
+          instance_extensions_(nullptr),
+          instance_extension_count_(0),
+          instance_extensions_cached_(false) {}
     Hal(const Hal&) = delete;
     Hal& operator=(const Hal&) = delete;
 
-    bool InitDebugReportIndex();
+    bool InitInstanceExtensions();
 
     static Hal hal_;
 
     const hwvulkan_device_t* dev_;
     int debug_report_index_;
+
+    // never freed, as hal_ lives as long as the process
+    const VkExtensionProperties* instance_extensions_;
+    uint32_t instance_extension_count_;
+    bool instance_extensions_cached_;
 };
 
 class CreateInfoWrapper {
@@ -254,12 +269,12 @@ bool Hal::Open() {
 
     hal_.dev_ = device;
 
-    hal_.InitDebugReportIndex();
+    hal_.InitInstanceExtensions();
 
     return true;
 }
 
-bool Hal::InitDebugReportIndex() {
+bool Hal::InitInstanceExtensions() {
     uint32_t count;
     if (dev_->EnumerateInstanceExtensionProperties(nullptr, &count, nullptr) !=
         VK_SUCCESS) {
@@ -267,6 +282,11 @@ bool Hal::InitDebugReportIndex() {
         return false;
     }
 
+    if (!count) {
+        instance_extensions_cached_ = true;
+        return true;
+    }
+
     VkExtensionProperties* exts = reinterpret_cast<VkExtensionProperties*>(
         malloc(sizeof(VkExtensionProperties) * count));
     if (!exts) {
@@ -289,11 +309,30 @@ bool Hal::InitDebugReportIndex() {
         }
     }
 
-    free(exts);
+    instance_extensions_ = exts;
+    instance_extension_count_ = count;
+    instance_extensions_cached_ = true;
 
     return true;
 }
 
+VkResult Hal::EnumerateInstanceExtensions(uint32_t* count,
+                                          VkExtensionProperties* props) const {
+    if (!instance_extensions_cached_)
+        return dev_->EnumerateInstanceExtensionProperties(nullptr, count,
+                                                          props);
+
+    if (!props) {
+        *count = instance_extension_count_;
+        return VK_SUCCESS;
+    }
+
+    const uint32_t copied = std::min(*count, instance_extension_count_);
+    std::copy_n(instance_extensions_, copied, props);
+    *count = copied;
+    return (copied < instance_extension_count_) ? VK_INCOMPLETE : VK_SUCCESS;
+}
+
 CreateInfoWrapper::CreateInfoWrapper(const VkInstanceCreateInfo& create_info,
                                      const VkAllocationCallbacks& allocator)
     : is_instance_(true),
@@ -421,8 +460,7 @@ VkResult CreateInfoWrapper::SanitizeExtensions() {
 
 VkResult CreateInfoWrapper::QueryExtensionCount(uint32_t& count) const {
     if (is_instance_) {
-        return Hal::Device().EnumerateInstanceExtensionProperties(
-            nullptr, &count, nullptr);
+        return Hal::Get().EnumerateInstanceExtensions(&count, nullptr);
     } else {
         const auto& driver = GetData(physical_dev_).driver;
         return driver.EnumerateDeviceExtensionProperties(physical_dev_, nullptr,
@@ -434,8 +472,7 @@ VkResult CreateInfoWrapper::EnumerateExtensions(
     uint32_t& count,
     VkExtensionProperties* props) const {
     if (is_instance_) {
-        return Hal::Device().EnumerateInstanceExtensionProperties(
-            nullptr, &count, props);
+        return Hal::Get().EnumerateInstanceExtensions(&count, props);
     } else {
         const auto& driver = GetData(physical_dev_).driver;
         return driver.EnumerateDeviceExtensionProperties(physical_dev_, nullptr,
@@ -821,8 +858,11 @@ VkResult EnumerateInstanceExtensionProperties(
         }
     }
 
-    VkResult result = Hal::Device().EnumerateInstanceExtensionProperties(
-        pLayerName, pPropertyCount, pProperties);
+    VkResult result =
+        (pLayerName) ? Hal::Device().EnumerateInstanceExtensionProperties(
+                           pLayerName, pPropertyCount, pProperties)
+                     : Hal::Get().EnumerateInstanceExtensions(pPropertyCount,
+                                                              pProperties);
 
     if (!pLayerName && (result == VK_SUCCESS || result == VK_INCOMPLETE)) {
         int idx = Hal::Get().GetDebugReportIndex();
@@ -906,10 +946,14 @@ VkResult EnumerateDeviceExtensionProperties(
     }
 
     // conditionally add VK_GOOGLE_display_timing if present timestamps are
-    // supported by the driver:
-    const std::string timestamp_property("service.sf.present_timestamp");
-    android::base::WaitForPropertyCreation(timestamp_property);
-    if (android::base::GetBoolProperty(timestamp_property, true)) {
+    // supported by the driver. SurfaceFlinger sets the property once at
+    // startup, so it is only read once.
+    static const bool present_timestamps = [] {
+        const std::string timestamp_property("service.sf.present_timestamp");
+        android::base::WaitForPropertyCreation(timestamp_property);
+        return android::base::GetBoolProperty(timestamp_property, true);
+    }();
+    if (present_timestamps) {
         loader_extensions.push_back({
                 VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
                 VK_GOOGLE_DISPLAY_TIMING_SPEC_VERSION});
@@ -19,6 +19,7 @@
 #include <string.h>
 
 #include <algorithm>
+#include <array>
 
 #include <log/log.h>
 
@@ -431,6 +432,37 @@ const ProcHook g_proc_hooks[] = {
     // clang-format on
 };
 
+struct KnownExtension {
+    const char* name;
+    ProcHook::Extension extension;
+};
+
+const KnownExtension g_known_extensions[] = {
+    // clang-format off
+    {"VK_ANDROID_native_buffer", ProcHook::ANDROID_native_buffer},
+    {"VK_EXT_debug_report", ProcHook::EXT_debug_report},
+    {"VK_EXT_hdr_metadata", ProcHook::EXT_hdr_metadata},
+    {"VK_EXT_swapchain_colorspace", ProcHook::EXT_swapchain_colorspace},
+    {"VK_GOOGLE_display_timing", ProcHook::GOOGLE_display_timing},
+    {"VK_KHR_android_surface", ProcHook::KHR_android_surface},
+    {"VK_KHR_incremental_present", ProcHook::KHR_incremental_present},
+    {"VK_KHR_shared_presentable_image", ProcHook::KHR_shared_presentable_image},
+    {"VK_KHR_surface", ProcHook::KHR_surface},
+    {"VK_KHR_swapchain", ProcHook::KHR_swapchain},
+    {"VK_KHR_get_surface_capabilities2", ProcHook::KHR_get_surface_capabilities2},
+    {"VK_KHR_get_physical_device_properties2", ProcHook::KHR_get_physical_device_properties2},
+    {"VK_ANDROID_external_memory_android_hardware_buffer", ProcHook::ANDROID_external_memory_android_hardware_buffer},
+    // clang-format on
+};
+
+// FNV-1a
+uint32_t HashExtensionName(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+        hash = (hash ^ static_cast<uint8_t>(*name)) * 16777619u;
+    return hash;
+}
+
 }  // namespace
 
 const ProcHook* GetProcHook(const char* name) {
@@ -444,21 +476,22 @@ const ProcHook* GetProcHook(const char* name) {
 }
 
 ProcHook::Extension GetProcHookExtension(const char* name) {
-    // clang-format off
-    if (strcmp(name, "VK_ANDROID_native_buffer") == 0) return ProcHook::ANDROID_native_buffer;
-    if (strcmp(name, "VK_EXT_debug_report") == 0) return ProcHook::EXT_debug_report;
-    if (strcmp(name, "VK_EXT_hdr_metadata") == 0) return ProcHook::EXT_hdr_metadata;
-    if (strcmp(name, "VK_EXT_swapchain_colorspace") == 0) return ProcHook::EXT_swapchain_colorspace;
-    if (strcmp(name, "VK_GOOGLE_display_timing") == 0) return ProcHook::GOOGLE_display_timing;
-    if (strcmp(name, "VK_KHR_android_surface") == 0) return ProcHook::KHR_android_surface;
-    if (strcmp(name, "VK_KHR_incremental_present") == 0) return ProcHook::KHR_incremental_present;
-    if (strcmp(name, "VK_KHR_shared_presentable_image") == 0) return ProcHook::KHR_shared_presentable_image;
-    if (strcmp(name, "VK_KHR_surface") == 0) return ProcHook::KHR_surface;
-    if (strcmp(name, "VK_KHR_swapchain") == 0) return ProcHook::KHR_swapchain;
-    if (strcmp(name, "VK_KHR_get_surface_capabilities2") == 0) return ProcHook::KHR_get_surface_capabilities2;
-    if (strcmp(name, "VK_KHR_get_physical_device_properties2") == 0) return ProcHook::KHR_get_physical_device_properties2;
-    if (strcmp(name, "VK_ANDROID_external_memory_android_hardware_buffer") == 0) return ProcHook::ANDROID_external_memory_android_hardware_buffer;
-    // clang-format on
+    constexpr size_t count =
+        sizeof(g_known_extensions) / sizeof(g_known_extensions[0]);
+    static const std::array<uint32_t, count> hashes = [] {
+        std::array<uint32_t, count> h;
+        for (size_t i = 0; i < count; i++)
+            h[i] = HashExtensionName(g_known_extensions[i].name);
+        return h;
+    }();
+
+    // Compare the names only when the hashes match.
+    const uint32_t hash = HashExtensionName(name);
+    for (size_t i = 0; i < count; i++) {
+        if (hashes[i] == hash &&
+            strcmp(g_known_extensions[i].name, name) == 0)
+            return g_known_extensions[i].extension;
+    }
     return ProcHook::EXTENSION_UNKNOWN;
 }
 
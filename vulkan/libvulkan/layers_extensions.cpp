@@ -21,12 +21,17 @@
 #include <dlfcn.h>
 #include <string.h>
 #include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
 #include <android/dlext.h>
+#include <android-base/file.h>
 #include <android-base/strings.h>
 #include <cutils/properties.h>
 #include <graphicsenv/GraphicsEnv.h>
@@ -66,6 +71,9 @@ namespace {
 
 const char kSystemLayerLibraryDir[] = "/data/local/debug/vulkan";
 
+const uint32_t kLayerCacheMagic = 0x434c4b56;  // "VKLC"
+const uint32_t kLayerCacheVersion = 1;
+
 class LayerLibrary {
    public:
     explicit LayerLibrary(const std::string& path,
@@ -311,14 +319,244 @@ void* LayerLibrary::GetGPA(const Layer& layer,
 
 // ----------------------------------------------------------------------------
 
+// Identifies a version of a layer library. Libraries in an APK are identified
+// by the APK, which is replaced whenever any of them changes.
+struct LibraryStamp {
+    int64_t mtime_ns;
+    int64_t size;
+};
+
+bool GetLibraryStamp(const std::string& library_path, LibraryStamp& stamp) {
+    size_t zip_pos = library_path.find("!/");
+    std::string file_path = (zip_pos == std::string::npos)
+                                ? library_path
+                                : library_path.substr(0, zip_pos);
+    struct stat st;
+    if (stat(file_path.c_str(), &st) != 0)
+        return false;
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                     st.st_mtim.tv_nsec;
+    stamp.size = static_cast<int64_t>(st.st_size);
+    return true;
+}
+
+// Caches the layers each library in the search paths provides, so that
+// discovering them doesn't mean loading every library. The cache is only
+// valid for the search paths it was written for, and a library's layers only
+// while its stamp is unchanged.
+class LayerCache {
+   public:
+    LayerCache(const std::string& filename, const std::string& search_paths)
+        : filename_(filename), search_paths_(search_paths), dirty_(false) {}
+
+    LayerCache(const LayerCache&) = delete;
+    LayerCache& operator=(const LayerCache&) = delete;
+
+    void Load();
+    void Save();
+
+    // Appends the cached layers of a library to instance_layers, returning
+    // false if they aren't cached.
+    bool Find(const std::string& library_path,
+              const LibraryStamp& stamp,
+              size_t library_idx,
+              std::vector<Layer>& instance_layers);
+    void Add(const std::string& library_path,
+             const LibraryStamp& stamp,
+             std::vector<Layer>::const_iterator first,
+             std::vector<Layer>::const_iterator last);
+
+   private:
+    struct Entry {
+        std::string library_path;
+        LibraryStamp stamp;
+        std::vector<Layer> layers;
+    };
+
+    const std::string filename_;
+    const std::string search_paths_;
+    std::vector<Entry> loaded_;
+    // The entries of the libraries found this time, which replace the
+    // loaded ones when saved.
+    std::vector<Entry> found_;
+    bool dirty_;
+};
+
+template <typename T>
+void WriteValue(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadValue(const std::string& in, size_t& pos, T& value) {
+    if (in.size() - pos < sizeof(value))
+        return false;
+    memcpy(&value, in.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+void WriteString(std::string& out, const std::string& value) {
+    WriteValue(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+bool ReadString(const std::string& in, size_t& pos, std::string& value) {
+    uint32_t size;
+    if (!ReadValue(in, pos, size) || in.size() - pos < size)
+        return false;
+    value.assign(in, pos, size);
+    pos += size;
+    return true;
+}
+
+void WriteExtensions(std::string& out,
+                     const std::vector<VkExtensionProperties>& extensions) {
+    WriteValue(out, static_cast<uint32_t>(extensions.size()));
+    for (const auto& extension : extensions)
+        WriteValue(out, extension);
+}
+
+bool ReadExtensions(const std::string& in,
+                    size_t& pos,
+                    std::vector<VkExtensionProperties>& extensions) {
+    uint32_t count;
+    if (!ReadValue(in, pos, count) ||
+        (in.size() - pos) / sizeof(VkExtensionProperties) < count)
+        return false;
+    extensions.resize(count);
+    for (auto& extension : extensions)
+        ReadValue(in, pos, extension);
+    return true;
+}
+
+void LayerCache::Load() {
+    std::string contents;
+    if (!android::base::ReadFileToString(filename_, &contents))
+        return;
+
+    size_t pos = 0;
+    uint32_t magic, version, num_entries;
+    std::string search_paths;
+    if (!ReadValue(contents, pos, magic) || magic != kLayerCacheMagic ||
+        !ReadValue(contents, pos, version) || version != kLayerCacheVersion ||
+        !ReadString(contents, pos, search_paths) ||
+        search_paths != search_paths_ ||
+        !ReadValue(contents, pos, num_entries)) {
+        ALOGV("ignoring layer cache '%s' for other search paths",
+              filename_.c_str());
+        return;
+    }
+
+    std::vector<Entry> entries(num_entries);
+    for (auto& entry : entries) {
+        uint32_t num_layers;
+        if (!ReadString(contents, pos, entry.library_path) ||
+            !ReadValue(contents, pos, entry.stamp) ||
+            !ReadValue(contents, pos, num_layers) ||
+            num_layers > contents.size() - pos) {
+            ALOGW("layer cache '%s' is corrupt", filename_.c_str());
+            return;
+        }
+        entry.layers.resize(num_layers);
+        for (auto& layer : entry.layers) {
+            uint8_t is_global;
+            if (!ReadValue(contents, pos, layer.properties) ||
+                !ReadValue(contents, pos, is_global) ||
+                !ReadExtensions(contents, pos, layer.instance_extensions) ||
+                !ReadExtensions(contents, pos, layer.device_extensions)) {
+                ALOGW("layer cache '%s' is corrupt", filename_.c_str());
+                return;
+            }
+            layer.is_global = is_global != 0;
+        }
+    }
+    loaded_ = std::move(entries);
+}
+
+void LayerCache::Save() {
+    if (!dirty_ && found_.size() == loaded_.size())
+        return;
+
+    std::string contents;
+    WriteValue(contents, kLayerCacheMagic);
+    WriteValue(contents, kLayerCacheVersion);
+    WriteString(contents, search_paths_);
+    WriteValue(contents, static_cast<uint32_t>(found_.size()));
+    for (const auto& entry : found_) {
+        WriteString(contents, entry.library_path);
+        WriteValue(contents, entry.stamp);
+        WriteValue(contents, static_cast<uint32_t>(entry.layers.size()));
+        for (const auto& layer : entry.layers) {
+            WriteValue(contents, layer.properties);
+            WriteValue(contents, static_cast<uint8_t>(layer.is_global));
+            WriteExtensions(contents, layer.instance_extensions);
+            WriteExtensions(contents, layer.device_extensions);
+        }
+    }
+
+    // Write a new file and rename it over the old one, so that a process
+    // reading the cache at the same time never sees a partial file.
+    std::string tmp_filename = filename_ + ".tmp";
+    if (!android::base::WriteStringToFile(contents, tmp_filename) ||
+        rename(tmp_filename.c_str(), filename_.c_str()) != 0) {
+        ALOGW("failed to write layer cache '%s': %s", filename_.c_str(),
+              strerror(errno));
+        unlink(tmp_filename.c_str());
+    }
+}
+
+bool LayerCache::Find(const std::string& library_path,
+                      const LibraryStamp& stamp,
+                      size_t library_idx,
+                      std::vector<Layer>& instance_layers) {
+    auto it = std::find_if(loaded_.cbegin(), loaded_.cend(),
+                           [&](const Entry& entry) {
+                               return entry.library_path == library_path;
+                           });
+    if (it == loaded_.cend() || it->stamp.mtime_ns != stamp.mtime_ns ||
+        it->stamp.size != stamp.size)
+        return false;
+
+    for (Layer layer : it->layers) {
+        layer.library_idx = library_idx;
+        instance_layers.push_back(layer);
+        ALOGD("added %s layer '%s' from library '%s' (cached)",
+              (layer.is_global) ? "global" : "instance",
+              layer.properties.layerName, library_path.c_str());
+    }
+    found_.push_back(*it);
+    return true;
+}
+
+void LayerCache::Add(const std::string& library_path,
+                     const LibraryStamp& stamp,
+                     std::vector<Layer>::const_iterator first,
+                     std::vector<Layer>::const_iterator last) {
+    found_.push_back(Entry{library_path, stamp, {first, last}});
+    dirty_ = true;
+}
+
 std::vector<LayerLibrary> g_layer_libraries;
 std::vector<Layer> g_instance_layers;
 
-void AddLayerLibrary(const std::string& path, const std::string& filename) {
-    LayerLibrary library(path + "/" + filename, filename);
+void AddLayerLibrary(const std::string& path,
+                     const std::string& filename,
+                     LayerCache* cache) {
+    std::string library_path = path + "/" + filename;
+    LibraryStamp stamp;
+    bool has_stamp = cache && GetLibraryStamp(library_path, stamp);
+    if (has_stamp && cache->Find(library_path, stamp, g_layer_libraries.size(),
+                                 g_instance_layers)) {
+        g_layer_libraries.emplace_back(library_path, filename);
+        return;
+    }
+
+    LayerLibrary library(library_path, filename);
     if (!library.Open())
         return;
 
+    size_t first_layer = g_instance_layers.size();
     if (!library.EnumerateLayers(g_layer_libraries.size(), g_instance_layers)) {
         library.Close();
         return;
@@ -326,6 +564,11 @@ void AddLayerLibrary(const std::string& path, const std::string& filename) {
 
     library.Close();
 
+    if (has_stamp) {
+        cache->Add(library_path, stamp,
+                   g_instance_layers.cbegin() + first_layer,
+                   g_instance_layers.cend());
+    }
     g_layer_libraries.emplace_back(std::move(library));
 }
 
@@ -401,7 +644,7 @@ void ForEachFileInPath(const std::string& path, Functor functor) {
     }
 }
 
-void DiscoverLayersInPathList(const std::string& pathstr) {
+void DiscoverLayersInPathList(const std::string& pathstr, LayerCache* cache) {
     std::vector<std::string> paths = android::base::Split(pathstr, ":");
     for (const auto& path : paths) {
         ForEachFileInPath(path, [&](const std::string& filename) {
@@ -425,7 +668,7 @@ void DiscoverLayersInPathList(const std::string& pathstr) {
                 }
 
                 if (!duplicate)
-                    AddLayerLibrary(path, filename);
+                    AddLayerLibrary(path, filename, cache);
             }
         });
     }
@@ -451,12 +694,30 @@ void* GetLayerGetProcAddr(const Layer& layer,
 }  // anonymous namespace
 
 void DiscoverLayers() {
+    std::vector<std::string> path_lists;
     if (property_get_bool("ro.debuggable", false) &&
         prctl(PR_GET_DUMPABLE, 0, 0, 0, 0)) {
-        DiscoverLayersInPathList(kSystemLayerLibraryDir);
+        path_lists.push_back(kSystemLayerLibraryDir);
+    }
+    std::string layer_paths =
+        android::GraphicsEnv::getInstance().getLayerPaths();
+    if (!layer_paths.empty())
+        path_lists.push_back(layer_paths);
+
+    std::unique_ptr<LayerCache> cache;
+    std::string cache_filename =
+        android::GraphicsEnv::getInstance().getLayerCacheFilename();
+    if (!cache_filename.empty() && !path_lists.empty()) {
+        cache.reset(new LayerCache(cache_filename,
+                                   android::base::Join(path_lists, ':')));
+        cache->Load();
     }
-    if (!android::GraphicsEnv::getInstance().getLayerPaths().empty())
-        DiscoverLayersInPathList(android::GraphicsEnv::getInstance().getLayerPaths());
+
+    for (const auto& path_list : path_lists)
+        DiscoverLayersInPathList(path_list, cache.get());
+
+    if (cache)
+        cache->Save();
 }
 
 uint32_t GetLayerCount() {
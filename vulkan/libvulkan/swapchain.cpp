@@ -15,12 +15,17 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <utility>
 
+#include <cutils/properties.h>
 #include <grallocusage/GrallocUsageConversion.h>
 #include <log/log.h>
 #include <ui/BufferQueueDefs.h>
 #include <sync/sync.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 #include <system/window.h>
 #include <android/hardware/graphics/common/1.0/types.h>
@@ -198,6 +203,27 @@ Surface* SurfaceFromHandle(VkSurfaceKHR handle) {
 
 // Maximum number of TimingInfo structs to keep per swapchain:
 enum { MAX_TIMING_INFOS = 10 };
+
+// The most refresh cycles the frame pacer will hold each frame on screen.
+enum { MAX_PACED_REFRESH_CYCLES = 4 };
+
+// Built-in frame pacing for FIFO swapchains whose application doesn't supply
+// its own VkPresentTimeGOOGLE times. Each frame gets a present time a whole
+// number of refresh cycles after the previous one, so that frames stay on
+// screen for equal lengths of time, and the application is held back rather
+// than allowed to queue frames further ahead than the next one.
+struct FramePacer {
+    FramePacer()
+        : enabled(false),
+          last_present_call(0),
+          average_frame_duration(0),
+          last_desired_present(0) {}
+
+    bool enabled;
+    nsecs_t last_present_call;
+    nsecs_t average_frame_duration;
+    nsecs_t last_desired_present;
+};
 // Minimum number of frames to look for in the past (so we don't cause
 // syncronous requests to Surface Flinger):
 enum { MIN_NUM_FRAMES_AGO = 5 };
@@ -205,21 +231,34 @@ enum { MIN_NUM_FRAMES_AGO = 5 };
 struct Swapchain {
     Swapchain(Surface& surface_,
               uint32_t num_images_,
-              VkPresentModeKHR present_mode)
+              const VkSwapchainCreateInfoKHR& create_info_)
         : surface(surface_),
           num_images(num_images_),
-          mailbox_mode(present_mode == VK_PRESENT_MODE_MAILBOX_KHR),
+          create_info(create_info_),
+          mailbox_mode(create_info_.presentMode ==
+                       VK_PRESENT_MODE_MAILBOX_KHR),
           frame_timestamps_enabled(false),
-          shared(present_mode == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
-                 present_mode == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR) {
+          shared(create_info_.presentMode ==
+                     VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR ||
+                 create_info_.presentMode ==
+                     VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR) {
+        // Only the parameters are kept; the pointers aren't valid past
+        // vkCreateSwapchainKHR.
+        create_info.pNext = nullptr;
+        create_info.queueFamilyIndexCount = 0;
+        create_info.pQueueFamilyIndices = nullptr;
+        create_info.oldSwapchain = VK_NULL_HANDLE;
         ANativeWindow* window = surface.window.get();
         native_window_get_refresh_cycle_duration(
             window,
             &refresh_duration);
+        pacer.enabled = create_info.presentMode == VK_PRESENT_MODE_FIFO_KHR &&
+                        property_get_bool("debug.vulkan.frame_pacing", false);
     }
 
     Surface& surface;
     uint32_t num_images;
+    VkSwapchainCreateInfoKHR create_info;
     bool mailbox_mode;
     bool frame_timestamps_enabled;
     int64_t refresh_duration;
@@ -238,6 +277,7 @@ struct Swapchain {
     } images[android::BufferQueueDefs::NUM_BUFFER_SLOTS];
 
     android::Vector<TimingInfo> timing;
+    FramePacer pacer;
 };
 
 VkSwapchainKHR HandleFromSwapchain(Swapchain* swapchain) {
@@ -308,6 +348,54 @@ void OrphanSwapchain(VkDevice device, Swapchain* swapchain) {
     swapchain->timing.clear();
 }
 
+// Returns whether a new swapchain for the same surface can take over the
+// images of an old one, instead of making the native window allocate new
+// buffers and creating new VkImages for them. The buffers are only
+// compatible if they'd be allocated the same way, and the queue has to keep
+// the same number of them. Images the application has acquired from the old
+// swapchain stay with it.
+bool CanReuseSwapchainImages(const Swapchain& old_swapchain,
+                             const VkSwapchainCreateInfoKHR& create_info) {
+    const VkSwapchainCreateInfoKHR& old_info = old_swapchain.create_info;
+    if (old_swapchain.surface.swapchain_handle !=
+            HandleFromSwapchain(&old_swapchain) ||
+        old_swapchain.shared ||
+        old_info.presentMode != create_info.presentMode ||
+        old_info.minImageCount != create_info.minImageCount ||
+        old_info.imageFormat != create_info.imageFormat ||
+        old_info.imageColorSpace != create_info.imageColorSpace ||
+        old_info.imageExtent.width != create_info.imageExtent.width ||
+        old_info.imageExtent.height != create_info.imageExtent.height ||
+        old_info.imageArrayLayers != create_info.imageArrayLayers ||
+        old_info.imageUsage != create_info.imageUsage ||
+        old_info.flags != create_info.flags ||
+        old_info.imageSharingMode != VK_SHARING_MODE_EXCLUSIVE ||
+        create_info.imageSharingMode != VK_SHARING_MODE_EXCLUSIVE) {
+        return false;
+    }
+    for (uint32_t i = 0; i < old_swapchain.num_images; i++) {
+        if (old_swapchain.images[i].dequeued)
+            return false;
+    }
+    return true;
+}
+
+// Images taken over from an old swapchain until the new one is created.
+// Whatever hasn't been handed to the new swapchain is released when this goes
+// out of scope, so that early returns from vkCreateSwapchainKHR don't leak.
+struct ReusedSwapchainImages {
+    explicit ReusedSwapchainImages(VkDevice device_)
+        : device(device_), num_images(0) {}
+    ~ReusedSwapchainImages() {
+        for (uint32_t i = 0; i < num_images; i++)
+            ReleaseSwapchainImage(device, nullptr, -1, images[i]);
+    }
+
+    VkDevice device;
+    uint32_t num_images;
+    Swapchain::Image images[android::BufferQueueDefs::NUM_BUFFER_SLOTS];
+};
+
 uint32_t get_num_ready_timings(Swapchain& swapchain) {
     if (swapchain.timing.size() < MIN_NUM_FRAMES_AGO) {
         return 0;
@@ -403,6 +491,63 @@ void copy_ready_timings(Swapchain& swapchain,
     *count = num_copied;
 }
 
+// Returns the time the next frame of a paced swapchain should be presented
+// at, or 0 if the window doesn't report compositor timing. The timing comes
+// from the display's vsync model, so present times land on refresh cycles.
+nsecs_t PaceNextFrame(Swapchain& swapchain, ANativeWindow* window) {
+    FramePacer& pacer = swapchain.pacer;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (pacer.last_present_call != 0) {
+        nsecs_t duration = now - pacer.last_present_call;
+        pacer.average_frame_duration =
+            pacer.average_frame_duration == 0
+                ? duration
+                : (pacer.average_frame_duration * 7 + duration) / 8;
+    }
+    pacer.last_present_call = now;
+
+    nsecs_t composite_deadline = 0;
+    nsecs_t composite_interval = 0;
+    nsecs_t composite_to_present_latency = 0;
+    if (native_window_get_compositor_timing(window, &composite_deadline,
+                                            &composite_interval,
+                                            &composite_to_present_latency) !=
+            android::NO_ERROR ||
+        composite_interval <= 0) {
+        return 0;
+    }
+
+    // Hold each frame for the fewest refresh cycles the application keeps
+    // up with. The slack keeps an application rendering at about the
+    // refresh rate from flipping between one and two cycles.
+    nsecs_t slack = composite_interval / 8;
+    nsecs_t refresh_cycles =
+        (pacer.average_frame_duration - slack + composite_interval - 1) /
+        composite_interval;
+    refresh_cycles = std::max<nsecs_t>(
+        1, std::min<nsecs_t>(refresh_cycles, MAX_PACED_REFRESH_CYCLES));
+    nsecs_t frame_interval = refresh_cycles * composite_interval;
+
+    nsecs_t earliest_present =
+        composite_deadline + composite_to_present_latency;
+    nsecs_t desired_present = earliest_present;
+    if (pacer.last_desired_present != 0) {
+        desired_present = std::max(
+            desired_present, pacer.last_desired_present + frame_interval);
+    }
+    pacer.last_desired_present = desired_present;
+
+    // Rather than let the application stuff the queue, wait until this
+    // frame is the next one due.
+    nsecs_t release_time =
+        desired_present - frame_interval - composite_to_present_latency;
+    if (release_time > now) {
+        std::this_thread::sleep_for(
+            std::chrono::nanoseconds(release_time - now));
+    }
+    return desired_present;
+}
+
 android_pixel_format GetNativePixelFormat(VkFormat format) {
     android_pixel_format native_format = HAL_PIXEL_FORMAT_RGBA_8888;
     switch (format) {
@@ -976,8 +1121,24 @@ VkResult CreateSwapchainKHR(VkDevice device,
               reinterpret_cast<uint64_t>(create_info->oldSwapchain));
         return VK_ERROR_NATIVE_WINDOW_IN_USE_KHR;
     }
-    if (create_info->oldSwapchain != VK_NULL_HANDLE)
-        OrphanSwapchain(device, SwapchainFromHandle(create_info->oldSwapchain));
+    // When the old swapchain's buffers suit the new one, e.g. when it's only
+    // recreated to change preTransform, keep them and their VkImages rather
+    // than waiting for new ones to be allocated.
+    ReusedSwapchainImages reused_images(device);
+    if (create_info->oldSwapchain != VK_NULL_HANDLE) {
+        Swapchain* old_swapchain =
+            SwapchainFromHandle(create_info->oldSwapchain);
+        if (CanReuseSwapchainImages(*old_swapchain, *create_info)) {
+            reused_images.num_images = old_swapchain->num_images;
+            for (uint32_t i = 0; i < old_swapchain->num_images; i++) {
+                std::swap(reused_images.images[i], old_swapchain->images[i]);
+            }
+            ALOGV("vkCreateSwapchainKHR: reusing %u images of 0x%" PRIx64,
+                  reused_images.num_images,
+                  reinterpret_cast<uint64_t>(create_info->oldSwapchain));
+        }
+        OrphanSwapchain(device, old_swapchain);
+    }
 
     // -- Reset the native window --
     // The native window might have been used previously, and had its properties
@@ -989,21 +1150,24 @@ VkResult CreateSwapchainKHR(VkDevice device,
     // been queued, since after that point at least one is assumed to be in
     // non-FREE state at any given time. Disconnecting and re-connecting
     // orphans the previous buffers, getting us back to the state where we can
-    // dequeue all buffers.
-    err = native_window_api_disconnect(surface.window.get(),
-                                       NATIVE_WINDOW_API_EGL);
-    ALOGW_IF(err != 0, "native_window_api_disconnect failed: %s (%d)",
-             strerror(-err), err);
-    err =
-        native_window_api_connect(surface.window.get(), NATIVE_WINDOW_API_EGL);
-    ALOGW_IF(err != 0, "native_window_api_connect failed: %s (%d)",
-             strerror(-err), err);
-
-    err = native_window_set_buffer_count(surface.window.get(), 0);
-    if (err != 0) {
-        ALOGE("native_window_set_buffer_count(0) failed: %s (%d)",
-              strerror(-err), err);
-        return VK_ERROR_SURFACE_LOST_KHR;
+    // dequeue all buffers. Reused buffers have to stay attached to the queue,
+    // and the settings that were reset for them are the same as before.
+    if (reused_images.num_images == 0) {
+        err = native_window_api_disconnect(surface.window.get(),
+                                           NATIVE_WINDOW_API_EGL);
+        ALOGW_IF(err != 0, "native_window_api_disconnect failed: %s (%d)",
+                 strerror(-err), err);
+        err = native_window_api_connect(surface.window.get(),
+                                        NATIVE_WINDOW_API_EGL);
+        ALOGW_IF(err != 0, "native_window_api_connect failed: %s (%d)",
+                 strerror(-err), err);
+
+        err = native_window_set_buffer_count(surface.window.get(), 0);
+        if (err != 0) {
+            ALOGE("native_window_set_buffer_count(0) failed: %s (%d)",
+                  strerror(-err), err);
+            return VK_ERROR_SURFACE_LOST_KHR;
+        }
     }
 
     int swap_interval =
@@ -1129,6 +1293,12 @@ VkResult CreateSwapchainKHR(VkDevice device,
     uint32_t min_undequeued_buffers = static_cast<uint32_t>(query_value);
     uint32_t num_images =
         (create_info->minImageCount - 1) + min_undequeued_buffers;
+    if (reused_images.num_images != 0 &&
+        reused_images.num_images != num_images) {
+        ALOGE("reused swapchain has %u images, but %u are needed",
+              reused_images.num_images, num_images);
+        return VK_ERROR_SURFACE_LOST_KHR;
+    }
 
     // Lower layer insists that we have at least two buffers. This is wasteful
     // and we'd like to relax it in the shared case, but not all the pieces are
@@ -1189,7 +1359,17 @@ VkResult CreateSwapchainKHR(VkDevice device,
     if (!mem)
         return VK_ERROR_OUT_OF_HOST_MEMORY;
     Swapchain* swapchain =
-        new (mem) Swapchain(surface, num_images, create_info->presentMode);
+        new (mem) Swapchain(surface, num_images, *create_info);
+
+    if (reused_images.num_images != 0) {
+        for (uint32_t i = 0; i < num_images; i++) {
+            std::swap(swapchain->images[i], reused_images.images[i]);
+        }
+        reused_images.num_images = 0;
+        surface.swapchain_handle = HandleFromSwapchain(swapchain);
+        *swapchain_handle = surface.swapchain_handle;
+        return VK_SUCCESS;
+    }
 
     // -- Dequeue all buffers and create a VkImage for each --
     // Any failures during or after this must cancel the dequeued buffers.
@@ -1605,6 +1785,16 @@ VkResult QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* present_info) {
                             static_cast<int64_t>(time->desiredPresentTime));
                     }
                 }
+                if (swapchain.pacer.enabled &&
+                    !(time && time->desiredPresentTime)) {
+                    nsecs_t desired_present = PaceNextFrame(swapchain, window);
+                    ALOGV("Pacing frame to present at %" PRId64,
+                          desired_present);
+                    native_window_set_buffers_timestamp(
+                        window, desired_present != 0
+                                    ? desired_present
+                                    : NATIVE_WINDOW_TIMESTAMP_AUTO);
+                }
 
                 err = window->queueBuffer(window, img.buffer.get(), fence);
                 // queueBuffer always closes fence, even on error